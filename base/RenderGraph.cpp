@@ -0,0 +1,527 @@
+/*
+ * Lightweight frame graph
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "RenderGraph.h"
+#include "VulkanContext.h"
+#include "TraceRecorder.h"
+#include "MemoryStats.h"
+#include <algorithm>
+#include <cassert>
+
+static constexpr VkAccessFlags2 writeAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+static bool lifetimesOverlap(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB)
+{
+	return (firstA <= lastB) && (firstB <= lastA);
+}
+
+RenderGraph::~RenderGraph()
+{
+	// Destroys everything right away, the device is idle at this point
+	onResourcesRetired = nullptr;
+	destroyTransientResources();
+}
+
+bool RenderGraph::isWrite(VkAccessFlags2 accessMask)
+{
+	return (accessMask & writeAccessMask) != 0;
+}
+
+RenderGraphResource RenderGraph::addImage(const RenderGraphImageCreateInfo& createInfo)
+{
+	Resource resource{
+		.name = createInfo.name,
+		.isImage = true,
+		.imported = false,
+		.discard = true,
+		.imageInfo = createInfo,
+		.aspectMask = createInfo.aspectMask
+	};
+	resources.push_back(resource);
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::importImage(const std::string& name, VkImageAspectFlags aspectMask, bool discard, VkPipelineStageFlags2 initialStageMask)
+{
+	Resource resource{
+		.name = name,
+		.isImage = true,
+		.imported = true,
+		.discard = discard,
+		.aspectMask = aspectMask,
+		.initialStageMask = initialStageMask
+	};
+	resources.push_back(resource);
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::importBuffer(const std::string& name)
+{
+	Resource resource{
+		.name = name,
+		.isImage = false,
+		.imported = true
+	};
+	resources.push_back(resource);
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+void RenderGraph::setImage(RenderGraphResource resource, VkImage image)
+{
+	Resource& r = resources[resource];
+	assert(r.isImage && r.imported);
+	if (r.image == image) {
+		return;
+	}
+	r.image = image;
+	r.state = { .writeStageMask = r.initialStageMask };
+}
+
+void RenderGraph::setBuffer(RenderGraphResource resource, VkBuffer buffer)
+{
+	Resource& r = resources[resource];
+	assert(!r.isImage && r.imported);
+	if (r.buffer == buffer) {
+		return;
+	}
+	r.buffer = buffer;
+	// Host writes are made visible by the queue submission, so a new buffer starts without pending accesses
+	r.state = {};
+}
+
+void RenderGraph::setFinalAccess(RenderGraphResource resource, VkPipelineStageFlags2 stageMask, VkAccessFlags2 accessMask, VkImageLayout layout)
+{
+	Resource& r = resources[resource];
+	r.hasFinalAccess = true;
+	r.finalAccess = { .resource = resource, .stageMask = stageMask, .accessMask = accessMask, .layout = layout };
+}
+
+void RenderGraph::addPass(const RenderGraphPassCreateInfo& createInfo)
+{
+#ifndef NDEBUG
+	// Two accesses to the same resource in one pass would end up as conflicting barriers in the same batch
+	for (size_t i = 0; i < createInfo.accesses.size(); i++) {
+		for (size_t j = i + 1; j < createInfo.accesses.size(); j++) {
+			assert(createInfo.accesses[i].resource != createInfo.accesses[j].resource);
+		}
+	}
+#endif
+	passes.push_back({ .info = createInfo });
+}
+
+void RenderGraph::destroyTransientResources()
+{
+	std::vector<VkImageView> views;
+	std::vector<VkImage> images;
+	for (Resource& resource : resources) {
+		if (resource.imported) {
+			continue;
+		}
+		if (resource.view != VK_NULL_HANDLE) {
+			views.push_back(resource.view);
+		}
+		if (resource.image != VK_NULL_HANDLE) {
+			images.push_back(resource.image);
+		}
+		resource.view = VK_NULL_HANDLE;
+		resource.image = VK_NULL_HANDLE;
+		resource.aliases.clear();
+	}
+	auto deleter = [device = VulkanContext::device->logicalDevice, views, images, memories = std::move(memories)] {
+		for (VkImageView view : views) {
+			vkDestroyImageView(device, view, nullptr);
+		}
+		for (VkImage image : images) {
+			vkDestroyImage(device, image, nullptr);
+		}
+		for (VkDeviceMemory memory : memories) {
+			vkFreeMemory(device, memory, nullptr);
+		}
+	};
+	if (onResourcesRetired) {
+		onResourcesRetired(std::move(deleter));
+	} else {
+		deleter();
+	}
+	memories.clear();
+	// Accounted as freed once retired, even though frames in flight may keep the memory alive for a little longer
+	memoryStats.addDevice(MemoryCategory::RenderTargets, -static_cast<int64_t>(transientMemorySize));
+	transientMemorySize = 0;
+}
+
+void RenderGraph::cullPasses()
+{
+	// Walks the passes back to front, starting from the exported resources
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t i = 0; i < resources.size(); i++) {
+		needed[i] = resources[i].hasFinalAccess;
+	}
+	for (size_t i = passes.size(); i-- > 0;) {
+		Pass& pass = passes[i];
+		bool keep = pass.info.sideEffects;
+		for (const RenderGraphAccess& access : pass.info.accesses) {
+			keep = keep || (isWrite(access.accessMask) && needed[access.resource]);
+		}
+		pass.culled = !keep;
+		if (!keep) {
+			continue;
+		}
+		for (const RenderGraphAccess& access : pass.info.accesses) {
+			if ((access.accessMask & ~writeAccessMask) != 0) {
+				needed[access.resource] = true;
+			}
+		}
+	}
+
+	for (Resource& resource : resources) {
+		resource.firstPass = UINT32_MAX;
+		resource.lastPass = 0;
+	}
+	for (uint32_t i = 0; i < static_cast<uint32_t>(passes.size()); i++) {
+		if (passes[i].culled) {
+			continue;
+		}
+		for (const RenderGraphAccess& access : passes[i].info.accesses) {
+			Resource& resource = resources[access.resource];
+			resource.firstPass = std::min(resource.firstPass, i);
+			resource.lastPass = std::max(resource.lastPass, i);
+		}
+	}
+	// Images not used by any pass (e.g. if the application doesn't use the graph for rendering) are treated as alive for the whole frame
+	for (Resource& resource : resources) {
+		if (resource.firstPass == UINT32_MAX) {
+			resource.firstPass = 0;
+			resource.lastPass = UINT32_MAX;
+		}
+	}
+}
+
+void RenderGraph::allocateTransientImages(uint32_t width, uint32_t height)
+{
+	Device* device = VulkanContext::device;
+
+	struct MemoryGroup {
+		uint32_t memoryTypeBits{ ~0u };
+		VkDeviceSize size{ 0 };
+		std::vector<RenderGraphResource> resources;
+	};
+	std::vector<MemoryGroup> groups;
+	std::vector<std::pair<RenderGraphResource, VkMemoryRequirements>> candidates;
+
+	for (RenderGraphResource i = 0; i < static_cast<RenderGraphResource>(resources.size()); i++) {
+		Resource& resource = resources[i];
+		if (resource.imported) {
+			continue;
+		}
+		const RenderGraphImageCreateInfo& info = resource.imageInfo;
+		VkImageCreateInfo imageCI{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = info.format,
+			.extent = { std::max(static_cast<uint32_t>(width * info.scale), 1u), std::max(static_cast<uint32_t>(height * info.scale), 1u), 1 },
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = info.samples,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = info.usage,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+		};
+		VK_CHECK_RESULT(vkCreateImage(*device, &imageCI, nullptr, &resource.image));
+		resource.state = {};
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(*device, resource.image, &memReqs);
+		resource.memorySize = memReqs.size;
+
+		// Transient attachments are backed lazily on tile based renderers, so there's nothing to gain from aliasing them
+		if (info.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+			VkBool32 lazyMemTypePresent;
+			const uint32_t memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemTypePresent);
+			if (lazyMemTypePresent) {
+				VkMemoryAllocateInfo memAllocInfo{ .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, .allocationSize = memReqs.size, .memoryTypeIndex = memoryTypeIndex };
+				VkDeviceMemory memory;
+				VK_CHECK_RESULT(vkAllocateMemory(*device, &memAllocInfo, nullptr, &memory));
+				VK_CHECK_RESULT(vkBindImageMemory(*device, resource.image, memory, 0));
+				memories.push_back(memory);
+				resource.memoryIndex = static_cast<uint32_t>(memories.size() - 1);
+				resource.aliases = { i };
+				transientMemorySize += memReqs.size;
+				memoryStats.addDevice(MemoryCategory::RenderTargets, static_cast<int64_t>(memReqs.size));
+				continue;
+			}
+		}
+		candidates.push_back({ i, memReqs });
+	}
+
+	// Largest images are placed first, each at the lowest offset that doesn't collide with an image whose lifetime overlaps
+	std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.second.size > b.second.size; });
+	for (const auto& [index, memReqs] : candidates) {
+		Resource& resource = resources[index];
+		MemoryGroup* target = nullptr;
+		for (MemoryGroup& group : groups) {
+			VkBool32 found;
+			device->getMemoryType(group.memoryTypeBits & memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &found);
+			if (found) {
+				target = &group;
+				break;
+			}
+		}
+		if (!target) {
+			groups.push_back({});
+			target = &groups.back();
+		}
+		target->memoryTypeBits &= memReqs.memoryTypeBits;
+
+		VkDeviceSize offset = 0;
+		bool collision = true;
+		while (collision) {
+			collision = false;
+			for (const RenderGraphResource placedIndex : target->resources) {
+				const Resource& placed = resources[placedIndex];
+				const bool memoryOverlaps = (offset < placed.memoryOffset + placed.memorySize) && (placed.memoryOffset < offset + memReqs.size);
+				if (memoryOverlaps && lifetimesOverlap(resource.firstPass, resource.lastPass, placed.firstPass, placed.lastPass)) {
+					offset = (placed.memoryOffset + placed.memorySize + memReqs.alignment - 1) / memReqs.alignment * memReqs.alignment;
+					collision = true;
+				}
+			}
+		}
+		resource.memoryOffset = offset;
+		target->size = std::max(target->size, offset + memReqs.size);
+		target->resources.push_back(index);
+	}
+
+	for (MemoryGroup& group : groups) {
+		VkMemoryAllocateInfo memAllocInfo{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = group.size,
+			.memoryTypeIndex = device->getMemoryType(group.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+		};
+		VkDeviceMemory memory;
+		VK_CHECK_RESULT(vkAllocateMemory(*device, &memAllocInfo, nullptr, &memory));
+		memories.push_back(memory);
+		transientMemorySize += group.size;
+		memoryStats.addDevice(MemoryCategory::RenderTargets, static_cast<int64_t>(group.size));
+		for (const RenderGraphResource index : group.resources) {
+			Resource& resource = resources[index];
+			resource.memoryIndex = static_cast<uint32_t>(memories.size() - 1);
+			VK_CHECK_RESULT(vkBindImageMemory(*device, resource.image, memory, resource.memoryOffset));
+			for (const RenderGraphResource otherIndex : group.resources) {
+				const Resource& other = resources[otherIndex];
+				if ((resource.memoryOffset < other.memoryOffset + other.memorySize) && (other.memoryOffset < resource.memoryOffset + resource.memorySize)) {
+					resource.aliases.push_back(otherIndex);
+				}
+			}
+		}
+	}
+
+	for (Resource& resource : resources) {
+		if (resource.imported) {
+			continue;
+		}
+		VkImageViewCreateInfo imageViewCI{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = resource.image,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = resource.imageInfo.format,
+			.subresourceRange = { .aspectMask = resource.aspectMask, .baseMipLevel = 0, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1 }
+		};
+		VK_CHECK_RESULT(vkCreateImageView(*device, &imageViewCI, nullptr, &resource.view));
+	}
+}
+
+void RenderGraph::compile(uint32_t width, uint32_t height)
+{
+	destroyTransientResources();
+	cullPasses();
+	allocateTransientImages(width, height);
+	usedThisFrame.assign(resources.size(), false);
+}
+
+void RenderGraph::addBarrier(CommandBuffer* cb, Resource& resource, const RenderGraphAccess& access, bool firstAccess)
+{
+	ResourceState& state = resource.state;
+	const bool write = isWrite(access.accessMask);
+	const VkImageLayout oldLayout = (firstAccess && resource.discard) ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+	const bool layoutChange = resource.isImage && ((oldLayout != access.layout) || (firstAccess && resource.discard));
+
+	VkPipelineStageFlags2 srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	VkAccessFlags2 srcAccessMask = VK_ACCESS_2_NONE;
+	bool barrier = false;
+	if (write || layoutChange) {
+		// Write after write and write after read hazards, layout transitions count as writes
+		srcStageMask = state.writeStageMask | state.readStageMask;
+		srcAccessMask = state.writeAccessMask;
+		if (firstAccess) {
+			srcStageMask |= resource.initialStageMask;
+			// The previous users of aliased memory have to be done with it
+			for (const RenderGraphResource alias : resource.aliases) {
+				const ResourceState& aliasState = resources[alias].state;
+				srcStageMask |= aliasState.writeStageMask | aliasState.readStageMask;
+				srcAccessMask |= aliasState.writeAccessMask;
+			}
+		}
+		barrier = layoutChange || (srcStageMask != VK_PIPELINE_STAGE_2_NONE);
+	} else if (state.writeStageMask != VK_PIPELINE_STAGE_2_NONE) {
+		// Read after write, only needed if the write hasn't been made visible to this access yet
+		if ((access.stageMask & ~state.visibleStageMask) || (access.accessMask & ~state.visibleAccessMask)) {
+			srcStageMask = state.writeStageMask;
+			srcAccessMask = state.writeAccessMask;
+			barrier = true;
+		}
+	}
+
+	if (barrier) {
+		if (resource.isImage) {
+			cb->addImageBarrier(resource.image, srcStageMask, srcAccessMask, access.stageMask, access.accessMask, oldLayout, access.layout, { resource.aspectMask, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS });
+		} else {
+			cb->addBufferBarrier(resource.buffer, srcStageMask, srcAccessMask, access.stageMask, access.accessMask);
+		}
+	}
+
+	if (write || layoutChange) {
+		state.writeStageMask = access.stageMask;
+		state.writeAccessMask = access.accessMask & writeAccessMask;
+		state.readStageMask = write ? VK_PIPELINE_STAGE_2_NONE : access.stageMask;
+		state.visibleStageMask = access.stageMask;
+		state.visibleAccessMask = access.accessMask;
+	} else {
+		state.readStageMask |= access.stageMask;
+		if (barrier) {
+			state.visibleStageMask |= access.stageMask;
+			state.visibleAccessMask |= access.accessMask;
+		}
+	}
+	if (resource.isImage) {
+		state.layout = access.layout;
+	}
+}
+
+// Returns true if the resource has pending accesses from the other queue, the semaphore wait for these takes the place of the barrier
+bool RenderGraph::changeQueue(Resource& resource, const RenderGraphAccess& access, bool compute)
+{
+	ResourceState& state = resource.state;
+	const bool pending = (state.writeStageMask | state.readStageMask) != VK_PIPELINE_STAGE_2_NONE;
+	const bool changed = (state.compute != compute) && pending;
+	if (changed) {
+		// Layout transitions still need a barrier, which is chained to the semaphore wait by its stages
+		state = { .readStageMask = access.stageMask, .layout = state.layout };
+	}
+	state.compute = compute;
+	return changed;
+}
+
+RenderGraphQueueSync RenderGraph::execute(CommandBuffer* cb, CommandBuffer* computeCb)
+{
+	TraceZoneScopedN("Render graph");
+	RenderGraphQueueSync sync{};
+	std::fill(usedThisFrame.begin(), usedThisFrame.end(), false);
+	for (Pass& pass : passes) {
+		if (pass.culled || (pass.info.enabled && !pass.info.enabled())) {
+			continue;
+		}
+		// The compute command buffer is submitted first, so passes depending on graphics work of this frame stay on the graphics queue
+		bool compute = computeCb && pass.info.asyncCompute;
+		for (const RenderGraphAccess& access : pass.info.accesses) {
+			compute = compute && !(usedThisFrame[access.resource] && !resources[access.resource].state.compute);
+		}
+		CommandBuffer* passCb = compute ? computeCb : cb;
+		for (const RenderGraphAccess& access : pass.info.accesses) {
+			Resource& resource = resources[access.resource];
+			assert(!compute || resource.imported);
+			if (changeQueue(resource, access, compute)) {
+				if (compute) {
+					sync.computeWaitsForGraphics = true;
+				} else {
+					sync.graphicsWaitStageMask |= access.stageMask;
+				}
+			}
+			addBarrier(passCb, resource, access, !usedThisFrame[access.resource]);
+			usedThisFrame[access.resource] = true;
+		}
+		sync.computeRecorded = sync.computeRecorded || compute;
+		// The pass's barriers are part of its GPU time
+		passCb->beginScope(pass.info.name.c_str());
+		passCb->flushBarriers();
+		pass.info.execute(passCb);
+		passCb->endScope();
+	}
+	for (RenderGraphResource i = 0; i < static_cast<RenderGraphResource>(resources.size()); i++) {
+		Resource& resource = resources[i];
+		if (resource.hasFinalAccess) {
+			if (changeQueue(resource, resource.finalAccess, false)) {
+				sync.graphicsWaitStageMask |= resource.finalAccess.stageMask;
+			}
+			addBarrier(cb, resource, resource.finalAccess, !usedThisFrame[i]);
+		}
+	}
+	cb->flushBarriers();
+	if (computeCb) {
+		computeCb->flushBarriers();
+	}
+	return sync;
+}
+
+VkImage RenderGraph::getImage(RenderGraphResource resource) const
+{
+	return resources[resource].image;
+}
+
+VkImageView RenderGraph::getImageView(RenderGraphResource resource) const
+{
+	return resources[resource].view;
+}
+
+uint32_t RenderGraph::getCulledPassCount() const
+{
+	return static_cast<uint32_t>(std::count_if(passes.begin(), passes.end(), [](const Pass& pass) { return pass.culled; }));
+}
+
+VkDeviceSize RenderGraph::getTransientMemorySize() const
+{
+	return transientMemorySize;
+}
+
+RenderGraphAccess RenderGraph::colorAttachment(RenderGraphResource resource)
+{
+	return { resource, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+}
+
+RenderGraphAccess RenderGraph::resolveAttachment(RenderGraphResource resource, VkImageLayout layout)
+{
+	return { resource, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, layout };
+}
+
+RenderGraphAccess RenderGraph::depthAttachment(RenderGraphResource resource, VkImageLayout layout)
+{
+	return { resource, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, layout };
+}
+
+RenderGraphAccess RenderGraph::sampledRead(RenderGraphResource resource, VkPipelineStageFlags2 stageMask, VkImageLayout layout)
+{
+	return { resource, stageMask, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, layout };
+}
+
+RenderGraphAccess RenderGraph::storageRead(RenderGraphResource resource, VkPipelineStageFlags2 stageMask, VkImageLayout layout)
+{
+	return { resource, stageMask, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, layout };
+}
+
+RenderGraphAccess RenderGraph::storageWrite(RenderGraphResource resource, VkPipelineStageFlags2 stageMask, VkImageLayout layout)
+{
+	return { resource, stageMask, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, layout };
+}
+
+RenderGraphAccess RenderGraph::storageReadWrite(RenderGraphResource resource, VkPipelineStageFlags2 stageMask, VkImageLayout layout)
+{
+	return { resource, stageMask, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, layout };
+}
+
+RenderGraphAccess RenderGraph::indirectRead(RenderGraphResource resource)
+{
+	return { resource, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT };
+}
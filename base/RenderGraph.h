@@ -0,0 +1,186 @@
+/*
+ * Lightweight frame graph
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include "volk.h"
+#include "VulkanTools.h"
+#include "CommandBuffer.hpp"
+
+// Index of an image or buffer declared with the render graph
+using RenderGraphResource = uint32_t;
+
+/** @brief How a pass accesses a resource, barriers between passes are derived from these */
+struct RenderGraphAccess {
+	RenderGraphResource resource;
+	VkPipelineStageFlags2 stageMask;
+	VkAccessFlags2 accessMask;
+	// Ignored for buffers
+	VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+};
+
+struct RenderGraphImageCreateInfo {
+	std::string name;
+	VkFormat format;
+	VkImageUsageFlags usage;
+	VkImageAspectFlags aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT };
+	VkSampleCountFlagBits samples{ VK_SAMPLE_COUNT_1_BIT };
+	// Size relative to the extent passed to compile
+	float scale{ 1.0f };
+};
+
+struct RenderGraphPassCreateInfo {
+	std::string name;
+	std::vector<RenderGraphAccess> accesses;
+	// Records the pass' commands, barriers for all declared accesses have been issued at that point
+	std::function<void(CommandBuffer* cb)> execute;
+	// Optional, evaluated each frame, disabled passes are skipped without recompiling the graph
+	std::function<bool()> enabled;
+	// Passes with side effects outside of the graph (e.g. host readbacks) are never culled
+	bool sideEffects{ false };
+	// Recorded into the compute command buffer passed to execute, unless it depends on a graphics pass of the same frame
+	// All resources accessed by the pass need to be imported and shared between the graphics and compute queue families (concurrent sharing)
+	bool asyncCompute{ false };
+};
+
+/** @brief What the submissions of a frame's graphics and compute command buffers need to wait for, returned by RenderGraph::execute */
+struct RenderGraphQueueSync {
+	// Passes have been recorded into the compute command buffer, it needs to be submitted ahead of the graphics command buffer
+	bool computeRecorded{ false };
+	// Stages of the graphics command buffer that access results of compute work (of this or earlier frames)
+	VkPipelineStageFlags2 graphicsWaitStageMask{ VK_PIPELINE_STAGE_2_NONE };
+	// The compute command buffer accesses resources last used by graphics work of earlier frames
+	bool computeWaitsForGraphics{ false };
+};
+
+/**
+ * Frame graph for a graphics and an optional async compute command buffer
+ * Passes declare the resources they read and write, the graph then
+ * - culls passes that don't contribute to an exported resource (one with a final state, e.g. the swap chain image)
+ * - places transient images with non-overlapping pass lifetimes in the same memory
+ * - issues the minimal set of barriers between passes, batched into one vkCmdPipelineBarrier2 per pass
+ * Transient image contents don't survive the frame, imported resources are owned by the application and only tracked
+ * Resource states are kept across frames, so the first barrier of a frame also covers the last accesses of the previous one
+ * Dependencies between the queues are returned by execute and need to be resolved with semaphores, which also make the accesses of the other queue visible
+ */
+class RenderGraph {
+private:
+	struct ResourceState {
+		VkPipelineStageFlags2 writeStageMask{ VK_PIPELINE_STAGE_2_NONE };
+		VkAccessFlags2 writeAccessMask{ VK_ACCESS_2_NONE };
+		// Stages that read the resource since the last write
+		VkPipelineStageFlags2 readStageMask{ VK_PIPELINE_STAGE_2_NONE };
+		// Stages and accesses the last write has been made visible to
+		VkPipelineStageFlags2 visibleStageMask{ VK_PIPELINE_STAGE_2_NONE };
+		VkAccessFlags2 visibleAccessMask{ VK_ACCESS_2_NONE };
+		VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		// Last accessed by a pass on the compute queue
+		bool compute{ false };
+	};
+
+	struct Resource {
+		std::string name;
+		bool isImage{ true };
+		bool imported{ false };
+		// Contents from previous frames aren't needed, the first access of each frame starts from an undefined layout
+		bool discard{ false };
+		RenderGraphImageCreateInfo imageInfo{};
+		VkImageAspectFlags aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT };
+		VkImage image{ VK_NULL_HANDLE };
+		VkImageView view{ VK_NULL_HANDLE };
+		VkBuffer buffer{ VK_NULL_HANDLE };
+		// Stage that has to be waited for before the first access after a new handle has been set (e.g. the swap chain acquire wait stage)
+		VkPipelineStageFlags2 initialStageMask{ VK_PIPELINE_STAGE_2_NONE };
+		bool hasFinalAccess{ false };
+		RenderGraphAccess finalAccess{};
+		ResourceState state{};
+		// First and last index of the (not culled) passes using the resource
+		uint32_t firstPass{ UINT32_MAX };
+		uint32_t lastPass{ 0 };
+		// Transient memory placement
+		uint32_t memoryIndex{ UINT32_MAX };
+		VkDeviceSize memoryOffset{ 0 };
+		VkDeviceSize memorySize{ 0 };
+		// Transient images sharing memory with this one, including itself
+		std::vector<RenderGraphResource> aliases;
+	};
+
+	struct Pass {
+		RenderGraphPassCreateInfo info;
+		bool culled{ false };
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<VkDeviceMemory> memories;
+	VkDeviceSize transientMemorySize{ 0 };
+	std::vector<bool> usedThisFrame;
+
+	static bool isWrite(VkAccessFlags2 accessMask);
+	void destroyTransientResources();
+	void cullPasses();
+	void allocateTransientImages(uint32_t width, uint32_t height);
+	void addBarrier(CommandBuffer* cb, Resource& resource, const RenderGraphAccess& access, bool firstAccess);
+	bool changeQueue(Resource& resource, const RenderGraphAccess& access, bool compute);
+public:
+	// Called with a deleter for the images and memory replaced by compile, so they can be destroyed once frames in flight are done with them
+	// If not set, these are destroyed right away
+	std::function<void(std::function<void()>)> onResourcesRetired;
+
+	~RenderGraph();
+
+	/** @brief Declares an image that's created and owned by the graph, only valid after compile */
+	RenderGraphResource addImage(const RenderGraphImageCreateInfo& createInfo);
+	/**
+	* @brief Declares an image owned by the application, the handle is set with setImage
+	*
+	* @param name Name of the resource
+	* @param aspectMask Aspects covered by the barriers
+	* @param discard If true, contents from previous frames are discarded
+	* @param initialStageMask Stage waited for before the first access after a new image has been set
+	*/
+	RenderGraphResource importImage(const std::string& name, VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, bool discard = false, VkPipelineStageFlags2 initialStageMask = VK_PIPELINE_STAGE_2_NONE);
+	/** @brief Declares a buffer owned by the application, the handle is set with setBuffer */
+	RenderGraphResource importBuffer(const std::string& name);
+	// Setting a different handle resets the tracked state, so per-frame resources can be swapped each frame
+	void setImage(RenderGraphResource resource, VkImage image);
+	void setBuffer(RenderGraphResource resource, VkBuffer buffer);
+	/** @brief Marks a resource as output of the graph, it's transitioned to the given access after the last pass (e.g. for presentation) */
+	void setFinalAccess(RenderGraphResource resource, VkPipelineStageFlags2 stageMask, VkAccessFlags2 accessMask, VkImageLayout layout);
+	void addPass(const RenderGraphPassCreateInfo& createInfo);
+	/** @brief Culls passes and (re)creates all transient images, the device must be idle if the graph has been compiled before and onResourcesRetired isn't set */
+	void compile(uint32_t width, uint32_t height);
+	/**
+	* @brief Records all enabled passes
+	*
+	* @param cb Graphics command buffer, also used for async compute passes that depend on graphics passes of the frame
+	* @param computeCb Optional command buffer for a compute queue, if not set all passes are recorded into cb
+	*
+	* @return Semaphore waits required between the submissions of both command buffers
+	*/
+	RenderGraphQueueSync execute(CommandBuffer* cb, CommandBuffer* computeCb = nullptr);
+
+	VkImage getImage(RenderGraphResource resource) const;
+	VkImageView getImageView(RenderGraphResource resource) const;
+	uint32_t getCulledPassCount() const;
+	// Size of the memory backing the aliased transient images
+	VkDeviceSize getTransientMemorySize() const;
+
+	static RenderGraphAccess colorAttachment(RenderGraphResource resource);
+	// Also used for multisample resolve targets, which are written in the color attachment output stage
+	static RenderGraphAccess resolveAttachment(RenderGraphResource resource, VkImageLayout layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	static RenderGraphAccess depthAttachment(RenderGraphResource resource, VkImageLayout layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	static RenderGraphAccess sampledRead(RenderGraphResource resource, VkPipelineStageFlags2 stageMask, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	static RenderGraphAccess storageRead(RenderGraphResource resource, VkPipelineStageFlags2 stageMask, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+	static RenderGraphAccess storageWrite(RenderGraphResource resource, VkPipelineStageFlags2 stageMask, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+	static RenderGraphAccess storageReadWrite(RenderGraphResource resource, VkPipelineStageFlags2 stageMask, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+	static RenderGraphAccess indirectRead(RenderGraphResource resource);
+};
@@ -67,6 +67,7 @@ namespace vks
 	/** Prepare all vulkan resources required to render the UI overlay */
 	void UIOverlay::prepareResources()
 	{
+		MemoryStats::Scope memoryScope(MemoryCategory::Overlay);
 		ImGuiIO& io = ImGui::GetIO();
 
 		// Create font texture
@@ -103,16 +104,12 @@ namespace vks
 
 		fontView = new ImageView(fontImage);
 
-		// Staging buffers for font data upload
-		Buffer* stagingBuffer = new Buffer({
-			.usageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			.size = uploadSize,
-			.data = fontData
-		});
+		// Staging region for font data upload
+		StagingRegion staging = VulkanContext::stagingBuffer->allocate(uploadSize);
+		memcpy(staging.mapped, fontData, uploadSize);
 
 		// Copy buffer data to font image
-		VkCommandBuffer copyCmd = VulkanContext::device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkCommandBuffer copyCmd = VulkanContext::stagingBuffer->beginCommandBuffer();
 
 		// Prepare for transfer
 		vks::tools::setImageLayout(
@@ -131,10 +128,11 @@ namespace vks
 		bufferCopyRegion.imageExtent.width = texWidth;
 		bufferCopyRegion.imageExtent.height = texHeight;
 		bufferCopyRegion.imageExtent.depth = 1;
+		bufferCopyRegion.bufferOffset = staging.offset;
 
 		vkCmdCopyBufferToImage(
 			copyCmd,
-			stagingBuffer->buffer,
+			staging.buffer,
 			*fontImage,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			1,
@@ -151,9 +149,7 @@ namespace vks
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 
-		VulkanContext::device->flushCommandBuffer(copyCmd, queue, true);
-
-		delete stagingBuffer;
+		VulkanContext::stagingBuffer->submit(copyCmd, queue);
 
 		// @todo: replace VK_DESC* constants?
 
@@ -300,7 +296,7 @@ namespace vks
 		cb->updatePushConstant(pipelineLayout, 0, &pushConstBlock);
 		// @bind functions for Buffer class
 		cb->bindIndexBuffer(frameObjects[frameIndex].indexBuffer->buffer, 0, VK_INDEX_TYPE_UINT16);
-		cb->bindVertexBuffers(0, 1, { frameObjects[frameIndex].vertexBuffer->buffer });
+		cb->bindVertexBuffer(0, frameObjects[frameIndex].vertexBuffer->buffer);
 
 		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++)
 		{
@@ -384,18 +380,13 @@ namespace vks
 		return res;
 	}
 
-	bool UIOverlay::comboBox(const char *caption, int32_t *itemindex, std::vector<std::string> items)
+	bool UIOverlay::comboBox(const char *caption, int32_t *itemindex, std::span<const char* const> items)
 	{
 		if (items.empty()) {
 			return false;
 		}
-		std::vector<const char*> charitems;
-		charitems.reserve(items.size());
-		for (size_t i = 0; i < items.size(); i++) {
-			charitems.push_back(items[i].c_str());
-		}
-		uint32_t itemCount = static_cast<uint32_t>(charitems.size());
-		bool res = ImGui::Combo(caption, itemindex, &charitems[0], itemCount, itemCount);
+		uint32_t itemCount = static_cast<uint32_t>(items.size());
+		bool res = ImGui::Combo(caption, itemindex, items.data(), itemCount, itemCount);
 		if (res) { updated = true; };
 		return res;
 	}
@@ -438,39 +429,58 @@ namespace vks
 		return false;
 	}
 
+	// Doubles the capacity and leaves headroom above the required count, so growing windows don't recreate the buffers every frame
+	static int32_t grownCapacity(int32_t capacity, int32_t required)
+	{
+		return std::max(required + required / 2, capacity * 2);
+	}
+
+	void UIOverlay::retireBuffer(Buffer* buffer)
+	{
+		if (!buffer) {
+			return;
+		}
+		if (onBufferRetired) {
+			onBufferRetired(buffer);
+		} else {
+			delete buffer;
+		}
+	}
+
 	void UIOverlay::allocateBuffers(uint32_t frameIndex)
 	{
+		MemoryStats::Scope memoryScope(MemoryCategory::Overlay);
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 		if (!imDrawData) {
 			return;
 		};
 
+		FrameObjects& frame = frameObjects[frameIndex];
+
 		// Vertex buffer
-		VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
-		if ((!frameObjects[frameIndex].vertexBuffer) || (imDrawData->TotalVtxCount > frameObjects[frameIndex].vertexCount)) {
-			if (frameObjects[frameIndex].vertexBuffer) {
-				delete frameObjects[frameIndex].vertexBuffer;
-			}
-			frameObjects[frameIndex].vertexBuffer = new Buffer({
+		if ((!frame.vertexBuffer) || (imDrawData->TotalVtxCount > frame.vertexCount)) {
+			retireBuffer(frame.vertexBuffer);
+			frame.uploadedVersion = UINT64_MAX;
+			frame.vertexCount = grownCapacity(frame.vertexCount, imDrawData->TotalVtxCount);
+			frame.vertexBuffer = new Buffer({
 				.usageFlags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 				.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-				.size = vertexBufferSize,
+				.size = frame.vertexCount * sizeof(ImDrawVert),
+				.memoryUsage = BufferMemoryUsage::HostWriteDeviceRead
 			});
-			frameObjects[frameIndex].vertexCount = imDrawData->TotalVtxCount;
 		}
 
 		// Index buffer
-		VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
-		if ((!frameObjects[frameIndex].indexBuffer) || (imDrawData->TotalIdxCount > frameObjects[frameIndex].indexCount)) {
-			if (frameObjects[frameIndex].indexBuffer) {
-				delete frameObjects[frameIndex].indexBuffer;
-			}
-			frameObjects[frameIndex].indexBuffer = new Buffer({
+		if ((!frame.indexBuffer) || (imDrawData->TotalIdxCount > frame.indexCount)) {
+			retireBuffer(frame.indexBuffer);
+			frame.uploadedVersion = UINT64_MAX;
+			frame.indexCount = grownCapacity(frame.indexCount, imDrawData->TotalIdxCount);
+			frame.indexBuffer = new Buffer({
 				.usageFlags = VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 				.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-				.size = indexBufferSize,
+				.size = frame.indexCount * sizeof(ImDrawIdx),
+				.memoryUsage = BufferMemoryUsage::HostWriteDeviceRead
 			});
-			frameObjects[frameIndex].indexCount = imDrawData->TotalIdxCount;
 		}
 	}
 
@@ -481,6 +491,12 @@ namespace vks
 			return; 
 		};
 
+		FrameObjects& frame = frameObjects[frameIndex];
+		if (frame.uploadedVersion == drawDataVersion) {
+			return;
+		}
+		frame.uploadedVersion = drawDataVersion;
+
 		// Upload current frame data to vertex and index buffer
 		if (imDrawData->CmdListsCount > 0) {
 			ImDrawVert* vtxDst = (ImDrawVert*)frameObjects[frameIndex].vertexBuffer->mapped;
@@ -499,4 +515,53 @@ namespace vks
 			frameObjects[frameIndex].indexBuffer->flush();
 		}
 	}
-}
\ No newline at end of file
+
+	// Hashes eight bytes at a time, as the overlay's vertex data is hashed every time it's rebuilt
+	static void hashData(uint64_t& hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		size_t offset = 0;
+		for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t)) {
+			uint64_t word;
+			memcpy(&word, bytes + offset, sizeof(uint64_t));
+			hash ^= word;
+			hash *= 0x100000001b3ull;
+			hash ^= hash >> 32;
+		}
+		for (; offset < size; offset++) {
+			hash ^= bytes[offset];
+			hash *= 0x100000001b3ull;
+		}
+	}
+
+	bool UIOverlay::updateDrawData()
+	{
+		ImDrawData* imDrawData = ImGui::GetDrawData();
+		if (!imDrawData) {
+			return false;
+		}
+		uint64_t hash = 0xcbf29ce484222325ull;
+		// The display size is part of the recorded viewport and push constants
+		const ImVec2 displaySize = ImGui::GetIO().DisplaySize;
+		hashData(hash, &displaySize, sizeof(displaySize));
+		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++) {
+			const ImDrawList* cmd_list = imDrawData->CmdLists[i];
+			hashData(hash, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+			hashData(hash, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+			for (int32_t j = 0; j < cmd_list->CmdBuffer.Size; j++) {
+				hashData(hash, &cmd_list->CmdBuffer[j].ElemCount, sizeof(cmd_list->CmdBuffer[j].ElemCount));
+			}
+		}
+		if (hash == drawDataHash) {
+			return false;
+		}
+		drawDataHash = hash;
+		drawDataVersion++;
+		return true;
+	}
+
+	uint64_t UIOverlay::getDrawDataVersion() const
+	{
+		return drawDataVersion;
+	}
+}
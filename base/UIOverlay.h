@@ -13,6 +13,8 @@
 #include <string.h>
 #include <assert.h>
 #include <vector>
+#include <span>
+#include <functional>
 #include <sstream>
 #include <iomanip>
 #include <glm/glm.hpp>
@@ -21,6 +23,7 @@
 #include "VulkanTools.h"
 #include "Device.hpp"
 #include "Buffer.hpp"
+#include "StagingBuffer.hpp"
 #include "Device.hpp"
 #include "CommandBuffer.hpp"
 #include "DescriptorPool.hpp"
@@ -71,15 +74,25 @@ namespace vks
 		VkDeviceMemory fontMemory{ VK_NULL_HANDLE };
 		Sampler* sampler{ nullptr };
 		void prepareResources();
+		void retireBuffer(Buffer* buffer);
+		uint64_t drawDataHash{ 0 };
+		uint64_t drawDataVersion{ 0 };
 		void preparePipeline(const VkPipelineCache pipelineCache, VkFormat colorFormat, VkFormat depthFormat);
 	public:
 		struct FrameObjects {
-			Buffer* vertexBuffer;
-			Buffer* indexBuffer;
+			Buffer* vertexBuffer{ nullptr };
+			Buffer* indexBuffer{ nullptr };
+			// Capacity of the buffers in vertices and indices
 			int32_t vertexCount{ 0 };
 			int32_t indexCount{ 0 };
+			// Version of the draw data in the buffers, they're only written if it changed
+			uint64_t uploadedVersion{ UINT64_MAX };
 		};
 		std::vector<FrameObjects> frameObjects;
+		// Called with buffers replaced by larger ones, which may still be in use by frames in flight and are owned by the callee. If not set, they're deleted right away
+		std::function<void(Buffer* buffer)> onBufferRetired;
+		// Max. number of times per second the overlay is rebuilt, in between the last draw data is drawn again. 0 rebuilds it every frame
+		float updateRate{ 30.0f };
 
 		struct PushConstBlock {
 			glm::vec2 scale;
@@ -104,15 +117,19 @@ namespace vks
 		bool sliderFloat(const char* caption, float* value, float min, float max);
 		bool sliderFloat2(const char* caption, float& value0, float& value1, float min, float max);
 		bool sliderInt(const char* caption, int32_t* value, int32_t min, int32_t max);
-		bool comboBox(const char* caption, int32_t* itemindex, std::vector<std::string> items);
+		bool comboBox(const char* caption, int32_t* itemindex, std::span<const char* const> items);
 		bool button(const char* caption);
 		void text(const char* formatstr, ...);
 
 		// Checks if the vertex and/or index buffers need to be recreated
 		bool bufferUpdateRequired(uint32_t frameIndex);
-		// (Re)allocate vertex and index buffers
+		// (Re)allocate vertex and index buffers, buffers grow geometrically so they're only recreated a few times
 		void allocateBuffers(uint32_t frameIndex);
-		// Updates the vertex and index buffers with ImGui's current frame data
+		// Updates the vertex and index buffers with ImGui's current frame data, skipped if they already contain it
 		void updateBuffers(uint32_t frameIndex);
+		/** @brief Compares the draw data of the last ImGui::Render against the previous one, needs to be called after each render. Returns true if it changed */
+		bool updateDrawData();
+		// Changes whenever the draw data changes, so recorded overlay commands can be reused until it does
+		uint64_t getDrawDataVersion() const;
 	};
 }
\ No newline at end of file
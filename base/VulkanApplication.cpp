@@ -7,9 +7,48 @@
  */
 
 #include "VulkanApplication.h"
+#include "SamplerCache.hpp"
+#include "SyncPool.hpp"
+#include "AssetArchive.h"
+#include "VirtualFileSystem.h"
+#include <fstream>
+#include <filesystem>
 
 std::vector<const char*> VulkanApplication::args;
 
+// Written in front of the pipeline cache blob on disk, as the blob header itself doesn't contain the driver version
+struct PipelineCacheFileHeader {
+	uint32_t magic;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+};
+const uint32_t pipelineCacheFileMagic = 0x43505356; // "VSPC"
+
+// Copies the cache blob of a pipeline cache file if its header matches the device and driver
+static bool readPipelineCacheFile(const vks::MappedFile& file, const VkPhysicalDeviceProperties& properties, std::vector<char>& data)
+{
+	PipelineCacheFileHeader header{};
+	if (!file.isValid() || (file.size() < sizeof(header))) {
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	const bool compatible = (header.magic == pipelineCacheFileMagic)
+		&& (header.vendorID == properties.vendorID)
+		&& (header.deviceID == properties.deviceID)
+		&& (header.driverVersion == properties.driverVersion)
+		&& (memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0)
+		&& (header.dataSize == file.size() - sizeof(header));
+	if (!compatible) {
+		return false;
+	}
+	const char* blob = reinterpret_cast<const char*>(file.data()) + sizeof(header);
+	data.assign(blob, blob + header.dataSize);
+	return true;
+}
+
 VKAPI_ATTR VkBool32 VKAPI_CALL debugUtilsMessengerCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData)
 {
 	// Select prefix depending on flags passed to the callback
@@ -89,16 +128,34 @@ VkResult VulkanApplication::createInstance()
 		}
 	}
 
+	// Required for the present fences of VK_EXT_swapchain_maintenance1, which tell when a retired swap chain can be destroyed
+	uint32_t availableExtensionCount{ 0 };
+	vkEnumerateInstanceExtensionProperties(nullptr, &availableExtensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(availableExtensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &availableExtensionCount, availableExtensions.data());
+	auto instanceExtensionSupported = [&availableExtensions](const char* name) {
+		return std::any_of(availableExtensions.begin(), availableExtensions.end(), [name](const VkExtensionProperties& extension) { return strcmp(extension.extensionName, name) == 0; });
+	};
+	surfaceMaintenance1 = instanceExtensionSupported(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME) && instanceExtensionSupported(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+	if (surfaceMaintenance1) {
+		instanceExtensions.push_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+	}
+
+#if defined(VKS_DEBUG_LABELS)
+	debugUtils = instanceExtensionSupported(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+#endif
+	debugUtils = debugUtils || settings.validation;
+	if (debugUtils) {
+		instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	}
+
 	VkInstanceCreateInfo instanceCreateInfo = {};
 	instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	instanceCreateInfo.pNext = NULL;
 	instanceCreateInfo.pApplicationInfo = &appInfo;
 	if (instanceExtensions.size() > 0)
 	{
-		if (settings.validation)
-		{
-			instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-		}
 		instanceCreateInfo.enabledExtensionCount = (uint32_t)instanceExtensions.size();
 		instanceCreateInfo.ppEnabledExtensionNames = instanceExtensions.data();
 	}
@@ -145,8 +202,11 @@ const std::string VulkanApplication::getAssetPath()
 
 void VulkanApplication::prepare()
 {
+	StartupProfiler::Scope startupScope("Base preparation");
+
 	VulkanContext::graphicsQueue = queue;
 	VulkanContext::device = vulkanDevice;
+	camera.reverseDepth = settings.reverseDepth;
 	// We try to get a transfer queue for background uploads
 	if (vulkanDevice->hasDedicatedTransferQueue) {
 		VulkanContext::copyQueue = vulkanDevice->getQueue(QueueType::Transfer);
@@ -154,22 +214,87 @@ void VulkanApplication::prepare()
 	else {
 		VulkanContext::copyQueue = queue;
 	}
+	VulkanContext::syncPool = new SyncPool();
+	// Shared staging buffer for all uploads
+	VulkanContext::stagingBuffer = new StagingBuffer({});
+	VulkanContext::samplerCache = new SamplerCache();
 
-	initSwapchain();
-	// Default command Pool
-	commandPool = new CommandPool({
-		.name = "Shared application command pool",
-		.queueFamilyIndex = swapChain->queueNodeIndex, // @todo: from device
-		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
-	});
-	swapChain->create(&width, &height, settings.vsync);
+	{
+		StartupProfiler::Scope swapChainScope("Swap chain creation");
+		initSwapchain();
+		// Default command Pool
+		commandPool = new CommandPool({
+			.name = "Shared application command pool",
+			.queueFamilyIndex = swapChain->queueNodeIndex, // @todo: from device
+			.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+		});
+		swapChain->create(&width, &height, settings.vsync, settings.lowLatency);
+		camera.preRotation = swapChain->getQuarterTurns();
+	}
+	if (settings.lowLatency && !vulkanDevice->hasPresentWait) {
+		std::cout << "Present wait is not supported, low latency mode only samples input late\n";
+	}
+#if defined(__ANDROID__)
+	// Frame work is reported to the system against the frame time of the limit, or that of a 60 Hz display
+	const float targetFrameRate = (settings.targetFrameRate > 0.0f) ? settings.targetFrameRate : 60.0f;
+	vks::android::createPerformanceHintSession(static_cast<int64_t>(1.0e9 / targetFrameRate));
+	vks::android::startThermalMonitoring();
+#endif
+	// With timeline semaphores, more frames in flight only cost the per-frame resources, one image is kept for presentation
+	renderAhead = std::clamp(swapChain->imageCount - 1, 2u, std::max(maxRenderAhead, 2u));
+	frameTimelineSemaphore = createTimelineSemaphore();
+	asyncCompute = vulkanDevice->hasDedicatedComputeQueue && (vulkanDevice->queueFamilyIndices.compute != vulkanDevice->queueFamilyIndices.graphics);
+	if (asyncCompute) {
+		computeQueue = vulkanDevice->getQueue(QueueType::Compute);
+		computeCommandPool = new CommandPool({
+			.name = "Async compute command pool",
+			.queueFamilyIndex = vulkanDevice->queueFamilyIndices.compute,
+			.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+		});
+		computeTimelineSemaphore = createTimelineSemaphore();
+	}
+	{
+		CommandBuffer* setupCommandBuffer = new CommandBuffer({
+			.device = *vulkanDevice,
+			.pool = commandPool
+		});
+		gpuProfiler = new GpuProfiler({
+			.device = *vulkanDevice,
+			.queue = queue,
+			.setupCommandBuffer = setupCommandBuffer->handle,
+			.frameCount = getFrameCount()
+		});
+		delete setupCommandBuffer;
+	}
+	renderGraph = new RenderGraph();
+	// Attachments replaced on resize may still be used by frames in flight
+	renderGraph->onResourcesRetired = [this](std::function<void()> deleter) {
+		deferDeletion(std::move(deleter));
+	};
+	swapChain->onSwapChainRetired = [this](std::function<void()> deleter) {
+		deferDeletion(std::move(deleter));
+	};
+	// The swap chain image is acquired at the color attachment output stage
+	swapChainResource = renderGraph->importImage("Swap chain", VK_IMAGE_ASPECT_COLOR_BIT, true, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+	// Offscreen images aren't presented, they're left ready for copies instead
+	renderGraph->setFinalAccess(swapChainResource, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 	setupDepthStencil();
 	setupImages();
-	// Default pipeline cache
-	VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
-	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-	VK_CHECK_RESULT(vkCreatePipelineCache(*vulkanDevice, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	// Derived classes compile again after adding their passes
+	compileRenderGraph();
+	// Default pipeline cache, initialized with the data from the last run if it's compatible with the current device and driver
+	{
+		StartupProfiler::Scope pipelineCacheScope("Pipeline cache creation");
+		std::vector<char> pipelineCacheData;
+		loadPipelineCacheData(pipelineCacheData);
+		VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
+		pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		pipelineCacheCreateInfo.initialDataSize = pipelineCacheData.size();
+		pipelineCacheCreateInfo.pInitialData = pipelineCacheData.empty() ? nullptr : pipelineCacheData.data();
+		VK_CHECK_RESULT(vkCreatePipelineCache(*vulkanDevice, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	}
 	// ImGUI based overlay
+	StartupProfiler::Scope overlayScope("Overlay creation");
 	overlay = new vks::UIOverlay({
 		.device = *vulkanDevice,
 		.queue = queue,
@@ -182,6 +307,9 @@ void VulkanApplication::prepare()
 		.scale = 1.0f,
 		.frameCount = getFrameCount(),
 		});
+	overlay->onBufferRetired = [this](Buffer* buffer) {
+		deferDeletion(buffer);
+	};
 }
 
 void VulkanApplication::renderFrame()
@@ -198,14 +326,11 @@ void VulkanApplication::renderFrame()
 	auto tEnd = std::chrono::high_resolution_clock::now();
 	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
 	frameTimer = (float)tDiff / 1000.0f;
+	frameTimeRecorder.addFrame(static_cast<float>(tDiff));
 	camera.mouse.buttons.left = mouseButtons.left;
 	camera.mouse.cursorPos = mousePos;
 	camera.mouse.cursorPosNDC = mousePos / glm::vec2(float(width), float(height));
-	if (GetKeyState(VK_SHIFT) & 0x8000) {
-		camera.update(frameTimer * 2.5f);
-	} else {
-		camera.update(frameTimer);
-	}
+	camera.update(frameTimer);
 	if (camera.moving())
 	{
 		viewUpdated = true;
@@ -235,6 +360,16 @@ void VulkanApplication::renderLoop()
 	destWidth = width;
 	destHeight = height;
 	lastTimestamp = std::chrono::high_resolution_clock::now();
+	// No window and no input, frames are rendered back to back
+	if (settings.headless) {
+		while (!exitRequested) {
+			if (prepared) {
+				updateInput();
+				nextFrame();
+			}
+		}
+		return;
+	}
 #if defined(_WIN32)
 	while (window->isOpen()) {
 		sf::Event event;
@@ -244,44 +379,23 @@ void VulkanApplication::renderLoop()
 				window->close();
 				return;
 			}
+			// Input comes from the recording during a replay
+			if (inputRecorder.isReplaying()) {
+				continue;
+			}
 			if (event.type == sf::Event::KeyPressed) {
 				if (event.key.code == sf::Keyboard::F1) {
 					overlay->visible = !overlay->visible;
 				}
 				keyPressed(event.key.code);
-			}
-			if (event.type == sf::Event::MouseButtonPressed) {
-				switch (event.mouseButton.button) {
-					case sf::Mouse::Left:
-						camera.mouse.buttons.left = true;
-						break;
-					case sf::Mouse::Right:
-						camera.mouse.buttons.right = true;
-						break;
-				}
-			}
-			if (event.type == sf::Event::MouseButtonReleased) {
-				switch (event.mouseButton.button) {
-				case sf::Mouse::Left:
-					camera.mouse.buttons.left = false;
-					camera.mouse.dragging = false;
-					break;
-				case sf::Mouse::Right:
-					camera.mouse.buttons.right = false;
-					break;
-				}
+				input.keyPresses.push_back(event.key.code);
 			}
 		}
-		auto mPos = sf::Mouse::getPosition(*window);
-		mousePos = glm::vec2((float)mPos.x, (float)mPos.y);
-		// @todo: move to camera func
-		if (camera.mouse.buttons.left && !camera.mouse.dragging) {
-			camera.mouse.dragCursorPos = mousePos;
-			camera.mouse.dragging = true;
-		};
+		// Mouse buttons and the cursor position are sampled by the input thread
 
 		if (prepared) {
 			// @todo: minimized
+			updateInput();
 			nextFrame();
 		}
 	}
@@ -452,11 +566,16 @@ void VulkanApplication::renderLoop()
 		wl_display_read_events(display);
 		wl_display_dispatch_pending(display);
 
+		updateInput();
+		requestPresentationFeedback();
 		render();
 		frameCounter++;
 		auto tEnd = std::chrono::high_resolution_clock::now();
 		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
 		frameTimer = tDiff / 1000.0f;
+		if (settings.vsync && presentTiming.isValid()) {
+			frameTimer = presentTiming.getFrameInterval();
+		}
 		camera.update(frameTimer);
 		if (camera.moving())
 		{
@@ -496,6 +615,7 @@ void VulkanApplication::renderLoop()
 			handleEvent(event);
 			free(event);
 		}
+		updateInput();
 		render();
 		frameCounter++;
 		auto tEnd = std::chrono::high_resolution_clock::now();
@@ -536,10 +656,42 @@ void VulkanApplication::updateOverlay(uint32_t frameIndex)
 	if (!overlay->visible)
 		return;
 
+	overlayElapsedTime += frameTimer;
+	const ImVec2 displaySize = ImGui::GetIO().DisplaySize;
+	const bool inputChanged = (mousePos != overlayMousePos) || (mouseButtons.left != overlayMouseDown[0]) || (mouseButtons.right != overlayMouseDown[1]) || (displaySize.x != (float)width) || (displaySize.y != (float)height);
+	const bool updateDue = (overlay->updateRate <= 0.0f) || (overlayElapsedTime >= 1.0f / overlay->updateRate);
+	if (inputChanged || updateDue || !ImGui::GetDrawData()) {
+		buildOverlay();
+		overlay->updateDrawData();
+	}
+
+	//Check if the overlay's index and vertex buffers needs to be updated (recreated), e.g. because new elements are visible and indices or vertices require additional buffer space
+	// Replaced buffers are retired through the deletion queue, so this doesn't need to wait for the GPU
+	if (overlay->bufferUpdateRequired(frameIndex)) {
+		overlay->allocateBuffers(frameIndex);
+		frameTimeRecorder.addEvent("Overlay buffer reallocation");
+	}
+	// Only writes the buffers if they don't contain the current draw data yet
+	overlay->updateBuffers(frameIndex);
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	if (mouseButtons.left) {
+		mouseButtons.left = false;
+	}
+#endif
+}
+
+void VulkanApplication::buildOverlay()
+{
 	ImGuiIO& io = ImGui::GetIO();
 
 	io.DisplaySize = ImVec2((float)width, (float)height);
-	io.DeltaTime = frameTimer;
+	// Time since the last rebuild, so ImGui's animations and timers run at the same speed with any update rate
+	io.DeltaTime = std::max(overlayElapsedTime, 1.0e-4f);
+	overlayElapsedTime = 0.0f;
+	overlayMousePos = mousePos;
+	overlayMouseDown[0] = mouseButtons.left;
+	overlayMouseDown[1] = mouseButtons.right;
 
 	io.MousePos = ImVec2(mousePos.x, mousePos.y);
 	io.MouseDown[0] = mouseButtons.left;
@@ -556,6 +708,24 @@ void VulkanApplication::updateOverlay(uint32_t frameIndex)
 	ImGui::TextUnformatted(title.c_str());
 	ImGui::TextUnformatted(vulkanDevice->properties.deviceName);
 	ImGui::Text("%.2f ms/frame (%.1d fps)", (1000.0f / lastFPS), lastFPS);
+	if (settings.lowLatency && vulkanDevice->hasPresentWait) {
+		ImGui::Text("Input to present: %.2f ms", inputLatency);
+	}
+	if (ImGui::CollapsingHeader("Frame times")) {
+		const std::vector<float>& frameTimes = frameTimeRecorder.getFrameTimes();
+		// Scaled to a multiple of the median, so regular frames stay readable while hitches hit the top
+		const float maxFrameTime = std::max(frameTimeRecorder.getMedian() * frameTimeRecorder.hitchFactor, 1.0f);
+		char medianText[32];
+		snprintf(medianText, sizeof(medianText), "median %.2f ms", frameTimeRecorder.getMedian());
+		ImGui::PlotLines("##frametimes", frameTimes.data(), static_cast<int>(frameTimeRecorder.getCount()), static_cast<int>(frameTimeRecorder.getOffset()), medianText, 0.0f, maxFrameTime, ImVec2(0.0f, 60.0f * overlay->scale));
+		const std::vector<float> histogram = frameTimeRecorder.getHistogram(32, maxFrameTime);
+		ImGui::PlotHistogram("##frametimehistogram", histogram.data(), static_cast<int>(histogram.size()), 0, nullptr, 0.0f, std::numeric_limits<float>::max(), ImVec2(0.0f, 60.0f * overlay->scale));
+		ImGui::Text("%llu hitches (> %.1fx median)", static_cast<unsigned long long>(frameTimeRecorder.getHitchCount()), frameTimeRecorder.hitchFactor);
+		const std::deque<FrameHitch>& hitches = frameTimeRecorder.getHitches();
+		for (auto hitch = hitches.rbegin(); hitch != hitches.rend(); hitch++) {
+			ImGui::Text("#%llu: %.2f ms %s", static_cast<unsigned long long>(hitch->frameNumber), hitch->frameTime, hitch->events.c_str());
+		}
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 5.0f * overlay->scale));
@@ -570,51 +740,41 @@ void VulkanApplication::updateOverlay(uint32_t frameIndex)
 	ImGui::End();
 	ImGui::PopStyleVar();
 	ImGui::Render();
-
-	//Check if the overlay's index and vertex buffers needs to be updated (recreated), e.g. because new elements are visible and indices or vertices require additional buffer space
-   //@todo: remove?
-	if (overlay->bufferUpdateRequired(frameIndex)) {
-		// Ensure all command buffers have finished execution, so we don't change vertex and/or index buffers still in use
-		// @todo: wait for fences instead?
-		vkQueueWaitIdle(queue);
-		overlay->allocateBuffers(frameIndex);
-	}
-	// @todo: cap update rate
-	overlay->updateBuffers(frameIndex);
-
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-	if (mouseButtons.left) {
-		mouseButtons.left = false;
-	}
-#endif
 }
 
 VulkanApplication::VulkanApplication()
 {
-#if !defined(VK_USE_PLATFORM_ANDROID_KHR)
-	// Check for a valid asset path
-	struct stat info;
-	if (stat(getAssetPath().c_str(), &info) != 0)
-	{
-#if defined(_WIN32)
-		std::string msg = "Could not locate asset path in \"" + getAssetPath() + "\" !";
-		MessageBox(NULL, msg.c_str(), "Fatal error", MB_OK | MB_ICONERROR);
-#else
-		std::cerr << "Error: Could not find asset path in " << getAssetPath() << std::endl;
-#endif
-		exit(-1);
-	}
-#endif
-
 	// Command line arguments
 	commandLineParser.add("help", { "--help" }, 0, "Show help");
 	commandLineParser.add("validation", { "-v", "--validation" }, 0, "Enable validation layers");
 	commandLineParser.add("vsync", { "-vs", "--vsync" }, 0, "Enable V-Sync");
+	commandLineParser.add("lowlatency", { "-ll", "--lowlatency" }, 0, "Wait for presentation and sample input as late as possible to reduce input latency");
+	commandLineParser.add("tilebased", { "-tb", "--tilebased" }, 0, "Keep attachments in transient tile memory (default on Android), disables reading back depth");
+	commandLineParser.add("standarddepth", { "-sd", "--standarddepth" }, 0, "Use a standard depth range with a finite far plane instead of reverse Z");
+	commandLineParser.add("framelimit", { "-fl", "--framelimit" }, 1, "Limit the frame rate to the given frames per second, 0 matches the display's refresh rate");
+	commandLineParser.add("postprocessing", { "-pp", "--postprocessing" }, 0, "Render the scene in HDR with bloom and tonemapping, disables multisampling");
 	commandLineParser.add("fullscreen", { "-f", "--fullscreen" }, 0, "Start in fullscreen mode");
 	commandLineParser.add("width", { "-w", "--width" }, 1, "Set window width");
 	commandLineParser.add("height", { "-h", "--height" }, 1, "Set window height");
 	commandLineParser.add("gpuselection", { "-g", "--gpu" }, 1, "Select GPU to run on");
+	commandLineParser.add("devicegroup", { "-dg", "--devicegroup" }, 0, "Render with all GPUs of the selected GPU's device group, each GPU renders and presents the part of the window on its displays");
 	commandLineParser.add("gpulist", { "-gl", "--listgpus" }, 0, "Display a list of available Vulkan devices");
+	commandLineParser.add("benchmark", { "-b", "--benchmark" }, 0, "Run a deterministic benchmark and exit, results are written to CSV and JSON files");
+	commandLineParser.add("benchmarkframes", { "-bf", "--benchmarkframes" }, 1, "Number of frames recorded by the benchmark");
+	commandLineParser.add("benchmarkwarmup", { "-bw", "--benchmarkwarmup" }, 1, "Number of frames rendered before the benchmark starts recording");
+	commandLineParser.add("benchmarkoutput", { "-bo", "--benchmarkoutput" }, 1, "File name for the benchmark results without extension");
+	commandLineParser.add("benchmarkprimitives", { "-bgp", "--benchmarkprimitives" }, 1, "Check the GPU scan, compaction and sort against CPU references for the given number of elements, print their timings and exit");
+	commandLineParser.add("capturepipelinecache", { "-cpc", "--capturepipelinecache" }, 0, "Write the pipeline cache to the asset path for the current device and driver on exit, to be shipped with the assets (e.g. after a benchmark run)");
+	commandLineParser.add("archive", { "-ar", "--archive" }, 1, "Load assets from an asset archive, defaults to the asset path with a .vkarchive extension if that exists");
+	commandLineParser.add("packarchive", { "-pa", "--packarchive" }, 1, "Pack all files of the asset path into an asset archive and exit");
+	commandLineParser.add("tracefile", { "-tf", "--tracefile" }, 1, "Record CPU and GPU timings without a Tracy connection and write them to a Chrome trace file (viewable with Perfetto) on exit");
+	commandLineParser.add("recordinput", { "-ri", "--recordinput" }, 1, "Record keyboard, mouse and game pad input and frame times of the session to a file");
+	commandLineParser.add("replayinput", { "-rpi", "--replayinput" }, 1, "Replay an input recording frame by frame with its recorded frame times and seed, and exit once it's finished");
+	commandLineParser.add("headless", { "-hl", "--headless" }, 0, "Render to offscreen images without a window or swap chain, e.g. for benchmarks on machines without a display");
+	commandLineParser.add("halfprecision", { "-hp", "--halfprecision" }, 0, "Use 16 bit floats for shading and post processing if supported (default on Android)");
+	commandLineParser.add("snapshot", { "-ss", "--snapshot" }, 1, "Restore the asteroid field from a simulation snapshot file at startup if it exists, and write snapshots to it in intervals");
+	commandLineParser.add("shirradiance", { "-shi", "--shirradiance" }, 0, "Light the scene with spherical harmonics irradiance projected from the skybox instead of an irradiance cubemap");
+	commandLineParser.add("virtualtexture", { "-vt", "--virtualtexture" }, 1, "KTX file (relative to the asset path) streamed as a virtual texture for the moon's surface");
 
 	commandLineParser.parse(args);
 	if (commandLineParser.isSet("help")) {
@@ -625,12 +785,85 @@ VulkanApplication::VulkanApplication()
 		std::cin.get();
 		exit(0);
 	}
+	if (commandLineParser.isSet("tracefile")) {
+		traceFileName = commandLineParser.getValueAsString("tracefile", "trace.json");
+		traceRecorder.setThreadName("Main thread");
+		traceRecorder.start();
+	}
+#if !defined(VK_USE_PLATFORM_ANDROID_KHR)
+	if (commandLineParser.isSet("packarchive")) {
+		const bool packed = vks::AssetArchive::write({
+			.directory = getAssetPath(),
+			.filename = commandLineParser.getValueAsString("packarchive", "")
+		});
+		exit(packed ? 0 : -1);
+	}
+	// Archived files are looked up below the asset path, so paths built from it work for archived and loose files
+	const std::string defaultArchive = std::filesystem::path(getAssetPath()).lexically_normal().parent_path().string() + ".vkarchive";
+	const std::string archive = commandLineParser.getValueAsString("archive", defaultArchive);
+	if (commandLineParser.isSet("archive") || std::filesystem::exists(defaultArchive)) {
+		vks::vfs::mount(archive, getAssetPath());
+	}
+
+	// Check for a valid asset path, which doesn't need to exist if the assets come from an archive
+	struct stat info;
+	if ((vks::vfs::getMountCount() == 0) && (stat(getAssetPath().c_str(), &info) != 0))
+	{
+#if defined(_WIN32)
+		std::string msg = "Could not locate asset path in \"" + getAssetPath() + "\" !";
+		MessageBox(NULL, msg.c_str(), "Fatal error", MB_OK | MB_ICONERROR);
+#else
+		std::cerr << "Error: Could not find asset path in " << getAssetPath() << std::endl;
+#endif
+		exit(-1);
+	}
+#endif
 	if (commandLineParser.isSet("validation")) {
 		settings.validation = true;
 	}
 	if (commandLineParser.isSet("vsync")) {
 		settings.vsync = true;
 	}
+	if (commandLineParser.isSet("lowlatency")) {
+		settings.lowLatency = true;
+	}
+	if (commandLineParser.isSet("devicegroup")) {
+		settings.deviceGroup = true;
+	}
+	if (commandLineParser.isSet("tilebased")) {
+		settings.tileBasedRendering = true;
+	}
+	if (commandLineParser.isSet("standarddepth")) {
+		settings.reverseDepth = false;
+	}
+	if (commandLineParser.isSet("postprocessing")) {
+		settings.postProcessing = true;
+	}
+	if (commandLineParser.isSet("framelimit")) {
+		settings.limitFrameRate = true;
+		settings.targetFrameRate = static_cast<float>(std::max(commandLineParser.getValueAsInt("framelimit", 0), 0));
+	}
+	if (commandLineParser.isSet("headless")) {
+		settings.headless = true;
+		// Nothing is presented, so there's nothing to wait for
+		settings.vsync = false;
+		settings.lowLatency = false;
+	}
+	if (commandLineParser.isSet("shirradiance")) {
+		settings.shIrradiance = true;
+	}
+	if (commandLineParser.isSet("halfprecision")) {
+		settings.halfPrecision = true;
+	}
+	if (commandLineParser.isSet("snapshot")) {
+		settings.snapshotFile = commandLineParser.getValueAsString("snapshot", "");
+	}
+	if (commandLineParser.isSet("virtualtexture")) {
+		settings.virtualTexture = commandLineParser.getValueAsString("virtualtexture", "");
+	}
+	if (commandLineParser.isSet("benchmarkprimitives")) {
+		settings.primitivesBenchmarkCount = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("benchmarkprimitives", 0), 0));
+	}
 	if (commandLineParser.isSet("height")) {
 		height = commandLineParser.getValueAsInt("height", width);
 	}
@@ -640,6 +873,28 @@ VulkanApplication::VulkanApplication()
 	if (commandLineParser.isSet("fullscreen")) {
 		settings.fullscreen = true;
 	}
+	if (commandLineParser.isSet("capturepipelinecache")) {
+		capturePipelineCache = true;
+	}
+	if (commandLineParser.isSet("benchmark")) {
+		benchmark.active = true;
+		benchmark.frameCount = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("benchmarkframes", benchmark.frameCount), 1));
+		benchmark.warmupFrames = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("benchmarkwarmup", benchmark.warmupFrames), 0));
+		benchmark.outputFile = commandLineParser.getValueAsString("benchmarkoutput", benchmark.outputFile);
+		// Presentation must not limit the frame rate, and the camera must advance by the scripted time step
+		settings.vsync = false;
+		settings.lowLatency = false;
+	}
+	// The camera needs to be updated in nextFrame, where recorded frame times are written and replayed
+	if (commandLineParser.isSet("replayinput")) {
+		if (inputRecorder.startReplay(commandLineParser.getValueAsString("replayinput", ""))) {
+			settings.lowLatency = false;
+		}
+	} else if (commandLineParser.isSet("recordinput")) {
+		if (inputRecorder.startRecording(commandLineParser.getValueAsString("recordinput", ""), benchmark.active ? benchmark.seed : static_cast<uint32_t>(time(nullptr)))) {
+			settings.lowLatency = false;
+		}
+	}
 	
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// Vulkan library is loaded dynamically on Android
@@ -648,9 +903,13 @@ VulkanApplication::VulkanApplication()
 #elif defined(_DIRECT2DISPLAY)
 
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	initWaylandConnection();
+	if (!settings.headless) {
+		initWaylandConnection();
+	}
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	initxcbConnection();
+	if (!settings.headless) {
+		initxcbConnection();
+	}
 #endif
 
 #if defined(_WIN32)
@@ -665,27 +924,49 @@ VulkanApplication::VulkanApplication()
 
 VulkanApplication::~VulkanApplication()
 {
+	inputThread.stop();
+#if defined(__ANDROID__)
+	vks::android::closePerformanceHintSession();
+	vks::android::stopThermalMonitoring();
+#endif
+	// Threads of the derived class (e.g. the job system's workers) have been joined by its destructor, so no more events are recorded
+	if (!traceFileName.empty()) {
+		traceRecorder.stop();
+		traceRecorder.write(traceFileName);
+	}
+	// The device is idle at this point, so everything that's still queued can be destroyed
+	// Retired swap chains need to be destroyed before their surface
+	flushDeletionQueue(UINT64_MAX);
+
 	delete swapChain;
 
-	vkDestroyImageView(*vulkanDevice, depthStencil.view, nullptr);
-	vkDestroyImage(*vulkanDevice, depthStencil.image, nullptr);
-	vkFreeMemory(*vulkanDevice, depthStencil.memory, nullptr);
+	delete renderGraph;
 
-	vkDestroyPipelineCache(*vulkanDevice, pipelineCache, nullptr);
-
-	if (settings.sampleCount > VK_SAMPLE_COUNT_1_BIT) {
-		vkDestroyImage(*vulkanDevice, multisampleTarget.color.image, nullptr);
-		vkDestroyImageView(*vulkanDevice, multisampleTarget.color.view, nullptr);
-		vkFreeMemory(*vulkanDevice, multisampleTarget.color.memory, nullptr);
-		vkDestroyImage(*vulkanDevice, multisampleTarget.depth.image, nullptr);
-		vkDestroyImageView(*vulkanDevice, multisampleTarget.depth.view, nullptr);
-		vkFreeMemory(*vulkanDevice, multisampleTarget.depth.memory, nullptr);
+	vkDestroySemaphore(*vulkanDevice, frameTimelineSemaphore, nullptr);
+	if (computeTimelineSemaphore != VK_NULL_HANDLE) {
+		vkDestroySemaphore(*vulkanDevice, computeTimelineSemaphore, nullptr);
 	}
 
-	// @todo: deletion queue
+	savePipelineCacheData(pipelineCacheFileName);
+	if (capturePipelineCache) {
+		const std::string prewarmedFileName = getPrewarmedPipelineCacheFileName();
+		std::error_code errorCode;
+		std::filesystem::create_directories(std::filesystem::path(prewarmedFileName).parent_path(), errorCode);
+		savePipelineCacheData(prewarmedFileName);
+		std::cout << "Pipeline cache captured to " << prewarmedFileName << "\n";
+	}
+	vkDestroyPipelineCache(*vulkanDevice, pipelineCache, nullptr);
 
 	delete overlay;
+	delete gpuProfiler;
+	delete VulkanContext::stagingBuffer;
+	delete VulkanContext::samplerCache;
+	VulkanContext::samplerCache = nullptr;
+	// Last, as the staging buffer and the profiler return their fences to it
+	delete VulkanContext::syncPool;
+	VulkanContext::syncPool = nullptr;
 	delete commandPool;
+	delete computeCommandPool;
 	delete vulkanDevice;
 
 	if (settings.validation)
@@ -701,6 +982,9 @@ VulkanApplication::~VulkanApplication()
 #if defined(_DIRECT2DISPLAY)
 
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
+	if (!display) {
+		return;
+	}
 	xdg_toplevel_destroy(xdg_toplevel);
 	xdg_surface_destroy(xdg_surface);
 	wl_surface_destroy(surface);
@@ -709,6 +993,8 @@ VulkanApplication::~VulkanApplication()
 	if (pointer)
 		wl_pointer_destroy(pointer);
 	wl_seat_destroy(seat);
+	if (presentation)
+		wp_presentation_destroy(presentation);
 	xdg_wm_base_destroy(shell);
 	wl_compositor_destroy(compositor);
 	wl_registry_destroy(registry);
@@ -716,27 +1002,33 @@ VulkanApplication::~VulkanApplication()
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// todo : android cleanup (if required)
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	xcb_destroy_window(connection, window);
-	xcb_disconnect(connection);
+	if (connection) {
+		xcb_destroy_window(connection, window);
+		xcb_disconnect(connection);
+	}
 #endif
 }
 
 bool VulkanApplication::initVulkan()
 {
+	StartupProfiler::Scope startupScope("Vulkan initialization");
+
 	VkResult err;
 
 	err = volkInitialize();
 	assert(err == VK_SUCCESS);
 
 	// Vulkan instance
-	err = createInstance();
-	if (err) {
-		vks::tools::exitFatal("Could not create Vulkan instance : \n" + vks::tools::errorString(err), err);
-		return false;
+	{
+		StartupProfiler::Scope instanceScope("Instance creation");
+		err = createInstance();
+		if (err) {
+			vks::tools::exitFatal("Could not create Vulkan instance : \n" + vks::tools::errorString(err), err);
+			return false;
+		}
+		volkLoadInstance(instance);
 	}
 
-	volkLoadInstance(instance);
-
 	// Create a debug callback to output validation messages to the console if validation is enabled
 	if (settings.validation)
 	{
@@ -817,19 +1109,56 @@ bool VulkanApplication::initVulkan()
 	}
 #endif
 	
+	// Device groups are reported by the instance, a group with a single device is the same as that device on its own
+	std::vector<VkPhysicalDevice> deviceGroup;
+	if (settings.deviceGroup) {
+		uint32_t groupCount = 0;
+		VK_CHECK_RESULT(vkEnumeratePhysicalDeviceGroups(instance, &groupCount, nullptr));
+		std::vector<VkPhysicalDeviceGroupProperties> groups(groupCount, { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GROUP_PROPERTIES });
+		VK_CHECK_RESULT(vkEnumeratePhysicalDeviceGroups(instance, &groupCount, groups.data()));
+		for (const VkPhysicalDeviceGroupProperties& group : groups) {
+			const VkPhysicalDevice* groupEnd = group.physicalDevices + group.physicalDeviceCount;
+			if (std::find(group.physicalDevices, groupEnd, physicalDevices[selectedDevice]) != groupEnd) {
+				deviceGroup.assign(group.physicalDevices, groupEnd);
+			}
+		}
+		if (deviceGroup.size() > 1) {
+			std::cout << "Using device group with " << deviceGroup.size() << " devices\n";
+		} else {
+			std::cout << "Selected device is not part of a device group with multiple devices\n";
+			deviceGroup.clear();
+		}
+	}
+
+	// Uploads on the transfer queue signal a timeline semaphore
+	Device::enabledFeatures12.timelineSemaphore = VK_TRUE;
+	// Barriers recorded through the command buffer wrapper are batched using synchronization2
+	Device::enabledFeatures13.synchronization2 = VK_TRUE;
+	// Shader invocation counts for the GPU profiler, only enabled if supported
+	Device::enabledFeatures.pipelineStatisticsQuery = VK_TRUE;
+	// Presents are waited for in low latency mode, only enabled if supported
+	Device::enabledPresentWaitFeatures.presentWait = settings.lowLatency;
+	// Present fences for destroying retired swap chains, only enabled if supported
+	Device::enabledSwapchainMaintenance1Features.swapchainMaintenance1 = surfaceMaintenance1;
+
 	// Find a better way to pass this
 	dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
 	dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
 	deviceCreatepNextChain = &dynamicRenderingFeatures;
 
 	// Vulkan device creation
-	vulkanDevice = new Device({
-		.physicalDevice = physicalDevices[selectedDevice],
-		.enabledExtensions = enabledDeviceExtensions,
-		.requestedQueueTypes = { VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT },
-		.pNextChain = deviceCreatepNextChain,
-		.useSwapChain = true
-	});
+	{
+		StartupProfiler::Scope deviceScope("Device creation");
+		vulkanDevice = new Device({
+			.physicalDevice = physicalDevices[selectedDevice],
+			.enabledExtensions = enabledDeviceExtensions,
+			.requestedQueueTypes = { VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT },
+			.pNextChain = deviceCreatepNextChain,
+			.useSwapChain = true,
+			.debugUtils = debugUtils,
+			.deviceGroup = deviceGroup
+		});
+	}
 	
 	queue = vulkanDevice->getQueue(QueueType::Graphics);
 
@@ -893,8 +1222,14 @@ void VulkanApplication::setupDPIAwareness()
 
 void VulkanApplication::setupWindow()
 {
+	if (settings.headless) {
+		return;
+	}
 	window = new sf::WindowBase(sf::VideoMode(width, height), "SFML window with Vulkan", settings.fullscreen ? sf::Style::Fullscreen : sf::Style::Default);
 	window->setTitle(windowTitle);
+	if (!inputRecorder.isReplaying()) {
+		inputThread.start(window);
+	}
 }
 
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -1077,6 +1412,15 @@ void VulkanApplication::handleAppCommand(android_app * app, int32_t cmd)
 		LOGD("APP_CMD_GAINED_FOCUS");
 		vulkanExample->focused = true;
 		break;
+	case APP_CMD_CONFIG_CHANGED:
+	case APP_CMD_WINDOW_RESIZED:
+		// Orientation changes by a quarter turn swap the surface's sides, the swap chain is recreated with the new transform and extent
+		// Half turns don't change the surface, these are picked up by the swap chain reporting itself as suboptimal once presented
+		LOGD("APP_CMD_CONFIG_CHANGED");
+		if (vulkanExample->prepared) {
+			vulkanExample->windowResize();
+		}
+		break;
 	case APP_CMD_TERM_WINDOW:
 		// Window is hidden or closed, clean up resources
 		LOGD("APP_CMD_TERM_WINDOW");
@@ -1309,6 +1653,45 @@ void VulkanApplication::registryGlobal(wl_registry *registry, uint32_t name,
 		{ seatCapabilitiesCb, };
 		wl_seat_add_listener(seat, &seat_listener, this);
 	}
+	else if (strcmp(interface, "wp_presentation") == 0)
+	{
+		presentation = (wp_presentation *) wl_registry_bind(registry, name,
+				&wp_presentation_interface, 1);
+	}
+}
+
+static void presentationFeedbackSyncOutput(void *data, struct wp_presentation_feedback *feedback, struct wl_output *output)
+{
+}
+
+/*static*/void VulkanApplication::presentationFeedbackPresentedCb(void *data, struct wp_presentation_feedback *feedback,
+		uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh,
+		uint32_t seq_hi, uint32_t seq_lo, uint32_t flags)
+{
+	VulkanApplication *self = reinterpret_cast<VulkanApplication *>(data);
+	// The timestamp is in the compositor's presentation clock, which is only compared against other presents
+	const uint64_t seconds = (static_cast<uint64_t>(tv_sec_hi) << 32) | tv_sec_lo;
+	self->presentTiming.addPresent(seconds * 1000000000ull + tv_nsec, ++self->presentationFeedbackId, refresh);
+	wp_presentation_feedback_destroy(feedback);
+}
+
+/*static*/void VulkanApplication::presentationFeedbackDiscardedCb(void *data, struct wp_presentation_feedback *feedback)
+{
+	VulkanApplication *self = reinterpret_cast<VulkanApplication *>(data);
+	++self->presentationFeedbackId;
+	wp_presentation_feedback_destroy(feedback);
+}
+
+void VulkanApplication::requestPresentationFeedback()
+{
+	if (!presentation) {
+		return;
+	}
+	static const struct wp_presentation_feedback_listener feedback_listener =
+	{ presentationFeedbackSyncOutput, presentationFeedbackPresentedCb, presentationFeedbackDiscardedCb };
+	// Applies to the next commit of the surface, which the swap chain does when presenting
+	wp_presentation_feedback *feedback = wp_presentation_feedback(presentation, surface);
+	wp_presentation_feedback_add_listener(feedback, &feedback_listener, this);
 }
 
 /*static*/void VulkanApplication::registryGlobalRemoveCb(void *data,
@@ -1400,6 +1783,9 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
 
 struct xdg_surface *VulkanApplication::setupWindow()
 {
+	if (settings.headless) {
+		return nullptr;
+	}
 	surface = wl_compositor_create_surface(compositor);
 	xdg_surface = xdg_wm_base_get_xdg_surface(shell, surface);
 
@@ -1423,6 +1809,9 @@ static inline xcb_intern_atom_reply_t* intern_atom_helper(xcb_connection_t *conn
 // Set up a window using XCB and request event types
 xcb_window_t VulkanApplication::setupWindow()
 {
+	if (settings.headless) {
+		return 0;
+	}
 	uint32_t value_mask, value_list[32];
 
 	window = xcb_generate_id(connection);
@@ -1625,43 +2014,38 @@ void VulkanApplication::mouseMoved(double x, double y, bool & handled) {}
 
 void VulkanApplication::setupDepthStencil()
 {
-	VkImageCreateInfo imageCI{};
-	imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageCI.imageType = VK_IMAGE_TYPE_2D;
-	imageCI.format = depthFormat;
-	imageCI.extent = { width, height, 1 };
-	imageCI.mipLevels = 1;
-	imageCI.arrayLayers = 1;
-	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-
-	VK_CHECK_RESULT(vkCreateImage(*vulkanDevice, &imageCI, nullptr, &depthStencil.image));
-	VkMemoryRequirements memReqs{};
-	vkGetImageMemoryRequirements(*vulkanDevice, depthStencil.image, &memReqs);
-
-	VkMemoryAllocateInfo memAllloc{};
-	memAllloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memAllloc.allocationSize = memReqs.size;
-	memAllloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(*vulkanDevice, &memAllloc, nullptr, &depthStencil.memory));
-	VK_CHECK_RESULT(vkBindImageMemory(*vulkanDevice, depthStencil.image, depthStencil.memory, 0));
-
-	VkImageViewCreateInfo imageViewCI{};
-	imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	imageViewCI.image = depthStencil.image;
-	imageViewCI.format = depthFormat;
-	imageViewCI.subresourceRange.baseMipLevel = 0;
-	imageViewCI.subresourceRange.levelCount = 1;
-	imageViewCI.subresourceRange.baseArrayLayer = 0;
-	imageViewCI.subresourceRange.layerCount = 1;
-	imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
 	// Stencil aspect should only be set on depth + stencil formats (VK_FORMAT_D16_UNORM_S8_UINT..VK_FORMAT_D32_SFLOAT_S8_UINT
 	if (depthFormat >= VK_FORMAT_D16_UNORM_S8_UINT) {
-		imageViewCI.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-	}
-	VK_CHECK_RESULT(vkCreateImageView(*vulkanDevice, &imageViewCI, nullptr, &depthStencil.view));
+		aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	// Sampled, so derived classes can read the depth of a frame (e.g. for occlusion culling)
+	// In tile based mode depth is only ever cleared and discarded within the render pass, so it can live in lazily allocated memory instead
+	const VkImageUsageFlags usage = settings.tileBasedRendering ?
+		(VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) :
+		(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	depthStencil.resource = renderGraph->addImage({
+		.name = "Depth stencil",
+		.format = depthFormat,
+		.usage = usage,
+		.aspectMask = aspectMask
+	});
+}
+
+VkCompareOp VulkanApplication::getDepthCompareOp() const
+{
+	return settings.reverseDepth ? VK_COMPARE_OP_GREATER_OR_EQUAL : VK_COMPARE_OP_LESS_OR_EQUAL;
+}
+
+float VulkanApplication::getDepthClearValue() const
+{
+	return settings.reverseDepth ? 0.0f : 1.0f;
+}
+
+VkResolveModeFlagBits VulkanApplication::getFarthestDepthResolveMode() const
+{
+	const VkResolveModeFlagBits mode = settings.reverseDepth ? VK_RESOLVE_MODE_MIN_BIT : VK_RESOLVE_MODE_MAX_BIT;
+	return (vulkanDevice->properties12.supportedDepthResolveModes & mode) ? mode : VK_RESOLVE_MODE_NONE;
 }
 
 void VulkanApplication::setupImages()
@@ -1670,96 +2054,36 @@ void VulkanApplication::setupImages()
 		// Check if device supports requested sample count for color and depth frame buffer
 		//assert((deviceProperties.limits.framebufferColorSampleCounts >= sampleCount) && (deviceProperties.limits.framebufferDepthSampleCounts >= sampleCount));
 
-		if (multisampleTarget.color.image != VK_NULL_HANDLE) {
-			vkDestroyImage(*vulkanDevice, multisampleTarget.color.image, nullptr);
-			vkDestroyImageView(*vulkanDevice, multisampleTarget.color.view, nullptr);
-			vkFreeMemory(*vulkanDevice, multisampleTarget.color.memory, nullptr);
-			vkDestroyImage(*vulkanDevice, multisampleTarget.depth.image, nullptr);
-			vkDestroyImageView(*vulkanDevice, multisampleTarget.depth.view, nullptr);
-			vkFreeMemory(*vulkanDevice, multisampleTarget.depth.memory, nullptr);
-		}
+		// Only ever resolved, so these can live in lazily allocated memory on tile based renderers
+		multisampleTarget.color.resource = renderGraph->addImage({
+			.name = "Multisample color",
+			.format = swapChain->colorFormat,
+			.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.samples = settings.sampleCount
+		});
+		// Without a min./max. depth resolve, derived classes need to reduce the samples themselves and sample the multi sampled depth
+		const VkImageUsageFlags depthUsage = (settings.tileBasedRendering || (getFarthestDepthResolveMode() != VK_RESOLVE_MODE_NONE)) ?
+			(VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) :
+			(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		multisampleTarget.depth.resource = renderGraph->addImage({
+			.name = "Multisample depth",
+			.format = depthFormat,
+			.usage = depthUsage,
+			.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
+			.samples = settings.sampleCount
+		});
+	}
+}
 
-		VkImageCreateInfo imageCI{};
-		imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageCI.imageType = VK_IMAGE_TYPE_2D;
-		imageCI.format = swapChain->colorFormat;
-		imageCI.extent.width = width;
-		imageCI.extent.height = height;
-		imageCI.extent.depth = 1;
-		imageCI.mipLevels = 1;
-		imageCI.arrayLayers = 1;
-		imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.samples = settings.sampleCount;
-		imageCI.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		VK_CHECK_RESULT(vkCreateImage(*vulkanDevice, &imageCI, nullptr, &multisampleTarget.color.image));
-
-		VkMemoryRequirements memReqs;
-		vkGetImageMemoryRequirements(*vulkanDevice, multisampleTarget.color.image, &memReqs);
-		VkMemoryAllocateInfo memAllocInfo{};
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memAllocInfo.allocationSize = memReqs.size;
-		VkBool32 lazyMemTypePresent;
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemTypePresent);
-		if (!lazyMemTypePresent) {
-			memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		}
-		VK_CHECK_RESULT(vkAllocateMemory(*vulkanDevice, &memAllocInfo, nullptr, &multisampleTarget.color.memory));
-		vkBindImageMemory(*vulkanDevice, multisampleTarget.color.image, multisampleTarget.color.memory, 0);
-
-		// Create image view for the MSAA target
-		VkImageViewCreateInfo imageViewCI{};
-		imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		imageViewCI.image = multisampleTarget.color.image;
-		imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageViewCI.format = swapChain->colorFormat;
-		imageViewCI.components.r = VK_COMPONENT_SWIZZLE_R;
-		imageViewCI.components.g = VK_COMPONENT_SWIZZLE_G;
-		imageViewCI.components.b = VK_COMPONENT_SWIZZLE_B;
-		imageViewCI.components.a = VK_COMPONENT_SWIZZLE_A;
-		imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageViewCI.subresourceRange.levelCount = 1;
-		imageViewCI.subresourceRange.layerCount = 1;
-		VK_CHECK_RESULT(vkCreateImageView(*vulkanDevice, &imageViewCI, nullptr, &multisampleTarget.color.view));
-
-		// Depth target
-		imageCI.imageType = VK_IMAGE_TYPE_2D;
-		imageCI.format = depthFormat;
-		imageCI.extent.width = width;
-		imageCI.extent.height = height;
-		imageCI.extent.depth = 1;
-		imageCI.mipLevels = 1;
-		imageCI.arrayLayers = 1;
-		imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.samples = settings.sampleCount;
-		imageCI.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		VK_CHECK_RESULT(vkCreateImage(*vulkanDevice, &imageCI, nullptr, &multisampleTarget.depth.image));
-
-		vkGetImageMemoryRequirements(*vulkanDevice, multisampleTarget.depth.image, &memReqs);
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemTypePresent);
-		if (!lazyMemTypePresent) {
-			memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+void VulkanApplication::compileRenderGraph()
+{
+	renderGraph->compile(width, height);
+	for (ImageAttachment* attachment : { &depthStencil, &multisampleTarget.color, &multisampleTarget.depth }) {
+		if (attachment->resource != UINT32_MAX) {
+			attachment->image = renderGraph->getImage(attachment->resource);
+			attachment->view = renderGraph->getImageView(attachment->resource);
 		}
-		VK_CHECK_RESULT(vkAllocateMemory(*vulkanDevice, &memAllocInfo, nullptr, &multisampleTarget.depth.memory));
-		vkBindImageMemory(*vulkanDevice, multisampleTarget.depth.image, multisampleTarget.depth.memory, 0);
-
-		// Create image view for the MSAA target
-		imageViewCI.image = multisampleTarget.depth.image;
-		imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageViewCI.format = depthFormat;
-		imageViewCI.components.r = VK_COMPONENT_SWIZZLE_R;
-		imageViewCI.components.g = VK_COMPONENT_SWIZZLE_G;
-		imageViewCI.components.b = VK_COMPONENT_SWIZZLE_B;
-		imageViewCI.components.a = VK_COMPONENT_SWIZZLE_A;
-		imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-		imageViewCI.subresourceRange.levelCount = 1;
-		imageViewCI.subresourceRange.layerCount = 1;
-		VK_CHECK_RESULT(vkCreateImageView(*vulkanDevice, &imageViewCI, nullptr, &multisampleTarget.depth.view));
 	}
 }
 
@@ -1770,28 +2094,27 @@ void VulkanApplication::windowResize()
 		return;
 	}
 	prepared = false;
+	frameTimeRecorder.addEvent("Resize");
+	displayRefreshRate = 0.0f;
 
-	// Ensure all operations on the device have been finished before destroying resources
-	vulkanDevice->waitIdle();
-
-	// Recreate swap chain
+	// Frames in flight may still use the old swap chain and frame buffer attachments, so instead of waiting for the device these are retired through the deletion queue
+	// Recreate swap chain, the old one is passed for recreation so the implementation can reuse its resources
 	width = destWidth;
 	height = destHeight;
-	swapChain->create(&width, &height, settings.vsync);
+	swapChain->create(&width, &height, settings.vsync, settings.lowLatency);
+	// The display may have been rotated, the images are always rendered in its native orientation
+	camera.preRotation = swapChain->getQuarterTurns();
+	// Present ids only apply to the swap chain they were queued with
+	lastPresentId = 0;
+	presentTiming.reset();
 
 	// Recreate the frame buffers
-	vkDestroyImageView(*vulkanDevice, depthStencil.view, nullptr);
-	vkDestroyImage(*vulkanDevice, depthStencil.image, nullptr);
-	vkFreeMemory(*vulkanDevice, depthStencil.memory, nullptr);
-	setupDepthStencil();	
-	setupImages();
+	compileRenderGraph();
 
 	if ((width > 0.0f) && (height > 0.0f)) {
 		overlay->resize(width, height);
 	}
 
-	vulkanDevice->waitIdle();
-
 	if ((width > 0.0f) && (height > 0.0f)) {
 		camera.updateAspectRatio((float)width / (float)height);
 	}
@@ -1843,6 +2166,10 @@ void VulkanApplication::windowResized()
 
 void VulkanApplication::initSwapchain()
 {
+	if (settings.headless) {
+		swapChain->initHeadless();
+		return;
+	}
 #if defined(_WIN32)
 	swapChain->initSurface(window);
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)	
@@ -1862,53 +2189,410 @@ void VulkanApplication::OnUpdateOverlay(vks::UIOverlay &overlay) {}
 
 void VulkanApplication::prepareFrame(VulkanFrameObjects& frame)
 {
-	// Ensure command buffer execution has finished
-	VK_CHECK_RESULT(vkWaitForFences(*vulkanDevice, 1, &frame.renderCompleteFence, VK_TRUE, UINT64_MAX));
-	VK_CHECK_RESULT(vkResetFences(*vulkanDevice, 1, &frame.renderCompleteFence));
+	// Ensure command buffer execution of the last frame using these frame objects has finished
+	waitForFrame(frame.frameNumber);
+	// Graphics waits for the frame's async compute work, so both pools are no longer in use
+	frame.commandPool->reset();
+	if (frame.computeCommandPool) {
+		frame.computeCommandPool->reset();
+	}
+	// Frames finish in submission order, so this may also release objects of frames submitted after the one waited for
+	flushDeletionQueue(getCompletedFrameNumber());
+	updatePresentTiming();
+	if (settings.limitFrameRate) {
+		// Waiting after the fence means time the GPU still needs for earlier frames isn't slept on top of that
+		if (presentTiming.isValid()) {
+			// The measured rate also matches displays the platform query doesn't know about (e.g. on Linux)
+			displayRefreshRate = presentTiming.getRefreshRate();
+		}
+		if ((settings.targetFrameRate <= 0.0f) && (displayRefreshRate == 0.0f)) {
+			displayRefreshRate = FrameLimiter::getDisplayRefreshRate(window ? reinterpret_cast<void*>(window->getSystemHandle()) : nullptr);
+		}
+		const double limiterWait = frameLimiter.wait((settings.targetFrameRate > 0.0f) ? settings.targetFrameRate : displayRefreshRate, gpuProfiler ? gpuProfiler->getFrameTime() : 0.0f);
+		frameWaitTime += limiterWait;
+		frameBreakdown.pacingWait += static_cast<float>(limiterWait);
+	}
+	if (settings.lowLatency) {
+		// Waiting for the last frame to be visible keeps frames from queuing up for presentation, so input is sampled right before it's needed
+		if ((lastPresentId > 0) && vulkanDevice->hasPresentWait) {
+			const auto tStart = std::chrono::high_resolution_clock::now();
+			// Times out after 100 ms, e.g. for minimized windows that never present
+			const VkResult presentResult = swapChain->waitForPresent(lastPresentId, 100000000);
+			const auto tEnd = std::chrono::high_resolution_clock::now();
+			const double presentWait = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+			frameWaitTime += presentWait;
+			frameBreakdown.pacingWait += static_cast<float>(presentWait);
+			if (presentResult == VK_SUCCESS) {
+				inputLatency = std::chrono::duration<float, std::milli>(tEnd - presentedInputSampleTimestamp).count();
+				TracyPlot("Input latency", inputLatency);
+				traceRecorder.addCounter("Input latency", inputLatency);
+			}
+			else if ((presentResult != VK_TIMEOUT) && (presentResult != VK_ERROR_OUT_OF_DATE_KHR) && (presentResult != VK_SUBOPTIMAL_KHR)) {
+				VK_CHECK_RESULT(presentResult);
+			}
+		}
+		sampleInput();
+	}
 	// Acquire the next image from the swap chain
+	// Blocks if no image is available yet (e.g. with FIFO presentation and all images queued), so this counts as waiting
+	const auto tAcquire = std::chrono::high_resolution_clock::now();
 	VkResult result = swapChain->acquireNextImage(frame.presentCompleteSemaphore, &currentBuffer);
-	// @todo: rework after removing currentBuffer
-	swapChain->currentImageIndex = currentBuffer;
-	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
-	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
+	const double acquireWait = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tAcquire).count();
+	frameWaitTime += acquireWait;
+	frameBreakdown.acquireWait += static_cast<float>(acquireWait);
+	// No image has been acquired if the swap chain is no longer compatible with the surface (OUT_OF_DATE), so it's recreated and acquired from again
+	// Images of a swap chain that's no longer optimal for presentation (SUBOPTIMAL) can still be presented, it's recreated once the frame has been presented
+	while (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		windowResize();
+		result = swapChain->acquireNextImage(frame.presentCompleteSemaphore, &currentBuffer);
+	}
+	if (result == VK_SUBOPTIMAL_KHR) {
+		swapChainSuboptimal = true;
 	}
 	else {
 		VK_CHECK_RESULT(result);
 	}
+	// @todo: rework after removing currentBuffer
+	swapChain->currentImageIndex = currentBuffer;
+	renderGraph->setImage(swapChainResource, swapChain->buffers[currentBuffer].image);
 }
 
-void VulkanApplication::submitFrame(VulkanFrameObjects& frame)
+void VulkanApplication::sampleInput()
 {
-	// Submit command buffer to queue
-	VkPipelineStageFlags submitWaitStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	const auto now = std::chrono::high_resolution_clock::now();
+	// Takes the changes the input thread sampled while the frame waited for the previous one to be presented
+	if (inputThread.isRunning()) {
+		applyInputEvents();
+	}
+	camera.mouse.buttons.left = mouseButtons.left;
+	camera.mouse.cursorPos = mousePos;
+	camera.mouse.cursorPosNDC = mousePos / glm::vec2(float(width), float(height));
+	// Advances by the time since the last sample instead of the last frame's duration, which also includes the wait
+	const float deltaTime = (inputSampleTimestamp.time_since_epoch().count() > 0) ? std::chrono::duration<float>(now - inputSampleTimestamp).count() : frameTimer;
+	inputSampleTimestamp = now;
+	camera.update(deltaTime);
+	if (camera.moving()) {
+		viewUpdated = true;
+	}
+}
+
+void VulkanApplication::updateInput()
+{
+	if (inputRecorder.isReplaying()) {
+		if (!inputRecorder.readFrame(input)) {
+			return;
+		}
+		mousePos = input.cursorPos * glm::vec2(float(width), float(height));
+		camera.mouse.buttons.left = input.mouseLeft;
+		camera.mouse.buttons.right = input.mouseRight;
+		gamePadState.axisLeft = input.axisLeft;
+		gamePadState.axisRight = input.axisRight;
+		for (sf::Keyboard::Key key : input.keyPresses) {
+			if (key == sf::Keyboard::F1) {
+				overlay->visible = !overlay->visible;
+			}
+			keyPressed(key);
+		}
+	} else if (inputThread.isRunning()) {
+		applyInputEvents();
+	} else {
+		// Without an input thread (e.g. XCB and Wayland, which get the mouse from their window events) keys are polled once per frame
+		input.mouseLeft = camera.mouse.buttons.left;
+		input.mouseRight = camera.mouse.buttons.right;
+		input.mouseMiddle = mouseButtons.middle;
+		input.keys.reset();
+		if (!settings.headless) {
+			for (int key = 0; key < sf::Keyboard::KeyCount; key++) {
+				input.keys.set(key, sf::Keyboard::isKeyPressed(static_cast<sf::Keyboard::Key>(key)));
+			}
+		}
+	}
+	if (!inputRecorder.isReplaying()) {
+		input.cursorPos = mousePos / glm::vec2(float(width), float(height));
+		input.axisLeft = gamePadState.axisLeft;
+		input.axisRight = gamePadState.axisRight;
+	}
+	camera.keyStates = input.keys;
+	if (!camera.mouse.buttons.left) {
+		camera.mouse.dragging = false;
+	}
+	// @todo: move to camera func
+	if (camera.mouse.buttons.left && !camera.mouse.dragging) {
+		camera.mouse.dragCursorPos = mousePos;
+		camera.mouse.dragging = true;
+	};
+}
+
+void VulkanApplication::applyInputEvents()
+{
+	inputEvents.clear();
+	inputThread.poll(inputEvents);
+	for (const InputEvent& event : inputEvents) {
+		const bool pressed = (event.type == InputEvent::Type::KeyDown) || (event.type == InputEvent::Type::ButtonDown);
+		switch (event.type) {
+		case InputEvent::Type::KeyDown:
+		case InputEvent::Type::KeyUp:
+			input.keys.set(event.code, pressed);
+			break;
+		case InputEvent::Type::ButtonDown:
+		case InputEvent::Type::ButtonUp:
+			if (event.code == sf::Mouse::Left) {
+				input.mouseLeft = pressed;
+			} else if (event.code == sf::Mouse::Right) {
+				input.mouseRight = pressed;
+			} else if (event.code == sf::Mouse::Middle) {
+				input.mouseMiddle = pressed;
+			}
+			break;
+		case InputEvent::Type::CursorMove:
+			mousePos = glm::vec2(event.position);
+			break;
+		}
+	}
+	camera.mouse.buttons.left = mouseButtons.left = input.mouseLeft;
+	camera.mouse.buttons.right = mouseButtons.right = input.mouseRight;
+	mouseButtons.middle = input.mouseMiddle;
+	camera.keyStates = input.keys;
+}
+
+uint32_t VulkanApplication::getRandomSeed() const
+{
+	if (inputRecorder.isRecording() || inputRecorder.isReplaying()) {
+		return inputRecorder.getSeed();
+	}
+	return benchmark.active ? benchmark.seed : static_cast<uint32_t>(time(nullptr));
+}
+
+void VulkanApplication::submitCompute(VulkanFrameObjects& frame)
+{
+	const RenderGraphQueueSync& sync = frame.computeSync;
+	// Frame numbers are only increased by the graphics submission, so this is the last frame submitted before the current one
+	const uint64_t graphicsWaitValue = submittedFrames;
+	const uint64_t signalValue = ++computeTimelineValue;
+	const bool waitForGraphics = sync.computeWaitsForGraphics && (graphicsWaitValue > 0);
+	const VkPipelineStageFlags waitStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = waitForGraphics ? 1u : 0u,
+		.pWaitSemaphoreValues = &graphicsWaitValue,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &signalValue
+	};
 	VkSubmitInfo submitInfo = vks::initializers::submitInfo();
-	submitInfo.pWaitDstStageMask = &submitWaitStages;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &frame.presentCompleteSemaphore;
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &frame.renderCompleteSemaphore;
+	submitInfo.pNext = &timelineSubmitInfo;
+	if (waitForGraphics) {
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &frameTimelineSemaphore;
+		submitInfo.pWaitDstStageMask = &waitStages;
+	}
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &frame.commandBuffer->handle;
-	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frame.renderCompleteFence));
-
-	// Present image to queue
-	VkResult result = swapChain->queuePresent(queue, currentBuffer, frame.renderCompleteSemaphore);
-	if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR))) {
-		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-			// Swap chain is no longer compatible with the surface and needs to be recreated
-			windowResize();
-			return;
+	submitInfo.pCommandBuffers = &frame.computeCommandBuffer->handle;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &computeTimelineSemaphore;
+	VK_CHECK_RESULT(vulkanDevice->queueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
+}
+
+void VulkanApplication::submitFrame(VulkanFrameObjects& frame)
+{
+	std::vector<VkSubmitInfo> submitInfos;
+
+	// Async compute work of the frame is submitted first, the graphics work only waits for it at the stages that use its results
+	VkPipelineStageFlags2 computeWaitStageMask = frame.computeSync.graphicsWaitStageMask;
+	if (frame.computeSync.computeRecorded) {
+		submitCompute(frame);
+		// Frame objects and deferred deletions only track the graphics submission, so it always waits for the frame's compute work
+		if (computeWaitStageMask == VK_PIPELINE_STAGE_2_NONE) {
+			computeWaitStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
 		}
-		else {
-			VK_CHECK_RESULT(result);
+	}
+	frame.computeSync = {};
+
+	// Resources uploaded on the transfer queue since the last frame are acquired in a separate batch waiting for the uploads to finish
+	// The acquire barriers order all later work on this queue, so only that batch has to wait for the timeline semaphore
+	frame.uploadAcquireCommandBuffer->begin();
+	const uint64_t uploadWaitValue = VulkanContext::stagingBuffer->recordAcquireBarriers(frame.uploadAcquireCommandBuffer->handle);
+	frame.uploadAcquireCommandBuffer->end();
+	const VkSemaphore uploadSemaphore = VulkanContext::stagingBuffer->getTimelineSemaphore();
+	const VkPipelineStageFlags uploadWaitStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkTimelineSemaphoreSubmitInfo uploadTimelineSubmitInfo{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = 1,
+		.pWaitSemaphoreValues = &uploadWaitValue
+	};
+	if (uploadWaitValue > 0) {
+		VkSubmitInfo uploadSubmitInfo = vks::initializers::submitInfo();
+		uploadSubmitInfo.pNext = &uploadTimelineSubmitInfo;
+		uploadSubmitInfo.waitSemaphoreCount = 1;
+		uploadSubmitInfo.pWaitSemaphores = &uploadSemaphore;
+		uploadSubmitInfo.pWaitDstStageMask = &uploadWaitStages;
+		uploadSubmitInfo.commandBufferCount = 1;
+		uploadSubmitInfo.pCommandBuffers = &frame.uploadAcquireCommandBuffer->handle;
+		submitInfos.push_back(uploadSubmitInfo);
+	}
+
+	// Submit command buffer to queue, signalling the frame timeline with this frame's number
+	frame.frameNumber = ++submittedFrames;
+	// Offscreen images of headless mode aren't acquired or presented, they are only reused once a later frame has waited for the frame timeline (see SwapChain::initHeadless)
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<uint64_t> waitValues;
+	std::vector<VkPipelineStageFlags> submitWaitStages;
+	if (!swapChain->headless) {
+		waitSemaphores.push_back(frame.presentCompleteSemaphore);
+		waitValues.push_back(0);
+		submitWaitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	}
+	if (frame.waitSemaphore != VK_NULL_HANDLE) {
+		waitSemaphores.push_back(frame.waitSemaphore);
+		waitValues.push_back(frame.waitValue);
+		submitWaitStages.push_back(frame.waitStageMask);
+		frame.waitSemaphore = VK_NULL_HANDLE;
+	}
+	// Results of earlier frames' compute work are covered by the latest value, as the compute queue executes its submissions in order
+	if ((computeWaitStageMask != VK_PIPELINE_STAGE_2_NONE) && (computeTimelineValue > 0)) {
+		waitSemaphores.push_back(computeTimelineSemaphore);
+		waitValues.push_back(computeTimelineValue);
+		// Legacy stage flags for vkQueueSubmit, synchronization2 stages without an equivalent (e.g. copy) fall back to all commands
+		VkPipelineStageFlags waitStageMask = static_cast<VkPipelineStageFlags>(computeWaitStageMask & 0xFFFFFFFFull);
+		if ((computeWaitStageMask >> 32) != 0) {
+			waitStageMask |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
 		}
+		submitWaitStages.push_back(waitStageMask);
+	}
+	const std::array<VkSemaphore, 2> signalSemaphores{ frame.renderCompleteSemaphore, frameTimelineSemaphore };
+	// Values for binary semaphores are ignored
+	const std::array<uint64_t, 2> signalValues{ 0, frame.frameNumber };
+	// Only the frame timeline is signalled in headless mode
+	const uint32_t signalOffset = swapChain->headless ? 1 : 0;
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size()),
+		.pWaitSemaphoreValues = waitValues.data(),
+		.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size()) - signalOffset,
+		.pSignalSemaphoreValues = signalValues.data() + signalOffset
+	};
+	VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.pWaitDstStageMask = submitWaitStages.data();
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size()) - signalOffset;
+	submitInfo.pSignalSemaphores = signalSemaphores.data() + signalOffset;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &frame.commandBuffer->handle;
+	submitInfos.push_back(submitInfo);
+	const auto tSubmit = std::chrono::high_resolution_clock::now();
+	VK_CHECK_RESULT(vulkanDevice->queueSubmit(queue, static_cast<uint32_t>(submitInfos.size()), submitInfos.data(), VK_NULL_HANDLE));
+	const auto tPresent = std::chrono::high_resolution_clock::now();
+	frameBreakdown.submit += std::chrono::duration<float, std::milli>(tPresent - tSubmit).count();
+
+	// Present image to queue, frame numbers are increasing so they also serve as present ids
+	const uint64_t presentId = settings.lowLatency ? frame.frameNumber : 0;
+	VkResult result = swapChain->queuePresent(queue, currentBuffer, frame.renderCompleteSemaphore, presentId, static_cast<uint32_t>(frame.frameNumber));
+	frameBreakdown.present += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tPresent).count();
+	if (presentId > 0) {
+		lastPresentId = presentId;
+		presentedInputSampleTimestamp = inputSampleTimestamp;
+	}
+	if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR) || (result == VK_ERROR_OUT_OF_DATE_KHR))) {
+		VK_CHECK_RESULT(result);
 	}
 
 	frameIndex++;
 	if (frameIndex >= renderAhead) {
 		frameIndex = 0;
 	}
+
+	// Swap chain is no longer compatible with the surface or no longer optimal and needs to be recreated
+	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR) || swapChainSuboptimal) {
+		swapChainSuboptimal = false;
+		windowResize();
+	}
+}
+
+std::string VulkanApplication::getPrewarmedPipelineCacheFileName()
+{
+	const VkPhysicalDeviceProperties& properties = vulkanDevice->properties;
+	char signature[64];
+	snprintf(signature, sizeof(signature), "%04x_%04x_%08x", properties.vendorID, properties.deviceID, properties.driverVersion);
+	return getAssetPath() + "pipelinecaches/" + signature + ".bin";
+}
+
+void VulkanApplication::loadPipelineCacheData(std::vector<char>& data)
+{
+	const VkPhysicalDeviceProperties& properties = vulkanDevice->properties;
+	if (std::filesystem::exists(pipelineCacheFileName)) {
+		if (readPipelineCacheFile(vks::MappedFile(pipelineCacheFileName), properties, data)) {
+			return;
+		}
+		std::cout << "Pipeline cache file is not compatible with the current device or driver\n";
+	}
+	// Fresh installs (or driver updates) start with the cache captured for this device and driver, which may be part of the asset archive
+	const std::string prewarmedFileName = getPrewarmedPipelineCacheFileName();
+	std::shared_ptr<vks::MappedFile> prewarmedFile = vks::vfs::open(prewarmedFileName);
+	if (prewarmedFile && readPipelineCacheFile(*prewarmedFile, properties, data)) {
+		std::cout << "Using prewarmed pipeline cache " << prewarmedFileName << "\n";
+		return;
+	}
+	std::cout << "No compatible pipeline cache found, starting with an empty cache\n";
+}
+
+void VulkanApplication::savePipelineCacheData(const std::string& fileName)
+{
+	size_t dataSize{ 0 };
+	VK_CHECK_RESULT(vkGetPipelineCacheData(*vulkanDevice, pipelineCache, &dataSize, nullptr));
+	std::vector<char> data(dataSize);
+	VK_CHECK_RESULT(vkGetPipelineCacheData(*vulkanDevice, pipelineCache, &dataSize, data.data()));
+
+	const VkPhysicalDeviceProperties& properties = vulkanDevice->properties;
+	PipelineCacheFileHeader header{
+		.magic = pipelineCacheFileMagic,
+		.vendorID = properties.vendorID,
+		.deviceID = properties.deviceID,
+		.driverVersion = properties.driverVersion,
+		.dataSize = dataSize
+	};
+	memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	// Write to a temporary file first and then replace the old one, so an interrupted write never leaves a corrupt cache behind
+	const std::string tempFileName = fileName + ".tmp";
+	{
+		std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "Could not write pipeline cache to " << tempFileName << "\n";
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), dataSize);
+		if (!file.good()) {
+			std::cerr << "Could not write pipeline cache to " << tempFileName << "\n";
+			return;
+		}
+	}
+	std::error_code errorCode;
+	std::filesystem::rename(tempFileName, fileName, errorCode);
+	if (errorCode) {
+		std::cerr << "Could not replace pipeline cache file: " << errorCode.message() << "\n";
+	}
+}
+
+void VulkanApplication::deferDeletion(std::function<void()> deleter)
+{
+	// The next frame to be submitted may also use the object
+	deletionQueue.push_back({ .frameNumber = submittedFrames + 1, .deleter = std::move(deleter) });
+}
+
+void VulkanApplication::deferDeletion(DeviceResource* resource)
+{
+	deferDeletion([resource] { delete resource; });
+}
+
+void VulkanApplication::flushDeletionQueue(uint64_t completedFrameNumber)
+{
+	// Entries are added in frame order
+	while (!deletionQueue.empty() && (deletionQueue.front().frameNumber <= completedFrameNumber)) {
+		deletionQueue.front().deleter();
+		deletionQueue.pop_front();
+	}
 }
 
 uint32_t VulkanApplication::getFrameCount()
@@ -1921,14 +2605,90 @@ uint32_t VulkanApplication::getCurrentFrameIndex()
 	return frameIndex;
 }
 
+uint64_t VulkanApplication::getCompletedFrameNumber()
+{
+	uint64_t completedFrameNumber{ 0 };
+	VK_CHECK_RESULT(vkGetSemaphoreCounterValue(*vulkanDevice, frameTimelineSemaphore, &completedFrameNumber));
+	return completedFrameNumber;
+}
+
+uint64_t VulkanApplication::getRecordingFrameNumber()
+{
+	return submittedFrames + 1;
+}
+
+void VulkanApplication::waitForFrame(uint64_t frameNumber)
+{
+	// Frame numbers start at one, so frame objects that haven't been submitted yet don't wait
+	if (frameNumber == 0) {
+		return;
+	}
+	VkSemaphoreWaitInfo waitInfo{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &frameTimelineSemaphore,
+		.pValues = &frameNumber
+	};
+	const auto tStart = std::chrono::high_resolution_clock::now();
+	VK_CHECK_RESULT(vkWaitSemaphores(*vulkanDevice, &waitInfo, UINT64_MAX));
+	const double fenceWait = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	frameWaitTime += fenceWait;
+	frameBreakdown.fenceWait += static_cast<float>(fenceWait);
+}
+
+std::vector<uint32_t> VulkanApplication::getSharedQueueFamilies() const
+{
+	if (!asyncCompute) {
+		return {};
+	}
+	return { vulkanDevice->queueFamilyIndices.graphics, vulkanDevice->queueFamilyIndices.compute };
+}
+
+VkSemaphore VulkanApplication::createTimelineSemaphore(uint64_t initialValue)
+{
+	VkSemaphoreTypeCreateInfo semaphoreTypeCI{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = initialValue
+	};
+	VkSemaphoreCreateInfo semaphoreCI = vks::initializers::semaphoreCreateInfo();
+	semaphoreCI.pNext = &semaphoreTypeCI;
+	VkSemaphore semaphore{ VK_NULL_HANDLE };
+	VK_CHECK_RESULT(vkCreateSemaphore(*vulkanDevice, &semaphoreCI, nullptr, &semaphore));
+	return semaphore;
+}
+
 void VulkanApplication::createBaseFrameObjects(VulkanFrameObjects& frame)
 {
+	// Pools without per command buffer resets, command buffers are only returned to the initial state by resetting the whole pool
+	frame.commandPool = new CommandPool({
+		.name = "Frame command pool",
+		.queueFamilyIndex = swapChain->queueNodeIndex,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
+	});
 	frame.commandBuffer = new CommandBuffer({
 		.device = *vulkanDevice,
-		.pool = commandPool
+		.pool = frame.commandPool,
+		.name = "Frame command buffer"
+	});
+	frame.commandBuffer->profiler = gpuProfiler;
+	frame.uploadAcquireCommandBuffer = new CommandBuffer({
+		.device = *vulkanDevice,
+		.pool = frame.commandPool,
+		.name = "Upload acquire command buffer"
 	});
-	VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-	VK_CHECK_RESULT(vkCreateFence(*vulkanDevice, &fenceCreateInfo, nullptr, &frame.renderCompleteFence));
+	if (asyncCompute) {
+		frame.computeCommandPool = new CommandPool({
+			.name = "Frame async compute command pool",
+			.queueFamilyIndex = vulkanDevice->queueFamilyIndices.compute,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
+		});
+		frame.computeCommandBuffer = new CommandBuffer({
+			.device = *vulkanDevice,
+			.pool = frame.computeCommandPool,
+			.name = "Frame async compute command buffer"
+		});
+	}
 	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
 	VK_CHECK_RESULT(vkCreateSemaphore(*vulkanDevice, &semaphoreCreateInfo, nullptr, &frame.presentCompleteSemaphore));
 	VK_CHECK_RESULT(vkCreateSemaphore(*vulkanDevice, &semaphoreCreateInfo, nullptr, &frame.renderCompleteSemaphore));
@@ -1936,14 +2696,79 @@ void VulkanApplication::createBaseFrameObjects(VulkanFrameObjects& frame)
 
 void VulkanApplication::destroyBaseFrameObjects(VulkanFrameObjects& frame)
 {
-	vkDestroyFence(*vulkanDevice, frame.renderCompleteFence, nullptr);
+	delete frame.commandBuffer;
+	delete frame.uploadAcquireCommandBuffer;
+	delete frame.computeCommandBuffer;
+	// Also frees command buffers the application allocated from the frame's pools
+	delete frame.commandPool;
+	delete frame.computeCommandPool;
 	vkDestroySemaphore(*vulkanDevice, frame.presentCompleteSemaphore, nullptr);
 	vkDestroySemaphore(*vulkanDevice, frame.renderCompleteSemaphore, nullptr);
 }
 
+void VulkanApplication::beginScreenRendering(CommandBuffer* cb, VkRenderingInfo& renderingInfo)
+{
+	if (!swapChain->multiDevicePresent) {
+		cb->beginRendering(renderingInfo);
+		return;
+	}
+	const VkRect2D& renderArea = renderingInfo.renderArea;
+	std::vector<VkRect2D> deviceRenderAreas(swapChain->deviceRegions.size());
+	uint32_t deviceMask = 0;
+	for (size_t i = 0; i < deviceRenderAreas.size(); i++) {
+		const VkRect2D& region = swapChain->deviceRegions[i];
+		if ((region.extent.width == 0) || (region.extent.height == 0)) {
+			// Devices that don't present anything are left out of the mask, but still need a valid area
+			deviceRenderAreas[i] = { renderArea.offset, { 1, 1 } };
+			continue;
+		}
+		// Rounded outwards, so scaled regions still cover all pixels between them
+		const uint32_t x0 = static_cast<uint32_t>(static_cast<uint64_t>(region.offset.x) * renderArea.extent.width / width);
+		const uint32_t y0 = static_cast<uint32_t>(static_cast<uint64_t>(region.offset.y) * renderArea.extent.height / height);
+		const uint32_t x1 = static_cast<uint32_t>((static_cast<uint64_t>(region.offset.x + region.extent.width) * renderArea.extent.width + width - 1) / width);
+		const uint32_t y1 = static_cast<uint32_t>((static_cast<uint64_t>(region.offset.y + region.extent.height) * renderArea.extent.height + height - 1) / height);
+		deviceRenderAreas[i] = {
+			{ renderArea.offset.x + static_cast<int32_t>(x0), renderArea.offset.y + static_cast<int32_t>(y0) },
+			{ std::max(std::min(x1, renderArea.extent.width) - x0, 1u), std::max(std::min(y1, renderArea.extent.height) - y0, 1u) }
+		};
+		deviceMask |= 1u << i;
+	}
+	if (deviceMask == 0) {
+		deviceMask = vulkanDevice->getDeviceMask();
+	}
+	VkDeviceGroupRenderPassBeginInfo deviceGroupBeginInfo{
+		.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_RENDER_PASS_BEGIN_INFO,
+		.pNext = renderingInfo.pNext,
+		.deviceMask = deviceMask,
+		.deviceRenderAreaCount = static_cast<uint32_t>(deviceRenderAreas.size()),
+		.pDeviceRenderAreas = deviceRenderAreas.data()
+	};
+	const void* pNext = renderingInfo.pNext;
+	renderingInfo.pNext = &deviceGroupBeginInfo;
+	cb->beginRendering(renderingInfo);
+	renderingInfo.pNext = pNext;
+}
+
+void VulkanApplication::updatePresentTiming()
+{
+	if (!vulkanDevice->hasDisplayTiming) {
+		return;
+	}
+	swapChain->getPastPresentationTimings(pastPresentationTimings);
+	if (pastPresentationTimings.empty()) {
+		return;
+	}
+	const uint64_t refreshDuration = swapChain->getRefreshCycleDuration();
+	for (const VkPastPresentationTimingGOOGLE& timing : pastPresentationTimings) {
+		presentTiming.addPresent(timing.actualPresentTime, timing.presentID, refreshDuration);
+	}
+}
+
 void VulkanApplication::nextFrame()
 {
 	auto tStart = std::chrono::high_resolution_clock::now();
+	frameWaitTime = 0.0;
+	frameBreakdown = {};
 
 	// Check if the overlay's index and vertex buffers needs to be updated (recreated), e.g. because new elements are visible and indices or vertices require additional buffer space
 	// TODO: Cap UI overlay update rates
@@ -1964,10 +2789,61 @@ void VulkanApplication::nextFrame()
 	auto tEnd = std::chrono::high_resolution_clock::now();
 	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
 	frameTimer = (float)tDiff / 1000.0f;
-	camera.update(frameTimer);
-	if (camera.moving())
-	{
-		viewUpdated = true;
+	if (settings.vsync && presentTiming.isValid()) {
+		// Presented frames advance by whole refresh cycles, so this doesn't carry the jitter of when frames were recorded
+		frameTimer = presentTiming.getFrameInterval();
+	}
+	cpuFrameTime = static_cast<float>(tDiff - frameWaitTime);
+	lastFrameBreakdown = frameBreakdown;
+	// The GPU time is that of the last completed frame, which lags behind by the number of frames in flight
+	const FrameBound frameBound = frameBoundClassifier.addFrame(frameBreakdown, static_cast<float>(tDiff), cpuFrameTime, gpuProfiler ? gpuProfiler->getFrameTime() : 0.0f);
+	TracyPlot("Fence wait", frameBreakdown.fenceWait);
+	TracyPlot("Acquire wait", frameBreakdown.acquireWait);
+	TracyPlot("Pacing wait", frameBreakdown.pacingWait);
+#if defined(__ANDROID__)
+	vks::android::reportActualWorkDuration(static_cast<int64_t>(static_cast<double>(cpuFrameTime) * 1.0e6));
+	thermalHeadroomTimer -= frameTimer;
+	if (thermalHeadroomTimer <= 0.0f) {
+		thermalHeadroom = vks::android::getThermalHeadroom(10);
+		thermalHeadroomTimer = 2.0f;
+	}
+	thermalQuality.update(vks::android::getThermalStatus(), thermalHeadroom, frameTimer);
+#endif
+	frameTimeRecorder.addFrame(static_cast<float>(tDiff));
+	if (benchmark.active) {
+		benchmark.addFrame({ .frameTime = static_cast<float>(tDiff), .cpuTime = cpuFrameTime, .gpuTime = gpuProfiler->getFrameTime(), .breakdown = frameBreakdown, .bound = frameBound, .stats = frameStats, .pipelineStatistics = gpuProfiler->getPipelineStatistics() });
+		if (benchmark.isFinished()) {
+			benchmark.saveResults(vulkanDevice->properties.deviceName);
+			if (window) {
+				window->close();
+			}
+			exitRequested = true;
+		}
+		// Animations and simulation advance by the same amount every frame, so runs are reproducible
+		frameTimer = benchmark.timeStep;
+	}
+	if (inputRecorder.isRecording()) {
+		input.deltaTime = frameTimer;
+		inputRecorder.writeFrame(input);
+	}
+	if (inputRecorder.isReplaying()) {
+		frameTimer = input.deltaTime;
+		if (inputRecorder.isFinished()) {
+			std::cout << "Input replay finished after " << inputRecorder.getFrameIndex() << " frames\n";
+			if (window) {
+				window->close();
+			}
+			exitRequested = true;
+		}
+	}
+	input.keyPresses.clear();
+	// In low latency mode the camera is updated in prepareFrame instead, once the next frame no longer needs to wait
+	if (!settings.lowLatency) {
+		camera.update(frameTimer);
+		if (camera.moving())
+		{
+			viewUpdated = true;
+		}
 	}
 	// Convert to clamped timer value
 	if (!paused)
@@ -23,6 +23,7 @@
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
 #include <wayland-client.h>
 #include "xdg-shell-client-protocol.h"
+#include "presentation-time-client-protocol.h"
 #elif defined(_DIRECT2DISPLAY)
 //
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
@@ -40,6 +41,9 @@
 #include <string>
 #include <array>
 #include <numeric>
+#include <algorithm>
+#include <deque>
+#include <functional>
 
 #include "volk.h"
 
@@ -53,9 +57,22 @@
 #include "Camera.hpp"
 
 #include "CommandBuffer.hpp"
+#include "RenderGraph.h"
 #include "CommandPool.hpp"
+#include "StagingBuffer.hpp"
 
 #include "CommandLineParser.hpp"
+#include "Benchmark.h"
+#include "InputRecorder.h"
+#include "InputThread.hpp"
+#include "GpuProfiler.h"
+#include "FrameTimeRecorder.h"
+#include "StartupProfiler.h"
+#include "TraceRecorder.h"
+#include "FrameLimiter.hpp"
+#include "FrameBreakdown.hpp"
+#include "ThermalQuality.hpp"
+#include "PresentTiming.hpp"
 
 #include "tracy/Tracy.hpp"
 #include "tracy/TracyVulkan.hpp"
@@ -64,16 +81,36 @@
 
 struct VulkanFrameObjects
 {
+	// Transient pools all per-frame command buffers are allocated from, reset as a whole by prepareFrame once the frame's last submission has finished
+	// Command buffers that are recorded once and executed across frames (e.g. cached secondary command buffers) need to come from a pool that isn't reset
+	CommandPool* commandPool{ nullptr };
+	CommandPool* computeCommandPool{ nullptr };
 	CommandBuffer* commandBuffer;
-	VkFence renderCompleteFence;
+	// Takes ownership of resources uploaded on the transfer queue, submitted ahead of commandBuffer
+	CommandBuffer* uploadAcquireCommandBuffer;
+	// Only created if async compute is available, async compute passes of the render graph are recorded into it
+	CommandBuffer* computeCommandBuffer{ nullptr };
+	// Set from the render graph's execution, the compute command buffer is only submitted if passes have been recorded into it
+	// Only applies to the next submit and is reset afterwards
+	RenderGraphQueueSync computeSync{};
+	// Number of the last frame submitted with this frame's objects, completed once the frame timeline semaphore reaches it
+	uint64_t frameNumber{ 0 };
+	// Binary semaphores are still required for acquiring and presenting swap chain images
 	VkSemaphore renderCompleteSemaphore;
 	VkSemaphore presentCompleteSemaphore;
+	// Optional, signalled by work of this frame submitted to another queue (e.g. async compute), commandBuffer waits for it at waitStageMask
+	// For timeline semaphores, waitValue is the value to wait for (ignored for binary semaphores)
+	// Only applies to the next submit and is reset afterwards
+	VkSemaphore waitSemaphore{ VK_NULL_HANDLE };
+	uint64_t waitValue{ 0 };
+	VkPipelineStageFlags waitStageMask{ 0 };
 };
 
+// Frame buffer attachment owned by the render graph, image and view change whenever the graph is compiled
 struct ImageAttachment {
 	VkImage image = VK_NULL_HANDLE;
-	VkImageView view;
-	VkDeviceMemory memory;
+	VkImageView view = VK_NULL_HANDLE;
+	RenderGraphResource resource = UINT32_MAX;
 };
 
 class VulkanApplication
@@ -88,27 +125,116 @@ private:
 	VkDebugUtilsMessengerEXT debugUtilsMessenger;
 	VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures{};
 	CommandLineParser commandLineParser;
+	const std::string pipelineCacheFileName = "pipelinecache.bin";
+	// Written once the application is destroyed if set, see TraceRecorder
+	std::string traceFileName;
+	// Written on exit in addition to the regular pipeline cache file if set, see getPrewarmedPipelineCacheFileName
+	bool capturePipelineCache{ false };
+	// Pipeline caches shipped with the assets, one per device and driver (pipelinecaches/vendor_device_driver.bin below the asset path)
+	std::string getPrewarmedPipelineCacheFileName();
+	// Falls back to the prewarmed cache if there is no (compatible) cache from an earlier run
+	void loadPipelineCacheData(std::vector<char>& data);
+	void savePipelineCacheData(const std::string& fileName);
+	struct DeferredDeletion {
+		uint64_t frameNumber;
+		std::function<void()> deleter;
+	};
+	std::deque<DeferredDeletion> deletionQueue;
+	uint64_t submittedFrames{ 0 };
+	// Signalled with the frame number by each frame's submission to the graphics queue
+	VkSemaphore frameTimelineSemaphore{ VK_NULL_HANDLE };
+	// Signalled by each submission to the compute queue
+	VkSemaphore computeTimelineSemaphore{ VK_NULL_HANDLE };
+	uint64_t computeTimelineValue{ 0 };
+	CommandPool* computeCommandPool{ nullptr };
+	void submitCompute(VulkanFrameObjects& frame);
+	// Set if VK_EXT_surface_maintenance1 has been enabled on the instance, required for swap chain present fences
+	bool surfaceMaintenance1{ false };
+	// Enabled for validation messages and for naming objects and labeling command buffer scopes in capture tools, which expose the extension while capturing
+	bool debugUtils{ false };
+	// Set if the image of the current frame has been acquired from a suboptimal swap chain, which is recreated after presenting it
+	bool swapChainSuboptimal{ false };
 protected:
+	// Runs the deleters of all frames up to the given one, derived classes can flush the queue on destruction if deleters depend on their objects
+	void flushDeletionQueue(uint64_t completedFrameNumber);
 	struct MultisampleTarget {
 		ImageAttachment color;
 		ImageAttachment depth;
 	} multisampleTarget;
 	ImageAttachment depthStencil;
+	// Frame buffer attachments are transient images of the render graph, derived classes add their passes to it
+	RenderGraph* renderGraph{ nullptr };
+	// Set to the image acquired for the current frame, transitioned for presentation at the end of the graph
+	RenderGraphResource swapChainResource{ UINT32_MAX };
+	/** @brief (Re)creates the render graph's transient images and updates the frame buffer attachments, the device must be idle */
+	void compileRenderGraph();
+	/**
+	* Begins a rendering scope for screen space attachments, with multi device presentation each physical device only rasterizes the region it presents
+	* Regions are scaled to the render area, so scopes rendered at a lower resolution (e.g. dynamic resolution) are split the same way
+	* Passes that read neighboring pixels (e.g. filters) only see the device's own region, so results differ slightly along the borders between devices
+	*/
+	void beginScreenRendering(CommandBuffer* cb, VkRenderingInfo& renderingInfo);
 	uint32_t frameCounter = 0;
 	uint32_t lastFPS = 0;
+	// Time spent waiting for frames in flight, swap chain images and frame pacing during the current frame in milliseconds, excluded from the CPU time of benchmark frames
+	double frameWaitTime = 0.0;
+	// Duration of the last frame in milliseconds without frameWaitTime, compared against the GPU time to tell if rendering is CPU or GPU bound
+	float cpuFrameTime = 0.0f;
+	// Waits and CPU work of the current frame, the base class times the waits, submit and present, applications time their own phases
+	FrameBreakdown frameBreakdown;
+	// Breakdown of the last completed frame, as shown in the overlay
+	FrameBreakdown lastFrameBreakdown;
+	FrameBoundClassifier frameBoundClassifier;
+	// Paces frames while settings.limitFrameRate is set, its waits count towards frameWaitTime
+	FrameLimiter frameLimiter;
+	// Queried once the limit first matches the display and again after resizes, which includes moving to a different display for fullscreen windows
+	float displayRefreshRate = 0.0f;
+	// Intervals of presented frames, from VK_GOOGLE_display_timing or (with the Wayland backend) wp_presentation feedback
+	// While valid and vsync is enabled, animations and simulation advance by the presented interval, and the frame limiter uses the measured refresh rate
+	PresentTiming presentTiming;
+	std::vector<VkPastPresentationTimingGOOGLE> pastPresentationTimings;
+	/** @brief Adds presents that completed since the last call to presentTiming */
+	void updatePresentTiming();
+	// Quality limits for the derived class to apply, updated from the thermal status on Android and at full quality elsewhere
+	ThermalQuality thermalQuality;
+#if defined(__ANDROID__)
+	// Last headroom forecast and time until it's queried again, as the system rate limits the queries
+	float thermalHeadroom = NAN;
+	float thermalHeadroomTimer = 0.0f;
+#endif
+	// Time since the overlay has last been rebuilt and the input it was built with, input changes rebuild it right away
+	float overlayElapsedTime = 0.0f;
+	glm::vec2 overlayMousePos{ -1.0f };
+	bool overlayMouseDown[2]{ false, false };
 	std::chrono::time_point<std::chrono::high_resolution_clock> lastTimestamp;
+	// Id of the last present of the current swap chain, waited for before sampling input in low latency mode
+	uint64_t lastPresentId{ 0 };
+	// When input was sampled for the frame being recorded and for the last presented frame
+	std::chrono::time_point<std::chrono::high_resolution_clock> inputSampleTimestamp;
+	std::chrono::time_point<std::chrono::high_resolution_clock> presentedInputSampleTimestamp;
+	// Time from sampling input to the frame being visible in milliseconds, only measured in low latency mode with present wait
+	float inputLatency = 0.0f;
+	// Events taken from the input thread's queue, kept to reuse the allocation
+	std::vector<InputEvent> inputEvents;
 	VkInstance instance; // @todo: abstract
 	std::vector<const char*> enabledDeviceExtensions;
 	std::vector<const char*> enabledInstanceExtensions;
 	void* deviceCreatepNextChain = nullptr;
 	VkQueue queue; // Use from device
+	// Set if the device has a compute queue family separate from the graphics one, work submitted to it can overlap with graphics work
+	bool asyncCompute{ false };
+	VkQueue computeQueue{ VK_NULL_HANDLE };
+	// Queue families for resources accessed by async compute passes (with concurrent sharing), empty if async compute isn't available
+	std::vector<uint32_t> getSharedQueueFamilies() const;
 	VkFormat depthFormat;
 	CommandPool* commandPool;
 	uint32_t currentBuffer = 0;
 	VkPipelineCache pipelineCache;
 	SwapChain* swapChain;
 	uint32_t frameIndex = 0;
+	// Number of frames in flight, raised up to maxRenderAhead if the swap chain has enough images
 	uint32_t renderAhead = 2;
+	uint32_t maxRenderAhead = 3;
 public: 
 	bool prepared = false;
 	uint32_t width = 1280;
@@ -125,7 +251,42 @@ public:
 		bool validation = false;
 		bool fullscreen = false;
 		bool vsync = false;
+		// Waits for the previous frame to be presented before sampling input for the next one, and keeps fewer images queued for presentation
+		bool lowLatency = false;
 		VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
+		// Keeps attachments that aren't read after the frame (incl. depth) in lazily allocated memory, so they never leave tile memory on tile based GPUs
+		// Derived classes must not read the depth stencil image in this mode
+#if defined(__ANDROID__)
+		bool tileBasedRendering = true;
+#else
+		bool tileBasedRendering = false;
+#endif
+		// Reverse Z with an infinite far plane, use getDepthCompareOp and getDepthClearValue for anything depth tested
+		bool reverseDepth = true;
+		// Renders the scene to an HDR target that's post processed (e.g. bloom, tonemapping) before it's presented
+		bool postProcessing = false;
+		// Paces frames to the target frame rate instead of rendering as fast as possible, e.g. to save power with vsync disabled
+		bool limitFrameRate = false;
+		// Frames per second for the frame rate limit, 0 matches the refresh rate of the display
+		float targetFrameRate = 0.0f;
+		// KTX file below the asset path that's streamed as a virtual texture, empty if the application's default is used
+		std::string virtualTexture;
+		// Diffuse environment lighting from spherical harmonics coefficients instead of an irradiance cubemap
+		bool shIrradiance = false;
+		// Renders to offscreen images without a window or swap chain, the application runs until exit is requested (e.g. by a finished benchmark)
+		bool headless = false;
+		// Creates the device for all GPUs of the selected GPU's device group, each one renders and presents the region of the window on its displays
+		bool deviceGroup = false;
+		// Shading and post processing math in 16 bit floats on devices supporting shaderFloat16, mostly benefits mobile and integrated GPUs
+#if defined(__ANDROID__)
+		bool halfPrecision = true;
+#else
+		bool halfPrecision = false;
+#endif
+		// Simulation state is restored from this file at startup (if it exists) and written to it in intervals, empty to disable snapshots
+		std::string snapshotFile;
+		// Number of elements the GPU compute primitives are checked and timed with at startup before exiting, 0 to skip the check
+		uint32_t primitivesBenchmarkCount = 0;
 	} settings;
 
 	static std::vector<const char*> args;
@@ -140,6 +301,22 @@ public:
 
 	Camera camera;
 
+	// Set up from the command line, derived classes drive the scene from its scripted time while it's active
+	Benchmark benchmark;
+	// Records the input of each frame to a file or replays a recording, set up from the command line
+	InputRecorder inputRecorder;
+	// Input of the current frame, sampled from the devices or read from the replayed recording
+	InputFrame input;
+	// Samples the devices independent of the frame rate if there's a window to sample them for
+	InputThread inputThread;
+
+	// Times the scopes of the frames' command buffers (e.g. render graph passes), frame command buffers are set up to use it
+	GpuProfiler* gpuProfiler{ nullptr };
+	// Commands recorded for the current frame, derived classes set these for the benchmark results
+	RenderStats frameStats;
+	// History of frame times, derived classes add events for work that may cause a hitch (e.g. reloads or asset uploads)
+	FrameTimeRecorder frameTimeRecorder;
+
 	glm::vec3 rotation = glm::vec3();
 	glm::vec3 cameraPos = glm::vec3();
 	glm::vec2 mousePos;
@@ -161,6 +338,8 @@ public:
 	} mouseButtons;
 
 	sf::WindowBase* window{ nullptr };
+	// Ends the render loop in headless mode, where there is no window to close
+	bool exitRequested{ false };
 
 	// OS specific 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -188,6 +367,16 @@ public:
 	wl_surface *surface = nullptr;
 	struct xdg_surface *xdg_surface;
 	struct xdg_toplevel *xdg_toplevel;
+	// Not all compositors support presentation feedback
+	struct wp_presentation *presentation = nullptr;
+	// Feedback is sent in commit order, so counting it gives the id of each present, with gaps for discarded ones
+	uint64_t presentationFeedbackId = 0;
+	/** @brief Requests feedback for the next commit of the surface, i.e. the next present */
+	void requestPresentationFeedback();
+	static void presentationFeedbackPresentedCb(void *data, struct wp_presentation_feedback *feedback,
+			uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh,
+			uint32_t seq_hi, uint32_t seq_lo, uint32_t flags);
+	static void presentationFeedbackDiscardedCb(void *data, struct wp_presentation_feedback *feedback);
 	bool quit = false;
 	bool configured = false;
 
@@ -195,7 +384,7 @@ public:
 	bool quit = false;
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
 	bool quit = false;
-	xcb_connection_t *connection;
+	xcb_connection_t *connection = nullptr;
 	xcb_screen_t *screen;
 	xcb_window_t window;
 	xcb_intern_atom_reply_t *atom_wm_delete_window;
@@ -282,11 +471,16 @@ public:
 	// Can be overriden in derived class to recreate or rebuild resources attached to the frame buffer / swapchain
 	virtual void windowResized();
 
-	// Setup default depth and stencil views
+	// Declare the default depth and stencil attachment with the render graph
 	virtual void setupDepthStencil();
-	// Create framebuffers for all requested swap chain images
-	// Can be overriden in derived class to setup a custom framebuffer (e.g. for MSAA)
+	// Declare the multi sampled color and depth attachments with the render graph
+	// Can be overriden in derived class to setup a custom framebuffer
 	virtual void setupImages();
+	// Depth compare op and clear value matching the depth range (settings.reverseDepth)
+	VkCompareOp getDepthCompareOp() const;
+	float getDepthClearValue() const;
+	// Resolve mode that keeps the farthest sample of multi sampled depth (min. with reverse Z, max. otherwise), VK_RESOLVE_MODE_NONE if the device doesn't support it
+	VkResolveModeFlagBits getFarthestDepthResolveMode() const;
 
 	// Connect and prepare the swap chain
 	void initSwapchain();
@@ -300,19 +494,43 @@ public:
 	// Render one frame of a render loop on platforms that sync rendering
 	void renderFrame();
 
+	/** @brief Rebuilds the overlay at its update rate (or on input) and updates the frame's overlay buffers, the last draw data is drawn again in between */
 	void updateOverlay(uint32_t frameIndex);
+	// Starts a new ImGui frame and records all overlay elements
+	void buildOverlay();
 
 	void nextFrame();
+	/** @brief Samples (and records) the input for the next frame, or reads it from the replayed recording */
+	void updateInput();
+	/** @brief Applies the changes queued by the input thread since the last call to the current input state */
+	void applyInputEvents();
+	/** @brief Seed for random scene content, fixed for benchmarks and taken from the recording when input is recorded or replayed */
+	uint32_t getRandomSeed() const;
 
 	/** @brief (Virtual) Called when the UI overlay is updating, can be used to add custom elements to the overlay */
 	virtual void OnUpdateOverlay(vks::UIOverlay& overlay);
 
 	// @todo: Functions for reworked proper sync and per-frame resources
 	void prepareFrame(VulkanFrameObjects& frame);
+	/** @brief Updates the camera from the current input state, called by prepareFrame in low latency mode once the frame no longer needs to wait */
+	void sampleInput();
 	void submitFrame(VulkanFrameObjects& frame);
 	uint32_t getFrameCount();
 	uint32_t getCurrentFrameIndex();
+	/** @brief Returns the number of the last frame that has finished executing on the device, doesn't block */
+	uint64_t getCompletedFrameNumber();
+	/** @brief Returns the number the frame that's currently being recorded will be submitted with */
+	uint64_t getRecordingFrameNumber();
+	/** @brief Blocks until the given frame has finished executing on the device */
+	void waitForFrame(uint64_t frameNumber);
+	/** @brief Creates a timeline semaphore, the caller is responsible for destroying it */
+	VkSemaphore createTimelineSemaphore(uint64_t initialValue = 0);
 
 	void createBaseFrameObjects(VulkanFrameObjects& frame);
 	void destroyBaseFrameObjects(VulkanFrameObjects& frame);
+
+	/** @brief Defers destruction of an object that may still be used by frames in flight (including the one currently being recorded) until all of these have finished */
+	void deferDeletion(std::function<void()> deleter);
+	/** @brief Defers deleting a device resource (Buffer, Image, Pipeline, etc.) until all frames in flight that may use it have finished */
+	void deferDeletion(DeviceResource* resource);
 };
\ No newline at end of file
@@ -13,3 +13,6 @@ VulkanContext vulkanContext{};
 VkQueue VulkanContext::copyQueue = VK_NULL_HANDLE;
 VkQueue VulkanContext::graphicsQueue = VK_NULL_HANDLE;
 Device* VulkanContext::device = nullptr;
+StagingBuffer* VulkanContext::stagingBuffer = nullptr;
+SamplerCache* VulkanContext::samplerCache = nullptr;
+SyncPool* VulkanContext::syncPool = nullptr;
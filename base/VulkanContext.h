@@ -11,11 +11,20 @@
 
 #pragma once
 
+class StagingBuffer;
+class SamplerCache;
+class SyncPool;
+
 class VulkanContext {
 public:
 	static VkQueue copyQueue;
 	static VkQueue graphicsQueue;
 	static Device* device;
+	static StagingBuffer* stagingBuffer;
+	// Samplers of textures are shared through this cache instead of being created per texture
+	static SamplerCache* samplerCache;
+	// Fences and semaphores of one-shot submits are taken from and returned to this pool instead of being created per submit
+	static SyncPool* syncPool;
 };
 
 extern VulkanContext vulkanContext;
\ No newline at end of file
@@ -0,0 +1,95 @@
+/*
+ * Precompiled SPIR-V shader bundle
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "ShaderBundle.hpp"
+#include "VulkanContext.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+
+ShaderBundle* shaderBundle{ nullptr };
+
+// Matches the version written by data/shaders/pack_shader_bundle.cmake
+const uint32_t shaderBundleVersion = 1;
+
+ShaderBundle::ShaderBundle(const std::string& filename, const std::string& shaderDirectory) : shaderDirectory(std::filesystem::path(shaderDirectory).lexically_normal())
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		throw std::runtime_error("Could not open shader bundle " + filename);
+	}
+	const size_t fileSize = static_cast<size_t>(file.tellg());
+	file.seekg(0);
+
+	std::string line;
+	uint32_t version{ 0 };
+	if (!std::getline(file, line) || (sscanf(line.c_str(), "SPVBUNDLE %u", &version) != 1) || (version != shaderBundleVersion)) {
+		throw std::runtime_error("Shader bundle " + filename + " has an unsupported format");
+	}
+	size_t dataSize{ 0 };
+	while (std::getline(file, line) && (line != "END")) {
+		std::istringstream stream(line);
+		Entry entry{};
+		std::string key;
+		if (!(stream >> entry.offset >> entry.size >> key) || (entry.offset % sizeof(uint32_t) != 0) || (entry.size % sizeof(uint32_t) != 0)) {
+			throw std::runtime_error("Shader bundle " + filename + " has a malformed entry");
+		}
+		dataSize = std::max(dataSize, entry.offset + entry.size);
+		entries[key] = entry;
+	}
+	const size_t dataStart = static_cast<size_t>(file.tellg());
+	if (!file.good() || (dataStart + dataSize > fileSize)) {
+		throw std::runtime_error("Shader bundle " + filename + " is truncated");
+	}
+	data.resize(dataSize / sizeof(uint32_t));
+	file.read(reinterpret_cast<char*>(data.data()), dataSize);
+}
+
+std::string ShaderBundle::getKey(const std::string& filename, const std::vector<std::string>& defines) const
+{
+	// Same as the keys generated in data/shaders/CMakeLists.txt
+	std::string key = std::filesystem::path(filename).lexically_normal().lexically_relative(shaderDirectory).generic_string();
+	for (const std::string& define : defines) {
+		key += "|" + define;
+	}
+	return key;
+}
+
+const uint32_t* ShaderBundle::getSpirv(const std::string& filename, const std::vector<std::string>& defines, size_t& size) const
+{
+	auto it = entries.find(getKey(filename, defines));
+	if (it == entries.end()) {
+		return nullptr;
+	}
+	size = it->second.size;
+	return &data[it->second.offset / sizeof(uint32_t)];
+}
+
+VkShaderModule ShaderBundle::createShaderModule(const std::string& filename, const std::vector<std::string>& defines) const
+{
+	size_t size{ 0 };
+	const uint32_t* code = getSpirv(filename, defines, size);
+	if (!code) {
+		return VK_NULL_HANDLE;
+	}
+	VkShaderModuleCreateInfo shaderModuleCI{
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = size,
+		.pCode = code
+	};
+	VkShaderModule shaderModule{ VK_NULL_HANDLE };
+	vkCreateShaderModule(VulkanContext::device->logicalDevice, &shaderModuleCI, nullptr, &shaderModule);
+	return shaderModule;
+}
+
+uint32_t ShaderBundle::size() const
+{
+	return static_cast<uint32_t>(entries.size());
+}
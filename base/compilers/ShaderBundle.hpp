@@ -0,0 +1,51 @@
+/*
+ * Precompiled SPIR-V shader bundle
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include "volk.h"
+
+/**
+ * SPIR-V of shaders compiled at build time (by the shader_bundle target, see data/shaders/CMakeLists.txt), so pipelines can be created without compiling at runtime
+ * Shaders are looked up by their path relative to the shader directory and their defines, which need to be listed in data/shaders/variants.txt to be part of the bundle
+ * File layout: A text header ("SPVBUNDLE <version>", one "<offset> <size> <key>" line per shader, "END"), followed by the SPIR-V of all shaders, offsets are relative to the end of the header
+ */
+class ShaderBundle {
+private:
+	struct Entry {
+		size_t offset;
+		size_t size;
+	};
+	std::unordered_map<std::string, Entry> entries;
+	// Kept as words, so the SPIR-V is suitably aligned for creating shader modules
+	std::vector<uint32_t> data;
+	std::filesystem::path shaderDirectory;
+
+	std::string getKey(const std::string& filename, const std::vector<std::string>& defines) const;
+public:
+	/**
+	* Loads a bundle
+	*
+	* @param filename Bundle file
+	* @param shaderDirectory Directory the shader file names passed to createShaderModule are in (e.g. the asset path's shaders directory)
+	* @throws std::runtime_error if the bundle can't be read or is malformed
+	*/
+	ShaderBundle(const std::string& filename, const std::string& shaderDirectory);
+	// Returns VK_NULL_HANDLE if the bundle has no SPIR-V for the shader with this set of defines
+	VkShaderModule createShaderModule(const std::string& filename, const std::vector<std::string>& defines) const;
+	// Returns the SPIR-V of a shader (size in bytes) or nullptr if the bundle doesn't contain it
+	const uint32_t* getSpirv(const std::string& filename, const std::vector<std::string>& defines, size_t& size) const;
+	uint32_t size() const;
+};
+
+// Optional, shaders are compiled at runtime if not set
+extern ShaderBundle* shaderBundle;
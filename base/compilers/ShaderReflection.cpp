@@ -0,0 +1,433 @@
+/*
+ * Reflection of descriptor bindings and push constants from SPIR-V
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "ShaderReflection.hpp"
+#include "ShaderBundle.hpp"
+#include "dxc.hpp"
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+// Only the parts of the SPIR-V specification needed to reflect resources
+namespace spv {
+	const uint32_t magicNumber = 0x07230203;
+
+	enum Op : uint32_t {
+		OpEntryPoint = 15,
+		OpTypeBool = 20,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpVariable = 59,
+		OpDecorate = 71,
+		OpMemberDecorate = 72,
+		OpTypeAccelerationStructureKHR = 5341
+	};
+
+	enum Decoration : uint32_t {
+		DecorationBlock = 2,
+		DecorationBufferBlock = 3,
+		DecorationRowMajor = 4,
+		DecorationArrayStride = 6,
+		DecorationMatrixStride = 7,
+		DecorationBinding = 33,
+		DecorationDescriptorSet = 34,
+		DecorationOffset = 35
+	};
+
+	enum StorageClass : uint32_t {
+		StorageClassUniformConstant = 0,
+		StorageClassUniform = 2,
+		StorageClassPushConstant = 9,
+		StorageClassStorageBuffer = 12
+	};
+
+	enum ExecutionModel : uint32_t {
+		ExecutionModelVertex = 0,
+		ExecutionModelFragment = 4,
+		ExecutionModelGLCompute = 5,
+		ExecutionModelTaskEXT = 5364,
+		ExecutionModelMeshEXT = 5365
+	};
+
+	// Image dimensions that map to other descriptor types than (storage) images
+	const uint32_t DimBuffer = 5;
+	const uint32_t DimSubpassData = 6;
+}
+
+namespace {
+	// Everything the reflection needs to know about an id
+	struct Id {
+		uint32_t opcode{ 0 };
+		// Operands of the defining instruction, without the result id
+		std::vector<uint32_t> operands;
+		uint32_t set{ UINT32_MAX };
+		uint32_t binding{ UINT32_MAX };
+		uint32_t arrayStride{ 0 };
+		bool bufferBlock{ false };
+		// Struct members
+		std::vector<uint32_t> memberOffsets;
+		std::vector<uint32_t> memberMatrixStrides;
+		std::vector<bool> memberRowMajor;
+	};
+
+	class SpirvModule {
+	public:
+		std::vector<Id> ids;
+
+		uint32_t getConstant(uint32_t id) const
+		{
+			const Id& constant = ids[id];
+			return (constant.opcode == spv::OpConstant && constant.operands.size() >= 2) ? constant.operands[1] : 0;
+		}
+
+		// Size a type takes in a block with explicit layout, matrix layout is specified at the member
+		uint32_t getSize(uint32_t typeId, uint32_t matrixStride = 0, bool rowMajor = false) const
+		{
+			const Id& type = ids[typeId];
+			switch (type.opcode) {
+			case spv::OpTypeBool:
+				return 4;
+			case spv::OpTypeInt:
+			case spv::OpTypeFloat:
+				return type.operands[0] / 8;
+			case spv::OpTypeVector:
+				return getSize(type.operands[0]) * type.operands[1];
+			case spv::OpTypeMatrix:
+				// Row major matrices store one stride per component of a column
+				return matrixStride * (rowMajor ? ids[type.operands[0]].operands[1] : type.operands[1]);
+			case spv::OpTypeArray:
+				return type.arrayStride * getConstant(type.operands[1]);
+			case spv::OpTypeStruct: {
+				uint32_t size = 0;
+				for (size_t i = 0; i < type.operands.size(); i++) {
+					const uint32_t offset = (i < type.memberOffsets.size()) ? type.memberOffsets[i] : 0;
+					const uint32_t memberMatrixStride = (i < type.memberMatrixStrides.size()) ? type.memberMatrixStrides[i] : 0;
+					const bool memberRowMajor = (i < type.memberRowMajor.size()) ? type.memberRowMajor[i] : false;
+					size = std::max(size, offset + getSize(type.operands[i], memberMatrixStride, memberRowMajor));
+				}
+				return size;
+			}
+			default:
+				// Runtime arrays and opaque types don't add to the size
+				return 0;
+			}
+		}
+	};
+
+	void growMembers(Id& id, uint32_t member)
+	{
+		if (id.memberOffsets.size() <= member) {
+			id.memberOffsets.resize(member + 1, 0);
+			id.memberMatrixStrides.resize(member + 1, 0);
+			id.memberRowMajor.resize(member + 1, false);
+		}
+	}
+
+	bool getDescriptorType(const SpirvModule& module, uint32_t storageClass, uint32_t typeId, VkDescriptorType& descriptorType)
+	{
+		const Id& type = module.ids[typeId];
+		switch (storageClass) {
+		case spv::StorageClassStorageBuffer:
+			descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			return true;
+		case spv::StorageClassUniform:
+			// Targets before SPIR-V 1.3 (DXC's default) declare storage buffers as uniform buffer blocks
+			descriptorType = type.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			return true;
+		case spv::StorageClassUniformConstant:
+			switch (type.opcode) {
+			case spv::OpTypeSampler:
+				descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+				return true;
+			case spv::OpTypeSampledImage:
+				descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				return true;
+			case spv::OpTypeAccelerationStructureKHR:
+				descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+				return true;
+			case spv::OpTypeImage: {
+				// Operands: sampled type, dim, depth, arrayed, multisampled, sampled (2 = storage)
+				const uint32_t dim = type.operands[1];
+				const bool storage = (type.operands[5] == 2);
+				if (dim == spv::DimBuffer) {
+					descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+				} else if (dim == spv::DimSubpassData) {
+					descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+				} else {
+					descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+				}
+				return true;
+			}
+			default:
+				return false;
+			}
+		default:
+			return false;
+		}
+	}
+
+	VkShaderStageFlags getStage(uint32_t executionModel)
+	{
+		switch (executionModel) {
+		case spv::ExecutionModelVertex:
+			return VK_SHADER_STAGE_VERTEX_BIT;
+		case spv::ExecutionModelFragment:
+			return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case spv::ExecutionModelGLCompute:
+			return VK_SHADER_STAGE_COMPUTE_BIT;
+		case spv::ExecutionModelTaskEXT:
+			return VK_SHADER_STAGE_TASK_BIT_EXT;
+		case spv::ExecutionModelMeshEXT:
+			return VK_SHADER_STAGE_MESH_BIT_EXT;
+		default:
+			return 0;
+		}
+	}
+
+	// Adds a binding or merges it with one already declared, returns false if they don't fit together
+	bool addBinding(std::vector<ReflectedBinding>& bindings, const ReflectedBinding& binding)
+	{
+		auto it = std::find_if(bindings.begin(), bindings.end(), [&binding](const ReflectedBinding& other) { return (other.set == binding.set) && (other.binding == binding.binding); });
+		if (it == bindings.end()) {
+			bindings.push_back(binding);
+			return true;
+		}
+		it->stageFlags |= binding.stageFlags;
+		if (it->descriptorType == binding.descriptorType) {
+			// Runtime sized arrays stay runtime sized
+			it->descriptorCount = ((it->descriptorCount == 0) || (binding.descriptorCount == 0)) ? 0 : std::max(it->descriptorCount, binding.descriptorCount);
+			return true;
+		}
+		// An image and a sampler sharing a binding form a combined image sampler, which may also be declared with several image views (e.g. bindless 2D and cube textures)
+		auto isImageSampler = [](VkDescriptorType type) {
+			return (type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE) || (type == VK_DESCRIPTOR_TYPE_SAMPLER) || (type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		};
+		if (isImageSampler(it->descriptorType) && isImageSampler(binding.descriptorType)) {
+			// The image is the array, the sampler is used with any of its elements
+			if ((it->descriptorType == VK_DESCRIPTOR_TYPE_SAMPLER) || ((binding.descriptorType != VK_DESCRIPTOR_TYPE_SAMPLER) && (binding.descriptorCount == 0))) {
+				it->descriptorCount = binding.descriptorCount;
+			}
+			it->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			return true;
+		}
+		return false;
+	}
+}
+
+ShaderReflection reflectSpirv(const uint32_t* code, size_t wordCount)
+{
+	// Header: magic number, version, generator, bound of ids, schema
+	if ((wordCount < 5) || (code[0] != spv::magicNumber)) {
+		throw std::runtime_error("Not a SPIR-V module");
+	}
+	SpirvModule module;
+	module.ids.resize(code[3]);
+	ShaderReflection reflection{};
+	std::vector<uint32_t> variables;
+
+	auto getId = [&module](uint32_t id) -> Id& {
+		if (id >= module.ids.size()) {
+			throw std::runtime_error("SPIR-V id out of bounds");
+		}
+		return module.ids[id];
+	};
+
+	size_t offset = 5;
+	while (offset < wordCount) {
+		const uint32_t instructionWordCount = code[offset] >> 16;
+		const uint32_t opcode = code[offset] & 0xffff;
+		if ((instructionWordCount == 0) || (offset + instructionWordCount > wordCount)) {
+			throw std::runtime_error("Malformed SPIR-V instruction");
+		}
+		const uint32_t* operands = &code[offset + 1];
+		const uint32_t operandCount = instructionWordCount - 1;
+		switch (opcode) {
+		case spv::OpEntryPoint:
+			if (operandCount >= 1) {
+				reflection.stage |= getStage(operands[0]);
+			}
+			break;
+		case spv::OpDecorate:
+			if (operandCount >= 2) {
+				Id& target = getId(operands[0]);
+				const uint32_t literal = (operandCount >= 3) ? operands[2] : 0;
+				switch (operands[1]) {
+				case spv::DecorationDescriptorSet: target.set = literal; break;
+				case spv::DecorationBinding: target.binding = literal; break;
+				case spv::DecorationArrayStride: target.arrayStride = literal; break;
+				case spv::DecorationBufferBlock: target.bufferBlock = true; break;
+				}
+			}
+			break;
+		case spv::OpMemberDecorate:
+			if (operandCount >= 3) {
+				Id& target = getId(operands[0]);
+				const uint32_t member = operands[1];
+				const uint32_t literal = (operandCount >= 4) ? operands[3] : 0;
+				switch (operands[2]) {
+				case spv::DecorationOffset: growMembers(target, member); target.memberOffsets[member] = literal; break;
+				case spv::DecorationMatrixStride: growMembers(target, member); target.memberMatrixStrides[member] = literal; break;
+				case spv::DecorationRowMajor: growMembers(target, member); target.memberRowMajor[member] = true; break;
+				}
+			}
+			break;
+		case spv::OpTypeBool:
+		case spv::OpTypeInt:
+		case spv::OpTypeFloat:
+		case spv::OpTypeVector:
+		case spv::OpTypeMatrix:
+		case spv::OpTypeImage:
+		case spv::OpTypeSampler:
+		case spv::OpTypeSampledImage:
+		case spv::OpTypeArray:
+		case spv::OpTypeRuntimeArray:
+		case spv::OpTypeStruct:
+		case spv::OpTypePointer:
+		case spv::OpTypeAccelerationStructureKHR:
+			// Result id first
+			if (operandCount >= 1) {
+				Id& id = getId(operands[0]);
+				id.opcode = opcode;
+				id.operands.assign(operands + 1, operands + operandCount);
+			}
+			break;
+		case spv::OpConstant:
+		case spv::OpVariable:
+			// Result type first, then the result id
+			if (operandCount >= 2) {
+				Id& id = getId(operands[1]);
+				id.opcode = opcode;
+				id.operands.assign(operands, operands + operandCount);
+				id.operands.erase(id.operands.begin() + 1);
+				if (opcode == spv::OpVariable) {
+					variables.push_back(operands[1]);
+				}
+			}
+			break;
+		}
+		offset += instructionWordCount;
+	}
+
+	for (uint32_t variableId : variables) {
+		const Id& variable = module.ids[variableId];
+		// Operands: pointer type, storage class
+		if (variable.operands.size() < 2) {
+			continue;
+		}
+		const uint32_t storageClass = variable.operands[1];
+		const Id& pointer = getId(variable.operands[0]);
+		if ((pointer.opcode != spv::OpTypePointer) || (pointer.operands.size() < 2)) {
+			continue;
+		}
+		uint32_t typeId = pointer.operands[1];
+
+		if (storageClass == spv::StorageClassPushConstant) {
+			reflection.pushConstantSize = std::max(reflection.pushConstantSize, module.getSize(typeId));
+			continue;
+		}
+		if ((variable.set == UINT32_MAX) || (variable.binding == UINT32_MAX)) {
+			continue;
+		}
+
+		// Arrays of resources are arrays of descriptors
+		uint32_t descriptorCount = 1;
+		while (true) {
+			const Id& type = getId(typeId);
+			if (type.opcode == spv::OpTypeArray) {
+				descriptorCount *= module.getConstant(type.operands[1]);
+			} else if (type.opcode == spv::OpTypeRuntimeArray) {
+				descriptorCount = 0;
+			} else {
+				break;
+			}
+			typeId = type.operands[0];
+		}
+
+		ReflectedBinding binding{
+			.set = variable.set,
+			.binding = variable.binding,
+			.descriptorCount = descriptorCount,
+			.stageFlags = reflection.stage
+		};
+		if (!getDescriptorType(module, storageClass, typeId, binding.descriptorType)) {
+			continue;
+		}
+		if (!addBinding(reflection.bindings, binding)) {
+			throw std::runtime_error("SPIR-V module declares incompatible resources for set " + std::to_string(binding.set) + " binding " + std::to_string(binding.binding));
+		}
+	}
+
+	std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+		return (a.set != b.set) ? (a.set < b.set) : (a.binding < b.binding);
+	});
+	return reflection;
+}
+
+const ShaderReflection& reflectShader(const ShaderReference& shader)
+{
+	static std::mutex mutex;
+	// Node based, so references stay valid while other shaders are added
+	static std::map<std::string, std::unique_ptr<ShaderReflection>> reflections;
+
+	std::string key = shader.filename;
+	for (const std::string& define : shader.defines) {
+		key += "|" + define;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = reflections.find(key);
+		if (it != reflections.end()) {
+			return *it->second;
+		}
+	}
+
+	// Reflected outside of the lock, so threads reflecting different shaders don't wait for each other compiling
+	std::unique_ptr<ShaderReflection> reflection;
+	size_t size{ 0 };
+	const uint32_t* bundledCode = shaderBundle ? shaderBundle->getSpirv(shader.filename, shader.defines, size) : nullptr;
+	if (bundledCode) {
+		reflection = std::make_unique<ShaderReflection>(reflectSpirv(bundledCode, size / sizeof(uint32_t)));
+	} else {
+		assert(dxcCompiler);
+		const std::vector<uint32_t> spirv = dxcCompiler->compileSpirv(shader.filename, shader.defines);
+		reflection = std::make_unique<ShaderReflection>(reflectSpirv(spirv.data(), spirv.size()));
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	// Another thread may have reflected the same shader in the meantime, which then gets used
+	auto it = reflections.emplace(key, std::move(reflection)).first;
+	return *it->second;
+}
+
+std::vector<ReflectedBinding> getReflectedBindings(const std::vector<ShaderReference>& shaders, uint32_t set)
+{
+	std::vector<ReflectedBinding> bindings;
+	for (const ShaderReference& shader : shaders) {
+		for (const ReflectedBinding& binding : reflectShader(shader).bindings) {
+			if ((binding.set == set) && !addBinding(bindings, binding)) {
+				throw std::runtime_error("Shader " + shader.filename + " declares set " + std::to_string(set) + " binding " + std::to_string(binding.binding) + " with a type other shaders don't use");
+			}
+		}
+	}
+	std::sort(bindings.begin(), bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) { return a.binding < b.binding; });
+	return bindings;
+}
@@ -0,0 +1,55 @@
+/*
+ * Reflection of descriptor bindings and push constants from SPIR-V
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "volk.h"
+
+/** @brief Shader file and the defines it's compiled with, as passed to a pipeline */
+struct ShaderReference {
+	std::string filename;
+	std::vector<std::string> defines{};
+};
+
+struct ReflectedBinding {
+	uint32_t set;
+	uint32_t binding;
+	// Never one of the dynamic buffer types, as these can't be told apart in SPIR-V
+	VkDescriptorType descriptorType;
+	// Zero for runtime sized arrays (e.g. bindless textures)
+	uint32_t descriptorCount;
+	VkShaderStageFlags stageFlags;
+};
+
+struct ShaderReflection {
+	VkShaderStageFlags stage{ 0 };
+	// Sorted by set and binding
+	std::vector<ReflectedBinding> bindings;
+	// Size of the push constant block from its start to the end of its last member, zero if the shader has no push constants
+	uint32_t pushConstantSize{ 0 };
+};
+
+/**
+ * Parses the descriptor bindings and the push constant block of a SPIR-V module
+ * Separate images and samplers sharing a binding (the usual way of declaring combined image samplers in HLSL) are reflected as a single combined image sampler
+ *
+ * @throws std::runtime_error if the code is not a valid SPIR-V module
+ */
+ShaderReflection reflectSpirv(const uint32_t* code, size_t wordCount);
+
+/**
+ * Returns the reflection of a shader, taken from the shader bundle if it contains the shader or compiled with DXC otherwise
+ * Reflections are kept for the lifetime of the application, so layouts sharing shaders only reflect them once
+ * Can be called from any thread
+ */
+const ShaderReflection& reflectShader(const ShaderReference& shader);
+
+/** @brief Merges the bindings of one descriptor set of several shaders, combining the stage flags of bindings used by multiple shaders */
+std::vector<ReflectedBinding> getReflectedBindings(const std::vector<ShaderReference>& shaders, uint32_t set);
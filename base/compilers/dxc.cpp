@@ -7,9 +7,89 @@
  */
 
 #include "dxc.hpp"
+#include "VirtualFileSystem.h"
+#include "StartupProfiler.h"
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <algorithm>
+#include <thread>
+#include <cstring>
 
 Dxc* dxcCompiler{ nullptr };
 
+// Bump when changing anything about the compilation that isn't part of the hashed input (e.g. the DXC version) or the cache file layout
+const uint32_t shaderCacheVersion = 2;
+
+// 64-bit FNV-1a
+static void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+}
+
+// Hashes the contents of a file, returns false if it can't be read
+static bool hashFile(const std::string& filename, uint64_t& hash)
+{
+	const auto file = vks::vfs::open(filename);
+	if (!file) {
+		return false;
+	}
+	hash = 0xcbf29ce484222325ull;
+	hashBytes(hash, file->data(), file->size());
+	return true;
+}
+
+// Loads a source file through the virtual file system, so shaders can also be compiled from an asset archive
+static HRESULT loadSourceBlob(IDxcUtils* utils, const std::string& filename, IDxcBlobEncoding** blob)
+{
+	const auto file = vks::vfs::open(filename);
+	if (!file) {
+		return E_FAIL;
+	}
+	// Copied by DXC, so the blob doesn't depend on the file's lifetime
+	return utils->CreateBlob(file->data(), static_cast<UINT32>(file->size()), DXC_CP_ACP, blob);
+}
+
+// Resolves includes through the virtual file system and records the files it loaded, which are the shader's dependencies
+// Only lives for the duration of a compilation on the compiling thread's stack, so reference counting is not needed
+class RecordingIncludeHandler : public IDxcIncludeHandler {
+private:
+	IDxcUtils* utils{ nullptr };
+public:
+	std::set<std::string> includes;
+
+	RecordingIncludeHandler(IDxcUtils* utils) : utils(utils) {}
+
+	HRESULT STDMETHODCALLTYPE LoadSource(LPCWSTR pFilename, IDxcBlob** ppIncludeSource) override
+	{
+		const std::string filename = std::filesystem::path(std::wstring(pFilename)).lexically_normal().string();
+		IDxcBlobEncoding* blob{ nullptr };
+		const HRESULT hres = loadSourceBlob(utils, filename, &blob);
+		if (SUCCEEDED(hres)) {
+			*ppIncludeSource = blob;
+			includes.insert(filename);
+		}
+		return hres;
+	}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
+	{
+		if ((riid == __uuidof(IDxcIncludeHandler)) || (riid == __uuidof(IUnknown))) {
+			*ppvObject = this;
+			return S_OK;
+		}
+		*ppvObject = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+	ULONG STDMETHODCALLTYPE Release() override { return 1; }
+};
+
 std::string Dxc::fileExtension(const std::string filename) {
 	std::string fname = filename;
 	if (filename.find(".hlsl") != std::string::npos) {
@@ -29,36 +109,157 @@ Dxc::Dxc()
 		throw std::runtime_error("Could not init DXC Library");
 	}
 
-	// Initialize DXC compiler
-	hres = DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler));
-	if (FAILED(hres)) {
-		throw std::runtime_error("Could not init DXC Compiler");
-	}
+	// Initialize DXC compiler and utility for the calling thread
+	getThreadInstances();
+}
 
-	// Initialize DXC utility
-	hres = DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&utils));
-	if (FAILED(hres)) {
-		throw std::runtime_error("Could not init DXC Utiliy");
+Dxc::ThreadInstances& Dxc::getThreadInstances()
+{
+	thread_local ThreadInstances instances{};
+	if (!instances.compiler) {
+		HRESULT hres;
+
+		// Initialize DXC compiler
+		hres = DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&instances.compiler));
+		if (FAILED(hres)) {
+			throw std::runtime_error("Could not init DXC Compiler");
+		}
+
+		// Initialize DXC utility
+		hres = DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&instances.utils));
+		if (FAILED(hres)) {
+			throw std::runtime_error("Could not init DXC Utiliy");
+		}
 	}
+	return instances;
 }
 
 VkShaderStageFlagBits Dxc::getShaderStage(const std::string filename) {
 	std::string ext = fileExtension(filename);
 	assert(shaderStages.find(ext) != shaderStages.end());
-	return shaderStages[ext];
+	return shaderStages.at(ext);
+}
+
+uint64_t Dxc::hashShaderInput(const std::string& filename, const void* source, size_t sourceSize, const std::vector<LPCWSTR>& arguments)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	hashBytes(hash, &shaderCacheVersion, sizeof(shaderCacheVersion));
+	// Includes are resolved relative to the file, so the same source at another path may compile to different SPIR-V
+	hashBytes(hash, filename.data(), filename.size());
+	hashBytes(hash, source, sourceSize);
+	// Arguments also contain the target profile
+	for (auto& argument : arguments) {
+		hashBytes(hash, argument, wcslen(argument) * sizeof(wchar_t));
+	}
+	return hash;
+}
+
+// Cache files start with the included files (count, then hash of the contents, path length and path per file), followed by the SPIR-V
+bool Dxc::loadCachedSpirv(uint64_t hash, std::vector<uint32_t>& spirv, std::set<std::string>& includes)
+{
+	std::stringstream cacheFileName;
+	cacheFileName << std::hex << hash << ".spv";
+	std::ifstream file(cacheDirectory / cacheFileName.str(), std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return false;
+	}
+	const size_t fileSize = static_cast<size_t>(file.tellg());
+	file.seekg(0);
+	uint32_t includeCount{ 0 };
+	file.read(reinterpret_cast<char*>(&includeCount), sizeof(includeCount));
+	for (uint32_t i = 0; (i < includeCount) && file.good(); i++) {
+		uint64_t storedHash{ 0 };
+		uint32_t pathLength{ 0 };
+		file.read(reinterpret_cast<char*>(&storedHash), sizeof(storedHash));
+		file.read(reinterpret_cast<char*>(&pathLength), sizeof(pathLength));
+		if (!file.good() || (pathLength > fileSize)) {
+			return false;
+		}
+		std::string path(pathLength, '\0');
+		file.read(path.data(), pathLength);
+		// Changed or removed includes invalidate the entry
+		uint64_t currentHash{ 0 };
+		if (!file.good() || !hashFile(path, currentHash) || (currentHash != storedHash)) {
+			return false;
+		}
+		includes.insert(path);
+	}
+	if (!file.good()) {
+		return false;
+	}
+	const size_t size = fileSize - static_cast<size_t>(file.tellg());
+	if ((size == 0) || (size % sizeof(uint32_t) != 0)) {
+		return false;
+	}
+	spirv.resize(size / sizeof(uint32_t));
+	file.read(reinterpret_cast<char*>(spirv.data()), size);
+	return file.good();
+}
+
+void Dxc::storeCachedSpirv(uint64_t hash, const void* spirv, size_t size, const std::set<std::string>& includes)
+{
+	std::stringstream cacheFileName;
+	cacheFileName << std::hex << hash << ".spv";
+	const std::filesystem::path cacheFile = cacheDirectory / cacheFileName.str();
+	// Pipelines sharing a shader may be compiled on different threads at the same time, so temp files are per thread
+	std::stringstream tempFileName;
+	tempFileName << cacheFileName.str() << "." << std::this_thread::get_id() << ".tmp";
+	const std::filesystem::path tempFile = cacheDirectory / tempFileName.str();
+	std::error_code errorCode;
+	std::filesystem::create_directories(cacheDirectory, errorCode);
+	{
+		std::ofstream file(tempFile, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "Could not write shader cache file " << tempFile << "\n";
+			return;
+		}
+		const uint32_t includeCount = static_cast<uint32_t>(includes.size());
+		file.write(reinterpret_cast<const char*>(&includeCount), sizeof(includeCount));
+		for (const std::string& include : includes) {
+			// Hashed after the compilation, so a file changing while compiling invalidates the entry on the next load
+			uint64_t includeHash{ 0 };
+			hashFile(include, includeHash);
+			const uint32_t pathLength = static_cast<uint32_t>(include.size());
+			file.write(reinterpret_cast<const char*>(&includeHash), sizeof(includeHash));
+			file.write(reinterpret_cast<const char*>(&pathLength), sizeof(pathLength));
+			file.write(include.data(), pathLength);
+		}
+		file.write(static_cast<const char*>(spirv), size);
+	}
+	// Rename so other processes reading the cache never see a partially written file
+	std::filesystem::rename(tempFile, cacheFile, errorCode);
+}
+
+VkShaderModule Dxc::createShaderModule(const void* spirv, size_t size)
+{
+	VkShaderModuleCreateInfo shaderModuleCI{};
+	shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderModuleCI.codeSize = size;
+	shaderModuleCI.pCode = static_cast<const uint32_t*>(spirv);
+	VkShaderModule shaderModule;
+	vkCreateShaderModule(VulkanContext::device->logicalDevice, &shaderModuleCI, nullptr, &shaderModule);
+	return shaderModule;
 }
 
-VkShaderModule Dxc::compileShader(const std::string filename) {
+VkShaderModule Dxc::compileShader(const std::string filename, const std::vector<std::string>& defines) {
+	const std::vector<uint32_t> spirv = compileSpirv(filename, defines);
+	// Create a Vulkan shader module from the compilation result
+	return createShaderModule(spirv.data(), spirv.size() * sizeof(uint32_t));
+}
+
+std::vector<uint32_t> Dxc::compileSpirv(const std::string filename, const std::vector<std::string>& defines) {
+	// Includes looking up the SPIR-V cache
+	StartupProfiler::Scope startupScope("Shader compile " + filename.substr(filename.find_last_of("/\\") + 1));
 	HRESULT hres;
+	ThreadInstances& instances = getThreadInstances();
 
 	// @todo
 	std::wstring stemp = std::wstring(filename.begin(), filename.end());
 	LPCWSTR shaderfile = stemp.c_str();
 
-	// Load the HLSL text shader from disk
-	uint32_t codePage = DXC_CP_ACP;
+	// Load the HLSL text shader from disk or an asset archive
 	CComPtr<IDxcBlobEncoding> sourceBlob;
-	hres = utils->LoadFile(shaderfile, &codePage, &sourceBlob);
+	hres = loadSourceBlob(instances.utils, filename, &sourceBlob);
 	if (FAILED(hres)) {
 		throw std::runtime_error("Could not load shader file");
 	}
@@ -66,7 +267,19 @@ VkShaderModule Dxc::compileShader(const std::string filename) {
 	// Select target profile based on shader file extension
 	std::string extension = fileExtension(filename);
 	assert(targetProfiles.find(extension) != targetProfiles.end());
-	LPCWSTR targetProfile = targetProfiles[extension];
+	LPCWSTR targetProfile = targetProfiles.at(extension);
+	// Inline ray tracing needs shader model 6.5 and SPIR-V 1.4, so variants using ray queries are compiled with a newer profile and target environment
+	const bool rayQuery = std::find(defines.begin(), defines.end(), "RAY_QUERY") != defines.end();
+	const std::wstring rayQueryProfile = std::wstring(targetProfile).substr(0, 3) + L"6_5";
+	if (rayQuery) {
+		targetProfile = rayQueryProfile.c_str();
+	}
+	// Native 16 bit types (see data/shaders/includes/half_precision.hlsl) need at least shader model 6.2
+	const bool halfPrecision = std::find(defines.begin(), defines.end(), "HALF_PRECISION") != defines.end();
+	const std::wstring halfPrecisionProfile = std::wstring(targetProfile).substr(0, 3) + L"6_2";
+	if (halfPrecision && (std::wstring(targetProfile) < halfPrecisionProfile)) {
+		targetProfile = halfPrecisionProfile.c_str();
+	}
 
 	// Configure the compiler arguments for compiling the HLSL shader to SPIR-V
 	std::vector<LPCWSTR> arguments = {
@@ -79,6 +292,30 @@ VkShaderModule Dxc::compileShader(const std::string filename) {
 		// Compile to SPIRV
 		L"-spirv"
 	};
+	// Task and mesh shaders are only emitted as VK_EXT_mesh_shader (instead of the NV extension) when targeting Vulkan 1.3
+	if (extension == ".task" || extension == ".mesh" || rayQuery) {
+		arguments.push_back(L"-fspv-target-env=vulkan1.3");
+	}
+	if (halfPrecision) {
+		arguments.push_back(L"-enable-16bit-types");
+	}
+	// Defines are part of the arguments, so they're also part of the cache hash
+	std::vector<std::wstring> wideDefines;
+	wideDefines.reserve(defines.size());
+	for (const std::string& define : defines) {
+		wideDefines.push_back(std::wstring(define.begin(), define.end()));
+		arguments.push_back(L"-D");
+		arguments.push_back(wideDefines.back().c_str());
+	}
+
+	// Skip compilation if the SPIR-V for this exact input is already in the cache
+	const uint64_t hash = hashShaderInput(filename, sourceBlob->GetBufferPointer(), sourceBlob->GetBufferSize(), arguments);
+	std::vector<uint32_t> cachedSpirv;
+	std::set<std::string> cachedIncludes;
+	if (loadCachedSpirv(hash, cachedSpirv, cachedIncludes)) {
+		addDependencies(filename, cachedIncludes);
+		return cachedSpirv;
+	}
 
 	// Compile shader
 	DxcBuffer buffer{};
@@ -86,18 +323,22 @@ VkShaderModule Dxc::compileShader(const std::string filename) {
 	buffer.Ptr = sourceBlob->GetBufferPointer();
 	buffer.Size = sourceBlob->GetBufferSize();
 
+	RecordingIncludeHandler includeHandler(instances.utils);
 	CComPtr<IDxcResult> result{ nullptr };
-	hres = compiler->Compile(
+	hres = instances.compiler->Compile(
 		&buffer,
 		arguments.data(),
 		(uint32_t)arguments.size(),
-		nullptr,
+		&includeHandler,
 		IID_PPV_ARGS(&result));
 
 	if (SUCCEEDED(hres)) {
 		result->GetStatus(&hres);
 	}
 
+	// Also recorded if the compilation failed, so fixing an included file triggers a reload
+	addDependencies(filename, includeHandler.includes);
+
 	// Output error if compilation failed
 	if (FAILED(hres) && (result)) {
 		CComPtr<IDxcBlobEncoding> errorBlob;
@@ -112,13 +353,38 @@ VkShaderModule Dxc::compileShader(const std::string filename) {
 	CComPtr<IDxcBlob> code;
 	result->GetResult(&code);
 
-	// Create a Vulkan shader module from the compilation result
-	VkShaderModuleCreateInfo shaderModuleCI{};
-	shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	shaderModuleCI.codeSize = code->GetBufferSize();
-	shaderModuleCI.pCode = (uint32_t*)code->GetBufferPointer();
-	VkShaderModule shaderModule;
-	vkCreateShaderModule(VulkanContext::device->logicalDevice, &shaderModuleCI, nullptr, &shaderModule);
+	storeCachedSpirv(hash, code->GetBufferPointer(), code->GetBufferSize(), includeHandler.includes);
 
-	return shaderModule;
+	std::vector<uint32_t> spirv(code->GetBufferSize() / sizeof(uint32_t));
+	memcpy(spirv.data(), code->GetBufferPointer(), spirv.size() * sizeof(uint32_t));
+	return spirv;
 };
+
+void Dxc::addDependencies(const std::string& filename, const std::set<std::string>& includes)
+{
+	std::lock_guard<std::mutex> lock(dependencyMutex);
+	dependencies[filename].insert(includes.begin(), includes.end());
+}
+
+std::vector<std::string> Dxc::getDependencies(const std::string& filename)
+{
+	std::lock_guard<std::mutex> lock(dependencyMutex);
+	auto it = dependencies.find(filename);
+	if (it == dependencies.end()) {
+		return {};
+	}
+	return std::vector<std::string>(it->second.begin(), it->second.end());
+}
+
+std::vector<std::string> Dxc::getDependentShaders(const std::string& dependency)
+{
+	const std::string path = std::filesystem::path(dependency).lexically_normal().string();
+	std::lock_guard<std::mutex> lock(dependencyMutex);
+	std::vector<std::string> shaders;
+	for (const auto& [filename, includes] : dependencies) {
+		if (includes.contains(path)) {
+			shaders.push_back(filename);
+		}
+	}
+	return shaders;
+}
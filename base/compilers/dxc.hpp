@@ -14,6 +14,9 @@
 #include <vector>
 #include <iostream>
 #include <map>
+#include <set>
+#include <mutex>
+#include <filesystem>
 #include "volk.h"
 #include "dxcapi.h"
 #include "VulkanContext.h"
@@ -21,24 +24,60 @@
 class Dxc {
 private:
 	CComPtr<IDxcLibrary> library{ nullptr };
-	CComPtr<IDxcCompiler3> compiler{ nullptr };
-	CComPtr<IDxcUtils> utils{ nullptr };
+
+	// DXC compiler and utility objects must not be used by multiple threads at once, so each thread compiling shaders gets its own
+	struct ThreadInstances {
+		CComPtr<IDxcCompiler3> compiler{ nullptr };
+		CComPtr<IDxcUtils> utils{ nullptr };
+	};
+	ThreadInstances& getThreadInstances();
 
 	std::map<std::string, VkShaderStageFlagBits> shaderStages{
 		{ ".vert", VK_SHADER_STAGE_VERTEX_BIT },
-		{ ".frag", VK_SHADER_STAGE_FRAGMENT_BIT }
+		{ ".frag", VK_SHADER_STAGE_FRAGMENT_BIT },
+		{ ".comp", VK_SHADER_STAGE_COMPUTE_BIT },
+		{ ".task", VK_SHADER_STAGE_TASK_BIT_EXT },
+		{ ".mesh", VK_SHADER_STAGE_MESH_BIT_EXT }
 	};
 
 	std::map<std::string, LPCWSTR> targetProfiles{
 		{ ".vert", L"vs_6_1" },
-		{ ".frag", L"ps_6_1" }
+		{ ".frag", L"ps_6_1" },
+		{ ".comp", L"cs_6_1" },
+		{ ".task", L"as_6_5" },
+		{ ".mesh", L"ms_6_5" }
 	};
 
+	// Compiled SPIR-V is stored in this directory, using a hash of the shader's source and arguments as the file name
+	// Entries also store the included files with a hash of their contents, an entry is only used if none of them changed
+	const std::filesystem::path cacheDirectory{ "shadercache" };
+
+	// Files included (directly or indirectly) by each shader file, from its last compilation or cache hit, for all sets of defines
+	std::map<std::string, std::set<std::string>> dependencies;
+	std::mutex dependencyMutex;
+
 	std::string fileExtension(const std::string filename);
+	uint64_t hashShaderInput(const std::string& filename, const void* source, size_t sourceSize, const std::vector<LPCWSTR>& arguments);
+	bool loadCachedSpirv(uint64_t hash, std::vector<uint32_t>& spirv, std::set<std::string>& includes);
+	void storeCachedSpirv(uint64_t hash, const void* spirv, size_t size, const std::set<std::string>& includes);
+	void addDependencies(const std::string& filename, const std::set<std::string>& includes);
+	VkShaderModule createShaderModule(const void* spirv, size_t size);
 public:
 	Dxc();
 	VkShaderStageFlagBits getShaderStage(const std::string filename);
-	VkShaderModule compileShader(const std::string filename);
+	/**
+	* Compiles an HLSL shader to SPIR-V and creates a shader module from it, the stage and target profile are derived from the file extension
+	*
+	* @param filename Shader file
+	* @param defines (Optional) Preprocessor defines as NAME or NAME=VALUE, each set of defines is compiled (and cached) separately
+	*/
+	VkShaderModule compileShader(const std::string filename, const std::vector<std::string>& defines = {});
+	// Same as compileShader, but returns the SPIR-V instead of creating a shader module (e.g. for reflection)
+	std::vector<uint32_t> compileSpirv(const std::string filename, const std::vector<std::string>& defines = {});
+	// Files included by a shader file, only known once the shader has been compiled (or loaded from the cache)
+	std::vector<std::string> getDependencies(const std::string& filename);
+	// Shader files that include the given file
+	std::vector<std::string> getDependentShaders(const std::string& dependency);
 };
 
 extern Dxc* dxcCompiler;
\ No newline at end of file
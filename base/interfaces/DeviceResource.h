@@ -15,5 +15,7 @@ class DeviceResource {
 public:
 	std::string name{ "" };
 	DeviceResource(const std::string name = "");
+	// Virtual so resources can be destroyed through a base pointer, e.g. by the deferred deletion queue
+	virtual ~DeviceResource() = default;
 	void setDebugName(uint64_t handle, VkObjectType type);
 };
\ No newline at end of file
@@ -14,21 +14,89 @@
 
 #include "glTF.h"
 #include "ApplicationContext.h"
+#include "Frustum.hpp"
+#include "meshoptimizer.h"
+#include <filesystem>
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define VKS_GLTF_SSE
+#elif defined(__aarch64__) || defined(_M_ARM64)
+// Division and square roots of vectors need AArch64
+#include <arm_neon.h>
+#define VKS_GLTF_NEON
+#endif
 
 namespace vkglTF
 {
-	PushConstBlock pushConstBlock{};
-
-	bool loadImageDataFunc(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int req_width, int req_height, const unsigned char* bytes, int size, void* userData)
+	// Only keeps the encoded image data, so images can be decoded in parallel once the file has been parsed
+	bool deferImageDataFunc(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int req_width, int req_height, const unsigned char* bytes, int size, void* userData)
 	{
-		// KTX files will be handled by our own code
+		// KTX and KTX2 files will be handled by our own code
 		if (image->uri.find_last_of(".") != std::string::npos) {
-			if (image->uri.substr(image->uri.find_last_of(".") + 1) == "ktx") {
+			const std::string extension = image->uri.substr(image->uri.find_last_of(".") + 1);
+			if (extension == "ktx" || extension == "ktx2") {
 				return true;
 			}
 		}
 
-		return tinygltf::LoadImageData(image, imageIndex, error, warning, req_width, req_height, bytes, size, userData);
+		image->image.assign(bytes, bytes + size);
+		static_cast<std::vector<int>*>(userData)->push_back(imageIndex);
+		return true;
+	}
+
+	// glTF files and their external buffers and images are read through the virtual file system, so models can be loaded from asset archives
+	static bool vfsFileExists(const std::string& filename, void* userData)
+	{
+		return vks::vfs::exists(filename);
+	}
+
+	static bool vfsReadWholeFile(std::vector<unsigned char>* out, std::string* error, const std::string& filename, void* userData)
+	{
+		const auto file = vks::vfs::open(filename);
+		if (!file) {
+			if (error) {
+				*error += "File not found : " + filename + "\n";
+			}
+			return false;
+		}
+		out->assign(file->data(), file->data() + file->size());
+		return true;
+	}
+
+	// Runs function on the job system if one is available, batches are sized so the number of jobs stays close to the number of threads
+	static void parallelFor(vks::JobSystem* jobSystem, uint32_t count, const std::function<void(uint32_t first, uint32_t count)>& function)
+	{
+		if (!jobSystem || count <= 1) {
+			function(0, count);
+			return;
+		}
+		const uint32_t batchSize = std::max(count / (jobSystem->getThreadCount() * 4), 1u);
+		jobSystem->parallelFor(count, batchSize, function);
+	}
+
+	// 64-bit FNV-1a
+	static void hashBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+	}
+
+	static CompactVertex compactVertex(const Vertex& vertex)
+	{
+		CompactVertex compact{};
+		compact.pos = vertex.pos;
+		compact.normal = glm::i16vec4(glm::round(glm::clamp(glm::vec4(vertex.normal, 0.0f), -1.0f, 1.0f) * 32767.0f));
+		compact.uv0 = glm::packHalf2x16(vertex.uv0);
+		compact.color = glm::packUnorm4x8(vertex.color);
+		return compact;
 	}
 
 	// Bounding box
@@ -65,85 +133,148 @@ namespace vkglTF
 		return BoundingBox(min, max);
 	}
 
+	// Most devices don't support RGB only on Vulkan so convert if necessary
+	// TODO: Check actual format support and transform only if required
+	// Converted in place, as the mipmap batch reads the pixels once it's submitted
+	static void expandToRGBA(tinygltf::Image& gltfimage)
+	{
+		if (gltfimage.component != 3) {
+			return;
+		}
+		std::vector<unsigned char> rgba(static_cast<size_t>(gltfimage.width) * gltfimage.height * 4, 255);
+		for (size_t p = 0; p < static_cast<size_t>(gltfimage.width) * gltfimage.height; p++) {
+			memcpy(&rgba[p * 4], &gltfimage.image[p * 3], 3);
+		}
+		gltfimage.image = std::move(rgba);
+		gltfimage.component = 4;
+	}
+
+	// Only color images are decoded from sRGB when sampled, there is no 16 bit sRGB format
+	static VkFormat getImageFormat(const tinygltf::Image& gltfimage, bool srgb)
+	{
+		if (gltfimage.pixel_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+			return VK_FORMAT_R16G16B16A16_UNORM;
+		}
+		return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
 	// Texture
 	void Texture::destroy()
-	{	
-		// @todo: textures are managed by the asset manager
-		//vkDestroyImageView(VulkanContext::device->logicalDevice, view, nullptr);
-		//vkDestroyImage(VulkanContext::device->logicalDevice, image, nullptr);
-		//vkFreeMemory(VulkanContext::device->logicalDevice, deviceMemory, nullptr);
-		//vkDestroySampler(VulkanContext::device->logicalDevice, sampler, nullptr);
+	{
+		// Textures are owned by the asset manager, releasing the slot lets the bindless texture table reuse it
+		if (assetIndex != UINT32_MAX) {
+			ApplicationContext::assetManager->removeTexture(assetIndex);
+			assetIndex = UINT32_MAX;
+		}
+	}
+
+	MaterialData Material::getData() const
+	{
+		auto getAssetIndex = [](const Texture* texture) {
+			return texture ? texture->assetIndex : UINT32_MAX;
+		};
+		auto getLayerCode = [](const Texture* texture) {
+			return (texture && texture->arrayLayer != UINT32_MAX) ? texture->arrayLayer + 1 : 0u;
+		};
+		return {
+			.baseColorFactor = baseColorFactor,
+			.emissiveFactor = emissiveFactor * emissiveStrength,
+			.metallicFactor = metallicFactor,
+			.roughnessFactor = roughnessFactor,
+			.alphaCutoff = alphaCutoff,
+			.alphaMode = static_cast<uint32_t>(alphaMode),
+			.baseColorTexture = getAssetIndex(baseColorTexture),
+			.metallicRoughnessTexture = getAssetIndex(metallicRoughnessTexture),
+			.normalTexture = getAssetIndex(normalTexture),
+			.occlusionTexture = getAssetIndex(occlusionTexture),
+			.emissiveTexture = getAssetIndex(emissiveTexture),
+			.textureLayers = {
+				getLayerCode(baseColorTexture) | (getLayerCode(metallicRoughnessTexture) << 8) | (getLayerCode(normalTexture) << 16) | (getLayerCode(occlusionTexture) << 24),
+				getLayerCode(emissiveTexture)
+			},
+		};
 	}
 
-	void Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string filePath, TextureSampler textureSampler)
+	void Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string filePath, TextureSampler textureSampler, bool srgb, vks::MipmapBatch* mipmapBatch, UploadBatch* uploadBatch)
 	{
+		// The same image may already have been uploaded by another model, or by the model a hot reload replaces
+		if (sourceKey != 0) {
+			assetIndex = ApplicationContext::assetManager->acquireTexture(sourceKey);
+			if (assetIndex != UINT32_MAX) {
+				const vks::Texture* sharedTexture = ApplicationContext::assetManager->getTexture(assetIndex);
+				width = sharedTexture->width;
+				height = sharedTexture->height;
+				mipLevels = sharedTexture->mipLevels;
+				createSampler(textureSampler);
+				return;
+			}
+		}
+
 		bool isKtx = false;
+		bool isKtx2 = false;
 		// Image points to an external ktx file
 		if (gltfimage.uri.find_last_of(".") != std::string::npos) {
-			if (gltfimage.uri.substr(gltfimage.uri.find_last_of(".") + 1) == "ktx") {
-				isKtx = true;
-			}
+			const std::string extension = gltfimage.uri.substr(gltfimage.uri.find_last_of(".") + 1);
+			isKtx = (extension == "ktx");
+			isKtx2 = (extension == "ktx2");
 		}
 
-		if (isKtx) {
-			assetIndex = ApplicationContext::assetManager->add(gltfimage.name, new vks::Texture2D({
+		// KTX files come with a mip chain, so these can be streamed
+		auto addKtxTexture = [&gltfimage, uploadBatch](vks::TextureCreateInfo createInfo) {
+			createInfo.uploadBatch = uploadBatch;
+			if (ApplicationContext::assetManager->textureStreamer) {
+				return ApplicationContext::assetManager->textureStreamer->add(gltfimage.name, createInfo);
+			}
+			return ApplicationContext::assetManager->add(gltfimage.name, new vks::Texture2D(createInfo));
+		};
+
+		if (isKtx2) {
+			// Basis Universal images are transcoded to a compressed format supported by the device, the sRGB format only selects the transcode target's color space
+			assetIndex = addKtxTexture({
+				.filename = filePath + "/" + gltfimage.uri,
+				.format = VK_FORMAT_R8G8B8A8_SRGB,
+				.jobSystem = ApplicationContext::assetManager->jobSystem
+			});
+			width = ApplicationContext::assetManager->getTexture(assetIndex)->width;
+			height = ApplicationContext::assetManager->getTexture(assetIndex)->height;
+			mipLevels = ApplicationContext::assetManager->getTexture(assetIndex)->mipLevels;
+		} else if (isKtx) {
+			assetIndex = addKtxTexture({
 				.filename = filePath + "/" + gltfimage.uri,
 				.format = VK_FORMAT_BC3_UNORM_BLOCK,
 				// @todo
 //				.format = VK_FORMAT_R8G8B8A8_UNORM,
 				//.createSampler = false
-			}));
-			width = ApplicationContext::assetManager->textures[assetIndex]->width;
-			height = ApplicationContext::assetManager->textures[assetIndex]->height;
-			mipLevels = ApplicationContext::assetManager->textures[assetIndex]->mipLevels;
+			});
+			width = ApplicationContext::assetManager->getTexture(assetIndex)->width;
+			height = ApplicationContext::assetManager->getTexture(assetIndex)->height;
+			mipLevels = ApplicationContext::assetManager->getTexture(assetIndex)->mipLevels;
 		} else {
-			unsigned char* buffer = nullptr;
-			VkDeviceSize bufferSize = 0;
-			bool deleteBuffer = false;
-			if (gltfimage.component == 3) {
-				// Most devices don't support RGB only on Vulkan so convert if necessary
-				// TODO: Check actual format support and transform only if required
-				bufferSize = gltfimage.width * gltfimage.height * 4;
-				buffer = new unsigned char[bufferSize];
-				unsigned char* rgba = buffer;
-				unsigned char* rgb = &gltfimage.image[0];
-				for (int32_t i = 0; i < gltfimage.width * gltfimage.height; ++i) {
-					for (int32_t j = 0; j < 3; ++j) {
-						rgba[j] = rgb[j];
-					}
-					rgba += 4;
-					rgb += 3;
-				}
-				deleteBuffer = true;
-			}
-			else {
-				buffer = &gltfimage.image[0];
-				bufferSize = gltfimage.image.size();
-			}
-
-			VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
-			if (gltfimage.pixel_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-				format = VK_FORMAT_R16G16B16A16_UNORM;
-			}
+			expandToRGBA(gltfimage);
+			const VkFormat format = getImageFormat(gltfimage, srgb);
 
 			width = gltfimage.width;
 			height = gltfimage.height;
 			mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
 
 			assetIndex = ApplicationContext::assetManager->add(gltfimage.name, new vks::Texture2D({
-				.buffer = buffer,
-				.bufferSize = bufferSize,
+				.buffer = gltfimage.image.data(),
+				.bufferSize = gltfimage.image.size(),
 				.texWidth = width,
 				.texHeight = height,
 				.format = format,
 				// @todo
 				//.createSampler = false
+				.mipmapBatch = mipmapBatch,
 			}));
-
-			if (deleteBuffer)
-				delete[] buffer;
 		}
+		ApplicationContext::assetManager->setTextureContentKey(assetIndex, sourceKey);
+
+		createSampler(textureSampler);
+	}
 
+	void Texture::createSampler(TextureSampler textureSampler)
+	{
 		VkSamplerCreateInfo samplerInfo{};
 		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 		samplerInfo.magFilter = textureSampler.magFilter;
@@ -154,12 +285,12 @@ namespace vkglTF
 		samplerInfo.addressModeW = textureSampler.addressModeW;
 		samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
 		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		samplerInfo.maxAnisotropy = 1.0;
-		samplerInfo.anisotropyEnable = VK_FALSE;
-		samplerInfo.maxLod = (float)mipLevels;
+		// Not clamped to the image's mip count, so all textures with the same glTF sampler share one Vulkan sampler
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 		samplerInfo.maxAnisotropy = 8.0f;
 		samplerInfo.anisotropyEnable = VK_TRUE;
-		VK_CHECK_RESULT(vkCreateSampler(VulkanContext::device->logicalDevice, &samplerInfo, nullptr, &sampler));
+		// Owned by the cache, so destroying the texture doesn't need to destroy it
+		sampler = VulkanContext::samplerCache->get(samplerInfo);
 
 		descriptor.sampler = sampler;
 		descriptor.imageView = view;
@@ -182,18 +313,121 @@ namespace vkglTF
 		// @todo
 	};
 
-	Mesh::~Mesh() {
-		for (Primitive* p : primitives) {
-			delete p;
-		}
-	}
-
 	void Mesh::setBoundingBox(glm::vec3 min, glm::vec3 max) {
 		bb.min = min;
 		bb.max = max;
 		bb.valid = true;
 	}
 
+	// Animation sampler
+	size_t AnimationSampler::findInterval(float time, size_t& cursor) const {
+		const size_t lastInterval = inputs.size() - 2;
+		cursor = std::min(cursor, lastInterval);
+		if ((time >= inputs[cursor]) && (time <= inputs[cursor + 1])) {
+			return cursor;
+		}
+		if ((cursor < lastInterval) && (time >= inputs[cursor + 1]) && (time <= inputs[cursor + 2])) {
+			return ++cursor;
+		}
+		// Jumps (e.g. looping or seeking) fall back to a binary search
+		const size_t upper = std::upper_bound(inputs.begin(), inputs.end(), time) - inputs.begin();
+		cursor = std::min(std::max(upper, size_t(1)) - 1, lastInterval);
+		return cursor;
+	}
+
+	// Max. error of a removed key, relative to the largest extent of the track for translations and scales, per quaternion component for rotations
+	static constexpr float keyReductionTolerance = 1e-4f;
+
+	static glm::vec4 interpolateOutput(const glm::vec4& a, const glm::vec4& b, float u, bool rotation)
+	{
+		if (!rotation) {
+			return glm::mix(a, b, u);
+		}
+		const glm::quat q = glm::normalize(glm::slerp(glm::quat(a.w, a.x, a.y, a.z), glm::quat(b.w, b.x, b.y, b.z), u));
+		return glm::vec4(q.x, q.y, q.z, q.w);
+	}
+
+	static float outputError(const glm::vec4& a, const glm::vec4& b, bool rotation)
+	{
+		const glm::vec4 difference = glm::abs(a - b);
+		float error = std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w));
+		if (rotation) {
+			// q and -q are the same rotation
+			const glm::vec4 negatedDifference = glm::abs(a + b);
+			error = std::min(error, std::max(std::max(negatedDifference.x, negatedDifference.y), std::max(negatedDifference.z, negatedDifference.w)));
+		}
+		return error;
+	}
+
+	void AnimationSampler::compress(const std::vector<glm::vec4>& outputs, bool isRotation) {
+		rotation = isRotation;
+		const size_t count = std::min(inputs.size(), outputs.size());
+		glm::vec3 outputMin(FLT_MAX);
+		glm::vec3 outputMax(-FLT_MAX);
+		for (size_t i = 0; i < count; i++) {
+			outputMin = glm::min(outputMin, glm::vec3(outputs[i]));
+			outputMax = glm::max(outputMax, glm::vec3(outputs[i]));
+		}
+		const glm::vec3 extent = glm::max(outputMax - outputMin, glm::vec3(0.0f));
+		const float tolerance = rotation ? keyReductionTolerance : keyReductionTolerance * std::max(std::max(extent.x, extent.y), extent.z);
+
+		// A key is removed if interpolating between the last kept key and the key after it reproduces it and all keys removed since the last kept one
+		std::vector<size_t> keptKeys;
+		if (count > 0) {
+			keptKeys.push_back(0);
+		}
+		for (size_t key = 1; key + 1 < count; key++) {
+			const size_t anchor = keptKeys.back();
+			const float duration = inputs[key + 1] - inputs[anchor];
+			bool removable = duration > 0.0f;
+			for (size_t i = anchor + 1; (i <= key) && removable; i++) {
+				const float u = (inputs[i] - inputs[anchor]) / duration;
+				removable = outputError(interpolateOutput(outputs[anchor], outputs[key + 1], u, rotation), outputs[i], rotation) <= tolerance;
+			}
+			if (!removable) {
+				keptKeys.push_back(key);
+			}
+		}
+		if (count > 1) {
+			keptKeys.push_back(count - 1);
+		}
+
+		rangeMin = outputMin;
+		rangeStep = extent / 65535.0f;
+		keys.resize(keptKeys.size());
+		std::vector<float> keptInputs(keptKeys.size());
+		for (size_t i = 0; i < keptKeys.size(); i++) {
+			const glm::vec4& output = outputs[keptKeys[i]];
+			keptInputs[i] = inputs[keptKeys[i]];
+			if (!rotation) {
+				const glm::vec3 normalized = (glm::vec3(output) - outputMin) / glm::max(extent, glm::vec3(FLT_MIN));
+				keys[i] = glm::u16vec3(glm::round(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f));
+				continue;
+			}
+			// Smallest three, the quaternion is negated if needed so the dropped component is positive
+			glm::vec4 q = glm::normalize(output);
+			uint32_t largest = 0;
+			for (uint32_t c = 1; c < 4; c++) {
+				if (std::abs(q[c]) > std::abs(q[largest])) {
+					largest = c;
+				}
+			}
+			if (q[largest] < 0.0f) {
+				q = -q;
+			}
+			glm::vec3 components;
+			uint32_t component = 0;
+			for (uint32_t c = 0; c < 4; c++) {
+				if (c != largest) {
+					components[component++] = q[c];
+				}
+			}
+			const glm::u16vec3 quantized = glm::u16vec3(glm::round(glm::clamp((components + 0.70710678f) / 1.41421356f, 0.0f, 1.0f) * 32767.0f));
+			keys[i] = glm::u16vec3(quantized.x | ((largest & 1) << 15), quantized.y | ((largest >> 1) << 15), quantized.z);
+		}
+		inputs = std::move(keptInputs);
+	}
+
 	// Node
 	glm::mat4 Node::localMatrix() {
 		return glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
@@ -209,42 +443,36 @@ namespace vkglTF
 		return m;
 	}
 
-	void Node::update() {
-		if (mesh) {
-			glm::mat4 m = getMatrix();
-			if (skin) {
-				// Update join matrices
-				glm::mat4 inverseTransform = glm::inverse(m);
-				size_t numJoints = std::min((uint32_t)skin->joints.size(), MAX_NUM_JOINTS);
-				for (size_t i = 0; i < numJoints; i++) {
-					vkglTF::Node *jointNode = skin->joints[i];
-					glm::mat4 jointMat = jointNode->getMatrix() * skin->inverseBindMatrices[i];
-					jointMat = inverseTransform * jointMat;
-					//mesh->uniformBlock.jointMatrix[i] = jointMat;
-				}
-				//mesh->uniformBlock.jointcount = (float)numJoints;
-				//memcpy(mesh->uniformBuffer->mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-			}
+	void Node::update(std::vector<glm::mat4>& jointMatrices) {
+		if (firstJoint == noJoints) {
+			return;
 		}
-
-		for (auto& child : children) {
-			child->update();
+		const glm::mat4 inverseTransform = glm::inverse(worldMatrix);
+		for (size_t i = 0; i < skin->joints.size(); i++) {
+			jointMatrices[firstJoint + i] = inverseTransform * skin->joints[i]->worldMatrix * skin->inverseBindMatrices[i];
 		}
 	}
 
-	Node::~Node() {
-		if (mesh) {
-			delete mesh;
-		}
-		for (auto& child : children) {
-			delete child;
-		}
+	void Model::reserveSceneGraph(size_t nodeCount, size_t meshCount, size_t primitiveCount)
+	{
+		nodeStorage.reserve(nodeCount);
+		meshStorage.reserve(meshCount);
+		primitiveStorage.reserve(primitiveCount);
+		linearNodes.reserve(nodeCount);
 	}
 
-	
+	// Nodes are added before their children, which keeps the storage in topological order
 	void Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, uint32_t nodeIndex, const tinygltf::Model &model, LoaderInfo& loaderInfo, float globalscale)
 	{
-		vkglTF::Node *newNode = new Node{};
+		assert(nodeStorage.size() < nodeStorage.capacity());
+		vkglTF::Node *newNode = &nodeStorage.emplace_back();
+		newNode->linearIndex = static_cast<uint32_t>(linearNodes.size());
+		linearNodes.push_back(newNode);
+		if (parent) {
+			parent->children.push_back(newNode);
+		} else {
+			nodes.push_back(newNode);
+		}
 		newNode->index = nodeIndex;
 		newNode->parent = parent;
 		newNode->name = node.name;
@@ -276,210 +504,472 @@ namespace vkglTF
 			newNode->matrix = glm::scale(newNode->matrix, scale);
 		}
 
-		// Node with children
-		if (node.children.size() > 0) {
-			for (size_t i = 0; i < node.children.size(); i++) {
-				loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, loaderInfo, globalscale);
-			}
-		}
-
 		// Node contains mesh data
 		if (node.mesh > -1) {
-			const tinygltf::Mesh mesh = model.meshes[node.mesh];
-			Mesh *newMesh = new Mesh(newNode->matrix);
+			const tinygltf::Mesh &mesh = model.meshes[node.mesh];
+			assert((meshStorage.size() < meshStorage.capacity()) && (primitiveStorage.size() + mesh.primitives.size() <= primitiveStorage.capacity()));
+			Mesh *newMesh = &meshStorage.emplace_back(newNode->matrix);
+			const size_t firstPrimitive = primitiveStorage.size();
 			for (size_t j = 0; j < mesh.primitives.size(); j++) {
 				const tinygltf::Primitive &primitive = mesh.primitives[j];
 				uint32_t vertexStart = static_cast<uint32_t>(loaderInfo.vertexPos);
 				uint32_t indexStart = static_cast<uint32_t>(loaderInfo.indexPos);
-				uint32_t indexCount = 0;
-				uint32_t vertexCount = 0;
-				glm::vec3 posMin{};
-				glm::vec3 posMax{};
-				bool hasSkin = false;
 				bool hasIndices = primitive.indices > -1;
-				// Vertices
-				{
-					const float *bufferPos = nullptr;
-					const float *bufferNormals = nullptr;
-					const float *bufferTexCoordSet0 = nullptr;
-					const float *bufferTexCoordSet1 = nullptr;
-					const float* bufferColorSet0 = nullptr;
-					const void *bufferJoints = nullptr;
-					const float *bufferWeights = nullptr;
-
-					int posByteStride;
-					int normByteStride;
-					int uv0ByteStride;
-					int color0ByteStride;
-					int jointByteStride;
-					int weightByteStride;
-
-					int jointComponentType;
-
-					// Position attribute is required
-					assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
-
-					const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-					const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-					bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
-					posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
-					posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
-					vertexCount = static_cast<uint32_t>(posAccessor.count);
-					posByteStride = posAccessor.ByteStride(posView) ? (posAccessor.ByteStride(posView) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
-
-					if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-						const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-						const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-						bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
-						normByteStride = normAccessor.ByteStride(normView) ? (normAccessor.ByteStride(normView) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
-					}
 
-					// UVs
-					if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-						const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-						const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-						bufferTexCoordSet0 = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-						uv0ByteStride = uvAccessor.ByteStride(uvView) ? (uvAccessor.ByteStride(uvView) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
-					}
+				// Position attribute is required
+				assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
 
-					// Vertex colors
-					if (primitive.attributes.find("COLOR_0") != primitive.attributes.end()) {
-						const tinygltf::Accessor& accessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
-						const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
-						bufferColorSet0 = reinterpret_cast<const float*>(&(model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-						color0ByteStride = accessor.ByteStride(view) ? (accessor.ByteStride(view) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
-					}
+				const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+				glm::vec3 posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
+				glm::vec3 posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
+				uint32_t vertexCount = static_cast<uint32_t>(posAccessor.count);
+				uint32_t indexCount = hasIndices ? static_cast<uint32_t>(model.accessors[primitive.indices].count) : 0;
 
-					// Skinning
-					// Joints
-					if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
-						const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
-						const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
-						bufferJoints = &(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]);
-						jointComponentType = jointAccessor.componentType;
-						jointByteStride = jointAccessor.ByteStride(jointView) ? (jointAccessor.ByteStride(jointView) / tinygltf::GetComponentSizeInBytes(jointComponentType)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC4);
-					}
+				Primitive *newPrimitive = &primitiveStorage.emplace_back(indexStart, indexCount, vertexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
+				newPrimitive->setBoundingBox(posMin, posMax);
 
-					if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
-						const tinygltf::Accessor &weightAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
-						const tinygltf::BufferView &weightView = model.bufferViews[weightAccessor.bufferView];
-						bufferWeights = reinterpret_cast<const float *>(&(model.buffers[weightView.buffer].data[weightAccessor.byteOffset + weightView.byteOffset]));
-						weightByteStride = weightAccessor.ByteStride(weightView) ? (weightAccessor.ByteStride(weightView) / sizeof(float)) : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC4);
-					}
+				// Vertex and index data is converted after the traversal, this only reserves the primitive's ranges in the loader buffers
+				loaderInfo.primitives.push_back({ .primitive = &primitive, .target = newPrimitive, .vertexStart = vertexStart, .indexStart = indexStart });
+				loaderInfo.vertexPos += vertexCount;
+				loaderInfo.indexPos += indexCount;
+			}
+			newMesh->primitives = std::span<Primitive>(primitiveStorage.data() + firstPrimitive, mesh.primitives.size());
+			// Mesh BB from BBs of primitives
+			for (const Primitive& p : newMesh->primitives) {
+				if (p.bb.valid && !newMesh->bb.valid) {
+					newMesh->bb = p.bb;
+					newMesh->bb.valid = true;
+				}
+				newMesh->bb.min = glm::min(newMesh->bb.min, p.bb.min);
+				newMesh->bb.max = glm::max(newMesh->bb.max, p.bb.max);
+			}
+			newNode->mesh = newMesh;
+		}
 
-					hasSkin = (bufferJoints && bufferWeights);
-
-					for (size_t v = 0; v < posAccessor.count; v++) {
-						Vertex& vert = loaderInfo.vertexBuffer[loaderInfo.vertexPos];
-						vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * posByteStride]), 1.0f);
-						vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * normByteStride]) : glm::vec3(0.0f)));
-						vert.uv0 = bufferTexCoordSet0 ? glm::make_vec2(&bufferTexCoordSet0[v * uv0ByteStride]) : glm::vec3(0.0f);
-						vert.color = bufferColorSet0 ? glm::make_vec4(&bufferColorSet0[v * color0ByteStride]) : glm::vec4(1.0f);
-
-						if (hasSkin)
-						{
-							switch (jointComponentType) {
-							case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
-								const uint16_t *buf = static_cast<const uint16_t*>(bufferJoints);
-								vert.joint0 = glm::vec4(glm::make_vec4(&buf[v * jointByteStride]));
-								break;
-							}
-							case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
-								const uint8_t *buf = static_cast<const uint8_t*>(bufferJoints);
-								vert.joint0 = glm::vec4(glm::make_vec4(&buf[v * jointByteStride]));
-								break;
-							}
-							default:
-								// Not supported by spec
-								std::cerr << "Joint component type " << jointComponentType << " not supported!" << std::endl;
-								break;
-							}
-						}
-						else {
-							vert.joint0 = glm::vec4(0.0f);
-						}
-						vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * weightByteStride]) : glm::vec4(0.0f);
+		for (size_t i = 0; i < node.children.size(); i++) {
+			loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, loaderInfo, globalscale);
+		}
+	}
+
+	/**
+	 * Strided view of an accessor's elements in place in their buffer, elements are converted to floats as they're read
+	 * Besides floats, normalized and plain integer components are supported (e.g. quantized attributes of KHR_mesh_quantization)
+	 */
+	struct AccessorView {
+		const uint8_t* data{ nullptr };
+		size_t stride{ 0 };
+		size_t count{ 0 };
+		uint32_t components{ 0 };
+		int componentType{ TINYGLTF_COMPONENT_TYPE_FLOAT };
+		bool normalized{ false };
+
+		AccessorView(const tinygltf::Model& model, int accessorIndex)
+		{
+			if (accessorIndex < 0) {
+				return;
+			}
+			const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+			// Accessors without a buffer view are all zeros (sparse accessors aren't supported)
+			if (accessor.bufferView < 0) {
+				return;
+			}
+			const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+			const int byteStride = accessor.ByteStride(view);
+			if (byteStride <= 0) {
+				std::cerr << "Invalid byte stride for accessor " << accessorIndex << std::endl;
+				return;
+			}
+			data = model.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset;
+			stride = static_cast<size_t>(byteStride);
+			count = accessor.count;
+			components = static_cast<uint32_t>(tinygltf::GetNumComponentsInType(accessor.type));
+			componentType = accessor.componentType;
+			normalized = accessor.normalized;
+		}
+
+		explicit operator bool() const
+		{
+			return data != nullptr;
+		}
+
+		float readComponent(const uint8_t* element, uint32_t component) const
+		{
+			switch (componentType) {
+			case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+				float value;
+				memcpy(&value, element + component * sizeof(float), sizeof(float));
+				return value;
+			}
+			case TINYGLTF_COMPONENT_TYPE_BYTE: {
+				const float value = static_cast<float>(static_cast<int8_t>(element[component]));
+				return normalized ? std::max(value / 127.0f, -1.0f) : value;
+			}
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+				const float value = static_cast<float>(element[component]);
+				return normalized ? value / 255.0f : value;
+			}
+			case TINYGLTF_COMPONENT_TYPE_SHORT: {
+				int16_t value;
+				memcpy(&value, element + component * sizeof(int16_t), sizeof(int16_t));
+				return normalized ? std::max(value / 32767.0f, -1.0f) : static_cast<float>(value);
+			}
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+				uint16_t value;
+				memcpy(&value, element + component * sizeof(uint16_t), sizeof(uint16_t));
+				return normalized ? value / 65535.0f : static_cast<float>(value);
+			}
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+				uint32_t value;
+				memcpy(&value, element + component * sizeof(uint32_t), sizeof(uint32_t));
+				return static_cast<float>(value);
+			}
+			}
+			return 0.0f;
+		}
+
+		// Components the accessor doesn't have keep their value in defaultValue (e.g. the alpha of RGB colors)
+		template<glm::length_t N>
+		glm::vec<N, float> read(size_t index, glm::vec<N, float> defaultValue) const
+		{
+			const uint8_t* element = data + index * stride;
+			const uint32_t readComponents = std::min(static_cast<uint32_t>(N), components);
+			// Plain floats are copied as they are, elements may not be aligned within their buffer
+			if (componentType == TINYGLTF_COMPONENT_TYPE_FLOAT) {
+				memcpy(&defaultValue, element, readComponents * sizeof(float));
+				return defaultValue;
+			}
+			for (uint32_t c = 0; c < readComponents; c++) {
+				defaultValue[c] = readComponent(element, c);
+			}
+			return defaultValue;
+		}
+	};
+
+	static int getAttributeAccessor(const tinygltf::Primitive& primitive, const char* name)
+	{
+		const auto attribute = primitive.attributes.find(name);
+		return (attribute != primitive.attributes.end()) ? attribute->second : -1;
+	}
+
+	// Indices address the model's vertices, so the smallest type that covers the vertex count can be used for all of its primitives
+	static VkIndexType selectIndexType(size_t vertexCount)
+	{
+		if ((vertexCount <= 0x100) && VulkanContext::device->hasIndexTypeUint8) {
+			return VK_INDEX_TYPE_UINT8_EXT;
+		}
+		return (vertexCount <= 0x10000) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	}
+
+	static uint32_t getIndexSize(VkIndexType indexType)
+	{
+		switch (indexType) {
+		case VK_INDEX_TYPE_UINT8_EXT:
+			return 1;
+		case VK_INDEX_TYPE_UINT16:
+			return 2;
+		default:
+			return 4;
+		}
+	}
+
+	// Indices are loaded and cached as 32 bit values and only narrowed when they're copied for the upload
+	static void copyIndices(void* destination, const uint32_t* source, size_t count, VkIndexType indexType)
+	{
+		switch (indexType) {
+		case VK_INDEX_TYPE_UINT8_EXT:
+			std::transform(source, source + count, static_cast<uint8_t*>(destination), [](uint32_t index) { return static_cast<uint8_t>(index); });
+			break;
+		case VK_INDEX_TYPE_UINT16:
+			std::transform(source, source + count, static_cast<uint16_t*>(destination), [](uint32_t index) { return static_cast<uint16_t>(index); });
+			break;
+		default:
+			memcpy(destination, source, count * sizeof(uint32_t));
+		}
+	}
+
+	// Vertices are converted in blocks small enough for the block's destination vertices and gathered attributes to stay in the cache
+	constexpr size_t conversionBlockSize = 64;
+
+	// Normalizes vectors given as separate components in place, zero length vectors stay zero
+	static void normalize(float* x, float* y, float* z, size_t count)
+	{
+		size_t i = 0;
+#if defined(VKS_GLTF_SSE)
+		for (; i + 4 <= count; i += 4) {
+			const __m128 vx = _mm_loadu_ps(&x[i]);
+			const __m128 vy = _mm_loadu_ps(&y[i]);
+			const __m128 vz = _mm_loadu_ps(&z[i]);
+			const __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+			const __m128 scale = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared)), _mm_cmpgt_ps(lengthSquared, _mm_setzero_ps()));
+			_mm_storeu_ps(&x[i], _mm_mul_ps(vx, scale));
+			_mm_storeu_ps(&y[i], _mm_mul_ps(vy, scale));
+			_mm_storeu_ps(&z[i], _mm_mul_ps(vz, scale));
+		}
+#elif defined(VKS_GLTF_NEON)
+		for (; i + 4 <= count; i += 4) {
+			const float32x4_t vx = vld1q_f32(&x[i]);
+			const float32x4_t vy = vld1q_f32(&y[i]);
+			const float32x4_t vz = vld1q_f32(&z[i]);
+			const float32x4_t lengthSquared = vmlaq_f32(vmlaq_f32(vmulq_f32(vx, vx), vy, vy), vz, vz);
+			const uint32x4_t valid = vcgtq_f32(lengthSquared, vdupq_n_f32(0.0f));
+			const float32x4_t scale = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vdivq_f32(vdupq_n_f32(1.0f), vsqrtq_f32(lengthSquared))), valid));
+			vst1q_f32(&x[i], vmulq_f32(vx, scale));
+			vst1q_f32(&y[i], vmulq_f32(vy, scale));
+			vst1q_f32(&z[i], vmulq_f32(vz, scale));
+		}
+#endif
+		for (; i < count; i++) {
+			const float lengthSquared = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+			const float scale = (lengthSquared > 0.0f) ? 1.0f / std::sqrt(lengthSquared) : 0.0f;
+			x[i] *= scale;
+			y[i] *= scale;
+			z[i] *= scale;
+		}
+	}
+
+	void Model::loadPrimitive(const tinygltf::Model& model, PrimitiveLoadInfo& primitiveLoadInfo)
+	{
+		const tinygltf::Primitive& primitive = *primitiveLoadInfo.primitive;
+		bool hasIndices = primitive.indices > -1;
+		// Vertices
+		{
+			const AccessorView positions(model, getAttributeAccessor(primitive, "POSITION"));
+			const AccessorView normals(model, getAttributeAccessor(primitive, "NORMAL"));
+			const AccessorView uvs(model, getAttributeAccessor(primitive, "TEXCOORD_0"));
+			const AccessorView colors(model, getAttributeAccessor(primitive, "COLOR_0"));
+			const AccessorView joints(model, getAttributeAccessor(primitive, "JOINTS_0"));
+			const AccessorView weights(model, getAttributeAccessor(primitive, "WEIGHTS_0"));
+			const bool hasSkin = joints && weights;
+
+			// Normals are gathered per block, so they can be normalized four at a time
+			std::array<float, conversionBlockSize> normalX;
+			std::array<float, conversionBlockSize> normalY;
+			std::array<float, conversionBlockSize> normalZ;
+			for (size_t blockStart = 0; blockStart < positions.count; blockStart += conversionBlockSize) {
+				const size_t blockCount = std::min(conversionBlockSize, positions.count - blockStart);
+				for (size_t i = 0; i < blockCount; i++) {
+					const glm::vec3 normal = normals ? normals.read(blockStart + i, glm::vec3(0.0f)) : glm::vec3(0.0f);
+					normalX[i] = normal.x;
+					normalY[i] = normal.y;
+					normalZ[i] = normal.z;
+				}
+				normalize(normalX.data(), normalY.data(), normalZ.data(), blockCount);
+
+				if (vertexLayout == VertexLayout::Compact) {
+					CompactVertex* vertices = &loaderInfo.compactVertexBuffer[primitiveLoadInfo.vertexStart + blockStart];
+					for (size_t i = 0; i < blockCount; i++) {
+						const size_t v = blockStart + i;
+						vertices[i] = compactVertex({
+							.pos = positions.read(v, glm::vec3(0.0f)),
+							.normal = glm::vec3(normalX[i], normalY[i], normalZ[i]),
+							.uv0 = uvs ? uvs.read(v, glm::vec2(0.0f)) : glm::vec2(0.0f),
+							.color = colors ? colors.read(v, glm::vec4(1.0f)) : glm::vec4(1.0f)
+						});
+					}
+				} else {
+					Vertex* vertices = &loaderInfo.vertexBuffer[primitiveLoadInfo.vertexStart + blockStart];
+					for (size_t i = 0; i < blockCount; i++) {
+						const size_t v = blockStart + i;
+						Vertex& vert = vertices[i];
+						vert.pos = positions.read(v, glm::vec3(0.0f));
+						vert.normal = glm::vec3(normalX[i], normalY[i], normalZ[i]);
+						vert.uv0 = uvs ? uvs.read(v, glm::vec2(0.0f)) : glm::vec2(0.0f);
+						// RGB colors are opaque
+						vert.color = colors ? colors.read(v, glm::vec4(1.0f)) : glm::vec4(1.0f);
+						vert.joint0 = hasSkin ? joints.read(v, glm::vec4(0.0f)) : glm::vec4(0.0f);
+						vert.weight0 = hasSkin ? weights.read(v, glm::vec4(0.0f)) : glm::vec4(0.0f);
 						// Fix for all zero weights
 						if (glm::length(vert.weight0) == 0.0f) {
 							vert.weight0 = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
 						}
-						loaderInfo.vertexPos++;
 					}
 				}
-				// Indices
-				if (hasIndices)
-				{
-					const tinygltf::Accessor &accessor = model.accessors[primitive.indices > -1 ? primitive.indices : 0];
-					const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-					const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-
-					indexCount = static_cast<uint32_t>(accessor.count);
-					const void *dataPtr = &(buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-
-					switch (accessor.componentType) {
-					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-						const uint32_t *buf = static_cast<const uint32_t*>(dataPtr);
-						for (size_t index = 0; index < accessor.count; index++) {
-							loaderInfo.indexBuffer[loaderInfo.indexPos] = buf[index] + vertexStart;
-							loaderInfo.indexPos++;
-						}
-						break;
-					}
-					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-						const uint16_t *buf = static_cast<const uint16_t*>(dataPtr);
-						for (size_t index = 0; index < accessor.count; index++) {
-							loaderInfo.indexBuffer[loaderInfo.indexPos] = buf[index] + vertexStart;
-							loaderInfo.indexPos++;
-						}
-						break;
-					}
-					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-						const uint8_t *buf = static_cast<const uint8_t*>(dataPtr);
-						for (size_t index = 0; index < accessor.count; index++) {
-							loaderInfo.indexBuffer[loaderInfo.indexPos] = buf[index] + vertexStart;
-							loaderInfo.indexPos++;
-						}
-						break;
-					}
-					default:
-						std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
-						return;
-					}
-				}					
-				Primitive *newPrimitive = new Primitive(indexStart, indexCount, vertexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
-				newPrimitive->setBoundingBox(posMin, posMax);
-				newMesh->primitives.push_back(newPrimitive);
 			}
-			// Mesh BB from BBs of primitives
-			for (auto p : newMesh->primitives) {
-				if (p->bb.valid && !newMesh->bb.valid) {
-					newMesh->bb = p->bb;
-					newMesh->bb.valid = true;
+		}
+		// Indices
+		if (hasIndices)
+		{
+			const tinygltf::Accessor &accessor = model.accessors[primitive.indices > -1 ? primitive.indices : 0];
+			const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+			const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+
+			const void *dataPtr = &(buffer.data[accessor.byteOffset + bufferView.byteOffset]);
+
+			switch (accessor.componentType) {
+			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
+				const uint32_t *buf = static_cast<const uint32_t*>(dataPtr);
+				for (size_t index = 0; index < accessor.count; index++) {
+					loaderInfo.indexBuffer[primitiveLoadInfo.indexStart + index] = buf[index] + primitiveLoadInfo.vertexStart;
 				}
-				newMesh->bb.min = glm::min(newMesh->bb.min, p->bb.min);
-				newMesh->bb.max = glm::max(newMesh->bb.max, p->bb.max);
+				break;
+			}
+			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
+				const uint16_t *buf = static_cast<const uint16_t*>(dataPtr);
+				for (size_t index = 0; index < accessor.count; index++) {
+					loaderInfo.indexBuffer[primitiveLoadInfo.indexStart + index] = buf[index] + primitiveLoadInfo.vertexStart;
+				}
+				break;
+			}
+			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
+				const uint8_t *buf = static_cast<const uint8_t*>(dataPtr);
+				for (size_t index = 0; index < accessor.count; index++) {
+					loaderInfo.indexBuffer[primitiveLoadInfo.indexStart + index] = buf[index] + primitiveLoadInfo.vertexStart;
+				}
+				break;
+			}
+			default:
+				std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
+				return;
+			}
+
+			const uint32_t vertexCount = static_cast<uint32_t>(model.accessors[primitive.attributes.find("POSITION")->second].count);
+			if (loaderInfo.optimizeMeshes && primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+				optimizePrimitive(primitiveLoadInfo, vertexCount, static_cast<uint32_t>(accessor.count));
+			}
+			// Simplification uses the final vertex order, so it needs to run after the optimization
+			if (loaderInfo.lodCount > 1 && primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+				generatePrimitiveLods(primitiveLoadInfo, vertexCount, static_cast<uint32_t>(accessor.count));
+			}
+			if (loaderInfo.buildMeshlets && primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+				generatePrimitiveMeshlets(primitiveLoadInfo, vertexCount, static_cast<uint32_t>(accessor.count));
 			}
-			newNode->mesh = newMesh;
 		}
-		if (parent) {
-			parent->children.push_back(newNode);
+	}
+
+	void Model::optimizePrimitive(const PrimitiveLoadInfo& primitiveLoadInfo, uint32_t vertexCount, uint32_t indexCount)
+	{
+		// The optimizer works on indices local to the primitive
+		uint32_t* indices = &loaderInfo.indexBuffer[primitiveLoadInfo.indexStart];
+		for (uint32_t i = 0; i < indexCount; i++) {
+			indices[i] -= primitiveLoadInfo.vertexStart;
+		}
+
+		std::vector<uint32_t> clusters;
+		vks::meshoptimizer::optimizeVertexCache(indices, indexCount, vertexCount, &clusters);
+		std::vector<uint32_t> remap;
+		if (vertexLayout == VertexLayout::Compact) {
+			CompactVertex* vertices = &loaderInfo.compactVertexBuffer[primitiveLoadInfo.vertexStart];
+			vks::meshoptimizer::optimizeOverdraw(indices, indexCount, &vertices[0].pos.x, sizeof(CompactVertex), clusters);
+			remap = vks::meshoptimizer::optimizeVertexFetch(indices, indexCount, vertexCount);
+			vks::meshoptimizer::remapVertices(vertices, vertexCount, remap);
 		} else {
-			nodes.push_back(newNode);
+			Vertex* vertices = &loaderInfo.vertexBuffer[primitiveLoadInfo.vertexStart];
+			vks::meshoptimizer::optimizeOverdraw(indices, indexCount, &vertices[0].pos.x, sizeof(Vertex), clusters);
+			remap = vks::meshoptimizer::optimizeVertexFetch(indices, indexCount, vertexCount);
+			vks::meshoptimizer::remapVertices(vertices, vertexCount, remap);
+		}
+
+		for (uint32_t i = 0; i < indexCount; i++) {
+			indices[i] += primitiveLoadInfo.vertexStart;
+		}
+	}
+
+	void Model::generatePrimitiveLods(PrimitiveLoadInfo& primitiveLoadInfo, uint32_t vertexCount, uint32_t indexCount)
+	{
+		std::vector<uint32_t> indices(&loaderInfo.indexBuffer[primitiveLoadInfo.indexStart], &loaderInfo.indexBuffer[primitiveLoadInfo.indexStart] + indexCount);
+		for (uint32_t& index : indices) {
+			index -= primitiveLoadInfo.vertexStart;
+		}
+		const float* positions = (vertexLayout == VertexLayout::Compact) ? &loaderInfo.compactVertexBuffer[primitiveLoadInfo.vertexStart].pos.x : &loaderInfo.vertexBuffer[primitiveLoadInfo.vertexStart].pos.x;
+		const size_t positionStride = (vertexLayout == VertexLayout::Compact) ? sizeof(CompactVertex) : sizeof(Vertex);
+
+		// Each level halves the grid resolution, which roughly matches halving the projected size in selectLod
+		std::vector<uint32_t> lodIndices(indexCount);
+		uint32_t previousIndexCount = indexCount;
+		for (uint32_t lod = 1; lod < loaderInfo.lodCount; lod++) {
+			const uint32_t gridSize = std::max(64u >> lod, 1u);
+			const uint32_t lodIndexCount = static_cast<uint32_t>(vks::meshoptimizer::simplifyClustered(lodIndices.data(), indices.data(), indexCount, positions, positionStride, vertexCount, gridSize));
+			// Levels that collapsed completely or didn't remove any triangles reuse the previous level
+			if (lodIndexCount == 0 || lodIndexCount >= previousIndexCount) {
+				primitiveLoadInfo.lodIndexCounts.push_back(0);
+				continue;
+			}
+			if (loaderInfo.optimizeMeshes) {
+				vks::meshoptimizer::optimizeVertexCache(lodIndices.data(), lodIndexCount, vertexCount);
+			}
+			for (uint32_t i = 0; i < lodIndexCount; i++) {
+				primitiveLoadInfo.lodIndices.push_back(lodIndices[i] + primitiveLoadInfo.vertexStart);
+			}
+			primitiveLoadInfo.lodIndexCounts.push_back(lodIndexCount);
+			previousIndexCount = lodIndexCount;
+		}
+	}
+
+	void Model::appendPrimitiveLods()
+	{
+		size_t lodIndexCount = 0;
+		for (const PrimitiveLoadInfo& primitiveLoadInfo : loaderInfo.primitives) {
+			lodIndexCount += primitiveLoadInfo.lodIndices.size();
+		}
+
+		if (lodIndexCount > 0) {
+			uint32_t* indexBuffer = new uint32_t[indexCount + lodIndexCount];
+			memcpy(indexBuffer, loaderInfo.indexBuffer, indexCount * sizeof(uint32_t));
+			delete[] loaderInfo.indexBuffer;
+			loaderInfo.indexBuffer = indexBuffer;
+		}
+
+		for (const PrimitiveLoadInfo& primitiveLoadInfo : loaderInfo.primitives) {
+			Primitive* primitive = primitiveLoadInfo.target;
+			Primitive::Lod lod{ primitive->firstIndex, primitive->indexCount };
+			size_t source = 0;
+			for (uint32_t lodIndexCount : primitiveLoadInfo.lodIndexCounts) {
+				if (lodIndexCount > 0) {
+					memcpy(&loaderInfo.indexBuffer[indexCount], &primitiveLoadInfo.lodIndices[source], lodIndexCount * sizeof(uint32_t));
+					lod = { static_cast<uint32_t>(indexCount), lodIndexCount };
+					indexCount += lodIndexCount;
+					source += lodIndexCount;
+				}
+				primitive->lods.push_back(lod);
+			}
+		}
+	}
+
+	void Model::generatePrimitiveMeshlets(PrimitiveLoadInfo& primitiveLoadInfo, uint32_t vertexCount, uint32_t indexCount)
+	{
+		std::vector<uint32_t> indices(&loaderInfo.indexBuffer[primitiveLoadInfo.indexStart], &loaderInfo.indexBuffer[primitiveLoadInfo.indexStart] + indexCount);
+		for (uint32_t& index : indices) {
+			index -= primitiveLoadInfo.vertexStart;
+		}
+		const float* positions = (vertexLayout == VertexLayout::Compact) ? &loaderInfo.compactVertexBuffer[primitiveLoadInfo.vertexStart].pos.x : &loaderInfo.vertexBuffer[primitiveLoadInfo.vertexStart].pos.x;
+		const size_t positionStride = (vertexLayout == VertexLayout::Compact) ? sizeof(CompactVertex) : sizeof(Vertex);
+		vks::meshoptimizer::buildMeshlets(primitiveLoadInfo.meshlets, primitiveLoadInfo.meshletVertices, primitiveLoadInfo.meshletTriangles, indices.data(), indexCount, positions, positionStride, vertexCount);
+		// Meshlet vertices index into the model's vertex buffer, so the mesh shader can fetch them directly
+		for (uint32_t& index : primitiveLoadInfo.meshletVertices) {
+			index += primitiveLoadInfo.vertexStart;
 		}
-		linearNodes.push_back(newNode);
 	}
 
-	void Model::getNodeProps(const tinygltf::Node& node, const tinygltf::Model& model, size_t& vertexCount, size_t& indexCount)
+	void Model::appendPrimitiveMeshlets()
 	{
-		if (node.children.size() > 0) {
-			for (size_t i = 0; i < node.children.size(); i++) {
-				getNodeProps(model.nodes[node.children[i]], model, vertexCount, indexCount);
+		for (PrimitiveLoadInfo& primitiveLoadInfo : loaderInfo.primitives) {
+			Primitive* primitive = primitiveLoadInfo.target;
+			primitive->firstMeshlet = static_cast<uint32_t>(loaderInfo.meshlets.size());
+			primitive->meshletCount = static_cast<uint32_t>(primitiveLoadInfo.meshlets.size());
+			const uint32_t vertexOffset = static_cast<uint32_t>(loaderInfo.meshletVertices.size());
+			const uint32_t triangleOffset = static_cast<uint32_t>(loaderInfo.meshletTriangles.size());
+			for (vks::meshoptimizer::Meshlet& meshlet : primitiveLoadInfo.meshlets) {
+				meshlet.vertexOffset += vertexOffset;
+				meshlet.triangleOffset += triangleOffset;
 			}
+			loaderInfo.meshlets.insert(loaderInfo.meshlets.end(), primitiveLoadInfo.meshlets.begin(), primitiveLoadInfo.meshlets.end());
+			loaderInfo.meshletVertices.insert(loaderInfo.meshletVertices.end(), primitiveLoadInfo.meshletVertices.begin(), primitiveLoadInfo.meshletVertices.end());
+			loaderInfo.meshletTriangles.insert(loaderInfo.meshletTriangles.end(), primitiveLoadInfo.meshletTriangles.begin(), primitiveLoadInfo.meshletTriangles.end());
+		}
+	}
+
+	void Model::getNodeProps(const tinygltf::Node& node, const tinygltf::Model& model, size_t& vertexCount, size_t& indexCount, size_t& nodeCount, size_t& meshCount, size_t& primitiveCount)
+	{
+		nodeCount++;
+		for (size_t i = 0; i < node.children.size(); i++) {
+			getNodeProps(model.nodes[node.children[i]], model, vertexCount, indexCount, nodeCount, meshCount, primitiveCount);
 		}
 		if (node.mesh > -1) {
-			const tinygltf::Mesh mesh = model.meshes[node.mesh];
+			const tinygltf::Mesh& mesh = model.meshes[node.mesh];
+			meshCount++;
+			primitiveCount += mesh.primitives.size();
 			for (size_t i = 0; i < mesh.primitives.size(); i++) {
-				auto primitive = mesh.primitives[i];
+				const tinygltf::Primitive& primitive = mesh.primitives[i];
 				vertexCount += model.accessors[primitive.attributes.find("POSITION")->second].count;
 				if (primitive.indices > -1) {
 					indexCount += model.accessors[primitive.indices].count;
@@ -515,6 +1005,8 @@ namespace vkglTF
 				newSkin->inverseBindMatrices.resize(accessor.count);
 				memcpy(newSkin->inverseBindMatrices.data(), &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::mat4));
 			}
+			// Missing inverse bind matrices are identity matrices
+			newSkin->inverseBindMatrices.resize(newSkin->joints.size(), glm::mat4(1.0f));
 
 			skins.push_back(newSkin);
 		}
@@ -536,27 +1028,133 @@ namespace vkglTF
 			else {
 				textureSampler = textureSamplers[tex.sampler];
 			}
-			vkglTF::Texture texture;
-			texture.fromglTfImage(image, filePath, textureSampler);
-			textures.push_back(texture);
+			// The actual texture is created by upload, materials only store pointers into this array
+			textures.push_back({});
+			textureSources.push_back({ .image = std::move(image), .sampler = textureSampler });
 		}
 	}
 
-	VkSamplerAddressMode Model::getVkWrapMode(int32_t wrapMode)
+	void Model::decodeImages(tinygltf::Model& gltfModel, const std::vector<int>& imageIndices, vks::JobSystem* jobSystem)
 	{
-		switch (wrapMode) {
-		case -1:
-		case 10497:
-			return VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		case 33071:
-			return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-		case 33648:
-			return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
-		}
-
-		std::cerr << "Unknown wrap mode for getVkWrapMode: " << wrapMode << std::endl;
-		return VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	}
+		parallelFor(jobSystem, static_cast<uint32_t>(imageIndices.size()), [&gltfModel, &imageIndices](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; i++) {
+				tinygltf::Image& image = gltfModel.images[imageIndices[i]];
+				const std::vector<unsigned char> encoded = std::move(image.image);
+				image.image.clear();
+				std::string error;
+				std::string warning;
+				if (!tinygltf::LoadImageData(&image, imageIndices[i], &error, &warning, 0, 0, encoded.data(), static_cast<int>(encoded.size()), nullptr)) {
+					std::cerr << "Could not decode image \"" << image.name << "\": " << error << std::endl;
+					continue;
+				}
+				// Most devices don't support RGB only on Vulkan so convert if necessary
+				// TODO: Check actual format support and transform only if required
+				if (image.component == 3) {
+					std::vector<unsigned char> rgba(static_cast<size_t>(image.width) * image.height * 4, 255);
+					for (size_t p = 0; p < static_cast<size_t>(image.width) * image.height; p++) {
+						memcpy(&rgba[p * 4], &image.image[p * 3], 3);
+					}
+					image.image = std::move(rgba);
+					image.component = 4;
+				}
+			}
+		});
+	}
+
+	/**
+	 * Decodes buffer views compressed with EXT_meshopt_compression into the buffers they refer to, which are their fallback buffers
+	 * Fallback buffers without data are zero filled by tinygltf, so accessors are read from the decoded data as for uncompressed files
+	 * Draco compressed primitives are decoded by tinygltf while parsing instead, if it's built with Draco
+	 */
+	bool Model::decodeBufferViews(tinygltf::Model& gltfModel, vks::JobSystem* jobSystem)
+	{
+		struct CompressedView {
+			const uint8_t* source;
+			size_t sourceSize;
+			uint8_t* destination;
+			size_t count;
+			size_t stride;
+			std::string mode;
+			std::string filter;
+		};
+		std::vector<CompressedView> views;
+		for (tinygltf::BufferView& bufferView : gltfModel.bufferViews) {
+			auto extension = bufferView.extensions.find("EXT_meshopt_compression");
+			if (extension == bufferView.extensions.end()) {
+				continue;
+			}
+			const tinygltf::Value& value = extension->second;
+			const int sourceBuffer = value.Get("buffer").GetNumberAsInt();
+			const size_t sourceOffset = value.Has("byteOffset") ? static_cast<size_t>(value.Get("byteOffset").GetNumberAsDouble()) : 0;
+			CompressedView view{
+				.sourceSize = static_cast<size_t>(value.Get("byteLength").GetNumberAsDouble()),
+				.count = static_cast<size_t>(value.Get("count").GetNumberAsDouble()),
+				.stride = static_cast<size_t>(value.Get("byteStride").GetNumberAsDouble()),
+				.mode = value.Get("mode").Get<std::string>(),
+				.filter = value.Has("filter") ? value.Get("filter").Get<std::string>() : "NONE",
+			};
+			if ((sourceBuffer < 0) || (sourceBuffer >= static_cast<int>(gltfModel.buffers.size())) || (sourceOffset + view.sourceSize > gltfModel.buffers[sourceBuffer].data.size())) {
+				std::cerr << "Compressed buffer view is outside of its buffer" << std::endl;
+				return false;
+			}
+			std::vector<unsigned char>& destination = gltfModel.buffers[bufferView.buffer].data;
+			if (bufferView.byteOffset + view.count * view.stride > destination.size()) {
+				std::cerr << "Decoded buffer view is outside of its fallback buffer" << std::endl;
+				return false;
+			}
+			view.source = gltfModel.buffers[sourceBuffer].data.data() + sourceOffset;
+			view.destination = destination.data() + bufferView.byteOffset;
+			views.push_back(view);
+		}
+		// Decoders only touch their view's ranges, and views of the same buffer don't overlap
+		std::atomic<bool> decoded{ true };
+		parallelFor(jobSystem, static_cast<uint32_t>(views.size()), [&views, &decoded](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; i++) {
+				const CompressedView& view = views[i];
+				int result{ -1 };
+				if (view.mode == "ATTRIBUTES") {
+					result = meshopt_decodeVertexBuffer(view.destination, view.count, view.stride, view.source, view.sourceSize);
+					// Filters are applied in place after decoding
+					if (result == 0) {
+						if (view.filter == "OCTAHEDRAL") {
+							meshopt_decodeFilterOct(view.destination, view.count, view.stride);
+						} else if (view.filter == "QUATERNION") {
+							meshopt_decodeFilterQuat(view.destination, view.count, view.stride);
+						} else if (view.filter == "EXPONENTIAL") {
+							meshopt_decodeFilterExp(view.destination, view.count, view.stride);
+						}
+					}
+				} else if (view.mode == "TRIANGLES") {
+					result = meshopt_decodeIndexBuffer(view.destination, view.count, view.stride, view.source, view.sourceSize);
+				} else if (view.mode == "INDICES") {
+					result = meshopt_decodeIndexSequence(view.destination, view.count, view.stride, view.source, view.sourceSize);
+				}
+				if (result != 0) {
+					decoded = false;
+				}
+			}
+		});
+		if (!decoded) {
+			std::cerr << "Could not decode meshopt compressed buffer views" << std::endl;
+		}
+		return decoded;
+	}
+
+	VkSamplerAddressMode Model::getVkWrapMode(int32_t wrapMode)
+	{
+		switch (wrapMode) {
+		case -1:
+		case 10497:
+			return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		case 33071:
+			return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		case 33648:
+			return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+		}
+
+		std::cerr << "Unknown wrap mode for getVkWrapMode: " << wrapMode << std::endl;
+		return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	}
 
 	VkFilter Model::getVkFilterMode(int32_t filterMode)
 	{
@@ -698,6 +1296,8 @@ namespace vkglTF
 	{
 		for (tinygltf::Animation &anim : gltfModel.animations) {
 			vkglTF::Animation animation{};
+			// Outputs are only kept until the samplers are compressed, which needs to know the type of the animated property
+			std::vector<std::vector<glm::vec4>> samplerOutputs;
 			animation.name = anim.name;
 			if (anim.name.empty()) {
 				animation.name = std::to_string(animations.size());
@@ -751,18 +1351,23 @@ namespace vkglTF
 
 					const void *dataPtr = &buffer.data[accessor.byteOffset + bufferView.byteOffset];
 
+					// Cubic spline outputs are stored as in-tangent, value and out-tangent, playback interpolates linearly so only the values are kept
+					const bool cubicSpline = (sampler.interpolation == AnimationSampler::InterpolationType::CUBICSPLINE);
+					const size_t first = cubicSpline ? 1 : 0;
+					const size_t stride = cubicSpline ? 3 : 1;
+					std::vector<glm::vec4>& outputs = samplerOutputs.emplace_back();
 					switch (accessor.type) {
 					case TINYGLTF_TYPE_VEC3: {
 						const glm::vec3 *buf = static_cast<const glm::vec3*>(dataPtr);
-						for (size_t index = 0; index < accessor.count; index++) {
-							sampler.outputsVec4.push_back(glm::vec4(buf[index], 0.0f));
+						for (size_t index = first; index < accessor.count; index += stride) {
+							outputs.push_back(glm::vec4(buf[index], 0.0f));
 						}
 						break;
 					}
 					case TINYGLTF_TYPE_VEC4: {
 						const glm::vec4 *buf = static_cast<const glm::vec4*>(dataPtr);
-						for (size_t index = 0; index < accessor.count; index++) {
-							sampler.outputsVec4.push_back(buf[index]);
+						for (size_t index = first; index < accessor.count; index += stride) {
+							outputs.push_back(buf[index]);
 						}
 						break;
 					}
@@ -802,14 +1407,561 @@ namespace vkglTF
 				animation.channels.push_back(channel);
 			}
 
+			std::vector<uint8_t> rotationSamplers(animation.samplers.size(), 0);
+			for (const AnimationChannel& channel : animation.channels) {
+				if (channel.path == AnimationChannel::PathType::ROTATION) {
+					rotationSamplers[channel.samplerIndex] = 1;
+				}
+			}
+			for (size_t i = 0; i < animation.samplers.size(); i++) {
+				animation.samplers[i].compress(samplerOutputs[i], rotationSamplers[i]);
+			}
+
 			animations.push_back(animation);
 		}
 	}
 
+	// Pre-baked model cache
+
+	// Needs to be incremented whenever the layout of the cache or the data stored in it changes
+	static constexpr uint32_t cacheVersion = 4;
+	static constexpr uint32_t cacheMagic = 0x43474B56;
+	// Sections are aligned so vertex and index data can be read in place from the mapped file
+	static constexpr uint64_t cacheAlignment = 16;
+
+	enum CacheSection : uint32_t { CacheVertices, CacheIndices, CacheNodes, CachePrimitives, CachePrimitiveLods, CacheMeshlets, CacheMeshletVertices, CacheMeshletTriangles, CacheMaterials, CacheTextures, CacheImageData, CacheStrings, CacheExtensions, CacheDependencies, CacheSectionCount };
+
+	struct CacheHeader {
+		uint32_t magic;
+		uint32_t version;
+		// Source file and loading parameters the cache has been created from, the cache is stale if any of them differ
+		uint64_t sourceSize;
+		int64_t sourceWriteTime;
+		uint32_t vertexLayout;
+		uint32_t vertexStride;
+		uint32_t optimizeMeshes;
+		uint32_t lodCount;
+		float scale;
+		uint32_t buildMeshlets;
+		uint64_t vertexCount;
+		uint64_t indexCount;
+		struct {
+			uint64_t offset;
+			uint64_t size;
+		} sections[CacheSectionCount];
+	};
+
+	struct CacheString {
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	// Nodes are stored in linearNodes order, parents always precede their children
+	struct CacheNode {
+		glm::mat4 matrix;
+		glm::quat rotation;
+		glm::vec3 translation;
+		glm::vec3 scale;
+		glm::vec3 bbMin;
+		glm::vec3 bbMax;
+		int32_t parent;
+		uint32_t index;
+		uint32_t hasMesh;
+		uint32_t bbValid;
+		uint32_t firstPrimitive;
+		uint32_t primitiveCount;
+		CacheString name;
+	};
+
+	struct CachePrimitive {
+		glm::vec3 bbMin;
+		glm::vec3 bbMax;
+		uint32_t bbValid;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t vertexCount;
+		uint32_t materialIndex;
+		uint32_t firstLod;
+		uint32_t lodCount;
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+	};
+
+	// Texture references are stored as indices into the model's textures, with -1 for no texture
+	struct CacheMaterial {
+		glm::vec4 baseColorFactor;
+		glm::vec4 emissiveFactor;
+		glm::vec4 diffuseFactor;
+		glm::vec3 specularFactor;
+		float alphaCutoff;
+		float metallicFactor;
+		float roughnessFactor;
+		float emissiveStrength;
+		uint32_t alphaMode;
+		uint32_t doubleSided;
+		uint32_t unlit;
+		uint32_t metallicRoughnessWorkflow;
+		uint32_t specularGlossinessWorkflow;
+		Material::TexCoordSets texCoordSets;
+		int32_t baseColorTexture;
+		int32_t metallicRoughnessTexture;
+		int32_t normalTexture;
+		int32_t occlusionTexture;
+		int32_t emissiveTexture;
+		int32_t specularGlossinessTexture;
+		int32_t diffuseTexture;
+	};
+
+	// Stores decoded pixels, so no image decoding is required when loading from the cache. External KTX files are only referenced by their uri
+	struct CacheTexture {
+		TextureSampler sampler;
+		int32_t width;
+		int32_t height;
+		int32_t component;
+		int32_t bits;
+		int32_t pixelType;
+		uint32_t pad;
+		uint64_t dataOffset;
+		uint64_t dataSize;
+		CacheString name;
+		CacheString uri;
+	};
+
+	// Identity of an external file referenced by the glTF file at the time the cache was written, files that don't exist are stored with zero size and write time
+	struct CacheDependency {
+		uint64_t size;
+		int64_t writeTime;
+		CacheString uri;
+		uint32_t pad;
+	};
+
+	static std::string getCacheFilename(const std::string& filename)
+	{
+		return filename + ".cache";
+	}
+
+	bool Model::loadCache(const ModelCreateInfo& createInfo)
+	{
+		// Caches packed into an asset archive are used like loose ones, as the archive keeps the source file's write time
+		auto cacheFile = vks::vfs::open(getCacheFilename(createInfo.filename));
+		if (!cacheFile || cacheFile->size() < sizeof(CacheHeader)) {
+			return false;
+		}
+
+		const uint8_t* data = cacheFile->data();
+		const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+		uint64_t sourceSize{ 0 };
+		int64_t sourceWriteTime{ 0 };
+		if (!vks::vfs::getFileInfo(createInfo.filename, sourceSize, sourceWriteTime)) {
+			return false;
+		}
+		const size_t vertexStride = (vertexLayout == VertexLayout::Compact) ? sizeof(CompactVertex) : sizeof(Vertex);
+		if ((header->magic != cacheMagic) || (header->version != cacheVersion) || (header->sourceSize != sourceSize) || (header->sourceWriteTime != sourceWriteTime)
+			|| (header->vertexLayout != static_cast<uint32_t>(vertexLayout)) || (header->vertexStride != vertexStride) || (header->optimizeMeshes != static_cast<uint32_t>(loaderInfo.optimizeMeshes))
+			|| (header->lodCount != loaderInfo.lodCount) || (header->scale != createInfo.scale) || (header->buildMeshlets != static_cast<uint32_t>(loaderInfo.buildMeshlets))) {
+			return false;
+		}
+		for (uint32_t i = 0; i < CacheSectionCount; i++) {
+			if (header->sections[i].offset + header->sections[i].size > cacheFile->size()) {
+				std::cerr << "Cache file for " << createInfo.filename << " is truncated, loading from glTF" << std::endl;
+				return false;
+			}
+		}
+
+		auto section = [data, header](CacheSection section) {
+			return data + header->sections[section].offset;
+		};
+		auto sectionCount = [header](CacheSection section, size_t elementSize) {
+			return static_cast<size_t>(header->sections[section].size / elementSize);
+		};
+		const char* strings = reinterpret_cast<const char*>(section(CacheStrings));
+		auto getString = [strings](CacheString string) {
+			return std::string(strings + string.offset, string.length);
+		};
+
+		// The header only covers the glTF file itself, buffers and images it references can change independently
+		const CacheDependency* cacheDependencies = reinterpret_cast<const CacheDependency*>(section(CacheDependencies));
+		for (size_t i = 0; i < sectionCount(CacheDependencies, sizeof(CacheDependency)); i++) {
+			uint64_t size{ 0 };
+			int64_t writeTime{ 0 };
+			if (!vks::vfs::getFileInfo(filePath + "/" + getString(cacheDependencies[i].uri), size, writeTime)) {
+				size = 0;
+				writeTime = 0;
+			}
+			if ((size != cacheDependencies[i].size) || (writeTime != cacheDependencies[i].writeTime)) {
+				return false;
+			}
+		}
+
+		// Textures are created by upload, the decoded pixels are copied back into glTF images for that
+		const CacheTexture* cacheTextures = reinterpret_cast<const CacheTexture*>(section(CacheTextures));
+		const uint8_t* imageData = section(CacheImageData);
+		for (size_t i = 0; i < sectionCount(CacheTextures, sizeof(CacheTexture)); i++) {
+			const CacheTexture& cacheTexture = cacheTextures[i];
+			tinygltf::Image image;
+			image.name = getString(cacheTexture.name);
+			image.uri = getString(cacheTexture.uri);
+			image.width = cacheTexture.width;
+			image.height = cacheTexture.height;
+			image.component = cacheTexture.component;
+			image.bits = cacheTexture.bits;
+			image.pixel_type = cacheTexture.pixelType;
+			image.image.assign(imageData + cacheTexture.dataOffset, imageData + cacheTexture.dataOffset + cacheTexture.dataSize);
+			textures.push_back({});
+			textureSources.push_back({ .image = std::move(image), .sampler = cacheTexture.sampler });
+		}
+
+		auto getTexture = [this](int32_t index) {
+			return (index > -1) ? &textures[index] : nullptr;
+		};
+		const CacheMaterial* cacheMaterials = reinterpret_cast<const CacheMaterial*>(section(CacheMaterials));
+		for (size_t i = 0; i < sectionCount(CacheMaterials, sizeof(CacheMaterial)); i++) {
+			const CacheMaterial& cacheMaterial = cacheMaterials[i];
+			Material material{};
+			material.alphaMode = static_cast<Material::AlphaMode>(cacheMaterial.alphaMode);
+			material.alphaCutoff = cacheMaterial.alphaCutoff;
+			material.metallicFactor = cacheMaterial.metallicFactor;
+			material.roughnessFactor = cacheMaterial.roughnessFactor;
+			material.baseColorFactor = cacheMaterial.baseColorFactor;
+			material.emissiveFactor = cacheMaterial.emissiveFactor;
+			material.baseColorTexture = getTexture(cacheMaterial.baseColorTexture);
+			material.metallicRoughnessTexture = getTexture(cacheMaterial.metallicRoughnessTexture);
+			material.normalTexture = getTexture(cacheMaterial.normalTexture);
+			material.occlusionTexture = getTexture(cacheMaterial.occlusionTexture);
+			material.emissiveTexture = getTexture(cacheMaterial.emissiveTexture);
+			material.doubleSided = cacheMaterial.doubleSided;
+			material.texCoordSets = cacheMaterial.texCoordSets;
+			material.extension.specularGlossinessTexture = getTexture(cacheMaterial.specularGlossinessTexture);
+			material.extension.diffuseTexture = getTexture(cacheMaterial.diffuseTexture);
+			material.extension.diffuseFactor = cacheMaterial.diffuseFactor;
+			material.extension.specularFactor = cacheMaterial.specularFactor;
+			material.pbrWorkflows.metallicRoughness = cacheMaterial.metallicRoughnessWorkflow;
+			material.pbrWorkflows.specularGlossiness = cacheMaterial.specularGlossinessWorkflow;
+			material.index = static_cast<int>(i);
+			material.unlit = cacheMaterial.unlit;
+			material.emissiveStrength = cacheMaterial.emissiveStrength;
+			materials.push_back(material);
+		}
+
+		const CacheNode* cacheNodes = reinterpret_cast<const CacheNode*>(section(CacheNodes));
+		const CachePrimitive* cachePrimitives = reinterpret_cast<const CachePrimitive*>(section(CachePrimitives));
+		const Primitive::Lod* cacheLods = reinterpret_cast<const Primitive::Lod*>(section(CachePrimitiveLods));
+		const size_t nodeCount = sectionCount(CacheNodes, sizeof(CacheNode));
+		reserveSceneGraph(nodeCount, std::count_if(cacheNodes, cacheNodes + nodeCount, [](const CacheNode& cacheNode) { return cacheNode.hasMesh != 0; }), sectionCount(CachePrimitives, sizeof(CachePrimitive)));
+		for (size_t i = 0; i < nodeCount; i++) {
+			const CacheNode& cacheNode = cacheNodes[i];
+			Node* node = &nodeStorage.emplace_back();
+			node->index = cacheNode.index;
+			node->linearIndex = static_cast<uint32_t>(i);
+			node->name = getString(cacheNode.name);
+			node->matrix = cacheNode.matrix;
+			node->translation = cacheNode.translation;
+			node->scale = cacheNode.scale;
+			node->rotation = cacheNode.rotation;
+			if (cacheNode.hasMesh) {
+				Mesh* mesh = &meshStorage.emplace_back(node->matrix);
+				const size_t firstPrimitive = primitiveStorage.size();
+				for (uint32_t j = 0; j < cacheNode.primitiveCount; j++) {
+					const CachePrimitive& cachePrimitive = cachePrimitives[cacheNode.firstPrimitive + j];
+					Primitive* primitive = &primitiveStorage.emplace_back(cachePrimitive.firstIndex, cachePrimitive.indexCount, cachePrimitive.vertexCount, materials[cachePrimitive.materialIndex]);
+					if (cachePrimitive.bbValid) {
+						primitive->setBoundingBox(cachePrimitive.bbMin, cachePrimitive.bbMax);
+					}
+					primitive->lods.assign(cacheLods + cachePrimitive.firstLod, cacheLods + cachePrimitive.firstLod + cachePrimitive.lodCount);
+					primitive->firstMeshlet = cachePrimitive.firstMeshlet;
+					primitive->meshletCount = cachePrimitive.meshletCount;
+				}
+				mesh->primitives = std::span<Primitive>(primitiveStorage.data() + firstPrimitive, cacheNode.primitiveCount);
+				if (cacheNode.bbValid) {
+					mesh->setBoundingBox(cacheNode.bbMin, cacheNode.bbMax);
+				}
+				node->mesh = mesh;
+			}
+			linearNodes.push_back(node);
+		}
+		// Parents precede their children and siblings are stored in order, so this restores the original hierarchy
+		for (size_t i = 0; i < nodeCount; i++) {
+			Node* node = linearNodes[i];
+			if (cacheNodes[i].parent > -1) {
+				node->parent = linearNodes[cacheNodes[i].parent];
+				node->parent->children.push_back(node);
+			} else {
+				nodes.push_back(node);
+			}
+		}
+
+		const CacheString* cacheExtensions = reinterpret_cast<const CacheString*>(section(CacheExtensions));
+		for (size_t i = 0; i < sectionCount(CacheExtensions, sizeof(CacheString)); i++) {
+			extensions.push_back(getString(cacheExtensions[i]));
+		}
+
+		vertexCount = static_cast<size_t>(header->vertexCount);
+		indexCount = static_cast<size_t>(header->indexCount);
+		loaderInfo.cachedVertices = section(CacheVertices);
+		loaderInfo.cachedIndices = (indexCount > 0) ? section(CacheIndices) : nullptr;
+		const vks::meshoptimizer::Meshlet* cacheMeshlets = reinterpret_cast<const vks::meshoptimizer::Meshlet*>(section(CacheMeshlets));
+		loaderInfo.meshlets.assign(cacheMeshlets, cacheMeshlets + sectionCount(CacheMeshlets, sizeof(vks::meshoptimizer::Meshlet)));
+		const uint32_t* cacheMeshletVertices = reinterpret_cast<const uint32_t*>(section(CacheMeshletVertices));
+		loaderInfo.meshletVertices.assign(cacheMeshletVertices, cacheMeshletVertices + sectionCount(CacheMeshletVertices, sizeof(uint32_t)));
+		const uint32_t* cacheMeshletTriangles = reinterpret_cast<const uint32_t*>(section(CacheMeshletTriangles));
+		loaderInfo.meshletTriangles.assign(cacheMeshletTriangles, cacheMeshletTriangles + sectionCount(CacheMeshletTriangles, sizeof(uint32_t)));
+		loaderInfo.cacheFile = std::move(cacheFile);
+		return true;
+	}
+
+	void Model::writeCache(const ModelCreateInfo& createInfo)
+	{
+		// The cache only stores geometry and materials, animated and skinned models are always loaded from the source file
+		if (!animations.empty() || !skins.empty()) {
+			// Models are loaded on worker threads, reported once for all of them
+			static std::atomic<bool> skipReported{ false };
+			if (!skipReported.exchange(true)) {
+				std::cout << "Models with animations or skins (e.g. " << createInfo.filename << ") aren't cached, they're loaded from their source file each time\n";
+			}
+			return;
+		}
+
+		CacheHeader header{};
+		header.magic = cacheMagic;
+		header.version = cacheVersion;
+		if (!vks::vfs::getFileInfo(createInfo.filename, header.sourceSize, header.sourceWriteTime)) {
+			return;
+		}
+		header.vertexLayout = static_cast<uint32_t>(vertexLayout);
+		header.vertexStride = static_cast<uint32_t>((vertexLayout == VertexLayout::Compact) ? sizeof(CompactVertex) : sizeof(Vertex));
+		header.optimizeMeshes = loaderInfo.optimizeMeshes;
+		header.lodCount = loaderInfo.lodCount;
+		header.scale = createInfo.scale;
+		header.buildMeshlets = loaderInfo.buildMeshlets;
+		header.vertexCount = vertexCount;
+		header.indexCount = indexCount;
+
+		std::vector<char> strings;
+		auto addString = [&strings](const std::string& string) {
+			CacheString cacheString{ static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(string.size()) };
+			strings.insert(strings.end(), string.begin(), string.end());
+			return cacheString;
+		};
+
+		std::vector<CacheTexture> cacheTextures;
+		std::vector<uint8_t> imageData;
+		for (const TextureSource& source : textureSources) {
+			CacheTexture cacheTexture{};
+			cacheTexture.sampler = source.sampler;
+			cacheTexture.width = source.image.width;
+			cacheTexture.height = source.image.height;
+			cacheTexture.component = source.image.component;
+			cacheTexture.bits = source.image.bits;
+			cacheTexture.pixelType = source.image.pixel_type;
+			cacheTexture.dataOffset = imageData.size();
+			cacheTexture.dataSize = source.image.image.size();
+			cacheTexture.name = addString(source.image.name);
+			cacheTexture.uri = addString(source.image.uri);
+			imageData.insert(imageData.end(), source.image.image.begin(), source.image.image.end());
+			cacheTextures.push_back(cacheTexture);
+		}
+
+		auto getTextureIndex = [this](const Texture* texture) {
+			return texture ? static_cast<int32_t>(texture - textures.data()) : -1;
+		};
+		std::vector<CacheMaterial> cacheMaterials;
+		for (const Material& material : materials) {
+			CacheMaterial cacheMaterial{};
+			cacheMaterial.baseColorFactor = material.baseColorFactor;
+			cacheMaterial.emissiveFactor = material.emissiveFactor;
+			cacheMaterial.diffuseFactor = material.extension.diffuseFactor;
+			cacheMaterial.specularFactor = material.extension.specularFactor;
+			cacheMaterial.alphaCutoff = material.alphaCutoff;
+			cacheMaterial.metallicFactor = material.metallicFactor;
+			cacheMaterial.roughnessFactor = material.roughnessFactor;
+			cacheMaterial.emissiveStrength = material.emissiveStrength;
+			cacheMaterial.alphaMode = static_cast<uint32_t>(material.alphaMode);
+			cacheMaterial.doubleSided = material.doubleSided;
+			cacheMaterial.unlit = material.unlit;
+			cacheMaterial.metallicRoughnessWorkflow = material.pbrWorkflows.metallicRoughness;
+			cacheMaterial.specularGlossinessWorkflow = material.pbrWorkflows.specularGlossiness;
+			cacheMaterial.texCoordSets = material.texCoordSets;
+			cacheMaterial.baseColorTexture = getTextureIndex(material.baseColorTexture);
+			cacheMaterial.metallicRoughnessTexture = getTextureIndex(material.metallicRoughnessTexture);
+			cacheMaterial.normalTexture = getTextureIndex(material.normalTexture);
+			cacheMaterial.occlusionTexture = getTextureIndex(material.occlusionTexture);
+			cacheMaterial.emissiveTexture = getTextureIndex(material.emissiveTexture);
+			cacheMaterial.specularGlossinessTexture = getTextureIndex(material.extension.specularGlossinessTexture);
+			cacheMaterial.diffuseTexture = getTextureIndex(material.extension.diffuseTexture);
+			cacheMaterials.push_back(cacheMaterial);
+		}
+
+		std::vector<CacheNode> cacheNodes;
+		std::vector<CachePrimitive> cachePrimitives;
+		std::vector<Primitive::Lod> cacheLods;
+		for (const Node* node : linearNodes) {
+			CacheNode cacheNode{};
+			cacheNode.matrix = node->matrix;
+			cacheNode.rotation = node->rotation;
+			cacheNode.translation = node->translation;
+			cacheNode.scale = node->scale;
+			cacheNode.parent = node->parent ? static_cast<int32_t>(node->parent->linearIndex) : -1;
+			cacheNode.index = node->index;
+			cacheNode.name = addString(node->name);
+			if (node->mesh) {
+				cacheNode.hasMesh = 1;
+				cacheNode.bbMin = node->mesh->bb.min;
+				cacheNode.bbMax = node->mesh->bb.max;
+				cacheNode.bbValid = node->mesh->bb.valid;
+				cacheNode.firstPrimitive = static_cast<uint32_t>(cachePrimitives.size());
+				cacheNode.primitiveCount = static_cast<uint32_t>(node->mesh->primitives.size());
+				for (const Primitive& primitive : node->mesh->primitives) {
+					cachePrimitives.push_back({
+						.bbMin = primitive.bb.min,
+						.bbMax = primitive.bb.max,
+						.bbValid = primitive.bb.valid,
+						.firstIndex = primitive.firstIndex,
+						.indexCount = primitive.indexCount,
+						.vertexCount = primitive.vertexCount,
+						.materialIndex = static_cast<uint32_t>(&primitive.material - materials.data()),
+						.firstLod = static_cast<uint32_t>(cacheLods.size()),
+						.lodCount = static_cast<uint32_t>(primitive.lods.size()),
+						.firstMeshlet = primitive.firstMeshlet,
+						.meshletCount = primitive.meshletCount
+					});
+					cacheLods.insert(cacheLods.end(), primitive.lods.begin(), primitive.lods.end());
+				}
+			}
+			cacheNodes.push_back(cacheNode);
+		}
+
+		std::vector<CacheString> cacheExtensions;
+		for (const std::string& extension : extensions) {
+			cacheExtensions.push_back(addString(extension));
+		}
+
+		std::vector<CacheDependency> cacheDependencies;
+		for (const std::string& dependency : loaderInfo.dependencies) {
+			CacheDependency cacheDependency{};
+			if (!vks::vfs::getFileInfo(filePath + "/" + dependency, cacheDependency.size, cacheDependency.writeTime)) {
+				cacheDependency.size = 0;
+				cacheDependency.writeTime = 0;
+			}
+			cacheDependency.uri = addString(dependency);
+			cacheDependencies.push_back(cacheDependency);
+		}
+
+		const void* vertexData = (vertexLayout == VertexLayout::Compact) ? static_cast<const void*>(loaderInfo.compactVertexBuffer) : static_cast<const void*>(loaderInfo.vertexBuffer);
+		const std::pair<const void*, uint64_t> sections[CacheSectionCount] = {
+			{ vertexData, vertexCount * header.vertexStride },
+			{ loaderInfo.indexBuffer, indexCount * sizeof(uint32_t) },
+			{ cacheNodes.data(), cacheNodes.size() * sizeof(CacheNode) },
+			{ cachePrimitives.data(), cachePrimitives.size() * sizeof(CachePrimitive) },
+			{ cacheLods.data(), cacheLods.size() * sizeof(Primitive::Lod) },
+			{ loaderInfo.meshlets.data(), loaderInfo.meshlets.size() * sizeof(vks::meshoptimizer::Meshlet) },
+			{ loaderInfo.meshletVertices.data(), loaderInfo.meshletVertices.size() * sizeof(uint32_t) },
+			{ loaderInfo.meshletTriangles.data(), loaderInfo.meshletTriangles.size() * sizeof(uint32_t) },
+			{ cacheMaterials.data(), cacheMaterials.size() * sizeof(CacheMaterial) },
+			{ cacheTextures.data(), cacheTextures.size() * sizeof(CacheTexture) },
+			{ imageData.data(), imageData.size() },
+			{ strings.data(), strings.size() },
+			{ cacheExtensions.data(), cacheExtensions.size() * sizeof(CacheString) },
+			{ cacheDependencies.data(), cacheDependencies.size() * sizeof(CacheDependency) },
+		};
+		uint64_t offset = sizeof(CacheHeader);
+		for (uint32_t i = 0; i < CacheSectionCount; i++) {
+			offset = (offset + cacheAlignment - 1) & ~(cacheAlignment - 1);
+			header.sections[i] = { offset, sections[i].second };
+			offset += sections[i].second;
+		}
+
+		// Written to a temporary file first, so a partially written cache is never picked up
+		const std::string cacheFilename = getCacheFilename(createInfo.filename);
+		const std::string tempFilename = cacheFilename + ".tmp";
+		{
+			std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+			if (!file.is_open()) {
+				std::cerr << "Could not write model cache " << cacheFilename << std::endl;
+				return;
+			}
+			file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+			const char padding[cacheAlignment]{};
+			for (uint32_t i = 0; i < CacheSectionCount; i++) {
+				file.write(padding, static_cast<std::streamsize>(header.sections[i].offset - static_cast<uint64_t>(file.tellp())));
+				if (sections[i].second > 0) {
+					file.write(static_cast<const char*>(sections[i].first), static_cast<std::streamsize>(sections[i].second));
+				}
+			}
+			if (!file.good()) {
+				std::cerr << "Could not write model cache " << cacheFilename << std::endl;
+				return;
+			}
+		}
+		std::error_code error;
+		std::filesystem::rename(tempFilename, cacheFilename, error);
+		if (error) {
+			std::cerr << "Could not write model cache " << cacheFilename << ": " << error.message() << std::endl;
+			std::filesystem::remove(tempFilename, error);
+		}
+	}
+
 	Model::Model(ModelCreateInfo createInfo) {
+		if (load(createInfo)) {
+			upload(createInfo.uploadBatch);
+		}
+	}
+
+	bool Model::load(ModelCreateInfo createInfo) {
+		size_t pos = createInfo.filename.find_last_of('/');
+		filePath = createInfo.filename.substr(0, pos);
+		vertexLayout = createInfo.vertexLayout;
+		loaderInfo.optimizeMeshes = createInfo.optimizeMeshes;
+		loaderInfo.lodCount = std::max(createInfo.lodCount, 1u);
+		lodCount = loaderInfo.lodCount;
+		meshletDescriptorSetLayout = createInfo.meshletDescriptorSetLayout;
+		loaderInfo.buildMeshlets = (meshletDescriptorSetLayout != VK_NULL_HANDLE);
+		maxPackedTextureSize = createInfo.maxPackedTextureSize;
+
+		// An up to date cache replaces parsing and converting the glTF file
+		const bool loadedFromCache = createInfo.useCache && loadCache(createInfo);
+		if (!loadedFromCache && !loadglTFFile(createInfo)) {
+			return false;
+		}
+
+		updateNodeMatrices();
+		assignJointRanges();
+		// Initial pose
+		for (auto& node : linearNodes) {
+			node->update(jointMatrices);
+		}
+		bakeDrawList();
+		getSceneDimensions();
+		assignTextureColorSpaces();
+		hashTextureSources(createInfo.jobSystem);
+		hashGeometry(createInfo.jobSystem);
+
+		// Archived models can't be written back to
+		if (createInfo.useCache && !loadedFromCache && !vks::vfs::isArchived(createInfo.filename)) {
+			writeCache(createInfo);
+		}
+
+		// Store a copy of the createInfo for hot reload		
+		if (createInfo.enableHotReload) {
+			initialCreateInfo = new ModelCreateInfo(createInfo);
+			// Reloads are uploaded in batches of their own
+			initialCreateInfo->uploadBatch = nullptr;
+		}
+
+		return true;
+	}
+
+	bool Model::loadglTFFile(const ModelCreateInfo& createInfo) {
 		tinygltf::Model gltfModel;
 		tinygltf::TinyGLTF gltfContext;
-		gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+		std::vector<int> deferredImages;
+		gltfContext.SetImageLoader(deferImageDataFunc, &deferredImages);
+		gltfContext.SetFsCallbacks({
+			.FileExists = vfsFileExists,
+			.ExpandFilePath = tinygltf::ExpandFilePath,
+			.ReadWholeFile = vfsReadWholeFile,
+			.WriteWholeFile = tinygltf::WriteWholeFile,
+			.user_data = nullptr
+		});
 
 		std::string error;
 		std::string warning;
@@ -819,34 +1971,72 @@ namespace vkglTF
 		if (extpos != std::string::npos) {
 			binary = (createInfo.filename.substr(extpos + 1, createInfo.filename.length() - extpos) == "glb");
 		}
-		size_t pos = createInfo.filename.find_last_of('/');
-		filePath = createInfo.filename.substr(0, pos);
 
-		bool fileLoaded = binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, createInfo.filename.c_str()) : gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, createInfo.filename.c_str());
+		bool fileLoaded = false;
+		if (binary) {
+			// Binary files are parsed from their mapping instead of a copy, only the binary chunk is copied into the model's buffer
+			const auto file = vks::vfs::open(createInfo.filename);
+			if (file && file->isValid()) {
+				fileLoaded = gltfContext.LoadBinaryFromMemory(&gltfModel, &error, &warning, file->data(), static_cast<unsigned int>(file->size()), tinygltf::GetBaseDir(createInfo.filename));
+			} else {
+				error = "File not found : " + createInfo.filename;
+			}
+		} else {
+			fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, createInfo.filename.c_str());
+		}
 
-		LoaderInfo loaderInfo{};
-		size_t vertexCount = 0;
-		size_t indexCount = 0;
+		// tinygltf ignores required extensions, so compressed files it can't decode would load with zeroed geometry
+#if !defined(TINYGLTF_ENABLE_DRACO)
+		if (fileLoaded && std::find(gltfModel.extensionsRequired.begin(), gltfModel.extensionsRequired.end(), "KHR_draco_mesh_compression") != gltfModel.extensionsRequired.end()) {
+			std::cerr << "Could not load gltf file " << createInfo.filename << ": Draco compressed files need a build with USE_DRACO" << std::endl;
+			return false;
+		}
+#endif
+		if (fileLoaded && !decodeBufferViews(gltfModel, createInfo.jobSystem)) {
+			std::cerr << "Could not load gltf file: " << createInfo.filename << std::endl;
+			return false;
+		}
 
 		if (fileLoaded) {
+			decodeImages(gltfModel, deferredImages, createInfo.jobSystem);
 			loadTextureSamplers(gltfModel);
 			loadTextures(gltfModel);
 			loadMaterials(gltfModel);
 
 			const tinygltf::Scene& scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
 
-			// Get vertex and index buffer sizes up-front
+			// Get vertex and index buffer sizes and the size of the scene graph up-front
+			size_t nodeCount = 0, meshCount = 0, primitiveCount = 0;
 			for (size_t i = 0; i < scene.nodes.size(); i++) {
-				getNodeProps(gltfModel.nodes[scene.nodes[i]], gltfModel, vertexCount, indexCount);
+				getNodeProps(gltfModel.nodes[scene.nodes[i]], gltfModel, vertexCount, indexCount, nodeCount, meshCount, primitiveCount);
+			}
+			reserveSceneGraph(nodeCount, meshCount, primitiveCount);
+			// The compact layout has no joints and weights
+			if (vertexLayout == VertexLayout::Compact && !gltfModel.skins.empty()) {
+				std::cout << "Using the default vertex layout for skinned model " << createInfo.filename << std::endl;
+				vertexLayout = VertexLayout::Default;
+			}
+			if (vertexLayout == VertexLayout::Compact) {
+				loaderInfo.compactVertexBuffer = new CompactVertex[vertexCount];
+			} else {
+				loaderInfo.vertexBuffer = new Vertex[vertexCount];
 			}
-			loaderInfo.vertexBuffer = new Vertex[vertexCount];
 			loaderInfo.indexBuffer = new uint32_t[indexCount];
 
 			// TODO: scene handling with no default scene
 			for (size_t i = 0; i < scene.nodes.size(); i++) {
-				const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
+				const tinygltf::Node& node = gltfModel.nodes[scene.nodes[i]];
 				loadNode(nullptr, node, scene.nodes[i], gltfModel, loaderInfo, createInfo.scale);
 			}
+			// Primitives only write to their own ranges of the loader buffers, so they can be converted in parallel
+			parallelFor(createInfo.jobSystem, static_cast<uint32_t>(loaderInfo.primitives.size()), [this, &gltfModel](uint32_t first, uint32_t count) {
+				for (uint32_t i = first; i < first + count; i++) {
+					loadPrimitive(gltfModel, loaderInfo.primitives[i]);
+				}
+			});
+			appendPrimitiveLods();
+			appendPrimitiveMeshlets();
+			loaderInfo.primitives.clear();
 			if (gltfModel.animations.size() > 0) {
 				loadAnimations(gltfModel);
 			}
@@ -857,94 +2047,381 @@ namespace vkglTF
 				if (node->skinIndex > -1) {
 					node->skin = skins[node->skinIndex];
 				}
-				// Initial pose
-				if (node->mesh) {
-					node->update();
-				}
 			}
 		}
 		else {
 			// TODO: throw
 			std::cerr << "Could not load gltf file: " << error << std::endl;
-			return;
+			return false;
 		}
 
 		extensions = gltfModel.extensionsUsed;
+		// Embedded buffers and images (data uris, or the binary chunk of glb files) are covered by the glTF file itself
+		auto addDependency = [this](const std::string& uri) {
+			if (!uri.empty() && !tinygltf::IsDataURI(uri) && (std::find(loaderInfo.dependencies.begin(), loaderInfo.dependencies.end(), uri) == loaderInfo.dependencies.end())) {
+				loaderInfo.dependencies.push_back(uri);
+			}
+		};
+		for (const tinygltf::Buffer& buffer : gltfModel.buffers) {
+			addDependency(buffer.uri);
+		}
+		for (const tinygltf::Image& image : gltfModel.images) {
+			addDependency(image.uri);
+		}
 
-		size_t vertexBufferSize = vertexCount * sizeof(Vertex);
-		size_t indexBufferSize = indexCount * sizeof(uint32_t);
+		return true;
+	}
 
-		assert(vertexBufferSize > 0);
+	// The color space of an image depends on how materials use it, which glTF (and the cache) only stores with the materials
+	void Model::assignTextureColorSpaces()
+	{
+		for (const Material& material : materials) {
+			for (const Texture* texture : { material.baseColorTexture, material.emissiveTexture, material.extension.diffuseTexture, material.extension.specularGlossinessTexture }) {
+				if (texture) {
+					textureSources[texture - textures.data()].srgb = true;
+				}
+			}
+		}
+	}
 
+	void Model::hashTextureSources(vks::JobSystem* jobSystem)
+	{
+		parallelFor(jobSystem, static_cast<uint32_t>(textureSources.size()), [this](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; i++) {
+				const tinygltf::Image& image = textureSources[i].image;
+				uint64_t hash = 0xcbf29ce484222325ull;
+				if (image.image.empty()) {
+					// KTX files are loaded by the texture classes, so the file's identity stands in for its contents
+					const std::string filename = filePath + "/" + image.uri;
+					uint64_t fileSize{ 0 };
+					int64_t writeTime{ 0 };
+					vks::vfs::getFileInfo(filename, fileSize, writeTime);
+					hashBytes(hash, filename.data(), filename.size());
+					hashBytes(hash, &writeTime, sizeof(writeTime));
+					hashBytes(hash, &fileSize, sizeof(fileSize));
+				} else {
+					// The same pixels are uploaded with a different format depending on their color space
+					const int properties[] = { image.width, image.height, image.component, image.pixel_type, textureSources[i].srgb ? 1 : 0 };
+					hashBytes(hash, properties, sizeof(properties));
+					hashBytes(hash, image.image.data(), image.image.size());
+				}
+				textureSources[i].key = hash;
+			}
+		});
+	}
+
+	void Model::packTextures(vks::MipmapBatch& mipmapBatch, std::vector<std::vector<unsigned char>>& arrayData)
+	{
+		if (maxPackedTextureSize == 0) {
+			return;
+		}
+		// Layers are stored with an 8 bit code per texture in the material data
+		const uint32_t maxLayers = std::min(VulkanContext::device->properties.limits.maxImageArrayLayers, 255u);
+		// Ordered, so the same model always packs its images into the same arrays (and a hot reload can share them)
+		std::map<std::tuple<uint32_t, uint32_t, VkFormat>, std::vector<size_t>> groups;
+		for (size_t i = 0; i < textureSources.size(); i++) {
+			tinygltf::Image& image = textureSources[i].image;
+			if (image.image.empty() || (static_cast<uint32_t>(image.width) > maxPackedTextureSize) || (static_cast<uint32_t>(image.height) > maxPackedTextureSize)) {
+				continue;
+			}
+			expandToRGBA(image);
+			if (image.component != 4) {
+				continue;
+			}
+			groups[{ image.width, image.height, getImageFormat(image, textureSources[i].srgb) }].push_back(i);
+		}
 
-		// Create staging buffers
-		Buffer* indexStaging{ nullptr };
+		for (auto& [properties, members] : groups) {
+			const auto [width, height, format] = properties;
+			for (size_t first = 0; first < members.size(); first += maxLayers) {
+				const uint32_t layerCount = static_cast<uint32_t>(std::min<size_t>(maxLayers, members.size() - first));
+				// A single image gains nothing from an array
+				if (layerCount < 2) {
+					continue;
+				}
+				// The array is shared by the hash of its layers, like single images are shared by their own hash
+				uint64_t arrayKey = 0xcbf29ce484222325ull;
+				for (uint32_t layer = 0; layer < layerCount; layer++) {
+					hashBytes(arrayKey, &textureSources[members[first + layer]].key, sizeof(uint64_t));
+				}
+				uint32_t assetIndex = ApplicationContext::assetManager->acquireTexture(arrayKey);
+				if (assetIndex == UINT32_MAX) {
+					const size_t layerSize = textureSources[members[first]].image.image.size();
+					std::vector<unsigned char>& data = arrayData.emplace_back(layerSize * layerCount);
+					for (uint32_t layer = 0; layer < layerCount; layer++) {
+						memcpy(data.data() + layer * layerSize, textureSources[members[first + layer]].image.image.data(), layerSize);
+					}
+					assetIndex = ApplicationContext::assetManager->add("texture array", new vks::Texture2DArray({
+						.buffer = data.data(),
+						.bufferSize = data.size(),
+						.texWidth = width,
+						.texHeight = height,
+						.format = format,
+						.mipmapBatch = &mipmapBatch,
+					}, layerCount));
+					ApplicationContext::assetManager->setTextureContentKey(assetIndex, arrayKey);
+				}
+				const vks::Texture* textureArray = ApplicationContext::assetManager->getTexture(assetIndex);
+				for (uint32_t layer = 0; layer < layerCount; layer++) {
+					Texture& texture = textures[members[first + layer]];
+					// Each packed texture holds a reference to the array, so it's only destroyed with the last one
+					texture.assetIndex = (layer == 0) ? assetIndex : ApplicationContext::assetManager->acquireTexture(arrayKey);
+					texture.arrayLayer = layer;
+					texture.sourceKey = textureSources[members[first + layer]].key;
+					texture.width = textureArray->width;
+					texture.height = textureArray->height;
+					texture.mipLevels = textureArray->mipLevels;
+					texture.createSampler(textureSources[members[first + layer]].sampler);
+				}
+			}
+		}
+	}
 
-		// Vertex data
-		Buffer* vertexStaging = new Buffer({
-			.usageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			.size = vertexBufferSize,
-			.data = loaderInfo.vertexBuffer
+	void Model::hashGeometry(vks::JobSystem* jobSystem)
+	{
+		const uint32_t vertexStride = (vertexLayout == VertexLayout::Compact) ? sizeof(CompactVertex) : sizeof(Vertex);
+		const uint8_t* vertexData = loaderInfo.cachedVertices;
+		if (!vertexData) {
+			vertexData = (vertexLayout == VertexLayout::Compact) ? reinterpret_cast<const uint8_t*>(loaderInfo.compactVertexBuffer) : reinterpret_cast<const uint8_t*>(loaderInfo.vertexBuffer);
+		}
+		const uint8_t* indexData = loaderInfo.cachedIndices ? loaderInfo.cachedIndices : reinterpret_cast<const uint8_t*>(loaderInfo.indexBuffer);
+		const std::pair<const uint8_t*, size_t> sections[2] = {
+			{ vertexData, vertexCount * vertexStride },
+			{ indexData, indexCount * sizeof(uint32_t) }
+		};
+		// Hashed in fixed size chunks on the job system, the chunk hashes are then combined in order
+		const size_t chunkSize = 1024 * 1024;
+		const size_t vertexChunks = (sections[0].second + chunkSize - 1) / chunkSize;
+		const size_t indexChunks = (sections[1].second + chunkSize - 1) / chunkSize;
+		std::vector<uint64_t> chunkHashes(vertexChunks + indexChunks, 0xcbf29ce484222325ull);
+		parallelFor(jobSystem, static_cast<uint32_t>(chunkHashes.size()), [&](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; i++) {
+				const auto& section = (i < vertexChunks) ? sections[0] : sections[1];
+				const size_t offset = ((i < vertexChunks) ? i : i - vertexChunks) * chunkSize;
+				hashBytes(chunkHashes[i], section.first + offset, std::min(chunkSize, section.second - offset));
+			}
 		});
+		uint64_t hash = 0xcbf29ce484222325ull;
+		const uint64_t sizes[] = { vertexStride, sections[0].second, sections[1].second };
+		hashBytes(hash, sizes, sizeof(sizes));
+		hashBytes(hash, chunkHashes.data(), chunkHashes.size() * sizeof(uint64_t));
+		geometryKey = hash;
+	}
 
-		// Index data
-		if (indexBufferSize > 0) {
-			indexStaging = new Buffer({
-				.usageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				.size = indexBufferSize,
-				.data = loaderInfo.indexBuffer
-			});
+	uint64_t Model::upload(UploadBatch* uploadBatch) {
+		// All copies of the model's textures and buffers are submitted at once (unless they're part of a larger batch), so the upload signals a single timeline value
+		std::unique_ptr<UploadBatch> ownUploadBatch;
+		if (!uploadBatch) {
+			ownUploadBatch = std::make_unique<UploadBatch>();
+			uploadBatch = ownUploadBatch.get();
+		}
+		// Textures reference the asset manager, so unlike the image decoding they are created here
+		// The mip chains of all images that aren't stored in KTX files are generated together, the batch reads from the texture sources so these are kept until it's submitted
+		vks::MipmapBatch mipmapBatch;
+		// Small images are packed into texture arrays first, the batch reads the arrays' layers from these buffers
+		std::vector<std::vector<unsigned char>> arrayData;
+		packTextures(mipmapBatch, arrayData);
+		// Images already uploaded by any model (including unchanged images of the model being replaced by a hot reload) share that model's slot
+		for (size_t i = 0; i < textureSources.size(); i++) {
+			Texture& texture = textures[i];
+			if (texture.arrayLayer != UINT32_MAX) {
+				continue;
+			}
+			texture.sourceKey = textureSources[i].key;
+			texture.fromglTfImage(textureSources[i].image, filePath, textureSources[i].sampler, textureSources[i].srgb, &mipmapBatch, uploadBatch);
+		}
+		mipmapBatch.submit();
+		textureSources.clear();
+		// Materials refer to the textures by asset index, so they can only be added once these exist
+		for (Material& material : materials) {
+			material.bufferIndex = ApplicationContext::assetManager->addMaterial(material.getData());
 		}
 
-		// Create device local buffers
-		vertices = new Buffer({
-			.usageFlags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			.size = vertexBufferSize,
-			.map = false
-		});
-		// Index buffer
-		if (indexBufferSize > 0) {
-			indices = new Buffer({
-				.usageFlags = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		size_t vertexBufferSize = vertexCount * ((vertexLayout == VertexLayout::Compact) ? sizeof(CompactVertex) : sizeof(Vertex));
+		indexType = selectIndexType(vertexCount);
+		const uint32_t indexSize = getIndexSize(indexType);
+		size_t indexBufferSize = indexCount * indexSize;
+
+		assert(vertexBufferSize > 0);
+
+
+		// Meshlet data is uploaded into storage buffers read by the task and mesh shaders
+		const bool uploadMeshlets = (meshletDescriptorSetLayout != VK_NULL_HANDLE) && !loaderInfo.meshlets.empty();
+		const std::pair<const void*, size_t> meshletData[3] = {
+			{ loaderInfo.meshlets.data(), loaderInfo.meshlets.size() * sizeof(vks::meshoptimizer::Meshlet) },
+			{ loaderInfo.meshletVertices.data(), loaderInfo.meshletVertices.size() * sizeof(uint32_t) },
+			{ loaderInfo.meshletTriangles.data(), loaderInfo.meshletTriangles.size() * sizeof(uint32_t) }
+		};
+		StagingRegion meshletStaging[3]{};
+		Buffer** meshletBuffers[3] = { &meshlets, &meshletVertices, &meshletTriangles };
+		if (uploadMeshlets) {
+			for (uint32_t i = 0; i < 3; i++) {
+				meshletStaging[i] = VulkanContext::stagingBuffer->allocate(meshletData[i].second);
+				memcpy(meshletStaging[i].mapped, meshletData[i].first, meshletData[i].second);
+				*meshletBuffers[i] = new Buffer({
+					.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+					.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					.size = meshletData[i].second,
+					.map = false
+				});
+			}
+		}
+
+		// Models share the asset manager's geometry pool if their vertices fit in, so draws of different models don't need to rebind buffers
+		// Geometry that's already in the pool (e.g. the unchanged geometry of a hot reloaded model) shares those ranges instead of being uploaded again
+		GeometryPool* pool = ApplicationContext::assetManager->geometryPool;
+		const uint32_t vertexStride = (vertexLayout == VertexLayout::Compact) ? sizeof(CompactVertex) : sizeof(Vertex);
+		bool sharedGeometry = false;
+		if (pool && (pool->getVertexStride() == vertexStride) && (!uploadMeshlets || pool->hasStorageVertices())) {
+			sharedGeometry = pool->acquire(geometryKey, vertexBufferSize, indexBufferSize, indexSize, geometryAllocation);
+			if (sharedGeometry || pool->allocate(vertexBufferSize, indexBufferSize, indexSize, geometryAllocation, geometryKey)) {
+				geometryPool = pool;
+			} else {
+				std::cerr << "Geometry pool is full, " << filePath << " uses buffers of its own" << std::endl;
+			}
+		}
+
+		// Copy vertex and index data into the shared staging buffer
+		// Models loaded from a cache are copied straight from the mapped cache file
+		StagingRegion vertexStaging{};
+		StagingRegion indexStaging{};
+		if (!sharedGeometry) {
+			vertexStaging = VulkanContext::stagingBuffer->allocate(vertexBufferSize);
+			if (loaderInfo.cachedVertices) {
+				memcpy(vertexStaging.mapped, loaderInfo.cachedVertices, vertexBufferSize);
+			} else if (vertexLayout == VertexLayout::Compact) {
+				memcpy(vertexStaging.mapped, loaderInfo.compactVertexBuffer, vertexBufferSize);
+			} else {
+				memcpy(vertexStaging.mapped, loaderInfo.vertexBuffer, vertexBufferSize);
+			}
+			if (indexBufferSize > 0) {
+				indexStaging = VulkanContext::stagingBuffer->allocate(indexBufferSize);
+				copyIndices(indexStaging.mapped, loaderInfo.cachedIndices ? reinterpret_cast<const uint32_t*>(loaderInfo.cachedIndices) : loaderInfo.indexBuffer, indexCount, indexType);
+			}
+		}
+
+		if (geometryPool) {
+			vertices = geometryPool->vertices;
+			indices = (indexBufferSize > 0) ? geometryPool->indices : nullptr;
+			baseVertex = geometryAllocation.baseVertex();
+			baseIndex = geometryAllocation.baseIndex();
+		} else {
+			VkBufferUsageFlags deviceAddressUsage = 0;
+			if (VulkanContext::device->hasBufferDeviceAddress) {
+				deviceAddressUsage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+			}
+			// Create device local buffers
+			// With meshlets the mesh shader fetches the vertices from a storage buffer instead of the vertex input stage
+			VkBufferUsageFlags vertexUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | deviceAddressUsage;
+			if (uploadMeshlets) {
+				vertexUsage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			}
+			vertices = new Buffer({
+				.usageFlags = vertexUsage,
 				.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				.size = indexBufferSize,
+				.size = vertexBufferSize,
 				.map = false
 			});
+			// Index buffer
+			if (indexBufferSize > 0) {
+				indices = new Buffer({
+					.usageFlags = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | deviceAddressUsage,
+					.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					.size = indexBufferSize,
+					.map = false
+				});
+			}
 		}
+		vertexAddress = vertices->deviceAddress;
+		indexAddress = indices ? indices->deviceAddress : 0;
+		const VkDeviceSize vertexOffset = geometryPool ? geometryAllocation.vertexOffset : 0;
+		const VkDeviceSize indexOffset = geometryPool ? geometryAllocation.indexOffset : 0;
 
-		// Copy from staging buffers
-		VkCommandBuffer copyCmd = VulkanContext::device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		// Copy from staging buffers on the transfer queue
+		VkCommandBuffer copyCmd = uploadBatch->getCommandBuffer();
 
 		VkBufferCopy copyRegion = {};
 
-		copyRegion.size = vertexBufferSize;
-		vkCmdCopyBuffer(copyCmd, vertexStaging->buffer, vertices->buffer, 1, &copyRegion);
-
-		if (indexBufferSize > 0) {
-			copyRegion.size = indexBufferSize;
-			vkCmdCopyBuffer(copyCmd, indexStaging->buffer, indices->buffer, 1, &copyRegion);
+		if (!sharedGeometry) {
+			copyRegion.srcOffset = vertexStaging.offset;
+			copyRegion.dstOffset = vertexOffset;
+			copyRegion.size = vertexBufferSize;
+			vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices->buffer, 1, &copyRegion);
+
+			if (indexBufferSize > 0) {
+				copyRegion.srcOffset = indexStaging.offset;
+				copyRegion.dstOffset = indexOffset;
+				copyRegion.size = indexBufferSize;
+				vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices->buffer, 1, &copyRegion);
+			}
 		}
-
-		// @todo: Transfer queue
-		VulkanContext::device->flushCommandBuffer(copyCmd, VulkanContext::graphicsQueue, true);
-
-		if (indexBufferSize > 0) {
-			delete indexStaging;
+		copyRegion.dstOffset = 0;
+
+		const VkPipelineStageFlags meshletStages = VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+		if (uploadMeshlets) {
+			for (uint32_t i = 0; i < 3; i++) {
+				copyRegion.srcOffset = meshletStaging[i].offset;
+				copyRegion.size = meshletData[i].second;
+				vkCmdCopyBuffer(copyCmd, meshletStaging[i].buffer, (*meshletBuffers[i])->buffer, 1, &copyRegion);
+				VulkanContext::stagingBuffer->releaseBuffer(copyCmd, (*meshletBuffers[i])->buffer, VK_ACCESS_SHADER_READ_BIT, meshletStages);
+			}
+		}
+		// The pool's buffers are in use by other models, so only the written ranges are released and without an ownership transfer
+		auto releaseGeometry = [this, copyCmd](VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask) {
+			if (geometryPool) {
+				VulkanContext::stagingBuffer->releaseSharedBuffer(copyCmd, buffer, offset, size, dstAccessMask, dstStageMask);
+			} else {
+				VulkanContext::stagingBuffer->releaseBuffer(copyCmd, buffer, dstAccessMask, dstStageMask);
+			}
+		};
+		// Vertex pulling reads the vertices in the vertex shader, mesh shading in the task and mesh shaders
+		// Shared geometry has been released by the model that uploaded it, whose upload was submitted before this one and so signals an earlier timeline value
+		VkAccessFlags vertexAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		VkPipelineStageFlags vertexStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		if (vertexAddress) {
+			vertexAccessMask |= VK_ACCESS_SHADER_READ_BIT;
+			vertexStages |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+		}
+		if (uploadMeshlets) {
+			vertexAccessMask |= VK_ACCESS_SHADER_READ_BIT;
+			vertexStages |= meshletStages;
 		}
+		if (!sharedGeometry) {
+			releaseGeometry(vertices->buffer, vertexOffset, vertexBufferSize, vertexAccessMask, vertexStages);
+			if (indexBufferSize > 0) {
+				releaseGeometry(indices->buffer, indexOffset, indexBufferSize, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+			}
+		}
+		// Doesn't wait, the graphics queue waits for the upload before it first uses the buffers
+		const uint64_t timelineValue = ownUploadBatch ? ownUploadBatch->submit() : 0;
 
-		delete vertexStaging;
 		delete[] loaderInfo.vertexBuffer;
+		delete[] loaderInfo.compactVertexBuffer;
 		delete[] loaderInfo.indexBuffer;
-
-		getSceneDimensions();
-
-		// Store a copy of the createInfo for hot reload		
-		if (createInfo.enableHotReload) {
-			initialCreateInfo = new ModelCreateInfo(createInfo);
+		loaderInfo = {};
+
+		if (uploadMeshlets) {
+			meshletVertexDescriptor = { .buffer = vertices->buffer, .offset = vertexOffset, .range = vertexBufferSize };
+			meshletDescriptorPool = new DescriptorPool({
+				.name = "glTF meshlet descriptor pool",
+				.maxSets = 1,
+				.poolSizes = {
+					{.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 4 }
+				}
+			});
+			meshletDescriptorSet = new DescriptorSet({
+				.pool = meshletDescriptorPool,
+				.layouts = { meshletDescriptorSetLayout },
+				.descriptors = {
+					{.dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &meshletVertexDescriptor },
+					{.dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &meshlets->descriptor },
+					{.dstBinding = 2, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &meshletVertices->descriptor },
+					{.dstBinding = 3, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &meshletTriangles->descriptor }
+				}
+			});
 		}
+
+		return timelineValue;
 	}
 
 	Model::~Model() 
@@ -952,58 +2429,238 @@ namespace vkglTF
 		freeResources();
 	}
 
-	void Model::bindBuffers(VkCommandBuffer commandBuffer)
+	void Model::bindBuffers(CommandBuffer* commandBuffer)
 	{
-		const VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices->buffer, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indices->buffer, 0, VK_INDEX_TYPE_UINT32);
+		commandBuffer->bindVertexBuffer(0, vertices->buffer);
+		commandBuffer->bindIndexBuffer(indices->buffer, 0, indexType);
 	}
 
-	void Model::drawNode(Node *node, VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, glm::mat4 matrix, bool skipMaterials)
+	void Model::drawNode(Node *node, CommandBuffer* commandBuffer, const DrawContext& context, glm::mat4 matrix)
 	{
+		PushConstBlock pushConstBlock{
+			.radianceIndex = context.radianceIndex,
+			.irradianceIndex = context.irradianceIndex,
+			.jointOffset = noJoints,
+			.vertexAddress = vertexAddress
+		};
 		if (node->mesh) {
-			for (Primitive *primitive : node->mesh->primitives) {
-				// @todo: optimize, only recalculate if necessary
-				glm::mat4 nodeMatrix = node->matrix;
-				Node* currentParent = node->parent;
-				while (currentParent) {
-					nodeMatrix = currentParent->matrix * nodeMatrix;
-					currentParent = currentParent->parent;
-				}
-				
-				// Material setup can explicitly be skipped if e.g. used for non standard glTF display
-				if (!skipMaterials) {
+			for (Primitive& primitive : node->mesh->primitives) {
+				const glm::mat4& nodeMatrix = node->worldMatrix;
+
+				if (!context.skipMaterials) {
 					pushConstBlock.matrix = nodeMatrix;
 					pushConstBlock.matrix[1][1] *= -1.0;
 					pushConstBlock.matrix[2][2] *= -1.0;
 					pushConstBlock.matrix = matrix * pushConstBlock.matrix;
-					// @todo: different textures (base, normal, etc.)
-					pushConstBlock.textureIndex = primitive->material.baseColorTexture->assetIndex;
+					pushConstBlock.materialIndex = primitive.material.bufferIndex;
 					// Pass the final matrix to the vertex shader using push constants
-					vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+					commandBuffer->pushConstants(context.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 				}
 				// @todo: images via push constants
-				vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+				commandBuffer->drawIndexed(primitive.indexCount, 1, baseIndex + primitive.firstIndex, baseVertex, 0);
 			}
 		}
 		for (auto& child : node->children) {
-			drawNode(child, commandBuffer, pipelineLayout, matrix);
+			drawNode(child, commandBuffer, context, matrix);
 		}
 	}
 
-	void Model::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, glm::mat4 matrix, bool skipMaterials, bool bindBuffers)
+	void Model::draw(CommandBuffer* commandBuffer, const DrawContext& context, glm::mat4 matrix, bool bindBuffers, uint32_t lod, const glm::mat4* pose, uint32_t jointBase, const vks::Frustum* frustum)
 	{
+		const glm::mat4* matrices = pose ? pose : nodeMatrices.data();
 		if (bindBuffers) {
 			this->bindBuffers(commandBuffer);
 		}
-		for (auto& node : nodes) {
-			drawNode(node, commandBuffer, pipelineLayout, matrix, skipMaterials);
+		const std::vector<DrawRecord>& drawList = drawLists[std::min(lod, lodCount - 1)];
+		// A single primitive is covered by the caller's test of the whole model
+		const bool cullPrimitives = frustum && (drawList.size() > 1);
+		PushConstBlock pushConstBlock{
+			.radianceIndex = context.radianceIndex,
+			.irradianceIndex = context.irradianceIndex,
+			.vertexAddress = vertexAddress
+		};
+		for (const DrawRecord& record : drawList) {
+			// The vertices of skinned primitives move away from the bounds of their node
+			if (cullPrimitives && record.bounds.valid && (record.jointOffset == noJoints) && !frustum->checkOrientedBox(matrix * matrices[record.nodeMatrixIndex], record.bounds.min, record.bounds.max)) {
+				continue;
+			}
+			if (!context.skipMaterials) {
+				pushConstBlock.matrix = matrix * matrices[record.nodeMatrixIndex];
+				pushConstBlock.materialIndex = materials[record.materialIndex].bufferIndex;
+				pushConstBlock.jointOffset = (record.jointOffset != noJoints) ? jointBase + record.jointOffset : noJoints;
+				commandBuffer->pushConstants(context.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+			}
+			commandBuffer->drawIndexed(record.indexCount, 1, baseIndex + record.firstIndex, baseVertex, 0);
 		}
 	}
 
-	void Model::calculateBoundingBox(Node *node, Node *parent) {
-		BoundingBox parentBvh = parent ? parent->bvh : BoundingBox(dimensions.min, dimensions.max);
+	void Model::drawInstanced(CommandBuffer* commandBuffer, const DrawContext& context, uint32_t instanceCount, uint32_t firstInstance, bool bindBuffers, uint32_t lod)
+	{
+		if (instanceCount == 0) {
+			return;
+		}
+		if (bindBuffers) {
+			this->bindBuffers(commandBuffer);
+		}
+		PushConstBlock pushConstBlock{
+			.radianceIndex = context.radianceIndex,
+			.irradianceIndex = context.irradianceIndex,
+			.jointOffset = noJoints,
+			.vertexAddress = vertexAddress
+		};
+		for (const DrawRecord& record : drawLists[std::min(lod, lodCount - 1)]) {
+			if (!context.skipMaterials) {
+				// Only the node matrix is passed, the instance's matrix is applied in the vertex shader
+				pushConstBlock.matrix = nodeMatrices[record.nodeMatrixIndex];
+				pushConstBlock.materialIndex = materials[record.materialIndex].bufferIndex;
+				commandBuffer->pushConstants(context.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+			}
+			commandBuffer->drawIndexed(record.indexCount, instanceCount, baseIndex + record.firstIndex, baseVertex, firstInstance);
+		}
+	}
 
+	uint32_t Model::appendIndirectCommands(std::vector<VkDrawIndexedIndirectCommand>& commands, uint32_t firstInstance, uint32_t lod)
+	{
+		const std::vector<DrawRecord>& drawList = drawLists[std::min(lod, lodCount - 1)];
+		for (const DrawRecord& record : drawList) {
+			commands.push_back({
+				.indexCount = record.indexCount,
+				.instanceCount = 0,
+				.firstIndex = baseIndex + record.firstIndex,
+				.vertexOffset = baseVertex,
+				.firstInstance = firstInstance
+			});
+		}
+		return static_cast<uint32_t>(drawList.size());
+	}
+
+	void Model::drawIndirect(CommandBuffer* commandBuffer, const DrawContext& context, VkBuffer indirectBuffer, VkDeviceSize commandOffset, VkBuffer countBuffer, VkDeviceSize countOffset, bool bindBuffers, uint32_t lod)
+	{
+		if (bindBuffers) {
+			this->bindBuffers(commandBuffer);
+		}
+		PushConstBlock pushConstBlock{
+			.radianceIndex = context.radianceIndex,
+			.irradianceIndex = context.irradianceIndex,
+			.jointOffset = noJoints,
+			.vertexAddress = vertexAddress
+		};
+		for (const DrawRecord& record : drawLists[std::min(lod, lodCount - 1)]) {
+			if (!context.skipMaterials) {
+				pushConstBlock.matrix = nodeMatrices[record.nodeMatrixIndex];
+				pushConstBlock.materialIndex = materials[record.materialIndex].bufferIndex;
+				commandBuffer->pushConstants(context.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+			}
+			// Instance count and draw count are written by the GPU, so a fully culled model doesn't issue any draws
+			commandBuffer->drawIndexedIndirectCount(indirectBuffer, commandOffset, countBuffer, countOffset, 1, sizeof(VkDrawIndexedIndirectCommand));
+			commandOffset += sizeof(VkDrawIndexedIndirectCommand);
+			pushConstBlock.firstTriangle += record.indexCount / 3;
+		}
+	}
+
+	void Model::drawMeshlets(CommandBuffer* commandBuffer, const DrawContext& context, uint32_t instanceCount, uint32_t firstInstance)
+	{
+		if (instanceCount == 0 || !hasMeshlets()) {
+			return;
+		}
+		commandBuffer->bindDescriptorSets(context.pipelineLayout, { meshletDescriptorSet }, 2);
+		MeshletPushConstBlock meshletPushConstBlock{
+			.radianceIndex = context.radianceIndex,
+			.irradianceIndex = context.irradianceIndex,
+			.firstInstance = firstInstance
+		};
+		for (const DrawRecord& record : drawLists[0]) {
+			if (record.meshletCount == 0) {
+				continue;
+			}
+			meshletPushConstBlock.matrix = nodeMatrices[record.nodeMatrixIndex];
+			meshletPushConstBlock.materialIndex = materials[record.materialIndex].bufferIndex;
+			meshletPushConstBlock.firstMeshlet = record.firstMeshlet;
+			meshletPushConstBlock.meshletCount = record.meshletCount;
+			commandBuffer->pushConstants(context.pipelineLayout, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(MeshletPushConstBlock), &meshletPushConstBlock);
+			// Each task shader workgroup culls 32 meshlets of one instance
+			commandBuffer->drawMeshTasks((record.meshletCount + 31) / 32, instanceCount, 1);
+		}
+	}
+
+	bool Model::hasMeshlets() const
+	{
+		return meshletDescriptorSet != nullptr;
+	}
+
+	bool Model::isSkinned() const
+	{
+		return !jointMatrices.empty();
+	}
+
+	void Model::bakeDrawList(Node* node)
+	{
+		if (node->mesh) {
+			for (Primitive& primitive : node->mesh->primitives) {
+				for (uint32_t lod = 0; lod < lodCount; lod++) {
+					// Primitives without generated levels (e.g. non-indexed ones) are drawn at full resolution
+					const bool hasLod = (lod > 0) && (lod <= primitive.lods.size());
+					drawLists[lod].push_back({
+						.firstIndex = hasLod ? primitive.lods[lod - 1].firstIndex : primitive.firstIndex,
+						.indexCount = hasLod ? primitive.lods[lod - 1].indexCount : primitive.indexCount,
+						.nodeMatrixIndex = node->linearIndex,
+						.materialIndex = static_cast<uint32_t>(&primitive.material - materials.data()),
+					.firstMeshlet = primitive.firstMeshlet,
+					.meshletCount = primitive.meshletCount,
+					.jointOffset = node->firstJoint,
+					.bounds = primitive.bb
+					});
+				}
+			}
+		}
+	}
+
+	// Each skinned mesh node gets its own range of the palette, as the joint matrices are relative to the node's world matrix
+	void Model::assignJointRanges()
+	{
+		uint32_t jointCount = 0;
+		for (Node* node : linearNodes) {
+			if (node->mesh && node->skin && (vertexLayout == VertexLayout::Default)) {
+				node->firstJoint = jointCount;
+				jointCount += static_cast<uint32_t>(node->skin->joints.size());
+			}
+		}
+		jointMatrices.assign(jointCount, glm::mat4(1.0f));
+	}
+
+	void Model::bakeDrawList()
+	{
+		drawLists.assign(lodCount, {});
+		// Storage order is the depth-first order of the scene graph
+		for (Node* node : linearNodes) {
+			bakeDrawList(node);
+		}
+	}
+
+	uint32_t Model::selectLod(float screenSize) const
+	{
+		if (lodCount <= 1 || screenSize >= lodTransitionSize) {
+			return 0;
+		}
+		const uint32_t lod = 1 + static_cast<uint32_t>(std::log2(lodTransitionSize / std::max(screenSize, FLT_MIN)));
+		return std::min(lod, lodCount - 1);
+	}
+
+	void Model::updateNodeMatrices()
+	{
+		// Parents precede their children in storage, so their world matrices are always up to date when a child reads them
+		// Also builds the flat copy used for drawing, with the axis flips required by the push constant matrix already applied
+		nodeMatrices.resize(nodeStorage.size());
+		for (Node& node : nodeStorage) {
+			node.worldMatrix = node.parent ? node.parent->worldMatrix * node.matrix : node.matrix;
+			glm::mat4& nodeMatrix = nodeMatrices[node.linearIndex];
+			nodeMatrix = node.worldMatrix;
+			nodeMatrix[1][1] *= -1.0;
+			nodeMatrix[2][2] *= -1.0;
+		}
+	}
+
+	void Model::calculateBoundingBox(Node *node) {
 		if (node->mesh) {
 			if (node->mesh->bb.valid) {
 				node->aabb = node->mesh->bb.getAABB(node->getMatrix());
@@ -1014,48 +2671,67 @@ namespace vkglTF
 				}
 			}
 		}
-
-		parentBvh.min = glm::min(parentBvh.min, node->bvh.min);
-		parentBvh.max = glm::min(parentBvh.max, node->bvh.max);
-
-		for (auto &child : node->children) {
-			calculateBoundingBox(child, node);
-		}
 	}
 
 	void Model::freeResources()
 	{
-		// @todo
-		if (vertices) {
+		// Ranges in the geometry pool are returned to it, the pool's buffers stay alive
+		if (geometryPool) {
+			geometryPool->free(geometryAllocation);
+			geometryPool = nullptr;
+		} else {
 			delete vertices;
-		}
-		if (indices) {
 			delete indices;
 		}
-		for (auto texture : textures) {
+		vertices = indices = nullptr;
+		vertexAddress = indexAddress = 0;
+		delete meshlets;
+		delete meshletVertices;
+		delete meshletTriangles;
+		delete meshletDescriptorSet;
+		delete meshletDescriptorPool;
+		meshlets = meshletVertices = meshletTriangles = nullptr;
+		meshletDescriptorSet = nullptr;
+		meshletDescriptorPool = nullptr;
+		// Only still present if the model has been loaded but never uploaded
+		delete[] loaderInfo.vertexBuffer;
+		delete[] loaderInfo.compactVertexBuffer;
+		delete[] loaderInfo.indexBuffer;
+		loaderInfo = {};
+		for (auto& texture : textures) {
 			texture.destroy();
 		}
 		textures.resize(0);
 		textureSamplers.resize(0);
-		for (auto node : nodes) {
-			delete node;
+		for (Material& material : materials) {
+			if (material.bufferIndex != UINT32_MAX) {
+				ApplicationContext::assetManager->removeMaterial(material.bufferIndex);
+			}
 		}
 		materials.resize(0);
 		animations.resize(0);
 		nodes.resize(0);
 		linearNodes.resize(0);
+		// Nodes, meshes and primitives are released as a whole, the hierarchy only points into these
+		primitiveStorage.clear();
+		meshStorage.clear();
+		nodeStorage.clear();
+		primitiveStorage.shrink_to_fit();
+		meshStorage.shrink_to_fit();
+		nodeStorage.shrink_to_fit();
 		extensions.resize(0);
 		for (auto skin : skins) {
 			delete skin;
 		}
 		skins.resize(0);
+		jointMatrices.clear();
 	}
 
 	void Model::getSceneDimensions()
 	{
 		// Calculate binary volume hierarchy for all nodes in the scene
 		for (auto node : linearNodes) {
-			calculateBoundingBox(node, nullptr);
+			calculateBoundingBox(node);
 		}
 
 		dimensions.min = glm::vec3(FLT_MAX);
@@ -1090,74 +2766,145 @@ namespace vkglTF
 		bool updated = false;
 		for (auto& channel : animation.channels) {
 			vkglTF::AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
-			if (sampler.inputs.size() > sampler.outputsVec4.size()) {
+			if ((sampler.inputs.size() < 2) || (sampler.inputs.size() > sampler.getKeyCount())) {
+				continue;
+			}
+			if ((time < sampler.inputs.front()) || (time > sampler.inputs.back())) {
 				continue;
 			}
 
-			for (size_t i = 0; i < sampler.inputs.size() - 1; i++) {
-				if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
-					float u = std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]);
-					if (u <= 1.0f) {
-						switch (channel.path) {
-						case vkglTF::AnimationChannel::PathType::TRANSLATION: {
-							glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-							channel.node->translation = glm::vec3(trans);
-							break;
-						}
-						case vkglTF::AnimationChannel::PathType::SCALE: {
-							glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-							channel.node->scale = glm::vec3(trans);
-							break;
-						}
-						case vkglTF::AnimationChannel::PathType::ROTATION: {
-							glm::quat q1;
-							q1.x = sampler.outputsVec4[i].x;
-							q1.y = sampler.outputsVec4[i].y;
-							q1.z = sampler.outputsVec4[i].z;
-							q1.w = sampler.outputsVec4[i].w;
-							glm::quat q2;
-							q2.x = sampler.outputsVec4[i + 1].x;
-							q2.y = sampler.outputsVec4[i + 1].y;
-							q2.z = sampler.outputsVec4[i + 1].z;
-							q2.w = sampler.outputsVec4[i + 1].w;
-							channel.node->rotation = glm::normalize(glm::slerp(q1, q2, u));
-							break;
-						}
-						}
-						updated = true;
-					}
-				}
+			const size_t i = sampler.findInterval(time, sampler.cursor);
+			const float u = std::min(std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]), 1.0f);
+			const glm::vec4 output1 = sampler.getOutput(i);
+			const glm::vec4 output2 = sampler.getOutput(i + 1);
+			switch (channel.path) {
+			case vkglTF::AnimationChannel::PathType::TRANSLATION: {
+				glm::vec4 trans = glm::mix(output1, output2, u);
+				channel.node->translation = glm::vec3(trans);
+				break;
 			}
+			case vkglTF::AnimationChannel::PathType::SCALE: {
+				glm::vec4 trans = glm::mix(output1, output2, u);
+				channel.node->scale = glm::vec3(trans);
+				break;
+			}
+			case vkglTF::AnimationChannel::PathType::ROTATION: {
+				glm::quat q1;
+				q1.x = output1.x;
+				q1.y = output1.y;
+				q1.z = output1.z;
+				q1.w = output1.w;
+				glm::quat q2;
+				q2.x = output2.x;
+				q2.y = output2.y;
+				q2.z = output2.z;
+				q2.w = output2.w;
+				channel.node->rotation = glm::normalize(glm::slerp(q1, q2, u));
+				break;
+			}
+			}
+			// Animated nodes are defined by their translation, rotation and scale, so their local matrix is rebuilt from those (same as for loading)
+			channel.node->matrix = glm::translate(glm::mat4(1.0f), channel.node->translation) * glm::toMat4(channel.node->rotation) * glm::scale(glm::mat4(1.0f), channel.node->scale);
+			updated = true;
 		}
 		if (updated) {
-			for (auto &node : nodes) {
-				node->update();
+			// World matrices are calculated in a single pass from the roots down, skins then read them instead of walking up the hierarchy for every joint
+			updateNodeMatrices();
+			for (auto& node : linearNodes) {
+				node->update(jointMatrices);
 			}
 		}
 	}
 
-	Node* Model::findNode(Node *parent, uint32_t index) {
-		Node* nodeFound = nullptr;
-		if (parent->index == index) {
-			return parent;
+	void Model::evaluateAnimation(AnimationInstance& instance, float deltaTime) const
+	{
+		if (instance.clip >= animations.size()) {
+			return;
+		}
+		const Animation& animation = animations[instance.clip];
+		if (instance.model != this) {
+			instance.model = this;
+			instance.cursors.assign(animation.samplers.size(), 0);
+			instance.translations.resize(linearNodes.size());
+			instance.rotations.resize(linearNodes.size());
+			instance.scales.resize(linearNodes.size());
+			instance.animatedNodes.assign(linearNodes.size(), 0);
+			for (const Node* node : linearNodes) {
+				instance.translations[node->linearIndex] = node->translation;
+				instance.rotations[node->linearIndex] = node->rotation;
+				instance.scales[node->linearIndex] = node->scale;
+			}
+			for (const AnimationChannel& channel : animation.channels) {
+				instance.animatedNodes[channel.node->linearIndex] = 1;
+			}
+			instance.pose.resize(linearNodes.size());
+			instance.worldMatrices.resize(linearNodes.size());
+			instance.joints.resize(jointMatrices.size());
+		}
+
+		const float duration = animation.end - animation.start;
+		instance.time += deltaTime * instance.speed;
+		if (duration > 0.0f) {
+			instance.time = animation.start + std::fmod(std::fmod(instance.time - animation.start, duration) + duration, duration);
 		}
-		for (auto& child : parent->children) {
-			nodeFound = findNode(child, index);
-			if (nodeFound) {
+
+		for (const AnimationChannel& channel : animation.channels) {
+			const AnimationSampler& sampler = animation.samplers[channel.samplerIndex];
+			if ((sampler.inputs.size() < 2) || (sampler.inputs.size() > sampler.getKeyCount())) {
+				continue;
+			}
+			const float time = std::clamp(instance.time, sampler.inputs.front(), sampler.inputs.back());
+			const size_t i = sampler.findInterval(time, instance.cursors[channel.samplerIndex]);
+			const float u = std::min(std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]), 1.0f);
+			const uint32_t nodeIndex = channel.node->linearIndex;
+			const glm::vec4 output1 = sampler.getOutput(i);
+			const glm::vec4 output2 = sampler.getOutput(i + 1);
+			switch (channel.path) {
+			case AnimationChannel::PathType::TRANSLATION:
+				instance.translations[nodeIndex] = glm::vec3(glm::mix(output1, output2, u));
+				break;
+			case AnimationChannel::PathType::SCALE:
+				instance.scales[nodeIndex] = glm::vec3(glm::mix(output1, output2, u));
+				break;
+			case AnimationChannel::PathType::ROTATION: {
+				instance.rotations[nodeIndex] = glm::normalize(glm::slerp(glm::quat(output1.w, output1.x, output1.y, output1.z), glm::quat(output2.w, output2.x, output2.y, output2.z), u));
 				break;
 			}
+			}
+		}
+
+		// Same as updateNodeMatrices but with the instance's local transforms for animated nodes
+		for (const Node& node : nodeStorage) {
+			const uint32_t nodeIndex = node.linearIndex;
+			const glm::mat4 local = instance.animatedNodes[nodeIndex] ? glm::translate(glm::mat4(1.0f), instance.translations[nodeIndex]) * glm::toMat4(instance.rotations[nodeIndex]) * glm::scale(glm::mat4(1.0f), instance.scales[nodeIndex]) : node.matrix;
+			glm::mat4& world = instance.worldMatrices[nodeIndex];
+			world = node.parent ? instance.worldMatrices[node.parent->linearIndex] * local : local;
+			glm::mat4& nodeMatrix = instance.pose[nodeIndex];
+			nodeMatrix = world;
+			nodeMatrix[1][1] *= -1.0;
+			nodeMatrix[2][2] *= -1.0;
+		}
+
+		// Same as Node::update, but with the instance's world matrices
+		if (!instance.joints.empty()) {
+			for (const Node* node : linearNodes) {
+				if (node->firstJoint == noJoints) {
+					continue;
+				}
+				const glm::mat4 inverseTransform = glm::inverse(instance.worldMatrices[node->linearIndex]);
+				for (size_t i = 0; i < node->skin->joints.size(); i++) {
+					instance.joints[node->firstJoint + i] = inverseTransform * instance.worldMatrices[node->skin->joints[i]->linearIndex] * node->skin->inverseBindMatrices[i];
+				}
+			}
 		}
-		return nodeFound;
 	}
 
 	Node* Model::nodeFromIndex(uint32_t index) {
-		Node* nodeFound = nullptr;
-		for (auto &node : nodes) {
-			nodeFound = findNode(node, index);
-			if (nodeFound) {
-				break;
+		for (Node& node : nodeStorage) {
+			if (node.index == index) {
+				return &node;
 			}
 		}
-		return nodeFound;
+		return nullptr;
 	}
 }
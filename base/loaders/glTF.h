@@ -13,11 +13,21 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <memory>
+#include <span>
 
 #include "vulkan/vulkan.h"
 #include "Device.hpp"
 #include "Pipeline.hpp"
 #include "Buffer.hpp"
+#include "StagingBuffer.hpp"
+#include "GeometryPool.hpp"
+#include "DescriptorSet.hpp"
+#include "CommandBuffer.hpp"
+#include "JobSystem.hpp"
+#include "MeshOptimizer.hpp"
+#include "MappedFile.hpp"
+#include "VirtualFileSystem.h"
 #include "VulkanContext.h"
 
 #define GLM_FORCE_RADIANS
@@ -26,6 +36,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/quaternion.hpp>
 
@@ -44,8 +55,11 @@
 
 #include "tiny_gltf.h"
 
-// Changing this value here also requires changing it in the vertex shader
-#define MAX_NUM_JOINTS 128u
+namespace vks
+{
+	class MipmapBatch;
+	class Frustum;
+}
 
 namespace vkglTF
 {
@@ -59,6 +73,25 @@ namespace vkglTF
 		glm::vec4 color;
 	};
 
+	/**
+	 * Quantized vertex without skinning data (28 instead of 80 bytes)
+	 * All attributes are decoded by the vertex input stage, so the same shaders can be used with both vertex layouts
+	 */
+	struct CompactVertex {
+		glm::vec3 pos;
+		// Signed normalized, w is unused
+		glm::i16vec4 normal;
+		// Two half floats
+		uint32_t uv0;
+		// Unsigned normalized RGBA8
+		uint32_t color;
+	};
+
+	enum class VertexLayout {
+		Default,
+		Compact
+	};
+
 	const PipelineVertexInput vertexInput = {
 		.bindings = {
 			{ 0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX }
@@ -73,15 +106,80 @@ namespace vkglTF
 		}
 	};
 
-	// @todo: add additional material parameters and image indices
+	const PipelineVertexInput compactVertexInput = {
+		.bindings = {
+			{ 0, sizeof(CompactVertex), VK_VERTEX_INPUT_RATE_VERTEX }
+		},
+		.attributes = {
+			{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(CompactVertex, pos) },
+			{ 1, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(CompactVertex, normal) },
+			{ 2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, uv0) },
+			{ 6, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(CompactVertex, color) },
+		}
+	};
+
+	// Only the positions, for depth-only passes that don't need the other attributes
+	const PipelineVertexInput positionVertexInput = {
+		.bindings = {
+			{ 0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX }
+		},
+		.attributes = {
+			{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) }
+		}
+	};
+
+	const PipelineVertexInput compactPositionVertexInput = {
+		.bindings = {
+			{ 0, sizeof(CompactVertex), VK_VERTEX_INPUT_RATE_VERTEX }
+		},
+		.attributes = {
+			{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(CompactVertex, pos) }
+		}
+	};
+
+	/** @brief Returns the vertex input state for pipelines rendering models loaded with the given vertex layout */
+	inline const PipelineVertexInput& getVertexInput(VertexLayout layout)
+	{
+		return (layout == VertexLayout::Compact) ? compactVertexInput : vertexInput;
+	}
+
+	/** @brief Returns the position-only vertex input state for depth-only pipelines rendering models loaded with the given vertex layout */
+	inline const PipelineVertexInput& getPositionVertexInput(VertexLayout layout)
+	{
+		return (layout == VertexLayout::Compact) ? compactPositionVertexInput : positionVertexInput;
+	}
+
 	struct PushConstBlock {
 		glm::mat4 matrix;
-		uint32_t textureIndex;
+		// Slot of the primitive's material in the asset manager's material buffer
+		uint32_t materialIndex;
 		uint32_t radianceIndex;
 		uint32_t irradianceIndex;
+		// Offset of the primitive's joint palette in the per-frame joint matrix buffer, noJoints for primitives that aren't skinned
+		uint32_t jointOffset;
+		// Vertex buffer address of the drawn model, read by vertex shaders that fetch their vertices themselves
+		VkDeviceAddress vertexAddress;
+		// Triangles of the preceding primitives of the drawn level of detail, only set by drawIndirect (for numbering the triangles of the visibility buffer)
+		uint32_t firstTriangle;
+		uint32_t padding;
+	};
+
+	/**
+	 * State the draw functions of a model record with that doesn't come from the model itself
+	 * Passed to every call instead of being kept in shared state, so the same model can be recorded by multiple threads at once
+	 */
+	struct DrawContext {
+		// Needs a push constant range of PushConstBlock for the vertex and fragment stages (MeshletPushConstBlock for the task, mesh and fragment stages with drawMeshlets)
+		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+		// Bindless indices of the environment cubemaps
+		uint32_t radianceIndex{ 0 };
+		uint32_t irradianceIndex{ 0 };
+		// Material setup can explicitly be skipped if e.g. used for non standard glTF display, no push constants are written then
+		bool skipMaterials{ false };
 	};
 
-	extern PushConstBlock pushConstBlock;
+	// Joint offset of nodes and draws without a skin
+	constexpr uint32_t noJoints = UINT32_MAX;
 
 	struct Node;
 
@@ -103,7 +201,8 @@ namespace vkglTF
 	};
 
 	struct Texture {
-		uint32_t assetIndex{ 0 };
+		// UINT32_MAX until the image has been registered with the asset manager
+		uint32_t assetIndex{ UINT32_MAX };
 		VkImage image;
 		VkImageLayout imageLayout;
 		VkDeviceMemory deviceMemory;
@@ -113,8 +212,34 @@ namespace vkglTF
 		uint32_t layerCount;
 		VkDescriptorImageInfo descriptor;
 		VkSampler sampler;
+		// Hash of the image the texture was created from (pixels for decoded images, path and write time for KTX files), textures with the same hash share one asset slot
+		uint64_t sourceKey{ 0 };
+		// Layer of the texture array the image has been packed into (see ModelCreateInfo::maxPackedTextureSize), assetIndex then refers to the array, UINT32_MAX for textures of their own
+		uint32_t arrayLayer{ UINT32_MAX };
 		void destroy();
-		void fromglTfImage(tinygltf::Image& gltfimage, std::string filePath, TextureSampler textureSampler);
+		// If set, the upload and mip chain generation of images that aren't stored in KTX files is deferred until the mipmap batch is submitted, KTX files are recorded into the upload batch
+		void fromglTfImage(tinygltf::Image& gltfimage, std::string filePath, TextureSampler textureSampler, bool srgb, vks::MipmapBatch* mipmapBatch = nullptr, UploadBatch* uploadBatch = nullptr);
+		void createSampler(TextureSampler textureSampler);
+	};
+
+	/** @brief Material parameters as stored in the asset manager's material buffer, matches the Material struct of the glTF fragment shader */
+	struct MaterialData {
+		glm::vec4 baseColorFactor{ 1.0f };
+		// Emissive strength is already applied
+		glm::vec4 emissiveFactor{ 0.0f };
+		float metallicFactor{ 1.0f };
+		float roughnessFactor{ 1.0f };
+		float alphaCutoff{ 1.0f };
+		uint32_t alphaMode{ 0 };
+		// Asset indices of the textures, UINT32_MAX if the material doesn't use the texture
+		uint32_t baseColorTexture{ UINT32_MAX };
+		uint32_t metallicRoughnessTexture{ UINT32_MAX };
+		uint32_t normalTexture{ UINT32_MAX };
+		uint32_t occlusionTexture{ UINT32_MAX };
+		uint32_t emissiveTexture{ UINT32_MAX };
+		// 8 bits per texture in the order above (4 per element), 0 if the texture has an asset slot of its own, layer + 1 if its asset index refers to a texture array
+		uint32_t textureLayers[2]{};
+		uint32_t padding{};
 	};
 
 	struct Material {
@@ -153,6 +278,9 @@ namespace vkglTF
 		int index = 0;
 		bool unlit = false;
 		float emissiveStrength = 1.0f;
+		// Slot in the asset manager's material buffer, assigned once the model is uploaded
+		uint32_t bufferIndex{ UINT32_MAX };
+		MaterialData getData() const;
 	};
 
 	struct Primitive {
@@ -162,21 +290,25 @@ namespace vkglTF
 		Material& material;
 		bool hasIndices;
 		BoundingBox bb;
+		// Index ranges of the simplified levels of detail following the full resolution range, sharing its vertices
+		struct Lod {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+		};
+		std::vector<Lod> lods;
+		// Range in Model::meshlets, only set if meshlets have been generated for this primitive
+		uint32_t firstMeshlet{ 0 };
+		uint32_t meshletCount{ 0 };
 		Primitive(uint32_t firstIndex, uint32_t indexCount, uint32_t vertexCount, Material& material);
 		void setBoundingBox(glm::vec3 min, glm::vec3 max);
 	};
 
 	struct Mesh {
-		std::vector<Primitive*> primitives;
+		// Consecutive range of Model::primitiveStorage
+		std::span<Primitive> primitives;
 		BoundingBox bb;
 		BoundingBox aabb;
-		// @todo: global ssbo for joint matrices
-		//struct UniformBlock {
-		//	glm::mat4 jointMatrix[MAX_NUM_JOINTS]{};
-		//	float jointcount{ 0 };
-		//} uniformBlock;
 		Mesh(glm::mat4 matrix);
-		~Mesh();
 		void setBoundingBox(glm::vec3 min, glm::vec3 max);
 	};
 
@@ -187,15 +319,22 @@ namespace vkglTF
 		std::vector<Node*> joints;
 	};
 
+	// Owned by Model::nodeStorage, so the hierarchy's pointers are references into the model's storage and nodes don't free anything themselves
 	struct Node {
-		Node* parent;
+		Node* parent{ nullptr };
 		uint32_t index;
 		std::vector<Node*> children;
 		glm::mat4 matrix;
+		// Concatenated matrices from the root down to this node, updated by Model::updateNodeMatrices
+		glm::mat4 worldMatrix{ 1.0f };
+		// Index into Model::linearNodes and Model::nodeMatrices, parents have lower indices than their children
+		uint32_t linearIndex{ 0 };
 		std::string name;
-		Mesh* mesh;
-		Skin* skin;
+		Mesh* mesh{ nullptr };
+		Skin* skin{ nullptr };
 		int32_t skinIndex = -1;
+		// Offset of the node's joint matrices in Model::jointMatrices, only set for nodes with a mesh and a skin
+		uint32_t firstJoint{ noJoints };
 		glm::vec3 translation{};
 		glm::vec3 scale{ 1.0f };
 		glm::quat rotation{};
@@ -203,8 +342,8 @@ namespace vkglTF
 		BoundingBox aabb;
 		glm::mat4 localMatrix();
 		glm::mat4 getMatrix();
-		void update();
-		~Node();
+		// Updates the node's range of the joint palette from the world matrices, which need to be up to date
+		void update(std::vector<glm::mat4>& jointMatrices);
 	};
 
 	struct AnimationChannel {
@@ -214,11 +353,52 @@ namespace vkglTF
 		uint32_t samplerIndex;
 	};
 
+	/**
+	 * Keyframes of one animated property, compressed at import
+	 * Keys that linear interpolation of their neighbours reproduces are removed, the remaining outputs are quantized to three 16 bit values per key (6 instead of 16 bytes)
+	 * Translations and scales are mapped to the track's range, rotations use the smallest three encoding (the largest component is dropped and restored from the unit length)
+	 */
 	struct AnimationSampler {
 		enum InterpolationType { LINEAR, STEP, CUBICSPLINE };
 		InterpolationType interpolation;
 		std::vector<float> inputs;
-		std::vector<glm::vec4> outputsVec4;
+		std::vector<glm::u16vec3> keys;
+		bool rotation{ false };
+		// Minimum and quantization step of translation and scale tracks
+		glm::vec3 rangeMin{ 0.0f };
+		glm::vec3 rangeStep{ 0.0f };
+		// Keyframe interval of the last lookup, playback usually stays within it or advances to the next one
+		size_t cursor{ 0 };
+		/** @brief Returns the index of the keyframe interval [i, i + 1] containing the time, time needs to be within the first and last input */
+		size_t findInterval(float time, size_t& cursor) const;
+		/**
+		* Reduces and quantizes the outputs of the sampler's inputs, removed keys are also removed from the inputs
+		*
+		* @param outputs One output per input, rotations as (x, y, z, w)
+		* @param isRotation True for rotation tracks, all other tracks store three components
+		*/
+		void compress(const std::vector<glm::vec4>& outputs, bool isRotation);
+		/** @brief Decodes the output of a key, rotations as (x, y, z, w) */
+		glm::vec4 getOutput(size_t index) const
+		{
+			const glm::u16vec3& key = keys[index];
+			if (!rotation) {
+				return glm::vec4(rangeMin + glm::vec3(key) * rangeStep, 0.0f);
+			}
+			// The index of the dropped component is stored in the top bits of the first two values, the other components use 15 bits over [-1/sqrt(2), 1/sqrt(2)]
+			constexpr float componentScale = 1.41421356f / 32767.0f;
+			constexpr float componentBias = 0.70710678f;
+			const uint32_t largest = (key.x >> 15) | ((key.y >> 15) << 1);
+			const glm::vec3 components = glm::vec3(glm::u16vec3(key.x & 0x7fff, key.y & 0x7fff, key.z & 0x7fff)) * componentScale - componentBias;
+			const float restored = std::sqrt(std::max(0.0f, 1.0f - glm::dot(components, components)));
+			glm::vec4 q;
+			uint32_t component = 0;
+			for (uint32_t i = 0; i < 4; i++) {
+				q[i] = (i == largest) ? restored : components[component++];
+			}
+			return q;
+		}
+		size_t getKeyCount() const { return keys.size(); }
 	};
 
 	struct Animation {
@@ -229,23 +409,157 @@ namespace vkglTF
 		float end = std::numeric_limits<float>::min();
 	};
 
+	class Model;
+
+	/**
+	 * Playback state of one animation clip for a single user (e.g. an actor) of a shared model, so users of the same model can be in different poses
+	 * The model's animation data isn't changed by evaluating it, so instances can be evaluated in parallel
+	 */
+	struct AnimationInstance {
+		uint32_t clip{ 0 };
+		float time{ 0.0f };
+		float speed{ 1.0f };
+		// Model the state below has been set up for, set up again if the model changes (e.g. on reload)
+		const Model* model{ nullptr };
+		// Keyframe interval of the last lookup for each sampler of the clip
+		std::vector<size_t> cursors;
+		// Local transforms of the nodes (indexed by Node::linearIndex), only used for nodes targeted by the clip's channels
+		std::vector<glm::vec3> translations;
+		std::vector<glm::quat> rotations;
+		std::vector<glm::vec3> scales;
+		std::vector<uint8_t> animatedNodes;
+		// Node matrices of the evaluated pose, same layout as Model::nodeMatrices
+		std::vector<glm::mat4> pose;
+		// World matrices of the pose without the axis flips, parents are read from here by their children
+		std::vector<glm::mat4> worldMatrices;
+		// Joint palette of the pose, same layout as Model::jointMatrices, only used for skinned models
+		std::vector<glm::mat4> joints;
+	};
+
+	/** @brief Pre-baked draw for a single primitive, referencing the node matrix and material by index */
+	struct DrawRecord {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t nodeMatrixIndex;
+		uint32_t materialIndex;
+		// Meshlets of the full resolution primitive, used by drawMeshlets
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+		// Offset of the node's joint palette in Model::jointMatrices, noJoints if the primitive isn't skinned
+		uint32_t jointOffset;
+		// Bounds of the primitive in the space of its node, only valid if the loader could determine them
+		BoundingBox bounds;
+	};
+
+	/** @brief Push constants for mesh shading draws, starts with the same members as PushConstBlock so the regular fragment shaders can be used */
+	struct MeshletPushConstBlock {
+		glm::mat4 matrix;
+		uint32_t materialIndex;
+		uint32_t radianceIndex;
+		uint32_t irradianceIndex;
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+		uint32_t firstInstance;
+	};
+
 	struct ModelCreateInfo {
 		const std::string filename;
 		float scale{ 1.0f };
+		// Compact drops skinning data and quantizes the remaining attributes, pipelines need to use the matching vertex input
+		// Files with skins are always loaded with the default layout, so they still can be skinned
+		VertexLayout vertexLayout{ VertexLayout::Default };
+		// Reorders the triangles and vertices of indexed primitives for vertex cache efficiency, reduced overdraw and vertex fetch locality
+		bool optimizeMeshes{ false };
+		// Number of levels of detail including the full resolution one, the additional levels are generated by simplifying indexed triangle primitives
+		uint32_t lodCount{ 1 };
+		// Loads from a pre-baked cache file next to the glTF file if it's up to date, otherwise the cache is (re)written after loading the glTF file
+		bool useCache{ false };
+		// (Optional) Generates meshlets for indexed triangle primitives and allocates a descriptor set with this layout for drawMeshlets
+		// The layout needs to contain the storage buffers for vertices, meshlets, meshlet vertices and meshlet triangles at bindings 0 to 3
+		VkDescriptorSetLayout meshletDescriptorSetLayout{ VK_NULL_HANDLE };
 		bool enableHotReload{ false };
+		// (Optional) Used to decode images and convert primitives in parallel, loading needs to be started from a thread owned by the job system
+		vks::JobSystem* jobSystem{ nullptr };
+		// (Optional) Records the uploads of a model created with the loading constructor into this batch, so the uploads of several assets are submitted together
+		UploadBatch* uploadBatch{ nullptr };
+		// Decoded images up to this size in both dimensions are packed into texture arrays with the model's other images of the same size and format, 0 uploads every image as a texture of its own
+		// Saves an image, an allocation and a bindless slot per packed image, KTX files are never packed as they are streamed per texture
+		uint32_t maxPackedTextureSize{ 256 };
 	};
 
 	class Model {
 	private:
+		// Ranges in the loader buffers reserved for a primitive while traversing the node tree
+		struct PrimitiveLoadInfo {
+			const tinygltf::Primitive* primitive;
+			Primitive* target;
+			uint32_t vertexStart;
+			uint32_t indexStart;
+			// Simplified levels of detail, appended to the index buffer once all primitives have been converted
+			std::vector<uint32_t> lodIndices;
+			std::vector<uint32_t> lodIndexCounts;
+			// Meshlets with offsets local to this primitive, appended to the model's meshlets once all primitives have been converted
+			std::vector<vks::meshoptimizer::Meshlet> meshlets;
+			std::vector<uint32_t> meshletVertices;
+			std::vector<uint32_t> meshletTriangles;
+		};
 		struct LoaderInfo {
-			uint32_t* indexBuffer;
-			Vertex* vertexBuffer;
+			uint32_t* indexBuffer{ nullptr };
+			Vertex* vertexBuffer{ nullptr };
+			CompactVertex* compactVertexBuffer{ nullptr };
 			size_t indexPos = 0;
 			size_t vertexPos = 0;
+			std::vector<PrimitiveLoadInfo> primitives;
+			bool optimizeMeshes{ false };
+			uint32_t lodCount{ 1 };
+			bool buildMeshlets{ false };
+			std::vector<vks::meshoptimizer::Meshlet> meshlets;
+			std::vector<uint32_t> meshletVertices;
+			std::vector<uint32_t> meshletTriangles;
+			// Set instead of the buffers above if the model has been loaded from a cache, which stays mapped until the model has been uploaded
+			std::shared_ptr<vks::MappedFile> cacheFile;
+			const uint8_t* cachedVertices{ nullptr };
+			const uint8_t* cachedIndices{ nullptr };
+			// External files (buffers and images) referenced by the glTF file relative to its directory, the cache is stale if any of them changes
+			std::vector<std::string> dependencies;
+		};
+		// Decoded image data kept between loading and uploading
+		struct TextureSource {
+			tinygltf::Image image;
+			TextureSampler sampler;
+			uint64_t key{ 0 };
+			// Set for images materials use as color (base color, emissive, diffuse and specular), all other images (normals, metallic roughness, occlusion) store linear data
+			bool srgb{ false };
 		};
+		LoaderInfo loaderInfo{};
+		size_t vertexCount{ 0 };
+		size_t indexCount{ 0 };
+		std::vector<TextureSource> textureSources;
+		uint32_t maxPackedTextureSize{ 0 };
+		// Hash of the vertices and indices, models with the same geometry share their range of the geometry pool
+		uint64_t geometryKey{ 0 };
+		// Vertex range read by the mesh shaders, only covers the model's part of the vertex buffer if it's in the geometry pool
+		VkDescriptorBufferInfo meshletVertexDescriptor{};
 		void freeResources();
+		bool loadglTFFile(const ModelCreateInfo& createInfo);
+		bool loadCache(const ModelCreateInfo& createInfo);
+		void writeCache(const ModelCreateInfo& createInfo);
 		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, LoaderInfo& loaderInfo, float globalscale);
-		void getNodeProps(const tinygltf::Node& node, const tinygltf::Model& model, size_t& vertexCount, size_t& indexCount);
+		void loadPrimitive(const tinygltf::Model& model, PrimitiveLoadInfo& primitiveLoadInfo);
+		void optimizePrimitive(const PrimitiveLoadInfo& primitiveLoadInfo, uint32_t vertexCount, uint32_t indexCount);
+		void generatePrimitiveLods(PrimitiveLoadInfo& primitiveLoadInfo, uint32_t vertexCount, uint32_t indexCount);
+		void appendPrimitiveLods();
+		void generatePrimitiveMeshlets(PrimitiveLoadInfo& primitiveLoadInfo, uint32_t vertexCount, uint32_t indexCount);
+		void appendPrimitiveMeshlets();
+		void decodeImages(tinygltf::Model& gltfModel, const std::vector<int>& imageIndices, vks::JobSystem* jobSystem);
+		bool decodeBufferViews(tinygltf::Model& gltfModel, vks::JobSystem* jobSystem);
+		void assignTextureColorSpaces();
+		void hashTextureSources(vks::JobSystem* jobSystem);
+		void packTextures(vks::MipmapBatch& mipmapBatch, std::vector<std::vector<unsigned char>>& arrayData);
+		void hashGeometry(vks::JobSystem* jobSystem);
+		void getNodeProps(const tinygltf::Node& node, const tinygltf::Model& model, size_t& vertexCount, size_t& indexCount, size_t& nodeCount, size_t& meshCount, size_t& primitiveCount);
+		// Reserves the scene graph storage, nothing may be added beyond these counts as the hierarchy points into the storage
+		void reserveSceneGraph(size_t nodeCount, size_t meshCount, size_t primitiveCount);
 		void loadSkins(tinygltf::Model& gltfModel);
 		void loadTextures(tinygltf::Model& gltfModel);
 		VkSamplerAddressMode getVkWrapMode(int32_t wrapMode);
@@ -253,20 +567,59 @@ namespace vkglTF
 		void loadTextureSamplers(tinygltf::Model& gltfModel);
 		void loadMaterials(tinygltf::Model& gltfModel);
 		void loadAnimations(tinygltf::Model& gltfModel);
-		void calculateBoundingBox(Node* node, Node* parent);
+		void calculateBoundingBox(Node* node);
+		void bakeDrawList(Node* node);
+		void bakeDrawList();
+		void assignJointRanges();
 	public:
 		// Store the createInfo for hot reload
 		ModelCreateInfo* initialCreateInfo{ nullptr };
 
-		Buffer* vertices;
-		Buffer* indices;
+		Buffer* vertices{ nullptr };
+		Buffer* indices{ nullptr };
+		// Set if the vertices and indices have been placed in the asset manager's geometry pool, vertices and indices then refer to the pool's buffers
+		GeometryPool* geometryPool{ nullptr };
+		GeometryAllocation geometryAllocation{};
+		// Added to the vertex offset and first index of all draws, non-zero for models in the geometry pool
+		int32_t baseVertex{ 0 };
+		uint32_t baseIndex{ 0 };
+		// Addresses of the start of the vertex and index buffers, only set if buffer device addresses are supported
+		// These point to the whole buffer and not the model's ranges in the pool, as the pulled vertex index already includes baseVertex
+		VkDeviceAddress vertexAddress{ 0 };
+		VkDeviceAddress indexAddress{ 0 };
+		// Smallest type that can address all of the model's vertices, selected when uploading the indices
+		VkIndexType indexType{ VK_INDEX_TYPE_UINT32 };
+		VertexLayout vertexLayout{ VertexLayout::Default };
+		// Only created if the model has been loaded with a meshlet descriptor set layout
+		Buffer* meshlets{ nullptr };
+		Buffer* meshletVertices{ nullptr };
+		Buffer* meshletTriangles{ nullptr };
+		VkDescriptorSetLayout meshletDescriptorSetLayout{ VK_NULL_HANDLE };
+		DescriptorPool* meshletDescriptorPool{ nullptr };
+		DescriptorSet* meshletDescriptorSet{ nullptr };
 
 		glm::mat4 aabb;
 
+		// Contiguous storage of the scene graph, filled once while loading and released as a whole
+		// Nodes are stored in topological order (parents precede their children), so hierarchy updates are a single linear pass
+		std::vector<Node> nodeStorage;
+		std::vector<Mesh> meshStorage;
+		std::vector<Primitive> primitiveStorage;
+		// Root nodes
 		std::vector<Node*> nodes;
+		// All nodes in storage order, linearNodes[i] is nodeStorage[i]
 		std::vector<Node*> linearNodes;
+		// Flattened draw lists in scene graph order with one list per level of detail, all draw functions iterate these instead of the node hierarchy
+		std::vector<std::vector<DrawRecord>> drawLists;
+		uint32_t lodCount{ 1 };
+		// Projected size relative to the viewport height below which the first simplified level of detail is used, every further halving selects the next level
+		float lodTransitionSize{ 0.25f };
+		std::vector<glm::mat4> nodeMatrices;
 
 		std::vector<Skin*> skins;
+		// Joint palettes of all skinned mesh nodes (one range per node, see Node::firstJoint) in their current pose, empty if the model isn't skinned
+		// The inverse of the mesh node's world matrix is applied, so the palette is used together with the node matrix
+		std::vector<glm::mat4> jointMatrices;
 
 		std::vector<Texture> textures;
 		std::vector<TextureSampler> textureSamplers;
@@ -282,15 +635,59 @@ namespace vkglTF
 		bool wantsReload = false;
 		std::string filePath = "";
 
+		Model() = default;
+		/** @brief Loads and uploads the model right away */
 		Model(ModelCreateInfo createInfo);
 		~Model();
 
-		void bindBuffers(VkCommandBuffer commandBuffer);
-		void drawNode(Node* node, VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, glm::mat4 matrix, bool skipMaterials = false);
-		void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, glm::mat4 matrix, bool skipMaterials = false, bool bindBuffers = false);
+		/** @brief Parses the file and prepares vertex, index and image data on the CPU only, so it can be called from any thread */
+		bool load(ModelCreateInfo createInfo);
+		/**
+		* Creates the textures and buffers for a loaded model and uploads them on the transfer queue, needs to be called from the main thread
+		* Images and geometry with the same contents as those of a model already in the asset manager (e.g. the model a hot reload replaces) share its texture slots and geometry pool range instead of being uploaded again
+		*
+		* @param uploadBatch (Optional) Batch the buffer and texture uploads are recorded into, if not set all uploads of the model are submitted together in a batch of its own
+		*
+		* @return Timeline semaphore value signaled once the model's uploads have finished, 0 if recorded into uploadBatch (whose submit returns the value instead)
+		*/
+		uint64_t upload(UploadBatch* uploadBatch = nullptr);
+
+		void bindBuffers(CommandBuffer* commandBuffer);
+		void drawNode(Node* node, CommandBuffer* commandBuffer, const DrawContext& context, glm::mat4 matrix);
+		/**
+		* Draws all primitives, pose optionally replaces the model's node matrices (e.g. with AnimationInstance::pose)
+		* For skinned models, jointBase is the offset of the instance's palette (laid out as jointMatrices) in the joint matrix buffer read by the vertex shader
+		* If a frustum (in the same space as matrix) is passed, primitives of models with more than one primitive are skipped if their bounds are outside of it, skinned primitives are always drawn
+		*/
+		void draw(CommandBuffer* commandBuffer, const DrawContext& context, glm::mat4 matrix, bool bindBuffers = false, uint32_t lod = 0, const glm::mat4* pose = nullptr, uint32_t jointBase = 0, const vks::Frustum* frustum = nullptr);
+		/** @brief Draws all primitives once for instanceCount instances, per-instance matrices are fetched by the vertex shader starting at firstInstance */
+		void drawInstanced(CommandBuffer* commandBuffer, const DrawContext& context, uint32_t instanceCount, uint32_t firstInstance, bool bindBuffers = false, uint32_t lod = 0);
+		/** @brief Appends one indexed indirect command per primitive (in draw order) with zero instances starting at firstInstance, returns the number of commands added */
+		uint32_t appendIndirectCommands(std::vector<VkDrawIndexedIndirectCommand>& commands, uint32_t firstInstance, uint32_t lod = 0);
+		/** @brief Draws all primitives from indirect commands written by appendIndirectCommands, the draw count for all of the model's commands is read from countBuffer at countOffset */
+		void drawIndirect(CommandBuffer* commandBuffer, const DrawContext& context, VkBuffer indirectBuffer, VkDeviceSize commandOffset, VkBuffer countBuffer, VkDeviceSize countOffset, bool bindBuffers = false, uint32_t lod = 0);
+		/**
+		* Draws the meshlets of all primitives for instanceCount instances with task and mesh shaders, per-instance matrices are fetched starting at firstInstance
+		* Binds the model's meshlet descriptor set to set 2 of the context's pipeline layout, which needs a push constant range of MeshletPushConstBlock for the task, mesh and fragment stages
+		*/
+		void drawMeshlets(CommandBuffer* commandBuffer, const DrawContext& context, uint32_t instanceCount, uint32_t firstInstance);
+		bool hasMeshlets() const;
+		/** @brief True if the model has joint palettes, its primitives then need to be drawn with a skinning pipeline using the default vertex layout */
+		bool isSkinned() const;
+		/** @brief Selects the level of detail for an instance covering screenSize (projected diameter relative to the viewport height) */
+		uint32_t selectLod(float screenSize) const;
 		void getSceneDimensions();
+		// Updates the world matrices of all nodes, called after loading and animation updates
+		void updateNodeMatrices();
 		void updateAnimation(uint32_t index, float time);
-		Node* findNode(Node* parent, uint32_t index);
+		/**
+		* Advances an animation instance and evaluates its pose, only reads the model's data so instances can be evaluated in parallel
+		*
+		* @param instance Playback state, set up for this model on first use
+		* @param deltaTime Time to advance the instance by in seconds (scaled by the instance's speed), clips loop
+		*/
+		void evaluateAnimation(AnimationInstance& instance, float deltaTime) const;
+		// Node loaded from the glTF node with this index, null if it isn't part of the scene
 		Node* nodeFromIndex(uint32_t index);
 	};
 }
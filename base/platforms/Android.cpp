@@ -12,6 +12,11 @@
 #include <android/log.h>
 #include <dlfcn.h>
 #include <android/native_window_jni.h>
+#include <android/performance_hint.h>
+#include <android/thermal.h>
+#include <unistd.h>
+#include <atomic>
+#include <cmath>
 
 android_app* androidApp;
 
@@ -19,6 +24,10 @@ int32_t vks::android::screenDensity;
 
 void* libVulkan;
 
+APerformanceHintSession* performanceHintSession{ nullptr };
+AThermalManager* thermalManager{ nullptr };
+std::atomic<int32_t> thermalStatus{ ATHERMAL_STATUS_NONE };
+
 namespace vks
 {
 	namespace android
@@ -69,6 +78,100 @@ namespace vks
 			androidApp->activity->vm->DetachCurrentThread();
 			return;
 		}
+
+		bool createPerformanceHintSession(int64_t targetWorkDurationNanos)
+		{
+			if (__builtin_available(android 33, *)) {
+				APerformanceHintManager* manager = APerformanceHint_getManager();
+				if (!manager) {
+					return false;
+				}
+				const int32_t threadId = gettid();
+				performanceHintSession = APerformanceHint_createSession(manager, &threadId, 1, targetWorkDurationNanos);
+			}
+			if (!performanceHintSession) {
+				LOGW("Performance hints are not supported");
+			}
+			return performanceHintSession != nullptr;
+		}
+
+		void updateTargetWorkDuration(int64_t targetWorkDurationNanos)
+		{
+			if (__builtin_available(android 33, *)) {
+				if (performanceHintSession) {
+					APerformanceHint_updateTargetWorkDuration(performanceHintSession, targetWorkDurationNanos);
+				}
+			}
+		}
+
+		void reportActualWorkDuration(int64_t actualDurationNanos)
+		{
+			if (__builtin_available(android 33, *)) {
+				// Durations of zero are rejected
+				if (performanceHintSession && (actualDurationNanos > 0)) {
+					APerformanceHint_reportActualWorkDuration(performanceHintSession, actualDurationNanos);
+				}
+			}
+		}
+
+		void closePerformanceHintSession()
+		{
+			if (__builtin_available(android 33, *)) {
+				if (performanceHintSession) {
+					APerformanceHint_closeSession(performanceHintSession);
+					performanceHintSession = nullptr;
+				}
+			}
+		}
+
+		// Called on a binder thread
+		static void thermalStatusChanged(void* data, AThermalStatus status)
+		{
+			thermalStatus.store(static_cast<int32_t>(status), std::memory_order_relaxed);
+			LOGI("Thermal status changed to %d", static_cast<int32_t>(status));
+		}
+
+		bool startThermalMonitoring()
+		{
+			if (__builtin_available(android 30, *)) {
+				thermalManager = AThermal_acquireManager();
+				if (!thermalManager) {
+					return false;
+				}
+				thermalStatus = static_cast<int32_t>(AThermal_getCurrentThermalStatus(thermalManager));
+				if (AThermal_registerThermalStatusListener(thermalManager, thermalStatusChanged, nullptr) != 0) {
+					LOGW("Could not register thermal status listener");
+				}
+				return true;
+			}
+			return false;
+		}
+
+		void stopThermalMonitoring()
+		{
+			if (__builtin_available(android 30, *)) {
+				if (thermalManager) {
+					AThermal_unregisterThermalStatusListener(thermalManager, thermalStatusChanged, nullptr);
+					AThermal_releaseManager(thermalManager);
+					thermalManager = nullptr;
+				}
+			}
+		}
+
+		int32_t getThermalStatus()
+		{
+			return thermalStatus.load(std::memory_order_relaxed);
+		}
+
+		float getThermalHeadroom(int32_t forecastSeconds)
+		{
+			if (__builtin_available(android 31, *)) {
+				if (thermalManager) {
+					return AThermal_getThermalHeadroom(thermalManager, forecastSeconds);
+				}
+			}
+			return NAN;
+		}
 	}
 }
 
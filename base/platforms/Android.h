@@ -61,6 +61,27 @@ namespace vks
 		void freeVulkanLibrary();
 		void getDeviceConfig();
 		void showAlert(const char* message);
+
+		/**
+		* Creates a performance hint session for the calling thread (Android 13+), the system then adjusts CPU clocks from the reported work durations instead of only reacting to load
+		*
+		* @param targetWorkDurationNanos Time the work of a frame should take, usually the frame time of the display's refresh rate
+		*
+		* @return False if performance hints aren't supported
+		*/
+		bool createPerformanceHintSession(int64_t targetWorkDurationNanos);
+		void updateTargetWorkDuration(int64_t targetWorkDurationNanos);
+		// Reports how long the work of the last frame took, without time spent waiting (e.g. for frames in flight)
+		void reportActualWorkDuration(int64_t actualDurationNanos);
+		void closePerformanceHintSession();
+		/** @brief Starts listening for changes of the thermal status (Android 11+), returns false if not supported */
+		bool startThermalMonitoring();
+		void stopThermalMonitoring();
+		// Last reported AThermalStatus, none if the thermal status isn't available
+		int32_t getThermalStatus();
+		// Forecast of the thermal headroom, 1.0 is where the device starts to throttle severely, NaN if not available (Android 12+)
+		// The system rate limits these queries, calls more frequent than once per second return NaN
+		float getThermalHeadroom(int32_t forecastSeconds);
 	}
 }
 
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "ProjectileHits.hpp"
+#include "TraceRecorder.h"
+
+void ProjectileHitDetection::detect(const ActorManager& actors, const std::vector<ActorHandle>& projectiles, ActorTag projectileTag, float deltaTime)
+{
+	TraceZoneScopedN("Projectile hit detection");
+	hits.clear();
+	for (const ActorHandle& handle : projectiles) {
+		if (!actors.isValid(handle)) {
+			continue;
+		}
+		const uint32_t index = actors.getIndex(handle);
+		const glm::vec3 origin = actors.positions[index];
+		const glm::vec3 velocity = actors.velocities[index];
+		const float distance = glm::length(velocity) * deltaTime;
+		if (distance <= 0.0f) {
+			continue;
+		}
+		const glm::vec3 direction = velocity / glm::length(velocity);
+		const float radius = actors.radii[index];
+		float hitDistance = 0.0f;
+		const uint32_t target = actors.sweepSphere(origin, direction, distance, radius, [&actors, projectileTag](uint32_t id) {
+			return (actors.tags[id] != projectileTag) && (actors.radii[id] > 0.0f);
+		}, &hitDistance);
+		if (target == UINT32_MAX) {
+			continue;
+		}
+		// Coincident centers use the direction the projectile came from
+		const glm::vec3 center = origin + direction * hitDistance;
+		const glm::vec3 delta = center - actors.positions[target];
+		const glm::vec3 normal = (glm::dot(delta, delta) > 0.0f) ? glm::normalize(delta) : -direction;
+		hits.push_back({
+			.projectile = handle,
+			.target = actors.getHandle(target),
+			.position = actors.positions[target] + normal * actors.radii[target],
+			.normal = normal
+		});
+	}
+}
+
+const std::vector<ProjectileHit>& ProjectileHitDetection::getHits() const
+{
+	return hits;
+}
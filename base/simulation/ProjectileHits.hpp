@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "ActorManager.h"
+
+/** @brief Projectile that touched another actor during the last call to detect */
+struct ProjectileHit {
+	ActorHandle projectile;
+	ActorHandle target;
+	// Point on the target's bounding sphere where the projectile touched it, and the sphere's normal at that point
+	glm::vec3 position;
+	glm::vec3 normal;
+};
+
+/**
+ * Continuous hit detection for fast moving projectiles (e.g. bullets) against all other actors
+ * Each projectile's path for a step is swept as a sphere through the actor manager's spatial grid, so projectiles can't pass through actors between two steps
+ * Only the grid cells along the paths are visited, so the cost grows with the number of projectiles and not with the number of actors
+ * Projectiles don't hit each other, and actors without bounds (radius of zero) are ignored the same way the rigid body simulation ignores them
+ */
+class ProjectileHitDetection {
+private:
+	std::vector<ProjectileHit> hits;
+public:
+	/**
+	 * Sweeps all projectiles along their velocity, meant to be called before the projectiles are moved by the step
+	 *
+	 * @param actors Actor manager with up to date bounds in its spatial grid
+	 * @param projectiles Handles of the projectiles, handles of removed actors are skipped
+	 * @param projectileTag Tag of all projectiles, actors with this tag are never hit
+	 * @param deltaTime Time the projectiles will move for
+	 */
+	void detect(const ActorManager& actors, const std::vector<ActorHandle>& projectiles, ActorTag projectileTag, float deltaTime);
+	// All hits of the last call to detect, at most one per projectile (the first actor along its path)
+	const std::vector<ProjectileHit>& getHits() const;
+};
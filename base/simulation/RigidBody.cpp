@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "RigidBody.hpp"
+#include "TraceRecorder.h"
+
+static float inverseMass(float radius)
+{
+	return 1.0f / (radius * radius * radius);
+}
+
+RigidBodySimulation::RigidBodySimulation(RigidBodySimulationCreateInfo createInfo) : settings(createInfo)
+{
+}
+
+bool RigidBodySimulation::isKinematic(uint32_t index) const
+{
+	return (index < kinematic.size()) && kinematic[index];
+}
+
+void RigidBodySimulation::subStep(ActorManager& actors, vks::JobSystem& jobSystem, float deltaTime)
+{
+	const uint32_t count = actors.size();
+	const uint32_t batchCount = (count + settings.batchSize - 1) / settings.batchSize;
+	velocityChanges.assign(count, glm::vec3(0.0f));
+	corrections.assign(count, glm::vec3(0.0f));
+	moved.assign(count, 0);
+	batchContacts.resize(batchCount);
+
+	// Broadphase and narrowphase, each body only writes its own scratch data
+	{
+		TraceZoneScopedN("Narrowphase");
+		jobSystem.parallelFor(count, settings.batchSize, [this, &actors](uint32_t first, uint32_t count) {
+			thread_local std::vector<uint32_t> neighbours;
+			std::vector<RigidBodyContact>& contacts = batchContacts[first / settings.batchSize];
+			contacts.clear();
+			for (uint32_t i = first; i < first + count; i++) {
+				const float radius = actors.radii[i];
+				if (radius <= 0.0f) {
+					continue;
+				}
+				const glm::vec3 position = actors.positions[i];
+				// Kinematic bodies only look for contacts, as they aren't moved
+				const bool pushed = !isKinematic(i);
+				const float invMass = inverseMass(radius);
+				neighbours.clear();
+				actors.queryRadius(position, radius, neighbours);
+				for (const uint32_t j : neighbours) {
+					if (j == i || actors.radii[j] <= 0.0f) {
+						continue;
+					}
+					const glm::vec3 delta = actors.positions[j] - position;
+					const float distance = glm::length(delta);
+					const float penetration = radius + actors.radii[j] - distance;
+					if (penetration <= 0.0f) {
+						continue;
+					}
+					// Coincident bodies are pushed apart along an arbitrary (but opposite for both bodies) axis
+					const glm::vec3 normal = (distance > 1e-6f) ? delta / distance : glm::vec3(0.0f, (i < j) ? 1.0f : -1.0f, 0.0f);
+					if (pushed) {
+						const float invMassSum = invMass + (isKinematic(j) ? 0.0f : inverseMass(actors.radii[j]));
+						const float relativeVelocity = glm::dot(actors.velocities[j] - actors.velocities[i], normal);
+						if (relativeVelocity < 0.0f) {
+							const float impulse = -(1.0f + settings.restitution) * relativeVelocity / invMassSum;
+							velocityChanges[i] -= normal * impulse * invMass;
+						}
+						corrections[i] -= normal * penetration * settings.correctionFactor * invMass / invMassSum;
+					}
+					if (i < j) {
+						contacts.push_back({ i, j });
+					}
+				}
+			}
+		});
+	}
+
+	// Integration
+	{
+		TraceZoneScopedN("Integration");
+		const float damping = std::max(1.0f - settings.linearDamping * deltaTime, 0.0f);
+		jobSystem.parallelFor(count, settings.batchSize, [this, &actors, deltaTime, damping](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; i++) {
+				if (isKinematic(i)) {
+					continue;
+				}
+				glm::vec3& velocity = actors.velocities[i];
+				velocity = (velocity + velocityChanges[i]) * damping;
+				if (velocity != glm::vec3(0.0f) || corrections[i] != glm::vec3(0.0f)) {
+					actors.positions[i] += velocity * deltaTime + corrections[i];
+					moved[i] = 1;
+				}
+			}
+		});
+	}
+
+	// The spatial grid isn't thread safe, so moved bodies are updated serially
+	for (uint32_t i = 0; i < count; i++) {
+		if (moved[i]) {
+			actors.markDirty(i);
+		}
+	}
+	for (const std::vector<RigidBodyContact>& batch : batchContacts) {
+		contacts.insert(contacts.end(), batch.begin(), batch.end());
+	}
+}
+
+uint32_t RigidBodySimulation::step(ActorManager& actors, vks::JobSystem& jobSystem, float deltaTime, std::span<const uint8_t> kinematic)
+{
+	TraceZoneScopedN("Rigid body simulation");
+	this->kinematic = kinematic;
+	contacts.clear();
+	accumulator += deltaTime;
+	uint32_t steps = 0;
+	while (accumulator >= settings.timeStep && steps < settings.maxSubSteps) {
+		subStep(actors, jobSystem, settings.timeStep);
+		accumulator -= settings.timeStep;
+		steps++;
+	}
+	this->kinematic = {};
+	if (steps == settings.maxSubSteps) {
+		accumulator = std::min(accumulator, settings.timeStep);
+	}
+	return steps;
+}
+
+const std::vector<RigidBodyContact>& RigidBodySimulation::getContacts() const
+{
+	return contacts;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <span>
+#include "glm/glm.hpp"
+#include "ActorManager.h"
+#include "JobSystem.hpp"
+
+struct RigidBodySimulationCreateInfo {
+	// Fixed simulation step in seconds, independent of the frame rate
+	float timeStep{ 1.0f / 120.0f };
+	// Upper limit for the steps taken per frame, time beyond that is dropped to avoid spiralling on slow frames
+	uint32_t maxSubSteps{ 4 };
+	float restitution{ 0.5f };
+	// Fraction of the penetration depth resolved per step
+	float correctionFactor{ 0.5f };
+	float linearDamping{ 0.0f };
+	// Number of bodies per job
+	uint32_t batchSize{ 256 };
+};
+
+/** @brief Collision between two bodies during the last call to step, a < b (dense actor indices) */
+struct RigidBodyContact {
+	uint32_t a;
+	uint32_t b;
+};
+
+/**
+ * Sphere rigid body simulation working directly on the actor manager's structure of arrays
+ * Bodies are all actors with a non-zero radius, their mass scales with the volume of their bounding sphere
+ * The actor manager's spatial grid is used as the broadphase
+ * Contacts are resolved Jacobi style: Each body only accumulates its own velocity and position changes, so bodies can be processed in parallel without synchronization
+ * Kinematic bodies (e.g. moved by the GPU simulation) are neither integrated nor pushed, other bodies collide with them as if their mass was infinite
+ */
+class RigidBodySimulation {
+private:
+	RigidBodySimulationCreateInfo settings;
+	float accumulator{ 0.0f };
+	// Per body scratch data, indexed with the dense actor index
+	std::vector<glm::vec3> velocityChanges;
+	std::vector<glm::vec3> corrections;
+	std::vector<uint8_t> moved;
+	// Contacts are collected per job batch and merged after each step
+	std::vector<std::vector<RigidBodyContact>> batchContacts;
+	std::vector<RigidBodyContact> contacts;
+	// Flags of the bodies moved elsewhere, indexed with the dense actor index, empty if there are none
+	std::span<const uint8_t> kinematic;
+	bool isKinematic(uint32_t index) const;
+	void subStep(ActorManager& actors, vks::JobSystem& jobSystem, float deltaTime);
+public:
+	RigidBodySimulation(RigidBodySimulationCreateInfo createInfo = {});
+	/**
+	* Advances the simulation by deltaTime in fixed steps
+	*
+	* @param kinematic (Optional) Non-zero for actors that are moved elsewhere, indexed with the dense actor index, actors beyond its size are simulated
+	*
+	* @return Number of steps taken
+	*/
+	uint32_t step(ActorManager& actors, vks::JobSystem& jobSystem, float deltaTime, std::span<const uint8_t> kinematic = {});
+	// All contacts of the last call to step, a pair may be reported once per step taken
+	const std::vector<RigidBodyContact>& getContacts() const;
+};
@@ -5,25 +5,373 @@
  */
 
 #include "ActorManager.h"
+#include "ApplicationContext.h"
+#include <algorithm>
+#include <cmath>
 
-Actor* ActorManager::addActor(const std::string name, Actor* actor) {
-	actors[name] = actor;
-	return actor;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define VKS_ACTOR_SSE
+#elif defined(__aarch64__) || defined(_M_ARM64)
+// Rounding conversions need AArch64
+#include <arm_neon.h>
+#define VKS_ACTOR_NEON
+#endif
+
+// Translation * rotation about x, y and z (in that order, angles in degrees) * scale
+// Written out instead of composed from glm::translate, glm::rotate and glm::scale, as the products of the mostly zero matrices don't need to be computed
+static glm::mat4 calculateMatrix(const glm::vec3 position, const glm::vec3 rotation, const glm::vec3 scale)
+{
+	const glm::vec3 angles = glm::radians(rotation);
+	const float sx = std::sin(angles.x), cx = std::cos(angles.x);
+	const float sy = std::sin(angles.y), cy = std::cos(angles.y);
+	const float sz = std::sin(angles.z), cz = std::cos(angles.z);
+	return glm::mat4(
+		glm::vec4(cy * cz, sx * sy * cz + cx * sz, sx * sz - cx * sy * cz, 0.0f) * scale.x,
+		glm::vec4(-cy * sz, cx * cz - sx * sy * sz, cx * sy * sz + sx * cz, 0.0f) * scale.y,
+		glm::vec4(sy, -sx * cy, cx * cy, 0.0f) * scale.z,
+		glm::vec4(position, 1.0f));
+}
+
+#if defined(VKS_ACTOR_SSE) || defined(VKS_ACTOR_NEON)
+namespace simd
+{
+#if defined(VKS_ACTOR_SSE)
+	using float4 = __m128;
+	using int4 = __m128i;
+	static inline float4 set(float value) { return _mm_set1_ps(value); }
+	static inline float4 gather(const glm::vec3* v, int component) { return _mm_set_ps(v[3][component], v[2][component], v[1][component], v[0][component]); }
+	static inline float4 add(float4 a, float4 b) { return _mm_add_ps(a, b); }
+	static inline float4 sub(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+	static inline float4 mul(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+	static inline int4 roundToInt(float4 a) { return _mm_cvtps_epi32(a); }
+	static inline float4 toFloat(int4 a) { return _mm_cvtepi32_ps(a); }
+	static inline int4 setInt(int32_t value) { return _mm_set1_epi32(value); }
+	static inline int4 addInt(int4 a, int4 b) { return _mm_add_epi32(a, b); }
+	static inline int4 andInt(int4 a, int4 b) { return _mm_and_si128(a, b); }
+	static inline int4 equalInt(int4 a, int4 b) { return _mm_cmpeq_epi32(a, b); }
+	// Moves bit 1 into the sign bit
+	static inline int4 signFromBit1(int4 a) { return _mm_slli_epi32(_mm_and_si128(a, _mm_set1_epi32(2)), 30); }
+	static inline float4 flipSign(float4 a, int4 sign) { return _mm_xor_ps(a, _mm_castsi128_ps(sign)); }
+	static inline float4 select(int4 mask, float4 a, float4 b) { return _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(mask), a), _mm_andnot_ps(_mm_castsi128_ps(mask), b)); }
+	// Writes the columns of four matrices, each column vector holds one component of the column of all four
+	static inline void storeColumn(glm::mat4* matrices, int column, float4 x, float4 y, float4 z, float4 w)
+	{
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_ps(&matrices[0][column][0], x);
+		_mm_storeu_ps(&matrices[1][column][0], y);
+		_mm_storeu_ps(&matrices[2][column][0], z);
+		_mm_storeu_ps(&matrices[3][column][0], w);
+	}
+#elif defined(VKS_ACTOR_NEON)
+	using float4 = float32x4_t;
+	using int4 = int32x4_t;
+	static inline float4 set(float value) { return vdupq_n_f32(value); }
+	static inline float4 gather(const glm::vec3* v, int component)
+	{
+		const float values[4] = { v[0][component], v[1][component], v[2][component], v[3][component] };
+		return vld1q_f32(values);
+	}
+	static inline float4 add(float4 a, float4 b) { return vaddq_f32(a, b); }
+	static inline float4 sub(float4 a, float4 b) { return vsubq_f32(a, b); }
+	static inline float4 mul(float4 a, float4 b) { return vmulq_f32(a, b); }
+	static inline int4 roundToInt(float4 a) { return vcvtnq_s32_f32(a); }
+	static inline float4 toFloat(int4 a) { return vcvtq_f32_s32(a); }
+	static inline int4 setInt(int32_t value) { return vdupq_n_s32(value); }
+	static inline int4 addInt(int4 a, int4 b) { return vaddq_s32(a, b); }
+	static inline int4 andInt(int4 a, int4 b) { return vandq_s32(a, b); }
+	static inline int4 equalInt(int4 a, int4 b) { return vreinterpretq_s32_u32(vceqq_s32(a, b)); }
+	static inline int4 signFromBit1(int4 a) { return vshlq_n_s32(vandq_s32(a, vdupq_n_s32(2)), 30); }
+	static inline float4 flipSign(float4 a, int4 sign) { return vreinterpretq_f32_s32(veorq_s32(vreinterpretq_s32_f32(a), sign)); }
+	static inline float4 select(int4 mask, float4 a, float4 b) { return vbslq_f32(vreinterpretq_u32_s32(mask), a, b); }
+	static inline void storeColumn(glm::mat4* matrices, int column, float4 x, float4 y, float4 z, float4 w)
+	{
+		const float32x4x2_t xy = vtrnq_f32(x, y);
+		const float32x4x2_t zw = vtrnq_f32(z, w);
+		vst1q_f32(&matrices[0][column][0], vcombine_f32(vget_low_f32(xy.val[0]), vget_low_f32(zw.val[0])));
+		vst1q_f32(&matrices[1][column][0], vcombine_f32(vget_low_f32(xy.val[1]), vget_low_f32(zw.val[1])));
+		vst1q_f32(&matrices[2][column][0], vcombine_f32(vget_high_f32(xy.val[0]), vget_high_f32(zw.val[0])));
+		vst1q_f32(&matrices[3][column][0], vcombine_f32(vget_high_f32(xy.val[1]), vget_high_f32(zw.val[1])));
+	}
+#endif
+
+	// Sine and cosine of angles in degrees, reduced to [-45, 45] degrees by subtracting the closest multiple of 90 degrees, which is exact for the angles actors usually have
+	// Uses the minimax polynomials of the Cephes library for that range, which are within a few ulps of std::sin and std::cos
+	static inline void sinCosDegrees(float4 degrees, float4& sine, float4& cosine)
+	{
+		const int4 quadrant = roundToInt(mul(degrees, set(1.0f / 90.0f)));
+		const float4 x = mul(sub(degrees, mul(toFloat(quadrant), set(90.0f))), set(3.14159265358979323846f / 180.0f));
+		const float4 x2 = mul(x, x);
+		float4 s = add(mul(x2, set(-1.9515295891e-4f)), set(8.3321608736e-3f));
+		s = add(mul(s, x2), set(-1.6666654611e-1f));
+		s = add(mul(mul(s, x2), x), x);
+		float4 c = add(mul(x2, set(2.443315711809948e-5f)), set(-1.388731625493765e-3f));
+		c = add(mul(c, x2), set(4.166664568298827e-2f));
+		c = add(sub(mul(mul(c, x2), x2), mul(x2, set(0.5f))), set(1.0f));
+		// Odd quadrants swap sine and cosine, the signs follow from rotating by the quadrant's multiple of 90 degrees
+		const int4 swap = equalInt(andInt(quadrant, setInt(1)), setInt(1));
+		sine = flipSign(select(swap, c, s), signFromBit1(quadrant));
+		cosine = flipSign(select(swap, s, c), signFromBit1(addInt(quadrant, setInt(1))));
+	}
+}
+#endif
+
+// Same as calculateMatrix for a range of actors, the SIMD paths compose the matrices of four actors at once
+static void calculateMatrices(const glm::vec3* positions, const glm::vec3* rotations, const glm::vec3* scales, glm::mat4* matrices, uint32_t count)
+{
+	uint32_t i = 0;
+#if defined(VKS_ACTOR_SSE) || defined(VKS_ACTOR_NEON)
+	using namespace simd;
+	for (; i + 4 <= count; i += 4) {
+		float4 sx, cx, sy, cy, sz, cz;
+		sinCosDegrees(gather(&rotations[i], 0), sx, cx);
+		sinCosDegrees(gather(&rotations[i], 1), sy, cy);
+		sinCosDegrees(gather(&rotations[i], 2), sz, cz);
+		const float4 scaleX = gather(&scales[i], 0);
+		const float4 scaleY = gather(&scales[i], 1);
+		const float4 scaleZ = gather(&scales[i], 2);
+		const float4 sxsy = mul(sx, sy);
+		const float4 cxsy = mul(cx, sy);
+		const float4 zero = set(0.0f);
+		storeColumn(&matrices[i], 0,
+			mul(mul(cy, cz), scaleX),
+			mul(add(mul(sxsy, cz), mul(cx, sz)), scaleX),
+			mul(sub(mul(sx, sz), mul(cxsy, cz)), scaleX),
+			zero);
+		storeColumn(&matrices[i], 1,
+			mul(sub(zero, mul(cy, sz)), scaleY),
+			mul(sub(mul(cx, cz), mul(sxsy, sz)), scaleY),
+			mul(add(mul(cxsy, sz), mul(sx, cz)), scaleY),
+			zero);
+		storeColumn(&matrices[i], 2,
+			mul(sy, scaleZ),
+			mul(sub(zero, mul(sx, cy)), scaleZ),
+			mul(mul(cx, cy), scaleZ),
+			zero);
+		storeColumn(&matrices[i], 3, gather(&positions[i], 0), gather(&positions[i], 1), gather(&positions[i], 2), set(1.0f));
+	}
+#endif
+	for (; i < count; i++) {
+		matrices[i] = calculateMatrix(positions[i], rotations[i], scales[i]);
+	}
+}
+
+static float calculateRadius(ModelHandle handle, const glm::vec3 scale)
+{
+	if (!handle.isSet() || !ApplicationContext::assetManager) {
+		return 0.0f;
+	}
+	const vkglTF::Model* model = ApplicationContext::assetManager->getModel(handle);
+	glm::vec3 size = (model->dimensions.max - model->dimensions.min) * scale * 1.1f;
+	float maxsize = std::max(size.x, std::max(size.y, size.z));
+	return maxsize / 2.0f;
+}
+
+ActorHandle ActorManager::addActor(const std::string name, const ActorCreateInfo createInfo) {
+	ActorHandle handle{};
+	if (!freeSlots.empty()) {
+		handle.slot = freeSlots.back();
+		freeSlots.pop_back();
+	} else {
+		handle.slot = static_cast<uint32_t>(slotIndices.size());
+		slotIndices.push_back(0);
+		slotGenerations.push_back(0);
+		slotNamed.push_back(0);
+	}
+	handle.generation = slotGenerations[handle.slot];
+
+	const uint32_t index = size();
+	slotIndices[handle.slot] = index;
+	denseSlots.push_back(handle.slot);
+
+	positions.push_back(createInfo.position);
+	rotations.push_back(createInfo.rotation);
+	scales.push_back(createInfo.scale);
+	velocities.push_back(createInfo.constantVelocity);
+	variations.push_back(glm::vec2(createInfo.variationSeed, std::max(createInfo.variation, 0.0f)));
+	radii.push_back(calculateRadius(createInfo.model, createInfo.scale) * (1.0f + variations.back().y));
+	models.push_back(createInfo.model);
+	// Keeps the model from being evicted while actors use it, actors without a model (or without an asset manager, e.g. in benchmarks) aren't counted
+	if (createInfo.model.isSet() && ApplicationContext::assetManager) {
+		ApplicationContext::assetManager->acquire(createInfo.model);
+	}
+	tags.push_back(getTag(createInfo.tag));
+	matrices.push_back(calculateMatrix(createInfo.position, createInfo.rotation, createInfo.scale));
+	dirty.push_back(0);
+	animationIndices.push_back(UINT32_MAX);
+	grid.add(positions.back(), radii.back());
+
+	slotNamed[handle.slot] = !name.empty();
+	if (!name.empty()) {
+		names[name] = handle;
+	}
+
+	return handle;
 }
 
-ActorManager::~ActorManager() {
-	for (auto& it : actors) {
-		delete it.second;
+void ActorManager::removeActor(ActorHandle handle)
+{
+	if (!isValid(handle)) {
+		return;
+	}
+	const uint32_t index = slotIndices[handle.slot];
+	const uint32_t last = size() - 1;
+	stopAnimation(index);
+	if (models[index].isSet() && ApplicationContext::assetManager) {
+		ApplicationContext::assetManager->release(models[index]);
+	}
+
+	// Keep the arrays dense by moving the last actor into the freed index
+	if (index != last) {
+		positions[index] = positions[last];
+		rotations[index] = rotations[last];
+		scales[index] = scales[last];
+		velocities[index] = velocities[last];
+		radii[index] = radii[last];
+		variations[index] = variations[last];
+		models[index] = models[last];
+		tags[index] = tags[last];
+		matrices[index] = matrices[last];
+		dirty[index] = dirty[last];
+		animationIndices[index] = animationIndices[last];
+		if (animationIndices[index] != UINT32_MAX) {
+			animationActors[animationIndices[index]] = index;
+		}
+		denseSlots[index] = denseSlots[last];
+		slotIndices[denseSlots[index]] = index;
+	}
+	positions.pop_back();
+	rotations.pop_back();
+	scales.pop_back();
+	velocities.pop_back();
+	radii.pop_back();
+	variations.pop_back();
+	models.pop_back();
+	tags.pop_back();
+	matrices.pop_back();
+	dirty.pop_back();
+	animationIndices.pop_back();
+	denseSlots.pop_back();
+	// The grid moves its last element the same way
+	grid.remove(index);
+
+	// Invalidates all outstanding handles to this slot
+	slotGenerations[handle.slot]++;
+	freeSlots.push_back(handle.slot);
+
+	if (!slotNamed[handle.slot]) {
+		return;
+	}
+	slotNamed[handle.slot] = 0;
+	for (auto it = names.begin(); it != names.end(); it++) {
+		if (it->second == handle) {
+			names.erase(it);
+			break;
+		}
 	}
 }
 
-void Actor::rotate(const glm::vec3 delta)
+void ActorManager::reserve(uint32_t count)
 {
-	this->rotation += delta;
+	slotIndices.reserve(count);
+	slotGenerations.reserve(count);
+	slotNamed.reserve(count);
+	freeSlots.reserve(count);
+	denseSlots.reserve(count);
+	positions.reserve(count);
+	rotations.reserve(count);
+	scales.reserve(count);
+	velocities.reserve(count);
+	radii.reserve(count);
+	variations.reserve(count);
+	models.reserve(count);
+	tags.reserve(count);
+	matrices.reserve(count);
+	dirty.reserve(count);
+	animationIndices.reserve(count);
 }
 
-void Actor::move(const glm::vec3 dir, float deltaT)
+bool ActorManager::isValid(ActorHandle handle) const
 {
+	return (handle.slot < slotGenerations.size()) && (slotGenerations[handle.slot] == handle.generation);
+}
+
+ActorHandle ActorManager::find(const std::string name) const
+{
+	auto it = names.find(name);
+	return (it != names.end()) ? it->second : ActorHandle{};
+}
+
+uint32_t ActorManager::getIndex(ActorHandle handle) const
+{
+	assert(isValid(handle));
+	return slotIndices[handle.slot];
+}
+
+ActorHandle ActorManager::getHandle(uint32_t index) const
+{
+	const uint32_t slot = denseSlots[index];
+	return { .slot = slot, .generation = slotGenerations[slot] };
+}
+
+ActorTag ActorManager::getTag(const std::string& name)
+{
+	auto it = tagLookup.find(name);
+	if (it != tagLookup.end()) {
+		return it->second;
+	}
+	const ActorTag tag{ .index = static_cast<uint32_t>(tagNames.size()) };
+	tagNames.push_back(name);
+	tagLookup[name] = tag;
+	return tag;
+}
+
+const std::string& ActorManager::getTagName(ActorTag tag) const
+{
+	return tagNames[tag.index];
+}
+
+uint32_t ActorManager::size() const
+{
+	return static_cast<uint32_t>(positions.size());
+}
+
+void ActorManager::markDirty(uint32_t index)
+{
+	dirty[index] = 1;
+	grid.update(index, positions[index], radii[index]);
+}
+
+void ActorManager::setPosition(uint32_t index, const glm::vec3 position)
+{
+	positions[index] = position;
+	dirty[index] = 1;
+	grid.update(index, position, radii[index]);
+}
+
+void ActorManager::setRotation(uint32_t index, const glm::vec3 rotation)
+{
+	rotations[index] = rotation;
+	dirty[index] = 1;
+}
+
+void ActorManager::setScale(uint32_t index, const glm::vec3 scale)
+{
+	scales[index] = scale;
+	radii[index] = calculateRadius(models[index], scale) * (1.0f + variations[index].y);
+	dirty[index] = 1;
+	grid.update(index, positions[index], radii[index]);
+}
+
+void ActorManager::rotate(uint32_t index, const glm::vec3 delta)
+{
+	rotations[index] += delta;
+	dirty[index] = 1;
+}
+
+void ActorManager::move(uint32_t index, const glm::vec3 dir, float deltaT)
+{
+	const glm::vec3 rotation = rotations[index];
 	glm::vec3 camFront;
 	camFront.x = -cos(glm::radians(rotation.x)) * sin(glm::radians(rotation.y));
 	camFront.y = sin(glm::radians(rotation.x));
@@ -33,35 +381,165 @@ void Actor::move(const glm::vec3 dir, float deltaT)
 	const float moveSpeed = 0.005f;
 
 	if (dir.z < 0.0f) {
-		position += camFront * moveSpeed;
+		positions[index] += camFront * moveSpeed;
+		dirty[index] = 1;
 	}
 	if (dir.z > 0.0f) {
-		position -= camFront * moveSpeed;
+		positions[index] -= camFront * moveSpeed;
+		dirty[index] = 1;
 	}
-	//if (keys.left)
-	//	position -= glm::normalize(glm::cross(camFront, glm::vec3(0.0f, 1.0f, 0.0f))) * moveSpeed;
-	//if (keys.right)
-	//	position += glm::normalize(glm::cross(camFront, glm::vec3(0.0f, 1.0f, 0.0f))) * moveSpeed;
+	grid.update(index, positions[index], radii[index]);
 }
 
-void Actor::update(float deltaTime)
+void ActorManager::update(float deltaTime)
 {
-	position = position + constantVelocity * deltaTime;
+	const uint32_t count = size();
+	for (uint32_t i = 0; i < count; i++) {
+		if (velocities[i] != glm::vec3(0.0f)) {
+			positions[i] += velocities[i] * deltaTime;
+			dirty[i] = 1;
+			grid.update(i, positions[i], radii[i]);
+		}
+	}
 }
 
-glm::mat4 Actor::getMatrix() const
+void ActorManager::updateTransforms(uint32_t first, uint32_t count)
 {
-	const glm::mat4 t = glm::translate(glm::mat4(1.0f), position);
-	glm::mat4 r = glm::rotate(glm::mat4(1.0f), glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-	r = glm::rotate(r, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-	r = glm::rotate(r, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-	const glm::mat4 s = glm::scale(glm::mat4(1.0f), scale);
-	return t * r * s;
+	const uint32_t last = std::min(first + count, size());
+	// Runs of consecutive dirty actors are composed in batches, which covers all of them when most actors move
+	uint32_t i = first;
+	while (i < last) {
+		if (!dirty[i]) {
+			i++;
+			continue;
+		}
+		const uint32_t runStart = i;
+		while ((i < last) && dirty[i]) {
+			dirty[i++] = 0;
+		}
+		calculateMatrices(&positions[runStart], &rotations[runStart], &scales[runStart], &matrices[runStart], i - runStart);
+	}
 }
 
-float Actor::getRadius() const
+void ActorManager::updateTransforms()
 {
-	glm::vec3 size = (model->dimensions.max - model->dimensions.min) * scale * 1.1f;
-	float maxsize = std::max(size.x, std::max(size.y, size.z));
-	return maxsize / 2.0f;
+	updateTransforms(0, size());
+}
+
+const glm::mat4& ActorManager::getMatrix(uint32_t index) const
+{
+	assert(!dirty[index]);
+	return matrices[index];
+}
+
+float ActorManager::getRadius(uint32_t index) const
+{
+	return radii[index];
+}
+
+void ActorManager::captureSnapshot(ActorSnapshot& snapshot) const
+{
+	assert(std::find(dirty.begin(), dirty.end(), 1) == dirty.end());
+	snapshot.matrices.assign(matrices.begin(), matrices.end());
+	snapshot.positions.assign(positions.begin(), positions.end());
+	snapshot.radii.assign(radii.begin(), radii.end());
+	snapshot.variations.assign(variations.begin(), variations.end());
+	snapshot.models.assign(models.begin(), models.end());
+	snapshot.poseOffsets.assign(size(), UINT32_MAX);
+	snapshot.poses.clear();
+	snapshot.jointOffsets.assign(size(), UINT32_MAX);
+	snapshot.joints.clear();
+	for (size_t i = 0; i < animations.size(); i++) {
+		// Clips the model doesn't have leave the pose empty, the actor is then drawn with the model's node matrices
+		if (animations[i].pose.empty()) {
+			continue;
+		}
+		snapshot.poseOffsets[animationActors[i]] = static_cast<uint32_t>(snapshot.poses.size());
+		snapshot.poses.insert(snapshot.poses.end(), animations[i].pose.begin(), animations[i].pose.end());
+		if (!animations[i].joints.empty()) {
+			snapshot.jointOffsets[animationActors[i]] = static_cast<uint32_t>(snapshot.joints.size());
+			snapshot.joints.insert(snapshot.joints.end(), animations[i].joints.begin(), animations[i].joints.end());
+		}
+	}
+}
+
+void ActorManager::playAnimation(uint32_t index, uint32_t clip, float time, float speed)
+{
+	if (animationIndices[index] == UINT32_MAX) {
+		animationIndices[index] = static_cast<uint32_t>(animations.size());
+		animations.emplace_back();
+		animationActors.push_back(index);
+	}
+	vkglTF::AnimationInstance& animation = animations[animationIndices[index]];
+	animation.clip = clip;
+	animation.time = time;
+	animation.speed = speed;
+	// Sets the state up again for the new clip
+	animation.model = nullptr;
+	// Evaluates the first pose, so the actor is drawn animated before the next update
+	ApplicationContext::assetManager->getModel(models[index])->evaluateAnimation(animation, 0.0f);
+}
+
+void ActorManager::stopAnimation(uint32_t index)
+{
+	const uint32_t animationIndex = animationIndices[index];
+	if (animationIndex == UINT32_MAX) {
+		return;
+	}
+	// Same as for the actors, the last animation is moved into the freed index
+	const uint32_t last = static_cast<uint32_t>(animations.size()) - 1;
+	if (animationIndex != last) {
+		animations[animationIndex] = std::move(animations[last]);
+		animationActors[animationIndex] = animationActors[last];
+		animationIndices[animationActors[animationIndex]] = animationIndex;
+	}
+	animations.pop_back();
+	animationActors.pop_back();
+	animationIndices[index] = UINT32_MAX;
+}
+
+bool ActorManager::isAnimated(uint32_t index) const
+{
+	return animationIndices[index] != UINT32_MAX;
+}
+
+uint32_t ActorManager::getAnimationCount() const
+{
+	return static_cast<uint32_t>(animations.size());
+}
+
+void ActorManager::updateAnimations(float deltaTime, vks::JobSystem& jobSystem)
+{
+	jobSystem.parallelFor(static_cast<uint32_t>(animations.size()), 64, [this, deltaTime](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; i++) {
+			ApplicationContext::assetManager->getModel(models[animationActors[i]])->evaluateAnimation(animations[i], deltaTime);
+		}
+	});
+}
+
+uint32_t ActorManager::queryRadius(const glm::vec3 center, float radius, std::vector<uint32_t>& results) const
+{
+	return grid.queryRadius(center, radius, results);
+}
+
+uint32_t ActorManager::raycast(const glm::vec3 origin, const glm::vec3 direction, float maxDistance, float* hitDistance) const
+{
+	vks::SpatialGrid::RayHit hit;
+	if (!grid.raycast(origin, direction, maxDistance, hit)) {
+		return UINT32_MAX;
+	}
+	if (hitDistance) {
+		*hitDistance = hit.distance;
+	}
+	return hit.id;
+}
+
+uint32_t ActorManager::cullFrustum(vks::Frustum& frustum, uint32_t* visibleIndices, float radiusScale) const
+{
+	return grid.queryFrustum(frustum, visibleIndices, radiusScale);
+}
+
+void ActorManager::cullFrustums(std::span<vks::Frustum* const> frustums, std::span<uint32_t* const> visibleIndices, std::span<uint32_t> visibleCounts, float radiusScale) const
+{
+	grid.queryFrustums(frustums, visibleIndices, visibleCounts, radiusScale);
 }
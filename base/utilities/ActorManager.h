@@ -7,38 +7,171 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <span>
+#include <unordered_map>
 #include "glm/glm.hpp"
 #include "glTF.h"
+#include "AssetManager.h"
+#include "SpatialGrid.hpp"
+#include "JobSystem.hpp"
 
 struct ActorCreateInfo {
 	glm::vec3 position{};
 	glm::vec3 rotation{};
 	glm::vec3 scale{};
-	vkglTF::Model* model{ nullptr };
+	ModelHandle model{};
 	std::string tag{ "" };
 	glm::vec3 constantVelocity;
+	// Strength of the procedural variation of the model's shape and tint relative to its size (0 = drawn as is), applied by the instanced shaders
+	float variation{ 0.0f };
+	// Selects the actor's variation, actors with the same seed and model look the same
+	float variationSeed{ 0.0f };
 };
 
-class Actor {
-private:
-public:
-	glm::vec3 position{};
-	glm::vec3 rotation{};
-	glm::vec3 scale{};
-	vkglTF::Model* model{ nullptr };
-	std::string tag{ "" };
-	glm::vec3 constantVelocity{};
-	Actor(ActorCreateInfo createInfo) : position(createInfo.position), rotation(createInfo.rotation), scale(createInfo.scale), model(createInfo.model), tag(createInfo.tag), constantVelocity(createInfo.constantVelocity) { };
-	void rotate(const glm::vec3 delta);
-	void move(const glm::vec3 dir, float deltaT);
-	void update(float deltaTime);
-	glm::mat4 getMatrix() const;
-	float getRadius() const;
+/** @brief Interned actor tag, so code looking for actors of a kind compares integers instead of strings */
+struct ActorTag {
+	uint32_t index{ UINT32_MAX };
+	bool operator==(const ActorTag& other) const { return index == other.index; };
+};
+
+/** @brief Stable reference to an actor, stays valid while other actors are added or removed */
+struct ActorHandle {
+	uint32_t slot{ UINT32_MAX };
+	uint32_t generation{ 0 };
+	bool operator==(const ActorHandle& other) const { return slot == other.slot && generation == other.generation; };
+};
+
+/**
+ * Copy of the actor state that rendering needs, indexed with the dense index the actors had when it was captured
+ * Lets the simulation advance the actor manager while a frame is recorded from the snapshot
+ */
+struct ActorSnapshot {
+	std::vector<glm::mat4> matrices;
+	std::vector<glm::vec3> positions;
+	std::vector<float> radii;
+	std::vector<ModelHandle> models;
+	// x = seed, y = strength of each actor's procedural variation
+	std::vector<glm::vec2> variations;
+	// Offset of each actor's pose in poses, UINT32_MAX for actors that aren't animated
+	std::vector<uint32_t> poseOffsets;
+	// Node matrices of all animated actors, one range of the model's node count per actor
+	std::vector<glm::mat4> poses;
+	// Offset of each actor's joint palette in joints, UINT32_MAX for actors that aren't animated or whose model isn't skinned
+	std::vector<uint32_t> jointOffsets;
+	// Joint palettes of all animated actors with skinned models, one range of the model's joint count per actor
+	std::vector<glm::mat4> joints;
+	uint32_t size() const { return static_cast<uint32_t>(matrices.size()); }
+	// Node matrices to draw an actor with, nullptr if it uses the model's own
+	const glm::mat4* getPose(uint32_t index) const { return (poseOffsets[index] != UINT32_MAX) ? &poses[poseOffsets[index]] : nullptr; }
+	// Joint palette to skin an actor with, nullptr if it uses the model's own
+	const glm::mat4* getJoints(uint32_t index) const { return (jointOffsets[index] != UINT32_MAX) ? &joints[jointOffsets[index]] : nullptr; }
 };
 
+/**
+ * Stores all actors as structure of arrays, so per-frame loops over positions, bounds, etc. stream through contiguous memory
+ * All arrays have the same length and are indexed with the dense index ([0, size()))
+ * Removing an actor moves the last actor into the freed dense index, so handles are used to refer to actors across frames
+ * World matrices are cached and only rebuilt for actors flagged as dirty, so changes to the transform arrays need to go through the setters or be followed by a call to markDirty
+ * The bounds of all actors are also kept in a spatial grid (indexed with the dense index) that is updated the same way
+ */
 class ActorManager {
+private:
+	// Handle slot to dense index indirection
+	std::vector<uint32_t> slotIndices;
+	std::vector<uint32_t> slotGenerations;
+	std::vector<uint32_t> freeSlots;
+	// Dense index to handle slot
+	std::vector<uint32_t> denseSlots;
+	// Optional name lookup, slotNamed lets removing unnamed actors skip the search
+	std::unordered_map<std::string, ActorHandle> names;
+	std::vector<uint8_t> slotNamed;
+	// Interned tags, indexed with ActorTag::index
+	std::vector<std::string> tagNames;
+	std::unordered_map<std::string, ActorTag> tagLookup;
+	// Animation playback of the animated actors, kept dense so updating the animations only visits animated actors
+	// animationIndices maps an actor's dense index to its animation (UINT32_MAX if not animated), animationActors maps back
+	std::vector<uint32_t> animationIndices;
+	std::vector<vkglTF::AnimationInstance> animations;
+	std::vector<uint32_t> animationActors;
 public:
-	std::unordered_map<std::string, Actor*> actors;
-	Actor* addActor(const std::string name, Actor* actor);
-	~ActorManager();
-};
\ No newline at end of file
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::vec3> velocities;
+	// Include the displacement of the actor's procedural variation
+	std::vector<float> radii;
+	// x = seed, y = strength
+	std::vector<glm::vec2> variations;
+	// Resolved through the asset manager, so actors keep referring to a model's slot while it's reloaded
+	std::vector<ModelHandle> models;
+	std::vector<ActorTag> tags;
+	// Cached world matrices, valid after updateTransforms for all actors not flagged dirty
+	std::vector<glm::mat4> matrices;
+	std::vector<uint8_t> dirty;
+	// Spatial index of the actor bounds for culling, radius and ray queries
+	vks::SpatialGrid grid;
+
+	ActorHandle addActor(const std::string name, const ActorCreateInfo createInfo);
+	void removeActor(ActorHandle handle);
+	// Reserves storage for a number of actors, so adding actors up to that count doesn't allocate
+	void reserve(uint32_t count);
+	bool isValid(ActorHandle handle) const;
+	// Returns the handle for a named actor or an invalid handle
+	ActorHandle find(const std::string name) const;
+	// Returns the current dense index of an actor, only valid until the next removal
+	uint32_t getIndex(ActorHandle handle) const;
+	// Returns the handle of the actor at a dense index
+	ActorHandle getHandle(uint32_t index) const;
+	// Returns the interned tag for a name, registering it if it's new, meant to be resolved once and not per frame
+	ActorTag getTag(const std::string& name);
+	const std::string& getTagName(ActorTag tag) const;
+	uint32_t size() const;
+
+	void markDirty(uint32_t index);
+	void setPosition(uint32_t index, const glm::vec3 position);
+	void setRotation(uint32_t index, const glm::vec3 rotation);
+	void setScale(uint32_t index, const glm::vec3 scale);
+	void rotate(uint32_t index, const glm::vec3 delta);
+	void move(uint32_t index, const glm::vec3 dir, float deltaT);
+	// Advances all actors by their constant velocity, only moving actors are flagged dirty
+	void update(float deltaTime);
+	// Rebuilds the cached matrices of all dirty actors in [first, first + count), disjoint ranges can be processed in parallel
+	void updateTransforms(uint32_t first, uint32_t count);
+	void updateTransforms();
+	// Returns the cached world matrix, requires updateTransforms to have been called after the last change
+	const glm::mat4& getMatrix(uint32_t index) const;
+	float getRadius(uint32_t index) const;
+	// Copies the render state of all actors into the snapshot, reusing its storage, requires updateTransforms to have been called after the last change
+	void captureSnapshot(ActorSnapshot& snapshot) const;
+
+	// Plays an animation clip of the actor's model, each actor has its own playback state so actors sharing a model can be in different poses
+	void playAnimation(uint32_t index, uint32_t clip, float time = 0.0f, float speed = 1.0f);
+	void stopAnimation(uint32_t index);
+	bool isAnimated(uint32_t index) const;
+	uint32_t getAnimationCount() const;
+	// Advances and evaluates the animations of all animated actors, spread across the job system's threads
+	void updateAnimations(float deltaTime, vks::JobSystem& jobSystem);
+
+	// Appends the dense indices of all actors intersecting the sphere to results
+	uint32_t queryRadius(const glm::vec3 center, float radius, std::vector<uint32_t>& results) const;
+	// Returns the dense index of the closest actor hit by the ray or UINT32_MAX, direction needs to be normalized
+	uint32_t raycast(const glm::vec3 origin, const glm::vec3 direction, float maxDistance, float* hitDistance = nullptr) const;
+	// Returns the dense index of the first actor touched by a sphere moving along the ray or UINT32_MAX, actors accept returns false for (called with their dense index) are ignored
+	template<typename F>
+	uint32_t sweepSphere(const glm::vec3 origin, const glm::vec3 direction, float maxDistance, float radius, F&& accept, float* hitDistance = nullptr) const
+	{
+		vks::SpatialGrid::RayHit hit;
+		if (!grid.sweepSphere(origin, direction, maxDistance, radius, hit, accept)) {
+			return UINT32_MAX;
+		}
+		if (hitDistance) {
+			*hitDistance = hit.distance;
+		}
+		return hit.id;
+	}
+	// Frustum culls all actors using the spatial grid, returns the number of visible actors written to visibleIndices (must have room for size() elements)
+	uint32_t cullFrustum(vks::Frustum& frustum, uint32_t* visibleIndices, float radiusScale = 1.0f) const;
+	// Frustum culls all actors against each of the frustums in one pass over the spatial grid, see SpatialGrid::queryFrustums
+	void cullFrustums(std::span<vks::Frustum* const> frustums, std::span<uint32_t* const> visibleIndices, std::span<uint32_t> visibleCounts, float radiusScale = 1.0f) const;
+};
@@ -0,0 +1,131 @@
+/*
+ * Pool for short lived actors of one kind (e.g. bullets)
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+#include "ActorManager.h"
+
+struct ActorPoolCreateInfo {
+	// Tag of all actors spawned from the pool
+	std::string tag{ "" };
+	ModelHandle model{};
+	glm::vec3 scale{ 1.0f };
+	// Max. number of live actors, spawning beyond that despawns the oldest actor
+	uint32_t capacity{ 256 };
+	// Actors are despawned once they're older than this (in seconds) or further from their spawn position than maxDistance, zero disables the limit
+	float maxLifetime{ 0.0f };
+	float maxDistance{ 0.0f };
+};
+
+/**
+ * Spawns actors of one kind without names and despawns them once they expire
+ * All storage (including the actor manager's arrays) is reserved for the capacity up front, so sustained spawning doesn't allocate
+ * Actors can also be removed through the actor manager directly (e.g. on impact), the pool drops their handles on the next update
+ */
+class ActorPool {
+private:
+	ActorManager* actorManager{ nullptr };
+	ActorPoolCreateInfo createInfo;
+	// Live actors in spawn order, so the oldest actor is always first
+	std::vector<ActorHandle> handles;
+	std::vector<float> ages;
+	std::vector<glm::vec3> origins;
+	// Kept across updates so its capacity is reused
+	std::vector<ActorHandle> expired;
+public:
+	ActorPool(ActorManager* actorManager, ActorPoolCreateInfo createInfo) : actorManager(actorManager), createInfo(createInfo)
+	{
+		handles.reserve(createInfo.capacity);
+		ages.reserve(createInfo.capacity);
+		origins.reserve(createInfo.capacity);
+		expired.reserve(createInfo.capacity);
+		actorManager->reserve(actorManager->size() + createInfo.capacity);
+	}
+
+	ActorHandle spawn(const glm::vec3 position, const glm::vec3 rotation, const glm::vec3 velocity)
+	{
+		if (size() >= createInfo.capacity) {
+			actorManager->removeActor(handles.front());
+			handles.erase(handles.begin());
+			ages.erase(ages.begin());
+			origins.erase(origins.begin());
+		}
+		const ActorHandle handle = actorManager->addActor("", {
+			.position = position,
+			.rotation = rotation,
+			.scale = createInfo.scale,
+			.model = createInfo.model,
+			.tag = createInfo.tag,
+			.constantVelocity = velocity
+		});
+		handles.push_back(handle);
+		ages.push_back(0.0f);
+		origins.push_back(position);
+		return handle;
+	}
+
+	// Ages all actors and despawns the expired ones, must be called after the actor manager advanced the actors
+	void update(float deltaTime)
+	{
+		const float maxDistanceSquared = createInfo.maxDistance * createInfo.maxDistance;
+		expired.clear();
+		uint32_t live = 0;
+		for (uint32_t i = 0; i < size(); i++) {
+			// Actors removed by someone else
+			if (!actorManager->isValid(handles[i])) {
+				continue;
+			}
+			ages[i] += deltaTime;
+			const glm::vec3 offset = actorManager->positions[actorManager->getIndex(handles[i])] - origins[i];
+			const bool tooOld = (createInfo.maxLifetime > 0.0f) && (ages[i] > createInfo.maxLifetime);
+			const bool tooFar = (createInfo.maxDistance > 0.0f) && (glm::dot(offset, offset) > maxDistanceSquared);
+			if (tooOld || tooFar) {
+				expired.push_back(handles[i]);
+				continue;
+			}
+			// Compacts in place, which keeps the spawn order
+			handles[live] = handles[i];
+			ages[live] = ages[i];
+			origins[live] = origins[i];
+			live++;
+		}
+		handles.resize(live);
+		ages.resize(live);
+		origins.resize(live);
+		// Removed after the loop, as removing actors changes the dense indices
+		for (const ActorHandle& handle : expired) {
+			actorManager->removeActor(handle);
+		}
+	}
+
+	// Despawns all actors of the pool
+	void clear()
+	{
+		for (const ActorHandle& handle : handles) {
+			actorManager->removeActor(handle);
+		}
+		handles.clear();
+		ages.clear();
+		origins.clear();
+	}
+
+	// Live actors in spawn order, may include actors removed since the last update
+	const std::vector<ActorHandle>& getHandles() const
+	{
+		return handles;
+	}
+
+	// Number of actors spawned and not yet expired, may include actors removed since the last update
+	uint32_t size() const
+	{
+		return static_cast<uint32_t>(handles.size());
+	}
+};
@@ -0,0 +1,194 @@
+/*
+ * Packed asset archive
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "AssetArchive.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include "zstd/zstd.h"
+
+namespace vks
+{
+	struct AssetArchiveHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t pathsSize;
+	};
+
+	// "VKAR"
+	static const uint32_t archiveMagic = 0x52414b56;
+	static const uint32_t archiveVersion = 1;
+
+	static uint64_t alignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	AssetArchive::AssetArchive(const std::string& filename)
+	{
+		auto mapping = std::make_shared<MappedFile>(filename);
+		if (!mapping->isValid() || mapping->size() < sizeof(AssetArchiveHeader)) {
+			throw std::runtime_error("Could not open asset archive " + filename);
+		}
+		AssetArchiveHeader header;
+		memcpy(&header, mapping->data(), sizeof(AssetArchiveHeader));
+		if ((header.magic != archiveMagic) || (header.version != archiveVersion)) {
+			throw std::runtime_error("Asset archive " + filename + " has an unsupported format");
+		}
+		const uint64_t pathsOffset = sizeof(AssetArchiveHeader) + static_cast<uint64_t>(header.entryCount) * sizeof(Entry);
+		if (pathsOffset + header.pathsSize > mapping->size()) {
+			throw std::runtime_error("Asset archive " + filename + " is truncated");
+		}
+		// The header keeps the entries aligned, so they're used in place
+		entries = reinterpret_cast<const Entry*>(mapping->data() + sizeof(AssetArchiveHeader));
+		const char* paths = reinterpret_cast<const char*>(mapping->data() + pathsOffset);
+		entryIndices.reserve(header.entryCount);
+		for (uint32_t i = 0; i < header.entryCount; i++) {
+			const Entry& entry = entries[i];
+			if ((static_cast<uint64_t>(entry.pathOffset) + entry.pathLength > header.pathsSize) || (entry.offset + entry.storedSize > mapping->size())) {
+				throw std::runtime_error("Asset archive " + filename + " has a malformed entry");
+			}
+			entryIndices[std::string(paths + entry.pathOffset, entry.pathLength)] = i;
+		}
+		file = mapping;
+	}
+
+	const AssetArchive::Entry* AssetArchive::find(const std::string& path) const
+	{
+		auto it = entryIndices.find(path);
+		return (it != entryIndices.end()) ? &entries[it->second] : nullptr;
+	}
+
+	std::shared_ptr<MappedFile> AssetArchive::open(const std::string& path) const
+	{
+		const Entry* entry = find(path);
+		if (!entry) {
+			return nullptr;
+		}
+		if (entry->compression == Compression::None) {
+			return std::make_shared<MappedFile>(file, entry->offset, entry->size);
+		}
+		std::vector<uint8_t> contents(entry->size);
+		const size_t size = ZSTD_decompress(contents.data(), contents.size(), file->data() + entry->offset, entry->storedSize);
+		if (ZSTD_isError(size) || (size != contents.size())) {
+			std::cerr << "Could not decompress " << path << " from asset archive" << std::endl;
+			return nullptr;
+		}
+		return std::make_shared<MappedFile>(std::move(contents));
+	}
+
+	uint32_t AssetArchive::size() const
+	{
+		return static_cast<uint32_t>(entryIndices.size());
+	}
+
+	bool AssetArchive::write(const AssetArchiveWriteInfo& writeInfo)
+	{
+		const std::filesystem::path root = std::filesystem::path(writeInfo.directory).lexically_normal();
+		const std::filesystem::path archivePath = std::filesystem::absolute(writeInfo.filename).lexically_normal();
+		auto hasExtension = [](const std::vector<std::string>& extensions, const std::string& extension) {
+			return std::find(extensions.begin(), extensions.end(), extension) != extensions.end();
+		};
+
+		// Sorted, so the same directory always results in the same archive
+		std::vector<std::filesystem::path> files;
+		std::error_code error;
+		for (const auto& item : std::filesystem::recursive_directory_iterator(root, error)) {
+			if (!item.is_regular_file() || hasExtension(writeInfo.excludedExtensions, item.path().extension().string())) {
+				continue;
+			}
+			// The archive may be written into the directory it packs
+			if (std::filesystem::absolute(item.path()).lexically_normal() == archivePath) {
+				continue;
+			}
+			files.push_back(item.path());
+		}
+		if (error) {
+			std::cerr << "Could not list the files of " << writeInfo.directory << ": " << error.message() << std::endl;
+			return false;
+		}
+		std::sort(files.begin(), files.end());
+
+		std::vector<Entry> entries(files.size());
+		std::string paths;
+		for (size_t i = 0; i < files.size(); i++) {
+			const std::string path = files[i].lexically_relative(root).generic_string();
+			entries[i].pathOffset = static_cast<uint32_t>(paths.size());
+			entries[i].pathLength = static_cast<uint32_t>(path.size());
+			paths += path;
+		}
+
+		const std::string tempFilename = writeInfo.filename + ".tmp";
+		std::ofstream archive(tempFilename, std::ios::binary | std::ios::trunc);
+		if (!archive.is_open()) {
+			std::cerr << "Could not write asset archive " << writeInfo.filename << std::endl;
+			return false;
+		}
+		const AssetArchiveHeader header{ archiveMagic, archiveVersion, static_cast<uint32_t>(entries.size()), static_cast<uint32_t>(paths.size()) };
+		// The entries are written again once their offsets and sizes are known
+		archive.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		archive.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+		archive.write(paths.data(), paths.size());
+
+		uint64_t offset = sizeof(header) + entries.size() * sizeof(Entry) + paths.size();
+		uint64_t totalSize{ 0 };
+		uint64_t totalStoredSize{ 0 };
+		const char padding[entryAlignment]{};
+		std::vector<uint8_t> compressed;
+		for (size_t i = 0; i < files.size(); i++) {
+			std::ifstream input(files[i], std::ios::binary);
+			const std::vector<uint8_t> contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+			if (input.bad()) {
+				std::cerr << "Could not read " << files[i] << std::endl;
+				return false;
+			}
+			Entry& entry = entries[i];
+			entry.size = contents.size();
+			entry.storedSize = contents.size();
+			entry.writeTime = static_cast<int64_t>(std::filesystem::last_write_time(files[i], error).time_since_epoch().count());
+			entry.compression = Compression::None;
+			entry.reserved = 0;
+			const uint8_t* storedData = contents.data();
+			if (writeInfo.compress && !contents.empty() && !hasExtension(writeInfo.uncompressedExtensions, files[i].extension().string())) {
+				compressed.resize(ZSTD_compressBound(contents.size()));
+				const size_t compressedSize = ZSTD_compress(compressed.data(), compressed.size(), contents.data(), contents.size(), writeInfo.compressionLevel);
+				if (!ZSTD_isError(compressedSize) && (compressedSize <= contents.size() * (1.0f - writeInfo.minCompressionSavings))) {
+					entry.compression = Compression::Zstd;
+					entry.storedSize = compressedSize;
+					storedData = compressed.data();
+				}
+			}
+			entry.offset = alignUp(offset, entryAlignment);
+			archive.write(padding, static_cast<std::streamsize>(entry.offset - offset));
+			archive.write(reinterpret_cast<const char*>(storedData), static_cast<std::streamsize>(entry.storedSize));
+			offset = entry.offset + entry.storedSize;
+			totalSize += entry.size;
+			totalStoredSize += entry.storedSize;
+		}
+		archive.seekp(sizeof(header));
+		archive.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+		archive.close();
+		if (!archive.good()) {
+			std::cerr << "Could not write asset archive " << writeInfo.filename << std::endl;
+			return false;
+		}
+		// Written to a temporary file first, so a partially written archive is never mounted
+		std::filesystem::rename(tempFilename, writeInfo.filename, error);
+		if (error) {
+			std::cerr << "Could not write asset archive " << writeInfo.filename << ": " << error.message() << std::endl;
+			std::filesystem::remove(tempFilename, error);
+			return false;
+		}
+		std::cout << "Packed " << entries.size() << " files (" << totalSize << " bytes, " << totalStoredSize << " bytes stored) into " << writeInfo.filename << std::endl;
+		return true;
+	}
+}
@@ -0,0 +1,81 @@
+/*
+ * Packed asset archive
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "MappedFile.hpp"
+
+namespace vks
+{
+	struct AssetArchiveWriteInfo {
+		// All files below this directory are packed, paths in the archive are relative to it
+		std::string directory;
+		std::string filename;
+		// Entries are only stored compressed if that saves at least this fraction of their size
+		bool compress{ true };
+		int compressionLevel{ 19 };
+		float minCompressionSavings{ 0.1f };
+		// Files with these extensions are always stored uncompressed, as they're already compressed or are read straight from the mapping (e.g. KTX images copied to the staging buffer)
+		std::vector<std::string> uncompressedExtensions{ ".ktx", ".ktx2", ".png", ".jpg", ".jpeg", ".ogg", ".mp3", ".flac" };
+		// Files with these extensions are skipped (e.g. temporary files of the model cache)
+		std::vector<std::string> excludedExtensions{ ".tmp" };
+	};
+
+	/**
+	* Read-only archive of asset files, mapped into memory as a whole
+	* File layout: Header, entries (sorted by path), path strings, then the contents of all entries, each one starting at a multiple of entryAlignment
+	* Uncompressed entries are returned as ranges of the archive's mapping, so they're never copied, zstd compressed ones are decompressed into host memory when opened
+	*/
+	class AssetArchive
+	{
+	public:
+		static constexpr uint64_t entryAlignment{ 4096 };
+		enum class Compression : uint32_t {
+			None = 0,
+			Zstd = 1
+		};
+		struct Entry {
+			uint64_t offset;
+			// Size of the file and of its (possibly compressed) contents in the archive
+			uint64_t size;
+			uint64_t storedSize;
+			// Last write time of the packed file, so caches checking against their source file also work for archived files
+			int64_t writeTime;
+			uint32_t pathOffset;
+			uint32_t pathLength;
+			Compression compression;
+			uint32_t reserved;
+		};
+	private:
+		std::shared_ptr<const MappedFile> file;
+		const Entry* entries{ nullptr };
+		std::unordered_map<std::string, uint32_t> entryIndices;
+	public:
+		/**
+		* Maps an archive
+		*
+		* @throws std::runtime_error if the archive can't be mapped or is malformed
+		*/
+		AssetArchive(const std::string& filename);
+		// Returns nullptr if the archive doesn't contain the file (path relative to the archive's root with forward slashes)
+		const Entry* find(const std::string& path) const;
+		// Returns a range of the archive's mapping for uncompressed entries and the decompressed contents otherwise, nullptr if the archive doesn't contain the file
+		std::shared_ptr<MappedFile> open(const std::string& path) const;
+		uint32_t size() const;
+		/**
+		* Packs all files below a directory into an archive
+		*
+		* @return False if a file couldn't be read or the archive couldn't be written
+		*/
+		static bool write(const AssetArchiveWriteInfo& writeInfo);
+	};
+}
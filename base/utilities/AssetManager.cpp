@@ -5,26 +5,438 @@
  */
 
 #include "AssetManager.h"
+#include "StartupProfiler.h"
 
 AssetManager::~AssetManager() {
-	for (auto& it : models) {
-		delete it.second;
+	waitIdle();
+	for (auto& pending : pendingModels) {
+		delete pending->job;
+		delete pending->model;
 	}
+	for (ModelSlot& slot : modelSlots) {
+		delete slot.model;
+	}
+	// Models release their material slots and geometry ranges, so the buffer and the pool are destroyed last
+	delete materialBuffer;
+	delete geometryPool;
+}
+
+ModelHandle AssetManager::addModelSlot(const std::string& name, vkglTF::Model* model)
+{
+	assert(model && modelNames.find(name) == modelNames.end());
+	std::lock_guard<std::mutex> lock(referenceMutex);
+	uint32_t index;
+	if (!freeModelSlots.empty()) {
+		index = freeModelSlots.back();
+		freeModelSlots.pop_back();
+	} else {
+		index = static_cast<uint32_t>(modelSlots.size());
+		assert(index <= ModelHandle::indexMask);
+		modelSlots.push_back({});
+	}
+	ModelSlot& slot = modelSlots[index];
+	slot.model = model;
+	slot.name = name;
+	const ModelHandle handle = ModelHandle::create(index, slot.generation);
+	modelNames[name] = handle;
+	return handle;
+}
+
+ModelHandle AssetManager::add(const std::string name, vkglTF::Model* model) {
+	return addModelSlot(name, model);
+}
+
+ModelHandle AssetManager::findModel(const std::string& name) const
+{
+	auto it = modelNames.find(name);
+	return (it != modelNames.end()) ? it->second : ModelHandle{};
+}
+
+const std::string& AssetManager::getModelName(ModelHandle handle) const
+{
+	assert(isValid(handle));
+	return modelSlots[handle.index()].name;
+}
+
+uint32_t AssetManager::getModelSlotCount() const
+{
+	return static_cast<uint32_t>(modelSlots.size());
+}
+
+ModelHandle AssetManager::getModelHandle(uint32_t slot) const
+{
+	return modelSlots[slot].model ? ModelHandle::create(slot, modelSlots[slot].generation) : ModelHandle{};
 }
 
-vkglTF::Model* AssetManager::add(const std::string name, vkglTF::Model* model) {
-	models[name] = model;
+vkglTF::Model* AssetManager::remove(ModelHandle handle)
+{
+	assert(isValid(handle) && !isLoading(handle));
+	std::lock_guard<std::mutex> lock(referenceMutex);
+	ModelSlot& slot = modelSlots[handle.index()];
+	vkglTF::Model* model = slot.model;
+	modelNames.erase(slot.name);
+	removeUnusedModel(handle.index());
+	if (slot.evicted) {
+		evictedModelCount--;
+	}
+	slot.model = nullptr;
+	slot.name.clear();
+	slot.references = 0;
+	slot.createInfo.reset();
+	slot.deviceMemory = 0;
+	slot.evicted = false;
+	slot.generation = (slot.generation + 1) & (UINT32_MAX >> ModelHandle::indexBits);
+	freeModelSlots.push_back(handle.index());
 	return model;
 }
 
+void AssetManager::addUnusedModel(uint32_t index)
+{
+	ModelSlot& slot = modelSlots[index];
+	if (!slot.unused && slot.createInfo && !slot.evicted) {
+		slot.unusedPosition = unusedModels.insert(unusedModels.end(), index);
+		slot.unused = true;
+	}
+}
+
+void AssetManager::removeUnusedModel(uint32_t index)
+{
+	ModelSlot& slot = modelSlots[index];
+	if (slot.unused) {
+		unusedModels.erase(slot.unusedPosition);
+		slot.unused = false;
+	}
+}
+
+void AssetManager::acquire(ModelHandle handle)
+{
+	std::lock_guard<std::mutex> lock(referenceMutex);
+	assert(isValid(handle));
+	ModelSlot& slot = modelSlots[handle.index()];
+	if (slot.references++ > 0) {
+		return;
+	}
+	removeUnusedModel(handle.index());
+	if (slot.evicted) {
+		modelsToReload.push_back(handle);
+	}
+}
+
+void AssetManager::release(ModelHandle handle)
+{
+	std::lock_guard<std::mutex> lock(referenceMutex);
+	assert(isValid(handle) && modelSlots[handle.index()].references > 0);
+	if (--modelSlots[handle.index()].references == 0) {
+		addUnusedModel(handle.index());
+	}
+}
+
+// Replaces the least recently used model that isn't being loaded with a placeholder, returns false if no model could be evicted
+bool AssetManager::evictModel(VkDeviceSize& deviceMemory)
+{
+	if (!createPlaceholder || !onModelEvicted) {
+		return false;
+	}
+	std::unique_lock<std::mutex> lock(referenceMutex);
+	for (const uint32_t index : unusedModels) {
+		ModelSlot& slot = modelSlots[index];
+		const ModelHandle handle = ModelHandle::create(index, slot.generation);
+		if (isLoading(handle)) {
+			continue;
+		}
+		removeUnusedModel(index);
+		slot.evicted = true;
+		evictedModelCount++;
+		vkglTF::Model* model = slot.model;
+		deviceMemory = slot.deviceMemory;
+		slot.deviceMemory = 0;
+		// Placeholders add materials and textures, so they're created without holding the lock
+		lock.unlock();
+		slot.model = createPlaceholder(handle);
+		onModelEvicted(handle, model);
+		return true;
+	}
+	return false;
+}
+
+VkDeviceSize AssetManager::evictUnusedModels(VkDeviceSize bytes)
+{
+	VkDeviceSize freed = 0;
+	VkDeviceSize deviceMemory = 0;
+	while ((freed < bytes) && evictModel(deviceMemory)) {
+		freed += deviceMemory;
+	}
+	return freed;
+}
+
+uint32_t AssetManager::getEvictedModelCount() const
+{
+	return evictedModelCount;
+}
+
+uint32_t AssetManager::addTexture(vks::Texture* texture)
+{
+	std::lock_guard<std::mutex> lock(textureMutex);
+	uint32_t index;
+	if (!freeTextureSlots.empty()) {
+		index = freeTextureSlots.back();
+		freeTextureSlots.pop_back();
+		textures[index] = texture;
+	} else {
+		index = static_cast<uint32_t>(textures.size());
+		textures.push_back(texture);
+		textureVersions.push_back(0);
+		textureReferences.push_back(0);
+		textureContentKeys.push_back(0);
+	}
+	textureReferences[index] = 1;
+	textureVersions[index]++;
+	textureGeneration++;
+	return index;
+}
+
 uint32_t AssetManager::add(const std::string name, vks::Texture2D* texture)
 {
-	textures.push_back(texture);
-	return static_cast<uint32_t>(textures.size() - 1);
+	return addTexture(texture);
+}
+
+uint32_t AssetManager::add(const std::string name, vks::Texture2DArray* textureArray)
+{
+	return addTexture(textureArray);
 }
 
 uint32_t AssetManager::add(const std::string name, vks::TextureCubeMap* cubemap)
 {
-	textures.push_back(cubemap);
-	return static_cast<uint32_t>(textures.size() - 1);
+	return addTexture(cubemap);
+}
+
+vks::Texture* AssetManager::getTexture(uint32_t index) const
+{
+	std::lock_guard<std::mutex> lock(textureMutex);
+	return textures[index];
+}
+
+uint32_t AssetManager::acquireTexture(uint64_t contentKey)
+{
+	std::lock_guard<std::mutex> lock(textureMutex);
+	auto it = textureContentSlots.find(contentKey);
+	if (it == textureContentSlots.end()) {
+		return UINT32_MAX;
+	}
+	textureReferences[it->second]++;
+	return it->second;
+}
+
+void AssetManager::setTextureContentKey(uint32_t index, uint64_t contentKey)
+{
+	std::lock_guard<std::mutex> lock(textureMutex);
+	assert(textures[index] && textureContentKeys[index] == 0);
+	// Keeps the slot already registered for these contents, if another texture was added with it in the meantime
+	if (contentKey != 0 && textureContentSlots.emplace(contentKey, index).second) {
+		textureContentKeys[index] = contentKey;
+	}
+}
+
+vks::Texture* AssetManager::setTexture(uint32_t index, vks::Texture* texture)
+{
+	std::lock_guard<std::mutex> lock(textureMutex);
+	assert(textures[index]);
+	vks::Texture* replacedTexture = textures[index];
+	textures[index] = texture;
+	textureVersions[index]++;
+	textureGeneration++;
+	return replacedTexture;
+}
+
+void AssetManager::removeTexture(uint32_t index)
+{
+	{
+		std::lock_guard<std::mutex> lock(textureMutex);
+		assert(textures[index] && textureReferences[index] > 0);
+		if (--textureReferences[index] > 0) {
+			return;
+		}
+		// Unregistered before the lock is released, so the slot can't be acquired again while it's being destroyed
+		if (textureContentKeys[index] != 0) {
+			textureContentSlots.erase(textureContentKeys[index]);
+			textureContentKeys[index] = 0;
+		}
+	}
+	// The streamer calls back into the asset manager with its own lock held, so it's called without holding the texture lock
+	if (textureStreamer) {
+		textureStreamer->remove(index);
+	}
+	std::lock_guard<std::mutex> lock(textureMutex);
+	textures[index]->destroy();
+	delete textures[index];
+	textures[index] = nullptr;
+	textureVersions[index]++;
+	textureGeneration++;
+	freeTextureSlots.push_back(index);
+}
+
+void AssetManager::createGeometryPool(GeometryPoolCreateInfo createInfo)
+{
+	assert(!geometryPool);
+	MemoryStats::Scope memoryScope(MemoryCategory::Models);
+	geometryPool = new GeometryPool(createInfo);
+}
+
+void AssetManager::createMaterialBuffer(uint32_t capacity)
+{
+	assert(!materialBuffer && capacity > 0);
+	MemoryStats::Scope memoryScope(MemoryCategory::Models);
+	// Host visible, as materials are only written once per model upload
+	materialBuffer = new Buffer({
+		.name = "Material buffer",
+		.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		.size = sizeof(vkglTF::MaterialData) * capacity,
+	});
+	materialCapacity = capacity;
+	const vkglTF::MaterialData defaultMaterial{};
+	memcpy(materialBuffer->mapped, &defaultMaterial, sizeof(vkglTF::MaterialData));
+	materialCount = 1;
+}
+
+uint32_t AssetManager::addMaterial(const vkglTF::MaterialData& data)
+{
+	assert(materialBuffer);
+	uint32_t index;
+	if (!freeMaterialSlots.empty()) {
+		index = freeMaterialSlots.back();
+		freeMaterialSlots.pop_back();
+	} else if (materialCount < materialCapacity) {
+		index = materialCount++;
+	} else {
+		std::cerr << "Number of materials exceeds the material buffer size of " << materialCapacity << ", using the default material\n";
+		return 0;
+	}
+	// Slots are only reused once the frames that used their previous material have completed, so they can be written while other slots are in use
+	memcpy(static_cast<vkglTF::MaterialData*>(materialBuffer->mapped) + index, &data, sizeof(vkglTF::MaterialData));
+	return index;
+}
+
+void AssetManager::removeMaterial(uint32_t index)
+{
+	if (index != 0) {
+		freeMaterialSlots.push_back(index);
+	}
+}
+
+ModelHandle AssetManager::loadAsync(const std::string name, vkglTF::ModelCreateInfo createInfo, vkglTF::Model* placeholder)
+{
+	const ModelHandle handle = addModelSlot(name, placeholder);
+	{
+		std::lock_guard<std::mutex> lock(referenceMutex);
+		modelSlots[handle.index()].createInfo = std::make_unique<vkglTF::ModelCreateInfo>(createInfo);
+		// Unused until the first actor acquires it
+		addUnusedModel(handle.index());
+	}
+	reloadAsync(handle, createInfo);
+	return handle;
+}
+
+void AssetManager::reloadAsync(ModelHandle handle, vkglTF::ModelCreateInfo createInfo)
+{
+	// Only one load per slot can be in flight, as the placeholder is handed over once the model is ready
+	assert(isValid(handle) && !isLoading(handle));
+
+	PendingModel* pending = pendingModels.emplace_back(std::make_unique<PendingModel>()).get();
+	pending->handle = handle;
+	pending->model = new vkglTF::Model();
+	pending->placeholder = getModel(handle);
+	if (!createInfo.jobSystem) {
+		createInfo.jobSystem = jobSystem;
+	}
+	auto loadFunction = [pending, createInfo, name = getModelName(handle)] {
+		StartupProfiler::Scope scope("Model load " + name);
+		MemoryStats::Scope memoryScope(MemoryCategory::Models);
+		pending->loaded = pending->model->load(createInfo);
+	};
+	vks::JobSystem::runBackgroundOrInline(jobSystem, pending->job, loadFunction);
+}
+
+void AssetManager::update()
+{
+	// Evicted models that were acquired again are loaded like a reload, models released again in the meantime stay evicted
+	{
+		std::lock_guard<std::mutex> lock(referenceMutex);
+		for (const ModelHandle handle : modelsToReload) {
+			if (!isValid(handle) || isLoading(handle)) {
+				continue;
+			}
+			ModelSlot& slot = modelSlots[handle.index()];
+			if (slot.evicted && slot.references > 0) {
+				slot.evicted = false;
+				evictedModelCount--;
+				reloadAsync(handle, *slot.createInfo);
+			}
+		}
+		modelsToReload.clear();
+	}
+	VkDeviceSize evictedMemory = 0;
+	if (evictionDelay > 0) {
+		evictionDelay--;
+	} else if ((hostMemoryBudget > 0) && (memoryStats.getHostBytes(MemoryCategory::Models) > static_cast<int64_t>(hostMemoryBudget)) && evictModel(evictedMemory)) {
+		evictionDelay = evictionInterval;
+	}
+
+	// Publish before uploading, so the acquire barriers of an upload have been submitted with at least one frame before the model is used
+	for (auto it = pendingModels.begin(); it != pendingModels.end();) {
+		PendingModel* pending = it->get();
+		if (!pending->uploaded || !VulkanContext::stagingBuffer->isComplete(pending->timelineValue)) {
+			it++;
+			continue;
+		}
+		assert(onModelLoaded);
+		modelSlots[pending->handle.index()].model = pending->model;
+		onModelLoaded(pending->handle, pending->placeholder, pending->model);
+		delete pending->job;
+		it = pendingModels.erase(it);
+	}
+
+	for (auto it = pendingModels.begin(); it != pendingModels.end();) {
+		PendingModel* pending = it->get();
+		if (pending->uploaded || (pending->job && !jobSystem->isFinished(pending->job))) {
+			it++;
+			continue;
+		}
+		if (!pending->loaded) {
+			// Keep the placeholder
+			std::cerr << "Could not load model \"" << getModelName(pending->handle) << "\" asynchronously" << std::endl;
+			delete pending->job;
+			delete pending->model;
+			it = pendingModels.erase(it);
+			continue;
+		}
+		// Textures and geometry that didn't change share the slots of the model being replaced, so a hot reload only uploads what was modified
+		StartupProfiler::Scope scope("Model upload " + getModelName(pending->handle));
+		MemoryStats::Scope memoryScope(MemoryCategory::Models);
+		const int64_t deviceMemory = memoryStats.getDeviceBytes(MemoryCategory::Models);
+		pending->timelineValue = pending->model->upload();
+		pending->uploaded = true;
+		// Accounted per slot, so evicting the model can report what it frees
+		modelSlots[pending->handle.index()].deviceMemory = static_cast<VkDeviceSize>(std::max(memoryStats.getDeviceBytes(MemoryCategory::Models) - deviceMemory, int64_t(0)));
+		it++;
+	}
+}
+
+bool AssetManager::isLoading(ModelHandle handle) const
+{
+	return std::find_if(pendingModels.begin(), pendingModels.end(), [handle](const std::unique_ptr<PendingModel>& pending) { return pending->handle == handle; }) != pendingModels.end();
+}
+
+bool AssetManager::hasPendingLoads() const
+{
+	return !pendingModels.empty();
+}
+
+void AssetManager::waitIdle()
+{
+	for (auto& pending : pendingModels) {
+		if (pending->job) {
+			jobSystem->wait(pending->job);
+		}
+	}
 }
@@ -8,15 +8,224 @@
 
 #include <unordered_map>
 #include <string>
+#include <list>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <mutex>
+#include <cassert>
 #include "glTF.h"
 #include "Texture.hpp"
+#include "Buffer.hpp"
+#include "GeometryPool.hpp"
+#include "JobSystem.hpp"
+#include "TextureStreamer.h"
+
+/**
+ * Typed 32 bit reference to an asset slot, the lower bits hold the slot index and the upper bits the slot's generation
+ * The generation is incremented when an asset is removed, so handles to removed assets can be told apart from those to an asset reusing the slot
+ * Replacing the asset of a slot (e.g. a reload) keeps its handles valid
+ */
+template<typename T>
+struct AssetHandle {
+	static constexpr uint32_t indexBits{ 24 };
+	static constexpr uint32_t indexMask{ (1u << indexBits) - 1 };
+	uint32_t value{ UINT32_MAX };
+	static AssetHandle create(uint32_t index, uint32_t generation) {
+		return { ((generation << indexBits) | (index & indexMask)) };
+	}
+	uint32_t index() const { return value & indexMask; }
+	uint32_t generation() const { return value >> indexBits; }
+	bool isSet() const { return value != UINT32_MAX; }
+	bool operator==(const AssetHandle& other) const { return value == other.value; };
+	bool operator!=(const AssetHandle& other) const { return value != other.value; };
+};
+
+using ModelHandle = AssetHandle<vkglTF::Model>;
 
 class AssetManager {
+private:
+	struct ModelSlot {
+		vkglTF::Model* model{ nullptr };
+		std::string name;
+		// Wraps around at the number of bits a handle has for it
+		uint32_t generation{ 0 };
+		// Users of the model (e.g. actors), see acquire and release
+		uint32_t references{ 0 };
+		// Copy of what the model was loaded with, only models that have one can be evicted, as they're loaded again from it on their next use
+		std::unique_ptr<vkglTF::ModelCreateInfo> createInfo;
+		// Device memory allocated by the model's upload, includes textures shared with other models
+		VkDeviceSize deviceMemory{ 0 };
+		// Set while the slot holds a placeholder in place of the evicted model
+		bool evicted{ false };
+		// Set while the slot is listed in unusedModels
+		bool unused{ false };
+		std::list<uint32_t>::iterator unusedPosition{};
+	};
+	// Dense array indexed with the handle's index, nullptr for free slots
+	std::vector<ModelSlot> modelSlots{};
+	std::vector<uint32_t> freeModelSlots{};
+	// Name lookup, only meant for setup and tooling, hot code keeps the handles
+	std::unordered_map<std::string, ModelHandle> modelNames{};
+	ModelHandle addModelSlot(const std::string& name, vkglTF::Model* model);
+	struct PendingModel {
+		ModelHandle handle;
+		vkglTF::Model* model{ nullptr };
+		vkglTF::Model* placeholder{ nullptr };
+		vks::Job* job{ nullptr };
+		bool loaded{ false };
+		bool uploaded{ false };
+		uint64_t timelineValue{ 0 };
+	};
+	std::vector<std::unique_ptr<PendingModel>> pendingModels{};
+	// Slots of unreferenced models that can be evicted, in the order they were released, so the least recently used model comes first
+	std::list<uint32_t> unusedModels{};
+	// Evicted models that have been acquired again, loaded by the next update
+	std::vector<ModelHandle> modelsToReload{};
+	// References may be changed by the simulation (e.g. removing actors) while the main thread records a frame
+	std::mutex referenceMutex;
+	uint32_t evictionDelay{ 0 };
+	uint32_t evictedModelCount{ 0 };
+	// Callers hold the reference mutex
+	void addUnusedModel(uint32_t index);
+	void removeUnusedModel(uint32_t index);
+	bool evictModel(VkDeviceSize& deviceMemory);
+	// Slots of removed textures, reused by the next textures that are added so the bindless texture table doesn't grow with every reload
+	std::vector<uint32_t> freeTextureSlots{};
+	// Number of users of each slot, a slot is only destroyed once its last user removes it
+	std::vector<uint32_t> textureReferences{};
+	// Content hash of each slot (zero if not shared) and the slot of each hash, so textures created from the same image are only uploaded once
+	std::vector<uint64_t> textureContentKeys{};
+	std::unordered_map<uint64_t, uint32_t> textureContentSlots{};
+	uint32_t addTexture(vks::Texture* texture);
+	std::vector<uint32_t> freeMaterialSlots{};
+	uint32_t materialCount{ 0 };
+	uint32_t materialCapacity{ 0 };
 public:
-	std::unordered_map<std::string, vkglTF::Model*> models{};
+	// Indexed by asset index, which is also the texture's index in the bindless texture table, nullptr for free slots
 	std::vector<vks::Texture*> textures{};
+	// Incremented whenever a slot is assigned a texture, compared against instead of the texture's handles as these may be reused by the driver
+	std::vector<uint32_t> textureVersions{};
+	// Incremented whenever any slot changes, so users of the slots can skip checking them if nothing changed
+	uint64_t textureGeneration{ 0 };
+	// Textures may be added from model loading jobs
+	mutable std::mutex textureMutex;
+	// Parameters of the materials of all uploaded models, indexed per draw by the fragment shader
+	// Slot 0 is a default material, used if the buffer is full
+	Buffer* materialBuffer{ nullptr };
+	// Used to parse asynchronously loaded assets, if not set these are loaded on the calling thread
+	vks::JobSystem* jobSystem{ nullptr };
+	// Optional, if set the mip levels of KTX textures used by models are streamed instead of being uploaded at once
+	TextureStreamer* textureStreamer{ nullptr };
+	// Optional, models with the pool's vertex layout place their vertices and indices in it instead of buffers of their own
+	GeometryPool* geometryPool{ nullptr };
+	// Called once an asynchronously loaded model replaces its placeholder in the model's slot, takes over ownership of the placeholder
+	std::function<void(ModelHandle handle, vkglTF::Model* placeholder, vkglTF::Model* model)> onModelLoaded;
+	// Creates the model an evicted model's slot holds until it's loaded again, models are only evicted if this and onModelEvicted are set
+	std::function<vkglTF::Model*(ModelHandle handle)> createPlaceholder;
+	// Called once a model has been replaced by a placeholder, takes over ownership of the evicted model which may still be in use by frames in flight
+	std::function<void(ModelHandle handle, vkglTF::Model* model)> onModelEvicted;
+	// Unused models are evicted by update while the host memory of all models exceeds this, 0 = no limit (device memory is reclaimed through evictUnusedModels)
+	size_t hostMemoryBudget{ 0 };
+	// Updates between evictions for the host memory budget, as evicted models are only freed once the frames in flight are done with them
+	uint32_t evictionInterval{ 4 };
 	~AssetManager();
-	vkglTF::Model* add(const std::string name, vkglTF::Model* model);
+	/** @brief Registers a model under a new name, the asset manager takes over ownership */
+	ModelHandle add(const std::string name, vkglTF::Model* model);
+	// Returns the model a handle refers to, the handle must be valid
+	vkglTF::Model* getModel(ModelHandle handle) const {
+		assert(isValid(handle));
+		return modelSlots[handle.index()].model;
+	}
+	bool isValid(ModelHandle handle) const {
+		return handle.isSet() && (handle.index() < modelSlots.size()) && modelSlots[handle.index()].model && (handle.generation() == modelSlots[handle.index()].generation);
+	}
+	// Returns the handle for a named model or an unset handle
+	ModelHandle findModel(const std::string& name) const;
+	const std::string& getModelName(ModelHandle handle) const;
+	// Number of model slots including free ones, with getModelHandle used to iterate over all models
+	uint32_t getModelSlotCount() const;
+	// Returns the handle of the model in a slot or an unset handle for free slots
+	ModelHandle getModelHandle(uint32_t slot) const;
+	/**
+	* Removes a model and frees its slot for reuse, handles to the model are no longer valid afterwards
+	*
+	* @return The removed model, which may still be in use by frames in flight and is owned by the caller
+	*/
+	vkglTF::Model* remove(ModelHandle handle);
+	/**
+	* Adds a reference to a model, referenced models are never evicted
+	* Acquiring an evicted model loads it again in the background, with a placeholder in its slot until it's GPU resident
+	* Can be called from any thread
+	*/
+	void acquire(ModelHandle handle);
+	/** @brief Releases a reference to a model, unreferenced models loaded with loadAsync become candidates for eviction, can be called from any thread */
+	void release(ModelHandle handle);
+	/**
+	* Evicts unreferenced models, least recently used first, e.g. as a reclaimer of the memory budget manager, needs to be called from the main thread
+	*
+	* @param bytes Device memory to free
+	*
+	* @return Device memory that is freed once the frames in flight are done with the evicted models, less than requested if there are not enough unused models
+	*/
+	VkDeviceSize evictUnusedModels(VkDeviceSize bytes);
+	// Number of models currently replaced by a placeholder
+	uint32_t getEvictedModelCount() const;
 	uint32_t add(const std::string name, vks::Texture2D* texture);
+	uint32_t add(const std::string name, vks::Texture2DArray* textureArray);
 	uint32_t add(const std::string name, vks::TextureCubeMap* cubemap);
-};
\ No newline at end of file
+	vks::Texture* getTexture(uint32_t index) const;
+	/**
+	* Looks up the slot of a texture by the hash of its contents and adds a reference to it, which is released with removeTexture
+	*
+	* @return Asset index of the texture or UINT32_MAX if no texture with these contents has been added
+	*/
+	uint32_t acquireTexture(uint64_t contentKey);
+	/** @brief Sets the hash of a texture's contents, so later textures with the same contents can share its slot through acquireTexture */
+	void setTextureContentKey(uint32_t index, uint64_t contentKey);
+	/**
+	* Replaces the texture in a slot, e.g. by one with a different mip chain
+	*
+	* @param index Asset index of the slot
+	* @param texture New texture of the slot, the asset manager takes over ownership
+	*
+	* @return The replaced texture, which may still be in use by frames in flight and is owned by the caller
+	*/
+	vks::Texture* setTexture(uint32_t index, vks::Texture* texture);
+	/**
+	* Releases a reference to a texture, once the last one is released the texture is destroyed and its slot freed for reuse
+	* The texture must no longer be used by frames in flight, streamed textures are also removed from the texture streamer
+	*/
+	void removeTexture(uint32_t index);
+	/** @brief Creates the material buffer, needs to be called before the first model is uploaded */
+	void createMaterialBuffer(uint32_t capacity);
+	/** @brief Creates the geometry pool shared by all models, needs to be called before the first model is uploaded */
+	void createGeometryPool(GeometryPoolCreateInfo createInfo);
+	/**
+	* Writes a material to a free slot of the material buffer, needs to be called from the main thread
+	*
+	* @return Slot of the material, passed to the shaders as material index
+	*/
+	uint32_t addMaterial(const vkglTF::MaterialData& data);
+	/** @brief Frees a material slot for reuse, the material must no longer be used by frames in flight */
+	void removeMaterial(uint32_t index);
+	/**
+	* Loads a model in the background, the file is parsed on the job system and uploaded on the transfer queue
+	*
+	* @param name Name the model is registered with
+	* @param createInfo Model create info
+	* @param placeholder Model in the new slot until the loaded model is GPU resident, owned by the asset manager until it's replaced
+	*
+	* @return Handle of the model's slot, refers to the placeholder while loading
+	*/
+	ModelHandle loadAsync(const std::string name, vkglTF::ModelCreateInfo createInfo, vkglTF::Model* placeholder);
+	/** @brief Loads a new version of a model in the background (e.g. for hot reload), the current model stays in its slot until the new one is GPU resident */
+	void reloadAsync(ModelHandle handle, vkglTF::ModelCreateInfo createInfo);
+	/** @brief Uploads models that have finished parsing and publishes those that are GPU resident, loads acquired evicted models and evicts models above the host memory budget, needs to be called once per frame from the main thread */
+	void update();
+	bool isLoading(ModelHandle handle) const;
+	// True while any model is still being loaded or uploaded in the background
+	bool hasPendingLoads() const;
+	/** @brief Waits until all background parsing jobs have finished */
+	void waitIdle();
+};
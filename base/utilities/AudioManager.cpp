@@ -5,22 +5,406 @@
  */
 
 #include "AudioManager.h"
+#include <algorithm>
 
-void AudioManager::AddSoundFile(const std::string name, const std::string filename)
+AudioManager::AudioManager()
 {
+	worker = std::thread(&AudioManager::process, this);
+}
+
+AudioManager::~AudioManager()
+{
+	// Decoding jobs write into the sound list
+	waitIdle();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_one();
+	worker.join();
+	music.stop();
+	// Voices need to release their buffers before those are deleted
+	for (Voice& voice : voices) {
+		voice.sound.stop();
+		voice.sound.resetBuffer();
+	}
+	for (sf::SoundBuffer* soundBuffer : soundBuffers) {
+		delete soundBuffer;
+	}
+}
+
+sf::SoundBuffer* AudioManager::decodeSoundFile(const std::string& filename)
+{
+	// Read through the virtual file system, so sounds can also come from an asset archive
+	const auto file = vks::vfs::open(filename);
 	auto soundBuffer = new sf::SoundBuffer;
-	if (soundBuffer->loadFromFile(filename)) {
-		soundBuffers[name] = soundBuffer;
-	} else {
+	if (!file || !soundBuffer->loadFromMemory(file->data(), file->size())) {
 		std::cout << "Error: Could not load soundfile " << filename << "\n";
 		delete soundBuffer;
+		return nullptr;
+	}
+	return soundBuffer;
+}
+
+SoundHandle AudioManager::AddSoundFile(const std::string name, const std::string filename)
+{
+	sf::SoundBuffer* soundBuffer = decodeSoundFile(filename);
+	if (!soundBuffer) {
+		return {};
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	const SoundHandle handle{ static_cast<uint32_t>(soundBuffers.size()) };
+	soundBuffers.push_back(soundBuffer);
+	soundProperties.push_back({});
+	soundNames[name] = handle;
+	return handle;
+}
+
+SoundHandle AudioManager::loadSoundFileAsync(const std::string name, const std::string filename)
+{
+	SoundHandle handle;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		handle = { static_cast<uint32_t>(soundBuffers.size()) };
+		soundBuffers.push_back(nullptr);
+		soundProperties.push_back({});
+		soundNames[name] = handle;
+	}
+	pendingLoads++;
+	// Without worker threads the sound is decoded before this returns
+	vks::Job* job = nullptr;
+	const bool scheduled = vks::JobSystem::runBackgroundOrInline(jobSystem, job, [this, handle, filename] {
+		sf::SoundBuffer* soundBuffer = decodeSoundFile(filename);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			soundBuffers[handle.index] = soundBuffer;
+		}
+		pendingLoads--;
+	});
+	if (scheduled) {
+		loadJobs.push_back(job);
+	}
+	return handle;
+}
+
+bool AudioManager::hasPendingLoads() const
+{
+	return pendingLoads.load() > 0;
+}
+
+void AudioManager::waitIdle()
+{
+	for (vks::Job* job : loadJobs) {
+		jobSystem->wait(job);
+		delete job;
+	}
+	loadJobs.clear();
+}
+
+SoundHandle AudioManager::findSound(const std::string& name) const
+{
+	auto it = soundNames.find(name);
+	return (it != soundNames.end()) ? it->second : SoundHandle{};
+}
+
+void AudioManager::setSoundProperties(SoundHandle sound, const SoundProperties& properties)
+{
+	if (!sound.isSet()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	soundProperties[sound.index] = properties;
+}
+
+void AudioManager::setListener(const glm::vec3& position, const glm::vec3& direction, const glm::vec3& up)
+{
+	// Picked up by the worker with its next update, so moving the listener doesn't wake it
+	std::lock_guard<std::mutex> lock(mutex);
+	listener = { .position = position, .direction = direction, .up = up };
+	listenerChanged = true;
+}
+
+void AudioManager::PlaySnd(SoundHandle sound, int32_t priority, float volume)
+{
+	if (!sound.isSet()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (requestCount == maxQueuedRequests) {
+			droppedRequests++;
+			return;
+		}
+		requests[(requestHead + requestCount) % maxQueuedRequests] = { .sound = sound, .priority = priority, .volume = volume, .positional = false, .position = glm::vec3(0.0f), .properties = soundProperties[sound.index] };
+		requestCount++;
+	}
+	wakeUp.notify_one();
+}
+
+void AudioManager::PlaySnd(SoundHandle sound, const glm::vec3& position, int32_t priority, float volume)
+{
+	if (!sound.isSet()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (requestCount == maxQueuedRequests) {
+			droppedRequests++;
+			return;
+		}
+		requests[(requestHead + requestCount) % maxQueuedRequests] = { .sound = sound, .priority = priority, .volume = volume, .positional = true, .position = position, .properties = soundProperties[sound.index] };
+		requestCount++;
+	}
+	wakeUp.notify_one();
+}
+
+void AudioManager::playMusic(const std::string& filename, float volume, bool loop)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		musicRequest = { .filename = filename, .volume = volume, .loop = loop };
+		musicRequested = true;
 	}
+	wakeUp.notify_one();
 }
 
-void AudioManager::PlaySnd(const std::string name)
+void AudioManager::stopMusic()
 {
-	sound.setBuffer(*soundBuffers[name]);
-	sound.play();
+	playMusic("");
 }
 
-// @todo: cleanup
+uint32_t AudioManager::getDroppedRequests() const
+{
+	return droppedRequests.load();
+}
+
+uint32_t AudioManager::getVirtualVoiceCount() const
+{
+	return virtualVoicesInUse.load();
+}
+
+void AudioManager::process()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	auto nextUpdate = std::chrono::steady_clock::now();
+	while (true) {
+		auto hasWork = [this] { return stopping || (requestCount > 0) || musicRequested; };
+		// Without virtual or positional voices nothing changes until the next request
+		if (voicesNeedUpdates) {
+			wakeUp.wait_until(lock, nextUpdate, hasWork);
+		} else {
+			wakeUp.wait(lock, hasWork);
+		}
+		if (stopping) {
+			return;
+		}
+		if (listenerChanged) {
+			activeListener = listener;
+			listenerChanged = false;
+		}
+		if (voicesNeedUpdates && (std::chrono::steady_clock::now() >= nextUpdate)) {
+			lock.unlock();
+			updateVoices();
+			lock.lock();
+			nextUpdate = std::chrono::steady_clock::now() + updateInterval;
+			continue;
+		}
+		if (musicRequested) {
+			const MusicRequest request = musicRequest;
+			musicRequested = false;
+			lock.unlock();
+			startMusic(request);
+			lock.lock();
+			continue;
+		}
+		// Requests are taken one at a time, so the game thread isn't blocked while voices are started
+		const PlaybackRequest request = requests[requestHead];
+		requestHead = (requestHead + 1) % maxQueuedRequests;
+		requestCount--;
+		lock.unlock();
+		start(request);
+		lock.lock();
+	}
+}
+
+void AudioManager::start(const PlaybackRequest& request)
+{
+	{
+		// Requests for sounds that are still being decoded are ignored
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!soundBuffers[request.sound.index]) {
+			return;
+		}
+	}
+	applyListener();
+	const auto now = std::chrono::steady_clock::now();
+	const float audibility = getAudibility(request);
+	Voice* target = (audibility >= inaudibleVolume) ? findVoice(request, audibility, false) : nullptr;
+	if (target) {
+		play(*target, request, now, startedVoices++);
+	} else {
+		virtualize(request, now, startedVoices++);
+	}
+}
+
+float AudioManager::getAudibility(const PlaybackRequest& request) const
+{
+	float gain = 1.0f;
+	if (request.positional) {
+		// Same inverse distance clamped model OpenAL applies to the voices
+		const SoundProperties& properties = request.properties;
+		const float distance = std::max(glm::length(request.position - activeListener.position), properties.minDistance);
+		gain = properties.minDistance / (properties.minDistance + properties.attenuation * (distance - properties.minDistance));
+	}
+	return gain * request.volume / 100.0f;
+}
+
+AudioManager::Voice* AudioManager::findVoice(const PlaybackRequest& request, float audibility, bool strict)
+{
+	uint32_t soundVoices = 0;
+	for (const Voice& voice : voices) {
+		if ((voice.sound.getStatus() != sf::SoundSource::Stopped) && (voice.request.sound.index == request.sound.index)) {
+			soundVoices++;
+		}
+	}
+	// Once the sound uses all voices it may have, it can only take over one of its own
+	const bool limited = soundVoices >= request.properties.maxVoices;
+	Voice* target{ nullptr };
+	float targetAudibility = 0.0f;
+	for (Voice& voice : voices) {
+		if (voice.sound.getStatus() == sf::SoundSource::Stopped) {
+			if (!limited) {
+				return &voice;
+			}
+			continue;
+		}
+		if ((limited && (voice.request.sound.index != request.sound.index)) || (voice.request.priority > request.priority)) {
+			continue;
+		}
+		// Voices of the same priority are only stolen if they are quieter than the request
+		const float voiceAudibility = getAudibility(voice.request);
+		if ((voice.request.priority == request.priority) && (strict ? (voiceAudibility >= audibility) : (voiceAudibility > audibility))) {
+			continue;
+		}
+		const bool moreImportant = target && ((voice.request.priority > target->request.priority) || ((voice.request.priority == target->request.priority) && ((voiceAudibility > targetAudibility) || ((voiceAudibility == targetAudibility) && (voice.startIndex > target->startIndex)))));
+		if (!target || !moreImportant) {
+			target = &voice;
+			targetAudibility = voiceAudibility;
+		}
+	}
+	return target;
+}
+
+void AudioManager::play(Voice& voice, const PlaybackRequest& request, std::chrono::steady_clock::time_point startTime, uint64_t startIndex)
+{
+	const auto now = std::chrono::steady_clock::now();
+	// A stolen sound keeps playing virtually
+	if (voice.sound.getStatus() != sf::SoundSource::Stopped) {
+		virtualize(voice.request, now - std::chrono::microseconds(voice.sound.getPlayingOffset().asMicroseconds()), voice.startIndex);
+	}
+	const sf::SoundBuffer* soundBuffer;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		soundBuffer = soundBuffers[request.sound.index];
+	}
+	voice.sound.stop();
+	voice.sound.setBuffer(*soundBuffer);
+	voice.sound.setVolume(request.volume);
+	// Sounds without a position play at the listener
+	voice.sound.setRelativeToListener(!request.positional);
+	voice.sound.setPosition(request.position.x, request.position.y, request.position.z);
+	voice.sound.setMinDistance(request.properties.minDistance);
+	voice.sound.setAttenuation(request.positional ? request.properties.attenuation : 0.0f);
+	voice.sound.play();
+	// The offset can only be changed once the sound is playing
+	if (startTime < now) {
+		voice.sound.setPlayingOffset(sf::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(now - startTime).count()));
+	}
+	voice.request = request;
+	voice.startIndex = startIndex;
+	voicesNeedUpdates |= request.positional;
+}
+
+void AudioManager::virtualize(const PlaybackRequest& request, std::chrono::steady_clock::time_point startTime, uint64_t startIndex)
+{
+	if (virtualVoiceCount == maxVirtualVoices) {
+		droppedRequests++;
+		return;
+	}
+	virtualVoices[virtualVoiceCount++] = { .request = request, .startTime = startTime, .startIndex = startIndex };
+	virtualVoicesInUse = virtualVoiceCount;
+	voicesNeedUpdates = true;
+}
+
+void AudioManager::updateVoices()
+{
+	applyListener();
+	const auto now = std::chrono::steady_clock::now();
+	bool positionalVoices = false;
+	// Voices that can no longer be heard (e.g. as the listener moved away) are virtualized, so the voice is free for other sounds
+	for (Voice& voice : voices) {
+		if ((voice.sound.getStatus() == sf::SoundSource::Stopped) || !voice.request.positional) {
+			continue;
+		}
+		if (getAudibility(voice.request) < inaudibleVolume) {
+			virtualize(voice.request, now - std::chrono::microseconds(voice.sound.getPlayingOffset().asMicroseconds()), voice.startIndex);
+			voice.sound.stop();
+		} else {
+			positionalVoices = true;
+		}
+	}
+	// Virtual voices that would have finished by now are dropped, the others take a voice again once they're audible and one is available
+	for (uint32_t i = 0; i < virtualVoiceCount;) {
+		const VirtualVoice virtualVoice = virtualVoices[i];
+		const sf::SoundBuffer* soundBuffer;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			soundBuffer = soundBuffers[virtualVoice.request.sound.index];
+		}
+		const auto duration = std::chrono::microseconds(soundBuffer->getDuration().asMicroseconds());
+		const float audibility = getAudibility(virtualVoice.request);
+		Voice* target{ nullptr };
+		const bool finished = (now - virtualVoice.startTime >= duration);
+		if (!finished && (audibility >= inaudibleVolume)) {
+			target = findVoice(virtualVoice.request, audibility, true);
+		}
+		if (!finished && !target) {
+			i++;
+			continue;
+		}
+		// Removed before a stolen voice may be appended
+		virtualVoices[i] = virtualVoices[--virtualVoiceCount];
+		if (target) {
+			play(*target, virtualVoice.request, virtualVoice.startTime, virtualVoice.startIndex);
+			positionalVoices |= virtualVoice.request.positional;
+		}
+	}
+	virtualVoicesInUse = virtualVoiceCount;
+	voicesNeedUpdates = positionalVoices || (virtualVoiceCount > 0);
+}
+
+void AudioManager::applyListener()
+{
+	sf::Listener::setPosition(activeListener.position.x, activeListener.position.y, activeListener.position.z);
+	sf::Listener::setDirection(activeListener.direction.x, activeListener.direction.y, activeListener.direction.z);
+	sf::Listener::setUpVector(activeListener.up.x, activeListener.up.y, activeListener.up.z);
+}
+
+void AudioManager::startMusic(const MusicRequest& request)
+{
+	music.stop();
+	if (request.filename.empty()) {
+		return;
+	}
+	// Only reads the file's headers, samples are decoded in chunks from the mapping while the track plays
+	std::shared_ptr<vks::MappedFile> file = vks::vfs::open(request.filename);
+	if (!file || !music.openFromMemory(file->data(), file->size())) {
+		std::cout << "Error: Could not open music file " << request.filename << "\n";
+		return;
+	}
+	// Replaced once the new stream has been opened, as the previous one may still refer to its file until then
+	musicFile = file;
+	music.setVolume(request.volume);
+	music.setLoop(request.loop);
+	music.play();
+}
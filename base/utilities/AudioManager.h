@@ -4,21 +4,184 @@
  * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
  */
 
+#pragma once
+
 #include <string>
 #include <iostream>
+#include <vector>
+#include <array>
 #include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <glm/glm.hpp>
 #include <SFML/Audio.hpp>
-
-// @todo: std::(de)queue?
+#include "VirtualFileSystem.h"
+#include "JobSystem.hpp"
 
 #undef PlaySoundA
 
+/** @brief Index of a loaded sound, looked up once by name so playback doesn't need to */
+struct SoundHandle {
+	uint32_t index{ UINT32_MAX };
+	bool isSet() const { return index != UINT32_MAX; }
+};
+
+/** @brief Distance attenuation and voice limit of a sound */
+struct SoundProperties {
+	// Distance from the listener up to which positional sounds play at full volume
+	float minDistance{ 1.0f };
+	// How fast the volume falls off beyond minDistance, see sf::SoundSource::setAttenuation
+	float attenuation{ 1.0f };
+	// Voices of the sound that are mixed at once, further requests take over the least audible of them or become virtual
+	uint32_t maxVoices{ UINT32_MAX };
+};
+
+/**
+ * Plays sounds on a fixed number of voices from an audio worker thread
+ * Playback requests are queued from the game thread without allocating, the worker assigns them to free voices or steals the voice of the least important sound (lowest priority, then least audible, then oldest)
+ * Sounds that can't be heard (attenuated below inaudibleVolume by their distance to the listener) or don't get a voice become virtual: they only keep track of their playback time, and take a voice again at that offset once they're audible and one is available
+ * So no more than maxVoices sounds are mixed regardless of how many are requested, requests are only dropped if they don't fit into the queue or all virtual voices are in use
+ * Music is streamed from its file instead (sf::Music decodes chunks ahead of playback on its own thread), so long tracks are never fully decoded into memory
+ * Sound files can be decoded on the job system, their handles are valid right away and requests for them are ignored until they have been decoded
+ * @note Only mono sounds are positioned, OpenAL plays stereo sounds without attenuation
+ */
 class AudioManager {
+public:
+	static constexpr uint32_t maxVoices{ 16 };
+	static constexpr uint32_t maxVirtualVoices{ 64 };
+	static constexpr uint32_t maxQueuedRequests{ 64 };
+	// Volume in [0..1] after attenuation below which sounds are culled
+	static constexpr float inaudibleVolume{ 0.01f };
+	// Interval in which voices are culled or restored while virtual or positional voices exist
+	static constexpr std::chrono::milliseconds updateInterval{ 50 };
+
 private:
-	sf::Sound sound;
+	struct PlaybackRequest {
+		SoundHandle sound;
+		int32_t priority;
+		float volume;
+		bool positional;
+		glm::vec3 position;
+		// Copied when the request is queued, so the worker never reads the sound list without the lock
+		SoundProperties properties;
+	};
+	struct Voice {
+		sf::Sound sound;
+		PlaybackRequest request{};
+		// Order in which sounds were requested, used to steal the oldest voice
+		uint64_t startIndex{ 0 };
+	};
+	struct VirtualVoice {
+		PlaybackRequest request;
+		// Time the sound would have started at if it had been playing all along
+		std::chrono::steady_clock::time_point startTime;
+		uint64_t startIndex;
+	};
+	struct Listener {
+		glm::vec3 position{ 0.0f };
+		glm::vec3 direction{ 0.0f, 0.0f, -1.0f };
+		glm::vec3 up{ 0.0f, 1.0f, 0.0f };
+	};
+	// Null while a sound is being decoded (or if it couldn't be loaded)
+	std::vector<sf::SoundBuffer*> soundBuffers;
+	std::vector<SoundProperties> soundProperties;
+	// Decoding jobs of loadSoundFileAsync, only accessed from the thread that loads the sounds
+	std::vector<vks::Job*> loadJobs;
+	std::atomic<uint32_t> pendingLoads{ 0 };
+	static sf::SoundBuffer* decodeSoundFile(const std::string& filename);
+	// Name lookup, only meant for setup, playback uses the handles
+	std::unordered_map<std::string, SoundHandle> soundNames;
+	// Only accessed by the worker
+	std::array<Voice, maxVoices> voices;
+	std::array<VirtualVoice, maxVirtualVoices> virtualVoices;
+	uint32_t virtualVoiceCount{ 0 };
+	uint64_t startedVoices{ 0 };
+	Listener activeListener;
+	// Voices need to be checked in intervals, as the listener may move
+	bool voicesNeedUpdates{ false };
+	std::atomic<uint32_t> virtualVoicesInUse{ 0 };
+	// Set from the game thread, guarded by the mutex
+	Listener listener;
+	bool listenerChanged{ false };
+	// Ring buffer of pending requests, guarded by the mutex
+	std::array<PlaybackRequest, maxQueuedRequests> requests;
+	uint32_t requestHead{ 0 };
+	uint32_t requestCount{ 0 };
+	std::atomic<uint32_t> droppedRequests{ 0 };
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool stopping{ false };
+	// Music track to switch to, opened by the worker so the game thread doesn't wait for the file's headers to be parsed
+	struct MusicRequest {
+		std::string filename;
+		float volume{ 100.0f };
+		bool loop{ true };
+	} musicRequest;
+	bool musicRequested{ false };
+	// Only accessed by the worker
+	// The music is streamed from the file's mapping, which is declared first so it outlives the stream
+	std::shared_ptr<vks::MappedFile> musicFile;
+	sf::Music music;
+	std::thread worker;
+
+	void process();
+	void start(const PlaybackRequest& request);
+	float getAudibility(const PlaybackRequest& request) const;
+	// Free voice or voice to steal for a request, if strict only voices less important than the request itself are stolen (so restored voices don't take turns)
+	Voice* findVoice(const PlaybackRequest& request, float audibility, bool strict);
+	void play(Voice& voice, const PlaybackRequest& request, std::chrono::steady_clock::time_point startTime, uint64_t startIndex);
+	void virtualize(const PlaybackRequest& request, std::chrono::steady_clock::time_point startTime, uint64_t startIndex);
+	void updateVoices();
+	void applyListener();
+	void startMusic(const MusicRequest& request);
 public:
-	std::unordered_map<std::string, sf::SoundBuffer*> soundBuffers;
-	void AddSoundFile(const std::string name, const std::string filename);
-	// Named like this to avoud a WinApi macro (PlaySoundA)
-	void PlaySnd(const std::string name);
-};
\ No newline at end of file
+	// Used to decode sounds loaded with loadSoundFileAsync, if not set these are decoded on the calling thread
+	vks::JobSystem* jobSystem{ nullptr };
+	AudioManager();
+	~AudioManager();
+	/** @brief Loads and decodes a sound file on the calling thread */
+	SoundHandle AddSoundFile(const std::string name, const std::string filename);
+	/**
+	* Decodes a sound file in the background on the job system, the sound becomes playable once it's finished
+	*
+	* @return Handle of the sound, which can be looked up and passed to PlaySnd right away
+	*/
+	SoundHandle loadSoundFileAsync(const std::string name, const std::string filename);
+	// True while any sound is still being decoded
+	bool hasPendingLoads() const;
+	/** @brief Waits until all sounds have been decoded */
+	void waitIdle();
+	// Returns an unset handle if there is no sound with that name
+	SoundHandle findSound(const std::string& name) const;
+	/** @brief Sets the attenuation and voice limit of a sound, applies to requests queued afterwards */
+	void setSoundProperties(SoundHandle sound, const SoundProperties& properties);
+	/** @brief Sets the position and orientation positional sounds are heard from, usually the camera's once per frame */
+	void setListener(const glm::vec3& position, const glm::vec3& direction, const glm::vec3& up);
+	/**
+	* Queues a sound for playback on the audio worker, can be called from any thread
+	* Named like this to avoud a WinApi macro (PlaySoundA)
+	*
+	* @param sound Sound to play, unset handles are ignored
+	* @param priority Sounds with a higher priority steal the voices of lower (or equal) priority sounds if all voices are busy
+	* @param volume Volume in the range of [0..100]
+	*/
+	void PlaySnd(SoundHandle sound, int32_t priority = 0, float volume = 100.0f);
+	/** @brief Queues a sound played at a position, attenuated by its distance to the listener and culled if it can't be heard */
+	void PlaySnd(SoundHandle sound, const glm::vec3& position, int32_t priority = 0, float volume = 100.0f);
+	/**
+	* Streams a music track, replacing the one currently playing, can be called from any thread
+	*
+	* @param filename Music file, an empty name stops the music
+	* @param volume Volume in the range of [0..100]
+	* @param loop Restart the track once it ended
+	*/
+	void playMusic(const std::string& filename, float volume = 100.0f, bool loop = true);
+	void stopMusic();
+	// Number of requests dropped since the start, as the queue or all virtual voices were full
+	uint32_t getDroppedRequests() const;
+	// Sounds that are currently culled or waiting for a voice
+	uint32_t getVirtualVoiceCount() const;
+};
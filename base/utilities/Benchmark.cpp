@@ -0,0 +1,164 @@
+/*
+ * Deterministic benchmark runs with per-frame timings
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "Benchmark.h"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <cmath>
+
+void Benchmark::addFrame(const BenchmarkFrame& frame)
+{
+	if (!ready || isFinished()) {
+		return;
+	}
+	if (!isWarmingUp()) {
+		frames.push_back(frame);
+	}
+	frameIndex++;
+}
+
+bool Benchmark::isWarmingUp() const
+{
+	return frameIndex < warmupFrames;
+}
+
+bool Benchmark::isFinished() const
+{
+	return frameIndex >= warmupFrames + frameCount;
+}
+
+float Benchmark::getTime() const
+{
+	return static_cast<float>(frameIndex) * timeStep;
+}
+
+float Benchmark::getProgress() const
+{
+	return static_cast<float>(frames.size()) / static_cast<float>(frameCount);
+}
+
+struct BenchmarkSummary {
+	float min{ 0.0f };
+	float max{ 0.0f };
+	float mean{ 0.0f };
+	float p50{ 0.0f };
+	float p95{ 0.0f };
+	float p99{ 0.0f };
+};
+
+// Nearest rank percentiles
+static BenchmarkSummary summarize(std::vector<float> values)
+{
+	BenchmarkSummary summary{};
+	if (values.empty()) {
+		return summary;
+	}
+	std::sort(values.begin(), values.end());
+	auto percentile = [&values](float p) {
+		const size_t rank = static_cast<size_t>(std::ceil(p * static_cast<float>(values.size())));
+		return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+	};
+	summary.min = values.front();
+	summary.max = values.back();
+	summary.mean = std::accumulate(values.begin(), values.end(), 0.0f) / static_cast<float>(values.size());
+	summary.p50 = percentile(0.50f);
+	summary.p95 = percentile(0.95f);
+	summary.p99 = percentile(0.99f);
+	return summary;
+}
+
+static void writeSummary(std::ofstream& file, const std::string& name, const BenchmarkSummary& summary, bool last)
+{
+	file << "\t\t\"" << name << "\": { "
+		<< "\"min\": " << summary.min << ", "
+		<< "\"max\": " << summary.max << ", "
+		<< "\"mean\": " << summary.mean << ", "
+		<< "\"p50\": " << summary.p50 << ", "
+		<< "\"p95\": " << summary.p95 << ", "
+		<< "\"p99\": " << summary.p99 << " }" << (last ? "\n" : ",\n");
+}
+
+bool Benchmark::saveResults(const std::string& deviceName) const
+{
+	std::ofstream csv(outputFile + ".csv");
+	if (!csv.is_open()) {
+		std::cerr << "Could not write benchmark results to " << outputFile << ".csv\n";
+		return false;
+	}
+	csv << "frame,frame_ms,cpu_ms,gpu_ms,fence_wait_ms,acquire_wait_ms,pacing_wait_ms,simulation_ms,culling_ms,recording_ms,submit_ms,present_ms,bound,draw_calls,instances,triangles,dispatches,pipeline_binds,descriptor_set_binds,push_constant_updates,buffer_binds,vertex_invocations,fragment_invocations,compute_invocations\n";
+	for (size_t i = 0; i < frames.size(); i++) {
+		const BenchmarkFrame& frame = frames[i];
+		csv << i << "," << frame.frameTime << "," << frame.cpuTime << "," << frame.gpuTime << ","
+			<< frame.breakdown.fenceWait << "," << frame.breakdown.acquireWait << "," << frame.breakdown.pacingWait << "," << frame.breakdown.simulation << ","
+			<< frame.breakdown.culling << "," << frame.breakdown.recording << "," << frame.breakdown.submit << "," << frame.breakdown.present << "," << getFrameBoundName(frame.bound) << ","
+			<< frame.stats.drawCalls << "," << frame.stats.instances << "," << frame.stats.triangles << "," << frame.stats.dispatches << ","
+			<< frame.stats.pipelineBinds << "," << frame.stats.descriptorSetBinds << "," << frame.stats.pushConstantUpdates << "," << frame.stats.bufferBinds << ","
+			<< frame.pipelineStatistics.vertexShaderInvocations << "," << frame.pipelineStatistics.fragmentShaderInvocations << "," << frame.pipelineStatistics.computeShaderInvocations << "\n";
+	}
+
+	auto summarizeFrames = [this](auto getValue) {
+		std::vector<float> values(frames.size());
+		std::transform(frames.begin(), frames.end(), values.begin(), [&getValue](const BenchmarkFrame& frame) { return static_cast<float>(getValue(frame)); });
+		return summarize(values);
+	};
+	const BenchmarkSummary frameSummary = summarizeFrames([](const BenchmarkFrame& frame) { return frame.frameTime; });
+
+	std::ofstream json(outputFile + ".json");
+	if (!json.is_open()) {
+		std::cerr << "Could not write benchmark results to " << outputFile << ".json\n";
+		return false;
+	}
+	json << "{\n";
+	json << "\t\"device\": \"" << deviceName << "\",\n";
+	json << "\t\"seed\": " << seed << ",\n";
+	json << "\t\"warmupFrames\": " << warmupFrames << ",\n";
+	json << "\t\"frames\": " << frames.size() << ",\n";
+	json << "\t\"averageFps\": " << (frameSummary.mean > 0.0f ? 1000.0f / frameSummary.mean : 0.0f) << ",\n";
+	json << "\t\"timings\": {\n";
+	writeSummary(json, "frame_ms", frameSummary, false);
+	writeSummary(json, "cpu_ms", summarizeFrames([](const BenchmarkFrame& frame) { return frame.cpuTime; }), false);
+	writeSummary(json, "gpu_ms", summarizeFrames([](const BenchmarkFrame& frame) { return frame.gpuTime; }), false);
+	writeSummary(json, "fence_wait_ms", summarizeFrames([](const BenchmarkFrame& frame) { return frame.breakdown.fenceWait; }), false);
+	writeSummary(json, "acquire_wait_ms", summarizeFrames([](const BenchmarkFrame& frame) { return frame.breakdown.acquireWait; }), false);
+	writeSummary(json, "pacing_wait_ms", summarizeFrames([](const BenchmarkFrame& frame) { return frame.breakdown.pacingWait; }), false);
+	writeSummary(json, "simulation_ms", summarizeFrames([](const BenchmarkFrame& frame) { return frame.breakdown.simulation; }), false);
+	writeSummary(json, "culling_ms", summarizeFrames([](const BenchmarkFrame& frame) { return frame.breakdown.culling; }), false);
+	writeSummary(json, "recording_ms", summarizeFrames([](const BenchmarkFrame& frame) { return frame.breakdown.recording; }), false);
+	writeSummary(json, "submit_ms", summarizeFrames([](const BenchmarkFrame& frame) { return frame.breakdown.submit; }), false);
+	writeSummary(json, "present_ms", summarizeFrames([](const BenchmarkFrame& frame) { return frame.breakdown.present; }), true);
+	json << "\t},\n";
+	// Fraction of the frames limited by each, to tell which knob to turn without going through the per-frame timings
+	std::array<uint32_t, 4> boundFrames{};
+	for (const BenchmarkFrame& frame : frames) {
+		boundFrames[static_cast<uint32_t>(frame.bound)]++;
+	}
+	json << "\t\"bound\": {\n";
+	for (uint32_t i = 0; i < boundFrames.size(); i++) {
+		const float fraction = frames.empty() ? 0.0f : static_cast<float>(boundFrames[i]) / static_cast<float>(frames.size());
+		json << "\t\t\"" << getFrameBoundName(static_cast<FrameBound>(i)) << "\": " << fraction << ((i + 1 < boundFrames.size()) ? ",\n" : "\n");
+	}
+	json << "\t},\n";
+	json << "\t\"stats\": {\n";
+	writeSummary(json, "draw_calls", summarizeFrames([](const BenchmarkFrame& frame) { return frame.stats.drawCalls; }), false);
+	writeSummary(json, "instances", summarizeFrames([](const BenchmarkFrame& frame) { return frame.stats.instances; }), false);
+	writeSummary(json, "triangles", summarizeFrames([](const BenchmarkFrame& frame) { return frame.stats.triangles; }), false);
+	writeSummary(json, "pipeline_binds", summarizeFrames([](const BenchmarkFrame& frame) { return frame.stats.pipelineBinds; }), false);
+	writeSummary(json, "descriptor_set_binds", summarizeFrames([](const BenchmarkFrame& frame) { return frame.stats.descriptorSetBinds; }), false);
+	writeSummary(json, "push_constant_updates", summarizeFrames([](const BenchmarkFrame& frame) { return frame.stats.pushConstantUpdates; }), false);
+	writeSummary(json, "vertex_invocations", summarizeFrames([](const BenchmarkFrame& frame) { return frame.pipelineStatistics.vertexShaderInvocations; }), false);
+	writeSummary(json, "fragment_invocations", summarizeFrames([](const BenchmarkFrame& frame) { return frame.pipelineStatistics.fragmentShaderInvocations; }), true);
+	json << "\t}\n";
+	json << "}\n";
+
+	std::cout << "Benchmark results written to " << outputFile << ".csv and " << outputFile << ".json\n";
+	std::cout << "Frame time p50/p95/p99: " << frameSummary.p50 << " / " << frameSummary.p95 << " / " << frameSummary.p99 << " ms\n";
+	return true;
+}
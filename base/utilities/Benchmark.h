@@ -0,0 +1,69 @@
+/*
+ * Deterministic benchmark runs with per-frame timings
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "RenderStats.hpp"
+#include "FrameBreakdown.hpp"
+
+/** @brief Timings of a single benchmark frame in milliseconds and the work it recorded */
+struct BenchmarkFrame {
+	// Duration of the whole frame, including waiting for the GPU
+	float frameTime{ 0.0f };
+	// Time the CPU spent on the frame, without waiting for the GPU
+	float cpuTime{ 0.0f };
+	// Time between the start of the first and the end of the last profiled scope of a frame on the GPU
+	float gpuTime{ 0.0f };
+	FrameBreakdown breakdown;
+	FrameBound bound{ FrameBound::Unknown };
+	RenderStats stats;
+	// Lags behind like the GPU time, all zero if the device doesn't support pipeline statistics queries
+	PipelineStatistics pipelineStatistics;
+};
+
+/**
+ * Records the timings of a fixed number of frames after a warm-up and writes them to CSV and JSON files
+ * Applications drive the scene from getTime() and use the fixed time step and seed, so every run renders the same frames
+ */
+class Benchmark {
+private:
+	std::vector<BenchmarkFrame> frames;
+	// Frames since the benchmark became ready, including warm-up
+	uint32_t frameIndex{ 0 };
+public:
+	bool active{ false };
+	// Frames aren't counted (and the scripted time doesn't advance) while not ready, e.g. while assets are still loading
+	bool ready{ true };
+	uint32_t warmupFrames{ 120 };
+	uint32_t frameCount{ 1000 };
+	uint32_t seed{ 1 };
+	// Replaces the measured frame time for animations and simulation
+	float timeStep{ 1.0f / 60.0f };
+	// Results are written to this file name with .csv and .json extensions
+	std::string outputFile{ "benchmark" };
+
+	/** @brief Records a frame, frames during warm-up only advance the scripted time */
+	void addFrame(const BenchmarkFrame& frame);
+	bool isWarmingUp() const;
+	bool isFinished() const;
+	// Scripted time in seconds, advances by timeStep with each counted frame
+	float getTime() const;
+	// Fraction of the frames to record that have been recorded
+	float getProgress() const;
+	/**
+	* Writes the per-frame timings to outputFile.csv and a summary with percentiles to outputFile.json
+	*
+	* @param deviceName Name of the device the benchmark ran on, stored in the summary
+	*
+	* @return False if one of the files couldn't be written
+	*/
+	bool saveResults(const std::string& deviceName) const;
+};
@@ -12,6 +12,7 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <SFML/Window/Keyboard.hpp>
+#include <bitset>
 
 class Camera
 {
@@ -24,6 +25,10 @@ private:
 		return glm::mat4_cast(rotation);
 	}
 
+	inline bool isKeyPressed(sf::Keyboard::Key key) {
+		return (key >= 0) && keyStates.test(key);
+	}
+
 	inline glm::mat4 translationMatrix() {
 		return glm::translate(glm::mat4(1.0f), -position);
 	}
@@ -91,6 +96,13 @@ public:
 	glm::vec3 targetAngularVelocity;
 
 	bool flipY = false;
+	// Builds a reverse Z projection with an infinite far plane, needs to be set before the perspective and matched by the depth compare and clear value
+	bool reverseDepth = false;
+	// Subpixel offset in NDC applied by getJitteredPerspective, e.g. for temporal anti-aliasing
+	glm::vec2 jitter = glm::vec2(0.0f);
+	// Quarter turns the presented image is rotated by (see SwapChain::getQuarterTurns), the projection renders the view rotated the other way so it's shown upright
+	// Needs to be set before the aspect ratio, which is still passed for the rendered, unrotated image
+	uint32_t preRotation = 0;
 
 	struct
 	{
@@ -122,6 +134,9 @@ public:
 		glm::vec2 dragCursorPos;
 	} mouse{};
 
+	// Keys held down during the current frame, set by the application instead of polled here so recorded input can be replayed
+	std::bitset<sf::Keyboard::KeyCount> keyStates;
+
 	bool moving()
 	{
 		return keys.left || keys.right || keys.up || keys.down;
@@ -131,29 +146,57 @@ public:
 		return znear;
 	}
 
+	// With reverseDepth the projection has no far plane, the value is still used as the range for distance based decisions
 	float getFarClip() {
 		return zfar;
 	}
 
+	// Vertical field of view in degrees
+	float getFov() {
+		return fov;
+	}
+
 	void setPerspective(float fov, float aspect, float znear, float zfar)
 	{
-		glm::mat4 currentMatrix = matrices.perspective;
 		this->fov = fov;
 		this->znear = znear;
 		this->zfar = zfar;
-		matrices.perspective = glm::perspective(glm::radians(fov), aspect, znear, zfar);
-		if (flipY) {
-			matrices.perspective[1][1] *= -1.0f;
-		}
+		updateAspectRatio(aspect);
 	};
 
 	void updateAspectRatio(float aspect)
 	{
-		glm::mat4 currentMatrix = matrices.perspective;
-		matrices.perspective = glm::perspective(glm::radians(fov), aspect, znear, zfar);
+		// The view is shown with the rendered image's sides swapped
+		if (preRotation % 2 == 1) {
+			aspect = 1.0f / aspect;
+		}
+		if (reverseDepth) {
+			// Maps the near plane to a depth of one and infinity to zero, which spreads the float depth precision evenly over distance
+			const float focalLength = 1.0f / tanf(glm::radians(fov) * 0.5f);
+			matrices.perspective = glm::mat4(0.0f);
+			matrices.perspective[0][0] = focalLength / aspect;
+			matrices.perspective[1][1] = focalLength;
+			matrices.perspective[2][3] = -1.0f;
+			matrices.perspective[3][2] = znear;
+		} else {
+			matrices.perspective = glm::perspective(glm::radians(fov), aspect, znear, zfar);
+		}
 		if (flipY) {
 			matrices.perspective[1][1] *= -1.0f;
 		}
+		if (preRotation != 0) {
+			matrices.perspective = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f * static_cast<float>(preRotation)), glm::vec3(0.0f, 0.0f, 1.0f)) * matrices.perspective;
+		}
+	}
+
+	// Perspective with the image shifted by jitter, the unjittered matrix is still used for culling and reprojection
+	glm::mat4 getJitteredPerspective()
+	{
+		glm::mat4 result = matrices.perspective;
+		// Both projections have w = -z, so subtracting from the z column offsets the NDC by the jitter
+		result[2][0] -= jitter.x;
+		result[2][1] -= jitter.y;
+		return result;
 	}
 
 	void setPosition(glm::vec3 position)
@@ -214,37 +257,37 @@ public:
 			//glm::vec3 camSide = glm::cross(camFront, camUp);
 
 			float moveSpeed = deltaTime * movementSpeed * 10.0f;
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::LShift)) {
+			if (isKeyPressed(sf::Keyboard::LShift)) {
 				moveSpeed *= 2.5f;
 			}
 
 			acceleration = angularAcceleration = targetAngularVelocity = glm::vec3(0.0f);
 
 			if (physicsBased) {
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) {
+				if (isKeyPressed(sf::Keyboard::W)) {
 					acceleration = camForward * moveSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) {
+				if (isKeyPressed(sf::Keyboard::S)) {
 					acceleration = camForward * -moveSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::A)) {
+				if (isKeyPressed(sf::Keyboard::A)) {
 					acceleration = camRight * -moveSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::D)) {
+				if (isKeyPressed(sf::Keyboard::D)) {
 					acceleration = camRight * moveSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space)) {
+				if (isKeyPressed(sf::Keyboard::Space)) {
 					acceleration = camUp * -moveSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl)) {
+				if (isKeyPressed(sf::Keyboard::LControl)) {
 					acceleration = camUp * moveSpeed;
 				}
 
 				float rollSpeed = rotationSpeed * deltaTime * 0.5f;
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::Q)) {
+				if (isKeyPressed(sf::Keyboard::Q)) {
 					angularAcceleration.z = -rollSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::E)) {
+				if (isKeyPressed(sf::Keyboard::E)) {
 					angularAcceleration.z = rollSpeed;
 				}
 
@@ -322,30 +365,30 @@ public:
 			else {
 				float movementSpeed = moveSpeed * deltaTime * 300.0f;
 
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) {
+				if (isKeyPressed(sf::Keyboard::W)) {
 					position += camForward * movementSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) {
+				if (isKeyPressed(sf::Keyboard::S)) {
 					position += camForward * -movementSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::A)) {
+				if (isKeyPressed(sf::Keyboard::A)) {
 					position += camRight * -movementSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::D)) {
+				if (isKeyPressed(sf::Keyboard::D)) {
 					position += camRight * movementSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::LShift)) {
+				if (isKeyPressed(sf::Keyboard::LShift)) {
 					position += camUp * -movementSpeed;
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl)) {
+				if (isKeyPressed(sf::Keyboard::LControl)) {
 					position += camUp * movementSpeed;
 				}
 
 				float rollSpeed = rotationSpeed * deltaTime * 0.5f;
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::Q)) {
+				if (isKeyPressed(sf::Keyboard::Q)) {
 					rotation *= glm::angleAxis(-rollSpeed, camForward);
 				}
-				if (sf::Keyboard::isKeyPressed(sf::Keyboard::E)) {
+				if (isKeyPressed(sf::Keyboard::E)) {
 					rotation *= glm::angleAxis(rollSpeed, camForward);
 				}
 
@@ -0,0 +1,77 @@
+/*
+ * Render scale controller for dynamic resolution
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+struct DynamicResolutionCreateInfo {
+	// GPU time per frame the scale is adjusted to hold, in milliseconds
+	float targetFrameTime{ 1000.0f / 60.0f };
+	float minScale{ 0.5f };
+	float maxScale{ 1.0f };
+};
+
+/**
+ * Adjusts the scale of the render resolution from measured GPU frame times, so the frame time stays close to a target
+ * GPU time is assumed to scale with the number of pixels rendered, so measured times are converted to the cost of a frame at full scale, which the scale is derived from
+ * That cost is smoothed and small scale changes are ignored, as timings lag behind by the frames in flight and a constantly changing resolution is visible
+ */
+class DynamicResolution {
+private:
+	float scale{ 1.0f };
+	// Estimated GPU time of a frame rendered at a scale of one
+	float fullScaleFrameTime{ 0.0f };
+public:
+	float targetFrameTime;
+	float minScale;
+	float maxScale;
+	// Weight of a new frame time in the estimate
+	float smoothing{ 0.1f };
+	// Scale changes below this are ignored
+	float threshold{ 0.02f };
+
+	DynamicResolution(DynamicResolutionCreateInfo createInfo) : targetFrameTime(createInfo.targetFrameTime), minScale(createInfo.minScale), maxScale(createInfo.maxScale)
+	{
+		scale = maxScale;
+	}
+
+	/** @brief Feeds the GPU time of the last completed frame, times of zero (e.g. no timestamp support) are ignored */
+	void update(float gpuFrameTime)
+	{
+		if (gpuFrameTime <= 0.0f) {
+			return;
+		}
+		const float frameTime = gpuFrameTime / (scale * scale);
+		fullScaleFrameTime = (fullScaleFrameTime > 0.0f) ? std::lerp(fullScaleFrameTime, frameTime, smoothing) : frameTime;
+		const float desiredScale = std::clamp(std::sqrt(targetFrameTime / fullScaleFrameTime), minScale, maxScale);
+		// The limits are always reached, even if closer than the threshold
+		if ((std::abs(desiredScale - scale) >= threshold) || (desiredScale == minScale) || (desiredScale == maxScale)) {
+			scale = desiredScale;
+		}
+	}
+
+	void reset()
+	{
+		scale = maxScale;
+		fullScaleFrameTime = 0.0f;
+	}
+
+	float getScale() const
+	{
+		return scale;
+	}
+
+	// Scaled size of an extent, never zero
+	uint32_t getScaledSize(uint32_t size) const
+	{
+		return std::max(static_cast<uint32_t>(static_cast<float>(size) * scale), 1u);
+	}
+};
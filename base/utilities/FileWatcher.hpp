@@ -10,70 +10,370 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
 #include <unordered_map>
 #include <filesystem>
 #include <iostream>
 #include <functional>
 #include "Pipeline.hpp"
+#include "ThreadConfig.hpp"
+#include "ProfiledMutex.hpp"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#define FILEWATCHER_WIN32
+#elif defined(__linux__) && !defined(__ANDROID__)
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#define FILEWATCHER_INOTIFY
+#endif
 
 struct FileWatchInfo {
-    std::filesystem::file_time_type filetime;
-    std::vector<void*> owners{};
+	// Name the file has been registered with, passed to onFileChanged
+	std::string filename;
+	std::filesystem::file_time_type filetime;
+	std::vector<void*> owners{};
+	// Set by change events, the file is reported once no further events arrived within the debounce interval
+	bool pending{ false };
+	std::chrono::steady_clock::time_point lastEvent{};
 };
 
+/**
+ * Watches the directories of registered files for changes and notifies the owners of changed files from a background thread
+ * Uses inotify on Linux and ReadDirectoryChangesW on Windows, so the thread only wakes up for changes, other platforms poll the files
+ * Editors often save in bursts (truncate, write, rename), so changes are only reported once a file has been quiet for the debounce interval, and only if its write time changed
+ * Files can be added from any thread, also while the watcher is running
+ */
 class FileWatcher {
 private:
-    std::thread thread;
-    std::unordered_map<std::string, FileWatchInfo> files{};
-	std::chrono::duration<int, std::milli> interval{ 1000 };
-	bool active = true;
-
-    void watch() {
-        while (active) {
-            std::this_thread::sleep_for(interval);
-
-            // Check if files have been modified
-            for (auto& file : files) {
-                auto current_file_last_write_time = std::filesystem::last_write_time(file.first);
-                if (file.second.filetime != current_file_last_write_time) {
-                    files[file.first].filetime = current_file_last_write_time;
-                    onFileChanged(file.first, file.second.owners);
-                }
-            }
-        }
-    }
+	std::thread thread;
+	vks::ProfiledMutex mutex{ "File watcher" };
+	// Keyed by the normalized absolute path, as change events report names relative to the watched directory
+	std::unordered_map<std::string, FileWatchInfo> files{};
+	std::atomic<bool> active{ false };
+#if defined(FILEWATCHER_INOTIFY)
+	int inotifyFd{ -1 };
+	// Wakes up the watch thread when stopping
+	int wakeFd{ -1 };
+	std::unordered_map<int, std::filesystem::path> watchDescriptors{};
+	std::unordered_map<std::string, int> directories{};
+#elif defined(FILEWATCHER_WIN32)
+	struct WatchedDirectory {
+		std::filesystem::path path;
+		HANDLE handle{ INVALID_HANDLE_VALUE };
+		OVERLAPPED overlapped{};
+		bool reading{ false };
+		alignas(DWORD) uint8_t buffer[16 * 1024];
+	};
+	// Completions of all directory reads are queued here, a completion without overlapped structure wakes up the thread
+	HANDLE completionPort{ nullptr };
+	std::unordered_map<std::string, std::unique_ptr<WatchedDirectory>> directories{};
+#endif
+
+	static std::string normalize(const std::filesystem::path& path) {
+		return std::filesystem::absolute(path).lexically_normal().string();
+	}
+
+	// Needs to be called with the mutex locked
+	void markChanged(const std::string& path, std::chrono::steady_clock::time_point now) {
+		auto it = files.find(path);
+		if (it != files.end()) {
+			it->second.pending = true;
+			it->second.lastEvent = now;
+		}
+	}
+
+	// Needs to be called with the mutex locked
+	void markDirectoryChanged(const std::filesystem::path& directory, std::chrono::steady_clock::time_point now) {
+		for (auto& [path, info] : files) {
+			if (std::filesystem::path(path).parent_path() == directory) {
+				info.pending = true;
+				info.lastEvent = now;
+			}
+		}
+	}
+
+	// Needs to be called with the mutex locked
+	void addDirectory(const std::filesystem::path& directory) {
+		const std::string key = directory.string();
+		if (directories.find(key) != directories.end()) {
+			return;
+		}
+#if defined(FILEWATCHER_INOTIFY)
+		// Saving via rename shows up as a move into the directory, touching a file only changes its attributes
+		const int wd = inotify_add_watch(inotifyFd, key.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ATTRIB);
+		if (wd < 0) {
+			std::cerr << "Could not watch directory " << key << " for changes\n";
+			return;
+		}
+		directories[key] = wd;
+		watchDescriptors[wd] = directory;
+#elif defined(FILEWATCHER_WIN32)
+		auto watched = std::make_unique<WatchedDirectory>();
+		watched->path = directory;
+		watched->handle = CreateFileW(directory.wstring().c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if ((watched->handle == INVALID_HANDLE_VALUE) || !CreateIoCompletionPort(watched->handle, completionPort, 0, 0)) {
+			std::cerr << "Could not watch directory " << key << " for changes\n";
+			if (watched->handle != INVALID_HANDLE_VALUE) {
+				CloseHandle(watched->handle);
+			}
+			return;
+		}
+		directories[key] = std::move(watched);
+		// Reads are issued by the watch thread, as outstanding I/O may be cancelled when the issuing thread exits
+		PostQueuedCompletionStatus(completionPort, 0, 0, nullptr);
+#endif
+	}
+
+#if defined(FILEWATCHER_WIN32)
+	// Needs to be called with the mutex locked
+	void readDirectoryChanges(WatchedDirectory& directory) {
+		directory.overlapped = {};
+		directory.reading = ReadDirectoryChangesW(directory.handle, directory.buffer, sizeof(directory.buffer), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE, nullptr, &directory.overlapped, nullptr);
+	}
+#endif
+
+	// Blocks until change events arrive or the timeout elapses and marks the changed files, a negative timeout waits indefinitely
+	void waitForEvents(int timeoutMs) {
+#if defined(FILEWATCHER_INOTIFY)
+		pollfd fds[2] = { { .fd = inotifyFd, .events = POLLIN }, { .fd = wakeFd, .events = POLLIN } };
+		if (poll(fds, 2, timeoutMs) <= 0) {
+			return;
+		}
+		if (fds[1].revents & POLLIN) {
+			uint64_t value;
+			(void)read(wakeFd, &value, sizeof(value));
+		}
+		if ((fds[0].revents & POLLIN) == 0) {
+			return;
+		}
+		alignas(inotify_event) char buffer[16 * 1024];
+		const auto now = std::chrono::steady_clock::now();
+		std::lock_guard<vks::ProfiledMutex> lock(mutex);
+		ssize_t length;
+		while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+			for (char* ptr = buffer; ptr < buffer + length; ptr += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(ptr)->len) {
+				const inotify_event* event = reinterpret_cast<inotify_event*>(ptr);
+				// Events have been dropped, so the changes are unknown
+				if (event->mask & IN_Q_OVERFLOW) {
+					for (auto& [directory, wd] : directories) {
+						markDirectoryChanged(directory, now);
+					}
+					continue;
+				}
+				auto it = watchDescriptors.find(event->wd);
+				if ((it != watchDescriptors.end()) && (event->len > 0)) {
+					markChanged((it->second / event->name).string(), now);
+				}
+			}
+		}
+#elif defined(FILEWATCHER_WIN32)
+		{
+			std::lock_guard<vks::ProfiledMutex> lock(mutex);
+			for (auto& [key, directory] : directories) {
+				if (!directory->reading) {
+					readDirectoryChanges(*directory);
+				}
+			}
+		}
+		DWORD bytes{ 0 };
+		ULONG_PTR completionKey{ 0 };
+		OVERLAPPED* overlapped{ nullptr };
+		// Timeouts and wake ups don't dequeue a directory read
+		GetQueuedCompletionStatus(completionPort, &bytes, &completionKey, &overlapped, (timeoutMs < 0) ? INFINITE : static_cast<DWORD>(timeoutMs));
+		if (!overlapped) {
+			return;
+		}
+		const auto now = std::chrono::steady_clock::now();
+		std::lock_guard<vks::ProfiledMutex> lock(mutex);
+		for (auto& [key, directory] : directories) {
+			if (&directory->overlapped != overlapped) {
+				continue;
+			}
+			directory->reading = false;
+			if (bytes == 0) {
+				// The buffer overflowed, so the changes are unknown
+				markDirectoryChanged(directory->path, now);
+			} else {
+				const uint8_t* ptr = directory->buffer;
+				while (true) {
+					const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(ptr);
+					if ((info->Action == FILE_ACTION_MODIFIED) || (info->Action == FILE_ACTION_ADDED) || (info->Action == FILE_ACTION_RENAMED_NEW_NAME)) {
+						const std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+						markChanged((directory->path / name).string(), now);
+					}
+					if (info->NextEntryOffset == 0) {
+						break;
+					}
+					ptr += info->NextEntryOffset;
+				}
+			}
+			if (active) {
+				readDirectoryChanges(*directory);
+			}
+			break;
+		}
+#else
+		std::this_thread::sleep_for(std::chrono::milliseconds((timeoutMs < 0) ? pollInterval.count() : std::min<int>(timeoutMs, static_cast<int>(pollInterval.count()))));
+		// Without native change notifications, write times are compared against the last known ones
+		const auto now = std::chrono::steady_clock::now();
+		std::lock_guard<vks::ProfiledMutex> lock(mutex);
+		for (auto& [path, info] : files) {
+			std::error_code ec;
+			const auto filetime = std::filesystem::last_write_time(path, ec);
+			if (!ec && (filetime != info.filetime) && !info.pending) {
+				markChanged(path, now);
+			}
+		}
+#endif
+	}
+
+	void wake() {
+#if defined(FILEWATCHER_INOTIFY)
+		const uint64_t value = 1;
+		(void)write(wakeFd, &value, sizeof(value));
+#elif defined(FILEWATCHER_WIN32)
+		PostQueuedCompletionStatus(completionPort, 0, 0, nullptr);
+#endif
+	}
+
+	void watch() {
+		// Only waits for changes, so it must not compete with the main thread or the job system's workers
+		vks::threading::setCurrentThreadPriority(vks::threading::Priority::Background);
+		struct Change {
+			std::string filename;
+			std::vector<void*> owners;
+		};
+		std::vector<Change> changes;
+		while (active) {
+			// Only wakes up periodically while changes are waiting to settle
+			int timeoutMs = -1;
+			{
+				std::lock_guard<vks::ProfiledMutex> lock(mutex);
+				for (auto& [path, info] : files) {
+					if (info.pending) {
+						timeoutMs = static_cast<int>(debounceInterval.count());
+						break;
+					}
+				}
+			}
+			waitForEvents(timeoutMs);
+
+			changes.clear();
+			{
+				const auto now = std::chrono::steady_clock::now();
+				std::lock_guard<vks::ProfiledMutex> lock(mutex);
+				for (auto& [path, info] : files) {
+					if (!info.pending || (now - info.lastEvent < debounceInterval)) {
+						continue;
+					}
+					info.pending = false;
+					// Events are also raised for writes that don't change the file (e.g. saving without modifications)
+					std::error_code ec;
+					const auto filetime = std::filesystem::last_write_time(path, ec);
+					if (ec || (filetime == info.filetime)) {
+						continue;
+					}
+					info.filetime = filetime;
+					changes.push_back({ info.filename, info.owners });
+				}
+			}
+			// Called without holding the lock, so the callback can register files
+			for (const Change& change : changes) {
+				if (onFileChanged) {
+					onFileChanged(change.filename, change.owners);
+				}
+			}
+		}
+	}
 
 public:
-    std::function<void(const std::string, const std::vector<void*> owners)> onFileChanged;
+	std::function<void(const std::string, const std::vector<void*> owners)> onFileChanged;
+	// Time a file needs to go without further change events before it's reported
+	std::chrono::milliseconds debounceInterval{ 100 };
+	// Only used on platforms without native change notifications
+	std::chrono::milliseconds pollInterval{ 1000 };
+
+	FileWatcher() {
+#if defined(FILEWATCHER_INOTIFY)
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#elif defined(FILEWATCHER_WIN32)
+		completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+#endif
+	}
+
+	~FileWatcher() {
+		if (thread.joinable()) {
+			stop();
+		}
+#if defined(FILEWATCHER_INOTIFY)
+		close(inotifyFd);
+		close(wakeFd);
+#elif defined(FILEWATCHER_WIN32)
+		for (auto& [key, directory] : directories) {
+			// Outstanding reads write to the directory's buffer, so they need to be finished before it's freed
+			if (directory->reading) {
+				CancelIoEx(directory->handle, &directory->overlapped);
+				DWORD bytes;
+				GetOverlappedResult(directory->handle, &directory->overlapped, &bytes, TRUE);
+			}
+			CloseHandle(directory->handle);
+		}
+		CloseHandle(completionPort);
+#endif
+	}
 
 	void addFile(const std::string filename, void* owner) {
-        if (files.find(filename) == files.end()) {
-            files[filename] = FileWatchInfo{
-                .filetime = std::filesystem::last_write_time(filename),
-                .owners = { owner }
-            };
-        } else {
-            // If the file is already present, only attach userData to the list, so the owning object gets properly notified
-            files[filename].owners.push_back(owner);
-        }
+		const std::string path = normalize(filename);
+		std::lock_guard<vks::ProfiledMutex> lock(mutex);
+		auto it = files.find(path);
+		if (it == files.end()) {
+			std::error_code ec;
+			files[path] = FileWatchInfo{
+				.filename = filename,
+				.filetime = std::filesystem::last_write_time(path, ec),
+				.owners = { owner }
+			};
+			addDirectory(std::filesystem::path(path).parent_path());
+		} else {
+			// If the file is already present, only attach userData to the list, so the owning object gets properly notified
+			if (std::find(it->second.owners.begin(), it->second.owners.end(), owner) == it->second.owners.end()) {
+				it->second.owners.push_back(owner);
+			}
+		}
 	}
 
-    void addPipeline(Pipeline* pipeline) {
-        for (auto& filename : pipeline->initialCreateInfo->shaders) {
-            addFile(filename, pipeline);
-        }
-    }
+	// Also watches the files included by the pipeline's shaders, so a change to a shared include only reloads the pipelines using it
+	// Can be called again after the pipeline has been rebuilt to pick up added includes
+	void addPipeline(Pipeline* pipeline) {
+		for (auto& filename : pipeline->initialCreateInfo->shaders) {
+			addFile(filename, pipeline);
+			for (const std::string& dependency : dxcCompiler->getDependencies(filename)) {
+				addFile(dependency, pipeline);
+			}
+		}
+	}
 
 	void start() {
-        active = true;
-        thread = std::thread(&FileWatcher::watch, this);
+		active = true;
+		thread = std::thread(&FileWatcher::watch, this);
 	}
 
-    void stop() {
-        active = false;
-        thread.join();
-    }
+	void stop() {
+		active = false;
+		wake();
+		thread.join();
+	}
 
-};
\ No newline at end of file
+};
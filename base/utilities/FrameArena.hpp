@@ -0,0 +1,76 @@
+/*
+ * Per-frame linear allocator for transient CPU data
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <memory>
+#include <atomic>
+#include <span>
+#include <string>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include "VulkanTools.h"
+
+/**
+ * Fixed block of memory that a frame's transient CPU data (e.g. command buffer lists or job arguments) is carved from
+ * Allocating only bumps an atomic head, so it can be used from recording jobs, and the memory is allocated once at creation
+ * Allocations are never destructed, the arena only hands out trivially destructible types and all of them are released at once on reset
+ */
+class FrameArena {
+private:
+	std::unique_ptr<std::byte[]> memory;
+	size_t capacity{ 0 };
+	std::atomic<size_t> head{ 0 };
+	size_t peak{ 0 };
+public:
+	FrameArena(size_t capacity = 256 * 1024) : capacity(capacity) {
+		memory = std::make_unique<std::byte[]>(capacity);
+	}
+
+	/**
+	* Allocates value initialized storage for a number of elements
+	*
+	* @param count Number of elements
+	*
+	* @return Span covering the elements, only valid until the arena is reset
+	*/
+	template<typename T>
+	std::span<T> allocate(size_t count) {
+		static_assert(std::is_trivially_destructible_v<T>, "Frame arena allocations are never destructed");
+		const size_t size = sizeof(T) * count;
+		// Over-allocates by the alignment, so the block can be aligned without a compare-exchange loop
+		const size_t offset = head.fetch_add(size + alignof(T), std::memory_order_relaxed);
+		if (offset + size + alignof(T) > capacity) {
+			vks::tools::exitFatal("Frame arena is out of memory (" + std::to_string(capacity) + " bytes)", -1);
+		}
+		void* block = memory.get() + offset;
+		size_t space = size + alignof(T);
+		block = std::align(alignof(T), size, block, space);
+		T* elements = static_cast<T*>(block);
+		for (size_t i = 0; i < count; i++) {
+			new (&elements[i]) T{};
+		}
+		return { elements, count };
+	}
+
+	/** @brief Releases all allocations at once, must not be called while other threads allocate from the arena */
+	void reset() {
+		peak = std::max(peak, head.load(std::memory_order_relaxed));
+		head.store(0, std::memory_order_relaxed);
+	}
+
+	// Highest number of bytes allocated within one frame, including alignment padding
+	size_t getPeakUsage() const {
+		return peak;
+	}
+
+	size_t getCapacity() const {
+		return capacity;
+	}
+};
@@ -0,0 +1,139 @@
+/*
+ * Per-frame accounting of CPU work and waits, and what limits the frame rate
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/** @brief Where the time of a single frame went, all in milliseconds */
+struct FrameBreakdown {
+	// Waiting for the frame objects' previous frame to finish on the GPU (on the frame timeline semaphore, which serves as the frame's fence)
+	float fenceWait{ 0.0f };
+	// Blocking in vkAcquireNextImageKHR until a swap chain image is available
+	float acquireWait{ 0.0f };
+	// Sleeping in the frame limiter and (in low latency mode) waiting for the last frame to be presented
+	float pacingWait{ 0.0f };
+	// Stepping the simulation, animations and waiting for the pipelined simulation step
+	float simulation{ 0.0f };
+	// Frustum and occlusion culling of the actors on the CPU, including sorting and impostor selection
+	float culling{ 0.0f };
+	// Descriptor updates and recording the frame's command buffers
+	float recording{ 0.0f };
+	float submit{ 0.0f };
+	// vkQueuePresentKHR, which may block (e.g. with FIFO presentation) depending on the driver
+	float present{ 0.0f };
+
+	float getWaitTime() const
+	{
+		return fenceWait + acquireWait + pacingWait;
+	}
+};
+
+/** @brief What the frame rate is limited by */
+enum class FrameBound : uint32_t {
+	// Not enough frames yet
+	Unknown,
+	CPU,
+	GPU,
+	// Neither the CPU nor the GPU is busy for the whole frame, e.g. because of vsync or the frame limiter
+	Presentation
+};
+
+inline const char* getFrameBoundName(FrameBound bound)
+{
+	switch (bound) {
+	case FrameBound::CPU:
+		return "CPU";
+	case FrameBound::GPU:
+		return "GPU";
+	case FrameBound::Presentation:
+		return "Presentation";
+	default:
+		return "Unknown";
+	}
+}
+
+/**
+ * Classifies frames as CPU, GPU or presentation bound from their breakdown and GPU time
+ * Single frames are too noisy (and GPU times lag behind by the frames in flight), so the classification uses smoothed timings
+ * A processor is considered to limit the frame if it's busy for most of it, if both are, the one with more work limits
+ */
+class FrameBoundClassifier {
+private:
+	float frameTime{ 0.0f };
+	float cpuTime{ 0.0f };
+	float gpuTime{ 0.0f };
+	float fenceWait{ 0.0f };
+	uint32_t frameCount{ 0 };
+	FrameBound bound{ FrameBound::Unknown };
+public:
+	// Weight of a new frame in the smoothed timings
+	float smoothing{ 0.1f };
+	// Fraction of the frame time a processor needs to be busy for to be considered limiting
+	float busyThreshold{ 0.85f };
+	// Frames needed before frames are classified
+	uint32_t warmupFrames{ 8 };
+
+	/**
+	* Adds a frame and classifies it
+	*
+	* @param breakdown Waits and CPU work of the frame
+	* @param totalTime Duration of the whole frame in milliseconds
+	* @param workTime Duration of the frame without waits in milliseconds
+	* @param gpuFrameTime GPU time of the last completed frame in milliseconds, zero if unknown
+	*
+	* @return Classification of the frame
+	*/
+	FrameBound addFrame(const FrameBreakdown& breakdown, float totalTime, float workTime, float gpuFrameTime)
+	{
+		auto blend = [this](float& value, float newValue) {
+			value = (frameCount > 0) ? std::lerp(value, newValue, smoothing) : newValue;
+		};
+		blend(frameTime, totalTime);
+		blend(cpuTime, workTime);
+		blend(gpuTime, gpuFrameTime);
+		blend(fenceWait, breakdown.fenceWait);
+		frameCount++;
+		if ((frameCount < warmupFrames) || (frameTime <= 0.0f)) {
+			bound = FrameBound::Unknown;
+			return bound;
+		}
+		// Without GPU timings, the CPU waiting for the GPU to finish earlier frames is the only hint at the GPU's load
+		const float gpuBusy = (gpuTime > 0.0f) ? gpuTime : cpuTime + fenceWait;
+		const float busyTime = frameTime * busyThreshold;
+		if ((cpuTime < busyTime) && (gpuBusy < busyTime)) {
+			bound = FrameBound::Presentation;
+		} else {
+			bound = (gpuBusy >= cpuTime) ? FrameBound::GPU : FrameBound::CPU;
+		}
+		return bound;
+	}
+
+	FrameBound getBound() const
+	{
+		return bound;
+	}
+
+	// Smoothed timings the classification is based on, in milliseconds
+	float getFrameTime() const
+	{
+		return frameTime;
+	}
+
+	float getCpuTime() const
+	{
+		return cpuTime;
+	}
+
+	float getGpuTime() const
+	{
+		return gpuTime;
+	}
+};
@@ -0,0 +1,131 @@
+/*
+ * Frame rate limiter
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+/**
+ * Paces frames to a target frame rate instead of rendering as fast as possible, e.g. to save power with vsync disabled
+ * The thread sleeps on a high resolution timer until shortly before a frame is due and only spins for the remainder, as sleeps may overshoot by up to the scheduler's granularity
+ * Frames are due at a fixed cadence, a frame that starts late doesn't make the following ones start early
+ */
+class FrameLimiter {
+private:
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point nextFrame{};
+#if defined(_WIN32)
+	HANDLE timer{ nullptr };
+#endif
+
+	void sleepUntil(Clock::time_point deadline)
+	{
+		const auto duration = deadline - Clock::now();
+		if (duration <= Clock::duration::zero()) {
+			return;
+		}
+#if defined(_WIN32)
+		// Plain sleeps are rounded up to the timer resolution of the system, which is 15.6 ms by default
+		if (timer) {
+			LARGE_INTEGER dueTime{};
+			// Negative values are relative, in 100 ns units
+			dueTime.QuadPart = -static_cast<LONGLONG>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / 100);
+			if (SetWaitableTimerEx(timer, &dueTime, 0, nullptr, nullptr, nullptr, 0)) {
+				WaitForSingleObject(timer, INFINITE);
+				return;
+			}
+		}
+#endif
+		std::this_thread::sleep_until(deadline);
+	}
+
+public:
+	// Time before a frame is due that's spun instead of slept, in milliseconds
+	float spinTime{ 0.5f };
+
+	FrameLimiter()
+	{
+#if defined(_WIN32)
+		// High resolution timers need Windows 10 1803 or newer, older versions fall back to a regular waitable timer
+		timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (!timer) {
+			timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+		}
+#endif
+	}
+
+	~FrameLimiter()
+	{
+#if defined(_WIN32)
+		if (timer) {
+			CloseHandle(timer);
+		}
+#endif
+	}
+
+	FrameLimiter(const FrameLimiter&) = delete;
+	FrameLimiter& operator=(const FrameLimiter&) = delete;
+
+	/**
+	 * Blocks until the next frame is due, meant to be called once per frame after waiting for the frame's fence, so waits for the GPU aren't added to the frame time
+	 *
+	 * @param targetFrameRate Frames per second to limit to
+	 * @param gpuFrameTime Measured GPU time of a frame in milliseconds, frames taking longer on the GPU than the target are already paced by the fence and aren't delayed further
+	 * @return Time spent waiting in milliseconds
+	 */
+	double wait(float targetFrameRate, float gpuFrameTime = 0.0f)
+	{
+		const Clock::time_point start = Clock::now();
+		const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / std::max(targetFrameRate, 1.0f)));
+		if ((gpuFrameTime >= std::chrono::duration<float, std::milli>(interval).count()) || (start > nextFrame + interval)) {
+			// GPU bound, or too far behind (e.g. after a hitch or when the limiter has just been enabled) to catch up without a burst of frames
+			nextFrame = start + interval;
+			return 0.0;
+		}
+		if (start < nextFrame) {
+			sleepUntil(nextFrame - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float, std::milli>(spinTime)));
+			while (Clock::now() < nextFrame) {
+				std::this_thread::yield();
+			}
+		}
+		nextFrame += interval;
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	/**
+	 * Refresh rate of the display, e.g. to limit to the rate the display can show when vsync is disabled
+	 *
+	 * @param window Native window handle, the display the window is on is queried on Windows
+	 * @return Refresh rate in Hz, 60 if it can't be queried on this platform
+	 */
+	static float getDisplayRefreshRate([[maybe_unused]] void* window = nullptr)
+	{
+#if defined(_WIN32)
+		DEVMODEW mode{ .dmSize = sizeof(DEVMODEW) };
+		const wchar_t* deviceName{ nullptr };
+		MONITORINFOEXW monitorInfo{};
+		monitorInfo.cbSize = sizeof(MONITORINFOEXW);
+		if (window && GetMonitorInfoW(MonitorFromWindow(static_cast<HWND>(window), MONITOR_DEFAULTTOPRIMARY), &monitorInfo)) {
+			deviceName = monitorInfo.szDevice;
+		}
+		// Values of 0 and 1 stand for the hardware's default rate
+		if (EnumDisplaySettingsW(deviceName, ENUM_CURRENT_SETTINGS, &mode) && (mode.dmDisplayFrequency > 1)) {
+			return static_cast<float>(mode.dmDisplayFrequency);
+		}
+#endif
+		return 60.0f;
+	}
+};
@@ -0,0 +1,105 @@
+/*
+ * Frame time history with hitch detection
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "FrameTimeRecorder.h"
+#include <algorithm>
+#include <cstdio>
+#include "tracy/Tracy.hpp"
+
+FrameTimeRecorder::FrameTimeRecorder(uint32_t capacity)
+{
+	frameTimes.resize(capacity, 0.0f);
+	sortedFrameTimes.reserve(capacity);
+}
+
+float FrameTimeRecorder::calculateMedian()
+{
+	sortedFrameTimes.assign(frameTimes.begin(), frameTimes.begin() + count);
+	auto middle = sortedFrameTimes.begin() + sortedFrameTimes.size() / 2;
+	std::nth_element(sortedFrameTimes.begin(), middle, sortedFrameTimes.end());
+	return *middle;
+}
+
+void FrameTimeRecorder::addEvent(const std::string& name)
+{
+	events.push_back(name);
+}
+
+bool FrameTimeRecorder::hasEvents() const
+{
+	return !events.empty();
+}
+
+void FrameTimeRecorder::addFrame(float frameTime)
+{
+	frameNumber++;
+	// Compared against the median of the previous frames, so a hitch doesn't raise its own threshold
+	if (count > 0) {
+		median = calculateMedian();
+	}
+	if ((count >= minFrames) && (frameTime > hitchFactor * median)) {
+		FrameHitch hitch{ .frameNumber = frameNumber, .frameTime = frameTime, .medianFrameTime = median };
+		for (size_t i = 0; i < events.size(); i++) {
+			hitch.events += (i > 0 ? ", " : "") + events[i];
+		}
+		char message[96];
+		snprintf(message, sizeof(message), "Hitch: %.2f ms (%.1fx median)%s", frameTime, frameTime / median, hitch.events.empty() ? "" : " during ");
+		const std::string text = message + hitch.events;
+		TracyMessage(text.c_str(), text.size());
+		hitches.push_back(std::move(hitch));
+		if (hitches.size() > maxHitches) {
+			hitches.pop_front();
+		}
+		hitchCount++;
+	}
+	events.clear();
+
+	frameTimes[head] = frameTime;
+	head = (head + 1) % static_cast<uint32_t>(frameTimes.size());
+	count = std::min(count + 1, static_cast<uint32_t>(frameTimes.size()));
+}
+
+const std::vector<float>& FrameTimeRecorder::getFrameTimes() const
+{
+	return frameTimes;
+}
+
+uint32_t FrameTimeRecorder::getOffset() const
+{
+	return (count < frameTimes.size()) ? 0 : head;
+}
+
+uint32_t FrameTimeRecorder::getCount() const
+{
+	return count;
+}
+
+float FrameTimeRecorder::getMedian() const
+{
+	return median;
+}
+
+std::vector<float> FrameTimeRecorder::getHistogram(uint32_t bucketCount, float maxFrameTime) const
+{
+	std::vector<float> buckets(bucketCount, 0.0f);
+	for (uint32_t i = 0; i < count; i++) {
+		const uint32_t bucket = static_cast<uint32_t>(frameTimes[i] / maxFrameTime * static_cast<float>(bucketCount));
+		buckets[std::min(bucket, bucketCount - 1)] += 1.0f;
+	}
+	return buckets;
+}
+
+const std::deque<FrameHitch>& FrameTimeRecorder::getHitches() const
+{
+	return hitches;
+}
+
+uint64_t FrameTimeRecorder::getHitchCount() const
+{
+	return hitchCount;
+}
@@ -0,0 +1,73 @@
+/*
+ * Frame time history with hitch detection
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdint>
+
+/** @brief Frame that took considerably longer than the median of the recorded frames */
+struct FrameHitch {
+	uint64_t frameNumber{ 0 };
+	float frameTime{ 0.0f };
+	float medianFrameTime{ 0.0f };
+	// Events noted during the frame, separated by commas
+	std::string events;
+};
+
+/**
+ * Keeps the times of the last frames in a ring buffer and flags frames exceeding a multiple of their median
+ * Work that may cause a hitch (e.g. pipeline reloads or resizes) is noted as an event, events of a hitching frame are sent to Tracy as a message
+ * Not thread safe, events need to be added from the thread that records the frames
+ */
+class FrameTimeRecorder {
+private:
+	std::vector<float> frameTimes;
+	// Index the next frame time is written to
+	uint32_t head{ 0 };
+	uint32_t count{ 0 };
+	uint64_t frameNumber{ 0 };
+	uint64_t hitchCount{ 0 };
+	float median{ 0.0f };
+	// Reused for calculating the median, so recording doesn't allocate
+	std::vector<float> sortedFrameTimes;
+	std::vector<std::string> events;
+	std::deque<FrameHitch> hitches;
+	float calculateMedian();
+public:
+	// Frames taking longer than this multiple of the median are reported as hitches
+	float hitchFactor{ 3.0f };
+	// Hitches aren't checked until this many frames have been recorded, as the first frames usually include one-time work
+	uint32_t minFrames{ 60 };
+	// Number of most recent hitches that are kept
+	uint32_t maxHitches{ 8 };
+
+	FrameTimeRecorder(uint32_t capacity = 256);
+	/** @brief Notes work done during the current frame, only reported if the frame turns out to be a hitch */
+	void addEvent(const std::string& name);
+	// True if events have been noted since the last recorded frame
+	bool hasEvents() const;
+	/** @brief Records the time of the finished frame in milliseconds and checks it against the median of the previous frames */
+	void addFrame(float frameTime);
+	// Ring buffer of frame times, the oldest one is at getOffset() once the buffer is full
+	const std::vector<float>& getFrameTimes() const;
+	uint32_t getOffset() const;
+	uint32_t getCount() const;
+	float getMedian() const;
+	/**
+	* Distributes the recorded frame times into equally sized buckets
+	*
+	* @param bucketCount Number of buckets
+	* @param maxFrameTime Upper bound of the last bucket in milliseconds, longer frames are added to the last bucket
+	*/
+	std::vector<float> getHistogram(uint32_t bucketCount, float maxFrameTime) const;
+	const std::deque<FrameHitch>& getHitches() const;
+	uint64_t getHitchCount() const;
+};
@@ -9,8 +9,21 @@
 #pragma once
 
 #include <math.h>
+#include <stdint.h>
 #include <glm/glm.hpp>
 
+// Select the widest SIMD path available for batched sphere tests
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VKS_FRUSTUM_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define VKS_FRUSTUM_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VKS_FRUSTUM_NEON
+#endif
+
 namespace vks
 {
 	class Frustum
@@ -42,10 +55,11 @@ namespace vks
 			planes[BOTTOM].z = matrix[2].w + matrix[2].y;
 			planes[BOTTOM].w = matrix[3].w + matrix[3].y;
 
-			planes[BACK].x = matrix[0].w + matrix[0].z;
-			planes[BACK].y = matrix[1].w + matrix[1].z;
-			planes[BACK].z = matrix[2].w + matrix[2].z;
-			planes[BACK].w = matrix[3].w + matrix[3].z;
+			// Depth is in [0, 1] (GLM_FORCE_DEPTH_ZERO_TO_ONE), with reverse Z the back and front plane swap places
+			planes[BACK].x = matrix[0].z;
+			planes[BACK].y = matrix[1].z;
+			planes[BACK].z = matrix[2].z;
+			planes[BACK].w = matrix[3].z;
 
 			planes[FRONT].x = matrix[0].w - matrix[0].z;
 			planes[FRONT].y = matrix[1].w - matrix[1].z;
@@ -55,19 +69,25 @@ namespace vks
 			for (auto i = 0; i < 6; i++)
 			{
 				float length = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+				// The far plane of an infinite projection has no normal, it's replaced with a plane that everything passes
+				if (length < 1e-6f) {
+					planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+					continue;
+				}
 				planes[i] /= length;
 			}
 
 			const glm::vec4 v[] = {
-				glm::vec4(-1, -1, -1,  1),  glm::vec4(1, -1, -1,  1),
-				glm::vec4(1,  1, -1,  1),  glm::vec4(-1,  1, -1,  1),
+				glm::vec4(-1, -1, 0,  1),  glm::vec4(1, -1, 0,  1),
+				glm::vec4(1,  1, 0,  1),  glm::vec4(-1,  1, 0,  1),
 				glm::vec4(-1, -1,  1,  1),  glm::vec4(1, -1,  1,  1),
 				glm::vec4(1,  1,  1,  1),  glm::vec4(-1,  1,  1,  1)
 			};
 			const glm::mat4 inv = glm::inverse(matrix);
 			for (auto i = 0; i < 8; i++) {
 				const glm::vec4 q = inv * v[i];
-				corners[i] = q / q.w;
+				// Corners on an infinite far plane are points at infinity (w = 0), they're moved far out along their direction instead
+				corners[i] = (fabsf(q.w) > 1e-6f) ? q / q.w : glm::vec4(glm::normalize(glm::vec3(q)) * 1e30f, 1.0f);
 			}
 
 		}
@@ -84,6 +104,121 @@ namespace vks
 			return true;
 		}
 
+		/**
+		* @brief Tests a batch of spheres against the frustum, using SIMD (AVX2, SSE2 or NEON) where available
+		*
+		* @param centers Sphere centers
+		* @param radii Sphere radii
+		* @param count Number of spheres
+		* @param visibleIndices Receives the indices of all visible spheres, must have room for count elements
+		* @param radiusScale Factor applied to all radii
+		*
+		* @return Number of visible spheres written to visibleIndices
+		*/
+		uint32_t checkSpheres(const glm::vec3* centers, const float* radii, uint32_t count, uint32_t* visibleIndices, float radiusScale = 1.0f)
+		{
+			uint32_t visibleCount = 0;
+			uint32_t i = 0;
+#if defined(VKS_FRUSTUM_AVX2)
+			const __m256 scale = _mm256_set1_ps(radiusScale);
+			for (; i + 8 <= count; i += 8) {
+				const glm::vec3* c = &centers[i];
+				const __m256 x = _mm256_set_ps(c[7].x, c[6].x, c[5].x, c[4].x, c[3].x, c[2].x, c[1].x, c[0].x);
+				const __m256 y = _mm256_set_ps(c[7].y, c[6].y, c[5].y, c[4].y, c[3].y, c[2].y, c[1].y, c[0].y);
+				const __m256 z = _mm256_set_ps(c[7].z, c[6].z, c[5].z, c[4].z, c[3].z, c[2].z, c[1].z, c[0].z);
+				const __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(_mm256_loadu_ps(&radii[i]), scale));
+				__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (uint32_t p = 0; p < 6; p++) {
+					__m256 d = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(planes[p].x)), _mm256_mul_ps(y, _mm256_set1_ps(planes[p].y)));
+					d = _mm256_add_ps(d, _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(planes[p].z)), _mm256_set1_ps(planes[p].w)));
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negRadius, _CMP_GT_OQ));
+				}
+				const int mask = _mm256_movemask_ps(inside);
+				for (uint32_t j = 0; j < 8; j++) {
+					if (mask & (1 << j)) {
+						visibleIndices[visibleCount++] = i + j;
+					}
+				}
+			}
+#elif defined(VKS_FRUSTUM_SSE)
+			const __m128 scale = _mm_set1_ps(radiusScale);
+			for (; i + 4 <= count; i += 4) {
+				const glm::vec3* c = &centers[i];
+				const __m128 x = _mm_set_ps(c[3].x, c[2].x, c[1].x, c[0].x);
+				const __m128 y = _mm_set_ps(c[3].y, c[2].y, c[1].y, c[0].y);
+				const __m128 z = _mm_set_ps(c[3].z, c[2].z, c[1].z, c[0].z);
+				const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_loadu_ps(&radii[i]), scale));
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (uint32_t p = 0; p < 6; p++) {
+					__m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p].x)), _mm_mul_ps(y, _mm_set1_ps(planes[p].y)));
+					d = _mm_add_ps(d, _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+					inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negRadius));
+				}
+				const int mask = _mm_movemask_ps(inside);
+				for (uint32_t j = 0; j < 4; j++) {
+					if (mask & (1 << j)) {
+						visibleIndices[visibleCount++] = i + j;
+					}
+				}
+			}
+#elif defined(VKS_FRUSTUM_NEON)
+			const float32x4_t scale = vdupq_n_f32(radiusScale);
+			for (; i + 4 <= count; i += 4) {
+				const glm::vec3* c = &centers[i];
+				const float xs[4] = { c[0].x, c[1].x, c[2].x, c[3].x };
+				const float ys[4] = { c[0].y, c[1].y, c[2].y, c[3].y };
+				const float zs[4] = { c[0].z, c[1].z, c[2].z, c[3].z };
+				const float32x4_t x = vld1q_f32(xs);
+				const float32x4_t y = vld1q_f32(ys);
+				const float32x4_t z = vld1q_f32(zs);
+				const float32x4_t negRadius = vnegq_f32(vmulq_f32(vld1q_f32(&radii[i]), scale));
+				uint32x4_t inside = vdupq_n_u32(0xFFFFFFFF);
+				for (uint32_t p = 0; p < 6; p++) {
+					float32x4_t d = vmlaq_n_f32(vdupq_n_f32(planes[p].w), x, planes[p].x);
+					d = vmlaq_n_f32(d, y, planes[p].y);
+					d = vmlaq_n_f32(d, z, planes[p].z);
+					inside = vandq_u32(inside, vcgtq_f32(d, negRadius));
+				}
+				uint32_t mask[4];
+				vst1q_u32(mask, inside);
+				for (uint32_t j = 0; j < 4; j++) {
+					if (mask[j]) {
+						visibleIndices[visibleCount++] = i + j;
+					}
+				}
+			}
+#endif
+			// Scalar path for the remaining spheres (or all of them if no SIMD path is available)
+			for (; i < count; i++) {
+				if (checkSphere(centers[i], radii[i] * radiusScale)) {
+					visibleIndices[visibleCount++] = i;
+				}
+			}
+			return visibleCount;
+		}
+
+		/**
+		* @brief Tests a box in the local space of a transform (e.g. a model's bounds and an actor's world matrix) against the frustum, exact for each plane
+		*
+		* @param matrix Transform from the box's local space into the space of the frustum, may contain scale and shear
+		* @param min Minimum corner of the box in local space
+		* @param max Maximum corner of the box in local space
+		*/
+		bool checkOrientedBox(const glm::mat4& matrix, const glm::vec3 min, const glm::vec3 max) const
+		{
+			const glm::vec3 center = glm::vec3(matrix * glm::vec4((min + max) * 0.5f, 1.0f));
+			const glm::vec3 extents = (max - min) * 0.5f;
+			for (uint32_t i = 0; i < 6; i++) {
+				const glm::vec3 normal = glm::vec3(planes[i]);
+				// Distance of the box's farthest corner along the plane normal from its center
+				const float radius = extents.x * fabsf(glm::dot(normal, glm::vec3(matrix[0]))) + extents.y * fabsf(glm::dot(normal, glm::vec3(matrix[1]))) + extents.z * fabsf(glm::dot(normal, glm::vec3(matrix[2])));
+				if (glm::dot(normal, center) + planes[i].w <= -radius) {
+					return false;
+				}
+			}
+			return true;
+		}
+
 		bool checkBox(glm::vec3 pos, glm::vec3 min, glm::vec3 max)
 		{
 			// https://iquilezles.org/articles/frustumcorrect/
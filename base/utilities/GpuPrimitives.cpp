@@ -0,0 +1,204 @@
+/*
+ * Compute primitives for GPU driven rendering: prefix sums, stream compaction and radix sort
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "GpuPrimitives.h"
+#include <algorithm>
+#include "VulkanContext.h"
+#include "MemoryStats.h"
+
+bool GpuPrimitives::isSupported(const Device& device)
+{
+	const VkSubgroupFeatureFlags requiredOperations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+	return device.hasPushDescriptor && (device.pushDescriptorProperties.maxPushDescriptors >= std::tuple_size_v<Bindings>)
+		&& (device.properties11.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT)
+		&& ((device.properties11.subgroupSupportedOperations & requiredOperations) == requiredOperations);
+}
+
+uint32_t GpuPrimitives::getTileCount(uint32_t count)
+{
+	return (count + tileSize - 1) / tileSize;
+}
+
+GpuPrimitives::GpuPrimitives(GpuPrimitivesCreateInfo createInfo)
+{
+	assert(isSupported(*VulkanContext::device));
+	maxElementCount = createInfo.maxElementCount;
+
+	// Scratch ranges are bound as storage buffers, so they need to start at the device's storage buffer alignment
+	const VkDeviceSize alignment = VulkanContext::device->properties.limits.minStorageBufferOffsetAlignment;
+	auto alignUp = [alignment](VkDeviceSize value) { return (value + alignment - 1) / alignment * alignment; };
+	const uint32_t maxTiles = getTileCount(maxElementCount);
+	// The digit counts are scanned with the same tile states, so these need to cover the larger of both scans
+	const uint32_t maxScanTiles = std::max(maxTiles, getTileCount(maxTiles * radixSize));
+	VkDeviceSize offset = 0;
+	auto addRange = [&offset, &alignUp](VkDescriptorBufferInfo& range, VkDeviceSize size) {
+		range.offset = offset;
+		range.range = size;
+		offset = alignUp(offset + size);
+	};
+	addRange(tileStatus, (1 + maxScanTiles) * sizeof(uint32_t));
+	addRange(digitCounts, maxTiles * radixSize * sizeof(uint32_t));
+	addRange(digitOffsets, maxTiles * radixSize * sizeof(uint32_t));
+	if (createInfo.sorting) {
+		addRange(sortKeys, maxElementCount * sizeof(uint32_t));
+		addRange(sortValues, maxElementCount * sizeof(uint32_t));
+	}
+	MemoryStats::Scope memoryScope(MemoryCategory::FrameData);
+	scratch = new Buffer({
+		.name = "GPU primitives scratch buffer",
+		.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		.size = offset,
+		.map = false
+	});
+	for (VkDescriptorBufferInfo* range : { &tileStatus, &digitCounts, &digitOffsets, &sortKeys, &sortValues }) {
+		range->buffer = scratch->buffer;
+	}
+
+	const std::vector<ShaderReference> shaders = {
+		{ createInfo.shaderPath + "prefix_scan.comp.hlsl" },
+		{ createInfo.shaderPath + "compact.comp.hlsl" },
+		{ createInfo.shaderPath + "radix_sort_count.comp.hlsl" },
+		{ createInfo.shaderPath + "radix_sort_scatter.comp.hlsl" },
+	};
+	descriptorSetLayout = new DescriptorSetLayout({
+		.pushDescriptor = true,
+		.bindings = {
+			{ .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+			{ .binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+			{ .binding = 2, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+			{ .binding = 3, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+			{ .binding = 4, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+			{ .binding = 5, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+		},
+		.shaders = shaders
+	});
+	pipelineLayout = new PipelineLayout({
+		.layouts = { descriptorSetLayout->handle },
+		.pushConstantRanges = { { .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(PushConstants) } },
+		.shaders = shaders
+	});
+	auto createPipeline = [this, &createInfo](const std::string& name) {
+		return new Pipeline({
+			.name = "GPU primitives " + name,
+			.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+			.shaders = { createInfo.shaderPath + name + ".comp.hlsl" },
+			.cache = createInfo.pipelineCache,
+			.layout = pipelineLayout->handle,
+			.enableHotReload = true
+		});
+	};
+	scanPipeline = createPipeline("prefix_scan");
+	compactPipeline = createPipeline("compact");
+	radixCountPipeline = createPipeline("radix_sort_count");
+	radixScatterPipeline = createPipeline("radix_sort_scatter");
+}
+
+GpuPrimitives::~GpuPrimitives()
+{
+	delete scanPipeline;
+	delete compactPipeline;
+	delete radixCountPipeline;
+	delete radixScatterPipeline;
+	delete pipelineLayout;
+	delete descriptorSetLayout;
+	delete scratch;
+}
+
+GpuPrimitives::Bindings GpuPrimitives::getBindings() const
+{
+	Bindings bindings;
+	bindings.fill(tileStatus);
+	return bindings;
+}
+
+// Tile indices and states start at zero for every scan, earlier dispatches may still be using them
+void GpuPrimitives::resetTileStatus(CommandBuffer* commandBuffer)
+{
+	commandBuffer->addMemoryBarrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+	commandBuffer->flushBarriers();
+	vkCmdFillBuffer(commandBuffer->handle, tileStatus.buffer, tileStatus.offset, tileStatus.range, 0);
+	commandBuffer->addMemoryBarrier(VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+	commandBuffer->flushBarriers();
+}
+
+void GpuPrimitives::dispatch(CommandBuffer* commandBuffer, Pipeline* pipeline, const Bindings& bindings, const PushConstants& pushConstants, uint32_t groupCount)
+{
+	auto write = [&bindings](uint32_t binding) {
+		return VkWriteDescriptorSet{ .dstBinding = binding, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &bindings[binding] };
+	};
+	commandBuffer->bindPipeline(pipeline);
+	commandBuffer->pushDescriptorSet(pipelineLayout, 0, { write(0), write(1), write(2), write(3), write(4), write(5) }, VK_PIPELINE_BIND_POINT_COMPUTE);
+	commandBuffer->pushConstants(pipelineLayout->handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+	commandBuffer->dispatch(groupCount);
+}
+
+void GpuPrimitives::exclusiveScan(CommandBuffer* commandBuffer, const VkDescriptorBufferInfo& source, const VkDescriptorBufferInfo& destination, uint32_t count)
+{
+	assert(count <= std::max(maxElementCount, getTileCount(maxElementCount) * radixSize));
+	if (count == 0) {
+		return;
+	}
+	const uint32_t tileCount = getTileCount(count);
+	Bindings bindings = getBindings();
+	bindings[0] = source;
+	bindings[1] = destination;
+	resetTileStatus(commandBuffer);
+	dispatch(commandBuffer, scanPipeline, bindings, { .count = count, .tileCount = tileCount }, tileCount);
+}
+
+void GpuPrimitives::compact(CommandBuffer* commandBuffer, const VkDescriptorBufferInfo& source, const VkDescriptorBufferInfo& flags, const VkDescriptorBufferInfo& destination, const VkDescriptorBufferInfo& counter, uint32_t count)
+{
+	assert(count <= maxElementCount);
+	// At least one tile is run, so the counter is also written without any elements
+	const uint32_t tileCount = std::max(getTileCount(count), 1u);
+	Bindings bindings = getBindings();
+	bindings[0] = source;
+	bindings[1] = destination;
+	bindings[3] = flags;
+	bindings[4] = counter;
+	resetTileStatus(commandBuffer);
+	dispatch(commandBuffer, compactPipeline, bindings, { .count = count, .tileCount = tileCount }, tileCount);
+}
+
+void GpuPrimitives::sort(CommandBuffer* commandBuffer, const VkDescriptorBufferInfo& keys, const VkDescriptorBufferInfo& values, uint32_t count, uint32_t keyBits)
+{
+	assert((count <= maxElementCount) && (sortKeys.range > 0) && (keyBits > 0) && (keyBits <= 32));
+	if (count <= 1) {
+		return;
+	}
+	const uint32_t tileCount = getTileCount(count);
+	const uint32_t hasValues = (values.range > 0) ? 1 : 0;
+	// Passes alternate between the caller's buffers and the scratch copy, an even number of them leaves the result in the caller's buffers
+	// Keys don't have bits set above keyBits, so the digits of an additional pass are all zero and don't change the order
+	uint32_t passCount = (keyBits + radixBits - 1) / radixBits;
+	passCount += passCount & 1;
+	for (uint32_t pass = 0; pass < passCount; pass++) {
+		const bool fromScratch = (pass & 1) != 0;
+		const PushConstants pushConstants{ .count = count, .tileCount = tileCount, .shift = pass * radixBits, .hasValues = hasValues };
+		Bindings bindings = getBindings();
+		bindings[0] = fromScratch ? sortKeys : keys;
+		bindings[1] = fromScratch ? keys : sortKeys;
+		if (hasValues) {
+			bindings[3] = fromScratch ? sortValues : values;
+			bindings[4] = fromScratch ? values : sortValues;
+		}
+		bindings[5] = digitCounts;
+		// Previous pass (or scan of the counts) needs to be done with the buffers this pass writes
+		commandBuffer->addMemoryBarrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+		commandBuffer->flushBarriers();
+		dispatch(commandBuffer, radixCountPipeline, bindings, pushConstants, tileCount);
+		commandBuffer->addMemoryBarrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+		commandBuffer->flushBarriers();
+		exclusiveScan(commandBuffer, digitCounts, digitOffsets, tileCount * radixSize);
+		commandBuffer->addMemoryBarrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+		commandBuffer->flushBarriers();
+		bindings[5] = digitOffsets;
+		dispatch(commandBuffer, radixScatterPipeline, bindings, pushConstants, tileCount);
+	}
+}
@@ -0,0 +1,114 @@
+/*
+ * Compute primitives for GPU driven rendering: prefix sums, stream compaction and radix sort
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <array>
+#include <string>
+#include "volk.h"
+#include "Device.hpp"
+#include "Buffer.hpp"
+#include "CommandBuffer.hpp"
+#include "DescriptorSetLayout.hpp"
+#include "PipelineLayout.hpp"
+#include "Pipeline.hpp"
+
+struct GpuPrimitivesCreateInfo {
+	// Directory containing the shaders (prefix_scan.comp.hlsl etc.)
+	std::string shaderPath;
+	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
+	// Upper bound for the number of elements of a single call, sizes the scratch buffer
+	uint32_t maxElementCount{ 1024 * 1024 };
+	// Sorting needs a copy of the keys and values in the scratch buffer, which is only reserved if this is set
+	bool sorting{ true };
+};
+
+/**
+ * Scans, compacts and sorts buffers of 32 bit unsigned integers on the device, recorded into a command buffer with compute dispatches
+ * Prefix sums and compaction run in a single pass with a decoupled look-back between tiles, workgroup wide sums are built from wave intrinsics
+ * Sorting is a stable least significant digit radix sort with 4 bit digits, each pass counts the digits per tile, scans the counts and scatters the keys
+ * All buffers are passed as descriptor ranges and need the storage buffer usage, their descriptors are pushed per dispatch (requires Device::hasPushDescriptor)
+ * Writes by earlier commands to the input buffers need to be made visible to compute shaders by the caller, and reading the results needs a barrier after compute shader writes
+ * Calls share the scratch buffer and are ordered by barriers, so command buffers recording calls of the same instance must not execute at the same time
+ */
+class GpuPrimitives {
+private:
+	// Matches compute_primitives.hlsl
+	static constexpr uint32_t threadCount = 256;
+	static constexpr uint32_t itemsPerThread = 4;
+	static constexpr uint32_t radixBits = 4;
+	static constexpr uint32_t radixSize = 1u << radixBits;
+	struct PushConstants {
+		uint32_t count;
+		uint32_t tileCount;
+		uint32_t shift;
+		uint32_t hasValues;
+	};
+	// Descriptors of all bindings of the shared layout, bindings a shader doesn't use point at the scratch buffer
+	using Bindings = std::array<VkDescriptorBufferInfo, 6>;
+
+	DescriptorSetLayout* descriptorSetLayout{ nullptr };
+	PipelineLayout* pipelineLayout{ nullptr };
+	Pipeline* scanPipeline{ nullptr };
+	Pipeline* compactPipeline{ nullptr };
+	Pipeline* radixCountPipeline{ nullptr };
+	Pipeline* radixScatterPipeline{ nullptr };
+	uint32_t maxElementCount{ 0 };
+	// Tile counter and tile states of the look-back, the digit counts and their scan, and the copy of keys and values sorting alternates with
+	Buffer* scratch{ nullptr };
+	VkDescriptorBufferInfo tileStatus{};
+	VkDescriptorBufferInfo digitCounts{};
+	VkDescriptorBufferInfo digitOffsets{};
+	VkDescriptorBufferInfo sortKeys{};
+	VkDescriptorBufferInfo sortValues{};
+
+	static uint32_t getTileCount(uint32_t count);
+	Bindings getBindings() const;
+	void resetTileStatus(CommandBuffer* commandBuffer);
+	void dispatch(CommandBuffer* commandBuffer, Pipeline* pipeline, const Bindings& bindings, const PushConstants& pushConstants, uint32_t groupCount);
+public:
+	// Elements processed by a single workgroup
+	static constexpr uint32_t tileSize = threadCount * itemsPerThread;
+
+	/** @brief Push descriptors and wave arithmetic in compute shaders are required */
+	static bool isSupported(const Device& device);
+
+	GpuPrimitives(GpuPrimitivesCreateInfo createInfo);
+	// The device needs to be idle
+	~GpuPrimitives();
+	GpuPrimitives(const GpuPrimitives&) = delete;
+	GpuPrimitives& operator=(const GpuPrimitives&) = delete;
+
+	/**
+	* Exclusive prefix sum, the sum of all elements needs to stay below 2^30
+	*
+	* @param source Elements to sum up
+	* @param destination Receives the sum of all preceding elements for each element, may be the same range as source
+	* @param count Number of elements, at most the maximum element count of the create info
+	*/
+	void exclusiveScan(CommandBuffer* commandBuffer, const VkDescriptorBufferInfo& source, const VkDescriptorBufferInfo& destination, uint32_t count);
+	/**
+	* Copies the elements with a non-zero flag to the front of the destination, keeping their order
+	*
+	* @param source Elements to compact
+	* @param flags One flag per element
+	* @param destination Receives the kept elements, must not overlap the source
+	* @param counter Receives the number of kept elements as a single uint
+	* @param count Number of elements, at most the maximum element count of the create info
+	*/
+	void compact(CommandBuffer* commandBuffer, const VkDescriptorBufferInfo& source, const VkDescriptorBufferInfo& flags, const VkDescriptorBufferInfo& destination, const VkDescriptorBufferInfo& counter, uint32_t count);
+	/**
+	* Sorts keys in ascending order in place, values are moved along with their keys, keys that compare equal keep their order
+	*
+	* @param keys Keys to sort
+	* @param values (Optional) One value per key, ignored if its range is 0
+	* @param count Number of keys, at most the maximum element count of the create info
+	* @param keyBits Number of low bits the keys (may) have set, sorting fewer bits needs fewer passes
+	*/
+	void sort(CommandBuffer* commandBuffer, const VkDescriptorBufferInfo& keys, const VkDescriptorBufferInfo& values, uint32_t count, uint32_t keyBits = 32);
+};
@@ -0,0 +1,145 @@
+/*
+ * Checks the GPU compute primitives against CPU references and times them
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "GpuPrimitivesBenchmark.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include "VulkanContext.h"
+#include "MemoryStats.h"
+
+std::vector<GpuPrimitivesBenchmarkResult> runGpuPrimitivesBenchmark(GpuPrimitives& primitives, CommandPool* commandPool, VkQueue queue, uint32_t count, uint32_t seed)
+{
+	Device& device = *VulkanContext::device;
+
+	// Small values keep the sum of the scan below its limit of 2^30, a quarter of the elements is kept by the compaction
+	// Sort keys fit into 24 bits and repeat about four times each, so the stability of the sort is checked through the values (the original positions)
+	std::default_random_engine generator(seed);
+	std::uniform_int_distribution<uint32_t> valueDist(0, 15);
+	std::uniform_int_distribution<uint32_t> flagDist(0, 3);
+	std::uniform_int_distribution<uint32_t> keyDist(0, std::clamp(count / 4, 1u, (1u << 24) - 1));
+	std::vector<uint32_t> values(count);
+	std::vector<uint32_t> flags(count);
+	std::vector<uint32_t> keys(count);
+	for (uint32_t i = 0; i < count; i++) {
+		values[i] = valueDist(generator);
+		flags[i] = (flagDist(generator) == 0) ? 1 : 0;
+		keys[i] = keyDist(generator);
+	}
+
+	MemoryStats::Scope memoryScope(MemoryCategory::Other);
+	const VkDeviceSize size = std::max(count, 1u) * sizeof(uint32_t);
+	auto createBuffer = [&device, size](const std::string& name, const void* data) {
+		Buffer* buffer = new Buffer({
+			.name = "GPU primitives benchmark " + name,
+			.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.size = size
+		});
+		if (data) {
+			memcpy(buffer->mapped, data, size);
+		}
+		return buffer;
+	};
+	Buffer* scanSource = createBuffer("scan source", values.data());
+	Buffer* scanDestination = createBuffer("scan destination", nullptr);
+	Buffer* compactSource = createBuffer("compact source", values.data());
+	Buffer* compactFlags = createBuffer("compact flags", flags.data());
+	Buffer* compactDestination = createBuffer("compact destination", nullptr);
+	Buffer* compactCounter = createBuffer("compact counter", nullptr);
+	Buffer* sortKeys = createBuffer("sort keys", keys.data());
+	std::vector<uint32_t> positions(count);
+	std::iota(positions.begin(), positions.end(), 0u);
+	Buffer* sortValues = createBuffer("sort values", positions.data());
+
+	// A timestamp before and after each primitive
+	const bool timestamps = device.properties.limits.timestampComputeAndGraphics && (device.properties.limits.timestampPeriod > 0.0f);
+	const uint32_t queryCount = 6;
+	VkQueryPool queryPool{ VK_NULL_HANDLE };
+	if (timestamps) {
+		const VkQueryPoolCreateInfo queryPoolCI{ .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, .queryType = VK_QUERY_TYPE_TIMESTAMP, .queryCount = queryCount };
+		VK_CHECK_RESULT(vkCreateQueryPool(device.logicalDevice, &queryPoolCI, nullptr, &queryPool));
+	}
+
+	CommandBuffer* cb = new CommandBuffer({ .device = device, .pool = commandPool, .name = "GPU primitives benchmark" });
+	cb->begin();
+	if (timestamps) {
+		vkCmdResetQueryPool(cb->handle, queryPool, 0, queryCount);
+	}
+	auto timestamp = [cb, queryPool, timestamps](uint32_t query) {
+		if (timestamps) {
+			cb->flushBarriers();
+			vkCmdWriteTimestamp2(cb->handle, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, queryPool, query);
+		}
+	};
+	// Inputs have been written by the host before the submit, which makes them visible to the device
+	timestamp(0);
+	primitives.exclusiveScan(cb, scanSource->descriptor, scanDestination->descriptor, count);
+	timestamp(1);
+	timestamp(2);
+	primitives.compact(cb, compactSource->descriptor, compactFlags->descriptor, compactDestination->descriptor, compactCounter->descriptor, count);
+	timestamp(3);
+	timestamp(4);
+	primitives.sort(cb, sortKeys->descriptor, sortValues->descriptor, count, 24);
+	timestamp(5);
+	cb->addMemoryBarrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+	cb->end();
+	cb->oneTimeSubmit(queue);
+	delete cb;
+
+	std::vector<uint64_t> queries(queryCount, 0);
+	if (timestamps) {
+		VK_CHECK_RESULT(vkGetQueryPoolResults(device.logicalDevice, queryPool, 0, queryCount, queries.size() * sizeof(uint64_t), queries.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+		vkDestroyQueryPool(device.logicalDevice, queryPool, nullptr);
+	}
+	auto gpuTime = [&queries, &device](uint32_t first) {
+		return static_cast<float>(static_cast<double>(queries[first + 1] - queries[first]) * device.properties.limits.timestampPeriod / 1e6);
+	};
+	auto cpuTime = [](auto&& reference) {
+		const auto tStart = std::chrono::high_resolution_clock::now();
+		reference();
+		return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	};
+	auto mapped = [](const Buffer* buffer) {
+		return static_cast<const uint32_t*>(buffer->mapped);
+	};
+
+	std::vector<GpuPrimitivesBenchmarkResult> results;
+
+	std::vector<uint32_t> scanReference(count);
+	const float scanTime = cpuTime([&] { std::exclusive_scan(values.begin(), values.end(), scanReference.begin(), 0u); });
+	results.push_back({ .name = "exclusiveScan", .valid = std::equal(scanReference.begin(), scanReference.end(), mapped(scanDestination)), .gpuTime = gpuTime(0), .cpuReferenceTime = scanTime });
+
+	std::vector<uint32_t> compactReference;
+	compactReference.reserve(count);
+	const float compactTime = cpuTime([&] {
+		for (uint32_t i = 0; i < count; i++) {
+			if (flags[i]) {
+				compactReference.push_back(values[i]);
+			}
+		}
+	});
+	const bool compactValid = (mapped(compactCounter)[0] == compactReference.size()) && std::equal(compactReference.begin(), compactReference.end(), mapped(compactDestination));
+	results.push_back({ .name = "compact", .valid = compactValid, .gpuTime = gpuTime(2), .cpuReferenceTime = compactTime });
+
+	// Sorted by key, positions of equal keys are ascending if the sort is stable
+	std::vector<uint32_t> sortReference = positions;
+	const float sortTime = cpuTime([&] { std::stable_sort(sortReference.begin(), sortReference.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; }); });
+	bool sortValid = true;
+	for (uint32_t i = 0; i < count && sortValid; i++) {
+		sortValid = (mapped(sortValues)[i] == sortReference[i]) && (mapped(sortKeys)[i] == keys[sortReference[i]]);
+	}
+	results.push_back({ .name = "sort", .valid = sortValid, .gpuTime = gpuTime(4), .cpuReferenceTime = sortTime });
+
+	for (Buffer* buffer : { scanSource, scanDestination, compactSource, compactFlags, compactDestination, compactCounter, sortKeys, sortValues }) {
+		delete buffer;
+	}
+	return results;
+}
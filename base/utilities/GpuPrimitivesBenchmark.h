@@ -0,0 +1,35 @@
+/*
+ * Checks the GPU compute primitives against CPU references and times them
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "GpuPrimitives.h"
+#include "CommandPool.hpp"
+
+/** @brief Outcome of one primitive, times are in milliseconds and zero if the queue doesn't support timestamps */
+struct GpuPrimitivesBenchmarkResult {
+	std::string name;
+	bool valid{ false };
+	float gpuTime{ 0.0f };
+	float cpuReferenceTime{ 0.0f };
+};
+
+/**
+ * Runs exclusiveScan, compact and sort once each on random data of the given size and compares the results with the standard library's
+ * Input and output buffers are host visible, so the results are read without copies, the device is idle once this returns
+ *
+ * @param primitives Primitives to check, need to have been created with sorting enabled and a maximum element count of at least count
+ * @param commandPool Pool of the queue's family the command buffer is allocated from
+ * @param queue Queue the commands are submitted to, waits for it to finish
+ * @param count Number of elements per primitive
+ * @param seed Seed of the random input
+ */
+std::vector<GpuPrimitivesBenchmarkResult> runGpuPrimitivesBenchmark(GpuPrimitives& primitives, CommandPool* commandPool, VkQueue queue, uint32_t count, uint32_t seed = 1);
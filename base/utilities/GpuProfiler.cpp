@@ -0,0 +1,240 @@
+/*
+ * GPU timings of named command buffer scopes using timestamp queries
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "GpuProfiler.h"
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cassert>
+#include "VulkanTools.h"
+#include "SyncPool.hpp"
+
+GpuProfiler::GpuProfiler(GpuProfilerCreateInfo createInfo) : device(createInfo.device)
+{
+	maxScopes = createInfo.maxScopes;
+	frames.resize(createInfo.frameCount);
+
+	// Only requested statistics are written, in the order of their flag bits (matching the members of PipelineStatistics)
+	statisticsSupported = Device::enabledFeatures.pipelineStatisticsQuery;
+	if (statisticsSupported) {
+		for (Frame& frame : frames) {
+			VkQueryPoolCreateInfo queryPoolCI{
+				.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+				.queryCount = 1,
+				.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT
+					| VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+					| VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+					| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+					| VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+					| VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT
+			};
+			VK_CHECK_RESULT(vkCreateQueryPool(device.logicalDevice, &queryPoolCI, nullptr, &frame.statisticsQueryPool));
+		}
+	}
+
+	const uint32_t timestampValidBits = device.queueFamilyProperties[device.queueFamilyIndices.graphics].timestampValidBits;
+	supported = (timestampValidBits > 0) && (device.properties.limits.timestampPeriod > 0.0f);
+	if (!supported) {
+		std::cout << "Timestamp queries are not supported on the graphics queue, GPU timings are disabled\n";
+		return;
+	}
+	timestampMask = (timestampValidBits >= 64) ? UINT64_MAX : ((1ull << timestampValidBits) - 1);
+
+	for (Frame& frame : frames) {
+		VkQueryPoolCreateInfo queryPoolCI{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			// Start and end of each scope
+			.queryCount = maxScopes * 2
+		};
+		VK_CHECK_RESULT(vkCreateQueryPool(device.logicalDevice, &queryPoolCI, nullptr, &frame.queryPool));
+		frame.scopes.reserve(maxScopes);
+	}
+	timestamps.resize(maxScopes * 2);
+	calibrate(createInfo.queue, createInfo.setupCommandBuffer);
+
+	tracyContext = TracyVkContext(device.physicalDevice, device.logicalDevice, createInfo.queue, createInfo.setupCommandBuffer);
+#if defined(TRACY_ENABLE)
+	if (tracyContext) {
+		const char* contextName = "Graphics queue";
+		TracyVkContextName(tracyContext, contextName, static_cast<uint16_t>(strlen(contextName)));
+	}
+#endif
+}
+
+GpuProfiler::~GpuProfiler()
+{
+#if defined(TRACY_ENABLE)
+	for (tracy::VkCtxScope* zone : tracyZones) {
+		delete zone;
+	}
+#endif
+	if (tracyContext) {
+		TracyVkDestroy(tracyContext);
+	}
+	for (Frame& frame : frames) {
+		vkDestroyQueryPool(device.logicalDevice, frame.queryPool, nullptr);
+		vkDestroyQueryPool(device.logicalDevice, frame.statisticsQueryPool, nullptr);
+	}
+}
+
+// Writes a single timestamp and takes the CPU time once it's available, the offset between both clocks is off by the latency of the wait (well below a millisecond)
+// Timestamps are not calibrated again, so long recordings may drift by the difference of the clock rates
+void GpuProfiler::calibrate(VkQueue queue, VkCommandBuffer commandBuffer)
+{
+	VkQueryPool queryPool = frames[0].queryPool;
+	VkCommandBufferBeginInfo commandBufferBI{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+	VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &commandBufferBI));
+	vkCmdResetQueryPool(commandBuffer, queryPool, 0, 1);
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, queryPool, 0);
+	VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+	VkSubmitInfo submitInfo{ .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO, .commandBufferCount = 1, .pCommandBuffers = &commandBuffer };
+	SubmitToken token = VulkanContext::syncPool->submit(queue, submitInfo);
+	VulkanContext::syncPool->wait(token, UINT64_MAX);
+	calibrationTime = TraceRecorder::now();
+	VK_CHECK_RESULT(vkGetQueryPoolResults(device.logicalDevice, queryPool, 0, 1, sizeof(uint64_t), &calibrationTimestamp, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+}
+
+void GpuProfiler::readResults(Frame& frame)
+{
+	if (frame.statisticsRecorded) {
+		PipelineStatistics statistics{};
+		if (vkGetQueryPoolResults(device.logicalDevice, frame.statisticsQueryPool, 0, 1, sizeof(PipelineStatistics), &statistics, sizeof(PipelineStatistics), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			pipelineStatistics = statistics;
+		}
+	}
+	if (frame.queryCount == 0) {
+		return;
+	}
+	// No wait, the frame has finished executing, if results are still missing the last results are kept
+	const VkResult result = vkGetQueryPoolResults(device.logicalDevice, frame.queryPool, 0, frame.queryCount, frame.queryCount * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS) {
+		return;
+	}
+	const float period = device.properties.limits.timestampPeriod;
+	auto toMilliseconds = [this, period](uint64_t start, uint64_t end) {
+		return static_cast<float>(static_cast<double>((end - start) & timestampMask) * period / 1000000.0);
+	};
+	results.resize(frame.scopes.size());
+	uint32_t firstQuery = UINT32_MAX;
+	uint32_t lastQuery = 0;
+	for (size_t i = 0; i < frame.scopes.size(); i++) {
+		const Scope& scope = frame.scopes[i];
+		results[i].name = scope.name;
+		results[i].depth = scope.depth;
+		results[i].time = toMilliseconds(timestamps[scope.query], timestamps[scope.query + 1]);
+		if (scope.depth == 0) {
+			firstQuery = std::min(firstQuery, scope.query);
+			lastQuery = scope.query + 1;
+		}
+	}
+	frameTime = (firstQuery != UINT32_MAX) ? toMilliseconds(timestamps[firstQuery], timestamps[lastQuery]) : 0.0f;
+	if (traceRecorder.isRecording()) {
+		auto toTraceTime = [this, period](uint64_t timestamp) {
+			return calibrationTime + static_cast<uint64_t>(static_cast<double>((timestamp - calibrationTimestamp) & timestampMask) * period);
+		};
+		for (const Scope& scope : frame.scopes) {
+			traceRecorder.addGpuZone(scope.name, toTraceTime(timestamps[scope.query]), toTraceTime(timestamps[scope.query + 1]));
+		}
+	}
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, bool collectStatistics)
+{
+	assert(openScopes.empty());
+	Frame& frame = frames[frameIndex];
+	readResults(frame);
+	currentFrame = &frame;
+	frame.statisticsRecorded = statisticsSupported && collectStatistics;
+	if (frame.statisticsRecorded) {
+		vkCmdResetQueryPool(commandBuffer, frame.statisticsQueryPool, 0, 1);
+		vkCmdBeginQuery(commandBuffer, frame.statisticsQueryPool, 0, 0);
+	}
+	if (!supported) {
+		return;
+	}
+	vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, maxScopes * 2);
+	frame.scopes.clear();
+	frame.queryCount = 0;
+	currentCommandBuffer = commandBuffer;
+	if (tracyContext) {
+		TracyVkCollect(tracyContext, commandBuffer);
+	}
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer commandBuffer)
+{
+	if (currentFrame && currentFrame->statisticsRecorded) {
+		vkCmdEndQuery(commandBuffer, currentFrame->statisticsQueryPool, 0);
+	}
+}
+
+// Timestamps are written once all previous commands have finished, so consecutive scopes don't overlap and add up to the frame's GPU time
+void GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name)
+{
+	if (!supported) {
+		return;
+	}
+#if defined(TRACY_ENABLE)
+	tracyZones.push_back(tracyContext ? new tracy::VkCtxScope(tracyContext, __LINE__, __FILE__, strlen(__FILE__), __FUNCTION__, strlen(__FUNCTION__), name, strlen(name), commandBuffer, true) : nullptr);
+#endif
+	if ((commandBuffer != currentCommandBuffer) || (currentFrame->scopes.size() >= maxScopes)) {
+		openScopes.push_back(UINT32_MAX);
+		return;
+	}
+	const uint32_t query = currentFrame->queryCount;
+	currentFrame->queryCount += 2;
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, currentFrame->queryPool, query);
+	openScopes.push_back(static_cast<uint32_t>(currentFrame->scopes.size()));
+	currentFrame->scopes.push_back({ .name = name, .depth = static_cast<uint32_t>(openScopes.size() - 1), .query = query });
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer)
+{
+	if (!supported) {
+		return;
+	}
+	assert(!openScopes.empty());
+#if defined(TRACY_ENABLE)
+	// The zone writes its end timestamp when destroyed
+	delete tracyZones.back();
+	tracyZones.pop_back();
+#endif
+	const uint32_t scopeIndex = openScopes.back();
+	openScopes.pop_back();
+	if (scopeIndex == UINT32_MAX) {
+		return;
+	}
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, currentFrame->queryPool, currentFrame->scopes[scopeIndex].query + 1);
+}
+
+const std::vector<GpuProfilerResult>& GpuProfiler::getResults() const
+{
+	return results;
+}
+
+float GpuProfiler::getFrameTime() const
+{
+	return frameTime;
+}
+
+bool GpuProfiler::isSupported() const
+{
+	return supported;
+}
+
+const PipelineStatistics& GpuProfiler::getPipelineStatistics() const
+{
+	return pipelineStatistics;
+}
+
+bool GpuProfiler::hasPipelineStatistics() const
+{
+	return statisticsSupported;
+}
@@ -0,0 +1,107 @@
+/*
+ * GPU timings of named command buffer scopes using timestamp queries
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "volk.h"
+#include "Device.hpp"
+#include "RenderStats.hpp"
+#include "TraceRecorder.h"
+#include "tracy/TracyVulkan.hpp"
+
+struct GpuProfilerCreateInfo {
+	Device& device;
+	VkQueue queue;
+	// Only used while creating the profiler, to calibrate the Tracy GPU context and the trace recorder's GPU track, must be resettable
+	VkCommandBuffer setupCommandBuffer;
+	uint32_t frameCount;
+	// Scopes beyond this number are not timed (but still sent to Tracy)
+	uint32_t maxScopes{ 64 };
+};
+
+/** @brief GPU time of a scope in milliseconds, depth is the number of enclosing scopes */
+struct GpuProfilerResult {
+	std::string name;
+	uint32_t depth{ 0 };
+	float time{ 0.0f };
+};
+
+/**
+ * Times named scopes of a frame's command buffer, with one query pool per frame in flight
+ * Results of a frame are read once its frame objects are reused, which is after the frame has been waited for, so reading them never stalls
+ * The timings shown are thus renderAhead frames behind the frame being recorded
+ * Scopes are also emitted as Tracy GPU zones, including scopes of command buffers recorded outside of the frame loop
+ * While the trace recorder is recording, the scopes of the frame loop are added to its GPU track once read
+ * If the device supports it, a pipeline statistics query spans each frame's command buffer
+ */
+class GpuProfiler {
+private:
+	struct Scope {
+		std::string name;
+		uint32_t depth;
+		uint32_t query;
+	};
+	struct Frame {
+		VkQueryPool queryPool{ VK_NULL_HANDLE };
+		VkQueryPool statisticsQueryPool{ VK_NULL_HANDLE };
+		std::vector<Scope> scopes;
+		uint32_t queryCount{ 0 };
+		bool statisticsRecorded{ false };
+	};
+	Device& device;
+	std::vector<Frame> frames;
+	uint32_t maxScopes;
+	// Frame that's currently being recorded and its command buffer, scopes of other command buffers are only sent to Tracy
+	Frame* currentFrame{ nullptr };
+	VkCommandBuffer currentCommandBuffer{ VK_NULL_HANDLE };
+	// Scope index of each open scope, UINT32_MAX for scopes that aren't timed
+	std::vector<uint32_t> openScopes;
+	std::vector<uint64_t> timestamps;
+	std::vector<GpuProfilerResult> results;
+	float frameTime{ 0.0f };
+	uint64_t timestampMask{ 0 };
+	bool supported{ false };
+	bool statisticsSupported{ false };
+	PipelineStatistics pipelineStatistics{};
+	// A GPU timestamp and the trace recorder's CPU time at that timestamp, for converting timestamps to CPU time
+	uint64_t calibrationTimestamp{ 0 };
+	uint64_t calibrationTime{ 0 };
+	TracyVkCtx tracyContext{ nullptr };
+#if defined(TRACY_ENABLE)
+	std::vector<tracy::VkCtxScope*> tracyZones;
+#endif
+	void calibrate(VkQueue queue, VkCommandBuffer commandBuffer);
+	void readResults(Frame& frame);
+public:
+	GpuProfiler(GpuProfilerCreateInfo createInfo);
+	~GpuProfiler();
+	/**
+	* Starts timing a frame, reads the timings of the last frame that used the same frame objects
+	* Needs to be called at the start of the frame's command buffer, outside of a rendering scope
+	*
+	* @param commandBuffer The frame's command buffer
+	* @param frameIndex Index of the frame's objects, the frame last submitted with these must have finished executing
+	* @param collectStatistics Begins the frame's pipeline statistics query, must be false if the frame executes secondary command buffers (as queries aren't inherited)
+	*/
+	void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, bool collectStatistics = true);
+	/** @brief Ends the frame's pipeline statistics query, needs to be called at the end of the frame's command buffer, outside of a rendering scope */
+	void endFrame(VkCommandBuffer commandBuffer);
+	void beginScope(VkCommandBuffer commandBuffer, const char* name);
+	void endScope(VkCommandBuffer commandBuffer);
+	// Timings of the last completed frame, in the order the scopes were started
+	const std::vector<GpuProfilerResult>& getResults() const;
+	// Time between the start of the first and the end of the last top level scope of the last completed frame in milliseconds
+	float getFrameTime() const;
+	bool isSupported() const;
+	// Pipeline statistics of the last completed frame that collected them
+	const PipelineStatistics& getPipelineStatistics() const;
+	bool hasPipelineStatistics() const;
+};
@@ -0,0 +1,215 @@
+/*
+ * Recording and deterministic replay of per-frame input
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "InputRecorder.h"
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+
+// File layout: Header, followed by one frame after another
+// Frame: delta time (float), cursor position (2 floats), flags (uint8), [key states], [game pad axes], key press count (uint8), key presses (uint8 each)
+static constexpr uint32_t recordingMagic = 0x52494b56; // "VKIR"
+static constexpr uint32_t recordingVersion = 1;
+static constexpr size_t keyStateSize = (sf::Keyboard::KeyCount + 7) / 8;
+// Recordings are flushed to disk in intervals
+static constexpr uint32_t flushInterval = 256;
+
+struct RecordingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seed;
+	uint32_t keyCount;
+};
+
+enum FrameFlags : uint8_t {
+	flagMouseLeft = 1,
+	flagMouseRight = 2,
+	flagMouseMiddle = 4,
+	// Key states changed and are stored with the frame
+	flagKeyStates = 8,
+	// Axes are only stored if one of them is deflected
+	flagGamePadAxes = 16,
+};
+
+static int16_t packAxis(float value)
+{
+	return static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+static float unpackAxis(int16_t value)
+{
+	return static_cast<float>(value) / 32767.0f;
+}
+
+bool InputRecorder::startRecording(const std::string& fileName, uint32_t seed)
+{
+	file.open(fileName, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "Could not create input recording " << fileName << "\n";
+		return false;
+	}
+	const RecordingHeader header{ .magic = recordingMagic, .version = recordingVersion, .seed = seed, .keyCount = sf::Keyboard::KeyCount };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	this->seed = seed;
+	mode = Mode::recording;
+	return true;
+}
+
+bool InputRecorder::startReplay(const std::string& fileName)
+{
+	std::ifstream input(fileName, std::ios::binary | std::ios::ate);
+	if (!input.is_open()) {
+		std::cerr << "Could not open input recording " << fileName << "\n";
+		return false;
+	}
+	const std::streamsize size = input.tellg();
+	input.seekg(0, std::ios::beg);
+	replayData.resize(static_cast<size_t>(size));
+	input.read(reinterpret_cast<char*>(replayData.data()), size);
+	RecordingHeader header{};
+	replayOffset = 0;
+	if (!read(&header, sizeof(header)) || header.magic != recordingMagic || header.version != recordingVersion || header.keyCount != sf::Keyboard::KeyCount) {
+		std::cerr << fileName << " is not a valid input recording for this version\n";
+		replayData.clear();
+		return false;
+	}
+	seed = header.seed;
+	mode = Mode::replaying;
+	return true;
+}
+
+bool InputRecorder::isRecording() const
+{
+	return mode == Mode::recording;
+}
+
+bool InputRecorder::isReplaying() const
+{
+	return mode == Mode::replaying;
+}
+
+bool InputRecorder::isFinished() const
+{
+	return replayOffset >= replayData.size();
+}
+
+uint32_t InputRecorder::getSeed() const
+{
+	return seed;
+}
+
+uint32_t InputRecorder::getFrameIndex() const
+{
+	return frameIndex;
+}
+
+void InputRecorder::writeFrame(const InputFrame& frame)
+{
+	if (mode != Mode::recording) {
+		return;
+	}
+	const bool keysChanged = (frameIndex == 0) || (frame.keys != previousKeys);
+	const bool axesDeflected = (frame.axisLeft != glm::vec2(0.0f)) || (frame.axisRight != glm::vec2(0.0f));
+	uint8_t flags = 0;
+	flags |= frame.mouseLeft ? flagMouseLeft : 0;
+	flags |= frame.mouseRight ? flagMouseRight : 0;
+	flags |= frame.mouseMiddle ? flagMouseMiddle : 0;
+	flags |= keysChanged ? flagKeyStates : 0;
+	flags |= axesDeflected ? flagGamePadAxes : 0;
+	file.write(reinterpret_cast<const char*>(&frame.deltaTime), sizeof(float));
+	file.write(reinterpret_cast<const char*>(&frame.cursorPos), sizeof(glm::vec2));
+	file.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+	if (keysChanged) {
+		uint8_t keyState[keyStateSize]{};
+		for (size_t i = 0; i < frame.keys.size(); i++) {
+			if (frame.keys.test(i)) {
+				keyState[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+			}
+		}
+		file.write(reinterpret_cast<const char*>(keyState), keyStateSize);
+		previousKeys = frame.keys;
+	}
+	if (axesDeflected) {
+		const int16_t axes[4] = { packAxis(frame.axisLeft.x), packAxis(frame.axisLeft.y), packAxis(frame.axisRight.x), packAxis(frame.axisRight.y) };
+		file.write(reinterpret_cast<const char*>(axes), sizeof(axes));
+	}
+	// Presses of keys without a code can't be replayed
+	std::vector<uint8_t> keyPresses;
+	for (sf::Keyboard::Key key : frame.keyPresses) {
+		if (key >= 0 && key < sf::Keyboard::KeyCount && keyPresses.size() < 255) {
+			keyPresses.push_back(static_cast<uint8_t>(key));
+		}
+	}
+	const uint8_t keyPressCount = static_cast<uint8_t>(keyPresses.size());
+	file.write(reinterpret_cast<const char*>(&keyPressCount), sizeof(keyPressCount));
+	file.write(reinterpret_cast<const char*>(keyPresses.data()), keyPresses.size());
+	frameIndex++;
+	if (frameIndex % flushInterval == 0) {
+		file.flush();
+	}
+}
+
+bool InputRecorder::read(void* data, size_t size)
+{
+	if (replayOffset + size > replayData.size()) {
+		// A truncated frame ends the replay
+		replayOffset = replayData.size();
+		return false;
+	}
+	memcpy(data, replayData.data() + replayOffset, size);
+	replayOffset += size;
+	return true;
+}
+
+bool InputRecorder::readFrame(InputFrame& frame)
+{
+	if (mode != Mode::replaying || isFinished()) {
+		return false;
+	}
+	InputFrame result{};
+	uint8_t flags = 0;
+	if (!read(&result.deltaTime, sizeof(float)) || !read(&result.cursorPos, sizeof(glm::vec2)) || !read(&flags, sizeof(flags))) {
+		return false;
+	}
+	result.mouseLeft = (flags & flagMouseLeft) != 0;
+	result.mouseRight = (flags & flagMouseRight) != 0;
+	result.mouseMiddle = (flags & flagMouseMiddle) != 0;
+	if (flags & flagKeyStates) {
+		uint8_t keyState[keyStateSize];
+		if (!read(keyState, keyStateSize)) {
+			return false;
+		}
+		for (size_t i = 0; i < previousKeys.size(); i++) {
+			previousKeys.set(i, (keyState[i / 8] & (1u << (i % 8))) != 0);
+		}
+	}
+	result.keys = previousKeys;
+	if (flags & flagGamePadAxes) {
+		int16_t axes[4];
+		if (!read(axes, sizeof(axes))) {
+			return false;
+		}
+		result.axisLeft = glm::vec2(unpackAxis(axes[0]), unpackAxis(axes[1]));
+		result.axisRight = glm::vec2(unpackAxis(axes[2]), unpackAxis(axes[3]));
+	}
+	uint8_t keyPressCount = 0;
+	if (!read(&keyPressCount, sizeof(keyPressCount))) {
+		return false;
+	}
+	for (uint8_t i = 0; i < keyPressCount; i++) {
+		uint8_t key;
+		if (!read(&key, sizeof(key))) {
+			return false;
+		}
+		result.keyPresses.push_back(static_cast<sf::Keyboard::Key>(key));
+	}
+	frame = result;
+	frameIndex++;
+	return true;
+}
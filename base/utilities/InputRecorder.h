@@ -0,0 +1,75 @@
+/*
+ * Recording and deterministic replay of per-frame input
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <bitset>
+#include <fstream>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <SFML/Window/Keyboard.hpp>
+
+/** @brief Input of a single frame, either sampled from the devices or read from a recording */
+struct InputFrame {
+	// Seconds the frame advanced animations and simulation by, replaces the measured frame time on replay
+	float deltaTime{ 0.0f };
+	// Cursor position relative to the window size, so recordings can be replayed at a different resolution
+	glm::vec2 cursorPos{ 0.0f };
+	bool mouseLeft{ false };
+	bool mouseRight{ false };
+	bool mouseMiddle{ false };
+	glm::vec2 axisLeft{ 0.0f };
+	glm::vec2 axisRight{ 0.0f };
+	// Keys held down during the frame, indexed by sf::Keyboard::Key
+	std::bitset<sf::Keyboard::KeyCount> keys;
+	// Keys pressed since the previous frame in the order of their key pressed events
+	std::vector<sf::Keyboard::Key> keyPresses;
+};
+
+/**
+ * Writes the input of each frame to a compact binary file, or reads a recording back frame by frame
+ * The seed for random scene content is stored in the recording, so a replay that uses it together with the recorded frame times renders the same frames as the recorded session
+ */
+class InputRecorder {
+private:
+	enum class Mode { none, recording, replaying };
+	Mode mode{ Mode::none };
+	std::ofstream file;
+	std::vector<uint8_t> replayData;
+	size_t replayOffset{ 0 };
+	uint32_t frameIndex{ 0 };
+	uint32_t seed{ 0 };
+	// Key states are only stored for frames where they changed
+	std::bitset<sf::Keyboard::KeyCount> previousKeys;
+
+	bool read(void* data, size_t size);
+public:
+	/**
+	* Starts writing frames to a file, frames are streamed and flushed in intervals, so a session that ends unexpectedly keeps all but its last frames
+	*
+	* @param fileName Name of the recording
+	* @param seed Seed the application uses for random scene content
+	*
+	* @return False if the file couldn't be created
+	*/
+	bool startRecording(const std::string& fileName, uint32_t seed);
+	/** @brief Reads a recording for replay, returns false if it couldn't be read or isn't a valid recording */
+	bool startReplay(const std::string& fileName);
+	bool isRecording() const;
+	bool isReplaying() const;
+	// All frames of the replay have been read
+	bool isFinished() const;
+	uint32_t getSeed() const;
+	uint32_t getFrameIndex() const;
+	/** @brief Appends a frame to the recording */
+	void writeFrame(const InputFrame& frame);
+	/** @brief Reads the next frame of the replay, returns false if there are no frames left */
+	bool readFrame(InputFrame& frame);
+};
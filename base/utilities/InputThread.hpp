@@ -0,0 +1,150 @@
+/*
+ * Input sampling on a dedicated thread
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <SFML/Window.hpp>
+#include "ThreadConfig.hpp"
+
+/** @brief Change of a key, a mouse button or the cursor position, timestamped when it was sampled */
+struct InputEvent {
+	enum class Type : uint8_t { KeyDown, KeyUp, ButtonDown, ButtonUp, CursorMove };
+	Type type{ Type::KeyDown };
+	// sf::Keyboard::Key for key events, sf::Mouse::Button for button events
+	int32_t code{ 0 };
+	// Window relative cursor position for cursor events
+	glm::ivec2 position{ 0 };
+	std::chrono::high_resolution_clock::time_point timestamp{};
+};
+
+/**
+ * Samples keyboard, mouse buttons and the cursor position on its own thread at a fixed rate and queues their changes for the render loop
+ * Sampling doesn't wait for frames, so a slow frame delays when input is applied but not when it's recorded, and the render loop can take the latest state right before it updates the camera
+ * Window events (e.g. closing or key presses with repeats for shortcuts) are still handled by the render loop, as they can only be polled on the thread that created the window
+ * Keys and buttons count as released while the window isn't focused
+ */
+class InputThread {
+private:
+	// Single producer (input thread) and single consumer (render loop) ring buffer, events are dropped if the consumer doesn't keep up
+	static constexpr size_t queueSize = 1024;
+	std::array<InputEvent, queueSize> queue{};
+	alignas(64) std::atomic<size_t> head{ 0 };
+	alignas(64) std::atomic<size_t> tail{ 0 };
+	std::atomic<uint64_t> droppedEvents{ 0 };
+
+	std::thread thread;
+	std::atomic<bool> active{ false };
+	const sf::WindowBase* window{ nullptr };
+
+	// Only accessed by the input thread
+	std::bitset<sf::Keyboard::KeyCount> keys;
+	std::array<bool, sf::Mouse::ButtonCount> buttons{};
+	glm::ivec2 cursorPosition{ INT32_MIN };
+
+	void push(const InputEvent& event) {
+		const size_t currentHead = head.load(std::memory_order_relaxed);
+		if (currentHead - tail.load(std::memory_order_acquire) >= queueSize) {
+			droppedEvents.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		queue[currentHead % queueSize] = event;
+		head.store(currentHead + 1, std::memory_order_release);
+	}
+
+	void sample() {
+		const auto now = std::chrono::high_resolution_clock::now();
+		const bool focused = window->hasFocus();
+		for (int key = 0; key < sf::Keyboard::KeyCount; key++) {
+			const bool pressed = focused && sf::Keyboard::isKeyPressed(static_cast<sf::Keyboard::Key>(key));
+			if (pressed != keys.test(key)) {
+				keys.set(key, pressed);
+				push({ .type = pressed ? InputEvent::Type::KeyDown : InputEvent::Type::KeyUp, .code = key, .timestamp = now });
+			}
+		}
+		for (int button = 0; button < sf::Mouse::ButtonCount; button++) {
+			const bool pressed = focused && sf::Mouse::isButtonPressed(static_cast<sf::Mouse::Button>(button));
+			if (pressed != buttons[button]) {
+				buttons[button] = pressed;
+				push({ .type = pressed ? InputEvent::Type::ButtonDown : InputEvent::Type::ButtonUp, .code = button, .timestamp = now });
+			}
+		}
+		const sf::Vector2i position = sf::Mouse::getPosition(*window);
+		if ((position.x != cursorPosition.x) || (position.y != cursorPosition.y)) {
+			cursorPosition = glm::ivec2(position.x, position.y);
+			push({ .type = InputEvent::Type::CursorMove, .position = cursorPosition, .timestamp = now });
+		}
+	}
+
+	void run() {
+		// Input is sampled in short intervals, so it must not wait for cores behind other work
+		vks::threading::setCurrentThreadPriority(vks::threading::Priority::High);
+		auto nextSample = std::chrono::high_resolution_clock::now();
+		while (active) {
+			sample();
+			nextSample += sampleInterval;
+			const auto now = std::chrono::high_resolution_clock::now();
+			if (nextSample < now) {
+				// Fell behind (e.g. the thread wasn't scheduled), so the missed samples aren't caught up in a burst
+				nextSample = now;
+			}
+			std::this_thread::sleep_until(nextSample);
+		}
+	}
+public:
+	// Time between two samples of the devices
+	std::chrono::microseconds sampleInterval{ 1000 };
+
+	~InputThread() {
+		stop();
+	}
+
+	/** @brief Starts sampling the input for the given window, which needs to stay valid while the thread is running */
+	void start(const sf::WindowBase* window) {
+		if (active) {
+			return;
+		}
+		this->window = window;
+		active = true;
+		thread = std::thread(&InputThread::run, this);
+	}
+
+	void stop() {
+		if (!active) {
+			return;
+		}
+		active = false;
+		thread.join();
+	}
+
+	bool isRunning() const {
+		return active;
+	}
+
+	/** @brief Moves all queued events to the end of events in the order they were sampled, only to be called from a single thread */
+	void poll(std::vector<InputEvent>& events) {
+		const size_t currentTail = tail.load(std::memory_order_relaxed);
+		const size_t currentHead = head.load(std::memory_order_acquire);
+		for (size_t i = currentTail; i < currentHead; i++) {
+			events.push_back(queue[i % queueSize]);
+		}
+		tail.store(currentHead, std::memory_order_release);
+	}
+
+	// Events that didn't fit into the queue since the thread started
+	uint64_t getDroppedEventCount() const {
+		return droppedEvents.load(std::memory_order_relaxed);
+	}
+};
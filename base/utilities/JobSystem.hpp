@@ -0,0 +1,441 @@
+/*
+ * Work stealing job system
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <chrono>
+#include <cassert>
+#include <string>
+#include "TraceRecorder.h"
+#include "ThreadConfig.hpp"
+#include "ProfiledMutex.hpp"
+
+namespace vks
+{
+	/**
+	 * A single unit of work
+	 * unfinishedJobs counts the job itself plus all of its unfinished children, the job is done once it reaches zero
+	 */
+	struct Job
+	{
+		std::function<void()> function;
+		Job* parent{ nullptr };
+		std::atomic<int32_t> unfinishedJobs{ 0 };
+	};
+
+	/**
+	 * Lock-free Chase-Lev work stealing deque (Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models")
+	 * push and pop must only be called by the owning thread, steal can be called from any thread
+	 */
+	class WorkStealingQueue
+	{
+	public:
+		static constexpr int64_t capacity = 4096;
+	private:
+		static constexpr int64_t mask = capacity - 1;
+		std::atomic<int64_t> top{ 0 };
+		std::atomic<int64_t> bottom{ 0 };
+		std::array<std::atomic<Job*>, capacity> buffer{};
+	public:
+		void push(Job* job)
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed);
+			assert(b - top.load(std::memory_order_acquire) < capacity);
+			buffer[b & mask].store(job, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		Job* pop()
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = top.load(std::memory_order_relaxed);
+			if (t > b) {
+				// Queue is empty
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			Job* job = buffer[b & mask].load(std::memory_order_relaxed);
+			if (t == b) {
+				// Last job in the queue, race against concurrent steals
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					job = nullptr;
+				}
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		Job* steal()
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = bottom.load(std::memory_order_acquire);
+			if (t >= b) {
+				return nullptr;
+			}
+			Job* job = buffer[t & mask].load(std::memory_order_relaxed);
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				// Lost the race against another thief or the owner
+				return nullptr;
+			}
+			return job;
+		}
+	};
+
+	/**
+	 * Work stealing job system with one deque per thread
+	 * The thread constructing the job system becomes thread 0 and executes jobs while waiting, so only threadCount - 1 workers are started
+	 * Jobs must only be created and run from threads owned by the job system
+	 * Job handles are taken from a per-thread ring buffer and are only valid until maxJobsPerThread further jobs have been created on that thread, long running jobs should use createBackgroundJob instead
+	 */
+	class JobSystem
+	{
+	public:
+		static constexpr uint32_t maxJobsPerThread = WorkStealingQueue::capacity;
+	private:
+		struct ThreadData {
+			WorkStealingQueue queue;
+			std::array<Job, maxJobsPerThread> jobs;
+			uint32_t allocatedJobs{ 0 };
+			uint32_t randomState{ 0 };
+			// Time spent executing jobs, read by other threads for utilization statistics
+			std::atomic<int64_t> busyNanoseconds{ 0 };
+			// Time spent asleep while there were no jobs (workers only)
+			std::atomic<int64_t> sleepNanoseconds{ 0 };
+			std::atomic<uint64_t> executedJobs{ 0 };
+			// Jobs taken from the queues of other threads
+			std::atomic<uint64_t> stolenJobs{ 0 };
+		};
+		std::vector<std::unique_ptr<ThreadData>> threadData;
+		std::vector<std::thread> workers;
+		std::atomic<bool> running{ true };
+		// Used to put workers to sleep while there are no jobs
+		std::atomic<int32_t> pendingJobs{ 0 };
+		ProfiledMutex wakeMutex{ "Job system wake" };
+		std::condition_variable_any wakeCondition;
+		// Long running jobs are kept out of the work stealing queues, so they're never picked up by a thread waiting for other work
+		std::deque<Job*> backgroundJobs;
+		ProfiledMutex backgroundMutex{ "Background jobs" };
+
+		static inline thread_local uint32_t threadIndex{ UINT32_MAX };
+		// Jobs executed while a job waits for others are part of the waiting job's busy time
+		static inline thread_local uint32_t executionDepth{ 0 };
+
+		ThreadData& getThreadData()
+		{
+			assert(threadIndex < threadData.size());
+			return *threadData[threadIndex];
+		}
+
+		Job* getBackgroundJob()
+		{
+			std::lock_guard<ProfiledMutex> lock(backgroundMutex);
+			if (backgroundJobs.empty()) {
+				return nullptr;
+			}
+			Job* job = backgroundJobs.front();
+			backgroundJobs.pop_front();
+			pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+			return job;
+		}
+
+		Job* getJob()
+		{
+			ThreadData& data = getThreadData();
+			Job* job = data.queue.pop();
+			if (!job) {
+				// Own queue is empty, try to steal from a random other thread
+				const uint32_t threadCount = static_cast<uint32_t>(threadData.size());
+				data.randomState ^= data.randomState << 13;
+				data.randomState ^= data.randomState >> 17;
+				data.randomState ^= data.randomState << 5;
+				const uint32_t start = data.randomState % threadCount;
+				for (uint32_t i = 0; i < threadCount && !job; i++) {
+					const uint32_t victim = (start + i) % threadCount;
+					if (victim != threadIndex) {
+						job = threadData[victim]->queue.steal();
+					}
+				}
+				if (job) {
+					data.stolenJobs.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			if (job) {
+				pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		void finish(Job* job)
+		{
+			// The job may be reused or deleted as soon as it's finished, so it must not be accessed after the decrement
+			Job* parent = job->parent;
+			if (job->unfinishedJobs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				if (parent) {
+					finish(parent);
+				}
+			}
+		}
+
+		void execute(Job* job)
+		{
+			const bool outermost = (executionDepth++ == 0);
+			const auto start = outermost ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+			if (job->function) {
+				job->function();
+			}
+			if (outermost) {
+				const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+				getThreadData().busyNanoseconds.fetch_add(duration.count(), std::memory_order_relaxed);
+			}
+			getThreadData().executedJobs.fetch_add(1, std::memory_order_relaxed);
+			executionDepth--;
+			finish(job);
+		}
+
+		void workerLoop(uint32_t index)
+		{
+			threadIndex = index;
+			traceRecorder.setThreadName("Worker " + std::to_string(index));
+			// Workers run the frame's recording jobs, which shouldn't be moved to efficiency cores
+			threading::pinCurrentThreadToPerformanceCores();
+			while (running) {
+				if (Job* job = getJob()) {
+					execute(job);
+					continue;
+				}
+				if (Job* job = getBackgroundJob()) {
+					threading::BackgroundScope backgroundScope;
+					execute(job);
+					continue;
+				}
+				std::unique_lock<ProfiledMutex> lock(wakeMutex);
+				const auto sleepStart = std::chrono::steady_clock::now();
+				wakeCondition.wait(lock, [this] { return pendingJobs.load() > 0 || !running; });
+				const auto sleepDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sleepStart);
+				getThreadData().sleepNanoseconds.fetch_add(sleepDuration.count(), std::memory_order_relaxed);
+			}
+		}
+
+	public:
+		// Defaults to one thread per physical performance core, as jobs on SMT siblings or efficiency cores would hold up the frame's other jobs
+		JobSystem(uint32_t threadCount = threading::getPerformanceCoreCount())
+		{
+			threadCount = std::max(threadCount, 1u);
+			for (uint32_t i = 0; i < threadCount; i++) {
+				threadData.push_back(std::make_unique<ThreadData>());
+				threadData.back()->randomState = 0x9E3779B9u * (i + 1);
+			}
+			threadIndex = 0;
+			for (uint32_t i = 1; i < threadCount; i++) {
+				workers.emplace_back(&JobSystem::workerLoop, this, i);
+			}
+		}
+
+		~JobSystem()
+		{
+			{
+				std::lock_guard<ProfiledMutex> lock(wakeMutex);
+				running = false;
+			}
+			wakeCondition.notify_all();
+			for (auto& worker : workers) {
+				worker.join();
+			}
+		}
+
+		uint32_t getThreadCount() const
+		{
+			return static_cast<uint32_t>(threadData.size());
+		}
+
+		// Total time a thread has spent executing jobs since the job system was created
+		std::chrono::nanoseconds getBusyTime(uint32_t thread) const
+		{
+			return std::chrono::nanoseconds(threadData[thread]->busyNanoseconds.load(std::memory_order_relaxed));
+		}
+
+		// Totals of a thread since the job system was created, the time neither busy nor asleep is spent looking for jobs (or outside of the job system for the main thread)
+		struct ThreadStats {
+			std::chrono::nanoseconds busyTime;
+			std::chrono::nanoseconds sleepTime;
+			uint64_t executedJobs;
+			uint64_t stolenJobs;
+		};
+		ThreadStats getThreadStats(uint32_t thread) const
+		{
+			const ThreadData& data = *threadData[thread];
+			return {
+				.busyTime = std::chrono::nanoseconds(data.busyNanoseconds.load(std::memory_order_relaxed)),
+				.sleepTime = std::chrono::nanoseconds(data.sleepNanoseconds.load(std::memory_order_relaxed)),
+				.executedJobs = data.executedJobs.load(std::memory_order_relaxed),
+				.stolenJobs = data.stolenJobs.load(std::memory_order_relaxed)
+			};
+		}
+
+		// Index of the calling thread in [0, getThreadCount()), can be used to select per-thread resources inside a job
+		uint32_t getThreadIndex() const
+		{
+			return threadIndex;
+		}
+
+		/**
+		* Creates a new job, which needs to be passed to run to be scheduled
+		*
+		* @param function Work to be executed
+		* @param parent (Optional) Parent job, which won't be finished until this job has been finished
+		*
+		* @return Handle to the new job
+		*/
+		Job* createJob(std::function<void()> function, Job* parent = nullptr)
+		{
+			ThreadData& data = getThreadData();
+			Job* job = &data.jobs[data.allocatedJobs++ % maxJobsPerThread];
+			assert(job->unfinishedJobs.load() == 0);
+			job->function = std::move(function);
+			job->parent = parent;
+			job->unfinishedJobs.store(1, std::memory_order_relaxed);
+			if (parent) {
+				parent->unfinishedJobs.fetch_add(1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		/**
+		* Creates a heap allocated job that isn't taken from the per-thread ring buffer, so it can stay in flight for any amount of time (e.g. background loading)
+		* Needs to be scheduled with runBackground, the caller owns the job and needs to delete it once it has finished
+		*
+		* @param function Work to be executed
+		*
+		* @return Handle to the new job
+		*/
+		Job* createBackgroundJob(std::function<void()> function)
+		{
+			Job* job = new Job();
+			job->function = std::move(function);
+			job->unfinishedJobs.store(1, std::memory_order_relaxed);
+			return job;
+		}
+
+		/**
+		* Reinitializes a finished job owned by the caller, so recurring background work doesn't need to allocate a new job each time
+		*
+		* @param job Job created with createBackgroundJob (or owned by the caller), must have finished
+		* @param function Work to be executed
+		*/
+		void resetBackgroundJob(Job* job, std::function<void()> function)
+		{
+			assert(isFinished(job));
+			job->function = std::move(function);
+			job->parent = nullptr;
+			job->unfinishedJobs.store(1, std::memory_order_relaxed);
+		}
+
+		void run(Job* job)
+		{
+			getThreadData().queue.push(job);
+			pendingJobs.fetch_add(1, std::memory_order_relaxed);
+			{
+				std::lock_guard<ProfiledMutex> lock(wakeMutex);
+			}
+			wakeCondition.notify_one();
+		}
+
+		// Schedules a background job, which is only executed by idle worker threads and never by the main thread. Can be called from any thread
+		// Urgent jobs are queued ahead of all other background jobs, e.g. for per-frame work that's waited for at the end of the frame
+		void runBackground(Job* job, bool urgent = false)
+		{
+			{
+				std::lock_guard<ProfiledMutex> lock(backgroundMutex);
+				if (urgent) {
+					backgroundJobs.push_front(job);
+				} else {
+					backgroundJobs.push_back(job);
+				}
+			}
+			pendingJobs.fetch_add(1, std::memory_order_relaxed);
+			{
+				std::lock_guard<ProfiledMutex> lock(wakeMutex);
+			}
+			wakeCondition.notify_one();
+		}
+
+		/**
+		* Runs function as a background job, or right away on the calling thread if there is no job system or it has no worker threads
+		* Background jobs are never executed by the main thread, so without workers they would only run once someone waits for them
+		*
+		* @param jobSystem (Optional) Job system to schedule the job with
+		* @param job Set to the new background job, which the caller owns and needs to delete once it has finished, untouched if function was run right away
+		* @param function Work to be executed
+		*
+		* @return True if function has been scheduled as a background job
+		*/
+		static bool runBackgroundOrInline(JobSystem* jobSystem, Job*& job, std::function<void()> function)
+		{
+			if (!jobSystem || (jobSystem->getThreadCount() <= 1)) {
+				function();
+				return false;
+			}
+			job = jobSystem->createBackgroundJob(std::move(function));
+			jobSystem->runBackground(job);
+			return true;
+		}
+
+		bool isFinished(const Job* job) const
+		{
+			return job->unfinishedJobs.load(std::memory_order_acquire) == 0;
+		}
+
+		// Waits for the job and all of its children, the calling thread executes other jobs in the meantime
+		void wait(const Job* job)
+		{
+			while (!isFinished(job)) {
+				if (Job* next = getJob()) {
+					execute(next);
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		/**
+		* Splits [0, count) into batches that are executed in parallel, returns once all batches have been processed
+		*
+		* @param count Number of elements
+		* @param batchSize Max. number of elements passed to a single invocation of function
+		* @param function Called with the first element and the number of elements of each batch
+		*/
+		void parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t first, uint32_t count)>& function)
+		{
+			if (count == 0) {
+				return;
+			}
+			batchSize = std::max(batchSize, 1u);
+			Job* root = createJob(nullptr);
+			for (uint32_t first = 0; first < count; first += batchSize) {
+				const uint32_t batchCount = std::min(batchSize, count - first);
+				run(createJob([&function, first, batchCount] { function(first, batchCount); }, root));
+			}
+			run(root);
+			wait(root);
+		}
+	};
+}
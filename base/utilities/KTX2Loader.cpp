@@ -0,0 +1,320 @@
+/*
+ * KTX and KTX2 texture file loaders
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "KTX2Loader.h"
+#include <cstring>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <iterator>
+#include <iostream>
+#include "VulkanContext.h"
+#include "VirtualFileSystem.h"
+#include "Device.hpp"
+#include "transcoder/basisu_transcoder.h"
+#include "zstd/zstd.h"
+#include "TraceRecorder.h"
+
+namespace vks
+{
+	static const uint8_t ktx2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	// Supercompression schemes
+	static const uint32_t ktx2SupercompressionNone = 0;
+	static const uint32_t ktx2SupercompressionZstd = 2;
+
+	struct KTX2Header {
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+
+	struct KTX2LevelIndex {
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	// Images are placed at offsets that satisfy the buffer to image copy alignment of all supported formats
+	static const VkDeviceSize imageAlignment = 16;
+
+	struct TranscodeTarget {
+		basist::transcoder_texture_format transcoderFormat;
+		VkFormat format;
+		VkFormat srgbFormat;
+	};
+
+	// In order of preference, the first one the device can sample from is used
+	static const TranscodeTarget transcodeTargets[] = {
+		{ basist::transcoder_texture_format::cTFBC7_RGBA, VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK },
+		{ basist::transcoder_texture_format::cTFASTC_4x4_RGBA, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, VK_FORMAT_ASTC_4x4_SRGB_BLOCK },
+		{ basist::transcoder_texture_format::cTFETC2_RGBA, VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK },
+		{ basist::transcoder_texture_format::cTFRGBA32, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB },
+	};
+
+	static const uint8_t ktxIdentifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+	static const uint32_t ktxEndianness = 0x04030201;
+
+	struct KTXHeader {
+		uint8_t identifier[12];
+		uint32_t endianness;
+		uint32_t glType;
+		uint32_t glTypeSize;
+		uint32_t glFormat;
+		uint32_t glInternalFormat;
+		uint32_t glBaseInternalFormat;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t numberOfArrayElements;
+		uint32_t numberOfFaces;
+		uint32_t numberOfMipmapLevels;
+		uint32_t bytesOfKeyValueData;
+	};
+
+	static const TranscodeTarget& selectTranscodeTarget(bool srgb)
+	{
+		for (const TranscodeTarget& target : transcodeTargets) {
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(VulkanContext::device->physicalDevice, srgb ? target.srgbFormat : target.format, &formatProperties);
+			if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) {
+				return target;
+			}
+		}
+		return transcodeTargets[std::size(transcodeTargets) - 1];
+	}
+
+	// Reserves space for all images, so they can be written to their final location in parallel
+	static void allocateImages(TextureData& target, const std::vector<VkDeviceSize>& imageSizes)
+	{
+		VkDeviceSize offset = 0;
+		target.sizes = imageSizes;
+		target.offsets.resize(imageSizes.size());
+		for (size_t i = 0; i < imageSizes.size(); i++) {
+			target.offsets[i] = offset;
+			offset = (offset + imageSizes[i] + imageAlignment - 1) & ~(imageAlignment - 1);
+		}
+		target.data.resize(offset);
+	}
+
+	// Basis Universal files (ETC1S or UASTC) are transcoded image by image, each job uses its own transcoder state so they can run concurrently
+	static bool transcodeBasisFile(const MappedFile& contents, bool srgb, TextureData& target, JobSystem* jobSystem)
+	{
+		static std::once_flag initFlag;
+		std::call_once(initFlag, [] { basist::basisu_transcoder_init(); });
+
+		basist::ktx2_transcoder transcoder;
+		if (!transcoder.init(contents.data(), static_cast<uint32_t>(contents.size())) || !transcoder.start_transcoding()) {
+			return false;
+		}
+
+		const TranscodeTarget& transcodeTarget = selectTranscodeTarget(srgb);
+		const bool uncompressed = basist::basis_transcoder_format_is_uncompressed(transcodeTarget.transcoderFormat);
+		const uint32_t bytesPerBlock = basist::basis_get_bytes_per_block_or_pixel(transcodeTarget.transcoderFormat);
+
+		target.format = srgb ? transcodeTarget.srgbFormat : transcodeTarget.format;
+		target.width = transcoder.get_width();
+		target.height = transcoder.get_height();
+		target.mipLevels = std::max(transcoder.get_levels(), 1u);
+		target.layerCount = std::max(transcoder.get_layers(), 1u);
+		target.faceCount = transcoder.get_faces();
+
+		const uint32_t imageCount = target.mipLevels * target.layerCount * target.faceCount;
+		std::vector<basist::ktx2_image_level_info> levelInfos(imageCount);
+		std::vector<VkDeviceSize> imageSizes(imageCount);
+		for (uint32_t level = 0; level < target.mipLevels; level++) {
+			for (uint32_t layer = 0; layer < target.layerCount; layer++) {
+				for (uint32_t face = 0; face < target.faceCount; face++) {
+					const uint32_t index = (level * target.layerCount + layer) * target.faceCount + face;
+					if (!transcoder.get_image_level_info(levelInfos[index], level, layer, face)) {
+						return false;
+					}
+					const basist::ktx2_image_level_info& info = levelInfos[index];
+					imageSizes[index] = static_cast<VkDeviceSize>(uncompressed ? info.m_orig_width * info.m_orig_height : info.m_total_blocks) * bytesPerBlock;
+				}
+			}
+		}
+		allocateImages(target, imageSizes);
+
+		std::atomic<bool> failed{ false };
+		auto transcodeImages = [&](uint32_t first, uint32_t count) {
+			TraceZoneScopedN("Transcode KTX2 images");
+			basist::ktx2_transcoder_state state;
+			for (uint32_t index = first; index < first + count; index++) {
+				const uint32_t face = index % target.faceCount;
+				const uint32_t layer = (index / target.faceCount) % target.layerCount;
+				const uint32_t level = index / (target.faceCount * target.layerCount);
+				const basist::ktx2_image_level_info& info = levelInfos[index];
+				const uint32_t outputSize = uncompressed ? info.m_orig_width * info.m_orig_height : info.m_total_blocks;
+				if (!transcoder.transcode_image_level(level, layer, face, target.data.data() + target.offsets[index], outputSize, transcodeTarget.transcoderFormat, 0, uncompressed ? info.m_orig_width : 0, uncompressed ? info.m_orig_height : 0, -1, -1, &state)) {
+					failed = true;
+				}
+			}
+		};
+		if (jobSystem) {
+			jobSystem->parallelFor(imageCount, 1, transcodeImages);
+		} else {
+			transcodeImages(0, imageCount);
+		}
+		return !failed;
+	}
+
+	// Files that are stored in a Vulkan format are used as is, zstd supercompressed ones are decompressed to host memory
+	static bool loadRawFile(const std::shared_ptr<MappedFile>& file, const KTX2Header& header, TextureData& target, JobSystem* jobSystem)
+	{
+		if (header.supercompressionScheme != ktx2SupercompressionNone && header.supercompressionScheme != ktx2SupercompressionZstd) {
+			return false;
+		}
+
+		target.format = static_cast<VkFormat>(header.vkFormat);
+		target.width = header.pixelWidth;
+		target.height = std::max(header.pixelHeight, 1u);
+		target.mipLevels = std::max(header.levelCount, 1u);
+		target.layerCount = std::max(header.layerCount, 1u);
+		target.faceCount = header.faceCount;
+
+		const MappedFile& contents = *file;
+		std::vector<KTX2LevelIndex> levels(target.mipLevels);
+		if (contents.size() < sizeof(KTX2Header) + levels.size() * sizeof(KTX2LevelIndex)) {
+			return false;
+		}
+		memcpy(levels.data(), contents.data() + sizeof(KTX2Header), levels.size() * sizeof(KTX2LevelIndex));
+
+		// All images of a level have the same size and are stored consecutively
+		const uint32_t imagesPerLevel = target.layerCount * target.faceCount;
+		std::vector<VkDeviceSize> imageSizes;
+		for (const KTX2LevelIndex& level : levels) {
+			if (level.byteOffset + level.byteLength > contents.size()) {
+				return false;
+			}
+			imageSizes.insert(imageSizes.end(), imagesPerLevel, level.uncompressedByteLength / imagesPerLevel);
+		}
+
+		// Without supercompression, the images are read from the mapped file directly
+		if (header.supercompressionScheme == ktx2SupercompressionNone) {
+			target.file = file;
+			target.sizes = imageSizes;
+			for (uint32_t level = 0; level < target.mipLevels; level++) {
+				for (uint32_t image = 0; image < imagesPerLevel; image++) {
+					target.offsets.push_back(levels[level].byteOffset + image * imageSizes[level * imagesPerLevel]);
+				}
+			}
+			return true;
+		}
+
+		allocateImages(target, imageSizes);
+
+		std::atomic<bool> failed{ false };
+		auto loadLevels = [&](uint32_t first, uint32_t count) {
+			std::vector<uint8_t> decompressed;
+			for (uint32_t level = first; level < first + count; level++) {
+				decompressed.resize(levels[level].uncompressedByteLength);
+				const size_t size = ZSTD_decompress(decompressed.data(), decompressed.size(), contents.data() + levels[level].byteOffset, levels[level].byteLength);
+				if (ZSTD_isError(size) || size != decompressed.size()) {
+					failed = true;
+					continue;
+				}
+				const uint8_t* levelData = decompressed.data();
+				const VkDeviceSize imageSize = levels[level].uncompressedByteLength / imagesPerLevel;
+				for (uint32_t image = 0; image < imagesPerLevel; image++) {
+					memcpy(target.data.data() + target.offsets[level * imagesPerLevel + image], levelData + image * imageSize, imageSize);
+				}
+			}
+		};
+		if (jobSystem) {
+			jobSystem->parallelFor(target.mipLevels, 1, loadLevels);
+		} else {
+			loadLevels(0, target.mipLevels);
+		}
+		return !failed;
+	}
+
+	bool isKTX2File(const std::string& filename)
+	{
+		const auto file = vfs::open(filename);
+		return file && (file->size() >= sizeof(ktx2Identifier)) && (memcmp(file->data(), ktx2Identifier, sizeof(ktx2Identifier)) == 0);
+	}
+
+	bool loadKTX2File(const std::string& filename, bool srgb, TextureData& target, JobSystem* jobSystem)
+	{
+		TraceZoneScopedN("Load KTX2 file");
+		auto file = vfs::open(filename);
+		if (!file || file->size() < sizeof(KTX2Header)) {
+			std::cerr << "Could not read KTX2 file " << filename << std::endl;
+			return false;
+		}
+		KTX2Header header;
+		memcpy(&header, file->data(), sizeof(KTX2Header));
+		if (memcmp(header.identifier, ktx2Identifier, sizeof(ktx2Identifier)) != 0 || header.pixelDepth > 1) {
+			std::cerr << "Unsupported KTX2 file " << filename << std::endl;
+			return false;
+		}
+		// Basis Universal payloads don't have a Vulkan format
+		const bool result = (header.vkFormat == VK_FORMAT_UNDEFINED) ? transcodeBasisFile(*file, srgb, target, jobSystem) : loadRawFile(file, header, target, jobSystem);
+		if (!result) {
+			std::cerr << "Could not load KTX2 file " << filename << std::endl;
+		}
+		return result;
+	}
+
+	bool mapKTXFile(const std::string& filename, VkFormat format, TextureData& target)
+	{
+		TraceZoneScopedN("Map KTX file");
+		auto file = vfs::open(filename);
+		if (!file || file->size() < sizeof(KTXHeader)) {
+			return false;
+		}
+		KTXHeader header;
+		memcpy(&header, file->data(), sizeof(KTXHeader));
+		// Files written on big endian machines would need their images to be byte swapped
+		if (memcmp(header.identifier, ktxIdentifier, sizeof(ktxIdentifier)) != 0 || header.endianness != ktxEndianness || header.numberOfArrayElements > 1 || header.pixelDepth > 1) {
+			return false;
+		}
+
+		target.format = format;
+		target.width = header.pixelWidth;
+		target.height = std::max(header.pixelHeight, 1u);
+		target.mipLevels = std::max(header.numberOfMipmapLevels, 1u);
+		target.layerCount = 1;
+		target.faceCount = header.numberOfFaces;
+
+		// Each level starts with its image size, followed by the images of all faces, each one padded to four bytes
+		VkDeviceSize offset = sizeof(KTXHeader) + header.bytesOfKeyValueData;
+		for (uint32_t level = 0; level < target.mipLevels; level++) {
+			if (offset + sizeof(uint32_t) > file->size()) {
+				return false;
+			}
+			uint32_t imageSize;
+			memcpy(&imageSize, file->data() + offset, sizeof(uint32_t));
+			offset += sizeof(uint32_t);
+			for (uint32_t face = 0; face < target.faceCount; face++) {
+				if (offset + imageSize > file->size()) {
+					return false;
+				}
+				target.offsets.push_back(offset);
+				target.sizes.push_back(imageSize);
+				offset = (offset + imageSize + 3) & ~VkDeviceSize(3);
+			}
+		}
+		target.file = file;
+		return true;
+	}
+}
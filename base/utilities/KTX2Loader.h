@@ -0,0 +1,94 @@
+/*
+ * KTX and KTX2 texture file loaders
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "volk.h"
+#include "JobSystem.hpp"
+#include "MappedFile.hpp"
+
+namespace vks
+{
+	/** @brief All images of a texture file, ready to be copied to a VkImage */
+	struct TextureData {
+		VkFormat format{ VK_FORMAT_UNDEFINED };
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		uint32_t mipLevels{ 1 };
+		uint32_t layerCount{ 1 };
+		uint32_t faceCount{ 1 };
+		std::vector<uint8_t> data;
+		// If set, the images are read from the memory mapped file instead of data, so files that don't need decoding are never copied to the heap
+		std::shared_ptr<MappedFile> file;
+		// Offset of each image in data (or the file), ordered by level, then layer, then face
+		std::vector<VkDeviceSize> offsets;
+		// Size of each image, same order as offsets
+		std::vector<VkDeviceSize> sizes;
+
+		uint32_t getImageIndex(uint32_t level, uint32_t layer, uint32_t face) const
+		{
+			return (level * layerCount + layer) * faceCount + face;
+		}
+
+		VkDeviceSize getOffset(uint32_t level, uint32_t layer, uint32_t face) const
+		{
+			return offsets[getImageIndex(level, layer, face)];
+		}
+
+		const uint8_t* getImage(uint32_t level, uint32_t layer, uint32_t face) const
+		{
+			return (file ? file->data() : data.data()) + getOffset(level, layer, face);
+		}
+
+		VkDeviceSize getImageSize(uint32_t level, uint32_t layer, uint32_t face) const
+		{
+			return sizes[getImageIndex(level, layer, face)];
+		}
+
+		// Bytes of all images of the given level and the smaller ones
+		VkDeviceSize getTailSize(uint32_t firstLevel) const
+		{
+			VkDeviceSize size = 0;
+			for (uint32_t index = getImageIndex(firstLevel, 0, 0); index < static_cast<uint32_t>(sizes.size()); index++) {
+				size += sizes[index];
+			}
+			return size;
+		}
+	};
+
+	bool isKTX2File(const std::string& filename);
+
+	/**
+	* Loads all images of a KTX2 file
+	* Basis Universal (ETC1S and UASTC) payloads are transcoded to BC7, ASTC 4x4 or ETC2, depending on what the device supports, with uncompressed RGBA8 as the last resort
+	* Other files are loaded in the format they've been stored in, zstd supercompression is decoded
+	* Files without supercompression aren't copied, their images are read from the memory mapped file
+	*
+	* @param filename Name of the KTX2 file
+	* @param srgb Selects the sRGB variant of the transcode target format
+	* @param target Receives the image data
+	* @param jobSystem (Optional) If set, images are transcoded in parallel on the job system
+	*
+	* @return False if the file couldn't be read or isn't a valid KTX2 file
+	*/
+	bool loadKTX2File(const std::string& filename, bool srgb, TextureData& target, JobSystem* jobSystem = nullptr);
+
+	/**
+	* Maps a (version 1) KTX file and locates its images, without copying any of them
+	*
+	* @param filename Name of the KTX file
+	* @param format Format of the images, KTX files store OpenGL formats
+	* @param target Receives the image locations, the mapped file is kept alive by target
+	*
+	* @return False if the file couldn't be mapped or is stored in a layout that isn't supported (e.g. texture arrays or big endian)
+	*/
+	bool mapKTXFile(const std::string& filename, VkFormat format, TextureData& target);
+}
@@ -0,0 +1,143 @@
+/*
+ * Read-only memory mapped file
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace vks
+{
+	/**
+	* @brief Maps a whole file into memory for reading, the mapping stays valid for the lifetime of the object
+	* Can also stand in for a file that's part of another mapping (e.g. an asset archive) or that has been decompressed to host memory, so users don't need to know where the file came from
+	*/
+	class MappedFile
+	{
+	private:
+		const uint8_t* mappedData{ nullptr };
+		size_t mappedSize{ 0 };
+		// Set for ranges of another mapping, which is kept alive as long as the range is used
+		std::shared_ptr<const MappedFile> parent;
+		std::vector<uint8_t> contents;
+#if defined(_WIN32)
+		HANDLE file{ INVALID_HANDLE_VALUE };
+		HANDLE mapping{ nullptr };
+#endif
+	public:
+		MappedFile(const std::string& filename)
+		{
+#if defined(_WIN32)
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				return;
+			}
+			LARGE_INTEGER fileSize{};
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+				return;
+			}
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mapping) {
+				return;
+			}
+			mappedData = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (mappedData) {
+				mappedSize = static_cast<size_t>(fileSize.QuadPart);
+			}
+#else
+			const int fd = open(filename.c_str(), O_RDONLY);
+			if (fd == -1) {
+				return;
+			}
+			struct stat fileStat{};
+			if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+				void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				if (data != MAP_FAILED) {
+					mappedData = static_cast<const uint8_t*>(data);
+					mappedSize = static_cast<size_t>(fileStat.st_size);
+				}
+			}
+			// The mapping keeps its own reference to the file
+			close(fd);
+#endif
+		}
+
+		/** @brief Range of another mapping, e.g. an uncompressed entry of an asset archive */
+		MappedFile(std::shared_ptr<const MappedFile> parent, size_t offset, size_t size) : parent(parent)
+		{
+			if (parent->isValid() && (size > 0) && (offset + size <= parent->size())) {
+				mappedData = parent->data() + offset;
+				mappedSize = size;
+			}
+		}
+
+		/** @brief Takes over a file's contents that have been read or decompressed into host memory */
+		MappedFile(std::vector<uint8_t>&& contents) : contents(std::move(contents))
+		{
+			if (!this->contents.empty()) {
+				mappedData = this->contents.data();
+				mappedSize = this->contents.size();
+			}
+		}
+
+		~MappedFile()
+		{
+			if (parent || !contents.empty()) {
+				return;
+			}
+#if defined(_WIN32)
+			if (mappedData) {
+				UnmapViewOfFile(mappedData);
+			}
+			if (mapping) {
+				CloseHandle(mapping);
+			}
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+			}
+#else
+			if (mappedData) {
+				munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+			}
+#endif
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool isValid() const
+		{
+			return mappedData != nullptr;
+		}
+
+		const uint8_t* data() const
+		{
+			return mappedData;
+		}
+
+		size_t size() const
+		{
+			return mappedSize;
+		}
+	};
+}
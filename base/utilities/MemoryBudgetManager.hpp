@@ -0,0 +1,148 @@
+/*
+ * Reacts to device memory pressure reported by the memory budget
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include "volk.h"
+#include "Device.hpp"
+
+struct MemoryBudgetManagerCreateInfo {
+	// Share of a device local heap's budget above which memory is reclaimed
+	float highWatermark{ 0.9f };
+	// Share of the budget reclaimed memory is given back below, the gap to the high watermark keeps it from toggling
+	float lowWatermark{ 0.75f };
+	// Frames to wait after reclaiming or restoring, as the usage reported by the driver lags behind (e.g. until retired resources are destroyed)
+	uint32_t settleFrames{ 30 };
+};
+
+/**
+ * Polls the budget of the device local heaps and asks registered reclaimers to give up memory once usage gets close to the budget, before the driver starts paging or allocations fail
+ * Reclaimers are asked in order of their priority, lower values first, until the estimated amount they free brings the usage back to the low watermark
+ * Once usage is well below the budget again, reclaimers are asked to restore what they gave up one step at a time in reverse order
+ * Without VK_EXT_memory_budget, the budget is the heap size and the usage only covers this application's allocations
+ */
+class MemoryBudgetManager {
+public:
+	// Receives the number of bytes to free, returns the number of bytes it expects to free (0 if it can't give up more)
+	using ReclaimFunction = std::function<VkDeviceSize(VkDeviceSize bytes)>;
+	// Returns true if it restored some of what it reclaimed, false if there is nothing left to restore
+	using RestoreFunction = std::function<bool()>;
+
+private:
+	struct Reclaimer {
+		std::string name;
+		uint32_t priority;
+		ReclaimFunction reclaim;
+		RestoreFunction restore;
+		bool reclaimed{ false };
+	};
+	std::vector<Reclaimer> reclaimers;
+	MemoryBudgetManagerCreateInfo settings;
+	uint32_t framesSinceAction{ UINT32_MAX };
+	// Highest usage relative to the budget of all device local heaps
+	float pressure{ 0.0f };
+	uint32_t reclaimCount{ 0 };
+
+public:
+	MemoryBudgetManager(MemoryBudgetManagerCreateInfo createInfo = {}) : settings(createInfo) {}
+
+	/**
+	* Registers a way of giving up device memory (e.g. lowering the detail of streamed textures)
+	*
+	* @param name Name for reporting
+	* @param priority Order reclaimers are asked in, cheaper cuts in quality should have lower values
+	* @param reclaim Called with the number of bytes to free
+	* @param restore Called to restore part of what has been reclaimed
+	*/
+	void addReclaimer(const std::string& name, uint32_t priority, ReclaimFunction reclaim, RestoreFunction restore)
+	{
+		reclaimers.push_back({ .name = name, .priority = priority, .reclaim = std::move(reclaim), .restore = std::move(restore) });
+		std::stable_sort(reclaimers.begin(), reclaimers.end(), [](const Reclaimer& a, const Reclaimer& b) { return a.priority < b.priority; });
+	}
+
+	/** @brief Feeds the current budget, meant to be called once per frame */
+	void update(const MemoryBudget& budget)
+	{
+		VkDeviceSize excess{ 0 };
+		pressure = 0.0f;
+		for (uint32_t i = 0; i < budget.heapCount; i++) {
+			const MemoryHeapBudget& heap = budget.heaps[i];
+			if (!heap.deviceLocal || (heap.budget == 0)) {
+				continue;
+			}
+			const float heapPressure = static_cast<float>(heap.usage) / static_cast<float>(heap.budget);
+			pressure = std::max(pressure, heapPressure);
+			if (heapPressure > settings.highWatermark) {
+				excess = std::max(excess, heap.usage - static_cast<VkDeviceSize>(static_cast<double>(heap.budget) * settings.lowWatermark));
+			}
+		}
+
+		if (framesSinceAction < settings.settleFrames) {
+			framesSinceAction++;
+			return;
+		}
+		if (excess > 0) {
+			bool reclaimed = false;
+			for (Reclaimer& reclaimer : reclaimers) {
+				const VkDeviceSize freed = reclaimer.reclaim(excess);
+				if (freed == 0) {
+					continue;
+				}
+				reclaimer.reclaimed = true;
+				reclaimed = true;
+				if (freed >= excess) {
+					break;
+				}
+				excess -= freed;
+			}
+			if (reclaimed) {
+				reclaimCount++;
+				framesSinceAction = 0;
+			}
+		} else if (pressure < settings.lowWatermark) {
+			for (auto it = reclaimers.rbegin(); it != reclaimers.rend(); it++) {
+				if (!it->reclaimed) {
+					continue;
+				}
+				if (it->restore()) {
+					framesSinceAction = 0;
+					break;
+				}
+				it->reclaimed = false;
+			}
+		}
+	}
+
+	float getPressure() const
+	{
+		return pressure;
+	}
+
+	// Number of times memory had to be reclaimed since startup
+	uint32_t getReclaimCount() const
+	{
+		return reclaimCount;
+	}
+
+	// Names of the reclaimers currently holding back memory, e.g. for display
+	std::vector<std::string> getActiveReclaimers() const
+	{
+		std::vector<std::string> names;
+		for (const Reclaimer& reclaimer : reclaimers) {
+			if (reclaimer.reclaimed) {
+				names.push_back(reclaimer.name);
+			}
+		}
+		return names;
+	}
+};
@@ -0,0 +1,115 @@
+/*
+ * Incremental defragmentation of the memory allocator's blocks
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include "volk.h"
+#include "MemoryAllocator.hpp"
+
+struct MemoryDefragmenterCreateInfo {
+	// Bytes copied per frame at most, so moving resources doesn't stall a frame
+	VkDeviceSize bytesPerFrame{ 32 * 1024 * 1024 };
+	// Blocks with less than this share of their size in use are emptied
+	float maxBlockUsage{ 0.5f };
+	// Pools to empty blocks of, buffers and linear images if set, optimal tiled images (e.g. textures) otherwise
+	bool linear{ false };
+	// Frames between looking for a block to empty
+	uint32_t interval{ 300 };
+	// Frames an evacuation may go on without anything being moved before it's given up, needs to cover the deferred destruction of moved resources
+	uint32_t stallFrames{ 120 };
+};
+
+/**
+ * Empties sparsely used blocks of the memory allocator a few resources per frame, so long sessions with lots of loading and streaming don't accumulate blocks that are mostly free
+ * The allocator stops placing allocations in the block that's being emptied, registered movers copy the resources living in it elsewhere with GPU copies and replace them with the copies
+ * The block is released by the allocator once the last of the replaced resources has been destroyed
+ * Evacuations that stop making progress (e.g. as the block holds resources no mover knows about) are canceled, so the block is used again
+ */
+class MemoryDefragmenter {
+public:
+	/**
+	* Moves resources placed in a block, the resources need to be replaced with their copies and the originals destroyed once the frames using them have finished
+	*
+	* @param block Block to empty, resources with this as their allocation's block need to be moved
+	* @param budget Bytes that may still be copied this frame, the resource exceeding it may still be moved
+	* @param commandBuffer Graphics command buffer of the current frame to record the copies into
+	*
+	* @return Bytes moved, 0 if the mover has nothing (left) to move
+	*/
+	using MoveFunction = std::function<VkDeviceSize(const void* block, VkDeviceSize budget, VkCommandBuffer commandBuffer)>;
+
+private:
+	MemoryAllocator* allocator{ nullptr };
+	MemoryDefragmenterCreateInfo settings;
+	std::vector<MoveFunction> movers;
+	uint32_t framesSinceCheck{ 0 };
+	uint32_t stalledFrames{ 0 };
+	uint64_t movedBytes{ 0 };
+	uint32_t canceledCount{ 0 };
+
+public:
+	MemoryDefragmenter(MemoryAllocator* allocator, MemoryDefragmenterCreateInfo createInfo = {}) : allocator(allocator), settings(createInfo) {}
+
+	void addMover(MoveFunction mover)
+	{
+		movers.push_back(std::move(mover));
+	}
+
+	/** @brief Starts emptying a block if one qualifies and moves resources out of it within the frame's budget, meant to be called once per frame */
+	void update(VkCommandBuffer commandBuffer)
+	{
+		void* block = allocator->getEvacuatingBlock();
+		if (!block) {
+			if (++framesSinceCheck < settings.interval) {
+				return;
+			}
+			framesSinceCheck = 0;
+			stalledFrames = 0;
+			block = allocator->beginEvacuation(settings.linear, settings.maxBlockUsage);
+			if (!block) {
+				return;
+			}
+		}
+		VkDeviceSize budget = settings.bytesPerFrame;
+		VkDeviceSize moved = 0;
+		for (MoveFunction& mover : movers) {
+			moved += mover(block, budget - moved, commandBuffer);
+			if (moved >= budget) {
+				break;
+			}
+		}
+		movedBytes += moved;
+		if (moved > 0) {
+			stalledFrames = 0;
+		} else if (++stalledFrames > settings.stallFrames) {
+			allocator->cancelEvacuation();
+			canceledCount++;
+		}
+	}
+
+	bool isActive() const
+	{
+		return allocator->getEvacuatingBlock() != nullptr;
+	}
+
+	// Bytes copied since startup
+	uint64_t getMovedBytes() const
+	{
+		return movedBytes;
+	}
+
+	// Evacuations given up since startup, as the blocks held resources that couldn't be moved
+	uint32_t getCanceledCount() const
+	{
+		return canceledCount;
+	}
+};
@@ -0,0 +1,34 @@
+/*
+ * Host and device memory usage by subsystem
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "MemoryStats.h"
+
+// Constant initialized, as operator new may update it during the initialization of other globals
+constinit MemoryStats memoryStats;
+
+const char* MemoryStats::getCategoryName(MemoryCategory category)
+{
+	switch (category) {
+	case MemoryCategory::Models:
+		return "Models";
+	case MemoryCategory::Textures:
+		return "Textures";
+	case MemoryCategory::Environment:
+		return "Environment";
+	case MemoryCategory::Overlay:
+		return "Overlay";
+	case MemoryCategory::FrameData:
+		return "Frame data";
+	case MemoryCategory::RenderTargets:
+		return "Render targets";
+	case MemoryCategory::Staging:
+		return "Staging";
+	default:
+		return "Other";
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ * Host and device memory usage by subsystem
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+enum class MemoryCategory : uint32_t {
+	Other = 0,
+	Models,
+	Textures,
+	// Skybox and the image based lighting cubemaps
+	Environment,
+	Overlay,
+	// Per frame buffers, e.g. uniforms, instance data and the frame allocators
+	FrameData,
+	// Attachments of the render graph
+	RenderTargets,
+	Staging,
+	Count
+};
+
+/**
+ * Bytes currently allocated per memory category, for host memory (the operator new override of the application) and device memory (the MemoryAllocator and resources allocating their own memory)
+ * Allocations are tagged with the category of the innermost Scope on the allocating thread, so a subsystem only needs to open a scope around the code creating its resources
+ * All counters are lock free and statically initialized, so they can be updated from operator new before any other global has been constructed
+ */
+class MemoryStats {
+private:
+	static constexpr uint32_t categoryCount = static_cast<uint32_t>(MemoryCategory::Count);
+	std::array<std::atomic<int64_t>, categoryCount> hostBytes{};
+	std::array<std::atomic<int64_t>, categoryCount> deviceBytes{};
+	inline static thread_local MemoryCategory currentCategory{ MemoryCategory::Other };
+public:
+	/** @brief Tags the allocations of the calling thread with a category until destroyed, scopes can be nested */
+	class Scope {
+	private:
+		MemoryCategory previousCategory;
+	public:
+		Scope(MemoryCategory category) : previousCategory(currentCategory)
+		{
+			currentCategory = category;
+		}
+		~Scope()
+		{
+			currentCategory = previousCategory;
+		}
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+
+	static MemoryCategory getCurrentCategory()
+	{
+		return currentCategory;
+	}
+	static const char* getCategoryName(MemoryCategory category);
+
+	// Size is negative for frees
+	void addHost(MemoryCategory category, int64_t size)
+	{
+		hostBytes[static_cast<uint32_t>(category)].fetch_add(size, std::memory_order_relaxed);
+	}
+	void addDevice(MemoryCategory category, int64_t size)
+	{
+		deviceBytes[static_cast<uint32_t>(category)].fetch_add(size, std::memory_order_relaxed);
+	}
+	int64_t getHostBytes(MemoryCategory category) const
+	{
+		return hostBytes[static_cast<uint32_t>(category)].load(std::memory_order_relaxed);
+	}
+	int64_t getDeviceBytes(MemoryCategory category) const
+	{
+		return deviceBytes[static_cast<uint32_t>(category)].load(std::memory_order_relaxed);
+	}
+};
+
+extern MemoryStats memoryStats;
@@ -0,0 +1,457 @@
+/*
+ * Triangle mesh optimization for vertex cache, overdraw and vertex fetch, simplification for level of detail and meshlet generation
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cfloat>
+#include <cassert>
+#include <unordered_map>
+#include <unordered_set>
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	namespace meshoptimizer
+	{
+		// Size of the simulated post-transform vertex cache
+		const uint32_t vertexCacheSize = 16;
+		// Meshlet limits, 64 vertices and 124 triangles are a good fit for most mesh shader implementations
+		const uint32_t maxMeshletVertices = 64;
+		const uint32_t maxMeshletTriangles = 124;
+
+		/**
+		* Cluster of up to maxMeshletVertices vertices and maxMeshletTriangles triangles with bounds for culling
+		* Laid out to match the std430 layout used by the mesh shading pipeline
+		*/
+		struct Meshlet {
+			// Bounding sphere
+			glm::vec3 center;
+			float radius;
+			// Normal cone, the meshlet is back facing for a camera if dot(center - camera, coneAxis) >= coneCutoff * length(center - camera) + radius
+			glm::vec3 coneAxis;
+			float coneCutoff;
+			// Offsets into the meshlet vertex and triangle arrays
+			uint32_t vertexOffset;
+			uint32_t triangleOffset;
+			uint32_t vertexCount;
+			uint32_t triangleCount;
+		};
+
+		/**
+		* Reorders triangles to improve post transform vertex cache hit rates using Tipsify (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw")
+		*
+		* @param indices Triangle list indices in [0, vertexCount), reordered in place
+		* @param indexCount Number of indices
+		* @param vertexCount Number of vertices referenced by the indices
+		* @param clusters (Optional) Receives the first index of each cluster of triangles emitted after the cache has been flushed, used as input for optimizeOverdraw
+		*/
+		inline void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>* clusters = nullptr)
+		{
+			assert(indexCount % 3 == 0);
+			const size_t triangleCount = indexCount / 3;
+			if (triangleCount == 0) {
+				return;
+			}
+
+			// Vertex to triangle adjacency
+			std::vector<uint32_t> liveTriangles(vertexCount, 0);
+			for (size_t i = 0; i < indexCount; i++) {
+				liveTriangles[indices[i]]++;
+			}
+			std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+			for (size_t v = 0; v < vertexCount; v++) {
+				adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+			}
+			std::vector<uint32_t> adjacency(indexCount);
+			std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < indexCount; i++) {
+				adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+
+			std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+			std::vector<uint32_t> deadEnds;
+			std::vector<uint32_t> candidates;
+			std::vector<bool> emitted(triangleCount, false);
+			std::vector<uint32_t> result;
+			result.reserve(indexCount);
+			if (clusters) {
+				clusters->clear();
+			}
+
+			uint32_t timestamp = vertexCacheSize + 1;
+			size_t cursor = 0;
+			int64_t fanningVertex = 0;
+			bool newCluster = true;
+
+			while (fanningVertex >= 0) {
+				if (newCluster && clusters && (clusters->empty() || clusters->back() != result.size())) {
+					clusters->push_back(static_cast<uint32_t>(result.size()));
+				}
+				candidates.clear();
+				const uint32_t f = static_cast<uint32_t>(fanningVertex);
+				for (uint32_t a = adjacencyOffsets[f]; a < adjacencyOffsets[f + 1]; a++) {
+					const uint32_t triangle = adjacency[a];
+					if (emitted[triangle]) {
+						continue;
+					}
+					for (uint32_t c = 0; c < 3; c++) {
+						const uint32_t v = indices[triangle * 3 + c];
+						result.push_back(v);
+						deadEnds.push_back(v);
+						candidates.push_back(v);
+						liveTriangles[v]--;
+						if (timestamp - cacheTimestamps[v] > vertexCacheSize) {
+							cacheTimestamps[v] = timestamp++;
+						}
+					}
+					emitted[triangle] = true;
+				}
+
+				// Pick the candidate that's still in the cache and has the most live triangles left
+				fanningVertex = -1;
+				int64_t bestPriority = -1;
+				for (uint32_t v : candidates) {
+					if (liveTriangles[v] > 0) {
+						int64_t priority = 0;
+						if (timestamp - cacheTimestamps[v] + 2 * liveTriangles[v] <= vertexCacheSize) {
+							priority = timestamp - cacheTimestamps[v];
+						}
+						if (priority > bestPriority) {
+							bestPriority = priority;
+							fanningVertex = v;
+						}
+					}
+				}
+
+				// Dead end, continue with a recently used vertex or the next vertex in input order
+				newCluster = (fanningVertex == -1);
+				while (fanningVertex == -1 && !deadEnds.empty()) {
+					const uint32_t v = deadEnds.back();
+					deadEnds.pop_back();
+					if (liveTriangles[v] > 0) {
+						fanningVertex = v;
+					}
+				}
+				while (fanningVertex == -1 && cursor < vertexCount) {
+					if (liveTriangles[cursor] > 0) {
+						fanningVertex = static_cast<int64_t>(cursor);
+					}
+					cursor++;
+				}
+			}
+
+			assert(result.size() == indexCount);
+			memcpy(indices, result.data(), indexCount * sizeof(uint32_t));
+		}
+
+		/**
+		* Reorders clusters of triangles so that those likely to occlude others are drawn first, using a view independent sort key
+		*
+		* @param indices Triangle list indices in [0, vertexCount), reordered in place
+		* @param indexCount Number of indices
+		* @param positions Pointer to the first vertex position (three floats)
+		* @param positionStride Distance in bytes between two vertex positions
+		* @param clusters First index of each cluster as returned by optimizeVertexCache
+		*/
+		inline void optimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, const std::vector<uint32_t>& clusters)
+		{
+			if (clusters.size() <= 1) {
+				return;
+			}
+			auto position = [positions, positionStride](uint32_t index) {
+				const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + index * positionStride);
+				return glm::vec3(p[0], p[1], p[2]);
+			};
+
+			// Area weighted centroid and normal for each cluster and the whole mesh
+			const size_t clusterCount = clusters.size();
+			std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+			std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+			glm::vec3 meshCentroid(0.0f);
+			float meshArea = 0.0f;
+			for (size_t c = 0; c < clusterCount; c++) {
+				const size_t last = (c + 1 < clusterCount) ? clusters[c + 1] : indexCount;
+				float clusterArea = 0.0f;
+				for (size_t i = clusters[c]; i < last; i += 3) {
+					const glm::vec3 p0 = position(indices[i]);
+					const glm::vec3 p1 = position(indices[i + 1]);
+					const glm::vec3 p2 = position(indices[i + 2]);
+					const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+					const float area = glm::length(normal);
+					clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+					clusterNormals[c] += normal;
+					clusterArea += area;
+				}
+				meshCentroid += clusterCentroids[c];
+				meshArea += clusterArea;
+				clusterCentroids[c] /= std::max(clusterArea, FLT_MIN);
+				const float normalLength = glm::length(clusterNormals[c]);
+				clusterNormals[c] = normalLength > 0.0f ? clusterNormals[c] / normalLength : glm::vec3(0.0f);
+			}
+			meshCentroid /= std::max(meshArea, FLT_MIN);
+
+			// Clusters facing away from the center are on the outside and drawn first
+			std::vector<float> sortKeys(clusterCount);
+			for (size_t c = 0; c < clusterCount; c++) {
+				sortKeys[c] = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+			}
+			std::vector<uint32_t> order(clusterCount);
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+			std::vector<uint32_t> result;
+			result.reserve(indexCount);
+			for (uint32_t c : order) {
+				const size_t last = (c + 1 < clusterCount) ? clusters[c + 1] : indexCount;
+				result.insert(result.end(), indices + clusters[c], indices + last);
+			}
+			memcpy(indices, result.data(), indexCount * sizeof(uint32_t));
+		}
+
+		/**
+		* Renumbers vertices in the order they're first referenced by the index buffer to improve vertex fetch locality
+		*
+		* @param indices Triangle list indices in [0, vertexCount), rewritten in place
+		* @param indexCount Number of indices
+		* @param vertexCount Number of vertices
+		*
+		* @return Table mapping the old to the new vertex index, to be passed to remapVertices
+		*/
+		inline std::vector<uint32_t> optimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount)
+		{
+			std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+			uint32_t next = 0;
+			for (size_t i = 0; i < indexCount; i++) {
+				uint32_t& newIndex = remap[indices[i]];
+				if (newIndex == UINT32_MAX) {
+					newIndex = next++;
+				}
+				indices[i] = newIndex;
+			}
+			// Unreferenced vertices are moved to the end
+			for (uint32_t& newIndex : remap) {
+				if (newIndex == UINT32_MAX) {
+					newIndex = next++;
+				}
+			}
+			return remap;
+		}
+
+		/**
+		* Simplifies a triangle list by vertex clustering (Rossignac and Borrel, "Multi-resolution 3D approximations for rendering complex scenes")
+		* All vertices inside a cell of a uniform grid are collapsed into the existing vertex closest to their average, so the result references the original vertices and can share their vertex buffer
+		*
+		* @param destination Receives the simplified indices, needs to hold at least indexCount indices
+		* @param indices Triangle list indices in [0, vertexCount)
+		* @param indexCount Number of indices
+		* @param positions Pointer to the first vertex position (three floats)
+		* @param positionStride Distance in bytes between two vertex positions
+		* @param vertexCount Number of vertices referenced by the indices
+		* @param gridSize Number of grid cells along the longest side of the mesh's bounding box
+		*
+		* @return Number of indices written to destination
+		*/
+		inline size_t simplifyClustered(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount, uint32_t gridSize)
+		{
+			assert(indexCount % 3 == 0);
+			assert(gridSize > 0);
+			auto position = [positions, positionStride](uint32_t index) {
+				const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + index * positionStride);
+				return glm::vec3(p[0], p[1], p[2]);
+			};
+
+			glm::vec3 min(FLT_MAX);
+			glm::vec3 max(-FLT_MAX);
+			for (size_t i = 0; i < indexCount; i++) {
+				const glm::vec3 p = position(indices[i]);
+				min = glm::min(min, p);
+				max = glm::max(max, p);
+			}
+			const glm::vec3 extent = max - min;
+			const float cellSize = std::max(std::max(extent.x, extent.y), extent.z) / static_cast<float>(gridSize);
+			if (cellSize <= 0.0f) {
+				return 0;
+			}
+
+			// Cells are addressed with 21 bits per axis
+			std::vector<uint64_t> vertexCells(vertexCount, UINT64_MAX);
+			std::unordered_map<uint64_t, uint32_t> cellIndices;
+			std::vector<glm::vec3> cellCenters;
+			std::vector<uint32_t> cellVertexCounts;
+			for (size_t i = 0; i < indexCount; i++) {
+				const uint32_t v = indices[i];
+				if (vertexCells[v] != UINT64_MAX) {
+					continue;
+				}
+				const glm::vec3 p = position(v);
+				const glm::uvec3 cell = glm::min(glm::uvec3((p - min) / cellSize), glm::uvec3(gridSize - 1));
+				const uint64_t key = (static_cast<uint64_t>(cell.x) << 42) | (static_cast<uint64_t>(cell.y) << 21) | static_cast<uint64_t>(cell.z);
+				auto [it, inserted] = cellIndices.try_emplace(key, static_cast<uint32_t>(cellCenters.size()));
+				if (inserted) {
+					cellCenters.push_back(glm::vec3(0.0f));
+					cellVertexCounts.push_back(0);
+				}
+				vertexCells[v] = it->second;
+				cellCenters[it->second] += p;
+				cellVertexCounts[it->second]++;
+			}
+
+			// Pick the vertex closest to the average of each cell as its representative
+			std::vector<uint32_t> cellVertices(cellCenters.size(), UINT32_MAX);
+			std::vector<float> cellDistances(cellCenters.size(), FLT_MAX);
+			for (size_t c = 0; c < cellCenters.size(); c++) {
+				cellCenters[c] /= static_cast<float>(cellVertexCounts[c]);
+			}
+			for (size_t i = 0; i < indexCount; i++) {
+				const uint32_t v = indices[i];
+				const uint32_t c = static_cast<uint32_t>(vertexCells[v]);
+				const glm::vec3 d = position(v) - cellCenters[c];
+				const float distance = glm::dot(d, d);
+				if (distance < cellDistances[c]) {
+					cellDistances[c] = distance;
+					cellVertices[c] = v;
+				}
+			}
+
+			assert(cellCenters.size() < (1ull << 21));
+			// Triangles that collapsed into a line or a point or that are duplicates of already emitted ones are dropped
+			std::unordered_set<uint64_t> emitted;
+			size_t count = 0;
+			for (size_t i = 0; i < indexCount; i += 3) {
+				uint32_t t[3];
+				for (uint32_t c = 0; c < 3; c++) {
+					t[c] = static_cast<uint32_t>(vertexCells[indices[i + c]]);
+				}
+				if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2]) {
+					continue;
+				}
+				// Rotate the smallest cell to the front, so duplicates share a key while the winding is kept
+				while (t[0] > t[1] || t[0] > t[2]) {
+					std::rotate(t, t + 1, t + 3);
+				}
+				const uint64_t key = (static_cast<uint64_t>(t[0]) << 42) | (static_cast<uint64_t>(t[1]) << 21) | static_cast<uint64_t>(t[2]);
+				if (!emitted.insert(key).second) {
+					continue;
+				}
+				for (uint32_t c = 0; c < 3; c++) {
+					destination[count++] = cellVertices[t[c]];
+				}
+			}
+			return count;
+		}
+
+		/**
+		* Splits a triangle list into meshlets, triangles are added in order so running optimizeVertexCache first results in fewer and tighter meshlets
+		* Cone bounds assume counter-clockwise front faces (as used by glTF)
+		*
+		* @param meshlets Receives the meshlets
+		* @param meshletVertices Receives the vertex indices referenced by the meshlets
+		* @param meshletTriangles Receives one entry per triangle with the three meshlet local vertex indices packed into 8 bits each
+		* @param indices Triangle list indices in [0, vertexCount)
+		* @param indexCount Number of indices
+		* @param positions Pointer to the first vertex position (three floats)
+		* @param positionStride Distance in bytes between two vertex positions
+		* @param vertexCount Number of vertices referenced by the indices
+		*/
+		inline void buildMeshlets(std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices, std::vector<uint32_t>& meshletTriangles, const uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount)
+		{
+			assert(indexCount % 3 == 0);
+			auto position = [positions, positionStride](uint32_t index) {
+				const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + index * positionStride);
+				return glm::vec3(p[0], p[1], p[2]);
+			};
+
+			auto finishMeshlet = [&](Meshlet& meshlet) {
+				glm::vec3 min(FLT_MAX);
+				glm::vec3 max(-FLT_MAX);
+				for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+					const glm::vec3 p = position(meshletVertices[meshlet.vertexOffset + i]);
+					min = glm::min(min, p);
+					max = glm::max(max, p);
+				}
+				meshlet.center = (min + max) * 0.5f;
+				meshlet.radius = 0.0f;
+				for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+					meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, position(meshletVertices[meshlet.vertexOffset + i])));
+				}
+
+				std::vector<glm::vec3> normals;
+				normals.reserve(meshlet.triangleCount);
+				glm::vec3 axis(0.0f);
+				for (uint32_t i = 0; i < meshlet.triangleCount; i++) {
+					const uint32_t triangle = meshletTriangles[meshlet.triangleOffset + i];
+					const glm::vec3 p0 = position(meshletVertices[meshlet.vertexOffset + (triangle & 0xff)]);
+					const glm::vec3 p1 = position(meshletVertices[meshlet.vertexOffset + ((triangle >> 8) & 0xff)]);
+					const glm::vec3 p2 = position(meshletVertices[meshlet.vertexOffset + ((triangle >> 16) & 0xff)]);
+					const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+					const float length = glm::length(normal);
+					if (length > 0.0f) {
+						normals.push_back(normal / length);
+						axis += normals.back();
+					}
+				}
+				const float axisLength = glm::length(axis);
+				meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+				float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+				for (const glm::vec3& normal : normals) {
+					minDot = std::min(minDot, glm::dot(meshlet.coneAxis, normal));
+				}
+				// Cones wider than a hemisphere can't be culled, a cutoff of one never passes the test
+				meshlet.coneCutoff = (minDot <= 0.0f) ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+				meshlets.push_back(meshlet);
+			};
+
+			// Meshlet local index of each vertex, only valid if the vertex has been added to the current meshlet
+			std::vector<uint32_t> vertexMeshlets(vertexCount, UINT32_MAX);
+			std::vector<uint8_t> localIndices(vertexCount, 0);
+			uint32_t meshletIndex = static_cast<uint32_t>(meshlets.size());
+			Meshlet meshlet{ .vertexOffset = static_cast<uint32_t>(meshletVertices.size()), .triangleOffset = static_cast<uint32_t>(meshletTriangles.size()) };
+
+			for (size_t i = 0; i < indexCount; i += 3) {
+				uint32_t newVertices = 0;
+				for (uint32_t c = 0; c < 3; c++) {
+					newVertices += (vertexMeshlets[indices[i + c]] != meshletIndex) ? 1 : 0;
+				}
+				if ((meshlet.vertexCount + newVertices > maxMeshletVertices) || (meshlet.triangleCount + 1 > maxMeshletTriangles)) {
+					finishMeshlet(meshlet);
+					meshletIndex++;
+					meshlet = { .vertexOffset = static_cast<uint32_t>(meshletVertices.size()), .triangleOffset = static_cast<uint32_t>(meshletTriangles.size()) };
+				}
+				uint32_t triangle = 0;
+				for (uint32_t c = 0; c < 3; c++) {
+					const uint32_t v = indices[i + c];
+					if (vertexMeshlets[v] != meshletIndex) {
+						vertexMeshlets[v] = meshletIndex;
+						localIndices[v] = static_cast<uint8_t>(meshlet.vertexCount++);
+						meshletVertices.push_back(v);
+					}
+					triangle |= static_cast<uint32_t>(localIndices[v]) << (c * 8);
+				}
+				meshletTriangles.push_back(triangle);
+				meshlet.triangleCount++;
+			}
+			if (meshlet.triangleCount > 0) {
+				finishMeshlet(meshlet);
+			}
+		}
+
+		/** @brief Reorders vertex data according to a table returned by optimizeVertexFetch */
+		template<typename T>
+		void remapVertices(T* vertices, size_t vertexCount, const std::vector<uint32_t>& remap)
+		{
+			std::vector<T> source(vertices, vertices + vertexCount);
+			for (size_t i = 0; i < vertexCount; i++) {
+				vertices[remap[i]] = source[i];
+			}
+		}
+	}
+}
@@ -0,0 +1,91 @@
+/*
+ * Frame intervals from the times images were actually presented
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * Derives the refresh interval of the display and the interval between presented frames from present feedback (VK_GOOGLE_display_timing or Wayland's wp_presentation)
+ * CPU timestamps include the jitter of when a frame happened to be recorded, while presented frames can only be apart by whole refresh cycles
+ * Advancing animations by the presented interval (instead of the CPU frame time) moves them by what's actually visible, which removes judder from uneven CPU frame times
+ * Feedback arrives some frames late, so the interval is that of the last presented frames and not of the frame being recorded
+ */
+class PresentTiming {
+private:
+	uint64_t lastPresentTime{ 0 };
+	uint64_t lastPresentId{ 0 };
+	// Nanoseconds per refresh cycle, either reported or estimated from present intervals
+	double refreshInterval{ 0.0 };
+	bool refreshIntervalReported{ false };
+	// Interval between the last two presented frames, in whole refresh cycles
+	uint32_t frameCycles{ 0 };
+	uint32_t presentCount{ 0 };
+public:
+	// Weight of a new present interval in the estimate of the refresh interval, if the refresh interval isn't reported
+	float smoothing{ 0.05f };
+	// Presents needed before intervals are considered, so the first frames after (re)creating a swap chain are skipped
+	uint32_t warmupPresents{ 4 };
+
+	/**
+	* Adds a presented frame, presents need to be added in order
+	*
+	* @param presentTime Time the frame was presented in nanoseconds, only compared against other presents
+	* @param presentId Increasing id of the frame, gaps mean feedback for frames in between was discarded (e.g. frames that were never shown)
+	* @param refreshDuration (Optional) Nanoseconds per refresh cycle as reported with the present, zero if unknown (e.g. variable refresh rates)
+	*/
+	void addPresent(uint64_t presentTime, uint64_t presentId, uint64_t refreshDuration = 0)
+	{
+		if (refreshDuration > 0) {
+			refreshInterval = static_cast<double>(refreshDuration);
+			refreshIntervalReported = true;
+		}
+		if ((lastPresentTime > 0) && (presentTime > lastPresentTime) && (presentId > lastPresentId)) {
+			const double interval = static_cast<double>(presentTime - lastPresentTime) / static_cast<double>(presentId - lastPresentId);
+			if (!refreshIntervalReported) {
+				// Intervals spanning multiple cycles are divided by their cycle count, so missed refreshes don't raise the estimate
+				const double cycleInterval = (refreshInterval > 0.0) ? interval / std::max(std::round(interval / refreshInterval), 1.0) : interval;
+				refreshInterval = (refreshInterval > 0.0) ? std::lerp(refreshInterval, cycleInterval, static_cast<double>(smoothing)) : interval;
+			}
+			frameCycles = static_cast<uint32_t>(std::max(std::round(interval / refreshInterval), 1.0));
+			presentCount++;
+		}
+		lastPresentTime = presentTime;
+		lastPresentId = presentId;
+	}
+
+	/** @brief Discards all feedback, e.g. after the swap chain or display changed */
+	void reset()
+	{
+		lastPresentTime = 0;
+		lastPresentId = 0;
+		refreshInterval = 0.0;
+		refreshIntervalReported = false;
+		frameCycles = 0;
+		presentCount = 0;
+	}
+
+	// Set once enough presents have been added for the intervals to be used
+	bool isValid() const
+	{
+		return (presentCount >= warmupPresents) && (refreshInterval > 0.0);
+	}
+
+	float getRefreshRate() const
+	{
+		return isValid() ? static_cast<float>(1.0e9 / refreshInterval) : 0.0f;
+	}
+
+	// Seconds between the last two presented frames
+	float getFrameInterval() const
+	{
+		return isValid() ? static_cast<float>(frameCycles * refreshInterval / 1.0e9) : 0.0f;
+	}
+};
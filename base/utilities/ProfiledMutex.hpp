@@ -0,0 +1,120 @@
+/*
+ * Mutex that reports how often and how long threads waited for it
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "tracy/Tracy.hpp"
+
+namespace vks
+{
+	// Contention of a mutex since its counters were last collected
+	struct LockStats {
+		// Name the mutex was created with, needs to outlive the mutex (e.g. a string literal)
+		const char* name;
+		uint32_t locks;
+		// Locks that had to wait for another thread
+		uint32_t contendedLocks;
+		std::chrono::nanoseconds waitTime;
+	};
+
+	/**
+	 * Drop-in replacement for std::mutex that counts its locks, the locks that found the mutex held and the time spent waiting for them
+	 * Uncontended locks only cost a try_lock and a relaxed increment, the clock is only read if the lock has to wait
+	 * Locks are also shown in Tracy (as TracyLockable) if enabled
+	 * Needs std::condition_variable_any instead of std::condition_variable to be waited on
+	 * All profiled mutexes are registered, so their contention can be shown together, e.g. per frame with collect
+	 */
+	class ProfiledMutex {
+	private:
+		const char* name;
+		TracyLockableN(std::mutex, mutex, "Profiled mutex");
+		std::atomic<uint32_t> locks{ 0 };
+		std::atomic<uint32_t> contendedLocks{ 0 };
+		std::atomic<int64_t> waitNanoseconds{ 0 };
+
+		// The registry's own mutex isn't profiled, it's only locked when mutexes are created, destroyed or collected
+		static inline std::mutex registryMutex;
+		static inline std::vector<ProfiledMutex*> registry;
+	public:
+		explicit ProfiledMutex(const char* name) : name(name)
+		{
+			LockableName(mutex, name, strlen(name));
+			std::lock_guard<std::mutex> lock(registryMutex);
+			registry.push_back(this);
+		}
+
+		~ProfiledMutex()
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			registry.erase(std::find(registry.begin(), registry.end(), this));
+		}
+
+		ProfiledMutex(const ProfiledMutex&) = delete;
+		ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+		void lock()
+		{
+			locks.fetch_add(1, std::memory_order_relaxed);
+			if (mutex.try_lock()) {
+				return;
+			}
+			const auto start = std::chrono::steady_clock::now();
+			mutex.lock();
+			contendedLocks.fetch_add(1, std::memory_order_relaxed);
+			waitNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+		}
+
+		bool try_lock()
+		{
+			const bool locked = mutex.try_lock();
+			if (locked) {
+				locks.fetch_add(1, std::memory_order_relaxed);
+			}
+			return locked;
+		}
+
+		void unlock()
+		{
+			mutex.unlock();
+		}
+
+		const char* getName() const
+		{
+			return name;
+		}
+
+		/**
+		* Reports the counters of all profiled mutexes and resets them, so each call reports the contention since the previous one
+		*
+		* @param stats Filled with one entry per mutex, most contended first, cleared but not shrunk so per frame calls don't allocate once it's large enough
+		*/
+		static void collect(std::vector<LockStats>& stats)
+		{
+			stats.clear();
+			{
+				std::lock_guard<std::mutex> lock(registryMutex);
+				for (ProfiledMutex* mutex : registry) {
+					stats.push_back({
+						.name = mutex->name,
+						.locks = mutex->locks.exchange(0, std::memory_order_relaxed),
+						.contendedLocks = mutex->contendedLocks.exchange(0, std::memory_order_relaxed),
+						.waitTime = std::chrono::nanoseconds(mutex->waitNanoseconds.exchange(0, std::memory_order_relaxed))
+					});
+				}
+			}
+			std::sort(stats.begin(), stats.end(), [](const LockStats& a, const LockStats& b) { return a.waitTime > b.waitTime; });
+		}
+	};
+}
@@ -0,0 +1,75 @@
+/*
+ * Radix sort for values with integer keys
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstdint>
+
+namespace vks
+{
+	/**
+	 * Stable least significant digit radix sort of 32 bit values by keys of up to 64 bits, e.g. actor indices by their draw keys
+	 * Sorts eight bits per pass, passes for digits that are the same for all keys are skipped
+	 * The internal arrays are kept between calls, so sorting doesn't allocate once they have grown to the largest count
+	 */
+	class RadixSort
+	{
+	private:
+		struct Element {
+			uint64_t key;
+			uint32_t value;
+		};
+		std::vector<Element> elements;
+		std::vector<Element> scratch;
+	public:
+		/**
+		* Sorts values by ascending keys, elements with equal keys keep their order
+		*
+		* @param values Values to sort, overwritten with the sorted values
+		* @param keys Key of each value
+		* @param count Number of values
+		* @param keyBits Number of (lower) key bits to sort by, defaults to the size of the key type
+		*/
+		template<typename Key>
+		void sort(uint32_t* values, const Key* keys, uint32_t count, uint32_t keyBits = sizeof(Key) * 8)
+		{
+			if (count < 2) {
+				return;
+			}
+			elements.resize(count);
+			scratch.resize(count);
+			for (uint32_t i = 0; i < count; i++) {
+				elements[i] = { static_cast<uint64_t>(keys[i]), values[i] };
+			}
+			for (uint32_t shift = 0; shift < keyBits; shift += 8) {
+				std::array<uint32_t, 256> offsets{};
+				for (uint32_t i = 0; i < count; i++) {
+					offsets[(elements[i].key >> shift) & 0xff]++;
+				}
+				if (offsets[(elements[0].key >> shift) & 0xff] == count) {
+					continue;
+				}
+				uint32_t offset = 0;
+				for (uint32_t& bucket : offsets) {
+					const uint32_t bucketCount = bucket;
+					bucket = offset;
+					offset += bucketCount;
+				}
+				for (uint32_t i = 0; i < count; i++) {
+					scratch[offsets[(elements[i].key >> shift) & 0xff]++] = elements[i];
+				}
+				elements.swap(scratch);
+			}
+			for (uint32_t i = 0; i < count; i++) {
+				values[i] = elements[i].value;
+			}
+		}
+	};
+}
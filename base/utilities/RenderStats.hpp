@@ -0,0 +1,51 @@
+/*
+ * Per-frame counters of recorded commands and GPU pipeline statistics
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/** @brief Commands recorded into a command buffer, counted by the command buffer wrapper */
+struct RenderStats {
+	// Direct and indirect draws as well as mesh task draws, indirect draws count once no matter how many draws the GPU issues
+	uint32_t drawCalls{ 0 };
+	// Instances and triangles are only known for direct draws
+	uint32_t instances{ 0 };
+	uint64_t triangles{ 0 };
+	uint32_t dispatches{ 0 };
+	uint32_t pipelineBinds{ 0 };
+	uint32_t descriptorSetBinds{ 0 };
+	uint32_t pushConstantUpdates{ 0 };
+	// Vertex buffer binds, i.e. the number of model changes
+	uint32_t bufferBinds{ 0 };
+	// Pipeline, descriptor set, vertex and index buffer binds skipped as the state was already bound
+	uint32_t skippedBinds{ 0 };
+
+	RenderStats& operator+=(const RenderStats& other) {
+		drawCalls += other.drawCalls;
+		instances += other.instances;
+		triangles += other.triangles;
+		dispatches += other.dispatches;
+		pipelineBinds += other.pipelineBinds;
+		descriptorSetBinds += other.descriptorSetBinds;
+		pushConstantUpdates += other.pushConstantUpdates;
+		bufferBinds += other.bufferBinds;
+		skippedBinds += other.skippedBinds;
+		return *this;
+	}
+};
+
+/** @brief Results of a pipeline statistics query, members are ordered like the statistic flags so results can be read directly into the struct */
+struct PipelineStatistics {
+	uint64_t inputAssemblyVertices{ 0 };
+	uint64_t inputAssemblyPrimitives{ 0 };
+	uint64_t vertexShaderInvocations{ 0 };
+	uint64_t clippingPrimitives{ 0 };
+	uint64_t fragmentShaderInvocations{ 0 };
+	uint64_t computeShaderInvocations{ 0 };
+};
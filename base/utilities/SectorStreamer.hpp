@@ -0,0 +1,218 @@
+/*
+ * Streaming of procedurally generated world sectors
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "JobSystem.hpp"
+
+namespace vks
+{
+	/**
+	 * Divides an unbounded world into square sectors on the XZ plane and only keeps the ones around a point of interest (e.g. the camera)
+	 * A sector's content is generated from a seed derived from the world seed and the sector's coordinate, so it's the same no matter when, in which order or how often the sector is visited
+	 * Generation runs as background jobs in parallel, finished sectors are handed to the load callback on the thread calling update (e.g. to add actors at the frame boundary)
+	 * Sectors are released once they're beyond the unload radius, which is larger than the load radius so moving along a border doesn't regenerate sectors over and over
+	 */
+	template<typename Content>
+	class SectorStreamer
+	{
+	public:
+		// Called on a worker thread, must only write to the content and not touch any shared state
+		using Generator = std::function<void(glm::ivec2 coord, uint64_t seed, Content& content)>;
+		// Called on the thread calling update
+		using Callback = std::function<void(glm::ivec2 coord, Content& content)>;
+
+		struct CreateInfo {
+			float sectorSize{ 64.0f };
+			// Sectors are loaded once their closest point is within the load radius and released once it's farther away than the unload radius
+			float loadRadius{ 448.0f };
+			float unloadRadius{ 512.0f };
+			uint64_t seed{ 0 };
+			// Generation jobs started by a single update, so moving fast doesn't flood the workers with sectors that may be out of range again by the time they're done
+			uint32_t maxJobsPerUpdate{ 32 };
+			Generator generate;
+			Callback load;
+			Callback release;
+		};
+
+	private:
+		struct Sector {
+			glm::ivec2 coord{};
+			Content content{};
+			Job* job{ nullptr };
+			bool loaded{ false };
+		};
+
+		JobSystem& jobSystem;
+		CreateInfo createInfo;
+		// Nodes of an unordered map stay in place, so jobs can write to their sector while other sectors are added
+		std::unordered_map<uint64_t, Sector> sectors;
+		std::vector<glm::ivec2> missingSectors;
+		uint32_t loadedCount{ 0 };
+
+		static uint64_t sectorKey(glm::ivec2 coord)
+		{
+			return (static_cast<uint64_t>(static_cast<uint32_t>(coord.x)) << 32) | static_cast<uint64_t>(static_cast<uint32_t>(coord.y));
+		}
+
+		// SplitMix64 finalizer, so neighbouring coordinates get unrelated seeds
+		static uint64_t mix(uint64_t value)
+		{
+			value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+			value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+			return value ^ (value >> 31);
+		}
+
+		float distanceToSector(glm::vec2 point, glm::ivec2 coord) const
+		{
+			const glm::vec2 min = glm::vec2(coord) * createInfo.sectorSize;
+			return glm::length(point - glm::clamp(point, min, min + createInfo.sectorSize));
+		}
+
+	public:
+		SectorStreamer(JobSystem& jobSystem, const CreateInfo& createInfo) : jobSystem(jobSystem), createInfo(createInfo) {}
+
+		// Content of sectors still loaded isn't released, as its owner may already be gone
+		~SectorStreamer()
+		{
+			for (auto& [key, sector] : sectors) {
+				if (sector.job) {
+					jobSystem.wait(sector.job);
+					delete sector.job;
+				}
+			}
+		}
+
+		SectorStreamer(const SectorStreamer&) = delete;
+		SectorStreamer& operator=(const SectorStreamer&) = delete;
+
+		uint64_t getSectorSeed(glm::ivec2 coord) const
+		{
+			return mix(createInfo.seed ^ mix(sectorKey(coord)));
+		}
+
+		uint64_t getSeed() const
+		{
+			return createInfo.seed;
+		}
+
+		/**
+		 * Adds a sector whose content has already been loaded elsewhere (e.g. restored from a snapshot), it's neither generated nor handed to the load callback
+		 * The sector is released like any other once it's out of range, so the content needs to be what the load callback would have made of it
+		 */
+		void addLoaded(glm::ivec2 coord, Content&& content)
+		{
+			Sector& sector = sectors[sectorKey(coord)];
+			if (sector.job || sector.loaded) {
+				return;
+			}
+			sector.coord = coord;
+			sector.content = std::move(content);
+			sector.loaded = true;
+			loadedCount++;
+		}
+
+		// Calls the function with the coordinate and content of each loaded sector, in no particular order
+		template<typename F>
+		void forEachLoaded(F&& function) const
+		{
+			for (const auto& [key, sector] : sectors) {
+				if (sector.loaded) {
+					function(sector.coord, sector.content);
+				}
+			}
+		}
+
+		/**
+		 * Starts generating sectors that came into range, loads the ones that have been generated and releases the ones out of range
+		 *
+		 * @param position Point of interest in world space, only its x and z coordinates are used
+		 * @param blocking Waits for all sectors in range to be generated and loads them, e.g. at startup or for benchmarks that need the same content in every frame
+		 */
+		void update(const glm::vec3& position, bool blocking = false)
+		{
+			const glm::vec2 point(position.x, position.z);
+
+			// Closest sectors first, so the ones next to the point of interest are generated first while moving
+			missingSectors.clear();
+			const glm::ivec2 first = glm::ivec2(glm::floor((point - createInfo.loadRadius) / createInfo.sectorSize));
+			const glm::ivec2 last = glm::ivec2(glm::floor((point + createInfo.loadRadius) / createInfo.sectorSize));
+			for (int32_t z = first.y; z <= last.y; z++) {
+				for (int32_t x = first.x; x <= last.x; x++) {
+					const glm::ivec2 coord(x, z);
+					if ((distanceToSector(point, coord) <= createInfo.loadRadius) && !sectors.contains(sectorKey(coord))) {
+						missingSectors.push_back(coord);
+					}
+				}
+			}
+			std::sort(missingSectors.begin(), missingSectors.end(), [this, point](glm::ivec2 a, glm::ivec2 b) { return distanceToSector(point, a) < distanceToSector(point, b); });
+			const size_t jobCount = blocking ? missingSectors.size() : std::min(missingSectors.size(), static_cast<size_t>(createInfo.maxJobsPerUpdate));
+			for (size_t i = 0; i < jobCount; i++) {
+				const glm::ivec2 coord = missingSectors[i];
+				Sector& sector = sectors[sectorKey(coord)];
+				sector.coord = coord;
+				// Background jobs are only run by workers, without them the sector is generated right away
+				if (jobSystem.getThreadCount() <= 1) {
+					createInfo.generate(coord, getSectorSeed(coord), sector.content);
+				} else {
+					sector.job = jobSystem.createBackgroundJob([this, &sector] { createInfo.generate(sector.coord, getSectorSeed(sector.coord), sector.content); });
+					jobSystem.runBackground(sector.job);
+				}
+			}
+
+			for (auto it = sectors.begin(); it != sectors.end();) {
+				Sector& sector = it->second;
+				if (sector.job) {
+					if (blocking) {
+						jobSystem.wait(sector.job);
+					}
+					if (!jobSystem.isFinished(sector.job)) {
+						it++;
+						continue;
+					}
+					delete sector.job;
+					sector.job = nullptr;
+				}
+				if (distanceToSector(point, sector.coord) > createInfo.unloadRadius) {
+					// Sectors that went out of range while they were generated are dropped without being loaded
+					if (sector.loaded) {
+						createInfo.release(sector.coord, sector.content);
+						loadedCount--;
+					}
+					it = sectors.erase(it);
+					continue;
+				}
+				if (!sector.loaded) {
+					createInfo.load(sector.coord, sector.content);
+					sector.loaded = true;
+					loadedCount++;
+				}
+				it++;
+			}
+		}
+
+		// Sectors handed to the load callback and not released yet
+		uint32_t getLoadedCount() const
+		{
+			return loadedCount;
+		}
+
+		// Sectors that are being generated or waiting for a worker
+		uint32_t getPendingCount() const
+		{
+			return static_cast<uint32_t>(sectors.size()) - loadedCount;
+		}
+	};
+}
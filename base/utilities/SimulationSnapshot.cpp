@@ -0,0 +1,324 @@
+/*
+ * Binary snapshots of the actors of streamed world sectors for warm restarts
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "SimulationSnapshot.h"
+#include "ApplicationContext.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+static constexpr uint32_t snapshotMagic = 0x53534b56; // "VKSS"
+// Needs to be incremented with every change to the layout, snapshots of other versions are ignored
+static constexpr uint32_t snapshotVersion = 1;
+
+struct SnapshotHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t seed;
+	uint32_t sectorCount;
+	uint32_t actorCount;
+	uint32_t modelCount;
+	uint32_t tagCount;
+	// Size of the whole file, so truncated files are detected before anything is read from them
+	uint64_t size;
+};
+
+// Offsets of the arrays following the header, only depend on the counts so reader and writer derive the same layout
+struct SnapshotLayout {
+	size_t sectors;
+	size_t positions;
+	size_t rotations;
+	size_t scales;
+	size_t velocities;
+	size_t variations;
+	size_t modelIndices;
+	size_t tagIndices;
+	// Names are stored as a length (uint32) followed by the characters, model names first
+	size_t names;
+};
+
+static size_t alignOffset(size_t offset)
+{
+	return (offset + 15) & ~static_cast<size_t>(15);
+}
+
+static SnapshotLayout getLayout(const SnapshotHeader& header)
+{
+	SnapshotLayout layout{};
+	size_t offset = alignOffset(sizeof(SnapshotHeader));
+	auto addArray = [&offset](size_t& arrayOffset, size_t size) {
+		arrayOffset = offset;
+		offset = alignOffset(offset + size);
+	};
+	addArray(layout.sectors, sizeof(SnapshotSector) * header.sectorCount);
+	addArray(layout.positions, sizeof(glm::vec3) * header.actorCount);
+	addArray(layout.rotations, sizeof(glm::vec3) * header.actorCount);
+	addArray(layout.scales, sizeof(glm::vec3) * header.actorCount);
+	addArray(layout.velocities, sizeof(glm::vec3) * header.actorCount);
+	addArray(layout.variations, sizeof(glm::vec2) * header.actorCount);
+	addArray(layout.modelIndices, sizeof(uint32_t) * header.actorCount);
+	addArray(layout.tagIndices, sizeof(uint32_t) * header.actorCount);
+	layout.names = offset;
+	return layout;
+}
+
+void SimulationSnapshotWriter::clear(uint64_t seed)
+{
+	this->seed = seed;
+	sectors.clear();
+	positions.clear();
+	rotations.clear();
+	scales.clear();
+	velocities.clear();
+	variations.clear();
+	modelIndices.clear();
+	tagIndices.clear();
+	modelNames.clear();
+	tagNames.clear();
+	modelLookup.clear();
+	tagLookup.clear();
+}
+
+void SimulationSnapshotWriter::addSector(glm::ivec2 coord, const ActorManager& actorManager, std::span<const ActorHandle> actors)
+{
+	SnapshotSector sector{ .coord = coord, .firstActor = getActorCount() };
+	for (const ActorHandle& handle : actors) {
+		if (!actorManager.isValid(handle)) {
+			continue;
+		}
+		const uint32_t index = actorManager.getIndex(handle);
+		positions.push_back(actorManager.positions[index]);
+		rotations.push_back(actorManager.rotations[index]);
+		scales.push_back(actorManager.scales[index]);
+		velocities.push_back(actorManager.velocities[index]);
+		variations.push_back(actorManager.variations[index]);
+		const ModelHandle model = actorManager.models[index];
+		auto modelIt = modelLookup.find(model.value);
+		if (modelIt == modelLookup.end()) {
+			modelIt = modelLookup.emplace(model.value, static_cast<uint32_t>(modelNames.size())).first;
+			modelNames.push_back(ApplicationContext::assetManager->getModelName(model));
+		}
+		modelIndices.push_back(modelIt->second);
+		const ActorTag tag = actorManager.tags[index];
+		auto tagIt = tagLookup.find(tag.index);
+		if (tagIt == tagLookup.end()) {
+			tagIt = tagLookup.emplace(tag.index, static_cast<uint32_t>(tagNames.size())).first;
+			tagNames.push_back(actorManager.getTagName(tag));
+		}
+		tagIndices.push_back(tagIt->second);
+	}
+	sector.actorCount = getActorCount() - sector.firstActor;
+	sectors.push_back(sector);
+}
+
+uint32_t SimulationSnapshotWriter::getActorCount() const
+{
+	return static_cast<uint32_t>(positions.size());
+}
+
+bool SimulationSnapshotWriter::write(const std::string& fileName) const
+{
+	SnapshotHeader header{
+		.magic = snapshotMagic,
+		.version = snapshotVersion,
+		.seed = seed,
+		.sectorCount = static_cast<uint32_t>(sectors.size()),
+		.actorCount = getActorCount(),
+		.modelCount = static_cast<uint32_t>(modelNames.size()),
+		.tagCount = static_cast<uint32_t>(tagNames.size())
+	};
+	const SnapshotLayout layout = getLayout(header);
+	size_t size = layout.names;
+	for (const std::vector<std::string>* names : { &modelNames, &tagNames }) {
+		for (const std::string& name : *names) {
+			size += sizeof(uint32_t) + name.size();
+		}
+	}
+	header.size = size;
+
+	// Assembled in memory, so the file is written with a single call
+	std::vector<uint8_t> data(size);
+	auto copy = [&data](size_t offset, const void* source, size_t sourceSize) {
+		if (sourceSize > 0) {
+			memcpy(data.data() + offset, source, sourceSize);
+		}
+	};
+	copy(0, &header, sizeof(header));
+	copy(layout.sectors, sectors.data(), sizeof(SnapshotSector) * sectors.size());
+	copy(layout.positions, positions.data(), sizeof(glm::vec3) * positions.size());
+	copy(layout.rotations, rotations.data(), sizeof(glm::vec3) * rotations.size());
+	copy(layout.scales, scales.data(), sizeof(glm::vec3) * scales.size());
+	copy(layout.velocities, velocities.data(), sizeof(glm::vec3) * velocities.size());
+	copy(layout.variations, variations.data(), sizeof(glm::vec2) * variations.size());
+	copy(layout.modelIndices, modelIndices.data(), sizeof(uint32_t) * modelIndices.size());
+	copy(layout.tagIndices, tagIndices.data(), sizeof(uint32_t) * tagIndices.size());
+	size_t offset = layout.names;
+	for (const std::vector<std::string>* names : { &modelNames, &tagNames }) {
+		for (const std::string& name : *names) {
+			const uint32_t length = static_cast<uint32_t>(name.size());
+			copy(offset, &length, sizeof(length));
+			copy(offset + sizeof(length), name.data(), name.size());
+			offset += sizeof(length) + name.size();
+		}
+	}
+
+	const std::string tempFileName = fileName + ".tmp";
+	{
+		std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "Could not write simulation snapshot " << tempFileName << "\n";
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		if (!file.good()) {
+			std::cerr << "Could not write simulation snapshot " << tempFileName << "\n";
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempFileName, fileName, error);
+	if (error) {
+		std::cerr << "Could not replace simulation snapshot " << fileName << ": " << error.message() << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool SimulationSnapshotReader::read(const std::string& fileName)
+{
+	release();
+	if (!std::filesystem::exists(fileName)) {
+		return false;
+	}
+	file = std::make_unique<vks::MappedFile>(fileName);
+	SnapshotHeader header{};
+	if (!file->isValid() || (file->size() < sizeof(header))) {
+		std::cerr << "Could not read simulation snapshot " << fileName << "\n";
+		release();
+		return false;
+	}
+	memcpy(&header, file->data(), sizeof(header));
+	const SnapshotLayout layout = getLayout(header);
+	auto invalid = [this, &fileName] {
+		std::cerr << fileName << " is not a valid simulation snapshot for this version\n";
+		release();
+		return false;
+	};
+	if ((header.magic != snapshotMagic) || (header.version != snapshotVersion) || (header.size != file->size()) || (layout.names > file->size())) {
+		return invalid();
+	}
+
+	// Mapped at a page boundary and 16 byte aligned within the file, so the arrays can be used in place
+	const uint8_t* data = file->data();
+	seed = header.seed;
+	sectors = { reinterpret_cast<const SnapshotSector*>(data + layout.sectors), header.sectorCount };
+	positions = { reinterpret_cast<const glm::vec3*>(data + layout.positions), header.actorCount };
+	rotations = { reinterpret_cast<const glm::vec3*>(data + layout.rotations), header.actorCount };
+	scales = { reinterpret_cast<const glm::vec3*>(data + layout.scales), header.actorCount };
+	velocities = { reinterpret_cast<const glm::vec3*>(data + layout.velocities), header.actorCount };
+	variations = { reinterpret_cast<const glm::vec2*>(data + layout.variations), header.actorCount };
+	modelIndices = { reinterpret_cast<const uint32_t*>(data + layout.modelIndices), header.actorCount };
+	tagIndices = { reinterpret_cast<const uint32_t*>(data + layout.tagIndices), header.actorCount };
+
+	size_t offset = layout.names;
+	auto readName = [&](std::string& name) {
+		uint32_t length = 0;
+		if (offset + sizeof(length) > file->size()) {
+			return false;
+		}
+		memcpy(&length, data + offset, sizeof(length));
+		offset += sizeof(length);
+		if (offset + length > file->size()) {
+			return false;
+		}
+		name.assign(reinterpret_cast<const char*>(data + offset), length);
+		offset += length;
+		return true;
+	};
+	std::string name;
+	for (uint32_t i = 0; i < header.modelCount; i++) {
+		if (!readName(name)) {
+			return invalid();
+		}
+		// Models may have been removed from the application since the snapshot was written
+		const ModelHandle model = ApplicationContext::assetManager->findModel(name);
+		if (!model.isSet()) {
+			std::cerr << "Simulation snapshot " << fileName << " refers to unknown model " << name << "\n";
+			release();
+			return false;
+		}
+		models.push_back(model);
+	}
+	tagNames.resize(header.tagCount);
+	for (std::string& tagName : tagNames) {
+		if (!readName(tagName)) {
+			return invalid();
+		}
+	}
+
+	// Indices are checked once up front, so restoring doesn't need to
+	for (uint32_t i = 0; i < header.actorCount; i++) {
+		if ((modelIndices[i] >= header.modelCount) || (tagIndices[i] >= header.tagCount)) {
+			return invalid();
+		}
+	}
+	for (const SnapshotSector& sector : sectors) {
+		if ((sector.firstActor > header.actorCount) || (sector.actorCount > header.actorCount - sector.firstActor)) {
+			return invalid();
+		}
+	}
+	return true;
+}
+
+void SimulationSnapshotReader::release()
+{
+	sectors = {};
+	positions = {};
+	rotations = {};
+	scales = {};
+	velocities = {};
+	variations = {};
+	modelIndices = {};
+	tagIndices = {};
+	models.clear();
+	tagNames.clear();
+	file.reset();
+}
+
+uint64_t SimulationSnapshotReader::getSeed() const
+{
+	return seed;
+}
+
+std::span<const SnapshotSector> SimulationSnapshotReader::getSectors() const
+{
+	return sectors;
+}
+
+uint32_t SimulationSnapshotReader::getActorCount() const
+{
+	return static_cast<uint32_t>(positions.size());
+}
+
+void SimulationSnapshotReader::restoreSector(const SnapshotSector& sector, ActorManager& actorManager, std::vector<ActorHandle>& handles) const
+{
+	handles.reserve(handles.size() + sector.actorCount);
+	for (uint32_t i = sector.firstActor; i < sector.firstActor + sector.actorCount; i++) {
+		handles.push_back(actorManager.addActor("", {
+			.position = positions[i],
+			.rotation = rotations[i],
+			.scale = scales[i],
+			.model = models[modelIndices[i]],
+			.tag = tagNames[tagIndices[i]],
+			.constantVelocity = velocities[i],
+			.variation = variations[i].y,
+			.variationSeed = variations[i].x
+		}));
+	}
+}
@@ -0,0 +1,107 @@
+/*
+ * Binary snapshots of the actors of streamed world sectors for warm restarts
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <span>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "ActorManager.h"
+#include "MappedFile.hpp"
+
+/** @brief Sector stored in a snapshot, its actors are stored one after another starting at firstActor */
+struct SnapshotSector {
+	glm::ivec2 coord{};
+	uint32_t firstActor{ 0 };
+	uint32_t actorCount{ 0 };
+};
+
+/**
+ * Captures the actors of world sectors and writes them to a compact binary file
+ * File layout: Header, sectors, one array per actor attribute (structure of arrays like the actor manager, each array 16 byte aligned), model and tag names
+ * Actors refer to models and tags by their index in the name tables, as handles and tags are only valid within a session
+ * Capturing copies the actor state, so the file can be written by a background job while the actors keep changing
+ */
+class SimulationSnapshotWriter {
+private:
+	uint64_t seed{ 0 };
+	std::vector<SnapshotSector> sectors;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::vec3> velocities;
+	std::vector<glm::vec2> variations;
+	std::vector<uint32_t> modelIndices;
+	std::vector<uint32_t> tagIndices;
+	std::vector<std::string> modelNames;
+	std::vector<std::string> tagNames;
+	// Model handle values and tag indices of the session to their index in the name tables
+	std::unordered_map<uint32_t, uint32_t> modelLookup;
+	std::unordered_map<uint32_t, uint32_t> tagLookup;
+public:
+	/** @brief Starts a new snapshot, storage of the previous one is reused */
+	void clear(uint64_t seed);
+	/**
+	* Adds a sector with its actors to the snapshot
+	*
+	* @param coord Coordinate of the sector in its sector streamer
+	* @param actorManager Actor manager the actors are read from
+	* @param actors Handles of the sector's actors, handles that are no longer valid are skipped
+	*/
+	void addSector(glm::ivec2 coord, const ActorManager& actorManager, std::span<const ActorHandle> actors);
+	uint32_t getActorCount() const;
+	/**
+	* Writes the snapshot to a temporary file that then replaces the file, so a crash while writing leaves the previous snapshot intact
+	* Only reads the captured state, so it can be called from another thread as long as the snapshot isn't changed meanwhile
+	*
+	* @return False if the file couldn't be written
+	*/
+	bool write(const std::string& fileName) const;
+};
+
+/**
+ * Reads a snapshot written by SimulationSnapshotWriter in place from a memory mapping and restores its sectors' actors
+ * Actor attributes aren't copied, actors are added straight from the mapped arrays
+ */
+class SimulationSnapshotReader {
+private:
+	std::unique_ptr<vks::MappedFile> file;
+	uint64_t seed{ 0 };
+	std::span<const SnapshotSector> sectors;
+	std::span<const glm::vec3> positions;
+	std::span<const glm::vec3> rotations;
+	std::span<const glm::vec3> scales;
+	std::span<const glm::vec3> velocities;
+	std::span<const glm::vec2> variations;
+	std::span<const uint32_t> modelIndices;
+	std::span<const uint32_t> tagIndices;
+	// Models of the name table resolved through the asset manager
+	std::vector<ModelHandle> models;
+	std::vector<std::string> tagNames;
+public:
+	/**
+	* Maps a snapshot and resolves the models it refers to
+	*
+	* @param fileName Snapshot to read
+	*
+	* @return False if the file doesn't exist, isn't a valid snapshot for this version or refers to models that aren't known to the asset manager
+	*/
+	bool read(const std::string& fileName);
+	/** @brief Unmaps the snapshot once all of its sectors have been restored */
+	void release();
+	// Seed of the sector streamer the snapshot was captured from, sectors streamed in later need to be generated with it to match
+	uint64_t getSeed() const;
+	std::span<const SnapshotSector> getSectors() const;
+	uint32_t getActorCount() const;
+	/** @brief Adds the actors of a sector to the actor manager and appends their handles */
+	void restoreSector(const SnapshotSector& sector, ActorManager& actorManager, std::vector<ActorHandle>& handles) const;
+};
@@ -0,0 +1,380 @@
+/*
+ * Loose hashed uniform grid for bounding spheres
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <span>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include "glm/glm.hpp"
+#include "Frustum.hpp"
+
+namespace vks
+{
+	/**
+	 * Spatial index for bounding spheres, used for culling, radius and ray queries without scanning all elements
+	 * Elements are stored in the cell containing their center, only occupied cells are kept in a hash map
+	 * The grid is loose: Spheres may extend up to half a cell size beyond their cell, so queries only need to look one cell further
+	 * Spheres larger than that are kept in a separate list that is always tested
+	 * Element ids are dense ([0, size())), removing an element moves the last one into the freed id (same as the ActorManager's arrays)
+	 */
+	class SpatialGrid
+	{
+	private:
+		static constexpr uint64_t oversizedKey{ UINT64_MAX };
+
+		float cellSize;
+		float invCellSize;
+		// xyz = center, w = radius
+		std::vector<glm::vec4> spheres;
+		std::vector<uint64_t> cellKeys;
+		// Position of each element inside its cell's element list, for constant time removal
+		std::vector<uint32_t> cellSlots;
+		std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+		std::vector<uint32_t> oversized;
+
+		glm::ivec3 cellCoord(const glm::vec3 position) const
+		{
+			return glm::ivec3(glm::floor(position * invCellSize));
+		}
+
+		// 21 bits per axis, enough for +/- one million cells
+		static uint64_t cellKey(const glm::ivec3 coord)
+		{
+			return (static_cast<uint64_t>(coord.x & 0x1FFFFF) << 42) | (static_cast<uint64_t>(coord.y & 0x1FFFFF) << 21) | static_cast<uint64_t>(coord.z & 0x1FFFFF);
+		}
+
+		uint64_t keyFor(const glm::vec4 sphere) const
+		{
+			return (sphere.w > cellSize * 0.5f) ? oversizedKey : cellKey(cellCoord(glm::vec3(sphere)));
+		}
+
+		std::vector<uint32_t>& bucket(uint64_t key)
+		{
+			return (key == oversizedKey) ? oversized : cells[key];
+		}
+
+		void link(uint32_t id)
+		{
+			std::vector<uint32_t>& elements = bucket(cellKeys[id]);
+			cellSlots[id] = static_cast<uint32_t>(elements.size());
+			elements.push_back(id);
+		}
+
+		void unlink(uint32_t id)
+		{
+			const uint64_t key = cellKeys[id];
+			std::vector<uint32_t>& elements = bucket(key);
+			const uint32_t slot = cellSlots[id];
+			elements[slot] = elements.back();
+			cellSlots[elements[slot]] = slot;
+			elements.pop_back();
+			// Only occupied cells are kept, so frustum queries don't have to visit empty ones
+			if (elements.empty() && key != oversizedKey) {
+				cells.erase(key);
+			}
+		}
+
+		static bool intersectSphere(const glm::vec3 origin, const glm::vec3 direction, const glm::vec4 sphere, float& distance)
+		{
+			const glm::vec3 oc = origin - glm::vec3(sphere);
+			const float b = glm::dot(oc, direction);
+			const float c = glm::dot(oc, oc) - sphere.w * sphere.w;
+			if (c > 0.0f && b > 0.0f) {
+				return false;
+			}
+			const float discriminant = b * b - c;
+			if (discriminant < 0.0f) {
+				return false;
+			}
+			// Origins inside the sphere report a hit at distance zero
+			distance = std::max(-b - std::sqrt(discriminant), 0.0f);
+			return true;
+		}
+
+		template<typename F>
+		void forEachCell(const glm::ivec3 min, const glm::ivec3 max, F&& func) const
+		{
+			// Large query volumes are cheaper to do by walking the occupied cells
+			const int64_t volume = static_cast<int64_t>(max.x - min.x + 1) * static_cast<int64_t>(max.y - min.y + 1) * static_cast<int64_t>(max.z - min.z + 1);
+			if (volume > static_cast<int64_t>(cells.size())) {
+				for (const auto& [key, elements] : cells) {
+					const glm::ivec3 coord = cellCoord(glm::vec3(spheres[elements.front()]));
+					if (glm::all(glm::greaterThanEqual(coord, min)) && glm::all(glm::lessThanEqual(coord, max))) {
+						func(elements);
+					}
+				}
+				return;
+			}
+			for (int32_t x = min.x; x <= max.x; x++) {
+				for (int32_t y = min.y; y <= max.y; y++) {
+					for (int32_t z = min.z; z <= max.z; z++) {
+						auto it = cells.find(cellKey(glm::ivec3(x, y, z)));
+						if (it != cells.end()) {
+							func(it->second);
+						}
+					}
+				}
+			}
+		}
+
+	public:
+		struct RayHit {
+			uint32_t id{ UINT32_MAX };
+			float distance{ 0.0f };
+		};
+
+		SpatialGrid(float cellSize = 32.0f) : cellSize(cellSize), invCellSize(1.0f / cellSize) {}
+
+		uint32_t size() const
+		{
+			return static_cast<uint32_t>(spheres.size());
+		}
+
+		// Appends an element, its id is the previous size
+		uint32_t add(const glm::vec3 center, float radius)
+		{
+			const uint32_t id = size();
+			spheres.push_back(glm::vec4(center, radius));
+			cellKeys.push_back(keyFor(spheres.back()));
+			cellSlots.push_back(0);
+			link(id);
+			return id;
+		}
+
+		// Only touches the cells if the element moved to another one, so updating every frame is cheap
+		void update(uint32_t id, const glm::vec3 center, float radius)
+		{
+			spheres[id] = glm::vec4(center, radius);
+			const uint64_t key = keyFor(spheres[id]);
+			if (key != cellKeys[id]) {
+				unlink(id);
+				cellKeys[id] = key;
+				link(id);
+			}
+		}
+
+		// Removes an element and moves the last element into its id
+		void remove(uint32_t id)
+		{
+			assert(id < size());
+			unlink(id);
+			const uint32_t last = size() - 1;
+			if (id != last) {
+				spheres[id] = spheres[last];
+				cellKeys[id] = cellKeys[last];
+				cellSlots[id] = cellSlots[last];
+				bucket(cellKeys[id])[cellSlots[id]] = id;
+			}
+			spheres.pop_back();
+			cellKeys.pop_back();
+			cellSlots.pop_back();
+		}
+
+		void clear()
+		{
+			spheres.clear();
+			cellKeys.clear();
+			cellSlots.clear();
+			cells.clear();
+			oversized.clear();
+		}
+
+		// Appends the ids of all elements intersecting the sphere to results, returns the number of ids added
+		uint32_t queryRadius(const glm::vec3 center, float radius, std::vector<uint32_t>& results) const
+		{
+			const size_t first = results.size();
+			auto test = [&](const std::vector<uint32_t>& elements) {
+				for (const uint32_t id : elements) {
+					const float distance = radius + spheres[id].w;
+					const glm::vec3 d = glm::vec3(spheres[id]) - center;
+					if (glm::dot(d, d) <= distance * distance) {
+						results.push_back(id);
+					}
+				}
+			};
+			test(oversized);
+			const float reach = radius + cellSize * 0.5f;
+			forEachCell(cellCoord(center - reach), cellCoord(center + reach), test);
+			return static_cast<uint32_t>(results.size() - first);
+		}
+
+		/**
+		* @brief Finds the closest element hit by a ray, walking the grid cells along the ray front to back
+		*
+		* @param origin Ray origin
+		* @param direction Normalized ray direction
+		* @param maxDistance Maximum distance along the ray
+		* @param hit Receives the id of the closest element and the distance to it
+		*
+		* @return True if an element was hit within maxDistance
+		*/
+		bool raycast(const glm::vec3 origin, const glm::vec3 direction, float maxDistance, RayHit& hit) const
+		{
+			return sweepSphere(origin, direction, maxDistance, 0.0f, hit, [](uint32_t) { return true; });
+		}
+
+		/**
+		* @brief Finds the first element touched by a sphere moving along a ray (e.g. a projectile's path during a step), walking the grid cells along the ray front to back
+		*
+		* @param origin Start position of the sphere's center
+		* @param direction Normalized direction of movement
+		* @param maxDistance Distance the sphere moves
+		* @param radius Radius of the moving sphere, zero for a plain ray
+		* @param hit Receives the id of the closest element and the distance the sphere traveled until touching it
+		* @param accept Called with the id of each candidate, elements it returns false for are ignored (e.g. the moving element itself)
+		*
+		* @return True if an accepted element was hit within maxDistance
+		*/
+		template<typename F>
+		bool sweepSphere(const glm::vec3 origin, const glm::vec3 direction, float maxDistance, float radius, RayHit& hit, F&& accept) const
+		{
+			assert(std::isfinite(maxDistance));
+			hit = {};
+			float closest = maxDistance;
+			// The moving sphere touches an element when its center is within the sum of both radii, which is a ray against the enlarged element
+			auto test = [&](const std::vector<uint32_t>& elements) {
+				for (const uint32_t id : elements) {
+					float distance;
+					if (intersectSphere(origin, direction, spheres[id] + glm::vec4(0.0f, 0.0f, 0.0f, radius), distance) && distance <= closest && accept(id)) {
+						closest = distance;
+						hit = { .id = id, .distance = distance };
+					}
+				}
+			};
+			test(oversized);
+
+			// 3D DDA, a hit at distance t is always found in the neighbourhood of the cell containing the ray at t
+			// The neighbourhood grows with the moving sphere's radius, as it can touch elements that far beyond the loose bounds of their cells
+			const glm::ivec3 reach = glm::ivec3(1 + static_cast<int32_t>(std::ceil(radius * invCellSize)));
+			glm::ivec3 coord = cellCoord(origin);
+			const glm::ivec3 step = glm::ivec3(glm::sign(direction));
+			glm::vec3 tMax, tDelta;
+			for (uint32_t i = 0; i < 3; i++) {
+				if (direction[i] != 0.0f) {
+					const float boundary = (coord[i] + (step[i] > 0 ? 1 : 0)) * cellSize;
+					tMax[i] = (boundary - origin[i]) / direction[i];
+					tDelta[i] = cellSize / std::abs(direction[i]);
+				} else {
+					tMax[i] = tDelta[i] = INFINITY;
+				}
+			}
+			float tEntry = 0.0f;
+			while (tEntry <= closest) {
+				forEachCell(coord - reach, coord + reach, test);
+				const uint32_t axis = (tMax.x < tMax.y) ? ((tMax.x < tMax.z) ? 0 : 2) : ((tMax.y < tMax.z) ? 1 : 2);
+				tEntry = tMax[axis];
+				tMax[axis] += tDelta[axis];
+				coord[axis] += step[axis];
+			}
+			return hit.id != UINT32_MAX;
+		}
+
+		/**
+		* @brief Frustum culls all elements cell by cell, cells fully inside the frustum are accepted without testing their elements
+		*
+		* @param frustum Frustum to test against
+		* @param visibleIds Receives the ids of all visible elements, must have room for size() elements
+		* @param radiusScale Factor applied to all radii
+		*
+		* @return Number of visible elements written to visibleIds
+		*/
+		uint32_t queryFrustum(Frustum& frustum, uint32_t* visibleIds, float radiusScale = 1.0f) const
+		{
+			uint32_t visibleCount = 0;
+			for (const uint32_t id : oversized) {
+				if (frustum.checkSphere(glm::vec3(spheres[id]), spheres[id].w * radiusScale)) {
+					visibleIds[visibleCount++] = id;
+				}
+			}
+			const float margin = cellSize * 0.5f * radiusScale;
+			for (const auto& [key, elements] : cells) {
+				const glm::vec3 cellMin = glm::vec3(cellCoord(glm::vec3(spheres[elements.front()]))) * cellSize;
+				const glm::vec3 cellMax = cellMin + cellSize;
+				// Tests the corners closest to (outside) and farthest from (inside) each plane
+				bool outside = false;
+				bool inside = true;
+				for (uint32_t p = 0; p < 6 && !outside; p++) {
+					const glm::vec3 normal = glm::vec3(frustum.planes[p]);
+					const glm::vec3 positive = glm::mix(cellMin, cellMax, glm::vec3(glm::greaterThanEqual(normal, glm::vec3(0.0f))));
+					const glm::vec3 negative = glm::mix(cellMax, cellMin, glm::vec3(glm::greaterThanEqual(normal, glm::vec3(0.0f))));
+					outside = (glm::dot(normal, positive) + frustum.planes[p].w <= -margin);
+					inside = inside && (glm::dot(normal, negative) + frustum.planes[p].w > 0.0f);
+				}
+				if (outside) {
+					continue;
+				}
+				for (const uint32_t id : elements) {
+					if (inside || frustum.checkSphere(glm::vec3(spheres[id]), spheres[id].w * radiusScale)) {
+						visibleIds[visibleCount++] = id;
+					}
+				}
+			}
+			return visibleCount;
+		}
+
+		/**
+		* @brief Frustum culls all elements against several frustums (e.g. one per view of the scene) in a single pass over the cells and elements
+		*
+		* @param frustums Frustums to test against, at most 32
+		* @param visibleIds Receives the ids of the elements visible in each frustum, each must have room for size() elements
+		* @param visibleCounts Receives the number of visible elements written for each frustum
+		* @param radiusScale Factor applied to all radii
+		*/
+		void queryFrustums(std::span<Frustum* const> frustums, std::span<uint32_t* const> visibleIds, std::span<uint32_t> visibleCounts, float radiusScale = 1.0f) const
+		{
+			assert((frustums.size() <= 32) && (visibleIds.size() == frustums.size()) && (visibleCounts.size() == frustums.size()));
+			const uint32_t frustumCount = static_cast<uint32_t>(frustums.size());
+			std::fill(visibleCounts.begin(), visibleCounts.end(), 0u);
+			for (const uint32_t id : oversized) {
+				for (uint32_t f = 0; f < frustumCount; f++) {
+					if (frustums[f]->checkSphere(glm::vec3(spheres[id]), spheres[id].w * radiusScale)) {
+						visibleIds[f][visibleCounts[f]++] = id;
+					}
+				}
+			}
+			const float margin = cellSize * 0.5f * radiusScale;
+			for (const auto& [key, elements] : cells) {
+				const glm::vec3 cellMin = glm::vec3(cellCoord(glm::vec3(spheres[elements.front()]))) * cellSize;
+				const glm::vec3 cellMax = cellMin + cellSize;
+				// Frustums the cell is fully inside of accept all of its elements, the ones it intersects test each element
+				uint32_t insideMask = 0;
+				uint32_t intersectMask = 0;
+				for (uint32_t f = 0; f < frustumCount; f++) {
+					bool outside = false;
+					bool inside = true;
+					for (uint32_t p = 0; p < 6 && !outside; p++) {
+						const glm::vec3 normal = glm::vec3(frustums[f]->planes[p]);
+						const glm::vec3 positive = glm::mix(cellMin, cellMax, glm::vec3(glm::greaterThanEqual(normal, glm::vec3(0.0f))));
+						const glm::vec3 negative = glm::mix(cellMax, cellMin, glm::vec3(glm::greaterThanEqual(normal, glm::vec3(0.0f))));
+						outside = (glm::dot(normal, positive) + frustums[f]->planes[p].w <= -margin);
+						inside = inside && (glm::dot(normal, negative) + frustums[f]->planes[p].w > 0.0f);
+					}
+					if (!outside) {
+						(inside ? insideMask : intersectMask) |= 1u << f;
+					}
+				}
+				if ((insideMask | intersectMask) == 0) {
+					continue;
+				}
+				for (const uint32_t id : elements) {
+					for (uint32_t f = 0; f < frustumCount; f++) {
+						const uint32_t bit = 1u << f;
+						if ((insideMask & bit) || ((intersectMask & bit) && frustums[f]->checkSphere(glm::vec3(spheres[id]), spheres[id].w * radiusScale))) {
+							visibleIds[f][visibleCounts[f]++] = id;
+						}
+					}
+				}
+			}
+		}
+	};
+}
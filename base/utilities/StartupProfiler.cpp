@@ -0,0 +1,199 @@
+/*
+ * Timings of the startup phases
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "StartupProfiler.h"
+#include "JobSystem.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+
+StartupProfiler startupProfiler;
+
+// Phases begun on the calling thread that haven't ended yet, innermost last
+static thread_local std::vector<uint32_t> openPhases;
+
+StartupProfiler::Scope::Scope(const std::string& name) : index(startupProfiler.begin(name))
+#if defined(TRACY_ENABLE)
+	, zone(__LINE__, __FILE__, strlen(__FILE__), __FUNCTION__, strlen(__FUNCTION__), name.c_str(), name.size())
+#endif
+	, traceZone(name)
+{
+}
+
+StartupProfiler::Scope::~Scope()
+{
+	startupProfiler.end(index);
+}
+
+double StartupProfiler::getTime() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+}
+
+uint32_t StartupProfiler::getThread() const
+{
+	return jobSystem ? jobSystem->getThreadIndex() : 0;
+}
+
+uint32_t StartupProfiler::begin(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (finished) {
+		return UINT32_MAX;
+	}
+	const uint32_t index = static_cast<uint32_t>(phases.size());
+	// Negative until the phase ends
+	phases.push_back({
+		.name = name,
+		.parent = openPhases.empty() ? UINT32_MAX : openPhases.back(),
+		.depth = static_cast<uint32_t>(openPhases.size()),
+		.thread = getThread(),
+		.start = getTime(),
+		.duration = -1.0
+	});
+	openPhases.push_back(index);
+	return index;
+}
+
+void StartupProfiler::end(uint32_t index)
+{
+	if (index == UINT32_MAX) {
+		return;
+	}
+	assert(!openPhases.empty() && openPhases.back() == index);
+	openPhases.pop_back();
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!finished) {
+		phases[index].duration = getTime() - phases[index].start;
+	}
+}
+
+void StartupProfiler::addMarker(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (finished) {
+		return;
+	}
+	phases.push_back({
+		.name = name,
+		.parent = openPhases.empty() ? UINT32_MAX : openPhases.back(),
+		.depth = static_cast<uint32_t>(openPhases.size()),
+		.thread = getThread(),
+		.start = getTime()
+	});
+	TracyMessage(name.c_str(), name.size());
+}
+
+void StartupProfiler::finish()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (finished) {
+		return;
+	}
+	finished = true;
+	totalTime = getTime();
+	for (StartupPhase& phase : phases) {
+		if (phase.duration < 0.0) {
+			phase.duration = totalTime - phase.start;
+		}
+	}
+	if (jobSystem) {
+		for (uint32_t thread = 0; thread < jobSystem->getThreadCount(); thread++) {
+			threadBusyTimes.push_back(std::chrono::duration<double, std::milli>(jobSystem->getBusyTime(thread)).count());
+		}
+	}
+}
+
+bool StartupProfiler::isFinished() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return finished;
+}
+
+double StartupProfiler::getTotalTime() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return totalTime;
+}
+
+void StartupProfiler::printSummary() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::cout << "Startup took " << totalTime << " ms\n";
+	std::cout << "   start ms | duration ms | thread | phase\n";
+	char line[64];
+	for (const StartupPhase& phase : phases) {
+		snprintf(line, sizeof(line), "%11.2f | %11.2f | ", phase.start, phase.duration);
+		std::cout << line;
+		if (phase.thread == UINT32_MAX) {
+			std::cout << "     - | ";
+		} else {
+			snprintf(line, sizeof(line), "%6u | ", phase.thread);
+			std::cout << line;
+		}
+		std::cout << std::string(phase.depth * 2, ' ') << phase.name << "\n";
+	}
+	// The main thread is busy outside of jobs too, so only the workers are reported
+	if (threadBusyTimes.size() > 1 && totalTime > 0.0) {
+		double busyTime = 0.0;
+		for (size_t thread = 1; thread < threadBusyTimes.size(); thread++) {
+			busyTime += threadBusyTimes[thread];
+		}
+		const double utilization = busyTime / (totalTime * static_cast<double>(threadBusyTimes.size() - 1));
+		snprintf(line, sizeof(line), "%.1f%%", utilization * 100.0);
+		std::cout << "Worker threads were busy for " << line << " of the startup time\n";
+	}
+}
+
+static std::string escapeJson(const std::string& text)
+{
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (const char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+bool StartupProfiler::saveResults(const std::string& filename, const std::string& deviceName) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::ofstream json(filename);
+	if (!json.is_open()) {
+		std::cerr << "Could not write startup timings to " << filename << "\n";
+		return false;
+	}
+	json << "{\n";
+	json << "\t\"device\": \"" << escapeJson(deviceName) << "\",\n";
+	json << "\t\"total_ms\": " << totalTime << ",\n";
+	json << "\t\"threads\": [\n";
+	for (size_t thread = 0; thread < threadBusyTimes.size(); thread++) {
+		json << "\t\t{ \"thread\": " << thread << ", \"busy_ms\": " << threadBusyTimes[thread] << ", \"utilization\": " << (totalTime > 0.0 ? threadBusyTimes[thread] / totalTime : 0.0) << " }" << ((thread + 1 < threadBusyTimes.size()) ? ",\n" : "\n");
+	}
+	json << "\t],\n";
+	json << "\t\"phases\": [\n";
+	for (size_t i = 0; i < phases.size(); i++) {
+		const StartupPhase& phase = phases[i];
+		json << "\t\t{ \"name\": \"" << escapeJson(phase.name) << "\", "
+			<< "\"parent\": " << ((phase.parent == UINT32_MAX) ? -1 : static_cast<int64_t>(phase.parent)) << ", "
+			<< "\"depth\": " << phase.depth << ", "
+			<< "\"thread\": " << ((phase.thread == UINT32_MAX) ? -1 : static_cast<int64_t>(phase.thread)) << ", "
+			<< "\"start_ms\": " << phase.start << ", "
+			<< "\"duration_ms\": " << phase.duration << " }" << ((i + 1 < phases.size()) ? ",\n" : "\n");
+	}
+	json << "\t]\n";
+	json << "}\n";
+	std::cout << "Startup timings written to " << filename << "\n";
+	return true;
+}
@@ -0,0 +1,94 @@
+/*
+ * Timings of the startup phases
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <cstdint>
+#include "TraceRecorder.h"
+
+namespace vks
+{
+	class JobSystem;
+}
+
+struct StartupPhase {
+	std::string name;
+	// Index of the enclosing phase on the same thread, UINT32_MAX for top level phases
+	uint32_t parent{ UINT32_MAX };
+	uint32_t depth{ 0 };
+	// Job system thread the phase ran on (0 is the main thread), UINT32_MAX for threads not owned by the job system
+	uint32_t thread{ 0 };
+	// Milliseconds since the profiler was created, which is at process launch for the global profiler
+	double start{ 0.0 };
+	// Zero for markers noting a point in time (e.g. the first frame)
+	double duration{ 0.0 };
+};
+
+/**
+ * Records nested timings of the work done until the application finished starting up, along with how busy the job system's workers were
+ * Phases can be recorded from any thread, they're nested per thread and also emitted as Tracy zones and trace recorder zones
+ * Nothing is recorded once finish has been called, Tracy zones are still emitted, so phases can stay in code that also runs later (e.g. model loads)
+ */
+class StartupProfiler {
+private:
+	const std::chrono::steady_clock::time_point origin{ std::chrono::steady_clock::now() };
+	std::vector<StartupPhase> phases;
+	mutable std::mutex mutex;
+	bool finished{ false };
+	double totalTime{ 0.0 };
+	// Busy milliseconds of each job system thread at the time the profiler finished
+	std::vector<double> threadBusyTimes;
+
+	double getTime() const;
+	uint32_t getThread() const;
+	uint32_t begin(const std::string& name);
+	void end(uint32_t index);
+public:
+	/** @brief Records the time from its construction to its destruction as a phase */
+	class Scope {
+	private:
+		uint32_t index;
+#if defined(TRACY_ENABLE)
+		tracy::ScopedZone zone;
+#endif
+		TraceRecorder::Zone traceZone;
+	public:
+		Scope(const std::string& name);
+		~Scope();
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+
+	// Optional, used for the thread of each phase and for the worker utilization
+	const vks::JobSystem* jobSystem{ nullptr };
+
+	/** @brief Records a point in time, e.g. the submission of the first frame */
+	void addMarker(const std::string& name);
+	/** @brief Ends startup profiling, phases still running are recorded with the time passed until now */
+	void finish();
+	bool isFinished() const;
+	// Milliseconds from the profiler's creation until finish
+	double getTotalTime() const;
+	/** @brief Prints the phases as a table indented by their nesting, followed by the utilization of the worker threads */
+	void printSummary() const;
+	/**
+	* Writes the phases and the worker utilization to a JSON file
+	*
+	* @param filename Output file
+	* @param deviceName Name of the device, stored in the file
+	*
+	* @return False if the file couldn't be written
+	*/
+	bool saveResults(const std::string& filename, const std::string& deviceName) const;
+};
+
+extern StartupProfiler startupProfiler;
@@ -0,0 +1,393 @@
+/*
+ * Coroutine tasks scheduled on the job system and the main thread
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <coroutine>
+#include <algorithm>
+#include <utility>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <cassert>
+#include "volk.h"
+#include "JobSystem.hpp"
+#include "SyncPool.hpp"
+#include "ProfiledMutex.hpp"
+
+namespace vks
+{
+	class TaskScheduler;
+
+	/**
+	 * Coroutine that's started by spawning it on a TaskScheduler or by awaiting it from another task
+	 * Awaiting a task resumes the awaiting coroutine once the task has finished, on the thread it finished on
+	 * Exceptions thrown by a task are rethrown where it's awaited, or by TaskScheduler::update for spawned tasks
+	 */
+	class Task {
+	public:
+		struct promise_type {
+			std::coroutine_handle<> continuation{};
+			std::exception_ptr exception{};
+			// Set for spawned tasks, which report their end to the scheduler instead of resuming a continuation
+			TaskScheduler* scheduler{ nullptr };
+
+			struct FinalAwaiter {
+				bool await_ready() noexcept { return false; }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+				void await_resume() noexcept {}
+			};
+
+			Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			FinalAwaiter final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception() { exception = std::current_exception(); }
+		};
+
+		Task() = default;
+		explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+		Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+		Task& operator=(Task&& other) noexcept
+		{
+			if (this != &other) {
+				if (handle) {
+					handle.destroy();
+				}
+				handle = std::exchange(other.handle, {});
+			}
+			return *this;
+		}
+		Task(const Task&) = delete;
+		Task& operator=(const Task&) = delete;
+		~Task()
+		{
+			if (handle) {
+				handle.destroy();
+			}
+		}
+
+		bool await_ready() const noexcept { return !handle || handle.done(); }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+		{
+			handle.promise().continuation = awaiting;
+			return handle;
+		}
+		void await_resume()
+		{
+			if (handle && handle.promise().exception) {
+				std::rethrow_exception(handle.promise().exception);
+			}
+		}
+	private:
+		friend class TaskScheduler;
+		std::coroutine_handle<promise_type> handle{};
+	};
+
+	/**
+	 * Runs coroutine tasks whose steps are spread over the job system's workers and the main thread
+	 * Loading code can be written as one sequence that waits on file reads, jobs and GPU work with co_await, without blocking the main thread or holding a worker while it waits:
+	 *   co_await scheduler.wait(job): resumes on the main thread once a job has finished
+	 *   co_await scheduler.submitted(token) or scheduler.timeline(semaphore, value): resumes on the main thread once the GPU has finished a submit
+	 *   co_await scheduler.run(function): runs a function on a worker (e.g. reading a file or compiling shaders) and resumes on that worker with its result
+	 *   co_await scheduler.onWorker() and scheduler.onMainThread(): moves the rest of the task to a worker or the main thread
+	 * Waits are polled by update once per frame, so a task waiting on the GPU resumes at the start of the next frame after the GPU has finished
+	 * Without additional worker threads, work that would run on a worker is run on the main thread instead
+	 */
+	class TaskScheduler {
+	private:
+		JobSystem& jobSystem;
+		ProfiledMutex mutex{ "Task scheduler" };
+		struct Wait {
+			std::function<bool()> ready;
+			std::coroutine_handle<> handle;
+		};
+		std::vector<Task> tasks;
+		std::vector<std::coroutine_handle<>> finishedTasks;
+		std::vector<std::coroutine_handle<>> mainThreadQueue;
+		std::vector<Wait> waits;
+		// Background jobs that resume tasks on workers, deleted by update once finished
+		std::vector<Job*> jobs;
+
+		friend struct Task::promise_type::FinalAwaiter;
+		void finish(std::coroutine_handle<> handle)
+		{
+			std::lock_guard<ProfiledMutex> lock(mutex);
+			finishedTasks.push_back(handle);
+		}
+
+		void resumeOnMainThread(std::coroutine_handle<> handle)
+		{
+			std::lock_guard<ProfiledMutex> lock(mutex);
+			mainThreadQueue.push_back(handle);
+		}
+
+		void addWait(std::function<bool()> ready, std::coroutine_handle<> handle)
+		{
+			std::lock_guard<ProfiledMutex> lock(mutex);
+			waits.push_back({ std::move(ready), handle });
+		}
+
+		void runOnWorker(std::function<void()> function)
+		{
+			Job* job = jobSystem.createBackgroundJob(std::move(function));
+			{
+				std::lock_guard<ProfiledMutex> lock(mutex);
+				jobs.push_back(job);
+			}
+			jobSystem.runBackground(job);
+		}
+
+		bool hasWorkers() const
+		{
+			return jobSystem.getThreadCount() > 1;
+		}
+
+		struct MainThreadAwaiter {
+			TaskScheduler& scheduler;
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> handle) { scheduler.resumeOnMainThread(handle); }
+			void await_resume() const noexcept {}
+		};
+
+		struct WorkerAwaiter {
+			TaskScheduler& scheduler;
+			bool await_ready() const noexcept { return !scheduler.hasWorkers(); }
+			void await_suspend(std::coroutine_handle<> handle) { scheduler.runOnWorker([handle] { handle.resume(); }); }
+			void await_resume() const noexcept {}
+		};
+
+		struct WaitAwaiter {
+			TaskScheduler& scheduler;
+			std::function<bool()> ready;
+			bool await_ready() const { return ready(); }
+			void await_suspend(std::coroutine_handle<> handle) { scheduler.addWait(std::move(ready), handle); }
+			void await_resume() const noexcept {}
+		};
+
+		template<typename Function>
+		struct RunAwaiter {
+			using Result = std::invoke_result_t<Function>;
+			// Void results are stored as a flag, so both cases share one awaiter
+			using Storage = std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>>;
+			TaskScheduler& scheduler;
+			Function function;
+			Storage result{};
+			std::exception_ptr exception{};
+
+			void invoke()
+			{
+				try {
+					if constexpr (std::is_void_v<Result>) {
+						function();
+						result = true;
+					} else {
+						result.emplace(function());
+					}
+				} catch (...) {
+					exception = std::current_exception();
+				}
+			}
+			bool await_ready() const noexcept { return false; }
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				if (!scheduler.hasWorkers()) {
+					invoke();
+					return false;
+				}
+				// The awaiter is part of the suspended coroutine's frame, so it stays valid until the coroutine is resumed
+				scheduler.runOnWorker([this, handle] {
+					invoke();
+					handle.resume();
+				});
+				return true;
+			}
+			Result await_resume()
+			{
+				if (exception) {
+					std::rethrow_exception(exception);
+				}
+				if constexpr (!std::is_void_v<Result>) {
+					return std::move(*result);
+				}
+			}
+		};
+
+	public:
+		explicit TaskScheduler(JobSystem& jobSystem) : jobSystem(jobSystem) {}
+
+		~TaskScheduler()
+		{
+			// Suspended tasks are destroyed without being resumed, but jobs resuming them must not run afterwards
+			waitForJobs();
+			tasks.clear();
+		}
+
+		/** @brief Starts a task on the calling thread, it runs until its first suspension before this returns, the scheduler takes over ownership */
+		void spawn(Task task)
+		{
+			assert(task.handle);
+			std::coroutine_handle<Task::promise_type> handle = task.handle;
+			handle.promise().scheduler = this;
+			{
+				std::lock_guard<ProfiledMutex> lock(mutex);
+				tasks.push_back(std::move(task));
+			}
+			handle.resume();
+		}
+
+		/** @brief Resumes tasks waiting for the main thread or for waits that are now complete, destroys finished tasks and their jobs, needs to be called once per frame from the main thread */
+		void update()
+		{
+			std::vector<std::coroutine_handle<>> resumable;
+			{
+				std::lock_guard<ProfiledMutex> lock(mutex);
+				resumable.swap(mainThreadQueue);
+				for (auto it = waits.begin(); it != waits.end();) {
+					if (it->ready()) {
+						resumable.push_back(it->handle);
+						it = waits.erase(it);
+					} else {
+						it++;
+					}
+				}
+			}
+			for (std::coroutine_handle<> handle : resumable) {
+				handle.resume();
+			}
+
+			std::exception_ptr exception{};
+			{
+				std::lock_guard<ProfiledMutex> lock(mutex);
+				for (auto it = jobs.begin(); it != jobs.end();) {
+					if (jobSystem.isFinished(*it)) {
+						delete *it;
+						it = jobs.erase(it);
+					} else {
+						it++;
+					}
+				}
+				for (std::coroutine_handle<> handle : finishedTasks) {
+					auto it = std::find_if(tasks.begin(), tasks.end(), [handle](const Task& task) { return task.handle == handle; });
+					assert(it != tasks.end());
+					if (it->handle.promise().exception && !exception) {
+						exception = it->handle.promise().exception;
+					}
+					tasks.erase(it);
+				}
+				finishedTasks.clear();
+			}
+			if (exception) {
+				std::rethrow_exception(exception);
+			}
+		}
+
+		// True while any spawned task hasn't finished yet
+		bool hasPendingTasks()
+		{
+			std::lock_guard<ProfiledMutex> lock(mutex);
+			return !tasks.empty();
+		}
+
+		/** @brief Updates until all spawned tasks have finished, e.g. before shutting down */
+		void waitIdle()
+		{
+			while (hasPendingTasks()) {
+				update();
+				std::this_thread::yield();
+			}
+			waitForJobs();
+		}
+
+		/** @brief Waits for all jobs resuming tasks, the calling thread executes other jobs in the meantime */
+		void waitForJobs()
+		{
+			while (true) {
+				Job* job{ nullptr };
+				{
+					std::lock_guard<ProfiledMutex> lock(mutex);
+					if (jobs.empty()) {
+						return;
+					}
+					job = jobs.back();
+					jobs.pop_back();
+				}
+				jobSystem.wait(job);
+				delete job;
+			}
+		}
+
+		/** @brief Resumes the awaiting task on the main thread with the next update */
+		MainThreadAwaiter onMainThread()
+		{
+			return { *this };
+		}
+
+		/** @brief Resumes the awaiting task on a worker thread */
+		WorkerAwaiter onWorker()
+		{
+			return { *this };
+		}
+
+		/** @brief Resumes the awaiting task on the main thread once ready returns true, ready is called by update with the scheduler's lock held */
+		WaitAwaiter until(std::function<bool()> ready)
+		{
+			return { *this, std::move(ready) };
+		}
+
+		/** @brief Resumes the awaiting task on the main thread once a job (and all of its children) has finished */
+		WaitAwaiter wait(const Job* job)
+		{
+			return until([this, job] { return jobSystem.isFinished(job); });
+		}
+
+		/** @brief Resumes the awaiting task on the main thread once the GPU has finished a submit made through the sync pool (e.g. CommandBuffer::submitAsync) */
+		WaitAwaiter submitted(SubmitToken token)
+		{
+			return until([token]() mutable { return VulkanContext::syncPool->isComplete(token); });
+		}
+
+		/** @brief Resumes the awaiting task on the main thread once a timeline semaphore has reached a value (e.g. the staging buffer's transfers) */
+		WaitAwaiter timeline(VkSemaphore semaphore, uint64_t value)
+		{
+			return until([semaphore, value] {
+				uint64_t currentValue{ 0 };
+				vkGetSemaphoreCounterValue(VulkanContext::device->logicalDevice, semaphore, &currentValue);
+				return currentValue >= value;
+			});
+		}
+
+		/**
+		* Runs a function on a worker thread and resumes the awaiting task on that worker with the function's result
+		*
+		* @param function Work to be executed, its exceptions are rethrown in the awaiting task
+		*/
+		template<typename Function>
+		RunAwaiter<Function> run(Function function)
+		{
+			return { *this, std::move(function) };
+		}
+	};
+
+	inline std::coroutine_handle<> Task::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+	{
+		promise_type& promise = handle.promise();
+		if (promise.continuation) {
+			return promise.continuation;
+		}
+		// The task is suspended at this point, so the scheduler may destroy it as soon as it has been reported
+		if (promise.scheduler) {
+			promise.scheduler->finish(handle);
+		}
+		return std::noop_coroutine();
+	}
+}
@@ -0,0 +1,262 @@
+/*
+ * Mip level streaming for textures registered with the asset manager
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <cmath>
+#include "AssetManager.h"
+#include "VulkanContext.h"
+#include "StagingBuffer.hpp"
+#include "TraceRecorder.h"
+
+TextureStreamer::TextureStreamer(AssetManager* assetManager, TextureStreamerCreateInfo createInfo)
+{
+	this->assetManager = assetManager;
+	settings = createInfo;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	waitIdle();
+	for (auto& texture : textures) {
+		delete texture->job;
+		if (texture->pendingTexture) {
+			texture->pendingTexture->destroy();
+			delete texture->pendingTexture;
+		}
+	}
+}
+
+TextureStreamer::StreamedTexture* TextureStreamer::getStreamed(uint32_t assetIndex) const
+{
+	if (assetIndex >= streamedIndices.size() || streamedIndices[assetIndex] == UINT32_MAX) {
+		return nullptr;
+	}
+	return textures[streamedIndices[assetIndex]].get();
+}
+
+uint32_t TextureStreamer::add(const std::string name, const vks::TextureCreateInfo& createInfo)
+{
+	TraceZoneScopedN("Add streamed texture");
+	MemoryStats::Scope memoryScope(MemoryCategory::Textures);
+	vks::TextureData data;
+	vks::Texture::loadTextureData(createInfo, data);
+
+	auto texture = std::make_unique<StreamedTexture>();
+	texture->createInfo = createInfo;
+	// Only the initial upload of the resident levels is part of the batch, levels streamed in later are uploaded on their own
+	texture->createInfo.uploadBatch = nullptr;
+	texture->width = data.width;
+	texture->height = data.height;
+	texture->mipLevels = data.mipLevels;
+	texture->tailSizes.resize(data.mipLevels);
+	for (uint32_t level = 0; level < data.mipLevels; level++) {
+		texture->tailSizes[level] = data.getTailSize(level);
+	}
+	while ((texture->baseLevel + 1 < data.mipLevels) && (std::max(data.width, data.height) >> texture->baseLevel) > settings.residentSize) {
+		texture->baseLevel++;
+	}
+	texture->residentLevel = texture->baseLevel;
+	texture->targetLevel = texture->baseLevel;
+
+	vks::Texture2D* texture2D = new vks::Texture2D(data, texture->baseLevel, createInfo);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	texture->assetIndex = assetManager->add(name, texture2D);
+	residentMemory += texture->tailSizes[texture->baseLevel];
+	if (streamedIndices.size() <= texture->assetIndex) {
+		streamedIndices.resize(texture->assetIndex + 1, UINT32_MAX);
+	}
+	streamedIndices[texture->assetIndex] = static_cast<uint32_t>(textures.size());
+	const uint32_t assetIndex = texture->assetIndex;
+	textures.push_back(std::move(texture));
+	return assetIndex;
+}
+
+void TextureStreamer::remove(uint32_t assetIndex)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	StreamedTexture* texture = getStreamed(assetIndex);
+	if (!texture) {
+		return;
+	}
+	if (texture->job) {
+		jobSystem->wait(texture->job);
+		delete texture->job;
+	}
+	if (texture->pendingTexture) {
+		assert(onTextureRetired);
+		onTextureRetired(texture->pendingTexture);
+	}
+	if (texture->loading) {
+		pendingLoads--;
+	}
+	residentMemory -= texture->tailSizes[texture->residentLevel];
+
+	// Swap with the last texture, so the indices of all other textures stay valid
+	const uint32_t streamedIndex = streamedIndices[assetIndex];
+	streamedIndices[assetIndex] = UINT32_MAX;
+	if (streamedIndex != textures.size() - 1) {
+		textures[streamedIndex] = std::move(textures.back());
+		streamedIndices[textures[streamedIndex]->assetIndex] = streamedIndex;
+	}
+	textures.pop_back();
+}
+
+bool TextureStreamer::isStreamed(uint32_t assetIndex) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return getStreamed(assetIndex) != nullptr;
+}
+
+void TextureStreamer::request(uint32_t assetIndex, float screenSize)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	StreamedTexture* texture = getStreamed(assetIndex);
+	if (!texture || screenSize <= 0.0f) {
+		return;
+	}
+	// One texel per pixel
+	const float texelsPerPixel = static_cast<float>(std::max(texture->width, texture->height)) / screenSize;
+	const uint32_t level = texelsPerPixel > 1.0f ? static_cast<uint32_t>(std::floor(std::log2(texelsPerPixel))) : 0;
+	texture->requestedLevel = std::min({ texture->requestedLevel, level, texture->baseLevel });
+}
+
+// Textures keep the most detailed level requested within the eviction delay
+// If these don't fit into the budget, the detail of all textures is lowered by the same number of levels until they do
+void TextureStreamer::updateTargetLevels()
+{
+	uint32_t maxBias = 0;
+	for (auto& texture : textures) {
+		if (texture->requestedLevel != UINT32_MAX) {
+			texture->lastRequestedLevel = texture->requestedLevel;
+			texture->lastRequestFrame = frameCounter;
+			texture->requestedLevel = UINT32_MAX;
+		}
+		const bool recentlyRequested = (texture->lastRequestedLevel != UINT32_MAX) && (frameCounter - texture->lastRequestFrame <= settings.evictionDelay);
+		texture->targetLevel = recentlyRequested ? texture->lastRequestedLevel : texture->baseLevel;
+		maxBias = std::max(maxBias, texture->baseLevel - texture->targetLevel);
+	}
+
+	auto getMemory = [this](uint32_t bias) {
+		VkDeviceSize memory = 0;
+		for (auto& texture : textures) {
+			memory += texture->tailSizes[std::min(texture->targetLevel + bias, texture->baseLevel)];
+		}
+		return memory;
+	};
+	uint32_t bias = 0;
+	while ((bias < maxBias) && (getMemory(bias) > settings.budget)) {
+		bias++;
+	}
+	for (auto& texture : textures) {
+		texture->targetLevel = std::min(texture->targetLevel + bias, texture->baseLevel);
+	}
+}
+
+void TextureStreamer::startLoad(StreamedTexture* texture, uint32_t level)
+{
+	texture->loading = true;
+	texture->loadingLevel = level;
+	pendingLoads++;
+	auto loadFunction = [texture] {
+		MemoryStats::Scope memoryScope(MemoryCategory::Textures);
+		vks::Texture::loadTextureData(texture->createInfo, texture->data);
+	};
+	vks::JobSystem::runBackgroundOrInline(jobSystem, texture->job, loadFunction);
+}
+
+void TextureStreamer::update()
+{
+	TraceZoneScopedN("Texture streaming");
+	MemoryStats::Scope memoryScope(MemoryCategory::Textures);
+	std::lock_guard<std::mutex> lock(mutex);
+	frameCounter++;
+
+	// Publish before uploading, so the acquire barriers of an upload have been submitted with at least one frame before the texture is used
+	for (auto& texture : textures) {
+		if (!texture->pendingTexture || !VulkanContext::stagingBuffer->isComplete(texture->pendingTexture->uploadTimelineValue)) {
+			continue;
+		}
+		vks::Texture* retiredTexture = assetManager->setTexture(texture->assetIndex, texture->pendingTexture);
+		residentMemory = residentMemory - texture->tailSizes[texture->residentLevel] + texture->tailSizes[texture->loadingLevel];
+		texture->residentLevel = texture->loadingLevel;
+		texture->pendingTexture = nullptr;
+		texture->loading = false;
+		pendingLoads--;
+		assert(onTextureRetired);
+		onTextureRetired(retiredTexture);
+	}
+
+	for (auto& texture : textures) {
+		if (!texture->loading || texture->pendingTexture || (texture->job && !jobSystem->isFinished(texture->job))) {
+			continue;
+		}
+		delete texture->job;
+		texture->job = nullptr;
+		texture->pendingTexture = new vks::Texture2D(texture->data, texture->loadingLevel, texture->createInfo);
+		// No host copy is kept, the next change of the mip chain loads the file again
+		texture->data = {};
+	}
+
+	updateTargetLevels();
+
+	// Evictions free memory for other textures so they're started first, followed by the textures missing the most levels
+	std::vector<StreamedTexture*> candidates;
+	for (auto& texture : textures) {
+		if (!texture->loading && (texture->targetLevel != texture->residentLevel)) {
+			candidates.push_back(texture.get());
+		}
+	}
+	auto getPriority = [](const StreamedTexture* texture) {
+		const int32_t missingLevels = static_cast<int32_t>(texture->residentLevel) - static_cast<int32_t>(texture->targetLevel);
+		return missingLevels < 0 ? INT32_MAX : missingLevels;
+	};
+	std::sort(candidates.begin(), candidates.end(), [&getPriority](const StreamedTexture* a, const StreamedTexture* b) { return getPriority(a) > getPriority(b); });
+	for (StreamedTexture* texture : candidates) {
+		if (pendingLoads >= settings.maxPendingLoads) {
+			break;
+		}
+		startLoad(texture, texture->targetLevel);
+	}
+}
+
+void TextureStreamer::waitIdle()
+{
+	for (auto& texture : textures) {
+		if (texture->job) {
+			jobSystem->wait(texture->job);
+		}
+	}
+}
+
+void TextureStreamer::setBudget(VkDeviceSize budget)
+{
+	settings.budget = budget;
+}
+
+VkDeviceSize TextureStreamer::getBudget() const
+{
+	return settings.budget;
+}
+
+VkDeviceSize TextureStreamer::getResidentMemory() const
+{
+	return residentMemory;
+}
+
+uint32_t TextureStreamer::getTextureCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return static_cast<uint32_t>(textures.size());
+}
+
+uint32_t TextureStreamer::getPendingLoads() const
+{
+	return pendingLoads;
+}
@@ -0,0 +1,123 @@
+/*
+ * Mip level streaming for textures registered with the asset manager
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include "volk.h"
+#include "Texture.hpp"
+#include "JobSystem.hpp"
+
+class AssetManager;
+
+struct TextureStreamerCreateInfo {
+	// Device memory all streamed textures may occupy together, if exceeded the detail of all textures is lowered evenly
+	VkDeviceSize budget{ 256 * 1024 * 1024 };
+	// Mip levels up to this size are always resident, so textures can be sampled right after they have been added
+	uint32_t residentSize{ 64 };
+	// Number of frames a texture keeps its detail after it has last been requested
+	uint32_t evictionDelay{ 120 };
+	// Upper bound for textures that are (re)loaded at the same time
+	uint32_t maxPendingLoads{ 4 };
+};
+
+/**
+ * Streams the mip levels of KTX and KTX2 textures in and out depending on how large they are requested to appear on screen
+ * Textures start with only their smallest levels resident, more detailed levels are loaded on the job system once requested
+ * A texture that changes its resident levels is recreated with the new mip chain and replaces the old one in the asset manager with the same asset index
+ * The replaced texture may still be in use by frames in flight, so it's handed to onTextureRetired instead of being destroyed
+ */
+class TextureStreamer {
+private:
+	struct StreamedTexture {
+		uint32_t assetIndex{ 0 };
+		vks::TextureCreateInfo createInfo{};
+		// Size of the full mip chain
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		uint32_t mipLevels{ 0 };
+		// Bytes of all levels starting at the given one
+		std::vector<VkDeviceSize> tailSizes;
+		// Least detailed level that's always resident
+		uint32_t baseLevel{ 0 };
+		// Most detailed level of the texture registered with the asset manager
+		uint32_t residentLevel{ 0 };
+		// Most detailed level requested this frame
+		uint32_t requestedLevel{ UINT32_MAX };
+		uint32_t lastRequestedLevel{ UINT32_MAX };
+		uint64_t lastRequestFrame{ 0 };
+		// Level targeted by the current budget
+		uint32_t targetLevel{ 0 };
+		// Reload in flight
+		bool loading{ false };
+		uint32_t loadingLevel{ 0 };
+		vks::Job* job{ nullptr };
+		vks::TextureData data{};
+		vks::Texture2D* pendingTexture{ nullptr };
+	};
+	TextureStreamerCreateInfo settings;
+	std::vector<std::unique_ptr<StreamedTexture>> textures;
+	// Maps asset indices to the streamed textures, UINT32_MAX for textures that aren't streamed
+	std::vector<uint32_t> streamedIndices;
+	// Textures may be added from model loading jobs
+	mutable std::mutex mutex;
+	uint64_t frameCounter{ 0 };
+	VkDeviceSize residentMemory{ 0 };
+	uint32_t pendingLoads{ 0 };
+
+	StreamedTexture* getStreamed(uint32_t assetIndex) const;
+	void startLoad(StreamedTexture* texture, uint32_t level);
+	void updateTargetLevels();
+public:
+	AssetManager* assetManager{ nullptr };
+	// Used to load more detailed levels in the background, if not set (or without worker threads) these are loaded on the main thread
+	vks::JobSystem* jobSystem{ nullptr };
+	// Called once a texture has been replaced with a different mip chain, takes over ownership of the replaced texture
+	std::function<void(vks::Texture* texture)> onTextureRetired;
+
+	TextureStreamer(AssetManager* assetManager, TextureStreamerCreateInfo createInfo);
+	~TextureStreamer();
+	/**
+	* Loads a texture with only its smallest levels resident and registers it with the asset manager
+	*
+	* @param name Name the texture is registered with
+	* @param createInfo Texture create info, needs to point to a KTX or KTX2 file with a full mip chain
+	*
+	* @return Asset index of the texture, stays the same when the texture is replaced with a different mip chain
+	*/
+	uint32_t add(const std::string name, const vks::TextureCreateInfo& createInfo);
+	/**
+	* Stops streaming a texture, called by the asset manager when the texture is removed
+	* A replacement that's still being uploaded is handed to onTextureRetired, the texture registered with the asset manager is left to the caller
+	*
+	* @param assetIndex Asset index of the texture, indices of textures that aren't streamed are ignored
+	*/
+	void remove(uint32_t assetIndex);
+	bool isStreamed(uint32_t assetIndex) const;
+	/**
+	* Requests the detail a texture is used with this frame, multiple requests for the same texture keep the most detailed one
+	*
+	* @param assetIndex Asset index of the texture, indices of textures that aren't streamed are ignored
+	* @param screenSize Size in pixels the texture is expected to cover on screen
+	*/
+	void request(uint32_t assetIndex, float screenSize);
+	/** @brief Publishes finished uploads and starts loading textures that need a different mip chain, needs to be called once per frame from the main thread */
+	void update();
+	/** @brief Waits until all background loading jobs have finished */
+	void waitIdle();
+	void setBudget(VkDeviceSize budget);
+	VkDeviceSize getBudget() const;
+	// Estimated device memory occupied by the resident levels of all streamed textures
+	VkDeviceSize getResidentMemory() const;
+	uint32_t getTextureCount() const;
+	uint32_t getPendingLoads() const;
+};
@@ -0,0 +1,91 @@
+/*
+ * Quality limits derived from the thermal state of a device
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+struct ThermalQualityLevel {
+	// Upper limit for the render scale
+	float maxResolutionScale{ 1.0f };
+	// Multiplier for the projected size LODs are selected with, lower values select coarser LODs closer to the camera
+	float lodBias{ 1.0f };
+	// Multiplier for the distance up to which actors are drawn
+	float drawDistanceScale{ 1.0f };
+};
+
+/**
+ * Steps quality down while a device heats up, so it can hold its frame rate instead of being throttled, and back up once it has cooled down
+ * The thermal status follows Android's AThermalStatus (0 = none up to 6 = shutdown), the headroom forecast (1.0 = severe throttling) lowers quality before the status changes
+ * Quality is lowered right away but only raised after the device stayed cooler for a while, so it doesn't oscillate around a status change
+ * Without thermal status (e.g. on desktop platforms) quality stays at the first level
+ */
+class ThermalQuality {
+private:
+	uint32_t level{ 0 };
+	float recoveryTimer{ 0.0f };
+public:
+	// From full quality down to the lowest quality
+	std::vector<ThermalQualityLevel> levels{
+		{ 1.0f, 1.0f, 1.0f },
+		{ 0.85f, 0.75f, 0.85f },
+		{ 0.7f, 0.5f, 0.7f },
+		{ 0.5f, 0.35f, 0.5f },
+	};
+	// Forecasts at or above this lower quality by one more level than the status alone
+	float headroomThreshold{ 0.9f };
+	// Seconds the device needs to stay cooler before quality is raised by one level
+	float recoveryTime{ 10.0f };
+
+	/**
+	* Updates the quality level, to be called once per frame
+	*
+	* @param thermalStatus Current thermal status, none (0) and light (1) keep full quality
+	* @param headroom Forecast of the thermal headroom, ignored if NaN
+	* @param deltaTime Seconds since the last update
+	*/
+	void update(int32_t thermalStatus, float headroom, float deltaTime)
+	{
+		const uint32_t lastLevel = static_cast<uint32_t>(levels.size()) - 1;
+		uint32_t targetLevel = static_cast<uint32_t>(std::clamp(thermalStatus - 1, 0, static_cast<int32_t>(lastLevel)));
+		if (!std::isnan(headroom) && (headroom >= headroomThreshold)) {
+			targetLevel = std::min(targetLevel + 1, lastLevel);
+		}
+		if (targetLevel > level) {
+			level = targetLevel;
+			recoveryTimer = 0.0f;
+		} else if (targetLevel < level) {
+			recoveryTimer += deltaTime;
+			if (recoveryTimer >= recoveryTime) {
+				level--;
+				recoveryTimer = 0.0f;
+			}
+		} else {
+			recoveryTimer = 0.0f;
+		}
+	}
+
+	void reset()
+	{
+		level = 0;
+		recoveryTimer = 0.0f;
+	}
+
+	uint32_t getLevel() const
+	{
+		return level;
+	}
+
+	const ThermalQualityLevel& getQuality() const
+	{
+		return levels[level];
+	}
+};
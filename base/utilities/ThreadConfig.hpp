@@ -0,0 +1,259 @@
+/*
+ * Thread priorities, affinities and processor topology
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <set>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <sys/qos.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+namespace vks
+{
+	namespace threading
+	{
+		enum class Priority { Background, Normal, High };
+
+		/**
+		 * Logical processors on the fastest cores of the system, e.g. the P-cores of hybrid desktop CPUs or the big cores of big.LITTLE devices
+		 * All cores count as performance cores on systems where all cores are the same
+		 */
+		struct ProcessorInfo {
+			uint32_t logicalProcessorCount{ 0 };
+			std::vector<uint32_t> performanceProcessors;
+			// Physical cores the performance processors belong to, SMT siblings share a core
+			uint32_t performanceCoreCount{ 0 };
+			// Cores differ in performance, so where a thread runs matters
+			bool hybrid{ false };
+		};
+
+#if defined(__linux__)
+		inline int64_t readSysfsValue(const std::string& path, int64_t defaultValue)
+		{
+			std::ifstream file(path);
+			int64_t value{ defaultValue };
+			if (!(file >> value)) {
+				return defaultValue;
+			}
+			return value;
+		}
+#endif
+
+		inline ProcessorInfo queryProcessorInfo()
+		{
+			ProcessorInfo info{};
+			info.logicalProcessorCount = std::max(std::thread::hardware_concurrency(), 1u);
+#if defined(_WIN32)
+			// Higher efficiency classes are faster, all cores have the same class on non-hybrid systems
+			// Only the first processor group is considered, which covers systems with up to 64 logical processors
+			DWORD length{ 0 };
+			GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+			std::vector<uint8_t> buffer(length);
+			if ((length > 0) && GetLogicalProcessorInformationEx(RelationProcessorCore, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data()), &length)) {
+				struct Core {
+					BYTE efficiencyClass;
+					KAFFINITY mask;
+				};
+				std::vector<Core> cores;
+				for (DWORD offset = 0; offset < length;) {
+					const auto* entry = reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+					if (entry->Processor.GroupMask[0].Group == 0) {
+						cores.push_back({ entry->Processor.EfficiencyClass, entry->Processor.GroupMask[0].Mask });
+					}
+					offset += entry->Size;
+				}
+				BYTE minClass{ UINT8_MAX };
+				BYTE maxClass{ 0 };
+				for (const Core& core : cores) {
+					minClass = std::min(minClass, core.efficiencyClass);
+					maxClass = std::max(maxClass, core.efficiencyClass);
+				}
+				info.hybrid = !cores.empty() && (minClass != maxClass);
+				for (const Core& core : cores) {
+					if (core.efficiencyClass != maxClass) {
+						continue;
+					}
+					info.performanceCoreCount++;
+					for (uint32_t i = 0; i < sizeof(KAFFINITY) * 8; i++) {
+						if (core.mask & (KAFFINITY(1) << i)) {
+							info.performanceProcessors.push_back(i);
+						}
+					}
+				}
+			}
+#elif defined(__linux__)
+			// Core types aren't exposed directly, but they differ in their maximum frequency
+			// Ones within 15% of the fastest are the same type (e.g. favored cores of the same design), otherwise cores above the mid point between the slowest and the fastest count as fast
+			struct Processor {
+				uint32_t index;
+				int64_t maxFrequency;
+				int64_t core;
+			};
+			std::vector<Processor> processors;
+			for (uint32_t i = 0; i < info.logicalProcessorCount; i++) {
+				const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(i);
+				const int64_t package = readSysfsValue(path + "/topology/physical_package_id", 0);
+				processors.push_back({ i, readSysfsValue(path + "/cpufreq/cpuinfo_max_freq", 0), (package << 32) | readSysfsValue(path + "/topology/core_id", i) });
+			}
+			const auto [slowest, fastest] = std::minmax_element(processors.begin(), processors.end(), [](const Processor& a, const Processor& b) { return a.maxFrequency < b.maxFrequency; });
+			info.hybrid = slowest->maxFrequency < fastest->maxFrequency * 85 / 100;
+			const int64_t threshold = info.hybrid ? (slowest->maxFrequency + fastest->maxFrequency) / 2 : 0;
+			std::set<int64_t> cores;
+			for (const Processor& processor : processors) {
+				if (processor.maxFrequency >= threshold) {
+					info.performanceProcessors.push_back(processor.index);
+					cores.insert(processor.core);
+				}
+			}
+			info.performanceCoreCount = static_cast<uint32_t>(cores.size());
+#endif
+			// Topology couldn't be queried, assume all processors are equal and without SMT
+			if (info.performanceProcessors.empty()) {
+				info.hybrid = false;
+				info.performanceCoreCount = info.logicalProcessorCount;
+				for (uint32_t i = 0; i < info.logicalProcessorCount; i++) {
+					info.performanceProcessors.push_back(i);
+				}
+			}
+			return info;
+		}
+
+		// Queried once, the topology doesn't change while the application is running
+		inline const ProcessorInfo& getProcessorInfo()
+		{
+			static const ProcessorInfo info = queryProcessorInfo();
+			return info;
+		}
+
+		// Number of threads that can run time critical work in parallel without ending up on slow cores or sharing a core
+		inline uint32_t getPerformanceCoreCount()
+		{
+			return std::max(getProcessorInfo().performanceCoreCount, 1u);
+		}
+
+		/**
+		 * Restricts the calling thread to the performance cores, so the scheduler doesn't move it to an efficiency core (e.g. while it waits for the GPU)
+		 * Does nothing on systems where all cores are the same, and on platforms without thread affinities (Apple platforms use the priority's quality of service instead)
+		 *
+		 * @return True if the thread's affinity was changed
+		 */
+		inline bool pinCurrentThreadToPerformanceCores()
+		{
+			const ProcessorInfo& info = getProcessorInfo();
+			if (!info.hybrid) {
+				return false;
+			}
+#if defined(_WIN32)
+			DWORD_PTR mask{ 0 };
+			for (const uint32_t processor : info.performanceProcessors) {
+				mask |= DWORD_PTR(1) << processor;
+			}
+			return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (const uint32_t processor : info.performanceProcessors) {
+				CPU_SET(processor, &set);
+			}
+			return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+			return false;
+#endif
+		}
+
+#if defined(__linux__)
+		// I/O priorities aren't wrapped by the C library, see ioprio_set(2)
+		inline bool setCurrentThreadIoPriority(bool idle)
+		{
+			constexpr int ioprioWhoProcess = 1;
+			constexpr int ioprioClassShift = 13;
+			constexpr int ioprioClassBestEffort = 2;
+			constexpr int ioprioClassIdle = 3;
+			// The best effort level 4 is the default for threads without an explicit I/O priority
+			const int priority = idle ? (ioprioClassIdle << ioprioClassShift) : ((ioprioClassBestEffort << ioprioClassShift) | 4);
+			return syscall(SYS_ioprio_set, ioprioWhoProcess, 0, priority) == 0;
+		}
+#endif
+
+		/**
+		 * Sets the scheduling priority of the calling thread, meant for threads that keep their priority (e.g. the main thread or a file watcher)
+		 * Raising the priority may need privileges on some platforms (e.g. Linux), the thread then keeps its current priority
+		 * Lowering it also lowers the thread's I/O priority where supported
+		 *
+		 * @return True if the priority was changed
+		 */
+		inline bool setCurrentThreadPriority(Priority priority)
+		{
+#if defined(_WIN32)
+			const int values[] = { THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_ABOVE_NORMAL };
+			return SetThreadPriority(GetCurrentThread(), values[static_cast<int>(priority)]) != 0;
+#elif defined(__APPLE__)
+			const qos_class_t classes[] = { QOS_CLASS_BACKGROUND, QOS_CLASS_DEFAULT, QOS_CLASS_USER_INTERACTIVE };
+			return pthread_set_qos_class_self_np(classes[static_cast<int>(priority)], 0) == 0;
+#elif defined(__linux__)
+			// Nice values apply to single threads on Linux
+			const int values[] = { 10, 0, -5 };
+			if (priority == Priority::Background) {
+				setCurrentThreadIoPriority(true);
+			}
+			return setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), values[static_cast<int>(priority)]) == 0;
+#else
+			return false;
+#endif
+		}
+
+		/**
+		 * Lowers the calling thread's priority while background work (e.g. asset loading or streaming) runs on a thread that also runs time critical work
+		 * Only changes what can be restored without privileges: background mode on Windows, quality of service on Apple platforms and the I/O priority on Linux
+		 */
+		class BackgroundScope {
+		public:
+			BackgroundScope()
+			{
+#if defined(_WIN32)
+				SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined(__APPLE__)
+				pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#elif defined(__linux__)
+				setCurrentThreadIoPriority(true);
+#endif
+			}
+
+			~BackgroundScope()
+			{
+#if defined(_WIN32)
+				SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+#elif defined(__APPLE__)
+				pthread_set_qos_class_self_np(QOS_CLASS_DEFAULT, 0);
+#elif defined(__linux__)
+				setCurrentThreadIoPriority(false);
+#endif
+			}
+
+			BackgroundScope(const BackgroundScope&) = delete;
+			BackgroundScope& operator=(const BackgroundScope&) = delete;
+		};
+	}
+}
@@ -0,0 +1,187 @@
+/*
+ * In-process trace recording with Chrome trace event export
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "TraceRecorder.h"
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cassert>
+#include <bit>
+
+TraceRecorder traceRecorder;
+
+thread_local TraceRecorder::ThreadBuffer* TraceRecorder::currentThreadBuffer{ nullptr };
+thread_local std::string TraceRecorder::currentThreadName;
+
+TraceRecorder::Zone::Zone(const char* name) : name(name)
+{
+	if (traceRecorder.isRecording()) {
+		start = now();
+		active = true;
+	}
+}
+
+TraceRecorder::Zone::Zone(const std::string& name) : dynamicName(traceRecorder.isRecording() ? name : std::string())
+{
+	if (traceRecorder.isRecording()) {
+		start = now();
+		active = true;
+	}
+}
+
+TraceRecorder::Zone::~Zone()
+{
+	if (!active) {
+		return;
+	}
+	const uint64_t end = now();
+	ThreadBuffer& buffer = traceRecorder.getThreadBuffer();
+	if (!name) {
+		buffer.names.push_back(std::move(dynamicName));
+		name = buffer.names.back().c_str();
+	}
+	traceRecorder.addEvent(buffer, { .name = name, .start = start, .value = end, .type = EventType::Zone });
+}
+
+TraceRecorder::ThreadBuffer& TraceRecorder::getThreadBuffer()
+{
+	if (!currentThreadBuffer) {
+		std::lock_guard<std::mutex> lock(threadMutex);
+		auto buffer = std::make_unique<ThreadBuffer>();
+		buffer->id = static_cast<uint32_t>(threadBuffers.size());
+		buffer->name = currentThreadName.empty() ? "Thread " + std::to_string(buffer->id) : currentThreadName;
+		// Only grows once the first events have been recorded, so threads recording few events don't reallocate
+		buffer->events.reserve(4096);
+		currentThreadBuffer = buffer.get();
+		threadBuffers.push_back(std::move(buffer));
+	}
+	return *currentThreadBuffer;
+}
+
+void TraceRecorder::addEvent(ThreadBuffer& buffer, const Event& event)
+{
+	if (buffer.events.size() >= maxEventsPerThread) {
+		buffer.droppedEvents++;
+		return;
+	}
+	buffer.events.push_back(event);
+}
+
+void TraceRecorder::start()
+{
+	recording.store(true, std::memory_order_relaxed);
+}
+
+void TraceRecorder::stop()
+{
+	recording.store(false, std::memory_order_relaxed);
+}
+
+void TraceRecorder::setThreadName(const std::string& name)
+{
+	currentThreadName = name;
+	if (currentThreadBuffer) {
+		std::lock_guard<std::mutex> lock(threadMutex);
+		currentThreadBuffer->name = name;
+	}
+}
+
+void TraceRecorder::addCounter(const char* name, double value)
+{
+	if (!isRecording()) {
+		return;
+	}
+	addEvent(getThreadBuffer(), { .name = name, .start = now(), .value = std::bit_cast<uint64_t>(value), .type = EventType::Counter });
+}
+
+void TraceRecorder::addGpuZone(const std::string& name, uint64_t start, uint64_t end)
+{
+	if (!isRecording()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(gpuMutex);
+	gpuBuffer.names.push_back(name);
+	addEvent(gpuBuffer, { .name = gpuBuffer.names.back().c_str(), .start = start, .value = end, .type = EventType::Zone });
+}
+
+static void writeJsonString(std::ofstream& file, const char* text)
+{
+	file << '"';
+	for (const char* c = text; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			file << '\\' << *c;
+		} else if (static_cast<unsigned char>(*c) < 0x20) {
+			file << ' ';
+		} else {
+			file << *c;
+		}
+	}
+	file << '"';
+}
+
+bool TraceRecorder::write(const std::string& filename)
+{
+	assert(!isRecording());
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		std::cerr << "Could not write trace to " << filename << "\n";
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(threadMutex);
+	// Timestamps are in microseconds relative to the recorder's creation
+	auto toMicroseconds = [this](uint64_t time) {
+		return static_cast<double>(static_cast<int64_t>(time - origin)) / 1000.0;
+	};
+	std::vector<ThreadBuffer*> buffers;
+	for (auto& buffer : threadBuffers) {
+		buffers.push_back(buffer.get());
+	}
+	buffers.push_back(&gpuBuffer);
+
+	char number[64];
+	uint64_t eventCount = 0;
+	uint64_t droppedEvents = 0;
+	bool first = true;
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	for (ThreadBuffer* buffer : buffers) {
+		// The GPU track is sorted after all CPU threads
+		const uint32_t tid = (buffer == &gpuBuffer) ? static_cast<uint32_t>(threadBuffers.size()) : buffer->id;
+		file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+		writeJsonString(file, buffer->name.c_str());
+		file << "}}";
+		first = false;
+		for (const Event& event : buffer->events) {
+			file << ",\n{\"name\":";
+			writeJsonString(file, event.name);
+			snprintf(number, sizeof(number), "%.3f", toMicroseconds(event.start));
+			if (event.type == EventType::Zone) {
+				file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << number;
+				snprintf(number, sizeof(number), "%.3f", static_cast<double>(event.value - event.start) / 1000.0);
+				file << ",\"dur\":" << number << "}";
+			} else {
+				file << ",\"ph\":\"C\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << number;
+				snprintf(number, sizeof(number), "%g", std::bit_cast<double>(event.value));
+				file << ",\"args\":{\"value\":" << number << "}}";
+			}
+		}
+		eventCount += buffer->events.size();
+		droppedEvents += buffer->droppedEvents;
+	}
+	file << "\n]}\n";
+	file.close();
+	if (!file.good()) {
+		std::cerr << "Could not write trace to " << filename << "\n";
+		return false;
+	}
+	std::cout << "Wrote " << eventCount << " trace events to " << filename;
+	if (droppedEvents > 0) {
+		std::cout << " (" << droppedEvents << " events were dropped)";
+	}
+	std::cout << "\n";
+	return true;
+}
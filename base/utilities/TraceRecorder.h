@@ -0,0 +1,118 @@
+/*
+ * In-process trace recording with Chrome trace event export
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "tracy/Tracy.hpp"
+
+/**
+ * Records CPU zones, GPU scopes and counters in process, so timings can be captured without a Tracy connection (e.g. on CI or headless machines)
+ * Each thread appends to its own buffer without locking, a thread's buffer is only registered once under a lock
+ * While not recording, a zone costs a single relaxed atomic load
+ * Traces are written in the Chrome trace event format, which can be opened with Perfetto (ui.perfetto.dev) or chrome://tracing
+ */
+class TraceRecorder {
+public:
+	enum class EventType : uint32_t { Zone, Counter };
+	struct Event {
+		// Static string or one owned by the thread's buffer
+		const char* name;
+		uint64_t start;
+		// End of zones, bits of the value of counters
+		uint64_t value;
+		EventType type;
+	};
+private:
+	struct ThreadBuffer {
+		uint32_t id;
+		std::string name;
+		std::vector<Event> events;
+		// Copies of names that aren't static, a deque so the pointers stored in the events stay valid
+		std::deque<std::string> names;
+		uint64_t droppedEvents{ 0 };
+	};
+	std::atomic<bool> recording{ false };
+	const uint64_t origin{ now() };
+	std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+	std::mutex threadMutex;
+	// GPU scopes are added from the thread reading the timestamp queries and are shown as a track of their own
+	ThreadBuffer gpuBuffer{ .id = UINT32_MAX, .name = "GPU (graphics queue)" };
+	std::mutex gpuMutex;
+	static thread_local ThreadBuffer* currentThreadBuffer;
+	static thread_local std::string currentThreadName;
+
+	ThreadBuffer& getThreadBuffer();
+	void addEvent(ThreadBuffer& buffer, const Event& event);
+public:
+	/** @brief Records the time from its construction to its destruction as a zone of the calling thread */
+	class Zone {
+	private:
+		const char* name{ nullptr };
+		std::string dynamicName;
+		uint64_t start{ 0 };
+		bool active{ false };
+	public:
+		// The name needs to outlive the recording, e.g. a string literal
+		Zone(const char* name);
+		// The name is copied, which is slower, meant for names that are built at runtime
+		Zone(const std::string& name);
+		~Zone();
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+	};
+
+	// Events beyond this number per thread are dropped, so a long recording can't exhaust memory
+	uint32_t maxEventsPerThread{ 1u << 22 };
+
+	static uint64_t now()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	void start();
+	void stop();
+	bool isRecording() const
+	{
+		return recording.load(std::memory_order_relaxed);
+	}
+	// Name of the calling thread's track in the trace
+	void setThreadName(const std::string& name);
+	// Name needs to outlive the recording, e.g. a string literal
+	void addCounter(const char* name, double value);
+	/**
+	* Adds a GPU scope
+	*
+	* @param start Start of the scope in nanoseconds on the clock of now(), converted from GPU timestamps by the caller
+	* @param end End of the scope on the same clock
+	*/
+	void addGpuZone(const std::string& name, uint64_t start, uint64_t end);
+	/**
+	* Writes all recorded events as Chrome trace event JSON
+	* Recording needs to have been stopped and other threads must not record while the trace is written
+	*
+	* @return False if the file couldn't be written
+	*/
+	bool write(const std::string& filename);
+};
+
+extern TraceRecorder traceRecorder;
+
+#define TRACE_RECORDER_CONCAT_IMPL(a, b) a##b
+#define TRACE_RECORDER_CONCAT(a, b) TRACE_RECORDER_CONCAT_IMPL(a, b)
+// Tracy zone that's also recorded by the trace recorder, name needs to be a string literal
+#define TraceZoneScopedN(name) ZoneScopedN(name); TraceRecorder::Zone TRACE_RECORDER_CONCAT(traceRecorderZone, __LINE__)(name)
+// Same as TraceZoneScopedN, named after the enclosing function
+#define TraceZoneScoped ZoneScoped; TraceRecorder::Zone TRACE_RECORDER_CONCAT(traceRecorderZone, __LINE__)(__FUNCTION__)
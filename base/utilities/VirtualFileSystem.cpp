@@ -0,0 +1,161 @@
+/*
+ * Virtual file system over asset archives and loose files
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "VirtualFileSystem.h"
+#include "AssetArchive.h"
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace vks::vfs
+{
+	struct Mount {
+		std::unique_ptr<AssetArchive> archive;
+		// Normalized with a trailing separator, so it's a plain prefix of the file names below it
+		std::string path;
+	};
+	static std::vector<Mount> mounts;
+
+	// Files read ahead of their use, keyed by their normalized name and handed over by the next open
+	static std::unordered_map<std::string, std::shared_ptr<vks::MappedFile>> prefetchedFiles;
+	static std::mutex prefetchMutex;
+
+	// Returns the archive containing a file and the file's path in it, searched in reverse mount order
+	static const AssetArchive* findArchive(const std::string& filename, std::string& path)
+	{
+		if (mounts.empty()) {
+			return nullptr;
+		}
+		const std::string normalizedFilename = std::filesystem::path(filename).lexically_normal().generic_string();
+		for (auto it = mounts.rbegin(); it != mounts.rend(); it++) {
+			if (normalizedFilename.compare(0, it->path.size(), it->path) != 0) {
+				continue;
+			}
+			path = normalizedFilename.substr(it->path.size());
+			if (it->archive->find(path)) {
+				return it->archive.get();
+			}
+		}
+		return nullptr;
+	}
+
+	bool mount(const std::string& filename, const std::string& mountPath)
+	{
+		try {
+			Mount mount{ std::make_unique<AssetArchive>(filename), std::filesystem::path(mountPath).lexically_normal().generic_string() };
+			if (!mount.path.empty() && mount.path.back() != '/') {
+				mount.path += '/';
+			}
+			std::cout << "Mounted asset archive " << filename << " with " << mount.archive->size() << " files at " << mountPath << std::endl;
+			mounts.push_back(std::move(mount));
+			return true;
+		} catch (const std::runtime_error& error) {
+			std::cerr << error.what() << std::endl;
+			return false;
+		}
+	}
+
+	void unmountAll()
+	{
+		mounts.clear();
+	}
+
+	uint32_t getMountCount()
+	{
+		return static_cast<uint32_t>(mounts.size());
+	}
+
+	static std::shared_ptr<vks::MappedFile> openFile(const std::string& filename)
+	{
+		std::string path;
+		if (const AssetArchive* archive = findArchive(filename, path)) {
+			return archive->open(path);
+		}
+		auto file = std::make_shared<vks::MappedFile>(filename);
+		if (file->isValid()) {
+			return file;
+		}
+		// Empty files can't be mapped
+		std::error_code error;
+		return std::filesystem::is_regular_file(filename, error) ? std::make_shared<vks::MappedFile>(std::vector<uint8_t>{}) : nullptr;
+	}
+
+	std::shared_ptr<vks::MappedFile> open(const std::string& filename)
+	{
+		{
+			std::lock_guard<std::mutex> lock(prefetchMutex);
+			if (!prefetchedFiles.empty()) {
+				auto it = prefetchedFiles.find(std::filesystem::path(filename).lexically_normal().generic_string());
+				if (it != prefetchedFiles.end()) {
+					std::shared_ptr<vks::MappedFile> file = std::move(it->second);
+					prefetchedFiles.erase(it);
+					return file;
+				}
+			}
+		}
+		return openFile(filename);
+	}
+
+	void prefetch(const std::string& filename)
+	{
+		std::shared_ptr<vks::MappedFile> file = openFile(filename);
+		if (!file) {
+			return;
+		}
+		// Touching every page of the mapping makes the OS read it now instead of when the file is first accessed
+		const size_t pageSize = 4096;
+		const volatile uint8_t* data = file->data();
+		uint8_t checksum = 0;
+		for (size_t offset = 0; offset < file->size(); offset += pageSize) {
+			checksum ^= data[offset];
+		}
+		(void)checksum;
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		prefetchedFiles[std::filesystem::path(filename).lexically_normal().generic_string()] = std::move(file);
+	}
+
+	void releasePrefetched()
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		prefetchedFiles.clear();
+	}
+
+	bool exists(const std::string& filename)
+	{
+		std::string path;
+		std::error_code error;
+		return findArchive(filename, path) || std::filesystem::is_regular_file(filename, error);
+	}
+
+	bool isArchived(const std::string& filename)
+	{
+		std::string path;
+		return findArchive(filename, path) != nullptr;
+	}
+
+	bool getFileInfo(const std::string& filename, uint64_t& size, int64_t& writeTime)
+	{
+		std::string path;
+		if (const AssetArchive* archive = findArchive(filename, path)) {
+			const AssetArchive::Entry* entry = archive->find(path);
+			size = entry->size;
+			writeTime = entry->writeTime;
+			return true;
+		}
+		std::error_code error;
+		size = static_cast<uint64_t>(std::filesystem::file_size(filename, error));
+		if (error) {
+			return false;
+		}
+		writeTime = static_cast<int64_t>(std::filesystem::last_write_time(filename, error).time_since_epoch().count());
+		return !error;
+	}
+}
@@ -0,0 +1,57 @@
+/*
+ * Virtual file system over asset archives and loose files
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include "MappedFile.hpp"
+
+/**
+ * Files are looked up in the mounted asset archives first, files not part of any archive are read from disk
+ * Archives are mounted at a directory (usually the asset path), so loaders keep using the same file names for archived and loose files
+ * Mounting is only meant for startup, before any assets are loaded, all other functions can be called from any thread
+ */
+namespace vks::vfs
+{
+	/**
+	* Mounts an asset archive, later mounts take precedence over earlier ones
+	*
+	* @param filename Archive file
+	* @param mountPath Directory the paths in the archive are relative to
+	*
+	* @return False if the archive couldn't be mounted
+	*/
+	bool mount(const std::string& filename, const std::string& mountPath);
+	void unmountAll();
+	// Number of mounted archives
+	uint32_t getMountCount();
+	/**
+	* Opens a file for reading, archived files are returned as ranges of the archive's mapping (or decompressed), loose files are memory mapped
+	*
+	* @return The file's contents or nullptr if the file doesn't exist in an archive or on disk
+	*/
+	std::shared_ptr<vks::MappedFile> open(const std::string& filename);
+	/**
+	* Reads a file ahead of its use (e.g. on a worker thread while the device is being created), the next open of the file returns the prefetched contents
+	* Loose and uncompressed archived files are faulted into memory, compressed archived files are decompressed
+	*/
+	void prefetch(const std::string& filename);
+	// Drops prefetched files that haven't been opened, e.g. ones that turned out not to be needed or that are read without the virtual file system
+	void releasePrefetched();
+	bool exists(const std::string& filename);
+	// True if the file is part of a mounted archive, e.g. to skip writing caches or watching for changes
+	bool isArchived(const std::string& filename);
+	/**
+	* Size and last write time (as file clock ticks) of a file, for archived files these are the ones the file had when it was packed
+	*
+	* @return False if the file doesn't exist
+	*/
+	bool getFileInfo(const std::string& filename, uint64_t& size, int64_t& writeTime);
+}
@@ -0,0 +1,542 @@
+/*
+ * Software virtual texturing with a fixed size page cache
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "VirtualTexture.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "AssetManager.h"
+#include "VulkanContext.h"
+#include "MemoryStats.h"
+#include "TraceRecorder.h"
+
+// Texels per side and bytes of a block of the format, pages can only be cut from formats listed here
+static bool getBlockInfo(VkFormat format, uint32_t& blockSize, uint32_t& blockBytes)
+{
+	switch (format) {
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		blockSize = 1;
+		blockBytes = 4;
+		return true;
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+		blockSize = 4;
+		blockBytes = 8;
+		return true;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+	case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+	case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+		blockSize = 4;
+		blockBytes = 16;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool isPowerOfTwo(uint32_t value)
+{
+	return (value != 0) && ((value & (value - 1)) == 0);
+}
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+VirtualTexture::VirtualTexture(AssetManager* assetManager, VirtualTextureCreateInfo createInfo)
+{
+	TraceZoneScopedN("Create virtual texture");
+	this->assetManager = assetManager;
+	settings = createInfo;
+	vks::Texture::loadTextureData({ .filename = settings.filename, .format = settings.format }, source);
+
+	bool valid = getBlockInfo(source.format, blockSize, blockBytes) && (source.layerCount == 1) && (source.faceCount == 1);
+	valid = valid && isPowerOfTwo(source.width) && isPowerOfTwo(source.height) && (source.width >= settings.pageSize) && (source.height >= settings.pageSize);
+	valid = valid && isPowerOfTwo(settings.pageSize) && (settings.pageSize % blockSize == 0) && (settings.pageBorder % blockSize == 0) && (settings.pageBorder < settings.pageSize);
+	// Cache page coordinates are stored in 8 bits of the page table
+	valid = valid && (settings.cacheSize > 1) && (settings.cacheSize <= 256) && (settings.frameCount > 0);
+	if (!valid) {
+		std::cerr << "Can't use " << settings.filename << " as a virtual texture, it needs to be a power of two sized 2D texture in a supported format" << std::endl;
+		return;
+	}
+
+	// Levels smaller than a page are left out, the least detailed level is the one still covered by whole pages
+	uint32_t levels = 0;
+	while ((levels < source.mipLevels) && ((source.width >> levels) >= settings.pageSize) && ((source.height >> levels) >= settings.pageSize)) {
+		const VkDeviceSize levelSize = static_cast<VkDeviceSize>((source.width >> levels) / blockSize) * ((source.height >> levels) / blockSize) * blockBytes;
+		if (source.getImageSize(levels, 0, 0) < levelSize) {
+			break;
+		}
+		levels++;
+	}
+	if (levels == 0) {
+		std::cerr << "Virtual texture " << settings.filename << " has no images" << std::endl;
+		return;
+	}
+	pagesX = source.width / settings.pageSize;
+	pagesY = source.height / settings.pageSize;
+	// The pages of the least detailed level stay in the cache, which needs room for other pages too
+	const uint32_t pinnedPages = (pagesX >> (levels - 1)) * (pagesY >> (levels - 1));
+	if (pinnedPages >= settings.cacheSize * settings.cacheSize) {
+		std::cerr << "The page cache of virtual texture " << settings.filename << " is too small for its least detailed level" << std::endl;
+		return;
+	}
+
+	const uint32_t paddedBlocks = (settings.pageSize + 2 * settings.pageBorder) / blockSize;
+	pageBytes = static_cast<VkDeviceSize>(paddedBlocks) * paddedBlocks * blockBytes;
+	pageTable.resize(levels);
+	for (uint32_t level = 0; level < levels; level++) {
+		pageTable[level].resize((pagesX >> level) * (pagesY >> level), 0);
+		pageTableBytes += pageTable[level].size() * sizeof(uint32_t);
+	}
+	slots.resize(settings.cacheSize * settings.cacheSize, nullptr);
+
+	{
+		MemoryStats::Scope memoryScope(MemoryCategory::Staging);
+		uploadBuffer = new Buffer({
+			.name = "Virtual texture uploads",
+			.usageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.size = getUploadPartSize() * settings.frameCount,
+			.map = true
+		});
+	}
+	const uint32_t cacheTexels = settings.cacheSize * (settings.pageSize + 2 * settings.pageBorder);
+	pageTableTexture = createTexture("Virtual texture page table", VK_FORMAT_R8G8B8A8_UNORM, pagesX, pagesY, levels, VK_FILTER_NEAREST);
+	cacheTexture = createTexture("Virtual texture page cache", source.format, cacheTexels, cacheTexels, 1, VK_FILTER_LINEAR);
+	pageTableIndex = assetManager->add("Virtual texture page table", pageTableTexture);
+	cacheIndex = assetManager->add("Virtual texture page cache", cacheTexture);
+	levelCount = levels;
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	waitIdle();
+	for (auto& [key, page] : pages) {
+		delete page->job;
+	}
+	if (pageTableIndex != UINT32_MAX) {
+		assetManager->removeTexture(pageTableIndex);
+	}
+	if (cacheIndex != UINT32_MAX) {
+		assetManager->removeTexture(cacheIndex);
+	}
+	delete uploadBuffer;
+}
+
+uint64_t VirtualTexture::getPageKey(uint32_t level, uint32_t x, uint32_t y)
+{
+	return (static_cast<uint64_t>(level) << 56) | (static_cast<uint64_t>(y) << 28) | static_cast<uint64_t>(x);
+}
+
+uint32_t VirtualTexture::getLevelPagesX(uint32_t level) const
+{
+	return pagesX >> level;
+}
+
+uint32_t VirtualTexture::getLevelPagesY(uint32_t level) const
+{
+	return pagesY >> level;
+}
+
+VkDeviceSize VirtualTexture::getUploadPartSize() const
+{
+	// Page copies need offsets that are a multiple of the block size
+	return alignUp(alignUp(pageTableBytes, 16) + pageBytes * settings.uploadsPerFrame, 16);
+}
+
+VirtualTexture::Page* VirtualTexture::getPage(uint32_t level, uint32_t x, uint32_t y)
+{
+	std::unique_ptr<Page>& page = pages[getPageKey(level, x, y)];
+	if (!page) {
+		page = std::make_unique<Page>();
+		page->level = level;
+		page->x = x;
+		page->y = y;
+	}
+	return page.get();
+}
+
+void VirtualTexture::loadPage(Page* page) const
+{
+	TraceZoneScopedN("Load virtual texture page");
+	const uint32_t levelBlocksX = (source.width >> page->level) / blockSize;
+	const uint32_t levelBlocksY = (source.height >> page->level) / blockSize;
+	const uint32_t pageBlocks = settings.pageSize / blockSize;
+	const uint32_t borderBlocks = settings.pageBorder / blockSize;
+	const uint32_t paddedBlocks = pageBlocks + 2 * borderBlocks;
+	const uint8_t* image = source.getImage(page->level, 0, 0);
+	page->data.resize(pageBytes);
+	uint8_t* target = page->data.data();
+	for (uint32_t row = 0; row < paddedBlocks; row++) {
+		// Borders at the edges of the texture are taken from the opposite edge, like with repeat addressing
+		const uint32_t y = (page->y * pageBlocks + levelBlocksY + row - borderBlocks) % levelBlocksY;
+		const uint8_t* sourceRow = image + static_cast<VkDeviceSize>(y) * levelBlocksX * blockBytes;
+		for (uint32_t column = 0; column < paddedBlocks; column++) {
+			const uint32_t x = (page->x * pageBlocks + levelBlocksX + column - borderBlocks) % levelBlocksX;
+			// The page's content never wraps, so it's copied in one go
+			if (column == borderBlocks) {
+				memcpy(target, sourceRow + static_cast<VkDeviceSize>(x) * blockBytes, pageBlocks * blockBytes);
+				target += pageBlocks * blockBytes;
+				column += pageBlocks - 1;
+				continue;
+			}
+			memcpy(target, sourceRow + static_cast<VkDeviceSize>(x) * blockBytes, blockBytes);
+			target += blockBytes;
+		}
+	}
+}
+
+void VirtualTexture::startLoad(Page* page)
+{
+	page->loading = true;
+	pendingLoads++;
+	// Only reads the source images, which don't change after construction
+	auto loadFunction = [this, page] {
+		loadPage(page);
+	};
+	vks::JobSystem::runBackgroundOrInline(jobSystem, page->job, loadFunction);
+}
+
+uint32_t VirtualTexture::acquireSlot()
+{
+	// Free slots first, then the page that has gone the longest without being requested
+	uint32_t candidate = UINT32_MAX;
+	uint64_t oldestRequest = UINT64_MAX;
+	for (uint32_t i = 0; i < static_cast<uint32_t>(slots.size()); i++) {
+		const Page* page = slots[i];
+		if (!page) {
+			return i;
+		}
+		if ((page->level == levelCount - 1) || (page->lastRequestFrame + settings.evictionDelay > frameCounter)) {
+			continue;
+		}
+		if (page->lastRequestFrame < oldestRequest) {
+			oldestRequest = page->lastRequestFrame;
+			candidate = i;
+		}
+	}
+	if (candidate != UINT32_MAX) {
+		slots[candidate]->slot = UINT32_MAX;
+		slots[candidate] = nullptr;
+		residentPages--;
+		pageTableDirty = true;
+	}
+	return candidate;
+}
+
+void VirtualTexture::updatePageTable()
+{
+	std::vector<std::vector<const Page*>> residentLevels(levelCount);
+	for (const Page* page : slots) {
+		if (page) {
+			residentLevels[page->level].push_back(page);
+		}
+	}
+	// Texels without a resident page take the entry of the less detailed level, so they point at the closest resident ancestor
+	for (int32_t level = static_cast<int32_t>(levelCount) - 1; level >= 0; level--) {
+		std::vector<uint32_t>& entries = pageTable[level];
+		const uint32_t width = getLevelPagesX(level);
+		if (level == static_cast<int32_t>(levelCount) - 1) {
+			std::fill(entries.begin(), entries.end(), 0);
+		} else {
+			const std::vector<uint32_t>& parentEntries = pageTable[level + 1];
+			const uint32_t parentWidth = getLevelPagesX(level + 1);
+			for (uint32_t y = 0; y < getLevelPagesY(level); y++) {
+				for (uint32_t x = 0; x < width; x++) {
+					entries[y * width + x] = parentEntries[(y / 2) * parentWidth + x / 2];
+				}
+			}
+		}
+		for (const Page* page : residentLevels[level]) {
+			entries[page->y * width + page->x] = (page->slot % settings.cacheSize) | ((page->slot / settings.cacheSize) << 8) | (static_cast<uint32_t>(level) << 16) | (255u << 24);
+		}
+	}
+}
+
+vks::Texture2D* VirtualTexture::createTexture(const std::string& name, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, VkFilter filter)
+{
+	MemoryStats::Scope memoryScope(MemoryCategory::Textures);
+	vks::Texture2D* texture = new vks::Texture2D();
+	texture->width = width;
+	texture->height = height;
+	texture->mipLevels = mipLevels;
+	texture->layerCount = 1;
+	texture->format = format;
+	texture->usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	texture->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = format;
+	imageCreateInfo.extent = { width, height, 1 };
+	imageCreateInfo.mipLevels = mipLevels;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.usage = texture->usage;
+	VK_CHECK_RESULT(vkCreateImage(VulkanContext::device->logicalDevice, &imageCreateInfo, nullptr, &texture->image));
+	VkMemoryRequirements memReqs;
+	vkGetImageMemoryRequirements(VulkanContext::device->logicalDevice, texture->image, &memReqs);
+	texture->allocation = VulkanContext::device->memoryAllocator->allocate(memReqs, VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), false);
+	VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, texture->image, texture->allocation.memory, texture->allocation.offset));
+
+	VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = format;
+	viewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+	viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+	viewCreateInfo.image = texture->image;
+	VK_CHECK_RESULT(vkCreateImageView(VulkanContext::device->logicalDevice, &viewCreateInfo, nullptr, &texture->view));
+
+	// Pages are sampled at a single level and never beyond their borders, so neither mipmapping nor anisotropic filtering apply
+	VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
+	samplerCreateInfo.magFilter = filter;
+	samplerCreateInfo.minFilter = filter;
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
+	samplerCreateInfo.minLod = 0.0f;
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+	samplerCreateInfo.maxAnisotropy = 1.0f;
+	samplerCreateInfo.anisotropyEnable = VK_FALSE;
+	texture->sampler = VulkanContext::samplerCache->get(samplerCreateInfo);
+	texture->updateDescriptor();
+	if (VulkanContext::device->hasDebugUtils) {
+		const VkDebugUtilsObjectNameInfoEXT objectNameInfo{
+			.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
+			.objectType = VK_OBJECT_TYPE_IMAGE,
+			.objectHandle = reinterpret_cast<uint64_t>(texture->image),
+			.pObjectName = name.c_str()
+		};
+		vkSetDebugUtilsObjectNameEXT(VulkanContext::device->logicalDevice, &objectNameInfo);
+	}
+	return texture;
+}
+
+bool VirtualTexture::isValid() const
+{
+	return levelCount > 0;
+}
+
+void VirtualTexture::addFeedback(const uint32_t* feedback, uint32_t count)
+{
+	if (!isValid()) {
+		return;
+	}
+	TraceZoneScopedN("Virtual texture feedback");
+	uint32_t previousRequest = UINT32_MAX;
+	for (uint32_t i = 0; i < count; i++) {
+		const uint32_t request = feedback[i];
+		// Neighbouring tiles mostly request the same page
+		if ((request == UINT32_MAX) || (request == previousRequest)) {
+			continue;
+		}
+		previousRequest = request;
+		const uint32_t level = request >> 28;
+		const uint32_t x = request & 0x3FFF;
+		const uint32_t y = (request >> 14) & 0x3FFF;
+		if ((level >= levelCount) || (x >= getLevelPagesX(level)) || (y >= getLevelPagesY(level))) {
+			continue;
+		}
+		// Less detailed ancestors are requested too, so a close fallback is kept in the cache while the page is loading or after it has been replaced
+		for (uint32_t ancestor = level; ancestor < levelCount; ancestor++) {
+			Page* page = getPage(ancestor, x >> (ancestor - level), y >> (ancestor - level));
+			if (page->lastRequestFrame == frameCounter) {
+				// Already requested along with its ancestors
+				break;
+			}
+			page->lastRequestFrame = frameCounter;
+		}
+	}
+}
+
+void VirtualTexture::update(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	if (!isValid()) {
+		return;
+	}
+	TraceZoneScopedN("Virtual texture update");
+	assert(frameIndex < settings.frameCount);
+
+	const uint32_t coarsestLevel = levelCount - 1;
+	for (uint32_t y = 0; y < getLevelPagesY(coarsestLevel); y++) {
+		for (uint32_t x = 0; x < getLevelPagesX(coarsestLevel); x++) {
+			getPage(coarsestLevel, x, y)->lastRequestFrame = frameCounter;
+		}
+	}
+
+	std::vector<Page*> loadedPages;
+	std::vector<Page*> requestedPages;
+	for (auto it = pages.begin(); it != pages.end();) {
+		Page* page = it->second.get();
+		if (page->loading) {
+			if (page->job && jobSystem->isFinished(page->job)) {
+				delete page->job;
+				page->job = nullptr;
+			}
+			if (!page->job) {
+				loadedPages.push_back(page);
+			}
+		} else if (page->slot == UINT32_MAX) {
+			if (page->lastRequestFrame == frameCounter) {
+				requestedPages.push_back(page);
+			} else if (page->lastRequestFrame + settings.evictionDelay < frameCounter) {
+				// Pages that are neither resident nor requested only cost lookups
+				it = pages.erase(it);
+				continue;
+			}
+		}
+		it++;
+	}
+
+	// Less detailed pages first, as they cover the largest areas and are the fallback for all pages below them
+	auto coarserFirst = [](const Page* a, const Page* b) { return a->level > b->level; };
+	std::sort(loadedPages.begin(), loadedPages.end(), coarserFirst);
+	std::sort(requestedPages.begin(), requestedPages.end(), coarserFirst);
+
+	uint8_t* upload = static_cast<uint8_t*>(uploadBuffer->mapped) + getUploadPartSize() * frameIndex;
+	const VkDeviceSize uploadOffset = getUploadPartSize() * frameIndex;
+	const VkDeviceSize pagesOffset = alignUp(pageTableBytes, 16);
+	const uint32_t paddedPageSize = settings.pageSize + 2 * settings.pageBorder;
+	std::vector<VkBufferImageCopy> pageCopies;
+	for (Page* page : loadedPages) {
+		if (pageCopies.size() >= settings.uploadsPerFrame) {
+			break;
+		}
+		const uint32_t slot = acquireSlot();
+		page->loading = false;
+		pendingLoads--;
+		if (slot == UINT32_MAX) {
+			// All other pages are in use, the page is loaded again if it's still requested once some of them are no longer needed
+			page->data = {};
+			continue;
+		}
+		const VkDeviceSize offset = pagesOffset + pageCopies.size() * pageBytes;
+		memcpy(upload + offset, page->data.data(), pageBytes);
+		page->data = {};
+		VkBufferImageCopy copyRegion{};
+		copyRegion.bufferOffset = uploadOffset + offset;
+		copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.imageOffset = { static_cast<int32_t>((slot % settings.cacheSize) * paddedPageSize), static_cast<int32_t>((slot / settings.cacheSize) * paddedPageSize), 0 };
+		copyRegion.imageExtent = { paddedPageSize, paddedPageSize, 1 };
+		pageCopies.push_back(copyRegion);
+		page->slot = slot;
+		slots[slot] = page;
+		residentPages++;
+		pageTableDirty = true;
+	}
+
+	for (Page* page : requestedPages) {
+		if (pendingLoads >= settings.maxPendingLoads) {
+			break;
+		}
+		startLoad(page);
+	}
+
+	// Previous frames sampling the cache and the page table need to have finished before they're overwritten
+	const VkImageLayout previousLayout = imagesInitialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	if (!pageCopies.empty() || !imagesInitialized) {
+		const VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vks::tools::setImageLayout(commandBuffer, cacheTexture->image, previousLayout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		if (!pageCopies.empty()) {
+			vkCmdCopyBufferToImage(commandBuffer, uploadBuffer->buffer, cacheTexture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(pageCopies.size()), pageCopies.data());
+		}
+		vks::tools::setImageLayout(commandBuffer, cacheTexture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+	if (pageTableDirty) {
+		updatePageTable();
+		std::vector<VkBufferImageCopy> levelCopies(levelCount);
+		VkDeviceSize offset = 0;
+		for (uint32_t level = 0; level < levelCount; level++) {
+			const VkDeviceSize size = pageTable[level].size() * sizeof(uint32_t);
+			memcpy(upload + offset, pageTable[level].data(), size);
+			levelCopies[level].bufferOffset = uploadOffset + offset;
+			levelCopies[level].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+			levelCopies[level].imageExtent = { getLevelPagesX(level), getLevelPagesY(level), 1 };
+			offset += size;
+		}
+		const VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+		vks::tools::setImageLayout(commandBuffer, pageTableTexture->image, previousLayout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		vkCmdCopyBufferToImage(commandBuffer, uploadBuffer->buffer, pageTableTexture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levelCount, levelCopies.data());
+		vks::tools::setImageLayout(commandBuffer, pageTableTexture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		pageTableDirty = false;
+	}
+	imagesInitialized = true;
+	frameCounter++;
+}
+
+void VirtualTexture::waitIdle()
+{
+	for (auto& [key, page] : pages) {
+		if (page->job) {
+			jobSystem->wait(page->job);
+		}
+	}
+}
+
+VirtualTextureShaderData VirtualTexture::getShaderData(uint32_t sourceTexture, uint32_t feedbackSize, uint32_t feedbackWidth) const
+{
+	if (!isValid()) {
+		return {};
+	}
+	return {
+		.sourceTexture = sourceTexture,
+		.pageTableTexture = pageTableIndex,
+		.cacheTexture = cacheIndex,
+		.levelCount = levelCount,
+		.size = glm::vec2(static_cast<float>(source.width), static_cast<float>(source.height)),
+		.pageSize = static_cast<float>(settings.pageSize),
+		.pageBorder = static_cast<float>(settings.pageBorder),
+		.cacheSize = static_cast<float>(settings.cacheSize),
+		.feedbackSize = feedbackSize,
+		.feedbackWidth = feedbackWidth,
+		.frame = static_cast<uint32_t>(frameCounter)
+	};
+}
+
+uint32_t VirtualTexture::getResidentPageCount() const
+{
+	return residentPages;
+}
+
+uint32_t VirtualTexture::getCachePageCount() const
+{
+	return static_cast<uint32_t>(slots.size());
+}
+
+uint32_t VirtualTexture::getPendingLoads() const
+{
+	return pendingLoads;
+}
+
+VkDeviceSize VirtualTexture::getDeviceMemory() const
+{
+	if (!isValid()) {
+		return 0;
+	}
+	return pageTableTexture->allocation.size + cacheTexture->allocation.size;
+}
@@ -0,0 +1,170 @@
+/*
+ * Software virtual texturing with a fixed size page cache
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include "volk.h"
+#include "glm/glm.hpp"
+#include "Texture.hpp"
+#include "Buffer.hpp"
+#include "JobSystem.hpp"
+
+class AssetManager;
+
+struct VirtualTextureCreateInfo {
+	// KTX or KTX2 file with a full mip chain, power of two sized and at least one page large, files without supercompression are read through their memory mapping
+	std::string filename;
+	// Format of KTX files, for Basis Universal KTX2 files it only selects between the sRGB and the linear variant of the transcode target
+	VkFormat format{ VK_FORMAT_R8G8B8A8_SRGB };
+	// Texels per side of a page's content, needs to be a multiple of 4 for block compressed formats
+	uint32_t pageSize{ 128 };
+	// Texels copied from the neighbouring pages around each page's content, so bilinear filtering never reaches into other pages of the cache
+	uint32_t pageBorder{ 4 };
+	// Pages per side of the page cache, which is the only memory the texture's texels occupy on the device
+	uint32_t cacheSize{ 16 };
+	// Upper bound for pages loaded at the same time
+	uint32_t maxPendingLoads{ 16 };
+	// Upper bound for pages copied into the cache by a single frame
+	uint32_t uploadsPerFrame{ 8 };
+	// Frames in flight, each one copies pages from its own part of the upload buffer
+	uint32_t frameCount{ 2 };
+	// Frames a page stays in the cache after it has last been requested, before it may be replaced
+	uint32_t evictionDelay{ 30 };
+};
+
+/** @brief Parameters for sampling a virtual texture in shaders, matches VirtualTexture in virtual_texture.hlsl */
+struct VirtualTextureShaderData {
+	// Asset index of the regular texture that's sampled through the virtual texture instead, UINT32_MAX if none is
+	uint32_t sourceTexture{ UINT32_MAX };
+	uint32_t pageTableTexture{ 0 };
+	uint32_t cacheTexture{ 0 };
+	// 0 if the virtual texture isn't used
+	uint32_t levelCount{ 0 };
+	// Texels of the most detailed level
+	glm::vec2 size{ 0.0f };
+	float pageSize{ 0.0f };
+	float pageBorder{ 0.0f };
+	float cacheSize{ 0.0f };
+	// Slots of the feedback buffer and feedback tiles per row of the screen
+	uint32_t feedbackSize{ 0 };
+	uint32_t feedbackWidth{ 0 };
+	// Selects the fragments writing feedback, changes every frame
+	uint32_t frame{ 0 };
+};
+
+/**
+ * Texture too large to be resident, split into square pages of which only the ones needed for the current view are kept in a fixed size page cache
+ * Shaders sample through a page table with a texel per page of each level, pointing at the cache page covering it (the page itself or its closest resident less detailed ancestor)
+ * Fragments write the pages they would like to sample to a feedback buffer, which is read back once the frame has completed
+ * Requested pages are read from the source file on the job system, copied into the cache and the page table is updated at the start of a frame's command buffer
+ * Pages that haven't been requested for a while are replaced first, the least detailed level is never replaced so every texel always has a page covering it
+ * Until that level has been loaded, shaders fall back to the regular texture the virtual texture stands in for
+ */
+class VirtualTexture {
+private:
+	struct Page {
+		uint32_t level{ 0 };
+		uint32_t x{ 0 };
+		uint32_t y{ 0 };
+		// Cache slot, UINT32_MAX if the page isn't resident
+		uint32_t slot{ UINT32_MAX };
+		uint64_t lastRequestFrame{ 0 };
+		bool loading{ false };
+		vks::Job* job{ nullptr };
+		// Texels of the page including its border, read by the job
+		std::vector<uint8_t> data;
+	};
+	VirtualTextureCreateInfo settings;
+	vks::TextureData source;
+	// Texels per block and bytes per block of the source format, 1x1 for uncompressed formats
+	uint32_t blockSize{ 1 };
+	uint32_t blockBytes{ 4 };
+	uint32_t levelCount{ 0 };
+	// Pages per side of the most detailed level
+	uint32_t pagesX{ 0 };
+	uint32_t pagesY{ 0 };
+	// Pages of all levels, keyed by level and coordinate
+	std::unordered_map<uint64_t, std::unique_ptr<Page>> pages;
+	// Page in each cache slot, null if the slot is free
+	std::vector<Page*> slots;
+	// Page table entries of each level, see virtual_texture.hlsl
+	std::vector<std::vector<uint32_t>> pageTable;
+	bool pageTableDirty{ true };
+	// Size of a page including its border and of all page table levels in bytes
+	VkDeviceSize pageBytes{ 0 };
+	VkDeviceSize pageTableBytes{ 0 };
+	// Host visible, with a part for each frame in flight that's reused once the frame has completed
+	Buffer* uploadBuffer{ nullptr };
+	// Until the first update, the images are in an undefined layout
+	bool imagesInitialized{ false };
+	vks::Texture2D* pageTableTexture{ nullptr };
+	vks::Texture2D* cacheTexture{ nullptr };
+	uint32_t pageTableIndex{ UINT32_MAX };
+	uint32_t cacheIndex{ UINT32_MAX };
+	uint64_t frameCounter{ 0 };
+	uint32_t pendingLoads{ 0 };
+	uint32_t residentPages{ 0 };
+
+	static uint64_t getPageKey(uint32_t level, uint32_t x, uint32_t y);
+	uint32_t getLevelPagesX(uint32_t level) const;
+	uint32_t getLevelPagesY(uint32_t level) const;
+	// Bytes of the upload buffer each frame in flight copies from
+	VkDeviceSize getUploadPartSize() const;
+	Page* getPage(uint32_t level, uint32_t x, uint32_t y);
+	void loadPage(Page* page) const;
+	void startLoad(Page* page);
+	uint32_t acquireSlot();
+	void updatePageTable();
+	vks::Texture2D* createTexture(const std::string& name, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, VkFilter filter);
+public:
+	AssetManager* assetManager{ nullptr };
+	// Used to read pages in the background, if not set (or without worker threads) these are read on the main thread
+	vks::JobSystem* jobSystem{ nullptr };
+
+	/**
+	* Maps the source file and creates the page table and the page cache, which are registered with the asset manager
+	*
+	* @param assetManager Asset manager the page table and the cache are registered with, so shaders can access them through the bindless textures
+	*/
+	VirtualTexture(AssetManager* assetManager, VirtualTextureCreateInfo createInfo);
+	// The device needs to be idle, as the page table and the cache are destroyed right away
+	~VirtualTexture();
+	/** @brief Returns false if the source file couldn't be loaded or isn't suited for virtual texturing (e.g. not power of two sized) */
+	bool isValid() const;
+	/**
+	* Requests the pages fragments wrote to the feedback buffer of a frame that has completed, requested pages that aren't resident are loaded in the background
+	*
+	* @param feedback Feedback buffer contents, unused slots are UINT32_MAX
+	* @param count Number of slots
+	*/
+	void addFeedback(const uint32_t* feedback, uint32_t count);
+	/**
+	* Copies loaded pages into the cache and updates the page table, needs to be called once per frame from the main thread
+	*
+	* @param commandBuffer Graphics command buffer of the frame, recorded before anything samples the virtual texture
+	* @param frameIndex Index of the frame in flight, the previous frame with this index needs to have completed
+	*/
+	void update(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	/** @brief Waits until all background loading jobs have finished */
+	void waitIdle();
+	/**
+	* @param sourceTexture Asset index of the texture the virtual texture is sampled instead of
+	* @param feedbackSize Slots of the feedback buffer
+	* @param feedbackWidth Feedback tiles per row of the screen, each fragment shader tile of 8x8 pixels writes to its own slot
+	*/
+	VirtualTextureShaderData getShaderData(uint32_t sourceTexture, uint32_t feedbackSize, uint32_t feedbackWidth) const;
+	uint32_t getResidentPageCount() const;
+	uint32_t getCachePageCount() const;
+	uint32_t getPendingLoads() const;
+	// Device memory of the page cache and the page table
+	VkDeviceSize getDeviceMemory() const;
+};
@@ -0,0 +1,147 @@
+/*
+ * Temporally coherent frustum culling
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "glm/glm.hpp"
+#include "Frustum.hpp"
+
+namespace vks
+{
+	/**
+	 * Caches the frustum test results of a set of spheres across frames, so only spheres whose result may have changed are tested again
+	 * For each sphere the cache keeps bounds of its slack (the smallest distance of the sphere to the inside of a frustum plane, visible if > 0) against a reference frustum
+	 * A frustum that moved away from the reference changes any slack by at most (max. change of the plane normals) * (distance from the reference origin) + (max. change of the planes at the origin)
+	 * Spheres whose bounds stay on one side of zero by more than that keep their result without being tested, spheres that moved or were added are always tested
+	 * The reference is moved to the current frustum once too many spheres fall between their bounds, or if the frustum stopped moving with some still in between
+	 */
+	class VisibilityCache
+	{
+	private:
+		struct Entry {
+			glm::vec4 sphere;
+			float minSlack;
+			float maxSlack;
+		};
+		std::vector<Entry> entries;
+		glm::vec4 referencePlanes[6]{};
+		glm::vec3 referenceOrigin{};
+		glm::vec4 lastPlanes[6]{};
+		bool valid{ false };
+		bool rebase{ true };
+		uint32_t testedCount{ 0 };
+
+		static float getSlack(const glm::vec4* planes, const glm::vec4& sphere)
+		{
+			float slack = planes[0].x * sphere.x + planes[0].y * sphere.y + planes[0].z * sphere.z + planes[0].w + sphere.w;
+			for (uint32_t p = 1; p < 6; p++) {
+				slack = std::min(slack, planes[p].x * sphere.x + planes[p].y * sphere.y + planes[p].z * sphere.z + planes[p].w + sphere.w);
+			}
+			return slack;
+		}
+	public:
+		// Reserves storage for a number of spheres, so culling up to that count doesn't allocate
+		void reserve(uint32_t count)
+		{
+			entries.reserve(count);
+		}
+
+		// Drops all cached results, the next call to cull tests all spheres
+		void reset()
+		{
+			entries.clear();
+			valid = false;
+			rebase = true;
+		}
+
+		/**
+		* Frustum culls a set of spheres, testing only those whose cached result may no longer be valid
+		*
+		* @param frustum Frustum to cull against
+		* @param origin Point the movement of the frustum is measured from, the camera position keeps the bounds of the spheres closest to it the tightest
+		* @param centers Sphere centers, indexed the same way across calls (spheres that changed places are detected and tested)
+		* @param radii Sphere radii
+		* @param count Number of spheres
+		* @param visibleIndices Receives the indices of all visible spheres in ascending order, must have room for count elements
+		* @param radiusScale Factor applied to all radii
+		*
+		* @return Number of visible spheres written to visibleIndices
+		*/
+		uint32_t cull(const Frustum& frustum, const glm::vec3 origin, const glm::vec3* centers, const float* radii, uint32_t count, uint32_t* visibleIndices, float radiusScale = 1.0f)
+		{
+			const bool frustumMoved = !valid || (memcmp(lastPlanes, frustum.planes, sizeof(lastPlanes)) != 0);
+			memcpy(lastPlanes, frustum.planes, sizeof(lastPlanes));
+			if (rebase) {
+				// The bounds of the cached spheres are relative to the old reference
+				entries.clear();
+				memcpy(referencePlanes, frustum.planes, sizeof(referencePlanes));
+				referenceOrigin = origin;
+				valid = true;
+				rebase = false;
+			}
+
+			// Bound of how much the frustum moved away from the reference
+			float normalChange{ 0.0f };
+			float originChange{ 0.0f };
+			for (uint32_t p = 0; p < 6; p++) {
+				const glm::vec4& current = frustum.planes[p];
+				const glm::vec4& reference = referencePlanes[p];
+				normalChange = std::max(normalChange, glm::length(glm::vec3(current) - glm::vec3(reference)));
+				originChange = std::max(originChange, std::fabs((glm::dot(glm::vec3(current), referenceOrigin) + current.w) - (glm::dot(glm::vec3(reference), referenceOrigin) + reference.w)));
+			}
+			const float normalChangeSquared = normalChange * normalChange;
+
+			const uint32_t cachedCount = std::min(static_cast<uint32_t>(entries.size()), count);
+			entries.resize(count);
+			uint32_t visibleCount{ 0 };
+			uint32_t undecidedCount{ 0 };
+			testedCount = 0;
+			for (uint32_t i = 0; i < count; i++) {
+				Entry& entry = entries[i];
+				const glm::vec4 sphere(centers[i], radii[i] * radiusScale);
+				const glm::vec3 offset = glm::vec3(sphere) - referenceOrigin;
+				const float distanceSquared = glm::dot(offset, offset);
+				bool visible{ false };
+				bool test = (i >= cachedCount) || (entry.sphere != sphere);
+				if (!test) {
+					// Same as minSlack - change > 0 and maxSlack + change <= 0 for change = normalChange * distance + originChange, without a square root
+					const float minSlack = entry.minSlack - originChange;
+					const float maxSlack = -(entry.maxSlack + originChange);
+					if ((minSlack > 0.0f) && (minSlack * minSlack > normalChangeSquared * distanceSquared)) {
+						visible = true;
+					} else if (!((maxSlack >= 0.0f) && (maxSlack * maxSlack >= normalChangeSquared * distanceSquared))) {
+						test = true;
+						undecidedCount++;
+					}
+				}
+				if (test) {
+					const float slack = getSlack(frustum.planes, sphere);
+					const float change = normalChange * std::sqrt(distanceSquared) + originChange;
+					entry = { .sphere = sphere, .minSlack = slack - change, .maxSlack = slack + change };
+					visible = slack > 0.0f;
+					testedCount++;
+				}
+				if (visible) {
+					visibleIndices[visibleCount++] = i;
+				}
+			}
+			rebase = (undecidedCount > count / 8) || (!frustumMoved && (undecidedCount > 0));
+			return visibleCount;
+		}
+
+		// Number of spheres that were tested by the last call to cull
+		uint32_t getTestedCount() const
+		{
+			return testedCount;
+		}
+	};
+}
@@ -0,0 +1,168 @@
+/*
+ * Vulkan acceleration structure for ray queries
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <cassert>
+#include "volk.h"
+#include "DeviceResource.h"
+#include "Device.hpp"
+#include "Buffer.hpp"
+#include "VulkanContext.h"
+
+struct AccelerationStructureCreateInfo {
+	const std::string name{ "" };
+	VkAccelerationStructureTypeKHR type{ VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR };
+	VkBuildAccelerationStructureFlagsKHR flags{ VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR };
+	// All builds use these geometries, with at most the maximum number of primitives (or instances) per geometry
+	std::vector<VkAccelerationStructureGeometryKHR> geometries{};
+	std::vector<uint32_t> maxPrimitiveCounts{};
+	// Queue families that build or trace against the acceleration structure, its storage is shared concurrently if these are different families
+	std::vector<uint32_t> queueFamilyIndices{};
+};
+
+/**
+ * Acceleration structure with its own storage and scratch buffer, built on the device with commands recorded by build
+ * Structures created with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR can be updated (refit) from a previous build, which is much faster than a full build but keeps the previous build's hierarchy, so quality degrades as primitives move
+ * The scratch buffer can be released after the last build, e.g. for bottom level structures that are only built once
+ */
+class AccelerationStructure : public DeviceResource {
+private:
+	std::vector<VkAccelerationStructureGeometryKHR> geometries;
+	std::vector<uint32_t> builtPrimitiveCounts{};
+	VkBuildAccelerationStructureFlagsKHR flags{ 0 };
+	VkDeviceAddress scratchAddress{ 0 };
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+public:
+	VkAccelerationStructureKHR handle{ VK_NULL_HANDLE };
+	VkAccelerationStructureTypeKHR type{ VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR };
+	// Address referenced by instances of top level structures
+	VkDeviceAddress deviceAddress{ 0 };
+	Buffer* buffer{ nullptr };
+	Buffer* scratchBuffer{ nullptr };
+
+	AccelerationStructure(AccelerationStructureCreateInfo createInfo) : DeviceResource(createInfo.name) {
+		assert(VulkanContext::device->hasRayQuery);
+		assert(createInfo.geometries.size() == createInfo.maxPrimitiveCounts.size());
+		type = createInfo.type;
+		flags = createInfo.flags;
+		geometries = createInfo.geometries;
+
+		VkAccelerationStructureBuildGeometryInfoKHR buildInfo{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+			.type = type,
+			.flags = flags,
+			.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+			.geometryCount = static_cast<uint32_t>(geometries.size()),
+			.pGeometries = geometries.data()
+		};
+		VkAccelerationStructureBuildSizesInfoKHR buildSizes{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
+		vkGetAccelerationStructureBuildSizesKHR(VulkanContext::device->logicalDevice, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, createInfo.maxPrimitiveCounts.data(), &buildSizes);
+
+		const bool concurrent = createInfo.queueFamilyIndices.size() > 1;
+		buffer = new Buffer({
+			.name = name + " storage",
+			.usageFlags = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			.size = buildSizes.accelerationStructureSize,
+			.map = false,
+			.sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndices = concurrent ? createInfo.queueFamilyIndices : std::vector<uint32_t>{}
+		});
+		VkAccelerationStructureCreateInfoKHR accelerationStructureCI{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+			.buffer = buffer->buffer,
+			.size = buildSizes.accelerationStructureSize,
+			.type = type
+		};
+		VK_CHECK_RESULT(vkCreateAccelerationStructureKHR(VulkanContext::device->logicalDevice, &accelerationStructureCI, nullptr, &handle));
+		VkAccelerationStructureDeviceAddressInfoKHR addressInfo{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR, .accelerationStructure = handle };
+		deviceAddress = vkGetAccelerationStructureDeviceAddressKHR(VulkanContext::device->logicalDevice, &addressInfo);
+
+		// Scratch contents don't need to survive between builds, so the buffer is never shared and doesn't need ownership transfers
+		const VkDeviceSize scratchAlignment = std::max<VkDeviceSize>(VulkanContext::device->accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+		const VkDeviceSize scratchSize = (flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR) ? std::max(buildSizes.buildScratchSize, buildSizes.updateScratchSize) : buildSizes.buildScratchSize;
+		scratchBuffer = new Buffer({
+			.name = name + " scratch",
+			.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			.size = scratchSize + scratchAlignment,
+			.map = false
+		});
+		scratchAddress = alignUp(scratchBuffer->deviceAddress, scratchAlignment);
+
+		setDebugName((uint64_t)handle, VK_OBJECT_TYPE_ACCELERATION_STRUCTURE_KHR);
+	}
+
+	~AccelerationStructure() {
+		vkDestroyAccelerationStructureKHR(VulkanContext::device->logicalDevice, handle, nullptr);
+		delete buffer;
+		delete scratchBuffer;
+	}
+
+	// True if a build with these ranges can update this structure's last build instead of doing a full build
+	bool canUpdate(std::span<const VkAccelerationStructureBuildRangeInfoKHR> ranges) const
+	{
+		if (!(flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR) || (builtPrimitiveCounts.size() != ranges.size())) {
+			return false;
+		}
+		for (size_t i = 0; i < ranges.size(); i++) {
+			if (builtPrimitiveCounts[i] != ranges[i].primitiveCount) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	* Record a build of the acceleration structure, the inputs need to be visible to acceleration structure builds and the results are written at the acceleration structure build stage
+	*
+	* @param commandBuffer Command buffer to record the build to
+	* @param ranges Primitive counts and offsets per geometry
+	* @param source (Optional) Structure whose last build is updated into this one (may be this structure), source->canUpdate(ranges) needs to be true, does a full build if null
+	*/
+	void build(VkCommandBuffer commandBuffer, std::span<const VkAccelerationStructureBuildRangeInfoKHR> ranges, const AccelerationStructure* source = nullptr)
+	{
+		assert(scratchBuffer);
+		assert(ranges.size() == geometries.size());
+		assert(!source || source->canUpdate(ranges));
+		VkAccelerationStructureBuildGeometryInfoKHR buildInfo{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+			.type = type,
+			.flags = flags,
+			.mode = source ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+			.srcAccelerationStructure = source ? source->handle : VK_NULL_HANDLE,
+			.dstAccelerationStructure = handle,
+			.geometryCount = static_cast<uint32_t>(geometries.size()),
+			.pGeometries = geometries.data(),
+			.scratchData = {.deviceAddress = scratchAddress }
+		};
+		const VkAccelerationStructureBuildRangeInfoKHR* rangeInfos = ranges.data();
+		vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &buildInfo, &rangeInfos);
+		builtPrimitiveCounts.resize(ranges.size());
+		for (size_t i = 0; i < ranges.size(); i++) {
+			builtPrimitiveCounts[i] = ranges[i].primitiveCount;
+		}
+	}
+
+	// Hands the scratch buffer over to the caller (e.g. for deferred deletion), no further builds can be recorded afterwards
+	Buffer* releaseScratchBuffer()
+	{
+		Buffer* scratch = scratchBuffer;
+		scratchBuffer = nullptr;
+		return scratch;
+	}
+};
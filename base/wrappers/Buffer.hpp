@@ -15,6 +15,15 @@
 #include "Device.hpp"
 #include "VulkanContext.h"
 
+// How a buffer's memory is accessed, so it can be placed where that access is fastest
+enum class BufferMemoryUsage {
+	// Memory with exactly the requested property flags
+	Default,
+	// Written by the host (e.g. every frame) and read by the device, but never read back by the host
+	// Placed in device local memory the host can write to directly if the device exposes all of its memory that way (resizable BAR, unified memory), in memory with the requested property flags otherwise
+	HostWriteDeviceRead
+};
+
 struct BufferCreateInfo {
 	const std::string name{ "" };
 	// @todo: replace with own enums and use cases (e.g. like VMA)
@@ -23,6 +32,12 @@ struct BufferCreateInfo {
 	VkDeviceSize size;
 	bool map{ true };
 	void* data{ nullptr };
+	// Concurrent sharing lets queues of different families access the buffer without ownership transfers
+	VkSharingMode sharingMode{ VK_SHARING_MODE_EXCLUSIVE };
+	std::vector<uint32_t> queueFamilyIndices{};
+	// Allocate a separate VkDeviceMemory instead of sub-allocating from the device's memory allocator
+	bool dedicatedAllocation{ false };
+	BufferMemoryUsage memoryUsage{ BufferMemoryUsage::Default };
 };
 
 // @todo: rework to class based on resource
@@ -31,89 +46,91 @@ class Buffer : public DeviceResource
 private:
 public:
 	// @todo: move to private after rework
-	VkDeviceMemory memory{ VK_NULL_HANDLE };
+	MemoryAllocation allocation{};
 	VkBuffer buffer{ VK_NULL_HANDLE }; // @todo: rename to handle
 	VkDescriptorBufferInfo descriptor;
 	VkDeviceSize size = 0;
 	VkDeviceSize alignment = 0;
 	void* mapped = nullptr;
+	// Only set for buffers created with the shader device address usage
+	VkDeviceAddress deviceAddress{ 0 };
 
 	Buffer(BufferCreateInfo createInfo) : DeviceResource(createInfo.name) {
 		size = createInfo.size;
 
 		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(createInfo.usageFlags, createInfo.size);
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCreateInfo.sharingMode = createInfo.sharingMode;
+		bufferCreateInfo.queueFamilyIndexCount = static_cast<uint32_t>(createInfo.queueFamilyIndices.size());
+		bufferCreateInfo.pQueueFamilyIndices = createInfo.queueFamilyIndices.data();
 		VK_CHECK_RESULT(vkCreateBuffer(VulkanContext::device->logicalDevice, &bufferCreateInfo, nullptr, &buffer));
 
-		// Create the memory backing up the buffer handle
+		// Get the memory backing up the buffer handle from the allocator
 		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 		vkGetBufferMemoryRequirements(VulkanContext::device->logicalDevice, buffer, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
+		alignment = memReqs.alignment;
 		// Find a memory type index that fits the properties of the buffer
-		memAlloc.memoryTypeIndex = VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, createInfo.memoryPropertyFlags);
-		VK_CHECK_RESULT(vkAllocateMemory(VulkanContext::device->logicalDevice, &memAlloc, nullptr, &memory));
-		VK_CHECK_RESULT(vkBindBufferMemory(VulkanContext::device->logicalDevice, buffer, memory, 0));
+		VkBool32 memoryTypeFound{ false };
+		uint32_t memoryTypeIndex{ 0 };
+		if (createInfo.memoryUsage == BufferMemoryUsage::HostWriteDeviceRead) {
+			memoryTypeIndex = VulkanContext::device->getHostVisibleDeviceMemoryType(memReqs.memoryTypeBits, &memoryTypeFound);
+		}
+		if (!memoryTypeFound) {
+			memoryTypeIndex = VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, createInfo.memoryPropertyFlags);
+		}
+		allocation = VulkanContext::device->memoryAllocator->allocate(memReqs, memoryTypeIndex, true, createInfo.dedicatedAllocation);
+		VK_CHECK_RESULT(vkBindBufferMemory(VulkanContext::device->logicalDevice, buffer, allocation.memory, allocation.offset));
 
-		// If a pointer to the buffer data has been passed, map the buffer and copy over the data from host memory
+		// If a pointer to the buffer data has been passed, copy over the data from host memory
+		// Host visible memory is persistently mapped by the allocator
 		if (createInfo.data != nullptr) {
-			void* mapped;
-			VK_CHECK_RESULT(vkMapMemory(VulkanContext::device->logicalDevice, memory, 0, size, 0, &mapped));
-			memcpy(mapped, createInfo.data, createInfo.size);
+			assert(allocation.mapped);
+			memcpy(allocation.mapped, createInfo.data, createInfo.size);
 			// If host coherency hasn't been requested, do a manual flush to make writes visible
 			if ((createInfo.memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) {
-				VkMappedMemoryRange mappedRange{
-					.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
-					.memory = memory,
-					.offset = 0,
-					.size = createInfo.size
-				};
-				vkFlushMappedMemoryRanges(VulkanContext::device->logicalDevice, 1, &mappedRange);
+				flush(createInfo.size);
 			}
-			vkUnmapMemory(VulkanContext::device->logicalDevice, memory);
 		}
 		if (createInfo.map) {
-			vkMapMemory(VulkanContext::device->logicalDevice, memory, 0, createInfo.size, 0, &mapped);
+			map();
 		}
 		descriptor = {
 			.buffer = buffer,
 			.offset = 0,
 			.range = VK_WHOLE_SIZE
 		};
+		if (createInfo.usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+			VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = buffer };
+			deviceAddress = vkGetBufferDeviceAddress(VulkanContext::device->logicalDevice, &addressInfo);
+		}
 		setDebugName((uint64_t)buffer, VK_OBJECT_TYPE_BUFFER);
-		setDebugName((uint64_t)memory, VK_OBJECT_TYPE_DEVICE_MEMORY);
 	}
 
 	~Buffer() {
-		if (buffer != VK_NULL_HANDLE) {
-			vkDestroyBuffer(VulkanContext::device->logicalDevice, buffer, nullptr);
-		}
-		if (memory != VK_NULL_HANDLE) {
-			vkFreeMemory(VulkanContext::device->logicalDevice, memory, nullptr);
-		}
+		destroy();
 	}
 
 	operator VkBuffer() const {
 		return buffer;
 	}
 
-	VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
+	// The allocation stays mapped for its whole lifetime, so this only hands out the host address (of the whole allocation from the offset on)
+	VkResult map(VkDeviceSize offset = 0)
 	{
-		return vkMapMemory(VulkanContext::device->logicalDevice, memory, offset, size, 0, &mapped);
+		if (!allocation.mapped) {
+			return VK_ERROR_MEMORY_MAP_FAILED;
+		}
+		mapped = static_cast<uint8_t*>(allocation.mapped) + offset;
+		return VK_SUCCESS;
 	}
 
 	void unmap()
 	{
-		if (mapped)
-		{
-			vkUnmapMemory(VulkanContext::device->logicalDevice, memory);
-			mapped = nullptr;
-		}
+		mapped = nullptr;
 	}
 
 	VkResult bind(VkDeviceSize offset = 0)
 	{
-		return vkBindBufferMemory(VulkanContext::device->logicalDevice, buffer, memory, offset);
+		return vkBindBufferMemory(VulkanContext::device->logicalDevice, buffer, allocation.memory, allocation.offset + offset);
 	}
 
 	void copyTo(void* data, VkDeviceSize size)
@@ -124,22 +141,12 @@ public:
 
 	VkResult flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
 	{
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
-		return vkFlushMappedMemoryRanges(VulkanContext::device->logicalDevice, 1, &mappedRange);
+		return VulkanContext::device->memoryAllocator->flush(allocation, size, offset);
 	}
 
 	VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
 	{
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = memory;
-		mappedRange.offset = offset;
-		mappedRange.size = size;
-		return vkInvalidateMappedMemoryRanges(VulkanContext::device->logicalDevice, 1, &mappedRange);
+		return VulkanContext::device->memoryAllocator->invalidate(allocation, size, offset);
 	}
 
 	void destroy()
@@ -147,11 +154,10 @@ public:
 		if (buffer)
 		{
 			vkDestroyBuffer(VulkanContext::device->logicalDevice, buffer, nullptr);
+			buffer = VK_NULL_HANDLE;
 		}
-		if (memory)
-		{
-			vkFreeMemory(VulkanContext::device->logicalDevice, memory, nullptr);
-		}
+		VulkanContext::device->memoryAllocator->free(allocation);
+		mapped = nullptr;
 	}
 
 };
@@ -0,0 +1,27 @@
+/*
+ * Helpers for building the binary keys of the object caches
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <type_traits>
+
+// Appends the bytes of a value, structs need to be appended member by member if they contain padding or pointers
+template<typename T>
+inline void appendValue(std::string& key, const T& value)
+{
+	static_assert(std::is_trivially_copyable_v<T>);
+	key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Prefixed with its length, so consecutive strings can't produce the same key
+inline void appendString(std::string& key, const std::string& value)
+{
+	appendValue(key, value.size());
+	key.append(value);
+}
@@ -11,31 +11,118 @@
 #include "volk.h"
 #include "Initializers.hpp"
 #include "DescriptorSet.hpp"
+#include "DescriptorBuffer.hpp"
 #include "Pipeline.hpp"
 #include "PipelineLayout.hpp"
 #include "Device.hpp"
 #include "CommandPool.hpp"
+#include "SyncPool.hpp"
+#include "GpuProfiler.h"
+#include "RenderStats.hpp"
+#include <vector>
+#include <string>
+#include <array>
+#include <span>
+#include <initializer_list>
 
 struct CommandBufferCreateInfo {
 	Device& device;
 	CommandPool* pool;
+	VkCommandBufferLevel level{ VK_COMMAND_BUFFER_LEVEL_PRIMARY };
+	// Optional, shown by capture tools if debug utils are enabled
+	std::string name{};
 };
 
 class CommandBuffer {
 private:
 	Device& device;
 	VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	// Synchronization2 barriers added since the last flush
+	std::vector<VkMemoryBarrier2> pendingMemoryBarriers;
+	std::vector<VkBufferMemoryBarrier2> pendingBufferBarriers;
+	std::vector<VkImageMemoryBarrier2> pendingImageBarriers;
+	// State bound through the wrapper, used to skip binds that wouldn't change anything
+	// Only graphics and compute are tracked, sets with more dynamic offsets than fit into a slot are always rebound
+	struct BoundSet {
+		VkDescriptorSet handle{ VK_NULL_HANDLE };
+		uint32_t dynamicOffsetCount{ 0 };
+		std::array<uint32_t, 4> dynamicOffsets{};
+	};
+	struct BoundBindPoint {
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		VkPipelineLayout layout{ VK_NULL_HANDLE };
+		std::array<BoundSet, 8> sets{};
+	};
+	struct BoundState {
+		std::array<BoundBindPoint, 2> bindPoints{};
+		std::array<VkBuffer, 4> vertexBuffers{};
+		std::array<VkDeviceSize, 4> vertexBufferOffsets{};
+		VkBuffer indexBuffer{ VK_NULL_HANDLE };
+		VkDeviceSize indexBufferOffset{ 0 };
+		VkIndexType indexType{ VK_INDEX_TYPE_UINT32 };
+	} bound;
+	BoundBindPoint* getBoundBindPoint(VkPipelineBindPoint bindPoint) {
+		switch (bindPoint) {
+		case VK_PIPELINE_BIND_POINT_GRAPHICS:
+			return &bound.bindPoints[0];
+		case VK_PIPELINE_BIND_POINT_COMPUTE:
+			return &bound.bindPoints[1];
+		default:
+			return nullptr;
+		}
+	}
+	// Compares the sets against the bound ones and updates the bound state, returns true if all of them are already bound
+	bool updateBoundSets(BoundBindPoint& bindPoint, VkPipelineLayout layout, uint32_t firstSet, std::span<DescriptorSet* const> sets) {
+		// Sets bound with a different layout may have been disturbed, so they are no longer considered bound
+		if (bindPoint.layout != layout) {
+			bindPoint.layout = layout;
+			bindPoint.sets = {};
+		}
+		bool allBound = true;
+		for (size_t i = 0; i < sets.size(); i++) {
+			const DescriptorSet* set = sets[i];
+			const bool trackable = (firstSet + i < bindPoint.sets.size()) && (set->dynamicOffsets.size() <= BoundSet{}.dynamicOffsets.size());
+			if (!trackable) {
+				allBound = false;
+				continue;
+			}
+			BoundSet& boundSet = bindPoint.sets[firstSet + i];
+			const bool sameOffsets = (boundSet.dynamicOffsetCount == set->dynamicOffsets.size()) && std::equal(set->dynamicOffsets.begin(), set->dynamicOffsets.end(), boundSet.dynamicOffsets.begin());
+			if ((boundSet.handle == set->handle) && sameOffsets) {
+				continue;
+			}
+			allBound = false;
+			boundSet.handle = set->handle;
+			boundSet.dynamicOffsetCount = static_cast<uint32_t>(set->dynamicOffsets.size());
+			std::copy(set->dynamicOffsets.begin(), set->dynamicOffsets.end(), boundSet.dynamicOffsets.begin());
+		}
+		return allBound;
+	}
 public:
 	CommandPool *pool = nullptr;
 	VkCommandBuffer handle = VK_NULL_HANDLE;
+	// Optional, named scopes are only timed if set
+	GpuProfiler* profiler{ nullptr };
+	// Commands recorded since begin, including those of executed secondary command buffers
+	RenderStats stats;
 	CommandBuffer(Device& device) : device(device) {
 		this->device = device;
 	}
 	CommandBuffer(CommandBufferCreateInfo createInfo) : device(createInfo.device) {
 		device = createInfo.device;
 		pool = createInfo.pool;
+		level = createInfo.level;
 		VkCommandBufferAllocateInfo AI = vks::initializers::commandBufferAllocateInfo(pool->handle, level, 1);
 		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &AI, &handle));
+		if (!createInfo.name.empty() && device.hasDebugUtils) {
+			VkDebugUtilsObjectNameInfoEXT objectNameInfo = {
+				.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
+				.objectType = VK_OBJECT_TYPE_COMMAND_BUFFER,
+				.objectHandle = (uint64_t)handle,
+				.pObjectName = createInfo.name.c_str()
+			};
+			vkSetDebugUtilsObjectNameEXT(device.logicalDevice, &objectNameInfo);
+		}
 	}
 	~CommandBuffer() {
 		vkFreeCommandBuffers(device, pool->handle, 1, &handle);
@@ -44,12 +131,67 @@ public:
 		this->level = level;
 	}
 	void begin() {
+		stats = {};
+		bound = {};
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		VK_CHECK_RESULT(vkBeginCommandBuffer(handle, &beginInfo));
+	}
+	// Begins a secondary command buffer that continues a dynamic rendering scope started in a primary command buffer
+	void begin(const VkCommandBufferInheritanceRenderingInfo& inheritanceRenderingInfo) {
+		assert(level == VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+		VkCommandBufferInheritanceInfo inheritanceInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+			.pNext = &inheritanceRenderingInfo
+		};
 		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+		stats = {};
+		bound = {};
 		VK_CHECK_RESULT(vkBeginCommandBuffer(handle, &beginInfo));
 	}
 	void end() {
+		flushBarriers();
 		VK_CHECK_RESULT(vkEndCommandBuffer(handle));
 	}
+	// Handles are gathered in fixed size batches on the stack, so executing any number of command buffers doesn't allocate
+	void executeCommands(std::span<CommandBuffer* const> commandBuffers) {
+		std::array<VkCommandBuffer, 16> handles;
+		for (size_t first = 0; first < commandBuffers.size(); first += handles.size()) {
+			const size_t count = std::min(handles.size(), commandBuffers.size() - first);
+			for (size_t i = 0; i < count; i++) {
+				handles[i] = commandBuffers[first + i]->handle;
+				stats += commandBuffers[first + i]->stats;
+			}
+			vkCmdExecuteCommands(handle, static_cast<uint32_t>(count), handles.data());
+		}
+		// Bound state is undefined after executing secondary command buffers
+		bound = {};
+	}
+	// Named scopes are timed on the GPU (if a profiler is set) and can be nested
+	// With debug utils they are also labeled regions in capture tools (e.g. RenderDoc or Nsight), labels are only compiled in with VKS_DEBUG_LABELS (set for debug builds or with the DEBUG_LABELS option)
+	// Scopes must begin and end in the same command buffer
+	void beginScope(const char* name) {
+#if defined(VKS_DEBUG_LABELS)
+		if (device.hasDebugUtils) {
+			const VkDebugUtilsLabelEXT label{ .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT, .pLabelName = name };
+			vkCmdBeginDebugUtilsLabelEXT(handle, &label);
+		}
+#endif
+		if (profiler) {
+			profiler->beginScope(handle, name);
+		}
+	}
+	void endScope() {
+		if (profiler) {
+			profiler->endScope(handle);
+		}
+#if defined(VKS_DEBUG_LABELS)
+		if (device.hasDebugUtils) {
+			vkCmdEndDebugUtilsLabelEXT(handle);
+		}
+#endif
+	}
 	void setViewport(float x, float y, float width, float height, float minDepth, float maxDepth) {
 		VkViewport viewport = { x, y, width, height, minDepth, maxDepth };
 		vkCmdSetViewport(handle, 0, 1, &viewport);
@@ -58,25 +200,162 @@ public:
 		VkRect2D scissor = { offsetx, offsety, width, height };
 		vkCmdSetScissor(handle, 0, 1, &scissor);
 	}
-	void bindDescriptorSets(PipelineLayout* layout, std::vector<DescriptorSet*> sets, uint32_t firstSet = 0) {
-		std::vector<VkDescriptorSet> descSets;
-		for (auto set : sets) {
-			descSets.push_back(set->handle);
+	void setDepthWriteEnable(bool enable) {
+		vkCmdSetDepthWriteEnable(handle, enable ? VK_TRUE : VK_FALSE);
+	}
+	void setDepthCompareOp(VkCompareOp compareOp) {
+		vkCmdSetDepthCompareOp(handle, compareOp);
+	}
+	void setDepthTestEnable(bool enable) {
+		vkCmdSetDepthTestEnable(handle, enable ? VK_TRUE : VK_FALSE);
+	}
+	void setCullMode(VkCullModeFlags cullMode) {
+		vkCmdSetCullMode(handle, cullMode);
+	}
+	void setFrontFace(VkFrontFace frontFace) {
+		vkCmdSetFrontFace(handle, frontFace);
+	}
+	// Needs to be of the same class (points, lines, triangles or patches) as the topology of the bound pipeline
+	void setPrimitiveTopology(VkPrimitiveTopology topology) {
+		vkCmdSetPrimitiveTopology(handle, topology);
+	}
+	// Only available if the device supports dynamic polygon modes (Device::hasDynamicPolygonMode)
+	void setPolygonMode(VkPolygonMode polygonMode) {
+		assert(device.hasDynamicPolygonMode);
+		vkCmdSetPolygonModeEXT(handle, polygonMode);
+	}
+	// Only available if the device supports fragment shading rates (Device::hasFragmentShadingRate), the rate is used as is for all primitives of the following draws
+	void setFragmentShadingRate(VkExtent2D fragmentSize) {
+		assert(device.hasFragmentShadingRate);
+		const VkFragmentShadingRateCombinerOpKHR combinerOps[2] = { VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR, VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR };
+		vkCmdSetFragmentShadingRateKHR(handle, &fragmentSize, combinerOps);
+	}
+	void bindDescriptorSets(PipelineLayout* layout, std::initializer_list<DescriptorSet*> sets, uint32_t firstSet = 0, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) {
+		bindDescriptorSets(layout->handle, std::span(sets.begin(), sets.size()), firstSet, bindPoint);
+	}
+	void bindDescriptorSets(VkPipelineLayout layout, std::initializer_list<DescriptorSet*> sets, uint32_t firstSet = 0, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) {
+		bindDescriptorSets(layout, std::span(sets.begin(), sets.size()), firstSet, bindPoint);
+	}
+	// Set handles and dynamic offsets are gathered on the stack, the limits cover the sets a pipeline layout can have in this application
+	// Skipped if the same sets with the same dynamic offsets are already bound with the same layout
+	void bindDescriptorSets(VkPipelineLayout layout, std::span<DescriptorSet* const> sets, uint32_t firstSet = 0, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) {
+		BoundBindPoint* boundBindPoint = getBoundBindPoint(bindPoint);
+		if (boundBindPoint && updateBoundSets(*boundBindPoint, layout, firstSet, sets)) {
+			stats.skippedBinds++;
+			return;
+		}
+		std::array<VkDescriptorSet, 8> descSets;
+		std::array<uint32_t, 16> dynamicOffsets;
+		assert(sets.size() <= descSets.size());
+		uint32_t dynamicOffsetCount = 0;
+		for (size_t i = 0; i < sets.size(); i++) {
+			descSets[i] = sets[i]->handle;
+			assert(dynamicOffsetCount + sets[i]->dynamicOffsets.size() <= dynamicOffsets.size());
+			for (uint32_t offset : sets[i]->dynamicOffsets) {
+				dynamicOffsets[dynamicOffsetCount++] = offset;
+			}
+		}
+		vkCmdBindDescriptorSets(handle, bindPoint, layout, firstSet, static_cast<uint32_t>(sets.size()), descSets.data(), dynamicOffsetCount, dynamicOffsets.data());
+		stats.descriptorSetBinds += static_cast<uint32_t>(sets.size());
+	}
+	// Descriptor buffers that following setDescriptorBufferOffset calls refer to by their index in this list
+	void bindDescriptorBuffers(std::initializer_list<DescriptorBuffer*> buffers) {
+		std::array<VkDescriptorBufferBindingInfoEXT, 4> bindingInfos;
+		assert(buffers.size() <= bindingInfos.size());
+		uint32_t count = 0;
+		for (DescriptorBuffer* buffer : buffers) {
+			bindingInfos[count++] = buffer->getBindingInfo();
+		}
+		vkCmdBindDescriptorBuffersEXT(handle, count, bindingInfos.data());
+	}
+	// Binds a set written to a descriptor buffer, sets bound as descriptor sets are no longer considered bound
+	void setDescriptorBufferOffset(PipelineLayout* layout, uint32_t set, uint32_t bufferIndex, VkDeviceSize offset, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) {
+		BoundBindPoint* boundBindPoint = getBoundBindPoint(bindPoint);
+		if (boundBindPoint) {
+			boundBindPoint->layout = VK_NULL_HANDLE;
+			boundBindPoint->sets = {};
 		}
-		vkCmdBindDescriptorSets(handle, VK_PIPELINE_BIND_POINT_GRAPHICS, layout->handle, firstSet, static_cast<uint32_t>(descSets.size()), descSets.data(), 0, nullptr);
+		vkCmdSetDescriptorBufferOffsetsEXT(handle, bindPoint, layout->handle, set, 1, &bufferIndex, &offset);
+		stats.descriptorSetBinds++;
 	}
+	// Writes the descriptors of a set with a push descriptor layout directly into the command buffer, no set needs to be allocated and the dstSet of the writes is ignored
+	// The descriptors are copied on recording, so they don't need to outlive the call
+	void pushDescriptorSet(PipelineLayout* layout, uint32_t set, std::initializer_list<VkWriteDescriptorSet> descriptors, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) {
+		BoundBindPoint* boundBindPoint = getBoundBindPoint(bindPoint);
+		if (boundBindPoint) {
+			if (boundBindPoint->layout != layout->handle) {
+				boundBindPoint->layout = layout->handle;
+				boundBindPoint->sets = {};
+			} else if (set < boundBindPoint->sets.size()) {
+				boundBindPoint->sets[set] = {};
+			}
+		}
+		std::array<VkWriteDescriptorSet, 8> writes;
+		assert(descriptors.size() <= writes.size());
+		uint32_t count = 0;
+		for (const VkWriteDescriptorSet& descriptor : descriptors) {
+			writes[count] = descriptor;
+			writes[count].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[count].dstSet = VK_NULL_HANDLE;
+			count++;
+		}
+		vkCmdPushDescriptorSetKHR(handle, bindPoint, layout->handle, set, count, writes.data());
+		stats.descriptorSetBinds++;
+	}
+	// Skipped if the pipeline is already bound, compares the handle so a reloaded pipeline is bound again
 	void bindPipeline(Pipeline* pipeline) {
-		vkCmdBindPipeline(handle, pipeline->bindPoint, *pipeline);
+		const VkPipeline pipelineHandle = *pipeline;
+		BoundBindPoint* boundBindPoint = getBoundBindPoint(pipeline->bindPoint);
+		if (boundBindPoint) {
+			if (boundBindPoint->pipeline == pipelineHandle) {
+				stats.skippedBinds++;
+				return;
+			}
+			boundBindPoint->pipeline = pipelineHandle;
+		}
+		vkCmdBindPipeline(handle, pipeline->bindPoint, pipelineHandle);
+		stats.pipelineBinds++;
 	}
 	void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
 		vkCmdDraw(handle, vertexCount, instanceCount, firstVertex, firstInstance);
+		stats.drawCalls++;
+		stats.instances += instanceCount;
+		stats.triangles += static_cast<uint64_t>(vertexCount / 3) * instanceCount;
 	}
 	void drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) {
 		vkCmdDrawIndexed(handle, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+		stats.drawCalls++;
+		stats.instances += instanceCount;
+		stats.triangles += static_cast<uint64_t>(indexCount / 3) * instanceCount;
+	}
+	// Draw parameters are written by the GPU, so only the draw call itself is counted
+	void drawIndexedIndirectCount(VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride) {
+		vkCmdDrawIndexedIndirectCount(handle, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+		stats.drawCalls++;
+	}
+	void drawIndirect(VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride) {
+		vkCmdDrawIndirect(handle, buffer, offset, drawCount, stride);
+		stats.drawCalls++;
+	}
+	void drawMeshTasks(uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1) {
+		vkCmdDrawMeshTasksEXT(handle, groupCountX, groupCountY, groupCountZ);
+		stats.drawCalls++;
+	}
+	void dispatch(uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1) {
+		vkCmdDispatch(handle, groupCountX, groupCountY, groupCountZ);
+		stats.dispatches++;
+	}
+	void dispatchIndirect(VkBuffer buffer, VkDeviceSize offset) {
+		vkCmdDispatchIndirect(handle, buffer, offset);
+		stats.dispatches++;
 	}
 	void updatePushConstant(PipelineLayout *layout, uint32_t index, const void* values) {
 		VkPushConstantRange pushConstantRange = layout->getPushConstantRange(index);
-		vkCmdPushConstants(handle, layout->handle, pushConstantRange.stageFlags, pushConstantRange.offset, pushConstantRange.size, values);
+		pushConstants(layout->handle, pushConstantRange.stageFlags, pushConstantRange.offset, pushConstantRange.size, values);
+	}
+	void pushConstants(VkPipelineLayout layout, VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* values) {
+		vkCmdPushConstants(handle, layout, stageFlags, offset, size, values);
+		stats.pushConstantUpdates++;
 	}
 	void insertImageMemoryBarrier(VkImage image, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkImageLayout oldImageLayout, VkImageLayout newImageLayout, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkImageSubresourceRange subresourceRange)
 	{
@@ -94,34 +373,147 @@ public:
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		vkCmdPipelineBarrier(this->handle, srcStageMask, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 	}
+	void insertBufferMemoryBarrier(VkBuffer buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE)
+	{
+		VkBufferMemoryBarrier bufferMemoryBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferMemoryBarrier.srcAccessMask = srcAccessMask;
+		bufferMemoryBarrier.dstAccessMask = dstAccessMask;
+		bufferMemoryBarrier.buffer = buffer;
+		bufferMemoryBarrier.offset = offset;
+		bufferMemoryBarrier.size = size;
+		vkCmdPipelineBarrier(this->handle, srcStageMask, dstStageMask, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+	}
+	void insertMemoryBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
+	{
+		VkMemoryBarrier memoryBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = srcAccessMask, .dstAccessMask = dstAccessMask };
+		vkCmdPipelineBarrier(this->handle, srcStageMask, dstStageMask, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+	/*
+	* Barrier batching
+	* Barriers added with the functions below are collected and issued with a single vkCmdPipelineBarrier2 once flushBarriers is called
+	* Pending barriers are also flushed by beginRendering and end, commands recorded in between (e.g. dispatches or copies) need an explicit flush
+	* Unlike the insert* functions, stage and access masks are passed per scope (as in the synchronization2 structures)
+	*/
+	void addImageBarrier(VkImage image, VkPipelineStageFlags2 srcStageMask, VkAccessFlags2 srcAccessMask, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask, VkImageLayout oldImageLayout, VkImageLayout newImageLayout, VkImageSubresourceRange subresourceRange)
+	{
+		pendingImageBarriers.push_back({
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.srcStageMask = srcStageMask,
+			.srcAccessMask = srcAccessMask,
+			.dstStageMask = dstStageMask,
+			.dstAccessMask = dstAccessMask,
+			.oldLayout = oldImageLayout,
+			.newLayout = newImageLayout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image,
+			.subresourceRange = subresourceRange
+		});
+	}
+	void addBufferBarrier(VkBuffer buffer, VkPipelineStageFlags2 srcStageMask, VkAccessFlags2 srcAccessMask, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE)
+	{
+		pendingBufferBarriers.push_back({
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.srcStageMask = srcStageMask,
+			.srcAccessMask = srcAccessMask,
+			.dstStageMask = dstStageMask,
+			.dstAccessMask = dstAccessMask,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffer,
+			.offset = offset,
+			.size = size
+		});
+	}
+	void addMemoryBarrier(VkPipelineStageFlags2 srcStageMask, VkAccessFlags2 srcAccessMask, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask)
+	{
+		pendingMemoryBarriers.push_back({
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+			.srcStageMask = srcStageMask,
+			.srcAccessMask = srcAccessMask,
+			.dstStageMask = dstStageMask,
+			.dstAccessMask = dstAccessMask
+		});
+	}
+	void flushBarriers()
+	{
+		if (pendingMemoryBarriers.empty() && pendingBufferBarriers.empty() && pendingImageBarriers.empty()) {
+			return;
+		}
+		VkDependencyInfo dependencyInfo{
+			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+			.memoryBarrierCount = static_cast<uint32_t>(pendingMemoryBarriers.size()),
+			.pMemoryBarriers = pendingMemoryBarriers.data(),
+			.bufferMemoryBarrierCount = static_cast<uint32_t>(pendingBufferBarriers.size()),
+			.pBufferMemoryBarriers = pendingBufferBarriers.data(),
+			.imageMemoryBarrierCount = static_cast<uint32_t>(pendingImageBarriers.size()),
+			.pImageMemoryBarriers = pendingImageBarriers.data()
+		};
+		vkCmdPipelineBarrier2(this->handle, &dependencyInfo);
+		pendingMemoryBarriers.clear();
+		pendingBufferBarriers.clear();
+		pendingImageBarriers.clear();
+	}
 	void beginRendering(VkRenderingInfo& renderingInfo)
 	{
+		flushBarriers();
 		vkCmdBeginRendering(this->handle, &renderingInfo);
 	}
 	void endRendering()
 	{
 		vkCmdEndRendering(this->handle);
 	}
-	void bindVertexBuffers(uint32_t firstBinding, uint32_t bindingCount, std::vector<VkBuffer> buffers, std::vector<VkDeviceSize> offsets = { 0 })
+	// Offsets need to have one entry per buffer, skipped if all buffers are already bound at the same offsets
+	void bindVertexBuffers(uint32_t firstBinding, std::span<const VkBuffer> buffers, std::span<const VkDeviceSize> offsets)
+	{
+		assert(buffers.size() == offsets.size());
+		bool allBound = true;
+		for (size_t i = 0; i < buffers.size(); i++) {
+			const size_t binding = firstBinding + i;
+			if (binding >= bound.vertexBuffers.size()) {
+				allBound = false;
+				continue;
+			}
+			if ((bound.vertexBuffers[binding] != buffers[i]) || (bound.vertexBufferOffsets[binding] != offsets[i])) {
+				allBound = false;
+				bound.vertexBuffers[binding] = buffers[i];
+				bound.vertexBufferOffsets[binding] = offsets[i];
+			}
+		}
+		if (allBound) {
+			stats.skippedBinds++;
+			return;
+		}
+		vkCmdBindVertexBuffers(this->handle, firstBinding, static_cast<uint32_t>(buffers.size()), buffers.data(), offsets.data());
+		stats.bufferBinds++;
+	}
+	void bindVertexBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset = 0)
 	{
-		vkCmdBindVertexBuffers(this->handle, firstBinding, bindingCount, buffers.data(), offsets.data());
+		bindVertexBuffers(binding, std::span(&buffer, 1), std::span(&offset, 1));
 	}
 	void bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkIndexType indexType = VK_INDEX_TYPE_UINT32)
 	{
+		if ((bound.indexBuffer == buffer) && (bound.indexBufferOffset == offset) && (bound.indexType == indexType)) {
+			stats.skippedBinds++;
+			return;
+		}
+		bound.indexBuffer = buffer;
+		bound.indexBufferOffset = offset;
+		bound.indexType = indexType;
 		vkCmdBindIndexBuffer(this->handle, buffer, offset, indexType);
 	}
-	void oneTimeSubmit(VkQueue queue)
+	// Submits without waiting, the command buffer must not be recorded again or destroyed before the token reports completion
+	SubmitToken submitAsync(VkQueue queue)
 	{
 		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &handle;
-
-		VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
-		VkFence fence;
-		VK_CHECK_RESULT(vkCreateFence(device.logicalDevice, &fenceInfo, nullptr, &fence));
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
-		VK_CHECK_RESULT(vkWaitForFences(device.logicalDevice, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
-		vkDestroyFence(device.logicalDevice, fence, nullptr);
+		return VulkanContext::syncPool->submit(queue, submitInfo);
+	}
+	void oneTimeSubmit(VkQueue queue)
+	{
+		SubmitToken token = submitAsync(queue);
+		VulkanContext::syncPool->wait(token);
 		vkResetCommandBuffer(handle, 0);
 	}
 };
\ No newline at end of file
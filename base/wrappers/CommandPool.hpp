@@ -34,4 +34,8 @@ public:
 	~CommandPool() {
 		vkDestroyCommandPool(VulkanContext::device->logicalDevice, handle, nullptr);
 	}
+	// Returns all command buffers allocated from the pool to the initial state at once, none of them may be in use by the device
+	void reset() {
+		VK_CHECK_RESULT(vkResetCommandPool(VulkanContext::device->logicalDevice, handle, 0));
+	}
 };
\ No newline at end of file
@@ -0,0 +1,148 @@
+/*
+ * Vulkan descriptor buffer abstraction class (VK_EXT_descriptor_buffer)
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include "volk.h"
+#include "VulkanTools.h"
+#include "DeviceResource.h"
+#include "Device.hpp"
+#include "Buffer.hpp"
+#include "DescriptorSetLayout.hpp"
+#include "VulkanContext.h"
+
+struct DescriptorBufferCreateInfo {
+	const std::string name{ "" };
+	VkDeviceSize size{ 0 };
+	// Buffers that contain samplers (including combined image samplers) need the sampler usage, which may come with tighter size limits
+	bool samplers{ false };
+};
+
+/**
+ * Host visible buffer that descriptors are written to directly, as an alternative to allocating descriptor sets from a pool
+ * Sets are ranges of the buffer in the size of their layout (which needs to be created with descriptorBuffer set), sub-allocated linearly and all freed at once with reset
+ * Sets are bound by binding the buffer once and setting their offsets, so there are no pools to size and nothing fragments
+ */
+class DescriptorBuffer : public DeviceResource {
+private:
+	Buffer* buffer{ nullptr };
+	VkBufferUsageFlags usage{ 0 };
+	VkDeviceSize used{ 0 };
+
+	size_t getDescriptorSize(VkDescriptorType type) const {
+		const VkPhysicalDeviceDescriptorBufferPropertiesEXT& properties = VulkanContext::device->descriptorBufferProperties;
+		switch (type) {
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+			return properties.samplerDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+			return properties.combinedImageSamplerDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+			return properties.sampledImageDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+			return properties.storageImageDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+			return properties.uniformBufferDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+			return properties.storageBufferDescriptorSize;
+		default:
+			// Dynamic buffers don't exist with descriptor buffers, other types aren't used by the samples
+			assert(false);
+			return 0;
+		}
+	}
+
+	void writeDescriptor(VkDeviceSize setOffset, const DescriptorSetLayout* layout, uint32_t binding, uint32_t arrayElement, const VkDescriptorGetInfoEXT& getInfo) {
+		const size_t descriptorSize = getDescriptorSize(getInfo.type);
+		const VkDeviceSize offset = setOffset + layout->getBindingOffset(binding) + arrayElement * descriptorSize;
+		assert(offset + descriptorSize <= buffer->size);
+		vkGetDescriptorEXT(VulkanContext::device->logicalDevice, &getInfo, descriptorSize, static_cast<uint8_t*>(buffer->mapped) + offset);
+	}
+
+public:
+	DescriptorBuffer(DescriptorBufferCreateInfo createInfo) : DeviceResource(createInfo.name) {
+		assert(VulkanContext::device->hasDescriptorBuffer);
+		usage = createInfo.samplers ? (VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT) : VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT;
+		buffer = new Buffer({
+			.name = createInfo.name,
+			.usageFlags = usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.size = createInfo.size
+		});
+		assert(buffer->deviceAddress % VulkanContext::device->descriptorBufferProperties.descriptorBufferOffsetAlignment == 0);
+	}
+
+	~DescriptorBuffer() {
+		delete buffer;
+	}
+
+	/**
+	* Reserves the space for one set of a layout
+	*
+	* @param layout Layout of the set, needs to be created for descriptor buffers
+	*
+	* @return Offset of the set in the buffer, passed to CommandBuffer::setDescriptorBufferOffset to bind the set
+	* @throws std::runtime_error if the buffer doesn't have enough space left
+	*/
+	VkDeviceSize allocateSet(const DescriptorSetLayout* layout) {
+		const VkDeviceSize alignment = VulkanContext::device->descriptorBufferProperties.descriptorBufferOffsetAlignment;
+		const VkDeviceSize offset = (used + alignment - 1) / alignment * alignment;
+		const VkDeviceSize size = layout->getSize();
+		if (offset + size > buffer->size) {
+			throw std::runtime_error("Descriptor buffer \"" + name + "\" is full");
+		}
+		used = offset + size;
+		return offset;
+	}
+
+	// Frees all sets at once, the GPU must no longer use any of them
+	void reset() {
+		used = 0;
+	}
+
+	void writeImage(VkDeviceSize setOffset, const DescriptorSetLayout* layout, uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo* imageInfo, uint32_t arrayElement = 0) {
+		VkDescriptorGetInfoEXT getInfo{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT, .type = type };
+		switch (type) {
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+			getInfo.data.pSampler = &imageInfo->sampler;
+			break;
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+			getInfo.data.pCombinedImageSampler = imageInfo;
+			break;
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+			getInfo.data.pSampledImage = imageInfo;
+			break;
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+			getInfo.data.pStorageImage = imageInfo;
+			break;
+		default:
+			assert(false);
+		}
+		writeDescriptor(setOffset, layout, binding, arrayElement, getInfo);
+	}
+
+	void writeBuffer(VkDeviceSize setOffset, const DescriptorSetLayout* layout, uint32_t binding, VkDescriptorType type, VkDeviceAddress address, VkDeviceSize range, uint32_t arrayElement = 0) {
+		const VkDescriptorAddressInfoEXT addressInfo{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT, .address = address, .range = range };
+		VkDescriptorGetInfoEXT getInfo{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT, .type = type };
+		switch (type) {
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+			getInfo.data.pUniformBuffer = &addressInfo;
+			break;
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+			getInfo.data.pStorageBuffer = &addressInfo;
+			break;
+		default:
+			assert(false);
+		}
+		writeDescriptor(setOffset, layout, binding, arrayElement, getInfo);
+	}
+
+	VkDescriptorBufferBindingInfoEXT getBindingInfo() const {
+		return { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT, .address = buffer->deviceAddress, .usage = usage };
+	}
+};
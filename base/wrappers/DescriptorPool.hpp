@@ -19,6 +19,8 @@ struct DescriptorPoolCreateInfo {
 	const std::string name{ "" };
 	uint32_t maxSets;
 	std::vector<VkDescriptorPoolSize> poolSizes;
+	// Sets with layouts that are updated after bind need to be allocated from a pool with the update after bind flag
+	VkDescriptorPoolCreateFlags flags = 0;
 };
 
 class DescriptorPool : public DeviceResource {
@@ -33,6 +35,7 @@ public:
 		CI.poolSizeCount = static_cast<uint32_t>(createInfo.poolSizes.size());
 		CI.pPoolSizes = createInfo.poolSizes.data();
 		CI.maxSets = createInfo.maxSets;
+		CI.flags = createInfo.flags;
 		VK_CHECK_RESULT(vkCreateDescriptorPool(VulkanContext::device->logicalDevice, &CI, nullptr, &handle));
 	}
 
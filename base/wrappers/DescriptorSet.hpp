@@ -15,10 +15,13 @@
 #include "Device.hpp"
 #include "DescriptorSetLayout.hpp"
 #include "DescriptorPool.hpp"
+#include "DescriptorWriteBatch.hpp"
 #include "VulkanContext.h"
 
 struct DescriptorSetCreateInfo {
 	DescriptorPool* pool = nullptr;
+	// If set, the initial descriptors are added to this batch instead of being written right away, the set must not be used before the batch has been flushed
+	DescriptorWriteBatch* batch = nullptr;
 	uint32_t variableDescriptorCount = 0;
 	std::vector<VkDescriptorSetLayout> layouts;
 	std::vector<VkWriteDescriptorSet> descriptors;
@@ -29,6 +32,8 @@ private:
 	std::vector<VkWriteDescriptorSet> descriptors;
 public:
 	VkDescriptorSet handle;
+	// Offsets of the set's dynamic buffer bindings in binding order, passed along whenever the set is bound
+	std::vector<uint32_t> dynamicOffsets;
 
 	DescriptorSet(DescriptorSetCreateInfo createInfo) {
 		descriptors = createInfo.descriptors;
@@ -46,7 +51,13 @@ public:
 			descriptor.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 			descriptor.dstSet = handle;
 		}
-		vkUpdateDescriptorSets(VulkanContext::device->logicalDevice, static_cast<uint32_t>(createInfo.descriptors.size()), createInfo.descriptors.data(), 0, nullptr);
+		if (createInfo.batch) {
+			for (auto& descriptor : createInfo.descriptors) {
+				createInfo.batch->add(descriptor);
+			}
+		} else {
+			vkUpdateDescriptorSets(VulkanContext::device->logicalDevice, static_cast<uint32_t>(createInfo.descriptors.size()), createInfo.descriptors.data(), 0, nullptr);
+		}
 	}
 
 	~DescriptorSet() {
@@ -93,4 +104,25 @@ public:
 			}
 		}
 	}
+
+	/**
+	* Writes a range of an arrayed binding, leaving all other elements untouched
+	*
+	* @param binding Binding to write to
+	* @param arrayElement First array element to write
+	* @param type Type of the descriptors
+	* @param imageInfo Pointer to descriptorCount image descriptors
+	* @param descriptorCount Number of consecutive array elements to write
+	*/
+	void updateDescriptor(uint32_t binding, uint32_t arrayElement, VkDescriptorType type, const VkDescriptorImageInfo* imageInfo, uint32_t descriptorCount = 1) {
+		VkWriteDescriptorSet writeDescriptorSet{};
+		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSet.dstSet = handle;
+		writeDescriptorSet.dstBinding = binding;
+		writeDescriptorSet.dstArrayElement = arrayElement;
+		writeDescriptorSet.descriptorType = type;
+		writeDescriptorSet.pImageInfo = imageInfo;
+		writeDescriptorSet.descriptorCount = descriptorCount;
+		vkUpdateDescriptorSets(VulkanContext::device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+	}
 };
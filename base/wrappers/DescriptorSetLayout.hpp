@@ -9,29 +9,109 @@
 #pragma once
 
 #include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
 #include "volk.h"
 #include "Initializers.hpp"
 #include "VulkanTools.h"
 #include "VulkanContext.h"
+#include "ShaderReflection.hpp"
 
 struct DescriptorSetLayoutCreateInfo {
 	bool descriptorIndexing = false;
+	// Additional binding flags for descriptor indexing, e.g. partially bound
+	VkDescriptorBindingFlags descriptorBindingFlags = 0;
+	// Layout flags, e.g. update after bind pool for bindings that are updated after bind
+	VkDescriptorSetLayoutCreateFlags flags = 0;
+	// Descriptors of the layout are written to a descriptor buffer instead of allocated descriptor sets, requires Device::hasDescriptorBuffer
+	bool descriptorBuffer = false;
+	// Descriptors of the layout are pushed into command buffers with CommandBuffer::pushDescriptorSet instead of allocated descriptor sets, requires Device::hasPushDescriptor
+	bool pushDescriptor = false;
 	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	// If no bindings are declared, they're derived from the resources these shaders declare in the given set, otherwise the declared bindings are checked against them
+	std::vector<ShaderReference> shaders;
+	uint32_t set{ 0 };
+	// Uniform and storage buffers of derived bindings that are bound with dynamic offsets, which can't be expressed in the shaders
+	std::vector<uint32_t> dynamicBindings;
 };
 
 class DescriptorSetLayout {
+private:
+	static bool isCompatible(VkDescriptorType declared, VkDescriptorType reflected) {
+		return (declared == reflected)
+			|| ((declared == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC) && (reflected == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER))
+			|| ((declared == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC) && (reflected == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER));
+	}
+
+	static void resolveBindings(DescriptorSetLayoutCreateInfo& createInfo) {
+		if (createInfo.shaders.empty()) {
+			return;
+		}
+		const std::vector<ReflectedBinding> reflectedBindings = getReflectedBindings(createInfo.shaders, createInfo.set);
+		const std::string setName = "Descriptor set " + std::to_string(createInfo.set) + " binding ";
+		if (createInfo.bindings.empty()) {
+			for (const ReflectedBinding& reflected : reflectedBindings) {
+				if (reflected.descriptorCount == 0) {
+					throw std::runtime_error(setName + std::to_string(reflected.binding) + " is a runtime sized array, which needs to be declared with a descriptor count");
+				}
+				VkDescriptorType descriptorType = reflected.descriptorType;
+				if (std::find(createInfo.dynamicBindings.begin(), createInfo.dynamicBindings.end(), reflected.binding) != createInfo.dynamicBindings.end()) {
+					assert((descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) || (descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER));
+					descriptorType = (descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+				}
+				createInfo.bindings.push_back({ .binding = reflected.binding, .descriptorType = descriptorType, .descriptorCount = reflected.descriptorCount, .stageFlags = reflected.stageFlags });
+			}
+			return;
+		}
+		// Declared bindings may have more stages and descriptors than the shaders use, but need to cover everything they access
+		for (const ReflectedBinding& reflected : reflectedBindings) {
+			auto declared = std::find_if(createInfo.bindings.begin(), createInfo.bindings.end(), [&reflected](const VkDescriptorSetLayoutBinding& binding) { return binding.binding == reflected.binding; });
+			if (declared == createInfo.bindings.end()) {
+				throw std::runtime_error(setName + std::to_string(reflected.binding) + " is used by the shaders but not declared");
+			}
+			if (!isCompatible(declared->descriptorType, reflected.descriptorType)) {
+				throw std::runtime_error(setName + std::to_string(reflected.binding) + " is declared with another descriptor type than used by the shaders");
+			}
+			if ((declared->stageFlags & reflected.stageFlags) != reflected.stageFlags) {
+				throw std::runtime_error(setName + std::to_string(reflected.binding) + " is not declared for all shader stages using it");
+			}
+			if (declared->descriptorCount < reflected.descriptorCount) {
+				throw std::runtime_error(setName + std::to_string(reflected.binding) + " is declared with less descriptors than used by the shaders");
+			}
+		}
+	}
 public:
 	VkDescriptorSetLayout handle = VK_NULL_HANDLE;
 
 	DescriptorSetLayout(DescriptorSetLayoutCreateInfo createInfo) {
+		resolveBindings(createInfo);
 		VkDescriptorSetLayoutCreateInfo CI = vks::initializers::descriptorSetLayoutCreateInfo(createInfo.bindings.data(), static_cast<uint32_t>(createInfo.bindings.size()));
+		CI.flags = createInfo.flags;
+		if (createInfo.descriptorBuffer) {
+			assert(VulkanContext::device->hasDescriptorBuffer);
+			CI.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+		}
+		if (createInfo.pushDescriptor) {
+			assert(VulkanContext::device->hasPushDescriptor);
+			assert(!createInfo.descriptorIndexing);
+			uint32_t descriptorCount{ 0 };
+			for (const VkDescriptorSetLayoutBinding& binding : createInfo.bindings) {
+				assert((binding.descriptorType != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC) && (binding.descriptorType != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC));
+				descriptorCount += binding.descriptorCount;
+			}
+			if (descriptorCount > VulkanContext::device->pushDescriptorProperties.maxPushDescriptors) {
+				throw std::runtime_error("Push descriptor set layout has more descriptors than supported by the device");
+			}
+			CI.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+		}
 		VkDescriptorSetLayoutBindingFlagsCreateInfo setLayoutBindingFlags{};
 			setLayoutBindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
 		if (createInfo.descriptorIndexing) {
 			// @todo: Right now only support descriptor index for layout with single binding
 			assert(createInfo.bindings.size() == 1);
 			setLayoutBindingFlags.bindingCount = 1;
-			VkDescriptorBindingFlags descriptorBindingFlags = VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT;
+			VkDescriptorBindingFlags descriptorBindingFlags = VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT | createInfo.descriptorBindingFlags;
 			setLayoutBindingFlags.pBindingFlags = &descriptorBindingFlags;
 			CI.pNext = &setLayoutBindingFlags;
 		}
@@ -41,4 +121,18 @@ public:
 	~DescriptorSetLayout() {
 		vkDestroyDescriptorSetLayout(VulkanContext::device->logicalDevice, handle, nullptr);
 	}
+
+	// Only for layouts created for descriptor buffers: Size of one set of the layout in a descriptor buffer
+	VkDeviceSize getSize() const {
+		VkDeviceSize size{ 0 };
+		vkGetDescriptorSetLayoutSizeEXT(VulkanContext::device->logicalDevice, handle, &size);
+		return size;
+	}
+
+	// Only for layouts created for descriptor buffers: Offset of a binding from the start of a set
+	VkDeviceSize getBindingOffset(uint32_t binding) const {
+		VkDeviceSize offset{ 0 };
+		vkGetDescriptorSetLayoutBindingOffsetEXT(VulkanContext::device->logicalDevice, handle, binding, &offset);
+		return offset;
+	}
 };
\ No newline at end of file
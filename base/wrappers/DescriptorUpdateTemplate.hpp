@@ -0,0 +1,52 @@
+/*
+ * Vulkan descriptor update template abstraction class
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include "volk.h"
+#include "DeviceResource.h"
+#include "VulkanTools.h"
+#include "VulkanContext.h"
+
+struct DescriptorUpdateTemplateCreateInfo {
+	const std::string name{ "" };
+	VkDescriptorSetLayout layout{ VK_NULL_HANDLE };
+	// Offsets and strides are relative to the data passed to update
+	std::vector<VkDescriptorUpdateTemplateEntry> entries;
+};
+
+/**
+ * Writes all descriptors of a set with a fixed shape from one plain struct, so the driver doesn't have to walk a list of VkWriteDescriptorSet structures
+ * Only useful for sets that are written as a whole with the same bindings every time
+ */
+class DescriptorUpdateTemplate : public DeviceResource {
+public:
+	VkDescriptorUpdateTemplate handle{ VK_NULL_HANDLE };
+
+	DescriptorUpdateTemplate(DescriptorUpdateTemplateCreateInfo createInfo) : DeviceResource(createInfo.name) {
+		VkDescriptorUpdateTemplateCreateInfo CI{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,
+			.descriptorUpdateEntryCount = static_cast<uint32_t>(createInfo.entries.size()),
+			.pDescriptorUpdateEntries = createInfo.entries.data(),
+			.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
+			.descriptorSetLayout = createInfo.layout,
+		};
+		VK_CHECK_RESULT(vkCreateDescriptorUpdateTemplate(VulkanContext::device->logicalDevice, &CI, nullptr, &handle));
+		setDebugName((uint64_t)handle, VK_OBJECT_TYPE_DESCRIPTOR_UPDATE_TEMPLATE);
+	}
+
+	~DescriptorUpdateTemplate() {
+		vkDestroyDescriptorUpdateTemplate(VulkanContext::device->logicalDevice, handle, nullptr);
+	}
+
+	// Writes the set's descriptors, laid out in data as described by the template's entries
+	void update(VkDescriptorSet set, const void* data) {
+		vkUpdateDescriptorSetWithTemplate(VulkanContext::device->logicalDevice, set, handle, data);
+	}
+};
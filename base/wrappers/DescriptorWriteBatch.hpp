@@ -0,0 +1,91 @@
+/*
+ * Batched descriptor set writes
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include "volk.h"
+#include "VulkanContext.h"
+
+/**
+ * Collects descriptor writes to any number of sets and writes all of them with a single vkUpdateDescriptorSets call on flush
+ * Image and buffer infos are copied, so the caller's infos don't need to outlive the call that added them
+ * Storage is kept across flushes, so a batch that's flushed once per frame doesn't allocate once it has grown to the frame's number of writes
+ * Sets must not be bound by command buffers that are being recorded or are in flight until the batch has been flushed, unless their bindings are update after bind
+ */
+class DescriptorWriteBatch {
+private:
+	std::vector<VkWriteDescriptorSet> writes;
+	// Index of each write's first info, the pointers are only set on flush as the info arrays may still grow
+	std::vector<size_t> infoIndices;
+	std::vector<VkDescriptorImageInfo> imageInfos;
+	std::vector<VkDescriptorBufferInfo> bufferInfos;
+
+	static bool isImageType(VkDescriptorType type)
+	{
+		switch (type) {
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+			return true;
+		default:
+			return false;
+		}
+	}
+public:
+	void addImages(VkDescriptorSet set, uint32_t binding, uint32_t arrayElement, VkDescriptorType type, const VkDescriptorImageInfo* infos, uint32_t count = 1)
+	{
+		writes.push_back({ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = set, .dstBinding = binding, .dstArrayElement = arrayElement, .descriptorCount = count, .descriptorType = type });
+		infoIndices.push_back(imageInfos.size());
+		imageInfos.insert(imageInfos.end(), infos, infos + count);
+	}
+
+	void addBuffers(VkDescriptorSet set, uint32_t binding, uint32_t arrayElement, VkDescriptorType type, const VkDescriptorBufferInfo* infos, uint32_t count = 1)
+	{
+		writes.push_back({ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = set, .dstBinding = binding, .dstArrayElement = arrayElement, .descriptorCount = count, .descriptorType = type });
+		infoIndices.push_back(bufferInfos.size());
+		bufferInfos.insert(bufferInfos.end(), infos, infos + count);
+	}
+
+	// Adds a write as passed to vkUpdateDescriptorSets, texel buffer views and extension structures aren't supported
+	void add(const VkWriteDescriptorSet& write)
+	{
+		if (isImageType(write.descriptorType)) {
+			addImages(write.dstSet, write.dstBinding, write.dstArrayElement, write.descriptorType, write.pImageInfo, write.descriptorCount);
+		} else {
+			addBuffers(write.dstSet, write.dstBinding, write.dstArrayElement, write.descriptorType, write.pBufferInfo, write.descriptorCount);
+		}
+	}
+
+	bool empty() const
+	{
+		return writes.empty();
+	}
+
+	/** @brief Writes all descriptors added since the last flush */
+	void flush()
+	{
+		if (writes.empty()) {
+			return;
+		}
+		for (size_t i = 0; i < writes.size(); i++) {
+			if (isImageType(writes[i].descriptorType)) {
+				writes[i].pImageInfo = &imageInfos[infoIndices[i]];
+			} else {
+				writes[i].pBufferInfo = &bufferInfos[infoIndices[i]];
+			}
+		}
+		vkUpdateDescriptorSets(VulkanContext::device->logicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		writes.clear();
+		infoIndices.clear();
+		imageInfos.clear();
+		bufferInfos.clear();
+	}
+};
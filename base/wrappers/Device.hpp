@@ -11,12 +11,27 @@
 #include <exception>
 #include <assert.h>
 #include <algorithm>
+#include <array>
 #include "volk.h"
 #include "VulkanTools.h"
+#include "MemoryAllocator.hpp"
 //#include "Buffer.hpp"
 
 enum class QueueType { Graphics, Compute, Transfer };
 
+/** @brief Size, budget and current usage of a memory heap in bytes, budget and usage are estimates by the allocator if VK_EXT_memory_budget isn't supported */
+struct MemoryHeapBudget {
+	VkDeviceSize size{ 0 };
+	VkDeviceSize budget{ 0 };
+	VkDeviceSize usage{ 0 };
+	bool deviceLocal{ false };
+};
+
+struct MemoryBudget {
+	uint32_t heapCount{ 0 };
+	std::array<MemoryHeapBudget, VK_MAX_MEMORY_HEAPS> heaps{};
+};
+
 struct DeviceCreateInfo {
 	VkPhysicalDevice physicalDevice;
 	std::vector<const char*> enabledExtensions;
@@ -24,6 +39,10 @@ struct DeviceCreateInfo {
 	VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
 	void* pNextChain;
 	bool useSwapChain = true;
+	// VK_EXT_debug_utils is an instance extension, set if the instance has been created with it
+	bool debugUtils = false;
+	// Physical devices of a device group to create the logical device for (including physicalDevice), ignored with less than two devices
+	std::vector<VkPhysicalDevice> deviceGroup;
 };
 
 struct Device
@@ -34,6 +53,10 @@ struct Device
 	VkDevice logicalDevice{ VK_NULL_HANDLE };
 	/** @brief Properties of the physical device including limits that the application can check against */
 	VkPhysicalDeviceProperties properties{};
+	/** @brief Vulkan 1.1 properties, e.g. the subgroup size and the subgroup operations supported by each stage */
+	VkPhysicalDeviceVulkan11Properties properties11{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES };
+	/** @brief Vulkan 1.2 properties, e.g. the descriptor limits for update after bind */
+	VkPhysicalDeviceVulkan12Properties properties12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES };
 	/** @brief Features of the physical device that an application can use to check if a feature is supported */
 	VkPhysicalDeviceFeatures features{};
 	/** @brief Features that have been enabled for use on the physical device */
@@ -41,6 +64,32 @@ struct Device
 	inline static VkPhysicalDeviceVulkan11Features enabledFeatures11{};
 	inline static VkPhysicalDeviceVulkan12Features enabledFeatures12{};
 	inline static VkPhysicalDeviceVulkan13Features enabledFeatures13{};
+	/** @brief Requested by setting meshShader (and taskShader), only enabled if supported by the device as mesh shaders are optional */
+	inline static VkPhysicalDeviceMeshShaderFeaturesEXT enabledMeshShaderFeatures{};
+	/** @brief Requested by setting presentWait, only enabled if the device supports both present ids and present wait */
+	inline static VkPhysicalDevicePresentIdFeaturesKHR enabledPresentIdFeatures{};
+	inline static VkPhysicalDevicePresentWaitFeaturesKHR enabledPresentWaitFeatures{};
+	/** @brief Requested by setting swapchainMaintenance1, only enabled if supported, the instance needs to have VK_EXT_surface_maintenance1 enabled */
+	inline static VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT enabledSwapchainMaintenance1Features{};
+	/** @brief Requested by setting graphicsPipelineLibrary, only enabled if supported with fast linking, as linking pipelines from libraries is only worth it if that's fast */
+	inline static VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT enabledGraphicsPipelineLibraryFeatures{};
+	/** @brief Requested by setting extendedDynamicState3PolygonMode, only enabled if supported, the extended dynamic states of Vulkan 1.3 are always available */
+	inline static VkPhysicalDeviceExtendedDynamicState3FeaturesEXT enabledExtendedDynamicState3Features{};
+	/** @brief Requested by setting descriptorBuffer, only enabled if supported together with buffer device addresses */
+	inline static VkPhysicalDeviceDescriptorBufferFeaturesEXT enabledDescriptorBufferFeatures{};
+	/** @brief Requested by setting pipelineFragmentShadingRate, only enabled if supported, the rate is then set per draw as dynamic state */
+	inline static VkPhysicalDeviceFragmentShadingRateFeaturesKHR enabledFragmentShadingRateFeatures{};
+	/** @brief Requested by setting indexTypeUint8, only enabled if supported, 16 bit indices are the smallest available otherwise */
+	inline static VkPhysicalDeviceIndexTypeUint8FeaturesEXT enabledIndexTypeUint8Features{};
+	/** @brief Requested by setting rayQuery, only enabled if supported together with acceleration structures and buffer device addresses */
+	inline static VkPhysicalDeviceRayQueryFeaturesKHR enabledRayQueryFeatures{};
+	inline static VkPhysicalDeviceAccelerationStructureFeaturesKHR enabledAccelerationStructureFeatures{};
+	/** @brief Descriptor sizes and alignments for writing descriptors to descriptor buffers, only valid if hasDescriptorBuffer is set */
+	VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptorBufferProperties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT };
+	/** @brief Max. number of descriptors in a push descriptor set layout, only valid if hasPushDescriptor is set */
+	VkPhysicalDevicePushDescriptorPropertiesKHR pushDescriptorProperties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR };
+	/** @brief Scratch alignment and instance limits of acceleration structures, only valid if hasRayQuery is set */
+	VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR };
 	/** @brief Memory types and heaps of the physical device */
 	VkPhysicalDeviceMemoryProperties memoryProperties{};
 	/** @brief Queue family properties of the physical device */
@@ -51,6 +100,8 @@ struct Device
 	/** @brief Default command pool for the graphics queue family index */
 	VkCommandPool commandPool{ VK_NULL_HANDLE };
 	VkCommandPool commandPoolTransfer{ VK_NULL_HANDLE };
+	/** @brief Sub-allocates device memory for buffers and images */
+	MemoryAllocator* memoryAllocator{ nullptr };
 
 	/** @brief Contains queue family indices */
 	struct {
@@ -62,6 +113,24 @@ struct Device
 	bool hasDedicatedTransferQueue{ false };
 	bool hasDedicatedComputeQueue{ false };
 	bool hasDebugUtils{ false };
+	bool hasMeshShaders{ false };
+	bool hasBufferDeviceAddress{ false };
+	bool hasPresentWait{ false };
+	bool hasSwapchainMaintenance1{ false };
+	bool hasGraphicsPipelineLibrary{ false };
+	bool hasDynamicPolygonMode{ false };
+	bool hasDescriptorBuffer{ false };
+	bool hasPushDescriptor{ false };
+	bool hasFragmentShadingRate{ false };
+	bool hasMemoryBudget{ false };
+	bool hasDisplayTiming{ false };
+	// Set if the logical device spans all physical devices of a device group, resources are replicated on each of them
+	bool hasDeviceGroup{ false };
+	/** @brief Physical devices of the logical device, in the order of their device indices, only physicalDevice without a device group */
+	std::vector<VkPhysicalDevice> groupDevices;
+	bool hasIndexTypeUint8{ false };
+	bool hasRayQuery{ false };
+	bool hasShaderFloat16{ false };
 
 	/**  @brief Typecast to VkDevice */
 	operator VkDevice() { return logicalDevice; };
@@ -71,6 +140,9 @@ struct Device
 
 		// Store Properties features, limits and properties of the physical device for later use
 		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		properties11.pNext = &properties12;
+		VkPhysicalDeviceProperties2 properties2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &properties11 };
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
 		vkGetPhysicalDeviceFeatures(physicalDevice, &features);
 		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
 		// Queue family properties, used for setting up requested queues upon device creation
@@ -166,12 +238,241 @@ struct Device
 		Device::enabledFeatures12.pNext = &Device::enabledFeatures13;
 		deviceCreateInfo.pNext = &Device::enabledFeatures11;
 
-		// Enable debug utils extension if available
-		if (extensionSupported(VK_EXT_DEBUG_UTILS_EXTENSION_NAME)) {
-			deviceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-			hasDebugUtils = true;
+		// All physical devices of a group are driven through the same logical device, commands execute on the devices in their submission's device masks (see queueSubmit)
+		groupDevices = { physicalDevice };
+		VkDeviceGroupDeviceCreateInfo deviceGroupCI{ .sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_DEVICE_CREATE_INFO };
+		if (createInfo.deviceGroup.size() > 1) {
+			assert(std::find(createInfo.deviceGroup.begin(), createInfo.deviceGroup.end(), physicalDevice) != createInfo.deviceGroup.end());
+			groupDevices = createInfo.deviceGroup;
+			hasDeviceGroup = true;
+			deviceGroupCI.pNext = deviceCreateInfo.pNext;
+			deviceGroupCI.physicalDeviceCount = static_cast<uint32_t>(groupDevices.size());
+			deviceGroupCI.pPhysicalDevices = groupDevices.data();
+			deviceCreateInfo.pNext = &deviceGroupCI;
+		}
+
+		// Enable mesh shaders if requested and supported, applications need to check hasMeshShaders before using them
+		if (Device::enabledMeshShaderFeatures.meshShader && extensionSupported(VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+			VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &meshShaderFeatures };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			hasMeshShaders = meshShaderFeatures.meshShader && (meshShaderFeatures.taskShader || !Device::enabledMeshShaderFeatures.taskShader);
+		}
+		// Buffer device addresses are requested by setting bufferDeviceAddress, only enabled if 64 bit shader integers are supported too, applications need to check hasBufferDeviceAddress before using them
+		if (Device::enabledFeatures12.bufferDeviceAddress) {
+			VkPhysicalDeviceVulkan12Features features12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &features12 };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			// Addresses of allocations replicated on multiple devices need a separate feature
+			hasBufferDeviceAddress = features12.bufferDeviceAddress && features.shaderInt64 && (!hasDeviceGroup || features12.bufferDeviceAddressMultiDevice);
+			Device::enabledFeatures12.bufferDeviceAddressMultiDevice = hasDeviceGroup && hasBufferDeviceAddress;
+		}
+		Device::enabledFeatures12.bufferDeviceAddress = hasBufferDeviceAddress;
+		if (hasBufferDeviceAddress) {
+			Device::enabledFeatures.shaderInt64 = VK_TRUE;
+		}
+		// 16 bit float arithmetic is requested by setting shaderFloat16, applications need to check hasShaderFloat16 before using shaders with 16 bit types
+		if (Device::enabledFeatures12.shaderFloat16) {
+			VkPhysicalDeviceVulkan12Features features12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &features12 };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			hasShaderFloat16 = features12.shaderFloat16;
+		}
+		Device::enabledFeatures12.shaderFloat16 = hasShaderFloat16;
+
+		// Optional feature structures are appended to the end of the chain
+		void** featureChainEnd = &Device::enabledFeatures13.pNext;
+		*featureChainEnd = nullptr;
+		if (hasMeshShaders) {
+			deviceExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+			Device::enabledMeshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+			Device::enabledMeshShaderFeatures.pNext = nullptr;
+			*featureChainEnd = &Device::enabledMeshShaderFeatures;
+			featureChainEnd = &Device::enabledMeshShaderFeatures.pNext;
+		} else {
+			Device::enabledMeshShaderFeatures = {};
+		}
+
+		// Enable present ids and present wait if requested and supported, applications need to check hasPresentWait before using them
+		if (Device::enabledPresentWaitFeatures.presentWait && extensionSupported(VK_KHR_PRESENT_ID_EXTENSION_NAME) && extensionSupported(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+			VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR };
+			VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR, .pNext = &presentWaitFeatures };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &presentIdFeatures };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			hasPresentWait = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+		}
+		if (hasPresentWait) {
+			deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+			Device::enabledPresentIdFeatures = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR, .pNext = &Device::enabledPresentWaitFeatures, .presentId = VK_TRUE };
+			Device::enabledPresentWaitFeatures = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR, .pNext = nullptr, .presentWait = VK_TRUE };
+			*featureChainEnd = &Device::enabledPresentIdFeatures;
+			featureChainEnd = &Device::enabledPresentWaitFeatures.pNext;
+		} else {
+			Device::enabledPresentIdFeatures = {};
+			Device::enabledPresentWaitFeatures = {};
+		}
+
+		// Enable present fences of the swap chain maintenance extension if requested and supported, applications need to check hasSwapchainMaintenance1 before using them
+		if (Device::enabledSwapchainMaintenance1Features.swapchainMaintenance1 && extensionSupported(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME)) {
+			VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchainMaintenance1Features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &swapchainMaintenance1Features };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			hasSwapchainMaintenance1 = swapchainMaintenance1Features.swapchainMaintenance1;
+		}
+		if (hasSwapchainMaintenance1) {
+			deviceExtensions.push_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+			Device::enabledSwapchainMaintenance1Features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT, .pNext = nullptr, .swapchainMaintenance1 = VK_TRUE };
+			*featureChainEnd = &Device::enabledSwapchainMaintenance1Features;
+			featureChainEnd = &Device::enabledSwapchainMaintenance1Features.pNext;
+		} else {
+			Device::enabledSwapchainMaintenance1Features = {};
+		}
+
+		// Enable graphics pipeline libraries if requested and supported with fast linking, applications need to check hasGraphicsPipelineLibrary before using them
+		if (Device::enabledGraphicsPipelineLibraryFeatures.graphicsPipelineLibrary && extensionSupported(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) && extensionSupported(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+			VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &graphicsPipelineLibraryFeatures };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphicsPipelineLibraryProperties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT };
+			VkPhysicalDeviceProperties2 properties2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &graphicsPipelineLibraryProperties };
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+			hasGraphicsPipelineLibrary = graphicsPipelineLibraryFeatures.graphicsPipelineLibrary && graphicsPipelineLibraryProperties.graphicsPipelineLibraryFastLinking;
+		}
+		if (hasGraphicsPipelineLibrary) {
+			deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+			deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+			Device::enabledGraphicsPipelineLibraryFeatures = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT, .pNext = nullptr, .graphicsPipelineLibrary = VK_TRUE };
+			*featureChainEnd = &Device::enabledGraphicsPipelineLibraryFeatures;
+			featureChainEnd = &Device::enabledGraphicsPipelineLibraryFeatures.pNext;
+		} else {
+			Device::enabledGraphicsPipelineLibraryFeatures = {};
+		}
+
+		// Enable dynamic polygon mode if requested and supported, applications need to check hasDynamicPolygonMode before using it
+		if (Device::enabledExtendedDynamicState3Features.extendedDynamicState3PolygonMode && extensionSupported(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+			VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &extendedDynamicState3Features };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			hasDynamicPolygonMode = extendedDynamicState3Features.extendedDynamicState3PolygonMode;
+		}
+		if (hasDynamicPolygonMode) {
+			deviceExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+			Device::enabledExtendedDynamicState3Features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT, .pNext = nullptr, .extendedDynamicState3PolygonMode = VK_TRUE };
+			*featureChainEnd = &Device::enabledExtendedDynamicState3Features;
+			featureChainEnd = &Device::enabledExtendedDynamicState3Features.pNext;
+		} else {
+			Device::enabledExtendedDynamicState3Features = {};
+		}
+
+		// Enable descriptor buffers if requested and supported, applications need to check hasDescriptorBuffer before using them
+		// Descriptor buffers are bound through their device address, so these also need buffer device addresses
+		if (Device::enabledDescriptorBufferFeatures.descriptorBuffer && hasBufferDeviceAddress && extensionSupported(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+			VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &descriptorBufferFeatures };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			hasDescriptorBuffer = descriptorBufferFeatures.descriptorBuffer;
+		}
+		if (hasDescriptorBuffer) {
+			deviceExtensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+			Device::enabledDescriptorBufferFeatures = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT, .pNext = nullptr, .descriptorBuffer = VK_TRUE };
+			*featureChainEnd = &Device::enabledDescriptorBufferFeatures;
+			featureChainEnd = &Device::enabledDescriptorBufferFeatures.pNext;
+			VkPhysicalDeviceProperties2 properties2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &descriptorBufferProperties };
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+		} else {
+			Device::enabledDescriptorBufferFeatures = {};
+		}
+
+		// Push descriptors have no features, so they're enabled whenever supported, applications need to check hasPushDescriptor before using them
+		if (extensionSupported(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME)) {
+			deviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+			hasPushDescriptor = true;
+			VkPhysicalDeviceProperties2 properties2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &pushDescriptorProperties };
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+		}
+
+		// Enable per draw fragment shading rates if requested and supported, applications need to check hasFragmentShadingRate before using them
+		if (Device::enabledFragmentShadingRateFeatures.pipelineFragmentShadingRate && extensionSupported(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME)) {
+			VkPhysicalDeviceFragmentShadingRateFeaturesKHR fragmentShadingRateFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &fragmentShadingRateFeatures };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			hasFragmentShadingRate = fragmentShadingRateFeatures.pipelineFragmentShadingRate;
+		}
+		if (hasFragmentShadingRate) {
+			deviceExtensions.push_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+			Device::enabledFragmentShadingRateFeatures = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR, .pNext = nullptr, .pipelineFragmentShadingRate = VK_TRUE };
+			*featureChainEnd = &Device::enabledFragmentShadingRateFeatures;
+			featureChainEnd = &Device::enabledFragmentShadingRateFeatures.pNext;
+		} else {
+			Device::enabledFragmentShadingRateFeatures = {};
+		}
+
+		// Enable 8 bit indices if requested and supported, applications need to check hasIndexTypeUint8 before binding index buffers with VK_INDEX_TYPE_UINT8_EXT
+		if (Device::enabledIndexTypeUint8Features.indexTypeUint8 && extensionSupported(VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME)) {
+			VkPhysicalDeviceIndexTypeUint8FeaturesEXT indexTypeUint8Features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &indexTypeUint8Features };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			hasIndexTypeUint8 = indexTypeUint8Features.indexTypeUint8;
+		}
+		if (hasIndexTypeUint8) {
+			deviceExtensions.push_back(VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME);
+			Device::enabledIndexTypeUint8Features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT, .pNext = nullptr, .indexTypeUint8 = VK_TRUE };
+			*featureChainEnd = &Device::enabledIndexTypeUint8Features;
+			featureChainEnd = &Device::enabledIndexTypeUint8Features.pNext;
+		} else {
+			Device::enabledIndexTypeUint8Features = {};
+		}
+
+		// Enable ray queries if requested and supported, applications need to check hasRayQuery before building acceleration structures or using shaders that trace rays
+		// Acceleration structures are built from buffer device addresses, and aren't supported for logical devices spanning a device group
+		if (Device::enabledRayQueryFeatures.rayQuery && hasBufferDeviceAddress && !hasDeviceGroup && extensionSupported(VK_KHR_RAY_QUERY_EXTENSION_NAME) && extensionSupported(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) && extensionSupported(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME)) {
+			VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR };
+			VkPhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR, .pNext = &accelerationStructureFeatures };
+			VkPhysicalDeviceFeatures2 features2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &rayQueryFeatures };
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			hasRayQuery = rayQueryFeatures.rayQuery && accelerationStructureFeatures.accelerationStructure;
+		}
+		if (hasRayQuery) {
+			deviceExtensions.push_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+			deviceExtensions.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
+			// Required by acceleration structures, even though builds are only recorded on the device
+			deviceExtensions.push_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+			Device::enabledRayQueryFeatures = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR, .pNext = &Device::enabledAccelerationStructureFeatures, .rayQuery = VK_TRUE };
+			Device::enabledAccelerationStructureFeatures = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR, .pNext = nullptr, .accelerationStructure = VK_TRUE };
+			*featureChainEnd = &Device::enabledRayQueryFeatures;
+			featureChainEnd = &Device::enabledAccelerationStructureFeatures.pNext;
+			VkPhysicalDeviceProperties2 properties2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &accelerationStructureProperties };
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+		} else {
+			Device::enabledRayQueryFeatures = {};
+			Device::enabledAccelerationStructureFeatures = {};
+		}
+
+		// Pipeline statistics queries are optional, applications need to check enabledFeatures.pipelineStatisticsQuery before using them
+		if (!features.pipelineStatisticsQuery) {
+			Device::enabledFeatures.pipelineStatisticsQuery = VK_FALSE;
+		}
+		// Geometry shaders are optional too, applications may request the feature for the primitive ID in fragment shaders and need to check enabledFeatures.geometryShader
+		if (!features.geometryShader) {
+			Device::enabledFeatures.geometryShader = VK_FALSE;
 		}
 
+		// Past presentation times for frame pacing, the extension has no features so it's enabled whenever supported
+		if (extensionSupported(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME)) {
+			deviceExtensions.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+			hasDisplayTiming = true;
+		}
+
+		// Heap budgets including the memory used by other processes, for detecting oversubscription before the driver starts paging
+		if (extensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+			deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			hasMemoryBudget = true;
+		}
+
+		// Object names and command buffer labels only need the instance extension
+		hasDebugUtils = createInfo.debugUtils;
+
 		if (deviceExtensions.size() > 0) {
 			deviceCreateInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
 			deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
@@ -182,6 +483,10 @@ struct Device
 			throw "Could not create Vulkan device : \n" + vks::tools::errorString(result);
 		}
 
+		// Replaces volk's global function pointers with ones fetched from the device, so device level calls (e.g. all vkCmd* functions) skip the loader's dispatch
+		// Only valid with a single logical device, which is all the application ever creates
+		volkLoadDevice(logicalDevice);
+
 		// Create a default command pool for graphics command buffers
 		// @todo: remove, shouldn't be part of the device
 		commandPool = createCommandPool(queueFamilyIndices.graphics);
@@ -190,20 +495,95 @@ struct Device
 		} else {
 			commandPoolTransfer = commandPool;
 		}
+
+		memoryAllocator = new MemoryAllocator(logicalDevice, memoryProperties, properties.limits, hasBufferDeviceAddress);
 	}
 
 	~Device()
 	{
+		if (commandPoolTransfer && (commandPoolTransfer != commandPool))
+		{
+			vkDestroyCommandPool(logicalDevice, commandPoolTransfer, nullptr);
+		}
 		if (commandPool)
 		{
 			vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
 		}
+		delete memoryAllocator;
 		if (logicalDevice)
 		{
 			vkDestroyDevice(logicalDevice, nullptr);
 		}
 	}
 
+	/** @brief True if a device local heap larger than the legacy 256 MB BAR window is host visible, e.g. with resizable BAR or on unified memory architectures */
+	bool hasHostVisibleDeviceMemory() const
+	{
+		VkBool32 found{ false };
+		getHostVisibleDeviceMemoryType(~0u, &found);
+		return found;
+	}
+
+	/** @brief Memory properties for buffers the host reads back from, host cached if available as reading uncached memory is slow, host coherent otherwise */
+	VkMemoryPropertyFlags getHostReadMemoryProperties()
+	{
+		VkBool32 cachedMemoryFound{ false };
+		getMemoryType(~0u, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &cachedMemoryFound);
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		properties |= cachedMemoryFound ? VK_MEMORY_PROPERTY_HOST_CACHED_BIT : VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		return properties;
+	}
+
+	/**
+	* Get the index of a device local, host visible and coherent memory type out of the given type bits, which isn't on a small (<= 256 MB) BAR window heap
+	* Unlike getMemoryType this doesn't pick the first matching type, as drivers without resizable BAR usually list the small window ahead of the large heap
+	*
+	* @param typeBits Bit mask with bits set for each memory type supported by the resource to request for (from VkMemoryRequirements)
+	* @param (Optional) memTypeFound Pointer to a bool that is set to true if a matching memory type has been found
+	*
+	* @return Index of the memory type, 0 if none was found
+	*/
+	uint32_t getHostVisibleDeviceMemoryType(uint32_t typeBits, VkBool32* memTypeFound = nullptr) const
+	{
+		const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+			const VkMemoryType& memoryType = memoryProperties.memoryTypes[i];
+			if ((typeBits & (1u << i)) && ((memoryType.propertyFlags & flags) == flags) && (memoryProperties.memoryHeaps[memoryType.heapIndex].size > 256ull * 1024 * 1024)) {
+				if (memTypeFound) {
+					*memTypeFound = true;
+				}
+				return i;
+			}
+		}
+		if (memTypeFound) {
+			*memTypeFound = false;
+		}
+		return 0;
+	}
+
+	/**
+	* Get the budget and usage of all memory heaps
+	* Without VK_EXT_memory_budget the budget is the size of the heap and the usage only includes the memory allocated by the memoryAllocator
+	* Doesn't allocate, so it can be called every frame
+	*/
+	MemoryBudget getMemoryBudget() const
+	{
+		MemoryBudget memoryBudget{ .heapCount = memoryProperties.memoryHeapCount };
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+		if (hasMemoryBudget) {
+			VkPhysicalDeviceMemoryProperties2 memoryProperties2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2, .pNext = &budgetProperties };
+			vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties2);
+		}
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+			MemoryHeapBudget& heap = memoryBudget.heaps[i];
+			heap.size = memoryProperties.memoryHeaps[i].size;
+			heap.deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+			heap.budget = hasMemoryBudget ? budgetProperties.heapBudget[i] : heap.size;
+			heap.usage = hasMemoryBudget ? budgetProperties.heapUsage[i] : memoryAllocator->getHeapUsage(i);
+		}
+		return memoryBudget;
+	}
+
 	/**
 	* Get the index of a memory type that has all the requested property bits set
 	*
@@ -396,7 +776,7 @@ struct Device
 		VK_CHECK_RESULT(vkCreateFence(logicalDevice, &fenceInfo, nullptr, &fence));
 
 		// Submit to the queue
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+		VK_CHECK_RESULT(queueSubmit(queue, 1, &submitInfo, fence));
 		// Wait for the fence to signal that command buffer has finished executing
 		VK_CHECK_RESULT(vkWaitForFences(logicalDevice, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
 
@@ -424,6 +804,46 @@ struct Device
 		return (std::find(supportedExtensions.begin(), supportedExtensions.end(), extension) != supportedExtensions.end());
 	}
 
+	// Device mask with a bit for each physical device of the logical device
+	uint32_t getDeviceMask() const
+	{
+		return (1u << static_cast<uint32_t>(groupDevices.size())) - 1;
+	}
+
+	/**
+	* Submits work to a queue, with a device group the command buffers are executed by all of its physical devices
+	* Submissions without device group info only execute on the first physical device, so all submissions need to go through this to keep the devices' copies of resources in sync
+	* Semaphores are waited on and signalled by the first physical device
+	*/
+	VkResult queueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* submits, VkFence fence)
+	{
+		if (!hasDeviceGroup) {
+			return vkQueueSubmit(queue, submitCount, submits, fence);
+		}
+		uint32_t maxCount = 0;
+		for (uint32_t i = 0; i < submitCount; i++) {
+			maxCount = std::max({ maxCount, submits[i].commandBufferCount, submits[i].waitSemaphoreCount, submits[i].signalSemaphoreCount });
+		}
+		const std::vector<uint32_t> deviceMasks(maxCount, getDeviceMask());
+		const std::vector<uint32_t> deviceIndices(maxCount, 0);
+		std::vector<VkSubmitInfo> groupSubmits(submits, submits + submitCount);
+		std::vector<VkDeviceGroupSubmitInfo> deviceGroupSubmitInfos(submitCount);
+		for (uint32_t i = 0; i < submitCount; i++) {
+			deviceGroupSubmitInfos[i] = {
+				.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO,
+				.pNext = submits[i].pNext,
+				.waitSemaphoreCount = submits[i].waitSemaphoreCount,
+				.pWaitSemaphoreDeviceIndices = deviceIndices.data(),
+				.commandBufferCount = submits[i].commandBufferCount,
+				.pCommandBufferDeviceMasks = deviceMasks.data(),
+				.signalSemaphoreCount = submits[i].signalSemaphoreCount,
+				.pSignalSemaphoreDeviceIndices = deviceIndices.data()
+			};
+			groupSubmits[i].pNext = &deviceGroupSubmitInfos[i];
+		}
+		return vkQueueSubmit(queue, submitCount, groupSubmits.data(), fence);
+	}
+
 	VkQueue getQueue(QueueType queueType) {
 		uint32_t queueFamilyIndex = 0;
 		bool validQueueFamilyIndex = false;
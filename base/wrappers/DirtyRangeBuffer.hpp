@@ -0,0 +1,203 @@
+/*
+ * Persistent buffer updated with the changed ranges of an array
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include "volk.h"
+#include "Device.hpp"
+#include "Buffer.hpp"
+#include "FrameAllocator.hpp"
+#include "VulkanContext.h"
+
+struct DirtyRangeBufferCreateInfo {
+	const std::string name{ "" };
+	VkDeviceSize elementSize{ 0 };
+	uint32_t capacity{ 0 };
+	VkBufferUsageFlags usageFlags{ VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+	// Number of frames in flight, each frame gets its own buffer
+	uint32_t frameCount{ 1 };
+	// Concurrent sharing for buffers read by multiple queue families (e.g. the graphics and async compute queues)
+	VkSharingMode sharingMode{ VK_SHARING_MODE_EXCLUSIVE };
+	std::vector<uint32_t> queueFamilyIndices{};
+	// Changed elements separated by at most this many unchanged ones are uploaded as a single range
+	uint32_t maxGap{ 4 };
+	// Write the buffers directly if all of device local memory is host visible
+	bool allowHostVisible{ true };
+};
+
+/**
+ * Device local buffer of fixed size elements that mirrors an array on the host, each update only uploads the elements that changed since the last one
+ * Changes are found by comparing against a host copy of what has been uploaded, so callers don't need to track them, adjacent changes are coalesced into ranges
+ * Each frame in flight has its own buffer (and host copy), so a frame never overwrites data a frame still executing reads, a change is thus uploaded once per frame in flight
+ * Ranges are copied from the frame allocator, or written directly if device local memory is host visible beyond the 256 MB BAR window (resizable BAR or unified memory)
+ * Upload traffic thus scales with the number of changed elements instead of the number of elements
+ */
+class DirtyRangeBuffer {
+private:
+	struct Target {
+		Buffer* buffer{ nullptr };
+		// Contents of buffer as last written
+		std::vector<uint8_t> shadow;
+		uint32_t count{ 0 };
+	};
+	std::vector<Target> targets;
+	VkDeviceSize elementSize{ 0 };
+	uint32_t capacity{ 0 };
+	uint32_t maxGap{ 0 };
+	bool hostVisible{ false };
+	// Reused across updates, so updating doesn't allocate
+	std::vector<VkBufferCopy> copyRegions;
+	VkDeviceSize uploadedBytes{ 0 };
+	uint32_t uploadedRanges{ 0 };
+
+	// Calls write(first, count) for each range of changed elements and updates the shadow copy
+	template<typename F>
+	void forEachChangedRange(Target& target, const uint8_t* elements, uint32_t count, F&& write)
+	{
+		uint32_t rangeStart = UINT32_MAX;
+		uint32_t rangeEnd = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			uint8_t* shadowElement = &target.shadow[i * elementSize];
+			const uint8_t* element = &elements[i * elementSize];
+			// Elements beyond the count of the last update are written without comparing, as the shadow holds stale data there
+			if ((i < target.count) && (memcmp(shadowElement, element, elementSize) == 0)) {
+				continue;
+			}
+			memcpy(shadowElement, element, elementSize);
+			if ((rangeStart != UINT32_MAX) && (i > rangeEnd + maxGap)) {
+				write(rangeStart, rangeEnd - rangeStart + 1);
+				rangeStart = UINT32_MAX;
+			}
+			if (rangeStart == UINT32_MAX) {
+				rangeStart = i;
+			}
+			rangeEnd = i;
+		}
+		if (rangeStart != UINT32_MAX) {
+			write(rangeStart, rangeEnd - rangeStart + 1);
+		}
+		target.count = count;
+	}
+
+public:
+	DirtyRangeBuffer(DirtyRangeBufferCreateInfo createInfo) : elementSize(createInfo.elementSize), capacity(createInfo.capacity), maxGap(createInfo.maxGap)
+	{
+		assert(elementSize > 0 && capacity > 0);
+		hostVisible = createInfo.allowHostVisible && VulkanContext::device->hasHostVisibleDeviceMemory();
+		targets.resize(createInfo.frameCount);
+		VkBufferUsageFlags usageFlags = createInfo.usageFlags;
+		VkMemoryPropertyFlags memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		if (!hostVisible) {
+			usageFlags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		}
+		for (Target& target : targets) {
+			target.buffer = new Buffer({
+				.name = createInfo.name,
+				.usageFlags = usageFlags,
+				.memoryPropertyFlags = memoryPropertyFlags,
+				.size = elementSize * capacity,
+				.map = hostVisible,
+				.sharingMode = createInfo.sharingMode,
+				.queueFamilyIndices = createInfo.queueFamilyIndices,
+				.memoryUsage = hostVisible ? BufferMemoryUsage::HostWriteDeviceRead : BufferMemoryUsage::Default
+			});
+			target.shadow.resize(elementSize * capacity);
+		}
+		copyRegions.reserve(capacity / 2 + 1);
+	}
+
+	~DirtyRangeBuffer()
+	{
+		for (Target& target : targets) {
+			delete target.buffer;
+		}
+	}
+
+	/**
+	* Uploads the elements that changed since the last update
+	*
+	* @param commandBuffer Command buffer of the frame, the copies and barriers are recorded to it, needs to be outside of a rendering scope
+	* @param frameIndex Index of the frame's objects, the frame last using them must have finished executing
+	* @param frameAllocator Allocator of the frame, the source of the copies is allocated from it (needs transfer source usage and room for count elements)
+	* @param elements Array of count elements
+	* @param dstStageMask Stages of the frame that read the buffer
+	*/
+	void update(VkCommandBuffer commandBuffer, uint32_t frameIndex, FrameAllocator& frameAllocator, const void* elements, uint32_t count, VkPipelineStageFlags2 dstStageMask)
+	{
+		assert(count <= capacity);
+		uploadedBytes = 0;
+		uploadedRanges = 0;
+		const uint8_t* source = static_cast<const uint8_t*>(elements);
+		Target& target = targets[frameIndex];
+		if (hostVisible) {
+			uint8_t* mapped = static_cast<uint8_t*>(target.buffer->mapped);
+			forEachChangedRange(target, source, count, [&](uint32_t first, uint32_t rangeCount) {
+				memcpy(mapped + first * elementSize, source + first * elementSize, rangeCount * elementSize);
+				uploadedBytes += rangeCount * elementSize;
+				uploadedRanges++;
+			});
+			return;
+		}
+
+		// Dirty elements are gathered into one block of the frame allocator, sized for all elements as the number of changes isn't known up front
+		copyRegions.clear();
+		FrameAllocation staging{};
+		forEachChangedRange(target, source, count, [&](uint32_t first, uint32_t rangeCount) {
+			if (!staging.mapped) {
+				staging = frameAllocator.allocate(elementSize * count, 16);
+			}
+			copyRegions.push_back({ .srcOffset = staging.offset + uploadedBytes, .dstOffset = first * elementSize, .size = rangeCount * elementSize });
+			memcpy(static_cast<uint8_t*>(staging.mapped) + uploadedBytes, source + first * elementSize, rangeCount * elementSize);
+			uploadedBytes += rangeCount * elementSize;
+		});
+		uploadedRanges = static_cast<uint32_t>(copyRegions.size());
+		if (copyRegions.empty()) {
+			return;
+		}
+		vkCmdCopyBuffer(commandBuffer, frameAllocator.getBuffer(), target.buffer->buffer, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+		VkBufferMemoryBarrier2 barrier{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+			.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			.dstStageMask = dstStageMask,
+			.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = target.buffer->buffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE
+		};
+		VkDependencyInfo dependencyInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .bufferMemoryBarrierCount = 1, .pBufferMemoryBarriers = &barrier };
+		vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+	}
+
+	Buffer* getBuffer(uint32_t frameIndex) const
+	{
+		return targets[frameIndex].buffer;
+	}
+
+	bool isHostVisible() const
+	{
+		return hostVisible;
+	}
+
+	// Bytes and ranges uploaded by the last update
+	VkDeviceSize getUploadedBytes() const
+	{
+		return uploadedBytes;
+	}
+
+	uint32_t getUploadedRanges() const
+	{
+		return uploadedRanges;
+	}
+};
@@ -0,0 +1,123 @@
+/*
+ * Per-frame linear allocator for host written shader data
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "volk.h"
+#include "VulkanTools.h"
+#include "Device.hpp"
+#include "Buffer.hpp"
+#include "VulkanContext.h"
+
+struct FrameAllocatorCreateInfo {
+	const std::string name{ "" };
+	VkDeviceSize size{ 4 * 1024 * 1024 };
+	VkBufferUsageFlags usageFlags{ VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+	// If set, the buffer is shared between these queue families (e.g. if it's written by async compute)
+	std::vector<uint32_t> queueFamilyIndices{};
+};
+
+/** @brief Block of a frame allocator, offset is passed as the dynamic offset of the binding that reads it */
+struct FrameAllocation {
+	void* mapped{ nullptr };
+	VkDeviceSize offset{ 0 };
+	VkDeviceSize size{ 0 };
+};
+
+/**
+ * Single persistently mapped buffer that a frame carves all of its host written shader data from
+ * Blocks are bound with dynamic offsets, so descriptors only need to be written once for the whole buffer
+ * The allocator is reset once the frame it belongs to is no longer in flight, so allocating is only a bump of the head
+ */
+class FrameAllocator {
+private:
+	Buffer* buffer{ nullptr };
+	VkDeviceSize head{ 0 };
+	VkDeviceSize peak{ 0 };
+public:
+	FrameAllocator(FrameAllocatorCreateInfo createInfo) {
+		MemoryStats::Scope memoryScope(MemoryCategory::FrameData);
+		buffer = new Buffer({
+			.name = createInfo.name,
+			.usageFlags = createInfo.usageFlags,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.size = createInfo.size,
+			.sharingMode = createInfo.queueFamilyIndices.empty() ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT,
+			.queueFamilyIndices = createInfo.queueFamilyIndices,
+			.memoryUsage = BufferMemoryUsage::HostWriteDeviceRead
+		});
+	}
+
+	~FrameAllocator() {
+		delete buffer;
+	}
+
+	/**
+	* Allocates a block from the frame's buffer
+	*
+	* @param size Size of the block in bytes
+	* @param alignment Alignment of the block's offset, needs to be a power of two
+	*
+	* @return The allocated block, only valid until the allocator is reset
+	*/
+	FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment) {
+		const VkDeviceSize offset = (head + alignment - 1) & ~(alignment - 1);
+		if (offset + size > buffer->size) {
+			vks::tools::exitFatal("Frame allocator \"" + buffer->name + "\" is out of memory", -1);
+		}
+		head = offset + size;
+		peak = std::max(peak, head);
+		return { .mapped = static_cast<uint8_t*>(buffer->mapped) + offset, .offset = offset, .size = size };
+	}
+
+	FrameAllocation allocateUniform(VkDeviceSize size) {
+		return allocate(size, VulkanContext::device->properties.limits.minUniformBufferOffsetAlignment);
+	}
+
+	FrameAllocation allocateStorage(VkDeviceSize size) {
+		return allocate(size, VulkanContext::device->properties.limits.minStorageBufferOffsetAlignment);
+	}
+
+	// Allocates a uniform block and copies the data to it
+	template<typename T>
+	FrameAllocation pushUniform(const T& data) {
+		FrameAllocation allocation = allocateUniform(sizeof(T));
+		memcpy(allocation.mapped, &data, sizeof(T));
+		return allocation;
+	}
+
+	/** @brief Releases all blocks at once, the frame must no longer be in flight */
+	void reset() {
+		head = 0;
+	}
+
+	/**
+	* Returns a descriptor that covers a block of the given size, with the offset supplied as dynamic offset at bind time
+	*
+	* @param range Size of the largest block that's bound with this descriptor
+	*/
+	VkDescriptorBufferInfo getDescriptor(VkDeviceSize range) const {
+		return { .buffer = buffer->buffer, .offset = 0, .range = range };
+	}
+
+	VkBuffer getBuffer() const {
+		return buffer->buffer;
+	}
+
+	VkDeviceSize getSize() const {
+		return buffer->size;
+	}
+
+	// Highest number of bytes allocated within one frame
+	VkDeviceSize getPeakUsage() const {
+		return peak;
+	}
+};
@@ -0,0 +1,305 @@
+/*
+ * Shared vertex and index buffers that models suballocate their geometry from
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
+#include <iostream>
+#include <assert.h>
+#include "volk.h"
+#include "VulkanTools.h"
+#include "Device.hpp"
+#include "Buffer.hpp"
+#include "VulkanContext.h"
+
+struct GeometryPoolCreateInfo {
+	VkDeviceSize vertexBufferSize{ 128 * 1024 * 1024 };
+	VkDeviceSize indexBufferSize{ 64 * 1024 * 1024 };
+	// All vertices in the pool share this stride, models with a different vertex layout keep their own buffers
+	uint32_t vertexStride{ 0 };
+	// Lets shaders read the vertex buffer as a storage buffer, e.g. the mesh shaders, ranges are then aligned for storage buffer descriptors
+	bool storageVertices{ false };
+	// Lets acceleration structure builds read the vertices and indices, builds on other queue families (e.g. async compute) need to add them to the shared queue families
+	bool accelerationStructureInput{ false };
+	std::vector<uint32_t> sharedQueueFamilies{};
+};
+
+/** @brief Vertex and index ranges of one model in the pool, offsets and sizes are in bytes */
+struct GeometryAllocation {
+	VkDeviceSize vertexOffset{ 0 };
+	VkDeviceSize vertexSize{ 0 };
+	VkDeviceSize indexOffset{ 0 };
+	VkDeviceSize indexSize{ 0 };
+	uint32_t vertexStride{ 1 };
+	// Size of an index of the range in bytes, ranges of different index types share the index buffer
+	uint32_t indexStride{ sizeof(uint32_t) };
+	// Hash of the geometry if the ranges are shared by all models with the same geometry, zero otherwise
+	uint64_t contentKey{ 0 };
+	bool valid{ false };
+	// First vertex and first index of the ranges, added to the vertex offset and first index of the model's draws
+	int32_t baseVertex() const { return static_cast<int32_t>(vertexOffset / vertexStride); }
+	// Index buffers are bound at offset zero with the range's index type, so the first index is counted in indices of that size
+	uint32_t baseIndex() const { return static_cast<uint32_t>(indexOffset / indexStride); }
+};
+
+/**
+ * One vertex and one index buffer for the geometry of all models, so draws of different models don't need to bind other buffers
+ * Each model gets a vertex and an index range, draws address them through their vertex offset and first index instead of buffer offsets
+ * Index ranges may use different index types, draws of a range need to bind the index buffer with the type matching its index stride
+ * Free ranges are kept ordered by offset, allocating picks the first one that fits and freeing merges a range with its free neighbours
+ * If a dedicated transfer queue is used, the buffers are shared by the transfer and graphics queue families, so ranges can be uploaded while others are drawn from
+ * Acceleration structure builds from the pooled geometry may run on other queue families, which are then added to the shared families
+ * Ranges allocated with a content key are reference counted, models with the same geometry acquire them instead of uploading another copy
+ */
+class GeometryPool {
+private:
+	struct Heap {
+		VkDeviceSize size{ 0 };
+		VkDeviceSize used{ 0 };
+		// Free ranges as offset -> size
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+	};
+	Heap vertexHeap;
+	Heap indexHeap;
+	uint32_t vertexStride{ 0 };
+	VkDeviceSize vertexAlignment{ 1 };
+	bool storageVertices{ false };
+	bool shared{ false };
+	std::mutex mutex;
+	struct SharedRanges {
+		GeometryAllocation allocation;
+		uint32_t references{ 0 };
+	};
+	std::unordered_map<uint64_t, SharedRanges> sharedRanges;
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	static bool allocateFromHeap(Heap& heap, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+	{
+		for (auto it = heap.freeRanges.begin(); it != heap.freeRanges.end(); it++) {
+			const VkDeviceSize rangeOffset = it->first;
+			const VkDeviceSize rangeSize = it->second;
+			const VkDeviceSize alignedOffset = alignUp(rangeOffset, alignment);
+			if (alignedOffset + size > rangeOffset + rangeSize) {
+				continue;
+			}
+			heap.freeRanges.erase(it);
+			// Padding in front of the range and the remainder behind it stay free
+			if (alignedOffset > rangeOffset) {
+				heap.freeRanges[rangeOffset] = alignedOffset - rangeOffset;
+			}
+			if (alignedOffset + size < rangeOffset + rangeSize) {
+				heap.freeRanges[alignedOffset + size] = rangeOffset + rangeSize - alignedOffset - size;
+			}
+			heap.used += size;
+			offset = alignedOffset;
+			return true;
+		}
+		return false;
+	}
+
+	static void freeToHeap(Heap& heap, VkDeviceSize offset, VkDeviceSize size)
+	{
+		heap.used -= size;
+		// Merge with the adjacent free ranges
+		auto next = heap.freeRanges.lower_bound(offset);
+		if (next != heap.freeRanges.end() && next->first == offset + size) {
+			size += next->second;
+			next = heap.freeRanges.erase(next);
+		}
+		if (next != heap.freeRanges.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset) {
+				prev->second += size;
+				return;
+			}
+		}
+		heap.freeRanges[offset] = size;
+	}
+
+public:
+	Buffer* vertices{ nullptr };
+	Buffer* indices{ nullptr };
+
+	GeometryPool(GeometryPoolCreateInfo createInfo)
+	{
+		assert(createInfo.vertexStride > 0);
+		vertexStride = createInfo.vertexStride;
+		storageVertices = createInfo.storageVertices;
+		// Vertex ranges start at a whole vertex, and at a valid storage buffer descriptor offset if the vertices are read as storage buffer
+		vertexAlignment = vertexStride;
+		if (createInfo.storageVertices) {
+			vertexAlignment = std::lcm(vertexAlignment, VulkanContext::device->properties.limits.minStorageBufferOffsetAlignment);
+		}
+		shared = VulkanContext::device->hasDedicatedTransferQueue;
+		std::vector<uint32_t> queueFamilyIndices{ VulkanContext::device->queueFamilyIndices.graphics };
+		if (shared) {
+			queueFamilyIndices.push_back(VulkanContext::device->queueFamilyIndices.transfer);
+		}
+		for (uint32_t queueFamilyIndex : createInfo.sharedQueueFamilies) {
+			if (std::find(queueFamilyIndices.begin(), queueFamilyIndices.end(), queueFamilyIndex) == queueFamilyIndices.end()) {
+				queueFamilyIndices.push_back(queueFamilyIndex);
+			}
+		}
+		const VkSharingMode sharingMode = (queueFamilyIndices.size() > 1) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+		if (sharingMode == VK_SHARING_MODE_EXCLUSIVE) {
+			queueFamilyIndices.clear();
+		}
+		// Vertex shaders can also fetch the vertices through the buffer's device address, which is also how acceleration structure builds read them
+		VkBufferUsageFlags deviceAddressUsage = 0;
+		if (VulkanContext::device->hasBufferDeviceAddress) {
+			deviceAddressUsage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+		}
+		if (createInfo.accelerationStructureInput) {
+			assert(VulkanContext::device->hasBufferDeviceAddress);
+			deviceAddressUsage |= VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+		}
+		VkBufferUsageFlags vertexUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | deviceAddressUsage;
+		if (createInfo.storageVertices) {
+			vertexUsage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		}
+		const VkBufferUsageFlags indexUsage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | deviceAddressUsage;
+		vertices = new Buffer({
+			.name = "Geometry pool vertices",
+			.usageFlags = vertexUsage,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			.size = createInfo.vertexBufferSize,
+			.map = false,
+			.sharingMode = sharingMode,
+			.queueFamilyIndices = queueFamilyIndices
+		});
+		indices = new Buffer({
+			.name = "Geometry pool indices",
+			.usageFlags = indexUsage,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			.size = createInfo.indexBufferSize,
+			.map = false,
+			.sharingMode = sharingMode,
+			.queueFamilyIndices = queueFamilyIndices
+		});
+		vertexHeap.size = createInfo.vertexBufferSize;
+		vertexHeap.freeRanges[0] = vertexHeap.size;
+		indexHeap.size = createInfo.indexBufferSize;
+		indexHeap.freeRanges[0] = indexHeap.size;
+	}
+
+	~GeometryPool()
+	{
+		if (vertexHeap.used > 0 || indexHeap.used > 0) {
+			std::cerr << "Geometry pool destroyed with ranges still in use\n";
+		}
+		delete vertices;
+		delete indices;
+	}
+
+	/**
+	* Reserve the vertex and index ranges for a model
+	*
+	* @param vertexSize Size of the model's vertices in bytes, needs to be a multiple of the pool's vertex stride
+	* @param indexSize Size of the model's indices in bytes
+	* @param indexStride Size of a single index in bytes (1, 2 or 4), index ranges start at a whole index
+	* @param allocation Receives the ranges
+	* @param contentKey (Optional) Hash of the geometry, if set later models with the same geometry can share the ranges through acquire once they have been written
+	*
+	* @return False if the pool doesn't have enough space left, nothing is reserved in that case
+	*/
+	bool allocate(VkDeviceSize vertexSize, VkDeviceSize indexSize, uint32_t indexStride, GeometryAllocation& allocation, uint64_t contentKey = 0)
+	{
+		assert(vertexSize % vertexStride == 0);
+		assert(indexSize % indexStride == 0);
+		std::lock_guard<std::mutex> lock(mutex);
+		allocation = { .vertexSize = vertexSize, .indexSize = indexSize, .vertexStride = vertexStride, .indexStride = indexStride };
+		if (!allocateFromHeap(vertexHeap, vertexSize, vertexAlignment, allocation.vertexOffset)) {
+			return false;
+		}
+		if (indexSize > 0 && !allocateFromHeap(indexHeap, indexSize, indexStride, allocation.indexOffset)) {
+			freeToHeap(vertexHeap, allocation.vertexOffset, vertexSize);
+			return false;
+		}
+		allocation.valid = true;
+		if (contentKey != 0 && sharedRanges.find(contentKey) == sharedRanges.end()) {
+			allocation.contentKey = contentKey;
+			sharedRanges[contentKey] = { allocation, 1 };
+		}
+		return true;
+	}
+
+	/**
+	* Adds a reference to the ranges of geometry allocated with the same content key
+	*
+	* @return False if no ranges with this key, sizes and index stride have been allocated
+	*/
+	bool acquire(uint64_t contentKey, VkDeviceSize vertexSize, VkDeviceSize indexSize, uint32_t indexStride, GeometryAllocation& allocation)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = sharedRanges.find(contentKey);
+		// The sizes are part of the key, comparing them guards against the worst of a hash collision
+		if (contentKey == 0 || it == sharedRanges.end() || it->second.allocation.vertexSize != vertexSize || it->second.allocation.indexSize != indexSize || it->second.allocation.indexStride != indexStride) {
+			return false;
+		}
+		it->second.references++;
+		allocation = it->second.allocation;
+		return true;
+	}
+
+	/** @brief Return a model's ranges to the pool, shared ranges are only freed once their last user returns them, the GPU must no longer use them */
+	void free(GeometryAllocation& allocation)
+	{
+		if (!allocation.valid) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		if (allocation.contentKey != 0) {
+			SharedRanges& ranges = sharedRanges[allocation.contentKey];
+			if (--ranges.references > 0) {
+				allocation = {};
+				return;
+			}
+			sharedRanges.erase(allocation.contentKey);
+		}
+		freeToHeap(vertexHeap, allocation.vertexOffset, allocation.vertexSize);
+		if (allocation.indexSize > 0) {
+			freeToHeap(indexHeap, allocation.indexOffset, allocation.indexSize);
+		}
+		allocation = {};
+	}
+
+	uint32_t getVertexStride() const
+	{
+		return vertexStride;
+	}
+
+	bool hasStorageVertices() const
+	{
+		return storageVertices;
+	}
+
+	// True if the buffers are shared by the graphics and transfer queue families, uploads then need to be released with StagingBuffer::releaseSharedBuffer
+	bool isShared() const
+	{
+		return shared;
+	}
+
+	VkDeviceSize getUsedVertexSize() const
+	{
+		return vertexHeap.used;
+	}
+
+	VkDeviceSize getUsedIndexSize() const
+	{
+		return indexHeap.used;
+	}
+};
@@ -31,17 +31,113 @@ struct ImageCreateInfo {
 	uint32_t queueFamilyIndexCount{ 0 };
 	const uint32_t* pQueueFamilyIndices{ nullptr };
 	VkImageLayout initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+	VkMemoryPropertyFlags memoryPropertyFlags{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT };
+	// Allocate a separate VkDeviceMemory instead of sub-allocating from the device's memory allocator
+	bool dedicatedAllocation{ false };
 };
 
-enum class ImageUseCase { TransferDestination, ShaderRead };
+// Intended uses of an image that transitions are requested for, see Image::getUse for their stages, accesses and layouts
+enum class ImageUseCase {
+	TransferSource,
+	TransferDestination,
+	// Sampled in fragment or compute shaders
+	ShaderRead,
+	// Storage image accesses in compute shaders
+	StorageRead,
+	StorageWrite,
+	StorageReadWrite,
+	ColorAttachment,
+	DepthAttachment,
+	// Depth test without writes, or depth sampled in fragment shaders
+	DepthRead,
+	Present
+};
+
+/** @brief Stages, accesses and layout of a use of an image, in the terms of the synchronization2 structures */
+struct ImageUse {
+	VkPipelineStageFlags2 stageMask{ VK_PIPELINE_STAGE_2_NONE };
+	VkAccessFlags2 accessMask{ VK_ACCESS_2_NONE };
+	VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+};
 
+/**
+ * Image with memory from the device's allocator
+ * Tracks the layout and the last accesses of each subresource (mip level and array layer), so transitions can be requested by their intended use
+ * Barriers are only added where the requested use needs one (e.g. reads after reads in the same layout don't), and are batched in the command buffer until it flushes them
+ * Changes outside of transition (e.g. by the render graph or a render pass) need to be reported with setUse, as tracking assumes commands are executed in the order they were recorded
+ */
 class Image : public DeviceResource {
 private:
-	VkDeviceMemory memory{ VK_NULL_HANDLE };
+	MemoryAllocation allocation{};
+	// Same state as the render graph tracks for its resources
+	struct SubresourceState {
+		VkPipelineStageFlags2 writeStageMask{ VK_PIPELINE_STAGE_2_NONE };
+		VkAccessFlags2 writeAccessMask{ VK_ACCESS_2_NONE };
+		// Stages that read the subresource since the last write
+		VkPipelineStageFlags2 readStageMask{ VK_PIPELINE_STAGE_2_NONE };
+		// Stages and accesses the last write has been made visible to
+		VkPipelineStageFlags2 visibleStageMask{ VK_PIPELINE_STAGE_2_NONE };
+		VkAccessFlags2 visibleAccessMask{ VK_ACCESS_2_NONE };
+		VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		bool operator==(const SubresourceState& other) const = default;
+	};
+	// Indexed by mip level * array layers + array layer
+	std::vector<SubresourceState> states;
+
+	static constexpr VkAccessFlags2 writeAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+	uint32_t resolveLevelCount(const VkImageSubresourceRange& range) const {
+		return (range.levelCount == VK_REMAINING_MIP_LEVELS) ? mipLevels - range.baseMipLevel : range.levelCount;
+	}
+
+	uint32_t resolveLayerCount(const VkImageSubresourceRange& range) const {
+		return (range.layerCount == VK_REMAINING_ARRAY_LAYERS) ? arrayLayers - range.baseArrayLayer : range.layerCount;
+	}
+
+	// Barrier needed to go from the state to the use, returns false if none is needed
+	static bool getBarrier(const SubresourceState& state, const ImageUse& use, bool discard, VkImageMemoryBarrier2& barrier) {
+		const bool write = (use.accessMask & writeAccessMask) != 0;
+		const VkImageLayout oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+		const bool layoutChange = discard || (oldLayout != use.layout);
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = use.layout;
+		barrier.dstStageMask = use.stageMask;
+		barrier.dstAccessMask = use.accessMask;
+		if (write || layoutChange) {
+			// Write after write and write after read hazards, layout transitions count as writes
+			barrier.srcStageMask = state.writeStageMask | state.readStageMask;
+			barrier.srcAccessMask = state.writeAccessMask;
+			return layoutChange || (barrier.srcStageMask != VK_PIPELINE_STAGE_2_NONE);
+		}
+		if (state.writeStageMask != VK_PIPELINE_STAGE_2_NONE) {
+			// Read after write, only needed if the write hasn't been made visible to this use yet
+			barrier.srcStageMask = state.writeStageMask;
+			barrier.srcAccessMask = state.writeAccessMask;
+			return (use.stageMask & ~state.visibleStageMask) || (use.accessMask & ~state.visibleAccessMask);
+		}
+		return false;
+	}
+
+	static void applyUse(SubresourceState& state, const ImageUse& use, bool barrier, bool discard) {
+		const bool write = (use.accessMask & writeAccessMask) != 0;
+		if (write || discard || (state.layout != use.layout)) {
+			state.writeStageMask = use.stageMask;
+			state.writeAccessMask = use.accessMask & writeAccessMask;
+			state.readStageMask = write ? VK_PIPELINE_STAGE_2_NONE : use.stageMask;
+			state.visibleStageMask = use.stageMask;
+			state.visibleAccessMask = use.accessMask;
+		} else {
+			state.readStageMask |= use.stageMask;
+			if (barrier) {
+				state.visibleStageMask |= use.stageMask;
+				state.visibleAccessMask |= use.accessMask;
+			}
+		}
+		state.layout = use.layout;
+	}
 public:
 	VkImageType type;
 	VkFormat format;
-	VkImageLayout currentLayout;
 	VkExtent3D extent;
 	uint32_t mipLevels;
 	uint32_t arrayLayers;
@@ -63,29 +159,24 @@ public:
 		VK_CHECK_RESULT(vkCreateImage(VulkanContext::device->logicalDevice, &CI, nullptr, &handle));
 		VkMemoryRequirements memReqs;
 		vkGetImageMemoryRequirements(VulkanContext::device->logicalDevice, handle, &memReqs);
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(VulkanContext::device->logicalDevice, &memAlloc, nullptr, &memory));
-		VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, handle, memory, 0));
+		const uint32_t memoryTypeIndex = VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, createInfo.memoryPropertyFlags);
+		allocation = VulkanContext::device->memoryAllocator->allocate(memReqs, memoryTypeIndex, createInfo.tiling == VK_IMAGE_TILING_LINEAR, createInfo.dedicatedAllocation);
+		VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, handle, allocation.memory, allocation.offset));
 		// Keep some values for tracking and making dependent resource creation easier (e.g. views)
 		type = createInfo.type;
 		format = createInfo.format;
-		currentLayout = createInfo.initialLayout;
 		extent = createInfo.extent;
 		mipLevels = createInfo.mipLevels;
 		arrayLayers = createInfo.arrayLayers;
+		states.resize(static_cast<size_t>(mipLevels) * arrayLayers, { .layout = createInfo.initialLayout });
 		setDebugName((uint64_t)handle, VK_OBJECT_TYPE_IMAGE);
-		setDebugName((uint64_t)memory, VK_OBJECT_TYPE_DEVICE_MEMORY);
 	}
 
 	~Image() {
 		if (handle != VK_NULL_HANDLE) {
 			vkDestroyImage(VulkanContext::device->logicalDevice, handle, nullptr);
 		}
-		if (memory != VK_NULL_HANDLE) {
-			vkFreeMemory(VulkanContext::device->logicalDevice, memory, nullptr);
-		}
+		VulkanContext::device->memoryAllocator->free(allocation);
 	}
 
 	operator VkImage() const {
@@ -102,74 +193,140 @@ public:
 		};
 	}
 
-	void transition(CommandBuffer* cb, ImageUseCase useCase, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask) {
-		VkImageMemoryBarrier barrier{};
-		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		barrier.image = handle;
-		barrier.subresourceRange = subresourceRange();
+	// Aspects of the whole image, derived from the format
+	VkImageAspectFlags getAspectMask() const {
+		switch (format) {
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		case VK_FORMAT_S8_UINT:
+			return VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+	}
 
-		VkImageLayout newLayout;
+	static ImageUse getUse(ImageUseCase useCase) {
 		switch (useCase) {
-		case(ImageUseCase::TransferDestination):
-			newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			break;
-		case (ImageUseCase::ShaderRead):
-			newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			break;
+		case ImageUseCase::TransferSource:
+			return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+		case ImageUseCase::TransferDestination:
+			return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+		case ImageUseCase::ShaderRead:
+			return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		case ImageUseCase::StorageRead:
+			return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		case ImageUseCase::StorageWrite:
+			return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		case ImageUseCase::StorageReadWrite:
+			return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		case ImageUseCase::ColorAttachment:
+			return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		case ImageUseCase::DepthAttachment:
+			return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+		case ImageUseCase::DepthRead:
+			return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+		case ImageUseCase::Present:
+			// Presentation engine accesses are made visible by the semaphore, not the barrier
+			return { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
 		}
+		return {};
+	}
 
-		switch (currentLayout) {
-		case VK_IMAGE_LAYOUT_UNDEFINED:
-			barrier.srcAccessMask = 0;
-			break;
-		case VK_IMAGE_LAYOUT_PREINITIALIZED:
-			barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-			break;
-		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
-			barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			break;
-		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
-			barrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-			break;
-		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
-			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-			break;
-		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			break;
-		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-			barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			break;
-		}
+	// Layout of a single subresource as of the last recorded transition
+	VkImageLayout getLayout(uint32_t mipLevel = 0, uint32_t arrayLayer = 0) const {
+		return states[static_cast<size_t>(mipLevel) * arrayLayers + arrayLayer].layout;
+	}
 
-		switch (newLayout) {
-		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			break;
-		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
-			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-			break;
-		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
-			barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			break;
-		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
-			barrier.dstAccessMask = barrier.dstAccessMask | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-			break;
-		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-			if (barrier.srcAccessMask == 0) {
-				barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	/**
+	* Adds the barriers needed before the range is used as requested to the command buffer, subresources already in a matching state don't get one
+	* Subresources of the range in the same state share a barrier, so transitioning a whole image adds a single barrier unless its levels or layers diverged
+	*
+	* @param use Stages, accesses and layout of the upcoming use
+	* @param range Subresources that will be used, VK_REMAINING_* counts are supported
+	* @param discard Contents don't need to be preserved, transitions from the undefined layout
+	*/
+	void transition(CommandBuffer* cb, const ImageUse& use, const VkImageSubresourceRange& range, bool discard = false) {
+		const uint32_t levelCount = resolveLevelCount(range);
+		const uint32_t layerCount = resolveLayerCount(range);
+		// Runs of consecutive layers in the same state are merged per level, and levels with the same runs into one barrier
+		struct Run {
+			uint32_t baseLevel;
+			uint32_t levelCount;
+			uint32_t baseLayer;
+			uint32_t layerCount;
+			SubresourceState state;
+		};
+		std::vector<Run> runs;
+		size_t previousLevelRuns = 0;
+		for (uint32_t level = range.baseMipLevel; level < range.baseMipLevel + levelCount; level++) {
+			const size_t levelStart = runs.size();
+			for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + layerCount; layer++) {
+				const SubresourceState& state = states[static_cast<size_t>(level) * arrayLayers + layer];
+				if ((runs.size() > levelStart) && (runs.back().state == state)) {
+					runs.back().layerCount++;
+				} else {
+					runs.push_back({ level, 1, layer, 1, state });
+				}
 			}
-			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			break;
+			// Extend the runs of the previous level if this level's runs match them
+			const size_t levelRuns = runs.size() - levelStart;
+			if ((level > range.baseMipLevel) && (levelRuns == previousLevelRuns)) {
+				const size_t previousStart = levelStart - previousLevelRuns;
+				bool match = true;
+				for (size_t i = 0; i < levelRuns && match; i++) {
+					const Run& a = runs[previousStart + i];
+					const Run& b = runs[levelStart + i];
+					match = (a.baseLayer == b.baseLayer) && (a.layerCount == b.layerCount) && (a.state == b.state);
+				}
+				if (match) {
+					for (size_t i = 0; i < levelRuns; i++) {
+						runs[previousStart + i].levelCount++;
+					}
+					runs.resize(levelStart);
+					continue;
+				}
+			}
+			previousLevelRuns = levelRuns;
 		}
+		for (const Run& run : runs) {
+			VkImageMemoryBarrier2 barrier{};
+			const bool needed = getBarrier(run.state, use, discard, barrier);
+			if (needed) {
+				cb->addImageBarrier(handle, barrier.srcStageMask, barrier.srcAccessMask, barrier.dstStageMask, barrier.dstAccessMask, barrier.oldLayout, barrier.newLayout, { range.aspectMask, run.baseLevel, run.levelCount, run.baseLayer, run.layerCount });
+			}
+			for (uint32_t level = run.baseLevel; level < run.baseLevel + run.levelCount; level++) {
+				for (uint32_t layer = run.baseLayer; layer < run.baseLayer + run.layerCount; layer++) {
+					applyUse(states[static_cast<size_t>(level) * arrayLayers + layer], use, needed, discard);
+				}
+			}
+		}
+	}
 
-		barrier.oldLayout = currentLayout;
-		barrier.newLayout = newLayout;
-
-		cb->insertImageMemoryBarrier(barrier, srcStageMask, dstStageMask);
+	void transition(CommandBuffer* cb, ImageUseCase useCase, bool discard = false) {
+		transition(cb, getUse(useCase), subresourceRange(getAspectMask()), discard);
+	}
 
-		currentLayout = newLayout;
+	void transition(CommandBuffer* cb, ImageUseCase useCase, const VkImageSubresourceRange& range, bool discard = false) {
+		transition(cb, getUse(useCase), range, discard);
+	}
 
+	/** @brief Updates the tracked state for accesses that were synchronized outside of transition (e.g. by the render graph or a semaphore), without adding a barrier */
+	void setUse(const ImageUse& use, const VkImageSubresourceRange& range) {
+		const uint32_t levelCount = resolveLevelCount(range);
+		const uint32_t layerCount = resolveLayerCount(range);
+		for (uint32_t level = range.baseMipLevel; level < range.baseMipLevel + levelCount; level++) {
+			for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + layerCount; layer++) {
+				SubresourceState& state = states[static_cast<size_t>(level) * arrayLayers + layer];
+				state = {};
+				applyUse(state, use, true, true);
+			}
+		}
 	}
 
 };
\ No newline at end of file
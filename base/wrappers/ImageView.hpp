@@ -51,6 +51,17 @@ public:
 		VK_CHECK_RESULT(vkCreateImageView(VulkanContext::device->logicalDevice, &CI, nullptr, &handle));
 	}
 
+	/** @brief Creates a view for a subset of the image, e.g. a single mip level, a single layer of a 2D array image is viewed as a 2D image */
+	ImageView(Image* image, VkImageSubresourceRange subresourceRange) {
+		VkImageViewCreateInfo CI{};
+		CI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		CI.viewType = ((image->type == VK_IMAGE_TYPE_2D) && (subresourceRange.layerCount == 1)) ? VK_IMAGE_VIEW_TYPE_2D : viewTypeFromImage(image);
+		CI.format = image->format;
+		CI.subresourceRange = subresourceRange;
+		CI.image = image->handle;
+		VK_CHECK_RESULT(vkCreateImageView(VulkanContext::device->logicalDevice, &CI, nullptr, &handle));
+	}
+
 	~ImageView() {
 		vkDestroyImageView(VulkanContext::device->logicalDevice, handle, nullptr);
 	}
@@ -0,0 +1,512 @@
+/*
+ * Vulkan device memory sub-allocator
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <iostream>
+#include <assert.h>
+#include "volk.h"
+#include "VulkanTools.h"
+#include "MemoryStats.h"
+
+/** @brief Range of device memory handed out by the MemoryAllocator */
+struct MemoryAllocation {
+	VkDeviceMemory memory{ VK_NULL_HANDLE };
+	// Start of the allocation inside memory, resources need to be bound at this offset
+	VkDeviceSize offset{ 0 };
+	VkDeviceSize size{ 0 };
+	// Host address of the allocation start, only set for host visible memory types
+	void* mapped{ nullptr };
+	uint32_t memoryTypeIndex{ 0 };
+	// Subsystem the allocation is accounted to in memoryStats
+	MemoryCategory category{ MemoryCategory::Other };
+	// Owning block, null for dedicated allocations
+	void* block{ nullptr };
+};
+
+/**
+ * Allocates large blocks of device memory per memory type and places resources inside them
+ * Free ranges of each block are kept in a free list ordered by offset (for merging neighbours on free) and by size (for best fit placement)
+ * Linear resources (buffers, linear images) and optimal tiled images live in separate blocks, so bufferImageGranularity never has to be taken into account
+ * Host visible blocks are mapped once at creation and stay mapped, as a VkDeviceMemory can only be mapped once at any time
+ */
+class MemoryAllocator {
+private:
+	struct Block {
+		VkDeviceMemory memory{ VK_NULL_HANDLE };
+		VkDeviceSize size{ 0 };
+		void* mapped{ nullptr };
+		uint32_t poolIndex{ 0 };
+		uint32_t allocationCount{ 0 };
+		// Bytes of all allocations placed in the block
+		VkDeviceSize usedSize{ 0 };
+		// Free ranges as offset -> size
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+		// Free ranges as size -> offset
+		std::multimap<VkDeviceSize, VkDeviceSize> freeRangesBySize;
+	};
+
+	struct Pool {
+		std::vector<std::unique_ptr<Block>> blocks;
+	};
+
+	VkDevice device{ VK_NULL_HANDLE };
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	VkDeviceSize nonCoherentAtomSize{ 1 };
+	// Set if buffer device addresses are enabled, memory then needs to be allocated with the device address flag
+	bool deviceAddress{ false };
+	// Two pools per memory type, one for linear and one for optimal tiled resources
+	std::array<Pool, VK_MAX_MEMORY_TYPES * 2> pools{};
+	uint32_t deviceMemoryCount{ 0 };
+	// Bytes of all VkDeviceMemory objects (including unused parts of blocks) per heap
+	std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapUsage{};
+	// Allocations placed in another heap than requested, as the requested one was exhausted
+	uint32_t fallbackCount{ 0 };
+	// Block that's being emptied by defragmentation, new allocations aren't placed in it and it's freed once its last allocation is
+	Block* evacuatingBlock{ nullptr };
+	uint32_t evacuatedBlockCount{ 0 };
+	std::mutex mutex;
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	bool isHostVisible(uint32_t memoryTypeIndex) const
+	{
+		return (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+	}
+
+	bool isNonCoherent(uint32_t memoryTypeIndex) const
+	{
+		const VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+		return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+
+	// Smaller heaps (e.g. the 256 MB host visible device local heap on some GPUs) get smaller blocks so a single block can't exhaust them
+	VkDeviceSize getBlockSize(uint32_t memoryTypeIndex) const
+	{
+		const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+		return std::min(defaultBlockSize, alignUp(heapSize / 8, 1024 * 1024));
+	}
+
+	VkResult allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, VkDeviceMemory& memory, void*& mapped)
+	{
+		// Blocks are shared by all kinds of buffers, so every allocation can back buffers that use device addresses
+		VkMemoryAllocateFlagsInfo allocFlags{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+			.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+		};
+		VkMemoryAllocateInfo memAlloc{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext = deviceAddress ? &allocFlags : nullptr,
+			.allocationSize = size,
+			.memoryTypeIndex = memoryTypeIndex
+		};
+		VkResult result = vkAllocateMemory(device, &memAlloc, nullptr, &memory);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+		if (isHostVisible(memoryTypeIndex)) {
+			VK_CHECK_RESULT(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+		}
+		deviceMemoryCount++;
+		heapUsage[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += size;
+		return VK_SUCCESS;
+	}
+
+	void freeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex)
+	{
+		// Freeing implicitly unmaps the memory
+		vkFreeMemory(device, memory, nullptr);
+		deviceMemoryCount--;
+		heapUsage[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] -= size;
+	}
+
+	void insertFreeRange(Block* block, VkDeviceSize offset, VkDeviceSize size)
+	{
+		block->freeRanges[offset] = size;
+		block->freeRangesBySize.insert({ size, offset });
+	}
+
+	void removeFreeRange(Block* block, std::map<VkDeviceSize, VkDeviceSize>::iterator range)
+	{
+		auto [first, last] = block->freeRangesBySize.equal_range(range->second);
+		for (auto it = first; it != last; it++) {
+			if (it->second == range->first) {
+				block->freeRangesBySize.erase(it);
+				break;
+			}
+		}
+		block->freeRanges.erase(range);
+	}
+
+	// Best fit search, returns false if the block has no free range that can hold the aligned allocation
+	bool allocateFromBlock(Block* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+	{
+		for (auto it = block->freeRangesBySize.lower_bound(size); it != block->freeRangesBySize.end(); it++) {
+			const VkDeviceSize rangeOffset = it->second;
+			const VkDeviceSize rangeSize = it->first;
+			const VkDeviceSize alignedOffset = alignUp(rangeOffset, alignment);
+			if (alignedOffset + size > rangeOffset + rangeSize) {
+				continue;
+			}
+			removeFreeRange(block, block->freeRanges.find(rangeOffset));
+			// Padding in front of the allocation and the remainder behind it stay free
+			if (alignedOffset > rangeOffset) {
+				insertFreeRange(block, rangeOffset, alignedOffset - rangeOffset);
+			}
+			if (alignedOffset + size < rangeOffset + rangeSize) {
+				insertFreeRange(block, alignedOffset + size, rangeOffset + rangeSize - alignedOffset - size);
+			}
+			offset = alignedOffset;
+			return true;
+		}
+		return false;
+	}
+
+	// One of the resource's supported memory types in another heap that provides at least the requested host access, UINT32_MAX if there is none
+	// E.g. system memory for a device local resource on a discrete GPU, which is slower to access but keeps the application running
+	uint32_t getFallbackMemoryType(uint32_t memoryTypeBits, uint32_t memoryTypeIndex) const
+	{
+		const VkMemoryType& requested = memoryProperties.memoryTypes[memoryTypeIndex];
+		const VkMemoryPropertyFlags hostAccess = requested.propertyFlags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+			const VkMemoryType& candidate = memoryProperties.memoryTypes[i];
+			if ((memoryTypeBits & (1u << i)) && (candidate.heapIndex != requested.heapIndex) && ((candidate.propertyFlags & hostAccess) == hostAccess)) {
+				return i;
+			}
+		}
+		return UINT32_MAX;
+	}
+
+	// The mutex needs to be locked by the caller
+	VkResult allocateFromType(const VkMemoryRequirements& memoryRequirements, uint32_t memoryTypeIndex, bool linear, bool dedicated, MemoryAllocation& allocation)
+	{
+		allocation = {};
+		allocation.memoryTypeIndex = memoryTypeIndex;
+		allocation.category = MemoryStats::getCurrentCategory();
+
+		VkDeviceSize size = memoryRequirements.size;
+		VkDeviceSize alignment = std::max(memoryRequirements.alignment, VkDeviceSize(1));
+		// Keeps flushes and invalidations of non-coherent memory from touching neighbouring allocations
+		if (isNonCoherent(memoryTypeIndex)) {
+			alignment = alignUp(alignment, nonCoherentAtomSize);
+			size = alignUp(size, nonCoherentAtomSize);
+		}
+
+		const VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+		if (dedicated || size > blockSize / 2) {
+			const VkResult result = allocateDeviceMemory(memoryRequirements.size, memoryTypeIndex, allocation.memory, allocation.mapped);
+			if (result != VK_SUCCESS) {
+				return result;
+			}
+			allocation.size = memoryRequirements.size;
+			memoryStats.addDevice(allocation.category, static_cast<int64_t>(allocation.size));
+			return VK_SUCCESS;
+		}
+
+		const uint32_t poolIndex = memoryTypeIndex * 2 + (linear ? 0 : 1);
+		Pool& pool = pools[poolIndex];
+		Block* target = nullptr;
+		VkDeviceSize offset = 0;
+		for (auto& block : pool.blocks) {
+			if ((block.get() != evacuatingBlock) && allocateFromBlock(block.get(), size, alignment, offset)) {
+				target = block.get();
+				break;
+			}
+		}
+
+		if (!target) {
+			auto block = std::make_unique<Block>();
+			block->poolIndex = poolIndex;
+			// Retry with smaller blocks if the heap is running low
+			VkDeviceSize newBlockSize = blockSize;
+			VkResult result = allocateDeviceMemory(newBlockSize, memoryTypeIndex, block->memory, block->mapped);
+			while (result != VK_SUCCESS && newBlockSize / 2 >= size) {
+				newBlockSize /= 2;
+				result = allocateDeviceMemory(newBlockSize, memoryTypeIndex, block->memory, block->mapped);
+			}
+			if (result != VK_SUCCESS) {
+				return result;
+			}
+			block->size = newBlockSize;
+			insertFreeRange(block.get(), 0, newBlockSize);
+			target = block.get();
+			pool.blocks.push_back(std::move(block));
+			const bool allocated = allocateFromBlock(target, size, alignment, offset);
+			assert(allocated);
+		}
+
+		target->allocationCount++;
+		target->usedSize += size;
+		allocation.memory = target->memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.block = target;
+		if (target->mapped) {
+			allocation.mapped = static_cast<uint8_t*>(target->mapped) + offset;
+		}
+		memoryStats.addDevice(allocation.category, static_cast<int64_t>(allocation.size));
+		return VK_SUCCESS;
+	}
+
+	void freeToBlock(Block* block, VkDeviceSize offset, VkDeviceSize size)
+	{
+		// Merge with the adjacent free ranges
+		auto next = block->freeRanges.lower_bound(offset);
+		if (next != block->freeRanges.end() && next->first == offset + size) {
+			size += next->second;
+			removeFreeRange(block, next);
+		}
+		next = block->freeRanges.lower_bound(offset);
+		if (next != block->freeRanges.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset) {
+				offset = prev->first;
+				size += prev->second;
+				removeFreeRange(block, prev);
+			}
+		}
+		insertFreeRange(block, offset, size);
+	}
+
+public:
+	/** @brief Default size for new blocks, allocations larger than half of this get their own memory */
+	static constexpr VkDeviceSize defaultBlockSize = 256 * 1024 * 1024;
+
+	MemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits, bool deviceAddress = false) : device(device), memoryProperties(memoryProperties), deviceAddress(deviceAddress)
+	{
+		nonCoherentAtomSize = std::max(limits.nonCoherentAtomSize, VkDeviceSize(1));
+	}
+
+	~MemoryAllocator()
+	{
+		for (auto& pool : pools) {
+			for (auto& block : pool.blocks) {
+				if (block->allocationCount > 0) {
+					std::cerr << "Memory block destroyed with " << block->allocationCount << " allocations still in use\n";
+				}
+				vkFreeMemory(device, block->memory, nullptr);
+			}
+		}
+	}
+
+	/**
+	* Allocate device memory for a resource
+	*
+	* @param memoryRequirements Size, alignment and supported memory types of the resource
+	* @param memoryTypeIndex Memory type to allocate from
+	* @param linear True for buffers and linear tiled images, false for optimal tiled images
+	* @param dedicated (Optional) Allocate a separate VkDeviceMemory for this resource instead of placing it into a shared block
+	* @note The allocation is accounted to the calling thread's current MemoryStats category
+	* @note If the memory type's heap is exhausted, the memory comes from a supported type of another heap with the same host access (see allocation.memoryTypeIndex)
+	*
+	* @return The allocation, resources need to be bound to allocation.memory at allocation.offset
+	*/
+	MemoryAllocation allocate(const VkMemoryRequirements& memoryRequirements, uint32_t memoryTypeIndex, bool linear, bool dedicated = false)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		MemoryAllocation allocation{};
+		VkResult result = allocateFromType(memoryRequirements, memoryTypeIndex, linear, dedicated, allocation);
+		if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+			const uint32_t fallbackType = getFallbackMemoryType(memoryRequirements.memoryTypeBits, memoryTypeIndex);
+			if (fallbackType != UINT32_MAX) {
+				result = allocateFromType(memoryRequirements, fallbackType, linear, dedicated, allocation);
+				if ((result == VK_SUCCESS) && (fallbackCount++ == 0)) {
+					std::cerr << "Memory heap " << memoryProperties.memoryTypes[memoryTypeIndex].heapIndex << " is exhausted, allocating from heap " << memoryProperties.memoryTypes[fallbackType].heapIndex << " instead\n";
+				}
+			}
+		}
+		VK_CHECK_RESULT(result);
+		return allocation;
+	}
+
+	/** @brief Return an allocation to its block, the resources bound to it must have been destroyed */
+	void free(MemoryAllocation& allocation)
+	{
+		if (allocation.memory == VK_NULL_HANDLE) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		memoryStats.addDevice(allocation.category, -static_cast<int64_t>(allocation.size));
+		if (!allocation.block) {
+			freeDeviceMemory(allocation.memory, allocation.size, allocation.memoryTypeIndex);
+		} else {
+			Block* block = static_cast<Block*>(allocation.block);
+			freeToBlock(block, allocation.offset, allocation.size);
+			block->allocationCount--;
+			block->usedSize -= allocation.size;
+			if (block->allocationCount == 0) {
+				// Keep one empty block per pool around, so allocating and freeing in a loop doesn't hit vkAllocateMemory every time
+				// Evacuated blocks are always released, as giving back their memory is the point of emptying them
+				Pool& pool = pools[block->poolIndex];
+				const size_t emptyBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const std::unique_ptr<Block>& b) { return b->allocationCount == 0; });
+				const bool evacuated = (block == evacuatingBlock);
+				if (evacuated) {
+					evacuatingBlock = nullptr;
+					evacuatedBlockCount++;
+				}
+				if ((emptyBlocks > 1) || evacuated) {
+					freeDeviceMemory(block->memory, block->size, block->poolIndex / 2);
+					pool.blocks.erase(std::find_if(pool.blocks.begin(), pool.blocks.end(), [block](const std::unique_ptr<Block>& b) { return b.get() == block; }));
+				}
+			}
+		}
+		allocation = {};
+	}
+
+	/**
+	* Get the memory range for flushing or invalidating part of an allocation
+	*
+	* @param allocation Allocation the range is relative to
+	* @param size Size of the range, VK_WHOLE_SIZE covers the rest of the allocation
+	* @param offset Offset of the range relative to the start of the allocation
+	*
+	* @return Mapped memory range with offset and size aligned to nonCoherentAtomSize
+	*/
+	VkMappedMemoryRange getMappedRange(const MemoryAllocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const
+	{
+		if (size == VK_WHOLE_SIZE) {
+			size = allocation.size - offset;
+		}
+		const VkDeviceSize start = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+		VkDeviceSize end = alignUp(allocation.offset + offset + size, nonCoherentAtomSize);
+		VkMappedMemoryRange mappedRange{
+			.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+			.memory = allocation.memory,
+			.offset = start,
+			.size = end - start
+		};
+		// Dedicated allocations aren't padded to the atom size, but may always be flushed up to their end
+		if (end > allocation.offset + allocation.size) {
+			mappedRange.size = allocation.block ? allocation.offset + allocation.size - start : VK_WHOLE_SIZE;
+		}
+		return mappedRange;
+	}
+
+	VkResult flush(const MemoryAllocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
+	{
+		VkMappedMemoryRange mappedRange = getMappedRange(allocation, size, offset);
+		return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
+	}
+
+	VkResult invalidate(const MemoryAllocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
+	{
+		VkMappedMemoryRange mappedRange = getMappedRange(allocation, size, offset);
+		return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
+	}
+
+	bool isNonCoherent(const MemoryAllocation& allocation) const
+	{
+		return isNonCoherent(allocation.memoryTypeIndex);
+	}
+
+	/** @brief Number of VkDeviceMemory objects currently allocated (blocks and dedicated allocations) */
+	uint32_t getDeviceMemoryCount() const
+	{
+		return deviceMemoryCount;
+	}
+
+	/** @brief Number of allocations that didn't fit into the heap of their requested memory type and were placed in another one */
+	uint32_t getFallbackCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return fallbackCount;
+	}
+
+	/**
+	* Picks the least used block of the pools for buffers or images as the one to be emptied, new allocations are no longer placed in it and it's released once its last allocation has been freed
+	* Only blocks whose allocations fit into the free space of the other blocks of their pool are considered, so moving them doesn't need new blocks
+	*
+	* @param linear True to pick from the pools of buffers and linear images, false for optimal tiled images
+	* @param maxUsage Only blocks with less than this share of their size in use are considered
+	*
+	* @return The block, allocations with this as allocation.block need to be moved by their owners (e.g. with Texture::createCopy), null if no block qualifies
+	*/
+	void* beginEvacuation(bool linear, float maxUsage)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (evacuatingBlock) {
+			return evacuatingBlock;
+		}
+		float lowestUsage = maxUsage;
+		for (uint32_t poolIndex = linear ? 0 : 1; poolIndex < static_cast<uint32_t>(pools.size()); poolIndex += 2) {
+			const Pool& pool = pools[poolIndex];
+			if (pool.blocks.size() < 2) {
+				continue;
+			}
+			VkDeviceSize freeSize = 0;
+			for (const auto& block : pool.blocks) {
+				freeSize += block->size - block->usedSize;
+			}
+			for (const auto& block : pool.blocks) {
+				const float usage = static_cast<float>(block->usedSize) / static_cast<float>(block->size);
+				const VkDeviceSize otherFreeSize = freeSize - (block->size - block->usedSize);
+				// Free space is split into ranges and alignment isn't accounted for, so twice the block's allocations need to be free elsewhere
+				if ((block->allocationCount > 0) && (usage < lowestUsage) && (block->usedSize * 2 <= otherFreeSize)) {
+					lowestUsage = usage;
+					evacuatingBlock = block.get();
+				}
+			}
+		}
+		return evacuatingBlock;
+	}
+
+	/** @brief Lets new allocations be placed in the block that's being emptied again, e.g. if its remaining allocations can't be moved */
+	void cancelEvacuation()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		evacuatingBlock = nullptr;
+	}
+
+	/** @brief Block that's being emptied, null once it has been released or if no evacuation is in progress */
+	void* getEvacuatingBlock()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return evacuatingBlock;
+	}
+
+	/** @brief Number of blocks that have been emptied and released since startup */
+	uint32_t getEvacuatedBlockCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return evacuatedBlockCount;
+	}
+
+	/**
+	* Get the bytes all blocks occupy and the bytes of the allocations placed in them, the difference is lost to fragmentation (or kept for later allocations)
+	* Dedicated allocations aren't included
+	*/
+	void getBlockUsage(VkDeviceSize& blockSize, VkDeviceSize& usedSize)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		blockSize = 0;
+		usedSize = 0;
+		for (const Pool& pool : pools) {
+			for (const auto& block : pool.blocks) {
+				blockSize += block->size;
+				usedSize += block->usedSize;
+			}
+		}
+	}
+
+	/** @brief Bytes of device memory allocated from a heap by the allocator, including the unused parts of its blocks */
+	VkDeviceSize getHeapUsage(uint32_t heapIndex)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return heapUsage[heapIndex];
+	}
+};
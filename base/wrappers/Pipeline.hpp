@@ -9,8 +9,14 @@
 #pragma once
 
 #include <vector>
+#include <array>
+#include <map>
+#include <algorithm>
 #include "volk.h"
 #include <stdexcept>
+#include <exception>
+#include <future>
+#include <atomic>
 #if defined(__ANDROID__)
 #include "Android.h"
 #endif
@@ -19,9 +25,15 @@
 #include "Initializers.hpp"
 #include "VulkanTools.h"
 #include "PipelineLayout.hpp"
+#include "PipelineLibrary.hpp"
+#include "CacheKey.hpp"
 #include "dxc.hpp"
+#include "ShaderBundle.hpp"
+#include "JobSystem.hpp"
 
-enum class DynamicState { Viewport, Scissor };
+// Except for PolygonMode (which needs Device::hasDynamicPolygonMode and is static otherwise), these are core in Vulkan 1.3
+// FragmentShadingRate needs Device::hasFragmentShadingRate, pipelines are always shaded at full rate otherwise
+enum class DynamicState { Viewport, Scissor, DepthWriteEnable, DepthCompareOp, DepthTestEnable, CullMode, FrontFace, PrimitiveTopology, PolygonMode, FragmentShadingRate };
 
 struct PipelineVertexInput {
 	std::vector<VkVertexInputBindingDescription> bindings{};
@@ -33,9 +45,15 @@ struct PipelineCreateInfo {
 	const std::string name{ "" };
 	VkPipelineBindPoint bindPoint{ VK_PIPELINE_BIND_POINT_GRAPHICS };
 	std::vector<std::string> shaders{};
+	// Preprocessor defines (NAME or NAME=VALUE) passed to all shaders, so variants of a shader don't need separate files
+	std::vector<std::string> defines{};
+	// Specialization constant values by constant id, applied to all shader stages (ids a stage doesn't declare are ignored)
+	// Values are 32 bit, booleans need to be passed as VkBool32 and floats as their bit pattern
+	std::map<uint32_t, uint32_t> specializationConstants{};
 	VkPipelineCache cache{ VK_NULL_HANDLE };
 	VkPipelineLayout layout;
-	VkPipelineCreateFlags flags;
+	// E.g. VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT for pipelines with layouts for descriptor buffers
+	VkPipelineCreateFlags flags{ 0 };
 	PipelineVertexInput vertexInput{};
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState{};
 	VkPipelineTessellationStateCreateInfo tessellationState{};
@@ -49,51 +67,160 @@ struct PipelineCreateInfo {
 	std::vector<DynamicState> dynamicState{};
 	VkPipelineRenderingCreateInfo pipelineRenderingInfo{};
 	bool enableHotReload{ false };
+	// Shaders are taken from the global shader bundle if one is loaded and contains them, reloads always compile from source as the bundle holds the shaders as they were at build time
+	bool useShaderBundle{ true };
+	// If set and the device supports graphics pipeline libraries, the pipeline is linked from parts kept in this library instead of being created as a whole
+	PipelineLibrary* library{ nullptr };
 };
 
 class Pipeline : public DeviceResource {
 private:
 	VkPipeline handle{ VK_NULL_HANDLE };
-	std::vector<VkShaderModule> shaderModules{};
-	std::vector<VkPipelineShaderStageCreateInfo> shaderStages{};
+	// Result of a background reload, swapped in by applyReload
+	std::future<VkPipeline> pendingReload{};
+	// Set if the pending pipeline object is the optimized version of a pipeline that has been (fast) linked from a library
+	bool pendingOptimization{ false };
 
-	void addShader(const std::string filename) {
+	// Shader state is kept local to pipeline object creation, so a new pipeline object can be built on another thread while the current one is in use
+	struct ShaderState {
+		std::vector<VkShaderModule> shaderModules{};
+		std::vector<VkPipelineShaderStageCreateInfo> shaderStages{};
+		// Shared by all stages
+		std::vector<VkSpecializationMapEntry> specializationEntries{};
+		std::vector<uint32_t> specializationData{};
+		VkSpecializationInfo specializationInfo{};
+	};
+
+	// Returns false if bundleOnly is set and the shader isn't in the shader bundle, it's compiled otherwise
+	static bool addShader(const std::string filename, const std::vector<std::string>& defines, bool useShaderBundle, ShaderState& shaderState, bool bundleOnly = false) {
 		// @todo: also support GLSL? Or jut drop it? And what about Android?
 		try {
 			assert(dxcCompiler);
-			VkShaderModule shaderModule = dxcCompiler->compileShader(filename);
+			VkShaderModule shaderModule = (useShaderBundle && shaderBundle) ? shaderBundle->createShaderModule(filename, defines) : VK_NULL_HANDLE;
+			if (shaderModule == VK_NULL_HANDLE) {
+				if (bundleOnly) {
+					return false;
+				}
+				shaderModule = dxcCompiler->compileShader(filename, defines);
+			}
 			VkShaderStageFlagBits shaderStage = dxcCompiler->getShaderStage(filename);
-			shaderModules.push_back(shaderModule);
+			shaderState.shaderModules.push_back(shaderModule);
 			VkPipelineShaderStageCreateInfo shaderStageCI{};
 			shaderStageCI.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 			shaderStageCI.stage = shaderStage;
 			shaderStageCI.module = shaderModule;
 			shaderStageCI.pName = "main";
-			shaderStages.push_back(shaderStageCI);
+			shaderStageCI.pSpecializationInfo = shaderState.specializationEntries.empty() ? nullptr : &shaderState.specializationInfo;
+			shaderState.shaderStages.push_back(shaderStageCI);
+			return true;
 		} catch (...) {
 			throw;
 		}
 	}
 	
-	void createPipelineObject(PipelineCreateInfo createInfo) {
-		shaderStages.clear();
-		shaderModules.clear();
+	// Compiles the shaders with the create info's defines and specialization constants, shader modules need to be destroyed once the pipeline object has been created
+	// With bundleOnly, nothing is compiled and false is returned (with no shader modules left) if any of the shaders isn't in the shader bundle
+	static bool compileShaders(const PipelineCreateInfo& createInfo, const std::vector<std::string>& filenames, ShaderState& shaderState, bool bundleOnly = false) {
+		for (const auto& [constantID, value] : createInfo.specializationConstants) {
+			shaderState.specializationEntries.push_back({ .constantID = constantID, .offset = static_cast<uint32_t>(shaderState.specializationData.size() * sizeof(uint32_t)), .size = sizeof(uint32_t) });
+			shaderState.specializationData.push_back(value);
+		}
+		shaderState.specializationInfo = {
+			.mapEntryCount = static_cast<uint32_t>(shaderState.specializationEntries.size()),
+			.pMapEntries = shaderState.specializationEntries.data(),
+			.dataSize = shaderState.specializationData.size() * sizeof(uint32_t),
+			.pData = shaderState.specializationData.data()
+		};
 		try {
-			for (auto& filename : createInfo.shaders) {
-				addShader(filename);
+			for (auto& filename : filenames) {
+				if (!addShader(filename, createInfo.defines, createInfo.useShaderBundle, shaderState, bundleOnly)) {
+					destroyShaderModules(shaderState);
+					return false;
+				}
 			}
 		}
 		catch (...) {
+			destroyShaderModules(shaderState);
 			throw;
 		}
+		return true;
+	}
+
+	static void destroyShaderModules(ShaderState& shaderState) {
+		for (auto& shaderModule : shaderState.shaderModules) {
+			vkDestroyShaderModule(VulkanContext::device->logicalDevice, shaderModule, nullptr);
+		}
+		shaderState.shaderModules.clear();
+	}
+
+	static bool isMeshShadingStage(VkShaderStageFlagBits stage) {
+		return stage == VK_SHADER_STAGE_TASK_BIT_EXT || stage == VK_SHADER_STAGE_MESH_BIT_EXT;
+	}
+
+	static bool usesLibrary(const PipelineCreateInfo& createInfo) {
+		if (!createInfo.library || !VulkanContext::device->hasGraphicsPipelineLibrary || createInfo.bindPoint != VK_PIPELINE_BIND_POINT_GRAPHICS) {
+			return false;
+		}
+		// Mesh shading pipelines are always created as a whole
+		return std::none_of(createInfo.shaders.begin(), createInfo.shaders.end(), [](const std::string& filename) { return isMeshShadingStage(dxcCompiler->getShaderStage(filename)); });
+	}
+
+	/**
+	* Creates a pipeline object from the create info
+	*
+	* @param createInfo Pipeline create info
+	* @param linkTimeOptimization Only used for pipelines linked from a library: If false, the parts are linked as fast as possible, if true the pipeline is optimized across the parts, which takes longer but results in a faster pipeline
+	*/
+	static VkPipeline createPipelineObject(PipelineCreateInfo createInfo, bool linkTimeOptimization = false) {
+		if (usesLibrary(createInfo)) {
+			return createLinkedPipelineObject(createInfo, linkTimeOptimization);
+		}
+
+		ShaderState shaderState{};
+		compileShaders(createInfo, createInfo.shaders, shaderState);
 
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		if (createInfo.bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
+			pipeline = createComputePipelineObject(createInfo, shaderState);
+		} else {
+			pipeline = createGraphicsPipelineObject(createInfo, shaderState);
+		}
+	
+		// Shader modules can be safely destroyed after pipeline creation
+		destroyShaderModules(shaderState);
+
+		return pipeline;
+	}
+
+	static VkPipeline createComputePipelineObject(PipelineCreateInfo& createInfo, ShaderState& shaderState) {
+		// Compute pipelines consist of a single shader stage and none of the fixed function state
+		assert(shaderState.shaderStages.size() == 1);
+		VkComputePipelineCreateInfo pipelineCI{};
+		pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineCI.flags = createInfo.flags;
+		pipelineCI.stage = shaderState.shaderStages[0];
+		pipelineCI.layout = createInfo.layout;
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		const VkResult result = vkCreateComputePipelines(VulkanContext::device->logicalDevice, createInfo.cache, 1, &pipelineCI, nullptr, &pipeline);
+		// Only returned for pipelines created with VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT that aren't in the pipeline cache
+		if (result == VK_PIPELINE_COMPILE_REQUIRED) {
+			return VK_NULL_HANDLE;
+		}
+		VK_CHECK_RESULT(result);
+		return pipeline;
+	}
+
+	static void setStateTypes(PipelineCreateInfo& createInfo) {
 		createInfo.inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		createInfo.tessellationState.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
 		createInfo.viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		createInfo.rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 		createInfo.multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 		createInfo.depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 		createInfo.pipelineRenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+	}
 
+	static std::vector<VkDynamicState> getDynamicStates(const PipelineCreateInfo& createInfo) {
 		std::vector<VkDynamicState> dstates{};
 		for (auto& s : createInfo.dynamicState) {
 			switch (s) {
@@ -103,32 +230,76 @@ private:
 			case DynamicState::Viewport:
 				dstates.push_back(VK_DYNAMIC_STATE_VIEWPORT);
 				break;
+			case DynamicState::DepthWriteEnable:
+				dstates.push_back(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE);
+				break;
+			case DynamicState::DepthCompareOp:
+				dstates.push_back(VK_DYNAMIC_STATE_DEPTH_COMPARE_OP);
+				break;
+			case DynamicState::DepthTestEnable:
+				dstates.push_back(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE);
+				break;
+			case DynamicState::CullMode:
+				dstates.push_back(VK_DYNAMIC_STATE_CULL_MODE);
+				break;
+			case DynamicState::FrontFace:
+				dstates.push_back(VK_DYNAMIC_STATE_FRONT_FACE);
+				break;
+			case DynamicState::PrimitiveTopology:
+				dstates.push_back(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY);
+				break;
+			case DynamicState::PolygonMode:
+				if (VulkanContext::device->hasDynamicPolygonMode) {
+					dstates.push_back(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+				}
+				break;
+			case DynamicState::FragmentShadingRate:
+				if (VulkanContext::device->hasFragmentShadingRate) {
+					dstates.push_back(VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR);
+				}
+				break;
 			}
 		}
-		VkPipelineDynamicStateCreateInfo dynamicState{};
-		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicState.dynamicStateCount = (uint32_t)dstates.size();
-		dynamicState.pDynamicStates = dstates.data();
+		return dstates;
+	}
 
+	static VkPipelineVertexInputStateCreateInfo getVertexInputState(const PipelineCreateInfo& createInfo) {
 		VkPipelineVertexInputStateCreateInfo vertexInputState{};
 		vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 		vertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(createInfo.vertexInput.bindings.size());
 		vertexInputState.pVertexBindingDescriptions = createInfo.vertexInput.bindings.data();
 		vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(createInfo.vertexInput.attributes.size());
 		vertexInputState.pVertexAttributeDescriptions = createInfo.vertexInput.attributes.data();
+		return vertexInputState;
+	}
+
+	static VkPipeline createGraphicsPipelineObject(PipelineCreateInfo& createInfo, ShaderState& shaderState) {
+		setStateTypes(createInfo);
+
+		const std::vector<VkDynamicState> dstates = getDynamicStates(createInfo);
+		VkPipelineDynamicStateCreateInfo dynamicState{};
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = (uint32_t)dstates.size();
+		dynamicState.pDynamicStates = dstates.data();
+
+		VkPipelineVertexInputStateCreateInfo vertexInputState = getVertexInputState(createInfo);
 
 		VkPipelineColorBlendStateCreateInfo colorBlendState{};
 		colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 		colorBlendState.attachmentCount = static_cast<uint32_t>(createInfo.blending.attachments.size());
 		colorBlendState.pAttachments = createInfo.blending.attachments.data();
 
+		// Mesh shading pipelines generate their primitives in the shaders and have no vertex input state
+		const bool meshShading = std::any_of(shaderState.shaderStages.begin(), shaderState.shaderStages.end(), [](const VkPipelineShaderStageCreateInfo& stage) { return stage.stage == VK_SHADER_STAGE_MESH_BIT_EXT; });
+
 		VkGraphicsPipelineCreateInfo pipelineCI{};
 		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
-		pipelineCI.pStages = shaderStages.data();
+		pipelineCI.flags = createInfo.flags;
+		pipelineCI.stageCount = static_cast<uint32_t>(shaderState.shaderStages.size());
+		pipelineCI.pStages = shaderState.shaderStages.data();
 		pipelineCI.layout = createInfo.layout;
-		pipelineCI.pVertexInputState = &vertexInputState;
-		pipelineCI.pInputAssemblyState = &createInfo.inputAssemblyState;
+		pipelineCI.pVertexInputState = meshShading ? nullptr : &vertexInputState;
+		pipelineCI.pInputAssemblyState = meshShading ? nullptr : &createInfo.inputAssemblyState;
 		pipelineCI.pTessellationState = &createInfo.tessellationState;
 		pipelineCI.pViewportState = &createInfo.viewportState;
 		pipelineCI.pRasterizationState = &createInfo.rasterizationState;
@@ -138,24 +309,285 @@ private:
 		pipelineCI.pDynamicState = &dynamicState;
 		pipelineCI.pNext = &createInfo.pipelineRenderingInfo; // createInfo.pNext;
 
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(VulkanContext::device->logicalDevice, createInfo.cache, 1, &pipelineCI, nullptr, &handle));
-	
-		// Shader modules can be safely destroyed after pipeline creation
-		for (auto& shaderModule : shaderModules) {
-			vkDestroyShaderModule(VulkanContext::device->logicalDevice, shaderModule, nullptr);
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		const VkResult result = vkCreateGraphicsPipelines(VulkanContext::device->logicalDevice, createInfo.cache, 1, &pipelineCI, nullptr, &pipeline);
+		if (result == VK_PIPELINE_COMPILE_REQUIRED) {
+			return VK_NULL_HANDLE;
 		}
+		VK_CHECK_RESULT(result);
+		return pipeline;
+	}
 
-		bindPoint = createInfo.bindPoint;
+	// Creates one part of a graphics pipeline library, pipelineCI only needs to contain the state that goes into that part
+	static VkPipeline createLibraryPart(PipelineCreateInfo& createInfo, VkGraphicsPipelineLibraryFlagsEXT flags, VkGraphicsPipelineCreateInfo& pipelineCI) {
+		VkGraphicsPipelineLibraryCreateInfoEXT libraryCI{ .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT, .pNext = &createInfo.pipelineRenderingInfo, .flags = flags };
+		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCI.pNext = &libraryCI;
+		// Parts keep the information needed to link optimized pipelines from them
+		pipelineCI.flags = createInfo.flags | VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+		VkPipeline part{ VK_NULL_HANDLE };
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(VulkanContext::device->logicalDevice, createInfo.cache, 1, &pipelineCI, nullptr, &part));
+		return part;
+	}
+
+	static VkPipeline createShaderLibraryPart(PipelineCreateInfo& createInfo, VkGraphicsPipelineLibraryFlagsEXT flags, const std::vector<std::string>& filenames, VkGraphicsPipelineCreateInfo& pipelineCI) {
+		ShaderState shaderState{};
+		compileShaders(createInfo, filenames, shaderState);
+		pipelineCI.stageCount = static_cast<uint32_t>(shaderState.shaderStages.size());
+		pipelineCI.pStages = shaderState.shaderStages.data();
+		pipelineCI.layout = createInfo.layout;
+		VkPipeline part = createLibraryPart(createInfo, flags, pipelineCI);
+		destroyShaderModules(shaderState);
+		return part;
+	}
+
+	// Shader files, defines and specialization constants of a part
+	static void appendShaderKey(std::string& key, const PipelineCreateInfo& createInfo, const std::vector<std::string>& filenames) {
+		appendValue(key, filenames.size());
+		for (const std::string& filename : filenames) {
+			appendString(key, filename);
+		}
+		appendValue(key, createInfo.defines.size());
+		for (const std::string& define : createInfo.defines) {
+			appendString(key, define);
+		}
+		appendValue(key, createInfo.specializationConstants.size());
+		for (const auto& [constantID, value] : createInfo.specializationConstants) {
+			appendValue(key, constantID);
+			appendValue(key, value);
+		}
+		appendValue(key, createInfo.layout);
+	}
+
+	static void appendMultisampleKey(std::string& key, const PipelineCreateInfo& createInfo) {
+		appendValue(key, createInfo.multisampleState.rasterizationSamples);
+		appendValue(key, createInfo.multisampleState.sampleShadingEnable);
+		appendValue(key, createInfo.multisampleState.minSampleShading);
+		appendValue(key, createInfo.multisampleState.alphaToCoverageEnable);
+	}
+
+	/** @brief Links the pipeline from the parts in the create info's library, only parts that aren't in the library yet are created (and have their shaders compiled) */
+	static VkPipeline createLinkedPipelineObject(PipelineCreateInfo& createInfo, bool linkTimeOptimization) {
+		setStateTypes(createInfo);
+		// Pipelines that only differ in dynamic state share their parts
+		clearDynamicStateValues(createInfo);
+		PipelineLibrary* library = createInfo.library;
+
+		std::vector<std::string> preRasterizationShaders{};
+		std::vector<std::string> fragmentShaders{};
+		for (const std::string& filename : createInfo.shaders) {
+			if (dxcCompiler->getShaderStage(filename) == VK_SHADER_STAGE_FRAGMENT_BIT) {
+				fragmentShaders.push_back(filename);
+			} else {
+				preRasterizationShaders.push_back(filename);
+			}
+		}
+
+		// Dynamic states are passed to all parts, each part only picks up the ones for its own state
+		const std::vector<VkDynamicState> dstates = getDynamicStates(createInfo);
+		VkPipelineDynamicStateCreateInfo dynamicState{ .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO, .dynamicStateCount = static_cast<uint32_t>(dstates.size()), .pDynamicStates = dstates.data() };
+		// State that goes into all parts
+		std::string sharedKey{};
+		appendValue(sharedKey, dstates.size());
+		sharedKey.append(reinterpret_cast<const char*>(dstates.data()), dstates.size() * sizeof(VkDynamicState));
+		const VkPipelineRenderingCreateInfo& rendering = createInfo.pipelineRenderingInfo;
+		appendValue(sharedKey, rendering.viewMask);
+		appendValue(sharedKey, createInfo.flags);
+
+		std::array<VkPipeline, 4> parts{};
+
+		// Vertex input
+		std::string key = sharedKey;
+		// Vertex input descriptions only consist of 32 bit members
+		appendValue(key, createInfo.vertexInput.bindings.size());
+		key.append(reinterpret_cast<const char*>(createInfo.vertexInput.bindings.data()), createInfo.vertexInput.bindings.size() * sizeof(VkVertexInputBindingDescription));
+		appendValue(key, createInfo.vertexInput.attributes.size());
+		key.append(reinterpret_cast<const char*>(createInfo.vertexInput.attributes.data()), createInfo.vertexInput.attributes.size() * sizeof(VkVertexInputAttributeDescription));
+		appendValue(key, createInfo.inputAssemblyState.topology);
+		appendValue(key, createInfo.inputAssemblyState.primitiveRestartEnable);
+		parts[0] = library->getPart(PipelineLibrary::PartType::VertexInput, key, {}, [&]() {
+			VkPipelineVertexInputStateCreateInfo vertexInputState = getVertexInputState(createInfo);
+			VkGraphicsPipelineCreateInfo pipelineCI{ .pVertexInputState = &vertexInputState, .pInputAssemblyState = &createInfo.inputAssemblyState, .pDynamicState = &dynamicState };
+			return createLibraryPart(createInfo, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, pipelineCI);
+		});
+
+		// Pre-rasterization shaders
+		key = sharedKey;
+		appendShaderKey(key, createInfo, preRasterizationShaders);
+		appendValue(key, createInfo.tessellationState.patchControlPoints);
+		appendValue(key, createInfo.viewportState.viewportCount);
+		appendValue(key, createInfo.viewportState.scissorCount);
+		const VkPipelineRasterizationStateCreateInfo& rasterization = createInfo.rasterizationState;
+		appendValue(key, rasterization.depthClampEnable);
+		appendValue(key, rasterization.rasterizerDiscardEnable);
+		appendValue(key, rasterization.polygonMode);
+		appendValue(key, rasterization.cullMode);
+		appendValue(key, rasterization.frontFace);
+		appendValue(key, rasterization.depthBiasEnable);
+		appendValue(key, rasterization.depthBiasConstantFactor);
+		appendValue(key, rasterization.depthBiasClamp);
+		appendValue(key, rasterization.depthBiasSlopeFactor);
+		appendValue(key, rasterization.lineWidth);
+		parts[1] = library->getPart(PipelineLibrary::PartType::PreRasterization, key, preRasterizationShaders, [&]() {
+			VkGraphicsPipelineCreateInfo pipelineCI{ .pTessellationState = &createInfo.tessellationState, .pViewportState = &createInfo.viewportState, .pRasterizationState = &createInfo.rasterizationState, .pDynamicState = &dynamicState };
+			return createShaderLibraryPart(createInfo, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, preRasterizationShaders, pipelineCI);
+		});
+
+		// Fragment shader
+		key = sharedKey;
+		appendShaderKey(key, createInfo, fragmentShaders);
+		const VkPipelineDepthStencilStateCreateInfo& depthStencil = createInfo.depthStencilState;
+		appendValue(key, depthStencil.depthTestEnable);
+		appendValue(key, depthStencil.depthWriteEnable);
+		appendValue(key, depthStencil.depthCompareOp);
+		appendValue(key, depthStencil.depthBoundsTestEnable);
+		appendValue(key, depthStencil.stencilTestEnable);
+		appendValue(key, depthStencil.front);
+		appendValue(key, depthStencil.back);
+		appendMultisampleKey(key, createInfo);
+		parts[2] = library->getPart(PipelineLibrary::PartType::FragmentShader, key, fragmentShaders, [&]() {
+			VkGraphicsPipelineCreateInfo pipelineCI{ .pMultisampleState = &createInfo.multisampleState, .pDepthStencilState = &createInfo.depthStencilState, .pDynamicState = &dynamicState };
+			return createShaderLibraryPart(createInfo, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, fragmentShaders, pipelineCI);
+		});
+
+		// Fragment output
+		key = sharedKey;
+		appendValue(key, createInfo.blending.attachments.size());
+		key.append(reinterpret_cast<const char*>(createInfo.blending.attachments.data()), createInfo.blending.attachments.size() * sizeof(VkPipelineColorBlendAttachmentState));
+		appendMultisampleKey(key, createInfo);
+		appendValue(key, rendering.colorAttachmentCount);
+		if (rendering.pColorAttachmentFormats) {
+			key.append(reinterpret_cast<const char*>(rendering.pColorAttachmentFormats), rendering.colorAttachmentCount * sizeof(VkFormat));
+		}
+		appendValue(key, rendering.depthAttachmentFormat);
+		appendValue(key, rendering.stencilAttachmentFormat);
+		parts[3] = library->getPart(PipelineLibrary::PartType::FragmentOutput, key, {}, [&]() {
+			VkPipelineColorBlendStateCreateInfo colorBlendState{ .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO, .attachmentCount = static_cast<uint32_t>(createInfo.blending.attachments.size()), .pAttachments = createInfo.blending.attachments.data() };
+			VkGraphicsPipelineCreateInfo pipelineCI{ .pMultisampleState = &createInfo.multisampleState, .pColorBlendState = &colorBlendState, .pDynamicState = &dynamicState };
+			return createLibraryPart(createInfo, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, pipelineCI);
+		});
+
+		VkPipelineLibraryCreateInfoKHR linkCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR, .libraryCount = static_cast<uint32_t>(parts.size()), .pLibraries = parts.data() };
+		VkGraphicsPipelineCreateInfo pipelineCI{
+			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+			.pNext = &linkCI,
+			.flags = createInfo.flags | (linkTimeOptimization ? static_cast<VkPipelineCreateFlags>(VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT) : 0u),
+			.layout = createInfo.layout
+		};
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(VulkanContext::device->logicalDevice, createInfo.cache, 1, &pipelineCI, nullptr, &pipeline));
+		return pipeline;
 	}
 
 public:
+	static bool hasDynamicState(const PipelineCreateInfo& createInfo, DynamicState state) {
+		if ((state == DynamicState::PolygonMode) && !VulkanContext::device->hasDynamicPolygonMode) {
+			return false;
+		}
+		if ((state == DynamicState::FragmentShadingRate) && !VulkanContext::device->hasFragmentShadingRate) {
+			return false;
+		}
+		return std::find(createInfo.dynamicState.begin(), createInfo.dynamicState.end(), state) != createInfo.dynamicState.end();
+	}
+
+	/**
+	* Replaces the values of state that's set dynamically with fixed ones, so create infos that only differ in dynamic state result in the same pipeline object (or variant key)
+	* Dynamic topologies need to be of the same class (points, lines, triangles or patches) as the one the pipeline was created with, so the topology is only replaced by the first of its class
+	*/
+	static void clearDynamicStateValues(PipelineCreateInfo& createInfo) {
+		if (hasDynamicState(createInfo, DynamicState::DepthWriteEnable)) {
+			createInfo.depthStencilState.depthWriteEnable = VK_FALSE;
+		}
+		if (hasDynamicState(createInfo, DynamicState::DepthCompareOp)) {
+			createInfo.depthStencilState.depthCompareOp = VK_COMPARE_OP_NEVER;
+		}
+		if (hasDynamicState(createInfo, DynamicState::DepthTestEnable)) {
+			createInfo.depthStencilState.depthTestEnable = VK_FALSE;
+		}
+		if (hasDynamicState(createInfo, DynamicState::CullMode)) {
+			createInfo.rasterizationState.cullMode = VK_CULL_MODE_NONE;
+		}
+		if (hasDynamicState(createInfo, DynamicState::FrontFace)) {
+			createInfo.rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		}
+		if (hasDynamicState(createInfo, DynamicState::PolygonMode)) {
+			createInfo.rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+		}
+		if (hasDynamicState(createInfo, DynamicState::PrimitiveTopology)) {
+			switch (createInfo.inputAssemblyState.topology) {
+			case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+				break;
+			case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+			case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+			case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+			case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+				createInfo.inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+				break;
+			case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+				break;
+			default:
+				createInfo.inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+				break;
+			}
+		}
+	}
+
 	// Store the createInfo for hot reload
 	PipelineCreateInfo* initialCreateInfo{ nullptr };
 	VkPipelineBindPoint bindPoint{ VK_PIPELINE_BIND_POINT_GRAPHICS };
-	bool wantsReload = false;
+	// Set by the file watcher thread
+	std::atomic<bool> wantsReload{ false };
 
-	Pipeline(PipelineCreateInfo createInfo) : DeviceResource(createInfo.name) {
-		createPipelineObject(createInfo);
+	Pipeline(PipelineCreateInfo createInfo) : Pipeline(createInfo, createPipelineObject(createInfo)) {}
+
+	/**
+	* Creates the pipeline only if it can be created without compiling, i.e. its shaders are in the shader bundle and the pipeline is in the pipeline cache
+	* Used to look up pipeline variants without stalling the calling thread, pipelines that weren't found need to be created with the constructor (e.g. on a background thread)
+	*
+	* @return The pipeline, or nullptr if it would need to be compiled
+	* @note Requires Device::enabledFeatures13.pipelineCreationCacheControl, pipelines linked from a library are never looked up
+	*/
+	static Pipeline* createIfCached(const PipelineCreateInfo& createInfo) {
+		if (!VulkanContext::device->enabledFeatures13.pipelineCreationCacheControl || !createInfo.useShaderBundle || (createInfo.cache == VK_NULL_HANDLE) || usesLibrary(createInfo)) {
+			return nullptr;
+		}
+		PipelineCreateInfo lookupCreateInfo = createInfo;
+		lookupCreateInfo.flags |= VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT;
+		ShaderState shaderState{};
+		if (!compileShaders(lookupCreateInfo, lookupCreateInfo.shaders, shaderState, true)) {
+			return nullptr;
+		}
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		try {
+			pipeline = (lookupCreateInfo.bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) ? createComputePipelineObject(lookupCreateInfo, shaderState) : createGraphicsPipelineObject(lookupCreateInfo, shaderState);
+		} catch (...) {
+			destroyShaderModules(shaderState);
+			throw;
+		}
+		destroyShaderModules(shaderState);
+		if (pipeline == VK_NULL_HANDLE) {
+			return nullptr;
+		}
+		return new Pipeline(createInfo, pipeline);
+	}
+
+private:
+	// Takes ownership of an already created pipeline object
+	Pipeline(const PipelineCreateInfo& createInfo, VkPipeline pipeline) : DeviceResource(createInfo.name) {
+		handle = pipeline;
+		bindPoint = createInfo.bindPoint;
+
+		// Pipelines linked from a library are usable right away, an optimized version is linked in the background and swapped in by applyReload
+		if (usesLibrary(createInfo)) {
+			pendingOptimization = true;
+			pendingReload = std::async(std::launch::async, [createInfo]() -> VkPipeline {
+				try {
+					return createPipelineObject(createInfo, true);
+				} catch (...) {
+					return VK_NULL_HANDLE;
+				}
+			});
+		}
 
 		// Store a copy of the createInfo for hot reload		
 		if (createInfo.enableHotReload) {
@@ -165,25 +597,95 @@ public:
 		setDebugName((uint64_t)handle, VK_OBJECT_TYPE_PIPELINE);
 	};
 
+public:
 	~Pipeline() {
+		if (pendingReload.valid()) {
+			VkPipeline pendingHandle = pendingReload.get();
+			if (pendingHandle != VK_NULL_HANDLE) {
+				vkDestroyPipeline(VulkanContext::device->logicalDevice, pendingHandle, nullptr);
+			}
+		}
 		vkDestroyPipeline(VulkanContext::device->logicalDevice, handle, nullptr);
 	}
 
+	/** @brief Starts recompiling shaders and recreating the pipeline object on a background thread, the current pipeline object stays in use until applyReload swaps in the new one */
 	void reload() {
-		wantsReload = false;
 		assert(initialCreateInfo);
-		// @todo: move to calling function to avoid multiple wait idles
-		VulkanContext::device->waitIdle();
-		// For hot reloads create a temp handle, so if pipeline creation fails the application will continue with the old pipeline
+		if (pendingReload.valid()) {
+			// A reload is still in progress, keep the request so it's restarted with the latest changes once that one has been applied
+			return;
+		}
+		wantsReload = false;
+		pendingOptimization = false;
+		// Not run on the job system, as threads waiting for jobs could pick up the (long running) compilation and stall a frame
+		// Pipelines linked from a library only recreate the parts of changed shaders (see PipelineLibrary::invalidate), as this runs in the background they are linked optimized right away
+		PipelineCreateInfo reloadCreateInfo = *initialCreateInfo;
+		reloadCreateInfo.useShaderBundle = false;
+		pendingReload = std::async(std::launch::async, [createInfo = reloadCreateInfo]() -> VkPipeline {
+			try {
+				return createPipelineObject(createInfo, true);
+			} catch (...) {
+				// If pipeline creation fails the application will continue with the old pipeline
+				std::cerr << "Could not recreate pipeline, using last version\n";
+				return VK_NULL_HANDLE;
+			}
+		});
+	}
+
+	/**
+	* Swaps in the pipeline object of a finished background reload, must be called at a frame boundary by the thread recording command buffers
+	*
+	* @return The replaced pipeline object, which may still be in use by frames in flight and needs to be destroyed once these have finished, or VK_NULL_HANDLE if no reload finished
+	*/
+	VkPipeline applyReload() {
+		if (!pendingReload.valid() || (pendingReload.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+			return VK_NULL_HANDLE;
+		}
+		VkPipeline newHandle = pendingReload.get();
+		if (newHandle == VK_NULL_HANDLE) {
+			return VK_NULL_HANDLE;
+		}
 		VkPipeline oldHandle = handle;
-		try {
-			createPipelineObject(*initialCreateInfo);
-			vkDestroyPipeline(VulkanContext::device->logicalDevice, oldHandle, nullptr);
+		handle = newHandle;
+		setDebugName((uint64_t)handle, VK_OBJECT_TYPE_PIPELINE);
+		if (!pendingOptimization) {
 			std::cout << "Pipeline recreated\n";
-		} catch (...) {
-			std::cerr << "Could not recreate pipeline, using last version\n";
 		}
+		pendingOptimization = false;
+		return oldHandle;
 	}
 
 	operator VkPipeline() { return handle; };
+
+	/**
+	* Creates multiple pipelines in parallel, with shader compilation and pipeline object creation distributed across the job system's threads
+	*
+	* @param createInfos Create infos for all pipelines, these should share a pipeline cache (which is thread-safe)
+	* @param jobSystem Job system used to create the pipelines
+	*
+	* @return Pipelines in the same order as createInfos, returns once all pipelines have been created
+	* @note If creation of any of the pipelines fails, all other pipelines are destroyed and the exception is rethrown
+	*/
+	static std::vector<Pipeline*> createPipelines(const std::vector<PipelineCreateInfo>& createInfos, vks::JobSystem& jobSystem) {
+		std::vector<Pipeline*> pipelines(createInfos.size(), nullptr);
+		std::vector<std::exception_ptr> exceptions(createInfos.size(), nullptr);
+		jobSystem.parallelFor(static_cast<uint32_t>(createInfos.size()), 1, [&](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; i++) {
+				try {
+					pipelines[i] = new Pipeline(createInfos[i]);
+				} catch (...) {
+					exceptions[i] = std::current_exception();
+				}
+			}
+		});
+		for (auto& exception : exceptions) {
+			if (exception) {
+				for (auto& pipeline : pipelines) {
+					delete pipeline;
+				}
+				std::rethrow_exception(exception);
+			}
+		}
+		return pipelines;
+	}
 };
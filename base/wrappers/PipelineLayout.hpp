@@ -9,16 +9,22 @@
 #pragma once
 
 #include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
 #include "volk.h"
 #include "Initializers.hpp"
 #include "VulkanTools.h"
 #include "Device.hpp"
 #include "DescriptorSetLayout.hpp"
+#include "ShaderReflection.hpp"
 
 struct PipelineLayoutCreateInfo {
 	// @todo: Use DescriptorSetLayout
 	std::vector<VkDescriptorSetLayout> layouts;
 	std::vector<VkPushConstantRange> pushConstantRanges;
+	// All shaders used with the layout, if no push constant ranges are declared a single range covering the push constant blocks of all of them is derived, otherwise the declared ranges are checked against them
+	std::vector<ShaderReference> shaders;
 };
 
 class PipelineLayout {
@@ -28,7 +34,43 @@ private:
 public:
 	VkPipelineLayout handle = VK_NULL_HANDLE;
 
+	/** @brief Derives or checks the push constant ranges of a create info from its shaders, which are no longer needed afterwards */
+	static void resolvePushConstantRanges(PipelineLayoutCreateInfo& createInfo) {
+		if (createInfo.shaders.empty()) {
+			return;
+		}
+		if (createInfo.pushConstantRanges.empty()) {
+			VkPushConstantRange range{};
+			for (const ShaderReference& shader : createInfo.shaders) {
+				const ShaderReflection& reflection = reflectShader(shader);
+				if (reflection.pushConstantSize > 0) {
+					range.stageFlags |= reflection.stage;
+					range.size = std::max(range.size, reflection.pushConstantSize);
+				}
+			}
+			if (range.size > 0) {
+				createInfo.pushConstantRanges.push_back(range);
+			}
+		} else {
+			for (const ShaderReference& shader : createInfo.shaders) {
+				const ShaderReflection& reflection = reflectShader(shader);
+				if (reflection.pushConstantSize == 0) {
+					continue;
+				}
+				bool covered = false;
+				for (const VkPushConstantRange& range : createInfo.pushConstantRanges) {
+					covered |= ((range.stageFlags & reflection.stage) != 0) && (range.offset == 0) && (range.size >= reflection.pushConstantSize);
+				}
+				if (!covered) {
+					throw std::runtime_error("Push constant block of " + shader.filename + " is not covered by the pipeline layout's push constant ranges");
+				}
+			}
+		}
+		createInfo.shaders.clear();
+	}
+
 	PipelineLayout(PipelineLayoutCreateInfo createInfo) {
+		resolvePushConstantRanges(createInfo);
 		layouts = createInfo.layouts;
 		pushConstantRanges = createInfo.pushConstantRanges;
 		VkPipelineLayoutCreateInfo CI = vks::initializers::pipelineLayoutCreateInfo(layouts.data(), static_cast<uint32_t>(layouts.size()));
@@ -0,0 +1,73 @@
+/*
+ * Cache for pipeline layouts shared by pipelines with the same signature
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include "volk.h"
+#include "CacheKey.hpp"
+#include "PipelineLayout.hpp"
+
+/**
+ * Owns pipeline layouts keyed on their signature (descriptor set layouts and push constant ranges)
+ * The signature is taken after the push constant ranges have been derived from the shaders, so create infos listing different shaders share a layout if their shaders use the same push constants
+ */
+class PipelineLayoutCache {
+private:
+	std::mutex mutex;
+	std::unordered_map<std::string, PipelineLayout*> layouts;
+
+	static std::string getKey(const PipelineLayoutCreateInfo& createInfo)
+	{
+		std::string key;
+		appendValue(key, createInfo.layouts.size());
+		for (const VkDescriptorSetLayout layout : createInfo.layouts) {
+			appendValue(key, layout);
+		}
+		appendValue(key, createInfo.pushConstantRanges.size());
+		for (const VkPushConstantRange& range : createInfo.pushConstantRanges) {
+			appendValue(key, range.stageFlags);
+			appendValue(key, range.offset);
+			appendValue(key, range.size);
+		}
+		return key;
+	}
+
+public:
+	~PipelineLayoutCache()
+	{
+		for (auto& [key, layout] : layouts) {
+			delete layout;
+		}
+	}
+
+	/** @brief Returns the layout with the signature of the create info, which is created if no such layout exists yet, layouts are owned by the cache */
+	PipelineLayout* get(PipelineLayoutCreateInfo createInfo)
+	{
+		PipelineLayout::resolvePushConstantRanges(createInfo);
+		const std::string key = getKey(createInfo);
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = layouts.find(key);
+		if (it != layouts.end()) {
+			return it->second;
+		}
+		PipelineLayout* layout = new PipelineLayout(createInfo);
+		layouts[key] = layout;
+		return layout;
+	}
+
+	// Number of distinct layouts
+	uint32_t size()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return static_cast<uint32_t>(layouts.size());
+	}
+};
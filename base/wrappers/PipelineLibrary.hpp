@@ -0,0 +1,97 @@
+/*
+ * Cache for the parts of graphics pipelines created with VK_EXT_graphics_pipeline_library
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <algorithm>
+#include "volk.h"
+#include "CacheKey.hpp"
+#include "VulkanContext.h"
+
+/**
+ * Owns the vertex input, pre-rasterization, fragment shader and fragment output parts that graphics pipelines are linked from
+ * Parts are keyed on the state (and shaders) that goes into them, so pipelines that only differ in some of the state share the other parts
+ * Shaders are only compiled for parts that aren't in the library yet, linking a pipeline from existing parts is much faster than creating it as a whole
+ * Linked pipelines don't depend on the parts, but parts replaced by a hot reload are kept until the library is destroyed, as other threads may still be linking with them
+ */
+class PipelineLibrary {
+public:
+	enum class PartType { VertexInput, PreRasterization, FragmentShader, FragmentOutput };
+
+private:
+	struct Part {
+		VkPipeline handle{ VK_NULL_HANDLE };
+		// Shader files compiled into the part, used to find the parts affected by a changed file
+		std::vector<std::string> shaders{};
+	};
+	std::mutex mutex;
+	std::unordered_map<std::string, Part> parts;
+	std::vector<VkPipeline> retiredParts;
+
+public:
+	~PipelineLibrary()
+	{
+		for (auto& [key, part] : parts) {
+			vkDestroyPipeline(VulkanContext::device->logicalDevice, part.handle, nullptr);
+		}
+		for (VkPipeline handle : retiredParts) {
+			vkDestroyPipeline(VulkanContext::device->logicalDevice, handle, nullptr);
+		}
+	}
+
+	/**
+	* Returns the part for a key, creating it if it isn't in the library yet
+	* Can be called from multiple threads, parts are created outside of the lock so different parts can be created at the same time
+	*
+	* @param type Type of the part, parts of different types never share a key
+	* @param key State that goes into the part
+	* @param shaders Shader files compiled into the part
+	* @param create Creates the part, only called if the part isn't in the library yet
+	*
+	* @throws Rethrows errors of part creation, nothing is added to the library in that case
+	*/
+	VkPipeline getPart(PartType type, std::string key, const std::vector<std::string>& shaders, const std::function<VkPipeline()>& create)
+	{
+		key.insert(key.begin(), static_cast<char>(type));
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = parts.find(key);
+			if (it != parts.end()) {
+				return it->second.handle;
+			}
+		}
+		VkPipeline handle = create();
+		std::lock_guard<std::mutex> lock(mutex);
+		auto [it, inserted] = parts.try_emplace(key, Part{ .handle = handle, .shaders = shaders });
+		if (!inserted) {
+			// Another thread created the same part in the meantime
+			retiredParts.push_back(handle);
+			return it->second.handle;
+		}
+		return handle;
+	}
+
+	/** @brief Removes all parts that were compiled from a (changed) shader file, so they are recreated on their next use, e.g. by a hot reload */
+	void invalidate(const std::string& filename)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto it = parts.begin(); it != parts.end();) {
+			if (std::find(it->second.shaders.begin(), it->second.shaders.end(), filename) != it->second.shaders.end()) {
+				retiredParts.push_back(it->second.handle);
+				it = parts.erase(it);
+			} else {
+				it++;
+			}
+		}
+	}
+};
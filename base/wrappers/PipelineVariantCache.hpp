@@ -0,0 +1,247 @@
+/*
+ * Cache for pipeline variants that are created on first use
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <mutex>
+#include <future>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include "volk.h"
+#include "CacheKey.hpp"
+#include "Pipeline.hpp"
+
+/**
+ * Owns pipelines that are variants of a few base create infos (e.g. with other shader defines, specialization constants or render state)
+ * Variants are keyed on everything in the create info that affects the pipeline object, so requesting the same variant again returns the existing pipeline
+ * Variants are only created when they are first requested, get blocks the requesting thread while the shaders are compiled (compiled shaders are cached by DXC)
+ * getAsync doesn't block on compilation: Variants that are in the pipeline cache are created right away, all others are created on a background thread while a fallback pipeline is used
+ */
+class PipelineVariantCache {
+private:
+	std::mutex mutex;
+	std::unordered_map<std::string, Pipeline*> variants;
+	// In creation order
+	std::vector<Pipeline*> pipelines;
+	// Variants requested by getAsync that are being created in the background
+	std::unordered_map<std::string, std::future<Pipeline*>> pendingVariants;
+	// Variants whose background creation failed, these aren't retried by getAsync
+	std::unordered_set<std::string> failedVariants;
+
+	// Needs the mutex to be locked
+	void addVariant(const std::string& key, Pipeline* pipeline)
+	{
+		variants[key] = pipeline;
+		pipelines.push_back(pipeline);
+		if (onVariantCreated) {
+			onVariantCreated(pipeline);
+		}
+	}
+
+public:
+	// Called for every new variant, e.g. to register it with the file watcher
+	std::function<void(Pipeline*)> onVariantCreated;
+
+	~PipelineVariantCache()
+	{
+		for (auto& [key, pending] : pendingVariants) {
+			delete pending.get();
+		}
+		for (Pipeline* pipeline : pipelines) {
+			delete pipeline;
+		}
+	}
+
+	/** @brief Builds the key of a create info from the shader set, defines, specialization constants and the state that goes into the pipeline object (values of dynamic state are ignored) */
+	static std::string getKey(PipelineCreateInfo createInfo)
+	{
+		Pipeline::clearDynamicStateValues(createInfo);
+		// Members are appended one by one, as the Vulkan state structures contain padding and pointers
+		std::string key;
+		appendValue(key, createInfo.bindPoint);
+		appendValue(key, createInfo.shaders.size());
+		for (const std::string& shader : createInfo.shaders) {
+			appendString(key, shader);
+		}
+		appendValue(key, createInfo.defines.size());
+		for (const std::string& define : createInfo.defines) {
+			appendString(key, define);
+		}
+		appendValue(key, createInfo.specializationConstants.size());
+		for (const auto& [constantID, value] : createInfo.specializationConstants) {
+			appendValue(key, constantID);
+			appendValue(key, value);
+		}
+		appendValue(key, createInfo.layout);
+		appendValue(key, createInfo.flags);
+		if (createInfo.bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
+			return key;
+		}
+		// Vertex input descriptions only consist of 32 bit members
+		appendValue(key, createInfo.vertexInput.bindings.size());
+		key.append(reinterpret_cast<const char*>(createInfo.vertexInput.bindings.data()), createInfo.vertexInput.bindings.size() * sizeof(VkVertexInputBindingDescription));
+		appendValue(key, createInfo.vertexInput.attributes.size());
+		key.append(reinterpret_cast<const char*>(createInfo.vertexInput.attributes.data()), createInfo.vertexInput.attributes.size() * sizeof(VkVertexInputAttributeDescription));
+		appendValue(key, createInfo.inputAssemblyState.topology);
+		appendValue(key, createInfo.inputAssemblyState.primitiveRestartEnable);
+		appendValue(key, createInfo.tessellationState.patchControlPoints);
+		appendValue(key, createInfo.viewportState.viewportCount);
+		appendValue(key, createInfo.viewportState.scissorCount);
+		const VkPipelineRasterizationStateCreateInfo& rasterization = createInfo.rasterizationState;
+		appendValue(key, rasterization.depthClampEnable);
+		appendValue(key, rasterization.rasterizerDiscardEnable);
+		appendValue(key, rasterization.polygonMode);
+		appendValue(key, rasterization.cullMode);
+		appendValue(key, rasterization.frontFace);
+		appendValue(key, rasterization.depthBiasEnable);
+		appendValue(key, rasterization.depthBiasConstantFactor);
+		appendValue(key, rasterization.depthBiasClamp);
+		appendValue(key, rasterization.depthBiasSlopeFactor);
+		appendValue(key, rasterization.lineWidth);
+		appendValue(key, createInfo.multisampleState.rasterizationSamples);
+		appendValue(key, createInfo.multisampleState.sampleShadingEnable);
+		appendValue(key, createInfo.multisampleState.minSampleShading);
+		appendValue(key, createInfo.multisampleState.alphaToCoverageEnable);
+		const VkPipelineDepthStencilStateCreateInfo& depthStencil = createInfo.depthStencilState;
+		appendValue(key, depthStencil.depthTestEnable);
+		appendValue(key, depthStencil.depthWriteEnable);
+		appendValue(key, depthStencil.depthCompareOp);
+		appendValue(key, depthStencil.depthBoundsTestEnable);
+		appendValue(key, depthStencil.stencilTestEnable);
+		appendValue(key, depthStencil.front);
+		appendValue(key, depthStencil.back);
+		appendValue(key, createInfo.blending.attachments.size());
+		key.append(reinterpret_cast<const char*>(createInfo.blending.attachments.data()), createInfo.blending.attachments.size() * sizeof(VkPipelineColorBlendAttachmentState));
+		appendValue(key, createInfo.dynamicState.size());
+		for (const DynamicState state : createInfo.dynamicState) {
+			appendValue(key, state);
+		}
+		const VkPipelineRenderingCreateInfo& rendering = createInfo.pipelineRenderingInfo;
+		appendValue(key, rendering.viewMask);
+		appendValue(key, rendering.colorAttachmentCount);
+		if (rendering.pColorAttachmentFormats) {
+			key.append(reinterpret_cast<const char*>(rendering.pColorAttachmentFormats), rendering.colorAttachmentCount * sizeof(VkFormat));
+		}
+		appendValue(key, rendering.depthAttachmentFormat);
+		appendValue(key, rendering.stencilAttachmentFormat);
+		return key;
+	}
+
+	/**
+	* Returns the pipeline for a create info, creating it if this variant hasn't been requested before
+	* Can be called from multiple threads, a thread requesting a variant that is being created waits for it (this includes background creation started by getAsync)
+	*
+	* @throws Rethrows errors of pipeline creation, nothing is added to the cache in that case
+	*/
+	Pipeline* get(const PipelineCreateInfo& createInfo)
+	{
+		const std::string key = getKey(createInfo);
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = variants.find(key);
+		if (it != variants.end()) {
+			return it->second;
+		}
+		Pipeline* pipeline{ nullptr };
+		auto pending = pendingVariants.find(key);
+		if (pending != pendingVariants.end()) {
+			pipeline = pending->second.get();
+			pendingVariants.erase(pending);
+		}
+		// Variants that failed in the background are created again here, so the error is passed on to the caller
+		if (!pipeline) {
+			pipeline = new Pipeline(createInfo);
+			failedVariants.erase(key);
+		}
+		addVariant(key, pipeline);
+		return pipeline;
+	}
+
+	/**
+	* Returns the pipeline for a create info without waiting for shader compilation or pipeline creation
+	* Variants that haven't been requested before are looked up in the pipeline cache (see Pipeline::createIfCached) and otherwise created on a background thread
+	* Until that has finished (and if it fails) the fallback is returned, so callers need to request the variant again (e.g. every frame) to pick it up once it's ready
+	*
+	* @param fallback Pipeline that's compatible with the variant (same layout and attachments), e.g. the base pipeline the variant is derived from
+	* @return The variant or the fallback, newly created variants are passed to onVariantCreated by the thread that picks them up
+	*/
+	Pipeline* getAsync(const PipelineCreateInfo& createInfo, Pipeline* fallback)
+	{
+		const std::string key = getKey(createInfo);
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = variants.find(key);
+		if (it != variants.end()) {
+			return it->second;
+		}
+		if (failedVariants.contains(key)) {
+			return fallback;
+		}
+		auto pending = pendingVariants.find(key);
+		if (pending != pendingVariants.end()) {
+			if (pending->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				return fallback;
+			}
+			Pipeline* pipeline = pending->second.get();
+			pendingVariants.erase(pending);
+			if (!pipeline) {
+				failedVariants.insert(key);
+				return fallback;
+			}
+			addVariant(key, pipeline);
+			return pipeline;
+		}
+		if (Pipeline* pipeline = Pipeline::createIfCached(createInfo)) {
+			addVariant(key, pipeline);
+			return pipeline;
+		}
+		// Not run on the job system, as threads waiting for jobs could pick up the (long running) compilation and stall a frame
+		pendingVariants[key] = std::async(std::launch::async, [createInfo]() -> Pipeline* {
+			try {
+				return new Pipeline(createInfo);
+			} catch (...) {
+				std::cerr << "Could not create pipeline variant \"" << createInfo.name << "\", using fallback\n";
+				return nullptr;
+			}
+		});
+		return fallback;
+	}
+
+	/** @brief Number of variants that are being created in the background */
+	size_t getPendingCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pendingVariants.size();
+	}
+
+	bool contains(const Pipeline* pipeline)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return std::find(pipelines.begin(), pipelines.end(), pipeline) != pipelines.end();
+	}
+
+	/** @brief Calls the function for all variants created so far, e.g. to apply pending hot reloads, variants must not be requested from within the function */
+	template<typename Function>
+	void forEach(Function function)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (Pipeline* pipeline : pipelines) {
+			function(pipeline);
+		}
+	}
+
+	size_t size()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pipelines.size();
+	}
+};
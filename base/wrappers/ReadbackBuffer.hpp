@@ -0,0 +1,152 @@
+/*
+ * Persistently mapped ring buffer for asynchronous readbacks
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include "volk.h"
+#include "Device.hpp"
+#include "Buffer.hpp"
+#include "MemoryStats.h"
+#include "VulkanContext.h"
+
+struct ReadbackBufferCreateInfo {
+	VkDeviceSize size{ 64 * 1024 * 1024 };
+};
+
+/** @brief Part of the readback buffer that a copy command of the current frame writes to */
+struct ReadbackRegion {
+	VkBuffer buffer{ VK_NULL_HANDLE };
+	// Offset into buffer, needs to be added to the destination offset of copy commands
+	VkDeviceSize offset{ 0 };
+	VkDeviceSize size{ 0 };
+};
+
+// Called with the read back data once the frame that copied it has finished on the device, the data is only valid during the call
+using ReadbackCallback = std::function<void(const void* data, VkDeviceSize size)>;
+
+/**
+ * Single host visible buffer that readbacks (e.g. screenshots) carve their destination regions from in a ring
+ * A region is tagged with the number of the frame that copies into it, its callback is run once that frame has completed, so reading back never waits for the device
+ * Host cached memory is preferred, as reading from uncached memory is slow, the memory is invalidated before the callback if it isn't coherent
+ */
+class ReadbackBuffer {
+private:
+	struct Request {
+		uint64_t frameNumber{ 0 };
+		VkDeviceSize offset{ 0 };
+		VkDeviceSize size{ 0 };
+		// Bytes (including padding) the request occupies in the ring
+		VkDeviceSize ringSize{ 0 };
+		ReadbackCallback callback;
+	};
+
+	Buffer* buffer{ nullptr };
+	VkDeviceSize capacity{ 0 };
+	VkDeviceSize head{ 0 };
+	VkDeviceSize used{ 0 };
+	// In frame order, so they're retired in the order their regions were allocated
+	std::deque<Request> requests;
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+public:
+	ReadbackBuffer(ReadbackBufferCreateInfo createInfo)
+	{
+		capacity = createInfo.size;
+		const VkMemoryPropertyFlags memoryPropertyFlags = VulkanContext::device->getHostReadMemoryProperties();
+		MemoryStats::Scope memoryScope(MemoryCategory::Staging);
+		buffer = new Buffer({
+			.name = "Readback ring buffer",
+			.usageFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.memoryPropertyFlags = memoryPropertyFlags,
+			.size = capacity,
+			.map = true,
+			.dedicatedAllocation = true
+		});
+	}
+
+	// Pending readbacks are dropped without running their callbacks, the device needs to be idle
+	~ReadbackBuffer()
+	{
+		delete buffer;
+	}
+
+	ReadbackBuffer(const ReadbackBuffer&) = delete;
+	ReadbackBuffer& operator=(const ReadbackBuffer&) = delete;
+
+	/**
+	* Get a region of the readback buffer for a copy recorded into a frame's command buffer
+	*
+	* @param size Size of the region in bytes
+	* @param frameNumber Number the frame recording the copy will be submitted with, the callback is run once that frame has completed
+	* @param callback Receives the data of the region
+	* @param region Receives the region to copy to
+	* @param alignment (Optional) Alignment of the region's offset, needs to be a multiple of the texel block size for image to buffer copies
+	*
+	* @return False if the ring is full with readbacks that haven't completed yet, nothing should be copied and the readback can be retried in a later frame
+	*/
+	bool allocate(VkDeviceSize size, uint64_t frameNumber, ReadbackCallback callback, ReadbackRegion& region, VkDeviceSize alignment = 16)
+	{
+		assert(requests.empty() || (requests.back().frameNumber <= frameNumber));
+		// Non-coherent memory is invalidated per region, so regions must not share an atom with regions of other readbacks
+		alignment = std::max(alignment, VulkanContext::device->properties.limits.nonCoherentAtomSize);
+		VkDeviceSize offset = alignUp(head, alignment);
+		VkDeviceSize consumed = offset - head + size;
+		if (offset + size > capacity) {
+			// Skip the rest of the ring and start at the front
+			offset = 0;
+			consumed = capacity - head + size;
+		}
+		if (used + consumed > capacity) {
+			return false;
+		}
+		head = alignUp(offset + size, alignment);
+		consumed += head - (offset + size);
+		used += consumed;
+		requests.push_back({ .frameNumber = frameNumber, .offset = offset, .size = size, .ringSize = consumed, .callback = std::move(callback) });
+		region = { .buffer = buffer->buffer, .offset = offset, .size = size };
+		return true;
+	}
+
+	/**
+	* Runs the callbacks of all readbacks whose frames have completed and recycles their regions, meant to be called once per frame
+	*
+	* @param completedFrameNumber Number of the last frame that has finished executing on the device
+	*/
+	void update(uint64_t completedFrameNumber)
+	{
+		while (!requests.empty() && (requests.front().frameNumber <= completedFrameNumber)) {
+			Request& request = requests.front();
+			if (VulkanContext::device->memoryAllocator->isNonCoherent(buffer->allocation)) {
+				buffer->invalidate(request.size, request.offset);
+			}
+			request.callback(static_cast<const uint8_t*>(buffer->mapped) + request.offset, request.size);
+			used -= request.ringSize;
+			requests.pop_front();
+		}
+		if (used == 0) {
+			// Start over at the front to keep wrap-around padding low
+			head = 0;
+		}
+	}
+
+	VkDeviceSize getSize() const
+	{
+		return capacity;
+	}
+
+	uint32_t getPendingCount() const
+	{
+		return static_cast<uint32_t>(requests.size());
+	}
+};
@@ -0,0 +1,84 @@
+/*
+ * Device wide cache for samplers with the same state
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <cassert>
+#include "volk.h"
+#include "CacheKey.hpp"
+#include "VulkanTools.h"
+#include "VulkanContext.h"
+
+/**
+ * Owns samplers keyed on their full create info state, so textures with the same sampling parameters share one sampler
+ * Devices only support a limited number of samplers (maxSamplerAllocationCount, as low as 4000), which would otherwise be reached by large scenes with one sampler per texture
+ * Samplers live until the cache is destroyed, textures must not destroy the samplers they got from the cache
+ */
+class SamplerCache {
+private:
+	std::mutex mutex;
+	std::unordered_map<std::string, VkSampler> samplers;
+
+	// Members are appended one by one, as the create info contains padding and a pointer
+	static std::string getKey(const VkSamplerCreateInfo& createInfo)
+	{
+		std::string key;
+		appendValue(key, createInfo.flags);
+		appendValue(key, createInfo.magFilter);
+		appendValue(key, createInfo.minFilter);
+		appendValue(key, createInfo.mipmapMode);
+		appendValue(key, createInfo.addressModeU);
+		appendValue(key, createInfo.addressModeV);
+		appendValue(key, createInfo.addressModeW);
+		appendValue(key, createInfo.mipLodBias);
+		appendValue(key, createInfo.anisotropyEnable);
+		appendValue(key, createInfo.maxAnisotropy);
+		appendValue(key, createInfo.compareEnable);
+		appendValue(key, createInfo.compareOp);
+		appendValue(key, createInfo.minLod);
+		appendValue(key, createInfo.maxLod);
+		appendValue(key, createInfo.borderColor);
+		appendValue(key, createInfo.unnormalizedCoordinates);
+		return key;
+	}
+
+public:
+	~SamplerCache()
+	{
+		for (auto& [key, sampler] : samplers) {
+			vkDestroySampler(VulkanContext::device->logicalDevice, sampler, nullptr);
+		}
+	}
+
+	/** @brief Returns a sampler with the state of the create info, which is created on first use, can be called from any thread */
+	VkSampler get(const VkSamplerCreateInfo& createInfo)
+	{
+		// Extension structures (e.g. YCbCr conversion) would need to be part of the key
+		assert(createInfo.pNext == nullptr);
+		const std::string key = getKey(createInfo);
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = samplers.find(key);
+		if (it != samplers.end()) {
+			return it->second;
+		}
+		VkSampler sampler{ VK_NULL_HANDLE };
+		VK_CHECK_RESULT(vkCreateSampler(VulkanContext::device->logicalDevice, &createInfo, nullptr, &sampler));
+		samplers[key] = sampler;
+		return sampler;
+	}
+
+	// Number of distinct samplers
+	uint32_t size()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return static_cast<uint32_t>(samplers.size());
+	}
+};
@@ -0,0 +1,632 @@
+/*
+ * Persistently mapped staging ring buffer for uploads
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "volk.h"
+#include "Initializers.hpp"
+#include "VulkanTools.h"
+#include "Device.hpp"
+#include "Buffer.hpp"
+#include "SyncPool.hpp"
+#include "VulkanContext.h"
+
+struct StagingBufferCreateInfo {
+	VkDeviceSize size{ 64 * 1024 * 1024 };
+};
+
+/** @brief Part of the staging buffer that an upload can write its source data to */
+struct StagingRegion {
+	VkBuffer buffer{ VK_NULL_HANDLE };
+	// Offset into buffer, needs to be added to the source offset of copy commands
+	VkDeviceSize offset{ 0 };
+	VkDeviceSize size{ 0 };
+	void* mapped{ nullptr };
+};
+
+/**
+ * Single host visible buffer that uploads carve their source regions from in a ring
+ * Regions are handed to the GPU with the next submit and recycled once the fence of that submit has signaled, so uploads don't need to allocate, map or free any memory
+ * If a region doesn't fit even after waiting for all submissions (it's larger than the ring or unsubmitted regions fill it), the ring is replaced by one at least twice as large
+ * Regions belong to the thread that allocated them and are only handed to submits made by that thread, so uploads on other threads can't recycle regions that are still being written
+ * The ring only advances past regions in allocation order, so if threads' uploads finish out of order, space is reclaimed once all older regions have been recycled
+ *
+ * Uploads started with beginTransfer are recorded for the dedicated transfer queue (if present) and submitted without waiting
+ * Destination resources are released from the transfer queue family, the matching acquire barriers are recorded on the graphics queue by recordAcquireBarriers
+ * Graphics work using these resources needs to wait for the timeline semaphore value returned by recordAcquireBarriers
+ */
+class StagingBuffer {
+private:
+	struct Submission {
+		VkFence fence{ VK_NULL_HANDLE };
+		VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+		VkQueueFlagBits queueType{ VK_QUEUE_GRAPHICS_BIT };
+		// Ids of the ring allocations the submission copies from
+		std::vector<uint64_t> ringAllocations;
+	};
+
+	struct RingAllocation {
+		// Bytes (including padding) the allocation occupies in the ring
+		VkDeviceSize size{ 0 };
+		// Ring the allocation has been made from, only allocations from the current ring count towards its usage
+		Buffer* ring{ nullptr };
+		// Set once the submission copying from the allocation has finished
+		bool released{ false };
+	};
+
+	// Regions a thread allocated since its last submit
+	struct PendingRegions {
+		std::vector<uint64_t> ringAllocations;
+		// While upload batches of the thread are open, its regions are handed over with the submit that closes the last one instead of the next submit
+		uint32_t openBatches{ 0 };
+	};
+
+	Buffer* buffer{ nullptr };
+	VkDeviceSize capacity{ 0 };
+	VkDeviceSize head{ 0 };
+	VkDeviceSize used{ 0 };
+	// Live ring allocations in allocation order, the id of an allocation is its index plus firstRingAllocation
+	std::deque<RingAllocation> ringAllocations;
+	uint64_t firstRingAllocation{ 0 };
+	// Rings replaced by a larger one, deleted once all allocations made from them have been recycled
+	std::vector<Buffer*> previousRings;
+	std::unordered_map<std::thread::id, PendingRegions> pendingRegions;
+	std::deque<Submission> submissions;
+	// Command buffers of retired submissions, reused for later uploads instead of being freed and allocated again
+	std::vector<VkCommandBuffer> freeCommandBuffers[2];
+	std::recursive_mutex mutex;
+
+	// Signaled by transfer queue submissions
+	VkSemaphore timelineSemaphore{ VK_NULL_HANDLE };
+	uint64_t timelineValue{ 0 };
+	// Acquire barriers for graphics queue ownership of released resources
+	std::vector<VkBufferMemoryBarrier> pendingBufferAcquires;
+	std::vector<VkImageMemoryBarrier> pendingImageAcquires;
+	VkPipelineStageFlags pendingAcquireStageMask{ 0 };
+	// Resources shared by both queue families don't need acquire barriers, a memory barrier makes their uploads visible instead
+	VkAccessFlags pendingSharedAccessMask{ 0 };
+
+	bool useTransferQueue() const
+	{
+		return VulkanContext::device->hasDedicatedTransferQueue;
+	}
+
+	bool hasPendingAcquires() const
+	{
+		return !pendingBufferAcquires.empty() || !pendingImageAcquires.empty() || (pendingSharedAccessMask != 0);
+	}
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	static uint32_t getPoolIndex(VkQueueFlagBits queueType)
+	{
+		return (queueType == VK_QUEUE_TRANSFER_BIT) ? 1 : 0;
+	}
+
+	static VkCommandPool getCommandPool(VkQueueFlagBits queueType)
+	{
+		return (queueType == VK_QUEUE_TRANSFER_BIT) ? VulkanContext::device->commandPoolTransfer : VulkanContext::device->commandPool;
+	}
+
+	// Hands the regions the calling thread allocated since its last submit to submission, unless batches of the thread that may still copy from them are open
+	void claimPendingRegions(Submission& submission)
+	{
+		PendingRegions& pending = pendingRegions[std::this_thread::get_id()];
+		if (pending.openBatches > 0) {
+			return;
+		}
+		submission.ringAllocations = std::move(pending.ringAllocations);
+		pending.ringAllocations.clear();
+	}
+
+	// Releases the oldest submission, if wait is false only if its fence has already signaled
+	bool retireOldest(bool wait)
+	{
+		if (submissions.empty()) {
+			return false;
+		}
+		Submission& submission = submissions.front();
+		if (wait) {
+			VK_CHECK_RESULT(vkWaitForFences(VulkanContext::device->logicalDevice, 1, &submission.fence, VK_TRUE, UINT64_MAX));
+		} else if (vkGetFenceStatus(VulkanContext::device->logicalDevice, submission.fence) != VK_SUCCESS) {
+			return false;
+		}
+		freeCommandBuffers[getPoolIndex(submission.queueType)].push_back(submission.commandBuffer);
+		VulkanContext::syncPool->releaseFence(submission.fence);
+		for (uint64_t id : submission.ringAllocations) {
+			ringAllocations[id - firstRingAllocation].released = true;
+		}
+		submissions.pop_front();
+		while (!ringAllocations.empty() && ringAllocations.front().released) {
+			if (ringAllocations.front().ring == buffer) {
+				used -= ringAllocations.front().size;
+			}
+			ringAllocations.pop_front();
+			firstRingAllocation++;
+		}
+		// Allocations are recycled in order, so once the oldest one is from the current ring, previous rings aren't used anymore
+		if (!previousRings.empty() && (ringAllocations.empty() || (ringAllocations.front().ring == buffer))) {
+			for (Buffer* previousRing : previousRings) {
+				delete previousRing;
+			}
+			previousRings.clear();
+		}
+		if (ringAllocations.empty()) {
+			// Start over at the front to keep wrap-around padding low
+			head = 0;
+		}
+		return true;
+	}
+
+	void createRing(VkDeviceSize size)
+	{
+		capacity = size;
+		MemoryStats::Scope memoryScope(MemoryCategory::Staging);
+		buffer = new Buffer({
+			.name = "Staging ring buffer",
+			.usageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.size = capacity,
+			.map = true,
+			.dedicatedAllocation = true
+		});
+	}
+
+	// Replaces the ring with one that fits at least size bytes, allocations from the current ring stay valid until they have been recycled
+	void growRing(VkDeviceSize size)
+	{
+		if (ringAllocations.empty()) {
+			delete buffer;
+		} else {
+			previousRings.push_back(buffer);
+		}
+		createRing(std::max(capacity * 2, size));
+		head = 0;
+		used = 0;
+		std::cout << "Staging ring buffer grown to " << capacity / (1024 * 1024) << " MB\n";
+	}
+
+public:
+	StagingBuffer(StagingBufferCreateInfo createInfo)
+	{
+		createRing(createInfo.size);
+		VkSemaphoreTypeCreateInfo semaphoreTypeCI{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+			.initialValue = 0
+		};
+		VkSemaphoreCreateInfo semaphoreCI = vks::initializers::semaphoreCreateInfo();
+		semaphoreCI.pNext = &semaphoreTypeCI;
+		VK_CHECK_RESULT(vkCreateSemaphore(VulkanContext::device->logicalDevice, &semaphoreCI, nullptr, &timelineSemaphore));
+	}
+
+	~StagingBuffer()
+	{
+		while (retireOldest(true)) {}
+		for (Buffer* previousRing : previousRings) {
+			delete previousRing;
+		}
+		for (VkQueueFlagBits queueType : { VK_QUEUE_GRAPHICS_BIT, VK_QUEUE_TRANSFER_BIT }) {
+			std::vector<VkCommandBuffer>& commandBuffers = freeCommandBuffers[getPoolIndex(queueType)];
+			if (!commandBuffers.empty()) {
+				vkFreeCommandBuffers(VulkanContext::device->logicalDevice, getCommandPool(queueType), static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+			}
+		}
+		vkDestroySemaphore(VulkanContext::device->logicalDevice, timelineSemaphore, nullptr);
+		delete buffer;
+	}
+
+	/**
+	* Get a region of the staging buffer to write upload data to
+	*
+	* @param size Size of the region in bytes
+	* @param alignment (Optional) Alignment of the region's offset, needs to be a multiple of the texel block size for buffer to image copies
+	*
+	* @return Mapped region that stays valid until the fence of the calling thread's next submit has signaled
+	*
+	* @note Needs to be submitted by the thread that allocated it
+	* @note Blocks if the ring is full until older submissions have finished, grows the ring if that doesn't free enough space
+	*/
+	StagingRegion allocate(VkDeviceSize size, VkDeviceSize alignment = 16)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+
+		// Recycle everything the GPU is already done with
+		while (retireOldest(false)) {}
+
+		for (;;) {
+			VkDeviceSize offset = alignUp(head, alignment);
+			VkDeviceSize consumed = offset - head + size;
+			if (offset + size > capacity) {
+				// Skip the rest of the ring and start at the front
+				offset = 0;
+				consumed = capacity - head + size;
+			}
+			if (used + consumed <= capacity) {
+				head = offset + size;
+				used += consumed;
+				pendingRegions[std::this_thread::get_id()].ringAllocations.push_back(firstRingAllocation + ringAllocations.size());
+				ringAllocations.push_back({ .size = consumed, .ring = buffer });
+				return { .buffer = buffer->buffer, .offset = offset, .size = size, .mapped = static_cast<uint8_t*>(buffer->mapped) + offset };
+			}
+			// Once all submissions have finished, either the region is larger than the ring or unsubmitted regions fill it
+			if (!retireOldest(true)) {
+				growRing(size);
+			}
+		}
+	}
+
+	/**
+	* Start recording a one-shot upload command buffer, finish it with submit (or submitTransfer for the queue type of beginTransfer)
+	* Command buffers of finished submissions are reused, so uploads usually don't allocate command buffers
+	*
+	* @param queueType (Optional) Type of the queue the command buffer will be submitted to (Defaults to graphics)
+	*/
+	VkCommandBuffer beginCommandBuffer(VkQueueFlagBits queueType = VK_QUEUE_GRAPHICS_BIT)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		while (retireOldest(false)) {}
+		std::vector<VkCommandBuffer>& commandBuffers = freeCommandBuffers[getPoolIndex(queueType)];
+		if (commandBuffers.empty()) {
+			return VulkanContext::device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true, queueType);
+		}
+		VkCommandBuffer commandBuffer = commandBuffers.back();
+		commandBuffers.pop_back();
+		// The device's pools allow resetting single command buffers, beginning implicitly resets it
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+		return commandBuffer;
+	}
+
+	/**
+	* Finish command buffer recording and submit it to a queue, the regions the calling thread allocated since its last submit are recycled once it has finished executing
+	*
+	* @param commandBuffer Command buffer with the copy commands, from beginCommandBuffer for queueType
+	* @param queue Queue to submit the command buffer to
+	* @param wait (Optional) Wait for the submission to finish before returning (Defaults to true)
+	* @param queueType (Optional) Type of the queue, selects the pool the command buffer is recycled for (Defaults to graphics)
+	*/
+	void submit(VkCommandBuffer commandBuffer, VkQueue queue, bool wait = true, VkQueueFlagBits queueType = VK_QUEUE_GRAPHICS_BIT)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		Submission submission{
+			.fence = VulkanContext::syncPool->acquireFence(),
+			.commandBuffer = commandBuffer,
+			.queueType = queueType
+		};
+		claimPendingRegions(submission);
+
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		VK_CHECK_RESULT(VulkanContext::device->queueSubmit(queue, 1, &submitInfo, submission.fence));
+		submissions.push_back(std::move(submission));
+
+		if (wait) {
+			while (retireOldest(true)) {}
+		}
+	}
+	/** @brief Called by UploadBatch, regions the calling thread allocates while a batch is open stay in use until the batch has been submitted */
+	void beginBatch()
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		pendingRegions[std::this_thread::get_id()].openBatches++;
+	}
+
+	/**
+	* Closes a batch opened with beginBatch and submits its command buffer with submitTransfer
+	*
+	* @param commandBuffer Upload command buffer from beginTransfer, VK_NULL_HANDLE if nothing has been recorded
+	*
+	* @return Timeline semaphore value that is signaled once the upload has finished, 0 if nothing has been submitted
+	*/
+	uint64_t endBatch(VkCommandBuffer commandBuffer)
+	{
+		// Closed and submitted under the same lock, so no other submit takes over the batch's regions in between
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		PendingRegions& pending = pendingRegions[std::this_thread::get_id()];
+		assert(pending.openBatches > 0);
+		pending.openBatches--;
+		return (commandBuffer != VK_NULL_HANDLE) ? submitTransfer(commandBuffer) : 0;
+	}
+
+	/** @brief Start recording an upload for the transfer queue, finish it with submitTransfer */
+	VkCommandBuffer beginTransfer()
+	{
+		return beginCommandBuffer(useTransferQueue() ? VK_QUEUE_TRANSFER_BIT : VK_QUEUE_GRAPHICS_BIT);
+	}
+
+	/**
+	* Hand a buffer written by a transfer upload over to the graphics queue
+	*
+	* @param commandBuffer Upload command buffer from beginTransfer, recorded after the copies
+	* @param buffer Destination buffer of the copies
+	* @param dstAccessMask Access types the graphics queue will use the buffer for
+	* @param dstStageMask Pipeline stages the graphics queue will use the buffer in
+	*/
+	void releaseBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		VkBufferMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = dstAccessMask,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE
+		};
+		if (!useTransferQueue()) {
+			// Same queue, a regular barrier makes the copy visible to all later work
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+			return;
+		}
+		barrier.srcQueueFamilyIndex = VulkanContext::device->queueFamilyIndices.transfer;
+		barrier.dstQueueFamilyIndex = VulkanContext::device->queueFamilyIndices.graphics;
+		// Release, destination access is ignored on this side of the ownership transfer
+		VkBufferMemoryBarrier release = barrier;
+		release.dstAccessMask = 0;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+		barrier.srcAccessMask = 0;
+		pendingBufferAcquires.push_back(barrier);
+		pendingAcquireStageMask |= dstStageMask;
+	}
+
+	/**
+	* Hand an image written by a transfer upload over to the graphics queue
+	*
+	* @param commandBuffer Upload command buffer from beginTransfer, recorded after the copies
+	* @param image Destination image of the copies
+	* @param subresourceRange Subresources that have been written
+	* @param oldLayout Layout the image has been written in
+	* @param newLayout Layout the image will be used in
+	* @param dstAccessMask Access types the graphics queue will use the image for
+	* @param dstStageMask Pipeline stages the graphics queue will use the image in
+	*
+	* @note The layout transition is part of the ownership transfer and is executed only once
+	*/
+	void releaseImage(VkCommandBuffer commandBuffer, VkImage image, VkImageSubresourceRange subresourceRange, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		VkImageMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = dstAccessMask,
+			.oldLayout = oldLayout,
+			.newLayout = newLayout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image,
+			.subresourceRange = subresourceRange
+		};
+		if (!useTransferQueue()) {
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+			return;
+		}
+		barrier.srcQueueFamilyIndex = VulkanContext::device->queueFamilyIndices.transfer;
+		barrier.dstQueueFamilyIndex = VulkanContext::device->queueFamilyIndices.graphics;
+		VkImageMemoryBarrier release = barrier;
+		release.dstAccessMask = 0;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &release);
+		barrier.srcAccessMask = 0;
+		pendingImageAcquires.push_back(barrier);
+		pendingAcquireStageMask |= dstStageMask;
+	}
+
+	/**
+	* Make a range written by a transfer upload visible to the graphics queue, for buffers shared by both queue families (concurrent sharing mode)
+	* There's no ownership transfer, so other ranges of the buffer may be in use by the graphics queue at the same time
+	*
+	* @param commandBuffer Upload command buffer from beginTransfer, recorded after the copies
+	* @param buffer Destination buffer of the copies
+	* @param offset Start of the written range
+	* @param size Size of the written range
+	* @param dstAccessMask Access types the graphics queue will use the range for
+	* @param dstStageMask Pipeline stages the graphics queue will use the range in
+	*/
+	void releaseSharedBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		if (!useTransferQueue()) {
+			VkBufferMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = dstAccessMask,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.buffer = buffer,
+				.offset = offset,
+				.size = size
+			};
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+			return;
+		}
+		// The timeline semaphore makes the writes available, the graphics queue records the barrier after waiting for it
+		pendingSharedAccessMask |= dstAccessMask;
+		pendingAcquireStageMask |= dstStageMask;
+	}
+
+	/**
+	* Submit an upload started with beginTransfer without waiting for it to finish
+	*
+	* @param commandBuffer Upload command buffer from beginTransfer
+	*
+	* @return Timeline semaphore value that is signaled once the upload has finished
+	*/
+	uint64_t submitTransfer(VkCommandBuffer commandBuffer)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		const uint64_t signalValue = ++timelineValue;
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+			.signalSemaphoreValueCount = 1,
+			.pSignalSemaphoreValues = &signalValue
+		};
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.pNext = &timelineSubmitInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &timelineSemaphore;
+
+		Submission submission{
+			.fence = VulkanContext::syncPool->acquireFence(),
+			.commandBuffer = commandBuffer,
+			.queueType = useTransferQueue() ? VK_QUEUE_TRANSFER_BIT : VK_QUEUE_GRAPHICS_BIT
+		};
+		claimPendingRegions(submission);
+
+		VK_CHECK_RESULT(VulkanContext::device->queueSubmit(VulkanContext::copyQueue, 1, &submitInfo, submission.fence));
+		submissions.push_back(std::move(submission));
+		return signalValue;
+	}
+
+	/**
+	* Record the acquire barriers for all resources released by transfer uploads since the last call
+	*
+	* @param commandBuffer Graphics queue command buffer, needs to be submitted before any work using the uploaded resources
+	*
+	* @return Timeline semaphore value the submission of commandBuffer needs to wait for, 0 if nothing has been recorded
+	*/
+	uint64_t recordAcquireBarriers(VkCommandBuffer commandBuffer)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		if (!hasPendingAcquires()) {
+			return 0;
+		}
+		if (!pendingBufferAcquires.empty() || !pendingImageAcquires.empty()) {
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pendingAcquireStageMask, 0, 0, nullptr, static_cast<uint32_t>(pendingBufferAcquires.size()), pendingBufferAcquires.data(), static_cast<uint32_t>(pendingImageAcquires.size()), pendingImageAcquires.data());
+		}
+		if (pendingSharedAccessMask != 0) {
+			// Chained to the semaphore wait of the submission, which waits at all stages
+			VkMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+				.dstAccessMask = pendingSharedAccessMask
+			};
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, pendingAcquireStageMask, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+		pendingBufferAcquires.clear();
+		pendingImageAcquires.clear();
+		pendingAcquireStageMask = 0;
+		pendingSharedAccessMask = 0;
+		return timelineValue;
+	}
+
+	/** @brief Make all transfer uploads available to the graphics queue right away, for work that's submitted outside of the frame loop */
+	void flushTransfers(VkQueue graphicsQueue)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		if (!hasPendingAcquires()) {
+			return;
+		}
+		VkSemaphoreWaitInfo waitInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+			.semaphoreCount = 1,
+			.pSemaphores = &timelineSemaphore,
+			.pValues = &timelineValue
+		};
+		VK_CHECK_RESULT(vkWaitSemaphores(VulkanContext::device->logicalDevice, &waitInfo, UINT64_MAX));
+		VkCommandBuffer commandBuffer = beginCommandBuffer();
+		recordAcquireBarriers(commandBuffer);
+		submit(commandBuffer, graphicsQueue);
+	}
+
+	/** @brief Returns true once the transfer upload that returned timelineValue has finished on the device, doesn't block */
+	bool isComplete(uint64_t value) const
+	{
+		uint64_t completedValue{ 0 };
+		VK_CHECK_RESULT(vkGetSemaphoreCounterValue(VulkanContext::device->logicalDevice, timelineSemaphore, &completedValue));
+		return completedValue >= value;
+	}
+
+	VkSemaphore getTimelineSemaphore() const
+	{
+		return timelineSemaphore;
+	}
+};
+
+/**
+ * Collects the copies and layout transitions of several uploads (e.g. all buffers and textures of a model) into one transfer queue command buffer
+ * The batch is submitted once without waiting and signals a single timeline value for all of its uploads
+ * Other submits made by the same thread while the batch is open (e.g. a mipmap batch) don't recycle staging regions, as the batch may still copy from them
+ * Needs to be submitted by the thread that created it
+ */
+class UploadBatch {
+private:
+	VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+	// Upload timeline values of resources recorded into the batch, written on submit
+	std::vector<uint64_t*> timelineTargets;
+	bool open{ true };
+public:
+	UploadBatch()
+	{
+		VulkanContext::stagingBuffer->beginBatch();
+	}
+
+	~UploadBatch()
+	{
+		submit();
+	}
+
+	UploadBatch(const UploadBatch&) = delete;
+	UploadBatch& operator=(const UploadBatch&) = delete;
+
+	/** @brief Command buffer to record an upload into, begun with the first call, the copies' source regions need to be allocated from the staging buffer */
+	VkCommandBuffer getCommandBuffer()
+	{
+		assert(open);
+		if (commandBuffer == VK_NULL_HANDLE) {
+			commandBuffer = VulkanContext::stagingBuffer->beginTransfer();
+		}
+		return commandBuffer;
+	}
+
+	/** @brief Sets target to the batch's timeline value once it's submitted, for resources that track their own upload */
+	void addTimelineTarget(uint64_t* target)
+	{
+		timelineTargets.push_back(target);
+	}
+
+	/**
+	* Submits all recorded uploads to the transfer queue without waiting, called by the destructor if not called before
+	*
+	* @return Timeline semaphore value that is signaled once all uploads of the batch have finished, 0 if nothing has been recorded
+	*/
+	uint64_t submit()
+	{
+		if (!open) {
+			return 0;
+		}
+		open = false;
+		const uint64_t timelineValue = VulkanContext::stagingBuffer->endBatch(commandBuffer);
+		commandBuffer = VK_NULL_HANDLE;
+		for (uint64_t* target : timelineTargets) {
+			*target = timelineValue;
+		}
+		timelineTargets.clear();
+		return timelineValue;
+	}
+};
@@ -15,6 +15,8 @@
 #include <assert.h>
 #include <stdio.h>
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include <SFML/Window.hpp>
 #include "volk.h"
 #include "VulkanTools.h"
@@ -40,16 +42,52 @@ class SwapChain
 private: 
 	VkInstance instance;
 	Device& device;
-	VkSurfaceKHR surface;
+	VkSurfaceKHR surface{ VK_NULL_HANDLE };
+	// Memory of the offscreen images in headless mode
+	std::vector<MemoryAllocation> headlessAllocations;
+	// Signalled once the presents of the current swap chain no longer use their images (VK_EXT_swapchain_maintenance1), in present order
+	std::vector<VkFence> presentFences;
+	std::vector<VkFence> freePresentFences;
+	VkFence getPresentFence()
+	{
+		while (!presentFences.empty() && (vkGetFenceStatus(device, presentFences.front()) == VK_SUCCESS)) {
+			VK_CHECK_RESULT(vkResetFences(device, 1, &presentFences.front()));
+			freePresentFences.push_back(presentFences.front());
+			presentFences.erase(presentFences.begin());
+		}
+		VkFence fence{ VK_NULL_HANDLE };
+		if (!freePresentFences.empty()) {
+			fence = freePresentFences.back();
+			freePresentFences.pop_back();
+		} else {
+			VkFenceCreateInfo fenceCI{ .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+			VK_CHECK_RESULT(vkCreateFence(device, &fenceCI, nullptr, &fence));
+		}
+		presentFences.push_back(fence);
+		return fence;
+	}
 public:
 	VkFormat colorFormat;
 	VkColorSpaceKHR colorSpace;
+	// Usage the images have been created with, transfer usages depend on the surface's support
+	VkImageUsageFlags imageUsage{ 0 };
 	VkSwapchainKHR handle{ VK_NULL_HANDLE };
 	uint32_t imageCount;
 	std::vector<VkImage> images; // why? see swapchainbuffer which has image
 	std::vector<SwapChainBuffer> buffers;
 	uint32_t queueNodeIndex = UINT32_MAX; // @todo: rename to presentQueueFamilyIndex
 	uint32_t currentImageIndex = 0;
+	// Renders to a ring of offscreen images instead of presenting to a surface, see initHeadless
+	bool headless{ false };
+	// Set with a device group whose physical devices each present their own region of the surface (e.g. one projector per GPU)
+	bool multiDevicePresent{ false };
+	// Region of the images each physical device of the group presents with multiDevicePresent, empty for devices not connected to the surface
+	std::vector<VkRect2D> deviceRegions;
+	// Transform the images are presented with, anything but identity needs the application to render rotated (see getQuarterTurns)
+	VkSurfaceTransformFlagBitsKHR transform{ VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR };
+	// Called with a deleter for the swap chain replaced by create, so it can be destroyed once frames in flight are done with its images
+	// With VK_EXT_swapchain_maintenance1 the deleter also waits for the swap chain's presents, if not set the old swap chain is destroyed right away
+	std::function<void(std::function<void()>)> onSwapChainRetired;
 
 	SwapChain(SwapChainCreateInfo createInfo) : device(createInfo.device) {
 		instance = createInfo.instance;
@@ -57,17 +95,43 @@ public:
 	}
 
 	~SwapChain() {
-		if (handle != VK_NULL_HANDLE) {
-			for (uint32_t i = 0; i < imageCount; i++) {
+		if (!presentFences.empty()) {
+			VK_CHECK_RESULT(vkWaitForFences(device, static_cast<uint32_t>(presentFences.size()), presentFences.data(), VK_TRUE, UINT64_MAX));
+		}
+		for (VkFence fence : presentFences) {
+			vkDestroyFence(device, fence, nullptr);
+		}
+		for (VkFence fence : freePresentFences) {
+			vkDestroyFence(device, fence, nullptr);
+		}
+		if ((handle != VK_NULL_HANDLE) || headless) {
+			for (uint32_t i = 0; i < buffers.size(); i++) {
 				vkDestroyImageView(device, buffers[i].view, nullptr);
 			}
 		}
+		for (uint32_t i = 0; i < headlessAllocations.size(); i++) {
+			vkDestroyImage(device, images[i], nullptr);
+			device.memoryAllocator->free(headlessAllocations[i]);
+		}
 		if (surface != VK_NULL_HANDLE) {
 			vkDestroySwapchainKHR(device, handle, nullptr);
 			vkDestroySurfaceKHR(instance, surface, nullptr);
 		}
 	}
 
+	/**
+	* Sets up rendering without a window (e.g. for benchmarks on machines without a display), create then allocates a ring of offscreen images instead of a swap chain
+	* Acquiring only advances to the next image and nothing is presented, images are reused once the frame that last rendered to them has finished (see VulkanApplication::submitFrame)
+	*/
+	void initHeadless()
+	{
+		headless = true;
+		queueNodeIndex = device.queueFamilyIndices.graphics;
+		// Color attachment and transfer usage are mandatory for this format
+		colorFormat = VK_FORMAT_R8G8B8A8_SRGB;
+		colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+	}
+
 	/** @brief Creates the platform specific surface abstraction of the native platform window used for presentation */	
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
 	void initSurface(sf::WindowBase* window)
@@ -282,9 +346,15 @@ public:
 	* @param width Pointer to the width of the swapchain (may be adjusted to fit the requirements of the swapchain)
 	* @param height Pointer to the height of the swapchain (may be adjusted to fit the requirements of the swapchain)
 	* @param vsync (Optional) Can be used to force vsync'd rendering (by using VK_PRESENT_MODE_FIFO_KHR as presentation mode)
+	* @param lowLatency (Optional) Requests as few images as possible for vsync'd rendering, so fewer frames can queue up for presentation
 	*/
-	void create(uint32_t *width, uint32_t *height, bool vsync = false)
+	void create(uint32_t *width, uint32_t *height, bool vsync = false, bool lowLatency = false)
 	{
+		if (headless) {
+			createHeadlessImages(*width, *height);
+			return;
+		}
+
 		VkSwapchainKHR oldSwapchain = handle;
 
 		// Get physical device surface properties and formats
@@ -342,7 +412,11 @@ public:
 		}
 
 		// Determine the number of images
+		// Every image queued in FIFO mode adds a refresh interval of latency, mailbox replaces queued images and needs the additional one
 		uint32_t desiredNumberOfSwapchainImages = surfCaps.minImageCount + 1;
+		if (lowLatency && (swapchainPresentMode == VK_PRESENT_MODE_FIFO_KHR)) {
+			desiredNumberOfSwapchainImages = std::max(surfCaps.minImageCount, 2u);
+		}
 		if ((surfCaps.maxImageCount > 0) && (desiredNumberOfSwapchainImages > surfCaps.maxImageCount))
 		{
 			desiredNumberOfSwapchainImages = surfCaps.maxImageCount;
@@ -350,6 +424,21 @@ public:
 
 		// Find the transformation of the surface
 		VkSurfaceTransformFlagsKHR preTransform;
+#if defined(__ANDROID__)
+		// Presenting with the display's current rotation lets the images be scanned out as they are, otherwise the compositor rotates each one with an additional full screen pass
+		// The images then have the display's native orientation, so the extent reported for the rotated surface is swapped back
+		const VkSurfaceTransformFlagsKHR rotations = VK_SURFACE_TRANSFORM_ROTATE_90_BIT_KHR | VK_SURFACE_TRANSFORM_ROTATE_180_BIT_KHR | VK_SURFACE_TRANSFORM_ROTATE_270_BIT_KHR;
+		if ((surfCaps.currentTransform & rotations) && (surfCaps.supportedTransforms & surfCaps.currentTransform))
+		{
+			preTransform = surfCaps.currentTransform;
+			if (surfCaps.currentTransform & (VK_SURFACE_TRANSFORM_ROTATE_90_BIT_KHR | VK_SURFACE_TRANSFORM_ROTATE_270_BIT_KHR)) {
+				std::swap(swapchainExtent.width, swapchainExtent.height);
+				*width = swapchainExtent.width;
+				*height = swapchainExtent.height;
+			}
+		}
+		else
+#endif
 		if (surfCaps.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
 		{
 			// We prefer a non-rotated transform
@@ -359,6 +448,7 @@ public:
 		{
 			preTransform = surfCaps.currentTransform;
 		}
+		transform = static_cast<VkSurfaceTransformFlagBitsKHR>(preTransform);
 
 		// Find a supported composite alpha format (not all devices support alpha opaque)
 		VkCompositeAlphaFlagBitsKHR compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
@@ -376,9 +466,50 @@ public:
 			};
 		}
 
+		// Each physical device of a group presents the part of the surface that's on its displays, so none of them needs the full image
+		multiDevicePresent = false;
+		deviceRegions.clear();
+		if (device.hasDeviceGroup) {
+			VkDeviceGroupPresentModeFlagsKHR presentModes{ 0 };
+			VK_CHECK_RESULT(vkGetDeviceGroupSurfacePresentModesKHR(device, surface, &presentModes));
+			multiDevicePresent = (presentModes & VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_MULTI_DEVICE_BIT_KHR) != 0;
+		}
+		if (multiDevicePresent) {
+			for (VkPhysicalDevice groupDevice : device.groupDevices) {
+				uint32_t rectCount = 0;
+				VK_CHECK_RESULT(vkGetPhysicalDevicePresentRectanglesKHR(groupDevice, surface, &rectCount, nullptr));
+				std::vector<VkRect2D> rects(rectCount);
+				VK_CHECK_RESULT(vkGetPhysicalDevicePresentRectanglesKHR(groupDevice, surface, &rectCount, rects.data()));
+				// Rectangles of a device are combined, as rendering is split into one region per device
+				VkRect2D region{};
+				for (uint32_t i = 0; i < rectCount; i++) {
+					const int32_t x0 = std::max(rects[i].offset.x, 0);
+					const int32_t y0 = std::max(rects[i].offset.y, 0);
+					const int32_t x1 = std::min(rects[i].offset.x + static_cast<int32_t>(rects[i].extent.width), static_cast<int32_t>(swapchainExtent.width));
+					const int32_t y1 = std::min(rects[i].offset.y + static_cast<int32_t>(rects[i].extent.height), static_cast<int32_t>(swapchainExtent.height));
+					if ((x1 <= x0) || (y1 <= y0)) {
+						continue;
+					}
+					if (region.extent.width == 0) {
+						region = { { x0, y0 }, { static_cast<uint32_t>(x1 - x0), static_cast<uint32_t>(y1 - y0) } };
+					} else {
+						const int32_t rx1 = std::max(region.offset.x + static_cast<int32_t>(region.extent.width), x1);
+						const int32_t ry1 = std::max(region.offset.y + static_cast<int32_t>(region.extent.height), y1);
+						region.offset = { std::min(region.offset.x, x0), std::min(region.offset.y, y0) };
+						region.extent = { static_cast<uint32_t>(rx1 - region.offset.x), static_cast<uint32_t>(ry1 - region.offset.y) };
+					}
+				}
+				deviceRegions.push_back(region);
+			}
+		}
+		const VkDeviceGroupSwapchainCreateInfoKHR deviceGroupSwapchainCI{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SWAPCHAIN_CREATE_INFO_KHR,
+			.modes = VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_MULTI_DEVICE_BIT_KHR
+		};
+
 		VkSwapchainCreateInfoKHR swapchainCI = {};
 		swapchainCI.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-		swapchainCI.pNext = NULL;
+		swapchainCI.pNext = multiDevicePresent ? &deviceGroupSwapchainCI : nullptr;
 		swapchainCI.surface = surface;
 		swapchainCI.minImageCount = desiredNumberOfSwapchainImages;
 		swapchainCI.imageFormat = colorFormat;
@@ -405,16 +536,35 @@ public:
 		if (surfCaps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) {
 			swapchainCI.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 		}
+		imageUsage = swapchainCI.imageUsage;
 
 		VK_CHECK_RESULT(vkCreateSwapchainKHR(device, &swapchainCI, nullptr, &handle));
 
 		// If an existing swap chain is re-created, destroy the old swap chain
 		// This also cleans up all the presentable images
 		if (oldSwapchain != VK_NULL_HANDLE)  { 
+			std::vector<VkImageView> oldViews;
 			for (uint32_t i = 0; i < imageCount; i++) {
-				vkDestroyImageView(device, buffers[i].view, nullptr);
+				oldViews.push_back(buffers[i].view);
+			}
+			auto deleter = [device = device.logicalDevice, oldSwapchain, oldViews, oldPresentFences = std::move(presentFences)] {
+				if (!oldPresentFences.empty()) {
+					VK_CHECK_RESULT(vkWaitForFences(device, static_cast<uint32_t>(oldPresentFences.size()), oldPresentFences.data(), VK_TRUE, UINT64_MAX));
+				}
+				for (VkFence fence : oldPresentFences) {
+					vkDestroyFence(device, fence, nullptr);
+				}
+				for (VkImageView view : oldViews) {
+					vkDestroyImageView(device, view, nullptr);
+				}
+				vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+			};
+			presentFences.clear();
+			if (onSwapChainRetired) {
+				onSwapChainRetired(std::move(deleter));
+			} else {
+				deleter();
 			}
-			vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
 		}
 		VK_CHECK_RESULT(vkGetSwapchainImagesKHR(device, handle, &imageCount, NULL));
 
@@ -464,8 +614,24 @@ public:
 	*/
 	VkResult acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t *imageIndex)
 	{
+		// Offscreen images can be rendered to right away, the semaphore isn't signalled
+		if (headless) {
+			*imageIndex = (*imageIndex + 1) % imageCount;
+			return VK_SUCCESS;
+		}
 		// By setting timeout to UINT64_MAX we will always wait until the next image has been acquired or an actual error is thrown
 		// With that we don't have to handle VK_NOT_READY
+		if (multiDevicePresent) {
+			// The image needs to be available to all devices that render and present their region of it
+			const VkAcquireNextImageInfoKHR acquireInfo{
+				.sType = VK_STRUCTURE_TYPE_ACQUIRE_NEXT_IMAGE_INFO_KHR,
+				.swapchain = handle,
+				.timeout = UINT64_MAX,
+				.semaphore = presentCompleteSemaphore,
+				.deviceMask = device.getDeviceMask()
+			};
+			return vkAcquireNextImage2KHR(device, &acquireInfo, imageIndex);
+		}
 		return vkAcquireNextImageKHR(device, handle, UINT64_MAX, presentCompleteSemaphore, (VkFence)nullptr, imageIndex);
 	}
 
@@ -475,14 +641,55 @@ public:
 	* @param queue Presentation queue for presenting the image
 	* @param imageIndex Index of the swapchain image to queue for presentation
 	* @param waitSemaphore (Optional) Semaphore that is waited on before the image is presented (only used if != VK_NULL_HANDLE)
+	* @param presentId (Optional) Identifies the present for waitForPresent, must be increasing for each swap chain (only used if != 0 and the device has present wait enabled)
+	* @param timingId (Optional) Identifies the present in getPastPresentationTimings (only used if != 0 and the device has display timing enabled)
 	*
 	* @return VkResult of the queue presentation
 	*/
-	VkResult queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore = VK_NULL_HANDLE)
+	VkResult queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore = VK_NULL_HANDLE, uint64_t presentId = 0, uint32_t timingId = 0)
 	{
+		if (headless) {
+			return VK_SUCCESS;
+		}
+		VkPresentIdKHR presentIdInfo{
+			.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+			.swapchainCount = 1,
+			.pPresentIds = &presentId
+		};
+		void* presentChain = ((presentId != 0) && device.hasPresentWait) ? &presentIdInfo : nullptr;
+		// No desired present time, images are presented as with regular presents
+		const VkPresentTimeGOOGLE presentTime{ .presentID = timingId, .desiredPresentTime = 0 };
+		VkPresentTimesInfoGOOGLE presentTimesInfo{
+			.sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
+			.pNext = presentChain,
+			.swapchainCount = 1,
+			.pTimes = &presentTime
+		};
+		if ((timingId != 0) && device.hasDisplayTiming) {
+			presentChain = &presentTimesInfo;
+		}
+		// Each device presents its own instance of the image, which only has its region rendered
+		const uint32_t deviceMask = device.getDeviceMask();
+		VkDeviceGroupPresentInfoKHR deviceGroupPresentInfo{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_INFO_KHR,
+			.pNext = presentChain,
+			.swapchainCount = 1,
+			.pDeviceMasks = &deviceMask,
+			.mode = VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_MULTI_DEVICE_BIT_KHR
+		};
+		if (multiDevicePresent) {
+			presentChain = &deviceGroupPresentInfo;
+		}
+		const VkFence presentFence = device.hasSwapchainMaintenance1 ? getPresentFence() : VK_NULL_HANDLE;
+		VkSwapchainPresentFenceInfoEXT presentFenceInfo{
+			.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT,
+			.pNext = presentChain,
+			.swapchainCount = 1,
+			.pFences = &presentFence
+		};
 		VkPresentInfoKHR presentInfo = {};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-		presentInfo.pNext = NULL;
+		presentInfo.pNext = device.hasSwapchainMaintenance1 ? &presentFenceInfo : presentChain;
 		presentInfo.swapchainCount = 1;
 		presentInfo.pSwapchains = &handle;
 		presentInfo.pImageIndices = &imageIndex;
@@ -495,6 +702,123 @@ public:
 		return vkQueuePresentKHR(queue, &presentInfo);
 	}
 
+	/**
+	* Waits until the image queued with the given present id (or a later one) is visible on the display
+	*
+	* @param presentId Id passed to queuePresent
+	* @param timeout Timeout in nanoseconds
+	*
+	* @return VK_SUCCESS once the image is presented, VK_TIMEOUT if the timeout expired, VK_ERROR_OUT_OF_DATE_KHR if the swap chain needs to be recreated
+	*/
+	VkResult waitForPresent(uint64_t presentId, uint64_t timeout)
+	{
+		assert(device.hasPresentWait && !headless);
+		return vkWaitForPresentKHR(device, handle, presentId, timeout);
+	}
+
+	/**
+	* Gets the timings of presents that completed since the last call, in the order they were presented
+	* Presents that were never displayed (e.g. replaced by a later one in mailbox mode) are discarded by the implementation
+	*
+	* @param timings Receives the timings, cleared first
+	*/
+	void getPastPresentationTimings(std::vector<VkPastPresentationTimingGOOGLE>& timings)
+	{
+		timings.clear();
+		if (headless || !device.hasDisplayTiming) {
+			return;
+		}
+		uint32_t count = 0;
+		if ((vkGetPastPresentationTimingGOOGLE(device, handle, &count, nullptr) != VK_SUCCESS) || (count == 0)) {
+			return;
+		}
+		timings.resize(count);
+		// Presents that completed in between are returned by the next call
+		const VkResult result = vkGetPastPresentationTimingGOOGLE(device, handle, &count, timings.data());
+		timings.resize(((result == VK_SUCCESS) || (result == VK_INCOMPLETE)) ? count : 0);
+	}
+
+	// Nanoseconds per refresh cycle of the display, zero if unknown
+	uint64_t getRefreshCycleDuration()
+	{
+		VkRefreshCycleDurationGOOGLE refreshCycle{};
+		if (headless || !device.hasDisplayTiming || (vkGetRefreshCycleDurationGOOGLE(device, handle, &refreshCycle) != VK_SUCCESS)) {
+			return 0;
+		}
+		return refreshCycle.refreshDuration;
+	}
+
+	// Enough images for the frames in flight and the one that was rendered last, e.g. for screenshots
+	static constexpr uint32_t headlessImageCount = 3;
+
+	// Clockwise quarter turns the presentation engine rotates the images by, the rendered image needs to be rotated the other way
+	uint32_t getQuarterTurns() const
+	{
+		switch (transform) {
+		case VK_SURFACE_TRANSFORM_ROTATE_90_BIT_KHR:
+			return 1;
+		case VK_SURFACE_TRANSFORM_ROTATE_180_BIT_KHR:
+			return 2;
+		case VK_SURFACE_TRANSFORM_ROTATE_270_BIT_KHR:
+			return 3;
+		default:
+			return 0;
+		}
+	}
+
+	void createHeadlessImages(uint32_t width, uint32_t height)
+	{
+		// Images of the previous size may still be used by frames in flight
+		if (!headlessAllocations.empty()) {
+			auto deleter = [&device = device, oldImages = images, oldBuffers = buffers, oldAllocations = headlessAllocations]() mutable {
+				for (uint32_t i = 0; i < oldAllocations.size(); i++) {
+					vkDestroyImageView(device, oldBuffers[i].view, nullptr);
+					vkDestroyImage(device, oldImages[i], nullptr);
+					device.memoryAllocator->free(oldAllocations[i]);
+				}
+			};
+			if (onSwapChainRetired) {
+				onSwapChainRetired(std::move(deleter));
+			} else {
+				deleter();
+			}
+		}
+		imageCount = headlessImageCount;
+		imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		images.resize(imageCount);
+		buffers.resize(imageCount);
+		headlessAllocations.resize(imageCount);
+		for (uint32_t i = 0; i < imageCount; i++) {
+			VkImageCreateInfo imageCI{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+				.imageType = VK_IMAGE_TYPE_2D,
+				.format = colorFormat,
+				.extent = { width, height, 1 },
+				.mipLevels = 1,
+				.arrayLayers = 1,
+				.samples = VK_SAMPLE_COUNT_1_BIT,
+				.tiling = VK_IMAGE_TILING_OPTIMAL,
+				.usage = imageUsage,
+				.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+				.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+			};
+			VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &images[i]));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device, images[i], &memReqs);
+			headlessAllocations[i] = device.memoryAllocator->allocate(memReqs, device.getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), false);
+			VK_CHECK_RESULT(vkBindImageMemory(device, images[i], headlessAllocations[i].memory, headlessAllocations[i].offset));
+			VkImageViewCreateInfo viewCI{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.image = images[i],
+				.viewType = VK_IMAGE_VIEW_TYPE_2D,
+				.format = colorFormat,
+				.subresourceRange = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 }
+			};
+			buffers[i].image = images[i];
+			VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &buffers[i].view));
+		}
+	}
+
 
 #if defined(_DIRECT2DISPLAY)
 	/**
@@ -0,0 +1,131 @@
+/*
+ * Device wide pool of reusable fences and semaphores
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include "volk.h"
+#include "Initializers.hpp"
+#include "VulkanTools.h"
+#include "VulkanContext.h"
+
+/** @brief Completion of a submit made with SyncPool::submit, the fence goes back to the pool once the submit has been found to be complete */
+struct SubmitToken {
+	VkFence fence{ VK_NULL_HANDLE };
+};
+
+/**
+ * Hands out fences and binary semaphores that are returned instead of destroyed, so one-shot submits (e.g. uploads and setup work) don't create and destroy sync objects every time
+ * Fences are always handed out unsignaled, semaphores must only be returned once the wait on them has completed
+ * All functions can be called from any thread
+ */
+class SyncPool {
+private:
+	std::mutex mutex;
+	std::vector<VkFence> fences;
+	std::vector<VkFence> freeFences;
+	std::vector<VkSemaphore> semaphores;
+	std::vector<VkSemaphore> freeSemaphores;
+
+public:
+	~SyncPool()
+	{
+		for (VkFence fence : fences) {
+			vkDestroyFence(VulkanContext::device->logicalDevice, fence, nullptr);
+		}
+		for (VkSemaphore semaphore : semaphores) {
+			vkDestroySemaphore(VulkanContext::device->logicalDevice, semaphore, nullptr);
+		}
+	}
+
+	VkFence acquireFence()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!freeFences.empty()) {
+			VkFence fence = freeFences.back();
+			freeFences.pop_back();
+			return fence;
+		}
+		VkFenceCreateInfo fenceCI = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+		VkFence fence{ VK_NULL_HANDLE };
+		VK_CHECK_RESULT(vkCreateFence(VulkanContext::device->logicalDevice, &fenceCI, nullptr, &fence));
+		fences.push_back(fence);
+		return fence;
+	}
+
+	/** @brief Returns a fence that's no longer used by any pending submit, it's reset right away */
+	void releaseFence(VkFence fence)
+	{
+		VK_CHECK_RESULT(vkResetFences(VulkanContext::device->logicalDevice, 1, &fence));
+		std::lock_guard<std::mutex> lock(mutex);
+		freeFences.push_back(fence);
+	}
+
+	VkSemaphore acquireSemaphore()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!freeSemaphores.empty()) {
+			VkSemaphore semaphore = freeSemaphores.back();
+			freeSemaphores.pop_back();
+			return semaphore;
+		}
+		VkSemaphoreCreateInfo semaphoreCI = vks::initializers::semaphoreCreateInfo();
+		VkSemaphore semaphore{ VK_NULL_HANDLE };
+		VK_CHECK_RESULT(vkCreateSemaphore(VulkanContext::device->logicalDevice, &semaphoreCI, nullptr, &semaphore));
+		semaphores.push_back(semaphore);
+		return semaphore;
+	}
+
+	/** @brief Returns a binary semaphore, the submit waiting on it needs to have completed (so it's unsignaled again) */
+	void releaseSemaphore(VkSemaphore semaphore)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		freeSemaphores.push_back(semaphore);
+	}
+
+	/**
+	* Submit work to a queue without waiting for it
+	*
+	* @param queue Queue to submit to (access to the queue needs to be synchronized by the caller)
+	* @param submitInfo Work to submit, must not contain a fence
+	*
+	* @return Token to poll with isComplete or to wait on with wait, one of them needs to report completion for the fence to be returned to the pool
+	*/
+	SubmitToken submit(VkQueue queue, const VkSubmitInfo& submitInfo)
+	{
+		SubmitToken token{ .fence = acquireFence() };
+		VK_CHECK_RESULT(VulkanContext::device->queueSubmit(queue, 1, &submitInfo, token.fence));
+		return token;
+	}
+
+	/** @brief Returns true once the submit has finished executing, doesn't block */
+	bool isComplete(SubmitToken& token)
+	{
+		if (token.fence == VK_NULL_HANDLE) {
+			return true;
+		}
+		if (vkGetFenceStatus(VulkanContext::device->logicalDevice, token.fence) != VK_SUCCESS) {
+			return false;
+		}
+		releaseFence(token.fence);
+		token.fence = VK_NULL_HANDLE;
+		return true;
+	}
+
+	/** @brief Blocks until the submit has finished executing */
+	void wait(SubmitToken& token, uint64_t timeout = DEFAULT_FENCE_TIMEOUT)
+	{
+		if (token.fence == VK_NULL_HANDLE) {
+			return;
+		}
+		VK_CHECK_RESULT(vkWaitForFences(VulkanContext::device->logicalDevice, 1, &token.fence, VK_TRUE, timeout));
+		releaseFence(token.fence);
+		token.fence = VK_NULL_HANDLE;
+	}
+};
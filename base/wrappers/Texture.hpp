@@ -21,6 +21,11 @@
 #include "VulkanTools.h"
 #include "Device.hpp"
 #include "VulkanContext.h"
+#include "StagingBuffer.hpp"
+#include "SamplerCache.hpp"
+#include "KTX2Loader.h"
+#include "VirtualFileSystem.h"
+#include "JobSystem.hpp"
 
 #if defined(__ANDROID__)
 #include <android/asset_manager.h>
@@ -40,8 +45,14 @@ namespace vks
 		VkSamplerAddressMode addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 		VkSamplerAddressMode addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 		VkSamplerAddressMode addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		// Used to transcode the images of Basis Universal KTX2 files in parallel, if not set these are transcoded on the calling thread
+		JobSystem* jobSystem{ nullptr };
+		// (Optional) Records the upload into the batch instead of submitting it right away, uploadTimelineValue is set once the batch has been submitted
+		UploadBatch* uploadBatch{ nullptr };
 	};
 
+	class MipmapBatch;
+
 	struct TextureFromBufferCreateInfo {
 		void* buffer;
 		VkDeviceSize bufferSize;
@@ -57,6 +68,119 @@ namespace vks
 		VkSamplerAddressMode addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 		VkSamplerAddressMode addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 		VkSamplerAddressMode addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		// Optional, if set the upload and mip chain generation are deferred until the batch is submitted, the buffer needs to stay valid until then
+		MipmapBatch* mipmapBatch{ nullptr };
+	};
+
+	/**
+	 * Uploads textures created from buffers and generates their mip chains with blits, all recorded into a single graphics queue command buffer
+	 * The blits of a level are issued for all textures at once, so each level only needs one barrier for all images instead of two per image
+	 * The submission doesn't wait, later graphics queue work is ordered after it by the final barrier
+	 */
+	class MipmapBatch {
+	private:
+		struct Image {
+			VkImage image;
+			uint32_t width;
+			uint32_t height;
+			uint32_t mipLevels;
+			uint32_t layer;
+			const void* data;
+			VkDeviceSize size;
+		};
+		std::vector<Image> images;
+
+		static VkImageMemoryBarrier levelBarrier(VkImage image, uint32_t layer, uint32_t baseLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+		{
+			VkImageMemoryBarrier barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+			barrier.srcAccessMask = srcAccessMask;
+			barrier.dstAccessMask = dstAccessMask;
+			barrier.oldLayout = oldLayout;
+			barrier.newLayout = newLayout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = image;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, layer, 1 };
+			return barrier;
+		}
+	public:
+		/**
+		* Adds an image to the batch, its first level is uploaded from data and the others are generated from it
+		* The layers of array images are added one at a time, each one gets its own mip chain
+		*
+		* @note data is only read by submit, staging regions are handed to the GPU with the next submit of the staging buffer, so they can't be allocated before
+		*/
+		void add(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const void* data, VkDeviceSize size, uint32_t layer = 0)
+		{
+			images.push_back({ .image = image, .width = width, .height = height, .mipLevels = mipLevels, .layer = layer, .data = data, .size = size });
+		}
+
+		bool empty() const
+		{
+			return images.empty();
+		}
+
+		/** @brief Records the uploads and mip chains of all added images and submits them to the graphics queue */
+		void submit()
+		{
+			if (images.empty()) {
+				return;
+			}
+			VkCommandBuffer commandBuffer = VulkanContext::stagingBuffer->beginCommandBuffer();
+			std::vector<VkImageMemoryBarrier> barriers;
+			uint32_t maxLevels = 0;
+
+			for (const Image& image : images) {
+				barriers.push_back(levelBarrier(image.image, image.layer, 0, image.mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT));
+				maxLevels = std::max(maxLevels, image.mipLevels);
+			}
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+			for (const Image& image : images) {
+				StagingRegion staging = VulkanContext::stagingBuffer->allocate(image.size);
+				memcpy(staging.mapped, image.data, image.size);
+				VkBufferImageCopy bufferCopyRegion{};
+				bufferCopyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, image.layer, 1 };
+				bufferCopyRegion.imageExtent = { image.width, image.height, 1 };
+				bufferCopyRegion.bufferOffset = staging.offset;
+				vkCmdCopyBufferToImage(commandBuffer, staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+			}
+
+			// Each level is generated from the previous one, which becomes a blit source once it has been written
+			for (uint32_t level = 1; level < maxLevels; level++) {
+				barriers.clear();
+				for (const Image& image : images) {
+					if (level < image.mipLevels) {
+						barriers.push_back(levelBarrier(image.image, image.layer, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT));
+					}
+				}
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+				for (const Image& image : images) {
+					if (level >= image.mipLevels) {
+						continue;
+					}
+					VkImageBlit imageBlit{};
+					imageBlit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, image.layer, 1 };
+					imageBlit.srcOffsets[1] = { int32_t(std::max(image.width >> (level - 1), 1u)), int32_t(std::max(image.height >> (level - 1), 1u)), 1 };
+					imageBlit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, image.layer, 1 };
+					imageBlit.dstOffsets[1] = { int32_t(std::max(image.width >> level, 1u)), int32_t(std::max(image.height >> level, 1u)), 1 };
+					vkCmdBlitImage(commandBuffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+				}
+			}
+
+			// All levels but the last one are blit sources at this point
+			barriers.clear();
+			for (const Image& image : images) {
+				if (image.mipLevels > 1) {
+					barriers.push_back(levelBarrier(image.image, image.layer, 0, image.mipLevels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT));
+				}
+				barriers.push_back(levelBarrier(image.image, image.layer, image.mipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+			}
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+			VulkanContext::stagingBuffer->submit(commandBuffer, VulkanContext::graphicsQueue, false);
+			images.clear();
+		}
 	};
 
 	/** @brief Vulkan texture base class */
@@ -64,13 +188,21 @@ namespace vks
 	public:
 		VkImage image = VK_NULL_HANDLE;
 		VkImageLayout imageLayout;
-		VkDeviceMemory deviceMemory;
+		MemoryAllocation allocation{};
 		VkImageView view;
 		uint32_t width, height;
 		uint32_t mipLevels;
 		uint32_t layerCount;
 		VkDescriptorImageInfo descriptor;
-		VkSampler sampler;
+		// Owned by the sampler cache
+		VkSampler sampler{ VK_NULL_HANDLE };
+		// Timeline value of the transfer upload, the texture can be used once the staging buffer reports it as complete
+		uint64_t uploadTimelineValue{ 0 };
+		// Properties of the image needed to create a copy of it, usage is 0 for textures whose image has been created outside of the texture classes
+		VkFormat format{ VK_FORMAT_UNDEFINED };
+		VkImageUsageFlags usage{ 0 };
+		VkImageCreateFlags imageFlags{ 0 };
+		VkImageViewType viewType{ VK_IMAGE_VIEW_TYPE_2D };
 
 		void updateDescriptor()
 		{
@@ -83,14 +215,69 @@ namespace vks
 		{
 			vkDestroyImageView(VulkanContext::device->logicalDevice, view, nullptr);
 			vkDestroyImage(VulkanContext::device->logicalDevice, image, nullptr);
-			if (sampler)
-			{
-				vkDestroySampler(VulkanContext::device->logicalDevice, sampler, nullptr);
+			VulkanContext::device->memoryAllocator->free(allocation);
+		}
+
+		/**
+		* Creates a texture with the same images in newly allocated memory, e.g. to move it out of a sparsely used memory block
+		* The copy is recorded into the command buffer, which needs to be executed on the graphics queue, both textures are back in the texture's layout afterwards
+		* The texture's upload needs to have been acquired by the graphics queue before the command buffer executes
+		*
+		* @param commandBuffer Command buffer to record the copy into, previous accesses to the texture on the same queue are waited for
+		*
+		* @return The copy sharing the texture's sampler, null if the texture's image can't be copied
+		*/
+		Texture* createCopy(VkCommandBuffer commandBuffer) const
+		{
+			const VkImageUsageFlags copyUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			if ((usage & copyUsage) != copyUsage) {
+				return nullptr;
 			}
-			vkFreeMemory(VulkanContext::device->logicalDevice, deviceMemory, nullptr);
+			Texture* copy = new Texture(*this);
+			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+			imageCreateInfo.flags = imageFlags;
+			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageCreateInfo.format = format;
+			imageCreateInfo.extent = { width, height, 1 };
+			imageCreateInfo.mipLevels = mipLevels;
+			imageCreateInfo.arrayLayers = layerCount;
+			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageCreateInfo.usage = usage;
+			VK_CHECK_RESULT(vkCreateImage(VulkanContext::device->logicalDevice, &imageCreateInfo, nullptr, &copy->image));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(VulkanContext::device->logicalDevice, copy->image, &memReqs);
+			MemoryStats::Scope memoryScope(allocation.category);
+			copy->allocation = VulkanContext::device->memoryAllocator->allocate(memReqs, VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), false);
+			VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, copy->image, copy->allocation.memory, copy->allocation.offset));
+
+			const VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, layerCount };
+			vks::tools::setImageLayout(commandBuffer, image, imageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange);
+			vks::tools::setImageLayout(commandBuffer, copy->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+			std::vector<VkImageCopy> regions(mipLevels);
+			for (uint32_t i = 0; i < mipLevels; i++) {
+				const VkImageSubresourceLayers subresource{ VK_IMAGE_ASPECT_COLOR_BIT, i, 0, layerCount };
+				regions[i] = { .srcSubresource = subresource, .dstSubresource = subresource, .extent = { std::max(width >> i, 1u), std::max(height >> i, 1u), 1 } };
+			}
+			vkCmdCopyImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, copy->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+			vks::tools::setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, imageLayout, subresourceRange);
+			vks::tools::setImageLayout(commandBuffer, copy->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, subresourceRange);
+
+			VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
+			viewCreateInfo.viewType = viewType;
+			viewCreateInfo.format = format;
+			viewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+			viewCreateInfo.subresourceRange = subresourceRange;
+			viewCreateInfo.image = copy->image;
+			VK_CHECK_RESULT(vkCreateImageView(VulkanContext::device->logicalDevice, &viewCreateInfo, nullptr, &copy->view));
+			// Keeps the completed upload value of the texture, so the copy can be told apart from textures that are still being uploaded
+			copy->updateDescriptor();
+			return copy;
 		}
 
-		ktxResult loadKTXFile(std::string filename, ktxTexture **target)
+		static ktxResult loadKTXFile(std::string filename, ktxTexture **target)
 		{
 			ktxResult result = KTX_SUCCESS;
 #if defined(__ANDROID__)
@@ -106,76 +293,147 @@ namespace vks
 			result = ktxTexture_CreateFromMemory(textureData, size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, target);
 			delete[] textureData;
 #else
-			if (!vks::tools::fileExists(filename)) {
+			// Read through the virtual file system, so the file may also come from an asset archive
+			const auto file = vfs::open(filename);
+			if (!file) {
 				vks::tools::exitFatal("Could not load texture from " + filename + "\n\nThe file may be part of the additional asset pack.\n\nRun \"download_assets.py\" in the repository root to download the latest version.", -1);
 			}
-			result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, target);			
+			result = ktxTexture_CreateFromMemory(file->data(), file->size(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, target);
 #endif		
 			return result;
 		}
-	};
 
-	class Texture2D : public Texture {
-	public:
-		Texture2D(TextureCreateInfo createInfo)
+		static bool isSrgbFormat(VkFormat format)
+		{
+			switch (format) {
+			case VK_FORMAT_R8G8B8A8_SRGB:
+			case VK_FORMAT_B8G8R8A8_SRGB:
+			case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+			case VK_FORMAT_BC2_SRGB_BLOCK:
+			case VK_FORMAT_BC3_SRGB_BLOCK:
+			case VK_FORMAT_BC7_SRGB_BLOCK:
+			case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+			case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		/**
+		* Loads all images of a KTX or KTX2 file into host memory
+		* The format of KTX files is taken from the create info, KTX2 files are loaded in their own format or, for Basis Universal files, the format they have been transcoded to
+		* For Basis Universal files, the create info's format only selects between the sRGB and the linear variant of the transcode target
+		* Files that don't need to be decoded are memory mapped instead of being read, so their images are only copied once into the staging buffer
+		*/
+		static void loadTextureData(const TextureCreateInfo& createInfo, TextureData& target)
 		{
+#if !defined(__ANDROID__)
+			if (isKTX2File(createInfo.filename)) {
+				if (!loadKTX2File(createInfo.filename, isSrgbFormat(createInfo.format), target, createInfo.jobSystem)) {
+					vks::tools::exitFatal("Could not load texture from " + createInfo.filename, -1);
+				}
+				return;
+			}
+			if (mapKTXFile(createInfo.filename, createInfo.format, target)) {
+				return;
+			}
+#endif
 			ktxTexture* ktxTexture;
 			ktxResult result = loadKTXFile(createInfo.filename, &ktxTexture);
 			assert(result == KTX_SUCCESS);
+			target.format = createInfo.format;
+			target.width = ktxTexture->baseWidth;
+			target.height = ktxTexture->baseHeight;
+			target.mipLevels = ktxTexture->numLevels;
+			target.layerCount = 1;
+			target.faceCount = ktxTexture->numFaces;
+			const ktx_uint8_t* ktxTextureData = ktxTexture_GetData(ktxTexture);
+			target.data.assign(ktxTextureData, ktxTextureData + ktxTexture_GetSize(ktxTexture));
+			for (uint32_t level = 0; level < target.mipLevels; level++) {
+				for (uint32_t face = 0; face < target.faceCount; face++) {
+					ktx_size_t offset;
+					result = ktxTexture_GetImageOffset(ktxTexture, level, 0, face, &offset);
+					assert(result == KTX_SUCCESS);
+					target.offsets.push_back(offset);
+					target.sizes.push_back(ktxTexture_GetImageSize(ktxTexture, level));
+				}
+			}
+			ktxTexture_Destroy(ktxTexture);
+		}
 
-			width = ktxTexture->baseWidth;
-			height = ktxTexture->baseHeight;
-			mipLevels = ktxTexture->numLevels;
+		/**
+		* Copies the images of a texture into the staging buffer
+		*
+		* @param textureData Images to copy
+		* @param firstLevel Most detailed level that's copied
+		* @param imageOffsets Receives the offset of each copied image in the staging region, ordered like the images in textureData
+		*
+		* @return Staging region with the images, each one aligned for buffer to image copies
+		*/
+		static StagingRegion stageTextureData(const TextureData& textureData, uint32_t firstLevel, std::vector<VkDeviceSize>& imageOffsets)
+		{
+			// Multiple of all supported texel block sizes
+			const VkDeviceSize alignment = 16;
+			VkDeviceSize size = 0;
+			imageOffsets.clear();
+			for (uint32_t level = firstLevel; level < textureData.mipLevels; level++) {
+				for (uint32_t layer = 0; layer < textureData.layerCount; layer++) {
+					for (uint32_t face = 0; face < textureData.faceCount; face++) {
+						imageOffsets.push_back(size);
+						size = (size + textureData.getImageSize(level, layer, face) + alignment - 1) & ~(alignment - 1);
+					}
+				}
+			}
+			StagingRegion staging = VulkanContext::stagingBuffer->allocate(size, alignment);
+			uint8_t* destination = static_cast<uint8_t*>(staging.mapped);
+			for (uint32_t level = firstLevel; level < textureData.mipLevels; level++) {
+				for (uint32_t layer = 0; layer < textureData.layerCount; layer++) {
+					for (uint32_t face = 0; face < textureData.faceCount; face++) {
+						const uint32_t image = textureData.getImageIndex(level - firstLevel, layer, face);
+						memcpy(destination + imageOffsets[image], textureData.getImage(level, layer, face), textureData.getImageSize(level, layer, face));
+					}
+				}
+			}
+			return staging;
+		}
+	};
 
-			ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
-			ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
+	class Texture2D : public Texture {
+	private:
+		// Creates the image from the mip levels starting at firstLevel, which becomes the image's first level
+		void create(const TextureData& textureData, uint32_t firstLevel, const TextureCreateInfo& createInfo)
+		{
+			assert(firstLevel < textureData.mipLevels);
+			const VkFormat format = textureData.format;
 
-			// Get device properites for the requested texture format
-			VkFormatProperties formatProperties;
-			vkGetPhysicalDeviceFormatProperties(VulkanContext::device->physicalDevice, createInfo.format, &formatProperties);
+			width = std::max(textureData.width >> firstLevel, 1u);
+			height = std::max(textureData.height >> firstLevel, 1u);
+			mipLevels = textureData.mipLevels - firstLevel;
+			layerCount = 1;
 
-			VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
 			VkMemoryRequirements memReqs;
-			VkCommandBuffer copyCmd = VulkanContext::device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-			VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-			bufferCreateInfo.size = ktxTextureSize;
-			// This buffer is used as a transfer source for the buffer copy
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			VK_CHECK_RESULT(vkCreateBuffer(VulkanContext::device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-			vkGetBufferMemoryRequirements(VulkanContext::device->logicalDevice, stagingBuffer, &memReqs);
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(VulkanContext::device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(VulkanContext::device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-			// Copy texture data into staging buffer
-			uint8_t *data;
-			VK_CHECK_RESULT(vkMapMemory(VulkanContext::device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-			memcpy(data, ktxTextureData, ktxTextureSize);
-			vkUnmapMemory(VulkanContext::device->logicalDevice, stagingMemory);
+			// Uploads are recorded for the transfer queue
+			VkCommandBuffer copyCmd = createInfo.uploadBatch ? createInfo.uploadBatch->getCommandBuffer() : VulkanContext::stagingBuffer->beginTransfer();
+
+			// Copy texture data into the shared staging buffer
+			std::vector<VkDeviceSize> imageOffsets;
+			StagingRegion staging = stageTextureData(textureData, firstLevel, imageOffsets);
 
 			// Setup buffer copy regions for each mip level
 			std::vector<VkBufferImageCopy> bufferCopyRegions;
 
 			for (uint32_t i = 0; i < mipLevels; i++)
 			{
-				ktx_size_t offset;
-				KTX_error_code result = ktxTexture_GetImageOffset(ktxTexture, i, 0, 0, &offset);
-				assert(result == KTX_SUCCESS);
-
 				VkBufferImageCopy bufferCopyRegion = {};
 				bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 				bufferCopyRegion.imageSubresource.mipLevel = i;
 				bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
 				bufferCopyRegion.imageSubresource.layerCount = 1;
-				bufferCopyRegion.imageExtent.width = ktxTexture->baseWidth >> i;
-				bufferCopyRegion.imageExtent.height = ktxTexture->baseHeight >> i;
+				bufferCopyRegion.imageExtent.width = std::max(width >> i, 1u);
+				bufferCopyRegion.imageExtent.height = std::max(height >> i, 1u);
 				bufferCopyRegion.imageExtent.depth = 1;
-				bufferCopyRegion.bufferOffset = offset;
+				bufferCopyRegion.bufferOffset = staging.offset + imageOffsets[textureData.getImageIndex(i, 0, 0)];
 
 				bufferCopyRegions.push_back(bufferCopyRegion);
 			}
@@ -183,7 +441,7 @@ namespace vks
 			// Create optimal tiled target image
 			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
 			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-			imageCreateInfo.format = createInfo.format;
+			imageCreateInfo.format = format;
 			imageCreateInfo.mipLevels = mipLevels;
 			imageCreateInfo.arrayLayers = 1;
 			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -191,21 +449,15 @@ namespace vks
 			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 			imageCreateInfo.extent = { width, height, 1 };
-			imageCreateInfo.usage = createInfo.imageUsageFlags;
-			// Ensure that the TRANSFER_DST bit is set for staging
-			if (!(imageCreateInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
-			{
-				imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-			}
+			// Ensure that the TRANSFER_DST bit is set for staging, TRANSFER_SRC lets the texture be moved with createCopy
+			imageCreateInfo.usage = createInfo.imageUsageFlags | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			this->format = format;
+			usage = imageCreateInfo.usage;
 			VK_CHECK_RESULT(vkCreateImage(VulkanContext::device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
 			vkGetImageMemoryRequirements(VulkanContext::device->logicalDevice, image, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-
-			memAllocInfo.memoryTypeIndex = VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(VulkanContext::device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, image, deviceMemory, 0));
+			allocation = VulkanContext::device->memoryAllocator->allocate(memReqs, VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), false);
+			VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, image, allocation.memory, allocation.offset));
 
 			VkImageSubresourceRange subresourceRange = {};
 			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -225,7 +477,7 @@ namespace vks
 			// Copy mip levels from staging buffer
 			vkCmdCopyBufferToImage(
 				copyCmd,
-				stagingBuffer,
+				staging.buffer,
 				image,
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 				static_cast<uint32_t>(bufferCopyRegions.size()),
@@ -233,27 +485,20 @@ namespace vks
 			);
 
 			// Change texture image layout to shader read after all mip levels have been copied
+			// The transition is part of the ownership transfer to the graphics queue
 			this->imageLayout = createInfo.imageLayout;
-			vks::tools::setImageLayout(
-				copyCmd,
-				image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				imageLayout,
-				subresourceRange);
+			VulkanContext::stagingBuffer->releaseImage(copyCmd, image, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
-			// @todo: transfer queue
-			VulkanContext::device->flushCommandBuffer(copyCmd, VulkanContext::graphicsQueue);
-
-			// Clean up staging resources
-			vkFreeMemory(VulkanContext::device->logicalDevice, stagingMemory, nullptr);
-			vkDestroyBuffer(VulkanContext::device->logicalDevice, stagingBuffer, nullptr);
-			
-			ktxTexture_Destroy(ktxTexture);
+			if (createInfo.uploadBatch) {
+				createInfo.uploadBatch->addTimelineTarget(&uploadTimelineValue);
+			} else {
+				uploadTimelineValue = VulkanContext::stagingBuffer->submitTransfer(copyCmd);
+			}
 
 			VkImageViewCreateInfo viewCreateInfo = {};
 			viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 			viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			viewCreateInfo.format = createInfo.format;
+			viewCreateInfo.format = format;
 			viewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
 			viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 			viewCreateInfo.subresourceRange.levelCount = mipLevels;
@@ -271,15 +516,38 @@ namespace vks
 				samplerCreateInfo.mipLodBias = 0.0f;
 				samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
 				samplerCreateInfo.minLod = 0.0f;
-				samplerCreateInfo.maxLod = (float)mipLevels;
+				// Not clamped to the texture's mip count (the image view already does that), so textures with a different number of mips share samplers
+				samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
 				samplerCreateInfo.maxAnisotropy = VulkanContext::device->properties.limits.maxSamplerAnisotropy;
 				samplerCreateInfo.anisotropyEnable = VulkanContext::device->enabledFeatures.samplerAnisotropy;
-				VK_CHECK_RESULT(vkCreateSampler(VulkanContext::device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+				sampler = VulkanContext::samplerCache->get(samplerCreateInfo);
 			}
 
 			// Update descriptor image info member that can be used for setting up descriptor sets
 			updateDescriptor();
 		}
+	public:
+		// Without an image, for textures whose image is created and filled outside of the texture classes (e.g. the page cache of a virtual texture)
+		Texture2D() {}
+
+		Texture2D(TextureCreateInfo createInfo)
+		{
+			TextureData textureData;
+			loadTextureData(createInfo, textureData);
+			create(textureData, 0, createInfo);
+		}
+
+		/**
+		* Creates the texture from already loaded image data, e.g. for streaming in parts of the mip chain
+		*
+		* @param textureData Images of the texture, usually loaded with loadTextureData
+		* @param firstLevel Most detailed level of textureData that's uploaded, the texture only contains this level and the smaller ones
+		* @param createInfo Texture create info, the filename is ignored
+		*/
+		Texture2D(const TextureData& textureData, uint32_t firstLevel, const TextureCreateInfo& createInfo)
+		{
+			create(textureData, firstLevel, createInfo);
+		}
 
 		Texture2D(TextureFromBufferCreateInfo createInfo)
 		{
@@ -288,51 +556,12 @@ namespace vks
 			width = createInfo.texWidth;
 			height = createInfo.texHeight;
 			mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
+			layerCount = 1;
+			format = createInfo.format;
+			usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
-			VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
 			VkMemoryRequirements memReqs;
 
-			// Use a separate command buffer for texture loading
-			VkCommandBuffer copyCmd = VulkanContext::device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-			// Create a host-visible staging buffer that contains the raw image data
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-
-			VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-			bufferCreateInfo.size = createInfo.bufferSize;
-			// This buffer is used as a transfer source for the buffer copy
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-			VK_CHECK_RESULT(vkCreateBuffer(VulkanContext::device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-			// Get memory requirements for the staging buffer (alignment, memory type bits)
-			vkGetBufferMemoryRequirements(VulkanContext::device->logicalDevice, stagingBuffer, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-			// Get memory type index for a host visible buffer
-			memAllocInfo.memoryTypeIndex = VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-			VK_CHECK_RESULT(vkAllocateMemory(VulkanContext::device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(VulkanContext::device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-			// Copy texture data into staging buffer
-			uint8_t* data;
-			VK_CHECK_RESULT(vkMapMemory(VulkanContext::device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-			memcpy(data, createInfo.buffer, createInfo.bufferSize);
-			vkUnmapMemory(VulkanContext::device->logicalDevice, stagingMemory);
-
-			VkBufferImageCopy bufferCopyRegion = {};
-			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			bufferCopyRegion.imageSubresource.mipLevel = 0;
-			bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-			bufferCopyRegion.imageSubresource.layerCount = 1;
-			bufferCopyRegion.imageExtent.width = width;
-			bufferCopyRegion.imageExtent.height = height;
-			bufferCopyRegion.imageExtent.depth = 1;
-			bufferCopyRegion.bufferOffset = 0;
-
 			// Create optimal tiled target image
 			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
 			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -344,145 +573,23 @@ namespace vks
 			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 			imageCreateInfo.extent = { width, height, 1 };
-			imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			imageCreateInfo.usage = usage;
 			VK_CHECK_RESULT(vkCreateImage(VulkanContext::device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
 			vkGetImageMemoryRequirements(VulkanContext::device->logicalDevice, image, &memReqs);
+			allocation = VulkanContext::device->memoryAllocator->allocate(memReqs, VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), false);
+			VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, image, allocation.memory, allocation.offset));
 
-			memAllocInfo.allocationSize = memReqs.size;
-
-			memAllocInfo.memoryTypeIndex = VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(VulkanContext::device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, image, deviceMemory, 0));
-
-			VkImageSubresourceRange subresourceRange = {};
-			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			subresourceRange.baseMipLevel = 0;
-			subresourceRange.levelCount = mipLevels;
-			subresourceRange.layerCount = 1;
-
-			// Image barrier for optimal image (target)
-			// Optimal image will be used as destination for the copy
-			vks::tools::setImageLayout(
-				copyCmd,
-				image,
-				VK_IMAGE_LAYOUT_UNDEFINED,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				subresourceRange);
-
-			// Copy mip levels from staging buffer
-			vkCmdCopyBufferToImage(
-				copyCmd,
-				stagingBuffer,
-				image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1,
-				&bufferCopyRegion
-			);
-
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = subresourceRange;
-				vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
-
-			// @todo
-			VkQueue copyQueue = VulkanContext::graphicsQueue;
-
-			VulkanContext::device->flushCommandBuffer(copyCmd, copyQueue, true);
-
-			vkFreeMemory(VulkanContext::device->logicalDevice, stagingMemory, nullptr);
-			vkDestroyBuffer(VulkanContext::device->logicalDevice, stagingBuffer, nullptr);
-
-			// Generate the mip chain
-			VkCommandBuffer blitCmd = VulkanContext::device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-			for (uint32_t i = 1; i < mipLevels; i++) {
-				VkImageBlit imageBlit{};
-
-				imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				imageBlit.srcSubresource.layerCount = 1;
-				imageBlit.srcSubresource.mipLevel = i - 1;
-				imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
-				imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
-				imageBlit.srcOffsets[1].z = 1;
-
-				imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				imageBlit.dstSubresource.layerCount = 1;
-				imageBlit.dstSubresource.mipLevel = i;
-				imageBlit.dstOffsets[1].x = int32_t(width >> i);
-				imageBlit.dstOffsets[1].y = int32_t(height >> i);
-				imageBlit.dstOffsets[1].z = 1;
-
-				VkImageSubresourceRange mipSubRange = {};
-				mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				mipSubRange.baseMipLevel = i;
-				mipSubRange.levelCount = 1;
-				mipSubRange.layerCount = 1;
-
-				{
-					VkImageMemoryBarrier imageMemoryBarrier{};
-					imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-					imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-					imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-					imageMemoryBarrier.srcAccessMask = 0;
-					imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-					imageMemoryBarrier.image = image;
-					imageMemoryBarrier.subresourceRange = mipSubRange;
-					vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-				}
-
-				vkCmdBlitImage(blitCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
-
-				{
-					VkImageMemoryBarrier imageMemoryBarrier{};
-					imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-					imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-					imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-					imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-					imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-					imageMemoryBarrier.image = image;
-					imageMemoryBarrier.subresourceRange = mipSubRange;
-					vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-				}
-			}
-
-			subresourceRange.levelCount = mipLevels;
+			// The copy and the mip chain generation are recorded by the batch, without one a batch for only this texture is submitted right away
 			imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = subresourceRange;
-				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+			if (createInfo.mipmapBatch) {
+				createInfo.mipmapBatch->add(image, width, height, mipLevels, createInfo.buffer, createInfo.bufferSize);
+			} else {
+				MipmapBatch mipmapBatch;
+				mipmapBatch.add(image, width, height, mipLevels, createInfo.buffer, createInfo.bufferSize);
+				mipmapBatch.submit();
 			}
 
-			VulkanContext::device->flushCommandBuffer(blitCmd, copyQueue, true);
-
-			// Change texture image layout to shader read after all mip levels have been copied
-			//this->imageLayout = createInfo.imageLayout;
-			//vks::tools::setImageLayout(
-			//	copyCmd,
-			//	image,
-			//	VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			//	imageLayout,
-			//	subresourceRange);
-
-			// @todo: create full mip chain
-
-			// @todo: transfer queu
-			//VulkanContext::device->flushCommandBuffer(copyCmd, VulkanContext::graphicsQueue);
-
 			// Create image view
 			VkImageViewCreateInfo viewCreateInfo = {};
 			viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -505,10 +612,11 @@ namespace vks
 				samplerCreateInfo.mipLodBias = 0.0f;
 				samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
 				samplerCreateInfo.minLod = 0.0f;
-				samplerCreateInfo.maxLod = (float)mipLevels;
+				// Not clamped to the texture's mip count (the image view already does that), so textures with a different number of mips share samplers
+				samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
 				samplerCreateInfo.maxAnisotropy = VulkanContext::device->properties.limits.maxSamplerAnisotropy;
 				samplerCreateInfo.anisotropyEnable = VulkanContext::device->enabledFeatures.samplerAnisotropy;
-				VK_CHECK_RESULT(vkCreateSampler(VulkanContext::device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+				sampler = VulkanContext::samplerCache->get(samplerCreateInfo);
 			}
 
 			// Update descriptor image info member that can be used for setting up descriptor sets
@@ -516,52 +624,104 @@ namespace vks
 		}
 	};
 
-	class TextureCubeMap : public Texture {
+	/**
+	 * Array of same sized images with one view over all layers, e.g. to pack small textures that would otherwise each need an image, an allocation and a bindless slot of their own
+	 * Sampled with Texture2DArray in shaders, wrapping and mip selection work per layer like for separate textures
+	 */
+	class Texture2DArray : public Texture {
 	public:
-		TextureCubeMap() { };
-		TextureCubeMap(TextureCreateInfo createInfo)
+		/**
+		* Creates the array from decoded images, the mip chain of each layer is generated from its first level
+		*
+		* @param createInfo Texture create info, buffer holds the images of all layers tightly packed one after another (bufferSize in total)
+		* @param layerCount Number of layers in the buffer
+		*/
+		Texture2DArray(TextureFromBufferCreateInfo createInfo, uint32_t layerCount)
 		{
-			ktxTexture* ktxTexture;
-			ktxResult result = loadKTXFile(createInfo.filename, &ktxTexture);
-			assert(result == KTX_SUCCESS);
-
-			width = ktxTexture->baseWidth;
-			height = ktxTexture->baseHeight;
-			mipLevels = ktxTexture->numLevels;
+			assert(createInfo.buffer && layerCount > 0);
 
-			ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
-			ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
+			width = createInfo.texWidth;
+			height = createInfo.texHeight;
+			mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
+			this->layerCount = layerCount;
+			format = createInfo.format;
+			usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
 
-			VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
 			VkMemoryRequirements memReqs;
 
-			// Create a host-visible staging buffer that contains the raw image data
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
+			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageCreateInfo.format = createInfo.format;
+			imageCreateInfo.mipLevels = mipLevels;
+			imageCreateInfo.arrayLayers = layerCount;
+			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageCreateInfo.extent = { width, height, 1 };
+			imageCreateInfo.usage = usage;
+			VK_CHECK_RESULT(vkCreateImage(VulkanContext::device->logicalDevice, &imageCreateInfo, nullptr, &image));
+
+			vkGetImageMemoryRequirements(VulkanContext::device->logicalDevice, image, &memReqs);
+			allocation = VulkanContext::device->memoryAllocator->allocate(memReqs, VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), false);
+			VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, image, allocation.memory, allocation.offset));
 
-			VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-			bufferCreateInfo.size = ktxTextureSize;
-			// This buffer is used as a transfer source for the buffer copy
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			// Each layer is uploaded and mipmapped by the batch, so the blits of all layers share the barriers of a level
+			imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			const VkDeviceSize layerSize = createInfo.bufferSize / layerCount;
+			MipmapBatch ownMipmapBatch;
+			MipmapBatch* mipmapBatch = createInfo.mipmapBatch ? createInfo.mipmapBatch : &ownMipmapBatch;
+			for (uint32_t layer = 0; layer < layerCount; layer++) {
+				mipmapBatch->add(image, width, height, mipLevels, static_cast<const uint8_t*>(createInfo.buffer) + layer * layerSize, layerSize, layer);
+			}
+			ownMipmapBatch.submit();
 
-			VK_CHECK_RESULT(vkCreateBuffer(VulkanContext::device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
+			VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
+			viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+			viewCreateInfo.format = createInfo.format;
+			viewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+			viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, layerCount };
+			viewCreateInfo.image = image;
+			VK_CHECK_RESULT(vkCreateImageView(VulkanContext::device->logicalDevice, &viewCreateInfo, nullptr, &view));
 
-			// Get memory requirements for the staging buffer (alignment, memory type bits)
-			vkGetBufferMemoryRequirements(VulkanContext::device->logicalDevice, stagingBuffer, &memReqs);
+			if (createInfo.createSampler) {
+				VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
+				samplerCreateInfo.magFilter = createInfo.magFilter;
+				samplerCreateInfo.minFilter = createInfo.minFilter;
+				samplerCreateInfo.mipmapMode = createInfo.mipmapMode;
+				samplerCreateInfo.addressModeU = createInfo.addressModeU;
+				samplerCreateInfo.addressModeV = createInfo.addressModeV;
+				samplerCreateInfo.addressModeW = createInfo.addressModeV;
+				samplerCreateInfo.mipLodBias = 0.0f;
+				samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
+				samplerCreateInfo.minLod = 0.0f;
+				samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+				samplerCreateInfo.maxAnisotropy = VulkanContext::device->properties.limits.maxSamplerAnisotropy;
+				samplerCreateInfo.anisotropyEnable = VulkanContext::device->enabledFeatures.samplerAnisotropy;
+				sampler = VulkanContext::samplerCache->get(samplerCreateInfo);
+			}
 
-			memAllocInfo.allocationSize = memReqs.size;
-			// Get memory type index for a host visible buffer
-			memAllocInfo.memoryTypeIndex = VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			updateDescriptor();
+		}
+	};
 
-			VK_CHECK_RESULT(vkAllocateMemory(VulkanContext::device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(VulkanContext::device->logicalDevice, stagingBuffer, stagingMemory, 0));
+	class TextureCubeMap : public Texture {
+	private:
+		void create(const TextureData& textureData, const TextureCreateInfo& createInfo)
+		{
+			assert(textureData.faceCount == 6);
+			const VkFormat format = textureData.format;
 
-			// Copy texture data into staging buffer
-			uint8_t *data;
-			VK_CHECK_RESULT(vkMapMemory(VulkanContext::device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-			memcpy(data, ktxTextureData, ktxTextureSize);
-			vkUnmapMemory(VulkanContext::device->logicalDevice, stagingMemory);
+			width = textureData.width;
+			height = textureData.height;
+			mipLevels = textureData.mipLevels;
+
+			VkMemoryRequirements memReqs;
+
+			// Copy texture data into the shared staging buffer
+			std::vector<VkDeviceSize> imageOffsets;
+			StagingRegion staging = stageTextureData(textureData, 0, imageOffsets);
 
 			// Setup buffer copy regions for each face including all of it's miplevels
 			std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -570,19 +730,15 @@ namespace vks
 			{
 				for (uint32_t level = 0; level < mipLevels; level++)
 				{
-					ktx_size_t offset;
-					KTX_error_code result = ktxTexture_GetImageOffset(ktxTexture, level, 0, face, &offset);
-					assert(result == KTX_SUCCESS);
-
 					VkBufferImageCopy bufferCopyRegion = {};
 					bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 					bufferCopyRegion.imageSubresource.mipLevel = level;
 					bufferCopyRegion.imageSubresource.baseArrayLayer = face;
 					bufferCopyRegion.imageSubresource.layerCount = 1;
-					bufferCopyRegion.imageExtent.width = ktxTexture->baseWidth >> level;
-					bufferCopyRegion.imageExtent.height = ktxTexture->baseHeight >> level;
+					bufferCopyRegion.imageExtent.width = std::max(width >> level, 1u);
+					bufferCopyRegion.imageExtent.height = std::max(height >> level, 1u);
 					bufferCopyRegion.imageExtent.depth = 1;
-					bufferCopyRegion.bufferOffset = offset;
+					bufferCopyRegion.bufferOffset = staging.offset + imageOffsets[textureData.getImageIndex(level, 0, face)];
 
 					bufferCopyRegions.push_back(bufferCopyRegion);
 				}
@@ -591,37 +747,34 @@ namespace vks
 			// Create optimal tiled target image
 			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
 			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-			imageCreateInfo.format = createInfo.format;
+			imageCreateInfo.format = format;
 			imageCreateInfo.mipLevels = mipLevels;
 			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 			imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 			imageCreateInfo.extent = { width, height, 1 };
-			imageCreateInfo.usage = createInfo.imageUsageFlags;
-			// Ensure that the TRANSFER_DST bit is set for staging
-			if (!(imageCreateInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
-			{
-				imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-			}
+			// Ensure that the TRANSFER_DST bit is set for staging, TRANSFER_SRC lets the texture be moved with createCopy
+			imageCreateInfo.usage = createInfo.imageUsageFlags | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 			// Cube faces count as array layers in Vulkan
 			imageCreateInfo.arrayLayers = 6;
 			// This flag is required for cube map images
 			imageCreateInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+			this->format = format;
+			usage = imageCreateInfo.usage;
+			imageFlags = imageCreateInfo.flags;
+			viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+			layerCount = 6;
 
 
 			VK_CHECK_RESULT(vkCreateImage(VulkanContext::device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
 			vkGetImageMemoryRequirements(VulkanContext::device->logicalDevice, image, &memReqs);
+			allocation = VulkanContext::device->memoryAllocator->allocate(memReqs, VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), false);
+			VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, image, allocation.memory, allocation.offset));
 
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = VulkanContext::device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-			VK_CHECK_RESULT(vkAllocateMemory(VulkanContext::device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(VulkanContext::device->logicalDevice, image, deviceMemory, 0));
-
-			// Use a separate command buffer for texture loading
-			VkCommandBuffer copyCmd = VulkanContext::device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			// Use a separate command buffer for texture loading (unless batched), recorded for the transfer queue
+			VkCommandBuffer copyCmd = createInfo.uploadBatch ? createInfo.uploadBatch->getCommandBuffer() : VulkanContext::stagingBuffer->beginTransfer();
 
 			// Image barrier for optimal image (target)
 			// Set initial layout for all array layers (faces) of the optimal (target) tiled texture
@@ -641,28 +794,27 @@ namespace vks
 			// Copy the cube map faces from the staging buffer to the optimal tiled image
 			vkCmdCopyBufferToImage(
 				copyCmd,
-				stagingBuffer,
+				staging.buffer,
 				image,
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 				static_cast<uint32_t>(bufferCopyRegions.size()),
 				bufferCopyRegions.data());
 
 			// Change texture image layout to shader read after all faces have been copied
+			// The transition is part of the ownership transfer to the graphics queue
 			this->imageLayout = createInfo.imageLayout;
-			vks::tools::setImageLayout(
-				copyCmd,
-				image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				imageLayout,
-				subresourceRange);
+			VulkanContext::stagingBuffer->releaseImage(copyCmd, image, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
-			// @todo: Transfer queue
-			VulkanContext::device->flushCommandBuffer(copyCmd, VulkanContext::graphicsQueue);
+			if (createInfo.uploadBatch) {
+				createInfo.uploadBatch->addTimelineTarget(&uploadTimelineValue);
+			} else {
+				uploadTimelineValue = VulkanContext::stagingBuffer->submitTransfer(copyCmd);
+			}
 
 			// Create image view
 			VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
 			viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-			viewCreateInfo.format = createInfo.format;
+			viewCreateInfo.format = format;
 			viewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
 			viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 			viewCreateInfo.subresourceRange.layerCount = 6;
@@ -681,20 +833,35 @@ namespace vks
 				samplerCreateInfo.mipLodBias = 0.0f;
 				samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
 				samplerCreateInfo.minLod = 0.0f;
-				samplerCreateInfo.maxLod = (float)mipLevels;
+				// Not clamped to the texture's mip count (the image view already does that), so textures with a different number of mips share samplers
+				samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
 				samplerCreateInfo.maxAnisotropy = VulkanContext::device->properties.limits.maxSamplerAnisotropy;
 				samplerCreateInfo.anisotropyEnable = VulkanContext::device->enabledFeatures.samplerAnisotropy;
-				VK_CHECK_RESULT(vkCreateSampler(VulkanContext::device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+				sampler = VulkanContext::samplerCache->get(samplerCreateInfo);
 			}
 
-			// Clean up staging resources
-			ktxTexture_Destroy(ktxTexture);
-			vkFreeMemory(VulkanContext::device->logicalDevice, stagingMemory, nullptr);
-			vkDestroyBuffer(VulkanContext::device->logicalDevice, stagingBuffer, nullptr);
-
 			// Update descriptor image info member that can be used for setting up descriptor sets
 			updateDescriptor();
 		}
+	public:
+		TextureCubeMap() { };
+		TextureCubeMap(TextureCreateInfo createInfo)
+		{
+			TextureData textureData;
+			loadTextureData(createInfo, textureData);
+			create(textureData, createInfo);
+		}
+
+		/**
+		* Creates the cube map from already loaded image data, e.g. loaded on a background job
+		*
+		* @param textureData Images of the cube map (six faces), usually loaded with loadTextureData
+		* @param createInfo Texture create info, the filename is ignored
+		*/
+		TextureCubeMap(const TextureData& textureData, const TextureCreateInfo& createInfo)
+		{
+			create(textureData, createInfo);
+		}
 	};
 
 }
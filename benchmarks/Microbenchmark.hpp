@@ -0,0 +1,102 @@
+/*
+ * Lightweight microbenchmark harness
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+
+namespace microbenchmark
+{
+	// Keeps the compiler from optimizing away a result that's otherwise unused
+	template <typename T>
+	inline void doNotOptimize(const T& value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const void* sink;
+		sink = &value;
+#endif
+	}
+
+	/**
+	* A benchmark's setup runs once, untimed, and returns the function that's timed
+	* The timed function runs its body the given number of times, itemsPerIteration is used to report the time per item (e.g. per culled sphere)
+	*/
+	struct Benchmark {
+		std::string name;
+		std::function<std::function<void(uint64_t iterations)>()> setup;
+		uint64_t itemsPerIteration{ 1 };
+	};
+
+	struct Settings {
+		// Only benchmarks whose name contains this are run
+		std::string filter;
+		// Iterations are doubled until a run takes at least this long
+		double minTime{ 100.0 };
+		// Timed runs after calibration, the fastest and the median one are reported
+		uint32_t repetitions{ 5 };
+	};
+
+	inline std::vector<Benchmark>& getBenchmarks()
+	{
+		static std::vector<Benchmark> benchmarks;
+		return benchmarks;
+	}
+
+	inline void add(const std::string& name, std::function<std::function<void(uint64_t)>()> setup, uint64_t itemsPerIteration = 1)
+	{
+		getBenchmarks().push_back({ name, std::move(setup), itemsPerIteration });
+	}
+
+	inline double measure(const std::function<void(uint64_t)>& function, uint64_t iterations)
+	{
+		const auto tStart = std::chrono::high_resolution_clock::now();
+		function(iterations);
+		const auto tEnd = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+	}
+
+	/** @brief Runs all benchmarks matching the filter and prints the time per item of the fastest and the median run */
+	inline void runAll(const Settings& settings)
+	{
+		char line[256];
+		snprintf(line, sizeof(line), "%-48s %14s %14s %12s", "benchmark", "min ns/item", "median ns/item", "iterations");
+		std::cout << line << "\n";
+		for (const Benchmark& benchmark : getBenchmarks()) {
+			if (!settings.filter.empty() && (benchmark.name.find(settings.filter) == std::string::npos)) {
+				continue;
+			}
+			const std::function<void(uint64_t)> function = benchmark.setup();
+			if (!function) {
+				snprintf(line, sizeof(line), "%-48s %14s", benchmark.name.c_str(), "skipped");
+				std::cout << line << "\n";
+				continue;
+			}
+			uint64_t iterations = 1;
+			while (measure(function, iterations) < settings.minTime && iterations < (1ull << 40)) {
+				iterations *= 2;
+			}
+			std::vector<double> times(std::max(settings.repetitions, 1u));
+			for (double& time : times) {
+				time = measure(function, iterations);
+			}
+			std::sort(times.begin(), times.end());
+			const double items = static_cast<double>(iterations * benchmark.itemsPerIteration);
+			snprintf(line, sizeof(line), "%-48s %14.2f %14.2f %12llu", benchmark.name.c_str(), times.front() * 1e6 / items, times[times.size() / 2] * 1e6 / items, static_cast<unsigned long long>(iterations));
+			std::cout << line << std::endl;
+		}
+	}
+}
@@ -0,0 +1,246 @@
+/*
+ * Microbenchmarks for hot paths of the base library
+ *
+ * Copyright (C) 2024 by Sascha Willems - www.saschawillems.de
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <iostream>
+#include <cstring>
+#include <cassert>
+#include <random>
+#include <filesystem>
+#include "Microbenchmark.hpp"
+#include "CommandLineParser.hpp"
+#include "Frustum.hpp"
+#include "ActorManager.h"
+#include "JobSystem.hpp"
+#include "glTF.h"
+#include "dxc.hpp"
+
+using microbenchmark::doNotOptimize;
+
+static std::string assetPath;
+
+// Same as in the application, so the benchmarks use the application's data
+static const std::vector<std::string> modelFiles = {
+	"models/crate_up.glb",
+	"models/asteroid.glb",
+	"models/bullet.glb"
+};
+
+static const uint32_t sphereCount = 16384;
+
+struct Spheres {
+	std::vector<glm::vec3> centers;
+	std::vector<float> radii;
+};
+
+// Spread around the camera of the frustum returned by createFrustum, so roughly half of them are visible
+static Spheres createSpheres(uint32_t count)
+{
+	std::default_random_engine generator(1);
+	std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> radius(0.5f, 5.0f);
+	Spheres spheres;
+	for (uint32_t i = 0; i < count; i++) {
+		spheres.centers.push_back(glm::vec3(position(generator), position(generator), position(generator)));
+		spheres.radii.push_back(radius(generator));
+	}
+	return spheres;
+}
+
+static vks::Frustum createFrustum()
+{
+	vks::Frustum frustum;
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 256.0f);
+	const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	frustum.update(projection * view);
+	return frustum;
+}
+
+static void addActors(ActorManager& actorManager, uint32_t count)
+{
+	const Spheres spheres = createSpheres(count);
+	actorManager.reserve(count);
+	for (uint32_t i = 0; i < count; i++) {
+		actorManager.addActor("", {
+			.position = spheres.centers[i],
+			.rotation = glm::vec3(0.0f, static_cast<float>(i % 360), 0.0f),
+			.scale = glm::vec3(spheres.radii[i]),
+			.constantVelocity = glm::vec3(1.0f, 0.0f, 0.0f)
+		});
+	}
+	actorManager.updateTransforms();
+}
+
+static void registerBenchmarks(vks::JobSystem& jobSystem)
+{
+	microbenchmark::add("Frustum::checkSphere", [] {
+		return [frustum = createFrustum(), spheres = createSpheres(sphereCount)](uint64_t iterations) mutable {
+			for (uint64_t i = 0; i < iterations; i++) {
+				uint32_t visible = 0;
+				for (uint32_t j = 0; j < sphereCount; j++) {
+					visible += frustum.checkSphere(spheres.centers[j], spheres.radii[j]) ? 1 : 0;
+				}
+				doNotOptimize(visible);
+			}
+		};
+	}, sphereCount);
+
+	microbenchmark::add("Frustum::checkSpheres", [] {
+		return [frustum = createFrustum(), spheres = createSpheres(sphereCount), visibleIndices = std::vector<uint32_t>(sphereCount)](uint64_t iterations) mutable {
+			for (uint64_t i = 0; i < iterations; i++) {
+				doNotOptimize(frustum.checkSpheres(spheres.centers.data(), spheres.radii.data(), sphereCount, visibleIndices.data()));
+			}
+		};
+	}, sphereCount);
+
+	microbenchmark::add("ActorManager::cullFrustum", [] {
+		auto actorManager = std::make_shared<ActorManager>();
+		addActors(*actorManager, sphereCount);
+		return [actorManager, frustum = createFrustum(), visibleIndices = std::vector<uint32_t>(sphereCount)](uint64_t iterations) mutable {
+			for (uint64_t i = 0; i < iterations; i++) {
+				doNotOptimize(actorManager->cullFrustum(frustum, visibleIndices.data()));
+			}
+		};
+	}, sphereCount);
+
+	// Rebuilds the matrices of all actors, which is what moving actors costs per frame
+	microbenchmark::add("ActorManager::updateTransforms", [] {
+		auto actorManager = std::make_shared<ActorManager>();
+		addActors(*actorManager, sphereCount);
+		return [actorManager](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; i++) {
+				for (uint32_t j = 0; j < actorManager->size(); j++) {
+					actorManager->markDirty(j);
+				}
+				actorManager->updateTransforms();
+			}
+		};
+	}, sphereCount);
+
+	microbenchmark::add("ActorManager::getMatrix", [] {
+		auto actorManager = std::make_shared<ActorManager>();
+		addActors(*actorManager, sphereCount);
+		return [actorManager](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; i++) {
+				glm::vec3 sum(0.0f);
+				for (uint32_t j = 0; j < actorManager->size(); j++) {
+					sum += glm::vec3(actorManager->getMatrix(j)[3]);
+				}
+				doNotOptimize(sum);
+			}
+		};
+	}, sphereCount);
+
+	// Moves all actors by their velocity, which also updates their cells in the spatial grid
+	microbenchmark::add("ActorManager::update", [] {
+		auto actorManager = std::make_shared<ActorManager>();
+		addActors(*actorManager, sphereCount);
+		return [actorManager](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; i++) {
+				actorManager->update(1.0f / 60.0f);
+			}
+		};
+	}, sphereCount);
+
+	// Overhead of spreading trivial work over all threads, so the time per item is the dispatch cost
+	microbenchmark::add("JobSystem::parallelFor", [&jobSystem] {
+		return [&jobSystem](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; i++) {
+				jobSystem.parallelFor(jobSystem.getThreadCount() * 4, 1, [](uint32_t first, uint32_t count) {
+					doNotOptimize(first + count);
+				});
+			}
+		};
+	}, jobSystem.getThreadCount() * 4);
+
+	microbenchmark::add("JobSystem::run and wait", [&jobSystem] {
+		return [&jobSystem](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; i++) {
+				vks::Job* job = jobSystem.createJob([] {});
+				jobSystem.run(job);
+				jobSystem.wait(job);
+			}
+		};
+	});
+
+	for (const std::string& file : modelFiles) {
+		microbenchmark::add("vkglTF::Model::load " + std::filesystem::path(file).filename().string(), [&jobSystem, filename = assetPath + file]() -> std::function<void(uint64_t)> {
+			if (!vks::vfs::exists(filename)) {
+				return nullptr;
+			}
+			return [&jobSystem, filename](uint64_t iterations) {
+				for (uint64_t i = 0; i < iterations; i++) {
+					vkglTF::Model model;
+					doNotOptimize(model.load({ .filename = filename, .optimizeMeshes = true, .jobSystem = &jobSystem }));
+				}
+			};
+		});
+	}
+
+	// Evaluates the first animation of the first bundled model that has one
+	microbenchmark::add("vkglTF::Model::updateAnimation", [&jobSystem]() -> std::function<void(uint64_t)> {
+		for (const std::string& file : modelFiles) {
+			auto model = std::make_shared<vkglTF::Model>();
+			if (vks::vfs::exists(assetPath + file) && model->load({ .filename = assetPath + file, .jobSystem = &jobSystem }) && !model->animations.empty()) {
+				return [model](uint64_t iterations) {
+					const float duration = model->animations[0].end - model->animations[0].start;
+					for (uint64_t i = 0; i < iterations; i++) {
+						model->updateAnimation(0, model->animations[0].start + duration * static_cast<float>(i % 64) / 64.0f);
+					}
+				};
+			}
+		}
+		return nullptr;
+	});
+
+	// Repeated compiles of the same input are served from the SPIR-V cache after the first one, so this measures the cache lookup
+	microbenchmark::add("Dxc::compileSpirv (cached)", [filename = assetPath + "shaders/skybox.vert.hlsl"]() -> std::function<void(uint64_t)> {
+		if (!vks::vfs::exists(filename)) {
+			return nullptr;
+		}
+		if (!dxcCompiler) {
+			dxcCompiler = new Dxc();
+		}
+		return [filename](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; i++) {
+				doNotOptimize(dxcCompiler->compileSpirv(filename).size());
+			}
+		};
+	});
+}
+
+int main(int argc, char* argv[])
+{
+	CommandLineParser commandLineParser;
+	commandLineParser.add("help", { "--help" }, 0, "Show help");
+	commandLineParser.add("filter", { "-f", "--filter" }, 1, "Only run benchmarks whose name contains this");
+	commandLineParser.add("mintime", { "-mt", "--mintime" }, 1, "Minimum duration of a timed run in milliseconds");
+	commandLineParser.add("repetitions", { "-r", "--repetitions" }, 1, "Number of timed runs per benchmark");
+	commandLineParser.add("assetpath", { "-ap", "--assetpath" }, 1, "Asset path the models and shaders are loaded from");
+	commandLineParser.parse(argc, argv);
+	if (commandLineParser.isSet("help")) {
+		commandLineParser.printHelp();
+		return 0;
+	}
+#if defined(VK_EXAMPLE_DATA_DIR)
+	assetPath = commandLineParser.getValueAsString("assetpath", VK_EXAMPLE_DATA_DIR);
+#else
+	assetPath = commandLineParser.getValueAsString("assetpath", "./../data/");
+#endif
+
+	microbenchmark::Settings settings;
+	settings.filter = commandLineParser.getValueAsString("filter", "");
+	settings.minTime = static_cast<double>(commandLineParser.getValueAsInt("mintime", static_cast<int32_t>(settings.minTime)));
+	settings.repetitions = static_cast<uint32_t>(commandLineParser.getValueAsInt("repetitions", static_cast<int32_t>(settings.repetitions)));
+
+	// Created on the main thread, which becomes the job system's first thread
+	vks::JobSystem jobSystem;
+	registerBenchmarks(jobSystem);
+	microbenchmark::runAll(settings);
+	delete dxcCompiler;
+	return 0;
+}
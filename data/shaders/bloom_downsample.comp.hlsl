@@ -0,0 +1,77 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Builds one level of the bloom chain from the next larger one (or the HDR scene for the first level), see recordBloom in main.cpp
+// 13 tap filter in the spirit of "Next Generation Post Processing in Call of Duty: Advanced Warfare", which doesn't flicker with subpixel movement like a plain 2x2 box
+// Taps are filtered in half precision, the same precision the bloom levels are stored with
+
+#include "includes/half_precision.hlsl"
+
+[[vk::binding(0, 0)]] Texture2D source;
+[[vk::binding(0, 0)]] SamplerState sourceSampler;
+// Matches the bloom levels, storage images default to rgba32f otherwise
+[[vk::binding(1, 0)]] [[vk::image_format("rgba16f")]] RWTexture2D<float4> destination;
+
+struct PushConsts
+{
+	// Part of the source that contains the image (the rendered area of the scene color target), one for all other levels
+	float2 sourceUVScale;
+	float2 sourceTexelSize;
+	uint2 destinationSize;
+	// Set for the first level, so single very bright pixels don't turn into blinking squares
+	uint firstLevel;
+};
+[[vk::push_constant]] PushConsts consts;
+
+hfloat3 sampleSource(float2 uv)
+{
+	// Filtering must not pick up texels outside of the rendered area, which contain older frames
+	const float2 maxUV = consts.sourceUVScale - consts.sourceTexelSize * 0.5;
+	return hfloat3(source.SampleLevel(sourceSampler, min(uv, maxUV), 0).rgb);
+}
+
+// Weight of a block of taps, the first level weighs each block by its brightness (Karis average)
+hfloat blockWeight(hfloat3 average, hfloat weight)
+{
+	return consts.firstLevel ? weight / (hfloat(1.0) + dot(average, hfloat3(0.2126, 0.7152, 0.0722))) : weight;
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	if (any(GlobalInvocationID.xy >= consts.destinationSize)) {
+		return;
+	}
+	const float2 uv = (float2(GlobalInvocationID.xy) + 0.5) / float2(consts.destinationSize) * consts.sourceUVScale;
+	const float2 t = consts.sourceTexelSize;
+
+	const hfloat3 a = sampleSource(uv + t * float2(-2.0, -2.0));
+	const hfloat3 b = sampleSource(uv + t * float2( 0.0, -2.0));
+	const hfloat3 c = sampleSource(uv + t * float2( 2.0, -2.0));
+	const hfloat3 d = sampleSource(uv + t * float2(-1.0, -1.0));
+	const hfloat3 e = sampleSource(uv + t * float2( 1.0, -1.0));
+	const hfloat3 f = sampleSource(uv + t * float2(-2.0,  0.0));
+	const hfloat3 g = sampleSource(uv);
+	const hfloat3 h = sampleSource(uv + t * float2( 2.0,  0.0));
+	const hfloat3 i = sampleSource(uv + t * float2(-1.0,  1.0));
+	const hfloat3 j = sampleSource(uv + t * float2( 1.0,  1.0));
+	const hfloat3 k = sampleSource(uv + t * float2(-2.0,  2.0));
+	const hfloat3 l = sampleSource(uv + t * float2( 0.0,  2.0));
+	const hfloat3 m = sampleSource(uv + t * float2( 2.0,  2.0));
+
+	// The center block carries half of the weight, the four overlapping corner blocks the other half
+	// Taps are scaled before they're added, so the sums stay within the 16 bit range
+	const hfloat3 blocks[5] = { d * 0.25 + e * 0.25 + i * 0.25 + j * 0.25, a * 0.25 + b * 0.25 + f * 0.25 + g * 0.25, b * 0.25 + c * 0.25 + g * 0.25 + h * 0.25, f * 0.25 + g * 0.25 + k * 0.25 + l * 0.25, g * 0.25 + h * 0.25 + l * 0.25 + m * 0.25 };
+	hfloat3 color = hfloat(0.0).rrr;
+	hfloat weightSum = 0.0;
+	for (uint block = 0; block < 5; block++) {
+		const hfloat weight = blockWeight(blocks[block], (block == 0) ? hfloat(0.5) : hfloat(0.125));
+		color += blocks[block] * weight;
+		weightSum += weight;
+	}
+	color /= weightSum;
+	destination[GlobalInvocationID.xy] = float4(color, 1.0);
+}
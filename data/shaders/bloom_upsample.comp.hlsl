@@ -0,0 +1,44 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Adds the next smaller level of the bloom chain to a level with a 3x3 tent filter, see recordBloom in main.cpp
+// Applied from the smallest level up, so the first level ends up with the sum of all levels
+// The taps are weighted before they're added in half precision, so the sum doesn't leave the 16 bit range of the bloom levels
+
+#include "includes/half_precision.hlsl"
+
+[[vk::binding(0, 0)]] Texture2D source;
+[[vk::binding(0, 0)]] SamplerState sourceSampler;
+// Matches the bloom levels, storage images default to rgba32f otherwise
+[[vk::binding(1, 0)]] [[vk::image_format("rgba16f")]] RWTexture2D<float4> destination;
+
+struct PushConsts
+{
+	float2 sourceTexelSize;
+	uint2 destinationSize;
+};
+[[vk::push_constant]] PushConsts consts;
+
+[numthreads(8, 8, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	if (any(GlobalInvocationID.xy >= consts.destinationSize)) {
+		return;
+	}
+	const float2 uv = (float2(GlobalInvocationID.xy) + 0.5) / float2(consts.destinationSize);
+	const float2 t = consts.sourceTexelSize;
+
+	hfloat3 color = hfloat3(source.SampleLevel(sourceSampler, uv, 0).rgb) * hfloat(4.0 / 16.0);
+	color += hfloat3(source.SampleLevel(sourceSampler, uv + t * float2( 0.0, -1.0), 0).rgb) * hfloat(2.0 / 16.0);
+	color += hfloat3(source.SampleLevel(sourceSampler, uv + t * float2( 0.0,  1.0), 0).rgb) * hfloat(2.0 / 16.0);
+	color += hfloat3(source.SampleLevel(sourceSampler, uv + t * float2(-1.0,  0.0), 0).rgb) * hfloat(2.0 / 16.0);
+	color += hfloat3(source.SampleLevel(sourceSampler, uv + t * float2( 1.0,  0.0), 0).rgb) * hfloat(2.0 / 16.0);
+	color += hfloat3(source.SampleLevel(sourceSampler, uv + t * float2(-1.0, -1.0), 0).rgb) * hfloat(1.0 / 16.0);
+	color += hfloat3(source.SampleLevel(sourceSampler, uv + t * float2( 1.0, -1.0), 0).rgb) * hfloat(1.0 / 16.0);
+	color += hfloat3(source.SampleLevel(sourceSampler, uv + t * float2(-1.0,  1.0), 0).rgb) * hfloat(1.0 / 16.0);
+	color += hfloat3(source.SampleLevel(sourceSampler, uv + t * float2( 1.0,  1.0), 0).rgb) * hfloat(1.0 / 16.0);
+	destination[GlobalInvocationID.xy] += float4(color, 0.0);
+}
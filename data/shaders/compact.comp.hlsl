@@ -0,0 +1,49 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Stream compaction in a single pass, see GpuPrimitives::compact
+// Elements with a non-zero flag are written to the destination in their original order, the scan of the flags gives their positions
+
+#include "includes/compute_primitives.hlsl"
+
+[[vk::binding(0, 0)]] RWStructuredBuffer<uint> source;
+[[vk::binding(1, 0)]] RWStructuredBuffer<uint> destination;
+[[vk::binding(3, 0)]] RWStructuredBuffer<uint> flags;
+// Receives the number of elements written
+[[vk::binding(4, 0)]] RWStructuredBuffer<uint> counter;
+
+[numthreads(PRIMITIVES_THREADS, 1, 1)]
+void main(uint3 LocalInvocationID : SV_GroupThreadID)
+{
+	const uint localIndex = LocalInvocationID.x;
+	const uint tile = acquireTile(localIndex);
+	const uint first = tile * PRIMITIVES_TILE_SIZE + localIndex * PRIMITIVES_ITEMS;
+
+	bool kept[PRIMITIVES_ITEMS];
+	uint threadCount = 0;
+	[unroll]
+	for (uint i = 0; i < PRIMITIVES_ITEMS; i++) {
+		kept[i] = (first + i < consts.count) && (flags[first + i] != 0);
+		threadCount += kept[i] ? 1 : 0;
+	}
+
+	uint tileCount;
+	const uint threadPrefix = workgroupPrefixSum(threadCount, localIndex, tileCount);
+	const uint tilePrefix = lookBack(tile, tileCount, localIndex);
+	uint position = tilePrefix + threadPrefix;
+
+	[unroll]
+	for (uint j = 0; j < PRIMITIVES_ITEMS; j++) {
+		if (kept[j]) {
+			destination[position++] = source[first + j];
+		}
+	}
+
+	// Tiles are numbered in start order, so the last tile is the only one that knows the total
+	if ((tile == consts.tileCount - 1) && (localIndex == 0)) {
+		counter[0] = tilePrefix + tileCount;
+	}
+}
@@ -0,0 +1,267 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Frustum culls all actors and compacts the visible ones into the instance buffer, building the indirect draw commands for each model batch
+// With occlusion culling this runs in two phases: The early phase builds the draws for actors visible in the last frame,
+// the late phase tests all actors against a depth pyramid of the early draws and builds the draws for newly visible actors
+// Shadow casters are culled with the frustum only phase against the bounds of all cascades, either for all static or all dynamic casters
+// For ray query shadows, the first phase also writes every actor's instance of the top level acceleration structure
+
+#include "includes/variation.hlsl"
+#include "includes/instance.hlsl"
+
+struct Actor
+{
+	// Index into the transforms
+	uint transformIndex;
+	uint batchIndex;
+	// Index into the GPU simulated bodies or NO_BODY
+	uint bodyIndex;
+	uint flags;
+};
+
+// Persistent across frames and only updated for actors that changed
+struct Transform
+{
+	// The last row holds the actor's procedural variation (x = seed, y = strength)
+	float4x4 model;
+	// xyz = world position, w = radius
+	float4 sphere;
+};
+
+struct Batch
+{
+	uint firstCommand;
+	uint commandCount;
+	uint instanceOffset;
+	uint pad;
+	// Device address of the bottom level acceleration structure, zero if there is none
+	uint2 accelerationStructure;
+};
+
+// Matches VkDrawIndexedIndirectCommand
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+[[vk::binding(0, 0)]] StructuredBuffer<Actor> actors;
+[[vk::binding(1, 0)]] StructuredBuffer<Batch> batches;
+[[vk::binding(2, 0)]] RWStructuredBuffer<DrawCommand> commands;
+[[vk::binding(3, 0)]] RWStructuredBuffer<uint> drawCounts;
+[[vk::binding(4, 0)]] RWStructuredBuffer<Instance> instances;
+// Per-actor visibility of the last frame, written by the late phase
+[[vk::binding(5, 0)]] RWStructuredBuffer<uint> visibility;
+// Max. depth of 2x2 texels per level, level 0 covers 2x2 pixels of the depth buffer
+[[vk::binding(6, 0)]] Texture2D<float> depthPyramid;
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+	// World position of the camera, matrices and the view are relative to it
+	float4 cameraPosition;
+};
+[[vk::binding(7, 0)]] ConstantBuffer<UBO> ubo;
+
+// Matches simulate.comp.hlsl, replaces the transform of actors simulated on the GPU
+struct Body
+{
+	float4x4 model;
+	float4 position;
+	float4 velocity;
+	float4 rotation;
+	float4 angularVelocity;
+};
+[[vk::binding(8, 0)]] StructuredBuffer<Body> bodies;
+[[vk::binding(9, 0)]] StructuredBuffer<Transform> transforms;
+
+// Matches VkAccelerationStructureInstanceKHR
+struct RayInstance
+{
+	// Rows of a 3x4 matrix
+	float4 transform[3];
+	// 24 bit custom index, 8 bit mask
+	uint customIndexMask;
+	// 24 bit hit group offset, 8 bit VkGeometryInstanceFlagsKHR
+	uint sbtOffsetFlags;
+	uint2 accelerationStructure;
+};
+[[vk::binding(10, 0)]] RWStructuredBuffer<RayInstance> rayInstances;
+
+static const uint NO_BODY = 0xFFFFFFFF;
+
+static const uint PHASE_FRUSTUM_ONLY = 0;
+static const uint PHASE_EARLY = 1;
+static const uint PHASE_LATE = 2;
+
+static const uint ACTOR_STATIC = 1;
+
+static const uint CASTERS_ALL = 0;
+static const uint CASTERS_STATIC = 1;
+static const uint CASTERS_DYNAMIC = 2;
+
+// VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR | VK_GEOMETRY_INSTANCE_FORCE_OPAQUE_BIT_KHR
+static const uint RAY_INSTANCE_FLAGS = 0x1 | 0x4;
+
+struct PushConsts
+{
+	float4 frustumPlanes[6];
+	uint actorCount;
+	uint phase;
+	// The late phase writes to a second set of commands and draw counts following the ones of the early phase
+	uint commandOffset;
+	uint batchCount;
+	uint2 depthSize;
+	uint pyramidLevels;
+	// Nearer depths are larger with reverse Z
+	uint reverseDepth;
+	// Index of the first draw count of the commands written
+	uint drawCountOffset;
+	uint casterFilter;
+	uint rayInstances;
+};
+[[vk::push_constant]] PushConsts consts;
+
+bool checkSphere(float3 pos, float radius)
+{
+	for (uint i = 0; i < 6; i++) {
+		if (dot(consts.frustumPlanes[i].xyz, pos) + consts.frustumPlanes[i].w <= -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Conservative test of the sphere's screen space bounds against the depth pyramid
+bool isOccluded(float3 center, float radius)
+{
+	// Bounds are taken from the projected corners of the sphere's bounding box, the view is camera relative
+	const float4x4 viewProjection = mul(ubo.projection, ubo.view);
+	center -= ubo.cameraPosition.xyz;
+	float2 minUV = 1.0;
+	float2 maxUV = 0.0;
+	float nearestDepth = consts.reverseDepth ? 0.0 : 1.0;
+	for (uint i = 0; i < 8; i++) {
+		const float3 corner = center + radius * float3((i & 1) ? 1.0 : -1.0, (i & 2) ? 1.0 : -1.0, (i & 4) ? 1.0 : -1.0);
+		const float4 clip = mul(viewProjection, float4(corner, 1.0));
+		// Bounds crossing the near plane can't be tested
+		const bool crossesNear = consts.reverseDepth ? (clip.z > clip.w) : (clip.z < 0.0);
+		if (crossesNear || clip.w <= 0.0) {
+			return false;
+		}
+		const float3 ndc = clip.xyz / clip.w;
+		minUV = min(minUV, ndc.xy * 0.5 + 0.5);
+		maxUV = max(maxUV, ndc.xy * 0.5 + 0.5);
+		nearestDepth = consts.reverseDepth ? max(nearestDepth, ndc.z) : min(nearestDepth, ndc.z);
+	}
+
+	const uint2 minPixel = min(uint2(clamp(minUV, 0.0, 1.0) * float2(consts.depthSize)), consts.depthSize - 1);
+	const uint2 maxPixel = min(uint2(clamp(maxUV, 0.0, 1.0) * float2(consts.depthSize)), consts.depthSize - 1);
+	// Texels of level n cover 2^(n+1) pixels, so the finest level where the bounds span at most 2x2 texels is used
+	uint level = 0;
+	while ((level + 1 < consts.pyramidLevels) && any((maxPixel >> (level + 1)) - (minPixel >> (level + 1)) > 1)) {
+		level++;
+	}
+	const uint2 minTexel = minPixel >> (level + 1);
+	const uint2 maxTexel = maxPixel >> (level + 1);
+	const float d0 = depthPyramid.Load(int3(minTexel.x, minTexel.y, level));
+	const float d1 = depthPyramid.Load(int3(maxTexel.x, minTexel.y, level));
+	const float d2 = depthPyramid.Load(int3(minTexel.x, maxTexel.y, level));
+	const float d3 = depthPyramid.Load(int3(maxTexel.x, maxTexel.y, level));
+	// Occluded if the bounds are behind the farthest depth of the texels they cover
+	if (consts.reverseDepth) {
+		return nearestDepth < min(min(d0, d1), min(d2, d3));
+	}
+	return nearestDepth > max(max(d0, d1), max(d2, d3));
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	uint index = GlobalInvocationID.x;
+	if (index >= consts.actorCount) {
+		return;
+	}
+
+	const Actor actor = actors[index];
+	if ((consts.casterFilter != CASTERS_ALL) && (((actor.flags & ACTOR_STATIC) != 0) != (consts.casterFilter == CASTERS_STATIC))) {
+		return;
+	}
+	Transform transform = transforms[actor.transformIndex];
+	if (actor.bodyIndex != NO_BODY) {
+		// Bodies don't have the actor's procedural variation
+		const float4 variation = transform.model[3];
+		transform.model = bodies[actor.bodyIndex].model;
+		transform.model[3] = variation;
+		transform.sphere.xyz = bodies[actor.bodyIndex].position.xyz;
+	}
+	// Actors outside of the view can still cast shadows into it, instances without a bottom level structure are inactive
+	if (consts.rayInstances != 0) {
+		RayInstance rayInstance;
+		for (uint i = 0; i < 3; i++) {
+			rayInstance.transform[i] = transform.model[i];
+		}
+		// Camera relative like the positions the fragment shaders trace from
+		rayInstance.transform[0].w -= ubo.cameraPosition.x;
+		rayInstance.transform[1].w -= ubo.cameraPosition.y;
+		rayInstance.transform[2].w -= ubo.cameraPosition.z;
+		rayInstance.customIndexMask = index | (0xFF << 24);
+		rayInstance.sbtOffsetFlags = RAY_INSTANCE_FLAGS << 24;
+		rayInstance.accelerationStructure = batches[actor.batchIndex].accelerationStructure;
+		rayInstances[index] = rayInstance;
+	}
+	const bool inFrustum = checkSphere(transform.sphere.xyz, transform.sphere.w);
+	switch (consts.phase) {
+	case PHASE_EARLY:
+		if (!inFrustum || visibility[index] == 0) {
+			return;
+		}
+		break;
+	case PHASE_LATE: {
+		const bool visible = inFrustum && !isOccluded(transform.sphere.xyz, transform.sphere.w);
+		const bool drawnEarly = (visibility[index] != 0);
+		visibility[index] = visible ? 1 : 0;
+		if (!visible || drawnEarly) {
+			return;
+		}
+		break;
+	}
+	default:
+		if (!inFrustum) {
+			return;
+		}
+	}
+
+	Batch batch = batches[actor.batchIndex];
+	const uint firstCommand = batch.firstCommand + consts.commandOffset;
+	const uint drawCountIndex = actor.batchIndex + consts.drawCountOffset;
+	// Late instances are placed after the batch's early instances, whose count is final once the early phase has finished
+	const uint instanceOffset = batch.instanceOffset + ((consts.phase == PHASE_LATE) ? commands[batch.firstCommand].instanceCount : 0);
+
+	// The first command's instance count doubles as the allocator for the batch's instance slots
+	uint slot;
+	InterlockedAdd(commands[firstCommand].instanceCount, 1, slot);
+	for (uint i = 1; i < batch.commandCount; i++) {
+		InterlockedAdd(commands[firstCommand + i].instanceCount, 1);
+	}
+	if (slot == 0) {
+		drawCounts[drawCountIndex] = 1;
+		for (uint i = 0; i < batch.commandCount; i++) {
+			commands[firstCommand + i].firstInstance = instanceOffset;
+		}
+	}
+
+	// Instances are camera relative, which keeps the values small for actors far from the origin
+	transform.model._m03_m13_m23 -= ubo.cameraPosition.xyz;
+	instances[instanceOffset + slot] = encodeInstance(transform.model, transform.model._m30_m31);
+}
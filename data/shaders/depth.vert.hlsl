@@ -0,0 +1,36 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Depth pre-pass for the per actor draws, only reads the vertex positions
+// The position needs to be calculated exactly like in gltf.vert.hlsl, so the main pass can test against the pre-pass depth with an equal compare
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+struct PushConsts {
+	float4x4 model;
+};
+[[vk::push_constant]] PushConsts primitive;
+
+struct VSOutput
+{
+	precise float4 pos : SV_POSITION;
+};
+
+VSOutput main([[vk::location(0)]] float3 pos : POSITION0)
+{
+	VSOutput output = (VSOutput)0;
+	float4x4 modelView = mul(ubo.view, primitive.model);
+	output.pos = mul(ubo.projection, mul(modelView, float4(pos, 1.0)));
+	return output;
+}
@@ -0,0 +1,45 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Depth pre-pass for the instanced and indirect draws, only reads the vertex positions
+// The position needs to be calculated exactly like in gltf_instanced.vert.hlsl, so the main pass can test against the pre-pass depth with an equal compare
+
+#include "includes/variation.hlsl"
+#include "includes/instance.hlsl"
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+[[vk::binding(1, 0)]]
+StructuredBuffer<Instance> instances;
+
+struct PushConsts {
+	float4x4 node;
+};
+[[vk::push_constant]] PushConsts primitive;
+
+struct VSOutput
+{
+	precise float4 pos : SV_POSITION;
+};
+
+VSOutput main([[vk::location(0)]] float3 pos : POSITION0, uint InstanceIndex : SV_InstanceID)
+{
+	VSOutput output = (VSOutput)0;
+	InstanceVariation variation;
+	const float4x4 instance = decodeInstance(instances[InstanceIndex], variation);
+	float4x4 model = mul(instance, primitive.node);
+	float4x4 modelView = mul(ubo.view, model);
+	output.pos = mul(ubo.projection, mul(modelView, float4(displacePosition(pos, variation), 1.0)));
+	return output;
+}
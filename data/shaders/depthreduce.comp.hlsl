@@ -0,0 +1,34 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Builds one level of the depth pyramid used for occlusion culling, each texel stores the farthest depth of 2x2 source texels (the max., or the min. with reverse Z)
+
+[[vk::binding(0, 0)]] Texture2D<float> source;
+[[vk::binding(1, 0)]] RWTexture2D<float> destination;
+
+struct PushConsts
+{
+	uint2 sourceSize;
+	uint2 destinationSize;
+	uint reverseDepth;
+};
+[[vk::push_constant]] PushConsts consts;
+
+[numthreads(8, 8, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	if (any(GlobalInvocationID.xy >= consts.destinationSize)) {
+		return;
+	}
+	// Texels outside of the source are clamped to its border, which doesn't change the farthest depth
+	const uint2 maxCoord = consts.sourceSize - 1;
+	const uint2 coord = GlobalInvocationID.xy * 2;
+	const float d0 = source.Load(int3(min(coord, maxCoord), 0));
+	const float d1 = source.Load(int3(min(coord + uint2(1, 0), maxCoord), 0));
+	const float d2 = source.Load(int3(min(coord + uint2(0, 1), maxCoord), 0));
+	const float d3 = source.Load(int3(min(coord + uint2(1, 1), maxCoord), 0));
+	destination[GlobalInvocationID.xy] = consts.reverseDepth ? min(min(d0, d1), min(d2, d3)) : max(max(d0, d1), max(d2, d3));
+}
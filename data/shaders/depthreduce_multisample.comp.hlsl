@@ -0,0 +1,41 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Builds the first level of the depth pyramid straight from multi sampled depth, for devices that can't resolve depth to its min. or max. sample
+// Each texel stores the farthest depth of all samples of 2x2 source texels (the max., or the min. with reverse Z)
+
+[[vk::binding(0, 0)]] Texture2DMS<float> source;
+[[vk::binding(1, 0)]] RWTexture2D<float> destination;
+
+struct PushConsts
+{
+	uint2 sourceSize;
+	uint2 destinationSize;
+	uint reverseDepth;
+};
+[[vk::push_constant]] PushConsts consts;
+
+[numthreads(8, 8, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	if (any(GlobalInvocationID.xy >= consts.destinationSize)) {
+		return;
+	}
+	uint width, height, sampleCount;
+	source.GetDimensions(width, height, sampleCount);
+	// Texels outside of the source are clamped to its border, which doesn't change the farthest depth
+	const uint2 maxCoord = consts.sourceSize - 1;
+	const uint2 coord = GlobalInvocationID.xy * 2;
+	float depth = consts.reverseDepth ? 1.0 : 0.0;
+	for (uint i = 0; i < 4; i++) {
+		const int2 texel = int2(min(coord + uint2(i & 1, i >> 1), maxCoord));
+		for (uint s = 0; s < sampleCount; s++) {
+			const float d = source.Load(texel, s);
+			depth = consts.reverseDepth ? min(depth, d) : max(depth, d);
+		}
+	}
+	destination[GlobalInvocationID.xy] = depth;
+}
@@ -0,0 +1,66 @@
+/* Copyright (c) 2018-2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Generates an irradiance cube from an environment map using convolution, writes all six faces of one mip level
+
+[[vk::binding(0, 0)]] TextureCube textureCubeMap;
+[[vk::binding(0, 0)]] SamplerState samplerCubeMap;
+// Needs to match the irradiance cube's format in generateCubemaps
+[[vk::binding(1, 0)]] [[vk::image_format("rgba32f")]] RWTexture2DArray<float4> destination;
+
+struct PushConsts
+{
+	uint size;
+	float deltaPhi;
+	float deltaTheta;
+};
+[[vk::push_constant]] PushConsts consts;
+
+#define PI 3.1415926535897932384626433832795
+
+// Direction through the center of a texel of a cube face, following the face order and orientation of Vulkan cube maps
+float3 cubeDirection(uint3 coord, uint size)
+{
+	const float2 uv = (float2(coord.xy) + 0.5) / float(size) * 2.0 - 1.0;
+	float3 direction;
+	switch (coord.z) {
+		case 0: direction = float3(1.0, -uv.y, -uv.x); break;
+		case 1: direction = float3(-1.0, -uv.y, uv.x); break;
+		case 2: direction = float3(uv.x, 1.0, uv.y); break;
+		case 3: direction = float3(uv.x, -1.0, -uv.y); break;
+		case 4: direction = float3(uv.x, -uv.y, 1.0); break;
+		default: direction = float3(-uv.x, -uv.y, -1.0); break;
+	}
+	return normalize(direction);
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	if (any(GlobalInvocationID.xy >= consts.size)) {
+		return;
+	}
+
+	float3 N = cubeDirection(GlobalInvocationID, consts.size);
+	float3 up = abs(N.y) < 0.999 ? float3(0.0, 1.0, 0.0) : float3(0.0, 0.0, 1.0);
+	float3 right = normalize(cross(up, N));
+	up = cross(N, right);
+
+	const float TWO_PI = PI * 2.0;
+	const float HALF_PI = PI * 0.5;
+
+	float3 color = float3(0.0, 0.0, 0.0);
+	uint sampleCount = 0u;
+	for (float phi = 0.0; phi < TWO_PI; phi += consts.deltaPhi) {
+		for (float theta = 0.0; theta < HALF_PI; theta += consts.deltaTheta) {
+			float3 tempVec = cos(phi) * right + sin(phi) * up;
+			float3 sampleVector = cos(theta) * N + sin(theta) * tempVec;
+			color += textureCubeMap.SampleLevel(samplerCubeMap, sampleVector, 0.0).rgb * cos(theta) * sin(theta);
+			sampleCount++;
+		}
+	}
+	destination[GlobalInvocationID] = float4(PI * color / float(sampleCount), 1.0);
+}
@@ -4,24 +4,41 @@
  *
  */
 
-struct VSOutput
-{
-    float4 pos : SV_POSITION;
-    [[vk::location(0)]] float3 UVW : TEXCOORD0;
-};
+// Prefilters an environment map for a given roughness, writes all six faces of one mip level
+// Samples are importance sampled from the GGX lobe and read from the source mip whose texels cover the sample's solid angle (filtered importance sampling),
+// so a few samples per texel give a smooth result and the number of samples can be chosen per roughness (see getRadianceSampleCount in main.cpp)
 
 [[vk::binding(0, 0)]] TextureCube textureCubeMap;
 [[vk::binding(0, 0)]] SamplerState samplerCubeMap;
+// Needs to match the radiance cube's format in generateCubemaps, storage images default to rgba32f otherwise
+[[vk::binding(1, 0)]] [[vk::image_format("rgba16f")]] RWTexture2DArray<float4> destination;
 
 struct PushConsts
 {
-    [[vk::offset(64)]] float roughness;
-    [[vk::offset(68)]] uint numSamples;
+	uint size;
+	float roughness;
+	uint numSamples;
 };
 [[vk::push_constant]] PushConsts consts;
 
 #define PI 3.1415926536
 
+// Direction through the center of a texel of a cube face, following the face order and orientation of Vulkan cube maps
+float3 cubeDirection(uint3 coord, uint size)
+{
+	const float2 uv = (float2(coord.xy) + 0.5) / float(size) * 2.0 - 1.0;
+	float3 direction;
+	switch (coord.z) {
+		case 0: direction = float3(1.0, -uv.y, -uv.x); break;
+		case 1: direction = float3(-1.0, -uv.y, uv.x); break;
+		case 2: direction = float3(uv.x, 1.0, uv.y); break;
+		case 3: direction = float3(uv.x, -1.0, -uv.y); break;
+		case 4: direction = float3(uv.x, -uv.y, 1.0); break;
+		default: direction = float3(-uv.x, -uv.y, -1.0); break;
+	}
+	return normalize(direction);
+}
+
 // Based on http://byteblacksmith.com/improvements-to-the-canonical-one-liner-glsl-rand-for-opengl-es-2-0/
 float random(float2 co)
 {
@@ -104,8 +121,8 @@ float3 prefilterEnvMap(float3 R, float3 N, float roughness)
             float omegaS = 1.0 / (float(consts.numSamples) * pdf);
 			// Solid angle of 1 pixel across all cube faces
             float omegaP = 4.0 * PI / (6.0 * envMapDim * envMapDim);
-			// Biased (+1.0) mip level for better result
-            float mipLevel = roughness == 0.0 ? 0.0 : max(0.5 * log2(omegaS / omegaP) + 1.0, 0.0f);
+			// Biased (+1.0) mip level for better result, a perfect mirror reads the source mip matching the destination's resolution
+            float mipLevel = roughness == 0.0 ? max(log2(envMapDim / float(consts.size)), 0.0) : max(0.5 * log2(omegaS / omegaP) + 1.0, 0.0f);
             color += textureCubeMap.SampleLevel(samplerCubeMap, L, mipLevel).rgb * dotNL;
             totalWeight += dotNL;
 
@@ -114,11 +131,12 @@ float3 prefilterEnvMap(float3 R, float3 N, float roughness)
     return (color / totalWeight);
 }
 
-float4 main(VSOutput input) : SV_TARGET
-{		
-    float3 N = normalize(input.UVW);
-    float3 color = prefilterEnvMap(N, N, consts.roughness);
-	
-    //return float4(N, 1.0);
-    return float4(color, 1.0);
+[numthreads(8, 8, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	if (any(GlobalInvocationID.xy >= consts.size)) {
+		return;
+	}
+	float3 N = cubeDirection(GlobalInvocationID, consts.size);
+	destination[GlobalInvocationID] = float4(prefilterEnvMap(N, N, consts.roughness), 1.0);
 }
@@ -1,24 +1,11 @@
-[[vk::binding(0, 1)]]
-Texture2D textures[];
-[[vk::binding(0, 1)]]
-TextureCube cubemaps[];
-[[vk::binding(0, 1)]]
-SamplerState samplerTexture;
+#include "includes/debug_view.hlsl"
 
-struct UBO
-{
-	float4x4 projection;
-	float4x4 view;
-	float time;
-	float2 resolution;
-};
-[[vk::binding(0, 0)]]
-ConstantBuffer<UBO> ubo;
+#include "includes/scene_shading.hlsl"
 
 struct PushConsts
 {
     float4x4 model;
-    uint textureIndex;
+    uint materialIndex;
     uint radianceIndex;
     uint irradianceIndex;
 };
@@ -33,35 +20,76 @@ struct VSOutput
 [[vk::location(3)]] float3 worldpos : NORMAL1;
 };
 
-float3 fresnelSchlickRoughness(float cosTheta, float3 F0, float roughness)
+#if DEBUG_VIEW == DEBUG_VIEW_QUAD_UTILIZATION
+// IsHelperLane needs shader model 6.6, so the SPIR-V built-in is read directly
+[[vk::ext_builtin_input(/* HelperInvocation */ 23)]]
+static const bool helperInvocation;
+
+// Lanes of the fragment's 2x2 quad that cover the primitive, the others are helpers only run for derivatives
+// Fine derivatives are the difference between the two lanes of a row (or column), so the values of the neighbours can be reconstructed from them without wave operations
+uint coveredQuadLanes(float2 fragCoord)
+{
+    const float covered = helperInvocation ? 0.0 : 1.0;
+    // 1 for lanes in the left column (or top row) of the quad, -1 for the others
+    const float2 side = 1.0 - 2.0 * fmod(floor(fragCoord), 2.0);
+    const float horizontal = covered + ddx_fine(covered) * side.x;
+    const float vertical = covered + ddy_fine(covered) * side.y;
+    const float diagonal = vertical + ddx_fine(vertical) * side.x;
+    return uint(covered + horizontal + vertical + diagonal + 0.5);
+}
+#endif
+
+#if defined(DEBUG_VIEW)
+float3 debugHashColor(uint value)
 {
-    return F0 + (max((1.0 - roughness).rrr, F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+    value = (value ^ 61u) ^ (value >> 16);
+    value *= 9u;
+    value = value ^ (value >> 4);
+    value *= 0x27d4eb2du;
+    value = value ^ (value >> 15);
+    return float3(value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff) / 255.0;
 }
+#endif
 
+// The primitive ID is only read by the debug view, as it needs the geometry shader feature with the vertex pipeline
+#if DEBUG_VIEW == DEBUG_VIEW_PRIMITIVES
+float4 main(VSOutput input, uint primitiveID : SV_PrimitiveID) : SV_TARGET
+#else
 float4 main(VSOutput input) : SV_TARGET
+#endif
 {
-    float4 albedo = textures[pushConsts.textureIndex].Sample(samplerTexture, input.uv);
-    //float4 ambient = cubemaps[pushConsts.irradianceIndex].Sample(samplerTexture, input.normal);
-    
-    float3 V = normalize(-input.worldpos);
-    float3 N = normalize(input.normal);
-    
-    float3 F0 = (0.04).rrr;
-    float roughness = 0.5;
-    
-    float3 kS = fresnelSchlickRoughness(max(dot(N, V), 0.0), F0, roughness);
-    float3 kD = 1.0 - kS;
-    float3 irradiance = cubemaps[pushConsts.irradianceIndex].Sample(samplerTexture, input.normal).rgb;
-    //float3 ambient = (0.5f).rrr;
-    //float3 diffuse = irradiance * albedo.rgb;
-    
-    float3 lightPos = float3(0.0, 0.0, 0.0);
-    float3 lightDir = normalize(lightPos - input.worldpos);
-    float3 diffuse = max(dot(N, lightDir), 0.0);
-        
-    float ao = 2.5;
-    float3 ambient = max(kD * diffuse, 0.1) * ao;       
+#if DEBUG_VIEW == DEBUG_VIEW_QUAD_UTILIZATION
+    // Derivatives need all lanes of the quad, so this runs before alpha masking discards any
+    const uint quadLanes = coveredQuadLanes(input.pos.xy);
+#endif
+
+    Material material = materials[pushConsts.materialIndex];
+
+    SceneSurface surface;
+    surface.uv = input.uv;
+    // Derivatives are taken before branching on the virtual texture's residency, which differs between the fragments of a quad
+    surface.uvDx = ddx(input.uv);
+    surface.uvDy = ddy(input.uv);
+    surface.normal = input.normal;
+    surface.worldpos = input.worldpos;
+    surface.fragCoord = input.pos.xy;
+
+    float4 albedo = sampleAlbedo(material, surface);
+    if (material.alphaMode == ALPHAMODE_MASK) {
+        clip(albedo.a - material.alphaCutoff);
+    }
+
+#if DEBUG_VIEW == DEBUG_VIEW_OVERDRAW
+    // Summed up by additive blending, red saturates after 4 layers, green after 16 and blue after 64
+    return float4(1.0 / 4.0, 1.0 / 16.0, 1.0 / 64.0, 1.0);
+#elif DEBUG_VIEW == DEBUG_VIEW_QUAD_UTILIZATION
+    // Red = 1 of 4 lanes doing useful work, green = all 4
+    const float3 quadColors[4] = { float3(1.0, 0.0, 0.0), float3(1.0, 0.5, 0.0), float3(1.0, 1.0, 0.0), float3(0.0, 1.0, 0.0) };
+    return float4(quadColors[clamp(quadLanes, 1, 4) - 1], 1.0);
+#elif DEBUG_VIEW == DEBUG_VIEW_PRIMITIVES
+    // Each triangle (or meshlet on the mesh shading path) gets its own color, so dense meshes show up as noise
+    return float4(debugHashColor(primitiveID) * 0.8 + 0.2, 1.0);
+#endif
 
-    return float4((ambient + diffuse) * albedo.rgb, 1.0);
-    
+    return float4(shadeSurface(material, albedo, surface, pushConsts.irradianceIndex), 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,134 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Generates the vertices and triangles of a meshlet that passed the task shader culling
+// Vertices are fetched from the model's vertex buffer and need to use the compact vertex layout
+
+#include "includes/variation.hlsl"
+#include "includes/instance.hlsl"
+#include "includes/debug_view.hlsl"
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+};
+[[vk::binding(0, 0)]]
+ConstantBuffer<UBO> ubo;
+
+[[vk::binding(1, 0)]]
+StructuredBuffer<Instance> instances;
+
+// vkglTF::CompactVertex, 28 bytes
+[[vk::binding(0, 2)]]
+ByteAddressBuffer vertexData;
+
+// Matches vks::meshoptimizer::Meshlet
+struct Meshlet
+{
+	float3 center;
+	float radius;
+	float3 coneAxis;
+	float coneCutoff;
+	uint vertexOffset;
+	uint triangleOffset;
+	uint vertexCount;
+	uint triangleCount;
+};
+[[vk::binding(1, 2)]]
+StructuredBuffer<Meshlet> meshlets;
+[[vk::binding(2, 2)]]
+StructuredBuffer<uint> meshletVertices;
+// Three 8 bit meshlet local vertex indices per triangle
+[[vk::binding(3, 2)]]
+StructuredBuffer<uint> meshletTriangles;
+
+struct PushConsts
+{
+	float4x4 node;
+	uint materialIndex;
+	uint radianceIndex;
+	uint irradianceIndex;
+	uint firstMeshlet;
+	uint meshletCount;
+	uint firstInstance;
+};
+[[vk::push_constant]] PushConsts primitive;
+
+struct Payload
+{
+	uint meshletIndices[32];
+	uint instanceIndex;
+};
+
+struct VSOutput
+{
+	float4 pos : SV_POSITION;
+[[vk::location(0)]] float2 uv : TEXCOORD0;
+[[vk::location(1)]] float3 normal : NORMAL0;
+[[vk::location(2)]] float4 color : COLOR0;
+[[vk::location(3)]] float3 worldpos : NORMAL1;
+};
+
+#if DEBUG_VIEW == DEBUG_VIEW_PRIMITIVES
+// Meshlet of each triangle, read as the primitive ID by the primitives debug view of gltf.frag.hlsl
+struct PrimitiveOutput
+{
+	uint meshletIndex : SV_PrimitiveID;
+};
+#endif
+
+static const uint vertexStride = 28;
+
+float snorm16(uint value)
+{
+	return max(float(int(value << 16) >> 16) / 32767.0, -1.0);
+}
+
+[outputtopology("triangle")]
+[numthreads(64, 1, 1)]
+#if DEBUG_VIEW == DEBUG_VIEW_PRIMITIVES
+void main(uint3 GroupThreadID : SV_GroupThreadID, uint3 GroupID : SV_GroupID, in payload Payload taskPayload, out indices uint3 triangles[124], out vertices VSOutput outVertices[64], out primitives PrimitiveOutput outPrimitives[124])
+#else
+void main(uint3 GroupThreadID : SV_GroupThreadID, uint3 GroupID : SV_GroupID, in payload Payload taskPayload, out indices uint3 triangles[124], out vertices VSOutput outVertices[64])
+#endif
+{
+	const Meshlet meshlet = meshlets[taskPayload.meshletIndices[GroupID.x]];
+	SetMeshOutputCounts(meshlet.vertexCount, meshlet.triangleCount);
+
+	InstanceVariation variation;
+	const float4x4 instance = decodeInstance(instances[taskPayload.instanceIndex], variation);
+	const float4x4 model = mul(instance, primitive.node);
+	const float4x4 modelViewProjection = mul(ubo.projection, mul(ubo.view, model));
+
+	for (uint i = GroupThreadID.x; i < meshlet.vertexCount; i += 64) {
+		const uint address = meshletVertices[meshlet.vertexOffset + i] * vertexStride;
+		const float3 vertexPos = asfloat(vertexData.Load3(address));
+		const float3 pos = displacePosition(vertexPos, variation);
+		const uint2 normal = vertexData.Load2(address + 12);
+		const uint uv = vertexData.Load(address + 20);
+		const uint color = vertexData.Load(address + 24);
+
+		VSOutput output = (VSOutput)0;
+		output.pos = mul(modelViewProjection, float4(pos, 1.0));
+		output.worldpos = mul(model, float4(pos, 1.0)).xyz;
+		output.uv = float2(f16tof32(uv), f16tof32(uv >> 16));
+		// Note: Only works with uniform scaling
+		output.normal = mul((float3x3)model, displaceNormal(vertexPos, float3(snorm16(normal.x), snorm16(normal.x >> 16), snorm16(normal.y)), variation));
+		output.color = tintColor(float4(color & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, color >> 24) / 255.0, variation);
+		outVertices[i] = output;
+	}
+
+	for (uint i = GroupThreadID.x; i < meshlet.triangleCount; i += 64) {
+		const uint packedTriangle = meshletTriangles[meshlet.triangleOffset + i];
+		triangles[i] = uint3(packedTriangle & 0xff, (packedTriangle >> 8) & 0xff, (packedTriangle >> 16) & 0xff);
+#if DEBUG_VIEW == DEBUG_VIEW_PRIMITIVES
+		outPrimitives[i].meshletIndex = taskPayload.meshletIndices[GroupID.x];
+#endif
+	}
+}
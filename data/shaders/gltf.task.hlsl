@@ -0,0 +1,122 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Culls the meshlets of one primitive instance against the view frustum and their normal cones, only visible meshlets are passed on to the mesh shader
+
+#include "includes/variation.hlsl"
+#include "includes/instance.hlsl"
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+};
+[[vk::binding(0, 0)]]
+ConstantBuffer<UBO> ubo;
+
+[[vk::binding(1, 0)]]
+StructuredBuffer<Instance> instances;
+
+// Matches vks::meshoptimizer::Meshlet
+struct Meshlet
+{
+	float3 center;
+	float radius;
+	float3 coneAxis;
+	float coneCutoff;
+	uint vertexOffset;
+	uint triangleOffset;
+	uint vertexCount;
+	uint triangleCount;
+};
+[[vk::binding(1, 2)]]
+StructuredBuffer<Meshlet> meshlets;
+
+struct PushConsts
+{
+	float4x4 node;
+	uint materialIndex;
+	uint radianceIndex;
+	uint irradianceIndex;
+	uint firstMeshlet;
+	uint meshletCount;
+	uint firstInstance;
+};
+[[vk::push_constant]] PushConsts primitive;
+
+struct Payload
+{
+	uint meshletIndices[32];
+	uint instanceIndex;
+};
+groupshared Payload payload;
+groupshared uint visibleCount;
+
+bool isVisible(Meshlet meshlet, float4x4 modelView, InstanceVariation variation)
+{
+	// Uniform scaling is assumed (like for the normals in the vertex shaders), so the largest axis scales the radius
+	const float scale = max(length(modelView[0].xyz), max(length(modelView[1].xyz), length(modelView[2].xyz)));
+	const float3 center = mul(modelView, float4(meshlet.center, 1.0)).xyz;
+	// Displaced vertices move by up to the variation's strength times their distance to the mesh's origin
+	const float radius = (meshlet.radius + variation.strength * (meshlet.radius + length(meshlet.center))) * scale;
+
+	// View space frustum planes, derived from the projection matrix rows
+	// The depth planes (z >= 0 and z <= w) are the near and far plane, or the other way around with reverse Z
+	// An infinite far plane has no normal and lets everything pass
+	const float4 planes[6] = {
+		ubo.projection[3] + ubo.projection[0],
+		ubo.projection[3] - ubo.projection[0],
+		ubo.projection[3] + ubo.projection[1],
+		ubo.projection[3] - ubo.projection[1],
+		ubo.projection[2],
+		ubo.projection[3] - ubo.projection[2]
+	};
+	for (uint i = 0; i < 6; i++) {
+		if (dot(planes[i].xyz, center) + planes[i].w <= -radius * length(planes[i].xyz)) {
+			return false;
+		}
+	}
+
+	// Cone culling, the camera is at the origin in view space
+	// The cones are those of the undisplaced normals, so they don't apply to varied instances
+	if ((meshlet.coneCutoff < 1.0) && (variation.strength <= 0.0)) {
+		const float3 axis = normalize(mul((float3x3)modelView, meshlet.coneAxis));
+		if (dot(center, axis) >= meshlet.coneCutoff * length(center) + radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+[numthreads(32, 1, 1)]
+void main(uint3 GroupThreadID : SV_GroupThreadID, uint3 GroupID : SV_GroupID)
+{
+	if (GroupThreadID.x == 0) {
+		visibleCount = 0;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	const uint meshletIndex = GroupID.x * 32 + GroupThreadID.x;
+	const uint instanceIndex = primitive.firstInstance + GroupID.y;
+	if (meshletIndex < primitive.meshletCount) {
+		InstanceVariation variation;
+		const float4x4 instance = decodeInstance(instances[instanceIndex], variation);
+		const float4x4 modelView = mul(ubo.view, mul(instance, primitive.node));
+		if (isVisible(meshlets[primitive.firstMeshlet + meshletIndex], modelView, variation)) {
+			uint index;
+			InterlockedAdd(visibleCount, 1, index);
+			payload.meshletIndices[index] = primitive.firstMeshlet + meshletIndex;
+		}
+	}
+	if (GroupThreadID.x == 0) {
+		payload.instanceIndex = instanceIndex;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	DispatchMesh(visibleCount, 1, 1, payload);
+}
@@ -8,22 +8,41 @@ struct UBO
 
 cbuffer ubo : register(b0) { UBO ubo; }
 
+// SKINNED: Skins the vertices with the joint palette of the drawn instance, vertices then need to use the default vertex layout (the compact one has no joints and weights)
+#ifdef SKINNED
+// Joint palettes of all skinned instances drawn in this frame
+[[vk::binding(3, 0)]]
+StructuredBuffer<float4x4> jointMatrices;
+
+static const uint noJoints = 0xffffffff;
+#endif
+
 struct VSInput
 {
 [[vk::location(0)]]float3 pos : POSITION0;
 [[vk::location(1)]]float3 normal : NORMAL0;
 [[vk::location(2)]]float2 uv : TEXCOORD0;
+#ifdef SKINNED
+[[vk::location(4)]]float4 joint0 : TEXCOORD1;
+[[vk::location(5)]]float4 weight0 : TEXCOORD2;
+#endif
 [[vk::location(6)]]float4 color : COLOR0;
 };
 
+// Matches vkglTF::PushConstBlock
 struct PushConsts {
 	float4x4 model;
+	uint materialIndex;
+	uint radianceIndex;
+	uint irradianceIndex;
+	// Start of the primitive's joint palette in jointMatrices, vkglTF::noJoints if the primitive isn't skinned
+	uint jointOffset;
 };
 [[vk::push_constant]] PushConsts primitive;
 
 struct VSOutput
 {
-	float4 pos : SV_POSITION;
+	precise float4 pos : SV_POSITION;
 [[vk::location(0)]] float2 uv : TEXCOORD0;
 [[vk::location(1)]] float3 normal : NORMAL0;
 [[vk::location(2)]] float4 color : COLOR0;
@@ -33,12 +52,24 @@ struct VSOutput
 VSOutput main(VSInput input)
 {
 	VSOutput output = (VSOutput)0;
-    output.worldpos = mul(primitive.model, float4(input.pos, 1.0)).xyz;
-	float4x4 modelView = mul(ubo.view, primitive.model);
+	float4x4 model = primitive.model;
+#ifdef SKINNED
+	if (primitive.jointOffset != noJoints) {
+		const uint4 joints = uint4(input.joint0) + primitive.jointOffset;
+		const float4x4 skin =
+			input.weight0.x * jointMatrices[joints.x] +
+			input.weight0.y * jointMatrices[joints.y] +
+			input.weight0.z * jointMatrices[joints.z] +
+			input.weight0.w * jointMatrices[joints.w];
+		model = mul(model, skin);
+	}
+#endif
+    output.worldpos = mul(model, float4(input.pos, 1.0)).xyz;
+	float4x4 modelView = mul(ubo.view, model);
 	output.pos = mul(ubo.projection, mul(modelView, float4(input.pos, 1.0)));
     output.uv = input.uv;
 	// Note: Only works with uniform scaling
-    output.normal = mul(primitive.model, input.normal);
+    output.normal = mul((float3x3)model, input.normal);
 	output.color = input.color;
 	return output;
 }
@@ -0,0 +1,57 @@
+#include "includes/variation.hlsl"
+#include "includes/instance.hlsl"
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+// Per-instance transforms, written by the application for all visible actors sharing a model
+[[vk::binding(1, 0)]]
+StructuredBuffer<Instance> instances;
+
+struct VSInput
+{
+[[vk::location(0)]]float3 pos : POSITION0;
+[[vk::location(1)]]float3 normal : NORMAL0;
+[[vk::location(2)]]float2 uv : TEXCOORD0;
+[[vk::location(6)]]float4 color : COLOR0;
+};
+
+struct PushConsts {
+	// Node (local) matrix of the primitive, the actor's matrix is fetched from the instance buffer
+	float4x4 node;
+};
+[[vk::push_constant]] PushConsts primitive;
+
+struct VSOutput
+{
+	precise float4 pos : SV_POSITION;
+[[vk::location(0)]] float2 uv : TEXCOORD0;
+[[vk::location(1)]] float3 normal : NORMAL0;
+[[vk::location(2)]] float4 color : COLOR0;
+[[vk::location(3)]] float3 worldpos : NORMAL1;
+};
+
+// Note: SV_InstanceID includes the firstInstance of the draw (DXC default), which is used as the offset into the instance buffer
+VSOutput main(VSInput input, uint InstanceIndex : SV_InstanceID)
+{
+	VSOutput output = (VSOutput)0;
+	InstanceVariation variation;
+	const float4x4 instance = decodeInstance(instances[InstanceIndex], variation);
+	const float3 pos = displacePosition(input.pos, variation);
+	float4x4 model = mul(instance, primitive.node);
+	output.worldpos = mul(model, float4(pos, 1.0)).xyz;
+	float4x4 modelView = mul(ubo.view, model);
+	output.pos = mul(ubo.projection, mul(modelView, float4(pos, 1.0)));
+	output.uv = input.uv;
+	// Note: Only works with uniform scaling
+	output.normal = mul((float3x3)model, displaceNormal(input.pos, input.normal, variation));
+	output.color = tintColor(input.color, variation);
+	return output;
+}
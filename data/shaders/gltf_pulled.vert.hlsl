@@ -0,0 +1,81 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Instanced vertex shader that fetches its vertices through the buffer device address of the model's vertex buffer instead of the vertex input stage
+// Vertices need to use the compact vertex layout
+
+#include "includes/variation.hlsl"
+#include "includes/instance.hlsl"
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+// Per-instance transforms, written by the application for all visible actors sharing a model
+[[vk::binding(1, 0)]]
+StructuredBuffer<Instance> instances;
+
+// Matches vkglTF::PushConstBlock
+struct PushConsts {
+	// Node (local) matrix of the primitive, the actor's matrix is fetched from the instance buffer
+	float4x4 node;
+	uint materialIndex;
+	uint radianceIndex;
+	uint irradianceIndex;
+	// Only read by the skinning vertex shader
+	uint jointOffset;
+	// Start of the model's vertex buffer, vkglTF::CompactVertex with 28 bytes
+	uint64_t vertexAddress;
+};
+[[vk::push_constant]] PushConsts primitive;
+
+struct VSOutput
+{
+	precise float4 pos : SV_POSITION;
+[[vk::location(0)]] float2 uv : TEXCOORD0;
+[[vk::location(1)]] float3 normal : NORMAL0;
+[[vk::location(2)]] float4 color : COLOR0;
+[[vk::location(3)]] float3 worldpos : NORMAL1;
+};
+
+// Set by the application to the size of vkglTF::CompactVertex
+[[vk::constant_id(0)]] const uint vertexStride = 28;
+
+float snorm16(uint value)
+{
+	return max(float(int(value << 16) >> 16) / 32767.0, -1.0);
+}
+
+// Note: SV_VertexID includes the vertexOffset of the draw, so it also addresses vertices of models placed in the geometry pool
+// Note: SV_InstanceID includes the firstInstance of the draw (DXC default), which is used as the offset into the instance buffer
+VSOutput main(uint VertexIndex : SV_VertexID, uint InstanceIndex : SV_InstanceID)
+{
+	const uint64_t address = primitive.vertexAddress + uint64_t(VertexIndex) * vertexStride;
+	const float3 vertexPos = vk::RawBufferLoad<float3>(address);
+	const uint2 normal = vk::RawBufferLoad<uint2>(address + 12);
+	const uint uv = vk::RawBufferLoad<uint>(address + 20);
+	const uint color = vk::RawBufferLoad<uint>(address + 24);
+
+	VSOutput output = (VSOutput)0;
+	InstanceVariation variation;
+	const float4x4 instance = decodeInstance(instances[InstanceIndex], variation);
+	const float3 pos = displacePosition(vertexPos, variation);
+	float4x4 model = mul(instance, primitive.node);
+	output.worldpos = mul(model, float4(pos, 1.0)).xyz;
+	float4x4 modelView = mul(ubo.view, model);
+	output.pos = mul(ubo.projection, mul(modelView, float4(pos, 1.0)));
+	output.uv = float2(f16tof32(uv), f16tof32(uv >> 16));
+	// Note: Only works with uniform scaling
+	output.normal = mul((float3x3)model, displaceNormal(vertexPos, float3(snorm16(normal.x), snorm16(normal.x >> 16), snorm16(normal.y)), variation));
+	output.color = tintColor(float4(color & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, color >> 24) / 255.0, variation);
+	return output;
+}
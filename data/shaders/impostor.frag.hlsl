@@ -0,0 +1,66 @@
+[[vk::binding(0, 1)]]
+Texture2D textures[];
+[[vk::binding(0, 1)]]
+SamplerState samplerTexture;
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+	// World position of the camera, matrices and the view are relative to it
+	float4 cameraPosition;
+};
+[[vk::binding(0, 0)]]
+ConstantBuffer<UBO> ubo;
+
+// Matches ImpostorPushConstBlock
+struct PushConsts {
+	float4 bounds;
+	uint albedoIndex;
+	uint normalIndex;
+	uint frameCount;
+	// Keeps lower mips from blending neighbouring frames of the atlas
+	float maxLod;
+};
+[[vk::push_constant]] PushConsts impostor;
+
+struct VSOutput
+{
+	float4 pos : SV_POSITION;
+[[vk::location(0)]] float2 uv : TEXCOORD0;
+[[vk::location(1)]] float3 worldpos : NORMAL0;
+[[vk::location(2)]] nointerpolation float3 axisX : NORMAL1;
+[[vk::location(3)]] nointerpolation float3 axisY : NORMAL2;
+[[vk::location(4)]] nointerpolation float3 axisZ : NORMAL3;
+[[vk::location(5)]] nointerpolation float fade : TEXCOORD1;
+};
+
+// 4x4 ordered dither, impostors fading in cover a growing share of the pixels without blending
+static const float ditherMatrix[16] = {
+	0.0 / 16.0, 8.0 / 16.0, 2.0 / 16.0, 10.0 / 16.0,
+	12.0 / 16.0, 4.0 / 16.0, 14.0 / 16.0, 6.0 / 16.0,
+	3.0 / 16.0, 11.0 / 16.0, 1.0 / 16.0, 9.0 / 16.0,
+	15.0 / 16.0, 7.0 / 16.0, 13.0 / 16.0, 5.0 / 16.0
+};
+
+float4 main(VSOutput input) : SV_TARGET
+{
+	float lod = min(textures[impostor.albedoIndex].CalculateLevelOfDetail(samplerTexture, input.uv), impostor.maxLod);
+	float4 albedo = textures[impostor.albedoIndex].SampleLevel(samplerTexture, input.uv, lod);
+	uint2 pixel = uint2(input.pos.xy) % 4;
+	clip(albedo.a - 0.5);
+	clip(input.fade - ditherMatrix[pixel.y * 4 + pixel.x] - 0.001);
+
+	float4 normalOcclusion = textures[impostor.normalIndex].SampleLevel(samplerTexture, input.uv, lod);
+	float3x3 basis = float3x3(input.axisX, input.axisY, input.axisZ);
+	float3 N = normalize(mul(normalOcclusion.xyz * 2.0 - 1.0, basis));
+
+	// Same light as the glTF shader, the impostors are too small for the specular and ambient terms to matter, so only the diffuse part is kept
+	float3 lightPos = float3(0.0, 0.0, 0.0) - ubo.cameraPosition.xyz;
+	float3 lightDir = normalize(lightPos - input.worldpos);
+	float3 diffuse = max(dot(N, lightDir), 0.0);
+	float3 ambient = max(diffuse, 0.1) * 2.5 * normalOcclusion.a;
+	return float4((ambient + diffuse) * albedo.rgb, 1.0);
+}
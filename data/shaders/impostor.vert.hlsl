@@ -0,0 +1,100 @@
+// Camera facing quads of distant actors, each one shows the frame of its model's impostor atlas that was baked from the direction closest to the view direction
+
+#include "includes/variation.hlsl"
+#include "includes/instance.hlsl"
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+// The actor's camera relative transform, the variation's seed is replaced with the impostor's opacity
+[[vk::binding(1, 0)]]
+StructuredBuffer<Instance> instances;
+
+// Matches ImpostorPushConstBlock
+struct PushConsts {
+	// Bounding sphere of the model in model space
+	float4 bounds;
+	uint albedoIndex;
+	uint normalIndex;
+	// Frames per row and column of the atlas
+	uint frameCount;
+	float maxLod;
+};
+[[vk::push_constant]] PushConsts impostor;
+
+struct VSOutput
+{
+	float4 pos : SV_POSITION;
+[[vk::location(0)]] float2 uv : TEXCOORD0;
+[[vk::location(1)]] float3 worldpos : NORMAL0;
+[[vk::location(2)]] nointerpolation float3 axisX : NORMAL1;
+[[vk::location(3)]] nointerpolation float3 axisY : NORMAL2;
+[[vk::location(4)]] nointerpolation float3 axisZ : NORMAL3;
+[[vk::location(5)]] nointerpolation float fade : TEXCOORD1;
+};
+
+float2 signNotZero(float2 v)
+{
+	return float2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Octahedral mapping around the y axis, must match octahedralDecode in main.cpp
+float2 octahedralEncode(float3 direction)
+{
+	direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+	float2 encoded = direction.xz;
+	if (direction.y < 0.0) {
+		encoded = (1.0 - abs(encoded.yx)) * signNotZero(encoded);
+	}
+	return encoded;
+}
+
+float3 octahedralDecode(float2 encoded)
+{
+	float3 direction = float3(encoded.x, 1.0 - abs(encoded.x) - abs(encoded.y), encoded.y);
+	if (direction.y < 0.0) {
+		direction.xz = (1.0 - abs(direction.zx)) * signNotZero(direction.xz);
+	}
+	return normalize(direction);
+}
+
+VSOutput main(uint VertexIndex : SV_VertexID, uint InstanceIndex : SV_InstanceID)
+{
+	VSOutput output = (VSOutput)0;
+	InstanceVariation variation;
+	const float4x4 instance = decodeInstance(instances[InstanceIndex], variation);
+	// Rows are the matrix' columns, so mul(v, basis) transforms from model space and mul(basis, v) back (up to the scale)
+	float3x3 basis = transpose((float3x3)instance);
+	float3 center = instance._m03_m13_m23 + mul(impostor.bounds.xyz, basis);
+
+	// The camera is at the origin of the render space
+	float3 viewDirection = normalize(mul(basis, -center));
+	float frames = float(impostor.frameCount);
+	float2 frame = min(floor((octahedralEncode(viewDirection) * 0.5 + 0.5) * frames), frames - 1.0);
+	float3 frameDirection = octahedralDecode((frame + 0.5) / frames * 2.0 - 1.0);
+	// Must match the frame basis in Application::bakeImpostor
+	float3 up = abs(frameDirection.y) > 0.999 ? float3(0.0, 0.0, 1.0) : float3(0.0, 1.0, 0.0);
+	float3 right = normalize(cross(up, frameDirection));
+	up = cross(frameDirection, right);
+
+	// Two triangles
+	const float2 corners[6] = { float2(-1.0, -1.0), float2(1.0, -1.0), float2(1.0, 1.0), float2(-1.0, -1.0), float2(1.0, 1.0), float2(-1.0, 1.0) };
+	float2 corner = corners[VertexIndex];
+	float3 offset = (corner.x * right + corner.y * up) * impostor.bounds.w;
+	output.worldpos = center + mul(offset, basis);
+	output.pos = mul(ubo.projection, mul(ubo.view, float4(output.worldpos, 1.0)));
+	// Frames are baked with up at the top
+	output.uv = (frame + float2(corner.x, -corner.y) * 0.5 + 0.5) / frames;
+	output.axisX = normalize(basis[0]);
+	output.axisY = normalize(basis[1]);
+	output.axisZ = normalize(basis[2]);
+	output.fade = variation.seed;
+	return output;
+}
@@ -0,0 +1,81 @@
+// Writes the albedo and model space normal of a model into one frame of its impostor atlas, see Application::bakeImpostor
+// Uses the vertex shader of the glTF pipeline, drawn with an identity matrix so its normals stay in model space
+[[vk::binding(0, 1)]]
+Texture2D textures[];
+[[vk::binding(0, 1)]]
+Texture2DArray textureArrays[];
+[[vk::binding(0, 1)]]
+SamplerState samplerTexture;
+
+#include "includes/texture_arrays.hlsl"
+
+// Matches vkglTF::MaterialData
+struct Material
+{
+    float4 baseColorFactor;
+    float4 emissiveFactor;
+    float metallicFactor;
+    float roughnessFactor;
+    float alphaCutoff;
+    uint alphaMode;
+    uint baseColorTexture;
+    uint metallicRoughnessTexture;
+    uint normalTexture;
+    uint occlusionTexture;
+    uint emissiveTexture;
+    // 8 bit layer code per texture, see includes/texture_arrays.hlsl
+    uint textureLayers[2];
+    uint padding;
+};
+[[vk::binding(2, 0)]]
+StructuredBuffer<Material> materials;
+
+static const uint NO_TEXTURE = 0xFFFFFFFF;
+static const uint ALPHAMODE_MASK = 1;
+
+struct PushConsts
+{
+    float4x4 model;
+    uint materialIndex;
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+struct VSOutput
+{
+		float4 pos : SV_POSITION;
+[[vk::location(0)]] float2 uv : POSITION0;
+[[vk::location(1)]] float3 normal : NORMAL0;
+[[vk::location(2)]] float4 color : COLOR0;
+[[vk::location(3)]] float3 worldpos : NORMAL1;
+};
+
+struct FSOutput
+{
+    // Alpha marks the texels covered by the model
+    float4 albedo : SV_TARGET0;
+    // Model space normal scaled to [0, 1], ambient occlusion in alpha
+    float4 normal : SV_TARGET1;
+};
+
+FSOutput main(VSOutput input)
+{
+    Material material = materials[pushConsts.materialIndex];
+
+    float4 albedo = material.baseColorFactor;
+    if (material.baseColorTexture != NO_TEXTURE) {
+        albedo *= sampleMaterialTexture(material.baseColorTexture, textureLayerCode(material.textureLayers, TEXTURE_BASE_COLOR), input.uv);
+    }
+    if (material.alphaMode == ALPHAMODE_MASK) {
+        clip(albedo.a - material.alphaCutoff);
+    }
+
+    float occlusion = 1.0;
+    if (material.occlusionTexture != NO_TEXTURE) {
+        occlusion = sampleMaterialTexture(material.occlusionTexture, textureLayerCode(material.textureLayers, TEXTURE_OCCLUSION), input.uv).r;
+    }
+
+    FSOutput output;
+    output.albedo = float4(albedo.rgb, 1.0);
+    output.normal = float4(normalize(input.normal) * 0.5 + 0.5, occlusion);
+    return output;
+}
@@ -0,0 +1,128 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Building blocks of the compute primitives (prefix sums, stream compaction and radix sort), see GpuPrimitives.h
+// Each thread of a workgroup handles PRIMITIVES_ITEMS consecutive elements, so a tile of PRIMITIVES_TILE_SIZE elements is processed per workgroup
+// Waves are assumed to cover consecutive local invocation indices in lane order, which is the case for one dimensional workgroups on all current implementations
+
+// Matches the constants of GpuPrimitives
+#define PRIMITIVES_THREADS 256
+#define PRIMITIVES_ITEMS 4
+#define PRIMITIVES_TILE_SIZE (PRIMITIVES_THREADS * PRIMITIVES_ITEMS)
+
+// Matches GpuPrimitives::PushConstants
+struct PushConsts {
+	// Number of elements
+	uint count;
+	// Number of tiles of the dispatch
+	uint tileCount;
+	// Radix sort: First bit of the digit sorted by the pass
+	uint shift;
+	// Radix sort: Values are moved along with the keys if set
+	uint hasValues;
+};
+[[vk::push_constant]] PushConsts consts;
+
+// Element 0 is the counter tiles acquire their index from, followed by the status of each tile
+// A status is 0 until the tile has published its own sum (flag = aggregate) and later the sum of itself and all preceding tiles (flag = prefix)
+// The sum is stored in the lower 30 bits, so sums of a single call need to stay below 2^30
+[[vk::binding(2, 0)]] globallycoherent RWStructuredBuffer<uint> tileStatus;
+
+static const uint TILE_STATUS_AGGREGATE = 1u << 30;
+static const uint TILE_STATUS_PREFIX = 2u << 30;
+static const uint TILE_STATUS_VALUE_MASK = (1u << 30) - 1;
+
+// Enough slots for the smallest wave size Vulkan allows
+groupshared uint waveSums[PRIMITIVES_THREADS / 4];
+groupshared uint workgroupSum;
+groupshared uint tileIndex;
+groupshared uint tilePrefix;
+
+// Exclusive prefix sum of value over all threads of the workgroup in local index order, total receives the sum over all threads
+// Needs to be called by all threads of the workgroup
+uint workgroupPrefixSum(uint value, uint localIndex, out uint total)
+{
+	const uint laneCount = WaveGetLaneCount();
+	const uint waveIndex = localIndex / laneCount;
+	const uint waveCount = (PRIMITIVES_THREADS + laneCount - 1) / laneCount;
+	const uint wavePrefix = WavePrefixSum(value);
+	const uint waveSum = WaveActiveSum(value);
+	if (WaveIsFirstLane()) {
+		waveSums[waveIndex] = waveSum;
+	}
+	GroupMemoryBarrierWithGroupSync();
+	// The sums of the waves are scanned by the first wave, or serially if there are more waves than lanes (only for very small wave sizes)
+	if (waveCount <= laneCount) {
+		if (waveIndex == 0) {
+			const uint sum = (localIndex < waveCount) ? waveSums[localIndex] : 0;
+			const uint prefix = WavePrefixSum(sum);
+			if (localIndex < waveCount) {
+				waveSums[localIndex] = prefix;
+			}
+			if (localIndex == waveCount - 1) {
+				workgroupSum = prefix + sum;
+			}
+		}
+	} else if (localIndex == 0) {
+		uint prefix = 0;
+		for (uint i = 0; i < waveCount; i++) {
+			const uint sum = waveSums[i];
+			waveSums[i] = prefix;
+			prefix += sum;
+		}
+		workgroupSum = prefix;
+	}
+	GroupMemoryBarrierWithGroupSync();
+	total = workgroupSum;
+	const uint result = waveSums[waveIndex] + wavePrefix;
+	// The shared sums are reused by the next call
+	GroupMemoryBarrierWithGroupSync();
+	return result;
+}
+
+// Tiles are numbered in the order their workgroups start instead of by their group id, so a tile only ever waits for tiles that are already running
+uint acquireTile(uint localIndex)
+{
+	if (localIndex == 0) {
+		InterlockedAdd(tileStatus[0], 1, tileIndex);
+	}
+	GroupMemoryBarrierWithGroupSync();
+	return tileIndex;
+}
+
+// Decoupled look-back: Publishes the sum of the tile right away, then walks back over the preceding tiles and adds up their sums
+// until a tile that already knows its prefix is found, so tiles don't wait for the full chain of their predecessors
+// Returns the sum of all preceding tiles, needs to be called by all threads of the workgroup
+uint lookBack(uint tile, uint tileSum, uint localIndex)
+{
+	if (localIndex == 0) {
+		uint prefix = 0;
+		uint previous;
+		if (tile == 0) {
+			InterlockedExchange(tileStatus[1], tileSum | TILE_STATUS_PREFIX, previous);
+		} else {
+			InterlockedExchange(tileStatus[1 + tile], tileSum | TILE_STATUS_AGGREGATE, previous);
+			uint predecessor = tile - 1;
+			while (true) {
+				uint status;
+				InterlockedAdd(tileStatus[1 + predecessor], 0, status);
+				if (status == 0) {
+					// Predecessor hasn't published its sum yet
+					continue;
+				}
+				prefix += status & TILE_STATUS_VALUE_MASK;
+				if ((status & TILE_STATUS_PREFIX) != 0) {
+					break;
+				}
+				predecessor--;
+			}
+			InterlockedExchange(tileStatus[1 + tile], (prefix + tileSum) | TILE_STATUS_PREFIX, previous);
+		}
+		tilePrefix = prefix;
+	}
+	GroupMemoryBarrierWithGroupSync();
+	return tilePrefix;
+}
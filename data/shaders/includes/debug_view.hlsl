@@ -0,0 +1,12 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Debug views of the scene, selected with DEBUG_VIEW by variants of the scene pipelines (values match DebugView in main.cpp)
+// Shaders are compiled without DEBUG_VIEW for regular rendering
+
+#define DEBUG_VIEW_OVERDRAW 1
+#define DEBUG_VIEW_QUAD_UTILIZATION 2
+#define DEBUG_VIEW_PRIMITIVES 3
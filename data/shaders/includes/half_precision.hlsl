@@ -0,0 +1,21 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Types for math that's fine with 16 bit precision, like colors, weights and normalized directions in shading and post processing
+// With HALF_PRECISION these are 16 bit floats (compiled with -enable-16bit-types, needs shaderFloat16), which lowers register pressure and ALU cost on GPUs with native 16 bit math
+// Positions, texture coordinates and depth need to stay at full precision, as do values that can exceed the 16 bit range (e.g. squared distances)
+
+#if defined(HALF_PRECISION)
+typedef float16_t hfloat;
+typedef float16_t2 hfloat2;
+typedef float16_t3 hfloat3;
+typedef float16_t4 hfloat4;
+#else
+typedef float hfloat;
+typedef float2 hfloat2;
+typedef float3 hfloat3;
+typedef float4 hfloat4;
+#endif
@@ -0,0 +1,78 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Compact per-instance transform of the instance buffers, half the size of a full matrix
+// Instances are uniformly scaled, which the normal transform of the instanced shaders already assumes, so a rotation quaternion and a single scale describe them
+// Needs variation.hlsl to be included before it
+
+// Matches InstanceData in main.cpp
+struct Instance
+{
+	// Camera relative
+	float3 position;
+	float scale;
+	// Rotation quaternion as four 16 bit snorm values, xy in the first and zw in the second component
+	uint2 rotation;
+	// x = seed, y = strength of the procedural variation, impostors store their opacity in x instead
+	float2 variation;
+};
+
+float2 unpackSnorm2x16(uint value)
+{
+	const int2 signedValue = int2(value << 16, value) >> 16;
+	return clamp(float2(signedValue) / 32767.0, -1.0, 1.0);
+}
+
+uint packSnorm2x16(float2 value)
+{
+	const int2 signedValue = int2(round(clamp(value, -1.0, 1.0) * 32767.0));
+	return (uint(signedValue.x) & 0xFFFF) | (uint(signedValue.y) << 16);
+}
+
+// Affine matrix of an instance, the translation is in the last column and the last row is (0, 0, 0, 1)
+float4x4 decodeInstance(Instance instance, out InstanceVariation variation)
+{
+	const float4 q = normalize(float4(unpackSnorm2x16(instance.rotation.x), unpackSnorm2x16(instance.rotation.y)));
+	const float3 q2 = q.xyz * q.xyz;
+	const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+	const float s = instance.scale;
+	variation.seed = instance.variation.x;
+	variation.strength = instance.variation.y;
+	return float4x4(
+		float4(s * (1.0 - 2.0 * (q2.y + q2.z)), s * 2.0 * (xy - wz), s * 2.0 * (xz + wy), instance.position.x),
+		float4(s * 2.0 * (xy + wz), s * (1.0 - 2.0 * (q2.x + q2.z)), s * 2.0 * (yz - wx), instance.position.y),
+		float4(s * 2.0 * (xz - wy), s * 2.0 * (yz + wx), s * (1.0 - 2.0 * (q2.x + q2.y)), instance.position.z),
+		float4(0.0, 0.0, 0.0, 1.0));
+}
+
+// Inverse of decodeInstance for matrices built from a translation, a rotation and a uniform scale, see packInstance in main.cpp
+Instance encodeInstance(float4x4 model, float2 variation)
+{
+	Instance instance;
+	instance.position = model._m03_m13_m23;
+	instance.scale = length(model._m00_m10_m20);
+	const float3x3 m = (float3x3)model / instance.scale;
+	// Largest component first, so the division is stable
+	float4 q;
+	const float trace = m._m00 + m._m11 + m._m22;
+	if (trace > 0.0) {
+		const float t = sqrt(trace + 1.0) * 2.0;
+		q = float4(m._m21 - m._m12, m._m02 - m._m20, m._m10 - m._m01, 0.25 * t * t) / t;
+	} else if ((m._m00 > m._m11) && (m._m00 > m._m22)) {
+		const float t = sqrt(1.0 + m._m00 - m._m11 - m._m22) * 2.0;
+		q = float4(0.25 * t * t, m._m01 + m._m10, m._m02 + m._m20, m._m21 - m._m12) / t;
+	} else if (m._m11 > m._m22) {
+		const float t = sqrt(1.0 + m._m11 - m._m00 - m._m22) * 2.0;
+		q = float4(m._m01 + m._m10, 0.25 * t * t, m._m12 + m._m21, m._m02 - m._m20) / t;
+	} else {
+		const float t = sqrt(1.0 + m._m22 - m._m00 - m._m11) * 2.0;
+		q = float4(m._m02 + m._m20, m._m12 + m._m21, 0.25 * t * t, m._m10 - m._m01) / t;
+	}
+	instance.rotation = uint2(packSnorm2x16(q.xy), packSnorm2x16(q.zw));
+	instance.variation = variation;
+	return instance;
+}
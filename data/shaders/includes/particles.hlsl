@@ -0,0 +1,95 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Shared by the particle compute shaders, layouts match the particle structures in main.cpp and particle.vert.hlsl
+
+// Blended particles are drawn back to front with alpha blending, all others are added to the target and don't need to be sorted
+#define PARTICLE_BLENDED 1
+
+struct Particle
+{
+	float3 position;
+	float age;
+	float3 velocity;
+	float lifetime;
+	float4 color;
+	float size;
+	// Change of the size per second
+	float growth;
+	uint flags;
+	// Fraction of the velocity lost per second
+	float drag;
+};
+
+struct Emitter
+{
+	float3 position;
+	uint count;
+	// All particles inherit this velocity and get a random one of up to speed in addition
+	float3 velocity;
+	float speed;
+	float4 color;
+	float lifetime;
+	float size;
+	float growth;
+	uint flags;
+};
+
+// Word offsets into the counter buffer, also used as indirect arguments
+#define COUNTER_ALIVE 0
+#define COUNTER_DEAD 2
+#define COUNTER_UNUSED 3
+#define COUNTER_ADDITIVE 4
+#define COUNTER_BLENDED 5
+#define ARGS_DISPATCH 8
+#define ARGS_DRAW_ADDITIVE 12
+#define ARGS_DRAW_BLENDED 16
+
+[[vk::binding(0, 0)]] RWStructuredBuffer<Particle> particles;
+// Dead list, both alive lists, the additive and the sorted blended draw lists, then the blended sort entries (key and particle index)
+[[vk::binding(1, 0)]] RWStructuredBuffer<uint> lists;
+[[vk::binding(2, 0)]] RWStructuredBuffer<uint> counters;
+
+// Matches ParticlePushConstBlock
+struct PushConsts
+{
+	float4 cameraPosition;
+	float deltaTime;
+	float time;
+	uint emitterCount;
+	// Alive list the frame's emission appends to and its simulation reads from, survivors are written to the other one
+	uint parity;
+	uint stage;
+	uint capacity;
+	uint maxBlended;
+	uint maxEmitCount;
+};
+[[vk::push_constant]] PushConsts consts;
+
+uint deadListOffset()
+{
+	return 0;
+}
+
+uint aliveListOffset(uint parity)
+{
+	return (1 + parity) * consts.capacity;
+}
+
+uint additiveListOffset()
+{
+	return 3 * consts.capacity;
+}
+
+uint blendedListOffset()
+{
+	return 4 * consts.capacity;
+}
+
+uint sortEntryOffset()
+{
+	return 4 * consts.capacity + consts.maxBlended;
+}
@@ -0,0 +1,289 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Material sampling and lighting of the scene's actors, shared by the forward fragment shader (gltf.frag.hlsl) and the visibility buffer's compute shading (visibility_shade.comp.hlsl)
+// Textures are sampled with explicit gradients, as implicit derivatives aren't available in compute shaders
+// Declares the scene's bindings of set 0 and the bindless textures of set 1
+
+[[vk::binding(0, 1)]]
+Texture2D textures[];
+[[vk::binding(0, 1)]]
+TextureCube cubemaps[];
+[[vk::binding(0, 1)]]
+Texture2DArray textureArrays[];
+[[vk::binding(0, 1)]]
+SamplerState samplerTexture;
+
+#include "virtual_texture.hlsl"
+#include "texture_arrays.hlsl"
+#include "half_precision.hlsl"
+
+// Matches shadowCascadeCount in main.cpp
+#define SHADOW_CASCADE_COUNT 3
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+	// World position of the camera, matrices and the view are relative to it
+	float4 cameraPosition;
+	// Same as the push constants of light_cull.comp.hlsl
+	float4 clusterDepth;
+	uint4 clusterGrid;
+	// xyz = direction the sun light travels in, w = intensity
+	float4 sunDirection;
+	// View depth each cascade ends at, w = length of the shadow rays if they're traced with ray queries instead (0 otherwise)
+	float4 shadowSplits;
+	// World space size of a texel of each cascade, w = cascade count (0 if shadows are disabled)
+	float4 shadowTexelSizes;
+	// Camera relative world space to the cascade's shadow map
+	float4x4 shadowMatrices[SHADOW_CASCADE_COUNT];
+	VirtualTexture virtualTexture;
+	// Spherical harmonics irradiance written by irradiance_sh.comp.hlsl, used instead of the irradiance cube if w of the first coefficient is 1
+	float4 irradianceSH[9];
+};
+[[vk::binding(0, 0)]]
+ConstantBuffer<UBO> ubo;
+
+// Matches vkglTF::MaterialData
+struct Material
+{
+	float4 baseColorFactor;
+	float4 emissiveFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	float alphaCutoff;
+	uint alphaMode;
+	uint baseColorTexture;
+	uint metallicRoughnessTexture;
+	uint normalTexture;
+	uint occlusionTexture;
+	uint emissiveTexture;
+	// 8 bit layer code per texture, see includes/texture_arrays.hlsl
+	uint textureLayers[2];
+	uint padding;
+};
+[[vk::binding(2, 0)]]
+StructuredBuffer<Material> materials;
+
+// Matches ClusterLight in main.cpp
+struct Light
+{
+	// World space, w = radius
+	float4 position;
+	float4 color;
+};
+[[vk::binding(4, 0)]]
+StructuredBuffer<Light> lights;
+// Light count and indices of each cluster, written by light_cull.comp.hlsl
+[[vk::binding(5, 0)]]
+StructuredBuffer<uint> clusterLights;
+// Matches maxLightsPerCluster in main.cpp
+static const uint MAX_LIGHTS_PER_CLUSTER = 64;
+
+// Pages of the virtual texture requested by the fragments, read back once the frame has completed
+[[vk::binding(7, 0)]]
+RWStructuredBuffer<uint> virtualTextureFeedback;
+
+// Cascades of the static casters (cached across frames) and of the dynamic casters (rendered every frame)
+[[vk::binding(6, 0)]]
+Texture2DArray shadowMaps[2];
+[[vk::binding(6, 0)]]
+SamplerComparisonState shadowSampler;
+
+#if defined(RAY_QUERY)
+// All actors of the frame in camera relative space, built by the culling pass
+[[vk::binding(8, 0)]]
+RaytracingAccelerationStructure topLevelAS;
+#endif
+
+static const uint NO_TEXTURE = 0xFFFFFFFF;
+static const uint ALPHAMODE_MASK = 1;
+
+// Attributes of the surface at a pixel, either interpolated by the rasterizer or reconstructed from the visibility buffer
+struct SceneSurface
+{
+	float2 uv;
+	// Screen space derivatives of the uv
+	float2 uvDx;
+	float2 uvDy;
+	float3 normal;
+	// Camera relative
+	float3 worldpos;
+	// Pixel coordinates, selects the pixels writing virtual texture feedback
+	float2 fragCoord;
+};
+
+hfloat3 fresnelSchlickRoughness(hfloat cosTheta, hfloat3 F0, hfloat roughness)
+{
+	const hfloat x = saturate(hfloat(1.0) - cosTheta);
+	const hfloat x2 = x * x;
+	return F0 + (max((hfloat(1.0) - roughness).rrr, F0) - F0) * (x2 * x2 * x);
+}
+
+// Same value the irradiance cube has for the normal, the coefficients already contain the cosine lobe convolution
+float3 evaluateIrradianceSH(float3 n)
+{
+	return max(ubo.irradianceSH[0].rgb * 0.282095
+		+ ubo.irradianceSH[1].rgb * (0.488603 * n.y)
+		+ ubo.irradianceSH[2].rgb * (0.488603 * n.z)
+		+ ubo.irradianceSH[3].rgb * (0.488603 * n.x)
+		+ ubo.irradianceSH[4].rgb * (1.092548 * n.x * n.y)
+		+ ubo.irradianceSH[5].rgb * (1.092548 * n.y * n.z)
+		+ ubo.irradianceSH[6].rgb * (0.315392 * (3.0 * n.z * n.z - 1.0))
+		+ ubo.irradianceSH[7].rgb * (1.092548 * n.x * n.z)
+		+ ubo.irradianceSH[8].rgb * (0.546274 * (n.x * n.x - n.y * n.y)), 0.0);
+}
+
+// Diffuse contribution of the point lights in the fragment's cluster
+float3 clusteredLighting(float3 worldpos, float3 N)
+{
+	// Views without light clusters (e.g. render views other than the main view) have an empty grid
+	if (ubo.clusterGrid.x == 0) {
+		return (0.0).rrr;
+	}
+	float4 viewPos = mul(ubo.view, float4(worldpos, 1.0));
+	float4 clipPos = mul(ubo.projection, viewPos);
+	float2 ndc = clipPos.xy / clipPos.w;
+	uint2 tile = min(uint2(saturate(ndc * 0.5 + 0.5) * float2(ubo.clusterGrid.xy)), ubo.clusterGrid.xy - 1);
+	float depth = max(-viewPos.z, ubo.clusterDepth.x);
+	uint slice = min(uint(max(log(depth) * ubo.clusterDepth.z + ubo.clusterDepth.w, 0.0)), ubo.clusterGrid.z - 1);
+	uint base = ((slice * ubo.clusterGrid.y + tile.y) * ubo.clusterGrid.x + tile.x) * MAX_LIGHTS_PER_CLUSTER;
+
+	float3 lighting = (0.0).rrr;
+	uint count = clusterLights[base];
+	for (uint i = 1; i <= count; i++) {
+		Light light = lights[clusterLights[base + i]];
+		float3 L = light.position.xyz - ubo.cameraPosition.xyz - worldpos;
+		float distanceSquared = dot(L, L);
+		// Smooth window, so the light reaches zero at its radius
+		float falloff = saturate(1.0 - pow(distanceSquared / (light.position.w * light.position.w), 2.0));
+		float attenuation = falloff * falloff / (distanceSquared + 1.0);
+		lighting += light.color.rgb * max(dot(N, L * rsqrt(max(distanceSquared, 1e-4))), 0.0) * attenuation;
+	}
+	return lighting;
+}
+
+// Visibility of the sun, the static and dynamic casters are combined by taking the smaller of both
+float sunShadow(float3 worldpos, float3 N)
+{
+#if defined(RAY_QUERY)
+	if (ubo.shadowSplits.w > 0.0) {
+		// Any hit towards the sun shadows the fragment, the start is offset along the normal (more with distance as precision drops) so surfaces don't shadow themselves
+		RayDesc ray;
+		ray.Origin = worldpos + N * max(0.02, length(worldpos) * 0.0005);
+		ray.Direction = -ubo.sunDirection.xyz;
+		ray.TMin = 0.0;
+		ray.TMax = ubo.shadowSplits.w;
+		RayQuery<RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_PROCEDURAL_PRIMITIVES> query;
+		query.TraceRayInline(topLevelAS, RAY_FLAG_NONE, 0xFF, ray);
+		query.Proceed();
+		return (query.CommittedStatus() == COMMITTED_TRIANGLE_HIT) ? 0.0 : 1.0;
+	}
+#endif
+	uint cascadeCount = uint(ubo.shadowTexelSizes.w);
+	if (cascadeCount == 0) {
+		return 1.0;
+	}
+	float depth = -mul(ubo.view, float4(worldpos, 1.0)).z;
+	uint cascade = 0;
+	while ((cascade < cascadeCount) && (depth > ubo.shadowSplits[cascade])) {
+		cascade++;
+	}
+	if (cascade == cascadeCount) {
+		return 1.0;
+	}
+	// Offset along the normal by the texel size, so surfaces don't shadow themselves
+	float3 offsetPos = worldpos + N * ubo.shadowTexelSizes[cascade] * 1.5;
+	float4 shadowPos = mul(ubo.shadowMatrices[cascade], float4(offsetPos, 1.0));
+	float2 uv = shadowPos.xy * 0.5 + 0.5;
+	if (any(uv < 0.0) || any(uv > 1.0) || (shadowPos.z > 1.0)) {
+		return 1.0;
+	}
+	// 2x2 bilinear comparisons
+	float visibility = 1.0;
+	for (uint i = 0; i < 2; i++) {
+		float sum = shadowMaps[i].SampleCmpLevelZero(shadowSampler, float3(uv, cascade), shadowPos.z, int2(-1, -1));
+		sum += shadowMaps[i].SampleCmpLevelZero(shadowSampler, float3(uv, cascade), shadowPos.z, int2(1, -1));
+		sum += shadowMaps[i].SampleCmpLevelZero(shadowSampler, float3(uv, cascade), shadowPos.z, int2(-1, 1));
+		sum += shadowMaps[i].SampleCmpLevelZero(shadowSampler, float3(uv, cascade), shadowPos.z, int2(1, 1));
+		visibility = min(visibility, sum * 0.25);
+	}
+	return visibility;
+}
+
+// Base color with alpha, the virtual texture is sampled instead of its source texture wherever it has a page resident
+float4 sampleAlbedo(Material material, SceneSurface surface)
+{
+	float4 albedo = material.baseColorFactor;
+	if (material.baseColorTexture != NO_TEXTURE) {
+		float4 baseColor;
+		bool virtualSampled = false;
+		const uint layerCode = textureLayerCode(material.textureLayers, TEXTURE_BASE_COLOR);
+		if ((ubo.virtualTexture.levelCount > 0) && (layerCode == 0) && (material.baseColorTexture == ubo.virtualTexture.sourceTexture)) {
+			const uint level = virtualTextureLevel(ubo.virtualTexture, surface.uvDx, surface.uvDy);
+			uint feedbackSlot;
+			if (writesVirtualTextureFeedback(ubo.virtualTexture, surface.fragCoord, feedbackSlot)) {
+				virtualTextureFeedback[feedbackSlot] = virtualTextureRequest(ubo.virtualTexture, surface.uv, level);
+			}
+			virtualSampled = sampleVirtualTexture(ubo.virtualTexture, surface.uv, level, baseColor);
+		}
+		if (!virtualSampled) {
+			baseColor = sampleMaterialTextureGrad(material.baseColorTexture, layerCode, surface.uv, surface.uvDx, surface.uvDy);
+		}
+		albedo *= baseColor;
+	}
+	return albedo;
+}
+
+// Lit color of an opaque surface, albedo is the result of sampleAlbedo
+// Surface terms are combined in half precision (see half_precision.hlsl), positions and the light accumulation (distances) stay at full precision
+float3 shadeSurface(Material material, float4 albedo, SceneSurface surface, uint irradianceIndex)
+{
+	hfloat metallic = hfloat(material.metallicFactor);
+	hfloat roughness = hfloat(material.roughnessFactor);
+	// glTF stores roughness in the green and metalness in the blue channel
+	if (material.metallicRoughnessTexture != NO_TEXTURE) {
+		hfloat4 metallicRoughness = hfloat4(sampleMaterialTextureGrad(material.metallicRoughnessTexture, textureLayerCode(material.textureLayers, TEXTURE_METALLIC_ROUGHNESS), surface.uv, surface.uvDx, surface.uvDy));
+		roughness *= metallicRoughness.g;
+		metallic *= metallicRoughness.b;
+	}
+
+	// Normalized at full precision, as camera relative positions exceed the 16 bit range
+	float3 N = normalize(surface.normal);
+	hfloat3 V = hfloat3(normalize(-surface.worldpos));
+	hfloat3 Nh = hfloat3(N);
+
+	hfloat3 F0 = lerp(hfloat(0.04).rrr, hfloat3(albedo.rgb), metallic);
+
+	hfloat3 kS = fresnelSchlickRoughness(max(dot(Nh, V), hfloat(0.0)), F0, roughness);
+	hfloat3 kD = (hfloat(1.0) - kS) * (hfloat(1.0) - metallic);
+	// The irradiance cube is low frequency, so its top level is sampled without derivatives
+	float3 irradiance = (ubo.irradianceSH[0].w == 1.0) ? evaluateIrradianceSH(N) : cubemaps[irradianceIndex].SampleLevel(samplerTexture, N, 0.0).rgb;
+
+	// World positions are camera relative
+	float3 lightPos = float3(0.0, 0.0, 0.0) - ubo.cameraPosition.xyz;
+	hfloat3 lightDir = hfloat3(normalize(lightPos - surface.worldpos));
+	hfloat3 diffuse = max(dot(Nh, lightDir), hfloat(0.0)).rrr;
+
+	hfloat ao = hfloat(2.5);
+	if (material.occlusionTexture != NO_TEXTURE) {
+		ao *= hfloat(sampleMaterialTextureGrad(material.occlusionTexture, textureLayerCode(material.textureLayers, TEXTURE_OCCLUSION), surface.uv, surface.uvDx, surface.uvDy).r);
+	}
+	hfloat3 ambient = max(kD * diffuse, hfloat(0.1).rrr) * ao;
+
+	hfloat3 emissive = hfloat3(material.emissiveFactor.rgb);
+	if (material.emissiveTexture != NO_TEXTURE) {
+		emissive *= hfloat3(sampleMaterialTextureGrad(material.emissiveTexture, textureLayerCode(material.textureLayers, TEXTURE_EMISSIVE), surface.uv, surface.uvDx, surface.uvDy).rgb);
+	}
+
+	hfloat3 pointLights = hfloat3(clusteredLighting(surface.worldpos, N));
+	hfloat3 sun = hfloat(max(dot(N, -ubo.sunDirection.xyz), 0.0) * ubo.sunDirection.w * sunShadow(surface.worldpos, N)).rrr;
+
+	return float3((ambient + diffuse + sun + pointLights) * hfloat3(albedo.rgb) + emissive);
+}
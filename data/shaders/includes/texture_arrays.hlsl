@@ -0,0 +1,38 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Sampling of material textures, which may have been packed into the layers of a texture array, see ModelCreateInfo::maxPackedTextureSize in glTF.h
+// Needs the bindless textures and textureArrays arrays and samplerTexture to be declared before it's included, both arrays alias the same binding
+// Indices are marked as non-uniform, as they differ between invocations wherever pixels of several materials are shaded together (e.g. the visibility buffer's shading pass)
+
+// Order of the textures in the layer codes of a material, matches vkglTF::MaterialData
+static const uint TEXTURE_BASE_COLOR = 0;
+static const uint TEXTURE_METALLIC_ROUGHNESS = 1;
+static const uint TEXTURE_NORMAL = 2;
+static const uint TEXTURE_OCCLUSION = 3;
+static const uint TEXTURE_EMISSIVE = 4;
+
+// 0 if the texture has a slot of its own, layer + 1 if its index refers to a texture array
+uint textureLayerCode(uint textureLayers[2], uint texture)
+{
+	return (textureLayers[texture / 4] >> ((texture % 4) * 8)) & 0xFF;
+}
+
+float4 sampleMaterialTexture(uint index, uint layerCode, float2 uv)
+{
+	if (layerCode == 0) {
+		return textures[NonUniformResourceIndex(index)].Sample(samplerTexture, uv);
+	}
+	return textureArrays[NonUniformResourceIndex(index)].Sample(samplerTexture, float3(uv, float(layerCode - 1)));
+}
+
+float4 sampleMaterialTextureGrad(uint index, uint layerCode, float2 uv, float2 uvDx, float2 uvDy)
+{
+	if (layerCode == 0) {
+		return textures[NonUniformResourceIndex(index)].SampleGrad(samplerTexture, uv, uvDx, uvDy);
+	}
+	return textureArrays[NonUniformResourceIndex(index)].SampleGrad(samplerTexture, float3(uv, float(layerCode - 1)), uvDx, uvDy);
+}
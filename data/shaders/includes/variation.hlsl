@@ -0,0 +1,75 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Procedural variation of actors sharing a mesh (e.g. the asteroids), each instance's shape is displaced with noise and its color is tinted
+// The variation is stored with each instance's transform, see instance.hlsl and toInstanceData in main.cpp
+// The strength is relative to the mesh's size (0 = drawn as is)
+// All passes drawing an instance need to displace it the same way, so depth only passes match the main pass
+
+struct InstanceVariation
+{
+	float seed;
+	float strength;
+};
+
+float variationHash(float3 p)
+{
+	p = frac(p * 0.3183099 + 0.1);
+	p *= 17.0;
+	return frac(p.x * p.y * p.z * (p.x + p.y + p.z));
+}
+
+// Value noise in [-1, 1] with a quintic falloff, so the displaced surface and its normals are smooth
+float variationNoise(float3 p)
+{
+	const float3 i = floor(p);
+	const float3 f = frac(p);
+	const float3 u = f * f * f * (f * (f * 6.0 - 15.0) + 10.0);
+	const float n = lerp(
+		lerp(lerp(variationHash(i), variationHash(i + float3(1, 0, 0)), u.x), lerp(variationHash(i + float3(0, 1, 0)), variationHash(i + float3(1, 1, 0)), u.x), u.y),
+		lerp(lerp(variationHash(i + float3(0, 0, 1)), variationHash(i + float3(1, 0, 1)), u.x), lerp(variationHash(i + float3(0, 1, 1)), variationHash(i + float3(1, 1, 1)), u.x), u.y),
+		u.z);
+	return n * 2.0 - 1.0;
+}
+
+// Points are moved along their direction from the mesh's origin, which keeps vertices shared by multiple faces (e.g. at UV seams) together
+// The displacement stays within strength times the distance to the origin, so bounds only need to grow by that factor
+float3 displacePosition(float3 pos, InstanceVariation variation)
+{
+	const float distance = length(pos);
+	if ((variation.strength <= 0.0) || (distance == 0.0)) {
+		return pos;
+	}
+	// The seed moves the noise domain, two octaves give large bumps with some detail
+	const float3 p = pos / distance * 1.5 + variation.seed * 113.0;
+	const float noise = variationNoise(p) * 0.7 + variationNoise(p * 2.7) * 0.3;
+	return pos * (1.0 + variation.strength * noise);
+}
+
+// Normal of the displaced surface, derived from the displaced positions of two nearby points on the tangent plane
+float3 displaceNormal(float3 pos, float3 normal, InstanceVariation variation)
+{
+	if (variation.strength <= 0.0) {
+		return normal;
+	}
+	const float3 tangent = normalize(cross(normal, (abs(normal.y) < 0.99) ? float3(0.0, 1.0, 0.0) : float3(1.0, 0.0, 0.0)));
+	const float3 bitangent = cross(normal, tangent);
+	const float epsilon = max(length(pos), 0.0001) * 0.01;
+	const float3 center = displacePosition(pos, variation);
+	const float3 displaced = cross(displacePosition(pos + tangent * epsilon, variation) - center, displacePosition(pos + bitangent * epsilon, variation) - center);
+	return (dot(displaced, displaced) > 0.0) ? normalize(displaced) : normal;
+}
+
+// Shifts the brightness and the hue towards warmer or colder tones
+float4 tintColor(float4 color, InstanceVariation variation)
+{
+	if (variation.strength <= 0.0) {
+		return color;
+	}
+	const float hue = frac(sin(variation.seed * 91.3458) * 47453.5453);
+	const float brightness = 0.8 + 0.4 * frac(hue * 7.13);
+	return float4(color.rgb * lerp(float3(0.85, 0.9, 1.05), float3(1.1, 0.95, 0.8), hue) * brightness, color.a);
+}
@@ -0,0 +1,85 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Sampling of a virtual texture through its page table and page cache, see VirtualTexture.h
+// Needs the bindless textures array and samplerTexture to be declared before it's included
+// Page table texels: rg = cache page, b = level of the cache page (may be less detailed than the texel's level), a = 1 if any page covers the texel
+
+// Matches VirtualTextureShaderData in VirtualTexture.h
+struct VirtualTexture
+{
+	uint sourceTexture;
+	uint pageTableTexture;
+	uint cacheTexture;
+	uint levelCount;
+	float2 size;
+	float pageSize;
+	float pageBorder;
+	float cacheSize;
+	// Slots of the feedback buffer and feedback tiles per row of the screen
+	uint feedbackSize;
+	uint feedbackWidth;
+	uint frame;
+};
+
+// Feedback slots are UINT_MAX if unused, requests are level << 28 | y << 14 | x, see VirtualTexture::addFeedback
+static const uint VIRTUAL_TEXTURE_NO_REQUEST = 0xFFFFFFFF;
+// Each tile of the screen writes one request per frame
+static const uint VIRTUAL_TEXTURE_FEEDBACK_TILE = 8;
+
+// Level of the virtual texture the texel footprint given by the screen space derivatives of the uv falls into, not clamped to the resident pages
+uint virtualTextureLevel(VirtualTexture vt, float2 uvDx, float2 uvDy)
+{
+	const float2 dx = uvDx * vt.size;
+	const float2 dy = uvDy * vt.size;
+	const float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+	return uint(clamp(floor(lod), 0.0, float(vt.levelCount - 1)));
+}
+
+// Page of the given level covering uv, which is wrapped like with repeat addressing
+uint2 virtualTexturePage(VirtualTexture vt, float2 uv, uint level)
+{
+	const float2 levelPages = max(floor(vt.size / (vt.pageSize * float(1u << level))), 1.0);
+	return min(uint2(frac(uv) * levelPages), uint2(levelPages) - 1);
+}
+
+uint virtualTextureRequest(VirtualTexture vt, float2 uv, uint level)
+{
+	const uint2 page = virtualTexturePage(vt, uv, level);
+	return (level << 28) | (page.y << 14) | page.x;
+}
+
+// Samples the most detailed resident page covering uv, returns false if no page is resident yet (e.g. right after startup)
+bool sampleVirtualTexture(VirtualTexture vt, float2 uv, uint level, out float4 color)
+{
+	color = float4(0.0, 0.0, 0.0, 0.0);
+	const uint2 page = virtualTexturePage(vt, uv, level);
+	const float4 entry = textures[vt.pageTableTexture].Load(int3(page, level));
+	if (entry.a < 0.5) {
+		return false;
+	}
+	const uint2 cachePage = uint2(entry.rg * 255.0 + 0.5);
+	const uint residentLevel = uint(entry.b * 255.0 + 0.5);
+	// Position inside the resident page, all of its texels are in the cache so the position is relative to the page's origin at its own level
+	const float2 texel = frac(uv) * vt.size / float(1u << residentLevel);
+	const float2 offset = texel - floor(texel / vt.pageSize) * vt.pageSize;
+	const float paddedPageSize = vt.pageSize + 2.0 * vt.pageBorder;
+	const float2 cacheTexel = float2(cachePage) * paddedPageSize + vt.pageBorder + offset;
+	// The cache only has a single level, the borders keep bilinear filtering inside the page
+	color = textures[vt.cacheTexture].SampleLevel(samplerTexture, cacheTexel / (vt.cacheSize * paddedPageSize), 0.0);
+	return true;
+}
+
+// True for a single fragment of each feedback tile, which one changes every frame so all parts of a tile are covered over time
+bool writesVirtualTextureFeedback(VirtualTexture vt, float2 fragCoord, out uint slot)
+{
+	const uint2 pixel = uint2(fragCoord);
+	const uint2 tile = pixel / VIRTUAL_TEXTURE_FEEDBACK_TILE;
+	const uint index = (vt.frame * 37u) % (VIRTUAL_TEXTURE_FEEDBACK_TILE * VIRTUAL_TEXTURE_FEEDBACK_TILE);
+	const uint2 selected = uint2(index % VIRTUAL_TEXTURE_FEEDBACK_TILE, index / VIRTUAL_TEXTURE_FEEDBACK_TILE);
+	slot = tile.y * vt.feedbackWidth + tile.x;
+	return all(pixel % VIRTUAL_TEXTURE_FEEDBACK_TILE == selected) && (tile.x < vt.feedbackWidth) && (slot < vt.feedbackSize);
+}
@@ -0,0 +1,32 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Visibility buffer: The visibility pass stores the instance and triangle covering each pixel, the compute passes then bin the pixels by material and shade each of them once
+// Values are the instance slot (x) and the triangle within the draws of the instance's level of detail (y), see visibility.frag.hlsl
+// Both get a full 32 bits, so neither the number of instances nor the triangles of a level of detail are limited by the encoding
+// Empty pixels are cleared to an instance slot that's never used
+
+static const uint VISIBILITY_EMPTY = 0xFFFFFFFF;
+
+uint2 encodeVisibility(uint instance, uint triangle)
+{
+	return uint2(instance, triangle);
+}
+
+bool isVisibilityEmpty(uint2 value)
+{
+	return value.x == VISIBILITY_EMPTY;
+}
+
+uint visibilityInstance(uint2 value)
+{
+	return value.x;
+}
+
+uint visibilityTriangle(uint2 value)
+{
+	return value.y;
+}
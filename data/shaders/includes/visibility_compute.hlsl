@@ -0,0 +1,93 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Bindings of the visibility buffer's compute passes (set 2) and the lookup of the draw a visibility value belongs to
+
+#include "visibility.hlsl"
+
+// Matches maxMaterials in main.cpp
+static const uint VISIBILITY_MATERIAL_COUNT = 4096;
+// The bins buffer holds the pixel count (and after the bins pass the first pixel list entry) of each material, followed by the dispatch arguments of the shading pass and the number of covered pixels
+static const uint VISIBILITY_DISPATCH_ARGS = VISIBILITY_MATERIAL_COUNT;
+static const uint VISIBILITY_PIXEL_COUNT = VISIBILITY_MATERIAL_COUNT + 3;
+// Workgroup size of the shading pass
+static const uint VISIBILITY_SHADE_THREADS = 64;
+
+// Matches VisibilityDraw in main.cpp, one per indirect command of the frame
+struct VisibilityDraw
+{
+	// Node (local) matrix of the primitive
+	float4x4 node;
+	// Start of the vertex and index buffers the command draws from
+	uint64_t vertexAddress;
+	uint64_t indexAddress;
+	uint firstIndex;
+	int vertexOffset;
+	// Triangles of the preceding draws of the same level of detail
+	uint firstTriangle;
+	uint materialIndex;
+	// 1, 2 or 4 bytes
+	uint indexSize;
+	uint padding[3];
+};
+
+// Matches CullBatch in main.cpp
+struct Batch
+{
+	uint firstCommand;
+	uint commandCount;
+	uint instanceOffset;
+	uint pad;
+	uint2 accelerationStructure;
+};
+
+[[vk::binding(0, 2)]] Texture2D<uint2> visibilityTarget;
+[[vk::binding(1, 2)]] RWStructuredBuffer<uint> bins;
+// Covered pixels ordered by material, x = pixel (x | y << 16), yz = visibility value, w is unused
+[[vk::binding(2, 2)]] RWStructuredBuffer<uint4> pixels;
+[[vk::binding(3, 2)]] StructuredBuffer<VisibilityDraw> draws;
+[[vk::binding(4, 2)]] StructuredBuffer<Batch> batches;
+// Shaded color, alpha is zero for pixels not covered by the visibility pass
+// Needs to match visibilityColorFormat, storage images default to rgba32f otherwise
+[[vk::binding(5, 2)]] [[vk::image_format("rgba16f")]] RWTexture2D<float4> shadedColor;
+
+// Matches VisibilityPushConstBlock in main.cpp
+struct PushConsts
+{
+	uint2 size;
+	uint batchCount;
+	uint irradianceIndex;
+};
+[[vk::push_constant]] PushConsts consts;
+
+// Draw command of the frame the triangle is part of, the triangle is turned into an index relative to that command
+uint findVisibilityDraw(uint2 value, out uint triangle)
+{
+	// Batches have consecutive instance slots in ascending order, so the batch is the last one starting at or before the instance
+	const uint instance = visibilityInstance(value);
+	uint first = 0;
+	uint count = consts.batchCount;
+	while (count > 0) {
+		const uint step = count / 2;
+		if (batches[first + step].instanceOffset <= instance) {
+			first += step + 1;
+			count -= step + 1;
+		} else {
+			count = step;
+		}
+	}
+	const Batch batch = batches[max(first, 1) - 1];
+	triangle = visibilityTriangle(value);
+	uint draw = batch.firstCommand;
+	for (uint i = 1; i < batch.commandCount; i++) {
+		if (draws[batch.firstCommand + i].firstTriangle > triangle) {
+			break;
+		}
+		draw = batch.firstCommand + i;
+	}
+	triangle -= draws[draw].firstTriangle;
+	return draw;
+}
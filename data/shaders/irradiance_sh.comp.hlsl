@@ -0,0 +1,104 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Projects an environment map into 9 spherical harmonics coefficients (bands 0 to 2) with a single workgroup
+// The coefficients are convolved with the cosine lobe and divided by pi, so evaluating them for a normal gives the same value as the irradiance cube (see filtercube_irradiance.comp.hlsl)
+
+[[vk::binding(0, 0)]] TextureCube textureCubeMap;
+[[vk::binding(0, 0)]] SamplerState samplerCubeMap;
+// Matches ShaderData::irradianceSH in main.cpp
+[[vk::binding(1, 0)]] RWStructuredBuffer<float4> coefficients;
+
+struct PushConsts
+{
+	// Texels per side of each face the environment is sampled with
+	uint size;
+	// Mip level of the environment map that matches the sampled size
+	float lod;
+};
+[[vk::push_constant]] PushConsts consts;
+
+#define PI 3.1415926535897932384626433832795
+#define THREAD_COUNT 256
+#define COEFFICIENT_COUNT 9
+
+// Only one coefficient is reduced at a time, so the shared memory stays within the minimum limit
+groupshared float4 partialSums[THREAD_COUNT];
+
+// Direction through the center of a texel of a cube face, following the face order and orientation of Vulkan cube maps
+float3 cubeDirection(uint3 coord, uint size)
+{
+	const float2 uv = (float2(coord.xy) + 0.5) / float(size) * 2.0 - 1.0;
+	float3 direction;
+	switch (coord.z) {
+		case 0: direction = float3(1.0, -uv.y, -uv.x); break;
+		case 1: direction = float3(-1.0, -uv.y, uv.x); break;
+		case 2: direction = float3(uv.x, 1.0, uv.y); break;
+		case 3: direction = float3(uv.x, -1.0, -uv.y); break;
+		case 4: direction = float3(uv.x, -uv.y, 1.0); break;
+		default: direction = float3(-uv.x, -uv.y, -1.0); break;
+	}
+	return direction;
+}
+
+// Real spherical harmonics basis, pre-multiplied with the cosine lobe's convolution factors (1, 2/3 and 1/4 per band after the division by pi)
+void shBasis(float3 n, out float basis[COEFFICIENT_COUNT])
+{
+	basis[0] = 0.282095;
+	basis[1] = 0.488603 * n.y * (2.0 / 3.0);
+	basis[2] = 0.488603 * n.z * (2.0 / 3.0);
+	basis[3] = 0.488603 * n.x * (2.0 / 3.0);
+	basis[4] = 1.092548 * n.x * n.y * 0.25;
+	basis[5] = 1.092548 * n.y * n.z * 0.25;
+	basis[6] = 0.315392 * (3.0 * n.z * n.z - 1.0) * 0.25;
+	basis[7] = 1.092548 * n.x * n.z * 0.25;
+	basis[8] = 0.546274 * (n.x * n.x - n.y * n.y) * 0.25;
+}
+
+[numthreads(THREAD_COUNT, 1, 1)]
+void main(uint3 LocalInvocationID : SV_GroupThreadID)
+{
+	const uint localIndex = LocalInvocationID.x;
+	const uint texelCount = consts.size * consts.size * 6;
+
+	// Solid angle weighted sums, w accumulates the solid angle so the result can be normalized to the full sphere
+	float4 sums[COEFFICIENT_COUNT];
+	for (uint i = 0; i < COEFFICIENT_COUNT; i++) {
+		sums[i] = float4(0.0, 0.0, 0.0, 0.0);
+	}
+	for (uint texel = localIndex; texel < texelCount; texel += THREAD_COUNT) {
+		const uint3 coord = uint3(texel % consts.size, (texel / consts.size) % consts.size, texel / (consts.size * consts.size));
+		const float3 direction = cubeDirection(coord, consts.size);
+		// Solid angle of the texel, its area on the unit cube projected onto the sphere
+		const float lengthSquared = dot(direction, direction);
+		const float solidAngle = 4.0 / (float(consts.size * consts.size) * lengthSquared * sqrt(lengthSquared));
+		const float3 n = direction / sqrt(lengthSquared);
+		const float3 color = textureCubeMap.SampleLevel(samplerCubeMap, n, consts.lod).rgb;
+		float basis[COEFFICIENT_COUNT];
+		shBasis(n, basis);
+		for (uint i = 0; i < COEFFICIENT_COUNT; i++) {
+			sums[i] += float4(color * basis[i], 1.0) * solidAngle;
+		}
+	}
+
+	for (uint i = 0; i < COEFFICIENT_COUNT; i++) {
+		partialSums[localIndex] = sums[i];
+		GroupMemoryBarrierWithGroupSync();
+		for (uint stride = THREAD_COUNT / 2; stride > 0; stride >>= 1) {
+			if (localIndex < stride) {
+				partialSums[localIndex] += partialSums[localIndex + stride];
+			}
+			GroupMemoryBarrierWithGroupSync();
+		}
+		if (localIndex == 0) {
+			// The texel solid angles only approximately add up to the full sphere
+			const float4 sum = partialSums[0];
+			// w = 1 marks the coefficients as valid for the fragment shader
+			coefficients[i] = float4(sum.rgb * (4.0 * PI / sum.w), (i == 0) ? 1.0 : 0.0);
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+}
@@ -0,0 +1,91 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Assigns the frame's point lights to the clusters of a froxel grid (screen tiles split into exponentially spaced depth slices), one thread per cluster
+// Each cluster's list starts with its light count, followed by up to MAX_LIGHTS_PER_CLUSTER - 1 light indices, lights beyond that are dropped
+// Lights are loaded into shared memory in batches, so each workgroup reads every light only once
+
+// Matches ClusterLight in main.cpp
+struct Light
+{
+	// World space, w = radius
+	float4 position;
+	float4 color;
+};
+
+[[vk::binding(0, 0)]] StructuredBuffer<Light> lights;
+[[vk::binding(1, 0)]] RWStructuredBuffer<uint> clusterLights;
+
+// Matches LightCullPushConstBlock
+struct PushConsts
+{
+	// Camera relative
+	float4x4 view;
+	float4 cameraPosition;
+	// x = near and y = far depth of the slices, z = scale and w = bias of the slice index from the log of the view depth
+	float4 clusterDepth;
+	// Tiles in x and y, depth slices, light count
+	uint4 clusterGrid;
+	// Diagonal of the projection matrix
+	float2 projectionScale;
+};
+[[vk::push_constant]] PushConsts consts;
+
+// Matches maxLightsPerCluster in main.cpp
+#define MAX_LIGHTS_PER_CLUSTER 64
+#define BATCH_SIZE 64
+
+groupshared float4 batch[BATCH_SIZE];
+
+float sliceDepth(uint slice)
+{
+	return consts.clusterDepth.x * pow(consts.clusterDepth.y / consts.clusterDepth.x, float(slice) / float(consts.clusterGrid.z));
+}
+
+[numthreads(BATCH_SIZE, 1, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID, uint3 LocalInvocationID : SV_GroupThreadID)
+{
+	const uint clusterIndex = GlobalInvocationID.x;
+	const uint clusterCount = consts.clusterGrid.x * consts.clusterGrid.y * consts.clusterGrid.z;
+	const bool active = clusterIndex < clusterCount;
+
+	// View space bounds of the cluster, the tile's edges at the near and far depth of the slice span its x and y extent
+	const uint3 cluster = uint3(clusterIndex % consts.clusterGrid.x, (clusterIndex / consts.clusterGrid.x) % consts.clusterGrid.y, clusterIndex / (consts.clusterGrid.x * consts.clusterGrid.y));
+	const float2 ndcMin = float2(cluster.xy) / float2(consts.clusterGrid.xy) * 2.0 - 1.0;
+	const float2 ndcMax = float2(cluster.xy + 1) / float2(consts.clusterGrid.xy) * 2.0 - 1.0;
+	const float nearDepth = (cluster.z == 0) ? 0.0 : sliceDepth(cluster.z);
+	const float farDepth = (cluster.z == consts.clusterGrid.z - 1) ? 1e30 : sliceDepth(cluster.z + 1);
+	const float2 a = ndcMin / consts.projectionScale;
+	const float2 b = ndcMax / consts.projectionScale;
+	// View space looks down -z
+	const float3 boundsMin = float3(min(min(a * nearDepth, a * farDepth), min(b * nearDepth, b * farDepth)), -farDepth);
+	const float3 boundsMax = float3(max(max(a * nearDepth, a * farDepth), max(b * nearDepth, b * farDepth)), -nearDepth);
+
+	const uint base = clusterIndex * MAX_LIGHTS_PER_CLUSTER;
+	uint count = 0;
+	for (uint first = 0; first < consts.clusterGrid.w; first += BATCH_SIZE) {
+		const uint lightIndex = first + LocalInvocationID.x;
+		if (lightIndex < consts.clusterGrid.w) {
+			const Light light = lights[lightIndex];
+			batch[LocalInvocationID.x] = float4(mul(consts.view, float4(light.position.xyz - consts.cameraPosition.xyz, 1.0)).xyz, light.position.w);
+		}
+		GroupMemoryBarrierWithGroupSync();
+		const uint batchCount = min(BATCH_SIZE, consts.clusterGrid.w - first);
+		for (uint i = 0; active && (i < batchCount); i++) {
+			const float4 sphere = batch[i];
+			const float3 closest = clamp(sphere.xyz, boundsMin, boundsMax);
+			const float3 offset = sphere.xyz - closest;
+			if ((dot(offset, offset) <= sphere.w * sphere.w) && (count < MAX_LIGHTS_PER_CLUSTER - 1)) {
+				count++;
+				clusterLights[base + count] = first + i;
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+	if (active) {
+		clusterLights[base] = count;
+	}
+}
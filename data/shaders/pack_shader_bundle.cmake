@@ -0,0 +1,35 @@
+# Packs the SPIR-V files listed in a manifest ("<spirv file> <key>" per line) into a shader bundle
+# Usage: cmake -DMANIFEST=<manifest> -DOUTPUT=<bundle> -P pack_shader_bundle.cmake
+# The layout needs to match the one read by base/compilers/ShaderBundle.cpp
+
+# Bump along with shaderBundleVersion in base/compilers/ShaderBundle.cpp
+set(BUNDLE_VERSION 1)
+
+file(STRINGS "${MANIFEST}" MANIFEST_LINES)
+set(HEADER "SPVBUNDLE ${BUNDLE_VERSION}\n")
+set(SPIRV_FILES "")
+set(OFFSET 0)
+foreach(MANIFEST_LINE ${MANIFEST_LINES})
+	string(FIND "${MANIFEST_LINE}" " " SEPARATOR REVERSE)
+	string(SUBSTRING "${MANIFEST_LINE}" 0 ${SEPARATOR} SPIRV_FILE)
+	math(EXPR KEY_START "${SEPARATOR} + 1")
+	string(SUBSTRING "${MANIFEST_LINE}" ${KEY_START} -1 KEY)
+	file(SIZE "${SPIRV_FILE}" SPIRV_SIZE)
+	string(APPEND HEADER "${OFFSET} ${SPIRV_SIZE} ${KEY}\n")
+	list(APPEND SPIRV_FILES "${SPIRV_FILE}")
+	math(EXPR OFFSET "${OFFSET} + ${SPIRV_SIZE}")
+endforeach()
+string(APPEND HEADER "END\n")
+
+get_filename_component(OUTPUT_DIR "${OUTPUT}" DIRECTORY)
+file(MAKE_DIRECTORY "${OUTPUT_DIR}")
+file(WRITE "${OUTPUT}.header" "${HEADER}")
+execute_process(
+	COMMAND ${CMAKE_COMMAND} -E cat "${OUTPUT}.header" ${SPIRV_FILES}
+	OUTPUT_FILE "${OUTPUT}"
+	RESULT_VARIABLE RESULT
+)
+file(REMOVE "${OUTPUT}.header")
+if(NOT RESULT EQUAL 0)
+	message(FATAL_ERROR "Could not write shader bundle ${OUTPUT}")
+endif()
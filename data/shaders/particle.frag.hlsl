@@ -0,0 +1,21 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Soft round sprites with premultiplied alpha, so the same shader serves the additive and the alpha blended pipeline
+
+struct VSOutput
+{
+[[vk::location(0)]] float2 uv : TEXCOORD0;
+[[vk::location(1)]] float4 color : COLOR0;
+};
+
+float4 main(VSOutput input) : SV_TARGET
+{
+	float falloff = saturate(1.0 - dot(input.uv, input.uv));
+	falloff *= falloff;
+	const float alpha = input.color.a * falloff;
+	return float4(input.color.rgb * alpha, alpha);
+}
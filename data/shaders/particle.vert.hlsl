@@ -0,0 +1,61 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Camera facing quads of the particles in one of the draw lists written by the particle simulation, one instance per particle
+
+// Matches includes/particles.hlsl
+struct Particle
+{
+	float3 position;
+	float age;
+	float3 velocity;
+	float lifetime;
+	float4 color;
+	float size;
+	float growth;
+	uint flags;
+	float drag;
+};
+
+[[vk::binding(0, 0)]] StructuredBuffer<Particle> particles;
+[[vk::binding(1, 0)]] StructuredBuffer<uint> lists;
+
+// Matches ParticleDrawPushConstBlock
+struct PushConsts
+{
+	// Camera relative, like the matrices of the scene passes
+	float4x4 viewProjection;
+	float4 renderOrigin;
+	float4 cameraRight;
+	float4 cameraUp;
+	// First entry of the draw list in the list buffer
+	uint listOffset;
+};
+[[vk::push_constant]] PushConsts consts;
+
+struct VSOutput
+{
+	float4 pos : SV_POSITION;
+[[vk::location(0)]] float2 uv : TEXCOORD0;
+[[vk::location(1)]] float4 color : COLOR0;
+};
+
+VSOutput main(uint VertexIndex : SV_VertexID, uint InstanceIndex : SV_InstanceID)
+{
+	const Particle particle = particles[lists[consts.listOffset + InstanceIndex]];
+	const float2 corners[6] = { float2(-1.0, -1.0), float2(1.0, -1.0), float2(1.0, 1.0), float2(-1.0, -1.0), float2(1.0, 1.0), float2(-1.0, 1.0) };
+	const float2 corner = corners[VertexIndex];
+	const float size = max(particle.size + particle.growth * particle.age, 0.0);
+	const float3 position = particle.position - consts.renderOrigin.xyz + (consts.cameraRight.xyz * corner.x + consts.cameraUp.xyz * corner.y) * size;
+
+	// Particles quickly fade in and then fade out over their lifetime
+	const float t = saturate(particle.age / particle.lifetime);
+	VSOutput output = (VSOutput)0;
+	output.pos = mul(consts.viewProjection, float4(position, 1.0));
+	output.uv = corner;
+	output.color = float4(particle.color.rgb, particle.color.a * saturate(t * 10.0) * (1.0 - t));
+	return output;
+}
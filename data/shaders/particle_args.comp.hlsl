@@ -0,0 +1,33 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Writes the indirect arguments of the particle passes from the counters, run by a single thread
+// Stage 0 (after emission) sizes the simulation dispatch and clears the lists it appends to, stage 1 (after the simulation) sets up both draws
+
+#include "includes/particles.hlsl"
+
+[numthreads(1, 1, 1)]
+void main()
+{
+	if (consts.stage == 0) {
+		counters[ARGS_DISPATCH + 0] = (counters[COUNTER_ALIVE + consts.parity] + 63) / 64;
+		counters[ARGS_DISPATCH + 1] = 1;
+		counters[ARGS_DISPATCH + 2] = 1;
+		counters[COUNTER_ALIVE + 1 - consts.parity] = 0;
+		counters[COUNTER_ADDITIVE] = 0;
+		counters[COUNTER_BLENDED] = 0;
+		return;
+	}
+	// Quads are expanded by the vertex shader, each instance is one particle
+	counters[ARGS_DRAW_ADDITIVE + 0] = 6;
+	counters[ARGS_DRAW_ADDITIVE + 1] = counters[COUNTER_ADDITIVE];
+	counters[ARGS_DRAW_ADDITIVE + 2] = 0;
+	counters[ARGS_DRAW_ADDITIVE + 3] = 0;
+	counters[ARGS_DRAW_BLENDED + 0] = 6;
+	counters[ARGS_DRAW_BLENDED + 1] = min(counters[COUNTER_BLENDED], consts.maxBlended);
+	counters[ARGS_DRAW_BLENDED + 2] = 0;
+	counters[ARGS_DRAW_BLENDED + 3] = 0;
+}
@@ -0,0 +1,80 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Spawns the particles requested by the frame's emitters, one thread per particle and one row of workgroups per emitter
+// Slots of dead particles are reused first, then slots that have never been used, particles beyond the capacity are dropped
+
+#include "includes/particles.hlsl"
+
+[[vk::binding(3, 0)]] StructuredBuffer<Emitter> emitters;
+
+uint hash(uint value)
+{
+	value ^= value >> 16;
+	value *= 0x7feb352d;
+	value ^= value >> 15;
+	value *= 0x846ca68b;
+	value ^= value >> 16;
+	return value;
+}
+
+float random(inout uint state)
+{
+	state = hash(state);
+	return float(state >> 8) / 16777216.0;
+}
+
+// Returns false if there is no free slot
+bool allocateSlot(out uint slot)
+{
+	uint dead;
+	InterlockedAdd(counters[COUNTER_DEAD], 0xffffffff, dead);
+	if (int(dead) > 0) {
+		slot = lists[deadListOffset() + dead - 1];
+		return true;
+	}
+	// Other threads may have seen the count below zero as well, each one restores its own decrement
+	InterlockedAdd(counters[COUNTER_DEAD], 1);
+	InterlockedAdd(counters[COUNTER_UNUSED], 1, slot);
+	return slot < consts.capacity;
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	const Emitter emitter = emitters[GlobalInvocationID.y];
+	if (GlobalInvocationID.x >= min(emitter.count, consts.maxEmitCount)) {
+		return;
+	}
+	uint slot;
+	if (!allocateSlot(slot)) {
+		return;
+	}
+
+	uint state = GlobalInvocationID.x * 1973 + GlobalInvocationID.y * 9277 + asuint(consts.time) * 26699;
+	// Random direction on the unit sphere
+	const float z = random(state) * 2.0 - 1.0;
+	const float phi = random(state) * 6.28318530718;
+	const float r = sqrt(1.0 - z * z);
+	const float3 direction = float3(r * cos(phi), r * sin(phi), z);
+
+	Particle particle;
+	particle.position = emitter.position;
+	particle.age = 0.0;
+	particle.velocity = emitter.velocity + direction * emitter.speed * lerp(0.25, 1.0, random(state));
+	particle.lifetime = emitter.lifetime * lerp(0.5, 1.0, random(state));
+	particle.color = emitter.color;
+	particle.size = emitter.size * lerp(0.5, 1.0, random(state));
+	particle.growth = emitter.growth;
+	particle.flags = emitter.flags;
+	// Blended particles (smoke) slow down quickly, additive ones (sparks) keep most of their speed
+	particle.drag = (emitter.flags & PARTICLE_BLENDED) ? 2.0 : 0.5;
+	particles[slot] = particle;
+
+	uint aliveIndex;
+	InterlockedAdd(counters[COUNTER_ALIVE + consts.parity], 1, aliveIndex);
+	lists[aliveListOffset(consts.parity) + aliveIndex] = slot;
+}
@@ -0,0 +1,51 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Advances all alive particles, dispatched indirectly with the alive count after emission
+// Expired particles return their slot to the dead list, survivors are compacted into the other alive list and appended to the draw lists
+// Blended particles get a sort entry with their distance to the camera (positive floats compare like their bits), those beyond maxBlended aren't drawn
+
+#include "includes/particles.hlsl"
+
+[numthreads(64, 1, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	const uint index = GlobalInvocationID.x;
+	if (index >= counters[COUNTER_ALIVE + consts.parity]) {
+		return;
+	}
+
+	const uint slot = lists[aliveListOffset(consts.parity) + index];
+	Particle particle = particles[slot];
+	particle.age += consts.deltaTime;
+	if (particle.age >= particle.lifetime) {
+		uint deadIndex;
+		InterlockedAdd(counters[COUNTER_DEAD], 1, deadIndex);
+		lists[deadListOffset() + deadIndex] = slot;
+		return;
+	}
+	particle.velocity *= exp(-particle.drag * consts.deltaTime);
+	particle.position += particle.velocity * consts.deltaTime;
+	particles[slot] = particle;
+
+	uint aliveIndex;
+	InterlockedAdd(counters[COUNTER_ALIVE + 1 - consts.parity], 1, aliveIndex);
+	lists[aliveListOffset(1 - consts.parity) + aliveIndex] = slot;
+
+	if (particle.flags & PARTICLE_BLENDED) {
+		uint blendedIndex;
+		InterlockedAdd(counters[COUNTER_BLENDED], 1, blendedIndex);
+		if (blendedIndex < consts.maxBlended) {
+			const float3 offset = particle.position - consts.cameraPosition.xyz;
+			lists[sortEntryOffset() + blendedIndex * 2] = asuint(dot(offset, offset));
+			lists[sortEntryOffset() + blendedIndex * 2 + 1] = slot;
+		}
+	} else {
+		uint additiveIndex;
+		InterlockedAdd(counters[COUNTER_ADDITIVE], 1, additiveIndex);
+		lists[additiveListOffset() + additiveIndex] = slot;
+	}
+}
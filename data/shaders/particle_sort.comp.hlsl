@@ -0,0 +1,55 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Sorts the blended particles back to front with a bitonic sort in shared memory, run as a single workgroup
+// Only the blended subset is sorted, the sort covers the next power of two of their count and writes the blended draw list
+
+#include "includes/particles.hlsl"
+
+// Matches maxBlendedParticles in main.cpp
+#define MAX_BLENDED 1024
+#define THREAD_COUNT 256
+
+groupshared uint2 entries[MAX_BLENDED];
+
+[numthreads(THREAD_COUNT, 1, 1)]
+void main(uint3 LocalInvocationID : SV_GroupThreadID)
+{
+	const uint count = min(counters[COUNTER_BLENDED], MAX_BLENDED);
+	uint size = 2;
+	while (size < count) {
+		size <<= 1;
+	}
+
+	// Padding entries have the smallest key, so they end up behind all particles
+	for (uint i = LocalInvocationID.x; i < size; i += THREAD_COUNT) {
+		entries[i] = (i < count) ? uint2(lists[sortEntryOffset() + i * 2], lists[sortEntryOffset() + i * 2 + 1]) : uint2(0, 0);
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	// Descending by distance, each pair is compared by the thread of its lower index
+	for (uint k = 2; k <= size; k <<= 1) {
+		for (uint j = k >> 1; j > 0; j >>= 1) {
+			for (uint n = LocalInvocationID.x; n < size; n += THREAD_COUNT) {
+				const uint partner = n ^ j;
+				if (partner > n) {
+					const uint2 a = entries[n];
+					const uint2 b = entries[partner];
+					const bool descending = (n & k) == 0;
+					if ((a.x < b.x) == descending) {
+						entries[n] = b;
+						entries[partner] = a;
+					}
+				}
+			}
+			GroupMemoryBarrierWithGroupSync();
+		}
+	}
+
+	for (uint m = LocalInvocationID.x; m < count; m += THREAD_COUNT) {
+		lists[blendedListOffset() + m] = entries[m].y;
+	}
+}
@@ -0,0 +1,41 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Exclusive prefix sum over a buffer of uints in a single pass, see GpuPrimitives::exclusiveScan
+// Source and destination may be the same buffer, as each thread reads its elements before writing them
+
+#include "includes/compute_primitives.hlsl"
+
+[[vk::binding(0, 0)]] RWStructuredBuffer<uint> source;
+[[vk::binding(1, 0)]] RWStructuredBuffer<uint> destination;
+
+[numthreads(PRIMITIVES_THREADS, 1, 1)]
+void main(uint3 LocalInvocationID : SV_GroupThreadID)
+{
+	const uint localIndex = LocalInvocationID.x;
+	const uint tile = acquireTile(localIndex);
+	const uint first = tile * PRIMITIVES_TILE_SIZE + localIndex * PRIMITIVES_ITEMS;
+
+	uint items[PRIMITIVES_ITEMS];
+	uint threadSum = 0;
+	[unroll]
+	for (uint i = 0; i < PRIMITIVES_ITEMS; i++) {
+		items[i] = (first + i < consts.count) ? source[first + i] : 0;
+		threadSum += items[i];
+	}
+
+	uint tileSum;
+	const uint threadPrefix = workgroupPrefixSum(threadSum, localIndex, tileSum);
+	uint prefix = lookBack(tile, tileSum, localIndex) + threadPrefix;
+
+	[unroll]
+	for (uint j = 0; j < PRIMITIVES_ITEMS; j++) {
+		if (first + j < consts.count) {
+			destination[first + j] = prefix;
+		}
+		prefix += items[j];
+	}
+}
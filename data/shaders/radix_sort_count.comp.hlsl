@@ -0,0 +1,44 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// First step of a radix sort pass: Counts the digits of each tile's keys, see GpuPrimitives::sort
+// The counts are stored digit major (all tiles of digit 0 first), so their exclusive scan is the position of each tile's first key of a digit
+
+#include "includes/compute_primitives.hlsl"
+
+// Matches GpuPrimitives::radixBits
+#define RADIX_BITS 4
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+[[vk::binding(0, 0)]] RWStructuredBuffer<uint> keys;
+[[vk::binding(5, 0)]] RWStructuredBuffer<uint> digitCounts;
+
+groupshared uint histogram[RADIX_SIZE];
+
+[numthreads(PRIMITIVES_THREADS, 1, 1)]
+void main(uint3 GroupID : SV_GroupID, uint3 LocalInvocationID : SV_GroupThreadID)
+{
+	const uint localIndex = LocalInvocationID.x;
+	const uint tile = GroupID.x;
+	if (localIndex < RADIX_SIZE) {
+		histogram[localIndex] = 0;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	// Consecutive threads read consecutive keys, the order within the tile doesn't matter for counting
+	[unroll]
+	for (uint i = 0; i < PRIMITIVES_ITEMS; i++) {
+		const uint index = tile * PRIMITIVES_TILE_SIZE + i * PRIMITIVES_THREADS + localIndex;
+		if (index < consts.count) {
+			InterlockedAdd(histogram[(keys[index] >> consts.shift) & (RADIX_SIZE - 1)], 1);
+		}
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (localIndex < RADIX_SIZE) {
+		digitCounts[localIndex * consts.tileCount + tile] = histogram[localIndex];
+	}
+}
@@ -0,0 +1,106 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Second step of a radix sort pass: Moves the keys (and values) of each tile to their sorted positions, see GpuPrimitives::sort
+// The tile is first sorted by the digit in shared memory with one split per bit, which keeps the keys of a digit in their original order (so the sort is stable)
+// Each key then goes to its digit's position for the tile from the scanned counts plus its rank among the tile's keys of the same digit
+
+#include "includes/compute_primitives.hlsl"
+
+// Matches GpuPrimitives::radixBits
+#define RADIX_BITS 4
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+[[vk::binding(0, 0)]] RWStructuredBuffer<uint> keys;
+[[vk::binding(1, 0)]] RWStructuredBuffer<uint> sortedKeys;
+[[vk::binding(3, 0)]] RWStructuredBuffer<uint> values;
+[[vk::binding(4, 0)]] RWStructuredBuffer<uint> sortedValues;
+// Exclusive scan of the counts of radix_sort_count.comp
+[[vk::binding(5, 0)]] RWStructuredBuffer<uint> digitOffsets;
+
+groupshared uint tileKeys[PRIMITIVES_TILE_SIZE];
+groupshared uint tileValues[PRIMITIVES_TILE_SIZE];
+groupshared uint digitStart[RADIX_SIZE];
+
+[numthreads(PRIMITIVES_THREADS, 1, 1)]
+void main(uint3 GroupID : SV_GroupID, uint3 LocalInvocationID : SV_GroupThreadID)
+{
+	const uint localIndex = LocalInvocationID.x;
+	const uint tile = GroupID.x;
+	const uint tileFirst = tile * PRIMITIVES_TILE_SIZE;
+	const uint validCount = min(consts.count - tileFirst, PRIMITIVES_TILE_SIZE);
+	const uint first = localIndex * PRIMITIVES_ITEMS;
+
+	if (localIndex < RADIX_SIZE) {
+		digitStart[localIndex] = 0;
+	}
+
+	// Elements past the end get the largest digit, as they're at the end of the tile they stay behind all valid keys of that digit
+	uint itemKeys[PRIMITIVES_ITEMS];
+	uint itemValues[PRIMITIVES_ITEMS];
+	[unroll]
+	for (uint i = 0; i < PRIMITIVES_ITEMS; i++) {
+		const bool valid = (first + i < validCount);
+		itemKeys[i] = valid ? keys[tileFirst + first + i] : 0xFFFFFFFF;
+		itemValues[i] = (valid && (consts.hasValues != 0)) ? values[tileFirst + first + i] : 0;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint bit = 0; bit < RADIX_BITS; bit++) {
+		// Keys with the bit cleared go to the front of the tile, keys with the bit set behind them, both in their current order
+		uint threadZeros = 0;
+		[unroll]
+		for (uint j = 0; j < PRIMITIVES_ITEMS; j++) {
+			threadZeros += ((itemKeys[j] >> (consts.shift + bit)) & 1) ? 0 : 1;
+		}
+		uint totalZeros;
+		uint zeros = workgroupPrefixSum(threadZeros, localIndex, totalZeros);
+		[unroll]
+		for (uint k = 0; k < PRIMITIVES_ITEMS; k++) {
+			const uint rank = first + k;
+			uint position;
+			if ((itemKeys[k] >> (consts.shift + bit)) & 1) {
+				position = totalZeros + rank - zeros;
+			} else {
+				position = zeros++;
+			}
+			tileKeys[position] = itemKeys[k];
+			tileValues[position] = itemValues[k];
+		}
+		GroupMemoryBarrierWithGroupSync();
+		[unroll]
+		for (uint l = 0; l < PRIMITIVES_ITEMS; l++) {
+			itemKeys[l] = tileKeys[first + l];
+			itemValues[l] = tileValues[first + l];
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	// First position of each digit in the sorted tile
+	[unroll]
+	for (uint m = 0; m < PRIMITIVES_ITEMS; m++) {
+		const uint rank = first + m;
+		const uint digit = (itemKeys[m] >> consts.shift) & (RADIX_SIZE - 1);
+		if ((rank == 0) || (((tileKeys[rank - 1] >> consts.shift) & (RADIX_SIZE - 1)) != digit)) {
+			digitStart[digit] = rank;
+		}
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint n = 0; n < PRIMITIVES_ITEMS; n++) {
+		const uint rank = first + n;
+		if (rank < validCount) {
+			const uint digit = (itemKeys[n] >> consts.shift) & (RADIX_SIZE - 1);
+			const uint destination = digitOffsets[digit * consts.tileCount + tile] + rank - digitStart[digit];
+			sortedKeys[destination] = itemKeys[n];
+			if (consts.hasValues != 0) {
+				sortedValues[destination] = itemValues[n];
+			}
+		}
+	}
+}
@@ -0,0 +1,56 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Shadow casters of all cascades in one multiview pass, each view renders into the cascade's layer of the shadow map
+// Instances are the ones culled for the shadow casters, see dispatchShadowCulling in main.cpp
+
+#include "includes/variation.hlsl"
+#include "includes/instance.hlsl"
+
+// Matches shadowCascadeCount in main.cpp
+#define SHADOW_CASCADE_COUNT 3
+
+// Same layout as in gltf.frag.hlsl, only the shadow matrices are used
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+	float4 cameraPosition;
+	float4 clusterDepth;
+	uint4 clusterGrid;
+	float4 sunDirection;
+	float4 shadowSplits;
+	float4 shadowTexelSizes;
+	// Camera relative world space to the cascade's shadow map
+	float4x4 shadowMatrices[SHADOW_CASCADE_COUNT];
+};
+[[vk::binding(0, 0)]]
+ConstantBuffer<UBO> ubo;
+
+[[vk::binding(1, 0)]]
+StructuredBuffer<Instance> instances;
+
+struct PushConsts {
+	float4x4 node;
+};
+[[vk::push_constant]] PushConsts primitive;
+
+struct VSOutput
+{
+	float4 pos : SV_POSITION;
+};
+
+VSOutput main([[vk::location(0)]] float3 pos : POSITION0, uint InstanceIndex : SV_InstanceID, uint ViewIndex : SV_ViewID)
+{
+	VSOutput output = (VSOutput)0;
+	InstanceVariation variation;
+	const float4x4 instance = decodeInstance(instances[InstanceIndex], variation);
+	float4x4 model = mul(instance, primitive.node);
+	output.pos = mul(ubo.shadowMatrices[ViewIndex], mul(model, float4(displacePosition(pos, variation), 1.0)));
+	return output;
+}
@@ -0,0 +1,70 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Integrates the GPU simulated asteroids, which orbit the origin and tumble around their own axes
+// Each frame reads the bodies written by the previous frame and writes its own copy, so frames in flight never write state that is still being read
+
+struct Body
+{
+	float4x4 model;
+	// w = uniform scale
+	float4 position;
+	float4 velocity;
+	// Euler angles in degrees
+	float4 rotation;
+	float4 angularVelocity;
+};
+
+[[vk::binding(0, 0)]] StructuredBuffer<Body> previousBodies;
+[[vk::binding(1, 0)]] RWStructuredBuffer<Body> bodies;
+
+struct PushConsts
+{
+	float deltaTime;
+	uint bodyCount;
+	// Gravitational parameter of the body at the origin
+	float gravity;
+};
+[[vk::push_constant]] PushConsts consts;
+
+// Same rotation order as the actor manager's matrices (x, then y, then z)
+float3x3 rotationMatrix(float3 angles)
+{
+	const float3 s = sin(radians(angles));
+	const float3 c = cos(radians(angles));
+	const float3x3 rx = float3x3(1.0, 0.0, 0.0, 0.0, c.x, -s.x, 0.0, s.x, c.x);
+	const float3x3 ry = float3x3(c.y, 0.0, s.y, 0.0, 1.0, 0.0, -s.y, 0.0, c.y);
+	const float3x3 rz = float3x3(c.z, -s.z, 0.0, s.z, c.z, 0.0, 0.0, 0.0, 1.0);
+	return mul(mul(rx, ry), rz);
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	const uint index = GlobalInvocationID.x;
+	if (index >= consts.bodyCount) {
+		return;
+	}
+
+	Body body = previousBodies[index];
+
+	// Semi-implicit Euler keeps the orbits stable
+	const float3 position = body.position.xyz;
+	const float distanceSquared = max(dot(position, position), 1.0);
+	const float3 acceleration = -consts.gravity * position / (distanceSquared * sqrt(distanceSquared));
+	body.velocity.xyz += acceleration * consts.deltaTime;
+	body.position.xyz += body.velocity.xyz * consts.deltaTime;
+	body.rotation.xyz = fmod(body.rotation.xyz + body.angularVelocity.xyz * consts.deltaTime, 360.0);
+
+	const float3x3 rotation = rotationMatrix(body.rotation.xyz) * body.position.w;
+	body.model = float4x4(
+		float4(rotation[0], body.position.x),
+		float4(rotation[1], body.position.y),
+		float4(rotation[2], body.position.z),
+		float4(0.0, 0.0, 0.0, 1.0));
+
+	bodies[index] = body;
+}
@@ -0,0 +1,38 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Skybox as a single fullscreen triangle at the far plane, drawn after the opaque geometry so only pixels not covered by anything are shaded
+// The cubemap direction of each corner is reconstructed from the projection and the camera's rotation, so it matches the cube of skybox.vert.hlsl
+
+// Same layout as in gltf.frag.hlsl, only the camera matrices are used
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+};
+[[vk::binding(0, 0)]]
+ConstantBuffer<UBO> ubo;
+
+// Infinity is at a depth of zero with a reversed depth buffer
+[[vk::constant_id(0)]] const bool reverseDepth = false;
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+[[vk::location(0)]] float3 UVW : TEXCOORD0;
+};
+
+VSOutput main(uint VertexIndex : SV_VertexID)
+{
+	VSOutput output = (VSOutput)0;
+	float2 ndc = float2((VertexIndex << 1) & 2, VertexIndex & 2) * 2.0f - 1.0f;
+	output.Pos = float4(ndc, reverseDepth ? 0.0f : 1.0f, 1.0f);
+	// Both projections have w = -z, so the view space point at z = -1 is found by undoing the x and y scale and offset
+	float3 viewDirection = float3((ndc.x + ubo.projection[0][2]) / ubo.projection[0][0], (ndc.y + ubo.projection[1][2]) / ubo.projection[1][1], -1.0f);
+	// The inverse of the view matrix' rotation is its transpose
+	output.UVW = mul(viewDirection, (float3x3)ubo.view);
+	return output;
+}
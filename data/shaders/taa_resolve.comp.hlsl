@@ -0,0 +1,83 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Temporal anti-aliasing resolve, accumulates the jittered scene into a history at the full output size
+// The history is reprojected with the camera's motion reconstructed from depth, which doesn't cover moving geometry
+// Stale history (e.g. of moving actors or disoccluded areas) is clamped to the range of the current frame's neighbourhood instead
+
+[[vk::binding(0, 0)]] Texture2D sceneTexture;
+[[vk::binding(0, 0)]] SamplerState sceneSampler;
+[[vk::binding(1, 0)]] Texture2D<float> depthTexture;
+[[vk::binding(2, 0)]] Texture2D historyTexture;
+[[vk::binding(2, 0)]] SamplerState historySampler;
+// Matches the history images, storage images default to rgba32f otherwise
+[[vk::binding(3, 0)]] [[vk::image_format("rgba16f")]] RWTexture2D<float4> destination;
+
+struct PushConsts
+{
+	// Current frame's clip space to the previous frame's clip space
+	float4x4 reprojection;
+	// Subpixel offset of the current frame in NDC
+	float2 jitter;
+	// Rendered size divided by the size of the scene color target
+	float2 uvScale;
+	// Size of a texel of the scene color target
+	float2 texelSize;
+	uint2 outputSize;
+	// Share of the history in the result, higher values converge to a smoother image but take longer to adapt
+	float historyWeight;
+	// Set if the history doesn't contain the previous frame (first frame, after a resize)
+	uint resetHistory;
+	uint reverseDepth;
+};
+[[vk::push_constant]] PushConsts consts;
+
+float3 sampleScene(float2 uv)
+{
+	// Filtering must not pick up texels outside of the rendered area, which contain older frames
+	const float2 maxUV = consts.uvScale - consts.texelSize * 0.5;
+	return sceneTexture.SampleLevel(sceneSampler, min(uv, maxUV), 0).rgb;
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	if (any(GlobalInvocationID.xy >= consts.outputSize)) {
+		return;
+	}
+	const float2 uv = (float2(GlobalInvocationID.xy) + 0.5) / float2(consts.outputSize);
+	// The scene was rendered shifted by the jitter, so the unjittered position of this pixel is offset by it
+	const float2 sceneUV = (uv + consts.jitter * 0.5) * consts.uvScale;
+	const float3 color = sampleScene(sceneUV);
+
+	// Neighbourhood of the current frame, also used to find the closest depth so edges of foreground objects reproject with them
+	float3 minColor = color;
+	float3 maxColor = color;
+	const int2 maxCoord = int2(consts.uvScale / consts.texelSize) - 1;
+	const int2 depthCoord = int2(sceneUV / consts.texelSize);
+	float depth = depthTexture.Load(int3(min(depthCoord, maxCoord), 0));
+	for (int y = -1; y <= 1; y++) {
+		for (int x = -1; x <= 1; x++) {
+			if ((x == 0) && (y == 0)) {
+				continue;
+			}
+			const float3 neighbour = sampleScene(sceneUV + float2(x, y) * consts.texelSize);
+			minColor = min(minColor, neighbour);
+			maxColor = max(maxColor, neighbour);
+			const float neighbourDepth = depthTexture.Load(int3(clamp(depthCoord + int2(x, y), 0, maxCoord), 0));
+			depth = consts.reverseDepth ? max(depth, neighbourDepth) : min(depth, neighbourDepth);
+		}
+	}
+
+	const float4 previousClip = mul(consts.reprojection, float4(uv * 2.0 - 1.0, depth, 1.0));
+	const float2 previousUV = (previousClip.xy / previousClip.w) * 0.5 + 0.5;
+	if (consts.resetHistory || any(previousUV < 0.0) || any(previousUV > 1.0)) {
+		destination[GlobalInvocationID.xy] = float4(color, 1.0);
+		return;
+	}
+	const float3 history = clamp(historyTexture.SampleLevel(historySampler, previousUV, 0).rgb, minColor, maxColor);
+	destination[GlobalInvocationID.xy] = float4(lerp(color, history, consts.historyWeight), 1.0);
+}
@@ -0,0 +1,95 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Upscales the part of the scene color target the scene was rendered to (with dynamic resolution) to the full output size
+// Bilinear filtering, followed by an optional contrast adaptive sharpening in the spirit of FSR1's RCAS to restore some of the detail lost to the lower resolution
+// With post processing, the scene is HDR and this also adds the bloom and tonemaps, so the overlay can be drawn on top in the same pass
+
+#include "includes/half_precision.hlsl"
+
+Texture2D sceneTexture : register(t0);
+SamplerState sceneSampler : register(s0);
+// Sum of all levels of the bloom chain, see bloom_upsample.comp.hlsl
+[[vk::binding(1, 0)]] Texture2D bloomTexture;
+[[vk::binding(1, 0)]] SamplerState bloomSampler;
+
+[[vk::constant_id(0)]] const bool postProcessing = false;
+
+struct PushConsts
+{
+	// Rendered size divided by the size of the scene color target
+	float2 uvScale;
+	// Size of a texel of the scene color target
+	float2 texelSize;
+	// 0 = bilinear only, 1 = max. sharpening
+	float sharpness;
+	float exposure;
+	// Share of the bloom in the result, 0 = no bloom
+	float bloomStrength;
+	// The bloom texture holds the sum of this many levels
+	float bloomLevels;
+	// 1 = the scene is shown without bloom and tonemapping, e.g. for debug views
+	uint passThrough;
+};
+[[vk::push_constant]] PushConsts consts;
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+[[vk::location(0)]] float2 UV : TEXCOORD0;
+};
+
+// Narkowicz's fit of the ACES filmic curve
+float3 tonemapACES(float3 color)
+{
+	return saturate((color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14));
+}
+
+float3 sampleScene(float2 uv)
+{
+	// Filtering must not pick up texels outside of the rendered area, which contain older frames
+	const float2 maxUV = consts.uvScale - consts.texelSize * 0.5;
+	const float3 color = sceneTexture.SampleLevel(sceneSampler, min(uv, maxUV), 0).rgb;
+	if (!postProcessing) {
+		return color;
+	}
+	if (consts.passThrough != 0) {
+		return saturate(color);
+	}
+	// Sharpening works on the tonemapped taps, as its limits assume colors in the [0, 1] range
+	// The bloom covers the rendered area only, so its coordinates are those of the output
+	float3 hdr = color;
+	if (consts.bloomStrength > 0.0) {
+		const float3 bloom = bloomTexture.SampleLevel(bloomSampler, min(uv, maxUV) / consts.uvScale, 0).rgb / consts.bloomLevels;
+		hdr = lerp(hdr, bloom, consts.bloomStrength);
+	}
+	return tonemapACES(hdr * consts.exposure);
+}
+
+float4 main(VSOutput input) : SV_TARGET
+{
+	const float2 uv = input.UV * consts.uvScale;
+	const float3 color = sampleScene(uv);
+	if (consts.sharpness <= 0.0) {
+		return float4(color, 1.0);
+	}
+
+	// Cross shaped neighbourhood one source texel apart
+	// The taps are tonemapped (or LDR), so the sharpening itself is done in half precision
+	const hfloat3 c = hfloat3(color);
+	const hfloat3 n = hfloat3(sampleScene(uv - float2(0.0, consts.texelSize.y)));
+	const hfloat3 s = hfloat3(sampleScene(uv + float2(0.0, consts.texelSize.y)));
+	const hfloat3 w = hfloat3(sampleScene(uv - float2(consts.texelSize.x, 0.0)));
+	const hfloat3 e = hfloat3(sampleScene(uv + float2(consts.texelSize.x, 0.0)));
+	const hfloat3 minColor = min(c, min(min(n, s), min(w, e)));
+	const hfloat3 maxColor = max(c, max(max(n, s), max(w, e)));
+
+	// The negative lobe is limited so the result stays within the neighbourhood's range, which avoids ringing on high contrast edges
+	const hfloat3 limit = min(minColor, hfloat(1.0) - maxColor) / max(maxColor, hfloat(1.0 / 4096.0).rrr);
+	const hfloat lobe = hfloat(-0.1875 * consts.sharpness) * saturate(min(limit.r, min(limit.g, limit.b)));
+	const hfloat3 sharpened = (c + lobe * (n + s + w + e)) / (hfloat(1.0) + hfloat(4.0) * lobe);
+	return float4(saturate(sharpened), 1.0);
+}
@@ -0,0 +1,47 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Fragment shader of the visibility pass, writes the instance and the triangle covering the pixel, see includes/visibility.hlsl
+// Alpha masked materials are the only ones sampled here, everything else is left to the shading pass
+// SV_PrimitiveID needs the geometry shader feature with the vertex pipeline
+
+#include "includes/scene_shading.hlsl"
+#include "includes/visibility.hlsl"
+
+// Matches vkglTF::PushConstBlock
+struct PushConsts
+{
+	float4x4 model;
+	uint materialIndex;
+	uint radianceIndex;
+	uint irradianceIndex;
+	uint jointOffset;
+	uint64_t vertexAddress;
+	// Triangles of the model's preceding draws, so triangles are numbered across all draws of the level of detail
+	uint firstTriangle;
+	uint padding;
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+struct VSOutput
+{
+	float4 pos : SV_POSITION;
+[[vk::location(0)]] float2 uv : TEXCOORD0;
+[[vk::location(1)]] nointerpolation uint instance : TEXCOORD1;
+};
+
+uint2 main(VSOutput input, uint primitiveID : SV_PrimitiveID) : SV_TARGET
+{
+	const Material material = materials[pushConsts.materialIndex];
+	if (material.alphaMode == ALPHAMODE_MASK) {
+		float alpha = material.baseColorFactor.a;
+		if (material.baseColorTexture != NO_TEXTURE) {
+			alpha *= sampleMaterialTexture(material.baseColorTexture, textureLayerCode(material.textureLayers, TEXTURE_BASE_COLOR), input.uv).a;
+		}
+		clip(alpha - material.alphaCutoff);
+	}
+	return encodeVisibility(input.instance, pushConsts.firstTriangle + primitiveID);
+}
@@ -0,0 +1,67 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Vertex shader of the visibility pass, fetches the compact vertices through the model's vertex buffer address like gltf_pulled.vert.hlsl
+// Only the position and the uv (for alpha masked materials) are needed, all other attributes are reconstructed by the shading pass
+
+#include "includes/variation.hlsl"
+#include "includes/instance.hlsl"
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float time;
+	float2 resolution;
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+// Per-instance transforms, written by the culling compute shader for all visible actors
+[[vk::binding(1, 0)]]
+StructuredBuffer<Instance> instances;
+
+// Matches vkglTF::PushConstBlock
+struct PushConsts {
+	float4x4 node;
+	uint materialIndex;
+	uint radianceIndex;
+	uint irradianceIndex;
+	uint jointOffset;
+	uint64_t vertexAddress;
+	uint firstTriangle;
+	uint padding;
+};
+[[vk::push_constant]] PushConsts primitive;
+
+struct VSOutput
+{
+	precise float4 pos : SV_POSITION;
+[[vk::location(0)]] float2 uv : TEXCOORD0;
+[[vk::location(1)]] nointerpolation uint instance : TEXCOORD1;
+};
+
+// Set by the application to the size of vkglTF::CompactVertex
+[[vk::constant_id(0)]] const uint vertexStride = 28;
+
+// Note: The position is transformed exactly like gltf_pulled.vert.hlsl does, so the depth matches the forward shaded pipelines
+VSOutput main(uint VertexIndex : SV_VertexID, uint InstanceIndex : SV_InstanceID)
+{
+	const uint64_t address = primitive.vertexAddress + uint64_t(VertexIndex) * vertexStride;
+	const float3 vertexPos = vk::RawBufferLoad<float3>(address);
+	const uint uv = vk::RawBufferLoad<uint>(address + 20);
+
+	VSOutput output = (VSOutput)0;
+	InstanceVariation variation;
+	const float4x4 instance = decodeInstance(instances[InstanceIndex], variation);
+	const float3 pos = displacePosition(vertexPos, variation);
+	float4x4 model = mul(instance, primitive.node);
+	float4x4 modelView = mul(ubo.view, model);
+	output.pos = mul(ubo.projection, mul(modelView, float4(pos, 1.0)));
+	output.uv = float2(f16tof32(uv), f16tof32(uv >> 16));
+	output.instance = InstanceIndex;
+	return output;
+}
@@ -0,0 +1,56 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Turns the pixel counts of the materials into the first entry of each material in the pixel list and writes the shading pass' dispatch arguments, run by a single workgroup
+
+#include "includes/visibility_compute.hlsl"
+
+#define BIN_THREADS 1024
+#define BINS_PER_THREAD (VISIBILITY_MATERIAL_COUNT / BIN_THREADS)
+
+// Two buffers, so each step of the scan reads the sums of the previous one
+groupshared uint sums[2][BIN_THREADS];
+
+[numthreads(BIN_THREADS, 1, 1)]
+void main(uint3 LocalInvocationID : SV_GroupThreadID)
+{
+	const uint localIndex = LocalInvocationID.x;
+	const uint first = localIndex * BINS_PER_THREAD;
+
+	uint counts[BINS_PER_THREAD];
+	uint threadSum = 0;
+	[unroll]
+	for (uint i = 0; i < BINS_PER_THREAD; i++) {
+		counts[i] = bins[first + i];
+		threadSum += counts[i];
+	}
+
+	// Inclusive scan over the sums of all threads
+	uint source = 0;
+	sums[source][localIndex] = threadSum;
+	GroupMemoryBarrierWithGroupSync();
+	for (uint offset = 1; offset < BIN_THREADS; offset *= 2) {
+		const uint sum = sums[source][localIndex] + ((localIndex >= offset) ? sums[source][localIndex - offset] : 0);
+		sums[source ^ 1][localIndex] = sum;
+		source ^= 1;
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	uint prefix = sums[source][localIndex] - threadSum;
+	[unroll]
+	for (uint j = 0; j < BINS_PER_THREAD; j++) {
+		bins[first + j] = prefix;
+		prefix += counts[j];
+	}
+
+	if (localIndex == BIN_THREADS - 1) {
+		const uint pixelCount = sums[source][localIndex];
+		bins[VISIBILITY_DISPATCH_ARGS + 0] = (pixelCount + VISIBILITY_SHADE_THREADS - 1) / VISIBILITY_SHADE_THREADS;
+		bins[VISIBILITY_DISPATCH_ARGS + 1] = 1;
+		bins[VISIBILITY_DISPATCH_ARGS + 2] = 1;
+		bins[VISIBILITY_PIXEL_COUNT] = pixelCount;
+	}
+}
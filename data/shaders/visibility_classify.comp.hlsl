@@ -0,0 +1,24 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Counts the covered pixels of each material, the bins buffer has been cleared before
+
+#include "includes/visibility_compute.hlsl"
+
+[numthreads(8, 8, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	if (any(GlobalInvocationID.xy >= consts.size)) {
+		return;
+	}
+	const uint2 value = visibilityTarget[GlobalInvocationID.xy];
+	if (isVisibilityEmpty(value)) {
+		return;
+	}
+	uint triangle;
+	const uint draw = findVisibilityDraw(value, triangle);
+	InterlockedAdd(bins[draws[draw].materialIndex], 1);
+}
@@ -0,0 +1,22 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Copies the color of the visibility shaded pixels into the scene pass, drawn as a fullscreen triangle before the forward shaded geometry
+// Pixels the visibility pass didn't cover are discarded, so the backdrop drawn before stays visible
+
+#include "includes/visibility.hlsl"
+
+[[vk::binding(0, 2)]] Texture2D<uint2> visibilityTarget;
+[[vk::binding(6, 2)]] Texture2D<float4> shadedColor;
+
+float4 main(float4 pos : SV_POSITION) : SV_TARGET
+{
+	const int3 pixel = int3(pos.xy, 0);
+	if (isVisibilityEmpty(visibilityTarget.Load(pixel))) {
+		discard;
+	}
+	return shadedColor.Load(pixel);
+}
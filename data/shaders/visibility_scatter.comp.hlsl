@@ -0,0 +1,26 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Appends each covered pixel to the list of its material, the bins are advanced from the first entry of their material to the first entry of the next one
+
+#include "includes/visibility_compute.hlsl"
+
+[numthreads(8, 8, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	if (any(GlobalInvocationID.xy >= consts.size)) {
+		return;
+	}
+	const uint2 value = visibilityTarget[GlobalInvocationID.xy];
+	if (isVisibilityEmpty(value)) {
+		return;
+	}
+	uint triangle;
+	const uint draw = findVisibilityDraw(value, triangle);
+	uint slot;
+	InterlockedAdd(bins[draws[draw].materialIndex], 1, slot);
+	pixels[slot] = uint4(GlobalInvocationID.x | (GlobalInvocationID.y << 16), value, 0);
+}
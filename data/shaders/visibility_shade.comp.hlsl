@@ -0,0 +1,126 @@
+/* Copyright (c) 2024, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Shades the covered pixels once each, in the order of the material bins so the invocations of a workgroup mostly share their material
+// The triangle of the pixel is fetched and transformed again, its attributes are interpolated with barycentrics that are reconstructed from the pixel's position
+// Screen space derivatives of the barycentrics are derived analytically, so textures are sampled with the same gradients as the forward fragment shader
+
+#include "includes/variation.hlsl"
+#include "includes/instance.hlsl"
+#include "includes/scene_shading.hlsl"
+#include "includes/visibility_compute.hlsl"
+
+[[vk::binding(1, 0)]]
+StructuredBuffer<Instance> instances;
+
+// Set by the application to the size of vkglTF::CompactVertex
+[[vk::constant_id(0)]] const uint vertexStride = 28;
+
+struct Barycentrics
+{
+	float3 lambda;
+	// Change of the barycentrics from one pixel to the next one along x and y
+	float3 ddx;
+	float3 ddy;
+};
+
+float snorm16(uint value)
+{
+	return max(float(int(value << 16) >> 16) / 32767.0, -1.0);
+}
+
+// Index buffers with 8 and 16 bit indices are read by the 32 bit word containing the index
+uint loadIndex(VisibilityDraw draw, uint index)
+{
+	const uint64_t address = draw.indexAddress + uint64_t(index) * draw.indexSize;
+	const uint word = vk::RawBufferLoad<uint>(address & ~3ull);
+	if (draw.indexSize == 4) {
+		return word;
+	}
+	return (word >> (uint(address & 3) * 8)) & ((1u << (draw.indexSize * 8)) - 1);
+}
+
+// Perspective correct barycentrics of the pixel within the triangle given by its clip space positions
+// The barycentrics are linear in screen space after dividing by w, so their derivatives are constant across the triangle before the perspective correction
+Barycentrics computeBarycentrics(float4 clip[3], float2 pixel, float2 size)
+{
+	const float3 invW = 1.0 / float3(clip[0].w, clip[1].w, clip[2].w);
+	const float2 ndc0 = clip[0].xy * invW.x;
+	const float2 ndc1 = clip[1].xy * invW.y;
+	const float2 ndc2 = clip[2].xy * invW.z;
+	// Vulkan's normalized device coordinates and pixel coordinates both point down along y
+	const float2 pixelNdc = (pixel + 0.5) / size * 2.0 - 1.0;
+
+	// Change of the barycentrics divided by w per unit in normalized device coordinates
+	const float invDet = 1.0 / determinant(float2x2(ndc2 - ndc1, ndc0 - ndc1));
+	float3 ddxW = float3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y) * invDet * invW;
+	float3 ddyW = float3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x) * invDet * invW;
+	float ddxSum = dot(ddxW, (1.0).xxx);
+	float ddySum = dot(ddyW, (1.0).xxx);
+
+	const float2 delta = pixelNdc - ndc0;
+	const float interpInvW = invW.x + delta.x * ddxSum + delta.y * ddySum;
+	const float3 lambdaW = float3(invW.x, 0.0, 0.0) + delta.x * ddxW + delta.y * ddyW;
+
+	Barycentrics result;
+	result.lambda = lambdaW / interpInvW;
+	// One pixel is 2 / size in normalized device coordinates
+	ddxW *= 2.0 / size.x;
+	ddyW *= 2.0 / size.y;
+	ddxSum *= 2.0 / size.x;
+	ddySum *= 2.0 / size.y;
+	result.ddx = (lambdaW + ddxW) / (interpInvW + ddxSum) - result.lambda;
+	result.ddy = (lambdaW + ddyW) / (interpInvW + ddySum) - result.lambda;
+	return result;
+}
+
+[numthreads(VISIBILITY_SHADE_THREADS, 1, 1)]
+void main(uint3 GlobalInvocationID : SV_DispatchThreadID)
+{
+	if (GlobalInvocationID.x >= bins[VISIBILITY_PIXEL_COUNT]) {
+		return;
+	}
+	const uint4 entry = pixels[GlobalInvocationID.x];
+	const uint2 pixel = uint2(entry.x & 0xFFFF, entry.x >> 16);
+	uint triangle;
+	const VisibilityDraw draw = draws[findVisibilityDraw(entry.yz, triangle)];
+
+	// Same transform as visibility.vert.hlsl
+	InstanceVariation variation;
+	const float4x4 instance = decodeInstance(instances[visibilityInstance(entry.yz)], variation);
+	const float4x4 model = mul(instance, draw.node);
+	float4 clip[3];
+	float3 worldpos[3];
+	float3 normal[3];
+	float2 uv[3];
+	[unroll]
+	for (uint i = 0; i < 3; i++) {
+		const uint index = loadIndex(draw, draw.firstIndex + triangle * 3 + i);
+		const uint64_t address = draw.vertexAddress + uint64_t(int(index) + draw.vertexOffset) * vertexStride;
+		const float3 vertexPos = vk::RawBufferLoad<float3>(address);
+		const uint2 packedNormal = vk::RawBufferLoad<uint2>(address + 12);
+		const uint packedUV = vk::RawBufferLoad<uint>(address + 20);
+		const float3 pos = displacePosition(vertexPos, variation);
+		worldpos[i] = mul(model, float4(pos, 1.0)).xyz;
+		clip[i] = mul(ubo.projection, mul(ubo.view, float4(worldpos[i], 1.0)));
+		// Note: Only works with uniform scaling
+		normal[i] = mul((float3x3)model, displaceNormal(vertexPos, float3(snorm16(packedNormal.x), snorm16(packedNormal.x >> 16), snorm16(packedNormal.y)), variation));
+		uv[i] = float2(f16tof32(packedUV), f16tof32(packedUV >> 16));
+	}
+
+	const Barycentrics barycentrics = computeBarycentrics(clip, float2(pixel), float2(consts.size));
+	SceneSurface surface;
+	surface.uv = uv[0] * barycentrics.lambda.x + uv[1] * barycentrics.lambda.y + uv[2] * barycentrics.lambda.z;
+	surface.uvDx = uv[0] * barycentrics.ddx.x + uv[1] * barycentrics.ddx.y + uv[2] * barycentrics.ddx.z;
+	surface.uvDy = uv[0] * barycentrics.ddy.x + uv[1] * barycentrics.ddy.y + uv[2] * barycentrics.ddy.z;
+	surface.normal = normal[0] * barycentrics.lambda.x + normal[1] * barycentrics.lambda.y + normal[2] * barycentrics.lambda.z;
+	surface.worldpos = worldpos[0] * barycentrics.lambda.x + worldpos[1] * barycentrics.lambda.y + worldpos[2] * barycentrics.lambda.z;
+	surface.fragCoord = float2(pixel) + 0.5;
+
+	const Material material = materials[draw.materialIndex];
+	const float4 albedo = sampleAlbedo(material, surface);
+	shadedColor[pixel] = float4(shadeSurface(material, albedo, surface, consts.irradianceIndex), 1.0);
+}
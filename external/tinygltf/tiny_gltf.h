@@ -4187,8 +4187,20 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
   buffer->uri.clear();
   ParseStringProperty(&buffer->uri, err, o, "uri", false, "Buffer");
 
+  // VulkanTemplate: Fallback buffers of EXT_meshopt_compression don't need to
+  // have data, they're zero filled for the application to decode into
+  bool meshoptFallback = false;
+  if (buffer->uri.empty()) {
+    ExtensionMap extensions;
+    ParseExtensionsProperty(&extensions, nullptr, o);
+    auto meshopt = extensions.find("EXT_meshopt_compression");
+    meshoptFallback = (meshopt != extensions.end()) &&
+                      meshopt->second.Get("fallback").IsBool() &&
+                      meshopt->second.Get("fallback").Get<bool>();
+  }
+
   // having an empty uri for a non embedded image should not be valid
-  if (!is_binary && buffer->uri.empty()) {
+  if (!is_binary && buffer->uri.empty() && !meshoptFallback) {
     if (err) {
       (*err) += "'uri' is missing from non binary glTF file buffer.\n";
     }
@@ -4204,7 +4216,9 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
     }
   }
 
-  if (is_binary) {
+  if (meshoptFallback) {
+    buffer->data.resize(static_cast<size_t>(byteLength), 0);
+  } else if (is_binary) {
     // Still binary glTF accepts external dataURI.
     if (!buffer->uri.empty()) {
       // First try embedded data URI.
@@ -10,42 +10,111 @@
 #include <VulkanApplication.h>
 #include "AssetManager.h"
 #include "AudioManager.h"
+#include "ActorPool.hpp"
 #include "Texture.hpp"
+#include "FrameAllocator.hpp"
+#include "DirtyRangeBuffer.hpp"
+#include "ReadbackBuffer.hpp"
+#include "FrameArena.hpp"
+#include "PipelineVariantCache.hpp"
+#include "PipelineLayoutCache.hpp"
+#include "RadixSort.hpp"
+#include "GpuPrimitivesBenchmark.h"
+#include "DescriptorWriteBatch.hpp"
+#include "DescriptorUpdateTemplate.hpp"
+#include "AccelerationStructure.hpp"
 #include "glTF.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <stdexcept>
 #include "simulation/RigidBody.hpp"
+#include "simulation/ProjectileHits.hpp"
 #include <random>
+#include <map>
+#include <bit>
+#include <optional>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
 #include "time.h"
 #include "Frustum.hpp"
+#include "VisibilityCache.hpp"
+#include "DynamicResolution.hpp"
+#include "MemoryBudgetManager.hpp"
+#include "MemoryDefragmenter.hpp"
+#include "VirtualTexture.h"
+#include "JobSystem.hpp"
+#include "TaskScheduler.hpp"
+#include "SectorStreamer.hpp"
+#include "SimulationSnapshot.h"
 #include <SFML/Audio.hpp>
 
 // @todo: audio (music and sfx)
-// @todo: sync2 everywhere
-// @todo: timeline semaphores
 
-#ifdef TRACY_ENABLE
+// Heap allocations made through operator new since the current frame started, the steady state frame loop is expected to not allocate at all
+std::atomic<uint64_t> heapAllocations{ 0 };
+
+// Each allocation is preceded by a header with its size and memory category, so frees are accounted to the category the memory was allocated with
+// The header keeps the alignment malloc guarantees for fundamental types
+struct alignas(alignof(std::max_align_t)) HeapAllocationHeader {
+	size_t size;
+	MemoryCategory category;
+};
+
 void* operator new(size_t count)
 {
-	auto ptr = malloc(count);
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	HeapAllocationHeader* header = static_cast<HeapAllocationHeader*>(malloc(sizeof(HeapAllocationHeader) + count));
+	if (!header) {
+		throw std::bad_alloc();
+	}
+	header->size = count;
+	header->category = MemoryStats::getCurrentCategory();
+	memoryStats.addHost(header->category, static_cast<int64_t>(count));
+	auto ptr = header + 1;
+#ifdef TRACY_ENABLE
 	TracyAlloc(ptr, count);
+#endif
 	return ptr;
 }
 
 void operator delete(void* ptr) noexcept
 {
+	if (!ptr) {
+		return;
+	}
+#ifdef TRACY_ENABLE
 	TracyFree(ptr);
-	free(ptr);
-}
 #endif
+	HeapAllocationHeader* header = static_cast<HeapAllocationHeader*>(ptr) - 1;
+	memoryStats.addHost(header->category, -static_cast<int64_t>(header->size));
+	free(header);
+}
 
 std::vector<Pipeline*> pipelineList{};
 
+// Everything is rendered camera relative: Matrices passed to the shaders have the camera's position subtracted from their translation and the view matrix only rotates
+// This keeps the values multiplied in the shaders small, so actors far from the origin don't jitter as the camera moves
 struct ShaderData {
 	glm::mat4 projection;
 	glm::mat4 view;
 	float time{ 0.0f };
 	float timer{ 0.0f };
+	// World position of the camera, xyz
+	alignas(16) glm::vec4 cameraPosition;
+	// Depth range, scale and bias of the light cluster slices and the cluster grid, see LightCullPushConstBlock
+	glm::vec4 clusterDepth;
+	glm::uvec4 clusterGrid;
+	// xyz = direction the sun light travels in, w = intensity
+	glm::vec4 sunDirection;
+	// View depth each shadow cascade ends at, w = length of the shadow rays if they are traced with ray queries instead (0 otherwise)
+	glm::vec4 shadowSplits;
+	// World space size of a texel of each cascade, w = cascade count (0 if shadows are disabled)
+	glm::vec4 shadowTexelSizes;
+	// Camera relative world space to each cascade's shadow map
+	glm::mat4 shadowMatrices[3];
+	VirtualTextureShaderData virtualTexture;
+	// Spherical harmonics irradiance, see generateIrradianceSH, all zero if the irradiance cube is used
+	glm::vec4 irradianceSH[9];
 } shaderData;
 
 uint32_t skyboxIndex{ 0 };
@@ -53,19 +122,253 @@ uint32_t skyboxIndex{ 0 };
 ActorManager* actorManager{ nullptr };
 AssetManager* assetManager{ nullptr };
 AudioManager* audioManager{ nullptr };
-Actor* ship{ nullptr };
+ActorHandle ship{};
 
 const float zFar = 1024.0f * 8.0f;
+// Number of actors the per-actor buffers (instances, culling, simulation) are created for, they grow once the scene has more actors
+const uint32_t initialInstanceCapacity = 16384;
+// Max. number of joint matrices of all skinned actors drawn in a frame
+const uint32_t maxJointMatrices = 16384;
+// Size of the material buffer shared by all models
+const uint32_t maxMaterials = 4096;
+// Space of the per-frame allocators for blocks other than the instance and joint matrices
+const VkDeviceSize frameAllocatorReserve = 1024 * 1024;
+// Limits for the GPU driven culling path
+const uint32_t maxDrawCommands = 1024;
+const uint32_t maxCullBatches = 256;
+// Limits of the GPU particles, blended particles are sorted by a single workgroup in shared memory (see particle_sort.comp.hlsl)
+const uint32_t maxParticles = 65536;
+const uint32_t maxBlendedParticles = 1024;
+const uint32_t maxParticleEmitters = 256;
+const uint32_t maxParticlesPerEmitter = 1024;
+// Clustered point lights, screen tiles are split into exponentially spaced depth slices from clusterNear to the far plane
+const uint32_t clusterTilesX = 16;
+const uint32_t clusterTilesY = 9;
+const uint32_t clusterSlices = 24;
+const uint32_t clusterCount = clusterTilesX * clusterTilesY * clusterSlices;
+// Light count and indices of a cluster, lights beyond that are dropped (see light_cull.comp.hlsl)
+const uint32_t maxLightsPerCluster = 64;
+const uint32_t maxLights = 1024;
+const float clusterNear = 1.0f;
+// Cascaded sun shadows, static casters are cached in their own set of cascades, see Shadows
+const uint32_t shadowCascadeCount = 3;
+const uint32_t shadowMapSize = 2048;
+const VkFormat shadowMapFormat = VK_FORMAT_D16_UNORM;
+// View depth covered by the cascades, split with a blend of logarithmic and uniform distances
+const float shadowDistance = 1000.0f;
+const float shadowSplitLambda = 0.8f;
+// Bounds of the cached cascades are this much larger than needed, so the camera can move within them before the static casters are rendered again
+const float shadowCacheMargin = 0.25f;
+// Casters this far towards the light from a cascade's bounds still cast into it
+const float shadowCasterDistance = 1000.0f;
+// Change of the sun's direction in degrees the cached cascades are kept for
+const float shadowLightThreshold = 0.5f;
+// Static and dynamic casters, each view covers all cascades and is rendered into all of them with multiview
+const uint32_t shadowViewCount = 2;
+// View mask of the shadow passes, one view per cascade
+const uint32_t shadowViewMask = (1u << shadowCascadeCount) - 1;
+// Command regions of the GPU culling: early and late phase, followed by one for each shadow view
+const uint32_t cullCommandRegions = 2 + shadowViewCount;
+// Bump when changing anything about the cubemap filtering that isn't part of the hashed cache key
+const uint32_t iblCacheVersion = 1;
+const std::filesystem::path iblCacheDirectory{ "iblcache" };
+
+// Per-actor input for the culling compute shader
+struct CullActor {
+	// Index of the actor's ActorTransform
+	uint32_t transformIndex;
+	uint32_t batchIndex;
+	// Index of the actor's GPU simulated body or noSimulationBody
+	uint32_t bodyIndex;
+	// cullActorStatic for static shadow casters
+	uint32_t flags;
+};
 
-vks::Frustum frustum;
-uint32_t visibleObjects{ 0 };
+constexpr uint32_t cullActorStatic{ 1 };
+
+// Transform of an actor for GPU culling, indexed by the actor's dense index and only uploaded for actors that changed, matches cull.comp.hlsl
+struct ActorTransform {
+	glm::mat4 matrix;
+	// xyz = position, w = radius
+	glm::vec4 sphere;
+};
+
+// Compact transform of an instance in the instance buffers, half the size of a matrix, matches Instance in instance.hlsl
+// Actors are uniformly scaled, so a rotation and a single scale describe them
+struct InstanceData {
+	// Render space
+	glm::vec3 position;
+	float scale;
+	// Rotation quaternion as four 16 bit snorm values, xy in the first and zw in the second element
+	uint32_t rotation[2];
+	// x = seed, y = strength of the procedural variation, impostors store their opacity in x instead
+	glm::vec2 variation;
+};
+static_assert(sizeof(InstanceData) == 32);
+
+constexpr uint32_t noSimulationBody{ UINT32_MAX };
 
-struct PushConstBlock {
+// State of an asteroid simulated on the GPU, matches simulate.comp.hlsl
+struct SimulationBody {
 	glm::mat4 matrix;
-	uint32_t textureIndex;
-	uint32_t radianceIndex;
+	// w = uniform scale
+	glm::vec4 position;
+	glm::vec4 velocity;
+	// Euler angles in degrees
+	glm::vec4 rotation;
+	glm::vec4 angularVelocity;
+};
+
+struct SimulationPushConstBlock {
+	float deltaTime;
+	uint32_t bodyCount;
+	float gravity;
+};
+
+// All actors using the same model form a batch with consecutive instance slots and indirect commands
+struct CullBatch {
+	uint32_t firstCommand;
+	uint32_t commandCount;
+	uint32_t instanceOffset;
+	uint32_t pad;
+	// Bottom level acceleration structure of the batch's model and level of detail for ray query shadows, zero if there is none
+	uint64_t accelerationStructure;
+};
+
+struct CullPushConstBlock {
+	glm::vec4 frustumPlanes[6];
+	uint32_t actorCount;
+	uint32_t phase;
+	uint32_t commandOffset;
+	uint32_t batchCount;
+	glm::uvec2 depthSize;
+	uint32_t pyramidLevels;
+	// Nearer depths are larger with reverse Z
+	uint32_t reverseDepth;
+	uint32_t drawCountOffset;
+	uint32_t casterFilter;
+	// Writes every actor's instance of the top level acceleration structure
+	uint32_t rayInstances;
+};
+
+// Matches includes/visibility_compute.hlsl, one per indirect command of the frame, so the shading pass can fetch the triangles of the visibility buffer
+struct VisibilityDraw {
+	glm::mat4 node;
+	VkDeviceAddress vertexAddress;
+	VkDeviceAddress indexAddress;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	// Triangles of the preceding draws of the same level of detail, same as vkglTF::PushConstBlock::firstTriangle
+	uint32_t firstTriangle;
+	uint32_t materialIndex;
+	uint32_t indexSize;
+	uint32_t padding[3];
+};
+
+struct VisibilityPushConstBlock {
+	glm::uvec2 size;
+	uint32_t batchCount;
 	uint32_t irradianceIndex;
-} pushConstBlock;
+};
+
+// Selects the actors culled for a shadow view, matches cull.comp.hlsl
+enum class CullCasters : uint32_t { All = 0, Static = 1, Dynamic = 2 };
+
+// With occlusion culling, the early phase draws the actors visible in the last frame and the late phase those that became visible
+enum class CullPhase : uint32_t { FrustumOnly = 0, Early = 1, Late = 2 };
+
+struct DepthReducePushConstBlock {
+	glm::uvec2 sourceSize;
+	glm::uvec2 destinationSize;
+	uint32_t reverseDepth;
+};
+
+enum class RenderPath { PerActor = 0, Instanced = 1, GPUDriven = 2, MeshShaders = 3 };
+
+// Actors are drawn with variants of their pipelines that visualize the cost of shading, matches DEBUG_VIEW in includes/debug_view.hlsl
+enum class DebugView { None = 0, Overdraw = 1, QuadUtilization = 2, Primitives = 3 };
+
+// Matches the push constants of the impostor shaders, pushed through the glTF pipeline layout (whose range is sized for vkglTF::PushConstBlock)
+struct ImpostorPushConstBlock {
+	// Bounding sphere of the model in model space
+	glm::vec4 bounds;
+	uint32_t albedoIndex;
+	uint32_t normalIndex;
+	uint32_t frameCount;
+	float maxLod;
+};
+
+// Matches Emitter in includes/particles.hlsl
+struct ParticleEmitter {
+	glm::vec3 position;
+	uint32_t count;
+	// All particles inherit this velocity and get a random one of up to speed in addition
+	glm::vec3 velocity;
+	float speed;
+	glm::vec4 color;
+	float lifetime;
+	float size;
+	// Change of the size per second
+	float growth;
+	uint32_t flags;
+};
+
+// Blended particles are drawn back to front with alpha blending, all others are added to the target
+constexpr uint32_t particleBlended{ 1 };
+// Size of a particle in includes/particles.hlsl
+constexpr VkDeviceSize particleSize{ 64 };
+// Word offsets of the counters and indirect arguments in includes/particles.hlsl
+constexpr uint32_t particleCounterAlive{ 0 };
+constexpr uint32_t particleArgsDispatch{ 8 };
+constexpr uint32_t particleArgsDrawAdditive{ 12 };
+constexpr uint32_t particleArgsDrawBlended{ 16 };
+constexpr uint32_t particleCounterWords{ 20 };
+
+struct ParticlePushConstBlock {
+	glm::vec4 cameraPosition;
+	float deltaTime;
+	float time;
+	uint32_t emitterCount;
+	// Alive list the emission appends to and the simulation reads from
+	uint32_t parity;
+	uint32_t stage;
+	uint32_t capacity;
+	uint32_t maxBlended;
+	uint32_t maxEmitCount;
+};
+
+// Point light of the clustered forward shading, matches light_cull.comp.hlsl and gltf.frag.hlsl
+struct ClusterLight {
+	// World space, w = radius
+	glm::vec4 position;
+	glm::vec4 color;
+};
+
+struct LightCullPushConstBlock {
+	// Camera relative
+	glm::mat4 view;
+	glm::vec4 cameraPosition;
+	// x = near and y = far depth of the slices, z = scale and w = bias of the slice index from the log of the view depth
+	glm::vec4 clusterDepth;
+	// Tiles in x and y, depth slices, light count
+	glm::uvec4 clusterGrid;
+	// Diagonal of the projection matrix
+	glm::vec2 projectionScale;
+};
+
+struct ParticleDrawPushConstBlock {
+	glm::mat4 viewProjection;
+	glm::vec4 renderOrigin;
+	glm::vec4 cameraRight;
+	glm::vec4 cameraUp;
+	// First entry of the draw list in the list buffer
+	uint32_t listOffset;
+};
+
+vks::Frustum frustum;
+// Same frustum in the camera relative space of the render matrices (see toRenderSpace), for the per primitive tests of models drawn per actor
+vks::Frustum renderFrustum;
+uint32_t visibleObjects{ 0 };
 
 struct Skybox {
 	uint32_t brdfLUT{ 0 };
@@ -76,20 +379,662 @@ struct Skybox {
 class Application : public VulkanApplication {
 private:
 	struct FrameObjects : public VulkanFrameObjects {
-		Buffer* uniformBuffer;
+		// Uniform and instance data are carved from the frame's allocator and bound with dynamic offsets
+		FrameAllocator* frameAllocator;
+		// Transient CPU data of the frame's recording (e.g. command buffer lists and job arguments)
+		FrameArena* frameArena;
+		FrameAllocation uniformAllocation;
+		FrameAllocation instanceAllocation;
+		FrameAllocation jointAllocation;
 		DescriptorSet* descriptorSet;
+		// GPU driven culling
+		Buffer* cullActorBuffer;
+		Buffer* cullBatchBuffer;
+		Buffer* indirectCommandBuffer;
+		Buffer* drawCountBuffer;
+		DescriptorSet* cullDescriptorSet;
+		uint32_t cullBatchCount{ 0 };
+		uint32_t cullCommandCount{ 0 };
+		bool cullOcclusion{ false };
+		// Ray query shadows, the culling pass writes an instance per actor and builds the frame's top level structure from them
+		Buffer* rayInstanceBuffer{ nullptr };
+		AccelerationStructure* topLevelAS{ nullptr };
+		// GPU simulation, each frame integrates the previous frame's bodies into its own buffer
+		Buffer* bodyBuffer;
+		DescriptorSet* simulationDescriptorSet;
+		// Particles, the emitters are carved from the frame allocator
+		DescriptorSet* particleDescriptorSet;
+		// Host visible copy of the particle counters, read once the frame is no longer in flight
+		Buffer* particleStatsBuffer;
+		uint32_t particleParity{ 0 };
+		bool particleStatsValid{ false };
+		// Point lights are carved from the frame allocator, the light culling pass writes the cluster lists
+		FrameAllocation lightAllocation;
+		Buffer* clusterLightBuffer;
+		DescriptorSet* lightCullDescriptorSet;
+		// Instances of the static and dynamic shadow casters
+		std::array<FrameAllocation, shadowViewCount> shadowInstanceAllocations;
+		// Parallel command buffer recording, pools can't be used from multiple threads at once so each recording job gets its own
+		std::vector<CommandPool*> threadCommandPools;
+		std::vector<CommandBuffer*> threadCommandBuffers;
+		// The skybox never changes, so it's only recorded again once any state it has been recorded with changed, see getSkyboxRecordingKey
+		CommandBuffer* skyboxCommandBuffer;
+		uint64_t skyboxKey{ 0 };
+		// Skinned actors and impostors
+		CommandBuffer* backdropCommandBuffer;
+		// Particles are drawn after all actors
+		CommandBuffer* effectsCommandBuffer;
+		// Pages of the virtual texture requested by the frame's fragments, read once the frame is no longer in flight
+		Buffer* virtualTextureFeedbackBuffer;
+		// Slots written by the frame, 0 if it didn't sample the virtual texture
+		uint32_t virtualTextureFeedbackSize{ 0 };
+		CommandBuffer* overlayCommandBuffer;
+		// Draw data version the overlay command buffer has been recorded with, it's only recorded again once the overlay changed
+		uint64_t overlayVersion{ UINT64_MAX };
+		// Bindless textures, each frame has its own set so descriptors of replaced textures (e.g. by texture streaming) can be rewritten once the frame is no longer in flight
+		DescriptorSet* descriptorSetTextures;
+		// Asset manager slot versions currently written to descriptorSetTextures
+		std::vector<uint32_t> textureVersions;
+		uint64_t textureGeneration{ UINT64_MAX };
+		// Depth pyramid generation written to cullDescriptorSet
+		uint32_t depthPyramidGeneration{ UINT32_MAX };
+		// Dynamic resolution, scene color target generation written to upscaleDescriptorSet
+		DescriptorSet* upscaleDescriptorSet;
+		uint32_t sceneColorGeneration{ UINT32_MAX };
+		// Source the upscale descriptor was last written with, the temporal history's current layer changes every frame
+		VkImageView upscaleSourceView{ VK_NULL_HANDLE };
+		// One set per downsample and upsample step of the bloom chain
+		std::vector<DescriptorSet*> bloomDescriptorSets;
+		// Hash of the sources written to bloomDescriptorSets
+		uint64_t bloomDescriptorKey{ 0 };
+		// The scene is rendered to the scene color target at a reduced scale and upscaled to the swap chain afterwards
+		bool scaledScene{ false };
+		// Temporal anti-aliasing, the scene color target is resolved into the history, which is then upscaled to the swap chain
+		bool temporalResolve{ false };
+		DescriptorSet* temporalResolveDescriptorSet;
+		// Hash of the targets and the history layers written to temporalResolveDescriptorSet
+		uint64_t temporalResolveKey{ 0 };
+		// Visibility buffer, set per frame as the culling pass writes the draws the shading pass looks up the triangles in
+		bool visibilityBuffer{ false };
+		Buffer* visibilityDrawBuffer{ nullptr };
+		DescriptorSet* visibilityDescriptorSet{ nullptr };
+		// Scene color generation the targets of visibilityDescriptorSet were written with
+		uint32_t visibilityGeneration{ UINT32_MAX };
 	};
 	std::vector<FrameObjects> frameObjects;
+	// Owns all pipeline layouts of the application, layouts with the same signature are shared (e.g. the glTF and skybox layouts)
+	PipelineLayoutCache* pipelineLayoutCache{ nullptr };
 	PipelineLayout* glTFPipelineLayout;
 	PipelineLayout* skyboxPipelineLayout;
+	// Mesh shading, only created if the device supports mesh shaders
+	PipelineLayout* meshletPipelineLayout{ nullptr };
+	DescriptorSetLayout* meshletDescriptorSetLayout{ nullptr };
 	FileWatcher* fileWatcher{ nullptr };
+	// Pipelines that are only created once they're needed
+	PipelineVariantCache* pipelineVariants{ nullptr };
+	// Only used if graphics pipeline libraries are supported
+	PipelineLibrary* pipelineLibrary{ nullptr };
+	// Same as the glTF pipeline, but with the vertex shader's skinning enabled, created once the first skinned actor is drawn
+	PipelineCreateInfo* skinnedPipelineCreateInfo{ nullptr };
 	DescriptorPool* descriptorPool;
 	DescriptorSetLayout* descriptorSetLayout;
+	// The bindless texture sets are updated after bind, which requires a pool of their own
+	DescriptorPool* textureDescriptorPool;
 	DescriptorSetLayout* descriptorSetLayoutTextures;
-	DescriptorSet* descriptorSetTextures;
+	// The bindless texture sets are allocated with a fixed size, so textures of assets loaded later on can be added
+	// Clamped to the device's update after bind limits, slots of removed textures are reused so the table doesn't fill up with reloads
+	static constexpr uint32_t textureTableCapacity{ 16384 };
+	uint32_t maxTextureDescriptors{ 0 };
 	std::unordered_map<std::string, Pipeline*> pipelines;
-	sf::Music backgroundMusic;
+	// Looked up once after creation, so recording doesn't look pipelines up by name (reloads keep the pipeline objects)
+	struct {
+		Pipeline* skybox{ nullptr };
+		Pipeline* skyboxFullscreen{ nullptr };
+		Pipeline* gltf{ nullptr };
+		Pipeline* gltfInstanced{ nullptr };
+		Pipeline* gltfPulled{ nullptr };
+		Pipeline* gltfSkinned{ nullptr };
+		Pipeline* depth{ nullptr };
+		Pipeline* depthInstanced{ nullptr };
+		Pipeline* gltfMesh{ nullptr };
+		Pipeline* cull{ nullptr };
+		Pipeline* depthReduce{ nullptr };
+		// Reduces the multi sampled depth into the first level if the depth can't be resolved to its farthest sample
+		Pipeline* depthReduceMultisample{ nullptr };
+		Pipeline* simulate{ nullptr };
+		Pipeline* upscale{ nullptr };
+		Pipeline* temporalResolve{ nullptr };
+		Pipeline* bloomDownsample{ nullptr };
+		Pipeline* bloomUpsample{ nullptr };
+		Pipeline* impostor{ nullptr };
+		Pipeline* impostorBake{ nullptr };
+		Pipeline* particleEmit{ nullptr };
+		Pipeline* particleArgs{ nullptr };
+		Pipeline* particleSimulate{ nullptr };
+		Pipeline* particleSort{ nullptr };
+		Pipeline* particleAdditive{ nullptr };
+		Pipeline* particleBlended{ nullptr };
+		Pipeline* lightCull{ nullptr };
+		Pipeline* shadow{ nullptr };
+		// Only created if the visibility buffer is supported
+		Pipeline* visibility{ nullptr };
+		Pipeline* visibilityClassify{ nullptr };
+		Pipeline* visibilityBins{ nullptr };
+		Pipeline* visibilityScatter{ nullptr };
+		Pipeline* visibilityShade{ nullptr };
+		Pipeline* visibilityComposite{ nullptr };
+	} scenePipelines;
+	SoundHandle laserSound;
+	SoundHandle impactSound;
 	float firingTimer;
+	int32_t renderPath{ static_cast<int32_t>(RenderPath::GPUDriven) };
+	int32_t debugView{ static_cast<int32_t>(DebugView::None) };
+	// Variants of the actor pipelines for the selected debug view, keyed on the pipeline they replace
+	std::unordered_map<Pipeline*, Pipeline*> debugViewPipelines;
+	// Radians per second and distance of the benchmark's camera orbit
+	static constexpr float benchmarkOrbitSpeed{ 0.2f };
+	static constexpr float benchmarkOrbitRadius{ 80.0f };
+	// Visible actors grouped by model for instanced rendering, kept as a member to reuse allocations across frames
+	std::map<std::pair<vkglTF::Model*, uint32_t>, std::vector<InstanceData>> instanceBatches;
+	uint32_t instanceBatchCount{ 0 };
+	// Indices of actors that passed the CPU frustum test, culled once per frame before the simulation advances the actors
+	std::vector<uint32_t> visibleActorIndices;
+	uint32_t visibleActorCount{ 0 };
+	// Frustum test results of the last frames, so only actors that moved (or all of them after large camera moves) are tested again
+	vks::VisibilityCache visibilityCache;
+	bool temporalCulling{ true };
+	// Additional views of the scene drawn into regions of the scene target after the main view (picture in picture or split screen)
+	// Views share the simulation, the actor snapshot and the frame's instance, joint and light data with the main view, only their uniform block and visible actors are their own
+	struct RenderView {
+		enum class Type { RearView, Map };
+		Type type{ Type::RearView };
+		const char* name{ nullptr };
+		bool enabled{ false };
+		// Region of the scene target as fractions of its size, xy = offset, zw = size
+		glm::vec4 region{ 0.0f };
+		// World position the view is rendered from, its render space is relative to this position
+		glm::vec3 position{ 0.0f };
+		// Rotation only, like the view matrix of the main view's uniform block
+		glm::mat4 view{ 1.0f };
+		glm::mat4 projection{ 1.0f };
+		// Tangent of half the vertical field of view, for the projected sizes levels of detail are selected with
+		float tanHalfFov{ 1.0f };
+		// World space frustum for culling, and the same frustum relative to the view's position for the per primitive tests
+		vks::Frustum frustum;
+		vks::Frustum renderFrustum;
+		std::vector<uint32_t> visibleIndices;
+		uint32_t visibleCount{ 0 };
+		uint32_t uniformOffset{ 0 };
+	};
+	static constexpr uint32_t maxRenderViews{ 4 };
+	std::vector<RenderView> renderViews{
+		{ .type = RenderView::Type::RearView, .name = "Rear view", .region = { 0.35f, 0.02f, 0.3f, 0.2f } },
+		{ .type = RenderView::Type::Map, .name = "Tactical map", .region = { 0.73f, 0.55f, 0.25f, 0.4f } },
+	};
+	// Height above the camera and width of the area the tactical map shows
+	float mapHeight{ 500.0f };
+	float mapExtent{ 400.0f };
+	// Visible actors with skinned models, these are drawn separately with the skinning pipeline by all render paths
+	std::vector<uint32_t> skinnedActorIndices;
+	// Flags model slots whose model is skinned, updated along with the culling
+	std::vector<uint8_t> skinnedModelSlots;
+	bool hasSkinnedModels{ false };
+	// Actor state the frame is recorded from, captured at the start of the frame
+	ActorSnapshot actorSnapshot;
+	// With a pipelined simulation, the next frame's actor state is simulated on a worker thread while the current frame is recorded and submitted
+	bool pipelinedSimulation{ true };
+	vks::Job* simulationJob{ nullptr };
+	// Resumes loading tasks (see loadEnvironment) on the workers and with each frame on the main thread
+	vks::TaskScheduler* taskScheduler{ nullptr };
+	// The skybox is loaded in the background and the environment cubemaps are filtered once it's resident, placeholders are used until then so the first frames don't wait for them
+	vks::Job* skyboxJob{ nullptr };
+	vks::TextureData skyboxData;
+	bool environmentReady{ false };
+	bool firstFrameSubmitted{ false };
+	// Startup work that doesn't need the device runs on the workers while the instance, device and swapchain are created
+	vks::Job* shaderBundleJob{ nullptr };
+	vks::Job* prefetchJob{ nullptr };
+	const std::string placeholderModelFile{ "models/crate_up.glb" };
+	const std::map<std::string, std::string> modelFiles = {
+		{ "asteroid", "models/asteroid.glb" },
+		{ "moon", "models/moon.gltf" },
+		{ "spaceship", "models/spaceship/scene_ktx.gltf" },
+		{ "bullet", "models/bullet.glb" }
+	};
+	const std::map<std::string, std::string> soundFiles = {
+		{ "laser", "sounds/laser1.mp3" }
+	};
+	// GPU driven culling
+	PipelineLayout* cullPipelineLayout;
+	DescriptorSetLayout* cullDescriptorSetLayout;
+	// Batch index per model slot and level of detail, UINT32_MAX for combinations without a batch in the current frame
+	std::vector<uint32_t> cullBatchLookup;
+	std::vector<vkglTF::Model*> cullBatchModels;
+	std::vector<uint32_t> cullBatchLods;
+	std::vector<CullBatch> cullBatches;
+	// Set for the batches drawn to the visibility buffer, the scene pass only draws the other ones
+	std::vector<bool> cullBatchVisibility;
+	std::vector<VkDrawIndexedIndirectCommand> indirectCommands;
+	uint32_t cullActorCount{ 0 };
+	// Two-phase occlusion culling against a depth pyramid of the early draws, only used by the GPU driven path
+	bool occlusionCulling{ true };
+	// Persists across frames, so it's shared by all frames in flight
+	Buffer* actorVisibilityBuffer{ nullptr };
+	// Transforms of all actors for GPU culling, only the ones that changed are uploaded
+	DirtyRangeBuffer* actorTransformBuffer{ nullptr };
+	std::vector<ActorTransform> actorTransforms;
+	struct DepthPyramid {
+		Image* image{ nullptr };
+		// All levels are read by the culling shader, the per-level views are used while building the pyramid
+		ImageView* view{ nullptr };
+		std::vector<ImageView*> levelViews;
+		// Depth aspect of the depth stencil image (or the multi sampled depth if it can't be resolved to its farthest sample), source of the first level
+		VkImageView depthView{ VK_NULL_HANDLE };
+		DescriptorPool* descriptorPool{ nullptr };
+		std::vector<DescriptorSet*> descriptorSets;
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		uint32_t levels{ 0 };
+		// Increased whenever the pyramid is recreated, frames write its descriptor once they're no longer in flight
+		uint32_t generation{ 0 };
+	} depthPyramid;
+	// Levels of the post processing bloom chain, the first one has half the size of the output
+	static constexpr uint32_t bloomLevelCount{ 5 };
+	// Per-frame resources tracked by the render graph, the handles are set before each frame's passes are recorded
+	struct {
+		RenderGraphResource depthPyramid;
+		RenderGraphResource indirectCommands;
+		RenderGraphResource drawCounts;
+		RenderGraphResource instances;
+		RenderGraphResource actorVisibility;
+		RenderGraphResource bodies;
+		RenderGraphResource previousBodies;
+		RenderGraphResource particles;
+		RenderGraphResource particleLists;
+		RenderGraphResource particleCounters;
+		RenderGraphResource clusterLights;
+		RenderGraphResource staticShadowMap;
+		RenderGraphResource dynamicShadowMap;
+		// Only written on the scaled scene path (dynamic resolution, temporal anti-aliasing and post processing)
+		RenderGraphResource sceneColor;
+		RenderGraphResource temporalHistory;
+		// Only declared with post processing
+		RenderGraphResource bloomLevels[bloomLevelCount];
+		// Only declared if the visibility buffer is supported
+		RenderGraphResource visibilityTarget;
+		RenderGraphResource visibilityColor;
+		RenderGraphResource visibilityBins;
+		RenderGraphResource visibilityPixels;
+	} graphResources;
+	// Renders the scene at a scale adapted to the GPU frame time, the result is then upscaled to the swap chain and the overlay drawn on top at full resolution
+	// Not combined with occlusion culling, as its depth pyramid is built from depth at full resolution
+	bool dynamicResolution{ false };
+	DynamicResolution dynamicResolutionController{ {} };
+	float upscaleSharpness{ 0.5f };
+	// Extent the scene passes of the frame render to, only smaller than the swap chain with dynamic resolution
+	VkExtent2D sceneExtent{};
+	// Increased whenever the render graph recreated the scene color target, frames write its descriptor once they're no longer in flight
+	uint32_t sceneColorGeneration{ 0 };
+	DescriptorSetLayout* upscaleDescriptorSetLayout{ nullptr };
+	PipelineLayout* upscalePipelineLayout{ nullptr };
+	DescriptorPool* upscaleDescriptorPool{ nullptr };
+	VkSampler upscaleSampler{ VK_NULL_HANDLE };
+	struct UpscalePushConstBlock {
+		glm::vec2 uvScale;
+		glm::vec2 texelSize;
+		float sharpness;
+		float exposure;
+		float bloomStrength;
+		float bloomLevels;
+		uint32_t passThrough;
+	};
+	// With post processing, the scene is rendered to an HDR scene color target (so it always takes the scaled scene path) and the upscale also tonemaps
+	// Set at startup, as all scene pipelines are created for this format
+	VkFormat sceneColorFormat{ VK_FORMAT_UNDEFINED };
+	bool bloom{ true };
+	float bloomStrength{ 0.05f };
+	float exposure{ 1.0f };
+	DescriptorSetLayout* bloomDescriptorSetLayout{ nullptr };
+	PipelineLayout* bloomDownsamplePipelineLayout{ nullptr };
+	PipelineLayout* bloomUpsamplePipelineLayout{ nullptr };
+	DescriptorPool* bloomDescriptorPool{ nullptr };
+	struct BloomDownsamplePushConstBlock {
+		glm::vec2 sourceUVScale;
+		glm::vec2 sourceTexelSize;
+		glm::uvec2 destinationSize;
+		uint32_t firstLevel;
+	};
+	struct BloomUpsamplePushConstBlock {
+		glm::vec2 sourceTexelSize;
+		glm::uvec2 destinationSize;
+	};
+	// Temporal anti-aliasing as a cheaper alternative to multisampling, the projection is jittered by a subpixel offset that changes every frame and the frames are accumulated into a history
+	// Uses the scaled scene path of dynamic resolution (so both can be combined), which also means it's not combined with occlusion culling
+	// The resolve reads the scene's depth, so it's only available without multisampling and tile based rendering
+	bool temporalAntiAliasing{ false };
+	float temporalHistoryWeight{ 0.9f };
+	struct TemporalHistory {
+		// Full output size with two layers, the resolve reads the previous frame's result from one and writes to the other
+		Image* image{ nullptr };
+		ImageView* layerViews[2]{};
+		// Increased whenever the history is recreated, frames write its descriptors once they're no longer in flight
+		uint32_t generation{ 0 };
+	} temporalHistory;
+	struct {
+		// Layer of the history written by the current frame
+		uint32_t layer{ 0 };
+		uint32_t sampleIndex{ 0 };
+		// Cleared whenever the history doesn't contain the previous frame
+		bool historyValid{ false };
+		// Unjittered projection and camera position of the previous frame
+		glm::mat4 previousViewProjection{ 1.0f };
+		glm::vec3 previousRenderOrigin{ 0.0f };
+		// Current frame's clip space to the previous frame's clip space
+		glm::mat4 reprojection{ 1.0f };
+	} temporalAA;
+	DescriptorSetLayout* temporalResolveDescriptorSetLayout{ nullptr };
+	PipelineLayout* temporalResolvePipelineLayout{ nullptr };
+	DescriptorPool* temporalResolveDescriptorPool{ nullptr };
+	struct TemporalResolvePushConstBlock {
+		glm::mat4 reprojection;
+		glm::vec2 jitter;
+		glm::vec2 uvScale;
+		glm::vec2 texelSize;
+		glm::uvec2 outputSize;
+		float historyWeight;
+		uint32_t resetHistory;
+		uint32_t reverseDepth;
+	};
+	// Visibility buffer: The GPU driven path draws its actors to a target of instance and triangle ids first, compute passes then bin the covered pixels by material and shade each of them once
+	// Material cost no longer scales with overdraw and the partially covered pixel quads of small triangles, see recordVisibilityShading
+	bool visibilityBuffer{ false };
+	struct {
+		DescriptorSetLayout* descriptorSetLayout{ nullptr };
+		PipelineLayout* pipelineLayout{ nullptr };
+		DescriptorPool* descriptorPool{ nullptr };
+		// Pixel count (and after binning the list offset) per material, followed by the shading dispatch arguments and the total pixel count
+		Buffer* bins{ nullptr };
+		// Covered pixels ordered by material, sized for the full output and recreated with the scene color target
+		Buffer* pixels{ nullptr };
+	} visibility;
+	// Matches includes/visibility_compute.hlsl
+	static constexpr uint32_t visibilityBinCount{ maxMaterials + 4 };
+	// Visibility values hold the instance slot and the triangle in one channel each, see includes/visibility.hlsl
+	static constexpr VkFormat visibilityTargetFormat{ VK_FORMAT_R32G32_UINT };
+	static constexpr VkFormat visibilityColorFormat{ VK_FORMAT_R16G16B16A16_SFLOAT };
+	// Frame the render graph passes are recorded for
+	FrameObjects* recordingFrame{ nullptr };
+	// Shared by the early and the late scene pass
+	struct {
+		VkRenderingAttachmentInfo color{};
+		VkRenderingAttachmentInfo depth{};
+		VkRenderingAttachmentInfo stencil{};
+		VkRenderingInfo renderingInfo{};
+	} sceneAttachments;
+	DescriptorSetLayout* depthReduceDescriptorSetLayout;
+	PipelineLayout* depthReducePipelineLayout;
+	// The reduce sets all have the same shape and are recreated with the pyramid
+	struct DepthReduceDescriptors {
+		VkDescriptorImageInfo source;
+		VkDescriptorImageInfo destination;
+	};
+	DescriptorUpdateTemplate* depthReduceUpdateTemplate;
+	// Descriptor writes of setup and of the per frame updates, each flushed with a single vkUpdateDescriptorSets before the sets they update are used
+	DescriptorWriteBatch descriptorWrites;
+	// Asteroid motion simulated in a compute shader, the GPU driven path reads the transforms directly from the device local body buffers
+	bool gpuSimulation{ false };
+	// Set once the bodies have been uploaded, cleared while the simulation isn't used so it restarts from the actors' current state
+	bool gpuSimulationRunning{ false };
+	// Simulation and early culling are render graph passes that run on the async compute queue if available, overlapping the previous frame's graphics work
+	bool asyncComputePasses{ true };
+	// Body i simulates this actor, while the GPU simulation owns them the CPU simulation treats these actors as kinematic and their transforms aren't uploaded
+	std::vector<ActorHandle> simulatedActors;
+	std::vector<uint32_t> actorBodyIndices;
+	// Non-zero for the actors owned by the GPU simulation, indexed with the dense actor index at the time of the CPU simulation step
+	std::vector<uint8_t> gpuSimulatedActors;
+	// Body positions are read back in intervals for the host's queries (collisions, picking, levels of detail), restarting the simulation invalidates readbacks still in flight
+	uint32_t bodyReadbackInterval{ 8 };
+	uint32_t bodyReadbackGeneration{ 0 };
+	Buffer* bodyUploadBuffer{ nullptr };
+	DescriptorSetLayout* simulationDescriptorSetLayout;
+	PipelineLayout* simulationPipelineLayout;
+	const float orbitGravity{ 50000.0f };
+	// Particles of weapon and impact effects live on the GPU only: A compute pass emits them into free slots, simulates them, compacts the survivors into the other alive list and sorts the blended ones
+	// Dispatch and draw sizes are indirect arguments written by the pass, so the CPU only uploads the frame's emitters
+	bool useParticles{ true };
+	Buffer* particleBuffer{ nullptr };
+	// Dead list, both alive lists, the additive and the sorted blended draw lists and the blended sort entries, see includes/particles.hlsl
+	Buffer* particleListBuffer{ nullptr };
+	Buffer* particleCounterBuffer{ nullptr };
+	DescriptorSetLayout* particleDescriptorSetLayout{ nullptr };
+	PipelineLayout* particleComputePipelineLayout{ nullptr };
+	PipelineLayout* particleDrawPipelineLayout{ nullptr };
+	// Requested since the last particle pass, emitters beyond maxParticleEmitters are dropped
+	std::vector<ParticleEmitter> particleEmitters;
+	// Positions of the bullets that hit something in the last simulation step, turned into emitters and sounds by the main thread
+	std::vector<glm::vec3> bulletImpacts;
+	ProjectileHitDetection bulletHits;
+	// Alive list the next particle pass emits into, flipped by each pass
+	uint32_t particleParity{ 0 };
+	// Counters are cleared by the first particle pass
+	bool particlesInitialized{ false };
+	// Alive particles after the last completed frame's pass
+	uint32_t particleCount{ 0 };
+	// Point lights are culled into a froxel grid by a compute pass, so fragments only loop over the lights of their cluster
+	// Bullets carry a light, explosions and muzzle flashes add short lived ones that fade out
+	struct TransientLight {
+		glm::vec3 position;
+		float radius;
+		glm::vec3 color;
+		float age;
+		float lifetime;
+	};
+	std::vector<TransientLight> transientLights;
+	DescriptorSetLayout* lightCullDescriptorSetLayout{ nullptr };
+	PipelineLayout* lightCullPipelineLayout{ nullptr };
+	// Additional lights orbiting with the asteroids, to compare the cost of many lights
+	int32_t testLightCount{ 0 };
+	uint32_t lightCount{ 0 };
+	// Cascaded shadow maps of the sun, casters are culled by the GPU driven path so shadows are only available with it
+	// Static casters (all actors not moved by the simulation) are kept in cached cascades, which are only rendered again once the camera left a cascade's enlarged bounds, the sun rotated or a static caster changed
+	// Dynamic casters are rendered into a second set of cascades with the same bounds every frame, the fragment shader combines both
+	// Each set is drawn in a single multiview pass, with one view per cascade, so the casters are culled and drawn once for all cascades
+	struct ShadowMap {
+		Image* image{ nullptr };
+		// All cascades, used as the multiview attachment and for sampling
+		ImageView* view{ nullptr };
+	};
+	struct ShadowCascade {
+		// Cached bounds, light space center snapped to the texel grid and half extent
+		glm::vec3 lightCenter{ 0.0f };
+		float extent{ 0.0f };
+		glm::mat4 viewProjection{ 1.0f };
+		float split{ 0.0f };
+	};
+	struct {
+		ShadowMap staticMap;
+		ShadowMap dynamicMap;
+		VkSampler sampler{ VK_NULL_HANDLE };
+		std::array<ShadowCascade, shadowCascadeCount> cascades;
+		// Bounds of all cascades, casters are culled against these for the multiview passes
+		vks::Frustum casterFrustum;
+		// Static casters need to be rendered again this frame, all cascades are refreshed together as they're drawn in one pass
+		bool refreshStatic{ true };
+		// Direction the cascades have been fitted for
+		glm::vec3 lightDirection{ 0.0f };
+		bool valid{ false };
+		// Per dense actor index, set for static casters
+		std::vector<uint8_t> staticCasters;
+		// Static casters of the current frame and at the last refresh, any difference invalidates the cached cascades
+		std::vector<glm::mat4> staticCasterMatrices;
+		std::vector<glm::mat4> cachedStaticCasterMatrices;
+		uint32_t staticUpdates{ 0 };
+	} shadows;
+	bool useShadows{ true };
+	// Sun shadows traced with ray queries against the actors instead of the shadow maps, only available with VK_KHR_ray_query
+	struct RayQueryShadows {
+		bool enabled{ true };
+		// Bottom level structures of the model in a slot, one per level of detail (null for levels without triangles), built the first time the model is drawn
+		struct ModelStructures {
+			// Compared against the slot's current model, so structures of a swapped model are never used
+			const vkglTF::Model* model{ nullptr };
+			std::vector<AccelerationStructure*> lods;
+		};
+		std::vector<ModelStructures> models;
+		// Models built per frame, the others are built in later frames and don't cast shadows until then
+		uint32_t maxBuildsPerFrame{ 4 };
+		// Top level structures are updated (refit) from the previous frame's, with a full build after this many updates as the moving actors degrade the kept hierarchy
+		uint32_t rebuildInterval{ 30 };
+		uint32_t updateCount{ 0 };
+		// Forces a full build, e.g. after bottom level structures were released or the culling pass changed queues
+		bool rebuild{ true };
+		// Length of the shadow rays, casters farther away than this are ignored
+		float rayDistance{ 2000.0f };
+	} rayQueryShadows;
+	// Degrees around the y axis
+	float sunAngle{ 30.0f };
+	vks::JobSystem* jobSystem{ nullptr };
+	RigidBodySimulation* simulation{ nullptr };
+	// None of the models use skinning, so all of them are loaded with quantized vertices and all glTF pipelines use the matching vertex input
+	const vkglTF::VertexLayout modelVertexLayout{ vkglTF::VertexLayout::Compact };
+	// Most actors are far away from the camera, so the actor models get simplified levels of detail selected by their projected size
+	const uint32_t modelLodCount{ 5 };
+	bool useLods{ true };
+	// Asteroids share one mesh that's displaced and tinted per actor by the instanced shaders (see variation.hlsl), the per actor path and impostors show the plain mesh
+	// The scale is applied to the strength the actors were created with, which their bounds have been enlarged for
+	bool proceduralVariation{ true };
+	float variationScale{ 1.0f };
+	static constexpr float asteroidVariation{ 0.25f };
+	// The asteroid field is generated in sectors around the camera, so it continues in every direction: two dense rings around the moon and sparse rocks everywhere else
+	// Each sector's rocks only depend on the field's seed and the sector's coordinate, they're generated on the workers and added as actors at the frame boundary
+	struct AsteroidRing {
+		float innerRadius;
+		float outerRadius;
+		uint32_t count;
+	};
+	static constexpr AsteroidRing asteroidRings[2]{ { 70.0f, 160.0f, 4096 }, { 210.0f, 360.0f, 4096 } };
+	// Asteroids per square unit outside of the rings
+	static constexpr float asteroidBackgroundDensity{ 0.0015f };
+	static constexpr float asteroidSectorSize{ 64.0f };
+	struct AsteroidSector {
+		std::vector<ActorCreateInfo> createInfos;
+		std::vector<ActorHandle> actors;
+	};
+	vks::SectorStreamer<AsteroidSector>* asteroidField{ nullptr };
+	// With settings.snapshotFile set, the asteroid field's actors are captured in intervals and written by a background job, so a restart restores them instead of regenerating the field
+	SimulationSnapshotWriter snapshotWriter;
+	vks::Job* snapshotJob{ nullptr };
+	float snapshotInterval{ 30.0f };
+	float snapshotTimer{ 30.0f };
+	// Copies to the host go through a ring that's read a few frames later once the copying frame has completed, so diagnostics never wait for the device
+	// Only created once something is read back for the first time
+	ReadbackBuffer* readbackBuffer{ nullptr };
+	bool screenshotRequested{ false };
+	// Screenshots are converted and written by a background job, so the file isn't written by the main thread
+	vks::Job* screenshotJob{ nullptr };
+	// Actor under the cursor, picked with a ray through the actor manager's spatial grid
+	ActorHandle hoveredActor{};
+	float hoveredActorDistance{ 0.0f };
+	// Actors projected smaller than impostorScreenSize are drawn as camera facing quads, textured from atlases of their model baked from impostorFrameCount^2 directions (octahedral mapping)
+	// Over the upper impostorFadeRange share of the threshold the impostor is dithered in while the mesh is still drawn, only used by the per actor and instanced paths
+	bool useImpostors{ true };
+	float impostorScreenSize{ 0.02f };
+	float impostorFadeRange{ 0.25f };
+	static constexpr uint32_t impostorFrameCount{ 8 };
+	static constexpr uint32_t impostorFrameSize{ 64 };
+	static constexpr VkFormat impostorAtlasFormats[2]{ VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM };
+	static constexpr VkFormat impostorDepthFormat{ VK_FORMAT_D16_UNORM };
+	struct Impostor {
+		// Model the atlases have been baked from, they're baked again once the slot's model changed (e.g. by a reload)
+		vkglTF::Model* model{ nullptr };
+		// Skinned models and models without bounds don't get impostors
+		bool supported{ false };
+		bool bakePending{ false };
+		uint32_t albedoIndex{ UINT32_MAX };
+		uint32_t normalIndex{ UINT32_MAX };
+		glm::vec4 bounds{};
+	};
+	// Per model slot
+	std::vector<Impostor> impostors;
+	struct ImpostorActor {
+		uint32_t index;
+		// Opacity of the impostor, below 1 within the fade range
+		float fade;
+	};
+	// Visible actors drawn as impostors this frame, indices refer to the actor snapshot
+	std::vector<ImpostorActor> impostorActors;
+	uint32_t impostorCount{ 0 };
+	// Instanced draws fetch their vertices through buffer device addresses instead of the vertex input stage, only available if the device supports them
+	bool vertexPulling{ false };
+	// Actors are drawn to depth first with position-only pipelines, so the main pass only shades the visible fragment of each pixel
+	bool depthPrepass{ false };
+	// Visible actors are sorted front to back by their quantized view depth on the CPU paths (per model on the per actor path), so fewer fragments pass the depth test
+	bool sortActors{ true };
+	// Switches the actors to wireframe through dynamic polygon mode, so no separate pipelines are needed, only available if the device supports it
+	bool wireframe{ false };
+	// Shades the skybox and actors drawn at coarser levels of detail at a reduced rate, only available if the device supports per draw fragment shading rates
+	bool variableRateShading{ true };
+	// Draws the skybox as a fullscreen triangle at the far plane after the opaque geometry instead of drawing a cube behind everything first, so covered pixels aren't shaded
+	bool fullscreenSkybox{ true };
+	vks::RadixSort actorSort;
+	std::vector<uint64_t> actorSortKeys;
+	// Mip levels of the models' KTX textures are streamed based on the screen size of the closest actor using them
+	TextureStreamer* textureStreamer{ nullptr };
+	int32_t textureBudgetMB{ 256 };
+	// Entries are kept across frames and only erased once their model is no longer used, so requesting mips doesn't allocate every frame
+	std::unordered_map<vkglTF::Model*, float> modelScreenSizes;
+	// Kept across frames so its capacity is reused
+	std::vector<ActorHandle> hitBullets;
+	// Bullets that don't hit anything are despawned once they expire, so firing doesn't add actors without bound
+	ActorPool* bulletPool{ nullptr };
+	// Resolved once at load, as names are only meant for setup
+	ModelHandle crateModel{};
+	ModelHandle bulletModel{};
+	ActorTag bulletTag{};
+	ActorTag asteroidTag{};
+	// Camera position the current frame is rendered relative to
+	glm::vec3 renderOrigin{ 0.0f };
+	// Heap allocations of the last frame, steady state frames are reported if they allocate
+	uint64_t frameHeapAllocations{ 0 };
+	// Utilization of each job system thread and contention of the profiled mutexes during the last frame, see updateThreadStats
+	struct ThreadFrameStats {
+		// Shares of the frame time
+		float busy{ 0.0f };
+		float asleep{ 0.0f };
+		uint32_t executedJobs{ 0 };
+		uint32_t stolenJobs{ 0 };
+	};
+	std::vector<vks::JobSystem::ThreadStats> threadTotals;
+	std::vector<ThreadFrameStats> threadFrameStats;
+	std::vector<std::string> threadPlotNames;
+	std::chrono::steady_clock::time_point threadStatsTime{};
+	std::vector<vks::LockStats> lockStats;
+	bool steadyStateAllocationReported{ false };
+	// Number of actors the per-actor buffers are created for, doubled (up to what the device limits allow) once there are more actors, see ensureInstanceCapacity
+	uint32_t instanceCapacity{ initialInstanceCapacity };
+	uint32_t maxInstanceCapacity{ initialInstanceCapacity };
+	// Actors beyond the capacity aren't drawn, reported once the count exceeds the max. capacity (and again after it dropped below)
+	bool instanceOverflowReported{ false };
+	// Heap budgets and usage of the last frame, device local heaps are reported once their usage gets close to their budget
+	MemoryBudget memoryBudget{};
+	std::array<bool, VK_MAX_MEMORY_HEAPS> memoryBudgetReported{};
+	// Gives up memory (e.g. texture detail) once device local heaps get close to their budget
+	MemoryBudgetManager memoryBudgetManager{};
+	// Moves textures out of sparsely used memory blocks, so streaming and reloading over long sessions doesn't leave mostly empty blocks behind
+	MemoryDefragmenter* memoryDefragmenter{ nullptr };
+	bool memoryDefragmentation{ true };
+	// Streams the moon's surface from a texture too large to be resident, sampled in place of the moon's base color texture
+	VirtualTexture* virtualTexture{ nullptr };
+	// Asset index of the moon's base color texture, UINT32_MAX until the moon has been loaded
+	uint32_t virtualTextureSource{ UINT32_MAX };
+	// Enough 8x8 pixel feedback tiles for a 4K window, tiles of larger windows don't request pages
+	static constexpr uint32_t maxVirtualTextureFeedback = (3840 / 8) * (2160 / 8);
+	// Plot names need to stay valid for as long as Tracy and the trace recorder reference them
+	std::array<std::string, static_cast<size_t>(MemoryCategory::Count)> hostMemoryPlotNames;
+	std::array<std::string, static_cast<size_t>(MemoryCategory::Count)> deviceMemoryPlotNames;
+	// Parallel command buffer recording, visible actors are split into one secondary command buffer per job
+	uint32_t numRecordingJobs{ 0 };
+	bool parallelRecording{ true };
 public:	
 	Application() : VulkanApplication() {
 		apiVersion = VK_API_VERSION_1_3;
@@ -98,14 +1043,48 @@ public:
 		Device::enabledFeatures.samplerAnisotropy = VK_TRUE;
 		Device::enabledFeatures.depthClamp = VK_TRUE;
 		Device::enabledFeatures.fillModeNonSolid = VK_TRUE;
+		// Fragments write the virtual texture's page requests to a storage buffer
+		Device::enabledFeatures.fragmentStoresAndAtomics = VK_TRUE;
+		// Optional, only needed by the primitives debug view and the visibility buffer to read the primitive ID in the fragment shader
+		Device::enabledFeatures.geometryShader = VK_TRUE;
 
 		Device::enabledFeatures11.multiview = VK_TRUE;
 		Device::enabledFeatures12.descriptorIndexing = VK_TRUE;
 		Device::enabledFeatures12.runtimeDescriptorArray = VK_TRUE;
+		// Material textures are indexed non-uniformly (see texture_arrays.hlsl), always supported along with descriptorIndexing
+		Device::enabledFeatures12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
 		Device::enabledFeatures12.descriptorBindingVariableDescriptorCount = VK_TRUE;
+		// Textures of asynchronously loaded assets are added to the bindless set while it's in use
+		Device::enabledFeatures12.descriptorBindingPartiallyBound = VK_TRUE;
+		Device::enabledFeatures12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		// Update after bind sets come with much higher descriptor limits
+		Device::enabledFeatures12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		Device::enabledFeatures12.drawIndirectCount = VK_TRUE;
+		// Optional, the vertex pulling pipeline is only available if supported
+		Device::enabledFeatures12.bufferDeviceAddress = VK_TRUE;
+		// Optional, shading and post processing stay at full precision if not supported
+		Device::enabledFeatures12.shaderFloat16 = VK_TRUE;
 		Device::enabledFeatures13.dynamicRendering = VK_TRUE;
-
-		settings.sampleCount = VK_SAMPLE_COUNT_4_BIT;
+		// Pipeline variants are looked up in the pipeline cache without compiling them (see PipelineVariantCache::getAsync)
+		Device::enabledFeatures13.pipelineCreationCacheControl = VK_TRUE;
+		// Optional, the mesh shader render path is only available if these are supported
+		Device::enabledMeshShaderFeatures.meshShader = VK_TRUE;
+		Device::enabledMeshShaderFeatures.taskShader = VK_TRUE;
+		// Optional, graphics pipelines are created as a whole if not supported
+		Device::enabledGraphicsPipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+		// Optional, cube map filtering falls back to descriptor sets if not supported
+		Device::enabledDescriptorBufferFeatures.descriptorBuffer = VK_TRUE;
+		// Optional, wireframe rendering is only available if supported
+		Device::enabledExtendedDynamicState3Features.extendedDynamicState3PolygonMode = VK_TRUE;
+		// Optional, everything is shaded at full rate if not supported
+		Device::enabledFragmentShadingRateFeatures.pipelineFragmentShadingRate = VK_TRUE;
+		// Optional, models with few vertices use 16 bit indices if not supported
+		Device::enabledIndexTypeUint8Features.indexTypeUint8 = VK_TRUE;
+		// Optional, sun shadows use the shadow maps if not supported
+		Device::enabledRayQueryFeatures.rayQuery = VK_TRUE;
+
+		// The HDR target isn't multisampled, temporal anti-aliasing can be used instead
+		settings.sampleCount = settings.postProcessing ? VK_SAMPLE_COUNT_1_BIT : VK_SAMPLE_COUNT_4_BIT;
 
 		assetManager = new AssetManager();
 		actorManager = new ActorManager();
@@ -113,13 +1092,160 @@ public:
 
 		ApplicationContext::assetManager = assetManager;
 
+		// The main thread records and submits the frames, so it's kept on the performance cores and scheduled ahead of background threads
+		vks::threading::setCurrentThreadPriority(vks::threading::Priority::High);
+		vks::threading::pinCurrentThreadToPerformanceCores();
+		// Created on the main thread, which becomes the job system's first thread
+		jobSystem = new vks::JobSystem();
+		taskScheduler = new vks::TaskScheduler(*jobSystem);
+		startupProfiler.jobSystem = jobSystem;
+		simulation = new RigidBodySimulation();
+		assetManager->jobSystem = jobSystem;
+		audioManager->jobSystem = jobSystem;
+		textureStreamer = new TextureStreamer(assetManager, { .budget = static_cast<VkDeviceSize>(textureBudgetMB) * 1024 * 1024 });
+		textureStreamer->jobSystem = jobSystem;
+		assetManager->textureStreamer = textureStreamer;
+		// Streamed textures are the cheapest to give up, they drop detail evenly and come back as the budget allows
+		memoryBudgetManager.addReclaimer("Texture streaming", 0,
+			[this](VkDeviceSize bytes) -> VkDeviceSize {
+				const VkDeviceSize minBudget = 32 * 1024 * 1024;
+				const VkDeviceSize current = std::min(textureStreamer->getBudget(), textureStreamer->getResidentMemory());
+				if (current <= minBudget) {
+					return 0;
+				}
+				const VkDeviceSize reduced = current - std::min(current - minBudget, std::max(bytes, current / 4));
+				textureStreamer->setBudget(reduced);
+				return current - reduced;
+			},
+			[this]() {
+				const VkDeviceSize budget = textureStreamer->getBudget();
+				const VkDeviceSize target = static_cast<VkDeviceSize>(textureBudgetMB) * 1024 * 1024;
+				if (budget >= target) {
+					return false;
+				}
+				textureStreamer->setBudget(std::min(target, budget + std::max(budget / 4, VkDeviceSize(16 * 1024 * 1024))));
+				return true;
+			});
+		// Unused models are next, they only come back once they're used again, so there is nothing to restore
+		memoryBudgetManager.addReclaimer("Unused models", 1,
+			[this](VkDeviceSize bytes) -> VkDeviceSize {
+				return assetManager->evictUnusedModels(bytes);
+			},
+			[]() {
+				return false;
+			});
+		memoryDefragmenter = new MemoryDefragmenter(vulkanDevice->memoryAllocator);
+		memoryDefragmenter->addMover([this](const void* block, VkDeviceSize budget, VkCommandBuffer commandBuffer) { return moveTextures(block, budget, commandBuffer); });
+
 		dxcCompiler = new Dxc();
+		startBackgroundLoads();
+	}
+
+	// Without additional worker threads, background jobs would only run once the main thread waits for them, so they're run right away instead
+	vks::Job* runStartupJob(std::function<void()> function)
+	{
+		if (jobSystem->getThreadCount() <= 1) {
+			function();
+			return nullptr;
+		}
+		vks::Job* job = jobSystem->createBackgroundJob(std::move(function));
+		jobSystem->runBackground(job);
+		return job;
+	}
+
+	// Starts reading and decoding everything that doesn't need the device, which is then created in parallel
+	void startBackgroundLoads()
+	{
+#if defined(NDEBUG)
+		// Built by the shader_bundle target, shaders not found in the bundle are still compiled at runtime
+		shaderBundleJob = runStartupJob([this] {
+			StartupProfiler::Scope startupScope("Shader bundle load");
+			const std::filesystem::path shaderBundleFile{ "shaders.spvbundle" };
+			if (std::filesystem::exists(shaderBundleFile)) {
+				try {
+					shaderBundle = new ShaderBundle(shaderBundleFile.string(), getAssetPath() + "shaders/");
+					std::cout << "Loaded " << shaderBundle->size() << " shaders from " << shaderBundleFile << std::endl;
+				}
+				catch (const std::runtime_error& e) {
+					std::cerr << e.what() << ", compiling shaders at runtime" << std::endl;
+				}
+			}
+		});
+#endif
+		skyboxJob = runStartupJob([this, createInfo = getSkyboxCreateInfo()] {
+			StartupProfiler::Scope startupScope("Skybox load");
+			MemoryStats::Scope memoryScope(MemoryCategory::Environment);
+			vks::Texture::loadTextureData(createInfo, skyboxData);
+		});
+		// Models are parsed once the device is known (e.g. meshlets are only built with mesh shader support), but their files are read in the meantime
+		std::vector<std::string> prefetchFiles = {
+			getAssetPath() + placeholderModelFile,
+			getAssetPath() + "textures/brdflut.ktx"
+		};
+		for (auto& it : modelFiles) {
+			prefetchFiles.push_back(getAssetPath() + it.second);
+			prefetchFiles.push_back(getAssetPath() + it.second + ".cache");
+		}
+		// Sounds don't need the device, so they're decoded on the job system right away
+		for (auto& it : soundFiles) {
+			audioManager->loadSoundFileAsync(it.first, getAssetPath() + it.second);
+		}
+		// Reading the files on the main thread wouldn't overlap with anything
+		if (jobSystem->getThreadCount() <= 1) {
+			return;
+		}
+		prefetchJob = runStartupJob([this, prefetchFiles] {
+			StartupProfiler::Scope startupScope("File prefetch");
+			jobSystem->parallelFor(static_cast<uint32_t>(prefetchFiles.size()), 1, [&prefetchFiles](uint32_t first, uint32_t count) {
+				for (uint32_t i = first; i < first + count; i++) {
+					vks::vfs::prefetch(prefetchFiles[i]);
+				}
+			});
+		});
 	}
 
 	~Application() {
+		waitForSimulation();
+		// Loading tasks are run to their end, so none of their resources are left behind half way
+		taskScheduler->waitIdle();
+		delete simulationJob;
+		delete asteroidField;
+		for (vks::Job* job : { shaderBundleJob, skyboxJob, prefetchJob, screenshotJob, snapshotJob }) {
+			if (job) {
+				jobSystem->wait(job);
+				delete job;
+			}
+		}
+		vks::vfs::releasePrefetched();
 		for (FrameObjects& frame : frameObjects) {
 			destroyBaseFrameObjects(frame);
+			delete frame.particleStatsBuffer;
+			delete frame.virtualTextureFeedbackBuffer;
+			delete frame.clusterLightBuffer;
+			delete frame.frameArena;
+			delete frame.upscaleDescriptorSet;
+			delete frame.temporalResolveDescriptorSet;
+			delete frame.visibilityDrawBuffer;
+			delete frame.visibilityDescriptorSet;
+			for (DescriptorSet* descriptorSet : frame.bloomDescriptorSets) {
+				delete descriptorSet;
+			}
+		}
+		destroyInstanceBuffers();
+		for (RayQueryShadows::ModelStructures& structures : rayQueryShadows.models) {
+			for (AccelerationStructure* accelerationStructure : structures.lods) {
+				delete accelerationStructure;
+			}
 		}
+		delete readbackBuffer;
+		delete simulationDescriptorSetLayout;
+		delete particleBuffer;
+		delete particleListBuffer;
+		delete particleCounterBuffer;
+		delete particleDescriptorSetLayout;
+		delete lightCullDescriptorSetLayout;
+		destroyShadowMap(shadows.staticMap);
+		destroyShadowMap(shadows.dynamicMap);
 		if (fileWatcher) {
 			fileWatcher->stop();
 			delete fileWatcher;
@@ -127,41 +1253,172 @@ public:
 		for (auto& it : pipelines) {
 			delete it.second;
 		}
+		delete pipelineVariants;
+		delete skinnedPipelineCreateInfo;
+		// Parts may still be used by the background linking of pipelines, so the library is destroyed after all pipelines
+		delete pipelineLibrary;
+		delete pipelineLayoutCache;
 		delete descriptorPool;
 		delete descriptorSetLayout;
+		delete textureDescriptorPool;
+		delete descriptorSetLayoutTextures;
+		// Deferred model deletions release texture slots of the asset manager
+		vulkanDevice->waitIdle();
+		flushDeletionQueue(UINT64_MAX);
+		// Model loading jobs may add streamed textures, so these need to finish first
+		assetManager->waitIdle();
+		audioManager->waitIdle();
+		// Waits for background loading jobs, so needs to be deleted before the job system
+		// Textures of models deleted by the asset manager are no longer streamed by then
+		assetManager->textureStreamer = nullptr;
+		delete textureStreamer;
+		delete memoryDefragmenter;
+		// Removes the page table and the cache from the asset manager
+		delete virtualTexture;
 		delete assetManager;
+		delete taskScheduler;
+		delete jobSystem;
+		delete simulation;
+		delete bulletPool;
 		delete actorManager;
-
-		// @todo: move to manager class
-		if (backgroundMusic.Playing) {
-			backgroundMusic.stop();
-		}
+		delete meshletDescriptorSetLayout;
+		destroyDepthPyramid(depthPyramid);
+		delete depthReduceUpdateTemplate;
+		delete depthReduceDescriptorSetLayout;
+		delete upscaleDescriptorPool;
+		delete upscaleDescriptorSetLayout;
+		destroyTemporalHistory(temporalHistory);
+		delete temporalResolveDescriptorPool;
+		delete temporalResolveDescriptorSetLayout;
+		delete visibility.bins;
+		delete visibility.pixels;
+		delete visibility.descriptorPool;
+		delete visibility.descriptorSetLayout;
+		delete bloomDescriptorPool;
+		delete bloomDescriptorSetLayout;
 		delete audioManager;
+		delete shaderBundle;
+		shaderBundle = nullptr;
 	}
 
 	void loadAssets() {
-		const std::map<std::string, std::string> files = {
-			{ "crate", "models/crate_up.glb" },
-			{ "asteroid", "models/asteroid.glb" },
-			{ "moon", "models/moon.gltf" },
-			{ "spaceship", "models/spaceship/scene_ktx.gltf" },
-			{ "bullet", "models/bullet.glb" }
-		};
+		StartupProfiler::Scope startupScope("Asset setup");
+		// Textures created below are accounted to their own categories
+		MemoryStats::Scope memoryScope(MemoryCategory::Models);
+		// Models are loaded in the background, the crate is used as a placeholder until they're ready
+		const std::string placeholderFilename = getAssetPath() + placeholderModelFile;
+
+		// The uploads of all assets created here are submitted together, models loaded in the background batch their own uploads
+		UploadBatch uploadBatch;
 
 		// @todo: from JSON?
 		const bool hotReload = true;
-		for (auto& it : files) {
+		crateModel = assetManager->add("crate", new vkglTF::Model({
+			.filename = placeholderFilename,
+			.vertexLayout = modelVertexLayout,
+			.enableHotReload = hotReload,
+			.uploadBatch = &uploadBatch
+		}));
+		fileWatcher->addFile(placeholderFilename, assetManager->getModel(crateModel));
+
+		// Actors refer to the model's slot, so they use the new model as soon as it has been swapped in
+		assetManager->onModelLoaded = [this](ModelHandle handle, vkglTF::Model* placeholder, vkglTF::Model* model) {
+			frameTimeRecorder.addEvent("Asset load " + assetManager->getModelName(handle));
+			for (uint32_t i = 0; i < actorManager->size(); i++) {
+				if (actorManager->models[i] == handle) {
+					// Updates the bounding radius
+					actorManager->setScale(i, actorManager->scales[i]);
+				}
+			}
+			// The impostor atlases show the placeholder
+			if (handle.index() < impostors.size()) {
+				impostors[handle.index()].model = nullptr;
+			}
+			releaseModelAccelerationStructures(handle.index());
+			// The virtual texture replaces the moon's base color texture, the placeholder's textures are never sampled through it
+			if (assetManager->getModelName(handle) == "moon") {
+				for (const vkglTF::Material& material : model->materials) {
+					if (material.baseColorTexture) {
+						virtualTextureSource = material.baseColorTexture->assetIndex;
+						break;
+					}
+				}
+			}
+			// The placeholder's buffers may still be in use by frames in flight
+			deferDeletion([placeholder] { delete placeholder; });
+		};
+		// Models no actor uses are evicted under memory pressure and loaded again once an actor uses them, with the crate in their slot until then
+		assetManager->createPlaceholder = [this, placeholderFilename](ModelHandle) {
+			return new vkglTF::Model({ .filename = placeholderFilename, .vertexLayout = modelVertexLayout });
+		};
+		assetManager->onModelEvicted = [this](ModelHandle handle, vkglTF::Model* model) {
+			frameTimeRecorder.addEvent("Asset eviction " + assetManager->getModelName(handle));
+			if (handle.index() < impostors.size()) {
+				impostors[handle.index()].model = nullptr;
+			}
+			releaseModelAccelerationStructures(handle.index());
+			if (assetManager->getModelName(handle) == "moon") {
+				virtualTextureSource = UINT32_MAX;
+			}
+			deferDeletion([model] { delete model; });
+		};
+		textureStreamer->onTextureRetired = [this](vks::Texture* texture) {
+			deferDeletion([texture] {
+				texture->destroy();
+				delete texture;
+			});
+		};
+		for (auto& it : modelFiles) {
 			const std::string filename = getAssetPath() + it.second;
-			auto model = assetManager->add(it.first, new vkglTF::Model({
+			// Each model gets its own placeholder, as the placeholder is handed over once the model is ready
+			const ModelHandle handle = assetManager->loadAsync(it.first, {
 				.filename = filename,
+				.vertexLayout = modelVertexLayout,
+				.optimizeMeshes = true,
+				.lodCount = modelLodCount,
+				.useCache = true,
+				.meshletDescriptorSetLayout = meshletDescriptorSetLayout ? meshletDescriptorSetLayout->handle : VK_NULL_HANDLE,
 				.enableHotReload = hotReload
-			}));
-			fileWatcher->addFile(filename, model);
+			}, new vkglTF::Model({ .filename = placeholderFilename, .vertexLayout = modelVertexLayout, .uploadBatch = &uploadBatch }));
+			fileWatcher->addFile(filename, assetManager->getModel(handle));
 		}
+		bulletModel = assetManager->findModel("bullet");
+		bulletTag = actorManager->getTag("bullet");
+		asteroidTag = actorManager->getTag("asteroid");
 
 		// Additional textures
 		// @todo
-		skyboxIndex = assetManager->add("skybox", new vks::TextureCubeMap({
+		// The environment cubemaps start out as single texel placeholders, see loadEnvironment
+		skyboxIndex = assetManager->add("skybox", createPlaceholderCubemap(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), &uploadBatch));
+		skybox.irradianceIndex = assetManager->add("skybox_irradiance", createPlaceholderCubemap(glm::vec4(0.05f, 0.05f, 0.05f, 1.0f), &uploadBatch));
+		skybox.radianceIndex = assetManager->add("skybox_radiance", createPlaceholderCubemap(glm::vec4(0.05f, 0.05f, 0.05f, 1.0f), &uploadBatch));
+
+		{
+			MemoryStats::Scope environmentMemoryScope(MemoryCategory::Environment);
+			skybox.brdfLUT = assetManager->add("brdflut", new vks::Texture2D({
+				.filename = getAssetPath() + "textures/brdflut.ktx",
+				.format = VK_FORMAT_R8G8B8A8_SRGB,
+				.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+				.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+				.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+				.uploadBatch = &uploadBatch
+			}));
+		}
+		uploadBatch.submit();
+
+		// Audio, sounds are still being decoded on the job system (see startBackgroundLoads) but their handles are valid
+		laserSound = audioManager->findSound("laser");
+		// Optional, impacts stay silent if no sound of that name is listed in soundFiles
+		impactSound = audioManager->findSound("impact");
+		// Impacts are positioned and fade out with distance, so only those close to the camera take up voices
+		audioManager->setSoundProperties(impactSound, { .minDistance = 25.0f, .attenuation = 1.0f, .maxVoices = 8 });
+		audioManager->setSoundProperties(laserSound, { .maxVoices = 4 });
+	}
+
+	vks::TextureCreateInfo getSkyboxCreateInfo()
+	{
+		return {
+			// Also part of the key for the prefiltered cubemaps' cache, see generateCubemaps
 			.filename = getAssetPath() + "textures/space01.ktx",
 			//.filename = getAssetPath() + "textures/cubemap01.ktx",
 			//.format = VK_FORMAT_R8G8B8A8_SRGB,
@@ -169,34 +1426,496 @@ public:
 			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
 			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
 			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE
-		}));
+		};
+	}
 
-		skybox.brdfLUT = assetManager->add("brdflut", new vks::Texture2D({
-			.filename = getAssetPath() + "textures/brdflut.ktx",
-			.format = VK_FORMAT_R8G8B8A8_SRGB,
-			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE
-		}));
+	// Single texel cubemap of one color, stands in for an environment cubemap that isn't resident yet
+	vks::TextureCubeMap* createPlaceholderCubemap(const glm::vec4& color, UploadBatch* uploadBatch)
+	{
+		MemoryStats::Scope memoryScope(MemoryCategory::Environment);
+		const glm::uvec2 texel{ glm::packHalf2x16(glm::vec2(color.r, color.g)), glm::packHalf2x16(glm::vec2(color.b, color.a)) };
+		vks::TextureData textureData;
+		textureData.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		textureData.width = 1;
+		textureData.height = 1;
+		textureData.faceCount = 6;
+		for (uint32_t face = 0; face < 6; face++) {
+			textureData.offsets.push_back(textureData.data.size());
+			textureData.sizes.push_back(sizeof(texel));
+			textureData.data.insert(textureData.data.end(), reinterpret_cast<const uint8_t*>(&texel), reinterpret_cast<const uint8_t*>(&texel) + sizeof(texel));
+		}
+		vks::TextureCreateInfo createInfo = getSkyboxCreateInfo();
+		createInfo.uploadBatch = uploadBatch;
+		return new vks::TextureCubeMap(textureData, createInfo);
+	}
+
+	// Replaces a texture that may still be used by frames in flight
+	void replaceTexture(uint32_t index, vks::Texture* texture)
+	{
+		vks::Texture* replacedTexture = assetManager->setTexture(index, texture);
+		deferDeletion([replacedTexture] {
+			replacedTexture->destroy();
+			delete replacedTexture;
+		});
+	}
+
+	// Moves textures placed in a memory block that's being emptied, the copies replace them in their asset manager slots so the bindless descriptors are updated like for streamed textures
+	// Only textures whose transfer upload has completed are moved, the ones without an upload value (e.g. mip chains generated by a batch that may not have been submitted yet) stay where they are
+	// Nothing is moved while the environment is generated, as that binds the skybox outside of the bindless descriptors
+	VkDeviceSize moveTextures(const void* block, VkDeviceSize budget, VkCommandBuffer commandBuffer)
+	{
+		if (!environmentReady) {
+			return 0;
+		}
+		std::vector<std::pair<uint32_t, vks::Texture*>> candidates;
+		{
+			std::lock_guard<std::mutex> lock(assetManager->textureMutex);
+			for (uint32_t i = 0; i < static_cast<uint32_t>(assetManager->textures.size()); i++) {
+				vks::Texture* texture = assetManager->textures[i];
+				if (texture && (texture->allocation.block == block) && (texture->uploadTimelineValue > 0) && VulkanContext::stagingBuffer->isComplete(texture->uploadTimelineValue)) {
+					candidates.push_back({ i, texture });
+				}
+			}
+		}
+		VkDeviceSize moved = 0;
+		for (auto& [index, texture] : candidates) {
+			if (moved >= budget) {
+				break;
+			}
+			vks::Texture* copy = texture->createCopy(commandBuffer);
+			if (!copy) {
+				continue;
+			}
+			moved += texture->allocation.size;
+			replaceTexture(index, copy);
+		}
+		return moved;
+	}
+
+	// Turns the job system's totals into shares of the last frame and collects the lock contention since the previous frame, both are also published to Tracy and the trace recorder
+	// Only allocates on the first call, so it doesn't count against steady state frames
+	void updateThreadStats()
+	{
+		const uint32_t threadCount = jobSystem->getThreadCount();
+		const auto now = std::chrono::steady_clock::now();
+		if (threadTotals.empty()) {
+			for (uint32_t i = 0; i < threadCount; i++) {
+				threadTotals.push_back(jobSystem->getThreadStats(i));
+				threadPlotNames.push_back((i == 0) ? std::string("Main thread busy") : "Worker " + std::to_string(i) + " busy");
+			}
+			threadFrameStats.resize(threadCount);
+			lockStats.reserve(64);
+			threadStatsTime = now;
+			return;
+		}
+		const double frameNanoseconds = std::max(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - threadStatsTime).count()), 1.0);
+		threadStatsTime = now;
+		for (uint32_t i = 0; i < threadCount; i++) {
+			const vks::JobSystem::ThreadStats totals = jobSystem->getThreadStats(i);
+			ThreadFrameStats& stats = threadFrameStats[i];
+			stats.busy = static_cast<float>(static_cast<double>((totals.busyTime - threadTotals[i].busyTime).count()) / frameNanoseconds);
+			stats.asleep = static_cast<float>(static_cast<double>((totals.sleepTime - threadTotals[i].sleepTime).count()) / frameNanoseconds);
+			stats.executedJobs = static_cast<uint32_t>(totals.executedJobs - threadTotals[i].executedJobs);
+			stats.stolenJobs = static_cast<uint32_t>(totals.stolenJobs - threadTotals[i].stolenJobs);
+			threadTotals[i] = totals;
+			TracyPlot(threadPlotNames[i].c_str(), static_cast<double>(stats.busy));
+			traceRecorder.addCounter(threadPlotNames[i].c_str(), static_cast<double>(stats.busy));
+		}
+		vks::ProfiledMutex::collect(lockStats);
+		double lockWait = 0.0;
+		for (const vks::LockStats& stats : lockStats) {
+			lockWait += std::chrono::duration<double, std::milli>(stats.waitTime).count();
+		}
+		TracyPlot("Lock wait (ms)", lockWait);
+		traceRecorder.addCounter("Lock wait (ms)", lockWait);
+	}
+
+	// Swaps the skybox and the filtered cubemaps in for their placeholders once the skybox has been loaded
+	// Publishes memory usage per category and heap to Tracy and the trace recorder, and reports device local heaps getting close to their budget
+	void updateMemoryStats()
+	{
+		if (hostMemoryPlotNames[0].empty()) {
+			for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); i++) {
+				hostMemoryPlotNames[i] = std::string("Host memory: ") + MemoryStats::getCategoryName(static_cast<MemoryCategory>(i));
+				deviceMemoryPlotNames[i] = std::string("Device memory: ") + MemoryStats::getCategoryName(static_cast<MemoryCategory>(i));
+			}
+		}
+		for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); i++) {
+			const int64_t hostBytes = memoryStats.getHostBytes(static_cast<MemoryCategory>(i));
+			const int64_t deviceBytes = memoryStats.getDeviceBytes(static_cast<MemoryCategory>(i));
+			TracyPlot(hostMemoryPlotNames[i].c_str(), hostBytes);
+			TracyPlot(deviceMemoryPlotNames[i].c_str(), deviceBytes);
+			traceRecorder.addCounter(hostMemoryPlotNames[i].c_str(), static_cast<double>(hostBytes));
+			traceRecorder.addCounter(deviceMemoryPlotNames[i].c_str(), static_cast<double>(deviceBytes));
+		}
+		memoryBudget = vulkanDevice->getMemoryBudget();
+		for (uint32_t i = 0; i < memoryBudget.heapCount; i++) {
+			const MemoryHeapBudget& heap = memoryBudget.heaps[i];
+			if (!heap.deviceLocal) {
+				continue;
+			}
+			// Reported again if the usage drops well below the budget and rises again
+			const bool overBudget = heap.usage > heap.budget / 10 * 9;
+			if (overBudget && !memoryBudgetReported[i]) {
+				const std::string message = "Device local heap " + std::to_string(i) + " is at " + std::to_string(heap.usage / (1024 * 1024)) + " of " + std::to_string(heap.budget / (1024 * 1024)) + " MB budget";
+				std::cerr << message << "\n";
+				TracyMessage(message.c_str(), message.size());
+				memoryBudgetReported[i] = true;
+			} else if (heap.usage < heap.budget / 10 * 8) {
+				memoryBudgetReported[i] = false;
+			}
+		}
+		memoryBudgetManager.update(memoryBudget);
+	}
+
+	// Waits for the skybox and filters the environment cubemaps from it, frames are rendered with the placeholders in the meantime
+	vks::Task loadEnvironment()
+	{
+		if (skyboxJob) {
+			co_await taskScheduler->wait(skyboxJob);
+			delete skyboxJob;
+			skyboxJob = nullptr;
+		}
+		const vks::TextureCreateInfo createInfo = getSkyboxCreateInfo();
+		vks::TextureCubeMap* cubemap{ nullptr };
+		{
+			MemoryStats::Scope memoryScope(MemoryCategory::Environment);
+			cubemap = new vks::TextureCubeMap(skyboxData, createInfo);
+		}
+		skyboxData = {};
+		replaceTexture(skyboxIndex, cubemap);
+		// Cubemap generation reads the skybox outside of the frame loop, so the upload needs to be available right away
+		VulkanContext::stagingBuffer->flushTransfers(queue);
+		co_await generateCubemaps(cubemap, createInfo.filename);
+		if (settings.shIrradiance) {
+			MemoryStats::Scope memoryScope(MemoryCategory::Environment);
+			generateIrradianceSH(cubemap);
+		}
+		environmentReady = true;
+		frameTimeRecorder.addEvent("Environment load");
+	}
 
-		// Audio
-		const std::map<std::string, std::string> soundFiles = {
-			{ "laser", "sounds/laser1.mp3" }
+	// All shaders used with the glTF pipeline layout, including the ones of pipelines that aren't created on all devices (e.g. vertex pulling), so the layout is the same everywhere
+	std::vector<ShaderReference> getGlTFShaders()
+	{
+		const std::string shaderPath = getAssetPath() + "shaders/";
+		std::vector<ShaderReference> shaders = {
+			{ shaderPath + "gltf.vert.hlsl" },
+			{ shaderPath + "gltf.vert.hlsl", { "SKINNED" } },
+			{ shaderPath + "gltf_instanced.vert.hlsl" },
+			{ shaderPath + "gltf_pulled.vert.hlsl" },
+			{ shaderPath + "visibility.vert.hlsl" },
+			{ shaderPath + "depth.vert.hlsl" },
+			{ shaderPath + "depth_instanced.vert.hlsl" },
+			{ shaderPath + "playership.vert.hlsl" },
+			{ shaderPath + "gltf.frag.hlsl" },
+			{ shaderPath + "visibility.frag.hlsl" },
+			{ shaderPath + "impostor.vert.hlsl" },
+			{ shaderPath + "impostor.frag.hlsl" },
+			{ shaderPath + "impostor_bake.frag.hlsl" },
+			{ shaderPath + "skybox.vert.hlsl" },
+			{ shaderPath + "skybox_fullscreen.vert.hlsl" },
+			{ shaderPath + "skybox.frag.hlsl" }
 		};
+		if (vulkanDevice->hasRayQuery) {
+			shaders.push_back({ shaderPath + "gltf.frag.hlsl", { "RAY_QUERY" } });
+		}
+		return shaders;
+	}
 
-		for (auto& it : soundFiles) {
-			audioManager->AddSoundFile(it.first, getAssetPath() + it.second);
+	std::vector<ShaderReference> getMeshShadingShaders()
+	{
+		const std::string shaderPath = getAssetPath() + "shaders/";
+		return {
+			{ shaderPath + "gltf.task.hlsl" },
+			{ shaderPath + "gltf.mesh.hlsl" },
+			{ shaderPath + "gltf.frag.hlsl" }
+		};
+	}
+
+	// Asteroids per square unit at a distance from the moon, each ring has its count spread evenly over its area
+	static float getAsteroidDensity(float distance)
+	{
+		for (const AsteroidRing& ring : asteroidRings) {
+			if ((distance >= ring.innerRadius) && (distance < ring.outerRadius)) {
+				return static_cast<float>(ring.count) / (static_cast<float>(M_PI) * (ring.outerRadius * ring.outerRadius - ring.innerRadius * ring.innerRadius));
+			}
+		}
+		return asteroidBackgroundDensity;
+	}
+
+	// Runs on a worker, only depends on the seed so a sector always contains the same rocks
+	static void generateAsteroidSector(glm::ivec2 coord, uint64_t seed, ModelHandle model, AsteroidSector& sector)
+	{
+		const glm::vec2 origin = glm::vec2(coord) * asteroidSectorSize;
+		// Highest density found anywhere in the sector, from the range of distances its area covers
+		const float minDistance = glm::length(glm::clamp(glm::vec2(0.0f), origin, origin + asteroidSectorSize));
+		const float maxDistance = glm::length(glm::max(glm::abs(origin), glm::abs(origin + asteroidSectorSize)));
+		float maxDensity = asteroidBackgroundDensity;
+		for (const AsteroidRing& ring : asteroidRings) {
+			if ((ring.outerRadius > minDistance) && (ring.innerRadius < maxDistance)) {
+				maxDensity = std::max(maxDensity, getAsteroidDensity(ring.innerRadius));
+			}
 		}
+		std::default_random_engine rndGenerator(static_cast<unsigned>(seed ^ (seed >> 32)));
+		std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
+		// Candidates are spread evenly at the highest density and kept with the ratio of the density at their position, so ring borders crossing the sector stay sharp
+		const uint32_t candidateCount = static_cast<uint32_t>(maxDensity * asteroidSectorSize * asteroidSectorSize + uniformDist(rndGenerator));
+		sector.createInfos.reserve(candidateCount);
+		for (uint32_t i = 0; i < candidateCount; i++) {
+			const glm::vec2 position = origin + glm::vec2(uniformDist(rndGenerator), uniformDist(rndGenerator)) * asteroidSectorSize;
+			if (uniformDist(rndGenerator) * maxDensity >= getAsteroidDensity(glm::length(position))) {
+				continue;
+			}
+			// Initializers of a braced list are evaluated in order, so the values are drawn in the same order on all compilers
+			sector.createInfos.push_back({
+				.position = glm::vec3(position.x, uniformDist(rndGenerator) * 16.0f, position.y),
+				.rotation = glm::vec3(360.0f * uniformDist(rndGenerator), 360.0f * uniformDist(rndGenerator), 360.0f * uniformDist(rndGenerator)),
+				.scale = glm::vec3(5.0f + uniformDist(rndGenerator) * 2.5f - uniformDist(rndGenerator) * 2.5f),
+				.model = model,
+				.tag = "asteroid",
+				.variation = asteroidVariation,
+				.variationSeed = uniformDist(rndGenerator)
+			});
+		}
+	}
+
+	// Buffers with an element per actor, sized for instanceCapacity and recreated once it grows (see ensureInstanceCapacity)
+	// The frame allocators are part of these, as the instances and the actor transform uploads are carved from them
+	void createInstanceBuffers()
+	{
+		// Buffers accessed by the async compute passes are shared with the compute queue family, concurrent sharing avoids ownership transfers
+		const std::vector<uint32_t> sharedQueueFamilies = getSharedQueueFamilies();
+		const VkSharingMode sharingMode = sharedQueueFamilies.empty() ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT;
+		for (FrameObjects& frame : frameObjects) {
+			MemoryStats::Scope memoryScope(MemoryCategory::FrameData);
+			// Instance matrices are also written by the culling compute shader, so the allocator needs to be a storage buffer
+			// Also the source of the actor transform uploads, which need room for all actors in case all of them changed
+			// Shadow views get their own instances, as their casters are culled into separate draws
+			frame.frameAllocator = new FrameAllocator({
+				.name = "Frame allocator",
+				.size = sizeof(InstanceData) * instanceCapacity * (1 + shadowViewCount) + sizeof(glm::mat4) * maxJointMatrices + sizeof(ActorTransform) * instanceCapacity + frameAllocatorReserve,
+				.usageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				.queueFamilyIndices = sharedQueueFamilies
+			});
+			frame.cullActorBuffer = new Buffer({
+				.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				.size = sizeof(CullActor) * instanceCapacity,
+				.sharingMode = sharingMode,
+				.queueFamilyIndices = sharedQueueFamilies,
+				.memoryUsage = BufferMemoryUsage::HostWriteDeviceRead
+			});
+			// Always bound to the culling shader, but only written (and sized for all actors) with ray query support
+			VkBufferUsageFlags rayInstanceUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			if (vulkanDevice->hasRayQuery) {
+				rayInstanceUsage |= VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+			}
+			frame.rayInstanceBuffer = new Buffer({
+				.name = "Ray query instances",
+				.usageFlags = rayInstanceUsage,
+				.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				.size = sizeof(VkAccelerationStructureInstanceKHR) * (vulkanDevice->hasRayQuery ? instanceCapacity : 1),
+				.map = false,
+				.sharingMode = sharingMode,
+				.queueFamilyIndices = sharedQueueFamilies
+			});
+			if (vulkanDevice->hasRayQuery) {
+				const VkAccelerationStructureGeometryKHR instanceGeometry{
+					.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+					.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+					.geometry = {.instances = {
+						.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+						.arrayOfPointers = VK_FALSE,
+						.data = {.deviceAddress = frame.rayInstanceBuffer->deviceAddress }
+					}},
+					.flags = VK_GEOMETRY_OPAQUE_BIT_KHR
+				};
+				// Rebuilt or updated every frame, so building fast matters more than tracing fast
+				frame.topLevelAS = new AccelerationStructure({
+					.name = "Actor top level acceleration structure",
+					.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+					.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR,
+					.geometries = { instanceGeometry },
+					.maxPrimitiveCounts = { instanceCapacity },
+					.queueFamilyIndices = sharedQueueFamilies
+				});
+			}
+			frame.bodyBuffer = new Buffer({
+				.name = "Simulation bodies",
+				.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				.size = sizeof(SimulationBody) * instanceCapacity,
+				.map = false,
+				.sharingMode = sharingMode,
+				.queueFamilyIndices = sharedQueueFamilies
+			});
+		}
+		// All actors start as not visible, so the first frame draws everything in the late phase
+		actorVisibilityBuffer = new Buffer({
+			.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.size = sizeof(uint32_t) * instanceCapacity,
+			.sharingMode = sharingMode,
+			.queueFamilyIndices = sharedQueueFamilies
+		});
+		memset(actorVisibilityBuffer->mapped, 0, sizeof(uint32_t) * instanceCapacity);
+		actorTransformBuffer = new DirtyRangeBuffer({
+			.name = "Actor transforms",
+			.elementSize = sizeof(ActorTransform),
+			.capacity = instanceCapacity,
+			.frameCount = getFrameCount(),
+			.sharingMode = sharingMode,
+			.queueFamilyIndices = sharedQueueFamilies
+		});
+		actorTransforms.reserve(instanceCapacity);
+		// Initial state, only copied to the device when the simulation (re)starts
+		bodyUploadBuffer = new Buffer({
+			.usageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.size = sizeof(SimulationBody) * instanceCapacity,
+		});
+	}
+
+	void destroyInstanceBuffers()
+	{
+		for (FrameObjects& frame : frameObjects) {
+			delete frame.frameAllocator;
+			delete frame.cullActorBuffer;
+			delete frame.rayInstanceBuffer;
+			delete frame.topLevelAS;
+			delete frame.bodyBuffer;
+			frame.rayInstanceBuffer = nullptr;
+			frame.topLevelAS = nullptr;
+		}
+		delete actorVisibilityBuffer;
+		delete actorTransformBuffer;
+		delete bodyUploadBuffer;
+	}
+
+	// Bindings of the instance buffers and of the frame allocator, added to descriptorWrites (which needs to be flushed by the caller)
+	void writeInstanceDescriptors()
+	{
+		for (uint32_t i = 0; i < getFrameCount(); i++) {
+			FrameObjects& frame = frameObjects[i];
+			const FrameObjects& previousFrame = frameObjects[(i + getFrameCount() - 1) % getFrameCount()];
+			const VkDescriptorBufferInfo uniformDescriptor = frame.frameAllocator->getDescriptor(sizeof(ShaderData));
+			const VkDescriptorBufferInfo instanceDescriptor = frame.frameAllocator->getDescriptor(sizeof(InstanceData) * instanceCapacity);
+			const VkDescriptorBufferInfo jointDescriptor = frame.frameAllocator->getDescriptor(sizeof(glm::mat4) * maxJointMatrices);
+			const VkDescriptorBufferInfo lightDescriptor = frame.frameAllocator->getDescriptor(sizeof(ClusterLight) * maxLights);
+			const VkDescriptorBufferInfo emitterDescriptor = frame.frameAllocator->getDescriptor(sizeof(ParticleEmitter) * maxParticleEmitters);
+			descriptorWrites.addBuffers(frame.descriptorSet->handle, 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &uniformDescriptor);
+			descriptorWrites.addBuffers(frame.descriptorSet->handle, 1, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, &instanceDescriptor);
+			descriptorWrites.addBuffers(frame.descriptorSet->handle, 3, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, &jointDescriptor);
+			descriptorWrites.addBuffers(frame.descriptorSet->handle, 4, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, &lightDescriptor);
+			descriptorWrites.addBuffers(frame.cullDescriptorSet->handle, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &frame.cullActorBuffer->descriptor);
+			descriptorWrites.addBuffers(frame.cullDescriptorSet->handle, 4, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, &instanceDescriptor);
+			descriptorWrites.addBuffers(frame.cullDescriptorSet->handle, 5, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &actorVisibilityBuffer->descriptor);
+			descriptorWrites.addBuffers(frame.cullDescriptorSet->handle, 7, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &uniformDescriptor);
+			descriptorWrites.addBuffers(frame.cullDescriptorSet->handle, 8, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &frame.bodyBuffer->descriptor);
+			descriptorWrites.addBuffers(frame.cullDescriptorSet->handle, 9, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &actorTransformBuffer->getBuffer(i)->descriptor);
+			descriptorWrites.addBuffers(frame.cullDescriptorSet->handle, 10, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &frame.rayInstanceBuffer->descriptor);
+			descriptorWrites.addBuffers(frame.simulationDescriptorSet->handle, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &previousFrame.bodyBuffer->descriptor);
+			descriptorWrites.addBuffers(frame.simulationDescriptorSet->handle, 1, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &frame.bodyBuffer->descriptor);
+			descriptorWrites.addBuffers(frame.particleDescriptorSet->handle, 3, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, &emitterDescriptor);
+			descriptorWrites.addBuffers(frame.lightCullDescriptorSet->handle, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, &lightDescriptor);
+			// Acceleration structures are passed through an extension structure, which the write batch doesn't support
+			if (frame.topLevelAS) {
+				VkWriteDescriptorSetAccelerationStructureKHR accelerationStructureWrite{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+					.accelerationStructureCount = 1,
+					.pAccelerationStructures = &frame.topLevelAS->handle
+				};
+				const VkWriteDescriptorSet descriptorWrite{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.pNext = &accelerationStructureWrite,
+					.dstSet = frame.descriptorSet->handle,
+					.dstBinding = 8,
+					.descriptorCount = 1,
+					.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR
+				};
+				vkUpdateDescriptorSets(*vulkanDevice, 1, &descriptorWrite, 0, nullptr);
+			}
+		}
+	}
+
+	/**
+	* Recreates the per-actor buffers with twice their capacity once there are more actors than fit into them
+	* Waits for the device to become idle, so this is meant for the rare occasion of a scene outgrowing its buffers (reported as a hitch)
+	* Needs to be called before anything of the frame has been allocated from its frame allocator, and while the simulation isn't running
+	*/
+	void ensureInstanceCapacity()
+	{
+		const uint32_t actorCount = actorManager->size();
+		if ((actorCount <= instanceCapacity) || (instanceCapacity >= maxInstanceCapacity)) {
+			return;
+		}
+		uint32_t capacity = instanceCapacity;
+		while ((capacity < actorCount) && (capacity < maxInstanceCapacity)) {
+			capacity = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(capacity) * 2, maxInstanceCapacity));
+		}
+		vulkanDevice->waitIdle();
+		destroyInstanceBuffers();
+		instanceCapacity = capacity;
+		createInstanceBuffers();
+		writeInstanceDescriptors();
+		descriptorWrites.flush();
+		actorManager->reserve(instanceCapacity);
+		// Command buffers recorded with the rewritten sets can't be executed anymore
+		for (FrameObjects& frame : frameObjects) {
+			frame.skyboxKey = 0;
+		}
+		// The bodies and the top level acceleration structures start over from the actors' current state
+		gpuSimulationRunning = false;
+		rayQueryShadows.rebuild = true;
+		frameTimeRecorder.addEvent("Instance capacity growth");
+		std::cout << "Instance capacity grown to " << instanceCapacity << " for " << actorCount << " actors\n";
 	}
 
 	void prepare() {
+		StartupProfiler::Scope startupScope("Application preparation");
+		// Pipelines (starting with the overlay's) look up their shaders in the bundle
+		if (shaderBundleJob) {
+			jobSystem->wait(shaderBundleJob);
+			delete shaderBundleJob;
+			shaderBundleJob = nullptr;
+		}
 		VulkanApplication::prepare();
+		sceneColorFormat = settings.postProcessing ? VK_FORMAT_R16G16B16A16_SFLOAT : swapChain->colorFormat;
 
 		fileWatcher = new FileWatcher();
+		pipelineLayoutCache = new PipelineLayoutCache();
 
-		loadAssets();
+		// Models are loaded with meshlets if mesh shaders are supported, which are then read via this layout in the task and mesh shaders
+		if (vulkanDevice->hasMeshShaders) {
+			meshletDescriptorSetLayout = new DescriptorSetLayout({
+				.shaders = getMeshShadingShaders(),
+				.set = 2
+			});
+		}
 
-		generateCubemaps(static_cast<vks::TextureCubeMap*>(assetManager->textures[skyboxIndex]));
+		// Models add their materials on upload
+		assetManager->createMaterialBuffer(maxMaterials);
+		// All models share one vertex and index buffer, so switching models between draws doesn't rebind buffers
+		assetManager->createGeometryPool({
+			.vertexStride = static_cast<uint32_t>((modelVertexLayout == vkglTF::VertexLayout::Compact) ? sizeof(vkglTF::CompactVertex) : sizeof(vkglTF::Vertex)),
+			.storageVertices = (meshletDescriptorSetLayout != nullptr),
+			// Bottom level acceleration structures are built from the pooled geometry on the culling pass' queue
+			.accelerationStructureInput = vulkanDevice->hasRayQuery,
+			.sharedQueueFamilies = vulkanDevice->hasRayQuery ? getSharedQueueFamilies() : std::vector<uint32_t>{}
+		});
+		loadAssets();
+		if (settings.virtualTexture.empty() && vks::vfs::exists(getAssetPath() + "textures/moon_virtual.ktx2")) {
+			settings.virtualTexture = "textures/moon_virtual.ktx2";
+		}
+		if (!settings.virtualTexture.empty()) {
+			virtualTexture = new VirtualTexture(assetManager, { .filename = getAssetPath() + settings.virtualTexture, .frameCount = getFrameCount() });
+			virtualTexture->jobSystem = jobSystem;
+			if (!virtualTexture->isValid()) {
+				delete virtualTexture;
+				virtualTexture = nullptr;
+			}
+		}
 
 		// @todo: move camera out of vulkanapplication (so we can have multiple cameras)
 		camera.type = Camera::CameraType::firstperson;
@@ -208,48 +1927,402 @@ public:
 		//playerShip.localPosition = { 0.0f, 0.0f, 0.0f };
 		//playerShip.localRotation = { 0.0f, 0.0f, 0.0f };
 
+		numRecordingJobs = jobSystem->getThreadCount();
+
+		// Buffers accessed by the async compute passes are shared with the compute queue family, concurrent sharing avoids ownership transfers
+		const std::vector<uint32_t> sharedQueueFamilies = getSharedQueueFamilies();
+		const VkSharingMode sharingMode = sharedQueueFamilies.empty() ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT;
 		frameObjects.resize(getFrameCount());
 		for (FrameObjects& frame : frameObjects) {
+			MemoryStats::Scope memoryScope(MemoryCategory::FrameData);
 			createBaseFrameObjects(frame);
+			// The cached skybox and overlay command buffers are executed across frames, so they can't come from the frame's pool
+			frame.skyboxCommandBuffer = new CommandBuffer({ .device = *vulkanDevice, .pool = commandPool, .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY, .name = "Skybox command buffer" });
+			frame.backdropCommandBuffer = new CommandBuffer({ .device = *vulkanDevice, .pool = frame.commandPool, .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY, .name = "Backdrop command buffer" });
+			frame.effectsCommandBuffer = new CommandBuffer({ .device = *vulkanDevice, .pool = frame.commandPool, .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY, .name = "Effects command buffer" });
+			frame.overlayCommandBuffer = new CommandBuffer({ .device = *vulkanDevice, .pool = commandPool, .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY, .name = "Overlay command buffer" });
+			for (uint32_t i = 0; i < numRecordingJobs; i++) {
+				CommandPool* threadCommandPool = new CommandPool({
+					.name = "Recording job command pool " + std::to_string(i),
+					.queueFamilyIndex = swapChain->queueNodeIndex,
+					.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
+				});
+				frame.threadCommandPools.push_back(threadCommandPool);
+				frame.threadCommandBuffers.push_back(new CommandBuffer({ .device = *vulkanDevice, .pool = threadCommandPool, .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY, .name = "Recording job command buffer " + std::to_string(i) }));
+			}
 			frameObjects.resize(getFrameCount());
-			frame.uniformBuffer = new Buffer({
-				.usageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			frame.frameArena = new FrameArena();
+			frame.cullBatchBuffer = new Buffer({
+				.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				.size = sizeof(CullBatch) * maxCullBatches,
+				.sharingMode = sharingMode,
+				.queueFamilyIndices = sharedQueueFamilies
+			});
+			// Host visible, so the visible instance counts written by the GPU can be read back once the frame's fence has been signalled
+			// Commands and draw counts are stored twice, once for each occlusion culling phase
+			frame.indirectCommandBuffer = new Buffer({
+				.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				.size = sizeof(VkDrawIndexedIndirectCommand) * maxDrawCommands * cullCommandRegions,
+				.sharingMode = sharingMode,
+				.queueFamilyIndices = sharedQueueFamilies
+			});
+			frame.drawCountBuffer = new Buffer({
+				.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
 				.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				.size = sizeof(ShaderData),
+				.size = sizeof(uint32_t) * maxCullBatches * cullCommandRegions,
+				.sharingMode = sharingMode,
+				.queueFamilyIndices = sharedQueueFamilies
 			});
 		}
 
-		descriptorPool = new DescriptorPool({
-			.name = "Application descriptor pool",
-			.maxSets = getFrameCount() + 1,
-			.poolSizes = {
-				{.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1024 /*getFrameCount()*/ },
-				{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1024 /*@todo*/},
-			}
+		// Per-actor buffers are bound as whole storage buffers, and with ray queries each actor is an instance of the top level acceleration structure
+		const VkDeviceSize maxActorElementSize = std::max({ sizeof(InstanceData), sizeof(CullActor), sizeof(ActorTransform), sizeof(SimulationBody) });
+		uint64_t deviceInstanceLimit = vulkanDevice->properties.limits.maxStorageBufferRange / maxActorElementSize;
+		if (vulkanDevice->hasRayQuery) {
+			deviceInstanceLimit = std::min<uint64_t>(deviceInstanceLimit, vulkanDevice->accelerationStructureProperties.maxInstanceCount);
+		}
+		maxInstanceCapacity = static_cast<uint32_t>(std::min<uint64_t>(deviceInstanceLimit, UINT32_MAX));
+		instanceCapacity = std::min(initialInstanceCapacity, maxInstanceCapacity);
+		createInstanceBuffers();
+
+		// Particle state persists across frames, so all frames share the same buffers
+		particleBuffer = new Buffer({
+			.name = "Particles",
+			.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			.size = particleSize * maxParticles,
+			.map = false
 		});
-
-		descriptorSetLayout = new DescriptorSetLayout({
-			.bindings = {
-				{.binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT }
-			}
+		particleListBuffer = new Buffer({
+			.name = "Particle lists",
+			.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			.size = sizeof(uint32_t) * (maxParticles * 4 + maxBlendedParticles * 3),
+			.map = false
 		});
-
+		particleCounterBuffer = new Buffer({
+			.name = "Particle counters",
+			.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			.size = sizeof(uint32_t) * particleCounterWords,
+			.map = false
+		});
+		// Reading uncached memory is slow, so host cached memory is preferred for the feedback
+		const VkMemoryPropertyFlags feedbackMemoryFlags = vulkanDevice->getHostReadMemoryProperties();
 		for (FrameObjects& frame : frameObjects) {
+			// Bound even without a virtual texture, as the scene's fragment shader declares it
+			frame.virtualTextureFeedbackBuffer = new Buffer({
+				.name = "Virtual texture feedback",
+				.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				.memoryPropertyFlags = feedbackMemoryFlags,
+				.size = sizeof(uint32_t) * (virtualTexture ? maxVirtualTextureFeedback : 1)
+			});
+			frame.particleStatsBuffer = new Buffer({
+				.usageFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				.size = sizeof(uint32_t) * particleArgsDispatch
+			});
+			// Written by the async light culling pass and read by the scene's fragment shaders
+			frame.clusterLightBuffer = new Buffer({
+				.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				.size = sizeof(uint32_t) * maxLightsPerCluster * clusterCount,
+				.sharingMode = sharingMode,
+				.queueFamilyIndices = sharedQueueFamilies
+			});
+		}
+		particleEmitters.reserve(maxParticleEmitters);
+		transientLights.reserve(maxLights);
+		shadows.staticCasters.reserve(instanceCapacity);
+		shadows.staticCasterMatrices.reserve(instanceCapacity);
+		shadows.cachedStaticCasterMatrices.reserve(instanceCapacity);
+		createShadowMaps();
+
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			{.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1024 /*getFrameCount()*/ },
+			{.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = getFrameCount() * 17 },
+			{.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = getFrameCount() * 2 },
+			{.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, .descriptorCount = getFrameCount() * 6 },
+			{.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .descriptorCount = getFrameCount() },
+			{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = getFrameCount() * 2 },
+		};
+		if (vulkanDevice->hasRayQuery) {
+			poolSizes.push_back({ .type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, .descriptorCount = getFrameCount() });
+		}
+		descriptorPool = new DescriptorPool({
+			.name = "Application descriptor pool",
+			.maxSets = getFrameCount() * 5,
+			.poolSizes = poolSizes
+		});
+
+		// The task and mesh shaders also read the uniform and instance buffers
+		const VkShaderStageFlags meshShadingStages = vulkanDevice->hasMeshShaders ? (VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT) : 0;
+		// The visibility buffer's shading pass reads the same resources as the fragment shader, plus the instances
+		const VkShaderStageFlags visibilityStages = visibilityBufferSupported() ? VK_SHADER_STAGE_COMPUTE_BIT : 0;
+		// Declared explicitly, as the stages are fixed for all pipelines, but checked against all shaders using the layout
+		std::vector<ShaderReference> sceneShaders = getGlTFShaders();
+		if (vulkanDevice->hasMeshShaders) {
+			std::vector<ShaderReference> meshShadingShaders = getMeshShadingShaders();
+			sceneShaders.insert(sceneShaders.end(), meshShadingShaders.begin(), meshShadingShaders.end());
+		}
+		if (visibilityBufferSupported()) {
+			sceneShaders.push_back({ getAssetPath() + "shaders/visibility_shade.comp.hlsl" });
+			if (vulkanDevice->hasRayQuery) {
+				sceneShaders.push_back({ getAssetPath() + "shaders/visibility_shade.comp.hlsl", { "RAY_QUERY" } });
+			}
+		}
+		std::vector<VkDescriptorSetLayoutBinding> sceneBindings = {
+			{.binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | meshShadingStages | visibilityStages },
+			{.binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | meshShadingStages | visibilityStages },
+			{.binding = 2, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | visibilityStages },
+			{.binding = 3, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_VERTEX_BIT },
+			{.binding = 4, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | visibilityStages },
+			{.binding = 5, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | visibilityStages },
+			{.binding = 6, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 2, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | visibilityStages },
+			{.binding = 7, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | visibilityStages }
+		};
+		// The frame's top level acceleration structure, traced by the ray query variant of the fragment shader
+		if (vulkanDevice->hasRayQuery) {
+			sceneBindings.push_back({ .binding = 8, .descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | visibilityStages });
+		}
+		descriptorSetLayout = new DescriptorSetLayout({
+			.bindings = sceneBindings,
+			.shaders = sceneShaders,
+			.set = 0
+		});
+
+		// Static and dynamic cascades
+		const std::array<VkDescriptorImageInfo, 2> shadowDescriptors = {
+			VkDescriptorImageInfo{ .sampler = shadows.sampler, .imageView = shadows.staticMap.view->handle, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			VkDescriptorImageInfo{ .sampler = shadows.sampler, .imageView = shadows.dynamicMap.view->handle, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }
+		};
+		for (FrameObjects& frame : frameObjects) {
+			// The frame allocator's and the top level acceleration structure's bindings are written by writeInstanceDescriptors
 			frame.descriptorSet = new DescriptorSet({
 				.pool = descriptorPool,
+				.batch = &descriptorWrites,
 				.layouts = { descriptorSetLayout->handle },
 				.descriptors = {
-					{.dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .pBufferInfo = &frame.uniformBuffer->descriptor }
+					{.dstBinding = 2, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &assetManager->materialBuffer->descriptor },
+					{.dstBinding = 5, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &frame.clusterLightBuffer->descriptor },
+					{.dstBinding = 6, .descriptorCount = 2, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = shadowDescriptors.data() },
+					{.dstBinding = 7, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &frame.virtualTextureFeedbackBuffer->descriptor }
 				}
 			});
 		}
 		
+		// Culling compute shader inputs and outputs
+		// Instances and uniforms are carved from the frame allocator
+		cullDescriptorSetLayout = new DescriptorSetLayout({
+			.shaders = { { getAssetPath() + "shaders/cull.comp.hlsl" } },
+			.dynamicBindings = { 4, 7 }
+		});
+
+		// The per-actor bindings are written by writeInstanceDescriptors
+		for (FrameObjects& frame : frameObjects) {
+			frame.cullDescriptorSet = new DescriptorSet({
+				.pool = descriptorPool,
+				.batch = &descriptorWrites,
+				.layouts = { cullDescriptorSetLayout->handle },
+				.descriptors = {
+					{.dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &frame.cullBatchBuffer->descriptor },
+					{.dstBinding = 2, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &frame.indirectCommandBuffer->descriptor },
+					{.dstBinding = 3, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &frame.drawCountBuffer->descriptor },
+				}
+			});
+		}
+
+		// Asteroid simulation, reads the bodies of the previous frame and writes those of the current frame
+		simulationDescriptorSetLayout = new DescriptorSetLayout({
+			.shaders = { { getAssetPath() + "shaders/simulate.comp.hlsl" } }
+		});
+		// Only binds the bodies, which are written by writeInstanceDescriptors
+		for (FrameObjects& frame : frameObjects) {
+			frame.simulationDescriptorSet = new DescriptorSet({
+				.pool = descriptorPool,
+				.layouts = { simulationDescriptorSetLayout->handle }
+			});
+		}
+		simulationPipelineLayout = pipelineLayoutCache->get({
+			.layouts = { simulationDescriptorSetLayout->handle },
+			.shaders = { { getAssetPath() + "shaders/simulate.comp.hlsl" } }
+		});
+
+		// Particles, the compute passes and the draws share one set, only the emitters differ per frame
+		const std::vector<ShaderReference> particleComputeShaders = {
+			{ getAssetPath() + "shaders/particle_emit.comp.hlsl" },
+			{ getAssetPath() + "shaders/particle_args.comp.hlsl" },
+			{ getAssetPath() + "shaders/particle_simulate.comp.hlsl" },
+			{ getAssetPath() + "shaders/particle_sort.comp.hlsl" }
+		};
+		const std::vector<ShaderReference> particleDrawShaders = {
+			{ getAssetPath() + "shaders/particle.vert.hlsl" },
+			{ getAssetPath() + "shaders/particle.frag.hlsl" }
+		};
+		std::vector<ShaderReference> particleShaders = particleComputeShaders;
+		particleShaders.insert(particleShaders.end(), particleDrawShaders.begin(), particleDrawShaders.end());
+		particleDescriptorSetLayout = new DescriptorSetLayout({
+			.shaders = particleShaders,
+			.dynamicBindings = { 3 }
+		});
+		// The emitters are written by writeInstanceDescriptors, as they're carved from the frame allocator
+		for (FrameObjects& frame : frameObjects) {
+			frame.particleDescriptorSet = new DescriptorSet({
+				.pool = descriptorPool,
+				.batch = &descriptorWrites,
+				.layouts = { particleDescriptorSetLayout->handle },
+				.descriptors = {
+					{.dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &particleBuffer->descriptor },
+					{.dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &particleListBuffer->descriptor },
+					{.dstBinding = 2, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &particleCounterBuffer->descriptor },
+				}
+			});
+			frame.particleDescriptorSet->dynamicOffsets = { 0 };
+		}
+		particleComputePipelineLayout = pipelineLayoutCache->get({
+			.layouts = { particleDescriptorSetLayout->handle },
+			.shaders = particleComputeShaders
+		});
+		particleDrawPipelineLayout = pipelineLayoutCache->get({
+			.layouts = { particleDescriptorSetLayout->handle },
+			.shaders = particleDrawShaders
+		});
+
+		// Light culling, the lights are carved from the frame allocator
+		lightCullDescriptorSetLayout = new DescriptorSetLayout({
+			.shaders = { { getAssetPath() + "shaders/light_cull.comp.hlsl" } },
+			.dynamicBindings = { 0 }
+		});
+		// The lights are written by writeInstanceDescriptors
+		for (FrameObjects& frame : frameObjects) {
+			frame.lightCullDescriptorSet = new DescriptorSet({
+				.pool = descriptorPool,
+				.batch = &descriptorWrites,
+				.layouts = { lightCullDescriptorSetLayout->handle },
+				.descriptors = {
+					{.dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &frame.clusterLightBuffer->descriptor },
+				}
+			});
+			frame.lightCullDescriptorSet->dynamicOffsets = { 0 };
+		}
+		writeInstanceDescriptors();
+		descriptorWrites.flush();
+		lightCullPipelineLayout = pipelineLayoutCache->get({
+			.layouts = { lightCullDescriptorSetLayout->handle },
+			.shaders = { { getAssetPath() + "shaders/light_cull.comp.hlsl" } }
+		});
+
+		// Depth pyramid reduction, each level is built from the previous one (or the depth buffer for the first level)
+		depthReduceDescriptorSetLayout = new DescriptorSetLayout({
+			.shaders = { { getAssetPath() + "shaders/depthreduce.comp.hlsl" } }
+		});
+		depthReducePipelineLayout = pipelineLayoutCache->get({
+			.layouts = { depthReduceDescriptorSetLayout->handle },
+			.shaders = { { getAssetPath() + "shaders/depthreduce.comp.hlsl" } }
+		});
+		depthReduceUpdateTemplate = new DescriptorUpdateTemplate({
+			.name = "Depth reduce descriptor update template",
+			.layout = depthReduceDescriptorSetLayout->handle,
+			.entries = {
+				{.dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .offset = offsetof(DepthReduceDescriptors, source) },
+				{.dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .offset = offsetof(DepthReduceDescriptors, destination) },
+			}
+		});
+		// Occlusion culling reads back the frame's depth, which never leaves tile memory in tile based mode
+		if (settings.tileBasedRendering) {
+			occlusionCulling = false;
+		}
+		// Recompiling the graph recreates the depth stencil image, so this needs to happen before the pyramid's depth view is created
+		setupRenderGraph();
+		// Also writes the pyramid to the culling descriptor sets
+		createDepthPyramid();
+
+		cullPipelineLayout = pipelineLayoutCache->get({
+			.layouts = { cullDescriptorSetLayout->handle },
+			.shaders = { { getAssetPath() + "shaders/cull.comp.hlsl" } }
+		});
+
+		// All pipelines are collected first and then created in parallel
+		std::vector<std::string> pipelineNames;
+		std::vector<PipelineCreateInfo> pipelineCreateInfos;
+
+		pipelineNames.push_back("cull");
+		pipelineCreateInfos.push_back({
+			.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+			.shaders = {
+				getAssetPath() + "shaders/cull.comp.hlsl"
+			},
+			.cache = pipelineCache,
+			.layout = *cullPipelineLayout,
+			.enableHotReload = true
+		});
+
+		pipelineNames.push_back("light_cull");
+		pipelineCreateInfos.push_back({
+			.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+			.shaders = {
+				getAssetPath() + "shaders/light_cull.comp.hlsl"
+			},
+			.cache = pipelineCache,
+			.layout = *lightCullPipelineLayout,
+			.enableHotReload = true
+		});
+
+		pipelineNames.push_back("simulate");
+		pipelineCreateInfos.push_back({
+			.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+			.shaders = {
+				getAssetPath() + "shaders/simulate.comp.hlsl"
+			},
+			.cache = pipelineCache,
+			.layout = *simulationPipelineLayout,
+			.enableHotReload = true
+		});
+
+		for (const std::string name : { "particle_emit", "particle_args", "particle_simulate", "particle_sort" }) {
+			pipelineNames.push_back(name);
+			pipelineCreateInfos.push_back({
+				.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+				.shaders = {
+					getAssetPath() + "shaders/" + name + ".comp.hlsl"
+				},
+				.cache = pipelineCache,
+				.layout = *particleComputePipelineLayout,
+				.enableHotReload = true
+			});
+		}
+
+		pipelineNames.push_back("depthreduce");
+		pipelineCreateInfos.push_back({
+			.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+			.shaders = {
+				getAssetPath() + "shaders/depthreduce.comp.hlsl"
+			},
+			.cache = pipelineCache,
+			.layout = *depthReducePipelineLayout,
+			.enableHotReload = true
+		});
+		if (multisampledDepthReduction()) {
+			pipelineNames.push_back("depthreduce_multisample");
+			pipelineCreateInfos.push_back({
+				.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+				.shaders = {
+					getAssetPath() + "shaders/depthreduce_multisample.comp.hlsl"
+				},
+				.cache = pipelineCache,
+				.layout = *depthReducePipelineLayout,
+				.enableHotReload = true
+			});
+		}
+
 		// One large set for all textures
 
 		VkPipelineRenderingCreateInfo pipelineRenderingCreateInfo{};
 		pipelineRenderingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
 		pipelineRenderingCreateInfo.colorAttachmentCount = 1;
-		pipelineRenderingCreateInfo.pColorAttachmentFormats = &swapChain->colorFormat;
+		pipelineRenderingCreateInfo.pColorAttachmentFormats = &sceneColorFormat;
 		pipelineRenderingCreateInfo.depthAttachmentFormat = depthFormat;
 		pipelineRenderingCreateInfo.stencilAttachmentFormat = depthFormat;
 
@@ -257,39 +2330,44 @@ public:
 		blendAttachmentState.colorWriteMask = 0xf;
 
 		// Use one large descriptor set for all imgages (aka "bindless")
-		std::vector<VkDescriptorImageInfo> textureDescriptors{};
-		for (auto i = 0; i < assetManager->textures.size(); i++) {
-			// @todo: directly construct from asset manager=?
-			VkDescriptorImageInfo imageInfo{};
-			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfo.sampler = assetManager->textures[i]->sampler;
-			imageInfo.imageView = assetManager->textures[i]->view;
-			textureDescriptors.push_back(imageInfo);
-		};
-
+		// Only descriptors that have been written to are accessed, so the remaining ones can be updated while the set is in use
+		const VkPhysicalDeviceVulkan12Properties& properties12 = vulkanDevice->properties12;
+		maxTextureDescriptors = std::min({ textureTableCapacity, properties12.maxDescriptorSetUpdateAfterBindSampledImages, properties12.maxDescriptorSetUpdateAfterBindSamplers,
+			properties12.maxPerStageDescriptorUpdateAfterBindSampledImages, properties12.maxPerStageDescriptorUpdateAfterBindSamplers });
+		textureDescriptorPool = new DescriptorPool({
+			.name = "Bindless texture descriptor pool",
+			.maxSets = getFrameCount(),
+			.poolSizes = {
+				{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = getFrameCount() * maxTextureDescriptors },
+			},
+			.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT
+		});
 		descriptorSetLayoutTextures = new DescriptorSetLayout({
 			.descriptorIndexing = true,
+			.descriptorBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+			.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
 			.bindings = {
-				{.binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = static_cast<uint32_t>(textureDescriptors.size()), .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT}
-			}
+				{.binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = maxTextureDescriptors, .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | visibilityStages }
+			},
+			.shaders = sceneShaders,
+			.set = 1
 		});
 
-		glTFPipelineLayout = new PipelineLayout({
+		// Push constants are vkglTF::PushConstBlock, which is pushed for the vertex and fragment stages by the model's draw functions
+		glTFPipelineLayout = pipelineLayoutCache->get({
 			.layouts = { descriptorSetLayout->handle, descriptorSetLayoutTextures->handle },
-			.pushConstantRanges = {
-				// @todo
-				{ .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, .offset = 0, .size = sizeof(PushConstBlock) }
-			}
+			.shaders = getGlTFShaders()
 		});
 
-		pipelines["gltf"] = new Pipeline({
+		pipelineNames.push_back("gltf");
+		pipelineCreateInfos.push_back({
 			.shaders = {
 				getAssetPath() + "shaders/gltf.vert.hlsl",
 				getAssetPath() + "shaders/gltf.frag.hlsl"
 			},
 			.cache = pipelineCache,
 			.layout = *glTFPipelineLayout,
-			.vertexInput = vkglTF::vertexInput,
+			.vertexInput = vkglTF::getVertexInput(modelVertexLayout),
 			.inputAssemblyState = {
 				.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
 			},
@@ -309,27 +2387,37 @@ public:
 			.depthStencilState = {
 				.depthTestEnable = VK_TRUE,
 				.depthWriteEnable = VK_TRUE,
-				.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+				.depthCompareOp = getDepthCompareOp(),
 			},
 			.blending = {
 				.attachments = { blendAttachmentState }
 			},
+			// Depth and rasterization state is set at draw time, so the same pipeline can be used with and without the depth pre-pass and for wireframe rendering
 			.dynamicState = {
 				DynamicState::Scissor,
-				DynamicState::Viewport
+				DynamicState::Viewport,
+				DynamicState::DepthWriteEnable,
+				DynamicState::DepthCompareOp,
+				DynamicState::DepthTestEnable,
+				DynamicState::CullMode,
+				DynamicState::FrontFace,
+				DynamicState::PolygonMode,
+				DynamicState::FragmentShadingRate
 			},
 			.pipelineRenderingInfo = pipelineRenderingCreateInfo,
 			.enableHotReload = true
 		});
 
-		pipelines["playership"] = new Pipeline({
+		// Same as the glTF pipeline, but fetches per-actor matrices from the instance buffer
+		pipelineNames.push_back("gltf_instanced");
+		pipelineCreateInfos.push_back({
 			.shaders = {
-				getAssetPath() + "shaders/playership.vert.hlsl",
+				getAssetPath() + "shaders/gltf_instanced.vert.hlsl",
 				getAssetPath() + "shaders/gltf.frag.hlsl"
 			},
 			.cache = pipelineCache,
 			.layout = *glTFPipelineLayout,
-			.vertexInput = vkglTF::vertexInput,
+			.vertexInput = vkglTF::getVertexInput(modelVertexLayout),
 			.inputAssemblyState = {
 				.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
 			},
@@ -349,46 +2437,104 @@ public:
 			.depthStencilState = {
 				.depthTestEnable = VK_TRUE,
 				.depthWriteEnable = VK_TRUE,
-				.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+				.depthCompareOp = getDepthCompareOp(),
 			},
 			.blending = {
 				.attachments = { blendAttachmentState }
 			},
+			// Depth and rasterization state is set at draw time, so the same pipeline can be used with and without the depth pre-pass and for wireframe rendering
 			.dynamicState = {
 				DynamicState::Scissor,
-				DynamicState::Viewport
+				DynamicState::Viewport,
+				DynamicState::DepthWriteEnable,
+				DynamicState::DepthCompareOp,
+				DynamicState::DepthTestEnable,
+				DynamicState::CullMode,
+				DynamicState::FrontFace,
+				DynamicState::PolygonMode,
+				DynamicState::FragmentShadingRate
 			},
 			.pipelineRenderingInfo = pipelineRenderingCreateInfo,
 			.enableHotReload = true
 		});
 
-		//
+		// Same as the instanced pipeline, but the vertex shader reads the compact vertices through the model's vertex buffer address, so there is no vertex input state
+		if (vulkanDevice->hasBufferDeviceAddress && (modelVertexLayout == vkglTF::VertexLayout::Compact)) {
+			PipelineCreateInfo pulledCreateInfo = pipelineCreateInfos.back();
+			pulledCreateInfo.shaders = {
+				getAssetPath() + "shaders/gltf_pulled.vert.hlsl",
+				getAssetPath() + "shaders/gltf.frag.hlsl"
+			};
+			pulledCreateInfo.vertexInput = {};
+			pulledCreateInfo.specializationConstants = { { 0, static_cast<uint32_t>(sizeof(vkglTF::CompactVertex)) } };
+			pipelineNames.push_back("gltf_pulled");
+			pipelineCreateInfos.push_back(pulledCreateInfo);
+		}
 
-		descriptorSetTextures = new DescriptorSet({
-			.pool = descriptorPool,
-			.variableDescriptorCount = static_cast<uint32_t>(textureDescriptors.size()),
-			.layouts = { descriptorSetLayoutTextures->handle },
-			.descriptors = {
-				{.dstBinding = 0, .descriptorCount = static_cast<uint32_t>(textureDescriptors.size()), .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = textureDescriptors.data()}
-			}
-		});
+		// Visibility pass, same state as the pulled pipeline but writes the instance and triangle of each pixel to an integer target instead of shading it
+		if (visibilityBufferSupported()) {
+			PipelineCreateInfo visibilityCreateInfo = pipelineCreateInfos.back();
+			visibilityCreateInfo.shaders = {
+				getAssetPath() + "shaders/visibility.vert.hlsl",
+				getAssetPath() + "shaders/visibility.frag.hlsl"
+			};
+			visibilityCreateInfo.blending.attachments[0] = { .blendEnable = VK_FALSE, .colorWriteMask = VK_COLOR_COMPONENT_R_BIT };
+			visibilityCreateInfo.pipelineRenderingInfo.pColorAttachmentFormats = &visibilityTargetFormat;
+			pipelineNames.push_back("visibility");
+			pipelineCreateInfos.push_back(visibilityCreateInfo);
+		}
 
-		// @todo: push consts also used by gltf renderer
-		skyboxPipelineLayout = new PipelineLayout({
-			.layouts = { descriptorSetLayout->handle, descriptorSetLayoutTextures->handle },
-			.pushConstantRanges = {
-				{.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT, .offset = 0, .size = sizeof(PushConstBlock)}
-			}
-		});
+		// Skinned models always use the default vertex layout
+		{
+			const size_t gltfIndex = std::distance(pipelineNames.begin(), std::find(pipelineNames.begin(), pipelineNames.end(), "gltf"));
+			skinnedPipelineCreateInfo = new PipelineCreateInfo(pipelineCreateInfos[gltfIndex]);
+			skinnedPipelineCreateInfo->defines = { "SKINNED" };
+			skinnedPipelineCreateInfo->vertexInput = vkglTF::vertexInput;
+		}
 
-		pipelines["skybox"] = new Pipeline({
+		// Depth pre-pass pipelines only fetch the positions and have no fragment shader, otherwise they match the pipelines of the main pass
+		auto addDepthPipeline = [&](const std::string& name, const std::string& mainPipelineName, const std::string& vertexShader) {
+			const size_t mainIndex = std::distance(pipelineNames.begin(), std::find(pipelineNames.begin(), pipelineNames.end(), mainPipelineName));
+			PipelineCreateInfo depthCreateInfo = pipelineCreateInfos[mainIndex];
+			depthCreateInfo.shaders = { getAssetPath() + "shaders/" + vertexShader };
+			depthCreateInfo.vertexInput = vkglTF::getPositionVertexInput(modelVertexLayout);
+			depthCreateInfo.blending.attachments[0].colorWriteMask = 0;
+			depthCreateInfo.dynamicState = { DynamicState::Scissor, DynamicState::Viewport };
+			pipelineNames.push_back(name);
+			pipelineCreateInfos.push_back(depthCreateInfo);
+		};
+		addDepthPipeline("depth", "gltf", "depth.vert.hlsl");
+		addDepthPipeline("depth_instanced", "gltf_instanced", "depth_instanced.vert.hlsl");
+
+		// Shadow casters are drawn like the instanced depth pre-pass, with one view per cascade and a slope scaled bias against acne
+		{
+			PipelineCreateInfo shadowCreateInfo = pipelineCreateInfos.back();
+			shadowCreateInfo.shaders = { getAssetPath() + "shaders/shadow.vert.hlsl" };
+			shadowCreateInfo.multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+			shadowCreateInfo.rasterizationState.cullMode = VK_CULL_MODE_NONE;
+			shadowCreateInfo.rasterizationState.depthBiasEnable = VK_TRUE;
+			shadowCreateInfo.rasterizationState.depthBiasConstantFactor = 1.25f;
+			shadowCreateInfo.rasterizationState.depthBiasSlopeFactor = 1.75f;
+			shadowCreateInfo.depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+			shadowCreateInfo.blending.attachments.clear();
+			shadowCreateInfo.pipelineRenderingInfo.colorAttachmentCount = 0;
+			shadowCreateInfo.pipelineRenderingInfo.pColorAttachmentFormats = nullptr;
+			shadowCreateInfo.pipelineRenderingInfo.depthAttachmentFormat = shadowMapFormat;
+			shadowCreateInfo.pipelineRenderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+			shadowCreateInfo.pipelineRenderingInfo.viewMask = shadowViewMask;
+			pipelineNames.push_back("shadow");
+			pipelineCreateInfos.push_back(shadowCreateInfo);
+		}
+
+		// Impostors of distant actors, the quads are built by the vertex shader so there is no vertex input
+		pipelineNames.push_back("impostor");
+		pipelineCreateInfos.push_back({
 			.shaders = {
-				getAssetPath() + "shaders/skybox.vert.hlsl",
-				getAssetPath() + "shaders/skybox.frag.hlsl"
+				getAssetPath() + "shaders/impostor.vert.hlsl",
+				getAssetPath() + "shaders/impostor.frag.hlsl"
 			},
 			.cache = pipelineCache,
-			.layout = *skyboxPipelineLayout,
-			.vertexInput = vkglTF::vertexInput,
+			.layout = *glTFPipelineLayout,
 			.inputAssemblyState = {
 				.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
 			},
@@ -398,17 +2544,17 @@ public:
 			},
 			.rasterizationState = {
 				.polygonMode = VK_POLYGON_MODE_FILL,
-				.cullMode = VK_CULL_MODE_BACK_BIT,
-				.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+				.cullMode = VK_CULL_MODE_NONE,
+				.frontFace = VK_FRONT_FACE_CLOCKWISE,
 				.lineWidth = 1.0f
 			},
 			.multisampleState = {
 				.rasterizationSamples = settings.sampleCount,
 			},
 			.depthStencilState = {
-				.depthTestEnable = VK_FALSE,
-				.depthWriteEnable = VK_FALSE,
-				.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+				.depthTestEnable = VK_TRUE,
+				.depthWriteEnable = VK_TRUE,
+				.depthCompareOp = getDepthCompareOp(),
 			},
 			.blending = {
 				.attachments = { blendAttachmentState }
@@ -421,259 +2567,418 @@ public:
 			.enableHotReload = true
 		});
 
-		//ship = actorManager->addActor("playership", new Actor({
-		//	.position = glm::vec3(0.0f),
-		//	.rotation = glm::vec3(0.0f),
-		//	.scale = glm::vec3(0.5f),
-		//	.model = assetManager->models["spaceship"]
-		//}));
-
-		//actorManager->addActor("orientation_crate", new Actor({
-		//	.position = glm::vec3(0.0f, 0.0f, -15.0f),
-		//	.rotation = glm::vec3(0.0f),
-		//	.scale = glm::vec3(0.5f),
-		//	.model = assetManager->models["crate"],
-		//}));
-
-		// Set up a grid of asteroids for testing purposes
-		std::default_random_engine rndGenerator((unsigned)time(nullptr));
-		//std::uniform_real_distribution<float> uniformDist(-1.0f, 1.0f);
-		//const int r = 8;
-		//const float s = 8.0f;
-		uint32_t a_idx = 0;
-		//for (int32_t x = -r; x < r; x++) {
-		//	for (int32_t y = -r; y < r; y++) {
-		//		for (int32_t z = -r; z < r; z++) {
-		//			glm::vec3 rndOffset = glm::vec3(uniformDist(rndGenerator), uniformDist(rndGenerator), uniformDist(rndGenerator)) * 5.0f;
-		//			actorManager->addActor("asteroid" + std::to_string(a_idx), new Actor({
-		//				.position = (glm::vec3(x, y, z) + rndOffset) * s,
-		//				.rotation = glm::vec3(360.0f * uniformDist(rndGenerator), 360.0f * uniformDist(rndGenerator), 360.0f * uniformDist(rndGenerator)),
-		//				.scale = glm::vec3(5.0f + uniformDist(rndGenerator) * 2.5f - uniformDist(rndGenerator) * 2.5f),
-		//				.model = assetManager->models["asteroid"],
-		//				.tag = "asteroid"
-		//			}));
-		//			a_idx++;
-		//		}
-		//	}
-		//}
-
-		const uint32_t asteroidCount = 8192;
-
-		std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
+		// Same vertex processing as the glTF pipeline, renders albedo and normals into the impostor atlases (see bakeImpostor)
+		{
+			const size_t gltfIndex = std::distance(pipelineNames.begin(), std::find(pipelineNames.begin(), pipelineNames.end(), "gltf"));
+			PipelineCreateInfo bakeCreateInfo = pipelineCreateInfos[gltfIndex];
+			bakeCreateInfo.shaders = { getAssetPath() + "shaders/gltf.vert.hlsl", getAssetPath() + "shaders/impostor_bake.frag.hlsl" };
+			bakeCreateInfo.rasterizationState.cullMode = VK_CULL_MODE_NONE;
+			bakeCreateInfo.multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+			bakeCreateInfo.depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
+			bakeCreateInfo.blending.attachments = { blendAttachmentState, blendAttachmentState };
+			bakeCreateInfo.dynamicState = { DynamicState::Scissor, DynamicState::Viewport };
+			bakeCreateInfo.pipelineRenderingInfo.colorAttachmentCount = 2;
+			bakeCreateInfo.pipelineRenderingInfo.pColorAttachmentFormats = impostorAtlasFormats;
+			bakeCreateInfo.pipelineRenderingInfo.depthAttachmentFormat = impostorDepthFormat;
+			bakeCreateInfo.pipelineRenderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+			bakeCreateInfo.enableHotReload = false;
+			pipelineNames.push_back("impostor_bake");
+			pipelineCreateInfos.push_back(bakeCreateInfo);
+		}
 
-		// Distribute rocks randomly on two different rings
-		for (auto i = 0; i < asteroidCount / 2; i++) {
-			glm::vec2 ring0{ 7.0f, 16.0f };
-			glm::vec2 ring1{ 14.0f, 24.0f };
+		// Particles are tested against the actors' depth but don't write it, blended ones are drawn back to front and the fragment shader outputs premultiplied alpha
+		{
+			VkPipelineColorBlendAttachmentState particleBlendState{
+				.blendEnable = VK_TRUE,
+				.srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+				.dstColorBlendFactor = VK_BLEND_FACTOR_ONE,
+				.colorBlendOp = VK_BLEND_OP_ADD,
+				.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+				.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+				.alphaBlendOp = VK_BLEND_OP_ADD,
+				.colorWriteMask = 0xf
+			};
+			PipelineCreateInfo particleCreateInfo{
+				.shaders = {
+					getAssetPath() + "shaders/particle.vert.hlsl",
+					getAssetPath() + "shaders/particle.frag.hlsl"
+				},
+				.cache = pipelineCache,
+				.layout = *particleDrawPipelineLayout,
+				.inputAssemblyState = {
+					.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+				},
+				.viewportState = {
+					.viewportCount = 1,
+					.scissorCount = 1
+				},
+				.rasterizationState = {
+					.polygonMode = VK_POLYGON_MODE_FILL,
+					.cullMode = VK_CULL_MODE_NONE,
+					.frontFace = VK_FRONT_FACE_CLOCKWISE,
+					.lineWidth = 1.0f
+				},
+				.multisampleState = {
+					.rasterizationSamples = settings.sampleCount,
+				},
+				.depthStencilState = {
+					.depthTestEnable = VK_TRUE,
+					.depthWriteEnable = VK_FALSE,
+					.depthCompareOp = getDepthCompareOp(),
+				},
+				.blending = {
+					.attachments = { particleBlendState }
+				},
+				.dynamicState = {
+					DynamicState::Scissor,
+					DynamicState::Viewport
+				},
+				.pipelineRenderingInfo = pipelineRenderingCreateInfo,
+				.enableHotReload = true
+			};
+			pipelineNames.push_back("particle_additive");
+			pipelineCreateInfos.push_back(particleCreateInfo);
+			particleCreateInfo.blending.attachments[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			particleCreateInfo.blending.attachments[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			pipelineNames.push_back("particle_blended");
+			pipelineCreateInfos.push_back(particleCreateInfo);
+		}
 
-			ring0 *= 10.0f;
-			ring1 *= 15.0f;
+		// Task shader culls meshlets, mesh shader fetches the compact vertices, so the regular fragment shader can be used
+		if (vulkanDevice->hasMeshShaders) {
+			meshletPipelineLayout = pipelineLayoutCache->get({
+				.layouts = { descriptorSetLayout->handle, descriptorSetLayoutTextures->handle, meshletDescriptorSetLayout->handle },
+				.shaders = getMeshShadingShaders()
+			});
 
-			float rho, theta;
+			pipelineNames.push_back("gltf_mesh");
+			pipelineCreateInfos.push_back({
+				.shaders = {
+					getAssetPath() + "shaders/gltf.task.hlsl",
+					getAssetPath() + "shaders/gltf.mesh.hlsl",
+					getAssetPath() + "shaders/gltf.frag.hlsl"
+				},
+				.cache = pipelineCache,
+				.layout = *meshletPipelineLayout,
+				.viewportState = {
+					.viewportCount = 1,
+					.scissorCount = 1
+				},
+				.rasterizationState = {
+					.polygonMode = VK_POLYGON_MODE_FILL,
+					.cullMode = VK_CULL_MODE_BACK_BIT,
+					.frontFace = VK_FRONT_FACE_CLOCKWISE,
+					.lineWidth = 1.0f
+				},
+				.multisampleState = {
+					.rasterizationSamples = settings.sampleCount,
+				},
+				.depthStencilState = {
+					.depthTestEnable = VK_TRUE,
+					.depthWriteEnable = VK_TRUE,
+					.depthCompareOp = getDepthCompareOp(),
+				},
+				.blending = {
+					.attachments = { blendAttachmentState }
+				},
+				.dynamicState = {
+					DynamicState::Scissor,
+					DynamicState::Viewport
+				},
+				.pipelineRenderingInfo = pipelineRenderingCreateInfo,
+				.enableHotReload = true
+			});
+		}
 
+		pipelineNames.push_back("playership");
+		pipelineCreateInfos.push_back({
+			.shaders = {
+				getAssetPath() + "shaders/playership.vert.hlsl",
+				getAssetPath() + "shaders/gltf.frag.hlsl"
+			},
+			.cache = pipelineCache,
+			.layout = *glTFPipelineLayout,
+			.vertexInput = vkglTF::getVertexInput(modelVertexLayout),
+			.inputAssemblyState = {
+				.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+			},
+			.viewportState = {
+				.viewportCount = 1,
+				.scissorCount = 1
+			},
+			.rasterizationState = {
+				.polygonMode = VK_POLYGON_MODE_FILL,
+				.cullMode = VK_CULL_MODE_BACK_BIT,
+				.frontFace = VK_FRONT_FACE_CLOCKWISE,
+				.lineWidth = 1.0f
+			},
+			.multisampleState = {
+				.rasterizationSamples = settings.sampleCount,
+			},
+			.depthStencilState = {
+				.depthTestEnable = VK_TRUE,
+				.depthWriteEnable = VK_TRUE,
+				.depthCompareOp = getDepthCompareOp(),
+			},
+			.blending = {
+				.attachments = { blendAttachmentState }
+			},
+			.dynamicState = {
+				DynamicState::Scissor,
+				DynamicState::Viewport
+			},
+			.pipelineRenderingInfo = pipelineRenderingCreateInfo,
+			.enableHotReload = true
+		});
 
-			// Inner ring
-			rho = sqrt((pow(ring0[1], 2.0f) - pow(ring0[0], 2.0f)) * uniformDist(rndGenerator) + pow(ring0[0], 2.0f));
-			theta = static_cast<float>(2.0f * M_PI * uniformDist(rndGenerator));
-			actorManager->addActor("asteroid" + std::to_string(a_idx), new Actor({
-				.position = glm::vec3(rho * cos(theta), uniformDist(rndGenerator) * 16.0f, rho * sin(theta)),
-				.rotation = glm::vec3(360.0f * uniformDist(rndGenerator), 360.0f * uniformDist(rndGenerator), 360.0f * uniformDist(rndGenerator)),
-				.scale = glm::vec3(5.0f + uniformDist(rndGenerator) * 2.5f - uniformDist(rndGenerator) * 2.5f),
-				.model = assetManager->models["asteroid"],
-				.tag = "asteroid"
-			}));
-			a_idx++;
+		//
 
-			// Outer ring
-			rho = sqrt((pow(ring1[1], 2.0f) - pow(ring1[0], 2.0f)) * uniformDist(rndGenerator) + pow(ring1[0], 2.0f));
-			theta = static_cast<float>(2.0f * M_PI * uniformDist(rndGenerator));
-			actorManager->addActor("asteroid" + std::to_string(a_idx), new Actor({
-				.position = glm::vec3(rho * cos(theta), uniformDist(rndGenerator) * 16.0f, rho * sin(theta)),
-				.rotation = glm::vec3(360.0f * uniformDist(rndGenerator), 360.0f * uniformDist(rndGenerator), 360.0f * uniformDist(rndGenerator)),
-				.scale = glm::vec3(5.0f + uniformDist(rndGenerator) * 2.5f - uniformDist(rndGenerator) * 2.5f),
-				.model = assetManager->models["asteroid"],
-				.tag = "asteroid"
-				}));
-			a_idx++;
+		for (FrameObjects& frame : frameObjects) {
+			frame.descriptorSetTextures = new DescriptorSet({
+				.pool = textureDescriptorPool,
+				.variableDescriptorCount = maxTextureDescriptors,
+				.layouts = { descriptorSetLayoutTextures->handle }
+			});
+			updateTextureDescriptors(frame);
 		}
+		descriptorWrites.flush();
 
-		actorManager->addActor("moon", new Actor({
-			.position = glm::vec3(0.0f, 0.0f, 0.0f),
-			.rotation = glm::vec3(0.0f),
-			.scale = glm::vec3(5.0f),
-			.model = assetManager->models["moon"],
-			.tag = "moon"
-		}));
+		// The skybox is drawn with the model's draw function, so it needs the same push constants as the glTF pipelines and ends up sharing their layout
+		skyboxPipelineLayout = pipelineLayoutCache->get({
+			.layouts = { descriptorSetLayout->handle, descriptorSetLayoutTextures->handle },
+			.shaders = getGlTFShaders()
+		});
 
-		pipelineList.push_back(pipelines["skybox"]);
-		pipelineList.push_back(pipelines["playership"]);
-		pipelineList.push_back(pipelines["gltf"]);
+		pipelineNames.push_back("skybox");
+		pipelineCreateInfos.push_back({
+			.shaders = {
+				getAssetPath() + "shaders/skybox.vert.hlsl",
+				getAssetPath() + "shaders/skybox.frag.hlsl"
+			},
+			.cache = pipelineCache,
+			.layout = *skyboxPipelineLayout,
+			.vertexInput = vkglTF::getVertexInput(modelVertexLayout),
+			.inputAssemblyState = {
+				.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+			},
+			.viewportState = {
+				.viewportCount = 1,
+				.scissorCount = 1
+			},
+			.rasterizationState = {
+				.polygonMode = VK_POLYGON_MODE_FILL,
+				.cullMode = VK_CULL_MODE_BACK_BIT,
+				.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+				.lineWidth = 1.0f
+			},
+			.multisampleState = {
+				.rasterizationSamples = settings.sampleCount,
+			},
+			.depthStencilState = {
+				.depthTestEnable = VK_FALSE,
+				.depthWriteEnable = VK_FALSE,
+				.depthCompareOp = getDepthCompareOp(),
+			},
+			.blending = {
+				.attachments = { blendAttachmentState }
+			},
+			// The skybox is shaded at a coarser rate if supported
+			.dynamicState = {
+				DynamicState::Scissor,
+				DynamicState::Viewport,
+				DynamicState::FragmentShadingRate
+			},
+			.pipelineRenderingInfo = pipelineRenderingCreateInfo,
+			.enableHotReload = true
+		});
 
-		for (auto& pipeline : pipelineList) {
-			fileWatcher->addPipeline(pipeline);
+		// Depth tested against the opaque geometry without writing, the triangle lies on the far plane so it only passes where nothing has been drawn
+		pipelineNames.push_back("skybox_fullscreen");
+		pipelineCreateInfos.push_back({
+			.shaders = {
+				getAssetPath() + "shaders/skybox_fullscreen.vert.hlsl",
+				getAssetPath() + "shaders/skybox.frag.hlsl"
+			},
+			.specializationConstants = { { 0, settings.reverseDepth ? VK_TRUE : VK_FALSE } },
+			.cache = pipelineCache,
+			.layout = *skyboxPipelineLayout,
+			.inputAssemblyState = {
+				.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+			},
+			.viewportState = {
+				.viewportCount = 1,
+				.scissorCount = 1
+			},
+			.rasterizationState = {
+				.polygonMode = VK_POLYGON_MODE_FILL,
+				.cullMode = VK_CULL_MODE_NONE,
+				.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+				.lineWidth = 1.0f
+			},
+			.multisampleState = {
+				.rasterizationSamples = settings.sampleCount,
+			},
+			.depthStencilState = {
+				.depthTestEnable = VK_TRUE,
+				.depthWriteEnable = VK_FALSE,
+				.depthCompareOp = getDepthCompareOp(),
+			},
+			.blending = {
+				.attachments = { blendAttachmentState }
+			},
+			.dynamicState = {
+				DynamicState::Scissor,
+				DynamicState::Viewport,
+				DynamicState::FragmentShadingRate
+			},
+			.pipelineRenderingInfo = pipelineRenderingCreateInfo,
+			.enableHotReload = true
+		});
+
+		// Dynamic resolution upscaling, the scene color written to the descriptors is only known once the render graph has been compiled
+		const std::vector<ShaderReference> upscaleShaders = {
+			{ getAssetPath() + "shaders/fullscreen.vert.hlsl" },
+			{ getAssetPath() + "shaders/upscale.frag.hlsl" }
+		};
+		upscaleDescriptorSetLayout = new DescriptorSetLayout({
+			.shaders = upscaleShaders
+		});
+		upscalePipelineLayout = pipelineLayoutCache->get({
+			.layouts = { upscaleDescriptorSetLayout->handle },
+			.shaders = upscaleShaders
+		});
+		// Scene (or history) and bloom
+		upscaleDescriptorPool = new DescriptorPool({
+			.name = "Upscale descriptor pool",
+			.maxSets = getFrameCount(),
+			.poolSizes = {
+				{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 2 * getFrameCount() },
+			}
+		});
+		for (FrameObjects& frame : frameObjects) {
+			frame.upscaleDescriptorSet = new DescriptorSet({
+				.pool = upscaleDescriptorPool,
+				.layouts = { upscaleDescriptorSetLayout->handle }
+			});
 		}
-		fileWatcher->onFileChanged = [=](const std::string filename, const std::vector<void*> userdata) {
-			this->onFileChanged(filename, userdata);
+		VkSamplerCreateInfo upscaleSamplerCI = vks::initializers::samplerCreateInfo();
+		upscaleSamplerCI.magFilter = VK_FILTER_LINEAR;
+		upscaleSamplerCI.minFilter = VK_FILTER_LINEAR;
+		upscaleSamplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		upscaleSamplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		upscaleSamplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		upscaleSamplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		upscaleSamplerCI.maxAnisotropy = 1.0f;
+		upscaleSampler = VulkanContext::samplerCache->get(upscaleSamplerCI);
+
+		// Temporal anti-aliasing resolve, the history is only created once temporal anti-aliasing is enabled
+		const std::vector<ShaderReference> temporalResolveShaders = {
+			{ getAssetPath() + "shaders/taa_resolve.comp.hlsl" }
 		};
-		fileWatcher->start();
-
-		// @todo
-		if (backgroundMusic.openFromFile(getAssetPath() + "music/singularity_calm.mp3")) {
-			backgroundMusic.setVolume(30);
-			backgroundMusic.play();
-		} else {
-			std::cout << "Could not load background music track\n";
+		temporalResolveDescriptorSetLayout = new DescriptorSetLayout({
+			.shaders = temporalResolveShaders
+		});
+		temporalResolvePipelineLayout = pipelineLayoutCache->get({
+			.layouts = { temporalResolveDescriptorSetLayout->handle },
+			.shaders = temporalResolveShaders
+		});
+		temporalResolveDescriptorPool = new DescriptorPool({
+			.name = "Temporal resolve descriptor pool",
+			.maxSets = getFrameCount(),
+			.poolSizes = {
+				{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 2 * getFrameCount() },
+				{.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .descriptorCount = getFrameCount() },
+				{.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = getFrameCount() },
+			}
+		});
+		for (FrameObjects& frame : frameObjects) {
+			frame.temporalResolveDescriptorSet = new DescriptorSet({
+				.pool = temporalResolveDescriptorPool,
+				.layouts = { temporalResolveDescriptorSetLayout->handle }
+			});
 		}
-		prepared = true;
-	}
-
-#pragma region PBR
-	void generateCubemaps(vks::TextureCubeMap* source)
-	{
-		enum Target { IRRADIANCE = 0, RADIANCE = 1 };
-
-		for (uint32_t target = 0; target < RADIANCE + 1; target++) {
-
-			vks::TextureCubeMap* cubemap = new vks::TextureCubeMap();
-
-			auto tStart = std::chrono::high_resolution_clock::now();
-
-			VkFormat format;
-			uint32_t dim;
+		pipelineNames.push_back("taa_resolve");
+		pipelineCreateInfos.push_back({
+			.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+			.shaders = {
+				getAssetPath() + "shaders/taa_resolve.comp.hlsl"
+			},
+			.cache = pipelineCache,
+			.layout = *temporalResolvePipelineLayout,
+			.enableHotReload = true
+		});
 
-			switch (target) {
-			case IRRADIANCE:
-				format = VK_FORMAT_R32G32B32A32_SFLOAT;
-				dim = 64;
-				break;
-			case RADIANCE:
-				format = VK_FORMAT_R16G16B16A16_SFLOAT;
-				dim = 512;
-				break;
+		// Visibility buffer shading, the passes share a layout with the scene's sets and their own set of targets, pixel lists and the frame's draws
+		if (visibilityBufferSupported()) {
+			const std::vector<ShaderReference> visibilityShaders = {
+				{ getAssetPath() + "shaders/visibility_classify.comp.hlsl" },
+				{ getAssetPath() + "shaders/visibility_bins.comp.hlsl" },
+				{ getAssetPath() + "shaders/visibility_scatter.comp.hlsl" },
+				{ getAssetPath() + "shaders/visibility_shade.comp.hlsl" },
+				{ getAssetPath() + "shaders/visibility_composite.frag.hlsl" }
 			};
-
-			const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
-
-			Device* device = VulkanContext::device;
-
-			// Create target cubemap
-			// Image
-			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
-			imageCI.imageType = VK_IMAGE_TYPE_2D;
-			imageCI.format = format;
-			imageCI.extent.width = dim;
-			imageCI.extent.height = dim;
-			imageCI.extent.depth = 1;
-			imageCI.mipLevels = numMips;
-			imageCI.arrayLayers = 6;
-			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-			imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-			imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &cubemap->image));
-			VkMemoryRequirements memReqs;
-			vkGetImageMemoryRequirements(device->logicalDevice, cubemap->image, &memReqs);
-			VkMemoryAllocateInfo memAllocInfo{};
-			memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &cubemap->deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, cubemap->image, cubemap->deviceMemory, 0));
-
-			// View
-			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
-			viewCI.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-			viewCI.format = format;
-			viewCI.subresourceRange = {};
-			viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			viewCI.subresourceRange.levelCount = numMips;
-			viewCI.subresourceRange.layerCount = 6;
-			viewCI.image = cubemap->image;
-			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &cubemap->view));
-
-			VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
-			samplerCI.magFilter = VK_FILTER_LINEAR;
-			samplerCI.minFilter = VK_FILTER_LINEAR;
-			samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-			samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-			samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-			samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-			samplerCI.minLod = 0.0f;
-			samplerCI.maxLod = static_cast<float>(numMips);
-			samplerCI.maxAnisotropy = 1.0f;
-			samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-			VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &cubemap->sampler));
-
-			// Create offscreen framebuffer
-			Image* offscreen = new Image({
-				.name = "Offscreen cubemap generation image",
-				.type = VK_IMAGE_TYPE_2D,
-				.format = format,
-				.extent = {
-					.width = dim,
-					.height = dim,
-					.depth = 1 
-				},
-				.tiling = VK_IMAGE_TILING_OPTIMAL,
-				.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
-			});
-
-			ImageView* offscreenView = new ImageView(offscreen);
-
-			// Descriptors
-			DescriptorPool* descriptorPool = new DescriptorPool({
-				.maxSets = 1,
-				.poolSizes = {
-					{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1 },
-				}
+			visibility.descriptorSetLayout = new DescriptorSetLayout({
+				.shaders = visibilityShaders,
+				.set = 2
 			});
-
-			DescriptorSetLayout* descriptorSetLayout = new DescriptorSetLayout({
-				.bindings = {
-					{.binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT }
-				}
+			visibility.pipelineLayout = pipelineLayoutCache->get({
+				.layouts = { descriptorSetLayout->handle, descriptorSetLayoutTextures->handle, visibility.descriptorSetLayout->handle },
+				.shaders = visibilityShaders
 			});
-
-			DescriptorSet* descriptorSet = new DescriptorSet({
-				.pool = descriptorPool,
-				.layouts = { descriptorSetLayout->handle },
-				.descriptors = {
-					{.dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &source->descriptor }
+			visibility.descriptorPool = new DescriptorPool({
+				.name = "Visibility buffer descriptor pool",
+				.maxSets = getFrameCount(),
+				.poolSizes = {
+					{.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .descriptorCount = 2 * getFrameCount() },
+					{.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 4 * getFrameCount() },
+					{.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = getFrameCount() },
 				}
 			});
-
-			struct PushBlockIrradiance {
-				glm::mat4 mvp;
-				float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
-				float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
-			} pushBlockIrradiance;
-
-			struct PushBlockPrefilterEnv {
-				glm::mat4 mvp;
-				float roughness = 0.0f;
-				uint32_t numSamples = 32u;
-			} pushBlockPrefilterEnv;
-
-			const uint32_t pushConstSize = static_cast<uint32_t>((target == IRRADIANCE ? sizeof(PushBlockIrradiance) : sizeof(PushBlockPrefilterEnv)));
-			PipelineLayout* pipelineLayout = new PipelineLayout({
-				.layouts = { descriptorSetLayout->handle },
-				.pushConstantRanges = {
-					{ .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, .offset = 0, .size = pushConstSize }
-				}
+			// Cleared by each frame before binning, the shading dispatch is sized by the GPU
+			visibility.bins = new Buffer({
+				.name = "Visibility bins",
+				.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				.size = sizeof(uint32_t) * visibilityBinCount,
+				.map = false
 			});
-
-			std::string vertexShader = "filtercube.vert.hlsl";
-			std::string fragmentShader = (target == IRRADIANCE ? "filtercube_irradiance.frag.hlsl" : "filtercube_radiance.frag.hlsl");
-
-			// Pipeline
-			Pipeline* pipeline = new Pipeline({
+			createVisibilityPixels();
+			for (FrameObjects& frame : frameObjects) {
+				frame.visibilityDrawBuffer = new Buffer({
+					.name = "Visibility draws",
+					.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+					.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					.size = sizeof(VisibilityDraw) * maxDrawCommands,
+					.memoryUsage = BufferMemoryUsage::HostWriteDeviceRead
+				});
+				// Written once the targets are known, see updateVisibilityDescriptors
+				frame.visibilityDescriptorSet = new DescriptorSet({
+					.pool = visibility.descriptorPool,
+					.layouts = { visibility.descriptorSetLayout->handle }
+				});
+			}
+			for (const char* name : { "visibility_classify", "visibility_bins", "visibility_scatter", "visibility_shade" }) {
+				pipelineNames.push_back(name);
+				pipelineCreateInfos.push_back({
+					.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+					.shaders = {
+						getAssetPath() + "shaders/" + name + ".comp.hlsl"
+					},
+					.specializationConstants = { { 0, static_cast<uint32_t>(sizeof(vkglTF::CompactVertex)) } },
+					.cache = pipelineCache,
+					.layout = *visibility.pipelineLayout,
+					.enableHotReload = true
+				});
+			}
+			// Drawn by the scene pass before the forward shaded geometry, depth has already been written by the visibility pass
+			pipelineNames.push_back("visibility_composite");
+			pipelineCreateInfos.push_back({
 				.shaders = {
-					getAssetPath() + "shaders/" + vertexShader,
-					getAssetPath() + "shaders/" + fragmentShader
+					getAssetPath() + "shaders/fullscreen.vert.hlsl",
+					getAssetPath() + "shaders/visibility_composite.frag.hlsl"
 				},
 				.cache = pipelineCache,
-				.layout = pipelineLayout->handle,
-				.vertexInput = vkglTF::vertexInput,
+				.layout = *visibility.pipelineLayout,
 				.inputAssemblyState = {
 					.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
 				},
@@ -684,7 +2989,7 @@ public:
 				.rasterizationState = {
 					.polygonMode = VK_POLYGON_MODE_FILL,
 					.cullMode = VK_CULL_MODE_NONE,
-					.frontFace = VK_FRONT_FACE_CLOCKWISE,
+					.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
 					.lineWidth = 1.0f
 				},
 				.multisampleState = {
@@ -693,322 +2998,4245 @@ public:
 				.depthStencilState = {
 					.depthTestEnable = VK_FALSE,
 					.depthWriteEnable = VK_FALSE,
-					.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+					.depthCompareOp = VK_COMPARE_OP_ALWAYS,
+				},
+				.blending = {
+					.attachments = { blendAttachmentState }
+				},
+				.dynamicState = {
+					DynamicState::Scissor,
+					DynamicState::Viewport
+				},
+				.pipelineRenderingInfo = pipelineRenderingCreateInfo,
+				.enableHotReload = true
+			});
+		}
+
+		// Post processing bloom chain, the levels are transient images of the render graph
+		if (settings.postProcessing) {
+			const std::vector<ShaderReference> bloomDownsampleShaders = { { getAssetPath() + "shaders/bloom_downsample.comp.hlsl" } };
+			const std::vector<ShaderReference> bloomUpsampleShaders = { { getAssetPath() + "shaders/bloom_upsample.comp.hlsl" } };
+			// Both shaders have the same bindings
+			bloomDescriptorSetLayout = new DescriptorSetLayout({
+				.shaders = bloomDownsampleShaders
+			});
+			bloomDownsamplePipelineLayout = pipelineLayoutCache->get({
+				.layouts = { bloomDescriptorSetLayout->handle },
+				.shaders = bloomDownsampleShaders
+			});
+			bloomUpsamplePipelineLayout = pipelineLayoutCache->get({
+				.layouts = { bloomDescriptorSetLayout->handle },
+				.shaders = bloomUpsampleShaders
+			});
+			const uint32_t bloomSetCount = getFrameCount() * (2 * bloomLevelCount - 1);
+			bloomDescriptorPool = new DescriptorPool({
+				.name = "Bloom descriptor pool",
+				.maxSets = bloomSetCount,
+				.poolSizes = {
+					{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = bloomSetCount },
+					{.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = bloomSetCount },
+				}
+			});
+			for (FrameObjects& frame : frameObjects) {
+				for (uint32_t i = 0; i < 2 * bloomLevelCount - 1; i++) {
+					frame.bloomDescriptorSets.push_back(new DescriptorSet({
+						.pool = bloomDescriptorPool,
+						.layouts = { bloomDescriptorSetLayout->handle }
+					}));
+				}
+			}
+			pipelineNames.push_back("bloom_downsample");
+			pipelineCreateInfos.push_back({
+				.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+				.shaders = {
+					getAssetPath() + "shaders/bloom_downsample.comp.hlsl"
+				},
+				.cache = pipelineCache,
+				.layout = *bloomDownsamplePipelineLayout,
+				.enableHotReload = true
+			});
+			pipelineNames.push_back("bloom_upsample");
+			pipelineCreateInfos.push_back({
+				.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+				.shaders = {
+					getAssetPath() + "shaders/bloom_upsample.comp.hlsl"
+				},
+				.cache = pipelineCache,
+				.layout = *bloomUpsamplePipelineLayout,
+				.enableHotReload = true
+			});
+		}
+
+		// Uses the same attachments as the scene passes, so the overlay can be drawn in the same pass
+		// Always writes to the swap chain, so with post processing its color format differs from the scene pipelines
+		VkPipelineRenderingCreateInfo upscaleRenderingCreateInfo = pipelineRenderingCreateInfo;
+		upscaleRenderingCreateInfo.pColorAttachmentFormats = &swapChain->colorFormat;
+		pipelineNames.push_back("upscale");
+		pipelineCreateInfos.push_back({
+			.shaders = {
+				getAssetPath() + "shaders/fullscreen.vert.hlsl",
+				getAssetPath() + "shaders/upscale.frag.hlsl"
+			},
+			.specializationConstants = { { 0, settings.postProcessing ? VK_TRUE : VK_FALSE } },
+			.cache = pipelineCache,
+			.layout = *upscalePipelineLayout,
+			.inputAssemblyState = {
+				.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+			},
+			.viewportState = {
+				.viewportCount = 1,
+				.scissorCount = 1
+			},
+			.rasterizationState = {
+				.polygonMode = VK_POLYGON_MODE_FILL,
+				.cullMode = VK_CULL_MODE_NONE,
+				.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+				.lineWidth = 1.0f
+			},
+			.multisampleState = {
+				.rasterizationSamples = settings.sampleCount,
+			},
+			.depthStencilState = {
+				.depthTestEnable = VK_FALSE,
+				.depthWriteEnable = VK_FALSE,
+				.depthCompareOp = VK_COMPARE_OP_ALWAYS,
+			},
+			.blending = {
+				.attachments = { blendAttachmentState }
+			},
+			.dynamicState = {
+				DynamicState::Scissor,
+				DynamicState::Viewport
+			},
+			.pipelineRenderingInfo = upscaleRenderingCreateInfo,
+			.enableHotReload = true
+		});
+
+		// Sun shadows can be traced against the actors' acceleration structures, which needs the variants of the shading shaders declaring them
+		if (vulkanDevice->hasRayQuery) {
+			const std::array<std::string, 2> shadingShaders = { getAssetPath() + "shaders/gltf.frag.hlsl", getAssetPath() + "shaders/visibility_shade.comp.hlsl" };
+			auto addRayQuery = [&shadingShaders](PipelineCreateInfo& createInfo) {
+				for (const std::string& shader : shadingShaders) {
+					if (std::find(createInfo.shaders.begin(), createInfo.shaders.end(), shader) != createInfo.shaders.end()) {
+						createInfo.defines.push_back("RAY_QUERY");
+					}
+				}
+			};
+			for (PipelineCreateInfo& createInfo : pipelineCreateInfos) {
+				addRayQuery(createInfo);
+			}
+			addRayQuery(*skinnedPipelineCreateInfo);
+		}
+		// Pipelines with shading or post processing shaders do their color math in 16 bit floats, see includes/half_precision.hlsl
+		// Added after the ray query define, as bundled variants are looked up with their defines in order
+		if (settings.halfPrecision && vulkanDevice->hasShaderFloat16) {
+			const std::array<std::string, 5> halfPrecisionShaders = {
+				getAssetPath() + "shaders/gltf.frag.hlsl",
+				getAssetPath() + "shaders/visibility_shade.comp.hlsl",
+				getAssetPath() + "shaders/upscale.frag.hlsl",
+				getAssetPath() + "shaders/bloom_downsample.comp.hlsl",
+				getAssetPath() + "shaders/bloom_upsample.comp.hlsl"
+			};
+			auto addHalfPrecision = [&halfPrecisionShaders](PipelineCreateInfo& createInfo) {
+				for (const std::string& shader : halfPrecisionShaders) {
+					if (std::find(createInfo.shaders.begin(), createInfo.shaders.end(), shader) != createInfo.shaders.end()) {
+						createInfo.defines.push_back("HALF_PRECISION");
+						return;
+					}
+				}
+			};
+			for (PipelineCreateInfo& createInfo : pipelineCreateInfos) {
+				addHalfPrecision(createInfo);
+			}
+			addHalfPrecision(*skinnedPipelineCreateInfo);
+		}
+
+		// Graphics pipelines are linked from shared parts if supported, so variants and hot reloads only need to create the parts that differ
+		if (vulkanDevice->hasGraphicsPipelineLibrary) {
+			pipelineLibrary = new PipelineLibrary();
+			for (PipelineCreateInfo& createInfo : pipelineCreateInfos) {
+				createInfo.library = pipelineLibrary;
+			}
+			skinnedPipelineCreateInfo->library = pipelineLibrary;
+		}
+
+		{
+			StartupProfiler::Scope startupScope("Pipeline creation");
+			std::vector<Pipeline*> createdPipelines = Pipeline::createPipelines(pipelineCreateInfos, *jobSystem);
+			for (size_t i = 0; i < createdPipelines.size(); i++) {
+				pipelines[pipelineNames[i]] = createdPipelines[i];
+			}
+		}
+
+		//ship = actorManager->addActor("playership", {
+		//	.position = glm::vec3(0.0f),
+		//	.rotation = glm::vec3(0.0f),
+		//	.scale = glm::vec3(0.5f),
+		//	.model = assetManager->models["spaceship"]
+		//});
+
+		//actorManager->addActor("orientation_crate", {
+		//	.position = glm::vec3(0.0f, 0.0f, -15.0f),
+		//	.rotation = glm::vec3(0.0f),
+		//	.scale = glm::vec3(0.5f),
+		//	.model = assetManager->models["crate"],
+		//});
+
+		// Benchmarks and replays need the same asteroid field in every run, so they never start from a snapshot
+		SimulationSnapshotReader snapshotReader;
+		const bool restoreSnapshot = !settings.snapshotFile.empty() && !benchmark.active && !inputRecorder.isReplaying() && snapshotReader.read(settings.snapshotFile);
+		const ModelHandle asteroidModel = assetManager->findModel("asteroid");
+		asteroidField = new vks::SectorStreamer<AsteroidSector>(*jobSystem, {
+			.sectorSize = asteroidSectorSize,
+			// Sectors streamed in after a restore need to match the ones around them
+			.seed = restoreSnapshot ? snapshotReader.getSeed() : getRandomSeed(),
+			.generate = [asteroidModel](glm::ivec2 coord, uint64_t seed, AsteroidSector& sector) { generateAsteroidSector(coord, seed, asteroidModel, sector); },
+			.load = [](glm::ivec2, AsteroidSector& sector) {
+				sector.actors.reserve(sector.createInfos.size());
+				for (const ActorCreateInfo& createInfo : sector.createInfos) {
+					sector.actors.push_back(actorManager->addActor("", createInfo));
+				}
+				std::vector<ActorCreateInfo>().swap(sector.createInfos);
+			},
+			.release = [](glm::ivec2, AsteroidSector& sector) {
+				for (const ActorHandle& handle : sector.actors) {
+					actorManager->removeActor(handle);
+				}
+			}
+		});
+		if (restoreSnapshot) {
+			StartupProfiler::Scope startupScope("Snapshot restore");
+			for (const SnapshotSector& snapshotSector : snapshotReader.getSectors()) {
+				AsteroidSector sector;
+				snapshotReader.restoreSector(snapshotSector, *actorManager, sector.actors);
+				asteroidField->addLoaded(snapshotSector.coord, std::move(sector));
+			}
+			std::cout << "Restored " << snapshotReader.getActorCount() << " actors in " << snapshotReader.getSectors().size() << " sectors from " << settings.snapshotFile << "\n";
+			snapshotReader.release();
+		}
+		// Only generates the sectors in range that weren't restored
+		asteroidField->update(glm::vec3(glm::inverse(camera.matrices.view)[3]), true);
+
+		actorManager->addActor("moon", {
+			.position = glm::vec3(0.0f, 0.0f, 0.0f),
+			.rotation = glm::vec3(0.0f),
+			.scale = glm::vec3(5.0f),
+			.model = assetManager->findModel("moon"),
+			.tag = "moon"
+		});
+
+		// Streamed asteroids come and go, storage for as many actors as can be drawn is reserved up front so loading sectors doesn't reallocate the actor arrays
+		actorManager->reserve(instanceCapacity);
+		// Created after the scene's actors, so the storage it reserves isn't used up by them
+		bulletPool = new ActorPool(actorManager, {
+			.tag = "bullet",
+			.model = bulletModel,
+			.scale = glm::vec3(0.5f),
+			.capacity = 64,
+			.maxLifetime = 10.0f,
+			.maxDistance = 1000.0f
+		});
+		// Each bullet hits at most once, so a step can't have more impacts than the pool has bullets
+		bulletImpacts.reserve(64);
+
+		pipelineList.push_back(pipelines["skybox"]);
+		pipelineList.push_back(pipelines["skybox_fullscreen"]);
+		pipelineList.push_back(pipelines["playership"]);
+		pipelineList.push_back(pipelines["gltf"]);
+		pipelineList.push_back(pipelines["gltf_instanced"]);
+		if (pipelines.contains("gltf_pulled")) {
+			pipelineList.push_back(pipelines["gltf_pulled"]);
+		}
+		pipelineList.push_back(pipelines["depth"]);
+		pipelineList.push_back(pipelines["depth_instanced"]);
+		pipelineList.push_back(pipelines["shadow"]);
+		pipelineList.push_back(pipelines["cull"]);
+		pipelineList.push_back(pipelines["depthreduce"]);
+		pipelineList.push_back(pipelines["simulate"]);
+		pipelineList.push_back(pipelines["light_cull"]);
+		pipelineList.push_back(pipelines["upscale"]);
+		pipelineList.push_back(pipelines["taa_resolve"]);
+		if (settings.postProcessing) {
+			pipelineList.push_back(pipelines["bloom_downsample"]);
+			pipelineList.push_back(pipelines["bloom_upsample"]);
+		}
+		pipelineList.push_back(pipelines["impostor"]);
+		for (const char* name : { "particle_emit", "particle_args", "particle_simulate", "particle_sort", "particle_additive", "particle_blended" }) {
+			pipelineList.push_back(pipelines[name]);
+		}
+		if (vulkanDevice->hasMeshShaders) {
+			pipelineList.push_back(pipelines["gltf_mesh"]);
+		}
+		if (visibilityBufferSupported()) {
+			for (const char* name : { "visibility", "visibility_classify", "visibility_bins", "visibility_scatter", "visibility_shade", "visibility_composite" }) {
+				pipelineList.push_back(pipelines[name]);
+			}
+		}
+
+		scenePipelines = {
+			.skybox = pipelines["skybox"],
+			.skyboxFullscreen = pipelines["skybox_fullscreen"],
+			.gltf = pipelines["gltf"],
+			.gltfInstanced = pipelines["gltf_instanced"],
+			.gltfPulled = pipelines.contains("gltf_pulled") ? pipelines["gltf_pulled"] : nullptr,
+			.depth = pipelines["depth"],
+			.depthInstanced = pipelines["depth_instanced"],
+			.gltfMesh = vulkanDevice->hasMeshShaders ? pipelines["gltf_mesh"] : nullptr,
+			.cull = pipelines["cull"],
+			.depthReduce = pipelines["depthreduce"],
+			.depthReduceMultisample = pipelines.contains("depthreduce_multisample") ? pipelines["depthreduce_multisample"] : nullptr,
+			.simulate = pipelines["simulate"],
+			.upscale = pipelines["upscale"],
+			.temporalResolve = pipelines["taa_resolve"],
+			.bloomDownsample = settings.postProcessing ? pipelines["bloom_downsample"] : nullptr,
+			.bloomUpsample = settings.postProcessing ? pipelines["bloom_upsample"] : nullptr,
+			.impostor = pipelines["impostor"],
+			.impostorBake = pipelines["impostor_bake"],
+			.particleEmit = pipelines["particle_emit"],
+			.particleArgs = pipelines["particle_args"],
+			.particleSimulate = pipelines["particle_simulate"],
+			.particleSort = pipelines["particle_sort"],
+			.particleAdditive = pipelines["particle_additive"],
+			.particleBlended = pipelines["particle_blended"],
+			.lightCull = pipelines["light_cull"],
+			.shadow = pipelines["shadow"],
+		};
+		if (visibilityBufferSupported()) {
+			scenePipelines.visibility = pipelines["visibility"];
+			scenePipelines.visibilityClassify = pipelines["visibility_classify"];
+			scenePipelines.visibilityBins = pipelines["visibility_bins"];
+			scenePipelines.visibilityScatter = pipelines["visibility_scatter"];
+			scenePipelines.visibilityShade = pipelines["visibility_shade"];
+			scenePipelines.visibilityComposite = pipelines["visibility_composite"];
+		}
+
+		for (auto& pipeline : pipelineList) {
+			fileWatcher->addPipeline(pipeline);
+		}
+		pipelineVariants = new PipelineVariantCache();
+		pipelineVariants->onVariantCreated = [this](Pipeline* pipeline) {
+			if (pipeline->initialCreateInfo) {
+				fileWatcher->addPipeline(pipeline);
+			}
+		};
+		fileWatcher->onFileChanged = [=](const std::string filename, const std::vector<void*> userdata) {
+			this->onFileChanged(filename, userdata);
+		};
+		fileWatcher->start();
+
+		audioManager->playMusic(getAssetPath() + "music/singularity_calm.mp3", 30.0f);
+		taskScheduler->spawn(loadEnvironment());
+		prepared = true;
+
+		if (settings.primitivesBenchmarkCount > 0) {
+			runPrimitivesBenchmark(settings.primitivesBenchmarkCount);
+		}
+	}
+
+	// Checks the GPU scan, compaction and sort against their CPU references once and exits, for validating the primitives on new devices and drivers
+	void runPrimitivesBenchmark(uint32_t count)
+	{
+		if (!GpuPrimitives::isSupported(*vulkanDevice)) {
+			std::cerr << "GPU primitives are not supported by " << vulkanDevice->properties.deviceName << "\n";
+		} else {
+			GpuPrimitives primitives({ .shaderPath = getAssetPath() + "shaders/", .pipelineCache = pipelineCache, .maxElementCount = std::max(count, 1u << 20) });
+			std::cout << "GPU primitives with " << count << " elements on " << vulkanDevice->properties.deviceName << "\n";
+			for (const GpuPrimitivesBenchmarkResult& result : runGpuPrimitivesBenchmark(primitives, commandPool, queue, count)) {
+				std::cout << std::left << std::setw(16) << result.name << (result.valid ? "valid  " : "INVALID") << " GPU " << std::fixed << std::setprecision(3) << result.gpuTime << " ms, CPU reference " << result.cpuReferenceTime << " ms\n";
+			}
+		}
+		if (window) {
+			window->close();
+		}
+		exitRequested = true;
+	}
+
+#pragma region PBR
+	// 64-bit FNV-1a, for the cache key of the prefiltered cubemaps
+	static void hashBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+	}
+
+	static bool hashFile(uint64_t& hash, const std::string& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+		const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		hashBytes(hash, contents.data(), contents.size());
+		return true;
+	}
+
+	// Stores all faces and mips of a prefiltered cubemap from a tightly packed readback (mip after mip, with all faces of a mip in order) as a KTX file
+	// Written to a temporary file first, so an interrupted write never leaves a corrupt cache entry
+	void writeCubemapCache(const std::filesystem::path& path, uint32_t glInternalFormat, uint32_t dim, uint32_t numMips, uint32_t texelSize, const uint8_t* data)
+	{
+		ktxTextureCreateInfo createInfo{
+			.glInternalformat = glInternalFormat,
+			.baseWidth = dim,
+			.baseHeight = dim,
+			.baseDepth = 1,
+			.numDimensions = 2,
+			.numLevels = numMips,
+			.numLayers = 1,
+			.numFaces = 6,
+			.isArray = KTX_FALSE,
+			.generateMipmaps = KTX_FALSE
+		};
+		ktxTexture* texture;
+		if (ktxTexture_Create(&createInfo, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture) != KTX_SUCCESS) {
+			std::cerr << "Could not create cubemap cache texture " << path << std::endl;
+			return;
+		}
+		VkDeviceSize offset = 0;
+		for (uint32_t m = 0; m < numMips; m++) {
+			const uint32_t size = std::max(dim >> m, 1u);
+			const ktx_size_t faceSize = static_cast<ktx_size_t>(size) * size * texelSize;
+			for (uint32_t f = 0; f < 6; f++) {
+				ktxTexture_SetImageFromMemory(texture, m, 0, f, data + offset, faceSize);
+				offset += faceSize;
+			}
+		}
+		std::error_code ec;
+		std::filesystem::create_directories(path.parent_path(), ec);
+		std::filesystem::path tempPath = path;
+		tempPath += ".tmp";
+		if (ktxTexture_WriteToNamedFile(texture, tempPath.string().c_str()) == KTX_SUCCESS) {
+			std::filesystem::rename(tempPath, path, ec);
+		}
+		if (ec) {
+			std::cerr << "Could not write cubemap cache " << path << std::endl;
+		}
+		ktxTexture_Destroy(texture);
+	}
+
+	// Irradiance and radiance cubemaps are filtered with compute shaders that write all faces of a mip level through a storage view
+	// All mips of both targets are dispatched in a single submission, as they only read the source cubemap
+	// Results are cached as KTX files, keyed by the source texture, the filter shaders and the filter parameters
+	// Reading the cache, compiling the filter pipelines and writing the cache run on workers and the filtering isn't waited for, so the main thread keeps rendering frames
+	// Always finishes on the main thread, the memory and profiler scopes only cover the parts between suspensions as they track the calling thread
+	vks::Task generateCubemaps(vks::TextureCubeMap* source, std::string sourceFilename)
+	{
+		enum Target { IRRADIANCE = 0, RADIANCE = 1 };
+
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		Device* device = VulkanContext::device;
+
+		// Also declared as the storage image formats of the filter shaders
+		const VkFormat filterFormats[] = { VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT };
+		// GL_RGBA32F and GL_RGBA16F, the cache is stored in the KTX 1 format supported by the bundled libktx
+		const uint32_t filterGlFormats[] = { 0x8814, 0x881A };
+		const uint32_t filterTexelSizes[] = { 16, 8 };
+		const uint32_t filterDims[] = { 64, 512 };
+		const std::string filterShaders[] = { "filtercube_irradiance.comp.hlsl", "filtercube_radiance.comp.hlsl" };
+		const std::string filterNames[] = { "skybox_irradiance", "skybox_radiance" };
+		uint32_t filterMips[RADIANCE + 1];
+		for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+			filterMips[target] = static_cast<uint32_t>(floor(log2(filterDims[target]))) + 1;
+		}
+
+		// If supported, the descriptors of all mips are written to one descriptor buffer instead of allocating a pool with a set per mip
+		// Otherwise they're pushed per dispatch if push descriptors are supported, the pool is only a fallback
+		const bool useDescriptorBuffer = device->hasDescriptorBuffer;
+		const bool usePushDescriptors = !useDescriptorBuffer && device->hasPushDescriptor;
+
+		DescriptorSetLayout* descriptorSetLayout = new DescriptorSetLayout({
+			.descriptorBuffer = useDescriptorBuffer,
+			.pushDescriptor = usePushDescriptors,
+			.bindings = {
+				{.binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+				{.binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT }
+			}
+		});
+
+		struct PushBlockIrradiance {
+			uint32_t size;
+			float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
+			float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
+		};
+
+		struct PushBlockPrefilterEnv {
+			uint32_t size;
+			float roughness = 0.0f;
+			uint32_t numSamples = 0u;
+		};
+		// The large mips with narrow lobes dominate the filtering time, but with filtered importance sampling they need the fewest samples
+		// A perfect mirror only needs a single one, wider lobes get more samples as their mips are small
+		auto getRadianceSampleCount = [](float roughness) -> uint32_t {
+			if (roughness == 0.0f) {
+				return 1u;
+			}
+			return std::max(static_cast<uint32_t>(64.0f * roughness), 8u);
+		};
+
+		vks::TextureCubeMap* cubemaps[RADIANCE + 1]{};
+		std::filesystem::path cachePaths[RADIANCE + 1];
+		bool cached[RADIANCE + 1];
+		vks::TextureCreateInfo cacheCreateInfos[RADIANCE + 1];
+		vks::TextureData cacheData[RADIANCE + 1];
+		bool readCache{ false };
+		for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+			uint64_t hash = 0xcbf29ce484222325ull;
+			hashBytes(hash, &iblCacheVersion, sizeof(iblCacheVersion));
+			hashFile(hash, sourceFilename);
+			hashFile(hash, getAssetPath() + "shaders/" + filterShaders[target]);
+			hashBytes(hash, &filterFormats[target], sizeof(VkFormat));
+			hashBytes(hash, &filterDims[target], sizeof(uint32_t));
+			if (target == IRRADIANCE) {
+				const PushBlockIrradiance params{};
+				hashBytes(hash, &params.deltaPhi, sizeof(float));
+				hashBytes(hash, &params.deltaTheta, sizeof(float));
+			} else {
+				for (uint32_t m = 0; m < filterMips[target]; m++) {
+					const uint32_t numSamples = getRadianceSampleCount(static_cast<float>(m) / static_cast<float>(filterMips[target] - 1));
+					hashBytes(hash, &numSamples, sizeof(uint32_t));
+				}
+			}
+			char key[17];
+			snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+			cachePaths[target] = iblCacheDirectory / (filterNames[target] + "_" + key + ".ktx");
+			// Spherical harmonics replace the irradiance cube, which then keeps its placeholder and is skipped like a cached one
+			if ((target == IRRADIANCE) && settings.shIrradiance) {
+				cubemaps[target] = nullptr;
+				cached[target] = true;
+				continue;
+			}
+			cached[target] = std::filesystem::exists(cachePaths[target]);
+			if (cached[target]) {
+				cacheCreateInfos[target] = {
+					.filename = cachePaths[target].string(),
+					.format = filterFormats[target],
+					.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+					.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+					.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE
+				};
+				readCache = true;
+			}
+		}
+
+		if (readCache) {
+			co_await taskScheduler->run([&] {
+				MemoryStats::Scope memoryScope(MemoryCategory::Environment);
+				for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+					if (!cacheCreateInfos[target].filename.empty()) {
+						vks::Texture::loadTextureData(cacheCreateInfos[target], cacheData[target]);
+					}
+				}
+			});
+			co_await taskScheduler->onMainThread();
+			MemoryStats::Scope memoryScope(MemoryCategory::Environment);
+			for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+				if (!cacheCreateInfos[target].filename.empty()) {
+					cubemaps[target] = new vks::TextureCubeMap(cacheData[target], cacheCreateInfos[target]);
+					cacheData[target] = {};
+				}
+			}
+		}
+
+		if (cached[IRRADIANCE] && cached[RADIANCE]) {
+			VulkanContext::stagingBuffer->flushTransfers(queue);
+			if (cubemaps[IRRADIANCE]) {
+				replaceTexture(skybox.irradianceIndex, cubemaps[IRRADIANCE]);
+			}
+			replaceTexture(skybox.radianceIndex, cubemaps[RADIANCE]);
+			auto tEnd = std::chrono::high_resolution_clock::now();
+			auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+			std::cout << "Loading cube maps from cache took " << tDiff << " ms" << std::endl;
+			co_return;
+		}
+
+		// Both filter pipelines are created up front in one batch, so their shaders are compiled in parallel
+		PipelineLayout* filterPipelineLayouts[RADIANCE + 1];
+		std::vector<PipelineCreateInfo> filterPipelineCreateInfos;
+		for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+			const uint32_t pushConstSize = static_cast<uint32_t>((target == IRRADIANCE ? sizeof(PushBlockIrradiance) : sizeof(PushBlockPrefilterEnv)));
+			filterPipelineLayouts[target] = new PipelineLayout({
+				.layouts = { descriptorSetLayout->handle },
+				.pushConstantRanges = {
+					{ .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = pushConstSize }
+				}
+			});
+			filterPipelineCreateInfos.push_back({
+				.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+				.shaders = {
+					getAssetPath() + "shaders/" + filterShaders[target]
+				},
+				.cache = pipelineCache,
+				.layout = filterPipelineLayouts[target]->handle,
+				.flags = useDescriptorBuffer ? static_cast<VkPipelineCreateFlags>(VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT) : 0u,
+				.enableHotReload = false
+			});
+		}
+		std::vector<Pipeline*> filterPipelines = co_await taskScheduler->run([&] {
+			StartupProfiler::Scope startupScope("Cubemap filter pipelines");
+			return Pipeline::createPipelines(filterPipelineCreateInfos, *jobSystem);
+		});
+		co_await taskScheduler->onMainThread();
+
+		std::optional<StartupProfiler::Scope> startupScope{ std::in_place, "Cubemap generation" };
+		std::optional<MemoryStats::Scope> memoryScope{ std::in_place, MemoryCategory::Environment };
+
+		// One descriptor set per mip level of each target
+		const uint32_t setCount = filterMips[IRRADIANCE] + filterMips[RADIANCE];
+		DescriptorPool* descriptorPool{ nullptr };
+		DescriptorBuffer* descriptorBuffer{ nullptr };
+		if (useDescriptorBuffer) {
+			const VkDeviceSize alignment = device->descriptorBufferProperties.descriptorBufferOffsetAlignment;
+			descriptorBuffer = new DescriptorBuffer({
+				.name = "Cubemap filter descriptors",
+				.size = setCount * ((descriptorSetLayout->getSize() + alignment - 1) / alignment * alignment),
+				.samplers = true
+			});
+		} else if (!usePushDescriptors) {
+			descriptorPool = new DescriptorPool({
+				.maxSets = setCount,
+				.poolSizes = {
+					{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = setCount },
+					{.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = setCount },
+				}
+			});
+		}
+		std::vector<DescriptorSet*> descriptorSets;
+		std::vector<VkDeviceSize> descriptorOffsets;
+		std::vector<VkDescriptorImageInfo> pushedDestinations;
+		std::vector<VkImageView> mipViews;
+
+		// Filtered cubemaps are copied to host memory for writing them to the cache, mip after mip with all faces of a mip in order
+		Buffer* readbackBuffers[RADIANCE + 1]{};
+		std::vector<VkBufferImageCopy> readbackRegions[RADIANCE + 1];
+
+		CommandBuffer* cb = new CommandBuffer({ .device = *vulkanDevice, .pool = commandPool, .name = "Cubemap generation command buffer" });
+		// Recorded outside of the frame loop, so the scope only shows up as a Tracy GPU zone
+		cb->profiler = gpuProfiler;
+		cb->begin();
+		cb->beginScope("Cubemap generation");
+
+		for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+			if (cached[target]) {
+				continue;
+			}
+			vks::TextureCubeMap* cubemap = new vks::TextureCubeMap();
+			cubemaps[target] = cubemap;
+
+			const VkFormat format = filterFormats[target];
+			const uint32_t dim = filterDims[target];
+			const uint32_t numMips = filterMips[target];
+
+			// Create target cubemap
+			// Image
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = format;
+			imageCI.extent.width = dim;
+			imageCI.extent.height = dim;
+			imageCI.extent.depth = 1;
+			imageCI.mipLevels = numMips;
+			imageCI.arrayLayers = 6;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &cubemap->image));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, cubemap->image, &memReqs);
+			cubemap->allocation = device->memoryAllocator->allocate(memReqs, device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), false);
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, cubemap->image, cubemap->allocation.memory, cubemap->allocation.offset));
+
+			// View
+			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+			viewCI.format = format;
+			viewCI.subresourceRange = {};
+			viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			viewCI.subresourceRange.levelCount = numMips;
+			viewCI.subresourceRange.layerCount = 6;
+			viewCI.image = cubemap->image;
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &cubemap->view));
+
+			VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+			samplerCI.magFilter = VK_FILTER_LINEAR;
+			samplerCI.minFilter = VK_FILTER_LINEAR;
+			samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.minLod = 0.0f;
+			samplerCI.maxLod = VK_LOD_CLAMP_NONE;
+			samplerCI.maxAnisotropy = 1.0f;
+			samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+			cubemap->sampler = VulkanContext::samplerCache->get(samplerCI);
+
+			// All faces and mips are written by the compute shaders, previous contents don't matter
+			const VkImageSubresourceRange cubemapRange{ .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = numMips, .layerCount = 6 };
+			cb->addImageBarrier(cubemap->image, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, cubemapRange);
+
+			VkDeviceSize readbackSize = 0;
+			for (uint32_t m = 0; m < numMips; m++) {
+				const uint32_t size = std::max(dim >> m, 1u);
+				readbackRegions[target].push_back({
+					.bufferOffset = readbackSize,
+					.imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = m, .baseArrayLayer = 0, .layerCount = 6 },
+					.imageExtent = { size, size, 1 }
+				});
+				readbackSize += static_cast<VkDeviceSize>(size) * size * filterTexelSizes[target] * 6;
+			}
+			readbackBuffers[target] = new Buffer({
+				.usageFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				.size = readbackSize,
+				.dedicatedAllocation = true
+			});
+
+			// Storage images can't be accessed through cube views, so each mip level gets an array view over all six faces
+			for (uint32_t m = 0; m < numMips; m++) {
+				VkImageViewCreateInfo mipViewCI = viewCI;
+				mipViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+				mipViewCI.subresourceRange.baseMipLevel = m;
+				mipViewCI.subresourceRange.levelCount = 1;
+				VkImageView mipView;
+				VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &mipViewCI, nullptr, &mipView));
+				mipViews.push_back(mipView);
+
+				VkDescriptorImageInfo destinationDescriptor{ .imageView = mipView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+				if (useDescriptorBuffer) {
+					const VkDeviceSize offset = descriptorBuffer->allocateSet(descriptorSetLayout);
+					descriptorBuffer->writeImage(offset, descriptorSetLayout, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &source->descriptor);
+					descriptorBuffer->writeImage(offset, descriptorSetLayout, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &destinationDescriptor);
+					descriptorOffsets.push_back(offset);
+					continue;
+				}
+				if (usePushDescriptors) {
+					pushedDestinations.push_back(destinationDescriptor);
+					continue;
+				}
+				descriptorSets.push_back(new DescriptorSet({
+					.pool = descriptorPool,
+					.layouts = { descriptorSetLayout->handle },
+					.descriptors = {
+						{.dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &source->descriptor },
+						{.dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .pImageInfo = &destinationDescriptor }
+					}
+				}));
+			}
+		}
+		cb->flushBarriers();
+
+		// Mips don't depend on each other, so the dispatches of both targets can overlap
+		if (useDescriptorBuffer) {
+			cb->bindDescriptorBuffers({ descriptorBuffer });
+		}
+		uint32_t descriptorSetIndex = 0;
+		for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+			if (cached[target]) {
+				continue;
+			}
+			cb->beginScope((target == IRRADIANCE) ? "Irradiance filtering" : "Radiance filtering");
+			PipelineLayout* pipelineLayout = filterPipelineLayouts[target];
+			cb->bindPipeline(filterPipelines[target]);
+			for (uint32_t m = 0; m < filterMips[target]; m++) {
+				const uint32_t size = std::max(filterDims[target] >> m, 1u);
+				switch (target) {
+				case IRRADIANCE: {
+					PushBlockIrradiance pushBlockIrradiance{ .size = size };
+					cb->updatePushConstant(pipelineLayout, 0, &pushBlockIrradiance);
+					break;
+				}
+				case RADIANCE: {
+					const float roughness = (float)m / (float)(filterMips[target] - 1);
+					PushBlockPrefilterEnv pushBlockPrefilterEnv{ .size = size, .roughness = roughness, .numSamples = getRadianceSampleCount(roughness) };
+					cb->updatePushConstant(pipelineLayout, 0, &pushBlockPrefilterEnv);
+					break;
+				}
+				};
+				if (useDescriptorBuffer) {
+					cb->setDescriptorBufferOffset(pipelineLayout, 0, 0, descriptorOffsets[descriptorSetIndex++], VK_PIPELINE_BIND_POINT_COMPUTE);
+				} else if (usePushDescriptors) {
+					cb->pushDescriptorSet(pipelineLayout, 0, {
+						{.dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &source->descriptor },
+						{.dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .pImageInfo = &pushedDestinations[descriptorSetIndex++] }
+					}, VK_PIPELINE_BIND_POINT_COMPUTE);
+				} else {
+					cb->bindDescriptorSets(pipelineLayout, { descriptorSets[descriptorSetIndex++] }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+				}
+				cb->dispatch((size + 7) / 8, (size + 7) / 8, 6);
+			}
+			cb->endScope();
+		}
+
+		for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+			if (!cached[target]) {
+				const VkImageSubresourceRange cubemapRange{ .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = filterMips[target], .layerCount = 6 };
+				cb->addImageBarrier(cubemaps[target]->image, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, cubemapRange);
+			}
+		}
+		cb->beginScope("Cubemap readback");
+		cb->flushBarriers();
+		for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+			if (!cached[target]) {
+				vkCmdCopyImageToBuffer(cb->handle, cubemaps[target]->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffers[target]->buffer, static_cast<uint32_t>(readbackRegions[target].size()), readbackRegions[target].data());
+				const VkImageSubresourceRange cubemapRange{ .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = filterMips[target], .layerCount = 6 };
+				cb->addImageBarrier(cubemaps[target]->image, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, cubemapRange);
+				cb->addBufferBarrier(readbackBuffers[target]->buffer, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+			}
+		}
+		cb->flushBarriers();
+		cb->endScope();
+		cb->endScope();
+		cb->end();
+		const SubmitToken submitToken = cb->submitAsync(queue);
+		// Cached cubemaps have been uploaded through the staging buffer
+		VulkanContext::stagingBuffer->flushTransfers(queue);
+		memoryScope.reset();
+		startupScope.reset();
+
+		co_await taskScheduler->submitted(submitToken);
+		co_await taskScheduler->run([&] {
+			for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+				if (!cached[target]) {
+					writeCubemapCache(cachePaths[target], filterGlFormats[target], filterDims[target], filterMips[target], filterTexelSizes[target], static_cast<const uint8_t*>(readbackBuffers[target]->mapped));
+				}
+			}
+		});
+		co_await taskScheduler->onMainThread();
+
+		memoryScope.emplace(MemoryCategory::Environment);
+		for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+			vks::TextureCubeMap* cubemap = cubemaps[target];
+			if (!cached[target]) {
+				cubemap->descriptor.imageView = cubemap->view;
+				cubemap->descriptor.sampler = cubemap->sampler;
+				cubemap->descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				delete readbackBuffers[target];
+			}
+			if (cubemap) {
+				replaceTexture((target == IRRADIANCE) ? skybox.irradianceIndex : skybox.radianceIndex, cubemap);
+			}
+		}
+
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+		std::cout << "Generating cube maps with " << filterMips[IRRADIANCE] << " and " << filterMips[RADIANCE] << " mip levels took " << tDiff << " ms" << std::endl;
+
+		delete cb;
+		for (DescriptorSet* descriptorSet : descriptorSets) {
+			delete descriptorSet;
+		}
+		delete descriptorPool;
+		delete descriptorBuffer;
+		for (VkImageView mipView : mipViews) {
+			vkDestroyImageView(device->logicalDevice, mipView, nullptr);
+		}
+		for (uint32_t target = 0; target < RADIANCE + 1; target++) {
+			delete filterPipelines[target];
+			delete filterPipelineLayouts[target];
+		}
+		delete descriptorSetLayout;
+	}
+
+	// Projects the skybox into spherical harmonics coefficients for the diffuse environment lighting, which are passed to the shaders with the scene uniforms
+	// A single workgroup reduces all texels, so unlike the irradiance cube this takes next to no time and isn't cached
+	void generateIrradianceSH(vks::TextureCubeMap* source)
+	{
+		StartupProfiler::Scope startupScope("Irradiance SH generation");
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		// Samples per face side, the source is sampled at the mip level closest to that resolution
+		const uint32_t sampleSize = 64;
+		struct PushBlock {
+			uint32_t size;
+			float lod;
+		} pushBlock{
+			.size = sampleSize,
+			.lod = std::clamp(std::log2(static_cast<float>(source->width) / static_cast<float>(sampleSize)), 0.0f, static_cast<float>(source->mipLevels - 1))
+		};
+
+		DescriptorSetLayout* descriptorSetLayout = new DescriptorSetLayout({
+			.bindings = {
+				{.binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+				{.binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT }
+			}
+		});
+		PipelineLayout* pipelineLayout = new PipelineLayout({
+			.layouts = { descriptorSetLayout->handle },
+			.pushConstantRanges = {
+				{ .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(PushBlock) }
+			}
+		});
+		Pipeline* pipeline = new Pipeline({
+			.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+			.shaders = {
+				getAssetPath() + "shaders/irradiance_sh.comp.hlsl"
+			},
+			.cache = pipelineCache,
+			.layout = pipelineLayout->handle,
+			.enableHotReload = false
+		});
+
+		Buffer* coefficientBuffer = new Buffer({
+			.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.size = sizeof(shaderData.irradianceSH)
+		});
+		DescriptorPool* descriptorPool = new DescriptorPool({
+			.maxSets = 1,
+			.poolSizes = {
+				{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1 },
+				{.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1 },
+			}
+		});
+		DescriptorSet* descriptorSet = new DescriptorSet({
+			.pool = descriptorPool,
+			.layouts = { descriptorSetLayout->handle },
+			.descriptors = {
+				{.dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &source->descriptor },
+				{.dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &coefficientBuffer->descriptor }
+			}
+		});
+
+		CommandBuffer* cb = new CommandBuffer({ .device = *vulkanDevice, .pool = commandPool, .name = "Irradiance SH command buffer" });
+		cb->profiler = gpuProfiler;
+		cb->begin();
+		cb->beginScope("Irradiance SH projection");
+		cb->bindPipeline(pipeline);
+		cb->bindDescriptorSets(pipelineLayout, { descriptorSet }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+		cb->updatePushConstant(pipelineLayout, 0, &pushBlock);
+		cb->dispatch(1, 1, 1);
+		cb->addBufferBarrier(coefficientBuffer->buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+		cb->flushBarriers();
+		cb->endScope();
+		cb->end();
+		cb->oneTimeSubmit(queue);
+
+		memcpy(shaderData.irradianceSH, coefficientBuffer->mapped, sizeof(shaderData.irradianceSH));
+
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+		std::cout << "Generating irradiance SH took " << tDiff << " ms" << std::endl;
+
+		delete cb;
+		delete descriptorSet;
+		delete descriptorPool;
+		delete coefficientBuffer;
+		delete pipeline;
+		delete pipelineLayout;
+		delete descriptorSetLayout;
+	}
+
+#pragma endregion PBR
+
+	// CPU frustum culling for all actors through the visibility cache (or the actor manager's spatial grid), stores the visible actors in visibleActorIndices
+	// The bounding spheres are loose, so actors passing them are tested again with their model's bounds, except for animated ones whose poses may leave them
+	// Visible actors with skinned models are moved to skinnedActorIndices, as they can't be drawn by the pipelines of the render paths
+	// Enabled render views are culled together with the main view in a single pass over the spatial grid, with temporal culling only the views are culled by the grid
+	// Needs to be done while the simulation isn't running, the indices refer to the actor snapshot
+	void cullActors()
+	{
+		TraceZoneScopedN("CPU culling");
+		visibleActorIndices.resize(actorManager->size());
+		std::array<vks::Frustum*, maxRenderViews + 1> cullFrustums{};
+		std::array<uint32_t*, maxRenderViews + 1> cullIndices{};
+		std::array<uint32_t, maxRenderViews + 1> cullCounts{};
+		uint32_t cullCount = 0;
+		if (temporalCulling) {
+			visibleActorCount = visibilityCache.cull(frustum, camera.position, actorManager->positions.data(), actorManager->radii.data(), actorManager->size(), visibleActorIndices.data(), 2.0f);
+			TracyPlot("Culling tests", static_cast<int64_t>(visibilityCache.getTestedCount()));
+		} else {
+			visibilityCache.reset();
+			cullFrustums[cullCount] = &frustum;
+			cullIndices[cullCount++] = visibleActorIndices.data();
+		}
+		for (RenderView& view : renderViews) {
+			view.visibleCount = 0;
+			if (view.enabled) {
+				view.visibleIndices.resize(actorManager->size());
+				cullFrustums[cullCount] = &view.frustum;
+				cullIndices[cullCount++] = view.visibleIndices.data();
+			}
+		}
+		if (cullCount > 0) {
+			actorManager->cullFrustums(std::span(cullFrustums.data(), cullCount), std::span(cullIndices.data(), cullCount), std::span(cullCounts.data(), cullCount), 2.0f);
+		}
+		uint32_t cullResult = 0;
+		if (!temporalCulling) {
+			visibleActorCount = cullCounts[cullResult++];
+		}
+		for (RenderView& view : renderViews) {
+			if (view.enabled) {
+				view.visibleCount = cullCounts[cullResult++];
+			}
+		}
+
+		skinnedModelSlots.assign(assetManager->getModelSlotCount(), 0);
+		hasSkinnedModels = false;
+		for (uint32_t slot = 0; slot < assetManager->getModelSlotCount(); slot++) {
+			const ModelHandle handle = assetManager->getModelHandle(slot);
+			if (handle.isSet() && assetManager->getModel(handle)->isSkinned()) {
+				skinnedModelSlots[slot] = 1;
+				hasSkinnedModels = true;
+			}
+		}
+		skinnedActorIndices.clear();
+		// Actors beyond the draw distance are only culled while thermal limits shorten it
+		const float drawDistance = camera.getFarClip() * thermalQuality.getQuality().drawDistanceScale;
+		const bool limitDrawDistance = thermalQuality.getQuality().drawDistanceScale < 1.0f;
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < visibleActorCount; i++) {
+			const uint32_t index = visibleActorIndices[i];
+			if (limitDrawDistance && (glm::distance(actorSnapshot.positions[index], camera.position) - actorSnapshot.radii[index] > drawDistance)) {
+				continue;
+			}
+			if (actorSnapshot.poseOffsets[index] == UINT32_MAX) {
+				const vkglTF::Model* model = assetManager->getModel(actorSnapshot.models[index]);
+				const bool hasBounds = glm::all(glm::lessThanEqual(model->dimensions.min, model->dimensions.max));
+				if (hasBounds && !frustum.checkOrientedBox(actorSnapshot.matrices[index], model->dimensions.min, model->dimensions.max)) {
+					continue;
+				}
+			}
+			if (hasSkinnedModels && skinnedModelSlots[actorSnapshot.models[index].index()]) {
+				skinnedActorIndices.push_back(index);
+			} else {
+				visibleActorIndices[count++] = index;
+			}
+		}
+		visibleActorCount = count;
+
+		// Views draw with the per actor pipeline, which can't draw skinned actors
+		for (RenderView& view : renderViews) {
+			uint32_t viewCount = 0;
+			for (uint32_t i = 0; i < view.visibleCount; i++) {
+				const uint32_t index = view.visibleIndices[i];
+				if (hasSkinnedModels && skinnedModelSlots[actorSnapshot.models[index].index()]) {
+					continue;
+				}
+				if (actorSnapshot.poseOffsets[index] == UINT32_MAX) {
+					const vkglTF::Model* model = assetManager->getModel(actorSnapshot.models[index]);
+					const bool hasBounds = glm::all(glm::lessThanEqual(model->dimensions.min, model->dimensions.max));
+					if (hasBounds && !view.frustum.checkOrientedBox(actorSnapshot.matrices[index], model->dimensions.min, model->dimensions.max)) {
+						continue;
+					}
+				}
+				view.visibleIndices[viewCount++] = index;
+			}
+			view.visibleCount = viewCount;
+		}
+	}
+
+	// Orders the visible actors of the CPU paths by a draw key, so the draw order (and with that the state changes) doesn't depend on the actor manager's order
+	// Key layout from the most significant bit: model slot index (24 bits, per actor path only), view depth of the actor's center quantized to 16 bits over the camera's depth range
+	// All actors use the same pipeline and select their materials through push constants, so the model is the only state that changes between actors
+	// The GPU driven path builds its draws on the GPU, so this only changes the draw order of the CPU paths
+	void sortVisibleActors()
+	{
+		TraceZoneScopedN("Actor sorting");
+		const uint32_t visibleCount = visibleActorCount;
+		actorSortKeys.resize(visibleCount);
+		const bool modelKeys = (renderPath == static_cast<int32_t>(RenderPath::PerActor));
+		const bool depthKeys = sortActors;
+		const glm::mat4 view = camera.matrices.view;
+		const float depthScale = 65535.0f / camera.getFarClip();
+		jobSystem->parallelFor(visibleCount, 1024, [this, modelKeys, depthKeys, view, depthScale](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; i++) {
+				const uint32_t index = visibleActorIndices[i];
+				uint64_t key = 0;
+				if (modelKeys) {
+					key |= static_cast<uint64_t>(actorSnapshot.models[index].index()) << 16;
+				}
+				if (depthKeys) {
+					const glm::vec3& position = actorSnapshot.positions[index];
+					const float depth = std::abs(view[0][2] * position.x + view[1][2] * position.y + view[2][2] * position.z + view[3][2]);
+					key |= static_cast<uint64_t>(std::min(depth * depthScale, 65535.0f));
+				}
+				actorSortKeys[i] = key;
+			}
+		});
+		actorSort.sort(visibleActorIndices.data(), actorSortKeys.data(), visibleCount, 16 + ModelHandle::indexBits);
+	}
+
+	// Advances the CPU simulation and the actors, runs as a background job with a pipelined simulation
+	void stepSimulation(float deltaTime)
+	{
+		TraceZoneScopedN("Simulation");
+		// Bullets are destroyed on impact, handles are collected first as removing actors changes the dense indices
+		auto removeHitBullets = [this] {
+			for (const ActorHandle& handle : hitBullets) {
+				actorManager->removeActor(handle);
+			}
+			hitBullets.clear();
+		};
+		bulletImpacts.clear();
+		// Bullets travel several times their size per step, so their paths are swept before they're moved instead of relying on overlaps after the step
+		bulletHits.detect(*actorManager, bulletPool->getHandles(), bulletTag, deltaTime);
+		for (const ProjectileHit& hit : bulletHits.getHits()) {
+			hitBullets.push_back(hit.projectile);
+			bulletImpacts.push_back(hit.position);
+		}
+		removeHitBullets();
+		// Removing bullets changes the dense indices, so the actors owned by the GPU simulation are flagged right before the step
+		gpuSimulatedActors.assign(simulatedActors.empty() ? 0 : actorManager->size(), 0);
+		for (const ActorHandle& handle : simulatedActors) {
+			if (actorManager->isValid(handle)) {
+				gpuSimulatedActors[actorManager->getIndex(handle)] = 1;
+			}
+		}
+		simulation->step(*actorManager, *jobSystem, deltaTime, gpuSimulatedActors);
+		// Actors moving into a bullet are only found by the simulation's contacts
+		for (const RigidBodyContact& contact : simulation->getContacts()) {
+			for (const uint32_t index : { contact.a, contact.b }) {
+				if (actorManager->tags[index] == bulletTag) {
+					hitBullets.push_back(actorManager->getHandle(index));
+					bulletImpacts.push_back(actorManager->positions[index]);
+				}
+			}
+		}
+		removeHitBullets();
+		bulletPool->update(deltaTime);
+		jobSystem->parallelFor(actorManager->size(), 1024, [](uint32_t first, uint32_t count) {
+			actorManager->updateTransforms(first, count);
+		});
+	}
+
+	// Picking is done on the host against the actors' bounds, so it doesn't need to read anything back from the device
+	// Asteroids moved by the GPU simulation are picked at the position of the last body readback
+	void updateHoveredActor()
+	{
+		hoveredActor = {};
+		const glm::vec2 ndc = camera.mouse.cursorPosNDC * 2.0f - 1.0f;
+		const glm::vec4 point = glm::inverse(camera.matrices.perspective * camera.matrices.view) * glm::vec4(ndc, 0.5f, 1.0f);
+		const glm::vec3 direction = glm::normalize(glm::vec3(point) / point.w - renderOrigin);
+		const uint32_t index = actorManager->raycast(renderOrigin, direction, camera.getFarClip(), &hoveredActorDistance);
+		if (index != UINT32_MAX) {
+			hoveredActor = actorManager->getHandle(index);
+		}
+	}
+
+	// All paths clamp their instances to instanceCapacity, so this is the only place that notices actors going missing
+	// Only reported once the capacity can't grow anymore, below that actors spawned by this frame's step are drawn after the next frame's growth
+	void checkInstanceCapacity()
+	{
+		const uint32_t actorCount = actorSnapshot.size();
+		if ((actorCount > instanceCapacity) && (instanceCapacity >= maxInstanceCapacity) && !instanceOverflowReported) {
+			const std::string message = std::to_string(actorCount) + " actors exceed the max. instance capacity of " + std::to_string(instanceCapacity) + ", " + std::to_string(actorCount - instanceCapacity) + " of them aren't drawn";
+			std::cerr << message << "\n";
+			TracyMessage(message.c_str(), message.size());
+			instanceOverflowReported = true;
+		} else if (actorCount <= instanceCapacity) {
+			instanceOverflowReported = false;
+		}
+	}
+
+	// Actors must not be accessed by the main thread while the simulation job is running
+	void waitForSimulation()
+	{
+		if (simulationJob) {
+			TraceZoneScopedN("Wait for simulation");
+			jobSystem->wait(simulationJob);
+		}
+	}
+
+	// Captures the asteroid field's actors in intervals, needs to be called while the simulation isn't running
+	void updateSnapshot()
+	{
+		if (settings.snapshotFile.empty() || benchmark.active || inputRecorder.isReplaying()) {
+			return;
+		}
+		snapshotTimer -= frameTimer;
+		if (snapshotTimer > 0.0f) {
+			return;
+		}
+		// The previous snapshot is still being written, capturing is retried with the next frame
+		if (snapshotJob) {
+			if (!jobSystem->isFinished(snapshotJob)) {
+				return;
+			}
+			delete snapshotJob;
+			snapshotJob = nullptr;
+		}
+		TraceZoneScopedN("Simulation snapshot");
+		snapshotTimer = snapshotInterval;
+		// Capturing may grow the snapshot's storage
+		frameTimeRecorder.addEvent("Simulation snapshot");
+		snapshotWriter.clear(asteroidField->getSeed());
+		asteroidField->forEachLoaded([this](glm::ivec2 coord, const AsteroidSector& sector) {
+			snapshotWriter.addSector(coord, *actorManager, sector.actors);
+		});
+		// The writer isn't changed until the job has finished
+		snapshotJob = runStartupJob([this] {
+			snapshotWriter.write(settings.snapshotFile);
+		});
+	}
+
+	// Level of detail for an actor's model from the projected size of its bounding sphere
+	uint32_t selectLod(uint32_t index)
+	{
+		return selectLod(index, camera.position, std::tan(glm::radians(camera.getFov()) * 0.5f));
+	}
+
+	// Level of detail for an actor's model as seen from another position, e.g. that of a render view
+	uint32_t selectLod(uint32_t index, const glm::vec3& viewPosition, float tanHalfFov)
+	{
+		if (!useLods) {
+			return 0;
+		}
+		const float distance = std::max(glm::distance(actorSnapshot.positions[index], viewPosition), camera.getNearClip());
+		const float screenSize = actorSnapshot.radii[index] / (distance * tanHalfFov) * thermalQuality.getQuality().lodBias;
+		return assetManager->getModel(actorSnapshot.models[index])->selectLod(screenSize);
+	}
+
+#pragma region Impostors
+	// Octahedral mapping around the y axis, must match octahedralDecode in impostor.vert.hlsl
+	static glm::vec3 octahedralDecode(glm::vec2 encoded)
+	{
+		glm::vec3 direction(encoded.x, 1.0f - std::abs(encoded.x) - std::abs(encoded.y), encoded.y);
+		if (direction.y < 0.0f) {
+			const glm::vec2 folded = (1.0f - glm::abs(glm::vec2(direction.z, direction.x))) * glm::vec2(direction.x >= 0.0f ? 1.0f : -1.0f, direction.z >= 0.0f ? 1.0f : -1.0f);
+			direction.x = folded.x;
+			direction.z = folded.y;
+		}
+		return glm::normalize(direction);
+	}
+
+	// Moves visible actors projected smaller than the impostor threshold from visibleActorIndices to impostorActors, actors within the fade range are kept in both
+	// Models without atlases are flagged for baking, their actors are drawn as meshes until then
+	void selectImpostors()
+	{
+		impostorActors.clear();
+		if (!useImpostors || ((renderPath != static_cast<int32_t>(RenderPath::PerActor)) && (renderPath != static_cast<int32_t>(RenderPath::Instanced)))) {
+			return;
+		}
+		TraceZoneScopedN("Impostor selection");
+		impostors.resize(assetManager->getModelSlotCount());
+		const float tanHalfFov = std::tan(glm::radians(camera.getFov()) * 0.5f);
+		const float fadeStart = impostorScreenSize * (1.0f - impostorFadeRange);
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < visibleActorCount; i++) {
+			const uint32_t index = visibleActorIndices[i];
+			visibleActorIndices[count++] = index;
+			// Atlases are baked from the model's rest pose
+			if (actorSnapshot.poseOffsets[index] != UINT32_MAX) {
+				continue;
+			}
+			const float distance = std::max(glm::distance(actorSnapshot.positions[index], camera.position), camera.getNearClip());
+			const float screenSize = actorSnapshot.radii[index] / (distance * tanHalfFov);
+			if (screenSize >= impostorScreenSize) {
+				continue;
+			}
+			const ModelHandle handle = actorSnapshot.models[index];
+			Impostor& impostor = impostors[handle.index()];
+			if (impostor.model != assetManager->getModel(handle)) {
+				// Placeholders of models that are still loading are not baked
+				impostor.bakePending = !assetManager->isLoading(handle);
+				continue;
+			}
+			if (!impostor.supported) {
+				continue;
+			}
+			impostorActors.push_back({ .index = index, .fade = std::min((impostorScreenSize - screenSize) / (impostorScreenSize - fadeStart), 1.0f) });
+			if (screenSize < fadeStart) {
+				count--;
+			}
+		}
+		visibleActorCount = count;
+	}
+
+	// Bakes the atlases of models flagged by selectImpostors, needs to be called once the frame's descriptors are up to date and before its command buffer is recorded
+	void bakeImpostors(FrameObjects& frame)
+	{
+		for (uint32_t slot = 0; slot < static_cast<uint32_t>(impostors.size()); slot++) {
+			Impostor& impostor = impostors[slot];
+			const ModelHandle handle = assetManager->getModelHandle(slot);
+			if (!impostor.bakePending || !handle.isSet()) {
+				continue;
+			}
+			impostor.bakePending = false;
+			vkglTF::Model* model = assetManager->getModel(handle);
+			impostor.model = model;
+			impostor.supported = !model->isSkinned() && glm::all(glm::lessThan(model->dimensions.min, model->dimensions.max));
+			if (impostor.supported) {
+				bakeImpostor(frame, impostor, model);
+				frameTimeRecorder.addEvent("Impostor bake " + assetManager->getModelName(handle));
+			}
+		}
+	}
+
+	// Renders a model from the directions of all frames into its albedo and normal atlases, orthographic over the model's bounding sphere
+	// Recorded outside of the frame's command buffer with the frame's descriptor sets, each frame gets its own view in the frame's uniform memory
+	// Waits for the GPU, the atlases are used from the next frame on
+	void bakeImpostor(FrameObjects& frame, Impostor& impostor, vkglTF::Model* model)
+	{
+		TraceZoneScopedN("Impostor baking");
+		MemoryStats::Scope memoryScope(MemoryCategory::Textures);
+
+		const uint32_t atlasSize = impostorFrameCount * impostorFrameSize;
+		const VkDeviceSize atlasBytes = static_cast<VkDeviceSize>(atlasSize) * atlasSize * 4;
+		const glm::vec3 center = (model->dimensions.min + model->dimensions.max) * 0.5f;
+		const float radius = glm::length(model->dimensions.max - model->dimensions.min) * 0.5f;
+		impostor.bounds = glm::vec4(center, radius);
+
+		Image* targets[2];
+		ImageView* targetViews[2];
+		for (uint32_t i = 0; i < 2; i++) {
+			targets[i] = new Image({
+				.name = "Impostor bake target",
+				.type = VK_IMAGE_TYPE_2D,
+				.format = impostorAtlasFormats[i],
+				.extent = { atlasSize, atlasSize, 1 },
+				.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+			});
+			targetViews[i] = new ImageView(targets[i]);
+		}
+		Image* depthTarget = new Image({
+			.name = "Impostor bake depth",
+			.type = VK_IMAGE_TYPE_2D,
+			.format = impostorDepthFormat,
+			.extent = { atlasSize, atlasSize, 1 },
+			.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+		});
+		const VkImageSubresourceRange depthRange{ .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT, .levelCount = 1, .layerCount = 1 };
+		VkImageViewCreateInfo depthViewCI = vks::initializers::imageViewCreateInfo();
+		depthViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		depthViewCI.format = impostorDepthFormat;
+		depthViewCI.subresourceRange = depthRange;
+		depthViewCI.image = depthTarget->handle;
+		VkImageView depthView;
+		VK_CHECK_RESULT(vkCreateImageView(vulkanDevice->logicalDevice, &depthViewCI, nullptr, &depthView));
+		Buffer* readbackBuffer = new Buffer({
+			.usageFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.size = atlasBytes * 2,
+			.dedicatedAllocation = true
+		});
+
+		CommandBuffer* cb = new CommandBuffer({ .device = *vulkanDevice, .pool = commandPool, .name = "Impostor baking command buffer" });
+		cb->profiler = gpuProfiler;
+		cb->begin();
+		cb->beginScope("Impostor baking");
+		const VkImageSubresourceRange colorRange{ .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 };
+		for (uint32_t i = 0; i < 2; i++) {
+			targets[i]->transition(cb, ImageUseCase::ColorAttachment, colorRange, true);
+		}
+		depthTarget->transition(cb, ImageUseCase::DepthAttachment, depthRange, true);
+
+		VkRenderingAttachmentInfo colorAttachments[2]{};
+		for (uint32_t i = 0; i < 2; i++) {
+			colorAttachments[i].sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+			colorAttachments[i].imageView = targetViews[i]->handle;
+			colorAttachments[i].imageLayout = targets[i]->getLayout();
+			colorAttachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			colorAttachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			colorAttachments[i].clearValue.color = { 0.0f, 0.0f, 0.0f, 0.0f };
+		}
+		VkRenderingAttachmentInfo depthAttachment{};
+		depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		depthAttachment.imageView = depthView;
+		depthAttachment.imageLayout = depthTarget->getLayout();
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.clearValue.depthStencil = { 1.0f, 0 };
+		VkRenderingInfo renderingInfo{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+			.renderArea = { 0, 0, atlasSize, atlasSize },
+			.layerCount = 1,
+			.colorAttachmentCount = 2,
+			.pColorAttachments = colorAttachments,
+			.pDepthAttachment = &depthAttachment
+		};
+		cb->beginRendering(renderingInfo);
+		cb->bindPipeline(scenePipelines.impostorBake);
+
+		// The frame's own offsets are restored once all frames of the atlas have been recorded
+		const std::vector<uint32_t> frameDynamicOffsets = frame.descriptorSet->dynamicOffsets;
+		ShaderData bakeData = shaderData;
+		bakeData.projection = glm::mat4(1.0f);
+		for (uint32_t y = 0; y < impostorFrameCount; y++) {
+			for (uint32_t x = 0; x < impostorFrameCount; x++) {
+				// Same directions and basis as the frame selection in impostor.vert.hlsl
+				const glm::vec3 direction = octahedralDecode((glm::vec2(x, y) + 0.5f) / static_cast<float>(impostorFrameCount) * 2.0f - 1.0f);
+				glm::vec3 up = (std::abs(direction.y) > 0.999f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+				const glm::vec3 right = glm::normalize(glm::cross(up, direction));
+				up = glm::cross(direction, right);
+				// Rows map the bounding sphere to clip space, with up at the top of the frame and depth from the side facing the viewer (0) to the far side (1)
+				bakeData.view = glm::transpose(glm::mat4(
+					glm::vec4(right / radius, -glm::dot(right, center) / radius),
+					glm::vec4(-up / radius, glm::dot(up, center) / radius),
+					glm::vec4(-direction * (0.5f / radius), glm::dot(direction, center) * (0.5f / radius) + 0.5f),
+					glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+				frame.descriptorSet->dynamicOffsets[0] = static_cast<uint32_t>(frame.frameAllocator->pushUniform(bakeData).offset);
+				cb->bindDescriptorSets(glTFPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+				cb->setViewport(static_cast<float>(x * impostorFrameSize), static_cast<float>(y * impostorFrameSize), static_cast<float>(impostorFrameSize), static_cast<float>(impostorFrameSize), 0.0f, 1.0f);
+				cb->setScissor(x * impostorFrameSize, y * impostorFrameSize, impostorFrameSize, impostorFrameSize);
+				// Node matrices only, so the normals stay in model space
+				model->draw(cb, getDrawContext(glTFPipelineLayout->handle), glm::mat4(1.0f), true);
+			}
+		}
+		frame.descriptorSet->dynamicOffsets = frameDynamicOffsets;
+		cb->endRendering();
+
+		for (uint32_t i = 0; i < 2; i++) {
+			targets[i]->transition(cb, ImageUseCase::TransferSource, colorRange);
+		}
+		cb->flushBarriers();
+		for (uint32_t i = 0; i < 2; i++) {
+			const VkBufferImageCopy region{
+				.bufferOffset = atlasBytes * i,
+				.imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1 },
+				.imageExtent = { atlasSize, atlasSize, 1 }
+			};
+			vkCmdCopyImageToBuffer(cb->handle, targets[i]->handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer->buffer, 1, &region);
+		}
+		cb->addBufferBarrier(readbackBuffer->buffer, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+		cb->flushBarriers();
+		cb->endScope();
+		cb->end();
+		cb->oneTimeSubmit(queue);
+
+		// The atlases get their mip chains from the upload, the sampled levels are clamped in the shader so frames don't bleed into each other
+		for (uint32_t i = 0; i < 2; i++) {
+			vks::Texture2D* atlas = new vks::Texture2D({
+				.buffer = static_cast<uint8_t*>(readbackBuffer->mapped) + atlasBytes * i,
+				.bufferSize = atlasBytes,
+				.texWidth = atlasSize,
+				.texHeight = atlasSize,
+				.format = impostorAtlasFormats[i],
+				.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+				.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+				.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE
+			});
+			uint32_t& index = (i == 0) ? impostor.albedoIndex : impostor.normalIndex;
+			if (index == UINT32_MAX) {
+				index = assetManager->add((i == 0) ? "impostor_albedo" : "impostor_normal", atlas);
+			} else {
+				replaceTexture(index, atlas);
+			}
+		}
+
+		delete cb;
+		delete readbackBuffer;
+		vkDestroyImageView(vulkanDevice->logicalDevice, depthView, nullptr);
+		delete depthTarget;
+		for (uint32_t i = 0; i < 2; i++) {
+			delete targetViews[i];
+			delete targets[i];
+		}
+	}
+
+	// Draws the impostors selected by selectImpostors with one instanced draw per model, their instances are written to the frame's instance buffer from firstInstance on
+	void recordImpostors(CommandBuffer* cb, FrameObjects& frame, uint32_t firstInstance)
+	{
+		impostorCount = 0;
+		// Impostors have their own pipeline and aren't part of the debug views
+		if (impostorActors.empty() || debugViewEnabled()) {
+			return;
+		}
+		cb->bindPipeline(scenePipelines.impostor);
+		cb->bindDescriptorSets(glTFPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+		setShadingRate(cb, variableRateShading ? VkExtent2D{ 2, 2 } : VkExtent2D{ 1, 1 });
+		const VkShaderStageFlags pushConstantStages = glTFPipelineLayout->getPushConstantRange(0).stageFlags;
+		InstanceData* instanceData = static_cast<InstanceData*>(frame.instanceAllocation.mapped);
+		uint32_t instance = firstInstance;
+		for (uint32_t slot = 0; slot < static_cast<uint32_t>(impostors.size()); slot++) {
+			const uint32_t first = instance;
+			for (const ImpostorActor& actor : impostorActors) {
+				if (instance >= instanceCapacity) {
+					break;
+				}
+				if (actorSnapshot.models[actor.index].index() == slot) {
+					instanceData[instance++] = packInstance(toRenderSpace(actorSnapshot.matrices[actor.index]), glm::vec2(actor.fade, 0.0f));
+				}
+			}
+			if (instance == first) {
+				continue;
+			}
+			const Impostor& impostor = impostors[slot];
+			// Frames are at least four texels wide in the sampled levels
+			const ImpostorPushConstBlock pushConstBlock{
+				.bounds = impostor.bounds,
+				.albedoIndex = impostor.albedoIndex,
+				.normalIndex = impostor.normalIndex,
+				.frameCount = impostorFrameCount,
+				.maxLod = std::log2(static_cast<float>(impostorFrameSize)) - 2.0f
+			};
+			cb->pushConstants(glTFPipelineLayout->handle, pushConstantStages, 0, sizeof(ImpostorPushConstBlock), &pushConstBlock);
+			cb->draw(6, instance - first, 0, first);
+		}
+		impostorCount = instance - firstInstance;
+	}
+#pragma endregion
+
+	// Selects the batches drawn to the visibility buffer and writes the draws the shading pass fetches their triangles with, one per indirect command
+	// Batches need their geometry in the pool with buffer device addresses
+	void writeVisibilityDraws(FrameObjects& frame)
+	{
+		VisibilityDraw* draws = static_cast<VisibilityDraw*>(frame.visibilityDrawBuffer->mapped);
+		for (uint32_t i = 0; i < static_cast<uint32_t>(cullBatches.size()); i++) {
+			const vkglTF::Model* model = cullBatchModels[i];
+			if (!model->geometryPool || (model->vertexLayout != vkglTF::VertexLayout::Compact) || (model->vertexAddress == 0) || (model->indexAddress == 0)) {
+				continue;
+			}
+			const std::vector<vkglTF::DrawRecord>& drawList = model->drawLists[std::min(cullBatchLods[i], model->lodCount - 1)];
+			assert(drawList.size() == cullBatches[i].commandCount);
+			const uint32_t indexSize = (model->indexType == VK_INDEX_TYPE_UINT8_EXT) ? 1 : ((model->indexType == VK_INDEX_TYPE_UINT16) ? 2 : 4);
+			uint32_t firstTriangle{ 0 };
+			for (uint32_t j = 0; j < cullBatches[i].commandCount; j++) {
+				const vkglTF::DrawRecord& record = drawList[j];
+				const VkDrawIndexedIndirectCommand& command = indirectCommands[cullBatches[i].firstCommand + j];
+				draws[cullBatches[i].firstCommand + j] = {
+					.node = model->nodeMatrices[record.nodeMatrixIndex],
+					.vertexAddress = model->vertexAddress,
+					.indexAddress = model->indexAddress,
+					.firstIndex = command.firstIndex,
+					.vertexOffset = command.vertexOffset,
+					.firstTriangle = firstTriangle,
+					.materialIndex = model->materials[record.materialIndex].bufferIndex,
+					.indexSize = indexSize
+				};
+				firstTriangle += record.indexCount / 3;
+			}
+			cullBatchVisibility[i] = true;
+		}
+	}
+
+	// Fills the culling inputs for all actors and records the compute dispatch that builds this frame's indirect draws
+	void recordCulling(CommandBuffer* cb, FrameObjects& frame)
+	{
+		TraceZoneScopedN("GPU culling setup");
+
+		// The frame's fence has been waited on, so the counts written by the GPU for the last use of this frame's buffers are available
+		if (frame.cullBatchCount > 0) {
+			const CullBatch* lastBatches = static_cast<const CullBatch*>(frame.cullBatchBuffer->mapped);
+			const VkDrawIndexedIndirectCommand* lastCommands = static_cast<const VkDrawIndexedIndirectCommand*>(frame.indirectCommandBuffer->mapped);
+			visibleObjects = 0;
+			for (uint32_t i = 0; i < frame.cullBatchCount; i++) {
+				visibleObjects += lastCommands[lastBatches[i].firstCommand].instanceCount;
+				if (frame.cullOcclusion) {
+					visibleObjects += lastCommands[frame.cullCommandCount + lastBatches[i].firstCommand].instanceCount;
+				}
+			}
+		}
+
+		cullBatchLookup.assign(assetManager->getModelSlotCount() * modelLodCount, UINT32_MAX);
+		cullBatchModels.clear();
+		cullBatchLods.clear();
+		cullBatches.clear();
+		indirectCommands.clear();
+
+		// Write actor bounds and count the instances per batch
+		CullActor* actorData = static_cast<CullActor*>(frame.cullActorBuffer->mapped);
+		cullActorCount = 0;
+		const uint32_t actorCount = std::min(actorSnapshot.size(), instanceCapacity);
+		actorTransforms.resize(actorCount);
+		for (uint32_t i = 0; i < actorCount; i++) {
+			// The culling shader takes the matrix and position of simulated actors from their bodies, so their transforms only change with their variation and radius and aren't uploaded again as their readback positions change
+			const bool simulated = gpuSimulationRunning && (actorBodyIndices[i] != noSimulationBody);
+			actorTransforms[i] = {
+				.matrix = simulated ? glm::mat4(1.0f) : actorSnapshot.matrices[i],
+				.sphere = glm::vec4(simulated ? glm::vec3(0.0f) : actorSnapshot.positions[i], actorSnapshot.radii[i] * 2.0f)
+			};
+			setInstanceVariation(actorTransforms[i].matrix, i);
+		}
+		actorTransformBuffer->update(cb->handle, getCurrentFrameIndex(), *frame.frameAllocator, actorTransforms.data(), actorCount, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+		TracyPlot("Actor transform upload", static_cast<int64_t>(actorTransformBuffer->getUploadedBytes()));
+		for (uint32_t i = 0; i < actorCount; i++) {
+			const ModelHandle model = actorSnapshot.models[i];
+			// Drawn by recordSkinnedActors
+			if (hasSkinnedModels && skinnedModelSlots[model.index()]) {
+				continue;
+			}
+			// Levels of detail are selected on the CPU, each level of a model forms its own batch
+			const uint32_t lod = selectLod(i);
+			assert(lod < modelLodCount);
+			uint32_t& batch = cullBatchLookup[model.index() * modelLodCount + lod];
+			if (batch == UINT32_MAX) {
+				assert(cullBatches.size() < maxCullBatches);
+				batch = static_cast<uint32_t>(cullBatches.size());
+				cullBatches.push_back({});
+				cullBatchModels.push_back(assetManager->getModel(model));
+				cullBatchLods.push_back(lod);
+			}
+			// Instance offset is used as the counter for now and turned into a prefix sum below
+			cullBatches[batch].instanceOffset++;
+			actorData[cullActorCount++] = {
+				.transformIndex = i,
+				.batchIndex = batch,
+				.bodyIndex = gpuSimulationRunning ? actorBodyIndices[i] : noSimulationBody,
+				.flags = (shadowsEnabled() && shadows.staticCasters[i]) ? cullActorStatic : 0
+			};
+		}
+
+		uint32_t instanceOffset = 0;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(cullBatches.size()); i++) {
+			const uint32_t instanceCount = cullBatches[i].instanceOffset;
+			cullBatches[i].instanceOffset = instanceOffset;
+			cullBatches[i].firstCommand = static_cast<uint32_t>(indirectCommands.size());
+			cullBatches[i].commandCount = cullBatchModels[i]->appendIndirectCommands(indirectCommands, instanceOffset, cullBatchLods[i]);
+			instanceOffset += instanceCount;
+		}
+		assert(indirectCommands.size() <= maxDrawCommands);
+		if (rayQueryShadowsEnabled()) {
+			assignBatchAccelerationStructures(cb);
+		}
+
+		// The late phase and each shadow view get their own copy of the commands and draw counts
+		const size_t commandsSize = indirectCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+		memcpy(frame.cullBatchBuffer->mapped, cullBatches.data(), cullBatches.size() * sizeof(CullBatch));
+		const uint32_t commandRegions = shadowsEnabled() ? cullCommandRegions : 2;
+		for (uint32_t i = 0; i < commandRegions; i++) {
+			memcpy(static_cast<uint8_t*>(frame.indirectCommandBuffer->mapped) + commandsSize * i, indirectCommands.data(), commandsSize);
+		}
+		memset(frame.drawCountBuffer->mapped, 0, cullBatches.size() * sizeof(uint32_t) * commandRegions);
+		frame.cullBatchCount = static_cast<uint32_t>(cullBatches.size());
+		frame.cullCommandCount = static_cast<uint32_t>(indirectCommands.size());
+		// The visibility pass draws all actors at once, so the early and late phases aren't split
+		frame.cullOcclusion = occlusionCulling && !frame.scaledScene && !frame.visibilityBuffer;
+		cullBatchVisibility.assign(cullBatches.size(), false);
+		if (frame.visibilityBuffer) {
+			writeVisibilityDraws(frame);
+		}
+
+		// The visibility buffer is shared by all frames, the render graph orders it against the previous frame's late phase
+		dispatchCulling(cb, frame, frame.cullOcclusion ? CullPhase::Early : CullPhase::FrustumOnly);
+		if (shadowsEnabled()) {
+			dispatchShadowCulling(cb, frame);
+		}
+		if (rayQueryShadowsEnabled()) {
+			buildTopLevelAccelerationStructure(cb, frame);
+		} else {
+			// The previous frame's structure may be outdated by the time ray queries are enabled again
+			rayQueryShadows.rebuild = true;
+		}
+	}
+
+	// Releases the bottom level structures of a slot's model, frames in flight may still trace against them
+	void releaseModelAccelerationStructures(uint32_t slot)
+	{
+		if (slot >= rayQueryShadows.models.size()) {
+			return;
+		}
+		RayQueryShadows::ModelStructures& structures = rayQueryShadows.models[slot];
+		for (AccelerationStructure* accelerationStructure : structures.lods) {
+			if (accelerationStructure) {
+				deferDeletion(accelerationStructure);
+			}
+		}
+		structures = {};
+		// Top level updates only refit the instances, so they can't drop references to released structures
+		rayQueryShadows.rebuild = true;
+	}
+
+	// Builds the bottom level structures of all levels of detail of a slot's model, with one geometry per draw record transformed by its node matrix
+	// Models outside of the geometry pool or with 8 bit indices (which builds can't read) get no structures and don't cast shadows
+	void buildModelAccelerationStructures(CommandBuffer* cb, uint32_t slot, const vkglTF::Model* model)
+	{
+		releaseModelAccelerationStructures(slot);
+		RayQueryShadows::ModelStructures& structures = rayQueryShadows.models[slot];
+		structures.model = model;
+		if (!model->geometryPool || (model->vertexAddress == 0) || (model->indexAddress == 0) || (model->indexType == VK_INDEX_TYPE_UINT8_EXT)) {
+			return;
+		}
+		MemoryStats::Scope memoryScope(MemoryCategory::Models);
+		const GeometryAllocation& allocation = model->geometryAllocation;
+		size_t recordCount{ 0 };
+		for (const std::vector<vkglTF::DrawRecord>& drawList : model->drawLists) {
+			recordCount += drawList.size();
+		}
+		// Only read by the builds, so the node matrices aren't kept afterwards
+		Buffer* transformBuffer = new Buffer({
+			.name = "Acceleration structure transforms",
+			.usageFlags = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.size = std::max<size_t>(recordCount, 1) * sizeof(VkTransformMatrixKHR),
+			.memoryUsage = BufferMemoryUsage::HostWriteDeviceRead
+		});
+		VkTransformMatrixKHR* transforms = static_cast<VkTransformMatrixKHR*>(transformBuffer->mapped);
+		uint32_t transformIndex{ 0 };
+		for (uint32_t lod = 0; lod < static_cast<uint32_t>(model->drawLists.size()); lod++) {
+			std::vector<VkAccelerationStructureGeometryKHR> geometries;
+			std::vector<VkAccelerationStructureBuildRangeInfoKHR> ranges;
+			std::vector<uint32_t> primitiveCounts;
+			for (const vkglTF::DrawRecord& record : model->drawLists[lod]) {
+				if (record.indexCount < 3) {
+					continue;
+				}
+				// Row major 3x4, glm matrices are column major
+				const glm::mat4& matrix = model->nodeMatrices[record.nodeMatrixIndex];
+				for (uint32_t row = 0; row < 3; row++) {
+					for (uint32_t column = 0; column < 4; column++) {
+						transforms[transformIndex].matrix[row][column] = matrix[column][row];
+					}
+				}
+				// Positions are the first member of all vertex layouts
+				geometries.push_back({
+					.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+					.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+					.geometry = {.triangles = {
+						.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+						.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+						.vertexData = {.deviceAddress = model->vertexAddress + allocation.vertexOffset },
+						.vertexStride = allocation.vertexStride,
+						.maxVertex = static_cast<uint32_t>(allocation.vertexSize / allocation.vertexStride) - 1,
+						.indexType = model->indexType,
+						.indexData = {.deviceAddress = model->indexAddress + allocation.indexOffset },
+						.transformData = {.deviceAddress = transformBuffer->deviceAddress }
+					}},
+					.flags = VK_GEOMETRY_OPAQUE_BIT_KHR
+				});
+				ranges.push_back({
+					.primitiveCount = record.indexCount / 3,
+					.primitiveOffset = record.firstIndex * allocation.indexStride,
+					.firstVertex = 0,
+					.transformOffset = static_cast<uint32_t>(transformIndex * sizeof(VkTransformMatrixKHR))
+				});
+				primitiveCounts.push_back(record.indexCount / 3);
+				transformIndex++;
+			}
+			if (geometries.empty()) {
+				structures.lods.push_back(nullptr);
+				continue;
+			}
+			AccelerationStructure* accelerationStructure = new AccelerationStructure({
+				.name = assetManager->getModelName(assetManager->getModelHandle(slot)) + " LOD " + std::to_string(lod),
+				.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+				.geometries = geometries,
+				.maxPrimitiveCounts = primitiveCounts,
+				.queueFamilyIndices = getSharedQueueFamilies()
+			});
+			accelerationStructure->build(cb->handle, ranges);
+			// Bottom level structures are only built once
+			deferDeletion(accelerationStructure->releaseScratchBuffer());
+			structures.lods.push_back(accelerationStructure);
+		}
+		deferDeletion(transformBuffer);
+	}
+
+	// Stores the bottom level structure of each batch's model and level of detail in the batches, building those of models drawn for the first time
+	void assignBatchAccelerationStructures(CommandBuffer* cb)
+	{
+		if (rayQueryShadows.models.size() < assetManager->getModelSlotCount()) {
+			rayQueryShadows.models.resize(assetManager->getModelSlotCount());
+		}
+		uint32_t builds{ 0 };
+		for (uint32_t key = 0; key < static_cast<uint32_t>(cullBatchLookup.size()); key++) {
+			const uint32_t batch = cullBatchLookup[key];
+			if (batch == UINT32_MAX) {
+				continue;
+			}
+			const uint32_t slot = key / modelLodCount;
+			const uint32_t lod = key % modelLodCount;
+			const vkglTF::Model* model = cullBatchModels[batch];
+			RayQueryShadows::ModelStructures& structures = rayQueryShadows.models[slot];
+			if (structures.model != model) {
+				if (builds >= rayQueryShadows.maxBuildsPerFrame) {
+					cullBatches[batch].accelerationStructure = 0;
+					continue;
+				}
+				buildModelAccelerationStructures(cb, slot, model);
+				builds++;
+			}
+			cullBatches[batch].accelerationStructure = ((lod < structures.lods.size()) && structures.lods[lod]) ? structures.lods[lod]->deviceAddress : 0;
+		}
+	}
+
+	// Builds the frame's top level structure from the instances the culling dispatch wrote, as an update of the previous frame's structure if possible
+	void buildTopLevelAccelerationStructure(CommandBuffer* cb, FrameObjects& frame)
+	{
+		// Bottom level structures and the previous frame's top level structure have been built by earlier commands on this queue
+		cb->addBufferBarrier(frame.rayInstanceBuffer->buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT);
+		cb->addMemoryBarrier(VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR);
+		cb->flushBarriers();
+		const VkAccelerationStructureBuildRangeInfoKHR range{ .primitiveCount = cullActorCount };
+		const std::span<const VkAccelerationStructureBuildRangeInfoKHR> ranges(&range, 1);
+		const FrameObjects& previousFrame = frameObjects[(getCurrentFrameIndex() + getFrameCount() - 1) % getFrameCount()];
+		const bool update = !rayQueryShadows.rebuild && (rayQueryShadows.updateCount < rayQueryShadows.rebuildInterval) && (previousFrame.topLevelAS != frame.topLevelAS) && previousFrame.topLevelAS->canUpdate(ranges);
+		frame.topLevelAS->build(cb->handle, ranges, update ? previousFrame.topLevelAS : nullptr);
+		rayQueryShadows.updateCount = update ? rayQueryShadows.updateCount + 1 : 0;
+		rayQueryShadows.rebuild = false;
+		// Traced by the fragment shaders of the scene passes, which the render graph already orders after this pass for the instances
+		cb->addMemoryBarrier(VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR);
+		cb->flushBarriers();
+	}
+
+	// Initial body state from the current state of all asteroid actors
+	void uploadSimulationBodies()
+	{
+		simulatedActors.clear();
+		bodyReadbackGeneration++;
+		SimulationBody* bodies = static_cast<SimulationBody*>(bodyUploadBuffer->mapped);
+		std::default_random_engine rndEngine(0);
+		std::uniform_real_distribution<float> spinDist(-30.0f, 30.0f);
+		for (uint32_t i = 0; i < actorManager->size() && simulatedActors.size() < instanceCapacity; i++) {
+			if (actorManager->tags[i] != asteroidTag) {
+				continue;
+			}
+			const glm::vec3 position = actorManager->positions[i];
+			// Circular orbit around the origin
+			const glm::vec3 tangent = glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), position);
+			const float distance = std::max(glm::length(position), 1.0f);
+			const glm::vec3 velocity = (glm::length(tangent) > 0.0f) ? glm::normalize(tangent) * std::sqrt(orbitGravity / distance) : glm::vec3(0.0f);
+			bodies[simulatedActors.size()] = {
+				.matrix = actorManager->getMatrix(i),
+				.position = glm::vec4(position, actorManager->scales[i].x),
+				.velocity = glm::vec4(velocity, 0.0f),
+				.rotation = glm::vec4(actorManager->rotations[i], 0.0f),
+				.angularVelocity = glm::vec4(spinDist(rndEngine), spinDist(rndEngine), spinDist(rndEngine), 0.0f)
+			};
+			simulatedActors.push_back(actorManager->getHandle(i));
+		}
+	}
+
+	// Uploads the bodies if the GPU simulation starts this frame and maps the actors to their bodies, needs to be done while the simulation isn't running
+	void prepareSimulationBodies()
+	{
+		if (!gpuSimulation || (renderPath != static_cast<int32_t>(RenderPath::GPUDriven))) {
+			// The CPU simulation takes over again from the last read back positions
+			simulatedActors.clear();
+			return;
+		}
+		if (!gpuSimulationRunning) {
+			uploadSimulationBodies();
+			if (!readbackBuffer) {
+				readbackBuffer = new ReadbackBuffer({});
+			}
+		}
+		// Actors may have been added or removed since the bodies were uploaded
+		actorBodyIndices.assign(actorManager->size(), noSimulationBody);
+		for (uint32_t i = 0; i < static_cast<uint32_t>(simulatedActors.size()); i++) {
+			if (actorManager->isValid(simulatedActors[i])) {
+				actorBodyIndices[actorManager->getIndex(simulatedActors[i])] = i;
+			}
+		}
+	}
+
+	// Integrates the simulated asteroids, recorded by the render graph ahead of the culling (on the async compute queue if available)
+	void recordSimulation(CommandBuffer* cb, FrameObjects& frame)
+	{
+		TraceZoneScopedN("GPU simulation setup");
+		// Bodies have been uploaded and mapped to the actors by prepareSimulationBodies
+		const bool upload = !gpuSimulationRunning;
+		gpuSimulationRunning = true;
+
+		const uint32_t bodyCount = static_cast<uint32_t>(simulatedActors.size());
+		if (upload) {
+			// The first frame starts from the uploaded state, so nothing needs to be integrated
+			VkBufferCopy copyRegion{ .srcOffset = 0, .dstOffset = 0, .size = bodyCount * sizeof(SimulationBody) };
+			if (copyRegion.size > 0) {
+				vkCmdCopyBuffer(cb->handle, bodyUploadBuffer->buffer, frame.bodyBuffer->buffer, 1, &copyRegion);
+			}
+		} else {
+			// Bodies of the previous frame have been written by an earlier submission to the same queue, the graph only tracks accesses within a frame for these
+			const FrameObjects& previousFrame = frameObjects[(getCurrentFrameIndex() + getFrameCount() - 1) % getFrameCount()];
+			cb->addBufferBarrier(previousFrame.bodyBuffer->buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+			cb->flushBarriers();
+			const SimulationPushConstBlock pushConstBlock{
+				.deltaTime = std::min(frameTimer, 0.1f),
+				.bodyCount = bodyCount,
+				.gravity = orbitGravity
+			};
+			cb->bindPipeline(scenePipelines.simulate);
+			cb->bindDescriptorSets(simulationPipelineLayout, { frame.simulationDescriptorSet }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+			cb->updatePushConstant(simulationPipelineLayout, 0, &pushConstBlock);
+			cb->dispatch((bodyCount + 63) / 64);
+			if ((bodyCount > 0) && (getRecordingFrameNumber() % bodyReadbackInterval == 0)) {
+				recordBodyReadback(cb, frame, bodyCount);
+			}
+		}
+	}
+
+	// Copies the integrated bodies to the readback buffer, their positions and rotations are applied to the actors once the frame has completed
+	void recordBodyReadback(CommandBuffer* cb, FrameObjects& frame, uint32_t bodyCount)
+	{
+		const VkDeviceSize size = bodyCount * sizeof(SimulationBody);
+		ReadbackRegion region{};
+		const bool allocated = readbackBuffer->allocate(size, getRecordingFrameNumber(), [this, generation = bodyReadbackGeneration](const void* data, VkDeviceSize size) {
+			// Runs before the frame's simulation step is started, so the actors can be changed
+			if (generation != bodyReadbackGeneration) {
+				return;
+			}
+			const SimulationBody* bodies = static_cast<const SimulationBody*>(data);
+			const uint32_t count = std::min(static_cast<uint32_t>(size / sizeof(SimulationBody)), static_cast<uint32_t>(simulatedActors.size()));
+			for (uint32_t i = 0; i < count; i++) {
+				if (actorManager->isValid(simulatedActors[i])) {
+					const uint32_t index = actorManager->getIndex(simulatedActors[i]);
+					actorManager->setPosition(index, glm::vec3(bodies[i].position));
+					actorManager->setRotation(index, glm::vec3(bodies[i].rotation));
+				}
+			}
+		}, region);
+		// The ring is full, the positions are read back with a later frame
+		if (!allocated) {
+			return;
+		}
+		cb->addBufferBarrier(frame.bodyBuffer->buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+		cb->flushBarriers();
+		const VkBufferCopy copyRegion{ .srcOffset = 0, .dstOffset = region.offset, .size = size };
+		vkCmdCopyBuffer(cb->handle, frame.bodyBuffer->buffer, region.buffer, 1, &copyRegion);
+		cb->addBufferBarrier(region.buffer, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+		cb->flushBarriers();
+	}
+
+	// Queues particles for the next particle pass, requests beyond maxParticleEmitters are dropped
+	void emitParticles(const ParticleEmitter& emitter)
+	{
+		if (useParticles && (particleEmitters.size() < maxParticleEmitters)) {
+			particleEmitters.push_back(emitter);
+		}
+	}
+
+	// Adds a light that fades out over its lifetime, lights beyond maxLights are dropped
+	void addTransientLight(const glm::vec3& position, const glm::vec3& color, float radius, float lifetime)
+	{
+		if (transientLights.size() < maxLights) {
+			transientLights.push_back({ .position = position, .radius = radius, .color = color, .age = 0.0f, .lifetime = lifetime });
+		}
+	}
+
+	// Sparks, a cloud of smoke and a flash
+	void emitExplosion(const glm::vec3& position)
+	{
+		addTransientLight(position, glm::vec3(8.0f, 4.0f, 1.5f), 60.0f, 0.8f);
+		emitParticles({
+			.position = position,
+			.count = 512,
+			.velocity = glm::vec3(0.0f),
+			.speed = 40.0f,
+			.color = glm::vec4(1.0f, 0.6f, 0.2f, 1.0f),
+			.lifetime = 1.2f,
+			.size = 0.25f
+		});
+		emitParticles({
+			.position = position,
+			.count = 64,
+			.velocity = glm::vec3(0.0f),
+			.speed = 8.0f,
+			.color = glm::vec4(0.35f, 0.33f, 0.3f, 0.6f),
+			.lifetime = 3.0f,
+			.size = 1.5f,
+			.growth = 2.0f,
+			.flags = particleBlended
+		});
+	}
+
+	// Writes the frame's point lights to its allocation, must be called while the actors aren't changed by the simulation
+	void updateLights(FrameObjects& frame, float deltaTime)
+	{
+		TraceZoneScopedN("Light setup");
+		ClusterLight* lights = static_cast<ClusterLight*>(frame.lightAllocation.mapped);
+		lightCount = 0;
+		// Swap and pop, the order of the lights doesn't matter
+		for (size_t i = 0; i < transientLights.size();) {
+			TransientLight& light = transientLights[i];
+			light.age += deltaTime;
+			if (light.age >= light.lifetime) {
+				light = transientLights.back();
+				transientLights.pop_back();
+				continue;
+			}
+			const float fade = 1.0f - light.age / light.lifetime;
+			lights[lightCount++] = { .position = glm::vec4(light.position, light.radius), .color = glm::vec4(light.color * fade * fade, 0.0f) };
+			i++;
+		}
+		for (const ActorHandle& handle : bulletPool->getHandles()) {
+			if ((lightCount < maxLights) && actorManager->isValid(handle)) {
+				lights[lightCount++] = { .position = glm::vec4(actorManager->positions[actorManager->getIndex(handle)], 20.0f), .color = glm::vec4(0.6f, 1.2f, 3.0f, 0.0f) };
+			}
+		}
+		// Spread along the asteroid ring and orbiting over time, with varying colors
+		const uint32_t testCount = std::min(static_cast<uint32_t>(testLightCount), maxLights - lightCount);
+		for (uint32_t i = 0; i < testCount; i++) {
+			const float angle = static_cast<float>(i) * 2.39996f + timer * glm::two_pi<float>() * 0.05f;
+			const float distance = 150.0f + static_cast<float>((i * 7919) % 1000) * 0.5f;
+			const glm::vec3 position(std::cos(angle) * distance, static_cast<float>((i * 104729) % 200) * 0.25f - 25.0f, std::sin(angle) * distance);
+			const glm::vec3 color = glm::vec3(0.5f) + 0.5f * glm::cos(glm::vec3(0.0f, 2.1f, 4.2f) + static_cast<float>(i));
+			lights[lightCount++] = { .position = glm::vec4(position, 40.0f), .color = glm::vec4(color * 4.0f, 0.0f) };
+		}
+	}
+
+	// Assigns the frame's lights to the clusters of the froxel grid, recorded by the render graph on the async compute queue if available
+	void recordLightCulling(CommandBuffer* cb, FrameObjects& frame)
+	{
+		TraceZoneScopedN("Light culling");
+		frame.lightCullDescriptorSet->dynamicOffsets[0] = static_cast<uint32_t>(frame.lightAllocation.offset);
+		const LightCullPushConstBlock pushConstBlock{
+			.view = shaderData.view,
+			.cameraPosition = shaderData.cameraPosition,
+			.clusterDepth = shaderData.clusterDepth,
+			.clusterGrid = shaderData.clusterGrid,
+			.projectionScale = glm::vec2(shaderData.projection[0][0], shaderData.projection[1][1])
+		};
+		cb->bindPipeline(scenePipelines.lightCull);
+		cb->bindDescriptorSets(lightCullPipelineLayout, { frame.lightCullDescriptorSet }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+		cb->updatePushConstant(lightCullPipelineLayout, 0, &pushConstBlock);
+		cb->dispatch((clusterCount + 63) / 64);
+	}
+
+	// Emits, simulates, compacts and sorts the particles, recorded by the render graph ahead of the scene passes
+	// Particle state is shared by all frames, the pass is on the graphics queue as the previous frame's draws read the same buffers
+	void recordParticles(CommandBuffer* cb, FrameObjects& frame)
+	{
+		TraceZoneScopedN("Particle setup");
+		// The frame is no longer in flight, so the counters copied by its last pass can be read
+		if (frame.particleStatsValid) {
+			particleCount = static_cast<const uint32_t*>(frame.particleStatsBuffer->mapped)[particleCounterAlive + 1 - frame.particleParity];
+		}
+		if (!particlesInitialized) {
+			vkCmdFillBuffer(cb->handle, particleCounterBuffer->buffer, 0, VK_WHOLE_SIZE, 0);
+			cb->addBufferBarrier(particleCounterBuffer->buffer, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+			particlesInitialized = true;
+		}
+
+		const uint32_t emitterCount = static_cast<uint32_t>(particleEmitters.size());
+		uint32_t maxEmitCount{ 0 };
+		for (const ParticleEmitter& emitter : particleEmitters) {
+			maxEmitCount = std::max(maxEmitCount, std::min(emitter.count, maxParticlesPerEmitter));
+		}
+		// Always the full range, as that's what the descriptor covers
+		const FrameAllocation emitterAllocation = frame.frameAllocator->allocateStorage(sizeof(ParticleEmitter) * maxParticleEmitters);
+		memcpy(emitterAllocation.mapped, particleEmitters.data(), emitterCount * sizeof(ParticleEmitter));
+		particleEmitters.clear();
+		frame.particleDescriptorSet->dynamicOffsets = { static_cast<uint32_t>(emitterAllocation.offset) };
+
+		// Each step reads what the previous one wrote, including the indirect arguments
+		auto barrier = [cb]() {
+			cb->addMemoryBarrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COPY_BIT,
+				VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT);
+			cb->flushBarriers();
+		};
+		cb->flushBarriers();
+
+		ParticlePushConstBlock pushConstBlock{
+			.cameraPosition = glm::vec4(renderOrigin, 0.0f),
+			.deltaTime = std::min(frameTimer, 0.1f),
+			.time = timer,
+			.emitterCount = emitterCount,
+			.parity = particleParity,
+			.stage = 0,
+			.capacity = maxParticles,
+			.maxBlended = maxBlendedParticles,
+			.maxEmitCount = maxParticlesPerEmitter
+		};
+		cb->bindDescriptorSets(particleComputePipelineLayout, { frame.particleDescriptorSet }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+		cb->updatePushConstant(particleComputePipelineLayout, 0, &pushConstBlock);
+		if (emitterCount > 0) {
+			cb->bindPipeline(scenePipelines.particleEmit);
+			cb->dispatch((maxEmitCount + 63) / 64, emitterCount);
+			barrier();
+		}
+		cb->bindPipeline(scenePipelines.particleArgs);
+		cb->dispatch(1);
+		barrier();
+		cb->bindPipeline(scenePipelines.particleSimulate);
+		cb->dispatchIndirect(particleCounterBuffer->buffer, particleArgsDispatch * sizeof(uint32_t));
+		barrier();
+		// Both only read what the simulation wrote
+		pushConstBlock.stage = 1;
+		cb->updatePushConstant(particleComputePipelineLayout, 0, &pushConstBlock);
+		cb->bindPipeline(scenePipelines.particleArgs);
+		cb->dispatch(1);
+		cb->bindPipeline(scenePipelines.particleSort);
+		cb->dispatch(1);
+
+		const VkBufferCopy copyRegion{ .srcOffset = 0, .dstOffset = 0, .size = frame.particleStatsBuffer->size };
+		vkCmdCopyBuffer(cb->handle, particleCounterBuffer->buffer, frame.particleStatsBuffer->buffer, 1, &copyRegion);
+		frame.particleStatsValid = true;
+		frame.particleParity = particleParity;
+		particleParity = 1 - particleParity;
+	}
+
+	// Blended particles are drawn back to front first, then the additive ones in any order, both with the counts written by the particle pass
+	// Needs to be recorded after all actors, as the particles don't write depth
+	void drawParticles(CommandBuffer* cb, FrameObjects& frame)
+	{
+		if (!useParticles || debugViewEnabled()) {
+			return;
+		}
+		const glm::mat4& view = camera.matrices.view;
+		ParticleDrawPushConstBlock pushConstBlock{
+			.viewProjection = shaderData.projection * shaderData.view,
+			.renderOrigin = glm::vec4(renderOrigin, 0.0f),
+			.cameraRight = glm::vec4(view[0][0], view[1][0], view[2][0], 0.0f),
+			.cameraUp = glm::vec4(view[0][1], view[1][1], view[2][1], 0.0f),
+			.listOffset = 4 * maxParticles
+		};
+		cb->bindDescriptorSets(particleDrawPipelineLayout, { frame.particleDescriptorSet });
+		cb->updatePushConstant(particleDrawPipelineLayout, 0, &pushConstBlock);
+		cb->bindPipeline(scenePipelines.particleBlended);
+		cb->drawIndirect(particleCounterBuffer->buffer, particleArgsDrawBlended * sizeof(uint32_t), 1, sizeof(VkDrawIndirectCommand));
+		pushConstBlock.listOffset = 3 * maxParticles;
+		cb->updatePushConstant(particleDrawPipelineLayout, 0, &pushConstBlock);
+		cb->bindPipeline(scenePipelines.particleAdditive);
+		cb->drawIndirect(particleCounterBuffer->buffer, particleArgsDrawAdditive * sizeof(uint32_t), 1, sizeof(VkDrawIndirectCommand));
+	}
+
+	// Records one culling phase, the late phase needs the depth pyramid built from the early phase's draws
+	void dispatchCulling(CommandBuffer* cb, FrameObjects& frame, CullPhase phase)
+	{
+		CullPushConstBlock cullPushConstBlock{};
+		for (uint32_t i = 0; i < 6; i++) {
+			cullPushConstBlock.frustumPlanes[i] = frustum.planes[i];
+		}
+		cullPushConstBlock.actorCount = cullActorCount;
+		cullPushConstBlock.phase = static_cast<uint32_t>(phase);
+		cullPushConstBlock.commandOffset = (phase == CullPhase::Late) ? frame.cullCommandCount : 0;
+		cullPushConstBlock.batchCount = frame.cullBatchCount;
+		cullPushConstBlock.depthSize = glm::uvec2(width, height);
+		cullPushConstBlock.pyramidLevels = depthPyramid.levels;
+		cullPushConstBlock.reverseDepth = settings.reverseDepth ? 1 : 0;
+		cullPushConstBlock.drawCountOffset = (phase == CullPhase::Late) ? frame.cullBatchCount : 0;
+		cullPushConstBlock.casterFilter = static_cast<uint32_t>(CullCasters::All);
+		// Instances are written for all actors regardless of visibility, so once per frame is enough
+		cullPushConstBlock.rayInstances = ((phase != CullPhase::Late) && rayQueryShadowsEnabled()) ? 1 : 0;
+
+		cb->bindPipeline(scenePipelines.cull);
+		cb->bindDescriptorSets(cullPipelineLayout, { frame.cullDescriptorSet }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+		cb->updatePushConstant(cullPipelineLayout, 0, &cullPushConstBlock);
+		cb->dispatch((cullActorCount + 63) / 64);
+	}
+
+	// Culls the static (only if the cached cascades are refreshed) and dynamic casters against the bounds of all cascades into their own commands and instances
+	void dispatchShadowCulling(CommandBuffer* cb, FrameObjects& frame)
+	{
+		const uint32_t instanceOffset = frame.cullDescriptorSet->dynamicOffsets[0];
+		cb->bindPipeline(scenePipelines.cull);
+		for (uint32_t view = 0; view < shadowViewCount; view++) {
+			const bool staticView = view == 0;
+			if (staticView && !shadows.refreshStatic) {
+				continue;
+			}
+			CullPushConstBlock cullPushConstBlock{};
+			for (uint32_t i = 0; i < 6; i++) {
+				cullPushConstBlock.frustumPlanes[i] = shadows.casterFrustum.planes[i];
+			}
+			cullPushConstBlock.actorCount = cullActorCount;
+			cullPushConstBlock.phase = static_cast<uint32_t>(CullPhase::FrustumOnly);
+			cullPushConstBlock.commandOffset = (2 + view) * frame.cullCommandCount;
+			cullPushConstBlock.batchCount = frame.cullBatchCount;
+			cullPushConstBlock.drawCountOffset = (2 + view) * frame.cullBatchCount;
+			cullPushConstBlock.casterFilter = static_cast<uint32_t>(staticView ? CullCasters::Static : CullCasters::Dynamic);
+			frame.cullDescriptorSet->dynamicOffsets[0] = static_cast<uint32_t>(frame.shadowInstanceAllocations[view].offset);
+			cb->bindDescriptorSets(cullPipelineLayout, { frame.cullDescriptorSet }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+			cb->updatePushConstant(cullPipelineLayout, 0, &cullPushConstBlock);
+			cb->dispatch((cullActorCount + 63) / 64);
+		}
+		frame.cullDescriptorSet->dynamicOffsets[0] = instanceOffset;
+	}
+
+	// Shadow maps, which ray query shadows replace if available
+	bool shadowsEnabled() const
+	{
+		return useShadows && (renderPath == static_cast<int32_t>(RenderPath::GPUDriven)) && !(vulkanDevice->hasRayQuery && rayQueryShadows.enabled);
+	}
+
+	bool rayQueryShadowsEnabled() const
+	{
+		return useShadows && (renderPath == static_cast<int32_t>(RenderPath::GPUDriven)) && vulkanDevice->hasRayQuery && rayQueryShadows.enabled;
+	}
+
+	glm::vec3 getSunDirection() const
+	{
+		const float angle = glm::radians(sunAngle);
+		return glm::normalize(glm::vec3(std::sin(angle), -0.6f, std::cos(angle)));
+	}
+
+	// One layer per cascade, sampled with depth comparisons
+	void createShadowMaps()
+	{
+		for (ShadowMap* map : { &shadows.staticMap, &shadows.dynamicMap }) {
+			map->image = new Image({
+				.name = (map == &shadows.staticMap) ? "Static shadow map" : "Dynamic shadow map",
+				.type = VK_IMAGE_TYPE_2D,
+				.format = shadowMapFormat,
+				.extent = { .width = shadowMapSize, .height = shadowMapSize, .depth = 1 },
+				.mipLevels = 1,
+				.arrayLayers = shadowCascadeCount,
+				.samples = VK_SAMPLE_COUNT_1_BIT,
+				.tiling = VK_IMAGE_TILING_OPTIMAL,
+				.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			});
+			map->view = new ImageView(map->image, { .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT, .baseMipLevel = 0, .levelCount = 1, .baseArrayLayer = 0, .layerCount = shadowCascadeCount });
+		}
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_LINEAR;
+		samplerCI.minFilter = VK_FILTER_LINEAR;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.compareEnable = VK_TRUE;
+		samplerCI.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		samplerCI.maxAnisotropy = 1.0f;
+		shadows.sampler = VulkanContext::samplerCache->get(samplerCI);
+	}
+
+	static void destroyShadowMap(ShadowMap& map)
+	{
+		delete map.view;
+		delete map.image;
+	}
+
+	// Fits a sphere around each cascade's slice of the view frustum, the cached bounds are only moved once the sphere left them (or the sun rotated)
+	// The sphere's radius only depends on the projection, so the bounds keep their size while the camera rotates
+	void updateShadowCascades()
+	{
+		// The fragment shaders trace shadow rays up to this distance instead of sampling the cascades if it's set
+		shaderData.shadowSplits.w = rayQueryShadowsEnabled() ? rayQueryShadows.rayDistance : 0.0f;
+		if (!shadowsEnabled()) {
+			shadows.valid = false;
+			shaderData.shadowTexelSizes.w = 0.0f;
+			return;
+		}
+		const glm::vec3 lightDirection = getSunDirection();
+		const bool lightChanged = !shadows.valid || (glm::dot(lightDirection, shadows.lightDirection) < std::cos(glm::radians(shadowLightThreshold)));
+		if (lightChanged) {
+			shadows.lightDirection = lightDirection;
+		}
+		const glm::vec3 up = (std::abs(shadows.lightDirection.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		const glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), shadows.lightDirection, up);
+		const glm::mat4 inverseLightRotation = glm::transpose(lightRotation);
+		// Squared tangent of the half diagonal field of view
+		const float tanX = 1.0f / std::abs(camera.matrices.perspective[0][0]);
+		const float tanY = 1.0f / std::abs(camera.matrices.perspective[1][1]);
+		const float k2 = tanX * tanX + tanY * tanY;
+		const glm::mat4& view = camera.matrices.view;
+		const glm::vec3 forward = -glm::vec3(view[0][2], view[1][2], view[2][2]);
+		const float nearClip = camera.getNearClip();
+		float splitNear = nearClip;
+		// Light space bounds of all cascades, the depth is the distance along the light direction
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+		for (uint32_t i = 0; i < shadowCascadeCount; i++) {
+			ShadowCascade& cascade = shadows.cascades[i];
+			const float fraction = static_cast<float>(i + 1) / static_cast<float>(shadowCascadeCount);
+			const float split = glm::mix(nearClip + (shadowDistance - nearClip) * fraction, nearClip * std::pow(shadowDistance / nearClip, fraction), shadowSplitLambda);
+			// Smallest sphere enclosing the slice, its center is on the view axis
+			float centerDistance = split;
+			float radius = split * std::sqrt(k2);
+			if (k2 < (split - splitNear) / (split + splitNear)) {
+				centerDistance = 0.5f * (split + splitNear) * (1.0f + k2);
+				radius = 0.5f * std::sqrt((split - splitNear) * (split - splitNear) + 2.0f * (split * split + splitNear * splitNear) * k2 + (split + splitNear) * (split + splitNear) * k2 * k2);
+			}
+			const float extent = radius * (1.0f + shadowCacheMargin);
+			const float texelSize = 2.0f * extent / static_cast<float>(shadowMapSize);
+			// Snapped to whole texels, so moving the bounds doesn't make the shadow edges shimmer
+			glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(renderOrigin + forward * centerDistance, 1.0f));
+			lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+			lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+			if (lightChanged || (extent != cascade.extent) || (glm::distance(lightCenter, cascade.lightCenter) > extent - radius)) {
+				cascade.lightCenter = lightCenter;
+				cascade.extent = extent;
+				const glm::vec3 center = glm::vec3(inverseLightRotation * glm::vec4(lightCenter, 1.0f));
+				const glm::mat4 lightView = glm::lookAt(center - shadows.lightDirection * (extent + shadowCasterDistance), center, up);
+				const glm::mat4 lightProjection = glm::ortho(-extent, extent, -extent, extent, 0.0f, 2.0f * extent + shadowCasterDistance);
+				cascade.viewProjection = lightProjection * lightView;
+				shadows.refreshStatic = true;
+			}
+			boundsMin = glm::min(boundsMin, glm::vec3(cascade.lightCenter.x - cascade.extent, cascade.lightCenter.y - cascade.extent, -cascade.lightCenter.z - cascade.extent - shadowCasterDistance));
+			boundsMax = glm::max(boundsMax, glm::vec3(cascade.lightCenter.x + cascade.extent, cascade.lightCenter.y + cascade.extent, -cascade.lightCenter.z + cascade.extent));
+			cascade.split = split;
+			splitNear = split;
+			// Same matrix for the casters (whose instances are camera relative) and the fragments
+			shaderData.shadowMatrices[i] = cascade.viewProjection * glm::translate(glm::mat4(1.0f), renderOrigin);
+			shaderData.shadowSplits[i] = split;
+			shaderData.shadowTexelSizes[i] = texelSize;
+		}
+		shaderData.shadowTexelSizes.w = static_cast<float>(shadowCascadeCount);
+		shadows.casterFrustum.update(glm::ortho(boundsMin.x, boundsMax.x, boundsMin.y, boundsMax.y, boundsMin.z, boundsMax.z) * lightRotation);
+		shadows.valid = true;
+	}
+
+	// Flags the static shadow casters, the cached cascades are rendered again if any of them changed
+	// All actors that aren't bullets or simulated on the GPU are static, the CPU simulation only moves them on collisions
+	void updateShadowCasters(FrameObjects& frame)
+	{
+		if (!shadowsEnabled()) {
+			return;
+		}
+		const uint32_t actorCount = std::min(actorSnapshot.size(), instanceCapacity);
+		const bool gpuSimulated = gpuSimulation && (renderPath == static_cast<int32_t>(RenderPath::GPUDriven));
+		shadows.staticCasters.resize(actorCount);
+		shadows.staticCasterMatrices.clear();
+		for (uint32_t i = 0; i < actorCount; i++) {
+			const bool simulated = gpuSimulated && (i < actorBodyIndices.size()) && (actorBodyIndices[i] != noSimulationBody);
+			const bool isStatic = (actorSnapshot.models[i] != bulletModel) && !simulated;
+			shadows.staticCasters[i] = isStatic ? 1 : 0;
+			if (isStatic) {
+				shadows.staticCasterMatrices.push_back(actorSnapshot.matrices[i]);
+			}
+		}
+		const bool changed = (shadows.staticCasterMatrices.size() != shadows.cachedStaticCasterMatrices.size()) ||
+			(memcmp(shadows.staticCasterMatrices.data(), shadows.cachedStaticCasterMatrices.data(), shadows.staticCasterMatrices.size() * sizeof(glm::mat4)) != 0);
+		// Models that finish loading replace their placeholders without changing the actors
+		if (changed || assetManager->hasPendingLoads()) {
+			std::swap(shadows.staticCasterMatrices, shadows.cachedStaticCasterMatrices);
+			shadows.refreshStatic = true;
+		}
+		for (uint32_t i = 0; i < shadowViewCount; i++) {
+			frame.shadowInstanceAllocations[i] = frame.frameAllocator->allocateStorage(sizeof(InstanceData) * instanceCapacity);
+		}
+	}
+
+	// Draws the static (only if the cached cascades are refreshed) or dynamic casters culled by dispatchShadowCulling into all cascades in one multiview pass
+	void recordShadowPass(CommandBuffer* cb, FrameObjects& frame, bool staticCasters)
+	{
+		TraceZoneScopedN("Shadow pass");
+		const ShadowMap& map = staticCasters ? shadows.staticMap : shadows.dynamicMap;
+		const uint32_t view = staticCasters ? 0 : 1;
+		const uint32_t instanceOffset = frame.descriptorSet->dynamicOffsets[1];
+		VkRenderingAttachmentInfo depthAttachment{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+			.imageView = map.view->handle,
+			.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.clearValue = { .depthStencil = { 1.0f, 0 } }
+		};
+		// With multiview, the layer count is ignored and each view renders into the layer of the same index
+		VkRenderingInfo renderingInfo{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+			.renderArea = { .offset = { 0, 0 }, .extent = { shadowMapSize, shadowMapSize } },
+			.layerCount = 1,
+			.viewMask = shadowViewMask,
+			.pDepthAttachment = &depthAttachment
+		};
+		cb->beginRendering(renderingInfo);
+		cb->setViewport(0.0f, 0.0f, static_cast<float>(shadowMapSize), static_cast<float>(shadowMapSize), 0.0f, 1.0f);
+		cb->setScissor(0, 0, shadowMapSize, shadowMapSize);
+		cb->bindPipeline(scenePipelines.shadow);
+		// The cascade matrices are part of the frame's uniform data, only the instances differ from the main pass
+		frame.descriptorSet->dynamicOffsets[1] = static_cast<uint32_t>(frame.shadowInstanceAllocations[view].offset);
+		cb->bindDescriptorSets(glTFPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+		for (uint32_t j = 0; j < static_cast<uint32_t>(cullBatches.size()); j++) {
+			cullBatchModels[j]->drawIndirect(cb, getDrawContext(glTFPipelineLayout->handle), frame.indirectCommandBuffer->buffer, ((2 + view) * frame.cullCommandCount + cullBatches[j].firstCommand) * sizeof(VkDrawIndexedIndirectCommand), frame.drawCountBuffer->buffer, ((2 + view) * frame.cullBatchCount + j) * sizeof(uint32_t), true, cullBatchLods[j]);
+		}
+		cb->endRendering();
+		frame.descriptorSet->dynamicOffsets[1] = instanceOffset;
+		if (staticCasters) {
+			shadows.refreshStatic = false;
+			shadows.staticUpdates++;
+		}
+	}
+
+	// Level 0 of the pyramid has half the (power of two rounded) size of the depth buffer, so a texel of level n always covers 2^(n+1) pixels
+	void createDepthPyramid()
+	{
+		depthPyramid.width = std::bit_ceil((width + 1) / 2);
+		depthPyramid.height = std::bit_ceil((height + 1) / 2);
+		depthPyramid.levels = std::bit_width(std::max(depthPyramid.width, depthPyramid.height));
+
+		depthPyramid.image = new Image({
+			.name = "Depth pyramid",
+			.type = VK_IMAGE_TYPE_2D,
+			.format = VK_FORMAT_R32_SFLOAT,
+			.extent = { .width = depthPyramid.width, .height = depthPyramid.height, .depth = 1 },
+			.mipLevels = depthPyramid.levels,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+		});
+		depthPyramid.view = new ImageView(depthPyramid.image);
+		for (uint32_t i = 0; i < depthPyramid.levels; i++) {
+			depthPyramid.levelViews.push_back(new ImageView(depthPyramid.image, { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = i, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1 }));
+		}
+		// The depth stencil image isn't sampleable in tile based mode, the pyramid is then only bound by culling and never built
+		if (settings.tileBasedRendering) {
+			return;
+		}
+
+		VkImageViewCreateInfo depthViewCI{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = multisampledDepthReduction() ? multisampleTarget.depth.image : depthStencil.image,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = depthFormat,
+			.subresourceRange = { .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT, .baseMipLevel = 0, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1 }
+		};
+		VK_CHECK_RESULT(vkCreateImageView(VulkanContext::device->logicalDevice, &depthViewCI, nullptr, &depthPyramid.depthView));
+
+		depthPyramid.descriptorPool = new DescriptorPool({
+			.name = "Depth pyramid descriptor pool",
+			.maxSets = depthPyramid.levels,
+			.poolSizes = {
+				{.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .descriptorCount = depthPyramid.levels },
+				{.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = depthPyramid.levels },
+			}
+		});
+		for (uint32_t i = 0; i < depthPyramid.levels; i++) {
+			const DepthReduceDescriptors descriptors{
+				.source = (i == 0) ?
+					VkDescriptorImageInfo{ .imageView = depthPyramid.depthView, .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL } :
+					VkDescriptorImageInfo{ .imageView = depthPyramid.levelViews[i - 1]->handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL },
+				.destination = { .imageView = depthPyramid.levelViews[i]->handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL }
+			};
+			DescriptorSet* descriptorSet = new DescriptorSet({
+				.pool = depthPyramid.descriptorPool,
+				.layouts = { depthReduceDescriptorSetLayout->handle }
+			});
+			depthReduceUpdateTemplate->update(descriptorSet->handle, &descriptors);
+			depthPyramid.descriptorSets.push_back(descriptorSet);
+		}
+
+	}
+
+	void updateDepthPyramidDescriptor(FrameObjects& frame)
+	{
+		if (frame.depthPyramidGeneration == depthPyramid.generation) {
+			return;
+		}
+		const VkDescriptorImageInfo pyramidDescriptor{ .imageView = depthPyramid.view->handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+		descriptorWrites.addImages(frame.cullDescriptorSet->handle, 6, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &pyramidDescriptor);
+		frame.depthPyramidGeneration = depthPyramid.generation;
+	}
+
+	// Also used for retired pyramids that frames in flight were still culling against
+	static void destroyDepthPyramid(DepthPyramid& pyramid)
+	{
+		for (DescriptorSet* descriptorSet : pyramid.descriptorSets) {
+			delete descriptorSet;
+		}
+		pyramid.descriptorSets.clear();
+		delete pyramid.descriptorPool;
+		for (ImageView* view : pyramid.levelViews) {
+			delete view;
+		}
+		pyramid.levelViews.clear();
+		delete pyramid.view;
+		delete pyramid.image;
+		if (pyramid.depthView != VK_NULL_HANDLE) {
+			vkDestroyImageView(VulkanContext::device->logicalDevice, pyramid.depthView, nullptr);
+		}
+		pyramid = {};
+	}
+
+	// Reduces the depth buffer of the early draws into the depth pyramid
+	void recordDepthPyramid(CommandBuffer* cb)
+	{
+		TraceZoneScopedN("Depth pyramid");
+		// Depth buffer and pyramid have been transitioned by the render graph, only the dependencies between the pyramid levels are handled here
+		cb->bindPipeline(multisampledDepthReduction() ? scenePipelines.depthReduceMultisample : scenePipelines.depthReduce);
+		for (uint32_t i = 0; i < depthPyramid.levels; i++) {
+			// Only the first level is reduced from multi sampled depth
+			if ((i == 1) && multisampledDepthReduction()) {
+				cb->bindPipeline(scenePipelines.depthReduce);
+			}
+			DepthReducePushConstBlock pushConstBlock{
+				.sourceSize = (i == 0) ? glm::uvec2(width, height) : glm::uvec2(std::max(depthPyramid.width >> (i - 1), 1u), std::max(depthPyramid.height >> (i - 1), 1u)),
+				.destinationSize = glm::uvec2(std::max(depthPyramid.width >> i, 1u), std::max(depthPyramid.height >> i, 1u)),
+				.reverseDepth = settings.reverseDepth ? 1u : 0u
+			};
+			cb->bindDescriptorSets(depthReducePipelineLayout, { depthPyramid.descriptorSets[i] }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+			cb->updatePushConstant(depthReducePipelineLayout, 0, &pushConstBlock);
+			cb->dispatch((pushConstBlock.destinationSize.x + 7) / 8, (pushConstBlock.destinationSize.y + 7) / 8, 1);
+			const VkImageSubresourceRange levelRange{ .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = i, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1 };
+			cb->addImageBarrier(depthPyramid.image->handle, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, levelRange);
+			cb->flushBarriers();
+		}
+	}
+
+	bool temporalAntiAliasingSupported() const
+	{
+		return (settings.sampleCount == VK_SAMPLE_COUNT_1_BIT) && !settings.tileBasedRendering;
+	}
+
+	void createTemporalHistory()
+	{
+		temporalHistory.image = new Image({
+			.name = "Temporal history",
+			.type = VK_IMAGE_TYPE_2D,
+			.format = VK_FORMAT_R16G16B16A16_SFLOAT,
+			.extent = { .width = width, .height = height, .depth = 1 },
+			.mipLevels = 1,
+			.arrayLayers = 2,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+		});
+		for (uint32_t i = 0; i < 2; i++) {
+			temporalHistory.layerViews[i] = new ImageView(temporalHistory.image, { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = 0, .levelCount = 1, .baseArrayLayer = i, .layerCount = 1 });
+		}
+		temporalAA.historyValid = false;
+	}
+
+	// Low discrepancy sequence used for the jitter, so the samples of consecutive frames cover the pixel evenly
+	static float halton(uint32_t index, uint32_t base)
+	{
+		float result = 0.0f;
+		float fraction = 1.0f;
+		while (index > 0) {
+			fraction /= static_cast<float>(base);
+			result += fraction * static_cast<float>(index % base);
+			index /= base;
+		}
+		return result;
+	}
+
+	static void destroyTemporalHistory(TemporalHistory& history)
+	{
+		for (ImageView*& view : history.layerViews) {
+			delete view;
+		}
+		delete history.image;
+		history = {};
+	}
+
+	// Room for every pixel of the output, dynamic resolution only covers part of it
+	void createVisibilityPixels()
+	{
+		visibility.pixels = new Buffer({
+			.name = "Visibility pixels",
+			.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			.size = sizeof(glm::uvec4) * width * height,
+			.map = false
+		});
+	}
+
+	void windowResized()
+	{
+		// The depth stencil image has been recreated with the new size by the render graph
+		// Frames in flight may still cull against the old pyramid, so it's retired through the deletion queue
+		if (depthPyramid.image) {
+			const uint32_t generation = depthPyramid.generation;
+			deferDeletion([retiredPyramid = depthPyramid]() mutable {
+				destroyDepthPyramid(retiredPyramid);
+			});
+			depthPyramid = {};
+			depthPyramid.generation = generation + 1;
+			createDepthPyramid();
+		}
+		if (temporalHistory.image) {
+			const uint32_t generation = temporalHistory.generation;
+			deferDeletion([retiredHistory = temporalHistory]() mutable {
+				destroyTemporalHistory(retiredHistory);
+			});
+			temporalHistory = {};
+			temporalHistory.generation = generation + 1;
+			createTemporalHistory();
+		}
+		// Rewritten to the frames' sets along with the targets, see updateVisibilityDescriptors
+		if (visibility.pixels) {
+			deferDeletion(visibility.pixels);
+			createVisibilityPixels();
+		}
+		sceneColorGeneration++;
+	}
+
+	// Coarser levels of detail are only selected for small and distant actors, where a reduced shading rate isn't noticeable either
+	VkExtent2D getShadingRate(uint32_t lod) const
+	{
+		if (!variableRateShading || (lod == 0)) {
+			return { 1, 1 };
+		}
+		return (lod == 1) ? VkExtent2D{ 1, 2 } : VkExtent2D{ 2, 2 };
+	}
+
+	void setShadingRate(CommandBuffer* cb, VkExtent2D rate)
+	{
+		if (vulkanDevice->hasFragmentShadingRate) {
+			cb->setFragmentShadingRate(rate);
+		}
+	}
+
+	// Moves a world matrix into the camera relative space the shaders work in, see ShaderData
+	glm::mat4 toRenderSpace(const glm::mat4& matrix) const
+	{
+		glm::mat4 result = matrix;
+		result[3] -= glm::vec4(renderOrigin, 0.0f);
+		return result;
+	}
+
+	// x = seed, y = strength of an actor's procedural variation
+	glm::vec2 getInstanceVariation(uint32_t index) const
+	{
+		const glm::vec2 variation = actorSnapshot.variations[index];
+		return glm::vec2(variation.x, proceduralVariation ? variation.y * variationScale : 0.0f);
+	}
+
+	// Stores an actor's procedural variation in the last row of its matrix for the culling shader, which moves it to the instance it writes
+	void setInstanceVariation(glm::mat4& matrix, uint32_t index) const
+	{
+		const glm::vec2 variation = getInstanceVariation(index);
+		matrix[0].w = variation.x;
+		matrix[1].w = variation.y;
+	}
+
+	// Matches encodeInstance in instance.hlsl, the matrix needs to be built from a translation, a rotation and a uniform scale
+	static InstanceData packInstance(const glm::mat4& matrix, const glm::vec2 variation)
+	{
+		const float scale = glm::length(glm::vec3(matrix[0]));
+		const glm::quat rotation = glm::quat_cast(glm::mat3(matrix) / scale);
+		return {
+			.position = glm::vec3(matrix[3]),
+			.scale = scale,
+			.rotation = { glm::packSnorm2x16(glm::vec2(rotation.x, rotation.y)), glm::packSnorm2x16(glm::vec2(rotation.z, rotation.w)) },
+			.variation = variation
+		};
+	}
+
+	// Render space transform of an actor for the instance buffers
+	InstanceData toInstanceData(uint32_t index) const
+	{
+		return packInstance(toRenderSpace(actorSnapshot.matrices[index]), getInstanceVariation(index));
+	}
+
+	// With fullscreenSkybox, this needs to be recorded after all opaque geometry of the pass, otherwise before anything else
+	void recordBackdrop(CommandBuffer* cb, FrameObjects& frame)
+	{
+		// Debug views show the actors on the cleared background, so overdraw isn't offset by the skybox' color
+		if (debugViewEnabled()) {
+			return;
+		}
+		// The skybox shader reads its texture index from the slot of the material index
+		vkglTF::PushConstBlock pushConstBlock{};
+		pushConstBlock.materialIndex = skyboxIndex;
+		cb->bindPipeline(fullscreenSkybox ? scenePipelines.skyboxFullscreen : scenePipelines.skybox);
+		// The skybox is a smooth gradient of distant stars and nebulae for most of the screen
+		setShadingRate(cb, variableRateShading ? VkExtent2D{ 2, 2 } : VkExtent2D{ 1, 1 });
+		cb->bindDescriptorSets(skyboxPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+		cb->updatePushConstant(skyboxPipelineLayout, 0, &pushConstBlock);
+		if (fullscreenSkybox) {
+			// The vertex shader generates the triangle from the vertex index
+			cb->draw(3, 1, 0, 0);
+		} else {
+			assetManager->getModel(crateModel)->draw(cb, getDrawContext(glTFPipelineLayout->handle, true), glm::mat4(1.0f), true);
+		}
+	}
+
+	// Hash of everything the skybox's commands depend on, a reloaded pipeline, a resize, a new texture set or skybox index, changed uniform offsets or a replaced model lead to a different key
+	uint64_t getSkyboxRecordingKey(const FrameObjects& frame, const VkCommandBufferInheritanceRenderingInfo& inheritanceRenderingInfo) const
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		const vkglTF::Model* model = assetManager->getModel(crateModel);
+		const VkBuffer buffers[2] = { model->vertices ? model->vertices->buffer : VK_NULL_HANDLE, model->indices ? model->indices->buffer : VK_NULL_HANDLE };
+		const bool coarseShading = variableRateShading && vulkanDevice->hasFragmentShadingRate;
+		const VkPipeline pipeline = fullscreenSkybox ? *scenePipelines.skyboxFullscreen : *scenePipelines.skybox;
+		hashBytes(hash, &pipeline, sizeof(VkPipeline));
+		hashBytes(hash, &frame.descriptorSet->handle, sizeof(VkDescriptorSet));
+		hashBytes(hash, frame.descriptorSet->dynamicOffsets.data(), frame.descriptorSet->dynamicOffsets.size() * sizeof(uint32_t));
+		hashBytes(hash, &frame.descriptorSetTextures->handle, sizeof(VkDescriptorSet));
+		// Pushed as the material index, the skybox is looked up in the texture set with it
+		hashBytes(hash, &skyboxIndex, sizeof(skyboxIndex));
+		hashBytes(hash, &model, sizeof(model));
+		hashBytes(hash, buffers, sizeof(buffers));
+		hashBytes(hash, &sceneExtent, sizeof(VkExtent2D));
+		hashBytes(hash, inheritanceRenderingInfo.pColorAttachmentFormats, sizeof(VkFormat));
+		hashBytes(hash, &inheritanceRenderingInfo.depthAttachmentFormat, sizeof(VkFormat));
+		hashBytes(hash, &inheritanceRenderingInfo.rasterizationSamples, sizeof(VkSampleCountFlagBits));
+		hashBytes(hash, &coarseShading, sizeof(bool));
+		hashBytes(hash, &debugView, sizeof(debugView));
+		return hash;
+	}
+
+	// Draws the visible actors in [first, first + count) of visibleActorIndices, may be called from worker threads
+	void recordActors(CommandBuffer* cb, uint32_t first, uint32_t count)
+	{
+		const vkglTF::DrawContext drawContext = getDrawContext(glTFPipelineLayout->handle);
+		ModelHandle lastModel{};
+		vkglTF::Model* lastBoundModel{ nullptr };
+		uint32_t lastLod{ UINT32_MAX };
+		for (uint32_t i = first; i < first + count; i++) {
+			const uint32_t index = visibleActorIndices[i];
+			if (actorSnapshot.models[index] != lastModel) {
+				lastModel = actorSnapshot.models[index];
+				lastBoundModel = assetManager->getModel(lastModel);
+				lastBoundModel->bindBuffers(cb);
+			}
+			const uint32_t lod = selectLod(index);
+			if (lod != lastLod) {
+				setShadingRate(cb, getShadingRate(lod));
+				lastLod = lod;
+			}
+			lastBoundModel->draw(cb, drawContext, toRenderSpace(actorSnapshot.matrices[index]), false, lod, actorSnapshot.getPose(index), 0, &renderFrustum);
+		}
+	}
+
+	// Region of the scene target a render view is drawn to
+	VkRect2D getRenderViewRect(const RenderView& view) const
+	{
+		const glm::vec2 extent(static_cast<float>(sceneExtent.width), static_cast<float>(sceneExtent.height));
+		const glm::ivec2 offset = glm::ivec2(glm::vec2(view.region.x, view.region.y) * extent);
+		const glm::uvec2 size = glm::max(glm::uvec2(glm::vec2(view.region.z, view.region.w) * extent), glm::uvec2(1));
+		return { { offset.x, offset.y }, { std::min(size.x, sceneExtent.width - offset.x), std::min(size.y, sceneExtent.height - offset.y) } };
+	}
+
+	// Matrices, frustums and the uniform block of the enabled render views, with the same lighting as the main view except for shadows and point lights
+	// Shadow cascades and light clusters are only built for the main view, views disable both through their uniform block
+	void updateRenderViews(FrameObjects& frame)
+	{
+		const glm::vec3 forward = camera.getForward();
+		const glm::vec3 up = camera.getUp();
+		for (RenderView& view : renderViews) {
+			if (!view.enabled) {
+				continue;
+			}
+			const VkRect2D rect = getRenderViewRect(view);
+			const float aspect = static_cast<float>(rect.extent.width) / static_cast<float>(rect.extent.height);
+			const float sceneAspect = static_cast<float>(sceneExtent.width) / static_cast<float>(std::max(sceneExtent.height, 1u));
+			glm::mat4 worldView;
+			if (view.type == RenderView::Type::RearView) {
+				// Main view turned around the camera's up axis, with the same projection stretched to the view's aspect ratio
+				view.position = renderOrigin;
+				worldView = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0f, 1.0f, 0.0f)) * camera.matrices.view;
+				view.projection = camera.matrices.perspective;
+				view.projection[0][0] *= sceneAspect / aspect;
+				view.tanHalfFov = std::tan(glm::radians(camera.getFov()) * 0.5f);
+			} else {
+				// Looks down on the camera from above with the camera's forward direction at the top
+				view.position = renderOrigin + up * mapHeight;
+				worldView = glm::lookAt(view.position, renderOrigin, forward);
+				const glm::vec2 halfSize = glm::vec2(mapExtent * aspect, mapExtent) * 0.5f;
+				const float depthRange = mapHeight * 2.0f;
+				// Same depth convention as the main view, reverse depth swaps the depth range
+				view.projection = camera.reverseDepth ? glm::ortho(-halfSize.x, halfSize.x, -halfSize.y, halfSize.y, depthRange, 1.0f) : glm::ortho(-halfSize.x, halfSize.x, -halfSize.y, halfSize.y, 1.0f, depthRange);
+				if (camera.flipY) {
+					view.projection[1][1] *= -1.0f;
+				}
+				view.tanHalfFov = halfSize.y / mapHeight;
+			}
+			view.view = worldView;
+			view.view[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			view.frustum.update(view.projection * worldView);
+			view.renderFrustum.update(view.projection * view.view);
+
+			ShaderData viewData = shaderData;
+			viewData.projection = view.projection;
+			viewData.view = view.view;
+			viewData.cameraPosition = glm::vec4(view.position, 0.0f);
+			viewData.clusterGrid = glm::uvec4(0);
+			viewData.shadowTexelSizes.w = 0.0f;
+			// The acceleration structure's instances are relative to the main camera
+			viewData.shadowSplits.w = 0.0f;
+			view.uniformOffset = static_cast<uint32_t>(frame.frameAllocator->pushUniform(viewData).offset);
+		}
+	}
+
+	// Draws the actors visible in a render view, with matrices relative to the view's position
+	void recordRenderViewActors(CommandBuffer* cb, const RenderView& view)
+	{
+		const vkglTF::DrawContext drawContext = getDrawContext(glTFPipelineLayout->handle);
+		ModelHandle lastModel{};
+		vkglTF::Model* lastBoundModel{ nullptr };
+		for (uint32_t i = 0; i < view.visibleCount; i++) {
+			const uint32_t index = view.visibleIndices[i];
+			if (actorSnapshot.models[index] != lastModel) {
+				lastModel = actorSnapshot.models[index];
+				lastBoundModel = assetManager->getModel(lastModel);
+				lastBoundModel->bindBuffers(cb);
+			}
+			glm::mat4 matrix = actorSnapshot.matrices[index];
+			matrix[3] -= glm::vec4(view.position, 0.0f);
+			lastBoundModel->draw(cb, drawContext, matrix, false, selectLod(index, view.position, view.tanHalfFov), actorSnapshot.getPose(index), 0, &view.renderFrustum);
+		}
+		visibleObjects += view.visibleCount;
+	}
+
+	// Draws the enabled render views into their regions of the scene target, on top of the main view and within its rendering scope
+	// Each view swaps in its own uniform block, everything else bound through the frame's descriptor sets is shared with the main view
+	void recordRenderViews(CommandBuffer* cb, FrameObjects& frame)
+	{
+		const uint32_t mainUniformOffset = frame.descriptorSet->dynamicOffsets[0];
+		bool viewsDrawn = false;
+		for (const RenderView& view : renderViews) {
+			if (!view.enabled) {
+				continue;
+			}
+			cb->beginScope(view.name);
+			const VkRect2D rect = getRenderViewRect(view);
+			const VkClearRect clearRect{ .rect = rect, .baseArrayLayer = 0, .layerCount = 1 };
+			const VkClearAttachment depthClear{ .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, .clearValue = { .depthStencil = { getDepthClearValue(), 0 } } };
+			// The view's region is cleared, so it isn't depth tested against the main view
+			const VkClearAttachment clears[2] = {
+				{ .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .colorAttachment = 0, .clearValue = { .color = { 0.0f, 0.0f, 0.0f, 0.0f } } },
+				depthClear
+			};
+			vkCmdClearAttachments(cb->handle, 2, clears, 1, &clearRect);
+			cb->setViewport(static_cast<float>(rect.offset.x), static_cast<float>(rect.offset.y), static_cast<float>(rect.extent.width), static_cast<float>(rect.extent.height), 0.0f, 1.0f);
+			cb->setScissor(rect.offset.x, rect.offset.y, rect.extent.width, rect.extent.height);
+			frame.descriptorSet->dynamicOffsets[0] = view.uniformOffset;
+			if (!fullscreenSkybox) {
+				recordBackdrop(cb, frame);
+			}
+			cb->bindDescriptorSets(glTFPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+			cb->bindPipeline(getActorPipeline(scenePipelines.gltf));
+			setActorRenderState(cb, false);
+			recordRenderViewActors(cb, view);
+			if (fullscreenSkybox) {
+				recordBackdrop(cb, frame);
+			}
+			// Depth of the region is reset to the clear value, so the depth pyramid built from the scene's depth doesn't occlude the main view's actors with the view's depth
+			vkCmdClearAttachments(cb->handle, 1, &depthClear, 1, &clearRect);
+			cb->endScope();
+			viewsDrawn = true;
+		}
+		if (viewsDrawn) {
+			frame.descriptorSet->dynamicOffsets[0] = mainUniformOffset;
+			cb->setViewport(0.0f, 0.0f, (float)sceneExtent.width, (float)sceneExtent.height, 0.0f, 1.0f);
+			cb->setScissor(0, 0, sceneExtent.width, sceneExtent.height);
+		}
+	}
+
+	// Draws the visible actors with skinned models, each with its own joint palette written to the frame's joint buffer
+	// Skinned actors aren't part of the depth pre-pass, so they are drawn with the regular depth state
+	void recordSkinnedActors(CommandBuffer* cb, FrameObjects& frame)
+	{
+		if (skinnedActorIndices.empty()) {
+			return;
+		}
+		// Skinned models use another vertex layout than the other glTF pipelines, so there is no fallback and skinned actors are skipped until their pipeline has been created in the background
+		if (!scenePipelines.gltfSkinned) {
+			scenePipelines.gltfSkinned = pipelineVariants->getAsync(*skinnedPipelineCreateInfo, nullptr);
+			if (!scenePipelines.gltfSkinned) {
+				return;
+			}
+			frameTimeRecorder.addEvent("Pipeline variant creation");
+		}
+		cb->bindPipeline(getActorPipeline(scenePipelines.gltfSkinned));
+		setActorRenderState(cb, false);
+		cb->bindDescriptorSets(glTFPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+		glm::mat4* jointData = static_cast<glm::mat4*>(frame.jointAllocation.mapped);
+		uint32_t jointCount = 0;
+		const vkglTF::DrawContext drawContext = getDrawContext(glTFPipelineLayout->handle);
+		ModelHandle lastModel{};
+		vkglTF::Model* lastBoundModel{ nullptr };
+		for (const uint32_t index : skinnedActorIndices) {
+			vkglTF::Model* model = assetManager->getModel(actorSnapshot.models[index]);
+			const uint32_t modelJointCount = static_cast<uint32_t>(model->jointMatrices.size());
+			if (jointCount + modelJointCount > maxJointMatrices) {
+				break;
+			}
+			// Actors that aren't animated are skinned with the model's own pose
+			const glm::mat4* joints = actorSnapshot.getJoints(index);
+			memcpy(&jointData[jointCount], joints ? joints : model->jointMatrices.data(), modelJointCount * sizeof(glm::mat4));
+			if (actorSnapshot.models[index] != lastModel) {
+				lastModel = actorSnapshot.models[index];
+				lastBoundModel = model;
+				lastBoundModel->bindBuffers(cb);
+			}
+			lastBoundModel->draw(cb, drawContext, toRenderSpace(actorSnapshot.matrices[index]), false, 0, actorSnapshot.getPose(index), jointCount);
+			jointCount += modelJointCount;
+		}
+		visibleObjects += static_cast<uint32_t>(skinnedActorIndices.size());
+	}
+
+	// Splits the visible actors across recording jobs, with each job recording a secondary command buffer that's executed by the primary
+	void recordSecondaryCommandBuffers(FrameObjects& frame)
+	{
+		TraceZoneScopedN("Parallel command buffer recording");
+
+		const VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+			.colorAttachmentCount = 1,
+			.pColorAttachmentFormats = &sceneColorFormat,
+			.depthAttachmentFormat = depthFormat,
+			.stencilAttachmentFormat = depthFormat,
+			.rasterizationSamples = settings.sampleCount
+		};
+
+		const uint32_t visibleCount = visibleActorCount;
+		visibleObjects = visibleCount;
+		const uint32_t actorsPerJob = (visibleCount + numRecordingJobs - 1) / numRecordingJobs;
+		Pipeline* pipeline = getActorPipeline(scenePipelines.gltf);
+
+		// Skybox, backdrop, one command buffer per recording job, the particles and the overlay
+		// The fullscreen skybox is executed after the actors instead of before them
+		std::span<CommandBuffer*> secondaryCommandBuffers = frame.frameArena->allocate<CommandBuffer*>(numRecordingJobs + 4);
+		uint32_t secondaryCount = 0;
+		if (!fullscreenSkybox) {
+			secondaryCommandBuffers[secondaryCount++] = frame.skyboxCommandBuffer;
+		}
+		secondaryCommandBuffers[secondaryCount++] = frame.backdropCommandBuffer;
+		// Job arguments live in the frame's arena, so the job's function only captures two pointers and fits into std::function's local storage
+		struct RecordingJobArgs {
+			FrameObjects* frame;
+			const VkCommandBufferInheritanceRenderingInfo* inheritanceRenderingInfo;
+			CommandBuffer* secondary;
+			Pipeline* pipeline;
+			uint32_t first;
+			uint32_t count;
+		};
+		std::span<RecordingJobArgs> jobArgs = frame.frameArena->allocate<RecordingJobArgs>(numRecordingJobs);
+		vks::Job* recordingJob = jobSystem->createJob(nullptr);
+		for (uint32_t j = 0; j < numRecordingJobs; j++) {
+			const uint32_t first = j * actorsPerJob;
+			if (first >= visibleCount) {
+				break;
+			}
+			RecordingJobArgs* args = &jobArgs[j];
+			*args = { .frame = &frame, .inheritanceRenderingInfo = &inheritanceRenderingInfo, .secondary = frame.threadCommandBuffers[j], .pipeline = pipeline, .first = first, .count = std::min(actorsPerJob, visibleCount - first) };
+			secondaryCommandBuffers[secondaryCount++] = args->secondary;
+			jobSystem->run(jobSystem->createJob([this, args] {
+				TraceZoneScopedN("Worker command buffer recording");
+				CommandBuffer* secondary = args->secondary;
+				secondary->begin(*args->inheritanceRenderingInfo);
+				secondary->setViewport(0.0f, 0.0f, (float)sceneExtent.width, (float)sceneExtent.height, 0.0f, 1.0f);
+				secondary->setScissor(0, 0, sceneExtent.width, sceneExtent.height);
+				secondary->bindPipeline(args->pipeline);
+				setActorRenderState(secondary, false);
+				secondary->bindDescriptorSets(glTFPipelineLayout, { args->frame->descriptorSet, args->frame->descriptorSetTextures });
+				recordActors(secondary, args->first, args->count);
+				secondary->end();
+			}, recordingJob));
+		}
+		jobSystem->run(recordingJob);
+
+		// Skybox, backdrop (skinned actors and impostors) and overlay are recorded on the main thread while the workers are busy
+		const uint64_t skyboxKey = getSkyboxRecordingKey(frame, inheritanceRenderingInfo);
+		if (frame.skyboxKey != skyboxKey) {
+			frame.skyboxCommandBuffer->begin(inheritanceRenderingInfo);
+			frame.skyboxCommandBuffer->setViewport(0.0f, 0.0f, (float)sceneExtent.width, (float)sceneExtent.height, 0.0f, 1.0f);
+			frame.skyboxCommandBuffer->setScissor(0, 0, sceneExtent.width, sceneExtent.height);
+			recordBackdrop(frame.skyboxCommandBuffer, frame);
+			frame.skyboxCommandBuffer->end();
+			frame.skyboxKey = skyboxKey;
+		}
+		frame.backdropCommandBuffer->begin(inheritanceRenderingInfo);
+		frame.backdropCommandBuffer->setViewport(0.0f, 0.0f, (float)sceneExtent.width, (float)sceneExtent.height, 0.0f, 1.0f);
+		frame.backdropCommandBuffer->setScissor(0, 0, sceneExtent.width, sceneExtent.height);
+		recordSkinnedActors(frame.backdropCommandBuffer, frame);
+		recordImpostors(frame.backdropCommandBuffer, frame, 0);
+		frame.backdropCommandBuffer->end();
+		frame.effectsCommandBuffer->begin(inheritanceRenderingInfo);
+		frame.effectsCommandBuffer->setViewport(0.0f, 0.0f, (float)sceneExtent.width, (float)sceneExtent.height, 0.0f, 1.0f);
+		frame.effectsCommandBuffer->setScissor(0, 0, sceneExtent.width, sceneExtent.height);
+		drawParticles(frame.effectsCommandBuffer, frame);
+		frame.effectsCommandBuffer->end();
+
+		// With dynamic resolution, the overlay is drawn by the upscale pass
+		const bool drawOverlay = overlay->visible && !frame.scaledScene;
+		if (drawOverlay && (frame.overlayVersion != overlay->getDrawDataVersion())) {
+			frame.overlayCommandBuffer->begin(inheritanceRenderingInfo);
+			overlay->draw(frame.overlayCommandBuffer, getCurrentFrameIndex());
+			frame.overlayCommandBuffer->end();
+			frame.overlayVersion = overlay->getDrawDataVersion();
+		}
+
+		jobSystem->wait(recordingJob);
+
+		if (fullscreenSkybox) {
+			secondaryCommandBuffers[secondaryCount++] = frame.skyboxCommandBuffer;
+		}
+		secondaryCommandBuffers[secondaryCount++] = frame.effectsCommandBuffer;
+		if (drawOverlay) {
+			secondaryCommandBuffers[secondaryCount++] = frame.overlayCommandBuffer;
+		}
+		frame.commandBuffer->executeCommands(secondaryCommandBuffers.first(secondaryCount));
+	}
+
+	// Attachment setup of the first scene pass, the late occlusion pass continues on the same attachments
+	void setupSceneAttachments(bool occlusionPass, bool useSecondaryCommandBuffers)
+	{
+		const bool multiSampling = (settings.sampleCount > VK_SAMPLE_COUNT_1_BIT);
+		const VkImageView targetView = recordingFrame->scaledScene ? renderGraph->getImageView(graphResources.sceneColor) : swapChain->buffers[swapChain->currentImageIndex].view;
+
+		// New structures are used to define the attachments used in dynamic rendering
+		VkRenderingAttachmentInfo& colorAttachment = sceneAttachments.color;
+		colorAttachment = {};
+		colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		colorAttachment.imageView = multiSampling ? multisampleTarget.color.view : targetView;
+		colorAttachment.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL_KHR;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		// Multisampled color is only resolved, so it never has to be written out to memory
+		colorAttachment.storeOp = multiSampling ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.clearValue.color = { 0.0f, 0.0f, 0.0f, 0.0f };
+		if (multiSampling) {
+			colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
+			colorAttachment.resolveImageView = targetView;
+			colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		}
+
+		// A single depth stencil attachment info can be used, but they can also be specified separately.
+		// When both are specified separately, the only requirement is that the image view is identical.			
+		VkRenderingAttachmentInfo& depthStencilAttachment = sceneAttachments.depth;
+		depthStencilAttachment = {};
+		depthStencilAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		depthStencilAttachment.imageView = multiSampling ? multisampleTarget.depth.view : depthStencil.view;
+		depthStencilAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_STENCIL_READ_ONLY_OPTIMAL;
+		depthStencilAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthStencilAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthStencilAttachment.clearValue.depthStencil = { getDepthClearValue(),  0 };
+		if (multiSampling) {
+			// Same layout as declared with the render graph, so the resolve target doesn't need a transition when resolves are enabled
+			depthStencilAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_STENCIL_READ_ONLY_OPTIMAL;
+			depthStencilAttachment.resolveImageView = depthStencil.view;
+			depthStencilAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+		}
+		// The visibility pass has already written the depth of the batches it draws
+		if (recordingFrame->visibilityBuffer) {
+			depthStencilAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		}
+		sceneAttachments.stencil = depthStencilAttachment;
+		// The temporal resolve reprojects the history with the scene's depth
+		if (recordingFrame->temporalResolve) {
+			depthStencilAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		}
+
+		if (occlusionPass) {
+			// Attachments are kept for the second pass, which also does the color resolve
+			colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			colorAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+			depthStencilAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			sceneAttachments.stencil.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			// The depth pyramid needs the farthest sample of each pixel, the first one may belong to an occluder that only partially covers the pixel and cull what's visible behind it
+			// Without support for that resolve mode, the pyramid's first level is reduced from the multi sampled depth instead
+			if (multiSampling) {
+				depthStencilAttachment.resolveMode = getFarthestDepthResolveMode();
+			}
+		}
+
+		VkRenderingFlags renderingFlags = 0;
+		if (useSecondaryCommandBuffers) {
+			renderingFlags |= VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+		}
+		sceneAttachments.renderingInfo = {
+			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+			.flags = renderingFlags,
+			.renderArea = { 0, 0, sceneExtent.width, sceneExtent.height },
+			.layerCount = 1,
+			.colorAttachmentCount = 1,
+			.pColorAttachments = &sceneAttachments.color,
+			.pDepthAttachment = &sceneAttachments.depth,
+			.pStencilAttachment = &sceneAttachments.stencil
+		};
+	}
+
+	// State for the model draw functions, created per call so the secondary command buffers recorded in parallel don't share any
+	vkglTF::DrawContext getDrawContext(VkPipelineLayout pipelineLayout, bool skipMaterials = false) const
+	{
+		return {
+			.pipelineLayout = pipelineLayout,
+			.radianceIndex = skybox.radianceIndex,
+			.irradianceIndex = skybox.irradianceIndex,
+			.skipMaterials = skipMaterials
+		};
+	}
+
+	// Pipeline for the instanced and indirect actor draws
+	Pipeline* getInstancedPipeline() const
+	{
+		return getActorPipeline((vertexPulling && scenePipelines.gltfPulled) ? scenePipelines.gltfPulled : scenePipelines.gltfInstanced);
+	}
+
+	bool debugViewEnabled() const
+	{
+		return debugView != static_cast<int32_t>(DebugView::None);
+	}
+
+	// Pipeline actors are drawn with instead of the given one, only differs with a debug view
+	// Variants are looked up only, so this can be called by the recording jobs
+	Pipeline* getActorPipeline(Pipeline* pipeline) const
+	{
+		if (!debugViewEnabled()) {
+			return pipeline;
+		}
+		auto it = debugViewPipelines.find(pipeline);
+		return (it != debugViewPipelines.end()) ? it->second : pipeline;
+	}
+
+	// Requests the debug view variants of the actor pipelines before recording starts, variants that aren't in the pipeline cache are created in the background
+	// Until then actors are drawn with their regular pipeline (see getActorPipeline), so selecting a view doesn't stall the frame
+	// Overdraw is counted by additive blending, the depth state stays the same so only fragments that are actually shaded are counted
+	void updateDebugViewPipelines()
+	{
+		if (!debugViewEnabled()) {
+			return;
+		}
+		for (Pipeline* pipeline : { scenePipelines.gltf, scenePipelines.gltfInstanced, scenePipelines.gltfPulled, scenePipelines.gltfMesh, scenePipelines.gltfSkinned }) {
+			if (!pipeline || !pipeline->initialCreateInfo || debugViewPipelines.contains(pipeline)) {
+				continue;
+			}
+			PipelineCreateInfo createInfo = *pipeline->initialCreateInfo;
+			createInfo.defines.push_back("DEBUG_VIEW=" + std::to_string(debugView));
+			if (debugView == static_cast<int32_t>(DebugView::Overdraw)) {
+				createInfo.blending.attachments[0] = {
+					.blendEnable = VK_TRUE,
+					.srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+					.dstColorBlendFactor = VK_BLEND_FACTOR_ONE,
+					.colorBlendOp = VK_BLEND_OP_ADD,
+					.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+					.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+					.alphaBlendOp = VK_BLEND_OP_ADD,
+					.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+				};
+			}
+			Pipeline* variant = pipelineVariants->getAsync(createInfo, pipeline);
+			if (variant != pipeline) {
+				debugViewPipelines[pipeline] = variant;
+				frameTimeRecorder.addEvent("Pipeline variant creation");
+			}
+		}
+	}
+
+	// Not used by the mesh shader path and with secondary command buffers, as the pre-pass would have to be split across the recording jobs
+	bool depthPrepassEnabled() const
+	{
+		if (renderPath == static_cast<int32_t>(RenderPath::MeshShaders)) {
+			return false;
+		}
+		return depthPrepass && !(parallelRecording && (renderPath == static_cast<int32_t>(RenderPath::PerActor)));
+	}
+
+	// The glTF pipelines use dynamic depth and rasterization state, after the pre-pass only the fragments matching its depth are shaded and depth isn't written again
+	// Needs to be set after binding the pipeline, as the depth pre-pass pipelines use static state
+	void setActorRenderState(CommandBuffer* cb, bool afterPrepass)
+	{
+		cb->setDepthTestEnable(true);
+		cb->setDepthWriteEnable(!afterPrepass);
+		cb->setDepthCompareOp(afterPrepass ? VK_COMPARE_OP_EQUAL : getDepthCompareOp());
+		cb->setCullMode(VK_CULL_MODE_BACK_BIT);
+		cb->setFrontFace(VK_FRONT_FACE_CLOCKWISE);
+		if (vulkanDevice->hasDynamicPolygonMode) {
+			cb->setPolygonMode(wireframe ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL);
+		}
+		// Paths that know the level of detail of their draws set a coarser rate per draw
+		setShadingRate(cb, { 1, 1 });
+	}
+
+	// The shading pass fetches the triangles through buffer device addresses like the pulled vertex shader, the visibility pass needs the primitive ID in fragment shaders
+	// Multisampling isn't supported, as the shading pass shades one sample per pixel
+	bool visibilityBufferSupported() const
+	{
+		return vulkanDevice->hasBufferDeviceAddress && (modelVertexLayout == vkglTF::VertexLayout::Compact) && Device::enabledFeatures.geometryShader && (settings.sampleCount == VK_SAMPLE_COUNT_1_BIT);
+	}
+
+	// Only used by the GPU driven path, debug views are only implemented by the forward shaded pipelines
+	// With multi device presentation each device would only render its region of the visibility target, but shade all of it
+	bool visibilityBufferEnabled() const
+	{
+		return visibilityBuffer && visibilityBufferSupported() && (renderPath == static_cast<int32_t>(RenderPath::GPUDriven)) && !debugViewEnabled() && !swapChain->multiDevicePresent;
+	}
+
+	// Draws the batches eligible for the visibility buffer (see writeVisibilityDraws) into its target, the scene pass continues on the depth written here
+	void recordVisibilityPass(CommandBuffer* cb, FrameObjects& frame)
+	{
+		VkRenderingAttachmentInfo colorAttachment{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+			.imageView = renderGraph->getImageView(graphResources.visibilityTarget),
+			.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.clearValue = { .color = { .uint32 = { UINT32_MAX, UINT32_MAX, 0, 0 } } }
+		};
+		VkRenderingAttachmentInfo depthStencilAttachment{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+			.imageView = depthStencil.view,
+			.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_STENCIL_READ_ONLY_OPTIMAL,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.clearValue = { .depthStencil = { getDepthClearValue(), 0 } }
+		};
+		VkRenderingInfo renderingInfo{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+			.renderArea = { 0, 0, sceneExtent.width, sceneExtent.height },
+			.layerCount = 1,
+			.colorAttachmentCount = 1,
+			.pColorAttachments = &colorAttachment,
+			.pDepthAttachment = &depthStencilAttachment,
+			.pStencilAttachment = &depthStencilAttachment
+		};
+		beginScreenRendering(cb, renderingInfo);
+		cb->setViewport(0.0f, 0.0f, (float)sceneExtent.width, (float)sceneExtent.height, 0.0f, 1.0f);
+		cb->setScissor(0, 0, sceneExtent.width, sceneExtent.height);
+		cb->bindDescriptorSets(glTFPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+		cb->bindPipeline(scenePipelines.visibility);
+		setActorRenderState(cb, false);
+		for (uint32_t i = 0; i < static_cast<uint32_t>(cullBatches.size()); i++) {
+			if (cullBatchVisibility[i]) {
+				cullBatchModels[i]->drawIndirect(cb, getDrawContext(glTFPipelineLayout->handle), frame.indirectCommandBuffer->buffer, cullBatches[i].firstCommand * sizeof(VkDrawIndexedIndirectCommand), frame.drawCountBuffer->buffer, i * sizeof(uint32_t), true, cullBatchLods[i]);
+			}
+		}
+		cb->endRendering();
+	}
+
+	// The targets are transient images of the render graph, so their views only change with a resize
+	void updateVisibilityDescriptors(FrameObjects& frame)
+	{
+		if (frame.visibilityGeneration == sceneColorGeneration) {
+			return;
+		}
+		const VkDescriptorImageInfo targetDescriptor{ .imageView = renderGraph->getImageView(graphResources.visibilityTarget), .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		const VkDescriptorImageInfo colorStorageDescriptor{ .imageView = renderGraph->getImageView(graphResources.visibilityColor), .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+		const VkDescriptorImageInfo colorDescriptor{ .imageView = renderGraph->getImageView(graphResources.visibilityColor), .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		const VkDescriptorSet set = frame.visibilityDescriptorSet->handle;
+		descriptorWrites.addImages(set, 0, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &targetDescriptor);
+		descriptorWrites.addBuffers(set, 1, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &visibility.bins->descriptor);
+		descriptorWrites.addBuffers(set, 2, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &visibility.pixels->descriptor);
+		descriptorWrites.addBuffers(set, 3, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &frame.visibilityDrawBuffer->descriptor);
+		descriptorWrites.addBuffers(set, 4, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &frame.cullBatchBuffer->descriptor);
+		descriptorWrites.addImages(set, 5, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &colorStorageDescriptor);
+		descriptorWrites.addImages(set, 6, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &colorDescriptor);
+		descriptorWrites.flush();
+		frame.visibilityGeneration = sceneColorGeneration;
+	}
+
+	// Bins the covered pixels by material and shades each of them once, so material cost no longer depends on overdraw
+	// Classifying counts the pixels per material, the bins pass turns the counts into offsets, scattering writes the pixel list and shading runs over that list
+	void recordVisibilityShading(CommandBuffer* cb, FrameObjects& frame)
+	{
+		updateVisibilityDescriptors(frame);
+		const VisibilityPushConstBlock pushConstBlock{
+			.size = glm::uvec2(sceneExtent.width, sceneExtent.height),
+			.batchCount = frame.cullBatchCount,
+			.irradianceIndex = skybox.irradianceIndex
+		};
+		const uint32_t groupCountX = (sceneExtent.width + 7) / 8;
+		const uint32_t groupCountY = (sceneExtent.height + 7) / 8;
+		const VkDeviceSize dispatchOffset = maxMaterials * sizeof(uint32_t);
+
+		vkCmdFillBuffer(cb->handle, visibility.bins->buffer, 0, VK_WHOLE_SIZE, 0);
+		cb->addBufferBarrier(visibility.bins->buffer, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+		cb->flushBarriers();
+
+		cb->bindDescriptorSets(visibility.pipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures, frame.visibilityDescriptorSet }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+		cb->bindPipeline(scenePipelines.visibilityClassify);
+		cb->updatePushConstant(visibility.pipelineLayout, 0, &pushConstBlock);
+		cb->dispatch(groupCountX, groupCountY);
+		cb->addBufferBarrier(visibility.bins->buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+		cb->flushBarriers();
+
+		cb->bindPipeline(scenePipelines.visibilityBins);
+		cb->dispatch(1);
+		cb->addBufferBarrier(visibility.bins->buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+		cb->flushBarriers();
+
+		cb->bindPipeline(scenePipelines.visibilityScatter);
+		cb->dispatch(groupCountX, groupCountY);
+		cb->addBufferBarrier(visibility.bins->buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+		cb->addBufferBarrier(visibility.pixels->buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+		cb->flushBarriers();
+
+		cb->bindPipeline(scenePipelines.visibilityShade);
+		cb->dispatchIndirect(visibility.bins->buffer, dispatchOffset);
+	}
+
+	// The device can't resolve depth to the farthest sample, the depth pyramid is then built from the multi sampled depth (see setupImages)
+	bool multisampledDepthReduction() const
+	{
+		return (settings.sampleCount > VK_SAMPLE_COUNT_1_BIT) && !settings.tileBasedRendering && (getFarthestDepthResolveMode() == VK_RESOLVE_MODE_NONE);
+	}
+
+	bool occlusionPassEnabled() const
+	{
+		return (renderPath == static_cast<int32_t>(RenderPath::GPUDriven)) && recordingFrame->cullOcclusion;
+	}
+
+	// Early (or only) scene pass, draws all actors visible from the current view (or the previous frame's visible actors with occlusion culling)
+	void recordScenePass(CommandBuffer* cb, FrameObjects& frame)
+	{
+		// Only the per actor path issues enough draws to benefit from recording in parallel
+		const bool useSecondaryCommandBuffers = parallelRecording && (renderPath == static_cast<int32_t>(RenderPath::PerActor));
+		// The late occlusion culling phase needs the depth of the early draws, so rendering is split into two passes
+		const bool occlusionPass = occlusionPassEnabled();
+		setupSceneAttachments(occlusionPass, useSecondaryCommandBuffers);
+
+		beginScreenRendering(cb, sceneAttachments.renderingInfo);
+
+		if (useSecondaryCommandBuffers) {
+			// With secondary command buffers, the rendering scope in the primary command buffer must not contain any inline commands
+			recordSecondaryCommandBuffers(frame);
+			cb->endRendering();
+			return;
+		}
+
+		cb->setViewport(0.0f, 0.0f, (float)sceneExtent.width, (float)sceneExtent.height, 0.0f, 1.0f);
+		cb->setScissor(0, 0, sceneExtent.width, sceneExtent.height);
+
+		// Backdrop
+		if (!fullscreenSkybox) {
+			cb->beginScope("Skybox");
+			recordBackdrop(cb, frame);
+			cb->endScope();
+		}
+
+		cb->bindDescriptorSets(glTFPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+		
+		//glm::vec3 currPos = { 0.0f, 8.0f, -30.0f }; //playerShip.localPosition;// +glm::vec3(0.0f, 0.0f, -playerShip.acceleration * 2.0f);
+		// glm::mat4 locMatrix = glm::translate(glm::mat4(1.0f), currPos);
+		// locMatrix = glm::scale(locMatrix, glm::vec3(0.5f));
+		// actorManager->positions[actorManager->getIndex(ship)] = camera.position * glm::vec3(-1.0f);
+		// cb->bindPipeline(pipelines["playership"]);
+		// ship->model->draw(cb, glTFPipelineLayout->handle, locMatrix);
+		
+		instanceBatchCount = 0;
+		if (renderPath != static_cast<int32_t>(RenderPath::GPUDriven)) {
+			visibleObjects = 0;
+		}
+
+		cb->beginScope("Actors");
+
+		// The visibility buffer's depth already holds the occluders of the remaining batches, so a pre-pass wouldn't save any shading
+		const bool prepass = depthPrepassEnabled() && !frame.visibilityBuffer;
+		if (renderPath == static_cast<int32_t>(RenderPath::GPUDriven)) {
+			if (frame.visibilityBuffer) {
+				cb->beginScope("Visibility composite");
+				cb->bindPipeline(scenePipelines.visibilityComposite);
+				cb->bindDescriptorSets(visibility.pipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures, frame.visibilityDescriptorSet });
+				cb->draw(3, 1, 0, 0);
+				cb->endScope();
+				cb->bindDescriptorSets(glTFPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+			}
+			// Instance and draw counts have been written by the culling compute shader
+			auto drawCullBatches = [&]() {
+				for (uint32_t i = 0; i < static_cast<uint32_t>(cullBatches.size()); i++) {
+					if (cullBatchVisibility[i]) {
+						continue;
+					}
+					setShadingRate(cb, getShadingRate(cullBatchLods[i]));
+					cullBatchModels[i]->drawIndirect(cb, getDrawContext(glTFPipelineLayout->handle), frame.indirectCommandBuffer->buffer, cullBatches[i].firstCommand * sizeof(VkDrawIndexedIndirectCommand), frame.drawCountBuffer->buffer, i * sizeof(uint32_t), true, cullBatchLods[i]);
+				}
+			};
+			if (prepass) {
+				cb->bindPipeline(scenePipelines.depthInstanced);
+				drawCullBatches();
+			}
+			cb->bindPipeline(getInstancedPipeline());
+			setActorRenderState(cb, prepass);
+			drawCullBatches();
+			instanceBatchCount = static_cast<uint32_t>(cullBatches.size());
+
+		} else if (renderPath == static_cast<int32_t>(RenderPath::Instanced)) {
+			// Group visible actors by model and level of detail, so each primitive of a model only needs to be drawn once per level
+			for (auto& it : instanceBatches) {
+				it.second.clear();
+			}
+			const uint32_t visibleCount = visibleActorCount;
+			for (uint32_t i = 0; i < visibleCount; i++) {
+				const uint32_t index = visibleActorIndices[i];
+				instanceBatches[{ assetManager->getModel(actorSnapshot.models[index]), selectLod(index) }].push_back(toInstanceData(index));
+			}
+
+			InstanceData* instanceData = static_cast<InstanceData*>(frame.instanceAllocation.mapped);
+			// The instance data is written by the first of the passes, the main pass then draws the same instances
+			for (const bool depthOnly : { true, false }) {
+				if (depthOnly && !prepass) {
+					continue;
+				}
+				cb->bindPipeline(depthOnly ? scenePipelines.depthInstanced : getInstancedPipeline());
+				if (!depthOnly) {
+					setActorRenderState(cb, prepass);
+				}
+				const bool writeInstances = depthOnly || !prepass;
+				uint32_t firstInstance = 0;
+				for (auto& it : instanceBatches) {
+					const uint32_t instanceCount = std::min(static_cast<uint32_t>(it.second.size()), instanceCapacity - firstInstance);
+					if (instanceCount == 0) {
+						continue;
+					}
+					if (writeInstances) {
+						memcpy(&instanceData[firstInstance], it.second.data(), instanceCount * sizeof(InstanceData));
+					}
+					if (!depthOnly) {
+						setShadingRate(cb, getShadingRate(it.first.second));
+					}
+					it.first.first->drawInstanced(cb, getDrawContext(glTFPipelineLayout->handle), instanceCount, firstInstance, true, it.first.second);
+					firstInstance += instanceCount;
+					if (!depthOnly) {
+						visibleObjects += instanceCount;
+						instanceBatchCount++;
+					}
+				}
+			}
+		} else if (renderPath == static_cast<int32_t>(RenderPath::MeshShaders)) {
+			// Actors are culled on the CPU and grouped by model, the task shader then culls the meshlets of each visible instance
+			for (auto& it : instanceBatches) {
+				it.second.clear();
+			}
+			const uint32_t visibleCount = visibleActorCount;
+			for (uint32_t i = 0; i < visibleCount; i++) {
+				const uint32_t index = visibleActorIndices[i];
+				instanceBatches[{ assetManager->getModel(actorSnapshot.models[index]), 0 }].push_back(toInstanceData(index));
+			}
+
+			InstanceData* instanceData = static_cast<InstanceData*>(frame.instanceAllocation.mapped);
+			uint32_t firstInstance = 0;
+			// Models without meshlets (e.g. placeholders) are drawn with the instanced pipeline first
+			cb->bindPipeline(getInstancedPipeline());
+			setActorRenderState(cb, false);
+			for (const bool meshlets : { false, true }) {
+				if (meshlets) {
+					cb->bindPipeline(getActorPipeline(scenePipelines.gltfMesh));
+					cb->bindDescriptorSets(meshletPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+				}
+				for (auto& it : instanceBatches) {
+					vkglTF::Model* model = it.first.first;
+					const uint32_t instanceCount = std::min(static_cast<uint32_t>(it.second.size()), instanceCapacity - firstInstance);
+					if (instanceCount == 0 || model->hasMeshlets() != meshlets) {
+						continue;
+					}
+					memcpy(&instanceData[firstInstance], it.second.data(), instanceCount * sizeof(InstanceData));
+					if (meshlets) {
+						model->drawMeshlets(cb, getDrawContext(meshletPipelineLayout->handle), instanceCount, firstInstance);
+					} else {
+						model->drawInstanced(cb, getDrawContext(glTFPipelineLayout->handle), instanceCount, firstInstance, true);
+					}
+					firstInstance += instanceCount;
+					visibleObjects += instanceCount;
+					instanceBatchCount++;
+				}
+			}
+		} else {
+			const uint32_t visibleCount = visibleActorCount;
+			visibleObjects += visibleCount;
+			if (prepass) {
+				cb->bindPipeline(scenePipelines.depth);
+				recordActors(cb, 0, visibleCount);
+			}
+			cb->bindPipeline(getActorPipeline(scenePipelines.gltf));
+			setActorRenderState(cb, prepass);
+			recordActors(cb, 0, visibleCount);
+		}
+		recordSkinnedActors(cb, frame);
+		// After all instances of the instanced path, which are capped at instanceCapacity
+		recordImpostors(cb, frame, (renderPath == static_cast<int32_t>(RenderPath::Instanced)) ? std::min(visibleActorCount, instanceCapacity) : 0);
+		cb->endScope();
+
+		// With occlusion culling, the fullscreen skybox is drawn by the late pass, once all actors are in the depth buffer
+		if (fullscreenSkybox && !occlusionPass) {
+			cb->beginScope("Skybox");
+			recordBackdrop(cb, frame);
+			cb->endScope();
+		}
+
+		// With occlusion culling, particles are drawn by the late pass on top of all actors
+		if (!occlusionPass) {
+			cb->beginScope("Particles");
+			drawParticles(cb, frame);
+			cb->endScope();
+			recordRenderViews(cb, frame);
+		}
+
+		// With occlusion culling, the overlay is drawn by the late pass, with dynamic resolution by the upscale pass
+		if (!occlusionPass && !frame.scaledScene && overlay->visible) {
+			cb->beginScope("Overlay");
+			overlay->draw(cb, getCurrentFrameIndex());
+			cb->endScope();
+		}
+		cb->endRendering();
+	}
+
+	// Second scene pass with occlusion culling, draws the actors that passed the late culling phase on top of the early pass' attachments
+	void recordLateScenePass(CommandBuffer* cb, FrameObjects& frame)
+	{
+		const bool multiSampling = (settings.sampleCount > VK_SAMPLE_COUNT_1_BIT);
+		sceneAttachments.color.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		sceneAttachments.color.storeOp = multiSampling ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+		if (multiSampling) {
+			sceneAttachments.color.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		}
+		sceneAttachments.depth.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		sceneAttachments.depth.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		sceneAttachments.depth.resolveMode = VK_RESOLVE_MODE_NONE;
+		sceneAttachments.stencil = sceneAttachments.depth;
+		beginScreenRendering(cb, sceneAttachments.renderingInfo);
+
+		cb->setViewport(0.0f, 0.0f, (float)sceneExtent.width, (float)sceneExtent.height, 0.0f, 1.0f);
+		cb->setScissor(0, 0, sceneExtent.width, sceneExtent.height);
+		cb->bindDescriptorSets(glTFPipelineLayout, { frame.descriptorSet, frame.descriptorSetTextures });
+		cb->beginScope("Actors");
+		const bool prepass = depthPrepassEnabled();
+		auto drawCullBatches = [&]() {
+			for (uint32_t i = 0; i < static_cast<uint32_t>(cullBatches.size()); i++) {
+				setShadingRate(cb, getShadingRate(cullBatchLods[i]));
+				cullBatchModels[i]->drawIndirect(cb, getDrawContext(glTFPipelineLayout->handle), frame.indirectCommandBuffer->buffer, (frame.cullCommandCount + cullBatches[i].firstCommand) * sizeof(VkDrawIndexedIndirectCommand), frame.drawCountBuffer->buffer, (frame.cullBatchCount + i) * sizeof(uint32_t), true, cullBatchLods[i]);
+			}
+		};
+		if (prepass) {
+			cb->bindPipeline(scenePipelines.depthInstanced);
+			drawCullBatches();
+		}
+		cb->bindPipeline(getInstancedPipeline());
+		setActorRenderState(cb, prepass);
+		drawCullBatches();
+		cb->endScope();
+
+		if (fullscreenSkybox) {
+			cb->beginScope("Skybox");
+			recordBackdrop(cb, frame);
+			cb->endScope();
+		}
+
+		cb->beginScope("Particles");
+		drawParticles(cb, frame);
+		cb->endScope();
+
+		recordRenderViews(cb, frame);
+
+		if (overlay->visible) {
+			cb->beginScope("Overlay");
+			overlay->draw(cb, getCurrentFrameIndex());
+			cb->endScope();
+		}
+		cb->endRendering();
+	}
+
+	// Resolves the jittered scene color target into the current layer of the temporal history, blended with the previous layer reprojected to the current view
+	void recordTemporalResolve(CommandBuffer* cb, FrameObjects& frame)
+	{
+		const uint32_t layer = temporalAA.layer;
+		uint64_t key = 0xcbf29ce484222325ull;
+		hashBytes(key, &sceneColorGeneration, sizeof(sceneColorGeneration));
+		hashBytes(key, &depthPyramid.generation, sizeof(depthPyramid.generation));
+		hashBytes(key, &temporalHistory.generation, sizeof(temporalHistory.generation));
+		hashBytes(key, &layer, sizeof(layer));
+		if (frame.temporalResolveKey != key) {
+			const VkDescriptorImageInfo sceneDescriptor{ .sampler = upscaleSampler, .imageView = renderGraph->getImageView(graphResources.sceneColor), .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			const VkDescriptorImageInfo depthDescriptor{ .imageView = depthPyramid.depthView, .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+			const VkDescriptorImageInfo historyDescriptor{ .sampler = upscaleSampler, .imageView = temporalHistory.layerViews[layer ^ 1]->handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+			const VkDescriptorImageInfo destinationDescriptor{ .imageView = temporalHistory.layerViews[layer]->handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+			descriptorWrites.addImages(frame.temporalResolveDescriptorSet->handle, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &sceneDescriptor);
+			descriptorWrites.addImages(frame.temporalResolveDescriptorSet->handle, 1, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &depthDescriptor);
+			descriptorWrites.addImages(frame.temporalResolveDescriptorSet->handle, 2, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &historyDescriptor);
+			descriptorWrites.addImages(frame.temporalResolveDescriptorSet->handle, 3, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &destinationDescriptor);
+			descriptorWrites.flush();
+			frame.temporalResolveKey = key;
+		}
+
+		const TemporalResolvePushConstBlock pushConstBlock{
+			.reprojection = temporalAA.reprojection,
+			.jitter = camera.jitter,
+			.uvScale = glm::vec2((float)sceneExtent.width / (float)width, (float)sceneExtent.height / (float)height),
+			.texelSize = glm::vec2(1.0f / (float)width, 1.0f / (float)height),
+			.outputSize = glm::uvec2(width, height),
+			.historyWeight = temporalHistoryWeight,
+			.resetHistory = temporalAA.historyValid ? 0u : 1u,
+			.reverseDepth = camera.reverseDepth ? 1u : 0u
+		};
+		cb->bindPipeline(scenePipelines.temporalResolve);
+		cb->bindDescriptorSets(temporalResolvePipelineLayout, { frame.temporalResolveDescriptorSet }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+		cb->updatePushConstant(temporalResolvePipelineLayout, 0, &pushConstBlock);
+		cb->dispatch((width + 7) / 8, (height + 7) / 8, 1);
+		temporalAA.historyValid = true;
+	}
+
+	VkExtent2D getBloomLevelExtent(uint32_t level) const
+	{
+		// Same rounding as the render graph's transient images
+		const float scale = 1.0f / static_cast<float>(2u << level);
+		return { std::max(static_cast<uint32_t>(width * scale), 1u), std::max(static_cast<uint32_t>(height * scale), 1u) };
+	}
+
+	// Sets [0, bloomLevelCount) downsample into the levels, the following ones upsample from level i + 1 into level i
+	void updateBloomDescriptors(FrameObjects& frame)
+	{
+		const uint32_t layer = temporalAA.layer;
+		uint64_t key = 0xcbf29ce484222325ull;
+		hashBytes(key, &sceneColorGeneration, sizeof(sceneColorGeneration));
+		hashBytes(key, &temporalHistory.generation, sizeof(temporalHistory.generation));
+		hashBytes(key, &frame.temporalResolve, sizeof(frame.temporalResolve));
+		hashBytes(key, &layer, sizeof(layer));
+		if (frame.bloomDescriptorKey == key) {
+			return;
+		}
+		for (uint32_t i = 0; i < bloomLevelCount; i++) {
+			const VkDescriptorImageInfo sourceDescriptor = (i > 0) ?
+				VkDescriptorImageInfo{ .sampler = upscaleSampler, .imageView = renderGraph->getImageView(graphResources.bloomLevels[i - 1]), .imageLayout = VK_IMAGE_LAYOUT_GENERAL } :
+				frame.temporalResolve ?
+				VkDescriptorImageInfo{ .sampler = upscaleSampler, .imageView = temporalHistory.layerViews[layer]->handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL } :
+				VkDescriptorImageInfo{ .sampler = upscaleSampler, .imageView = renderGraph->getImageView(graphResources.sceneColor), .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			const VkDescriptorImageInfo destinationDescriptor{ .imageView = renderGraph->getImageView(graphResources.bloomLevels[i]), .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+			descriptorWrites.addImages(frame.bloomDescriptorSets[i]->handle, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &sourceDescriptor);
+			descriptorWrites.addImages(frame.bloomDescriptorSets[i]->handle, 1, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &destinationDescriptor);
+		}
+		for (uint32_t i = 0; i < bloomLevelCount - 1; i++) {
+			DescriptorSet* descriptorSet = frame.bloomDescriptorSets[bloomLevelCount + i];
+			const VkDescriptorImageInfo sourceDescriptor{ .sampler = upscaleSampler, .imageView = renderGraph->getImageView(graphResources.bloomLevels[i + 1]), .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+			const VkDescriptorImageInfo destinationDescriptor{ .imageView = renderGraph->getImageView(graphResources.bloomLevels[i]), .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+			descriptorWrites.addImages(descriptorSet->handle, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &sourceDescriptor);
+			descriptorWrites.addImages(descriptorSet->handle, 1, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &destinationDescriptor);
+		}
+		descriptorWrites.flush();
+		frame.bloomDescriptorKey = key;
+	}
+
+	// Downsamples the HDR scene (or the temporal history) into the given level of the bloom chain, the first level starts at half the output size
+	void recordBloomDownsample(CommandBuffer* cb, FrameObjects& frame, uint32_t level)
+	{
+		if (level == 0) {
+			updateBloomDescriptors(frame);
+		}
+		const VkExtent2D extent = getBloomLevelExtent(level);
+		const VkExtent2D sourceExtent = (level > 0) ? getBloomLevelExtent(level - 1) : VkExtent2D{ width, height };
+		// The scene only covers part of the scene color target with dynamic resolution, the temporal history always covers all of it
+		const bool scaledSource = (level == 0) && !frame.temporalResolve;
+		const BloomDownsamplePushConstBlock pushConstBlock{
+			.sourceUVScale = scaledSource ? glm::vec2((float)sceneExtent.width / (float)width, (float)sceneExtent.height / (float)height) : glm::vec2(1.0f),
+			.sourceTexelSize = glm::vec2(1.0f / (float)sourceExtent.width, 1.0f / (float)sourceExtent.height),
+			.destinationSize = glm::uvec2(extent.width, extent.height),
+			.firstLevel = (level == 0) ? 1u : 0u
+		};
+		cb->bindPipeline(scenePipelines.bloomDownsample);
+		cb->bindDescriptorSets(bloomDownsamplePipelineLayout, { frame.bloomDescriptorSets[level] }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+		cb->updatePushConstant(bloomDownsamplePipelineLayout, 0, &pushConstBlock);
+		cb->dispatch((extent.width + 7) / 8, (extent.height + 7) / 8, 1);
+	}
+
+	// Adds the given level of the bloom chain (which already contains the sum of all smaller levels) to the next larger one
+	void recordBloomUpsample(CommandBuffer* cb, FrameObjects& frame, uint32_t level)
+	{
+		const VkExtent2D extent = getBloomLevelExtent(level - 1);
+		const VkExtent2D sourceExtent = getBloomLevelExtent(level);
+		const BloomUpsamplePushConstBlock pushConstBlock{
+			.sourceTexelSize = glm::vec2(1.0f / (float)sourceExtent.width, 1.0f / (float)sourceExtent.height),
+			.destinationSize = glm::uvec2(extent.width, extent.height)
+		};
+		cb->bindPipeline(scenePipelines.bloomUpsample);
+		cb->bindDescriptorSets(bloomUpsamplePipelineLayout, { frame.bloomDescriptorSets[bloomLevelCount + level - 1] }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+		cb->updatePushConstant(bloomUpsamplePipelineLayout, 0, &pushConstBlock);
+		cb->dispatch((extent.width + 7) / 8, (extent.height + 7) / 8, 1);
+	}
+
+	// Upscales the scene color target rendered with dynamic resolution (or the temporal history) to the swap chain, the overlay is drawn on top at full resolution
+	void recordUpscalePass(CommandBuffer* cb, FrameObjects& frame)
+	{
+		const bool multiSampling = (settings.sampleCount > VK_SAMPLE_COUNT_1_BIT);
+		// The history is already at full resolution, so it's only sharpened
+		const VkImageView sourceView = frame.temporalResolve ? temporalHistory.layerViews[temporalAA.layer]->handle : renderGraph->getImageView(graphResources.sceneColor);
+		if ((frame.sceneColorGeneration != sceneColorGeneration) || (frame.upscaleSourceView != sourceView)) {
+			const VkDescriptorImageInfo sourceDescriptor{ .sampler = upscaleSampler, .imageView = sourceView, .imageLayout = frame.temporalResolve ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			// Only read with post processing, the source fills the binding otherwise
+			const VkDescriptorImageInfo bloomDescriptor = settings.postProcessing ?
+				VkDescriptorImageInfo{ .sampler = upscaleSampler, .imageView = renderGraph->getImageView(graphResources.bloomLevels[0]), .imageLayout = VK_IMAGE_LAYOUT_GENERAL } : sourceDescriptor;
+			descriptorWrites.addImages(frame.upscaleDescriptorSet->handle, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &sourceDescriptor);
+			descriptorWrites.addImages(frame.upscaleDescriptorSet->handle, 1, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &bloomDescriptor);
+			descriptorWrites.flush();
+			frame.sceneColorGeneration = sceneColorGeneration;
+			frame.upscaleSourceView = sourceView;
+		}
+
+		// Every pixel is written by the upscale, so nothing needs to be loaded
+		VkRenderingAttachmentInfo colorAttachment{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+			.imageView = multiSampling ? multisampleTarget.color.view : swapChain->buffers[swapChain->currentImageIndex].view,
+			.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.storeOp = multiSampling ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+		};
+		if (multiSampling) {
+			colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+			colorAttachment.resolveImageView = swapChain->buffers[swapChain->currentImageIndex].view;
+			colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
+		}
+		// Not used by the upscale, but the overlay pipeline is created for the scene's depth format
+		VkRenderingAttachmentInfo depthStencilAttachment{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+			.imageView = multiSampling ? multisampleTarget.depth.view : depthStencil.view,
+			.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_STENCIL_READ_ONLY_OPTIMAL,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.clearValue = { .depthStencil = { getDepthClearValue(), 0 } }
+		};
+		VkRenderingInfo renderingInfo{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+			.renderArea = { 0, 0, width, height },
+			.layerCount = 1,
+			.colorAttachmentCount = 1,
+			.pColorAttachments = &colorAttachment,
+			.pDepthAttachment = &depthStencilAttachment,
+			.pStencilAttachment = &depthStencilAttachment
+		};
+		beginScreenRendering(cb, renderingInfo);
+		cb->setViewport(0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f);
+		cb->setScissor(0, 0, width, height);
+		const UpscalePushConstBlock pushConstBlock{
+			.uvScale = frame.temporalResolve ? glm::vec2(1.0f) : glm::vec2((float)sceneExtent.width / (float)width, (float)sceneExtent.height / (float)height),
+			.texelSize = glm::vec2(1.0f / (float)width, 1.0f / (float)height),
+			.sharpness = ((frame.temporalResolve || (sceneExtent.width < width)) && !debugViewEnabled()) ? upscaleSharpness : 0.0f,
+			.exposure = exposure,
+			.bloomStrength = bloom ? bloomStrength : 0.0f,
+			.bloomLevels = static_cast<float>(bloomLevelCount),
+			// Debug views are shown as is, so their colors match the legend
+			.passThrough = debugViewEnabled()
+		};
+		cb->bindPipeline(scenePipelines.upscale);
+		cb->bindDescriptorSets(upscalePipelineLayout, { frame.upscaleDescriptorSet });
+		cb->updatePushConstant(upscalePipelineLayout, 0, &pushConstBlock);
+		cb->draw(3, 1, 0, 0);
+
+		if (overlay->visible) {
+			cb->beginScope("Overlay");
+			overlay->draw(cb, getCurrentFrameIndex());
+			cb->endScope();
+		}
+		cb->endRendering();
+	}
+
+	// Declares the frame's passes, barriers between them and the attachment memory are managed by the render graph
+	void setupRenderGraph()
+	{
+		const bool multiSampling = (settings.sampleCount > VK_SAMPLE_COUNT_1_BIT);
+		// Contents of the pyramid are rebuilt every frame
+		graphResources.depthPyramid = renderGraph->importImage("Depth pyramid", VK_IMAGE_ASPECT_COLOR_BIT, true);
+		graphResources.indirectCommands = renderGraph->importBuffer("Indirect commands");
+		graphResources.drawCounts = renderGraph->importBuffer("Draw counts");
+		graphResources.instances = renderGraph->importBuffer("Instances");
+		graphResources.actorVisibility = renderGraph->importBuffer("Actor visibility");
+		graphResources.bodies = renderGraph->importBuffer("Simulation bodies");
+		graphResources.previousBodies = renderGraph->importBuffer("Previous simulation bodies");
+		graphResources.particles = renderGraph->importBuffer("Particles");
+		graphResources.particleLists = renderGraph->importBuffer("Particle lists");
+		graphResources.particleCounters = renderGraph->importBuffer("Particle counters");
+		graphResources.clusterLights = renderGraph->importBuffer("Cluster lights");
+		graphResources.staticShadowMap = renderGraph->importImage("Static shadow map", VK_IMAGE_ASPECT_DEPTH_BIT);
+		// Cleared by each frame's dynamic shadow pass
+		graphResources.dynamicShadowMap = renderGraph->importImage("Dynamic shadow map", VK_IMAGE_ASPECT_DEPTH_BIT, true);
+		// Same size as the swap chain, dynamic resolution only renders to part of it so it doesn't need to be recreated when the scale changes
+		graphResources.sceneColor = renderGraph->addImage({
+			.name = "Scene color",
+			.format = sceneColorFormat,
+			.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+		});
+		// Both layers are kept across frames, as each frame reads the result of the previous one
+		graphResources.temporalHistory = renderGraph->importImage("Temporal history");
+		// Only live between the scene and the upscale, so their memory can be shared with other transient images
+		if (settings.postProcessing) {
+			for (uint32_t i = 0; i < bloomLevelCount; i++) {
+				graphResources.bloomLevels[i] = renderGraph->addImage({
+					.name = "Bloom level " + std::to_string(i),
+					.format = VK_FORMAT_R16G16B16A16_SFLOAT,
+					.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+					.scale = 1.0f / static_cast<float>(2u << i)
+				});
+			}
+		}
+
+		// Written by the visibility pass and shading, read back by the scene pass' composite
+		if (visibilityBufferSupported()) {
+			graphResources.visibilityTarget = renderGraph->addImage({
+				.name = "Visibility target",
+				.format = visibilityTargetFormat,
+				.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+			});
+			graphResources.visibilityColor = renderGraph->addImage({
+				.name = "Visibility color",
+				.format = visibilityColorFormat,
+				.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+			});
+			graphResources.visibilityBins = renderGraph->importBuffer("Visibility bins");
+			graphResources.visibilityPixels = renderGraph->importBuffer("Visibility pixels");
+		}
+
+		const RenderGraphResource colorTarget = multiSampling ? multisampleTarget.color.resource : swapChainResource;
+		const RenderGraphResource depthTarget = multiSampling ? multisampleTarget.depth.resource : depthStencil.resource;
+		const VkImageLayout depthLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_STENCIL_READ_ONLY_OPTIMAL;
+		std::vector<RenderGraphAccess> sceneAccesses = {
+			RenderGraph::colorAttachment(colorTarget),
+			RenderGraph::depthAttachment(depthTarget, depthLayout),
+			RenderGraph::indirectRead(graphResources.indirectCommands),
+			RenderGraph::indirectRead(graphResources.drawCounts),
+			RenderGraph::storageRead(graphResources.instances, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT),
+			RenderGraph::storageRead(graphResources.particles, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT),
+			RenderGraph::storageRead(graphResources.particleLists, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT),
+			RenderGraph::indirectRead(graphResources.particleCounters),
+			RenderGraph::storageRead(graphResources.clusterLights, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT),
+			RenderGraph::sampledRead(graphResources.staticShadowMap, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT),
+			RenderGraph::sampledRead(graphResources.dynamicShadowMap, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT),
+		};
+		if (multiSampling) {
+			sceneAccesses.push_back(RenderGraph::resolveAttachment(swapChainResource));
+		}
+		std::vector<RenderGraphAccess> lateSceneAccesses = sceneAccesses;
+		if (visibilityBufferSupported()) {
+			sceneAccesses.push_back(RenderGraph::sampledRead(graphResources.visibilityTarget, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT));
+			sceneAccesses.push_back(RenderGraph::sampledRead(graphResources.visibilityColor, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT));
+		}
+		// With dynamic resolution, the scene is rendered (or resolved) to the scene color target instead of the swap chain
+		std::vector<RenderGraphAccess> scaledSceneAccesses = sceneAccesses;
+		for (RenderGraphAccess& access : scaledSceneAccesses) {
+			if (access.resource == swapChainResource) {
+				access.resource = graphResources.sceneColor;
+			}
+		}
+		std::vector<RenderGraphAccess> upscaleAccesses = {
+			RenderGraph::sampledRead(graphResources.sceneColor, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT),
+			RenderGraph::colorAttachment(colorTarget),
+			RenderGraph::depthAttachment(depthTarget, depthLayout),
+		};
+		if (multiSampling) {
+			upscaleAccesses.push_back(RenderGraph::resolveAttachment(swapChainResource));
+		}
+		if (settings.postProcessing) {
+			upscaleAccesses.push_back(RenderGraph::sampledRead(graphResources.bloomLevels[0], VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL));
+		}
+		std::vector<RenderGraphAccess> temporalUpscaleAccesses = upscaleAccesses;
+		temporalUpscaleAccesses[0] = RenderGraph::sampledRead(graphResources.temporalHistory, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL);
+		// The depth resolve is only enabled for the early pass (for building the depth pyramid)
+		if (multiSampling && !settings.tileBasedRendering && !multisampledDepthReduction()) {
+			sceneAccesses.push_back(RenderGraph::resolveAttachment(depthStencil.resource, depthLayout));
+		}
+
+		// Both run on the async compute queue if available, as they only depend on the previous frame
+		// With occlusion culling, the early phase reads the visibility written by the previous frame's late phase and has to wait for that frame's graphics work
+		renderGraph->addPass({
+			.name = "Simulation",
+			.accesses = {
+				RenderGraph::storageRead(graphResources.previousBodies, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				// Written by a copy when the simulation (re)starts
+				{ graphResources.bodies, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT },
+			},
+			.execute = [this](CommandBuffer* cb) { recordSimulation(cb, *recordingFrame); },
+			.enabled = [this]() { return gpuSimulation && (renderPath == static_cast<int32_t>(RenderPath::GPUDriven)); },
+			.asyncCompute = true
+		});
+		// Early culling phase (or frustum culling only) of the GPU driven path
+		renderGraph->addPass({
+			.name = "Culling",
+			.accesses = {
+				RenderGraph::storageReadWrite(graphResources.indirectCommands, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				RenderGraph::storageReadWrite(graphResources.drawCounts, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				RenderGraph::storageWrite(graphResources.instances, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				RenderGraph::storageRead(graphResources.actorVisibility, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				RenderGraph::storageRead(graphResources.bodies, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+			},
+			.execute = [this](CommandBuffer* cb) { recordCulling(cb, *recordingFrame); },
+			.enabled = [this]() { return renderPath == static_cast<int32_t>(RenderPath::GPUDriven); },
+			.asyncCompute = true
+		});
+		// Casters are culled by the culling pass, static ones only if the cached cascades are rendered again this frame
+		renderGraph->addPass({
+			.name = "Static shadows",
+			.accesses = {
+				RenderGraph::indirectRead(graphResources.indirectCommands),
+				RenderGraph::indirectRead(graphResources.drawCounts),
+				RenderGraph::storageRead(graphResources.instances, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT),
+				RenderGraph::depthAttachment(graphResources.staticShadowMap),
+			},
+			.execute = [this](CommandBuffer* cb) { recordShadowPass(cb, *recordingFrame, true); },
+			.enabled = [this]() { return shadowsEnabled() && shadows.refreshStatic; }
+		});
+		renderGraph->addPass({
+			.name = "Dynamic shadows",
+			.accesses = {
+				RenderGraph::indirectRead(graphResources.indirectCommands),
+				RenderGraph::indirectRead(graphResources.drawCounts),
+				RenderGraph::storageRead(graphResources.instances, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT),
+				RenderGraph::depthAttachment(graphResources.dynamicShadowMap),
+			},
+			.execute = [this](CommandBuffer* cb) { recordShadowPass(cb, *recordingFrame, false); },
+			.enabled = [this]() { return shadowsEnabled(); }
+		});
+		// Always run, so the scene never reads stale cluster lists (without lights it only clears the counts)
+		renderGraph->addPass({
+			.name = "Light culling",
+			.accesses = {
+				RenderGraph::storageWrite(graphResources.clusterLights, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+			},
+			.execute = [this](CommandBuffer* cb) { recordLightCulling(cb, *recordingFrame); },
+			.asyncCompute = true
+		});
+		// State is kept across frames, so the graph's barriers also order each pass after the previous frame's particle draws
+		renderGraph->addPass({
+			.name = "Particles",
+			.accesses = {
+				RenderGraph::storageReadWrite(graphResources.particles, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				RenderGraph::storageReadWrite(graphResources.particleLists, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				// Cleared on the first frame, used for the indirect simulation dispatch and copied to the frame's stats
+				{ graphResources.particleCounters, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT,
+					VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT },
+			},
+			.execute = [this](CommandBuffer* cb) { recordParticles(cb, *recordingFrame); },
+			.enabled = [this]() { return useParticles; }
+		});
+		if (visibilityBufferSupported()) {
+			renderGraph->addPass({
+				.name = "Visibility",
+				.accesses = {
+					RenderGraph::colorAttachment(graphResources.visibilityTarget),
+					RenderGraph::depthAttachment(depthStencil.resource, depthLayout),
+					RenderGraph::indirectRead(graphResources.indirectCommands),
+					RenderGraph::indirectRead(graphResources.drawCounts),
+					RenderGraph::storageRead(graphResources.instances, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT),
 				},
-				.blending = {
-					.attachments = { 
-						{.blendEnable = VK_FALSE, .colorWriteMask = 0xF }
-					}
+				.execute = [this](CommandBuffer* cb) { recordVisibilityPass(cb, *recordingFrame); },
+				.enabled = [this]() { return recordingFrame->visibilityBuffer; }
+			});
+			// Stays on the graphics queue, as it's between two graphics passes of the same frame
+			renderGraph->addPass({
+				.name = "Visibility shading",
+				.accesses = {
+					RenderGraph::sampledRead(graphResources.visibilityTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					// Cleared before binning, holds the dispatch arguments of the shading pass
+					{ graphResources.visibilityBins, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT,
+						VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT },
+					RenderGraph::storageReadWrite(graphResources.visibilityPixels, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					RenderGraph::storageWrite(graphResources.visibilityColor, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					RenderGraph::storageRead(graphResources.instances, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					RenderGraph::storageRead(graphResources.clusterLights, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					RenderGraph::sampledRead(graphResources.staticShadowMap, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					RenderGraph::sampledRead(graphResources.dynamicShadowMap, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
 				},
-				.dynamicState = {
-					DynamicState::Scissor,
-					DynamicState::Viewport
+				.execute = [this](CommandBuffer* cb) { recordVisibilityShading(cb, *recordingFrame); },
+				.enabled = [this]() { return recordingFrame->visibilityBuffer; }
+			});
+		}
+		renderGraph->addPass({
+			.name = "Scene",
+			.accesses = sceneAccesses,
+			.execute = [this](CommandBuffer* cb) { recordScenePass(cb, *recordingFrame); },
+			.enabled = [this]() { return !recordingFrame->scaledScene; }
+		});
+		renderGraph->addPass({
+			.name = "Scaled scene",
+			.accesses = scaledSceneAccesses,
+			.execute = [this](CommandBuffer* cb) { recordScenePass(cb, *recordingFrame); },
+			.enabled = [this]() { return recordingFrame->scaledScene; }
+		});
+		if (temporalAntiAliasingSupported()) {
+			renderGraph->addPass({
+				.name = "Temporal resolve",
+				.accesses = {
+					RenderGraph::sampledRead(graphResources.sceneColor, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					RenderGraph::sampledRead(depthStencil.resource, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL),
+					// Reads the previous frame's layer and writes the current one
+					{ graphResources.temporalHistory, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL },
 				},
-				.pipelineRenderingInfo = {
-					.colorAttachmentCount = 1,
-					.pColorAttachmentFormats = &format,
+				.execute = [this](CommandBuffer* cb) { recordTemporalResolve(cb, *recordingFrame); },
+				.enabled = [this]() { return recordingFrame->temporalResolve; }
+			});
+		}
+		// Bloom chain at half the output size and below, every step only depends on the previous one
+		// The chain reads the scene of the same frame and its levels are transient, so it can't be moved to the async compute queue
+		if (settings.postProcessing) {
+			renderGraph->addPass({
+				.name = "Bloom downsample 0",
+				.accesses = {
+					RenderGraph::sampledRead(graphResources.sceneColor, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					RenderGraph::storageWrite(graphResources.bloomLevels[0], VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
 				},
-				.enableHotReload = false
+				.execute = [this](CommandBuffer* cb) { recordBloomDownsample(cb, *recordingFrame, 0); },
+				.enabled = [this]() { return bloom && !recordingFrame->temporalResolve; }
 			});
-
-			VkRenderingAttachmentInfo colorAttachment = {
-				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
-				.imageView = offscreenView->handle,
-				.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL,
-				.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-				.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-				.clearValue = { .color = { 0.0f, 0.0f, 0.0f, 0.0f } }
-			};
-
-			VkRenderingInfo renderingInfo = {
-				.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
-				.renderArea = { 0, 0, static_cast<uint32_t>(dim), static_cast<uint32_t>(dim) },
-				.layerCount = 1,
-				.colorAttachmentCount = 1,
-				.pColorAttachments = &colorAttachment,
-			};
-
-			// Render cubemap
-			const std::vector<glm::mat4> matrices = {
-				glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-				glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-				glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-				glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-				glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-				glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-			};
-
-			CommandBuffer* cb = new CommandBuffer({ .device = *vulkanDevice, .pool = commandPool });
-
-			cb->begin();
-			// Initial transition for offscreen image
-			cb->insertImageMemoryBarrier({
-				.srcAccessMask = 0,
-				.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-				.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-				.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-				.image = offscreen->handle,
-				.subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 }
-				}, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-			// Change image layout for all cubemap faces to transfer destination
-			cb->insertImageMemoryBarrier({
-				.srcAccessMask = 0,
-				.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-				.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-				.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				.image = cubemap->image,
-				.subresourceRange = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount =  numMips, .layerCount = 6 }
-				}, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-
-			for (uint32_t m = 0; m < numMips; m++) {
-				for (uint32_t f = 0; f < 6; f++) {
-					glm::vec2 viewport = glm::vec2(static_cast<float>(dim * std::pow(0.5f, m)), static_cast<float>(dim * std::pow(0.5f, m)));
-
-					cb->insertImageMemoryBarrier({
-						.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-						.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-						.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-						.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-						.image = offscreen->handle,
-						.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
-						}, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-					cb->beginRendering(renderingInfo);
-					cb->setViewport(0, 0, viewport.x, viewport.y, 0.0f, 1.0f);
-					cb->setScissor(0, 0, static_cast<uint32_t>(viewport.x), static_cast<uint32_t>(viewport.y));
-					
-					// Pass parameters for current pass using a push constant block
-					switch (target) {
-					case IRRADIANCE:
-						pushBlockIrradiance.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-						cb->updatePushConstant(pipelineLayout, 0, &pushBlockIrradiance);
-						break;
-					case RADIANCE:
-						pushBlockPrefilterEnv.mvp = glm::perspective((float)(M_PI / 2.0), 1.0f, 0.1f, 512.0f) * matrices[f];
-						pushBlockPrefilterEnv.roughness = (float)m / (float)(numMips - 1);
-						cb->updatePushConstant(pipelineLayout, 0, &pushBlockPrefilterEnv);
-						break;
-					};
-
-					cb->bindPipeline(pipeline);
-					cb->bindDescriptorSets(pipelineLayout, { descriptorSet });
-					assetManager->models["crate"]->draw(cb->handle, pipelineLayout->handle, glm::mat4(1.0f), true, true);
-
-					cb->endRendering();
-
-					// Copy region for transfer from framebuffer to cube face
-					VkImageCopy copyRegion = {
-						.srcSubresource = {
-							.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-							.mipLevel = 0,
-							.baseArrayLayer = 0,
-							.layerCount = 1
-						},
-						.srcOffset = { 0, 0, 0 },
-						.dstSubresource = {
-							.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-							.mipLevel = m,
-							.baseArrayLayer = f,
-							.layerCount = 1
-						},
-						.dstOffset = { 0, 0, 0 },
-						.extent = {
-							.width = static_cast<uint32_t>(viewport.x),
-							.height = static_cast<uint32_t>(viewport.y),
-							.depth = 1
-}
-					};
-					vkCmdCopyImage(cb->handle, offscreen->handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, cubemap->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-					cb->insertImageMemoryBarrier({
-						.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-						.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-						.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-						.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-						.image = offscreen->handle,
-						.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
-						}, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-				}
+			if (temporalAntiAliasingSupported()) {
+				renderGraph->addPass({
+					.name = "Temporal bloom downsample 0",
+					.accesses = {
+						RenderGraph::sampledRead(graphResources.temporalHistory, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL),
+						RenderGraph::storageWrite(graphResources.bloomLevels[0], VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					},
+					.execute = [this](CommandBuffer* cb) { recordBloomDownsample(cb, *recordingFrame, 0); },
+					.enabled = [this]() { return bloom && recordingFrame->temporalResolve; }
+				});
+			}
+			for (uint32_t i = 1; i < bloomLevelCount; i++) {
+				renderGraph->addPass({
+					.name = "Bloom downsample " + std::to_string(i),
+					.accesses = {
+						RenderGraph::sampledRead(graphResources.bloomLevels[i - 1], VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL),
+						RenderGraph::storageWrite(graphResources.bloomLevels[i], VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					},
+					.execute = [this, i](CommandBuffer* cb) { recordBloomDownsample(cb, *recordingFrame, i); },
+					.enabled = [this]() { return bloom; }
+				});
+			}
+			for (uint32_t i = bloomLevelCount - 1; i > 0; i--) {
+				renderGraph->addPass({
+					.name = "Bloom upsample " + std::to_string(i),
+					.accesses = {
+						RenderGraph::sampledRead(graphResources.bloomLevels[i], VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL),
+						RenderGraph::storageReadWrite(graphResources.bloomLevels[i - 1], VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+					},
+					.execute = [this, i](CommandBuffer* cb) { recordBloomUpsample(cb, *recordingFrame, i); },
+					.enabled = [this]() { return bloom; }
+				});
 			}
+		}
+		renderGraph->addPass({
+			.name = "Upscale",
+			.accesses = upscaleAccesses,
+			.execute = [this](CommandBuffer* cb) { recordUpscalePass(cb, *recordingFrame); },
+			.enabled = [this]() { return recordingFrame->scaledScene && !recordingFrame->temporalResolve; }
+		});
+		if (temporalAntiAliasingSupported()) {
+			renderGraph->addPass({
+				.name = "Temporal upscale",
+				.accesses = temporalUpscaleAccesses,
+				.execute = [this](CommandBuffer* cb) { recordUpscalePass(cb, *recordingFrame); },
+				.enabled = [this]() { return recordingFrame->temporalResolve; }
+			});
+		}
+		// Without occlusion culling the scene is a single pass, so all attachments are cleared, resolved and discarded on tile
+		if (settings.tileBasedRendering) {
+			addScreenshotPass();
+			compileRenderGraph();
+			return;
+		}
+		renderGraph->addPass({
+			.name = "Depth pyramid",
+			.accesses = {
+				RenderGraph::sampledRead(multisampledDepthReduction() ? multisampleTarget.depth.resource : depthStencil.resource, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL),
+				RenderGraph::storageWrite(graphResources.depthPyramid, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+			},
+			.execute = [this](CommandBuffer* cb) { recordDepthPyramid(cb); },
+			.enabled = [this]() { return occlusionPassEnabled(); }
+		});
+		renderGraph->addPass({
+			.name = "Late culling",
+			.accesses = {
+				RenderGraph::sampledRead(graphResources.depthPyramid, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_GENERAL),
+				RenderGraph::storageReadWrite(graphResources.indirectCommands, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				RenderGraph::storageReadWrite(graphResources.drawCounts, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				RenderGraph::storageReadWrite(graphResources.instances, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				RenderGraph::storageReadWrite(graphResources.actorVisibility, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+				RenderGraph::storageRead(graphResources.bodies, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT),
+			},
+			.execute = [this](CommandBuffer* cb) { dispatchCulling(cb, *recordingFrame, CullPhase::Late); },
+			.enabled = [this]() { return occlusionPassEnabled(); }
+		});
+		renderGraph->addPass({
+			.name = "Late scene",
+			.accesses = lateSceneAccesses,
+			.execute = [this](CommandBuffer* cb) { recordLateScenePass(cb, *recordingFrame); },
+			.enabled = [this]() { return occlusionPassEnabled(); }
+		});
+		addScreenshotPass();
 
-			cb->insertImageMemoryBarrier({
-				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-				.dstAccessMask = VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
-				.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-				.image = cubemap->image,
-				.subresourceRange = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = numMips, .layerCount = 6 }
-				}, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-			cb->end();
-			cb->oneTimeSubmit(queue);
-
-			cubemap->descriptor.imageView = cubemap->view;
-			cubemap->descriptor.sampler = cubemap->sampler;
-			cubemap->descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			switch (target) {
-			case IRRADIANCE:
-				skybox.irradianceIndex = assetManager->add("skybox_irradiance", cubemap);
-				break;
-			case RADIANCE:
-				skybox.radianceIndex = assetManager->add("skybox_radiance", cubemap);
-				break;
-			};
+		compileRenderGraph();
+	}
 
-			delete cb;
-			delete pipeline;
-			delete pipelineLayout;
-			delete descriptorPool;
-			delete descriptorSetLayout;
-			delete descriptorSet;
-			delete offscreen;
-			delete offscreenView;
+	// The overlay is drawn by the passes writing the swap chain image, so the pass copying it for screenshots needs to be added after all of them
+	void addScreenshotPass()
+	{
+		if (!(swapChain->imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+			return;
+		}
+		renderGraph->addPass({
+			.name = "Screenshot",
+			.accesses = {
+				{ .resource = swapChainResource, .stageMask = VK_PIPELINE_STAGE_2_COPY_BIT, .accessMask = VK_ACCESS_2_TRANSFER_READ_BIT, .layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL },
+			},
+			.execute = [this](CommandBuffer* cb) { recordScreenshot(cb); },
+			.enabled = [this]() { return screenshotRequested; },
+			.sideEffects = true
+		});
+	}
 
-			auto tEnd = std::chrono::high_resolution_clock::now();
-			auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-			std::cout << "Generating cube map with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+	// Only swap chains with 8 bit color channels can be written as they are
+	bool screenshotsSupported()
+	{
+		const VkFormat formats[] = { VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB };
+		return (swapChain->imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) && (std::find(std::begin(formats), std::end(formats), swapChain->colorFormat) != std::end(formats));
+	}
+
+	void recordScreenshot(CommandBuffer* cb)
+	{
+		const uint32_t imageWidth = width;
+		const uint32_t imageHeight = height;
+		const bool bgra = (swapChain->colorFormat == VK_FORMAT_B8G8R8A8_UNORM) || (swapChain->colorFormat == VK_FORMAT_B8G8R8A8_SRGB);
+		const uint64_t frameNumber = getRecordingFrameNumber();
+		const VkDeviceSize size = static_cast<VkDeviceSize>(imageWidth) * imageHeight * 4;
+		if (size > readbackBuffer->getSize()) {
+			std::cout << "Screenshot of " << imageWidth << "x" << imageHeight << " doesn't fit into the readback buffer" << std::endl;
+			screenshotRequested = false;
+			return;
 		}
+		ReadbackRegion region{};
+		const bool allocated = readbackBuffer->allocate(size, frameNumber, [this, imageWidth, imageHeight, bgra, frameNumber](const void* data, VkDeviceSize size) {
+			saveScreenshot("screenshot_" + std::to_string(frameNumber) + ".ppm", imageWidth, imageHeight, bgra, data, size);
+		}, region);
+		// The ring is full with earlier readbacks, the next frame tries again
+		if (!allocated) {
+			return;
+		}
+		screenshotRequested = false;
+		const VkBufferImageCopy copyRegion{
+			.bufferOffset = region.offset,
+			.imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1 },
+			.imageExtent = { imageWidth, imageHeight, 1 }
+		};
+		vkCmdCopyImageToBuffer(cb->handle, renderGraph->getImage(swapChainResource), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, region.buffer, 1, &copyRegion);
+		cb->addBufferBarrier(region.buffer, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+		cb->flushBarriers();
 	}
 
-#pragma endregion PBR
+	// Called once the copy has completed, the pixels are copied out of the ring so the job can convert and write them while the ring is reused
+	void saveScreenshot(const std::string& filename, uint32_t imageWidth, uint32_t imageHeight, bool bgra, const void* data, VkDeviceSize size)
+	{
+		if (screenshotJob) {
+			jobSystem->wait(screenshotJob);
+			delete screenshotJob;
+		}
+		std::vector<uint8_t> pixels(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+		screenshotJob = runStartupJob([filename, imageWidth, imageHeight, bgra, pixels = std::move(pixels)] {
+			// Binary PPM, which only stores RGB
+			std::vector<uint8_t> rgb(static_cast<size_t>(imageWidth) * imageHeight * 3);
+			for (size_t i = 0; i < static_cast<size_t>(imageWidth) * imageHeight; i++) {
+				rgb[i * 3 + 0] = pixels[i * 4 + (bgra ? 2 : 0)];
+				rgb[i * 3 + 1] = pixels[i * 4 + 1];
+				rgb[i * 3 + 2] = pixels[i * 4 + (bgra ? 0 : 2)];
+			}
+			std::ofstream file(filename, std::ios::binary);
+			file << "P6\n" << imageWidth << " " << imageHeight << "\n255\n";
+			file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+			std::cout << "Saved screenshot to " << filename << std::endl;
+		});
+	}
 
 	void recordCommandBuffer(FrameObjects& frame)
 	{
-		ZoneScopedN("Command buffer recording");
-
-		const bool multiSampling = (settings.sampleCount > VK_SAMPLE_COUNT_1_BIT);
+		TraceZoneScopedN("Command buffer recording");
 
 		CommandBuffer* cb = frame.commandBuffer;
 		cb->begin();
-
-		// New structures are used to define the attachments used in dynamic rendering
-		VkRenderingAttachmentInfo colorAttachment{};
-		VkRenderingAttachmentInfo depthStencilAttachment{};		
-
-		// Transition color and depth images for drawing
-		cb->insertImageMemoryBarrier(
-			swapChain->buffers[swapChain->currentImageIndex].image,
-			0,
-			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-		cb->insertImageMemoryBarrier(
-			depthStencil.image,
-			0,
-			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_STENCIL_READ_ONLY_OPTIMAL,
-			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-			VkImageSubresourceRange{ VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, 0, 1, 0, 1 });
-
-		// New structures are used to define the attachments used in dynamic rendering
-		colorAttachment = {};
-		colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
-		colorAttachment.imageView = multiSampling ? multisampleTarget.color.view : swapChain->buffers[swapChain->currentImageIndex].view;
-		colorAttachment.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL_KHR;
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colorAttachment.clearValue.color = { 0.0f, 0.0f, 0.0f, 0.0f };
-		if (multiSampling) {
-			colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
-			colorAttachment.resolveImageView = swapChain->buffers[swapChain->currentImageIndex].view;
-			colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		frameStats = {};
+		// The frame objects are no longer in flight, so the timings of their last frame can be read without waiting
+		// Queries aren't inherited by secondary command buffers, so pipeline statistics aren't available with parallel recording
+		const bool useSecondaryCommandBuffers = parallelRecording && (renderPath == static_cast<int32_t>(RenderPath::PerActor));
+		gpuProfiler->beginFrame(cb->handle, getCurrentFrameIndex(), !useSecondaryCommandBuffers);
+		if (memoryDefragmentation) {
+			cb->beginScope("Memory defragmentation");
+			memoryDefragmenter->update(cb->handle);
+			cb->endScope();
+		}
+		if (virtualTexture) {
+			cb->beginScope("Virtual texture");
+			virtualTexture->update(cb->handle, getCurrentFrameIndex());
+			// Cleared on the device, so the host only ever reads the feedback
+			vkCmdFillBuffer(cb->handle, frame.virtualTextureFeedbackBuffer->buffer, 0, VK_WHOLE_SIZE, UINT32_MAX);
+			// Also written by the visibility buffer's shading pass
+			cb->addBufferBarrier(frame.virtualTextureFeedbackBuffer->buffer, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+			cb->endScope();
 		}
 
-		// A single depth stencil attachment info can be used, but they can also be specified separately.
-		// When both are specified separately, the only requirement is that the image view is identical.			
-		depthStencilAttachment = {};
-		depthStencilAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
-		depthStencilAttachment.imageView = multiSampling ? multisampleTarget.depth.view : depthStencil.view;
-		depthStencilAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_STENCIL_READ_ONLY_OPTIMAL;
-		depthStencilAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthStencilAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depthStencilAttachment.clearValue.depthStencil = { 1.0f,  0 };
-		if (multiSampling) {
-			depthStencilAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
-			depthStencilAttachment.resolveImageView = depthStencil.view;
-			depthStencilAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+		// The scale is derived from the GPU time of the frame that just completed
+		// Debug views aren't resolved, as accumulating them over frames would blur their values
+		frame.temporalResolve = temporalAntiAliasing && temporalAntiAliasingSupported() && !debugViewEnabled();
+		// Thermal limits cap the scale dynamic resolution may pick, or scale the scene on their own
+		const float thermalScale = thermalQuality.getQuality().maxResolutionScale;
+		frame.scaledScene = dynamicResolution || (thermalScale < 1.0f) || frame.temporalResolve || settings.postProcessing;
+		frame.visibilityBuffer = visibilityBufferEnabled();
+		sceneExtent = { width, height };
+		if (dynamicResolution) {
+			dynamicResolutionController.maxScale = thermalScale;
+			dynamicResolutionController.update(gpuProfiler->getFrameTime());
+			sceneExtent = { dynamicResolutionController.getScaledSize(width), dynamicResolutionController.getScaledSize(height) };
+		} else if (thermalScale < 1.0f) {
+			sceneExtent = { std::max(static_cast<uint32_t>(width * thermalScale), 1u), std::max(static_cast<uint32_t>(height * thermalScale), 1u) };
 		}
 
-		VkRenderingInfo renderingInfo = {
-			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
-			.renderArea = { 0, 0, width, height },
-			.layerCount = 1,
-			.colorAttachmentCount = 1,
-			.pColorAttachments = &colorAttachment,
-			.pDepthAttachment = &depthStencilAttachment,
-			.pStencilAttachment = &depthStencilAttachment
-		};
+		if (!gpuSimulation || (renderPath != static_cast<int32_t>(RenderPath::GPUDriven))) {
+			gpuSimulationRunning = false;
+		}
 
-		cb->beginRendering(renderingInfo);
-		cb->setViewport(0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f);
-		cb->setScissor(0, 0, width, height);
+		recordingFrame = &frame;
+		updateDebugViewPipelines();
+		renderGraph->setImage(graphResources.depthPyramid, depthPyramid.image->handle);
+		renderGraph->setBuffer(graphResources.indirectCommands, frame.indirectCommandBuffer->buffer);
+		renderGraph->setBuffer(graphResources.drawCounts, frame.drawCountBuffer->buffer);
+		renderGraph->setBuffer(graphResources.instances, frame.frameAllocator->getBuffer());
+		renderGraph->setBuffer(graphResources.actorVisibility, actorVisibilityBuffer->buffer);
+		renderGraph->setBuffer(graphResources.bodies, frame.bodyBuffer->buffer);
+		renderGraph->setBuffer(graphResources.previousBodies, frameObjects[(getCurrentFrameIndex() + getFrameCount() - 1) % getFrameCount()].bodyBuffer->buffer);
+		renderGraph->setBuffer(graphResources.particles, particleBuffer->buffer);
+		renderGraph->setBuffer(graphResources.particleLists, particleListBuffer->buffer);
+		renderGraph->setBuffer(graphResources.particleCounters, particleCounterBuffer->buffer);
+		renderGraph->setBuffer(graphResources.clusterLights, frame.clusterLightBuffer->buffer);
+		renderGraph->setImage(graphResources.staticShadowMap, shadows.staticMap.image->handle);
+		renderGraph->setImage(graphResources.dynamicShadowMap, shadows.dynamicMap.image->handle);
+		if (visibilityBufferSupported()) {
+			renderGraph->setBuffer(graphResources.visibilityBins, visibility.bins->buffer);
+			renderGraph->setBuffer(graphResources.visibilityPixels, visibility.pixels->buffer);
+		}
+		if (frame.temporalResolve) {
+			if (!temporalHistory.image) {
+				createTemporalHistory();
+			}
+			temporalAA.layer ^= 1;
+			renderGraph->setImage(graphResources.temporalHistory, temporalHistory.image->handle);
+		} else {
+			temporalAA.historyValid = false;
+		}
+		CommandBuffer* computeCb = (asyncCompute && asyncComputePasses) ? frame.computeCommandBuffer : nullptr;
+		if (computeCb) {
+			computeCb->begin();
+		}
+		// Also transitions the swap chain image for presentation
+		frame.computeSync = renderGraph->execute(cb, computeCb);
+		if (computeCb) {
+			computeCb->end();
+			frameStats += computeCb->stats;
+		}
 
-		// Backdrop
-		PushConstBlock pushConstBlock{};
-		pushConstBlock.textureIndex = skyboxIndex;
-		cb->bindPipeline(pipelines["skybox"]);
-		cb->bindDescriptorSets(skyboxPipelineLayout, { frame.descriptorSet, descriptorSetTextures });
-		cb->updatePushConstant(skyboxPipelineLayout, 0, &pushConstBlock);
-		assetManager->models["crate"]->draw(cb->handle, glTFPipelineLayout->handle, glm::mat4(1.0f), true, true);
+		if (virtualTexture) {
+			cb->addBufferBarrier(frame.virtualTextureFeedbackBuffer->buffer, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+		}
 
-		// @todo
-		vkglTF::pushConstBlock.irradianceIndex = skybox.irradianceIndex;
-		vkglTF::pushConstBlock.radianceIndex = skybox.radianceIndex;
+		gpuProfiler->endFrame(cb->handle);
+		cb->end();
+		frameStats += cb->stats;
+	}
 
-		cb->bindDescriptorSets(glTFPipelineLayout, { frame.descriptorSet, descriptorSetTextures });
-		
-		//glm::vec3 currPos = { 0.0f, 8.0f, -30.0f }; //playerShip.localPosition;// +glm::vec3(0.0f, 0.0f, -playerShip.acceleration * 2.0f);
-		// glm::mat4 locMatrix = glm::translate(glm::mat4(1.0f), currPos);
-		// locMatrix = glm::scale(locMatrix, glm::vec3(0.5f));
-		// actorManager->actors["playership"]->position = camera.position * glm::vec3(-1.0f);
-		// cb->bindPipeline(pipelines["playership"]);
-		// ship->model->draw(cb->handle, glTFPipelineLayout->handle, locMatrix);
-		
-		cb->bindPipeline(pipelines["gltf"]);
-		
-		// @todo: instancing
-		vkglTF::Model* lastBoundModel{ nullptr };
-		visibleObjects = 0;
-		auto modelChanges = 0;
-		for (auto& it : actorManager->actors) {
-			auto actor = it.second;
-			if (frustum.checkSphere(actor->position, actor->getRadius() * 2.0f)) {
-				if (actor->model != lastBoundModel) {
-					lastBoundModel = actor->model;
-					actor->model->bindBuffers(cb->handle);
-					modelChanges++;
-				}
-				visibleObjects++;
-				glm::mat4 locMatrix = actor->getMatrix();
-				lastBoundModel->draw(cb->handle, glTFPipelineLayout->handle, locMatrix);
-			}
+	// Adds the descriptors of all asset manager slots that have been assigned a texture (e.g. by loading or texture streaming) since the frame's set has last been updated to the descriptor write batch
+	// The frame must not be in flight, as descriptors that are in use can't be updated
+	// Free slots are skipped, their stale descriptors are never accessed as no material refers to them
+	void updateTextureDescriptors(FrameObjects& frame) {
+		std::lock_guard<std::mutex> lock(assetManager->textureMutex);
+		if (frame.textureGeneration == assetManager->textureGeneration) {
+			return;
 		}
-
-		if (overlay->visible) {
-			overlay->draw(cb, getCurrentFrameIndex());
+		const uint32_t textureCount = static_cast<uint32_t>(assetManager->textures.size());
+		if (textureCount > maxTextureDescriptors) {
+			std::cerr << "Number of textures exceeds the bindless descriptor array size of " << maxTextureDescriptors << "\n";
+			return;
 		}
-		cb->endRendering();
+		frame.textureVersions.resize(textureCount, 0);
+		std::vector<VkDescriptorImageInfo> imageInfos{};
+		// Consecutive descriptors are written at once
+		auto flush = [this, &frame, &imageInfos](uint32_t end) {
+			if (!imageInfos.empty()) {
+				descriptorWrites.addImages(frame.descriptorSetTextures->handle, 0, end - static_cast<uint32_t>(imageInfos.size()), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfos.data(), static_cast<uint32_t>(imageInfos.size()));
+				imageInfos.clear();
+			}
+		};
+		for (uint32_t i = 0; i < textureCount; i++) {
+			const vks::Texture* texture = assetManager->textures[i];
+			if (!texture || (frame.textureVersions[i] == assetManager->textureVersions[i])) {
+				flush(i);
+				continue;
+			}
+			frame.textureVersions[i] = assetManager->textureVersions[i];
+			imageInfos.push_back({ .sampler = texture->sampler, .imageView = texture->view, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+		}
+		flush(textureCount);
+		frame.textureGeneration = assetManager->textureGeneration;
+	}
 
-		// Transition color image for presentation
-		cb->insertImageMemoryBarrier(
-			swapChain->buffers[swapChain->currentImageIndex].image,
-			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-			0,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+	// Scripted camera path for benchmark runs, orbits the asteroid rings starting at the default camera position
+	void updateBenchmarkCamera() {
+		const float angle = benchmark.getTime() * benchmarkOrbitSpeed;
+		const glm::vec3 position(std::sin(angle) * benchmarkOrbitRadius, -30.0f, std::cos(angle) * benchmarkOrbitRadius);
+		camera.rotation = glm::quat_cast(glm::mat3(glm::lookAt(position, glm::vec3(0.0f, position.y, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f))));
+		camera.setPosition(position);
+	}
 
-		cb->end();
+	// Requests the mip levels of streamed textures from the projected size of the closest actor using them
+	void requestTextureMips() {
+		TraceZoneScopedN("Request texture mips");
+		// Negative sizes mark models not used by any actor this frame
+		for (auto& [model, screenSize] : modelScreenSizes) {
+			screenSize = -1.0f;
+		}
+		const float tanHalfFov = std::tan(glm::radians(camera.getFov()) * 0.5f);
+		for (uint32_t i = 0; i < actorSnapshot.size(); i++) {
+			// Same projection as the LOD selection, scaled to pixels
+			const float distance = std::max(glm::distance(actorSnapshot.positions[i], camera.position), camera.getNearClip());
+			const float screenSize = actorSnapshot.radii[i] / (distance * tanHalfFov) * static_cast<float>(height);
+			float& modelScreenSize = modelScreenSizes[assetManager->getModel(actorSnapshot.models[i])];
+			modelScreenSize = std::max(modelScreenSize, screenSize);
+		}
+		// Models that are no longer used may have been deleted
+		std::erase_if(modelScreenSizes, [](const auto& entry) { return entry.second < 0.0f; });
+		for (auto& [model, screenSize] : modelScreenSizes) {
+			for (const vkglTF::Texture& texture : model->textures) {
+				textureStreamer->request(texture.assetIndex, screenSize);
+			}
+		}
 	}
 
 	void render() {
-		ZoneScoped;
+		TraceZoneScoped;
+
+		heapAllocations.store(0, std::memory_order_relaxed);
 
 		camera.viewportSize = glm::uvec2(width, height);
 
@@ -1016,77 +7244,498 @@ public:
 		camera.mouse.cursorPos = mousePos;
 		camera.mouse.cursorPosNDC = (mousePos / glm::vec2(float(width), float(height)));
 
-		FrameObjects currentFrame = frameObjects[getCurrentFrameIndex()];
+		if (benchmark.active) {
+			// The scripted time only starts once all models and the environment are resident, so every run renders the same frames
+			benchmark.ready = !assetManager->hasPendingLoads() && environmentReady;
+			updateBenchmarkCamera();
+		}
+
+		FrameObjects& currentFrame = frameObjects[getCurrentFrameIndex()];
 		VulkanApplication::prepareFrame(currentFrame);
+		if (readbackBuffer) {
+			readbackBuffer->update(getCompletedFrameNumber());
+		}
+		// The frame is no longer in flight, so the pages its fragments requested can be read
+		if (virtualTexture && (currentFrame.virtualTextureFeedbackSize > 0)) {
+			Buffer* feedbackBuffer = currentFrame.virtualTextureFeedbackBuffer;
+			if (vulkanDevice->memoryAllocator->isNonCoherent(feedbackBuffer->allocation)) {
+				feedbackBuffer->invalidate();
+			}
+			virtualTexture->addFeedback(static_cast<const uint32_t*>(feedbackBuffer->mapped), currentFrame.virtualTextureFeedbackSize);
+		}
+		// Like the frame's own pools, reset as a whole now that the frame is no longer in flight
+		for (CommandPool* threadCommandPool : currentFrame.threadCommandPools) {
+			threadCommandPool->reset();
+		}
+		// Before the frame allocates from its allocator, as growing recreates it
+		ensureInstanceCapacity();
 		updateOverlay(getCurrentFrameIndex());
 		//shaderData.time = time;
 		shaderData.timer = timer;
 
-		shaderData.projection = camera.matrices.perspective;
+		// With temporal anti-aliasing, the image is shifted by a subpixel offset of the size the previous frame rendered the scene at
+		camera.jitter = glm::vec2(0.0f);
+		if (temporalAntiAliasing && temporalAntiAliasingSupported()) {
+			const uint32_t sampleIndex = (temporalAA.sampleIndex++ % 8) + 1;
+			const glm::vec2 renderSize = glm::vec2(std::max(sceneExtent.width, 1u), std::max(sceneExtent.height, 1u));
+			camera.jitter = (glm::vec2(halton(sampleIndex, 2), halton(sampleIndex, 3)) - 0.5f) * 2.0f / renderSize;
+		}
+		shaderData.projection = camera.getJitteredPerspective();
+		renderOrigin = glm::vec3(glm::inverse(camera.matrices.view)[3]);
 		shaderData.view = camera.matrices.view;
-		memcpy(currentFrame.uniformBuffer->mapped, &shaderData, sizeof(ShaderData)); // @todo: buffer function
+		shaderData.view[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		// Render space moves with the camera, so the reprojection also includes the camera's translation since the previous frame
+		const glm::mat4 viewProjection = camera.matrices.perspective * shaderData.view;
+		temporalAA.reprojection = temporalAA.previousViewProjection * glm::translate(glm::mat4(1.0f), renderOrigin - temporalAA.previousRenderOrigin) * glm::inverse(viewProjection);
+		temporalAA.previousViewProjection = viewProjection;
+		temporalAA.previousRenderOrigin = renderOrigin;
+		shaderData.cameraPosition = glm::vec4(renderOrigin, 0.0f);
+		// Slice index = log(depth / near) / log(far / near) * slices, as scale and bias of log(depth)
+		const float clusterFar = camera.getFarClip();
+		const float sliceScale = static_cast<float>(clusterSlices) / std::log(clusterFar / clusterNear);
+		shaderData.clusterDepth = glm::vec4(clusterNear, clusterFar, sliceScale, -std::log(clusterNear) * sliceScale);
+		shaderData.clusterGrid = glm::uvec4(clusterTilesX, clusterTilesY, clusterSlices, 0);
+		updateShadowCascades();
+		shaderData.sunDirection = glm::vec4(shadows.valid ? shadows.lightDirection : getSunDirection(), 1.5f);
+		// The frame is no longer in flight, so all of its previous blocks can be reused
+		currentFrame.frameAllocator->reset();
+		currentFrame.frameArena->reset();
+		if (virtualTexture) {
+			const uint32_t feedbackWidth = (width + 7) / 8;
+			currentFrame.virtualTextureFeedbackSize = (virtualTextureSource != UINT32_MAX) ? std::min(feedbackWidth * ((height + 7) / 8), maxVirtualTextureFeedback) : 0;
+			shaderData.virtualTexture = virtualTexture->getShaderData(virtualTextureSource, currentFrame.virtualTextureFeedbackSize, feedbackWidth);
+		}
+		currentFrame.uniformAllocation = currentFrame.frameAllocator->pushUniform(shaderData);
+		currentFrame.instanceAllocation = currentFrame.frameAllocator->allocateStorage(sizeof(InstanceData) * instanceCapacity);
+		currentFrame.jointAllocation = currentFrame.frameAllocator->allocateStorage(sizeof(glm::mat4) * maxJointMatrices);
+		currentFrame.lightAllocation = currentFrame.frameAllocator->allocateStorage(sizeof(ClusterLight) * maxLights);
+		// Dynamic offsets in binding order
+		currentFrame.descriptorSet->dynamicOffsets = { static_cast<uint32_t>(currentFrame.uniformAllocation.offset), static_cast<uint32_t>(currentFrame.instanceAllocation.offset), static_cast<uint32_t>(currentFrame.jointAllocation.offset), static_cast<uint32_t>(currentFrame.lightAllocation.offset) };
+		currentFrame.cullDescriptorSet->dynamicOffsets = { static_cast<uint32_t>(currentFrame.instanceAllocation.offset), static_cast<uint32_t>(currentFrame.uniformAllocation.offset) };
 
 		frustum.update(camera.matrices.perspective * camera.matrices.view);
-
-		for (auto& it : actorManager->actors) {
-			it.second->update(frameTimer);
+		renderFrustum.update(shaderData.projection * shaderData.view);
+		updateRenderViews(currentFrame);
+
+		// Phases are timed for the frame breakdown, so the overlay and benchmarks can tell which of them the CPU time goes to
+		auto phaseTime = [](std::chrono::high_resolution_clock::time_point& tStart) {
+			const auto tEnd = std::chrono::high_resolution_clock::now();
+			const float time = std::chrono::duration<float, std::milli>(tEnd - tStart).count();
+			tStart = tEnd;
+			return time;
+		};
+		auto tPhase = std::chrono::high_resolution_clock::now();
+		// Background jobs are only run by workers, so the simulation can't be pipelined without them
+		const bool pipelined = pipelinedSimulation && (jobSystem->getThreadCount() > 1);
+		if (!pipelined) {
+			stepSimulation(frameTimer);
+		} else {
+			// Actors may have been changed since the last step (e.g. spawned bullets)
+			jobSystem->parallelFor(actorManager->size(), 1024, [](uint32_t first, uint32_t count) {
+				actorManager->updateTransforms(first, count);
+			});
+		}
+		actorManager->updateAnimations(frameTimer, *jobSystem);
+		// Everything the frame reads from the actors is gathered up front, so the next step can run while the frame is recorded
+		actorManager->captureSnapshot(actorSnapshot);
+		checkInstanceCapacity();
+		frameBreakdown.simulation += phaseTime(tPhase);
+		updateLights(currentFrame, frameTimer);
+		shaderData.clusterGrid.w = lightCount;
+		phaseTime(tPhase);
+		cullActors();
+		if ((renderPath == static_cast<int32_t>(RenderPath::PerActor)) || (sortActors && (renderPath != static_cast<int32_t>(RenderPath::GPUDriven)))) {
+			sortVisibleActors();
 		}
+		selectImpostors();
+		frameBreakdown.culling += phaseTime(tPhase);
+		prepareSimulationBodies();
+		updateShadowCasters(currentFrame);
+		if (pipelined) {
+			auto step = [this, deltaTime = frameTimer] { stepSimulation(deltaTime); };
+			if (!simulationJob) {
+				simulationJob = jobSystem->createBackgroundJob(step);
+			} else {
+				jobSystem->resetBackgroundJob(simulationJob, step);
+			}
+			jobSystem->runBackground(simulationJob, true);
+		}
+		requestTextureMips();
 
+		phaseTime(tPhase);
+		updateTextureDescriptors(currentFrame);
+		updateDepthPyramidDescriptor(currentFrame);
+		descriptorWrites.flush();
+		bakeImpostors(currentFrame);
 		recordCommandBuffer(currentFrame);
+		frameBreakdown.recording += phaseTime(tPhase);
 		VulkanApplication::submitFrame(currentFrame);
+		if (!firstFrameSubmitted) {
+			startupProfiler.addMarker("First frame submitted");
+			firstFrameSubmitted = true;
+		}
+		// Everything below may change the actors
+		phaseTime(tPhase);
+		waitForSimulation();
+		frameBreakdown.simulation += phaseTime(tPhase);
+		{
+			TraceZoneScopedN("Asteroid field streaming");
+			// Sectors generated on the workers while the camera moves would differ between benchmark runs, so benchmarks wait for them
+			// Rocks of sectors loaded while the GPU simulation runs stay in place until it restarts, as its bodies are only uploaded when it starts
+			asteroidField->update(renderOrigin, benchmark.active);
+		}
+		updateSnapshot();
+		updateHoveredActor();
+		audioManager->setListener(camera.position, camera.getForward(), camera.getUp());
+		for (const glm::vec3& impact : bulletImpacts) {
+			emitExplosion(impact);
+			audioManager->PlaySnd(impactSound, impact, 1);
+		}
 
-		for (auto& pipeline : pipelineList) {
+		// Pipelines are rebuilt in the background and swapped in at the frame boundary once ready
+		auto updatePipelineReload = [this](Pipeline* pipeline) {
 			if (pipeline->wantsReload) {
 				pipeline->reload();
+				frameTimeRecorder.addEvent("Pipeline reload");
+			}
+			VkPipeline retiredPipeline = pipeline->applyReload();
+			if (retiredPipeline != VK_NULL_HANDLE) {
+				frameTimeRecorder.addEvent("Pipeline swap");
+				// The changed shaders may include other files now
+				if (pipeline->initialCreateInfo) {
+					fileWatcher->addPipeline(pipeline);
+				}
+				deferDeletion([device = vulkanDevice->logicalDevice, retiredPipeline] {
+					vkDestroyPipeline(device, retiredPipeline, nullptr);
+				});
 			}
+		};
+		for (auto& pipeline : pipelineList) {
+			updatePipelineReload(pipeline);
 		}
+		pipelineVariants->forEach(updatePipelineReload);
 
-		// @todo: work in progress
-		for (auto& it : assetManager->models) {
-			if (it.second->wantsReload) {
-				vkglTF::Model* newModel = new vkglTF::Model(*it.second->initialCreateInfo);
-				// @todo: check if this works
-				delete it.second;
-				it.second = newModel;
+		// Reloaded models are loaded in the background with the current model acting as the placeholder
+		for (uint32_t slot = 0; slot < assetManager->getModelSlotCount(); slot++) {
+			const ModelHandle handle = assetManager->getModelHandle(slot);
+			if (!handle.isSet()) {
+				continue;
+			}
+			vkglTF::Model* model = assetManager->getModel(handle);
+			if (model->wantsReload && !assetManager->isLoading(handle)) {
+				model->wantsReload = false;
+				assetManager->reloadAsync(handle, *model->initialCreateInfo);
+				frameTimeRecorder.addEvent("Model reload " + assetManager->getModelName(handle));
+			}
+		}
+		assetManager->update();
+		textureStreamer->update();
+		taskScheduler->update();
+		// Startup is over once everything the first frames would have waited for is resident
+		if (environmentReady && !assetManager->hasPendingLoads() && !audioManager->hasPendingLoads() && !startupProfiler.isFinished()) {
+			startupProfiler.finish();
+			startupProfiler.printSummary();
+			if (benchmark.active) {
+				startupProfiler.saveResults(benchmark.outputFile + "_startup.json", vulkanDevice->properties.deviceName);
 			}
 		}
+		// Prefetched files that weren't opened through the virtual file system are dropped once everything needed at startup is resident
+		if (prefetchJob && environmentReady && !assetManager->hasPendingLoads() && jobSystem->isFinished(prefetchJob)) {
+			delete prefetchJob;
+			prefetchJob = nullptr;
+			vks::vfs::releasePrefetched();
+		}
 
 		// @todo
-		if (sf::Mouse::isButtonPressed(sf::Mouse::Left) && firingTimer <= 0.0f) {
-			// @todo: test
-			actorManager->addActor("bullet" + std::to_string(actorManager->actors.size() + 1), new Actor({
-				.position = glm::vec3(camera.position),
-				.rotation = glm::vec3(0.0f),
-				.scale = glm::vec3(0.5f),
-				.model = assetManager->models["bullet"],
-				.tag = "bullet",
-				// @todo: velocity from player ship
-				.constantVelocity = glm::vec3(camera.getForward()) * 100.0f
-				}));
-			audioManager->PlaySnd("laser");
+		if (input.mouseLeft && firingTimer <= 0.0f) {
+			// The spatial grid may still allocate for cells it hasn't seen yet
+			frameTimeRecorder.addEvent("Actor spawn");
+			// @todo: velocity from player ship
+			bulletPool->spawn(glm::vec3(camera.position), glm::vec3(0.0f), glm::vec3(camera.getForward()) * 100.0f);
+			// Muzzle sparks
+			emitParticles({
+				.position = glm::vec3(camera.position) + glm::vec3(camera.getForward()) * 2.0f,
+				.count = 64,
+				.velocity = glm::vec3(camera.getForward()) * 20.0f,
+				.speed = 8.0f,
+				.color = glm::vec4(0.4f, 0.7f, 1.0f, 1.0f),
+				.lifetime = 0.3f,
+				.size = 0.1f
+			});
+			addTransientLight(glm::vec3(camera.position) + glm::vec3(camera.getForward()) * 2.0f, glm::vec3(1.0f, 2.0f, 4.0f), 25.0f, 0.15f);
+			audioManager->PlaySnd(laserSound);
 			firingTimer = 1.0f;
 		}
 		firingTimer -= frameTimer;
 
+		frameHeapAllocations = heapAllocations.load(std::memory_order_relaxed);
+		TracyPlot("Heap allocations", static_cast<int64_t>(frameHeapAllocations));
+		updateMemoryStats();
+		updateThreadStats();
+		traceRecorder.addCounter("Heap allocations", static_cast<double>(frameHeapAllocations));
+		// Frames that noted events (e.g. reloads, resizes or spawned actors) or upload assets are expected to allocate
+		const bool steadyState = (frameTimeRecorder.getCount() >= frameTimeRecorder.minFrames) && !frameTimeRecorder.hasEvents() && !assetManager->hasPendingLoads();
+		if (steadyState && (frameHeapAllocations > 0) && !steadyStateAllocationReported) {
+			const std::string message = "Steady state frame made " + std::to_string(frameHeapAllocations) + " heap allocations";
+			std::cerr << message << "\n";
+			TracyMessage(message.c_str(), message.size());
+			steadyStateAllocationReported = true;
+		}
 		//time += frameTimer;
 	}
 
 	void OnUpdateOverlay(vks::UIOverlay& overlay) {
 		overlay.text("visible objects: %d", visibleObjects);
+		overlay.text("impostors: %d", impostorCount);
+		if (useParticles) {
+			overlay.text("particles: %d", particleCount);
+		}
+		overlay.text("lights: %d", lightCount);
+		overlay.text("asteroid sectors: %d (%d pending)", asteroidField->getLoadedCount(), asteroidField->getPendingCount());
+		if (actorManager->isValid(hoveredActor)) {
+			const uint32_t index = actorManager->getIndex(hoveredActor);
+			overlay.text("cursor: %s #%u at %.1f", actorManager->getTagName(actorManager->tags[index]).c_str(), index, hoveredActorDistance);
+		}
+		if (renderPath != static_cast<int32_t>(RenderPath::PerActor)) {
+			overlay.text("instanced batches: %d", instanceBatchCount);
+		}
+		if (overlay.header("Render stats")) {
+			// Draws issued by the GPU (indirect and mesh shading) don't report their instances and triangles here
+			overlay.text("Draw calls: %d (%d instances)", frameStats.drawCalls, frameStats.instances);
+			overlay.text("Triangles: %llu", static_cast<unsigned long long>(frameStats.triangles));
+			overlay.text("Dispatches: %d", frameStats.dispatches);
+			overlay.text("Redundant binds skipped: %d", frameStats.skippedBinds);
+			overlay.text("Heap allocations: %llu", static_cast<unsigned long long>(frameHeapAllocations));
+			overlay.text("Pipeline binds: %d", frameStats.pipelineBinds);
+			overlay.text("Descriptor set binds: %d", frameStats.descriptorSetBinds);
+			overlay.text("Push constant updates: %d", frameStats.pushConstantUpdates);
+			overlay.text("Model changes: %d", frameStats.bufferBinds);
+			if (renderPath == static_cast<int32_t>(RenderPath::GPUDriven)) {
+				overlay.text("Actor transform upload: %.1f KB (%u ranges)", actorTransformBuffer->getUploadedBytes() / 1024.0f, actorTransformBuffer->getUploadedRanges());
+			}
+			if (gpuProfiler->hasPipelineStatistics()) {
+				const PipelineStatistics& statistics = gpuProfiler->getPipelineStatistics();
+				overlay.text("Vertex invocations: %llu", static_cast<unsigned long long>(statistics.vertexShaderInvocations));
+				overlay.text("Primitives: %llu (%llu after clipping)", static_cast<unsigned long long>(statistics.inputAssemblyPrimitives), static_cast<unsigned long long>(statistics.clippingPrimitives));
+				overlay.text("Fragment invocations: %llu", static_cast<unsigned long long>(statistics.fragmentShaderInvocations));
+				overlay.text("Compute invocations: %llu", static_cast<unsigned long long>(statistics.computeShaderInvocations));
+			}
+		}
+		if (overlay.header("Threads")) {
+			// Time neither busy nor asleep is spent looking for jobs, or for the main thread on work outside of the job system (e.g. recording the frame)
+			for (uint32_t i = 0; i < static_cast<uint32_t>(threadFrameStats.size()); i++) {
+				const ThreadFrameStats& stats = threadFrameStats[i];
+				overlay.text("%s %u: %.0f%% busy, %.0f%% asleep, %u jobs (%u stolen)", (i == 0) ? "Main" : "Worker", i, stats.busy * 100.0f, stats.asleep * 100.0f, stats.executedJobs, stats.stolenJobs);
+			}
+			for (const vks::LockStats& stats : lockStats) {
+				if (stats.locks > 0) {
+					overlay.text("%s: %u locks, %u contended, %.3f ms waiting", stats.name, stats.locks, stats.contendedLocks, std::chrono::duration<float, std::milli>(stats.waitTime).count());
+				}
+			}
+		}
+		if (overlay.header("Memory")) {
+			const float megabyte = 1024.0f * 1024.0f;
+			for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); i++) {
+				const MemoryCategory category = static_cast<MemoryCategory>(i);
+				overlay.text("%s: %.1f MB host, %.1f MB device", MemoryStats::getCategoryName(category), memoryStats.getHostBytes(category) / megabyte, memoryStats.getDeviceBytes(category) / megabyte);
+			}
+			for (uint32_t i = 0; i < memoryBudget.heapCount; i++) {
+				const MemoryHeapBudget& heap = memoryBudget.heaps[i];
+				overlay.text("Heap %u%s: %.0f / %.0f MB", i, heap.deviceLocal ? " (device local)" : "", heap.usage / megabyte, heap.budget / megabyte);
+			}
+			if (!vulkanDevice->hasMemoryBudget) {
+				overlay.text("No VK_EXT_memory_budget, heap usage is this application's only");
+			}
+			overlay.text("Memory pressure: %.0f%%, reclaimed %u times", 100.0f * memoryBudgetManager.getPressure(), memoryBudgetManager.getReclaimCount());
+			overlay.text("Evicted models: %u", assetManager->getEvictedModelCount());
+			for (const std::string& reclaimer : memoryBudgetManager.getActiveReclaimers()) {
+				overlay.text("Reduced: %s", reclaimer.c_str());
+			}
+			VkDeviceSize blockBytes{ 0 };
+			VkDeviceSize usedBytes{ 0 };
+			vulkanDevice->memoryAllocator->getBlockUsage(blockBytes, usedBytes);
+			overlay.text("Blocks: %.1f MB used of %.1f MB", usedBytes / megabyte, blockBytes / megabyte);
+			overlay.checkBox("Defragment memory", &memoryDefragmentation);
+			overlay.text("Defragmented: %.1f MB moved, %u blocks released%s", memoryDefragmenter->getMovedBytes() / megabyte, vulkanDevice->memoryAllocator->getEvacuatedBlockCount(), memoryDefragmenter->isActive() ? " (active)" : "");
+			if (vulkanDevice->memoryAllocator->getFallbackCount() > 0) {
+				overlay.text("Allocations moved to other heaps: %u", vulkanDevice->memoryAllocator->getFallbackCount());
+			}
+		}
+		const std::array<const char*, 4> renderPaths{ "Per actor", "Instanced", "GPU driven", "Mesh shaders" };
+		overlay.comboBox("Render path", &renderPath, std::span(renderPaths).first(vulkanDevice->hasMeshShaders ? 4 : 3));
+		const std::array<const char*, 4> debugViews{ "None", "Overdraw", "Quad utilization", "Primitives" };
+		if (overlay.comboBox("Debug view", &debugView, std::span(debugViews).first(Device::enabledFeatures.geometryShader ? 4 : 3))) {
+			debugViewPipelines.clear();
+		}
+		switch (static_cast<DebugView>(debugView)) {
+		case DebugView::Overdraw:
+			overlay.text("Shaded fragments per pixel: red 1-4, yellow 16, white 64+");
+			if (depthPrepassEnabled()) {
+				overlay.text("The depth pre-pass limits this to 1");
+			}
+			break;
+		case DebugView::QuadUtilization:
+			overlay.text("Covered lanes per 2x2 quad: red 1, orange 2, yellow 3, green 4");
+			break;
+		case DebugView::Primitives:
+			overlay.text((renderPath == static_cast<int32_t>(RenderPath::MeshShaders)) ? "One color per meshlet" : "One color per triangle, noise = dense meshes");
+			break;
+		default:
+			break;
+		}
+		if (renderPath == static_cast<int32_t>(RenderPath::PerActor)) {
+			overlay.checkBox("Parallel recording", &parallelRecording);
+		}
+		if (actorSnapshot.size() > instanceCapacity) {
+			overlay.text("Actors beyond instance capacity: %d", actorSnapshot.size() - instanceCapacity);
+		}
+		overlay.checkBox("Pipelined simulation", &pipelinedSimulation);
+		overlay.checkBox("Temporal culling", &temporalCulling);
+		if (temporalCulling) {
+			overlay.text("Culling tests: %d of %d actors", visibilityCache.getTestedCount(), actorManager->size());
+		}
+		if (renderPath == static_cast<int32_t>(RenderPath::GPUDriven)) {
+			if (!settings.tileBasedRendering && !dynamicResolution && !temporalAntiAliasing) {
+				overlay.checkBox("Occlusion culling", &occlusionCulling);
+			}
+			overlay.checkBox("GPU simulation", &gpuSimulation);
+			// Bodies of the previous frame are only synchronized with the queue that wrote them, so the simulation restarts when switching queues
+			if (asyncCompute && overlay.checkBox("Async compute", &asyncComputePasses)) {
+				gpuSimulationRunning = false;
+				rayQueryShadows.rebuild = true;
+			}
+		}
+		overlay.checkBox("Mesh LODs", &useLods);
+		overlay.checkBox("Particles", &useParticles);
+		overlay.sliderInt("Test lights", &testLightCount, 0, static_cast<int32_t>(maxLights));
+		if (renderPath == static_cast<int32_t>(RenderPath::GPUDriven)) {
+			overlay.checkBox("Shadows", &useShadows);
+			if (useShadows) {
+				if (vulkanDevice->hasRayQuery) {
+					overlay.checkBox("Ray traced shadows", &rayQueryShadows.enabled);
+				}
+				overlay.sliderFloat("Sun angle", &sunAngle, -180.0f, 180.0f);
+				if (shadowsEnabled()) {
+					overlay.text("static shadow updates: %d", shadows.staticUpdates);
+				}
+			}
+		}
+		if ((renderPath == static_cast<int32_t>(RenderPath::PerActor)) || (renderPath == static_cast<int32_t>(RenderPath::Instanced))) {
+			overlay.checkBox("Impostors", &useImpostors);
+		}
+		if (renderPath != static_cast<int32_t>(RenderPath::PerActor)) {
+			overlay.checkBox("Procedural variation", &proceduralVariation);
+			if (proceduralVariation) {
+				overlay.sliderFloat("Variation", &variationScale, 0.0f, 1.0f);
+			}
+		}
+		if (renderPath != static_cast<int32_t>(RenderPath::MeshShaders)) {
+			overlay.checkBox("Depth pre-pass", &depthPrepass);
+		}
+		if (renderPath != static_cast<int32_t>(RenderPath::GPUDriven)) {
+			overlay.checkBox("Front to back sorting", &sortActors);
+		}
+		if (scenePipelines.gltfPulled && (renderPath != static_cast<int32_t>(RenderPath::PerActor))) {
+			overlay.checkBox("Vertex pulling", &vertexPulling);
+		}
+		if (visibilityBufferSupported() && (renderPath == static_cast<int32_t>(RenderPath::GPUDriven))) {
+			overlay.checkBox("Visibility buffer", &visibilityBuffer);
+		}
+		if (vulkanDevice->hasDynamicPolygonMode && (renderPath != static_cast<int32_t>(RenderPath::MeshShaders))) {
+			overlay.checkBox("Wireframe", &wireframe);
+		}
+		if (vulkanDevice->hasFragmentShadingRate) {
+			overlay.checkBox("Variable rate shading", &variableRateShading);
+		}
+		overlay.checkBox("Fullscreen skybox", &fullscreenSkybox);
+		for (RenderView& view : renderViews) {
+			overlay.checkBox(view.name, &view.enabled);
+		}
+		overlay.checkBox("Frame rate limit", &settings.limitFrameRate);
+		if (settings.limitFrameRate) {
+			// Zero matches the display
+			overlay.sliderFloat("Target FPS", &settings.targetFrameRate, 0.0f, 240.0f);
+		}
+		if (gpuProfiler->isSupported() && overlay.checkBox("Dynamic resolution", &dynamicResolution)) {
+			dynamicResolutionController.reset();
+		}
+		if (dynamicResolution) {
+			overlay.sliderFloat("Target GPU time (ms)", &dynamicResolutionController.targetFrameTime, 4.0f, 33.3f);
+			overlay.text("Render scale: %.0f%%", dynamicResolutionController.getScale() * 100.0f);
+		}
+		if (thermalQuality.getLevel() > 0) {
+			overlay.text("Thermal quality level: %u", thermalQuality.getLevel());
+		}
+		if (temporalAntiAliasingSupported()) {
+			overlay.checkBox("Temporal anti-aliasing", &temporalAntiAliasing);
+		}
+		if (temporalAntiAliasing && temporalAntiAliasingSupported()) {
+			overlay.sliderFloat("History weight", &temporalHistoryWeight, 0.5f, 0.98f);
+		}
+		if (dynamicResolution || (temporalAntiAliasing && temporalAntiAliasingSupported())) {
+			overlay.sliderFloat("Sharpness", &upscaleSharpness, 0.0f, 1.0f);
+		}
+		if (settings.postProcessing) {
+			overlay.sliderFloat("Exposure", &exposure, 0.1f, 4.0f);
+			overlay.checkBox("Bloom", &bloom);
+			if (bloom) {
+				overlay.sliderFloat("Bloom strength", &bloomStrength, 0.0f, 0.25f);
+			}
+		}
+		if (benchmark.active) {
+			overlay.text(benchmark.isWarmingUp() ? "Benchmark: warming up" : "Benchmark: %.0f%%", 100.0f * benchmark.getProgress());
+		}
+		if (textureStreamer->getTextureCount() > 0) {
+			overlay.text("Streamed textures: %.1f / %.0f MB", static_cast<float>(textureStreamer->getResidentMemory()) / (1024.0f * 1024.0f), static_cast<float>(textureStreamer->getBudget()) / (1024.0f * 1024.0f));
+			if (overlay.sliderInt("Texture budget (MB)", &textureBudgetMB, 16, 2048)) {
+				textureStreamer->setBudget(static_cast<VkDeviceSize>(textureBudgetMB) * 1024 * 1024);
+			}
+		}
+		if (virtualTexture) {
+			overlay.text("Virtual texture: %u / %u pages, %u loading, %.1f MB", virtualTexture->getResidentPageCount(), virtualTexture->getCachePageCount(), virtualTexture->getPendingLoads(), static_cast<float>(virtualTexture->getDeviceMemory()) / (1024.0f * 1024.0f));
+		}
+		if (overlay.header("Frame breakdown")) {
+			// Waits point at the other side: Fence waits mean the GPU is behind, acquire and pacing waits mean presentation (vsync or the limiter) paces frames
+			const FrameBreakdown& breakdown = lastFrameBreakdown;
+			overlay.text("Bound by: %s (CPU %.2f ms, GPU %.2f ms, frame %.2f ms)", getFrameBoundName(frameBoundClassifier.getBound()), frameBoundClassifier.getCpuTime(), frameBoundClassifier.getGpuTime(), frameBoundClassifier.getFrameTime());
+			overlay.text("Waits: fence %.2f ms, acquire %.2f ms, pacing %.2f ms", breakdown.fenceWait, breakdown.acquireWait, breakdown.pacingWait);
+			overlay.text("Simulation: %.2f ms, culling: %.2f ms", breakdown.simulation, breakdown.culling);
+			overlay.text("Recording: %.2f ms, submit: %.2f ms, present: %.2f ms", breakdown.recording, breakdown.submit, breakdown.present);
+		}
+		if (gpuProfiler->isSupported() && overlay.header("GPU timings")) {
+			// The GPU being busier than the CPU (including recording) means rendering is GPU bound
+			overlay.text("CPU: %.2f ms, GPU: %.2f ms", cpuFrameTime, gpuProfiler->getFrameTime());
+			for (const GpuProfilerResult& result : gpuProfiler->getResults()) {
+				overlay.text("%*s%s: %.2f ms", static_cast<int>(result.depth * 2), "", result.name.c_str(), result.time);
+			}
+		}
 		overlay.text("Angular velocity: %.6f, %.6f", camera.angularVelocity.x, camera.angularVelocity.y);
 		//overlay.text("Cursor NDC: %.2f, %.2f", camera.mouse.cursorPosNDC.x, camera.mouse.cursorPosNDC.y);
 	}
 
 	void onFileChanged(const std::string filename, const std::vector<void*> owners) {
 		std::cout << filename << " was modified\n";
+		if (pipelineLibrary) {
+			pipelineLibrary->invalidate(filename);
+			// Parts compiled from shaders including the changed file
+			for (const std::string& shader : dxcCompiler->getDependentShaders(filename)) {
+				pipelineLibrary->invalidate(shader);
+			}
+		}
 		for (auto& owner : owners) {
-			if (std::find(pipelineList.begin(), pipelineList.end(), owner) != pipelineList.end()) {
+			if ((std::find(pipelineList.begin(), pipelineList.end(), owner) != pipelineList.end()) || pipelineVariants->contains(static_cast<Pipeline*>(owner))) {
 				static_cast<Pipeline*>(owner)->wantsReload = true;
 			}
-			for (auto& it : assetManager->models) {
-				if (it.second == owner) {
-					static_cast<vkglTF::Model*>(owner)->wantsReload = true;
-				}
+		}
+		// Models are replaced on reload and asynchronous loading, so they're matched by filename instead of the owner registered with the file watcher
+		for (uint32_t slot = 0; slot < assetManager->getModelSlotCount(); slot++) {
+			const ModelHandle handle = assetManager->getModelHandle(slot);
+			if (!handle.isSet()) {
+				continue;
+			}
+			vkglTF::Model* model = assetManager->getModel(handle);
+			if (model->initialCreateInfo && model->initialCreateInfo->filename == filename) {
+				model->wantsReload = true;
 			}
 		}
 	}
@@ -1102,6 +7751,16 @@ public:
 		if (key == sf::Keyboard::L) {
 			camera.mouse.cursorLock = !camera.mouse.cursorLock;
 		}
+		if (key == sf::Keyboard::F12) {
+			if (screenshotsSupported()) {
+				if (!readbackBuffer) {
+					readbackBuffer = new ReadbackBuffer({});
+				}
+				screenshotRequested = true;
+			} else {
+				std::cout << "Screenshots aren't supported for the swap chain's format and usage" << std::endl;
+			}
+		}
 	}
 
 };